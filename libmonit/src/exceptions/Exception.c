@@ -32,7 +32,6 @@
 #include <string.h>
 
 #include "Str.h"
-#include "Thread.h"
 #include "system/System.h"
 #include "Exception.h"
 
@@ -56,8 +55,8 @@
 
 
 #define T Exception_T
-/* Thread specific Exception stack */
-ThreadData_T Exception_Stack;
+/* Thread local Exception stack */
+__thread Exception_Frame *Exception_Stack;
 /* System exceptions */
 T IOException = {"IOException"};
 T AssertException = {"AssertException"};
@@ -65,25 +64,18 @@ T MemoryException = {"MemoryException"};
 T NumberFormatException = {"NumberFormatException"};
 T ProtocolException = {"ProtocolException"};
 
-static pthread_once_t once_control = PTHREAD_ONCE_INIT;
-
-
-/* --------------------------------------------------------------- Private */
-
-
-static void init_once(void) { ThreadData_create(Exception_Stack); }
-
-
 /* ---------------------------------------------------------------- Public */
 
 
-void Exception_init() { pthread_once(&once_control, init_once); }
+void Exception_init() {
+        /* The Exception stack is a thread-local variable and needs no setup; kept for API compatibility */
+}
 
 
 void Exception_throw(const T *e, const char *func, const char *file, int line, const char *cause, ...) {
 	assert(e);
         va_list ap;
-	Exception_Frame *p = ThreadData_get(Exception_Stack);
+	Exception_Frame *p = Exception_Stack;
 	if (p) {
                 p->exception = e;
                 p->func = func;
@@ -95,7 +87,7 @@ void Exception_throw(const T *e, const char *func, const char *file, int line, c
                         va_end(ap);
                 }
                 pop_exception_stack;	
-                longjmp(p->env, Exception_thrown);
+                siglongjmp(p->env, Exception_thrown);
         } else if (cause) {
                 char message[EXCEPTION_MESSAGE_LENGTH + 1] = "?";
                 va_start(ap, cause);
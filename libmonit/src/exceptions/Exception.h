@@ -144,8 +144,11 @@
  * END_TRY;
  * </pre>
  * 
- * <p>The Exception stack is stored in a thread-specific variable so Exceptions
- * are made thread-safe. <i>This means that Exceptions are thread local and an
+ * <p>The Exception stack is stored in a thread-local variable so Exceptions
+ * are made thread-safe. Entering a TRY block costs a store to this variable
+ * and a <code>sigsetjmp</code> which does not save the signal mask, i.e. no
+ * system call or thread-specific data lookup is performed on the non-throwing
+ * path. <i>This means that Exceptions are thread local and an
  * Exception thrown in one thread cannot be caught in another thread</i>.
  * This also means that clients must handle Exceptions per thread and cannot 
  * use one TRY-ELSE block in the main program to catch all Exceptions. This is
@@ -174,7 +177,6 @@
 
 #define T Exception_T
 /** @cond hide */
-#include <pthread.h>
 typedef struct T {
         const char *name;
 } T;
@@ -182,7 +184,7 @@ typedef struct T {
 typedef struct Exception_Frame Exception_Frame;
 struct Exception_Frame {
 	int line;
-	jmp_buf env;
+	sigjmp_buf env;
         const char *func;
 	const char *file;
 	const T *exception;
@@ -195,10 +197,10 @@ enum {
         Exception_handled,
         Exception_finalized
 };
-extern pthread_key_t Exception_Stack;
+extern __thread Exception_Frame *Exception_Stack;
 void Exception_init(void);
 void Exception_throw(const T *e, const char *func, const char *file, int line, const char *cause, ...) CLANG_ANALYZER_NORETURN;
-#define pop_exception_stack pthread_setspecific(Exception_Stack, ((Exception_Frame*)pthread_getspecific(Exception_Stack))->prev)
+#define pop_exception_stack (Exception_Stack = Exception_Stack->prev)
 /** @endcond */
 
 
@@ -238,9 +240,9 @@ void Exception_throw(const T *e, const char *func, const char *file, int line, c
 	volatile int Exception_flag; \
         Exception_Frame Exception_frame; \
         Exception_frame.message[0] = 0; \
-        Exception_frame.prev = pthread_getspecific(Exception_Stack); \
-        pthread_setspecific(Exception_Stack, &Exception_frame); \
-        Exception_flag = setjmp(Exception_frame.env); \
+        Exception_frame.prev = Exception_Stack; \
+        Exception_Stack = &Exception_frame; \
+        Exception_flag = sigsetjmp(Exception_frame.env, 0); \
         if (Exception_flag == Exception_entered) {
 
 
@@ -37,6 +37,7 @@
 #endif
 
 #include "system/Net.h"
+#include "Convert.h"
 #include "OutputStream.h"
 
 
@@ -199,53 +200,23 @@ static void cvt_s(T S, __attribute__ ((unused)) int code, va_list_box *box, unsi
 
 
 static void cvt_d(T S, __attribute__ ((unused)) int code, va_list_box *box, unsigned char flags[], int width, int precision) {
-        int val = va_arg(box->ap, int);
-        unsigned int m;
-        char buf[43];
-        char *p = buf + sizeof buf;
-        if (val == INT_MIN)
-                m = INT_MAX + 1UL;
-        else if (val < 0)
-                m = -val;
-        else
-                m = val;
-        do
-                *--p = m%10 + '0';
-        while ((m /= 10) > 0);
-        if (val < 0)
-                *--p = '-';
-        putd(S, p, (int)((buf + sizeof buf) - p), flags, width, precision);
+        char buf[21];
+        int len = Convert_int2str(va_arg(box->ap, int), buf);
+        putd(S, buf, len, flags, width, precision);
 }
 
 
 static void cvt_l(T S, __attribute__ ((unused)) int code, va_list_box *box, unsigned char flags[], int width, int precision) {
-        long val = va_arg(box->ap, long);
-        unsigned long m;
-        char buf[43];
-        char *p = buf + sizeof buf;
-        if (val == LONG_MIN)
-                m = LONG_MAX + 1UL;
-        else if (val < 0)
-                m = -val;
-        else
-                m = val;
-        do
-                *--p = m%10 + '0';
-        while ((m /= 10) > 0);
-        if (val < 0)
-                *--p = '-';
-        putd(S, p, (int)((buf + sizeof buf) - p), flags, width, precision);
+        char buf[21];
+        int len = Convert_int2str(va_arg(box->ap, long), buf);
+        putd(S, buf, len, flags, width, precision);
 }
 
 
 static void cvt_u(T S, __attribute__ ((unused)) int code, va_list_box *box, unsigned char flags[], int width, int precision) {
-        unsigned long m = va_arg(box->ap, unsigned long);
-        char buf[43];
-        char *p = buf + sizeof buf;
-        do
-                *--p = m%10 + '0';
-        while ((m /= 10) > 0);
-        putd(S, p, (int)((buf + sizeof buf) - p), flags, width, precision);
+        char buf[21];
+        int len = Convert_uint2str(va_arg(box->ap, unsigned long), buf);
+        putd(S, buf, len, flags, width, precision);
 }
 
 
@@ -304,13 +275,22 @@ static void cvt_f(T S, int code, va_list_box *box, unsigned char flags[], int wi
                 precision = 6;
         if (code == 'g' && precision == 0)
                 precision = 1;
+        double d = va_arg(box->ap, double);
+        if (code == 'f' && precision <= 9) {
+                // The common fixed precision case without the libc format parser
+                int len = Convert_double2str(d, precision, buf);
+                if (len >= 0) {
+                        putd(S, buf, len, flags, width, precision);
+                        return;
+                }
+        }
         {
                 char fmt[] = "%.dd?";
                 assert(precision <= 99);
                 fmt[4] = code;
                 fmt[3] = precision%10 + '0';
                 fmt[2] = (precision/10)%10 + '0';
-                snprintf(buf, sizeof(buf), fmt, va_arg(box->ap, double));
+                snprintf(buf, sizeof(buf), fmt, d);
         }
         putd(S, buf, (int)strlen(buf), flags, width, precision);
 }
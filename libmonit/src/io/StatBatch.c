@@ -0,0 +1,488 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#include "Config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "Str.h"
+#include "HashMap.h"
+#include "StatBatch.h"
+
+
+/**
+ * Implementation of the StatBatch interface. The io_uring rings are used
+ * directly by the system calls, so liburing is not required. The requests
+ * are IORING_OP_STATX (Linux 5.6). If the kernel rejects the operation,
+ * the batch falls back to fstatat(2) permanently.
+ *
+ * The files are grouped by their parent directory. The directory is opened
+ * once (O_PATH on Linux) and kept open between the runs, the files are
+ * stat'ed relative to the directory descriptor, so only the last path
+ * component is resolved for each file. Before each run, the directory path
+ * is stat'ed once and compared with the open descriptor, so the renamed,
+ * replaced or unmounted directory is detected once per group and opened
+ * again. The directories which were not used in the last run are closed.
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+#define T StatBatch_T
+
+
+// The ring size, the larger batches are submitted in more rounds
+#define RING_ENTRIES 256
+
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(STATX_BASIC_STATS)
+#define URING 1
+#endif
+
+
+#ifdef O_PATH
+#define DIRECTORY_FLAGS (O_PATH | O_DIRECTORY | O_CLOEXEC)
+#else
+#define DIRECTORY_FLAGS (O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+#endif
+
+
+typedef struct dir_t {
+        char *path;
+        int fd;
+        dev_t dev;
+        ino_t ino;
+        unsigned long long used;       // The last run which used the directory
+        bool verified;                 // The descriptor was verified in this run
+        struct dir_t *next;
+} *dir_t;
+
+
+typedef struct request_t {
+        const char *path;
+        const char *name;              // The last path component if the directory is set
+        dir_t dir;
+        int error;
+        struct stat st;
+#ifdef URING
+        struct statx stx;
+#endif
+} request_t;
+
+
+#ifdef URING
+typedef struct ring_t {
+        int fd;
+        unsigned entries;
+        void *sq;
+        size_t sqSize;
+        void *cq;
+        size_t cqSize;
+        struct io_uring_sqe *sqes;
+        size_t sqesSize;
+        unsigned *sqHead;
+        unsigned *sqTail;
+        unsigned *sqMask;
+        unsigned *sqArray;
+        unsigned *cqHead;
+        unsigned *cqTail;
+        unsigned *cqMask;
+        struct io_uring_cqe *cqes;
+} ring_t;
+#endif
+
+
+struct T {
+        int count;
+        int size;
+        request_t *requests;
+        unsigned long long run;
+        dir_t dirs;
+        HashMap_T directories;
+        bool initialized;      // The ring setup was tried
+        bool batched;          // The ring is used
+#ifdef URING
+        ring_t ring;
+#endif
+};
+
+
+/* ---------------------------------------------------------------- Private */
+
+
+static void _closeDirectory(dir_t d) {
+        if (d->fd >= 0)
+                close(d->fd);
+        FREE(d->path);
+        FREE(d);
+}
+
+
+/**
+ * Open the directory or check that the open descriptor still refers to the
+ * directory path. The renamed, replaced or unmounted directory is opened again
+ * @return true if the descriptor is valid otherwise false
+ */
+static bool _verifyDirectory(dir_t d) {
+        if (! d->verified) {
+                d->verified = true;
+                struct stat st;
+                if (d->fd >= 0 && (stat(d->path, &st) != 0 || st.st_dev != d->dev || st.st_ino != d->ino)) {
+                        close(d->fd);
+                        d->fd = -1;
+                }
+                if (d->fd < 0 && (d->fd = open(d->path, DIRECTORY_FLAGS)) >= 0) {
+                        if (fstat(d->fd, &st) == 0) {
+                                d->dev = st.st_dev;
+                                d->ino = st.st_ino;
+                        } else {
+                                close(d->fd);
+                                d->fd = -1;
+                        }
+                }
+        }
+        return d->fd >= 0;
+}
+
+
+/**
+ * Get the parent directory of the path, the directory is added to the cache
+ * @return The directory or NULL if the path is not grouped
+ */
+static dir_t _getDirectory(T B, const char *path, const char **name) {
+        char parent[PATH_MAX];
+        const char *slash = strrchr(path, '/');
+        if (! slash)
+                return NULL;
+        *name = slash + 1;
+        if (! **name || Str_isEqual(*name, ".") || Str_isEqual(*name, ".."))
+                return NULL;
+        size_t length = slash == path ? 1 : (size_t)(slash - path);
+        if (length >= sizeof(parent))
+                return NULL;
+        memcpy(parent, path, length);
+        parent[length] = 0;
+        dir_t d = HashMap_get(B->directories, parent);
+        if (! d) {
+                NEW(d);
+                d->path = Str_dup(parent);
+                d->fd = -1;
+                d->next = B->dirs;
+                B->dirs = d;
+                HashMap_put(B->directories, d->path, d);
+        }
+        d->used = B->run;
+        return d;
+}
+
+
+/**
+ * Close the directories which were not used in the last run
+ */
+static void _pruneDirectories(T B) {
+        for (dir_t *p = &(B->dirs); *p;) {
+                dir_t d = *p;
+                d->verified = false;
+                if (d->used < B->run) {
+                        *p = d->next;
+                        HashMap_remove(B->directories, d->path);
+                        _closeDirectory(d);
+                } else {
+                        p = &(d->next);
+                }
+        }
+}
+
+
+/**
+ * Resolve the descriptor and the path used for the request
+ */
+static int _getTarget(request_t *r, const char **path) {
+        if (r->dir && _verifyDirectory(r->dir)) {
+                *path = r->name;
+                return r->dir->fd;
+        }
+        *path = r->path;
+        return AT_FDCWD;
+}
+
+
+#ifdef URING
+static void _closeRing(ring_t *r) {
+        if (r->sqes && r->sqes != MAP_FAILED)
+                munmap(r->sqes, r->sqesSize);
+        if (r->cq && r->cq != MAP_FAILED)
+                munmap(r->cq, r->cqSize);
+        if (r->sq && r->sq != MAP_FAILED)
+                munmap(r->sq, r->sqSize);
+        if (r->fd >= 0)
+                close(r->fd);
+        memset(r, 0, sizeof(ring_t));
+        r->fd = -1;
+}
+
+
+static bool _openRing(ring_t *r) {
+        struct io_uring_params p = {};
+        r->fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+        if (r->fd < 0)
+                return false;
+        fcntl(r->fd, F_SETFD, FD_CLOEXEC);
+        r->entries = p.sq_entries;
+        r->sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        r->cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        r->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+        r->sq = mmap(NULL, r->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+        r->cq = mmap(NULL, r->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        r->sqes = mmap(NULL, r->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+        if (r->sq == MAP_FAILED || r->cq == MAP_FAILED || r->sqes == MAP_FAILED) {
+                _closeRing(r);
+                return false;
+        }
+        r->sqHead = (unsigned *)((char *)r->sq + p.sq_off.head);
+        r->sqTail = (unsigned *)((char *)r->sq + p.sq_off.tail);
+        r->sqMask = (unsigned *)((char *)r->sq + p.sq_off.ring_mask);
+        r->sqArray = (unsigned *)((char *)r->sq + p.sq_off.array);
+        r->cqHead = (unsigned *)((char *)r->cq + p.cq_off.head);
+        r->cqTail = (unsigned *)((char *)r->cq + p.cq_off.tail);
+        r->cqMask = (unsigned *)((char *)r->cq + p.cq_off.ring_mask);
+        r->cqes = (struct io_uring_cqe *)((char *)r->cq + p.cq_off.cqes);
+        return true;
+}
+
+
+static void _toStat(const struct statx *x, struct stat *st) {
+        memset(st, 0, sizeof(struct stat));
+        st->st_dev = makedev(x->stx_dev_major, x->stx_dev_minor);
+        st->st_ino = x->stx_ino;
+        st->st_mode = x->stx_mode;
+        st->st_nlink = x->stx_nlink;
+        st->st_uid = x->stx_uid;
+        st->st_gid = x->stx_gid;
+        st->st_rdev = makedev(x->stx_rdev_major, x->stx_rdev_minor);
+        st->st_size = x->stx_size;
+        st->st_blksize = x->stx_blksize;
+        st->st_blocks = x->stx_blocks;
+        st->st_atim.tv_sec = x->stx_atime.tv_sec;
+        st->st_atim.tv_nsec = x->stx_atime.tv_nsec;
+        st->st_mtim.tv_sec = x->stx_mtime.tv_sec;
+        st->st_mtim.tv_nsec = x->stx_mtime.tv_nsec;
+        st->st_ctim.tv_sec = x->stx_ctime.tv_sec;
+        st->st_ctim.tv_nsec = x->stx_ctime.tv_nsec;
+}
+
+
+/**
+ * Submit the requests [first, first + count) and wait for their completion
+ * @return false if the ring failed or the kernel doesn't support statx
+ */
+static bool _submit(T B, int first, int count) {
+        ring_t *r = &(B->ring);
+        unsigned tail = *r->sqTail;
+        for (int i = 0; i < count; i++) {
+                unsigned index = tail & *r->sqMask;
+                struct io_uring_sqe *sqe = &(r->sqes[index]);
+                memset(sqe, 0, sizeof(struct io_uring_sqe));
+                const char *path;
+                sqe->opcode = IORING_OP_STATX;
+                sqe->fd = _getTarget(&(B->requests[first + i]), &path);
+                sqe->addr = (unsigned long long)(uintptr_t)path;
+                sqe->len = STATX_BASIC_STATS;
+                sqe->off = (unsigned long long)(uintptr_t)&(B->requests[first + i].stx);
+                sqe->user_data = (unsigned long long)(first + i);
+                r->sqArray[index] = index;
+                tail++;
+        }
+        __atomic_store_n(r->sqTail, tail, __ATOMIC_RELEASE);
+        int submitted = 0, completed = 0;
+        while (completed < count) {
+                int rv = (int)syscall(__NR_io_uring_enter, r->fd, count - submitted, count - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+                if (rv < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return false;
+                }
+                submitted += rv;
+                unsigned head = *r->cqHead;
+                while (head != __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE)) {
+                        struct io_uring_cqe *cqe = &(r->cqes[head & *r->cqMask]);
+                        if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) {
+                                // The statx operation is not supported
+                                __atomic_store_n(r->cqHead, head + 1, __ATOMIC_RELEASE);
+                                return false;
+                        }
+                        if (cqe->user_data < (unsigned long long)B->count) {
+                                request_t *q = &(B->requests[cqe->user_data]);
+                                q->error = cqe->res < 0 ? -cqe->res : 0;
+                                if (! q->error)
+                                        _toStat(&(q->stx), &(q->st));
+                        }
+                        head++;
+                        completed++;
+                }
+                __atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+        }
+        return true;
+}
+#endif
+
+
+static void _setup(T B) {
+        if (! B->initialized) {
+                B->initialized = true;
+#ifdef URING
+                B->batched = _openRing(&(B->ring));
+#endif
+        }
+}
+
+
+static void _runSync(T B) {
+        for (int i = 0; i < B->count; i++) {
+                request_t *r = &(B->requests[i]);
+                const char *path;
+                int fd = _getTarget(r, &path);
+                r->error = fstatat(fd, path, &(r->st), 0) == 0 ? 0 : errno;
+        }
+}
+
+
+/* ---------------------------------------------------------------- Public */
+
+
+T StatBatch_new(int hint) {
+        T B;
+        NEW(B);
+        B->size = hint > 0 ? hint : 16;
+        B->requests = CALLOC(B->size, sizeof(request_t));
+        B->directories = HashMap_new(HashMap_String, 0);
+        B->run = 1;
+#ifdef URING
+        B->ring.fd = -1;
+#endif
+        return B;
+}
+
+
+void StatBatch_free(T *B) {
+        assert(B && *B);
+#ifdef URING
+        _closeRing(&((*B)->ring));
+#endif
+        for (dir_t d = (*B)->dirs, next; d; d = next) {
+                next = d->next;
+                _closeDirectory(d);
+        }
+        HashMap_free(&((*B)->directories));
+        FREE((*B)->requests);
+        FREE(*B);
+}
+
+
+int StatBatch_add(T B, const char *path) {
+        assert(B);
+        assert(path);
+        if (B->count == B->size) {
+                B->size *= 2;
+                RESIZE(B->requests, B->size * sizeof(request_t));
+        }
+        request_t *r = &(B->requests[B->count]);
+        r->path = path;
+        r->name = NULL;
+        r->dir = _getDirectory(B, path, &(r->name));
+        r->error = EAGAIN; // Not collected yet
+        return B->count++;
+}
+
+
+void StatBatch_run(T B) {
+        assert(B);
+        _setup(B);
+#ifdef URING
+        if (B->batched) {
+                for (int first = 0; first < B->count; first += (int)B->ring.entries) {
+                        int count = B->count - first < (int)B->ring.entries ? B->count - first : (int)B->ring.entries;
+                        if (! _submit(B, first, count)) {
+                                // Don't use the ring anymore, get all results synchronously
+                                _closeRing(&(B->ring));
+                                B->batched = false;
+                                break;
+                        }
+                }
+        }
+#endif
+        if (! B->batched)
+                _runSync(B);
+        _pruneDirectories(B);
+        B->run++;
+}
+
+
+int StatBatch_get(T B, int index, struct stat *buf) {
+        assert(B);
+        assert(buf);
+        assert(index >= 0 && index < B->count);
+        request_t *r = &(B->requests[index]);
+        if (r->error)
+                return r->error;
+        *buf = r->st;
+        return 0;
+}
+
+
+void StatBatch_clear(T B) {
+        assert(B);
+        B->count = 0;
+}
+
+
+bool StatBatch_isBatched(T B) {
+        assert(B);
+        _setup(B);
+        return B->batched;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#ifndef STATBATCH_INCLUDED
+#define STATBATCH_INCLUDED
+#include <sys/stat.h>
+
+
+/**
+ * A <b>StatBatch</b> collects the status of many files at once. The
+ * paths are added with StatBatch_add() and StatBatch_run() gets the
+ * status of all of them. On Linux with io_uring, the requests are
+ * submitted to the kernel in a few ring submissions instead of one
+ * stat(2) system call per file. If io_uring is not available (older
+ * kernel, disabled by the system policy or other platform), the files
+ * are stat'ed one by one, so the result is the same.
+ *
+ * The files are stat'ed relative to their parent directory, which is kept
+ * open between the runs, so the full path is not resolved for each file.
+ * The directory is checked once per run and opened again if it was renamed,
+ * replaced or unmounted.
+ *
+ * Example:
+ * <pre>
+ * StatBatch_T b = StatBatch_new(0);
+ * int i = StatBatch_add(b, "/etc/passwd");
+ * StatBatch_run(b);
+ * struct stat st;
+ * if (StatBatch_get(b, i, &st) == 0)
+ *         printf("%lld bytes\n", (long long)st.st_size);
+ * StatBatch_free(&b);
+ * </pre>
+ *
+ * This class is reentrant but not thread-safe
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+#define T StatBatch_T
+typedef struct T *T;
+
+
+/**
+ * Create a new StatBatch object. The io_uring ring is set up on the
+ * first use
+ * @param hint The expected number of files or 0 for the default
+ * @return A StatBatch object
+ * @exception MemoryException if allocation failed
+ */
+T StatBatch_new(int hint);
+
+
+/**
+ * Destroy a StatBatch object and release allocated resources
+ * @param B A StatBatch object reference
+ */
+void StatBatch_free(T *B);
+
+
+/**
+ * Add the file to the batch. The path is not copied and must stay valid
+ * until StatBatch_run() returns
+ * @param B A StatBatch object
+ * @param path The file path
+ * @return The index of the request, which is used with StatBatch_get()
+ * @exception MemoryException if allocation failed
+ */
+int StatBatch_add(T B, const char *path);
+
+
+/**
+ * Get the status of all files added since the last StatBatch_clear()
+ * @param B A StatBatch object
+ */
+void StatBatch_run(T B);
+
+
+/**
+ * Get the status of the file collected by StatBatch_run(). The symbolic
+ * links are followed as by stat(2)
+ * @param B A StatBatch object
+ * @param index The request index returned by StatBatch_add()
+ * @param buf The status buffer
+ * @return 0 on success, otherwise the errno value of the failed request
+ * @exception AssertException if the index is out of range
+ */
+int StatBatch_get(T B, int index, struct stat *buf);
+
+
+/**
+ * Remove all requests. The storage and the ring are kept for reuse
+ * @param B A StatBatch object
+ */
+void StatBatch_clear(T B);
+
+
+/**
+ * Returns true if the requests are submitted to the kernel in batches,
+ * false if each file is stat'ed by a separate system call
+ * @param B A StatBatch object
+ * @return true if io_uring is used otherwise false
+ */
+bool StatBatch_isBatched(T B);
+
+
+#undef T
+#endif
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+#include "Config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "Arena.h"
+
+
+/**
+ * Implementation of the Arena interface
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+#define T Arena_T
+
+
+// The strictest alignment of the basic types
+typedef union align_t {
+        long long l;
+        long double d;
+        void *p;
+        void (*f)(void);
+} align_t;
+
+
+typedef struct block_t {
+        struct block_t *next;
+        long size;
+        long used;
+        align_t data[];
+} *block_t;
+
+
+struct T {
+        long blocksize;
+        long used;
+        block_t head;
+        block_t current; // The blocks after the current block are empty
+};
+
+
+/* ---------------------------------------------------------------- Private */
+
+
+static void *_allocate(T A, long size, long align) {
+        for (block_t b = A->current; b; b = b->next) {
+                long offset = (b->used + align - 1) & ~(align - 1);
+                if (offset <= b->size - size) {
+                        A->used += offset + size - b->used;
+                        b->used = offset + size;
+                        A->current = b;
+                        return (char *)b->data + offset;
+                }
+        }
+        // No room left, insert a new block after the current block
+        long blocksize = size > A->blocksize ? size : A->blocksize;
+        block_t b = ALLOC(sizeof(struct block_t) + blocksize);
+        b->size = blocksize;
+        b->used = size;
+        if (A->current) {
+                b->next = A->current->next;
+                A->current->next = b;
+        } else {
+                b->next = A->head;
+                A->head = b;
+        }
+        A->current = b;
+        A->used += size;
+        return b->data;
+}
+
+
+/* ---------------------------------------------------------------- Public */
+
+
+T Arena_new(long blocksize) {
+        assert(blocksize > 0);
+        T A;
+        NEW(A);
+        A->blocksize = blocksize;
+        return A;
+}
+
+
+void Arena_free(T *A) {
+        assert(A && *A);
+        for (block_t b = (*A)->head, next; b; b = next) {
+                next = b->next;
+                FREE(b);
+        }
+        FREE(*A);
+}
+
+
+void *Arena_alloc(T A, long size) {
+        assert(A);
+        assert(size > 0);
+        return _allocate(A, size, __alignof__(align_t));
+}
+
+
+void *Arena_calloc(T A, long count, long size) {
+        assert(A);
+        assert(count > 0);
+        assert(size > 0);
+        void *p = _allocate(A, count * size, __alignof__(align_t));
+        memset(p, 0, count * size);
+        return p;
+}
+
+
+char *Arena_strdup(T A, const char *s) {
+        return s ? Arena_strndup(A, s, strlen(s)) : NULL;
+}
+
+
+char *Arena_strndup(T A, const char *s, long n) {
+        assert(A);
+        assert(n >= 0);
+        if (! s)
+                return NULL;
+        n = strnlen(s, n);
+        char *copy = _allocate(A, n + 1, 1);
+        memcpy(copy, s, n);
+        copy[n] = 0;
+        return copy;
+}
+
+
+void Arena_reset(T A) {
+        assert(A);
+        for (block_t *b = &A->head; *b;) {
+                if ((*b)->size > A->blocksize) {
+                        block_t large = *b;
+                        *b = large->next;
+                        FREE(large);
+                } else {
+                        (*b)->used = 0;
+                        b = &(*b)->next;
+                }
+        }
+        A->current = A->head;
+        A->used = 0;
+}
+
+
+long Arena_used(T A) {
+        assert(A);
+        return A->used;
+}
+
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED
+
+
+/**
+ * An <b>Arena</b> is a region allocator. Memory is handed out from large
+ * blocks and is not freed individually, instead all allocations are
+ * released at once with Arena_reset() or Arena_free(). An Arena is
+ * useful for objects which share the same lifetime, such as the data of
+ * one HTTP request or of one process table snapshot, and replaces many
+ * small malloc/free pairs by a few block allocations. The blocks are kept
+ * by Arena_reset() so an Arena reused for each cycle does not touch the
+ * heap once it has grown to its working size.
+ *
+ * This class is reentrant but not thread-safe
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+#define T Arena_T
+typedef struct T *T;
+
+
+/**
+ * Create a new Arena object.
+ * @param blocksize The size of the blocks the memory is allocated from.
+ * An allocation larger than the block size gets a block of its own
+ * @return An Arena object
+ * @exception MemoryException if allocation failed
+ * @exception AssertException if <code>blocksize <= 0</code>
+ */
+T Arena_new(long blocksize);
+
+
+/**
+ * Destroy an Arena object and release all memory allocated from it.
+ * @param A An Arena object reference
+ */
+void Arena_free(T *A);
+
+
+/**
+ * Allocate <code>size</code> bytes from the Arena. The memory is aligned
+ * for any type and is valid until the next Arena_reset() or Arena_free().
+ * @param A An Arena object
+ * @param size The number of bytes to allocate
+ * @return A pointer to the allocated memory
+ * @exception MemoryException if allocation failed
+ * @exception AssertException if <code>size <= 0</code>
+ */
+void *Arena_alloc(T A, long size);
+
+
+/**
+ * Allocate <code>count</code> objects of <code>size</code> bytes each
+ * from the Arena and clear the memory.
+ * @param A An Arena object
+ * @param count The number of objects to allocate
+ * @param size The size of each object
+ * @return A pointer to the allocated memory
+ * @exception MemoryException if allocation failed
+ * @exception AssertException if <code>count or size <= 0</code>
+ */
+void *Arena_calloc(T A, long count, long size);
+
+
+/**
+ * Copy the string to the Arena. Strings are not aligned, so many short
+ * strings are packed tightly.
+ * @param A An Arena object
+ * @param s The string to copy
+ * @return The copy or NULL if s is NULL
+ * @exception MemoryException if allocation failed
+ */
+char *Arena_strdup(T A, const char *s);
+
+
+/**
+ * Copy at most <code>n</code> bytes of the string to the Arena. The copy
+ * is always NUL terminated.
+ * @param A An Arena object
+ * @param s The string to copy
+ * @param n The maximum number of bytes to copy
+ * @return The copy or NULL if s is NULL
+ * @exception MemoryException if allocation failed
+ */
+char *Arena_strndup(T A, const char *s, long n);
+
+
+/**
+ * Release all allocations at once. The blocks of the standard size are
+ * kept for reuse, the larger blocks are freed.
+ * @param A An Arena object
+ */
+void Arena_reset(T A);
+
+
+/**
+ * Returns the number of bytes allocated from the Arena since it was
+ * created or reset
+ * @param A An Arena object
+ * @return The allocated bytes count, including the alignment padding
+ */
+long Arena_used(T A);
+
+
+#undef T
+#endif
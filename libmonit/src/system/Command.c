@@ -67,12 +67,23 @@
 
 
 #define T Command_T
+/* The environment is kept as the NULL terminated array of "name=value"
+ strings passed to execve as is. The entries are indexed by the name in an
+ open addressing hash table and the value is overwritten in place if the
+ entry buffer is large enough, so patching the variables of a reused
+ Command doesn't allocate */
 struct T {
         uid_t uid;
         gid_t gid;
-        List_T env;
+        struct {
+                int count;
+                int size;
+                char **list;
+                int *capacity;
+                int *index;          /**< Hash table of list index + 1 */
+                int indexSize;
+        } env;
         List_T args;
-        char **_env;
         char **_args;
         char *working_directory;
 };
@@ -102,25 +113,74 @@ struct _usergroups {
 /* --------------------------------------------------------------- Private */
 
 
-/* Search the env list and return the pointer to the name (in the list)
- if found, otherwise NULL */
-static inline char *_findEnv(T C, const char *name) {
-        for (list_t p = C->env->head; p; p = p->next) {
-                if ((strncmp(p->e, name, strlen(name)) == 0))
-                        if (((char*)p->e)[strlen(name)] == '=') // Ensure that p->e is not just a sub-string
-                                return p->e;
+/* Hash of the variable name, the name ends with '=' or NUL */
+static inline unsigned int _hashEnv(const char *name) {
+        unsigned int h = 2166136261u;
+        for (; *name && *name != '='; name++)
+                h = (h ^ (unsigned char)*name) * 16777619u;
+        return h;
+}
+
+
+static inline bool _isEnv(const char *entry, const char *name, size_t length) {
+        return strncmp(entry, name, length) == 0 && entry[length] == '=';
+}
+
+
+/* Return the index of the name's slot in the hash table, the slot is 0 if the name isn't set */
+static inline int _slotEnv(T C, const char *name, size_t length) {
+        int mask = C->env.indexSize - 1;
+        int slot = _hashEnv(name) & mask;
+        while (C->env.index[slot] && ! _isEnv(C->env.list[C->env.index[slot] - 1], name, length))
+                slot = (slot + 1) & mask;
+        return slot;
+}
+
+
+static void _rehashEnv(T C) {
+        while (C->env.indexSize < C->env.size * 2)
+                C->env.indexSize = C->env.indexSize ? C->env.indexSize * 2 : 64;
+        FREE(C->env.index);
+        C->env.index = CALLOC(C->env.indexSize, sizeof(int));
+        for (int i = 0; i < C->env.count; i++) {
+                const char *e = C->env.list[i];
+                C->env.index[_slotEnv(C, e, strcspn(e, "="))] = i + 1;
         }
-        return NULL;
 }
 
 
-/* Remove env variable and value identified by name */
-static inline void _removeEnv(T C, const char *name) {
-        char *e = _findEnv(C, name);
-        if (e) {
-                List_remove(C->env, e);
-                FREE(e);
+/* Search the environment and return the "name=value" entry if found, otherwise NULL */
+static inline char *_findEnv(T C, const char *name) {
+        int i = C->env.index[_slotEnv(C, name, strlen(name))];
+        return i ? C->env.list[i - 1] : NULL;
+}
+
+
+/* Set the "name=value" entry. The existing entry is overwritten in place if it has enough space */
+static void _setEnv(T C, const char *name, const char *value) {
+        size_t length = strlen(name);
+        int needed = (int)(length + strlen(value) + 2);
+        int slot = _slotEnv(C, name, length);
+        int i = C->env.index[slot] - 1;
+        if (i < 0) {
+                if (C->env.count + 1 >= C->env.size) {
+                        C->env.size = C->env.size ? C->env.size * 2 : 64;
+                        RESIZE(C->env.list, C->env.size * sizeof(char *));
+                        RESIZE(C->env.capacity, C->env.size * sizeof(int));
+                        _rehashEnv(C);
+                        slot = _slotEnv(C, name, length);
+                }
+                i = C->env.count++;
+                C->env.list[i] = NULL;
+                C->env.list[C->env.count] = NULL;
+                C->env.capacity[i] = 0;
+                C->env.index[slot] = i + 1;
+        }
+        if (C->env.capacity[i] < needed) {
+                C->env.capacity[i] = needed + 16; // Room for a longer value next time
+                RESIZE(C->env.list[i], C->env.capacity[i]);
         }
+        snprintf(C->env.list[i], C->env.capacity[i], "%s=%s", name, value);
 }
 
 
@@ -157,9 +217,7 @@ static inline char **_args(T C) {
 
 /* Returns an array of program environment */
 static inline char **_env(T C) {
-        if (! C->_env)
-                C->_env = (char**)List_toArray(C->env);
-        return C->_env;
+        return C->env.list;
 }
 
 
@@ -435,7 +493,6 @@ T Command_new(const char *path, const char *arg0, ...) {
         if (! File_exist(path))
                 THROW(AssertException, "File '%s' does not exist", path);
         NEW(C);
-        C->env = List_new();
         C->args = List_new();
         va_list ap;
         va_start(ap, arg0);
@@ -443,8 +500,20 @@ T Command_new(const char *path, const char *arg0, ...) {
         va_end(ap);
         // Copy this process's environment for transit to sub-processes
         extern char **environ;
+        int count = 0;
+        while (environ[count])
+                count++;
+        C->env.size = count + 32;
+        C->env.list = CALLOC(C->env.size, sizeof(char *));
+        C->env.capacity = CALLOC(C->env.size, sizeof(int));
+        _rehashEnv(C);
         for (char **e = environ; *e; e++) {
-                List_append(C->env, Str_dup(*e));
+                char *value = strchr(*e, '=');
+                if (value) {
+                        char *name = Str_ndup(*e, (int)(value - *e));
+                        _setEnv(C, name, value + 1);
+                        FREE(name);
+                }
         }
         return C;
 }
@@ -453,11 +522,13 @@ T Command_new(const char *path, const char *arg0, ...) {
 void Command_free(T *C) {
         assert(C && *C);
         FREE((*C)->_args);
-        FREE((*C)->_env);
         _freeStringsInList((*C)->args);
         List_free(&(*C)->args);
-        _freeStringsInList((*C)->env);
-        List_free(&(*C)->env);
+        for (int i = 0; i < (*C)->env.count; i++)
+                FREE((*C)->env.list[i]);
+        FREE((*C)->env.list);
+        FREE((*C)->env.capacity);
+        FREE((*C)->env.index);
         FREE((*C)->working_directory);
         FREE(*C);
 }
@@ -515,30 +586,36 @@ const char *Command_getDir(T C) {
 }
 
 
-/* Env variables are stored in the environment list as "name=value" strings */
+/* Env variables are stored in the environment array as "name=value" strings */
 void Command_setEnv(Command_T C, const char *name, const char *value) {
         assert(C);
         assert(name);
-        _removeEnv(C, name);
-        List_append(C->env, Str_cat("%s=%s", name, value ? value : ""));
-        FREE(C->_env); // Recreate Command environment on exec
+        _setEnv(C, name, value ? value : "");
 }
 
 
-/* Env variables are stored in the environment list as "name=value" strings */
+/* Env variables are stored in the environment array as "name=value" strings. The
+ value is formatted on the stack if it fits, which is the common case */
 void Command_vSetEnv(T C, const char *name, const char *value, ...) {
         assert(C);
         assert(name);
-        _removeEnv(C, name);
-        StringBuffer_T b = StringBuffer_new(name);
-        StringBuffer_append(b, "=");
-        va_list ap;
-        va_start(ap, value);
-        StringBuffer_vappend(b, value, ap);
-        va_end(ap);
-        List_append(C->env, Str_dup(StringBuffer_toString(b)));
-        StringBuffer_free(&b);
-        FREE(C->_env); // Recreate Command environment on exec
+        char buf[256];
+        char *v = buf;
+        *buf = 0;
+        if (value) {
+                va_list ap;
+                va_start(ap, value);
+                int n = vsnprintf(buf, sizeof(buf), value, ap);
+                va_end(ap);
+                if (n >= (int)sizeof(buf)) {
+                        va_start(ap, value);
+                        v = Str_vcat(value, ap);
+                        va_end(ap);
+                }
+        }
+        _setEnv(C, name, v);
+        if (v != buf)
+                FREE(v);
 }
 
 
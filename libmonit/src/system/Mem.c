@@ -33,6 +33,10 @@
 #include "System.h"
 #include "MemoryException.h"
 
+#ifdef HAVE_MEMSTAT
+#include <stdatomic.h>
+#endif
+
 
 /**
  * Implementation of the Mem interface
@@ -43,6 +47,200 @@
  */
 
 
+#ifdef HAVE_MEMSTAT
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+// Number of call sites recorded, power of two. The allocations from the sites beyond this limit are not counted
+#define MEM_SITES 4096
+
+#define MEM_MAGIC 0x4d656d53U
+
+
+typedef struct Site_T {
+        atomic_int state; // 0 = free, 1 = being claimed, 2 = used
+        const char *func;
+        const char *file;
+        int line;
+        atomic_ullong allocations;
+        atomic_ullong bytes;
+        atomic_llong live;
+        atomic_llong liveBytes;
+} Site_T;
+
+
+// The allocation header, sized to keep the user data aligned for any type
+typedef union Header_T {
+        struct {
+                unsigned int magic;
+                unsigned int site;
+                long size;
+        } h;
+        long double align;
+} Header_T;
+
+
+static Site_T _sites[MEM_SITES];
+
+
+/* ---------------------------------------------------------------- Private */
+
+
+/**
+ * Find the call site slot or claim a free one. The slot is claimed with a
+ * compare and swap, the other threads wait for the claiming thread only
+ * while it stores the site location
+ */
+static unsigned int _site(const char *func, const char *file, int line) {
+        // The __FILE__ string is the same object in all allocations of a translation unit, so the site is identified by its address and line
+        unsigned int hash = (unsigned int)(((uintptr_t)file >> 3) ^ ((uintptr_t)line * 2654435761U));
+        for (unsigned int i = 0; i < MEM_SITES; i++) {
+                unsigned int slot = (hash + i) & (MEM_SITES - 1);
+                Site_T *site = &_sites[slot];
+                int state = atomic_load_explicit(&site->state, memory_order_acquire);
+                if (state == 0) {
+                        int expected = 0;
+                        if (atomic_compare_exchange_strong(&site->state, &expected, 1)) {
+                                site->func = func;
+                                site->file = file;
+                                site->line = line;
+                                atomic_store_explicit(&site->state, 2, memory_order_release);
+                                return slot;
+                        }
+                }
+                while ((state = atomic_load_explicit(&site->state, memory_order_acquire)) == 1)
+                        ;
+                if (site->file == file && site->line == line)
+                        return slot;
+        }
+        return MEM_SITES;
+}
+
+
+static void *_record(Header_T *header, long size, unsigned int site) {
+        header->h.magic = MEM_MAGIC;
+        header->h.site = site;
+        header->h.size = size;
+        if (site < MEM_SITES) {
+                atomic_fetch_add_explicit(&_sites[site].allocations, 1, memory_order_relaxed);
+                atomic_fetch_add_explicit(&_sites[site].bytes, size, memory_order_relaxed);
+                atomic_fetch_add_explicit(&_sites[site].live, 1, memory_order_relaxed);
+                atomic_fetch_add_explicit(&_sites[site].liveBytes, size, memory_order_relaxed);
+        }
+        return header + 1;
+}
+
+
+/**
+ * Return the header of the allocation or NULL if the memory was not allocated by Mem_alloc/Mem_calloc,
+ * such as a string returned by a library and freed with FREE
+ */
+static Header_T *_header(void *ptr) {
+        Header_T *header = (Header_T *)ptr - 1;
+        return header->h.magic == MEM_MAGIC ? header : NULL;
+}
+
+
+static void _release(Header_T *header) {
+        unsigned int site = header->h.site;
+        if (site < MEM_SITES) {
+                atomic_fetch_sub_explicit(&_sites[site].live, 1, memory_order_relaxed);
+                atomic_fetch_sub_explicit(&_sites[site].liveBytes, header->h.size, memory_order_relaxed);
+        }
+        header->h.magic = 0;
+}
+
+
+/* ---------------------------------------------------------------- Public */
+
+
+void *Mem_alloc(long nbytes, const char *func, const char *file, int line){
+	assert(nbytes > 0);
+	Header_T *header = malloc(sizeof(Header_T) + nbytes);
+	if (header == NULL)
+                Exception_throw(&(MemoryException), func, file, line, System_getLastError());
+	return _record(header, nbytes, _site(func, file, line));
+}
+
+
+void *Mem_calloc(long count, long nbytes, const char *func, const char *file, int line) {
+	assert(count > 0);
+	assert(nbytes > 0);
+        if (count > (LONG_MAX - (long)sizeof(Header_T)) / nbytes)
+                Exception_throw(&(MemoryException), func, file, line, "Integer overflow");
+	Header_T *header = calloc(1, sizeof(Header_T) + count * nbytes);
+	if (header == NULL)
+                Exception_throw(&(MemoryException), func, file, line, System_getLastError());
+	return _record(header, count * nbytes, _site(func, file, line));
+}
+
+
+void Mem_free(void *ptr, __attribute__ ((unused)) const char *func, __attribute__ ((unused)) const char *file, __attribute__ ((unused)) int line) {
+	if (ptr) {
+                Header_T *header = _header(ptr);
+                if (header) {
+                        _release(header);
+                        free(header);
+                } else {
+                        free(ptr);
+                }
+        }
+}
+
+
+void *Mem_resize(void *ptr, long nbytes, const char *func, const char *file, int line) {
+	assert(nbytes > 0);
+        if (! ptr)
+                return Mem_alloc(nbytes, func, file, line);
+        Header_T *header = _header(ptr);
+        if (! header) {
+                ptr = realloc(ptr, nbytes);
+                if (ptr == NULL)
+                        Exception_throw(&(MemoryException), func, file, line, System_getLastError());
+                return ptr;
+        }
+        // The allocation stays with its original call site
+        unsigned int site = header->h.site;
+        long size = header->h.size;
+        header = realloc(header, sizeof(Header_T) + nbytes);
+	if (header == NULL)
+                Exception_throw(&(MemoryException), func, file, line, System_getLastError());
+        header->h.size = nbytes;
+        if (site < MEM_SITES) {
+                if (nbytes > size)
+                        atomic_fetch_add_explicit(&_sites[site].bytes, nbytes - size, memory_order_relaxed);
+                atomic_fetch_add_explicit(&_sites[site].liveBytes, nbytes - size, memory_order_relaxed);
+        }
+	return header + 1;
+}
+
+
+bool Mem_statistics(void (*callback)(const MemSite_T *site, void *ap), void *ap) {
+        assert(callback);
+        for (int i = 0; i < MEM_SITES; i++) {
+                Site_T *site = &_sites[i];
+                if (atomic_load_explicit(&site->state, memory_order_acquire) == 2) {
+                        MemSite_T s = {
+                                .func = site->func,
+                                .file = site->file,
+                                .line = site->line,
+                                .allocations = atomic_load_explicit(&site->allocations, memory_order_relaxed),
+                                .bytes = atomic_load_explicit(&site->bytes, memory_order_relaxed),
+                                .live = atomic_load_explicit(&site->live, memory_order_relaxed),
+                                .liveBytes = atomic_load_explicit(&site->liveBytes, memory_order_relaxed)
+                        };
+                        callback(&s, ap);
+                }
+        }
+        return true;
+}
+
+
+#else
+
+
 /* ---------------------------------------------------------------- Public */
 
 
@@ -82,3 +280,12 @@ void *Mem_resize(void *ptr, long nbytes, const char *func, const char *file, int
                 Exception_throw(&(MemoryException), func, file, line, System_getLastError());
 	return ptr;
 }
+
+
+bool Mem_statistics(__attribute__ ((unused)) void (*callback)(const MemSite_T *site, void *ap), __attribute__ ((unused)) void *ap) {
+        return false;
+}
+
+
+#endif
+
@@ -153,4 +153,35 @@ void Mem_free(void *p, const char *func, const char *file, int line);
 void *Mem_resize(void *p, long size, const char *func, const char *file, int line);
 
 
+/**
+ * Allocation statistics of one call site, see Mem_statistics()
+ */
+typedef struct MemSite_T {
+        const char *func;                                     /**< The callee */
+        const char *file;                            /**< Location of caller */
+        int line;                                    /**< Location of caller */
+        unsigned long long allocations;       /**< Number of allocations */
+        unsigned long long bytes;           /**< Number of bytes allocated */
+        long long live;              /**< Number of objects not yet freed */
+        long long liveBytes;           /**< Number of bytes not yet freed */
+} MemSite_T;
+
+
+/**
+ * Call <code>callback</code> with the statistics of each allocation call
+ * site. The statistics are recorded only if libmonit was configured with
+ * <code>--enable-memstat</code>. In this mode each allocation carries a
+ * small header which identifies its call site, so memory allocated with
+ * ALLOC/CALLOC/RESIZE must be released with FREE, not with free(3). The
+ * counters are updated without locks and this method can be called from
+ * any thread, the result is a snapshot which may be slightly inconsistent
+ * while other threads allocate.
+ * @param callback The function called for each call site
+ * @param ap An argument passed to the callback
+ * @return true if the statistics are recorded, otherwise false and the
+ * callback is not called
+ */
+bool Mem_statistics(void (*callback)(const MemSite_T *site, void *ap), void *ap);
+
+
 #endif
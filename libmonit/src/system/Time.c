@@ -148,6 +148,24 @@ time_t timegm(struct tm *tm)
 static const char days[] = "SunMonTueWedThuFriSat";
 static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
 
+/* Per thread cache of the broken-down local time. localtime_r is called again when the time
+ leaves the cached minute, the timezone offset is thereby refreshed at each minute boundary */
+static __thread struct {
+        time_t time;
+        struct tm tm;
+} _localtimeCache = {.time = -1};
+
+/* Per thread cache of the last Time_string and Time_fmt results, valid for one second */
+static __thread struct {
+        time_t time;
+        char result[26];
+} _stringCache = {.time = -1};
+static __thread struct {
+        time_t time;
+        char format[32];
+        char result[64];
+} _fmtCache = {.time = -1};
+
 
 /* --------------------------------------------------------------- Private */
 
@@ -171,6 +189,65 @@ static inline int _m2i(const char m[static 3]) {
 }
 
 
+static inline int _cronNumber(const char **s) {
+        int n = 0;
+        for (; isdigit((unsigned char)**s); (*s)++)
+                if (n < 1000)
+                        n = n * 10 + **s - '0';
+        return n;
+}
+
+
+static void _localtime(time_t time, struct tm *tm) {
+        if (time >= 0 && _localtimeCache.time >= 0 && time >= _localtimeCache.time && time / 60 == _localtimeCache.time / 60) {
+                int sec = _localtimeCache.tm.tm_sec + (int)(time - _localtimeCache.time);
+                if (sec < 60) {
+                        *tm = _localtimeCache.tm;
+                        tm->tm_sec = sec;
+                        return;
+                }
+        }
+        localtime_r(&time, tm);
+        if (time >= 0) {
+                _localtimeCache.time = time;
+                _localtimeCache.tm = *tm;
+        }
+}
+
+
+/* Parse a comma separated list of '*', numbers and ranges to a bitset. Values above max are ignored */
+static const char *_cronField(const char *s, int max, unsigned long long *field) {
+        *field = 0ULL;
+        while (true) {
+                int from, to;
+                if (*s == '*') {
+                        from = 0;
+                        to = max;
+                        s++;
+                } else if (isdigit((unsigned char)*s)) {
+                        from = to = _cronNumber(&s);
+                        if (*s == '-') {
+                                if (! isdigit((unsigned char)*++s))
+                                        return NULL;
+                                to = _cronNumber(&s);
+                        }
+                } else {
+                        return NULL;
+                }
+                for (int i = from; i <= to && i <= max; i++)
+                        *field |= 1ULL << i;
+                if (*s != ',')
+                        return s;
+                s++;
+        }
+}
+
+
+static inline bool _cronDay(const TimeCron_T *c, const struct tm *tm) {
+        return (c->months >> (tm->tm_mon + 1) & 1) && (c->days >> tm->tm_mday & 1) && (c->weekdays >> tm->tm_wday & 1);
+}
+
+
 /* ----------------------------------------------------------------- Class */
 
 
@@ -1294,60 +1371,78 @@ long long Time_micro(void) {
 }
 
 
+long long Time_monotonicMilli(void) {
+#if defined CLOCK_MONOTONIC_COARSE || defined CLOCK_MONOTONIC
+        struct timespec t;
+#ifdef CLOCK_MONOTONIC_COARSE
+        if (clock_gettime(CLOCK_MONOTONIC_COARSE, &t) == 0)
+                return (long long)t.tv_sec * 1000 + (long long)t.tv_nsec / 1000000;
+#endif
+#ifdef CLOCK_MONOTONIC
+        if (clock_gettime(CLOCK_MONOTONIC, &t) == 0)
+                return (long long)t.tv_sec * 1000 + (long long)t.tv_nsec / 1000000;
+#endif
+#endif
+        return Time_milli();
+}
+
+
 int Time_seconds(time_t time) {
         struct tm tm;
-        localtime_r(&time, &tm);
+        _localtime(time, &tm);
         return tm.tm_sec;
 }
 
 
 int Time_minutes(time_t time) {
         struct tm tm;
-        localtime_r(&time, &tm);
+        _localtime(time, &tm);
         return tm.tm_min;
 }
 
 
 int Time_hour(time_t time) {
         struct tm tm;
-        localtime_r(&time, &tm);
+        _localtime(time, &tm);
         return tm.tm_hour;
 }
 
 
 int Time_weekday(time_t time) {
         struct tm tm;
-        localtime_r(&time, &tm);
+        _localtime(time, &tm);
         return tm.tm_wday;
 }
 
 
 int Time_day(time_t time) {
         struct tm tm;
-        localtime_r(&time, &tm);
+        _localtime(time, &tm);
         return tm.tm_mday;
 }
 
 
 int Time_month(time_t time) {
         struct tm tm;
-        localtime_r(&time, &tm);
+        _localtime(time, &tm);
         return (tm.tm_mon + 1);
 }
 
 
 int Time_year(time_t time) {
         struct tm tm;
-        localtime_r(&time, &tm);
+        _localtime(time, &tm);
         return (tm.tm_year + 1900);
 }
 
 
 char *Time_string(time_t time, char *result) {
         if (result) {
+                if (time == _stringCache.time && time >= 0)
+                        return memcpy(result, _stringCache.result, 26);
                 char x[2];
                 struct tm ts;
-                localtime_r((const time_t *)&time, &ts);
+                _localtime(time, &ts);
                 memcpy(result, "aaa, xx aaa xxxx xx:xx:xx\0", 26);
                 /*              0    5  8   1214 17 20 2326 */
                 memcpy(result, days + 3 * ts.tm_wday, 3);
@@ -1370,6 +1465,8 @@ char *Time_string(time_t time, char *result) {
                 _i2a(ts.tm_sec);
                 result[23] = x[0];
                 result[24] = x[1];
+                _stringCache.time = time;
+                memcpy(_stringCache.result, result, 26);
         }
 	return result;
 }
@@ -1411,9 +1508,20 @@ char *Time_fmt(char *result, int size, const char *format, time_t time) {
         struct tm tm;
         assert(result);
         assert(format);
-        localtime_r((const time_t *)&time, &tm);
-        if (strftime(result, size, format, &tm) == 0)
+        if (time == _fmtCache.time && time >= 0 && Str_isByteEqual(format, _fmtCache.format)) {
+                size_t length = strlen(_fmtCache.result);
+                if (length < (size_t)size)
+                        return memcpy(result, _fmtCache.result, length + 1);
+        }
+        _localtime(time, &tm);
+        size_t length = strftime(result, size, format, &tm);
+        if (length == 0) {
                 *result = 0;
+        } else if (length < sizeof(_fmtCache.result) && strlen(format) < sizeof(_fmtCache.format)) {
+                _fmtCache.time = time;
+                strcpy(_fmtCache.format, format);
+                memcpy(_fmtCache.result, result, length + 1);
+        }
         return result;
 }
 
@@ -1446,139 +1554,65 @@ char *Time_uptime(time_t sec, char *result) {
  where fields may have a numeric type, an asterix, a
  sequence of numbers or a range
  */
-int Time_incron(const char *cron, time_t time) {
+int Time_parseCron(const char *cron, TimeCron_T *c) {
         assert(cron);
-#undef YYCURSOR
-#undef YYLIMIT
-#undef YYMARKER
-#define YYCURSOR cron
-#define YYLIMIT  end
-#define YYMARKER m
-#define YYTOKEN  t
-        const char *m;
-        const char *t;
-        const char *end = cron + strlen(cron);
-        int n = 0;
-        int found = 0;
-        int fields[] = {Time_minutes(time), Time_hour(time), Time_day(time), Time_month(time), Time_weekday(time)};
-parse:
-        if (YYCURSOR >= YYLIMIT)
-                return found == 5;
-        YYTOKEN = YYCURSOR;
-        
-{
-	unsigned char yych;
-	yych = *YYCURSOR;
-	switch (yych) {
-	case '\t':
-	case '\n':
-	case '\r':
-	case ' ':	goto yy55;
-	case '*':	goto yy57;
-	case ',':	goto yy59;
-	case '0':
-	case '1':
-	case '2':
-	case '3':
-	case '4':
-	case '5':
-	case '6':
-	case '7':
-	case '8':
-	case '9':	goto yy61;
-	default:	goto yy53;
-	}
-yy53:
-	++YYCURSOR;
-	{
+        assert(c);
+        static const int max[] = {59, 23, 31, 12, 6};
+        unsigned long long fields[5];
+        const char *s = cron;
+        for (int n = 0; n < 5; n++) {
+                while (isspace((unsigned char)*s))
+                        s++;
+                if (! (s = _cronField(s, max[n], &fields[n])) || (*s && ! isspace((unsigned char)*s)))
+                        return false;
+        }
+        while (isspace((unsigned char)*s))
+                s++;
+        if (*s)
                 return false;
+        c->minutes = fields[0];
+        c->hours = (unsigned)fields[1];
+        c->days = (unsigned)fields[2];
+        c->months = (unsigned)fields[3];
+        c->weekdays = (unsigned)fields[4];
+        return true;
+}
+
+
+int Time_matchCron(const TimeCron_T *c, time_t time) {
+        assert(c);
+        struct tm tm;
+        _localtime(time, &tm);
+        return _cronDay(c, &tm) && (c->hours >> tm.tm_hour & 1) && (c->minutes >> tm.tm_min & 1);
+}
+
+
+time_t Time_nextCron(const TimeCron_T *c, time_t time) {
+        assert(c);
+        struct tm tm;
+        time_t limit = time + 5 * 366 * 86400;
+        time_t t = time - time % 60 + 60;
+        while (t > 0 && t <= limit) {
+                _localtime(t, &tm);
+                if (! _cronDay(c, &tm)) {
+                        // Midnight of the next day, mktime normalize the date and handle the DST change
+                        tm = (struct tm){.tm_year = tm.tm_year, .tm_mon = tm.tm_mon, .tm_mday = tm.tm_mday + 1, .tm_isdst = -1};
+                        t = mktime(&tm);
+                } else if (! (c->hours >> tm.tm_hour & 1)) {
+                        t += 3600 - tm.tm_min * 60 - tm.tm_sec;
+                } else if (! (c->minutes >> tm.tm_min & 1)) {
+                        t += 60 - tm.tm_sec;
+                } else {
+                        return t;
+                }
         }
-yy55:
-	++YYCURSOR;
-	{
-                goto parse;
-        }
-yy57:
-	++YYCURSOR;
-	{
-                n++;
-                found++;
-                goto parse;
-        }
-yy59:
-	++YYCURSOR;
-	{
-                n--; // backtrack on fields advance
-                assert(n < 5 && n >= 0);
-                goto parse;
-        }
-yy61:
-	yych = *(YYMARKER = ++YYCURSOR);
-	switch (yych) {
-	case '-':	goto yy64;
-	case '0':
-	case '1':
-	case '2':
-	case '3':
-	case '4':
-	case '5':
-	case '6':
-	case '7':
-	case '8':
-	case '9':	goto yy61;
-	default:	goto yy63;
-	}
-yy63:
-	{
-                if (fields[n] == Str_parseInt(YYTOKEN))
-                        found++;
-                n++;
-                goto parse;
-        }
-yy64:
-	yych = *++YYCURSOR;
-	switch (yych) {
-	case '0':
-	case '1':
-	case '2':
-	case '3':
-	case '4':
-	case '5':
-	case '6':
-	case '7':
-	case '8':
-	case '9':	goto yy66;
-	default:	goto yy65;
-	}
-yy65:
-	YYCURSOR = YYMARKER;
-	goto yy63;
-yy66:
-	yych = *++YYCURSOR;
-	switch (yych) {
-	case '0':
-	case '1':
-	case '2':
-	case '3':
-	case '4':
-	case '5':
-	case '6':
-	case '7':
-	case '8':
-	case '9':	goto yy66;
-	default:	goto yy68;
-	}
-yy68:
-	{
-                int from = Str_parseInt(YYTOKEN);
-                int to = Str_parseInt(strchr(YYTOKEN, '-') + 1);
-                if ((fields[n] <= to) && (fields[n] >= from))
-                        found++;
-                n++;
-                goto parse;
-        }
+        return -1;
 }
-        return found == 5;
+
+
+int Time_incron(const char *cron, time_t time) {
+        TimeCron_T c;
+        return Time_parseCron(cron, &c) && Time_matchCron(&c, time);
 }
 
 
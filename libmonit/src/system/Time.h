@@ -31,6 +31,9 @@
  * <b>Time</b> is an abstraction of date and time. Time is stored internally
  * as the number of seconds and microseconds since the epoch, <i>January 1,
  * 1970 00:00 UTC</i>.
+ * <p>The local time conversion and the formatted results of Time_string()
+ * and Time_fmt() are cached per thread, so repeated calls within the same
+ * second, e.g. timestamps of log lines, do not convert the time again.
  *
  * @author http://www.tildeslash.com/
  * @see http://www.mmonit.com/
@@ -38,6 +41,20 @@
  */
 
 
+/**
+ * A crontab format string parsed by Time_parseCron(). Each field is a
+ * bitset of the matching values, e.g. bit 5 in <code>hours</code> is set
+ * if the specification matches 5AM.
+ */
+typedef struct TimeCron_T {
+        unsigned long long minutes; /**< Minutes 0-59 */
+        unsigned hours;             /**< Hours 0-23 */
+        unsigned days;              /**< Days of month 1-31 */
+        unsigned months;            /**< Months 1-12 */
+        unsigned weekdays;          /**< Days of week 0-6 (0=sunday) */
+} TimeCron_T;
+
+
 /** @name class methods */
 //@{
 
@@ -135,6 +152,18 @@ long long Time_milli(void);
 long long Time_micro(void);
 
 
+/**
+ * Returns the time of a monotonic clock measured in milliseconds. The
+ * clock is not affected by changes of the system time and is intended
+ * for measuring intervals and deadlines, the start point is arbitrary.
+ * The coarse clock variant is used where available, its resolution is
+ * typically a few milliseconds. Falls back to Time_milli() if the system
+ * does not have a monotonic clock.
+ * @return Milliseconds of a monotonic clock
+ */
+long long Time_monotonicMilli(void);
+
+
 /**
  * Returns the second of the minute for time.
  * @param time Number of seconds since the EPOCH
@@ -315,6 +344,41 @@ char *Time_uptime(time_t sec, char result[static 24]);
 int Time_incron(const char *cron, time_t time);
 
 
+/**
+ * Parse a crontab format string, see Time_incron() for the format. Use
+ * this method to parse the string once and Time_matchCron() to test a
+ * time repeatedly. Values outside the range of a field never match.
+ * @param cron A crontab format string. e.g. "* 8-9 * * *"
+ * @param c The parsed result
+ * @return 1 if the string was parsed, 0 if the syntax is invalid
+ */
+int Time_parseCron(const char *cron, TimeCron_T *c);
+
+
+/**
+ * Test if the given time is in range of a parsed crontab specification.
+ * @param c A crontab specification parsed by Time_parseCron()
+ * @param time The time to test if in range of the specification
+ * @return 1 if time is in range, otherwise 0
+ */
+int Time_matchCron(const TimeCron_T *c, time_t time);
+
+
+/**
+ * Returns the start of the first minute after the given time which is
+ * in range of a parsed crontab specification. Example:
+ * <pre>
+ * Time_parseCron("0 8 * * 1-5", &c);
+ * Time_nextCron(&c, Time_now()) -> the next weekday 8:00 AM
+ * </pre>
+ * @param c A crontab specification parsed by Time_parseCron()
+ * @param time The time to search from
+ * @return The timestamp of the next matching minute or -1 if no minute
+ * in the next five years matches, e.g. the 31st of February
+ */
+time_t Time_nextCron(const TimeCron_T *c, time_t time);
+
+
 /**
  * This method suspend the calling process or Thread for
  * <code>u</code> micro seconds.
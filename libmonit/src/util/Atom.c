@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#include "Config.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Str.h"
+#include "Atom.h"
+#include "Thread.h"
+
+
+/**
+ * Implementation of the Atom interface. The atoms are chained in a hash
+ * table whose size is a power of two, the table doubles when it holds
+ * more atoms than buckets. Each atom carries its hash and reference count
+ * in a header before the string, so the string pointer is the atom.
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+#define ATOM_BITS 8
+
+
+typedef struct atom_t {
+        struct atom_t *link;
+        unsigned int hash;
+        int references;
+        char string[];
+} atom_t;
+
+
+static struct {
+        int bits;
+        int length;
+        atom_t **table;
+        Mutex_T mutex;
+} _atoms = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/* -------------------------------------------------------- Private methods */
+
+
+static inline atom_t *_atom(const char *s) {
+        return (atom_t *)(s - offsetof(atom_t, string));
+}
+
+
+static inline unsigned int _hash(const char *s) {
+        return (unsigned int)Str_hash(s) * 2654435761u;
+}
+
+
+static inline int _index(unsigned int hash) {
+        return hash >> (32 - _atoms.bits);
+}
+
+
+static void _resize(int bits) {
+        atom_t **old = _atoms.table;
+        int size = old ? 1 << _atoms.bits : 0;
+        _atoms.table = CALLOC(1 << bits, sizeof(atom_t *));
+        _atoms.bits = bits;
+        for (int i = 0; i < size; i++) {
+                for (atom_t *a = old[i], *next; a; a = next) {
+                        next = a->link;
+                        int j = _index(a->hash);
+                        a->link = _atoms.table[j];
+                        _atoms.table[j] = a;
+                }
+        }
+        FREE(old);
+}
+
+
+static atom_t *_lookup(const char *s, unsigned int hash) {
+        if (_atoms.table)
+                for (atom_t *a = _atoms.table[_index(hash)]; a; a = a->link)
+                        if (a->hash == hash && Str_isByteEqual(a->string, s))
+                                return a;
+        return NULL;
+}
+
+
+/* --------------------------------------------------------------- Public */
+
+
+const char *Atom_new(const char *s) {
+        assert(s);
+        unsigned int hash = _hash(s);
+        atom_t *a;
+        LOCK(_atoms.mutex)
+        {
+                a = _lookup(s, hash);
+                if (a) {
+                        a->references++;
+                } else {
+                        if (! _atoms.table)
+                                _resize(ATOM_BITS);
+                        else if (_atoms.length >= 1 << _atoms.bits)
+                                _resize(_atoms.bits + 1);
+                        size_t length = strlen(s);
+                        a = ALLOC(sizeof(atom_t) + length + 1);
+                        memcpy(a->string, s, length + 1);
+                        a->hash = hash;
+                        a->references = 1;
+                        int i = _index(hash);
+                        a->link = _atoms.table[i];
+                        _atoms.table[i] = a;
+                        _atoms.length++;
+                }
+        }
+        END_LOCK;
+        return a->string;
+}
+
+
+const char *Atom_find(const char *s) {
+        assert(s);
+        unsigned int hash = _hash(s);
+        atom_t *a;
+        LOCK(_atoms.mutex)
+        {
+                a = _lookup(s, hash);
+        }
+        END_LOCK;
+        return a ? a->string : NULL;
+}
+
+
+const char *Atom_ref(const char *atom) {
+        assert(atom);
+        LOCK(_atoms.mutex)
+        {
+                _atom(atom)->references++;
+        }
+        END_LOCK;
+        return atom;
+}
+
+
+void Atom_free(const char **atom) {
+        assert(atom);
+        if (! *atom)
+                return;
+        atom_t *a = _atom(*atom);
+        LOCK(_atoms.mutex)
+        {
+                if (--a->references == 0) {
+                        atom_t **p = &_atoms.table[_index(a->hash)];
+                        while (*p != a)
+                                p = &(*p)->link;
+                        *p = a->link;
+                        _atoms.length--;
+                        FREE(a);
+                }
+        }
+        END_LOCK;
+        *atom = NULL;
+}
+
+
+int Atom_length(void) {
+        int length;
+        LOCK(_atoms.mutex)
+        {
+                length = _atoms.length;
+        }
+        END_LOCK;
+        return length;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#ifndef ATOM_INCLUDED
+#define ATOM_INCLUDED
+
+
+/**
+ * An <b>Atom</b> is a unique, immutable string. The atoms are kept in one
+ * global table, so equal strings interned with Atom_new() share one copy
+ * and two atoms are equal if and only if the pointers are equal. Use the
+ * atoms for the long lived strings which are repeated or compared often,
+ * such as the service names. Each Atom_new() adds a reference which must
+ * be released with Atom_free(), the copy is freed with the last reference.
+ * Example:
+ * <pre>
+ * const char *a = Atom_new("nginx");
+ * const char *b = Atom_new(name);
+ * if (a == b)
+ *      ... // name is "nginx"
+ * Atom_free(&a);
+ * Atom_free(&b);
+ * </pre>
+ *
+ * This class is thread-safe
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/**
+ * Return the atom of the string and add a reference to it. If the
+ * string is not in the table, a copy is added
+ * @param s A string, must not be NULL
+ * @return The atom, which must not be modified
+ * @exception MemoryException if allocation failed
+ */
+const char *Atom_new(const char *s);
+
+
+/**
+ * Return the atom of the string without adding a reference. Use it to
+ * turn a lookup key into the pointer which is compared with the atoms
+ * @param s A string, must not be NULL
+ * @return The atom or NULL if the string is not in the table. The
+ * atom is valid only while its references are held
+ */
+const char *Atom_find(const char *s);
+
+
+/**
+ * Add a reference to the atom
+ * @param atom An atom returned by Atom_new()
+ * @return The atom
+ */
+const char *Atom_ref(const char *atom);
+
+
+/**
+ * Release a reference to the atom, the atom is freed with the last
+ * reference. Set the reference to NULL
+ * @param atom A reference to the atom, the atom may be NULL
+ */
+void Atom_free(const char **atom);
+
+
+/**
+ * Returns the number of the atoms in the table
+ * @return The number of the distinct strings interned
+ */
+int Atom_length(void);
+
+
+#endif
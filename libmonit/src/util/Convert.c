@@ -26,6 +26,7 @@
 #include "Config.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include "Convert.h"
@@ -41,6 +42,36 @@ static bool _isInt(double x) {
 }
 
 
+// Two ASCII digits for each number 0..99, used to convert the integers two digits per division
+static const char _digits[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const unsigned long long _pow10[] = {1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL};
+
+
+// Write the digits of value backwards ending at end, return the pointer to the first digit
+static inline char *_utoa(unsigned long long value, char *end) {
+    while (value >= 100) {
+        const char *d = _digits + (value % 100) * 2;
+        value /= 100;
+        *--end = d[1];
+        *--end = d[0];
+    }
+    if (value >= 10) {
+        const char *d = _digits + value * 2;
+        *--end = d[1];
+        *--end = d[0];
+    } else {
+        *--end = (char)('0' + value);
+    }
+    return end;
+}
+
+
 /* -------------------------------------------------------- Public Methods */
 
 
@@ -90,3 +121,68 @@ char *Convert_time2str(double milli, char s[static 11]) {
     }
     return s;
 }
+
+
+int Convert_int2str(long long value, char s[static 21]) {
+    assert(s);
+    char buf[21];
+    char *end = buf + sizeof(buf);
+    char *p = _utoa(value < 0 ? -(unsigned long long)value : (unsigned long long)value, end);
+    if (value < 0)
+        *--p = '-';
+    int length = (int)(end - p);
+    memcpy(s, p, length);
+    s[length] = 0;
+    return length;
+}
+
+
+int Convert_uint2str(unsigned long long value, char s[static 21]) {
+    assert(s);
+    char buf[20];
+    char *end = buf + sizeof(buf);
+    char *p = _utoa(value, end);
+    int length = (int)(end - p);
+    memcpy(s, p, length);
+    s[length] = 0;
+    return length;
+}
+
+
+int Convert_double2str(double value, int precision, char s[static 32]) {
+    assert(s);
+    assert(precision >= 0 && precision <= 9);
+    if (! isfinite(value))
+        return -1;
+    // Below 1e15 the double has at least three fraction bits, so the rounding below is exact
+    double scaled = fabs(value) * (double)_pow10[precision];
+    if (scaled >= 1e15)
+        return -1;
+    double integral = floor(scaled);
+    double fraction = scaled - integral;
+    if (fraction == 0.5) {
+        // A possible tie, printf rounds the exact binary value so leave it to snprintf
+        return snprintf(s, 32, "%.*f", precision, value);
+    }
+    unsigned long long n = (unsigned long long)integral + (fraction > 0.5);
+    char buf[32];
+    char *end = buf + sizeof(buf);
+    char *p = end;
+    if (precision > 0) {
+        unsigned long long f = n % _pow10[precision];
+        n /= _pow10[precision];
+        char *q = _utoa(f, end);
+        while (q > end - precision)
+            *--q = '0';
+        p = q;
+        *--p = '.';
+    }
+    p = _utoa(n, p);
+    if (signbit(value))
+        *--p = '-';
+    int length = (int)(end - p);
+    memcpy(s, p, length);
+    s[length] = 0;
+    return length;
+}
+
@@ -54,4 +54,39 @@ char *Convert_bytes2str(double bytes, char s[static 10]);
 char *Convert_time2str(double milli, char s[static 11]);
 
 
+/**
+ * Convert the integer to its decimal string representation. The result
+ * is the same as printf's "%lld" but the conversion is done two digits
+ * at a time and does not parse a format string.
+ * @param value The value to convert
+ * @param s A result buffer, must be large enough to hold 21 chars
+ * @return The length of the string written to s
+ */
+int Convert_int2str(long long value, char s[static 21]);
+
+
+/**
+ * Convert the unsigned integer to its decimal string representation.
+ * The result is the same as printf's "%llu".
+ * @param value The value to convert
+ * @param s A result buffer, must be large enough to hold 21 chars
+ * @return The length of the string written to s
+ */
+int Convert_uint2str(unsigned long long value, char s[static 21]);
+
+
+/**
+ * Convert the double to a string with a fixed number of decimals. The
+ * result is the same as printf's "%.<precision>f", including the
+ * rounding, but is computed with integer arithmetic.
+ * @param value The value to convert
+ * @param precision The number of decimals, 0-9
+ * @param s A result buffer, must be large enough to hold 32 chars
+ * @return The length of the string written to s or -1 if the value
+ * is not finite or its magnitude times 10^precision is 1e15 or more,
+ * in which case the caller should use snprintf
+ */
+int Convert_double2str(double value, int precision, char s[static 32]);
+
+
 #endif
@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+#include "Config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Str.h"
+#include "HashMap.h"
+
+
+/**
+ * Implementation of the HashMap interface. The table size is a power of
+ * two and the table grows when it would become more than half full. The
+ * entries are removed with backward shift deletion, so no tombstones are
+ * needed and the probe sequences stay short.
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+#define T HashMap_T
+
+
+typedef struct entry_t {
+        union {
+                const char *string;
+                long long integer;
+        } key;
+        unsigned int hash;
+        void *value; // NULL marks a free entry
+} entry_t;
+
+
+struct T {
+        HashMap_Type type;
+        int bits;
+        int length;
+        entry_t *table;
+};
+
+
+/* -------------------------------------------------------- Private methods */
+
+
+static inline unsigned int _hashString(const char *key) {
+        return (unsigned int)Str_hash(key) * 2654435761u;
+}
+
+
+static inline unsigned int _hashInteger(long long key) {
+        unsigned long long h = (unsigned long long)key * 0x9E3779B97F4A7C15ull;
+        return (unsigned int)(h >> 32);
+}
+
+
+static inline bool _equals(T M, entry_t *e, unsigned int hash, const void *key) {
+        if (e->hash != hash)
+                return false;
+        if (M->type == HashMap_String)
+                return strcmp(e->key.string, key) == 0;
+        return e->key.integer == *(const long long *)key;
+}
+
+
+// The index of the key's entry, or of the free entry where the key belongs
+static inline unsigned int _find(T M, unsigned int hash, const void *key) {
+        unsigned int mask = (1u << M->bits) - 1;
+        unsigned int i = hash >> (32 - M->bits);
+        while (M->table[i].value && ! _equals(M, &M->table[i], hash, key))
+                i = (i + 1) & mask;
+        return i;
+}
+
+
+static void _resize(T M, int bits) {
+        entry_t *old = M->table;
+        int size = old ? 1 << M->bits : 0;
+        M->bits = bits;
+        M->table = CALLOC(1 << bits, sizeof(entry_t));
+        unsigned int mask = (1u << bits) - 1;
+        for (int i = 0; i < size; i++) {
+                if (old[i].value) {
+                        unsigned int j = old[i].hash >> (32 - bits);
+                        while (M->table[j].value)
+                                j = (j + 1) & mask;
+                        M->table[j] = old[i];
+                }
+        }
+        FREE(old);
+}
+
+
+static void *_put(T M, unsigned int hash, const void *key, void *value) {
+        assert(value);
+        if (! M->table || 2 * (M->length + 1) > (1 << M->bits))
+                _resize(M, M->table ? M->bits + 1 : M->bits);
+        unsigned int i = _find(M, hash, key);
+        entry_t *e = &M->table[i];
+        void *previous = e->value;
+        if (! previous) {
+                e->hash = hash;
+                if (M->type == HashMap_String)
+                        e->key.string = key;
+                else
+                        e->key.integer = *(const long long *)key;
+                M->length++;
+        } else if (M->type == HashMap_String) {
+                e->key.string = key;
+        }
+        e->value = value;
+        return previous;
+}
+
+
+static void *_get(T M, unsigned int hash, const void *key) {
+        if (! M->length)
+                return NULL;
+        return M->table[_find(M, hash, key)].value;
+}
+
+
+static void *_remove(T M, unsigned int hash, const void *key) {
+        if (! M->length)
+                return NULL;
+        unsigned int mask = (1u << M->bits) - 1;
+        unsigned int i = _find(M, hash, key);
+        void *value = M->table[i].value;
+        if (value) {
+                // Shift the following entries of the probe sequence back, so lookups don't stop at the hole
+                for (unsigned int j = (i + 1) & mask; M->table[j].value; j = (j + 1) & mask) {
+                        unsigned int home = M->table[j].hash >> (32 - M->bits);
+                        // Move the entry if its home slot is not cyclically in (i, j]
+                        if (((j - home) & mask) >= ((j - i) & mask)) {
+                                M->table[i] = M->table[j];
+                                i = j;
+                        }
+                }
+                M->table[i].value = NULL;
+                M->length--;
+        }
+        return value;
+}
+
+
+/* --------------------------------------------------------- Public methods */
+
+
+T HashMap_new(HashMap_Type type, int hint) {
+        assert(type == HashMap_String || type == HashMap_Integer);
+        assert(hint >= 0);
+        T M;
+        NEW(M);
+        M->type = type;
+        M->bits = 4;
+        while ((1 << M->bits) < 2 * hint)
+                M->bits++;
+        return M;
+}
+
+
+void HashMap_free(T *M) {
+        assert(M && *M);
+        FREE((*M)->table);
+        FREE(*M);
+}
+
+
+void *HashMap_put(T M, const char *key, void *value) {
+        assert(M);
+        assert(M->type == HashMap_String);
+        assert(key);
+        return _put(M, _hashString(key), key, value);
+}
+
+
+void *HashMap_get(T M, const char *key) {
+        assert(M);
+        assert(M->type == HashMap_String);
+        assert(key);
+        return _get(M, _hashString(key), key);
+}
+
+
+void *HashMap_remove(T M, const char *key) {
+        assert(M);
+        assert(M->type == HashMap_String);
+        assert(key);
+        return _remove(M, _hashString(key), key);
+}
+
+
+void *HashMap_putInt(T M, long long key, void *value) {
+        assert(M);
+        assert(M->type == HashMap_Integer);
+        return _put(M, _hashInteger(key), &key, value);
+}
+
+
+void *HashMap_getInt(T M, long long key) {
+        assert(M);
+        assert(M->type == HashMap_Integer);
+        return _get(M, _hashInteger(key), &key);
+}
+
+
+void *HashMap_removeInt(T M, long long key) {
+        assert(M);
+        assert(M->type == HashMap_Integer);
+        return _remove(M, _hashInteger(key), &key);
+}
+
+
+void HashMap_map(T M, void (*apply)(const void *key, void *value, void *ap), void *ap) {
+        assert(M);
+        assert(apply);
+        for (int i = 0; M->table && i < (1 << M->bits); i++) {
+                entry_t *e = &M->table[i];
+                if (e->value)
+                        apply(M->type == HashMap_String ? (const void *)e->key.string : (const void *)&e->key.integer, e->value, ap);
+        }
+}
+
+
+int HashMap_length(T M) {
+        assert(M);
+        return M->length;
+}
+
+
+void HashMap_clear(T M) {
+        assert(M);
+        if (M->table)
+                memset(M->table, 0, (1 << M->bits) * sizeof(entry_t));
+        M->length = 0;
+}
+
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+#ifndef HASHMAP_INCLUDED
+#define HASHMAP_INCLUDED
+
+
+/**
+ * A <b>HashMap</b> maps keys to values. The map uses open addressing
+ * with linear probing: the entries are stored in one array, which is
+ * kept at most half full so a lookup usually inspects one or two adjacent
+ * entries. The keys are either strings or integers, selected when the map
+ * is created, and the string keys are compared by value.
+ *
+ * The map stores the pointers to the keys and values, it does not copy
+ * them. A string key must therefore stay valid and unchanged while it is
+ * in the map. Example:
+ * <pre>
+ * HashMap_T m = HashMap_new(HashMap_String, 0);
+ * HashMap_put(m, s->name, s);
+ * Service_T found = HashMap_get(m, "nginx");
+ * HashMap_free(&m);
+ * </pre>
+ *
+ * This class is reentrant but not thread-safe
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+#define T HashMap_T
+typedef struct T *T;
+
+
+/**
+ * The key type of a HashMap
+ */
+typedef enum {
+        HashMap_String = 0,
+        HashMap_Integer
+} HashMap_Type;
+
+
+/**
+ * Create a new HashMap object.
+ * @param type The key type, HashMap_String or HashMap_Integer
+ * @param hint The expected number of entries or 0 for the default
+ * @return A HashMap object
+ * @exception MemoryException if allocation failed
+ */
+T HashMap_new(HashMap_Type type, int hint);
+
+
+/**
+ * Destroy a HashMap object and release allocated resources. The keys
+ * and values are not freed.
+ * @param M A HashMap object reference
+ */
+void HashMap_free(T *M);
+
+
+/**
+ * Map the string <code>key</code> to <code>value</code>. If the key was
+ * in the map the value is replaced.
+ * @param M A HashMap object with string keys
+ * @param key The key, which must stay valid while it is in the map
+ * @param value The value, must not be NULL
+ * @return The previous value of the key or NULL if the key was not in
+ * the map
+ * @exception MemoryException if allocation failed
+ */
+void *HashMap_put(T M, const char *key, void *value);
+
+
+/**
+ * Returns the value of the string <code>key</code>
+ * @param M A HashMap object with string keys
+ * @param key The key
+ * @return The value or NULL if the key is not in the map
+ */
+void *HashMap_get(T M, const char *key);
+
+
+/**
+ * Remove the string <code>key</code> from the map
+ * @param M A HashMap object with string keys
+ * @param key The key
+ * @return The removed value or NULL if the key was not in the map
+ */
+void *HashMap_remove(T M, const char *key);
+
+
+/**
+ * Map the integer <code>key</code> to <code>value</code>. If the key was
+ * in the map the value is replaced.
+ * @param M A HashMap object with integer keys
+ * @param key The key
+ * @param value The value, must not be NULL
+ * @return The previous value of the key or NULL if the key was not in
+ * the map
+ * @exception MemoryException if allocation failed
+ */
+void *HashMap_putInt(T M, long long key, void *value);
+
+
+/**
+ * Returns the value of the integer <code>key</code>
+ * @param M A HashMap object with integer keys
+ * @param key The key
+ * @return The value or NULL if the key is not in the map
+ */
+void *HashMap_getInt(T M, long long key);
+
+
+/**
+ * Remove the integer <code>key</code> from the map
+ * @param M A HashMap object with integer keys
+ * @param key The key
+ * @return The removed value or NULL if the key was not in the map
+ */
+void *HashMap_removeInt(T M, long long key);
+
+
+/**
+ * Call <code>apply</code> for each entry in the map, in no particular
+ * order. The map must not be modified by the apply function.
+ * @param M A HashMap object
+ * @param apply The function called with the key (a string or a pointer
+ * to the integer key), the value and <code>ap</code>
+ * @param ap An argument passed to the apply function
+ */
+void HashMap_map(T M, void (*apply)(const void *key, void *value, void *ap), void *ap);
+
+
+/**
+ * Returns the number of entries in the map
+ * @param M A HashMap object
+ * @return Number of entries
+ */
+int HashMap_length(T M);
+
+
+/**
+ * Remove all entries from the map. The storage is kept.
+ * @param M A HashMap object
+ */
+void HashMap_clear(T M);
+
+
+#undef T
+#endif
@@ -57,12 +57,8 @@
 
 
 char *Str_chomp(char *s) {
-        if (STR_DEF(s)) {
-                for (char *p = s; *p; p++)
-                        if (*p == '\r' || *p == '\n') {
-                                *p = 0; break;
-                        }
-        }
+        if (STR_DEF(s))
+                s[strcspn(s, "\r\n")] = 0;
         return s;
 }
 
@@ -74,11 +70,9 @@ char *Str_trim(char *s) {
 
 char *Str_ltrim(char *s) {
         if (STR_DEF(s) && isspace(*s)) {
-                int i, j;
-                for (j = 0; s[j]; j++) ;
-                for (i = 0; isspace(s[i]); i++) ;
-                memmove(s, s + i, j - i);
-                s[j - i] = 0;
+                size_t i;
+                for (i = 1; isspace(s[i]); i++) ;
+                memmove(s, s + i, strlen(s + i) + 1);
         }
         return s;
 }
@@ -170,23 +164,21 @@ double Str_parseDouble(const char *s) {
 
 char *Str_replaceChar(char *s, char o, char n) {
         if (s) {
-                for (char *t = s; *t; t++)
-                        if (*t == o)
-                                *t = n;
+                // The branch free loop over the known length is vectorized by the compiler
+                size_t length = strlen(s);
+                for (size_t i = 0; i < length; i++)
+                        s[i] = s[i] == o ? n : s[i];
         }
         return s;
 }
 
 
 bool Str_startsWith(const char *a, const char *b) {
-	if (a && b) {
-	        do {
-	                if (toupper(*a) != toupper(*b))
-                                return false;
-                        if (*a++ == 0 || *b++ == 0)
-                                break;
-                } while (*b);
-                return true;
+        if (a && b) {
+                // The empty prefix matches only the empty string
+                if (! *b)
+                        return ! *a;
+                return strncasecmp(a, b, strlen(b)) == 0;
         }
         return false;
 }
@@ -194,10 +186,8 @@ bool Str_startsWith(const char *a, const char *b) {
 
 bool Str_endsWith(const char *a, const char *b) {
         if (a && b) {
-                size_t i = 0, j = 0;
-                for (i = strlen(a), j = strlen(b); (i && j); i--, j--)
-                        if (toupper(a[i]) != toupper(b[j])) return false;
-                return (i >= j);
+                size_t i = strlen(a), j = strlen(b);
+                return (i >= j && strcasecmp(a + i - j, b) == 0);
         }
         return false;
 }
@@ -205,32 +195,20 @@ bool Str_endsWith(const char *a, const char *b) {
 
 char *Str_sub(const char *a, const char *b) {
         if (a && STR_DEF(b)) {
-                const char *p, *q;
-                while (*a) {
-                        if (toupper(*a) == toupper(*b)) {
-                                p = a;
-                                q = b;
-                                do
-                                        if (! *q)
-                                                return (char*)a;
-                                while (toupper(*p++) == toupper(*q++));
-                        }
-                        a++;
-                }
+                // Let strpbrk skip to the candidates which start with the first character of b in either case, then compare the rest
+                char first[3] = {tolower((unsigned char)*b), toupper((unsigned char)*b), 0};
+                size_t n = strlen(b);
+                for (a = strpbrk(a, first); a; a = strpbrk(a + 1, first))
+                        if (strncasecmp(a, b, n) == 0)
+                                return (char *)a;
         }
         return NULL;
 }
 
 
 bool Str_has(const char *charset, const char *s) {
-        if (charset && s) {
-                for (int x = 0; s[x]; x++) {
-                        for (int y = 0; charset[y]; y++) {
-                                if (s[x] == charset[y])
-                                        return true;
-                        }
-                }
-        }
+        if (charset && s)
+                return strpbrk(s, charset) != NULL;
         return false;
 }
 
@@ -255,31 +233,24 @@ char *Str_unescape(const char *charset, char *s) {
 
 
 bool Str_isEqual(const char *a, const char *b) {
-        if (a && b) {
-                while (*a && *b)
-                        if (toupper(*a++) != toupper(*b++)) return false;
-                return (*a == *b);
-        }
+        if (a && b)
+                return strcasecmp(a, b) == 0;
         return false;
 }
 
 
 bool Str_isByteEqual(const char *a, const char *b) {
-        if (a && b) {
-                while (*a && *b)
-                        if (*a++ != *b++) return false;
-                return (*a == *b);
-        }
+        if (a && b)
+                return strcmp(a, b) == 0;
         return false;
 }
 
 
 char *Str_copy(char *dest, const char *src, int n) {
 	if (src && dest && (n > 0)) {
-        	char *t = dest;
-	        while (*src && n--)
-        		*t++ = *src++;
-        	*t = 0;
+                size_t length = strnlen(src, n);
+                memcpy(dest, src, length);
+                dest[length] = 0;
 	} else if (dest)
 	        *dest = 0;
         return dest;
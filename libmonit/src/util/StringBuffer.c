@@ -29,11 +29,13 @@
 #include <string.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <stdint.h>
 #ifdef HAVE_ZLIB_H
 #include <zlib.h>
 #endif
 
 #include "Str.h"
+#include "Convert.h"
 #include "StringBuffer.h"
 
 
@@ -61,20 +63,203 @@ struct T {
 /* ---------------------------------------------------------------- Private */
 
 
+// Make room for n more bytes and the terminating NUL, the buffer grows geometrically so appending is amortized O(1)
+static inline void _ensure(T S, int n) {
+        if (S->used + n >= S->length) {
+                int length = S->length * 2;
+                if (length <= S->used + n)
+                        length = S->used + n + 1;
+                S->length = length;
+                RESIZE(S->buffer, S->length);
+        }
+}
+
+
+/*
+ * Parse the conversion specification following '%'. The fast path handles
+ * the conversions without flags and width: %%, s, c, d, i, u, o, x with
+ * the l, ll, z and j length modifiers and f with a precision of 0-9.
+ * Return the pointer to the conversion character or NULL if the
+ * specification must be left to vsnprintf.
+ */
+static inline const char *_conversion(const char *s, int *precision, int *length) {
+        *precision = 6;
+        *length = 0;
+        if (*s == '.') {
+                if (! isdigit((unsigned char)s[1]) || isdigit((unsigned char)s[2]))
+                        return NULL;
+                *precision = s[1] - '0';
+                s += 2;
+                if (*s == 'l')
+                        s++;
+                return *s == 'f' ? s : NULL;
+        }
+        if (*s == 'l') {
+                *length = (*++s == 'l') ? (s++, 2) : 1;
+        } else if (*s == 'z') {
+                *length = 3;
+                s++;
+        } else if (*s == 'j') {
+                *length = 4;
+                s++;
+        }
+        switch (*s) {
+                case '%':
+                case 's':
+                case 'c':
+                        return *length ? NULL : s;
+                case 'd':
+                case 'i':
+                case 'u':
+                case 'o':
+                case 'x':
+                        return s;
+                case 'f':
+                        return *length == 0 || *length == 1 ? s : NULL;
+                default:
+                        return NULL;
+        }
+}
+
+
+static inline bool _isSimple(const char *s) {
+        int precision, length;
+        for (; (s = strchr(s, '%')); s++)
+                if (! (s = _conversion(s + 1, &precision, &length)))
+                        return false;
+        return true;
+}
+
+
+static inline unsigned long long _unsigned(int length, va_list ap) {
+        switch (length) {
+                case 1:  return va_arg(ap, unsigned long);
+                case 2:  return va_arg(ap, unsigned long long);
+                case 3:  return va_arg(ap, size_t);
+                case 4:  return va_arg(ap, uintmax_t);
+                default: return va_arg(ap, unsigned int);
+        }
+}
+
+
+static inline long long _signed(int length, va_list ap) {
+        switch (length) {
+                case 1:  return va_arg(ap, long);
+                case 2:  return va_arg(ap, long long);
+                case 3:  return va_arg(ap, ssize_t);
+                case 4:  return va_arg(ap, intmax_t);
+                default: return va_arg(ap, int);
+        }
+}
+
+
+// Format the numbers and strings directly into the buffer, the format must have passed _isSimple
+static void _format(T S, const char *s, va_list ap) {
+        char buf[32];
+        int precision, length;
+        for (const char *p; (p = strchr(s, '%')); s = p + 1) {
+                StringBuffer_appendBytes(S, s, (int)(p - s));
+                p = _conversion(p + 1, &precision, &length);
+                switch (*p) {
+                        case '%':
+                                StringBuffer_appendChar(S, '%');
+                                break;
+                        case 's':
+                                {
+                                        const char *a = va_arg(ap, const char *);
+                                        StringBuffer_appendString(S, a ? a : "(null)");
+                                }
+                                break;
+                        case 'c':
+                                StringBuffer_appendChar(S, (char)va_arg(ap, int));
+                                break;
+                        case 'd':
+                        case 'i':
+                                StringBuffer_appendBytes(S, buf, Convert_int2str(_signed(length, ap), buf));
+                                break;
+                        case 'u':
+                                StringBuffer_appendBytes(S, buf, Convert_uint2str(_unsigned(length, ap), buf));
+                                break;
+                        case 'o':
+                        case 'x':
+                                {
+                                        unsigned long long u = _unsigned(length, ap);
+                                        int shift = *p == 'o' ? 3 : 4;
+                                        char *q = buf + sizeof(buf);
+                                        do
+                                                *--q = "0123456789abcdef"[u & ((1U << shift) - 1)];
+                                        while ((u >>= shift));
+                                        StringBuffer_appendBytes(S, q, (int)(buf + sizeof(buf) - q));
+                                }
+                                break;
+                        case 'f':
+                                {
+                                        double d = va_arg(ap, double);
+                                        int n = Convert_double2str(d, precision, buf);
+                                        if (n < 0)
+                                                StringBuffer_append(S, "%.*f", precision, d);
+                                        else
+                                                StringBuffer_appendBytes(S, buf, n);
+                                }
+                                break;
+                }
+        }
+        StringBuffer_appendString(S, s);
+}
+
+
 __attribute__((format (printf, 2, 0)))
 static inline void _append(T S, const char *s, va_list ap) {
+        if (_isSimple(s)) {
+                _format(S, s, ap);
+                return;
+        }
         va_list ap_copy;
-        while (true) {
+        va_copy(ap_copy, ap);
+        int n = vsnprintf((char *)(S->buffer + S->used), S->length - S->used, s, ap_copy);
+        va_end(ap_copy);
+        if (n >= S->length - S->used) {
+                // The output was truncated, format again with the exact size known
+                _ensure(S, n);
                 va_copy(ap_copy, ap);
-                int n = vsnprintf((char *)(S->buffer + S->used), S->length - S->used, s, ap_copy);
+                n = vsnprintf((char *)(S->buffer + S->used), S->length - S->used, s, ap_copy);
                 va_end(ap_copy);
-                if ((S->used + n) < S->length) {
-                        S->used += n;
-                        break;
+        }
+        if (n > 0)
+                S->used += n;
+}
+
+
+static const void *_compress(T S, int level, int windowBits, size_t *length) {
+        assert(S);
+        assert(length);
+        assert(level >= 0 && level <= 9);
+#ifdef HAVE_LIBZ
+        *length = 0;
+        if (S->used > 0) {
+                z_stream zstream = {};
+                zstream.next_in = S->buffer;
+                zstream.avail_in = S->used;
+                int status = deflateInit2(&zstream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+                if (status == Z_OK) {
+                        int need = (int)deflateBound(&zstream, S->used);
+                        RESIZE(S->compressedBuffer, need);
+                        zstream.next_out = S->compressedBuffer;
+                        zstream.avail_out = need;
+                        status = deflate(&zstream, Z_FINISH);
+                        deflateEnd(&zstream);
+                        if (status == Z_STREAM_END) {
+                                *length = need - zstream.avail_out;
+                                return (const void *)S->compressedBuffer;
+                        }
                 }
-                S->length += STRLEN + n;
-                RESIZE(S->buffer, S->length);
+                FREE(S->compressedBuffer);
+                THROW(AssertException, "compression failed: %s", zError(status));
         }
+#else
+        THROW(AssertException, "compression not supported");
+#endif
+        return NULL;
 }
 
 
@@ -136,6 +321,80 @@ T StringBuffer_vappend(T S, const char *s, va_list ap) {
 }
 
 
+T StringBuffer_appendBytes(T S, const void *bytes, int length) {
+        assert(S);
+        assert(length >= 0);
+        if (bytes && length > 0) {
+                _ensure(S, length);
+                memcpy(S->buffer + S->used, bytes, length);
+                S->used += length;
+                S->buffer[S->used] = 0;
+        }
+        return S;
+}
+
+
+T StringBuffer_appendString(T S, const char *s) {
+        assert(S);
+        if (s)
+                StringBuffer_appendBytes(S, s, (int)strlen(s));
+        return S;
+}
+
+
+T StringBuffer_appendChar(T S, char c) {
+        assert(S);
+        _ensure(S, 1);
+        S->buffer[S->used++] = c;
+        S->buffer[S->used] = 0;
+        return S;
+}
+
+
+T StringBuffer_appendInt(T S, long long n) {
+        assert(S);
+        char buf[21];
+        return StringBuffer_appendBytes(S, buf, Convert_int2str(n, buf));
+}
+
+
+T StringBuffer_appendDouble(T S, double d, int precision) {
+        assert(S);
+        char buf[32];
+        int n = Convert_double2str(d, precision, buf);
+        if (n < 0)
+                return StringBuffer_append(S, "%.*f", precision, d);
+        return StringBuffer_appendBytes(S, buf, n);
+}
+
+
+T StringBuffer_appendEscaped(T S, const char *s, const char *(*escape)(int c)) {
+        assert(S);
+        assert(escape);
+        if (s) {
+                const char *run = s;
+                for (; *s; s++) {
+                        const char *replacement = escape((unsigned char)*s);
+                        if (replacement) {
+                                StringBuffer_appendBytes(S, run, (int)(s - run));
+                                StringBuffer_appendString(S, replacement);
+                                run = s + 1;
+                        }
+                }
+                StringBuffer_appendBytes(S, run, (int)(s - run));
+        }
+        return S;
+}
+
+
+T StringBuffer_reserve(T S, int length) {
+        assert(S);
+        assert(length >= 0);
+        _ensure(S, length);
+        return S;
+}
+
+
 int StringBuffer_replace(T S, const char *a, const char *b) {
         int n = 0;
         assert(S);
@@ -275,34 +534,11 @@ const char *StringBuffer_toString(T S) {
 
 
 const void *StringBuffer_toCompressed(T S, int level, size_t *length) {
-        assert(S);
-        assert(length);
-        assert(level >= 0 && level <= 9);
-#ifdef HAVE_LIBZ
-        *length = 0;
-        if (S->used > 0) {
-                z_stream zstream = {};
-                zstream.next_in = S->buffer;
-                zstream.avail_in = S->used;
-                int status = deflateInit2(&zstream, level, Z_DEFLATED, 15 | 16, 8, Z_DEFAULT_STRATEGY);
-                if (status == Z_OK) {
-                        int need = (int)deflateBound(&zstream, S->used);
-                        RESIZE(S->compressedBuffer, need);
-                        zstream.next_out = S->compressedBuffer;
-                        zstream.avail_out = need;
-                        status = deflate(&zstream, Z_FINISH);
-                        deflateEnd(&zstream);
-                        if (status == Z_STREAM_END) {
-                                *length = need - zstream.avail_out;
-                                return (const void *)S->compressedBuffer;
-                        }
-                }
-                FREE(S->compressedBuffer);
-                THROW(AssertException, "compression failed: %s", zError(status));
-        }
-#else
-        THROW(AssertException, "compression not supported");
-#endif
-        return NULL;
+        return _compress(S, level, 15 | 16, length); // gzip wrapper
+}
+
+
+const void *StringBuffer_toDeflated(T S, int level, size_t *length) {
+        return _compress(S, level, 15, length); // zlib wrapper
 }
 
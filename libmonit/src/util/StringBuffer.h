@@ -97,6 +97,99 @@ T StringBuffer_append(T S, const char *s, ...) __attribute__((format (printf, 2,
 T StringBuffer_vappend(T S, const char *s, va_list ap) __attribute__((format (printf, 2, 0)));
 
 
+/**
+ * Append <code>length</code> bytes to the contents of this string buffer.
+ * The bytes are copied as is and may contain NUL characters, use
+ * StringBuffer_length() rather than strlen() to get the buffer length
+ * after binary content was appended.
+ * @param S StringBuffer object
+ * @param bytes The bytes to append
+ * @param length The number of bytes to append
+ * @return a reference to this StringBuffer
+ * @exception MemoryException if allocation was used and failed
+ */
+T StringBuffer_appendBytes(T S, const void *bytes, int length);
+
+
+/**
+ * Append the string to the contents of this string buffer. Unlike
+ * StringBuffer_append() the string is copied as is, without format
+ * processing
+ * @param S StringBuffer object
+ * @param s The string to append, NULL is ignored
+ * @return a reference to this StringBuffer
+ * @exception MemoryException if allocation was used and failed
+ */
+T StringBuffer_appendString(T S, const char *s);
+
+
+/**
+ * Append the character to the contents of this string buffer
+ * @param S StringBuffer object
+ * @param c The character to append
+ * @return a reference to this StringBuffer
+ * @exception MemoryException if allocation was used and failed
+ */
+T StringBuffer_appendChar(T S, char c);
+
+
+/**
+ * Append the decimal representation of the number to the contents of
+ * this string buffer. Faster than StringBuffer_append() with "%lld"
+ * @param S StringBuffer object
+ * @param n The number to append
+ * @return a reference to this StringBuffer
+ * @exception MemoryException if allocation was used and failed
+ */
+T StringBuffer_appendInt(T S, long long n);
+
+
+/**
+ * Append the decimal representation of the double, with the given
+ * number of decimals, to the contents of this string buffer. The
+ * result is the same as StringBuffer_append(S, "%.*f", precision, d).
+ * @param S StringBuffer object
+ * @param d The value to append
+ * @param precision The number of decimals, 0-9
+ * @return a reference to this StringBuffer
+ * @exception MemoryException if allocation was used and failed
+ */
+T StringBuffer_appendDouble(T S, double d, int precision);
+
+
+/**
+ * Append the string to the contents of this string buffer and replace
+ * the characters for which the <code>escape</code> function returns a
+ * replacement string. The characters for which the function returns
+ * NULL are copied as is. Example:
+ * <pre>
+ * static const char *html(int c) {
+ *         return c == '<' ? "&lt;" : c == '&' ? "&amp;" : NULL;
+ * }
+ * StringBuffer_appendEscaped(b, "a < b", html) -> "a &lt; b"
+ * </pre>
+ * @param S StringBuffer object
+ * @param s The string to append, NULL is ignored
+ * @param escape The function returning the replacement for the character
+ * or NULL
+ * @return a reference to this StringBuffer
+ * @exception MemoryException if allocation was used and failed
+ */
+T StringBuffer_appendEscaped(T S, const char *s, const char *(*escape)(int c));
+
+
+/**
+ * Ensure that at least <code>length</code> bytes can be appended to this
+ * string buffer without reallocation. Use to preallocate the buffer
+ * if the size of the content is known in advance
+ * @param S StringBuffer object
+ * @param length The number of bytes to reserve
+ * @return a reference to this StringBuffer
+ * @exception MemoryException if allocation was used and failed
+ */
+T StringBuffer_reserve(T S, int length);
+
+
 /**
  * Replace all occurrences of <code>a</code> with <code>b</code>. Example:
  * <pre>
@@ -219,5 +312,19 @@ const char *StringBuffer_toString(T S);
 const void *StringBuffer_toCompressed(T S, int level, size_t *length);
 
 
+/**
+ * Returns the content of this string buffer as zlib compressed data (binary
+ * data), as used by the HTTP "deflate" content-coding (RFC 1950).
+ * @param S StringBuffer object
+ * @param level compression level. A number between 0 and 9 where 1 gives
+ * best speed, 9 gives best compression, 0 gives no compression. 6 is a good value.
+ * @param length The number of bytes in the returned data is stored in length
+ * @return The compressed data representing this string buffer. If the buffer is
+ * empty, NULL is returned and length set to 0.
+ * @exception AssertException if level is not in [0..9] or if compression failed
+ */
+const void *StringBuffer_toDeflated(T S, int level, size_t *length);
+
+
 #undef T
 #endif
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+#include "Config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Vector.h"
+
+
+/**
+ * Implementation of the Vector interface.
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+#define T Vector_T
+struct T {
+        int length;
+        int capacity;
+        int elementSize;
+        char *data;
+};
+
+
+/* -------------------------------------------------------- Private methods */
+
+
+static inline void _ensure(T V, int capacity) {
+        if (capacity > V->capacity) {
+                int c = V->capacity ? V->capacity * 2 : 8;
+                if (c < capacity)
+                        c = capacity;
+                RESIZE(V->data, (long)c * V->elementSize);
+                V->capacity = c;
+        }
+}
+
+
+/* --------------------------------------------------------- Public methods */
+
+
+T Vector_new(int elementSize, int hint) {
+        assert(elementSize > 0);
+        assert(hint >= 0);
+        T V;
+        NEW(V);
+        V->elementSize = elementSize;
+        if (hint > 0)
+                _ensure(V, hint);
+        return V;
+}
+
+
+void Vector_free(T *V) {
+        assert(V && *V);
+        FREE((*V)->data);
+        FREE(*V);
+}
+
+
+void *Vector_append(T V, const void *e) {
+        assert(V);
+        assert(e);
+        _ensure(V, V->length + 1);
+        void *slot = V->data + (long)V->length * V->elementSize;
+        memcpy(slot, e, V->elementSize);
+        V->length++;
+        return slot;
+}
+
+
+void *Vector_insert(T V, int i, const void *e) {
+        assert(V);
+        assert(e);
+        assert(i >= 0 && i <= V->length);
+        _ensure(V, V->length + 1);
+        char *slot = V->data + (long)i * V->elementSize;
+        memmove(slot + V->elementSize, slot, (long)(V->length - i) * V->elementSize);
+        memcpy(slot, e, V->elementSize);
+        V->length++;
+        return slot;
+}
+
+
+void *Vector_get(T V, int i) {
+        assert(V);
+        assert(i >= 0 && i < V->length);
+        return V->data + (long)i * V->elementSize;
+}
+
+
+void Vector_remove(T V, int i) {
+        assert(V);
+        assert(i >= 0 && i < V->length);
+        char *slot = V->data + (long)i * V->elementSize;
+        memmove(slot, slot + V->elementSize, (long)(V->length - i - 1) * V->elementSize);
+        V->length--;
+}
+
+
+bool Vector_pop(T V, void *e) {
+        assert(V);
+        if (V->length == 0)
+                return false;
+        V->length--;
+        if (e)
+                memcpy(e, V->data + (long)V->length * V->elementSize, V->elementSize);
+        return true;
+}
+
+
+void Vector_sort(T V, int (*compare)(const void *a, const void *b)) {
+        assert(V);
+        assert(compare);
+        if (V->length > 1)
+                qsort(V->data, V->length, V->elementSize, compare);
+}
+
+
+void *Vector_data(T V) {
+        assert(V);
+        return V->data;
+}
+
+
+int Vector_length(T V) {
+        assert(V);
+        return V->length;
+}
+
+
+void Vector_clear(T V) {
+        assert(V);
+        V->length = 0;
+}
+
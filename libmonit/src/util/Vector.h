@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+#ifndef VECTOR_INCLUDED
+#define VECTOR_INCLUDED
+
+
+/**
+ * A <b>Vector</b> is a growable array which stores its elements by value
+ * in one contiguous memory block. Unlike a List, iterating a Vector does
+ * not chase pointers and the elements are adjacent in memory, which makes
+ * it the better container for data that is walked often. Appending is
+ * amortized constant time, the storage grows geometrically.
+ *
+ * The elements are copied into the Vector, so a Vector can store structs
+ * as well as pointers. Example, a Vector of ints:
+ * <pre>
+ * Vector_T v = Vector_new(sizeof(int), 0);
+ * for (int i = 0; i < 10; i++)
+ *         Vector_append(v, &i);
+ * int *third = Vector_get(v, 2);
+ * Vector_free(&v);
+ * </pre>
+ * The pointer returned by Vector_get() is valid until the Vector is
+ * modified.
+ *
+ * This class is reentrant but not thread-safe
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+#define T Vector_T
+typedef struct T *T;
+
+
+/**
+ * Create a new Vector object.
+ * @param elementSize The size of each element in bytes
+ * @param hint The initial capacity in elements or 0 for the default
+ * @return A Vector object
+ * @exception MemoryException if allocation failed
+ * @exception AssertException if <code>elementSize <= 0</code>
+ */
+T Vector_new(int elementSize, int hint);
+
+
+/**
+ * Destroy a Vector object and release allocated resources.
+ * @param V A Vector object reference
+ */
+void Vector_free(T *V);
+
+
+/**
+ * Append a copy of the element <code>e</code> to the end of the Vector
+ * @param V A Vector object
+ * @param e A pointer to the element to copy
+ * @return A pointer to the element stored in the Vector
+ * @exception MemoryException if allocation failed
+ */
+void *Vector_append(T V, const void *e);
+
+
+/**
+ * Insert a copy of the element <code>e</code> at the index <code>i</code>.
+ * The elements from <code>i</code> on are moved one position up.
+ * @param V A Vector object
+ * @param i The index, 0 <= i <= Vector_length()
+ * @param e A pointer to the element to copy
+ * @return A pointer to the element stored in the Vector
+ * @exception MemoryException if allocation failed
+ * @exception AssertException if the index is out of range
+ */
+void *Vector_insert(T V, int i, const void *e);
+
+
+/**
+ * Returns a pointer to the element at the index <code>i</code>
+ * @param V A Vector object
+ * @param i The index, 0 <= i < Vector_length()
+ * @return A pointer to the element
+ * @exception AssertException if the index is out of range
+ */
+void *Vector_get(T V, int i);
+
+
+/**
+ * Remove the element at the index <code>i</code>. The elements after
+ * <code>i</code> are moved one position down.
+ * @param V A Vector object
+ * @param i The index, 0 <= i < Vector_length()
+ * @exception AssertException if the index is out of range
+ */
+void Vector_remove(T V, int i);
+
+
+/**
+ * Remove the last element and copy it to <code>e</code>
+ * @param V A Vector object
+ * @param e The buffer for the element or NULL
+ * @return true if an element was removed, false if the Vector was empty
+ */
+bool Vector_pop(T V, void *e);
+
+
+/**
+ * Sort the elements with the qsort(3) comparison function
+ * @param V A Vector object
+ * @param compare The comparison function, called with pointers to two
+ * elements
+ */
+void Vector_sort(T V, int (*compare)(const void *a, const void *b));
+
+
+/**
+ * Returns a pointer to the contiguous element array, NULL if the Vector
+ * has no storage yet. The pointer is valid until the Vector is modified.
+ * @param V A Vector object
+ * @return A pointer to the first element
+ */
+void *Vector_data(T V);
+
+
+/**
+ * Returns the number of elements in the Vector.
+ * @param V A Vector object
+ * @return Number of elements in the Vector
+ */
+int Vector_length(T V);
+
+
+/**
+ * Clear this Vector so it contains no elements. The storage is kept.
+ * @param V A Vector object
+ */
+void Vector_clear(T V);
+
+
+#undef T
+#endif
@@ -0,0 +1,103 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "Bootstrap.h"
+#include "Str.h"
+#include "system/Arena.h"
+
+/**
+ * Arena.c unity tests.
+ */
+
+
+int main(void) {
+        Arena_T A = NULL;
+
+        Bootstrap(); // Need to initialize library
+
+        printf("============> Start Arena Tests\n\n");
+
+        printf("=> Test0: create\n");
+        {
+                A = Arena_new(1024);
+                assert(A);
+                assert(Arena_used(A) == 0);
+                Arena_free(&A);
+                assert(A == NULL);
+        }
+        printf("=> Test0: OK\n\n");
+
+        printf("=> Test1: Arena_alloc() alignment and Arena_calloc()\n");
+        {
+                A = Arena_new(1024);
+                char *c = Arena_alloc(A, 1);
+                long long *l = Arena_alloc(A, sizeof(long long));
+                double *d = Arena_alloc(A, sizeof(double));
+                assert(c && l && d);
+                assert(((uintptr_t)l % __alignof__(long long)) == 0);
+                assert(((uintptr_t)d % __alignof__(double)) == 0);
+                *l = 42;
+                *d = 4.2;
+                int *z = Arena_calloc(A, 100, sizeof(int));
+                for (int i = 0; i < 100; i++)
+                        assert(z[i] == 0);
+                assert(*l == 42 && *d == 4.2);
+                Arena_free(&A);
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: Arena_strdup() and Arena_strndup()\n");
+        {
+                A = Arena_new(16);
+                assert(Arena_strdup(A, NULL) == NULL);
+                char *a = Arena_strdup(A, "abc");
+                char *b = Arena_strndup(A, "defghi", 3);
+                char *c = Arena_strndup(A, "x", 10);
+                assert(Str_isEqual(a, "abc"));
+                assert(Str_isEqual(b, "def"));
+                assert(Str_isEqual(c, "x"));
+                // Strings are packed without alignment padding
+                assert(b == a + 4);
+                assert(Arena_used(A) == 10);
+                // Larger than the block size
+                char *long_string = Arena_strdup(A, "a string longer than the block size");
+                assert(Str_isEqual(long_string, "a string longer than the block size"));
+                assert(Str_isEqual(a, "abc"));
+                Arena_free(&A);
+        }
+        printf("=> Test2: OK\n\n");
+
+        printf("=> Test3: Arena_reset() reuses the blocks\n");
+        {
+                A = Arena_new(256);
+                char *first = NULL;
+                for (int cycle = 0; cycle < 3; cycle++) {
+                        char *p = NULL;
+                        for (int i = 0; i < 100; i++) {
+                                p = Arena_strdup(A, "0123456789");
+                                if (i == 0) {
+                                        if (cycle == 0)
+                                                first = p;
+                                        // The first block is reused after reset
+                                        assert(p == first);
+                                }
+                        }
+                        assert(Str_isEqual(p, "0123456789"));
+                        assert(Arena_used(A) == 1100);
+                        Arena_alloc(A, 4096);
+                        Arena_reset(A);
+                        assert(Arena_used(A) == 0);
+                }
+                Arena_free(&A);
+        }
+        printf("=> Test3: OK\n\n");
+
+        printf("============> Arena Tests: OK\n\n");
+
+        return 0;
+}
+
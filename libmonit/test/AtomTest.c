@@ -0,0 +1,113 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "Bootstrap.h"
+#include "Str.h"
+#include "Atom.h"
+#include "Thread.h"
+
+/**
+ * Atom.c unity tests.
+ */
+
+
+static void *_intern(void *args) {
+        const char *atom = args;
+        for (int i = 0; i < 10000; i++) {
+                const char *a = Atom_new("shared");
+                assert(a == atom);
+                Atom_free(&a);
+        }
+        return NULL;
+}
+
+
+int main(void) {
+
+        Bootstrap(); // Need to initialize library
+
+        printf("============> Start Atom Tests\n\n");
+
+        printf("=> Test0: intern\n");
+        {
+                char copy[] = "nginx";
+                const char *a = Atom_new("nginx");
+                const char *b = Atom_new(copy);
+                assert(a);
+                assert(a == b);
+                assert(a != copy);
+                assert(Str_isEqual(a, "nginx"));
+                assert(Atom_find("nginx") == a);
+                assert(Atom_find("apache") == NULL);
+                assert(Atom_length() == 1);
+                const char *c = Atom_new("");
+                assert(c != a);
+                assert(*c == 0);
+                assert(Atom_length() == 2);
+                Atom_free(&c);
+                assert(c == NULL);
+                Atom_free(&c);
+                Atom_free(&b);
+                assert(b == NULL);
+                // a still holds a reference
+                assert(Atom_find("nginx") == a);
+                assert(Atom_ref(a) == a);
+                Atom_free(&a);
+                assert(Atom_length() == 1);
+                a = Atom_find("nginx");
+                Atom_free(&a);
+                assert(Atom_find("nginx") == NULL);
+                assert(Atom_length() == 0);
+        }
+        printf("=> Test0: OK\n\n");
+
+        printf("=> Test1: many atoms\n");
+        {
+                const char *atoms[5000];
+                char s[16];
+                for (int i = 0; i < 5000; i++) {
+                        snprintf(s, sizeof(s), "service%d", i);
+                        atoms[i] = Atom_new(s);
+                }
+                assert(Atom_length() == 5000);
+                for (int i = 0; i < 5000; i++) {
+                        snprintf(s, sizeof(s), "service%d", i);
+                        assert(Atom_find(s) == atoms[i]);
+                        assert(Str_isEqual(atoms[i], s));
+                }
+                // Free every other atom, the rest stays intact
+                for (int i = 0; i < 5000; i += 2)
+                        Atom_free(&atoms[i]);
+                assert(Atom_length() == 2500);
+                for (int i = 0; i < 5000; i++) {
+                        snprintf(s, sizeof(s), "service%d", i);
+                        assert(Atom_find(s) == atoms[i]);
+                }
+                for (int i = 1; i < 5000; i += 2)
+                        Atom_free(&atoms[i]);
+                assert(Atom_length() == 0);
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: threads\n");
+        {
+                Thread_T threads[4];
+                const char *atom = Atom_new("shared");
+                for (int i = 0; i < 4; i++)
+                        Thread_create(threads[i], _intern, (void *)atom);
+                for (int i = 0; i < 4; i++)
+                        Thread_join(threads[i]);
+                assert(Atom_length() == 1);
+                Atom_free(&atom);
+                assert(Atom_length() == 0);
+        }
+        printf("=> Test2: OK\n\n");
+
+        printf("============> Atom Tests: OK\n\n");
+
+        return 0;
+}
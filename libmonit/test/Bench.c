@@ -0,0 +1,262 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <stdlib.h>
+
+#include "Bootstrap.h"
+#include "Str.h"
+#include "StringBuffer.h"
+#include "system/Time.h"
+
+/**
+ * libmonit microbenchmarks, run with "make bench". Each benchmark prints
+ * one JSON line: the name, the number of iterations and the nanoseconds
+ * per operation. The number of iterations is calibrated so a run takes at
+ * least BENCH_TIME milliseconds (default 100), the best of five runs is
+ * reported. The input data is fixed, so the results are comparable
+ * between releases on the same host.
+ */
+
+
+static volatile long long sink;
+
+
+static long long _nanos(void) {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+
+static void _run(const char *name, long long bytes, void (*bench)(long long n)) {
+        const char *env = getenv("BENCH_TIME");
+        long long budget = (env ? atoll(env) : 100) * 1000000LL;
+        long long n = 1, elapsed = 0;
+        // Calibrate the number of iterations
+        while (true) {
+                long long start = _nanos();
+                bench(n);
+                elapsed = _nanos() - start;
+                if (elapsed >= budget || n >= (1LL << 40))
+                        break;
+                long long next = elapsed > 0 ? (long long)(n * 1.2 * budget / elapsed) : n * 100;
+                n = next > n * 2 ? next : n * 2;
+        }
+        for (int i = 0; i < 4; i++) {
+                long long start = _nanos();
+                bench(n);
+                long long e = _nanos() - start;
+                if (e < elapsed)
+                        elapsed = e;
+        }
+        double ns = (double)elapsed / n;
+        printf("{\"suite\":\"libmonit\",\"name\":\"%s\",\"iterations\":%lld,\"ns_per_op\":%.2f", name, n, ns);
+        if (bytes)
+                printf(",\"bytes_per_op\":%lld,\"mb_per_s\":%.1f", bytes, bytes * 1000. / ns);
+        printf("}\n");
+        fflush(stdout);
+}
+
+
+/* --------------------------------------------------------------- StringBuffer */
+
+
+static void _stringBufferAppend(long long n) {
+        StringBuffer_T b = StringBuffer_create(4096);
+        for (long long i = 0; i < n; i++) {
+                if ((i & 255) == 0)
+                        StringBuffer_clear(b);
+                StringBuffer_append(b, "<%s>%lld</%s>", "collected_sec", i, "collected_sec");
+        }
+        sink = StringBuffer_length(b);
+        StringBuffer_free(&b);
+}
+
+
+static void _stringBufferAppendInt(long long n) {
+        StringBuffer_T b = StringBuffer_create(4096);
+        for (long long i = 0; i < n; i++) {
+                if ((i & 255) == 0)
+                        StringBuffer_clear(b);
+                StringBuffer_appendInt(b, i * 7919);
+        }
+        sink = StringBuffer_length(b);
+        StringBuffer_free(&b);
+}
+
+
+static const char *_html(int c) {
+        return c == '<' ? "&lt;" : c == '>' ? "&gt;" : c == '&' ? "&amp;" : NULL;
+}
+
+
+static void _stringBufferAppendEscaped(long long n) {
+        StringBuffer_T b = StringBuffer_create(4096);
+        for (long long i = 0; i < n; i++) {
+                if ((i & 63) == 0)
+                        StringBuffer_clear(b);
+                StringBuffer_appendEscaped(b, "/usr/bin/java -Xmx2g -jar <server> & echo done", _html);
+        }
+        sink = StringBuffer_length(b);
+        StringBuffer_free(&b);
+}
+
+
+/* ------------------------------------------------------------------------ Str */
+
+
+static void _strIsEqual(long long n) {
+        const char *a = "monit-service-name-0001", *b[] = {"monit-service-name-0001", "monit-service-name-0002"};
+        long long found = 0;
+        for (long long i = 0; i < n; i++)
+                found += Str_isEqual(a, b[i & 1]);
+        sink = found;
+}
+
+
+static void _strStartsWith(long long n) {
+        const char *a[] = {"/proc/self/mountinfo", "/var/log/messages"};
+        long long found = 0;
+        for (long long i = 0; i < n; i++)
+                found += Str_startsWith(a[i & 1], "/proc");
+        sink = found;
+}
+
+
+static void _strTrim(long long n) {
+        char buf[64];
+        long long length = 0;
+        for (long long i = 0; i < n; i++) {
+                strcpy(buf, "  \t value with blanks \r\n");
+                length += strlen(Str_trim(buf));
+        }
+        sink = length;
+}
+
+
+static void _strSub(long long n) {
+        const char *a = "GET /collector?service=nginx&token=abcdefghijklmnopqrstuvwxyz HTTP/1.1";
+        long long found = 0;
+        for (long long i = 0; i < n; i++)
+                found += Str_sub(a, i & 1 ? "http/1.1" : "HTTP/2") != NULL;
+        sink = found;
+}
+
+
+static void _strReplaceChar(long long n) {
+        char buf[128];
+        long long length = 0;
+        for (long long i = 0; i < n; i++) {
+                strcpy(buf, "/var/lib/monit/events/1.2.3/service/filesystem/rootfs/usage");
+                length += *Str_replaceChar(buf, '/', '_');
+        }
+        sink = length;
+}
+
+
+static void _strParseInt(long long n) {
+        const char *a[] = {"12345", "-987654", "42"};
+        long long sum = 0;
+        for (long long i = 0; i < n; i++)
+                sum += Str_parseInt(a[i % 3]);
+        sink = sum;
+}
+
+
+static void _strHash(long long n) {
+        const char *a[] = {"nginx", "postgresql-main", "filesystem-rootfs"};
+        long long sum = 0;
+        for (long long i = 0; i < n; i++)
+                sum += Str_hash(a[i % 3]);
+        sink = sum;
+}
+
+
+static void _strMatch(long long n) {
+        long long found = 0;
+        for (long long i = 0; i < n; i++)
+                found += Str_match("^[^@ ]+@([-a-zA-Z0-9]+\\.)+[a-zA-Z]{2,}$", "foo@bar.baz");
+        sink = found;
+}
+
+
+/* ----------------------------------------------------------------------- Time */
+
+
+static void _timeIncron(long long n) {
+        long long found = 0;
+        for (long long i = 0; i < n; i++)
+                found += Time_incron("0,15,30,45 9-17 * * 1-5", 1267441200 + i * 60);
+        sink = found;
+}
+
+
+static void _timeMatchCron(long long n) {
+        TimeCron_T cron;
+        int parsed = Time_parseCron("0,15,30,45 9-17 * * 1-5", &cron);
+        assert(parsed);
+        long long found = 0;
+        for (long long i = 0; i < n; i++)
+                found += Time_matchCron(&cron, 1267441200 + i * 60);
+        sink = found;
+}
+
+
+static void _timeNextCron(long long n) {
+        TimeCron_T cron;
+        int parsed = Time_parseCron("0 3 1 * *", &cron);
+        assert(parsed);
+        long long sum = 0;
+        for (long long i = 0; i < n; i++)
+                sum += Time_nextCron(&cron, 1267441200 + (i & 1023) * 3600);
+        sink = sum;
+}
+
+
+static void _timeFmt(long long n) {
+        char buf[STRLEN];
+        long long length = 0;
+        for (long long i = 0; i < n; i++)
+                length += strlen(Time_fmt(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", 1267441200 + (i & 1)));
+        sink = length;
+}
+
+
+static void _timeString(long long n) {
+        char buf[STRLEN];
+        long long length = 0;
+        for (long long i = 0; i < n; i++)
+                length += strlen(Time_string(1267441200 + (i & 1), buf));
+        sink = length;
+}
+
+
+int main(void) {
+
+        setenv("TZ", "CET", 1);
+        tzset();
+
+        Bootstrap(); // Need to initialize library
+
+        _run("StringBuffer_append", 0, _stringBufferAppend);
+        _run("StringBuffer_appendInt", 0, _stringBufferAppendInt);
+        _run("StringBuffer_appendEscaped", 0, _stringBufferAppendEscaped);
+        _run("Str_isEqual", 0, _strIsEqual);
+        _run("Str_startsWith", 0, _strStartsWith);
+        _run("Str_trim", 0, _strTrim);
+        _run("Str_sub", 70, _strSub);
+        _run("Str_replaceChar", 59, _strReplaceChar);
+        _run("Str_parseInt", 0, _strParseInt);
+        _run("Str_hash", 0, _strHash);
+        _run("Str_match", 0, _strMatch);
+        _run("Time_incron", 0, _timeIncron);
+        _run("Time_matchCron", 0, _timeMatchCron);
+        _run("Time_nextCron", 0, _timeNextCron);
+        _run("Time_fmt", 0, _timeFmt);
+        _run("Time_string", 0, _timeString);
+
+        return 0;
+}
@@ -172,6 +172,30 @@ int main(void) {
                 assert(Str_parseLLong(Command_getEnv(c, "PID")) > 1);
                 Command_vSetEnv(c, "ZERO", NULL);
                 assert(Str_isEqual(Command_getEnv(c, "ZERO"), ""));
+                // Overwrite with a longer and a shorter value
+                Command_setEnv(c, "PAT", "Lewis Carroll");
+                assert(Str_isEqual(Command_getEnv(c, "PAT"), "Lewis Carroll"));
+                Command_setEnv(c, "PAT", "L");
+                assert(Str_isEqual(Command_getEnv(c, "PAT"), "L"));
+                assert(Str_isEqual(Command_getEnv(c, "PATH"), ""));
+                // Value longer than the vSetEnv stack buffer
+                char value[1024];
+                memset(value, 'x', sizeof(value) - 1);
+                value[sizeof(value) - 1] = 0;
+                Command_vSetEnv(c, "LONG", "%s", value);
+                assert(Str_isEqual(Command_getEnv(c, "LONG"), value));
+                // Many variables, grow the environment
+                for (int i = 0; i < 1000; i++) {
+                        char name[32];
+                        snprintf(name, sizeof(name), "VAR%d", i);
+                        Command_vSetEnv(c, name, "%d", i);
+                }
+                for (int i = 0; i < 1000; i++) {
+                        char name[32];
+                        snprintf(name, sizeof(name), "VAR%d", i);
+                        assert(Str_parseInt(Command_getEnv(c, name)) == i);
+                }
+                assert(Str_isEqual(Command_getEnv(c, "PAT"), "L"));
                 Command_free(&c);
                 assert(!c);
         }
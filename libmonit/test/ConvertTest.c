@@ -4,6 +4,9 @@
 #include <assert.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
 
 #include "Bootstrap.h"
 #include "Str.h"
@@ -73,6 +76,54 @@ int main(void) {
         }
         printf("=> Test2: OK\n\n");
 
+        printf("=> Test3: Convert_int2str and Convert_uint2str\n");
+        {
+                char str[21];
+                char expect[32];
+                assert(Convert_int2str(0, str) == 1 && Str_isEqual(str, "0"));
+                assert(Convert_int2str(-7, str) == 2 && Str_isEqual(str, "-7"));
+                assert(Convert_int2str(LLONG_MAX, str) == 19 && Str_isEqual(str, "9223372036854775807"));
+                assert(Convert_int2str(LLONG_MIN, str) == 20 && Str_isEqual(str, "-9223372036854775808"));
+                assert(Convert_uint2str(ULLONG_MAX, str) == 20 && Str_isEqual(str, "18446744073709551615"));
+                for (long long i = -100000; i <= 100000; i += 7) {
+                        snprintf(expect, sizeof(expect), "%lld", i * 1000003);
+                        assert(Convert_int2str(i * 1000003, str) == (int)strlen(expect));
+                        assert(Str_isEqual(str, expect));
+                }
+        }
+        printf("=> Test3: OK\n\n");
+
+        printf("=> Test4: Convert_double2str\n");
+        {
+                char str[32];
+                char expect[32];
+                double values[] = {0., -0., 0.05, 0.15, 0.25, 0.35, 2.5, 12.25, -0.04, 99.95, 100., 1234567.891, -98.765, 1e-9, 0.999999999, 123456789012.5};
+                for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+                        for (int precision = 0; precision <= 3; precision++) {
+                                snprintf(expect, sizeof(expect), "%.*f", precision, values[i]);
+                                assert(Convert_double2str(values[i], precision, str) == (int)strlen(expect));
+                                assert(Str_isEqual(str, expect));
+                        }
+                }
+                srand(42);
+                for (int i = 0; i < 100000; i++) {
+                        double value = (rand() - RAND_MAX / 2) / (double)(rand() % 10000 + 1);
+                        int precision = rand() % 10;
+                        int length = Convert_double2str(value, precision, str);
+                        if (length < 0) {
+                                assert(fabs(value) * pow(10, precision) >= 1e15);
+                                continue;
+                        }
+                        snprintf(expect, sizeof(expect), "%.*f", precision, value);
+                        assert(length == (int)strlen(expect));
+                        assert(Str_isEqual(str, expect));
+                }
+                assert(Convert_double2str(1e15, 1, str) == -1);
+                assert(Convert_double2str(NAN, 1, str) == -1);
+                assert(Convert_double2str(INFINITY, 1, str) == -1);
+        }
+        printf("=> Test4: OK\n\n");
+
         printf("============> Convert Tests: OK\n\n");
         return 0;
 }
@@ -0,0 +1,107 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "Bootstrap.h"
+#include "Str.h"
+#include "HashMap.h"
+
+/**
+ * HashMap.c unity tests.
+ */
+
+
+static void _count(__attribute__ ((unused)) const void *key, void *value, void *ap) {
+        *(long *)ap += (long)value;
+}
+
+
+int main(void) {
+        HashMap_T M = NULL;
+
+        Bootstrap(); // Need to initialize library
+
+        printf("============> Start HashMap Tests\n\n");
+
+        printf("=> Test0: create\n");
+        {
+                M = HashMap_new(HashMap_String, 0);
+                assert(M);
+                assert(HashMap_length(M) == 0);
+                assert(HashMap_get(M, "none") == NULL);
+                assert(HashMap_remove(M, "none") == NULL);
+                HashMap_free(&M);
+                assert(M == NULL);
+        }
+        printf("=> Test0: OK\n\n");
+
+        printf("=> Test1: string keys\n");
+        {
+                char keys[1000][16];
+                M = HashMap_new(HashMap_String, 0);
+                for (int i = 0; i < 1000; i++) {
+                        snprintf(keys[i], sizeof(keys[i]), "service%d", i);
+                        assert(HashMap_put(M, keys[i], keys[i]) == NULL);
+                }
+                assert(HashMap_length(M) == 1000);
+                for (int i = 0; i < 1000; i++) {
+                        char key[16];
+                        // The keys are compared by value
+                        snprintf(key, sizeof(key), "service%d", i);
+                        assert(HashMap_get(M, key) == keys[i]);
+                }
+                assert(HashMap_get(M, "service1000") == NULL);
+                // Replace
+                assert(HashMap_put(M, keys[5], "five") == keys[5]);
+                assert(Str_isEqual(HashMap_get(M, "service5"), "five"));
+                assert(HashMap_length(M) == 1000);
+                HashMap_free(&M);
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: integer keys and removal\n");
+        {
+                M = HashMap_new(HashMap_Integer, 100);
+                for (long long i = 1; i <= 5000; i++)
+                        HashMap_putInt(M, i * 7919, (void *)(long)i);
+                assert(HashMap_length(M) == 5000);
+                // Remove every other key, the remaining keys must stay reachable
+                for (long long i = 1; i <= 5000; i += 2)
+                        assert(HashMap_removeInt(M, i * 7919) == (void *)(long)i);
+                assert(HashMap_length(M) == 2500);
+                for (long long i = 1; i <= 5000; i++)
+                        assert(HashMap_getInt(M, i * 7919) == (i % 2 ? NULL : (void *)(long)i));
+                assert(HashMap_removeInt(M, 7919) == NULL);
+                assert(HashMap_getInt(M, -1) == NULL);
+                HashMap_putInt(M, -1, (void *)1L);
+                assert(HashMap_getInt(M, -1) == (void *)1L);
+                HashMap_free(&M);
+        }
+        printf("=> Test2: OK\n\n");
+
+        printf("=> Test3: HashMap_map() & HashMap_clear()\n");
+        {
+                M = HashMap_new(HashMap_String, 0);
+                HashMap_put(M, "a", (void *)1L);
+                HashMap_put(M, "b", (void *)2L);
+                HashMap_put(M, "c", (void *)3L);
+                long sum = 0;
+                HashMap_map(M, _count, &sum);
+                assert(sum == 6);
+                HashMap_clear(M);
+                assert(HashMap_length(M) == 0);
+                assert(HashMap_get(M, "a") == NULL);
+                HashMap_put(M, "a", (void *)4L);
+                assert(HashMap_get(M, "a") == (void *)4L);
+                HashMap_free(&M);
+        }
+        printf("=> Test3: OK\n\n");
+
+        printf("============> HashMap Tests: OK\n\n");
+
+        return 0;
+}
+
@@ -0,0 +1,130 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Bootstrap.h"
+#include "Str.h"
+#include "io/StatBatch.h"
+
+/**
+ * StatBatch.c unity tests.
+ */
+
+
+static bool _isEqual(struct stat *a, struct stat *b) {
+        return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_mode == b->st_mode && a->st_nlink == b->st_nlink && a->st_uid == b->st_uid && a->st_gid == b->st_gid && a->st_size == b->st_size && a->st_mtime == b->st_mtime && a->st_ctime == b->st_ctime;
+}
+
+
+int main(void) {
+        StatBatch_T B = NULL;
+
+        Bootstrap(); // Need to initialize library
+
+        printf("============> Start StatBatch Tests\n\n");
+
+        printf("=> Test0: create\n");
+        {
+                B = StatBatch_new(0);
+                assert(B);
+                printf("\tio_uring: %s\n", StatBatch_isBatched(B) ? "yes" : "no");
+                StatBatch_run(B); // Empty batch
+                StatBatch_free(&B);
+                assert(B == NULL);
+        }
+        printf("=> Test0: OK\n\n");
+
+        printf("=> Test1: the result is the same as stat(2)\n");
+        {
+                const char *paths[] = {"/", "/tmp", "/etc/passwd", "/dev/null", ".", "/nonexistent/file", "", "/tmp/", "/tmp/..", "/etc/passwd/x", "StatBatchTest.c"};
+                int count = sizeof(paths) / sizeof(paths[0]);
+                B = StatBatch_new(2); // Grows
+                for (int i = 0; i < count; i++)
+                        assert(StatBatch_add(B, paths[i]) == i);
+                StatBatch_run(B);
+                for (int i = 0; i < count; i++) {
+                        struct stat a, b;
+                        int rv = stat(paths[i], &a) == 0 ? 0 : errno;
+                        assert(StatBatch_get(B, i, &b) == rv);
+                        if (rv == 0)
+                                assert(_isEqual(&a, &b));
+                }
+                StatBatch_free(&B);
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: more files than the ring size and reuse\n");
+        {
+                B = StatBatch_new(0);
+                for (int cycle = 0; cycle < 3; cycle++) {
+                        StatBatch_clear(B);
+                        for (int i = 0; i < 1000; i++)
+                                StatBatch_add(B, i % 2 ? "/" : "/nonexistent");
+                        StatBatch_run(B);
+                        struct stat a, b;
+                        assert(stat("/", &a) == 0);
+                        for (int i = 0; i < 1000; i++) {
+                                if (i % 2) {
+                                        assert(StatBatch_get(B, i, &b) == 0);
+                                        assert(_isEqual(&a, &b));
+                                } else {
+                                        assert(StatBatch_get(B, i, &b) == ENOENT);
+                                }
+                        }
+                }
+                StatBatch_free(&B);
+        }
+        printf("=> Test2: OK\n\n");
+
+        printf("=> Test3: the renamed directory is opened again\n");
+        {
+                char dir[] = "/tmp/StatBatchTest.XXXXXX";
+                char moved[64];
+                char path[256];
+                assert(mkdtemp(dir));
+                snprintf(moved, sizeof(moved), "%s.moved", dir);
+                snprintf(path, sizeof(path), "%s/file", dir);
+                FILE *f = fopen(path, "w");
+                assert(f);
+                fclose(f);
+                struct stat st;
+                B = StatBatch_new(0);
+                StatBatch_add(B, path);
+                StatBatch_run(B);
+                assert(StatBatch_get(B, 0, &st) == 0);
+                // The file is not found after the directory was renamed although the old descriptor still refers to it
+                assert(rename(dir, moved) == 0);
+                StatBatch_clear(B);
+                StatBatch_add(B, path);
+                StatBatch_run(B);
+                assert(StatBatch_get(B, 0, &st) == ENOENT);
+                // The new directory with the same path is found
+                assert(mkdir(dir, 0700) == 0);
+                f = fopen(path, "w");
+                assert(f);
+                fputs("data", f);
+                fclose(f);
+                StatBatch_clear(B);
+                StatBatch_add(B, path);
+                StatBatch_run(B);
+                assert(StatBatch_get(B, 0, &st) == 0);
+                assert(st.st_size == 4);
+                StatBatch_free(&B);
+                unlink(path);
+                rmdir(dir);
+                snprintf(path, sizeof(path), "%s/file", moved);
+                unlink(path);
+                rmdir(moved);
+        }
+        printf("=> Test3: OK\n\n");
+
+        printf("============> StatBatch Tests: OK\n\n");
+
+        return 0;
+}
@@ -527,6 +527,33 @@ int main(void) {
         }
         printf("=> Test25: OK\n\n");
 
+        printf("=> Test26: sub and has\n");
+        {
+                char s[] = "Haystack with Needle";
+                assert(Str_sub(s, "needle") == s + 14);
+                assert(Str_sub(s, "HAY") == s);
+                assert(Str_sub("foo bar baz", "bar") && Str_isEqual(Str_sub("foo bar baz", "bar"), "bar baz"));
+                assert(Str_sub("aab", "ab") && Str_isEqual(Str_sub("aab", "ab"), "ab"));
+                assert(Str_sub("/var/log/1.log", "1.LOG"));
+                assert(!Str_sub("foo", "foo bar"));
+                assert(!Str_sub("foo", ""));
+                assert(!Str_sub(NULL, "foo"));
+                assert(!Str_sub("foo", NULL));
+                assert(Str_has("(')", "'bar' (baz)"));
+                assert(!Str_has(",;", "'bar' (baz)"));
+                assert(!Str_has(",;", NULL));
+                assert(!Str_has("", "foo"));
+                char t[] = "line\r\nnext";
+                assert(Str_isEqual(Str_chomp(t), "line"));
+                char u[] = "a,b,c";
+                assert(Str_isEqual(Str_replaceChar(u, 0, 'x'), "a,b,c"));
+                assert(Str_isEqual(Str_replaceChar(u, ',', ' '), "a b c"));
+                char v[4];
+                assert(Str_isEqual(Str_copy(v, "abc", 3), "abc"));
+                assert(Str_isEqual(Str_copy(v, "ab", 3), "ab"));
+        }
+        printf("=> Test26: OK\n\n");
+
         printf("============> Str Tests: OK\n\n");
         return 0;
 }
@@ -5,6 +5,10 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <limits.h>
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
 
 #include "Bootstrap.h"
 #include "Str.h"
@@ -24,6 +28,16 @@ static void append(StringBuffer_T B, const char *s, ...) {
 }
 
 
+static const char *_escapeHTML(int c) {
+        switch (c) {
+                case '<': return "&lt;";
+                case '>': return "&gt;";
+                case '&': return "&amp;";
+                default:  return NULL;
+        }
+}
+
+
 int main(void) {
         StringBuffer_T sb;
 
@@ -438,7 +452,123 @@ int main(void) {
                 assert(sb == NULL);
         }
         printf("=> Test15: OK\n\n");
+
+        printf("=> Test16: zlib compression\n");
+        {
+                const char *input = "<aaaaaaaaaa><bbbbbbbbbb></bbbbbbbbbb><bbbbbbbbbb></bbbbbbbbbb></aaaaaaaaaa>";
+                sb = StringBuffer_new(input);
+                size_t compressedLength;
+                const unsigned char *compressed = StringBuffer_toDeflated(sb, 6, &compressedLength);
+                assert(compressed);
+                assert(compressedLength > 6 && compressedLength < strlen(input));
+                // zlib header: deflate method with 32K window and a valid check value (see 2.2 in https://www.ietf.org/rfc/rfc1950.txt)
+                assert(compressed[0] == 0x78);
+                assert(((compressed[0] << 8) | compressed[1]) % 31 == 0);
+                char output[256] = {};
+                uLongf outputLength = sizeof(output);
+                assert(uncompress((Bytef *)output, &outputLength, compressed, compressedLength) == Z_OK);
+                assert(outputLength == strlen(input));
+                assert(Str_isEqual(output, input));
+                StringBuffer_clear(sb);
+                compressed = StringBuffer_toDeflated(sb, 6, &compressedLength);
+                assert(compressed == NULL);
+                assert(compressedLength == 0);
+                StringBuffer_free(&sb);
+                assert(sb == NULL);
+        }
+        printf("=> Test16: OK\n\n");
 #endif
+
+        printf("=> Test17: append bytes\n");
+        {
+                const unsigned char bytes[] = {0x62, 0x00, 0xff, 0x00, 0x63};
+                sb = StringBuffer_create(4);
+                StringBuffer_append(sb, "a");
+                StringBuffer_appendBytes(sb, bytes, sizeof(bytes));
+                StringBuffer_appendBytes(sb, NULL, 10);
+                StringBuffer_appendBytes(sb, bytes, 0);
+                assert(StringBuffer_length(sb) == 6);
+                assert(memcmp(StringBuffer_toString(sb), "ab\0\xff\0c", 7) == 0);
+                for (int i = 0; i < 1000; i++)
+                        StringBuffer_appendBytes(sb, bytes, sizeof(bytes));
+                assert(StringBuffer_length(sb) == 5006);
+                assert(memcmp(StringBuffer_toString(sb) + 5001, bytes, sizeof(bytes)) == 0);
+                StringBuffer_append(sb, "%s", "x");
+                assert(StringBuffer_length(sb) == 5007);
+                assert(StringBuffer_toString(sb)[5006] == 'x');
+                StringBuffer_free(&sb);
+                assert(sb == NULL);
+        }
+        printf("=> Test17: OK\n\n");
+
+        printf("=> Test18: append string, char, int and escaped\n");
+        {
+                sb = StringBuffer_create(1);
+                StringBuffer_appendString(sb, "a%sb");
+                StringBuffer_appendString(sb, NULL);
+                StringBuffer_appendChar(sb, '|');
+                StringBuffer_appendInt(sb, 0);
+                StringBuffer_appendChar(sb, '|');
+                StringBuffer_appendInt(sb, -42);
+                StringBuffer_appendChar(sb, '|');
+                StringBuffer_appendInt(sb, LLONG_MAX);
+                StringBuffer_appendChar(sb, '|');
+                StringBuffer_appendInt(sb, LLONG_MIN);
+                assert(Str_isEqual(StringBuffer_toString(sb), "a%sb|0|-42|9223372036854775807|-9223372036854775808"));
+                StringBuffer_clear(sb);
+                StringBuffer_appendEscaped(sb, "<a href='x'>&</a>", _escapeHTML);
+                assert(Str_isEqual(StringBuffer_toString(sb), "&lt;a href='x'&gt;&amp;&lt;/a&gt;"));
+                StringBuffer_clear(sb);
+                StringBuffer_appendEscaped(sb, "plain", _escapeHTML);
+                StringBuffer_appendEscaped(sb, NULL, _escapeHTML);
+                StringBuffer_appendEscaped(sb, "", _escapeHTML);
+                assert(Str_isEqual(StringBuffer_toString(sb), "plain"));
+                StringBuffer_free(&sb);
+                assert(sb == NULL);
+        }
+        printf("=> Test18: OK\n\n");
+
+        printf("=> Test19: reserve and geometric growth\n");
+        {
+                sb = StringBuffer_create(1);
+                StringBuffer_reserve(sb, 10000);
+                const char *buffer = StringBuffer_toString(sb);
+                for (int i = 0; i < 1000; i++)
+                        StringBuffer_append(sb, "%09d\n", i);
+                assert(StringBuffer_toString(sb) == buffer); // No reallocation
+                assert(StringBuffer_length(sb) == 10000);
+                assert(Str_startsWith(StringBuffer_substring(sb, 9990), "000000999\n"));
+                StringBuffer_clear(sb);
+                for (int i = 0; i < 100000; i++)
+                        StringBuffer_append(sb, "%s", "abcdefghij");
+                assert(StringBuffer_length(sb) == 1000000);
+                StringBuffer_append(sb, "%s%0200d", "x", 7);
+                assert(StringBuffer_length(sb) == 1000201);
+                assert(StringBuffer_toString(sb)[1000200] == '7');
+                StringBuffer_free(&sb);
+                assert(sb == NULL);
+        }
+        printf("=> Test19: OK\n\n");
+
+        printf("=> Test20: formatted append without the libc parser\n");
+        {
+                sb = StringBuffer_create(4);
+                StringBuffer_append(sb, "<a>%d</a><b>%lld</b><c>%llu</c><d>%.1f</d><e>%.1lf</e><f>%o</f><g>%s</g><h>%c%%</h><i>%zu</i><j>%lx</j>",
+                                    -42, LLONG_MIN, ULLONG_MAX, 99.95, -0.04, 0755, "x", 'y', (size_t)12, 0xbeefUL);
+                assert(Str_isEqual(StringBuffer_toString(sb), "<a>-42</a><b>-9223372036854775808</b><c>18446744073709551615</c><d>100.0</d><e>-0.0</e><f>755</f><g>x</g><h>y%</h><i>12</i><j>beef</j>"));
+                StringBuffer_clear(sb);
+                // Flags, width and the other conversions go through vsnprintf
+                StringBuffer_append(sb, "%5d|%-3s|%.2s|%g|%.12f|%f", 7, "a", "xyz", 0.5, 1.5, 1e20);
+                assert(Str_isEqual(StringBuffer_toString(sb), "    7|a  |xy|0.5|1.500000000000|100000000000000000000.000000"));
+                StringBuffer_clear(sb);
+                StringBuffer_appendDouble(sb, 12.25, 1);
+                StringBuffer_appendChar(sb, ' ');
+                StringBuffer_appendDouble(sb, 3.14159, 3);
+                assert(Str_isEqual(StringBuffer_toString(sb), "12.2 3.142"));
+                StringBuffer_free(&sb);
+        }
+        printf("=> Test20: OK\n\n");
+
         printf("============> StringBuffer Tests: OK\n\n");
 
         return 0;
@@ -349,6 +349,75 @@ int main(void) {
         }
         printf("=> Test11: OK\n\n");
 
+        printf("=> Test12: Time_monotonicMilli\n");
+        {
+                long long t1 = Time_monotonicMilli();
+                usleep(500000);
+                long long t2 = Time_monotonicMilli();
+                assert(t2 - t1 >= 490LL);
+        }
+        printf("=> Test12: OK\n\n");
+
+        printf("=> Test13: cached local time across minutes and a DST change\n");
+        {
+                setenv("TZ", "Europe/Oslo", 1);
+                tzset();
+                char s[STRLEN], t[STRLEN], r[26];
+                struct tm tm;
+                // 2024-03-31 01:00:00 UTC, the clock jumps from 02:00 to 03:00 local time
+                for (time_t i = 1711846800 - 3600; i < 1711846800 + 3600; i++) {
+                        localtime_r(&i, &tm);
+                        strftime(t, sizeof(t), "%Y-%m-%d %H:%M:%S %z", &tm);
+                        assert(Str_isEqual(Time_fmt(s, sizeof(s), "%Y-%m-%d %H:%M:%S %z", i), t));
+                        assert(Str_isEqual(Time_fmt(s, sizeof(s), "%Y-%m-%d %H:%M:%S %z", i), t));
+                        assert(Time_seconds(i) == tm.tm_sec && Time_minutes(i) == tm.tm_min && Time_hour(i) == tm.tm_hour);
+                        assert(Time_string(i, r)[18] == t[12]);
+                }
+                // Too small output buffer
+                assert(*Time_fmt(s, 5, "%Y-%m-%d", 1711846800) == 0);
+                assert(Str_isEqual(Time_fmt(s, 11, "%Y-%m-%d", 1711846800), "2024-03-31"));
+                assert(Str_isEqual(Time_string(1711846800, r), "Sun, 31 Mar 2024 03:00:00"));
+                assert(Str_isEqual(Time_string(1711846799, r), "Sun, 31 Mar 2024 01:59:59"));
+        }
+        printf("=> Test13: OK\n\n");
+
+        printf("=> Test14: Time_parseCron, Time_matchCron and Time_nextCron\n");
+        {
+                TimeCron_T c;
+                assert(! Time_parseCron("1- * * * *", &c));
+                assert(! Time_parseCron("* * * *", &c));
+                assert(! Time_parseCron("* * * * * *", &c));
+                assert(! Time_parseCron("a * * * *", &c));
+                assert(! Time_parseCron("5* * * * *", &c));
+                assert(Time_parseCron(" 0,30 8-9,17 * * 1-5 ", &c));
+                assert(c.minutes == (1ULL | 1ULL << 30) && c.hours == (1U << 8 | 1U << 9 | 1U << 17) && c.weekdays == 0x3e);
+                assert(Time_matchCron(&c, Time_build(2024, 3, 29, 9, 30, 10)));
+                assert(! Time_matchCron(&c, Time_build(2024, 3, 30, 9, 30, 10)));
+                // Friday 17:30 -> Monday 08:00
+                assert(Time_nextCron(&c, Time_build(2024, 3, 29, 17, 30, 0)) == Time_build(2024, 4, 1, 8, 0, 0));
+                // 02:30 does not exist on the day of the DST change in Europe/Oslo
+                assert(Time_parseCron("30 2 * * *", &c));
+                assert(Time_nextCron(&c, Time_build(2024, 3, 30, 12, 0, 0)) == Time_build(2024, 4, 1, 2, 30, 0));
+                // Never matches
+                assert(Time_parseCron("* * 31 2 *", &c));
+                assert(Time_nextCron(&c, Time_build(2024, 3, 30, 12, 0, 0)) == -1);
+                // Compare with a minute by minute search
+                const char *specs[] = {"* * * * *", "15 * * * *", "*/ 0 0 * *", "0-5,58 23 * * 0", "59 1-3 29-31 * *", NULL};
+                for (int i = 0; specs[i]; i++) {
+                        if (! Time_parseCron(specs[i], &c))
+                                continue;
+                        for (time_t from = Time_build(2024, 3, 29, 22, 58, 31); from < Time_build(2024, 4, 2, 0, 0, 0); from += 4001) {
+                                time_t t = from - from % 60 + 60;
+                                while (! Time_matchCron(&c, t))
+                                        t += 60;
+                                assert(Time_nextCron(&c, from) == t);
+                        }
+                }
+                // Time_incron uses the same parser
+                assert(Time_incron("* 8-9 29 3 5", Time_build(2024, 3, 29, 9, 30, 10)));
+        }
+        printf("=> Test14: OK\n\n");
+
         printf("============> Time Tests: OK\n\n");
 
         return 0;
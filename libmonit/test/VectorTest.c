@@ -0,0 +1,105 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "Bootstrap.h"
+#include "Str.h"
+#include "Vector.h"
+
+/**
+ * Vector.c unity tests.
+ */
+
+
+typedef struct {
+        int id;
+        char name[16];
+} item_t;
+
+
+static int _compareInt(const void *a, const void *b) {
+        return *(const int *)a - *(const int *)b;
+}
+
+
+int main(void) {
+        Vector_T V = NULL;
+
+        Bootstrap(); // Need to initialize library
+
+        printf("============> Start Vector Tests\n\n");
+
+        printf("=> Test0: create\n");
+        {
+                V = Vector_new(sizeof(int), 0);
+                assert(V);
+                assert(Vector_length(V) == 0);
+                assert(Vector_data(V) == NULL);
+                Vector_free(&V);
+                assert(V == NULL);
+        }
+        printf("=> Test0: OK\n\n");
+
+        printf("=> Test1: Vector_append() & Vector_get()\n");
+        {
+                V = Vector_new(sizeof(int), 0);
+                for (int i = 0; i < 1000; i++)
+                        Vector_append(V, &i);
+                assert(Vector_length(V) == 1000);
+                for (int i = 0; i < 1000; i++)
+                        assert(*(int *)Vector_get(V, i) == i);
+                // The elements are contiguous
+                int *data = Vector_data(V);
+                assert(data[999] == 999);
+                Vector_free(&V);
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: struct elements, Vector_insert() & Vector_remove()\n");
+        {
+                V = Vector_new(sizeof(item_t), 2);
+                item_t a = {1, "one"}, b = {2, "two"}, c = {3, "three"};
+                Vector_append(V, &a);
+                Vector_append(V, &c);
+                item_t *inserted = Vector_insert(V, 1, &b);
+                assert(inserted->id == 2);
+                assert(Str_isEqual(((item_t *)Vector_get(V, 0))->name, "one"));
+                assert(Str_isEqual(((item_t *)Vector_get(V, 1))->name, "two"));
+                assert(Str_isEqual(((item_t *)Vector_get(V, 2))->name, "three"));
+                Vector_remove(V, 0);
+                assert(Vector_length(V) == 2);
+                assert(((item_t *)Vector_get(V, 0))->id == 2);
+                Vector_insert(V, 2, &a);
+                assert(((item_t *)Vector_get(V, 2))->id == 1);
+                Vector_free(&V);
+        }
+        printf("=> Test2: OK\n\n");
+
+        printf("=> Test3: Vector_pop(), Vector_sort() & Vector_clear()\n");
+        {
+                V = Vector_new(sizeof(int), 0);
+                int values[] = {5, 3, 9, 1, 7};
+                for (int i = 0; i < 5; i++)
+                        Vector_append(V, &values[i]);
+                Vector_sort(V, _compareInt);
+                for (int i = 0; i < 4; i++)
+                        assert(*(int *)Vector_get(V, i) < *(int *)Vector_get(V, i + 1));
+                int last = 0;
+                assert(Vector_pop(V, &last));
+                assert(last == 9);
+                assert(Vector_length(V) == 4);
+                Vector_clear(V);
+                assert(Vector_length(V) == 0);
+                assert(! Vector_pop(V, &last));
+                Vector_free(&V);
+        }
+        printf("=> Test3: OK\n\n");
+
+        printf("============> Vector Tests: OK\n\n");
+
+        return 0;
+}
+
@@ -8,6 +8,11 @@ ConvertTest && \
 TimeTest && \
 SystemTest && \
 ListTest && \
+VectorTest && \
+HashMapTest && \
+AtomTest && \
+ArenaTest && \
+StatBatchTest && \
 StringBufferTest && \
 DirTest && \
 InputStreamTest && \
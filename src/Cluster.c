@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "monit.h"
+#include "Cluster.h"
+
+// libmonit
+#include "system/Time.h"
+#include "exceptions/AssertException.h"
+#include "exceptions/IOException.h"
+
+
+/**
+ *  The peers are polled with the "/_cluster" request of their HTTP
+ *  interface, which returns the peer monit ID and the status of the cluster
+ *  services owned by the peer. The peer is live if it replied within the
+ *  cluster timeout, the poll interval is one third of the timeout.
+ *
+ *  The owner of a cluster service is the live node with the highest score
+ *  of its monit ID and the service name (rendezvous hashing). Every node
+ *  computes the same owner from the same set of live nodes without any
+ *  coordination.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define CLUSTER_REPLYLIMIT 1048576
+
+
+static struct {
+        bool running;                        /**< true if the cluster thread runs */
+        bool stop;                        /**< Stop request for the cluster thread */
+        bool changed;            /**< The live nodes changed since Cluster_changed() */
+        Thread_T thread;
+        Mutex_T mutex;
+        Sem_T cond;
+} _cluster = {};
+
+
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _init(void) {
+        Mutex_init(_cluster.mutex);
+        Sem_init(_cluster.cond);
+}
+
+
+static int _interval(void) {
+        return MAX(1, Run.cluster.timeout / 3);
+}
+
+
+static bool _isLive(ClusterPeer_T p, time_t now) {
+        return p->id && p->seen && now - p->seen < Run.cluster.timeout;
+}
+
+
+static bool _isMember(Service_T s) {
+        ServiceGroup_T g = Util_getServiceGroup(Run.cluster.group);
+        if (g)
+                for (list_t m = g->members->head; m; m = m->next)
+                        if (m->e == s)
+                                return true;
+        return false;
+}
+
+
+/**
+ * Find the live node with the highest score for the service, the caller
+ * must hold the lock
+ * @return The peer which owns the service or NULL if this node owns it
+ */
+static ClusterPeer_T _getOwner(Service_T s) {
+        ClusterPeer_T owner = NULL;
+        const char *id = Run.id;
+        uint64_t score = Util_hash(id, s->name);
+        for (ClusterPeer_T p = Run.cluster.peers; p; p = p->next) {
+                if (p->live) {
+                        uint64_t peer = Util_hash(p->id, s->name);
+                        if (peer > score || (peer == score && strcmp(p->id, id) > 0)) {
+                                owner = p;
+                                id = p->id;
+                                score = peer;
+                        }
+                }
+        }
+        return owner;
+}
+
+
+/**
+ * Update the peer from the reply: the monit ID line followed by the status
+ * line of each service owned by the peer. The caller must hold the lock
+ */
+static void _update(ClusterPeer_T p, char *reply, time_t now) {
+        char *line = strchr(reply, '\n');
+        if (line)
+                *line++ = 0;
+        FREE(p->id);
+        p->id = Str_dup(Str_trim(reply));
+        p->seen = now;
+        // The map keys and values point to the lines of the reply buffer
+        if (p->services)
+                HashMap_clear(p->services);
+        else
+                p->services = HashMap_new(HashMap_String, 0);
+        FREE(p->status);
+        p->status = reply;
+        while (line && *line) {
+                char *next = strchr(line, '\n');
+                if (next)
+                        *next++ = 0;
+                // The line format is "<error> <error hint> <name>"
+                char *name = strchr(line, ' ');
+                if (name)
+                        name = strchr(name + 1, ' ');
+                if (name && *++name)
+                        HashMap_put(p->services, name, line);
+                line = next;
+        }
+}
+
+
+/**
+ * Request the monit ID and the service status of the peer
+ * @return The reply body (the caller owns it) or NULL if the peer didn't reply
+ */
+static char *_request(ClusterPeer_T p) {
+        Socket_T S = Socket_create(p->url->hostname, p->url->port, Socket_Tcp, Socket_Ip, &(p->ssl), _interval() * 1000);
+        if (! S) {
+                DEBUG("Cluster: cannot connect to %s\n", p->url->url);
+                return NULL;
+        }
+        char *reply = NULL;
+        char *auth = Util_getBasicAuthHeader(p->url->user, p->url->password);
+        StringBuffer_T sb = StringBuffer_create(STRLEN);
+        TRY
+        {
+                char buf[STRLEN];
+                int status = 0;
+                if (Socket_print(S,
+                                 "GET %s%s_cluster HTTP/1.0\r\n"
+                                 "Host: %s%s%s:%d\r\n"
+                                 "User-Agent: Monit/%s\r\n"
+                                 "%s"
+                                 "\r\n",
+                                 p->url->path, Str_endsWith(p->url->path, "/") ? "" : "/",
+                                 p->url->ipv6 ? "[" : "", p->url->hostname, p->url->ipv6 ? "]" : "", p->url->port,
+                                 VERSION,
+                                 auth ? auth : "") < 0)
+                        THROW(IOException, "cannot send the request -- %s", STRERROR);
+                if (! Socket_readLine(S, buf, sizeof(buf)) || sscanf(buf, "%*s %d", &status) != 1 || status != 200)
+                        THROW(IOException, "unexpected response -- %s", Str_chomp(buf));
+                // Skip the headers, the body is read until the peer closes the connection
+                while (Socket_readLine(S, buf, sizeof(buf)) && ! (buf[0] == '\r' || buf[0] == '\n'))
+                        ;
+                int n;
+                while ((n = Socket_read(S, buf, sizeof(buf))) > 0) {
+                        if (StringBuffer_length(sb) + n > CLUSTER_REPLYLIMIT)
+                                THROW(IOException, "the reply exceeds %d bytes", CLUSTER_REPLYLIMIT);
+                        StringBuffer_append(sb, "%.*s", n, buf);
+                }
+                if (StringBuffer_length(sb) && *StringBuffer_toString(sb) != '\n')
+                        reply = Str_dup(StringBuffer_toString(sb));
+        }
+        ELSE
+        {
+                DEBUG("Cluster: %s %s\n", p->url->url, Exception_frame.message);
+        }
+        END_TRY;
+        StringBuffer_free(&sb);
+        FREE(auth);
+        Socket_free(&S);
+        return reply;
+}
+
+
+/**
+ * Poll all peers and wake up the daemon if some peer went down or up
+ */
+static void _poll(void) {
+        bool changed = false;
+        for (ClusterPeer_T p = Run.cluster.peers; p; p = p->next) {
+                char *reply = _request(p);
+                time_t now = Time_now();
+                LOCK(_cluster.mutex)
+                {
+                        if (reply)
+                                _update(p, reply, now);
+                        bool live = _isLive(p, now);
+                        if (live != p->live) {
+                                p->live = live;
+                                Log_info("Cluster: node %s is %s\n", p->url->url, live ? "up" : "down");
+                                _cluster.changed = changed = true;
+                        }
+                }
+                END_LOCK;
+        }
+        if (changed && _cluster.running)
+                do_wakeupcall();
+}
+
+
+static void *_thread(__attribute__ ((unused)) void *args) {
+        set_signal_block();
+        LOCK(_cluster.mutex)
+        {
+                while (! _cluster.stop) {
+                        struct timespec wait = {.tv_sec = Time_now() + _interval(), .tv_nsec = 0};
+                        Sem_timeWait(_cluster.cond, _cluster.mutex, wait);
+                        if (_cluster.stop)
+                                break;
+                        Mutex_unlock(_cluster.mutex);
+                        _poll();
+                        Mutex_lock(_cluster.mutex);
+                }
+        }
+        END_LOCK;
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        return NULL;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Cluster_start(void) {
+        pthread_once(&_once, _init);
+        if (! Run.cluster.group || _cluster.running)
+                return;
+        if (! Util_getServiceGroup(Run.cluster.group))
+                Log_warning("Cluster: the service group '%s' doesn't exist\n", Run.cluster.group);
+        int count = 0;
+        for (ClusterPeer_T p = Run.cluster.peers; p; p = p->next)
+                count++;
+        Log_info("Cluster: the services of the group '%s' are shared with %d peer nodes\n", Run.cluster.group, count);
+        _poll();
+        _cluster.changed = false;
+        _cluster.stop = false;
+        Thread_create(_cluster.thread, _thread, NULL);
+        _cluster.running = true;
+}
+
+
+void Cluster_stop(void) {
+        if (_cluster.running) {
+                LOCK(_cluster.mutex)
+                {
+                        _cluster.stop = true;
+                        Sem_signal(_cluster.cond);
+                }
+                END_LOCK;
+                Thread_join(_cluster.thread);
+                _cluster.running = false;
+        }
+}
+
+
+bool Cluster_isOwner(Service_T s) {
+        ASSERT(s);
+        if (! Run.cluster.group || ! _isMember(s))
+                return true;
+        pthread_once(&_once, _init);
+        bool rv;
+        LOCK(_cluster.mutex)
+        {
+                rv = _getOwner(s) == NULL;
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+bool Cluster_getStatus(Service_T s, int *error, int *errorHint) {
+        ASSERT(s);
+        ASSERT(error);
+        ASSERT(errorHint);
+        if (! Run.cluster.group || ! _isMember(s))
+                return false;
+        pthread_once(&_once, _init);
+        bool rv = false;
+        LOCK(_cluster.mutex)
+        {
+                ClusterPeer_T owner = _getOwner(s);
+                if (owner && owner->services) {
+                        const char *line = HashMap_get(owner->services, s->name);
+                        rv = line && sscanf(line, "%d %d", error, errorHint) == 2;
+                }
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+void Cluster_printStatus(StringBuffer_T sb, Service_T (*get)(Service_T)) {
+        ASSERT(sb);
+        ASSERT(get);
+        StringBuffer_append(sb, "%s\n", Run.id);
+        ServiceGroup_T g = Run.cluster.group ? Util_getServiceGroup(Run.cluster.group) : NULL;
+        if (g) {
+                for (list_t m = g->members->head; m; m = m->next) {
+                        Service_T s = get(m->e);
+                        // Only the services checked by this node, the status of the service which moved here is reported after its first check
+                        if (! s->remote && (s->monitor & Monitor_Yes) && ! (s->monitor & Monitor_Init) && Cluster_isOwner(m->e))
+                                StringBuffer_append(sb, "%d %d %s\n", s->error, s->error_hint, s->name);
+                }
+        }
+}
+
+
+bool Cluster_changed(void) {
+        if (! _cluster.running)
+                return false;
+        bool rv;
+        LOCK(_cluster.mutex)
+        {
+                rv = _cluster.changed;
+                _cluster.changed = false;
+        }
+        END_LOCK;
+        return rv;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_CLUSTER_H
+#define MONIT_CLUSTER_H
+
+#include "config.h"
+
+
+/**
+ * Cluster mode. If enabled with "set cluster", the monit instances on
+ * several nodes share the services of the cluster group: each service is
+ * owned by exactly one of the live nodes, which checks it and runs its
+ * start and restart actions, the other nodes skip the service. The owner
+ * is chosen by the rendezvous hashing of the monit IDs of the live nodes
+ * and the service name, so the services are spread across the nodes and
+ * only the services of a failed node move when the set of live nodes
+ * changes.
+ *
+ * A thread polls the peers over their HTTP interface. The reply contains
+ * the status of the services which the peer owns, so the other nodes show
+ * the status of the services they don't check. A peer which didn't reply
+ * within the cluster timeout is considered down, its services are taken
+ * over by the other nodes and the daemon is woken up to check them at once.
+ *
+ * @file
+ */
+
+
+/**
+ * Start the cluster thread. The peers are polled once before the function
+ * returns, so the service ownership is known before the first validation
+ */
+void Cluster_start(void);
+
+
+/**
+ * Stop the cluster thread
+ */
+void Cluster_stop(void);
+
+
+/**
+ * Test if this node owns the service
+ * @param s A service object
+ * @return true if the service is owned by this node or if it doesn't
+ * belong to the cluster group, otherwise false
+ */
+bool Cluster_isOwner(Service_T s);
+
+
+/**
+ * Get the status of the service reported by the node which owns it
+ * @param s A service object
+ * @param error The error flags of the service
+ * @param errorHint The error hint flags of the service
+ * @return true if the service is owned by a peer which reported its
+ * status in the last reply, otherwise false
+ */
+bool Cluster_getStatus(Service_T s, int *error, int *errorHint);
+
+
+/**
+ * Write the status of the cluster services which this node owns to the
+ * buffer, as replied to the peer poll: the first line is the monit ID and
+ * each service has a line with its error flags, error hint flags and name
+ * @param sb The output buffer
+ * @param get The function returning the current status of the service
+ */
+void Cluster_printStatus(StringBuffer_T sb, Service_T (*get)(Service_T));
+
+
+/**
+ * Test and reset the change of the live cluster nodes. Should be called
+ * when the daemon is woken up
+ * @return true if some node went down or up since the last call
+ */
+bool Cluster_changed(void);
+
+
+#endif
+
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#include "monit.h"
+#include "ContentMatch.h"
+#include "LiteralMatch.h"
+
+// libmonit
+#include "exceptions/AssertException.h"
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define T ContentMatch_T
+
+
+struct T {
+        LiteralMatch_T literals;                    /**< The pattern literals */
+};
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+T ContentMatch_new(Match_T ignorelist, Match_T matchlist) {
+        T C;
+        NEW(C);
+        C->literals = LiteralMatch_new();
+        Match_T lists[] = {ignorelist, matchlist};
+        for (int i = 0; i < 2; i++)
+                for (Match_T m = lists[i]; m; m = m->next)
+                        if (m->literal)
+                                m->index = LiteralMatch_add(C->literals, m->literal);
+        return C;
+}
+
+
+void ContentMatch_free(T *C) {
+        ASSERT(C && *C);
+        LiteralMatch_free(&(*C)->literals);
+        FREE(*C);
+}
+
+
+void ContentMatch_scan(T C, const char *line) {
+        ASSERT(C);
+        ASSERT(line);
+        LiteralMatch_scan(C->literals, line);
+}
+
+
+int ContentMatch_test(T C, Match_T pattern, const char *line) {
+        ASSERT(C);
+        ASSERT(pattern);
+        // The regex cannot match if the line doesn't contain the literal string which the pattern requires
+        if (pattern->literal && ! LiteralMatch_contains(C->literals, pattern->index))
+                return REG_NOMATCH;
+        return regexec(pattern->regex_comp, line, 0, NULL, 0);
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_CONTENTMATCH_H
+#define MONIT_CONTENTMATCH_H
+
+#include "config.h"
+
+
+/**
+ * Content match prefilter. The literal strings which the match and ignore
+ * patterns of a file service require (see Match_T.literal) are searched in
+ * each line by one LiteralMatch automaton. A regex is then executed only
+ * if the line contains the pattern's literal, so the cost of testing a line
+ * depends on the line length and the number of candidate patterns, not on
+ * the number of configured patterns. Patterns without a literal are always
+ * executed.
+ *
+ * @file
+ */
+
+
+#define T ContentMatch_T
+typedef struct T *T;
+
+
+/**
+ * Create the automaton for the given pattern lists
+ * @param ignorelist The service ignore patterns
+ * @param matchlist The service match patterns
+ * @return A new automaton object
+ */
+T ContentMatch_new(Match_T ignorelist, Match_T matchlist);
+
+
+/**
+ * Destroy the automaton object
+ * @param C A ContentMatch object reference
+ */
+void ContentMatch_free(T *C);
+
+
+/**
+ * Scan the line and record which pattern literals it contains. Must be
+ * called before ContentMatch_test() for every line
+ * @param C A ContentMatch object
+ * @param line The NUL terminated line
+ */
+void ContentMatch_scan(T C, const char *line);
+
+
+/**
+ * Test the pattern on the last scanned line
+ * @param C A ContentMatch object
+ * @param pattern A pattern from the lists given to ContentMatch_new()
+ * @param line The line passed to the last ContentMatch_scan() call
+ * @return 0 if the pattern matched, otherwise REG_NOMATCH (see regexec(3))
+ */
+int ContentMatch_test(T C, Match_T pattern, const char *line);
+
+
+#undef T
+#endif
@@ -0,0 +1,566 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_FANOTIFY_H
+#include <sys/fanotify.h>
+#include <sys/vfs.h>
+#endif
+
+#include "monit.h"
+#include "DirectoryTree.h"
+
+// libmonit
+#include "system/Time.h"
+#include "util/HashMap.h"
+#include "exceptions/AssertException.h"
+
+/**
+ *  Each directory of the tree has a node with the statistics of the files
+ *  directly in the directory, the totals of its subtree and the list of
+ *  subdirectory nodes.
+ *
+ *  Without the change notification, each walk reads all directories of the
+ *  tree and stats their files, as a file which changes in place (its size
+ *  or modification time) doesn't change its directory. The nodes only keep
+ *  the subdirectory list between the walks.
+ *
+ *  On Linux, the filesystem of the tree is marked with fanotify, reporting
+ *  the parent directory handle and the entry name of each change anywhere
+ *  on the filesystem. The nodes are indexed by their directory handle: the
+ *  event invalidates the node of the directory and marks its ancestors as
+ *  stale, the walk descends only into the stale subtrees and uses the
+ *  totals of the others, so a tree with millions of files costs nothing
+ *  while it doesn't change. The file modified in place invalidates its
+ *  directory too. If the event queue overflows, the whole tree is read
+ *  again. The tracked node is also read again if the directory modification
+ *  or change time changed, and a directory modified in the last second is
+ *  read again in the next walk, as its timestamp may not change if it is
+ *  modified again within the timestamp granularity. The fanotify requires
+ *  the root privileges (CAP_SYS_ADMIN) and Linux 5.9 or later, otherwise
+ *  the tree is walked as described above.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+// Maximum tree depth, deeper directories are not walked
+#define MAXDEPTH 128
+
+
+#if defined(HAVE_SYS_FANOTIFY_H) && defined(FAN_REPORT_DFID_NAME) && defined(FAN_MARK_FILESYSTEM) && defined(MAX_HANDLE_SZ)
+#define FANOTIFY 1
+#define FANOTIFY_MASK (FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_MODIFY | FAN_ATTRIB | FAN_ONDIR)
+// The handle key: the hexadecimal handle type and bytes
+#define HANDLEKEYLEN (2 * MAX_HANDLE_SZ + 16)
+#endif
+
+
+typedef struct Tracking_T *Tracking_T;
+
+
+typedef struct Total_T {
+        unsigned long long size;
+        unsigned long long files;
+        time_t oldest;
+        time_t newest;
+} Total_T;
+
+
+typedef struct DirectoryTree_T {
+        char *name;                               /**< Directory entry name */
+        bool cached;      /**< true if the file statistics are valid (fanotify) */
+        bool stale;       /**< The node or some subdirectory changed (fanotify) */
+        unsigned long long mtime;               /**< Modification time [ns] */
+        unsigned long long ctime;                /**< Inode change time [ns] */
+        Total_T own;                    /**< Statistics of the directory files */
+        Total_T total;                        /**< Statistics of the subtree */
+        char *handle;        /**< The directory handle key or NULL (fanotify) */
+        Tracking_T tracking;           /**< The tree tracking, root node only */
+        bool untracked;            /**< The tree cannot be tracked, root node only */
+        struct DirectoryTree_T *parent;
+        struct DirectoryTree_T *children;             /**< Subdirectories */
+        struct DirectoryTree_T *next;                    /**< Next sibling */
+} *DirectoryTree_T;
+
+
+#ifdef FANOTIFY
+
+
+/**
+ * The tree tracked by fanotify
+ */
+struct Tracking_T {
+        HashMap_T handles;                 /**< The nodes by the handle key */
+        fsid_t fsid;                               /**< The tree filesystem */
+        unsigned long long overflows;   /**< The queue overflows seen by the tree */
+        Tracking_T next;
+};
+
+
+static struct {
+        int fd;             /**< fanotify descriptor, -1 if not initialized */
+        bool unavailable;                    /**< fanotify cannot be used */
+        unsigned long long overflows;         /**< The event queue overflows */
+        Tracking_T trees;
+        Mutex_T mutex;
+} _fanotify = {.fd = -1, .mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+#endif
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _timestamps(struct stat *buf, unsigned long long *mtime, unsigned long long *ctime) {
+#if defined HAVE_STRUCT_STAT_ST_MTIM
+        *mtime = (unsigned long long)buf->st_mtim.tv_sec * 1000000000ULL + (unsigned long long)buf->st_mtim.tv_nsec;
+        *ctime = (unsigned long long)buf->st_ctim.tv_sec * 1000000000ULL + (unsigned long long)buf->st_ctim.tv_nsec;
+#elif defined HAVE_STRUCT_STAT_ST_MTIMESPEC
+        *mtime = (unsigned long long)buf->st_mtimespec.tv_sec * 1000000000ULL + (unsigned long long)buf->st_mtimespec.tv_nsec;
+        *ctime = (unsigned long long)buf->st_ctimespec.tv_sec * 1000000000ULL + (unsigned long long)buf->st_ctimespec.tv_nsec;
+#else
+        *mtime = (unsigned long long)buf->st_mtime * 1000000000ULL;
+        *ctime = (unsigned long long)buf->st_ctime * 1000000000ULL;
+#endif
+}
+
+
+static void _add(Total_T *total, Total_T *t) {
+        total->size += t->size;
+        total->files += t->files;
+        if (t->oldest && (! total->oldest || t->oldest < total->oldest))
+                total->oldest = t->oldest;
+        if (t->newest > total->newest)
+                total->newest = t->newest;
+}
+
+
+static void _free(DirectoryTree_T *list, Tracking_T tracking) {
+        while (*list) {
+                DirectoryTree_T node = *list;
+                *list = node->next;
+                _free(&node->children, tracking);
+#ifdef FANOTIFY
+                if (tracking && node->handle && HashMap_get(tracking->handles, node->handle) == node)
+                        HashMap_remove(tracking->handles, node->handle);
+#endif
+                FREE(node->handle);
+                FREE(node->name);
+                FREE(node);
+        }
+}
+
+
+/**
+ * Detach the node with the given name from the list
+ */
+static DirectoryTree_T _take(DirectoryTree_T *list, const char *name) {
+        for (DirectoryTree_T *n = list; *n; n = &(*n)->next) {
+                if (IS((*n)->name, name)) {
+                        DirectoryTree_T node = *n;
+                        *n = node->next;
+                        node->next = NULL;
+                        return node;
+                }
+        }
+        return NULL;
+}
+
+
+/**
+ * Read the directory entries: the files are accounted in the node, the subdirectory nodes are reused from the last walk if they still exist
+ */
+static bool _read(DirectoryTree_T node, int fd, dev_t device, Tracking_T tracking) {
+        int dfd = dup(fd);
+        DIR *dir = dfd >= 0 ? fdopendir(dfd) : NULL;
+        if (! dir) {
+                if (dfd >= 0)
+                        close(dfd);
+                return false;
+        }
+        DirectoryTree_T old = node->children;
+        node->children = NULL;
+        node->own = (Total_T){};
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+                if (IS(entry->d_name, ".") || IS(entry->d_name, ".."))
+                        continue;
+                struct stat buf;
+                if (fstatat(fd, entry->d_name, &buf, AT_SYMLINK_NOFOLLOW))
+                        continue; // The entry was removed meanwhile
+                if (S_ISDIR(buf.st_mode)) {
+                        if (buf.st_dev != device)
+                                continue;
+                        DirectoryTree_T child = _take(&old, entry->d_name);
+                        if (! child) {
+                                NEW(child);
+                                child->name = Str_dup(entry->d_name);
+                                child->parent = node;
+                        }
+                        child->next = node->children;
+                        node->children = child;
+                } else {
+                        node->own.files++;
+                        if (S_ISREG(buf.st_mode))
+                                node->own.size += (unsigned long long)buf.st_size;
+                        if (! node->own.oldest || buf.st_mtime < node->own.oldest)
+                                node->own.oldest = buf.st_mtime;
+                        if (buf.st_mtime > node->own.newest)
+                                node->own.newest = buf.st_mtime;
+                }
+        }
+        closedir(dir);
+        _free(&old, tracking);
+        return true;
+}
+
+
+#ifdef FANOTIFY
+
+
+/**
+ * Invalidate all nodes of the subtree
+ */
+static void _invalidate(DirectoryTree_T node) {
+        node->cached = false;
+        node->stale = true;
+        for (DirectoryTree_T child = node->children; child; child = child->next)
+                _invalidate(child);
+}
+
+
+static void _handleKey(struct file_handle *handle, char key[static HANDLEKEYLEN]) {
+        int n = snprintf(key, HANDLEKEYLEN, "%x:", handle->handle_type);
+        for (unsigned i = 0; i < handle->handle_bytes && i < MAX_HANDLE_SZ; i++)
+                n += snprintf(key + n, HANDLEKEYLEN - n, "%02x", handle->f_handle[i]);
+}
+
+
+/**
+ * Index the node by its directory handle. The node whose directory was replaced is read again
+ */
+static void _register(DirectoryTree_T node, int fd, Tracking_T tracking) {
+        union {
+                struct file_handle handle;
+                char buffer[sizeof(struct file_handle) + MAX_HANDLE_SZ];
+        } h = {.handle.handle_bytes = MAX_HANDLE_SZ};
+        int mount;
+        if (name_to_handle_at(fd, "", &h.handle, &mount, AT_EMPTY_PATH) == 0) {
+                char key[HANDLEKEYLEN];
+                _handleKey(&h.handle, key);
+                if (! node->handle || ! IS(node->handle, key)) {
+                        if (node->handle) {
+                                if (HashMap_get(tracking->handles, node->handle) == node)
+                                        HashMap_remove(tracking->handles, node->handle);
+                                _invalidate(node);
+                        }
+                        FREE(node->handle);
+                        node->handle = Str_dup(key);
+                }
+                if (HashMap_get(tracking->handles, node->handle) != node)
+                        HashMap_put(tracking->handles, node->handle, node);
+        }
+}
+
+
+/**
+ * Invalidate the node of the changed directory, its ancestors must be visited by the next walk
+ */
+static void _changed(DirectoryTree_T node) {
+        node->cached = false;
+        for (; node && ! node->stale; node = node->parent)
+                node->stale = true;
+}
+
+
+static void _event(struct fanotify_event_metadata *event) {
+        if (event->mask & FAN_Q_OVERFLOW) {
+                _fanotify.overflows++;
+                return;
+        }
+        for (size_t offset = event->metadata_len; offset + sizeof(struct fanotify_event_info_header) <= event->event_len;) {
+                struct fanotify_event_info_header *header = (struct fanotify_event_info_header *)((char *)event + offset);
+                if (header->len == 0)
+                        break;
+                if (header->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME || header->info_type == FAN_EVENT_INFO_TYPE_DFID || header->info_type == FAN_EVENT_INFO_TYPE_FID) {
+                        struct fanotify_event_info_fid *fid = (struct fanotify_event_info_fid *)header;
+                        char key[HANDLEKEYLEN];
+                        _handleKey((struct file_handle *)fid->handle, key);
+                        for (Tracking_T t = _fanotify.trees; t; t = t->next) {
+                                if (memcmp(&(t->fsid), &(fid->fsid), sizeof(fsid_t)) == 0) {
+                                        DirectoryTree_T node = HashMap_get(t->handles, key);
+                                        if (node)
+                                                _changed(node);
+                                }
+                        }
+                }
+                offset += header->len;
+        }
+}
+
+
+/**
+ * Process the queued events
+ */
+static void _drain() {
+        char buffer[16384] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+        ssize_t n;
+        while ((n = read(_fanotify.fd, buffer, sizeof(buffer))) > 0) {
+                for (struct fanotify_event_metadata *event = (struct fanotify_event_metadata *)buffer; FAN_EVENT_OK(event, n); event = FAN_EVENT_NEXT(event, n)) {
+                        if (event->fd >= 0)
+                                close(event->fd);
+                        _event(event);
+                }
+        }
+}
+
+
+/**
+ * Start tracking the tree if possible
+ * @return The tree tracking or NULL if the tree is walked without fanotify
+ */
+static void _untrack(DirectoryTree_T root) {
+        for (Tracking_T *t = &(_fanotify.trees); *t; t = &(*t)->next) {
+                if (*t == root->tracking) {
+                        *t = root->tracking->next;
+                        break;
+                }
+        }
+        HashMap_free(&(root->tracking->handles));
+        FREE(root->tracking);
+}
+
+
+static Tracking_T _track(Service_T s, DirectoryTree_T root, int fd) {
+        struct statfs sfs;
+        if (root->tracking && (fstatfs(fd, &sfs) != 0 || memcmp(&(sfs.f_fsid), &(root->tracking->fsid), sizeof(fsid_t)) != 0)) {
+                // Another filesystem was mounted over the tree or the tree was replaced, mark the new filesystem
+                _untrack(root);
+        }
+        if (! root->tracking && ! root->untracked && ! _fanotify.unavailable) {
+                if (_fanotify.fd < 0) {
+                        _fanotify.fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC, O_RDONLY | O_CLOEXEC);
+                        if (_fanotify.fd < 0) {
+                                DEBUG("Directory tree change notification is not available -- %s\n", STRERROR);
+                                _fanotify.unavailable = true;
+                                return NULL;
+                        }
+                }
+                if (fstatfs(fd, &sfs) != 0 || fanotify_mark(_fanotify.fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FANOTIFY_MASK, fd, NULL) != 0) {
+                        DEBUG("'%s' directory tree %s cannot be tracked, it will be walked -- %s\n", s->name, s->path, STRERROR);
+                        root->untracked = true;
+                        return NULL;
+                }
+                Tracking_T t;
+                NEW(t);
+                t->handles = HashMap_new(HashMap_String, 0);
+                t->fsid = sfs.f_fsid;
+                t->overflows = _fanotify.overflows;
+                t->next = _fanotify.trees;
+                _fanotify.trees = t;
+                root->tracking = t;
+                // The changes before the mark were not reported
+                _invalidate(root);
+        }
+        return root->tracking;
+}
+
+
+#endif
+
+
+static bool _walk(Service_T s, DirectoryTree_T node, int fd, struct stat *buf, time_t now, int depth, Tracking_T tracking) {
+        unsigned long long mtime, ctime;
+        _timestamps(buf, &mtime, &ctime);
+#ifdef FANOTIFY
+        if (tracking)
+                _register(node, fd, tracking);
+#endif
+        // The untracked directory is read in each walk, its files may change in place
+        if (! tracking || ! node->cached || node->mtime != mtime || node->ctime != ctime) {
+                if (! _read(node, fd, buf->st_dev, tracking)) {
+                        DEBUG("'%s' cannot read directory %s -- %s\n", s->name, node->name, STRERROR);
+                        node->cached = false;
+                        return false;
+                }
+                node->mtime = mtime;
+                node->ctime = ctime;
+                node->cached = (time_t)(MAX(mtime, ctime) / 1000000000ULL) + 1 < now;
+        }
+        node->stale = false;
+        Total_T total = node->own;
+        if (depth >= MAXDEPTH) {
+                DEBUG("'%s' directory tree depth limit %d reached in %s\n", s->name, MAXDEPTH, node->name);
+                node->total = total;
+                return true;
+        }
+        for (DirectoryTree_T child = node->children; child; child = child->next) {
+                // The tracked subtree which didn't change is not walked
+                if (tracking && child->handle && child->cached && ! child->stale) {
+                        _add(&total, &(child->total));
+                        continue;
+                }
+                struct stat childbuf;
+                int childfd = openat(fd, child->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                if (childfd < 0) {
+                        // Removed or replaced meanwhile, the parent modification will update the tree
+                        child->cached = false;
+                        continue;
+                }
+                if (fstat(childfd, &childbuf) == 0 && childbuf.st_dev == buf->st_dev && _walk(s, child, childfd, &childbuf, now, depth + 1, tracking))
+                        _add(&total, &(child->total));
+                close(childfd);
+        }
+        node->total = total;
+        return true;
+}
+
+
+static bool _update(Service_T s, DirectoryTree_T root, int fd, struct stat *buf, Tracking_T tracking) {
+        if (! _walk(s, root, fd, buf, Time_now(), 0, tracking))
+                return false;
+        s->inf.directory->tree.size = root->total.size;
+        s->inf.directory->tree.files = root->total.files;
+        s->inf.directory->tree.oldest = root->total.oldest;
+        s->inf.directory->tree.newest = root->total.newest;
+        return true;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool DirectoryTree_update(Service_T s) {
+        ASSERT(s);
+        ASSERT(s->type == Service_Directory);
+        int fd = open(s->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+                Log_error("'%s' cannot open directory %s -- %s\n", s->name, s->path, STRERROR);
+                s->inf.directory->tree.collected = false;
+                return false;
+        }
+        bool rv = false;
+        struct stat buf;
+        if (fstat(fd, &buf) == 0) {
+                if (! s->inf.directory->tree.cache) {
+                        NEW(s->inf.directory->tree.cache);
+                        s->inf.directory->tree.cache->name = Str_dup(s->path);
+                }
+                DirectoryTree_T root = s->inf.directory->tree.cache;
+                bool tracked = false;
+#ifdef FANOTIFY
+                // The walk of the tracked tree is serialized with the processing of the events, which update the nodes
+                LOCK(_fanotify.mutex)
+                {
+                        Tracking_T tracking = _track(s, root, fd);
+                        if (tracking) {
+                                tracked = true;
+                                _drain();
+                                if (tracking->overflows != _fanotify.overflows) {
+                                        tracking->overflows = _fanotify.overflows;
+                                        _invalidate(root);
+                                }
+                                rv = _update(s, root, fd, &buf, tracking);
+                        }
+                }
+                END_LOCK;
+#endif
+                if (! tracked)
+                        rv = _update(s, root, fd, &buf, NULL);
+                s->inf.directory->tree.collected = rv;
+        }
+        if (! rv) {
+                Log_error("'%s' cannot read directory %s -- %s\n", s->name, s->path, STRERROR);
+                s->inf.directory->tree.collected = false;
+        }
+        close(fd);
+        return rv;
+}
+
+
+void DirectoryTree_free(Service_T s) {
+        ASSERT(s);
+#ifdef FANOTIFY
+        DirectoryTree_T root = s->inf.directory->tree.cache;
+        if (root && root->tracking) {
+                LOCK(_fanotify.mutex)
+                {
+                        _untrack(root);
+                        _free(&s->inf.directory->tree.cache, NULL);
+                }
+                END_LOCK;
+                s->inf.directory->tree.collected = false;
+                return;
+        }
+#endif
+        _free(&s->inf.directory->tree.cache, NULL);
+        s->inf.directory->tree.collected = false;
+}
+
+
+bool DirectoryTree_isNeeded(Service_T s) {
+        ASSERT(s);
+        if (s->sizelist || s->filecountlist)
+                return true;
+        for (Timestamp_T t = s->timestamplist; t; t = t->next)
+                if (t->type == Timestamp_Oldest || t->type == Timestamp_Newest)
+                        return true;
+        return false;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_DIRECTORYTREE_H
+#define MONIT_DIRECTORYTREE_H
+
+#include "config.h"
+
+
+/**
+ * Directory tree statistics: the total size and number of the files in a
+ * directory tree and the modification time of the oldest file, used by the
+ * directory check size, file count and oldest file timestamp tests. If
+ * the tree is tracked by the change notification (Linux fanotify), only
+ * the changed directories are read again, otherwise each walk reads the
+ * whole tree. The walk doesn't cross filesystem boundaries and doesn't
+ * follow symbolic links.
+ *
+ * @file
+ */
+
+
+/**
+ * Walk the directory tree of the service and update the tree statistics
+ * in s->inf.directory->tree
+ * @param s A directory service
+ * @return true if succeeded otherwise false
+ */
+bool DirectoryTree_update(Service_T s);
+
+
+/**
+ * Release the directory tree cache of the service
+ * @param s A directory service
+ */
+void DirectoryTree_free(Service_T s);
+
+
+/**
+ * Test if the service has a test which needs the directory tree statistics
+ * @param s A directory service
+ * @return true if the tree should be walked otherwise false
+ */
+bool DirectoryTree_isNeeded(Service_T s);
+
+
+#endif
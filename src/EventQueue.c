@@ -0,0 +1,628 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_STDDEF_H
+#include <stddef.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#include "monit.h"
+#include "event.h"
+#include "file.h"
+#include "EventQueue.h"
+#include "Webhook.h"
+
+// libmonit
+#include "util/List.h"
+#include "io/File.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ *  The queue is a sequence of segment files named segment.<sequence> in the
+ *  event queue directory. A segment starts with a magic string followed by
+ *  the records:
+ *
+ *      header:  uint32 payload size, uint32 pending handlers, uint32 pending
+ *               webhooks, uint32 checksum
+ *      payload: int32 event version, event structure, int32 action,
+ *               uint32 source length, source, uint32 message length, message
+ *
+ *  The records are appended to the last segment, a new segment is started
+ *  when the last segment grows over SEGMENTSIZE. The checksum covers the
+ *  payload only, so the pending handlers and webhooks can be updated in place. A
+ *  record which was not written completely (monit was killed during the
+ *  write) is truncated when the queue is opened.
+ *
+ *  The event files of the previous monit versions (one file per event) found
+ *  in the queue directory are imported into the queue when it is opened.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+// Segment size limit, a new segment is started when the last segment grows over the limit
+#define SEGMENTSIZE 1048576
+
+// Maximum record payload size
+#define RECORDSIZE 1048576
+
+#define SEGMENTPREFIX "segment."
+#define SEGMENTMAGIC "MONITEQ1"
+#define SEGMENTHEADER ((off_t)(sizeof(SEGMENTMAGIC) - 1))
+
+
+typedef struct RecordHeader_T {
+        uint32_t size;                                        /**< Payload size */
+        uint32_t flags;         /**< Handlers which didn't deliver the event yet */
+        uint32_t webhooks;    /**< Webhooks which didn't take the event yet */
+        uint32_t checksum;                                /**< Payload checksum */
+} RecordHeader_T;
+
+
+static struct {
+        char *dir;                                    /**< The queue directory */
+        unsigned first;                     /**< The first segment sequence number */
+        unsigned last;                       /**< The last segment sequence number */
+        int fd;                      /**< The last segment descriptor or -1 if closed */
+        off_t size;                /**< The last segment size, 0 if it doesn't exist */
+        struct {
+                unsigned segment;
+                off_t offset;
+        } cursor;                         /**< The first record not delivered yet */
+        bool rescan;   /**< Count the pending records again when the queue is accessed */
+} _queue = {.fd = -1};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static uint32_t _checksum(const unsigned char *data, size_t size) {
+        uint32_t hash = 2166136261U; // FNV-1a
+        for (size_t i = 0; i < size; i++) {
+                hash ^= data[i];
+                hash *= 16777619U;
+        }
+        return hash;
+}
+
+
+static char *_segmentPath(char *buf, int size, unsigned sequence) {
+        snprintf(buf, size, "%s/" SEGMENTPREFIX "%010u", _queue.dir, sequence);
+        return buf;
+}
+
+
+static int _segmentOpen(unsigned sequence, int flags) {
+        char path[PATH_MAX];
+        return open(_segmentPath(path, sizeof(path), sequence), flags | O_CLOEXEC, 0600);
+}
+
+
+static void _segmentRemove(unsigned sequence) {
+        char path[PATH_MAX];
+        if (unlink(_segmentPath(path, sizeof(path), sequence)) < 0 && errno != ENOENT)
+                Log_error("Cannot remove the event queue segment %s -- %s\n", path, STRERROR);
+        else
+                DEBUG("Removed the delivered event queue segment %s\n", path);
+}
+
+
+static off_t _segmentSize(int fd) {
+        struct stat buf;
+        return fstat(fd, &buf) ? 0 : buf.st_size;
+}
+
+
+/**
+ * Read the record header at the given offset and optionally the payload (allocated, the caller must free it)
+ */
+static bool _readRecord(int fd, off_t offset, off_t limit, RecordHeader_T *header, unsigned char **payload) {
+        if (pread(fd, header, sizeof(RecordHeader_T), offset) != sizeof(RecordHeader_T))
+                return false;
+        if (header->size == 0 || header->size > RECORDSIZE || offset + (off_t)sizeof(RecordHeader_T) + (off_t)header->size > limit)
+                return false;
+        if (payload) {
+                *payload = ALLOC(header->size);
+                if (pread(fd, *payload, header->size, offset + sizeof(RecordHeader_T)) != (ssize_t)header->size || _checksum(*payload, header->size) != header->checksum) {
+                        FREE(*payload);
+                        return false;
+                }
+        }
+        return true;
+}
+
+
+static bool _append(Event_T E, const char *source, const char *message, Action_Type action, Handler_Type flags, unsigned webhooks) {
+        if (_queue.fd < 0 || _queue.size >= SEGMENTSIZE) {
+                if (_queue.fd >= 0) {
+                        close(_queue.fd);
+                        _queue.fd = -1;
+                }
+                if (_queue.size >= SEGMENTSIZE) {
+                        _queue.last++;
+                        _queue.size = 0;
+                }
+                char path[PATH_MAX];
+                _segmentPath(path, sizeof(path), _queue.last);
+                if ((_queue.fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600)) < 0) {
+                        Log_error("Cannot open the event queue segment %s -- %s\n", path, STRERROR);
+                        return false;
+                }
+                if (_queue.size == 0) {
+                        if (ftruncate(_queue.fd, 0) < 0 || write(_queue.fd, SEGMENTMAGIC, SEGMENTHEADER) != SEGMENTHEADER) {
+                                Log_error("Cannot write the event queue segment %s -- %s\n", path, STRERROR);
+                                close(_queue.fd);
+                                _queue.fd = -1;
+                                return false;
+                        }
+                        _queue.size = SEGMENTHEADER;
+                }
+        }
+        uint32_t sourceLength = (uint32_t)strlen(source) + 1;
+        uint32_t messageLength = message ? (uint32_t)strlen(message) + 1 : 0;
+        size_t size = sizeof(int32_t) + sizeof(*E) + sizeof(int32_t) + sizeof(uint32_t) + sourceLength + sizeof(uint32_t) + messageLength;
+        if (size > RECORDSIZE) {
+                Log_error("Cannot add the event to the queue -- the event is too large\n");
+                return false;
+        }
+        unsigned char *record = ALLOC(sizeof(RecordHeader_T) + size);
+        unsigned char *p = record + sizeof(RecordHeader_T);
+        int32_t version = EVENT_VERSION, type = action;
+        memcpy(p, &version, sizeof(int32_t));
+        p += sizeof(int32_t);
+        memcpy(p, E, sizeof(*E));
+        p += sizeof(*E);
+        memcpy(p, &type, sizeof(int32_t));
+        p += sizeof(int32_t);
+        memcpy(p, &sourceLength, sizeof(uint32_t));
+        p += sizeof(uint32_t);
+        memcpy(p, source, sourceLength);
+        p += sourceLength;
+        memcpy(p, &messageLength, sizeof(uint32_t));
+        p += sizeof(uint32_t);
+        if (messageLength)
+                memcpy(p, message, messageLength);
+        RecordHeader_T header = {.size = (uint32_t)size, .flags = flags, .webhooks = webhooks, .checksum = _checksum(record + sizeof(RecordHeader_T), size)};
+        memcpy(record, &header, sizeof(RecordHeader_T));
+        bool rv = true;
+        if (write(_queue.fd, record, sizeof(RecordHeader_T) + size) != (ssize_t)(sizeof(RecordHeader_T) + size)) {
+                Log_error("Cannot write the event to the queue -- %s\n", STRERROR);
+                // Drop the partially written record
+                if (ftruncate(_queue.fd, _queue.size) < 0)
+                        Log_error("Cannot truncate the event queue segment -- %s\n", STRERROR);
+                rv = false;
+        } else {
+                _queue.size += sizeof(RecordHeader_T) + size;
+                Run.eventlist_used++;
+        }
+        FREE(record);
+        return rv;
+}
+
+
+/**
+ * Decode the record payload. Returns the event with the message and the source service or NULL if the record is invalid
+ */
+static Event_T _decode(const unsigned char *payload, uint32_t size, Action_Type *action) {
+        const unsigned char *p = payload, *end = payload + size;
+        int32_t version, type;
+        uint32_t sourceLength, messageLength;
+        if (end - p < (ptrdiff_t)(sizeof(int32_t) + sizeof(struct myevent) + sizeof(int32_t) + sizeof(uint32_t)))
+                goto invalid;
+        memcpy(&version, p, sizeof(int32_t));
+        p += sizeof(int32_t);
+        if (version != EVENT_VERSION) {
+                Log_error("Aborting queued event - incompatible data format version %d\n", version);
+                return NULL;
+        }
+        Event_T e;
+        NEW(e);
+        memcpy(e, p, sizeof(*e));
+        p += sizeof(*e);
+        e->message = NULL;
+        e->action = NULL;
+        e->next = NULL;
+        memcpy(&type, p, sizeof(int32_t));
+        p += sizeof(int32_t);
+        *action = type;
+        memcpy(&sourceLength, p, sizeof(uint32_t));
+        p += sizeof(uint32_t);
+        if (sourceLength == 0 || sourceLength > (uint32_t)(end - p) || p[sourceLength - 1])
+                goto invalid_event;
+        const char *source = (const char *)p;
+        p += sourceLength;
+        if (end - p < (ptrdiff_t)sizeof(uint32_t))
+                goto invalid_event;
+        memcpy(&messageLength, p, sizeof(uint32_t));
+        p += sizeof(uint32_t);
+        if (messageLength > (uint32_t)(end - p) || (messageLength && p[messageLength - 1]))
+                goto invalid_event;
+        if (! (e->source = Util_getService(source))) {
+                Log_error("Aborting queued event - service %s not found in monit configuration\n", source);
+                FREE(e);
+                return NULL;
+        }
+        if (messageLength)
+                e->message = Str_dup((const char *)p);
+        return e;
+invalid_event:
+        FREE(e);
+invalid:
+        Log_error("Aborting queued event - invalid record\n");
+        return NULL;
+}
+
+
+/**
+ * Import the event file of the previous monit versions
+ */
+static void _import(const char *name) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", _queue.dir, name);
+        FILE *file = fopen(path, "r");
+        if (! file) {
+                Log_error("Cannot open the queued event file %s -- %s\n", path, STRERROR);
+                return;
+        }
+        bool rv = false;
+        size_t size;
+        Event_T e = NULL;
+        char *source = NULL, *message = NULL;
+        Action_Type *action = NULL;
+        int *version = file_readQueue(file, &size);
+        if (version && size == sizeof(int) && *version == EVENT_VERSION &&
+            (e = file_readQueue(file, &size)) && size == sizeof(*e) &&
+            (source = file_readQueue(file, &size)) &&
+            (message = file_readQueue(file, &size)) &&
+            (action = file_readQueue(file, &size)) && size == sizeof(Action_Type))
+        {
+                rv = _append(e, source, message, *action, e->flag, WEBHOOK_ALL);
+        }
+        fclose(file);
+        if (rv) {
+                DEBUG("Imported the queued event file %s\n", path);
+                if (unlink(path) < 0)
+                        Log_error("Failed to remove queued event file '%s' -- %s\n", path, STRERROR);
+        } else {
+                Log_error("Cannot import the queued event file %s, skipping it\n", path);
+        }
+        FREE(action);
+        FREE(message);
+        FREE(source);
+        FREE(e);
+        FREE(version);
+}
+
+
+/**
+ * Scan the segment: count the pending records and find the cursor. A torn record at the end of the last segment is truncated. Returns false if the segment has no pending record
+ */
+static bool _scan(unsigned sequence, bool *head) {
+        bool last = sequence == _queue.last;
+        bool pending = false;
+        int fd = _segmentOpen(sequence, last ? O_RDWR : O_RDONLY);
+        if (fd < 0) {
+                if (errno != ENOENT)
+                        Log_error("Cannot open the event queue segment %u -- %s\n", sequence, STRERROR);
+                return false;
+        }
+        char magic[SEGMENTHEADER];
+        off_t size = _segmentSize(fd), offset = SEGMENTHEADER;
+        if (pread(fd, magic, SEGMENTHEADER, 0) != SEGMENTHEADER || memcmp(magic, SEGMENTMAGIC, SEGMENTHEADER)) {
+                Log_error("Event queue segment %u is not valid, skipping it\n", sequence);
+                if (last) {
+                        // Don't append to the invalid segment
+                        _queue.last++;
+                        _queue.size = 0;
+                }
+                close(fd);
+                return true; // Keep the segment
+        }
+        while (offset < size) {
+                RecordHeader_T header;
+                unsigned char *payload = NULL;
+                if (! _readRecord(fd, offset, size, &header, last ? &payload : NULL)) {
+                        if (last) {
+                                Log_error("Event queue segment %u has an incomplete record, truncating it\n", sequence);
+                                if (ftruncate(fd, offset) < 0)
+                                        Log_error("Cannot truncate the event queue segment %u -- %s\n", sequence, STRERROR);
+                        }
+                        break;
+                }
+                FREE(payload);
+                if (header.flags) {
+                        pending = true;
+                        Run.eventlist_used++;
+                        if (*head) {
+                                *head = false;
+                                _queue.cursor.segment = sequence;
+                                _queue.cursor.offset = offset;
+                        }
+                }
+                offset += sizeof(RecordHeader_T) + header.size;
+        }
+        if (last)
+                _queue.size = offset;
+        close(fd);
+        return pending;
+}
+
+
+static bool _open(void) {
+        if (_queue.dir && IS(_queue.dir, Run.eventlist_dir) && Run.eventlist_used >= 0 && ! _queue.rescan)
+                return true;
+        EventQueue_close();
+        if (! file_checkQueueDirectory(Run.eventlist_dir))
+                return false;
+        DIR *dir = opendir(Run.eventlist_dir);
+        if (! dir) {
+                Log_error("Cannot open the event queue directory '%s' -- %s\n", Run.eventlist_dir, STRERROR);
+                return false;
+        }
+        _queue.dir = Str_dup(Run.eventlist_dir);
+        bool found = false;
+        List_T legacy = List_new();
+        struct dirent *de;
+        while ((de = readdir(dir))) {
+                if (Str_startsWith(de->d_name, SEGMENTPREFIX)) {
+                        char c;
+                        unsigned sequence;
+                        if (sscanf(de->d_name + sizeof(SEGMENTPREFIX) - 1, "%u%c", &sequence, &c) == 1) {
+                                if (! found || sequence < _queue.first)
+                                        _queue.first = sequence;
+                                if (! found || sequence > _queue.last)
+                                        _queue.last = sequence;
+                                found = true;
+                        }
+                } else if (*de->d_name != '.') {
+                        char path[PATH_MAX];
+                        snprintf(path, sizeof(path), "%s/%s", _queue.dir, de->d_name);
+                        if (File_isFile(path))
+                                List_append(legacy, Str_dup(de->d_name));
+                }
+        }
+        closedir(dir);
+        Run.eventlist_used = 0;
+        bool head = true;
+        for (unsigned sequence = _queue.first; found && sequence <= _queue.last; sequence++) {
+                if (! _scan(sequence, &head) && head && sequence != _queue.last) {
+                        // Leftover of the delivered events
+                        _segmentRemove(sequence);
+                        _queue.first = sequence + 1;
+                }
+        }
+        if (head) {
+                _queue.cursor.segment = _queue.last;
+                _queue.cursor.offset = MAX(_queue.size, SEGMENTHEADER);
+        }
+        while (List_length(legacy) > 0) {
+                char *name = List_pop(legacy);
+                _import(name);
+                FREE(name);
+        }
+        List_free(&legacy);
+        DEBUG("Event queue %s opened with %d queued events\n", _queue.dir, Run.eventlist_used);
+        return true;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool EventQueue_add(Event_T E, unsigned webhooks) {
+        ASSERT(E);
+        if (! Run.eventlist_dir || ! _open())
+                return false;
+        if (Run.eventlist_slots >= 0 && Run.eventlist_used >= Run.eventlist_slots) {
+                Log_error("Event queue is full\n");
+                return false;
+        }
+        return _append(E, E->source->name, E->message, Event_get_action(E), E->flag, webhooks);
+}
+
+
+void EventQueue_replay(bool (*deliver)(Event_T E, unsigned *webhooks)) {
+        ASSERT(deliver);
+        if (! Run.eventlist_dir || ! _open() || Run.eventlist_used == 0)
+                return;
+        DEBUG("Processing postponed events queue\n");
+        struct Action_T a = {};
+        struct EventAction_T ea = {};
+        // The records added during the replay are processed in the next cycle
+        unsigned endSegment = _queue.last;
+        off_t endOffset = _queue.size;
+        bool head = true, stop = false;
+        for (unsigned sequence = _queue.cursor.segment; sequence <= endSegment && ! stop; sequence++) {
+                off_t offset = sequence == _queue.cursor.segment ? _queue.cursor.offset : SEGMENTHEADER;
+                off_t limit = offset;
+                int fd = _segmentOpen(sequence, O_RDWR);
+                if (fd >= 0) {
+                        limit = sequence == endSegment ? endOffset : _segmentSize(fd);
+                } else if (errno == ENOENT) {
+                        // The segment was removed outside of Monit: treat it as empty, so the cursor moves past it
+                        if (head) {
+                                Log_warning("Event queue segment %u is missing, skipping it\n", sequence);
+                                // Its records were counted in Run.eventlist_used. Scan the queue again on the next access to recount the pending records
+                                _queue.rescan = true;
+                                if (sequence == _queue.last)
+                                        offset = _queue.size;
+                        }
+                } else {
+                        Log_error("Cannot open the event queue segment %u -- %s\n", sequence, STRERROR);
+                        head = false;
+                        continue;
+                }
+                while (offset < limit) {
+                        RecordHeader_T header;
+                        unsigned char *payload = NULL;
+                        if (! _readRecord(fd, offset, limit, &header, NULL)) {
+                                Log_error("Event queue segment %u is corrupted at offset %lld, skipping the rest of the segment\n", sequence, (long long)offset);
+                                // The skipped records were counted in Run.eventlist_used, but their number is unknown. Scan the queue again on the next access to recount the pending records
+                                _queue.rescan = true;
+                                offset = limit;
+                                break;
+                        }
+                        off_t next = offset + sizeof(RecordHeader_T) + header.size;
+                        if (header.flags) {
+                                Handler_Type flags = Handler_Succeeded;
+                                unsigned webhooks = header.webhooks;
+                                Action_Type action;
+                                Event_T e = NULL;
+                                if (! _readRecord(fd, offset, limit, &header, &payload))
+                                        Log_error("Aborting queued event - invalid checksum in segment %u at offset %lld\n", sequence, (long long)offset);
+                                else
+                                        e = _decode(payload, header.size, &action);
+                                FREE(payload);
+                                if (e) {
+                                        a.id = action;
+                                        ea.failed = ea.succeeded = NULL;
+                                        switch (e->state) {
+                                                case State_Succeeded:
+                                                case State_ChangedNot:
+                                                        ea.succeeded = &a;
+                                                        break;
+                                                case State_Failed:
+                                                case State_Changed:
+                                                case State_Init:
+                                                        ea.failed = &a;
+                                                        break;
+                                                default:
+                                                        Log_error("Aborting queued event -- invalid state: %d\n", e->state);
+                                                        FREE(e->message);
+                                                        FREE(e);
+                                                        break;
+                                        }
+                                }
+                                if (e) {
+                                        e->action = &ea;
+                                        e->flag = header.flags;
+                                        if (deliver(e, &webhooks))
+                                                flags = e->flag;
+                                        else
+                                                stop = true;
+                                        FREE(e->message);
+                                        FREE(e);
+                                }
+                                if (stop)
+                                        break;
+                                if (flags != header.flags || webhooks != header.webhooks) {
+                                        // The flags and webhooks fields are adjacent in the header
+                                        uint32_t value[2] = {flags, webhooks};
+                                        if (pwrite(fd, value, sizeof(value), offset + offsetof(RecordHeader_T, flags)) != sizeof(value))
+                                                Log_error("Cannot update the queued event in segment %u -- %s\n", sequence, STRERROR);
+                                        else if (flags == Handler_Succeeded)
+                                                Run.eventlist_used = MAX(0, Run.eventlist_used - 1);
+                                        header.flags = flags;
+                                        header.webhooks = webhooks;
+                                }
+                        }
+                        if (head) {
+                                if (header.flags) {
+                                        head = false;
+                                } else {
+                                        _queue.cursor.segment = sequence;
+                                        _queue.cursor.offset = next;
+                                }
+                        }
+                        offset = next;
+                }
+                if (fd >= 0)
+                        close(fd);
+                if (head && ! stop) {
+                        // All records of the segment were delivered
+                        if (sequence != _queue.last) {
+                                _segmentRemove(sequence);
+                                _queue.first = sequence + 1;
+                                _queue.cursor.segment = sequence + 1;
+                                _queue.cursor.offset = SEGMENTHEADER;
+                        } else if (offset == _queue.size) {
+                                if (_queue.fd >= 0) {
+                                        close(_queue.fd);
+                                        _queue.fd = -1;
+                                }
+                                _segmentRemove(sequence);
+                                _queue.first = _queue.last = sequence + 1;
+                                _queue.size = 0;
+                                _queue.cursor.segment = _queue.last;
+                                _queue.cursor.offset = SEGMENTHEADER;
+                        }
+                }
+        }
+}
+
+
+void EventQueue_close(void) {
+        if (_queue.fd >= 0)
+                close(_queue.fd);
+        FREE(_queue.dir);
+        memset(&_queue, 0, sizeof(_queue));
+        _queue.fd = -1;
+}
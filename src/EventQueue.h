@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_EVENTQUEUE_H
+#define MONIT_EVENTQUEUE_H
+
+#include "config.h"
+
+#include "event.h"
+
+
+/**
+ * Persistent queue of the partially handled events. The events which
+ * couldn't be delivered by all handlers are appended to a log of segment
+ * files in the event queue directory (Run.eventlist_dir). Each record has
+ * a header with the handlers which didn't deliver the event yet, the flags
+ * are updated in place as the handlers succeed. The replay starts at the
+ * consumer cursor, which is the first record not delivered yet, and walks
+ * the records in the order they were added. A segment is removed when all
+ * its records were delivered. The queue is not thread safe, the caller
+ * must serialize the access.
+ *
+ * @file
+ */
+
+
+/**
+ * Append the event to the queue. The handlers not delivered yet are taken
+ * from E->flag
+ * @param E An event object
+ * @param webhooks The webhooks which didn't take the event yet, if the
+ * Handler_Webhook flag is set (see Webhook_send())
+ * @return true if succeeded otherwise false (the queue is full or cannot
+ * be written)
+ */
+bool EventQueue_add(Event_T E, unsigned webhooks);
+
+
+/**
+ * Replay the queued events in order. The deliver function is called for
+ * each event not delivered yet and updates E->flag with the handlers which
+ * still failed and the webhooks bitmap with the webhooks which didn't take
+ * the event yet. The event, its message and action are owned by the queue
+ * and valid during the call only
+ * @param deliver The event handler function, returns false to stop the
+ * replay in this cycle (the event is left untouched)
+ */
+void EventQueue_replay(bool (*deliver)(Event_T E, unsigned *webhooks));
+
+
+/**
+ * Close the queue files and release the queue state. Should be called when
+ * the event queue directory changes (reload) and on exit
+ */
+void EventQueue_close(void);
+
+
+#endif
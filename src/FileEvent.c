@@ -0,0 +1,542 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include "monit.h"
+#include "FileEvent.h"
+#include "system/Time.h"
+
+// libmonit
+#include "io/File.h"
+#include "exceptions/AssertException.h"
+
+/**
+ *  File event engine based on the Linux inotify: each monitored object is
+ *  watched directly (content and attribute changes) and via its parent
+ *  directory (the object was created, removed or replaced by rename). The
+ *  watch descriptors are added by the main thread in FileEvent_update(),
+ *  the watcher thread only reads the events and marks the watches changed.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#if defined(HAVE_SYS_INOTIFY_H) && defined(HAVE_POLL_H)
+
+
+#define WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+
+typedef struct Watch_T {
+        Service_T service;          /**< The service (identity only, the watcher thread doesn't access it) */
+        char *path;                                       /**< The object path */
+        const char *name;                 /**< The object name in the parent directory */
+        int self;                   /**< The object watch descriptor or -1 */
+        int parent;       /**< The parent directory watch descriptor or -1 */
+        bool changed;         /**< Changed since the last FileEvent_unchanged() */
+        bool scheduled;          /**< Changed since the last FileEvent_collect() */
+        bool wanted;                          /**< Used by FileEvent_update() */
+} Watch_T;
+
+
+static struct {
+        bool running;
+        bool pending;                 /**< Some watch is scheduled, not collected */
+        bool exhausted;       /**< The inotify watch limit was reached (logged once) */
+        int fd;                                          /**< inotify descriptor */
+        int pipe[2];                            /**< Watcher thread wakeup pipe */
+        Thread_T thread;
+        Mutex_T mutex;
+        struct {
+                int count;
+                int size;
+                Watch_T *list;
+        } watched;
+} _engine = {.fd = -1, .pipe = {-1, -1}, .mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _wakeup() {
+        ssize_t __attribute__ ((unused)) n = write(_engine.pipe[1], "", 1);
+}
+
+
+static bool _watchable(Service_T s) {
+        if ((s->type != Service_File && s->type != Service_Directory && s->type != Service_Fifo) || s->monitor == Monitor_Not)
+                return false;
+        // The pseudo filesystems content is generated on read, without change events
+        if (Str_startsWith(s->path, "/proc/") || Str_startsWith(s->path, "/sys/"))
+                return false;
+        // inotify doesn't report the access time change for all object types => such services are polled
+        for (Timestamp_T t = s->timestamplist; t; t = t->next)
+                if (t->type == Timestamp_Access)
+                        return false;
+        return true;
+}
+
+
+static Watch_T *_find(Service_T s) {
+        int i = s->fileEvent;
+        if (i >= 0 && i < _engine.watched.count && _engine.watched.list[i].service == s)
+                return &_engine.watched.list[i];
+        return NULL;
+}
+
+
+static void _touch(Watch_T *w) {
+        w->changed = w->scheduled = true;
+        _engine.pending = true;
+}
+
+
+static int _addWatch(const char *path) {
+        int wd = inotify_add_watch(_engine.fd, path, WATCH_MASK);
+        if (wd < 0) {
+                if (errno == ENOSPC && ! _engine.exhausted) {
+                        _engine.exhausted = true;
+                        Log_warning("File events -- the inotify watch limit was reached (see /proc/sys/fs/inotify/max_user_watches), some objects are polled\n");
+                } else if (errno != ENOENT && errno != ENOTDIR) {
+                        DEBUG("File events -- cannot watch %s: %s\n", path, STRERROR);
+                }
+        }
+        return wd;
+}
+
+
+static void _removeWatch(int wd) {
+        if (wd >= 0) {
+                for (int i = 0; i < _engine.watched.count; i++)
+                        if (_engine.watched.list[i].self == wd || _engine.watched.list[i].parent == wd)
+                                return; // Shared with another object
+                inotify_rm_watch(_engine.fd, wd);
+        }
+}
+
+
+/**
+ * Watch the object and its parent directory if not watched yet. Must be called with the engine mutex locked
+ */
+static void _watch(Watch_T *w) {
+        if (w->parent < 0) {
+                char parent[PATH_MAX];
+                snprintf(parent, sizeof(parent), "%.*s", w->name > w->path + 1 ? (int)(w->name - w->path - 1) : 1, w->path);
+                if ((w->parent = _addWatch(parent)) >= 0)
+                        w->changed = true;
+        }
+        if (w->self < 0 && (w->self = _addWatch(w->path)) >= 0)
+                w->changed = true; // The object might have changed between the last stat and the watch setup
+}
+
+
+/**
+ * The watch descriptor is not valid anymore (the watched object was removed or moved). Must be called with the engine mutex locked
+ */
+static void _forget(int wd) {
+        for (int i = 0; i < _engine.watched.count; i++) {
+                Watch_T *w = &_engine.watched.list[i];
+                if (w->self == wd) {
+                        w->self = -1;
+                        _touch(w);
+                }
+                if (w->parent == wd) {
+                        w->parent = -1;
+                        _touch(w);
+                }
+        }
+}
+
+
+/**
+ * Mark the watches affected by the event. Must be called with the engine mutex locked
+ */
+static void _dispatch(struct inotify_event *event) {
+        if (event->mask & IN_Q_OVERFLOW) {
+                DEBUG("File events -- event queue overflow, all objects will be checked\n");
+                for (int i = 0; i < _engine.watched.count; i++)
+                        _touch(&_engine.watched.list[i]);
+        } else if (event->mask & IN_IGNORED) {
+                _forget(event->wd);
+        } else if (event->mask & IN_MOVE_SELF) {
+                // The watch follows the moved object, which is not at the monitored path anymore
+                _forget(event->wd);
+                inotify_rm_watch(_engine.fd, event->wd);
+        } else {
+                for (int i = 0; i < _engine.watched.count; i++) {
+                        Watch_T *w = &_engine.watched.list[i];
+                        if (w->self == event->wd || (w->parent == event->wd && event->len && IS(event->name, w->name))) {
+                                if (! w->scheduled)
+                                        DEBUG("File events -- %s changed\n", w->path);
+                                _touch(w);
+                        }
+                }
+        }
+}
+
+
+static void *_watcher(__attribute__ ((unused)) void *args) {
+        set_signal_block();
+        char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        struct pollfd fds[2] = {{.fd = _engine.pipe[0], .events = POLLIN}, {.fd = _engine.fd, .events = POLLIN}};
+        while (_engine.running) {
+                if (poll(fds, 2, -1) < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        Log_error("File events -- poll failed: %s\n", STRERROR);
+                        break;
+                }
+                if (fds[0].revents & POLLIN) {
+                        char buf[64];
+                        while (read(_engine.pipe[0], buf, sizeof(buf)) > 0)
+                                ;
+                }
+                if (fds[1].revents & POLLIN) {
+                        bool pending;
+                        LOCK(_engine.mutex)
+                        {
+                                ssize_t n;
+                                while ((n = read(_engine.fd, buffer, sizeof(buffer))) > 0) {
+                                        for (char *p = buffer; p < buffer + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
+                                                _dispatch((struct inotify_event *)p);
+                                }
+                                pending = _engine.pending;
+                        }
+                        END_LOCK;
+                        if (pending)
+                                kill(getpid(), SIGUSR1); // Wake up the daemon
+                }
+        }
+        return NULL;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool FileEvent_start() {
+        if (_engine.running)
+                return true;
+        if ((_engine.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+                Log_warning("File events are not available -- %s\n", STRERROR);
+                return false;
+        }
+        if (pipe(_engine.pipe) < 0) {
+                Log_error("File events -- cannot create pipe: %s\n", STRERROR);
+                close(_engine.fd);
+                _engine.fd = -1;
+                return false;
+        }
+        for (int i = 0; i < 2; i++) {
+                fcntl(_engine.pipe[i], F_SETFD, FD_CLOEXEC);
+                fcntl(_engine.pipe[i], F_SETFL, O_NONBLOCK);
+        }
+        _engine.running = true;
+        FileEvent_update();
+        Thread_create(_engine.thread, _watcher, NULL);
+        Log_info("File event engine started\n");
+        return true;
+}
+
+
+void FileEvent_stop() {
+        if (_engine.running) {
+                _engine.running = false;
+                _wakeup();
+                Thread_join(_engine.thread);
+                for (int i = 0; i < _engine.watched.count; i++)
+                        FREE(_engine.watched.list[i].path);
+                FREE(_engine.watched.list);
+                _engine.watched.count = _engine.watched.size = 0;
+                _engine.pending = _engine.exhausted = false;
+                close(_engine.fd); // Removes all watches
+                close(_engine.pipe[0]);
+                close(_engine.pipe[1]);
+                _engine.fd = _engine.pipe[0] = _engine.pipe[1] = -1;
+                Log_info("File event engine stopped\n");
+        }
+}
+
+
+void FileEvent_update() {
+        if (_engine.running) {
+                LOCK(_engine.mutex)
+                {
+                        for (int i = 0; i < _engine.watched.count; i++)
+                                _engine.watched.list[i].wanted = false;
+                        for (Service_T s = servicelist; s; s = s->next) {
+                                if (_watchable(s)) {
+                                        Watch_T *w = _find(s);
+                                        if (! w) {
+                                                if (_engine.watched.count == _engine.watched.size) {
+                                                        _engine.watched.size = _engine.watched.size ? _engine.watched.size * 2 : 64;
+                                                        RESIZE(_engine.watched.list, _engine.watched.size * sizeof(Watch_T));
+                                                }
+                                                s->fileEvent = _engine.watched.count;
+                                                w = &_engine.watched.list[_engine.watched.count++];
+                                                *w = (Watch_T){.service = s, .path = Str_dup(s->path), .self = -1, .parent = -1, .changed = true};
+                                                char *name = strrchr(w->path, '/');
+                                                w->name = name ? name + 1 : w->path;
+                                        }
+                                        w->wanted = true;
+                                        _watch(w);
+                                }
+                        }
+                        // Drop the watches of the services which are not monitored anymore, the removed entries are moved past the end of the list
+                        int count = 0, total = _engine.watched.count;
+                        for (int i = 0; i < total; i++) {
+                                Watch_T w = _engine.watched.list[i];
+                                if (w.wanted) {
+                                        w.service->fileEvent = count;
+                                        _engine.watched.list[i] = _engine.watched.list[count];
+                                        _engine.watched.list[count++] = w;
+                                }
+                        }
+                        _engine.watched.count = count;
+                        for (int i = count; i < total; i++) {
+                                Watch_T *w = &_engine.watched.list[i];
+                                _removeWatch(w->self);
+                                _removeWatch(w->parent);
+                                FREE(w->path);
+                        }
+                }
+                END_LOCK;
+        }
+}
+
+
+bool FileEvent_collect() {
+        bool collected = false;
+        if (_engine.running) {
+                LOCK(_engine.mutex)
+                {
+                        if (_engine.pending) {
+                                for (int i = 0; i < _engine.watched.count; i++) {
+                                        Watch_T *w = &_engine.watched.list[i];
+                                        if (w->scheduled) {
+                                                DEBUG("'%s' object changed -- scheduling immediate check\n", w->service->name);
+                                                w->service->every.next = 0;
+                                                w->scheduled = false;
+                                                collected = true;
+                                        }
+                                }
+                                _engine.pending = false;
+                        }
+                }
+                END_LOCK;
+        }
+        return collected;
+}
+
+
+bool FileEvent_pending() {
+        bool pending = false;
+        if (_engine.running) {
+                LOCK(_engine.mutex)
+                {
+                        pending = _engine.pending;
+                }
+                END_LOCK;
+        }
+        return pending;
+}
+
+
+bool FileEvent_unchanged(Service_T s) {
+        ASSERT(s);
+        bool unchanged = false;
+        if (_engine.running) {
+                LOCK(_engine.mutex)
+                {
+                        Watch_T *w = _find(s);
+                        if (w && w->self >= 0 && w->parent >= 0) {
+                                unchanged = ! w->changed;
+                                w->changed = false;
+                        }
+                }
+                END_LOCK;
+        }
+        return unchanged;
+}
+
+
+bool FileEvent_current(Service_T s) {
+        ASSERT(s);
+        bool current = false;
+        if (_engine.running) {
+                LOCK(_engine.mutex)
+                {
+                        Watch_T *w = _find(s);
+                        current = w && w->self >= 0 && w->parent >= 0 && ! w->changed;
+                }
+                END_LOCK;
+        }
+        return current;
+}
+
+
+void FileEvent_invalidate(Service_T s) {
+        ASSERT(s);
+        if (_engine.running) {
+                LOCK(_engine.mutex)
+                {
+                        Watch_T *w = _find(s);
+                        if (w)
+                                w->changed = true;
+                }
+                END_LOCK;
+        }
+}
+
+
+int FileEvent_watchFile(const char *path) {
+        ASSERT(path);
+        char dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s", path);
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd >= 0 && inotify_add_watch(fd, File_dirname(dir), IN_CLOSE_WRITE | IN_CREATE | IN_MODIFY | IN_MOVED_TO) < 0) {
+                DEBUG("File events -- cannot watch %s: %s\n", dir, STRERROR);
+                close(fd);
+                fd = -1;
+        }
+        return fd;
+}
+
+
+bool FileEvent_wait(int watch, int timeout) {
+        if (watch < 0) {
+                Time_usleep(timeout * USEC_PER_MSEC);
+                return false;
+        }
+        struct pollfd event = {.fd = watch, .events = POLLIN};
+        if (poll(&event, 1, timeout) > 0) {
+                // Drain the events, the caller tests the file itself
+                char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+                while (read(watch, buf, sizeof(buf)) > 0)
+                        ;
+                return true;
+        }
+        return false;
+}
+
+
+void FileEvent_unwatchFile(int watch) {
+        if (watch >= 0)
+                close(watch);
+}
+
+
+#else
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool FileEvent_start() {
+        Log_warning("File events are not supported on this system\n");
+        return false;
+}
+
+
+void FileEvent_stop() {
+}
+
+
+void FileEvent_update() {
+}
+
+
+bool FileEvent_collect() {
+        return false;
+}
+
+
+bool FileEvent_pending() {
+        return false;
+}
+
+
+bool FileEvent_unchanged(__attribute__ ((unused)) Service_T s) {
+        return false;
+}
+
+
+bool FileEvent_current(__attribute__ ((unused)) Service_T s) {
+        return false;
+}
+
+
+void FileEvent_invalidate(__attribute__ ((unused)) Service_T s) {
+}
+
+
+int FileEvent_watchFile(__attribute__ ((unused)) const char *path) {
+        return -1;
+}
+
+
+bool FileEvent_wait(__attribute__ ((unused)) int watch, int timeout) {
+        Time_usleep(timeout * USEC_PER_MSEC);
+        return false;
+}
+
+
+void FileEvent_unwatchFile(__attribute__ ((unused)) int watch) {
+}
+
+
+#endif
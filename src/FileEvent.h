@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_FILEEVENT_H
+#define MONIT_FILEEVENT_H
+
+#include "config.h"
+
+
+/**
+ * File event engine. If enabled with "set file events", a thread watches
+ * the paths of the monitored files, directories and fifos and wakes up the
+ * daemon as soon as some object changes, so the service is checked
+ * immediately instead of in the next poll cycle. The check of an object
+ * which didn't change since the last cycle reuses the last stat data and
+ * skips the checksum and content match. The engine is available on Linux
+ * with inotify support, otherwise the objects are polled as usual.
+ *
+ * @file
+ */
+
+
+/**
+ * Start the file event engine
+ * @return true if the engine was started otherwise false
+ */
+bool FileEvent_start(void);
+
+
+/**
+ * Stop the file event engine
+ */
+void FileEvent_stop(void);
+
+
+/**
+ * Update the set of watched paths from the servicelist. Should be
+ * called after each validation cycle as the objects may appear or
+ * disappear
+ */
+void FileEvent_update(void);
+
+
+/**
+ * Schedule the services whose object changed for an immediate check
+ * @return true if some object changed since the last call otherwise false
+ */
+bool FileEvent_collect(void);
+
+
+/**
+ * Test if a file change event is pending
+ * @return true if some object changed and was not collected yet
+ */
+bool FileEvent_pending(void);
+
+
+/**
+ * Test if the service object is watched and didn't change since the last
+ * call. The change flag is cleared, so the next call returns true until
+ * the object changes again
+ * @param s A file, directory or fifo service
+ * @return true if the last stat data of the service are current otherwise false
+ */
+bool FileEvent_unchanged(Service_T s);
+
+
+/**
+ * Test if the service object is watched and didn't change, as
+ * FileEvent_unchanged() but the change flag is kept
+ * @param s A file, directory or fifo service
+ * @return true if the last stat data of the service are current otherwise false
+ */
+bool FileEvent_current(Service_T s);
+
+
+/**
+ * Mark the service object as changed, so the next FileEvent_unchanged()
+ * call returns false. Should be called if the object cannot be tested
+ * @param s A file, directory or fifo service
+ */
+void FileEvent_invalidate(Service_T s);
+
+
+/**
+ * Watch the directory of the file for a private FileEvent_wait(), such as
+ * the wait for the pidfile during the process start. The engine doesn't
+ * need to run
+ * @param path The file path
+ * @return The watch descriptor or -1 if the directory cannot be watched
+ */
+int FileEvent_watchFile(const char *path);
+
+
+/**
+ * Wait for a change in the watched directory. If the watch is -1, just
+ * sleep for the timeout
+ * @param watch The watch descriptor returned by FileEvent_watchFile()
+ * @param timeout The maximum wait in milliseconds
+ * @return true if the directory changed otherwise false
+ */
+bool FileEvent_wait(int watch, int timeout);
+
+
+/**
+ * Remove the watch
+ * @param watch The watch descriptor returned by FileEvent_watchFile()
+ */
+void FileEvent_unwatchFile(int watch);
+
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "monit.h"
+#include "Histogram.h"
+
+
+/**
+ *  The bucket of a value below 16 is the value itself. Larger values are
+ *  split by the position of the most significant bit to magnitudes and
+ *  each magnitude to 16 linear sub-buckets, like in the HDR histogram. The
+ *  window keeps the bucket of each recent sample, so the oldest sample can
+ *  be removed from the counts without a timestamp.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define SUB_BITS    4
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define MAGNITUDES  40 // Values up to 2^40 (12 days in microseconds), larger values are counted in the last bucket
+#define BUCKETS     ((MAGNITUDES - SUB_BITS + 1) * SUB_BUCKETS)
+
+
+#define T Histogram_T
+struct T {
+        int count;                               /**< Number of samples in the window */
+        int cursor;                       /**< Position of the next sample in the window */
+        uint16_t window[HISTOGRAM_WINDOW];        /**< Bucket of the recent samples */
+        uint8_t counts[BUCKETS];                  /**< Number of samples per bucket */
+};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static int _bucket(long long value) {
+        if (value < SUB_BUCKETS)
+                return value < 0 ? 0 : (int)value;
+        int msb = 63 - __builtin_clzll((unsigned long long)value);
+        if (msb >= MAGNITUDES)
+                return BUCKETS - 1;
+        return (msb - SUB_BITS + 1) * SUB_BUCKETS + (int)((value >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+
+static long long _value(int bucket) {
+        if (bucket < 2 * SUB_BUCKETS)
+                return bucket; // The buckets are one unit wide up to here
+        int shift = bucket / SUB_BUCKETS - 1;
+        long long lower = (long long)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        return lower + (1LL << shift) / 2; // The middle of the bucket
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+T Histogram_new(void) {
+        T H;
+        NEW(H);
+        return H;
+}
+
+
+void Histogram_free(T *H) {
+        ASSERT(H && *H);
+        FREE(*H);
+}
+
+
+void Histogram_reset(T H) {
+        ASSERT(H);
+        memset(H, 0, sizeof(*H));
+}
+
+
+void Histogram_add(T H, long long value) {
+        ASSERT(H);
+        int bucket = _bucket(value);
+        if (H->count == HISTOGRAM_WINDOW)
+                H->counts[H->window[H->cursor]]--; // Remove the oldest sample
+        else
+                H->count++;
+        H->window[H->cursor] = bucket;
+        H->counts[bucket]++;
+        H->cursor = (H->cursor + 1) % HISTOGRAM_WINDOW;
+}
+
+
+int Histogram_getCount(T H) {
+        ASSERT(H);
+        return H->count;
+}
+
+
+long long Histogram_getPercentile(T H, double percentile) {
+        ASSERT(H);
+        if (H->count == 0)
+                return -1LL;
+        double position = percentile * H->count / 100.;
+        int rank = (int)position;
+        if (rank < position || rank < 1)
+                rank++; // Round up, the percentile is the value of the sample at the position
+
+        for (int i = 0, seen = 0; i < BUCKETS; i++) {
+                seen += H->counts[i];
+                if (seen >= rank)
+                        return _value(i);
+        }
+        return _value(BUCKETS - 1);
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_HISTOGRAM_H
+#define MONIT_HISTOGRAM_H
+
+#include "config.h"
+
+
+/**
+ * Fixed memory histogram of the recent samples for latency percentiles.
+ * The samples are counted in log-linear buckets (16 buckets per power of
+ * two, so the relative error of a percentile is below 1/32) and the
+ * histogram covers a sliding window of the last HISTOGRAM_WINDOW samples:
+ * the oldest sample is removed when a new one is added.
+ *
+ * @file
+ */
+
+
+#define HISTOGRAM_WINDOW 100
+
+
+#define T Histogram_T
+typedef struct T *T;
+
+
+/**
+ * Create a new empty histogram
+ * @return A new histogram
+ */
+T Histogram_new(void);
+
+
+/**
+ * Free the histogram
+ * @param H A reference to the histogram
+ */
+void Histogram_free(T *H);
+
+
+/**
+ * Remove all samples from the histogram
+ * @param H A histogram
+ */
+void Histogram_reset(T H);
+
+
+/**
+ * Add a sample to the histogram. If the window is full, the oldest sample
+ * is removed
+ * @param H A histogram
+ * @param value The sample value (negative values are counted as zero)
+ */
+void Histogram_add(T H, long long value);
+
+
+/**
+ * Get the number of samples in the window
+ * @param H A histogram
+ * @return The number of samples
+ */
+int Histogram_getCount(T H);
+
+
+/**
+ * Get the value below which the given percentage of the samples fall
+ * @param H A histogram
+ * @param percentile The percentile, e.g. 95 for p95
+ * @return The percentile value or -1 if the histogram has no samples
+ */
+long long Histogram_getPercentile(T H, double percentile);
+
+
+#undef T
+#endif
@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "monit.h"
+#include "LiteralMatch.h"
+
+// libmonit
+#include "util/Str.h"
+#include "exceptions/AssertException.h"
+
+/**
+ *  Aho-Corasick automaton over the literals. The bytes which occur in some
+ *  literal are mapped to character classes 1..n, all other bytes to class
+ *  0, which keeps the dense transition table small. The failure links are
+ *  folded into the transition table, so the scan does exactly one table
+ *  lookup per input byte. Each state has the list of literals which end
+ *  there and a link to the nearest state on the failure chain which has
+ *  some literal too.
+ *
+ *  The literals are collected until the first scan, which builds the
+ *  automaton. The scan marks the found literals with the current text
+ *  stamp, so the marks don't have to be cleared between texts.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define T LiteralMatch_T
+
+
+struct T {
+        int count;                                   /**< Number of literals */
+        int size;                             /**< Allocated literals count */
+        char **literal;               /**< The literals until the automaton is built */
+        int states;                            /**< Number of automaton states */
+        int classes;                          /**< Number of character classes */
+        unsigned char map[256];              /**< Byte to character class map */
+        int *delta;  /**< Transition table [states * classes] or NULL until built */
+        int *output;          /**< First literal ending in the state or -1 */
+        int *dictionary;  /**< Nearest failure state with some literal or 0 */
+        int *next;         /**< Next literal ending in the same state or -1 */
+        unsigned *seen;                       /**< Text stamp of the literal */
+        unsigned stamp;                           /**< Stamp of the last text */
+        int found;                /**< Number of literals found by the last scan */
+        int *list;                          /**< Literals found by the last scan */
+};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _addLiteral(T L, int index) {
+        int state = 0;
+        for (const unsigned char *p = (const unsigned char *)L->literal[index]; *p; p++) {
+                int *transition = &L->delta[state * L->classes + L->map[*p]];
+                if (*transition < 0)
+                        *transition = L->states++;
+                state = *transition;
+        }
+        L->next[index] = L->output[state];
+        L->output[state] = index;
+}
+
+
+static void _build(T L) {
+        int length = 0;
+        for (int i = 0; i < L->count; i++) {
+                for (const unsigned char *p = (const unsigned char *)L->literal[i]; *p; p++) {
+                        if (! L->map[*p])
+                                L->map[*p] = ++L->classes;
+                        length++;
+                }
+        }
+        L->classes++; // Class 0
+        L->states = 1; // Root
+        L->delta = ALLOC((length + 1) * L->classes * sizeof(int));
+        memset(L->delta, 0xff, (length + 1) * L->classes * sizeof(int));
+        L->output = ALLOC((length + 1) * sizeof(int));
+        memset(L->output, 0xff, (length + 1) * sizeof(int));
+        L->dictionary = CALLOC(length + 1, sizeof(int));
+        L->next = ALLOC((L->count + 1) * sizeof(int));
+        L->seen = CALLOC(L->count + 1, sizeof(unsigned));
+        L->list = ALLOC((L->count + 1) * sizeof(int));
+        for (int i = 0; i < L->count; i++) {
+                _addLiteral(L, i);
+                FREE(L->literal[i]);
+        }
+        FREE(L->literal);
+        int *fail = CALLOC(L->states, sizeof(int));
+        int *queue = CALLOC(L->states, sizeof(int));
+        int head = 0, tail = 0;
+        for (int c = 0; c < L->classes; c++) {
+                int *transition = &L->delta[c];
+                if (*transition < 0) {
+                        *transition = 0;
+                } else {
+                        fail[*transition] = 0;
+                        queue[tail++] = *transition;
+                }
+        }
+        // Breadth first: the failure state of a child is the parent's failure state transition, which is already complete
+        while (head < tail) {
+                int state = queue[head++];
+                L->dictionary[state] = L->output[fail[state]] >= 0 ? fail[state] : L->dictionary[fail[state]];
+                for (int c = 0; c < L->classes; c++) {
+                        int *transition = &L->delta[state * L->classes + c];
+                        int target = L->delta[fail[state] * L->classes + c];
+                        if (*transition < 0) {
+                                *transition = target;
+                        } else {
+                                fail[*transition] = target;
+                                queue[tail++] = *transition;
+                        }
+                }
+        }
+        FREE(queue);
+        FREE(fail);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+char *LiteralMatch_literal(const char *regex) {
+        ASSERT(regex);
+        const char *p = regex;
+        size_t bestLength = 0, length = 0;
+        char *run = CALLOC(1, strlen(regex) + 1), *result = NULL;
+        // Close the current literal run, keep it if it is the longest so far
+#define ENDRUN() do { if (length > bestLength) { bestLength = length; FREE(result); result = Str_ndup(run, (int)length); } length = 0; } while (0)
+        while (*p) {
+                switch (*p) {
+                        case '|':
+                                // Top-level alternation: no literal is mandatory
+                                FREE(run);
+                                FREE(result);
+                                return NULL;
+                        case '(':
+                        case '[':
+                                {
+                                        // Skip the group or bracket expression, it is not a literal
+                                        int depth = 0;
+                                        ENDRUN();
+                                        do {
+                                                if (*p == '\\' && p[1]) {
+                                                        p++;
+                                                } else if (*p == '[') {
+                                                        // Bracket expression: ']' right after '[' or '[^' is literal, skip [:class:] etc.
+                                                        p++;
+                                                        if (*p == '^')
+                                                                p++;
+                                                        if (*p == ']')
+                                                                p++;
+                                                        while (*p && *p != ']') {
+                                                                if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+                                                                        char delimiter = p[1];
+                                                                        for (p += 2; *p && ! (*p == delimiter && p[1] == ']'); p++)
+                                                                                ;
+                                                                        if (*p)
+                                                                                p++;
+                                                                }
+                                                                if (*p)
+                                                                        p++;
+                                                        }
+                                                } else if (*p == '(') {
+                                                        depth++;
+                                                } else if (*p == ')') {
+                                                        depth--;
+                                                }
+                                                if (*p)
+                                                        p++;
+                                        } while (*p && depth > 0);
+                                }
+                                continue;
+                        case '*':
+                        case '?':
+                        case '{':
+                                // The previous atom is optional: drop it from the run
+                                if (length)
+                                        length--;
+                                ENDRUN();
+                                if (*p == '{')
+                                        while (*p && *p != '}')
+                                                p++;
+                                break;
+                        case '+':
+                                // The previous atom is mandatory, but may repeat
+                                ENDRUN();
+                                break;
+                        case '.':
+                        case '^':
+                        case '$':
+                        case ')':
+                                ENDRUN();
+                                break;
+                        case '\\':
+                                if (p[1] && strchr(".[]()*+?{}|^$\\", p[1])) {
+                                        p++;
+                                        run[length++] = *p;
+                                } else {
+                                        // Backreference or an extension such as \w or \b
+                                        ENDRUN();
+                                        if (p[1])
+                                                p++;
+                                }
+                                break;
+                        default:
+                                run[length++] = *p;
+                                break;
+                }
+                if (*p)
+                        p++;
+        }
+        ENDRUN();
+#undef ENDRUN
+        FREE(run);
+        return result;
+}
+
+
+T LiteralMatch_new(void) {
+        T L;
+        NEW(L);
+        return L;
+}
+
+
+void LiteralMatch_free(T *L) {
+        ASSERT(L && *L);
+        for (int i = 0; (*L)->literal && i < (*L)->count; i++)
+                FREE((*L)->literal[i]);
+        FREE((*L)->literal);
+        FREE((*L)->delta);
+        FREE((*L)->output);
+        FREE((*L)->dictionary);
+        FREE((*L)->next);
+        FREE((*L)->seen);
+        FREE((*L)->list);
+        FREE(*L);
+}
+
+
+int LiteralMatch_add(T L, const char *literal) {
+        ASSERT(L);
+        ASSERT(literal && *literal);
+        ASSERT(! L->delta);
+        if (L->count == L->size) {
+                L->size = L->size ? L->size * 2 : 8;
+                RESIZE(L->literal, L->size * sizeof(char *));
+        }
+        L->literal[L->count] = Str_dup(literal);
+        return L->count++;
+}
+
+
+int LiteralMatch_scan(T L, const char *text) {
+        ASSERT(L);
+        ASSERT(text);
+        if (! L->delta)
+                _build(L);
+        L->found = 0;
+        if (! L->count)
+                return 0;
+        if (++L->stamp == 0) {
+                memset(L->seen, 0, L->count * sizeof(unsigned));
+                L->stamp = 1;
+        }
+        int state = 0;
+        for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+                state = L->delta[state * L->classes + L->map[*p]];
+                for (int s = L->output[state] >= 0 ? state : L->dictionary[state]; s; s = L->dictionary[s]) {
+                        for (int i = L->output[s]; i >= 0; i = L->next[i]) {
+                                if (L->seen[i] != L->stamp) {
+                                        L->seen[i] = L->stamp;
+                                        L->list[L->found++] = i;
+                                }
+                        }
+                }
+        }
+        return L->found;
+}
+
+
+int LiteralMatch_found(T L, int i) {
+        ASSERT(L);
+        ASSERT(i >= 0 && i < L->found);
+        return L->list[i];
+}
+
+
+bool LiteralMatch_contains(T L, int index) {
+        ASSERT(L);
+        ASSERT(index >= 0 && index < L->count);
+        return L->stamp && L->seen[index] == L->stamp;
+}
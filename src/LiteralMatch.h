@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_LITERALMATCH_H
+#define MONIT_LITERALMATCH_H
+
+#include "config.h"
+
+
+/**
+ * Literal prefilter of the regular expressions. The literal strings which
+ * the patterns require (see LiteralMatch_literal()) are compiled into one
+ * Aho-Corasick automaton, which finds all literals contained in a text in
+ * a single pass. The caller then executes only the regular expressions of
+ * the found literals, so the cost of testing a text depends on the text
+ * length and the number of candidate patterns, not on the number of
+ * patterns. The file content match and the process match use the filter.
+ *
+ * A LiteralMatch object is not thread-safe.
+ *
+ * @file
+ */
+
+
+#define T LiteralMatch_T
+typedef struct T *T;
+
+
+/**
+ * Get the longest literal string, which any text matched by the POSIX
+ * extended regular expression must contain. The extraction is
+ * conservative: the groups, bracket expressions, optional characters and
+ * escapes other than the escaped metacharacters end the literal run and
+ * the pattern with top-level alternation has no literal
+ * @param regex The regular expression
+ * @return The literal string or NULL if the pattern has no literal. The
+ * caller must free the string
+ */
+char *LiteralMatch_literal(const char *regex);
+
+
+/**
+ * Create a new automaton object
+ * @return A new automaton object
+ */
+T LiteralMatch_new(void);
+
+
+/**
+ * Destroy the automaton object
+ * @param L A LiteralMatch object reference
+ */
+void LiteralMatch_free(T *L);
+
+
+/**
+ * Add the literal to the automaton. The literals must be added before the
+ * first LiteralMatch_scan() call, which builds the automaton
+ * @param L A LiteralMatch object
+ * @param literal The non-empty literal string, the string is copied
+ * @return The literal index, the literals are numbered from 0 in the order
+ * they were added
+ */
+int LiteralMatch_add(T L, const char *literal);
+
+
+/**
+ * Scan the text and record which literals it contains
+ * @param L A LiteralMatch object
+ * @param text The NUL terminated text
+ * @return The number of distinct literals found in the text
+ */
+int LiteralMatch_scan(T L, const char *text);
+
+
+/**
+ * Get the literal found by the last scan
+ * @param L A LiteralMatch object
+ * @param i The found literal number, 0 <= i < LiteralMatch_scan() result
+ * @return The literal index
+ */
+int LiteralMatch_found(T L, int i);
+
+
+/**
+ * Test if the text given to the last LiteralMatch_scan() call contains
+ * the literal
+ * @param L A LiteralMatch object
+ * @param index The literal index
+ * @return true if the text contains the literal, otherwise false
+ */
+bool LiteralMatch_contains(T L, int index);
+
+
+#undef T
+#endif
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#include "monit.h"
+#include "Profile.h"
+#include "Box.h"
+
+
+/**
+ *  The samples are added under one mutex: the service checks run in the
+ *  validator workers and the profiles are printed by the HTTP thread. The
+ *  profile of the service is freed with the service on reload, the phase
+ *  profiles live for the lifetime of the daemon.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define T Profile_T
+struct T {
+        long long count;                                /**< Number of the samples */
+        long long last;                               /**< The last duration [μs] */
+        long long max;                             /**< The maximum duration [μs] */
+        long long total;                                 /**< Total duration [μs] */
+        Histogram_T recent;              /**< Histogram of the recent durations */
+};
+
+
+typedef struct ProfileRow_T {
+        const char *name;
+        long long count;
+        long long last;
+        long long max;
+        long long total;
+        long long median;
+        long long p95;
+} ProfileRow_T;
+
+
+static pthread_mutex_t _mutex = PTHREAD_MUTEX_INITIALIZER;
+static T _phases[Profile_Last];
+static const char *_phaseNames[Profile_Last] = {"cycle", "event queue", "system info", "process tree", "service checks", "state save"};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+// Must be called with the mutex locked
+static ProfileRow_T _row(const char *name, T P) {
+        if (! P)
+                return (ProfileRow_T){.name = name};
+        return (ProfileRow_T){
+                .name = name,
+                .count = P->count,
+                .last = P->last,
+                .max = P->max,
+                .total = P->total,
+                .median = MIN(Histogram_getPercentile(P->recent, 50), P->max), // The percentile is the middle of the bucket
+                .p95 = MIN(Histogram_getPercentile(P->recent, 95), P->max)
+        };
+}
+
+
+static int _compareRow(const void *a, const void *b) {
+        const ProfileRow_T *x = a, *y = b;
+        return x->p95 != y->p95 ? (x->p95 < y->p95 ? 1 : -1) : strcmp(x->name, y->name);
+}
+
+
+static void _print(StringBuffer_T B, const char *title, ProfileRow_T *rows, int count) {
+        Box_T t = Box_new(B, 7, (BoxColumn_T []){
+                        {.name = title,         .width = 31, .wrap = false, .align = BoxAlign_Left},
+                        {.name = "Count",       .width = 9,  .wrap = false, .align = BoxAlign_Right},
+                        {.name = "Last [ms]",   .width = 10, .wrap = false, .align = BoxAlign_Right},
+                        {.name = "Median [ms]", .width = 11, .wrap = false, .align = BoxAlign_Right},
+                        {.name = "P95 [ms]",    .width = 10, .wrap = false, .align = BoxAlign_Right},
+                        {.name = "Max [ms]",    .width = 10, .wrap = false, .align = BoxAlign_Right},
+                        {.name = "Total [s]",   .width = 10, .wrap = false, .align = BoxAlign_Right}
+                  }, true);
+        for (int i = 0; i < count; i++) {
+                Box_setColumn(t, 1, "%s", rows[i].name);
+                Box_setColumn(t, 2, "%lld", rows[i].count);
+                if (rows[i].count) {
+                        Box_setColumn(t, 3, "%.3f", rows[i].last / 1000.);
+                        Box_setColumn(t, 4, "%.3f", rows[i].median / 1000.);
+                        Box_setColumn(t, 5, "%.3f", rows[i].p95 / 1000.);
+                        Box_setColumn(t, 6, "%.3f", rows[i].max / 1000.);
+                        Box_setColumn(t, 7, "%.3f", rows[i].total / 1000000.);
+                } else {
+                        for (int c = 3; c <= 7; c++)
+                                Box_setColumn(t, c, "-");
+                }
+                Box_printRow(t);
+        }
+        Box_free(&t);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+long long Profile_start(void) {
+        struct timespec t;
+        if (clock_gettime(CLOCK_MONOTONIC, &t) != 0)
+                return Time_micro();
+        return t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+}
+
+
+void Profile_add(T *P, long long start) {
+        ASSERT(P);
+        long long duration = Profile_start() - start;
+        LOCK(_mutex)
+        {
+                if (! *P) {
+                        NEW(*P);
+                        (*P)->recent = Histogram_new();
+                }
+                T p = *P;
+                p->count++;
+                p->last = duration;
+                p->max = MAX(p->max, duration);
+                p->total += duration;
+                Histogram_add(p->recent, duration);
+        }
+        END_LOCK;
+}
+
+
+
+void Profile_phase(Profile_Phase phase, long long start) {
+        ASSERT(phase >= 0 && phase < Profile_Last);
+        Profile_add(&_phases[phase], start);
+}
+
+
+void Profile_free(T *P) {
+        ASSERT(P);
+        LOCK(_mutex)
+        {
+                if (*P) {
+                        Histogram_free(&(*P)->recent);
+                        FREE(*P);
+                }
+        }
+        END_LOCK;
+}
+
+
+void Profile_print(StringBuffer_T B) {
+        ASSERT(B);
+        int count = 0;
+        for (Service_T s = servicelist_conf; s; s = s->next_conf)
+                count++;
+        ProfileRow_T phases[Profile_Last];
+        ProfileRow_T *services = CALLOC(count + 1, sizeof(ProfileRow_T));
+        LOCK(_mutex)
+        {
+                for (int i = 0; i < Profile_Last; i++)
+                        phases[i] = _row(_phaseNames[i], _phases[i]);
+                int i = 0;
+                for (Service_T s = servicelist_conf; s && i < count; s = s->next_conf)
+                        services[i++] = _row(s->name, s->profile);
+        }
+        END_LOCK;
+        qsort(services, count, sizeof(ProfileRow_T), _compareRow);
+        _print(B, "Cycle Phase", phases, Profile_Last);
+        StringBuffer_append(B, "\n");
+        _print(B, "Service Check", services, count);
+        FREE(services);
+}
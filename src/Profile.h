@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_PROFILE_H
+#define MONIT_PROFILE_H
+
+#include "config.h"
+
+#include "util/StringBuffer.h"
+
+
+/**
+ * Self instrumentation of the daemon: the duration of each service check
+ * and of each phase of the validation cycle is measured with the
+ * monotonic clock. Every profile keeps the number of the samples, the
+ * last, maximum and total duration and the histogram of the recent
+ * durations for the percentiles.
+ *
+ * The profiles are written by the validator and its workers and read by
+ * the HTTP interface, the access is serialized by the module mutex.
+ *
+ * @file
+ */
+
+
+typedef enum {
+        Profile_Cycle = 0,                          /**< The whole validation cycle */
+        Profile_EventQueue,                    /**< Event_queue_process() [μs] */
+        Profile_SystemInfo,                     /**< update_system_info() [μs] */
+        Profile_ProcessTree,                      /**< ProcessTree_init() [μs] */
+        Profile_Checks,                             /**< All service checks [μs] */
+        Profile_StateSave,                               /**< State_save() [μs] */
+        Profile_Last
+} Profile_Phase;
+
+
+#define T Profile_T
+typedef struct T *T;
+
+
+/**
+ * Get the start time of the measured interval
+ * @return The monotonic clock in microseconds
+ */
+long long Profile_start(void);
+
+
+/**
+ * Add the duration since the start to the profile of the service check.
+ * The profile is created on the first sample
+ * @param P A reference to the profile of the service
+ * @param start The start time returned by Profile_start()
+ */
+void Profile_add(T *P, long long start);
+
+
+/**
+ * Add the duration since the start to the profile of the cycle phase
+ * @param phase The phase of the validation cycle
+ * @param start The start time returned by Profile_start()
+ */
+void Profile_phase(Profile_Phase phase, long long start);
+
+
+/**
+ * Free the profile
+ * @param P A reference to the profile
+ */
+void Profile_free(T *P);
+
+
+/**
+ * Print the table of the cycle phases and of the service checks, the
+ * services with the slowest checks (by the 95th percentile) first
+ * @param B The output buffer
+ */
+void Profile_print(StringBuffer_T B);
+
+
+#undef T
+#endif
@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#include "monit.h"
+#include "ProgramOutput.h"
+
+// libmonit
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+/**
+ *  The watched captures are linked in a list which the capture thread
+ *  polls. The thread is started with the first watch and is waked up by
+ *  a pipe when the list changes. The captures are read and modified with
+ *  the mutex locked only, so once a capture is removed from the list by
+ *  ProgramOutput_unwatch(), the thread doesn't access it anymore and the
+ *  caller drains the rest of the output itself.
+ *
+ *  The first half of the limit keeps the head of the output, the second
+ *  half is a ring with the tail of the output.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define T ProgramOutput_T
+
+
+typedef struct Stream_T {
+        int fd;                            /**< The pipe descriptor or -1 if closed */
+        size_t length;                           /**< The length of the line */
+        char *line;                       /**< The incomplete line of the stream */
+} Stream_T;
+
+
+struct T {
+        bool watched;
+        size_t headSize;
+        size_t headLength;
+        size_t tailSize;
+        size_t tailStart;                         /**< Ring start of the tail */
+        size_t tailLength;
+        unsigned long long total;                 /**< The number of bytes read */
+        size_t lineLimit;
+        char *head;
+        char *tail;
+        ProgramOutput_Line callback;
+        void *context;
+        Stream_T streams[2];                             /**< stdout and stderr */
+        T next;
+};
+
+
+static struct {
+        bool running;
+        int pipe[2];                             /**< Capture thread wakeup pipe */
+        T watched;
+        Thread_T thread;
+        Mutex_T mutex;
+} _engine = {.pipe = {-1, -1}, .mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _wakeup(void) {
+        ssize_t __attribute__ ((unused)) n = write(_engine.pipe[1], "", 1);
+}
+
+
+static void _retain(T O, const char *data, size_t length) {
+        O->total += length;
+        size_t n = MIN(length, O->headSize - O->headLength);
+        memcpy(O->head + O->headLength, data, n);
+        O->headLength += n;
+        data += n;
+        length -= n;
+        if (length >= O->tailSize) {
+                memcpy(O->tail, data + length - O->tailSize, O->tailSize);
+                O->tailStart = 0;
+                O->tailLength = O->tailSize;
+        } else if (length) {
+                size_t end = (O->tailStart + O->tailLength) % O->tailSize;
+                n = MIN(length, O->tailSize - end);
+                memcpy(O->tail + end, data, n);
+                memcpy(O->tail, data + n, length - n);
+                O->tailLength += length;
+                if (O->tailLength > O->tailSize) {
+                        O->tailStart = (O->tailStart + O->tailLength - O->tailSize) % O->tailSize;
+                        O->tailLength = O->tailSize;
+                }
+        }
+}
+
+
+/**
+ * Pass the complete lines to the callback, the incomplete line is kept in the stream
+ */
+static void _lines(T O, Stream_T *S, const char *data, size_t length) {
+        for (const char *end = data + length; data < end;) {
+                const char *eol = memchr(data, '\n', end - data);
+                size_t n = (eol ? eol : end) - data;
+                size_t stored = MIN(n, O->lineLimit - S->length);
+                memcpy(S->line + S->length, data, stored);
+                S->length += stored;
+                if (! eol)
+                        break;
+                S->line[S->length] = 0;
+                O->callback(O->context, S->line);
+                S->length = 0;
+                data = eol + 1;
+        }
+}
+
+
+/**
+ * Read the available data of the stream
+ * @return false if the stream was closed
+ */
+static bool _read(T O, Stream_T *S) {
+        char buffer[8192];
+        while (S->fd >= 0) {
+                ssize_t n = read(S->fd, buffer, sizeof(buffer));
+                if (n > 0) {
+                        _retain(O, buffer, n);
+                        if (O->callback)
+                                _lines(O, S, buffer, n);
+                } else if (n < 0 && errno == EINTR) {
+                        continue;
+                } else {
+                        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                                S->fd = -1; // The descriptor is owned by the process, it is closed by Process_free()
+                        break;
+                }
+        }
+        return S->fd >= 0;
+}
+
+
+static void *_capturer(__attribute__ ((unused)) void *args) {
+        set_signal_block();
+        int size = 16;
+        struct pollfd *fds = CALLOC(size, sizeof(struct pollfd));
+        while (true) {
+                int count = 1;
+                fds[0] = (struct pollfd){.fd = _engine.pipe[0], .events = POLLIN};
+                LOCK(_engine.mutex)
+                {
+                        for (T O = _engine.watched; O; O = O->next) {
+                                for (int i = 0; i < 2; i++) {
+                                        if (O->streams[i].fd >= 0) {
+                                                if (count == size) {
+                                                        size *= 2;
+                                                        RESIZE(fds, size * sizeof(struct pollfd));
+                                                }
+                                                fds[count++] = (struct pollfd){.fd = O->streams[i].fd, .events = POLLIN};
+                                        }
+                                }
+                        }
+                }
+                END_LOCK;
+                if (poll(fds, count, -1) < 0 && errno != EINTR) {
+                        Log_error("Program output -- poll failed: %s\n", STRERROR);
+                        break;
+                }
+                if (fds[0].revents & POLLIN) {
+                        char buf[64];
+                        while (read(_engine.pipe[0], buf, sizeof(buf)) > 0)
+                                ;
+                }
+                // The list may have changed during the poll, read all watched streams (they are non-blocking)
+                LOCK(_engine.mutex)
+                {
+                        for (T O = _engine.watched; O; O = O->next)
+                                for (int i = 0; i < 2; i++)
+                                        _read(O, &(O->streams[i]));
+                }
+                END_LOCK;
+        }
+        FREE(fds);
+        LOCK(_engine.mutex)
+        {
+                _engine.running = false;
+        }
+        END_LOCK;
+        return NULL;
+}
+
+
+// Must be called with the mutex locked
+static bool _start(void) {
+        if (_engine.running)
+                return true;
+        if (_engine.pipe[0] < 0) {
+                if (pipe(_engine.pipe) < 0) {
+                        Log_error("Program output -- cannot create pipe: %s\n", STRERROR);
+                        return false;
+                }
+                for (int i = 0; i < 2; i++) {
+                        fcntl(_engine.pipe[i], F_SETFD, FD_CLOEXEC);
+                        fcntl(_engine.pipe[i], F_SETFL, O_NONBLOCK);
+                }
+        }
+        _engine.running = true;
+        Thread_create(_engine.thread, _capturer, NULL);
+        Thread_detach(_engine.thread);
+        return true;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+T ProgramOutput_new(int limit, size_t lineLimit) {
+        ASSERT(limit > 0);
+        T O;
+        NEW(O);
+        O->headSize = limit / 2;
+        O->tailSize = limit - O->headSize;
+        O->head = ALLOC(O->headSize + 1);
+        O->tail = ALLOC(O->tailSize);
+        O->lineLimit = lineLimit > 0 ? lineLimit : 1;
+        for (int i = 0; i < 2; i++) {
+                O->streams[i].fd = -1;
+                O->streams[i].line = ALLOC(O->lineLimit + 1);
+        }
+        return O;
+}
+
+
+void ProgramOutput_free(T *O) {
+        ASSERT(O && *O);
+        ProgramOutput_unwatch(*O);
+        for (int i = 0; i < 2; i++)
+                FREE((*O)->streams[i].line);
+        FREE((*O)->head);
+        FREE((*O)->tail);
+        FREE(*O);
+}
+
+
+void ProgramOutput_watch(T O, Process_T P, ProgramOutput_Line line, void *context) {
+        ASSERT(O);
+        ASSERT(P);
+        ProgramOutput_unwatch(O);
+        O->headLength = O->tailStart = O->tailLength = 0;
+        O->total = 0;
+        O->callback = line;
+        O->context = context;
+        O->streams[0].fd = InputStream_getDescriptor(Process_getInputStream(P));
+        O->streams[1].fd = InputStream_getDescriptor(Process_getErrorStream(P));
+        for (int i = 0; i < 2; i++) {
+                O->streams[i].length = 0;
+                if (O->streams[i].fd >= 0)
+                        fcntl(O->streams[i].fd, F_SETFL, fcntl(O->streams[i].fd, F_GETFL) | O_NONBLOCK);
+        }
+        LOCK(_engine.mutex)
+        {
+                if (_start()) {
+                        O->watched = true;
+                        O->next = _engine.watched;
+                        _engine.watched = O;
+                        _wakeup();
+                }
+        }
+        END_LOCK;
+}
+
+
+void ProgramOutput_unwatch(T O) {
+        ASSERT(O);
+        LOCK(_engine.mutex)
+        {
+                if (O->watched) {
+                        for (T *p = &_engine.watched; *p; p = &(*p)->next) {
+                                if (*p == O) {
+                                        *p = O->next;
+                                        break;
+                                }
+                        }
+                        O->watched = false;
+                        O->next = NULL;
+                        _wakeup();
+                }
+        }
+        END_LOCK;
+        // The capture is not watched by the thread anymore, read the rest of the output
+        for (int i = 0; i < 2; i++) {
+                Stream_T *S = &(O->streams[i]);
+                _read(O, S);
+                if (O->callback && S->length) {
+                        S->line[S->length] = 0;
+                        O->callback(O->context, S->line);
+                }
+                S->length = 0;
+                S->fd = -1;
+        }
+}
+
+
+void ProgramOutput_get(T O, StringBuffer_T B) {
+        ASSERT(O);
+        ASSERT(B);
+        O->head[O->headLength] = 0;
+        StringBuffer_append(B, "%s", O->head);
+        unsigned long long dropped = O->total - O->headLength - O->tailLength;
+        if (dropped)
+                StringBuffer_append(B, "\n... [%llu bytes dropped] ...\n", dropped);
+        size_t n = MIN(O->tailLength, O->tailSize - O->tailStart);
+        StringBuffer_append(B, "%.*s%.*s", (int)n, O->tail + O->tailStart, (int)(O->tailLength - n), O->tail);
+}
+
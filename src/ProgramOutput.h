@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_PROGRAMOUTPUT_H
+#define MONIT_PROGRAMOUTPUT_H
+
+#include "config.h"
+
+
+/**
+ * Program output capture. The stdout and stderr pipes of the running check
+ * programs are drained by one thread as the data arrives, so a program
+ * which writes more than the pipe buffer doesn't block until the next
+ * cycle. The capture keeps at most the limit: the head and the tail of the
+ * output are retained and the middle is dropped. The output lines can be
+ * passed to a callback as they arrive, so the content test sees the whole
+ * output, not only the retained part.
+ *
+ * @file
+ */
+
+
+#define T ProgramOutput_T
+typedef struct T *T;
+
+
+/**
+ * The callback called for each output line. It is called by the capture
+ * thread, or by the thread which calls ProgramOutput_unwatch()
+ * @param context The context given to ProgramOutput_watch()
+ * @param line The line without the newline character
+ */
+typedef void (*ProgramOutput_Line)(void *context, const char *line);
+
+
+/**
+ * Create a program output capture
+ * @param limit The maximum number of the retained bytes
+ * @param lineLimit The maximum line length passed to the callback, the
+ * rest of the longer line is dropped
+ * @return A new capture object
+ */
+T ProgramOutput_new(int limit, size_t lineLimit);
+
+
+/**
+ * Stop watching the program if it is watched and free the capture
+ * @param O A reference to the capture object
+ */
+void ProgramOutput_free(T *O);
+
+
+/**
+ * Start capturing the output of the program. The previous output is
+ * cleared. The pipes of the process must not be read by the caller until
+ * ProgramOutput_unwatch() is called
+ * @param O The capture object
+ * @param P The program process
+ * @param line The line callback or NULL
+ * @param context The callback context
+ */
+void ProgramOutput_watch(T O, Process_T P, ProgramOutput_Line line, void *context);
+
+
+/**
+ * Stop capturing the output. The data which is available in the pipes is
+ * read and the incomplete last line is passed to the callback. Must be
+ * called before the process is freed
+ * @param O The capture object
+ */
+void ProgramOutput_unwatch(T O);
+
+
+/**
+ * Append the retained output to the buffer. If the middle of the output
+ * was dropped, it is replaced by a note with the number of the dropped
+ * bytes. Should be called after ProgramOutput_unwatch()
+ * @param O The capture object
+ * @param B The buffer
+ */
+void ProgramOutput_get(T O, StringBuffer_T B);
+
+
+#undef T
+#endif
+
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDDEF_H
+#include <stddef.h>
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+// libmonit
+#include "util/HashMap.h"
+
+#include "monit.h"
+#include "RegexCache.h"
+
+
+/**
+ *  The compiled expression is embedded in the cache entry, so the entry of
+ *  the released expression is found from its address without a lookup. The
+ *  map key is the flags and the pattern, i.e. "<flags> <pattern>".
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef struct RegexEntry_T {
+        regex_t regex;                          /**< The compiled expression */
+        int references;                           /**< Number of the users */
+        char *key;                                    /**< The cache map key */
+} *RegexEntry_T;
+
+
+static HashMap_T _cache = NULL;
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+regex_t *RegexCache_get(const char *pattern, int flags, char *error, size_t size) {
+        ASSERT(pattern);
+        ASSERT(error);
+        if (! _cache)
+                _cache = HashMap_new(HashMap_String, 0);
+        char *key = Str_cat("%d %s", flags, pattern);
+        RegexEntry_T entry = HashMap_get(_cache, key);
+        if (entry) {
+                FREE(key);
+                entry->references++;
+                return &(entry->regex);
+        }
+        NEW(entry);
+        int rv = regcomp(&(entry->regex), pattern, flags);
+        if (rv != 0) {
+                regerror(rv, &(entry->regex), error, size);
+                regfree(&(entry->regex));
+                FREE(entry);
+                FREE(key);
+                return NULL;
+        }
+        entry->references = 1;
+        entry->key = key;
+        HashMap_put(_cache, entry->key, entry);
+        return &(entry->regex);
+}
+
+
+void RegexCache_release(regex_t **regex) {
+        ASSERT(regex);
+        if (*regex) {
+                RegexEntry_T entry = (RegexEntry_T)((char *)*regex - offsetof(struct RegexEntry_T, regex));
+                if (--entry->references == 0) {
+                        HashMap_remove(_cache, entry->key);
+                        regfree(&(entry->regex));
+                        FREE(entry->key);
+                        FREE(entry);
+                        if (HashMap_length(_cache) == 0)
+                                HashMap_free(&_cache);
+                }
+                *regex = NULL;
+        }
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_REGEXCACHE_H
+#define MONIT_REGEXCACHE_H
+
+#include "config.h"
+
+#ifdef HAVE_REGEX_H
+#include <regex.h>
+#endif
+
+
+/**
+ * Reference counted cache of the compiled regular expressions. The parser
+ * gets the match, content, expect and request patterns from the cache, so
+ * a pattern repeated in thousands of services is compiled and stored once.
+ * The compiled expression is shared read-only, regexec() may use it from
+ * several threads. Each RegexCache_get() must be paired with
+ * RegexCache_release(), the expression is freed with its last user. The
+ * cache is used by the parser and the garbage collector in the main thread
+ * only, it is not thread-safe.
+ *
+ * @file
+ */
+
+
+/**
+ * Get the compiled regular expression for the pattern and flags. The
+ * expression is compiled if it is not in the cache yet
+ * @param pattern The regular expression
+ * @param flags The regcomp() flags
+ * @param error The buffer for the regerror() message if the compilation failed
+ * @param size The error buffer size
+ * @return The compiled expression or NULL if the pattern is invalid
+ */
+regex_t *RegexCache_get(const char *pattern, int flags, char *error, size_t size);
+
+
+/**
+ * Release the expression obtained by RegexCache_get(). The expression is
+ * freed if it has no other user and the reference is set to NULL
+ * @param regex A reference to the compiled expression
+ */
+void RegexCache_release(regex_t **regex);
+
+
+#endif
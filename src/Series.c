@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_MATH_H
+#include <math.h>
+#endif
+
+#include <stdatomic.h>
+
+#include "monit.h"
+#include "Series.h"
+
+
+/**
+ *  The samples are kept in a ring, the cursor points to the slot of the
+ *  next sample. The series is a sequence lock like the ServiceStatus
+ *  snapshot: the validator is the only writer and the version is odd while
+ *  a sample is added, the reader retries the copy if the version changed.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define T Series_T
+struct T {
+        atomic_ullong version;                   /**< Odd while a sample is added */
+        struct {
+                int count;                                /**< Number of samples */
+                int cursor;                   /**< Position of the next sample */
+                time_t time[SERIES_CAPACITY];            /**< Sample timestamps */
+                float value[Series_Last][SERIES_CAPACITY];   /**< Metric columns */
+        } samples;
+};
+
+
+static const char *_names[] = {"cpu", "memory", "responsetime", "read", "write"};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+// Translate the sample index (0 is the oldest) to the ring slot
+static inline int _slot(T S, int index) {
+        return (S->samples.cursor - S->samples.count + index + SERIES_CAPACITY) % SERIES_CAPACITY;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+T Series_new(void) {
+        T S;
+        NEW(S);
+        return S;
+}
+
+
+void Series_free(T *S) {
+        ASSERT(S && *S);
+        FREE(*S);
+}
+
+
+void Series_add(T S, time_t time, const double values[Series_Last]) {
+        ASSERT(S);
+        ASSERT(values);
+        unsigned long long version = atomic_load_explicit(&S->version, memory_order_relaxed);
+        atomic_store_explicit(&S->version, version + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        int slot = S->samples.cursor;
+        S->samples.time[slot] = time;
+        for (int i = 0; i < Series_Last; i++)
+                S->samples.value[i][slot] = (float)values[i];
+        S->samples.cursor = (slot + 1) % SERIES_CAPACITY;
+        if (S->samples.count < SERIES_CAPACITY)
+                S->samples.count++;
+        atomic_store_explicit(&S->version, version + 2, memory_order_release);
+}
+
+
+void Series_copy(T S, T copy) {
+        ASSERT(S);
+        ASSERT(copy);
+        unsigned long long before, after;
+        do {
+                while ((before = atomic_load_explicit(&S->version, memory_order_acquire)) & 1)
+                        ;
+                memcpy(&copy->samples, &S->samples, sizeof(S->samples));
+                atomic_thread_fence(memory_order_acquire);
+                after = atomic_load_explicit(&S->version, memory_order_relaxed);
+        } while (before != after);
+        atomic_store_explicit(&copy->version, 0, memory_order_relaxed);
+}
+
+
+int Series_getCount(T S) {
+        ASSERT(S);
+        return S->samples.count;
+}
+
+
+time_t Series_getTime(T S, int index) {
+        ASSERT(S);
+        ASSERT(index >= 0 && index < S->samples.count);
+        return S->samples.time[_slot(S, index)];
+}
+
+
+double Series_getValue(T S, Series_Metric metric, int index) {
+        ASSERT(S);
+        ASSERT(metric >= 0 && metric < Series_Last);
+        ASSERT(index >= 0 && index < S->samples.count);
+        return S->samples.value[metric][_slot(S, index)];
+}
+
+
+bool Series_getChange(T S, Series_Metric metric, int period, double *change) {
+        ASSERT(S);
+        ASSERT(change);
+        int last = S->samples.count - 1;
+        if (last < 1)
+                return false;
+        double current = Series_getValue(S, metric, last);
+        if (isnan(current))
+                return false;
+        time_t limit = Series_getTime(S, last) - period;
+        for (int i = last - 1; i >= 0; i--) {
+                if (Series_getTime(S, i) <= limit) {
+                        double base = Series_getValue(S, metric, i);
+                        if (isnan(base) || base == 0.)
+                                return false;
+                        *change = (current - base) * 100. / base;
+                        return true;
+                }
+        }
+        return false; // The series doesn't cover the period yet
+}
+
+
+const char *Series_getName(Series_Metric metric) {
+        ASSERT(metric >= 0 && metric < Series_Last);
+        return _names[metric];
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_SERIES_H
+#define MONIT_SERIES_H
+
+#include "config.h"
+
+
+/**
+ * Fixed memory time series of the recent service metrics. The series
+ * keeps the last SERIES_CAPACITY samples, each sample has the collection
+ * timestamp and the value of every metric (NAN if the metric is not
+ * available for the service or in the given cycle). The values are stored
+ * in columns, so the history of one metric is contiguous.
+ *
+ * The series is written by the validator and can be copied by other
+ * threads (the HTTP interface) at any time.
+ *
+ * @file
+ */
+
+
+#define SERIES_CAPACITY 240
+
+
+typedef enum {
+        Series_Cpu = 0,                                           /**< CPU usage [%] */
+        Series_Memory,                                     /**< Memory usage [bytes] */
+        Series_ResponseTime,                                /**< Response time [ms] */
+        Series_Read,                                       /**< Read rate [bytes/s] */
+        Series_Write,                                     /**< Write rate [bytes/s] */
+        Series_Last
+} Series_Metric;
+
+
+#define T Series_T
+typedef struct T *T;
+
+
+/**
+ * Create a new empty series
+ * @return A new series
+ */
+T Series_new(void);
+
+
+/**
+ * Free the series
+ * @param S A reference to the series
+ */
+void Series_free(T *S);
+
+
+/**
+ * Add a sample to the series. If the series is full, the oldest sample
+ * is replaced
+ * @param S A series
+ * @param time The sample timestamp [s]
+ * @param values The value of each metric, NAN if not available
+ */
+void Series_add(T S, time_t time, const double values[Series_Last]);
+
+
+/**
+ * Make a consistent copy of the series, which can be read while the
+ * validator adds new samples to the original
+ * @param S A series
+ * @param copy The series to copy the samples to
+ */
+void Series_copy(T S, T copy);
+
+
+/**
+ * Get the number of samples in the series
+ * @param S A series
+ * @return The number of samples
+ */
+int Series_getCount(T S);
+
+
+/**
+ * Get the timestamp of the sample
+ * @param S A series
+ * @param index The sample index, 0 is the oldest sample
+ * @return The sample timestamp [s]
+ */
+time_t Series_getTime(T S, int index);
+
+
+/**
+ * Get the metric value of the sample
+ * @param S A series
+ * @param metric The metric
+ * @param index The sample index, 0 is the oldest sample
+ * @return The value or NAN if the metric was not available
+ */
+double Series_getValue(T S, Series_Metric metric, int index);
+
+
+/**
+ * Get the relative change of the metric over the given period: the last
+ * value is compared with the newest value which is at least period
+ * seconds older
+ * @param S A series
+ * @param metric The metric
+ * @param period The period [s]
+ * @param change The change [%] output
+ * @return true if the change is known, false if the series doesn't cover
+ * the period yet or the base value is zero
+ */
+bool Series_getChange(T S, Series_Metric metric, int period, double *change);
+
+
+/**
+ * Get the metric name
+ * @param metric The metric
+ * @return The metric name, e.g. "memory"
+ */
+const char *Series_getName(Series_Metric metric);
+
+
+#undef T
+#endif
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <stdatomic.h>
+
+#include "monit.h"
+#include "ServiceStatus.h"
+
+// libmonit
+#include "exceptions/AssertException.h"
+
+/**
+ *  The snapshot is a sequence lock: the service owner (the validator, or
+ *  the action thread while the service is busy) is the only writer, it
+ *  makes the version odd, copies the service and makes the version even
+ *  again. A reader copies the snapshot and retries if the version was
+ *  odd or changed during the copy. The writer never waits for the readers
+ *  and the readers don't block the writer, the snapshot memory is never
+ *  reallocated, so there is nothing to reclaim.
+ *
+ *  The runtime data which the service references (the type specific info)
+ *  is copied too. The data referenced from the info (the network link
+ *  statistics, the program output) is shared with the live service.
+ *
+ *  The fragments rendered from the snapshot are kept with the snapshot and
+ *  tagged with the version they were rendered from. A service which wasn't
+ *  validated (it was not due) keeps its version, so its fragments are reused
+ *  as they are. The fragments are shared by the readers, the fragment mutex
+ *  serializes their access, the rendering itself is done by each reader
+ *  without the lock.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef union ServiceInfo_T {
+        struct DirectoryInfo_T directory;
+        struct FifoInfo_T fifo;
+        struct FileInfo_T file;
+        struct FileSystemInfo_T filesystem;
+        struct NetInfo_T net;
+        struct ProcessInfo_T process;
+} ServiceInfo_T;
+
+
+typedef struct Fragment_T {
+        unsigned long long version;  /**< The snapshot version, 0 = not cached */
+        Action_Type doaction;       /**< The pending action shown in the status */
+        int length;                                  /**< The fragment length */
+        char *data;                                 /**< The rendered fragment */
+} Fragment_T;
+
+
+#define T ServiceStatus_T
+struct T {
+        atomic_ullong version;               /**< Odd while the copy is updated */
+        struct Service_T service;                       /**< Copy of the service */
+        ServiceInfo_T info;                /**< Copy of the service specific info */
+        /** The snapshot fragments */
+        Fragment_T fragments[StatusFormat_Max];
+        /** Reader buffer */
+        struct {
+                T snapshot;           /**< The snapshot copied by the last get */
+                unsigned long long version;          /**< The copied version */
+        } copied;
+};
+
+
+static Mutex_T _fragmentMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+// The number of the published statuses
+static atomic_ullong _version;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static size_t _infoSize(Service_T s) {
+        switch (s->type) {
+                case Service_Directory:
+                        return sizeof(struct DirectoryInfo_T);
+                case Service_Fifo:
+                        return sizeof(struct FifoInfo_T);
+                case Service_File:
+                        return sizeof(struct FileInfo_T);
+                case Service_Filesystem:
+                        return sizeof(struct FileSystemInfo_T);
+                case Service_Net:
+                        return sizeof(struct NetInfo_T);
+                case Service_Process:
+                        return sizeof(struct ProcessInfo_T);
+                default:
+                        return 0;
+        }
+}
+
+
+static void _copy(Service_T source, struct Service_T *service, ServiceInfo_T *info) {
+        size_t size = _infoSize(source);
+        memcpy(service, source, sizeof(struct Service_T));
+        if (size && source->inf.directory) {
+                memcpy(info, source->inf.directory, size);
+                service->inf.directory = (DirectoryInfo_T)info;
+        }
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void ServiceStatus_init(Service_T s) {
+        ASSERT(s);
+        NEW(s->status);
+}
+
+
+void ServiceStatus_free(Service_T s) {
+        ASSERT(s);
+        if (s->status)
+                for (int i = 0; i < StatusFormat_Max; i++)
+                        FREE(s->status->fragments[i].data);
+        FREE(s->status);
+}
+
+
+void ServiceStatus_publish(Service_T s) {
+        ASSERT(s);
+        T S = s->status;
+        if (S) {
+                unsigned long long version = atomic_load_explicit(&S->version, memory_order_relaxed);
+                atomic_store_explicit(&S->version, version + 1, memory_order_relaxed);
+                atomic_thread_fence(memory_order_release);
+                _copy(s, &S->service, &S->info);
+                atomic_store_explicit(&S->version, version + 2, memory_order_release);
+                atomic_fetch_add_explicit(&_version, 1, memory_order_release);
+        }
+}
+
+
+unsigned long long ServiceStatus_getVersion(void) {
+        return atomic_load_explicit(&_version, memory_order_acquire);
+}
+
+
+T ServiceStatus_new(void) {
+        T S;
+        NEW(S);
+        return S;
+}
+
+
+void ServiceStatus_delete(T *S) {
+        ASSERT(S && *S);
+        FREE(*S);
+}
+
+
+Service_T ServiceStatus_get(T S, Service_T s) {
+        ASSERT(S);
+        ASSERT(s);
+        T P = s->status;
+        if (P && atomic_load_explicit(&P->version, memory_order_acquire) > 0) {
+                unsigned long long before, after;
+                do {
+                        while ((before = atomic_load_explicit(&P->version, memory_order_acquire)) & 1)
+                                ;
+                        memcpy(&S->service, &P->service, sizeof(struct Service_T));
+                        memcpy(&S->info, &P->info, _infoSize(s));
+                        atomic_thread_fence(memory_order_acquire);
+                        after = atomic_load_explicit(&P->version, memory_order_relaxed);
+                } while (before != after);
+                if (S->service.inf.directory)
+                        S->service.inf.directory = (DirectoryInfo_T)&S->info;
+                S->copied.snapshot = s->type == Service_System ? NULL : P;
+                S->copied.version = before;
+        } else {
+                _copy(s, &S->service, &S->info);
+                S->copied.snapshot = NULL;
+        }
+        // The action is scheduled by the HTTP interface, show it before the validator picks it up
+        S->service.doaction = s->doaction;
+        return &S->service;
+}
+
+
+bool ServiceStatus_getFragment(T S, StatusFormat_Type format, StringBuffer_T B) {
+        ASSERT(S);
+        ASSERT(format < StatusFormat_Max);
+        ASSERT(B);
+        bool rv = false;
+        if (S->copied.snapshot) {
+                LOCK(_fragmentMutex)
+                {
+                        Fragment_T *f = &S->copied.snapshot->fragments[format];
+                        if (f->version == S->copied.version && f->doaction == S->service.doaction) {
+                                StringBuffer_appendBytes(B, f->data, f->length);
+                                rv = true;
+                        }
+                }
+                END_LOCK;
+        }
+        return rv;
+}
+
+
+void ServiceStatus_setFragment(T S, StatusFormat_Type format, const void *fragment, int length) {
+        ASSERT(S);
+        ASSERT(format < StatusFormat_Max);
+        ASSERT(fragment);
+        if (S->copied.snapshot && length > 0) {
+                LOCK(_fragmentMutex)
+                {
+                        Fragment_T *f = &S->copied.snapshot->fragments[format];
+                        // Another reader may have stored the fragment of a newer version meanwhile
+                        if (S->copied.version >= f->version) {
+                                RESIZE(f->data, length);
+                                memcpy(f->data, fragment, length);
+                                f->length = length;
+                                f->version = S->copied.version;
+                                f->doaction = S->service.doaction;
+                        }
+                }
+                END_LOCK;
+        }
+}
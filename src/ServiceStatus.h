@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_SERVICESTATUS_H
+#define MONIT_SERVICESTATUS_H
+
+#include "config.h"
+
+
+/**
+ * Service status snapshot: the validator publishes a copy of the service
+ * status at the end of each service validation and the readers (the HTTP
+ * interface, the XML status and the reports) render the status from the
+ * published copy, without locking and without seeing a half updated
+ * service. The snapshot is versioned, a reader which copied the snapshot
+ * while the validator was publishing a new version retries the copy.
+ *
+ * The status rendered from a snapshot (text, XML or CBOR) can be cached
+ * with the snapshot as a fragment, so the status documents only render
+ * the services which published a new version since they were last sent.
+ *
+ * @file
+ */
+
+
+#define T ServiceStatus_T
+typedef struct T *T;
+
+
+/** The cached status fragment formats */
+typedef enum {
+        StatusFormat_Text = 0,
+        StatusFormat_Xml1,
+        StatusFormat_Xml2,
+        StatusFormat_Cbor,
+        StatusFormat_Json,
+        StatusFormat_Max
+} StatusFormat_Type;
+
+
+/**
+ * Create the service status snapshot. It is called when the service
+ * is created, before any reader can access it
+ * @param s A service
+ */
+void ServiceStatus_init(Service_T s);
+
+
+/**
+ * Free the service status snapshot
+ * @param s A service
+ */
+void ServiceStatus_free(Service_T s);
+
+
+/**
+ * Publish the current status of the service. Only the thread which owns
+ * the service may call this method: the validator, or the thread which
+ * executes the service action while the service is busy (the validator
+ * skips the busy service). The monitoring state changes and the actions
+ * publish the status, so the readers see them before the next validation
+ * @param s A service
+ */
+void ServiceStatus_publish(Service_T s);
+
+
+/**
+ * Get the version of the services status. It is incremented whenever some
+ * service publishes its status, so the readers can tell that nothing
+ * changed since they rendered the status last time
+ * @return The status version
+ */
+unsigned long long ServiceStatus_getVersion(void);
+
+
+/**
+ * Create a reader buffer for ServiceStatus_get()
+ * @return A new reader buffer
+ */
+T ServiceStatus_new(void);
+
+
+/**
+ * Free a reader buffer
+ * @param S A reference to the reader buffer
+ */
+void ServiceStatus_delete(T *S);
+
+
+/**
+ * Copy the last published status of the service to the reader buffer. If
+ * no status was published yet, the current service status is copied. The
+ * returned service is valid until the next call with the same buffer, it
+ * has the runtime data of the snapshot and shares the configuration with
+ * the service (the configuration doesn't change while the service exists)
+ * @param S A reader buffer
+ * @param s A service
+ * @return The service snapshot
+ */
+Service_T ServiceStatus_get(T S, Service_T s);
+
+
+/**
+ * Append the cached fragment of the snapshot which was copied to the reader
+ * buffer by the last ServiceStatus_get() call. The fragment is valid if it
+ * was rendered from the same snapshot version and pending action. The
+ * system service status, which contains the global system statistics, and
+ * the status which was not published yet are not cached
+ * @param S A reader buffer
+ * @param format The fragment format
+ * @param B The buffer to append the fragment to
+ * @return true if the fragment was appended, otherwise false and the caller
+ * should render the fragment and store it with ServiceStatus_setFragment()
+ */
+bool ServiceStatus_getFragment(T S, StatusFormat_Type format, StringBuffer_T B);
+
+
+/**
+ * Store the fragment rendered from the snapshot in the reader buffer
+ * @param S A reader buffer
+ * @param format The fragment format
+ * @param fragment The rendered status (may be binary)
+ * @param length The fragment length
+ */
+void ServiceStatus_setFragment(T S, StatusFormat_Type format, const void *fragment, int length);
+
+
+#undef T
+#endif
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include <stdatomic.h>
+
+#include "monit.h"
+#include "ServiceStatus.h"
+#include "StatusFile.h"
+#include "ProcessTree.h"
+#include "cervlet.h"
+#include "Box.h"
+
+// libmonit
+#include "system/Time.h"
+
+
+/**
+ *  The status file has the header followed by one record per service in the
+ *  configuration order. The daemon updates the file with a sequence lock
+ *  like the ServiceStatus snapshot: the sequence is odd while the records
+ *  are updated. The reader copies the file and retries if the sequence was
+ *  odd or changed during the copy. The records have a fixed size and the
+ *  file is created again for the new service list on reload.
+ *
+ *  The service status is rendered when the file is updated, the reader just
+ *  lays out the summary table.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define STATUSFILE_MAGIC   0x4d4f4e53 // "MONS"
+#define STATUSFILE_VERSION 1
+#define STATUSFILE_RETRY   100
+
+
+typedef struct StatusFileHeader_T {
+        uint32_t magic;
+        uint32_t version;
+        atomic_uint sequence;                /**< Odd while the file is updated */
+        int32_t pid;                                           /**< Daemon pid */
+        int64_t started;                            /**< Daemon start time [s] */
+        int32_t count;                                  /**< Number of records */
+} StatusFileHeader_T;
+
+
+typedef struct StatusFileRecord_T {
+        char name[STRLEN];
+        char status[STRLEN];
+        int32_t type;
+} StatusFileRecord_T;
+
+
+static struct {
+        char path[PATH_MAX];
+        size_t size;
+        StatusFileHeader_T *header;
+        ServiceStatus_T buffer;
+} _status = {};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+// The status file is in the pid file directory: /var/run/monit.pid -> /var/run/monit.status
+static char *_path(char path[static PATH_MAX]) {
+        snprintf(path, PATH_MAX, "%s", Run.files.pid);
+        char *suffix = strrchr(path, '.');
+        if (suffix && Str_isEqual(suffix, ".pid"))
+                *suffix = 0;
+        snprintf(path + strlen(path), PATH_MAX - strlen(path), ".status");
+        return path;
+}
+
+
+#ifdef HAVE_SYS_MMAN_H
+static void _printRecord(Box_T t, StatusFileRecord_T *r) {
+        Box_setColumn(t, 1, "%s", r->name);
+        Box_setColumn(t, 2, "%s", r->status);
+        Box_setColumn(t, 3, "%s", r->type >= 0 && r->type <= Service_Last ? servicetypes[r->type] : "");
+        Box_printRow(t);
+}
+
+
+static bool _isMember(ServiceGroup_T g, const char *name) {
+        for (list_t m = g->members->head; m; m = m->next)
+                if (IS(((Service_T)m->e)->name, name))
+                        return true;
+        return false;
+}
+
+
+// Copy the consistent version of the status file
+static StatusFileHeader_T *_read(StatusFileHeader_T *mapped, size_t size) {
+        StatusFileHeader_T *copy = ALLOC(size);
+        for (int i = 0; i < STATUSFILE_RETRY; i++) {
+                unsigned int before = atomic_load_explicit(&mapped->sequence, memory_order_acquire);
+                if (! (before & 1)) {
+                        memcpy(copy, mapped, size);
+                        atomic_thread_fence(memory_order_acquire);
+                        if (atomic_load_explicit(&mapped->sequence, memory_order_relaxed) == before)
+                                return copy;
+                }
+                usleep(1000);
+        }
+        FREE(copy);
+        return NULL;
+}
+#endif
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void StatusFile_open(void) {
+#ifdef HAVE_SYS_MMAN_H
+        StatusFile_close();
+        int count = 0;
+        for (Service_T s = servicelist_conf; s; s = s->next_conf)
+                count++;
+        _path(_status.path);
+        _status.size = sizeof(StatusFileHeader_T) + count * sizeof(StatusFileRecord_T);
+        // Create the new file, the reader which has the old file mapped keeps the old copy
+        unlink(_status.path);
+        int fd = open(_status.path, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd == -1) {
+                Log_warning("Status file '%s': cannot create -- %s\n", _status.path, STRERROR);
+                return;
+        }
+        if (ftruncate(fd, _status.size) == -1 || (_status.header = mmap(NULL, _status.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+                Log_warning("Status file '%s': cannot map -- %s\n", _status.path, STRERROR);
+                _status.header = NULL;
+                close(fd);
+                unlink(_status.path);
+                return;
+        }
+        close(fd);
+        if (! _status.buffer)
+                _status.buffer = ServiceStatus_new();
+        _status.header->magic = STATUSFILE_MAGIC;
+        _status.header->version = STATUSFILE_VERSION;
+        _status.header->pid = getpid();
+        _status.header->started = Time_now() - ProcessTree_getProcessUptime(getpid());
+        _status.header->count = count;
+        // The sequence starts odd, the readers wait for the first update
+        atomic_store_explicit(&_status.header->sequence, 1, memory_order_release);
+        StatusFile_update();
+#endif
+}
+
+
+void StatusFile_close(void) {
+#ifdef HAVE_SYS_MMAN_H
+        if (_status.header) {
+                munmap(_status.header, _status.size);
+                _status.header = NULL;
+                unlink(_status.path);
+        }
+        if (_status.buffer)
+                ServiceStatus_delete(&_status.buffer);
+#endif
+}
+
+
+void StatusFile_update(void) {
+#ifdef HAVE_SYS_MMAN_H
+        StatusFileHeader_T *h = _status.header;
+        if (h) {
+                unsigned int sequence = atomic_load_explicit(&h->sequence, memory_order_relaxed) | 1;
+                atomic_store_explicit(&h->sequence, sequence, memory_order_relaxed);
+                atomic_thread_fence(memory_order_release);
+                StatusFileRecord_T *r = (StatusFileRecord_T *)(h + 1);
+                for (Service_T s = servicelist_conf; s && r < (StatusFileRecord_T *)(h + 1) + h->count; s = s->next_conf, r++) {
+                        Service_T S = ServiceStatus_get(_status.buffer, s);
+                        snprintf(r->name, sizeof(r->name), "%s", S->name);
+                        get_service_status_text(S, r->status, sizeof(r->status));
+                        r->type = S->type;
+                }
+                atomic_store_explicit(&h->sequence, sequence + 1, memory_order_release);
+        }
+#endif
+}
+
+
+bool StatusFile_summary(StringBuffer_T B, const char *group, const char *service, bool plain) {
+        ASSERT(B);
+        bool rv = false;
+#ifdef HAVE_SYS_MMAN_H
+        char path[PATH_MAX];
+        int fd = open(_path(path), O_RDONLY);
+        if (fd == -1)
+                return false;
+        struct stat st;
+        StatusFileHeader_T *mapped = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(StatusFileHeader_T))
+                mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+                return false;
+        ServiceGroup_T g = group ? Util_getServiceGroup(group) : NULL;
+        StatusFileHeader_T *h = NULL;
+        // The daemon which created the file must be running, otherwise the file is stale
+        if (mapped->magic == STATUSFILE_MAGIC && mapped->version == STATUSFILE_VERSION && mapped->pid == exist_daemon() && sizeof(StatusFileHeader_T) + mapped->count * sizeof(StatusFileRecord_T) == (size_t)st.st_size && (! group || g) && (h = _read(mapped, st.st_size))) {
+                int found = 0;
+                StatusFileRecord_T *records = (StatusFileRecord_T *)(h + 1);
+                for (int i = 0; i < h->count; i++)
+                        records[i].name[sizeof(records[i].name) - 1] = records[i].status[sizeof(records[i].status) - 1] = 0;
+                StringBuffer_T table = StringBuffer_create(STRLEN * 4);
+                Box_T t = Box_new(table, 3, (BoxColumn_T []){
+                                {.name = "Service Name", .width = 31, .wrap = false, .align = BoxAlign_Left},
+                                {.name = "Status",       .width = 26, .wrap = false, .align = BoxAlign_Left},
+                                {.name = "Type",         .width = 13, .wrap = false, .align = BoxAlign_Left}
+                          }, true);
+                Box_setPlain(t, plain);
+                if (g || service) {
+                        for (int i = 0; i < h->count; i++) {
+                                if (g ? _isMember(g, records[i].name) : IS(service, records[i].name)) {
+                                        _printRecord(t, &records[i]);
+                                        found++;
+                                }
+                        }
+                } else {
+                        Service_Type types[] = {Service_System, Service_Process, Service_File, Service_Fifo, Service_Directory, Service_Filesystem, Service_Host, Service_Net, Service_Program};
+                        for (int k = 0; k < (int)(sizeof(types) / sizeof(types[0])); k++) {
+                                for (int i = 0; i < h->count; i++) {
+                                        if (records[i].type == types[k]) {
+                                                _printRecord(t, &records[i]);
+                                                found++;
+                                        }
+                                }
+                        }
+                }
+                Box_free(&t);
+                // Not found: let the daemon report the error
+                if (found) {
+                        StringBuffer_append(B, "Monit %s uptime: %s\n%s", VERSION, Util_getUptime(Time_now() - h->started, (char[256]){}), StringBuffer_toString(table));
+                        rv = true;
+                }
+                StringBuffer_free(&table);
+                FREE(h);
+        }
+        munmap(mapped, st.st_size);
+#endif
+        return rv;
+}
+
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_STATUSFILE_H
+#define MONIT_STATUSFILE_H
+
+#include "config.h"
+
+
+/**
+ * Service status file: the daemon publishes the summary status of all
+ * services to the memory mapped file next to its pid file at the end of each
+ * validation cycle. The command line summary reads the file directly, without
+ * the HTTP request and rendering in the daemon. The file is versioned with a
+ * sequence lock, a reader which copied the file while the daemon was updating
+ * it retries the copy.
+ *
+ * @file
+ */
+
+
+/**
+ * Create the status file for the current service list. Called by the
+ * daemon after the configuration was parsed
+ */
+void StatusFile_open(void);
+
+
+/**
+ * Remove the status file
+ */
+void StatusFile_close(void);
+
+
+/**
+ * Publish the current status of the services. Only the validator thread
+ * may call this method
+ */
+void StatusFile_update(void);
+
+
+/**
+ * Render the service summary from the status file of the running daemon in
+ * the same format as the HTTP interface
+ * @param B The output buffer
+ * @param group Print only the services of the given group or NULL
+ * @param service Print only the given service or NULL
+ * @param plain true to render the table without the colors and the box
+ * drawing characters (see Box_setPlain())
+ * @return true if the summary was rendered, false if the status file is not
+ * available (the caller should ask the daemon)
+ */
+bool StatusFile_summary(StringBuffer_T B, const char *group, const char *service, bool plain);
+
+
+#endif
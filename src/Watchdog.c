@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#include "monit.h"
+#include "Watchdog.h"
+
+// libmonit
+#include "system/Time.h"
+#include "system/System.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ *  Each runner is a detached thread which waits for a check assigned by
+ *  Watchdog_check(), runs it and waits for the next one. If the caller
+ *  stopped waiting, the runner is orphaned: it clears the hung flag of the
+ *  service when the check returns and exits. The runner and the caller
+ *  share the module mutex, the runner's semaphore signals both the new
+ *  check and the finished check.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef struct Runner_T {
+        Service_T service;                         /**< The check to run or NULL */
+        State_Type state;                            /**< The state of the check */
+        bool done;                                /**< true if the check returned */
+        bool orphaned;                    /**< true if the caller stopped waiting */
+        Sem_T sem;
+        struct Runner_T *next;                             /**< Next idle runner */
+} *Runner_T;
+
+
+static struct {
+        Runner_T idle;                                       /**< Idle runners */
+        Mutex_T mutex;
+} _watchdog = {};
+
+
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _init(void) {
+        Mutex_init(_watchdog.mutex);
+}
+
+
+static State_Type _run(Service_T s) {
+        volatile State_Type state = State_Failed;
+        TRY
+        {
+                state = s->check(s);
+        }
+        ELSE
+        {
+                Log_error("'%s' check failed -- %s\n", s->name, Exception_frame.message);
+        }
+        END_TRY;
+        return state;
+}
+
+
+static void *_runner(void *args) {
+        set_signal_block();
+        Runner_T R = args;
+        LOCK(_watchdog.mutex)
+        {
+                while (true) {
+                        while (! R->service || R->done)
+                                Sem_wait(R->sem, _watchdog.mutex);
+                        Service_T s = R->service;
+                        Mutex_unlock(_watchdog.mutex);
+                        State_Type state = _run(s);
+                        Mutex_lock(_watchdog.mutex);
+                        R->state = state;
+                        R->done = true;
+                        if (R->orphaned) {
+                                s->watchdog.hung = false;
+                                DEBUG("'%s' hung check returned after %lldms\n", s->name, (long long)Time_milli() - s->watchdog.started);
+                                break;
+                        }
+                        Sem_signal(R->sem);
+                }
+        }
+        END_LOCK;
+        Sem_destroy(R->sem);
+        FREE(R);
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        return NULL;
+}
+
+
+// Get an idle runner or start a new one, the caller holds the mutex
+static Runner_T _getRunner(void) {
+        Runner_T R = _watchdog.idle;
+        if (R) {
+                _watchdog.idle = R->next;
+                R->next = NULL;
+        } else {
+                NEW(R);
+                Sem_init(R->sem);
+                Thread_T thread;
+                int status = pthread_create(&thread, NULL, _runner, R);
+                if (status != 0) {
+                        Log_warning("Cannot create the check runner thread: %s\n", System_getError(status));
+                        Sem_destroy(R->sem);
+                        FREE(R);
+                        return NULL;
+                }
+                pthread_detach(thread);
+        }
+        return R;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool Watchdog_check(Service_T s, State_Type *state) {
+        ASSERT(s);
+        ASSERT(state);
+        pthread_once(&_once, _init);
+        bool rv = true;
+        Runner_T R;
+        LOCK(_watchdog.mutex)
+        {
+                if ((R = _getRunner())) {
+                        R->service = s;
+                        R->done = false;
+                        Sem_signal(R->sem);
+                        long long started = Time_milli();
+                        long long deadline = started + Run.limits.checkTimeout;
+                        struct timespec wait = {.tv_sec = deadline / 1000, .tv_nsec = (deadline % 1000) * 1000000};
+                        while (! R->done && Time_milli() < deadline)
+                                Sem_timeWait(R->sem, _watchdog.mutex, wait);
+                        if (R->done) {
+                                *state = R->state;
+                                R->service = NULL;
+                                R->next = _watchdog.idle;
+                                _watchdog.idle = R;
+                        } else {
+                                R->orphaned = true;
+                                s->watchdog.hung = true;
+                                s->watchdog.started = started;
+                                rv = false;
+                        }
+                }
+        }
+        END_LOCK;
+        if (! R)
+                *state = s->check(s);
+        return rv;
+}
+
+
+bool Watchdog_isHung(Service_T s, long long *duration) {
+        ASSERT(s);
+        pthread_once(&_once, _init);
+        bool rv = false;
+        LOCK(_watchdog.mutex)
+        {
+                if (s->watchdog.hung) {
+                        if (duration)
+                                *duration = Time_milli() - s->watchdog.started;
+                        rv = true;
+                }
+        }
+        END_LOCK;
+        return rv;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_WATCHDOG_H
+#define MONIT_WATCHDOG_H
+
+#include "config.h"
+
+
+/**
+ * Check watchdog. If the check timeout limit is set, the service checks
+ * run in the runner threads and the validator waits for the check with
+ * the time limit. A check which didn't finish in time (e.g. blocked in
+ * statvfs on a dead NFS mount or in a read which ignores the timeout) is
+ * left to its runner, the validator marks the service as hung and goes
+ * on with the next service. The service isn't checked again until the
+ * hung check returns, its runner then exits.
+ *
+ * The idle runners are kept for the next checks, so a check costs two
+ * thread wakeups instead of a thread creation.
+ *
+ * @file
+ */
+
+
+/**
+ * Run the check of the service in a runner thread and wait for the result
+ * at most Run.limits.checkTimeout milliseconds. If the runner thread cannot
+ * be created, the check runs in the calling thread
+ * @param s A service object
+ * @param state The state returned by the check if it finished in time
+ * @return true if the check finished in time, false if the check is hung
+ */
+bool Watchdog_check(Service_T s, State_Type *state);
+
+
+/**
+ * Test if the check of the service is still running after the time limit
+ * @param s A service object
+ * @param duration If not NULL, set to the duration of the hung check [ms]
+ * @return true if the check is hung, otherwise false
+ */
+bool Watchdog_isHung(Service_T s, long long *duration);
+
+
+#endif
@@ -56,6 +56,9 @@
 // libmonit
 #include "system/Time.h"
 #include "util/Str.h"
+#include "util/StringBuffer.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
 #include "exceptions/IOException.h"
 
 
@@ -66,6 +69,67 @@
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+#define SMTP_SESSION_IDLE 60 // Seconds the idle SMTP session is kept open
+#define DIGEST_MAX        100 // Maximum number of alerts in one digest
+
+// Maximum number of alerts waiting in memory for the sender thread
+#define ALERT_QUEUESIZE 1024
+
+// The initial and maximum delay in seconds before the failed delivery is retried
+#define ALERT_RETRY_MIN 5
+#define ALERT_RETRY_MAX 600
+
+
+typedef struct Message_T {
+        struct myevent event;                            /**< Copy of the event */
+        struct Action_T action;                          /**< The event action */
+        struct EventAction_T eventAction;
+        List_T mails;      /**< The mails not delivered yet, NULL before the first attempt */
+        struct Message_T *next;
+} *Message_T;
+
+
+typedef struct Digest_T {
+        Mail_T mail;                 /**< The first alert, provides the envelope */
+        StringBuffer_T message;             /**< The concatenated alert messages */
+        int count;                                  /**< Number of queued alerts */
+        time_t started;                         /**< The digest window start time */
+        struct Digest_T *next;
+} *Digest_T;
+
+
+static struct {
+        Mutex_T mutex;
+        MailServer_T mta;
+        SMTP_T smtp;
+        time_t used;
+} _session = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+static struct {
+        Mutex_T mutex;
+        Digest_T list;
+} _digest = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+static struct {
+        bool running;                         /**< true if the sender thread runs */
+        bool stop;                         /**< Stop request for the sender thread */
+        int count;                               /**< Number of queued messages */
+        Message_T head;
+        Message_T tail;
+        Thread_T thread;
+        Mutex_T mutex;
+        Sem_T cond;
+} _sender = {};
+
+
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+
+
 /* ----------------------------------------------------------------- Private */
 
 
@@ -167,14 +231,20 @@ static void _copyMail(Mail_T n, Mail_T o) {
 // 1) is the given event type allowed for this recipient?
 // 2a) state change notifications is always delivered
 // 2b) failure notification is sent only of it matches reminder settings
+static bool _isInterested(Mail_T m, Event_T e) {
+        return IS_EVENT_SET(m->events, e->id) && (e->state_changed || (e->state && m->reminder && e->count % m->reminder == 0));
+}
+
+
 static void _appendMail(List_T list, Mail_T m, Event_T e, char *host) {
-        if (IS_EVENT_SET(m->events, e->id) && (e->state_changed || (e->state && m->reminder && e->count % m->reminder == 0))) {
+        if (_isInterested(m, e)) {
                 Mail_T tmp = NULL;
                 NEW(tmp);
                 tmp->host = host;
                 _copyMail(tmp, m);
                 _substitute(tmp, e);
                 _escape(tmp);
+                tmp->host = NULL; // The host buffer is valid during the list creation only
                 List_append(list, tmp);
                 DEBUG("Sending %s notification to %s\n", Event_get_description(e), m->to);
         }
@@ -202,79 +272,166 @@ static MailServer_T _connectMTA(void) {
 }
 
 
+static void _closeSession(void) {
+        if (_session.smtp)
+                SMTP_free(&(_session.smtp));
+        if (_session.mta && _session.mta->socket)
+                Socket_free(&(_session.mta->socket));
+        _session.mta = NULL;
+}
+
+
+static void _openSession(void) {
+        _session.mta = _connectMTA();
+        _session.smtp = SMTP_new(_session.mta->socket);
+        SMTP_greeting(_session.smtp);
+        SMTP_helo(_session.smtp, Run.mail_hostname ? Run.mail_hostname : Run.system->name);
+        if (_session.mta->ssl.flags == SSL_StartTLS)
+                SMTP_starttls(_session.smtp, &(_session.mta->ssl));
+        if (_session.mta->username && _session.mta->password)
+                SMTP_auth(_session.smtp, _session.mta->username, _session.mta->password);
+}
+
+
+// The daemon keeps the SMTP session open for the next alerts, it is reset with RSET before reuse and reopened if the server closed it meanwhile
+static void _getSession(void) {
+        if (_session.smtp) {
+                if (Time_now() - _session.used > SMTP_SESSION_IDLE || ! (Run.flags & Run_Daemon)) {
+                        _closeSession();
+                } else {
+                        TRY
+                        {
+                                SMTP_rset(_session.smtp);
+                        }
+                        ELSE
+                        {
+                                DEBUG("Mail: the session with %s was closed -- %s\n", _session.mta->host, Exception_frame.message);
+                                _closeSession();
+                        }
+                        END_TRY;
+                }
+        }
+        if (! _session.smtp)
+                _openSession();
+}
+
+
 static bool _send(List_T list) {
         volatile bool failed = false;
         if (List_length(list)) {
                 volatile Mail_T m = NULL;
-                volatile SMTP_T smtp = NULL;
-                volatile MailServer_T mta = NULL;
-                TRY
+                LOCK(_session.mutex)
                 {
-                        mta = _connectMTA();
-                        smtp = SMTP_new(mta->socket);
-                        SMTP_greeting(smtp);
-                        SMTP_helo(smtp, Run.mail_hostname ? Run.mail_hostname : Run.system->name);
-                        if (mta->ssl.flags == SSL_StartTLS)
-                                SMTP_starttls(smtp, &(mta->ssl));
-                        if (mta->username && mta->password)
-                                SMTP_auth(smtp, mta->username, mta->password);
-                        char now[STRLEN];
-                        Time_gmtstring(Time_now(), now);
-                        while ((m = List_pop(list))) {
-                                SMTP_from(smtp, m->from->address);
-                                SMTP_to(smtp, m->to);
-                                SMTP_dataBegin(smtp);
-                                if (
-                                        (m->replyto && ((m->replyto->name ? Socket_print(mta->socket, "Reply-To: \"%s\" <%s>\r\n", m->replyto->name, m->replyto->address) : Socket_print(mta->socket, "Reply-To: %s\r\n", m->replyto->address)) <= 0))
-                                        ||
-                                        ((m->from->name ? Socket_print(mta->socket, "From: \"%s\" <%s>\r\n", m->from->name, m->from->address) : Socket_print(mta->socket, "From: %s\r\n", m->from->address)) <= 0)
-                                        ||
-                                        Socket_print(mta->socket,
-                                                "To: %s\r\n"
-                                                "Subject: %s\r\n"
-                                                "Date: %s\r\n"
-                                                "X-Mailer: Monit %s\r\n"
-                                                "MIME-Version: 1.0\r\n"
-                                                "Content-Type: text/plain; charset=utf-8\r\n"
-                                                "Content-Transfer-Encoding: 8bit\r\n"
-                                                "Message-Id: <%lld.%llx@%s>\r\n"
-                                                "\r\n"
-                                                "%s",
-                                                m->to,
-                                                m->subject,
-                                                now,
-                                                VERSION,
-                                                (long long)Time_now(), System_randomNumber(), Run.mail_hostname ? Run.mail_hostname : Run.system->name,
-                                                m->message) <= 0
-                                   )
-                                {
-                                        THROW(IOException, "Error sending data to mail server %s -- %s", mta->host, STRERROR);
+                        TRY
+                        {
+                                _getSession();
+                                MailServer_T mta = _session.mta;
+                                char now[STRLEN];
+                                Time_gmtstring(Time_now(), now);
+                                while ((m = List_pop(list))) {
+                                        SMTP_from(_session.smtp, m->from->address);
+                                        SMTP_to(_session.smtp, m->to);
+                                        SMTP_dataBegin(_session.smtp);
+                                        if (
+                                                (m->replyto && ((m->replyto->name ? Socket_print(mta->socket, "Reply-To: \"%s\" <%s>\r\n", m->replyto->name, m->replyto->address) : Socket_print(mta->socket, "Reply-To: %s\r\n", m->replyto->address)) <= 0))
+                                                ||
+                                                ((m->from->name ? Socket_print(mta->socket, "From: \"%s\" <%s>\r\n", m->from->name, m->from->address) : Socket_print(mta->socket, "From: %s\r\n", m->from->address)) <= 0)
+                                                ||
+                                                Socket_print(mta->socket,
+                                                        "To: %s\r\n"
+                                                        "Subject: %s\r\n"
+                                                        "Date: %s\r\n"
+                                                        "X-Mailer: Monit %s\r\n"
+                                                        "MIME-Version: 1.0\r\n"
+                                                        "Content-Type: text/plain; charset=utf-8\r\n"
+                                                        "Content-Transfer-Encoding: 8bit\r\n"
+                                                        "Message-Id: <%lld.%llx@%s>\r\n"
+                                                        "\r\n"
+                                                        "%s",
+                                                        m->to,
+                                                        m->subject,
+                                                        now,
+                                                        VERSION,
+                                                        (long long)Time_now(), System_randomNumber(), Run.mail_hostname ? Run.mail_hostname : Run.system->name,
+                                                        m->message) <= 0
+                                           )
+                                        {
+                                                THROW(IOException, "Error sending data to mail server %s -- %s", mta->host, STRERROR);
+                                        }
+                                        SMTP_dataCommit(_session.smtp);
+                                        gc_mail_list((Mail_T *)&m);
+                                        // Reset the transaction state before the next message in the batch
+                                        if (List_length(list))
+                                                SMTP_rset(_session.smtp);
                                 }
-                                SMTP_dataCommit(smtp);
-                                gc_mail_list((Mail_T *)&m);
+                                _session.used = Time_now();
+                                if (! (Run.flags & Run_Daemon))
+                                        _closeSession();
                         }
-                        SMTP_quit(smtp);
-                }
-                ELSE
-                {
-                        failed = true;
-                        Log_error("Mail: %s\n", Exception_frame.message);
-                }
-                FINALLY
-                {
-                        if (m)
-                                gc_mail_list((Mail_T *)&m);
-                        if (smtp)
-                                SMTP_free((SMTP_T *)&smtp);
-                        if (mta && mta->socket)
-                                Socket_free(&(mta->socket));
+                        ELSE
+                        {
+                                failed = true;
+                                Log_error("Mail: %s\n", Exception_frame.message);
+                                _closeSession();
+                                // Keep the mail which failed in the list with the mails which were not sent yet
+                                if (m)
+                                        List_push(list, m);
+                        }
+                        END_TRY;
                 }
-                END_TRY;
+                END_LOCK;
         }
         return failed;
 }
 
 
+// Queue the mail in the recipient's digest, the messages are concatenated and the first alert's envelope is kept
+static void _digestMail(Mail_T m) {
+        Digest_T d = NULL;
+        for (d = _digest.list; d; d = d->next)
+                if (IS(d->mail->to, m->to))
+                        break;
+        if (! d) {
+                NEW(d);
+                d->mail = m;
+                d->message = StringBuffer_create(STRLEN);
+                d->started = Time_now();
+                d->next = _digest.list;
+                _digest.list = d;
+        } else if (d->count >= DIGEST_MAX) {
+                DEBUG("Mail: the digest for %s is full, the alert '%s' is dropped\n", m->to, m->subject);
+                gc_mail_list(&m);
+                return;
+        }
+        StringBuffer_append(d->message, "%s%s\r\n\r\n%s", d->count ? "\r\n----\r\n\r\n" : "", m->subject, m->message);
+        d->count++;
+        if (m != d->mail)
+                gc_mail_list(&m);
+}
+
+
+// Create the mail which carries the digest content
+static Mail_T _digestToMail(Digest_T d) {
+        Mail_T m = NULL;
+        NEW(m);
+        _copyMail(m, d->mail);
+        FREE(m->message);
+        m->message = Str_dup(StringBuffer_toString(d->message));
+        if (d->count > 1) {
+                FREE(m->subject);
+                m->subject = Str_cat("monit alert digest -- %d alerts on %s", d->count, Run.system->name);
+        }
+        return m;
+}
+
+
+static void _freeDigest(Digest_T *d) {
+        gc_mail_list(&((*d)->mail));
+        StringBuffer_free(&((*d)->message));
+        FREE(*d);
+}
+
+
 static bool _hasRecipient(Mail_T list, const char *recipient) {
         for (Mail_T l = list; l; l = l->next)
                 if (IS(recipient, l->to))
@@ -283,6 +440,213 @@ static bool _hasRecipient(Mail_T list, const char *recipient) {
 }
 
 
+// Return true if any local or global recipient is interested in the event
+static bool _hasInterest(Service_T s, Event_T E) {
+        for (Mail_T m = s->maillist; m; m = m->next)
+                if (_isInterested(m, E))
+                        return true;
+        for (Mail_T m = Run.maillist; m; m = m->next)
+                if (! _hasRecipient(s->maillist, m->to) && _isInterested(m, E))
+                        return true;
+        return false;
+}
+
+
+static bool _hasServiceRecipients(void) {
+        for (Service_T s = servicelist; s; s = s->next)
+                if (s->maillist)
+                        return true;
+        return false;
+}
+
+
+// Build the mail list for the local and global recipients
+static void _createMails(Event_T E, List_T list) {
+        Service_T s = E->source;
+        char host[256] = {};
+        // Build a mail-list with local recipients that has registered interest for this event
+        for (Mail_T m = s->maillist; m; m = m->next)
+                _appendMail(list, m, E, host);
+        // Build a mail-list with global recipients that has registered interest for this event. Recipients which are defined in the service localy overrides the same recipient events which are registered globaly.
+        for (Mail_T m = Run.maillist; m; m = m->next)
+                if (! _hasRecipient(s->maillist, m->to))
+                        _appendMail(list, m, E, host);
+}
+
+
+// Send the mails or add them to the digests. The delivered mails are removed from the list, if the delivery failed the list keeps the mails which were not delivered
+static Handler_Type _deliver(List_T list) {
+        if (List_length(list)) {
+                if (Run.mail_digest > 0 && (Run.flags & Run_Daemon) && ! (Run.flags & Run_Once)) {
+                        // The alerts are delivered by _flush() when the recipient's digest window expires
+                        LOCK(_digest.mutex)
+                        {
+                                for (Mail_T m; (m = List_pop(list));)
+                                        _digestMail(m);
+                        }
+                        END_LOCK;
+                } else if (_send(list)) {
+                        return Handler_Alert;
+                }
+        }
+        return Handler_Succeeded;
+}
+
+
+static void _freeMails(List_T *list) {
+        for (Mail_T m; (m = List_pop(*list));)
+                gc_mail_list(&m);
+        List_free(list);
+}
+
+
+/**
+ * Send the digests whose window expired and close the idle SMTP session
+ * @param force If true, send all pending digests and close the SMTP session
+ * @return The time when the next digest window expires or the idle session
+ * should be closed, 0 if nothing is pending
+ */
+static time_t _flush(bool force) {
+        time_t next = 0;
+        Digest_T sent = NULL;
+        LOCK(_digest.mutex)
+        {
+                time_t now = Time_now();
+                for (Digest_T d = _digest.list, prev = NULL, following; d; d = following) {
+                        following = d->next;
+                        if (force || now - d->started >= Run.mail_digest) {
+                                if (prev)
+                                        prev->next = following;
+                                else
+                                        _digest.list = following;
+                                d->next = sent;
+                                sent = d;
+                        } else {
+                                prev = d;
+                                next = next ? MIN(next, d->started + Run.mail_digest) : d->started + Run.mail_digest;
+                        }
+                }
+        }
+        END_LOCK;
+        // The digests are sent one by one, so after a failure only the digests which were not delivered are kept
+        bool failed = false;
+        for (Digest_T d = sent, following; d; d = following) {
+                following = d->next;
+                if (! failed) {
+                        List_T list = List_new();
+                        List_append(list, _digestToMail(d));
+                        failed = _send(list);
+                        _freeMails(&list);
+                }
+                if (failed && ! force) {
+                        // Delivery failed, keep the digest for the next attempt in a new window
+                        LOCK(_digest.mutex)
+                        {
+                                d->started = Time_now();
+                                d->next = _digest.list;
+                                _digest.list = d;
+                                next = next ? MIN(next, d->started + Run.mail_digest) : d->started + Run.mail_digest;
+                        }
+                        END_LOCK;
+                } else {
+                        _freeDigest(&d);
+                }
+        }
+        LOCK(_session.mutex)
+        {
+                if (_session.smtp) {
+                        if (force || Time_now() - _session.used > SMTP_SESSION_IDLE)
+                                _closeSession();
+                        else
+                                next = next ? MIN(next, _session.used + SMTP_SESSION_IDLE + 1) : _session.used + SMTP_SESSION_IDLE + 1;
+                }
+        }
+        END_LOCK;
+        return next;
+}
+
+
+static void _init(void) {
+        Mutex_init(_sender.mutex);
+        Sem_init(_sender.cond);
+}
+
+
+static Message_T _pop(void) {
+        Message_T m = _sender.head;
+        if (m) {
+                _sender.head = m->next;
+                if (! _sender.head)
+                        _sender.tail = NULL;
+                _sender.count--;
+        }
+        return m;
+}
+
+
+static void _freeMessage(Message_T *m) {
+        if ((*m)->mails)
+                _freeMails(&((*m)->mails));
+        FREE((*m)->event.message);
+        FREE(*m);
+}
+
+
+static void *_thread(__attribute__ ((unused)) void *args) {
+        set_signal_block();
+        time_t retry = 0;
+        int backoff = ALERT_RETRY_MIN;
+        LOCK(_sender.mutex)
+        {
+                while (! _sender.stop) {
+                        // Deliver the queued alerts in order. If the delivery failed, the alerts are retried with exponential backoff
+                        if (Time_now() >= retry) {
+                                while (_sender.head && ! _sender.stop) {
+                                        Message_T m = _sender.head;
+                                        Mutex_unlock(_sender.mutex);
+                                        // The mails are created on the first attempt, the retry sends only the mails which were not delivered
+                                        if (! m->mails) {
+                                                m->mails = List_new();
+                                                _createMails(&m->event, m->mails);
+                                        }
+                                        bool sent = _deliver(m->mails) == Handler_Succeeded;
+                                        Mutex_lock(_sender.mutex);
+                                        if (! sent) {
+                                                Log_error("Alert delivery failed, retry scheduled in %d seconds\n", backoff);
+                                                retry = Time_now() + backoff;
+                                                backoff = MIN(backoff * 2, ALERT_RETRY_MAX);
+                                                break;
+                                        }
+                                        backoff = ALERT_RETRY_MIN;
+                                        _pop();
+                                        _freeMessage(&m);
+                                }
+                        }
+                        if (_sender.stop)
+                                break;
+                        Mutex_unlock(_sender.mutex);
+                        time_t next = _flush(false);
+                        Mutex_lock(_sender.mutex);
+                        if (! _sender.stop && (! _sender.head || Time_now() < retry)) {
+                                // Wake up only when the digest or the retry is due, with nothing pending sleep until an alert is queued
+                                time_t wait = next;
+                                if (_sender.head)
+                                        wait = wait ? MIN(wait, retry) : retry;
+                                if (wait)
+                                        Sem_timeWait(_sender.cond, _sender.mutex, ((struct timespec){.tv_sec = wait, .tv_nsec = 0}));
+                                else
+                                        Sem_wait(_sender.cond, _sender.mutex);
+                        }
+                }
+        }
+        END_LOCK;
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        return NULL;
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -297,20 +661,75 @@ Handler_Type handle_alert(Event_T E) {
         Handler_Type rv = Handler_Succeeded;
         Service_T s = E->source;
         if (s->maillist || Run.maillist) {
-                char host[256] = {};
-                List_T list = List_new();
-                // Build a mail-list with local recipients that has registered interest for this event
-                for (Mail_T m = s->maillist; m; m = m->next)
-                        _appendMail(list, m, E, host);
-                // Build a mail-list with global recipients that has registered interest for this event. Recipients which are defined in the service localy overrides the same recipient events which are registered globaly.
-                for (Mail_T m = Run.maillist; m; m = m->next)
-                        if (! _hasRecipient(s->maillist, m->to))
-                                _appendMail(list, m, E, host);
-                if (List_length(list))
-                        if (_send(list))
-                                rv = Handler_Alert;
-                List_free(&list);
+                if (_sender.running) {
+                        if (! _hasInterest(s, E))
+                                return rv;
+                        LOCK(_sender.mutex)
+                        {
+                                if (_sender.count < ALERT_QUEUESIZE) {
+                                        Message_T m;
+                                        NEW(m);
+                                        m->event = *E;
+                                        m->event.message = E->message ? Str_dup(E->message) : NULL;
+                                        m->event.next = NULL;
+                                        m->action.id = Event_get_action(E);
+                                        m->eventAction.failed = m->eventAction.succeeded = &m->action;
+                                        m->event.action = &m->eventAction;
+                                        if (_sender.tail)
+                                                _sender.tail->next = m;
+                                        else
+                                                _sender.head = m;
+                                        _sender.tail = m;
+                                        _sender.count++;
+                                        Sem_signal(_sender.cond);
+                                } else {
+                                        Log_error("Alert: the send queue is full\n");
+                                        rv = Handler_Alert;
+                                }
+                        }
+                        END_LOCK;
+                } else {
+                        List_T list = List_new();
+                        _createMails(E, list);
+                        rv = _deliver(list);
+                        _freeMails(&list);
+                }
         }
         return rv;
 }
 
+
+void alert_start(void) {
+        pthread_once(&_once, _init);
+        if ((Run.maillist || _hasServiceRecipients()) && ! _sender.running) {
+                _sender.stop = false;
+                Thread_create(_sender.thread, _thread, NULL);
+                _sender.running = true;
+        }
+}
+
+
+void alert_stop(void) {
+        if (_sender.running) {
+                LOCK(_sender.mutex)
+                {
+                        _sender.stop = true;
+                        Sem_signal(_sender.cond);
+                }
+                END_LOCK;
+                Thread_join(_sender.thread);
+                _sender.running = false;
+                // Save the alerts which were not delivered yet to the event queue
+                Message_T m;
+                while ((m = _pop())) {
+                        m->event.flag = Handler_Alert;
+                        Event_queue_add(&m->event, 0);
+                        _freeMessage(&m);
+                }
+        }
+}
+
+
+void alert_flush(bool force) {
+        _flush(force);
+}
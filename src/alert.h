@@ -54,6 +54,13 @@
  *  machinery to notify users who have asked to be alerted for
  *  particular events.
  *
+ *  In daemon mode the alerts are delivered by the sender thread: the
+ *  events are queued in memory, so a slow or unavailable mail server
+ *  doesn't delay the validation. The failed delivery is retried with
+ *  exponential backoff. If the memory queue is full, handle_alert()
+ *  fails and the event is saved to the event queue (if enabled) as in
+ *  the synchronous mode.
+ *
  *  @file
  */
 
@@ -66,4 +73,27 @@
 Handler_Type handle_alert(Event_T E);
 
 
+/**
+ * Start the sender thread which delivers the alerts asynchronously
+ */
+void alert_start(void);
+
+
+/**
+ * Stop the sender thread. The alerts which were not delivered yet
+ * are saved to the event queue
+ */
+void alert_stop(void);
+
+
+/**
+ * Send the alert digests whose window expired (see the digest option
+ * of the set mailserver statement) and close the idle SMTP session.
+ * The sender thread does this periodically
+ * @param force If true, send all pending digests and close the SMTP
+ * session. Used before the configuration is reloaded or Monit exits
+ */
+void alert_flush(bool force);
+
+
 #endif
@@ -0,0 +1,1047 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_LOCALE_H
+#include <locale.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#ifdef HAVE_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+#include <openssl/pem.h>
+#endif
+
+#ifdef LINUX
+#include <ftw.h>
+#endif
+
+#include "monit.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "checksum.h"
+#include "ContentMatch.h"
+#include "ProcessTree.h"
+#include "ProcessSnapshot.h"
+
+// libmonit
+#include "Bootstrap.h"
+#include "exceptions/AssertException.h"
+#include "exceptions/IOException.h"
+
+
+/**
+ *  Monit microbenchmarks, run with "make bench". The benchmarks cover the
+ *  hot paths of the daemon: the checksum throughput, the process table scan
+ *  (Linux only, using the synthetic /proc fixtures), the XML status rendering
+ *  and the content match. The control file with the benchmark services is
+ *  generated and parsed at start.
+ *
+ *  "monitbench load [services [processes [cycles [workers]]]]" is the
+ *  scalability test (Linux only, default 5000 services, 60000 processes, 10
+ *  cycles and 1 worker). It generates the control file with the mix of the
+ *  process, file, directory and filesystem services and the synthetic /proc,
+ *  then runs the validation cycles with all services due and reports the
+ *  cycle time, the maximum RSS, the read and write system calls and, if
+ *  libmonit was configured with --enable-memstat, the allocations.
+ *
+ *  "monitbench http [clients [seconds]]" is the HTTP server load test
+ *  (default 8 clients, 2 seconds per scenario). It starts the embedded HTTP
+ *  server with the system service and 1000 directory services and drives
+ *  the home page, the status and summary reports and the service action
+ *  with the closed loop clients over TCP, TLS (if available) and the unix
+ *  socket, with and without keep-alive, while the validation cycles run in
+ *  parallel. Each scenario reports the requests per second, the latency
+ *  percentiles and the median validation cycle time, the first line is the
+ *  cycle time without the HTTP load.
+ *
+ *  "monitbench replay <archive>" extracts the /proc snapshot recorded with
+ *  "monit procfs record" and measures the process table scan on it.
+ *
+ *  Each benchmark prints one JSON line in the same format as the libmonit
+ *  benchmarks: the name, the number of iterations, the nanoseconds per
+ *  operation and for the throughput benchmarks the bytes per operation and
+ *  MB/s. The number of iterations is calibrated so a run takes at least
+ *  BENCH_TIME milliseconds (default 100), the best of five runs is reported.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define BENCH_SERVICES 1000    // Number of the file services in the status rendering (the log and system services are added)
+#define BENCH_PATTERNS 100     // Number of the content match patterns
+#define BENCH_LINES    1024    // Number of the log lines in the content match
+#define BENCH_PROCESSES 4096   // Number of the processes in the synthetic /proc
+
+
+static volatile long long sink;
+
+
+static struct {
+        char *buffer;                   /**< Checksum input, 1 MiB */
+        Service_T log;                  /**< The service with the content patterns */
+        ContentMatch_T match;           /**< Content match automaton of the service */
+        char **lines;                   /**< Log lines */
+} _bench;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static long long _nanos(void) {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+
+static int _compareDuration(const void *a, const void *b) {
+        long long x = *(const long long *)a, y = *(const long long *)b;
+        return x < y ? -1 : x > y;
+}
+
+
+static void _run(const char *name, long long bytes, void (*bench)(long long n)) {
+        const char *env = getenv("BENCH_TIME");
+        long long budget = (env ? atoll(env) : 100) * 1000000LL;
+        long long n = 1, elapsed = 0;
+        // Calibrate the number of iterations
+        while (true) {
+                long long start = _nanos();
+                bench(n);
+                elapsed = _nanos() - start;
+                if (elapsed >= budget || n >= (1LL << 40))
+                        break;
+                n = elapsed > 0 ? MAX(n * 2, (long long)(n * 1.2 * budget / elapsed)) : n * 100;
+        }
+        for (int i = 0; i < 4; i++) {
+                long long start = _nanos();
+                bench(n);
+                elapsed = MIN(elapsed, _nanos() - start);
+        }
+        double ns = (double)elapsed / n;
+        printf("{\"suite\":\"monit\",\"name\":\"%s\",\"iterations\":%lld,\"ns_per_op\":%.2f", name, n, ns);
+        if (bytes)
+                printf(",\"bytes_per_op\":%lld,\"mb_per_s\":%.1f", bytes, bytes * 1000. / ns);
+        printf("}\n");
+        fflush(stdout);
+}
+
+
+/* ---------------------------------------------------------------- Checksum */
+
+
+#define CHECKSUM_SIZE (1024 * 1024)
+
+
+static void _checksum(Hash_Type type, long long n) {
+        struct ChecksumContext_T context;
+        long long sum = 0;
+        for (long long i = 0; i < n; i++) {
+                Checksum_init(&context, type);
+                Checksum_append(&context, _bench.buffer, CHECKSUM_SIZE);
+                sum += Checksum_finish(&context)[0];
+        }
+        sink = sum;
+}
+
+
+static void _checksumMd5(long long n) {
+        _checksum(Hash_Md5, n);
+}
+
+
+static void _checksumSha1(long long n) {
+        _checksum(Hash_Sha1, n);
+}
+
+
+static void _checksumSha256(long long n) {
+        _checksum(Hash_Sha256, n);
+}
+
+
+static void _hmacSha256(long long n) {
+        unsigned char digest[32];
+        long long sum = 0;
+        for (long long i = 0; i < n; i++) {
+                Checksum_hmacSHA256((const unsigned char *)_bench.buffer, 256, (const unsigned char *)"secret", 6, digest);
+                sum += digest[0];
+        }
+        sink = sum;
+}
+
+
+/* ------------------------------------------------------------ Process tree */
+
+
+#ifdef LINUX
+static void _writeFixture(const char *dir, int pid, const char *name, const char *content, size_t length) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%d/%s", dir, pid, name);
+        FILE *f = fopen(path, "w");
+        if (! f || fwrite(content, 1, length, f) != length) {
+                fprintf(stderr, "Cannot write the fixture %s -- %s\n", path, STRERROR);
+                exit(1);
+        }
+        fclose(f);
+}
+
+
+/**
+ * Create the synthetic /proc with the process tree of count processes (each process has four
+ * children) with the stat, status, cmdline and io files in the format of the Linux kernel
+ */
+static char *_createProcfs(int count) {
+        char *dir = Str_dup("/tmp/monit-bench-proc.XXXXXX");
+        if (! mkdtemp(dir)) {
+                fprintf(stderr, "Cannot create the directory for the /proc fixtures -- %s\n", STRERROR);
+                exit(1);
+        }
+        char buf[1024], path[PATH_MAX];
+        for (int pid = 1; pid <= count; pid++) {
+                snprintf(path, sizeof(path), "%s/%d", dir, pid);
+                mkdir(path, 0700);
+                int length = snprintf(buf, sizeof(buf), "%d (worker-%d) S %d %d %d 0 -1 4194560 1200 0 0 0 %d %d 0 0 20 0 1 0 %d 123456789 2048 18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n", pid, pid, pid / 4, pid, pid, pid * 3, pid, 100 + pid);
+                _writeFixture(dir, pid, "stat", buf, length);
+                length = snprintf(buf, sizeof(buf), "Name:\tworker-%d\nState:\tS (sleeping)\nPid:\t%d\nPPid:\t%d\nUid:\t1000\t1000\t1000\t1000\nGid:\t1000\t1000\t1000\t1000\nThreads:\t1\n", pid, pid, pid / 4);
+                _writeFixture(dir, pid, "status", buf, length);
+                length = snprintf(buf, sizeof(buf), "/usr/bin/worker%c--id%c%d%c", 0, 0, pid, 0);
+                _writeFixture(dir, pid, "cmdline", buf, length);
+                length = snprintf(buf, sizeof(buf), "rchar: %d\nwchar: %d\nsyscr: 10\nsyscw: 20\nread_bytes: 4096\nwrite_bytes: 8192\ncancelled_write_bytes: 0\n", pid * 10, pid * 20);
+                _writeFixture(dir, pid, "io", buf, length);
+        }
+        return dir;
+}
+
+
+static int _removeEntry(const char *path, __attribute__ ((unused)) const struct stat *sb, __attribute__ ((unused)) int flag, __attribute__ ((unused)) struct FTW *ftw) {
+        return remove(path);
+}
+
+
+/**
+ * Remove the synthetic /proc or the extracted snapshot
+ */
+static void _removeProcfs(char *dir) {
+        if (nftw(dir, _removeEntry, 16, FTW_DEPTH | FTW_PHYS))
+                fprintf(stderr, "Cannot remove %s -- %s\n", dir, STRERROR);
+        FREE(dir);
+}
+
+
+static void _processTreeInit(long long n) {
+        long long count = 0;
+        for (long long i = 0; i < n; i++)
+                count += ProcessTree_init(ProcessEngine_CollectCommandLine);
+        sink = count;
+}
+
+
+/**
+ * Replay the recorded /proc snapshot (see "monit procfs record") through the process engine
+ */
+static int _replay(const char *archive) {
+        char *dir = Str_dup("/tmp/monit-bench-replay.XXXXXX");
+        if (! mkdtemp(dir)) {
+                fprintf(stderr, "Cannot create the directory for the snapshot -- %s\n", STRERROR);
+                FREE(dir);
+                return 1;
+        }
+        int count = ProcessSnapshot_extract(archive, dir);
+        if (count >= 0) {
+                char name[STRLEN];
+                snprintf(name, sizeof(name), "ProcessTree_init_replay_%d_processes", count);
+                Run.procfs = dir;
+                _run(name, 0, _processTreeInit);
+                Run.procfs = NULL;
+        }
+        _removeProcfs(dir);
+        return count >= 0 ? 0 : 1;
+}
+#endif
+
+
+/* -------------------------------------------------------------- Status XML */
+
+
+static void _statusXml(long long n) {
+        StringBuffer_T B = StringBuffer_create(1024 * 1024);
+        long long length = 0;
+        for (long long i = 0; i < n; i++) {
+                StringBuffer_clear(B);
+                status_xml(B, NULL, 2, "localhost");
+                length += StringBuffer_length(B);
+        }
+        sink = length;
+        StringBuffer_free(&B);
+}
+
+
+static long long _statusXmlLength(void) {
+        StringBuffer_T B = StringBuffer_create(1024 * 1024);
+        status_xml(B, NULL, 2, "localhost");
+        long long length = StringBuffer_length(B);
+        StringBuffer_free(&B);
+        return length;
+}
+
+
+/* ----------------------------------------------------------- Content match */
+
+
+static void _contentMatch(long long n) {
+        long long matches = 0;
+        for (long long i = 0; i < n; i++) {
+                const char *line = _bench.lines[i % BENCH_LINES];
+                ContentMatch_scan(_bench.match, line);
+                for (Match_T m = _bench.log->matchlist; m; m = m->next)
+                        if (ContentMatch_test(_bench.match, m, line) == 0)
+                                matches++;
+        }
+        sink = matches;
+}
+
+
+/* ------------------------------------------------------------------- Setup */
+
+
+/**
+ * Write the control file using the generate function and parse it
+ */
+static void _parseControlFile(void (*generate)(FILE *f)) {
+        char path[] = "/tmp/monit-bench-rc.XXXXXX";
+        int fd = mkstemp(path);
+        FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+        if (! f) {
+                fprintf(stderr, "Cannot create the control file -- %s\n", STRERROR);
+                exit(1);
+        }
+        generate(f);
+        fclose(f);
+        bool parsed = parse(path);
+        unlink(path);
+        if (! parsed) {
+                fprintf(stderr, "Cannot parse the benchmark control file\n");
+                exit(1);
+        }
+}
+
+
+/**
+ * The control file with BENCH_SERVICES file services and the service with BENCH_PATTERNS content match patterns
+ */
+static void _generateBench(FILE *f) {
+        for (int i = 0; i < BENCH_SERVICES; i++)
+                fprintf(f, "check file file%d with path /var/lib/bench/file%d\n    if size > 10 MB then alert\n    if changed timestamp then alert\n", i, i);
+        fprintf(f, "check file log with path /var/log/bench.log\n");
+        for (int i = 0; i < BENCH_PATTERNS; i++)
+                fprintf(f, "    if content = \"component%d: request [0-9]+ failed\" then alert\n", i);
+}
+
+
+static void _setup(void) {
+        _parseControlFile(_generateBench);
+        _bench.log = Util_getService("log");
+        _bench.match = ContentMatch_new(_bench.log->matchignorelist, _bench.log->matchlist);
+        _bench.lines = CALLOC(BENCH_LINES, sizeof(char *));
+        for (int i = 0; i < BENCH_LINES; i++) {
+                // Every 16th line matches one pattern, every 4th line contains the literal of a pattern but doesn't match
+                if (i % 16 == 0)
+                        _bench.lines[i] = Str_cat("2024-05-01T12:00:%02d host app[%d]: component%d: request %d failed", i % 60, i, i % BENCH_PATTERNS, i);
+                else if (i % 4 == 0)
+                        _bench.lines[i] = Str_cat("2024-05-01T12:00:%02d host app[%d]: component%d: request %d succeeded after retry", i % 60, i, i % BENCH_PATTERNS, i);
+                else
+                        _bench.lines[i] = Str_cat("2024-05-01T12:00:%02d host app[%d]: session %d opened for user bench from 192.0.2.%d port %d", i % 60, i, i, i % 256, 40000 + i);
+        }
+        _bench.buffer = ALLOC(CHECKSUM_SIZE);
+        for (int i = 0; i < CHECKSUM_SIZE; i++)
+                _bench.buffer[i] = (char)((unsigned)i * 7919U >> 3);
+}
+
+
+static void _cleanup(void) {
+        for (int i = 0; i < BENCH_LINES; i++)
+                FREE(_bench.lines[i]);
+        FREE(_bench.lines);
+        ContentMatch_free(&_bench.match);
+        FREE(_bench.buffer);
+}
+
+
+/* -------------------------------------------------------------------- Load */
+
+
+#ifdef LINUX
+static struct {
+        int services;                       /**< Number of the generated services */
+        int processes;      /**< Number of the processes in the synthetic /proc */
+        int cycles;                        /**< Number of the validation cycles */
+        int workers;                      /**< Number of the validation workers */
+        char *dir;           /**< Directory with the monitored files and pidfiles */
+        char *procfs;                                  /**< The synthetic /proc */
+} _load = {.services = 5000, .processes = 60000, .cycles = 10, .workers = 1};
+
+
+/**
+ * The control file of the load test. Out of every 20 services 12 are processes (one is matched by the
+ * command line, the others use a pidfile), 6 are files, one is a directory and one is a filesystem
+ */
+static void _generateLoad(FILE *f) {
+        fprintf(f, "set workers %d\nset procfs %s\n", _load.workers, _load.procfs);
+        fprintf(f, "check system loadhost\n    if loadavg (1min) > 1000 then alert\n    if memory usage > 99%% then alert\n");
+        for (int i = 0; i < _load.services; i++) {
+                int kind = i % 20;
+                if (kind < 12) {
+                        if (kind == 11)
+                                fprintf(f, "check process process%d matching \"worker --id %d$\"\n", i, 1 + i % _load.processes);
+                        else
+                                fprintf(f, "check process process%d with pidfile %s/process%d.pid\n", i, _load.dir, i);
+                        fprintf(f, "    if cpu > 95%% for 3 cycles then alert\n    if totalmem > 2 GB then alert\n    if children > 1000 then alert\n");
+                } else if (kind < 18) {
+                        fprintf(f, "check file file%d with path %s/file%d\n    if size > 10 MB then alert\n    if changed timestamp then alert\n", i, _load.dir, i);
+                        if (kind == 12)
+                                fprintf(f, "    if changed checksum then alert\n");
+                } else if (kind == 18) {
+                        fprintf(f, "check directory directory%d with path %s\n    if changed timestamp then alert\n", i, _load.dir);
+                } else {
+                        fprintf(f, "check filesystem filesystem%d with path /\n    if space usage > 99%% then alert\n", i);
+                }
+        }
+}
+
+
+/**
+ * Create or remove the pidfiles and the files monitored by the load test services
+ */
+static void _loadFiles(bool create) {
+        char path[PATH_MAX], content[STRLEN];
+        for (int i = 0; i < _load.services; i++) {
+                int kind = i % 20, length;
+                if (kind < 11) {
+                        snprintf(path, sizeof(path), "%s/process%d.pid", _load.dir, i);
+                        length = snprintf(content, sizeof(content), "%d\n", 1 + i % _load.processes);
+                } else if (kind >= 12 && kind < 18) {
+                        snprintf(path, sizeof(path), "%s/file%d", _load.dir, i);
+                        length = snprintf(content, sizeof(content), "file %d of the monit load test\n", i);
+                } else {
+                        continue;
+                }
+                if (! create) {
+                        unlink(path);
+                        continue;
+                }
+                FILE *f = fopen(path, "w");
+                if (! f || fwrite(content, 1, length, f) != (size_t)length) {
+                        fprintf(stderr, "Cannot write %s -- %s\n", path, STRERROR);
+                        exit(1);
+                }
+                fclose(f);
+        }
+}
+
+
+static void _memorySite(const MemSite_T *site, void *ap) {
+        *(unsigned long long *)ap += site->allocations;
+}
+
+
+/**
+ * Get the number of the allocations, available if libmonit was configured with --enable-memstat
+ * @return The number of the allocations or -1 if not available
+ */
+static long long _allocations(void) {
+        unsigned long long allocations = 0;
+        return Mem_statistics(_memorySite, &allocations) ? (long long)allocations : -1;
+}
+
+
+/**
+ * Get the number of the read and write system calls of the process
+ * @return The number of the system calls or -1 if not available
+ */
+static long long _syscalls(void) {
+        long long syscalls = -1;
+        FILE *f = fopen("/proc/self/io", "r");
+        if (f) {
+                char line[STRLEN];
+                long long count;
+                syscalls = 0;
+                while (fgets(line, sizeof(line), f))
+                        if (sscanf(line, "syscr: %lld", &count) == 1 || sscanf(line, "syscw: %lld", &count) == 1)
+                                syscalls += count;
+                fclose(f);
+        }
+        return syscalls;
+}
+
+
+/**
+ * Get the maximum resident set size in kilobytes
+ */
+static long _maxrss(void) {
+        struct rusage usage;
+        return getrusage(RUSAGE_SELF, &usage) ? -1 : usage.ru_maxrss;
+}
+
+
+/**
+ * Run the validation cycles with all services due in each cycle. Each cycle prints one JSON line with
+ * its duration, the maximum RSS and the number of the allocations and system calls, the summary
+ * line follows
+ */
+static void _cycles(void) {
+        long long *duration = CALLOC(_load.cycles, sizeof(long long));
+        for (int i = 0; i < _load.cycles; i++) {
+                long long allocations = _allocations(), syscalls = _syscalls();
+                validate_reset();
+                long long start = _nanos();
+                int errors = validate();
+                duration[i] = _nanos() - start;
+                printf("{\"suite\":\"load\",\"cycle\":%d,\"ms\":%.3f,\"errors\":%d,\"maxrss_kb\":%ld", i + 1, duration[i] / 1e6, errors, _maxrss());
+                if (allocations >= 0)
+                        printf(",\"allocations\":%lld", _allocations() - allocations);
+                if (syscalls >= 0)
+                        printf(",\"read_write_syscalls\":%lld", _syscalls() - syscalls);
+                printf("}\n");
+                fflush(stdout);
+        }
+        qsort(duration, _load.cycles, sizeof(long long), _compareDuration);
+        printf("{\"suite\":\"load\",\"name\":\"cycle\",\"services\":%d,\"processes\":%d,\"workers\":%d,\"cycles\":%d,\"min_ms\":%.3f,\"median_ms\":%.3f,\"max_ms\":%.3f,\"maxrss_kb\":%ld}\n",
+               _load.services, _load.processes, _load.workers, _load.cycles, duration[0] / 1e6, duration[_load.cycles / 2] / 1e6, duration[_load.cycles - 1] / 1e6, _maxrss());
+        FREE(duration);
+}
+
+
+/**
+ * The load test: generate the control file with the mixed services and the synthetic /proc and run
+ * the validation cycles. Arguments: [services [processes [cycles [workers]]]]
+ */
+static int _loadTest(int argc, char **argv) {
+        int *parameter[] = {&_load.services, &_load.processes, &_load.cycles, &_load.workers};
+        for (int i = 1; i < argc; i++) {
+                if (i > 4 || (*parameter[i - 1] = atoi(argv[i])) < 1) {
+                        fprintf(stderr, "Usage: %s load [services [processes [cycles [workers]]]]\n", prog);
+                        return 1;
+                }
+        }
+        _load.dir = Str_dup("/tmp/monit-load.XXXXXX");
+        if (! mkdtemp(_load.dir)) {
+                fprintf(stderr, "Cannot create the load test directory -- %s\n", STRERROR);
+                return 1;
+        }
+        _loadFiles(true);
+        _load.procfs = _createProcfs(_load.processes);
+        _parseControlFile(_generateLoad);
+        _cycles();
+        _removeProcfs(_load.procfs);
+        _loadFiles(false);
+        rmdir(_load.dir);
+        FREE(_load.dir);
+        return 0;
+}
+#endif
+
+
+/* -------------------------------------------------------------------- HTTP */
+
+
+#define BENCH_HTTP_WARMUP 5    // Number of the requests of each client which are not measured
+
+
+typedef enum {
+        Transport_Tcp = 0,
+        Transport_Tls,
+        Transport_Unix
+} Transport_Type;
+
+
+static const char *transportnames[] = {"tcp", "tls", "unix"};
+
+
+/**
+ * The requests of the HTTP load test: the home page, the status and summary reports and the
+ * service action (monitor of the monitored system service, which doesn't change its state)
+ */
+static struct {
+        const char *name;
+        const char *method;
+        const char *path;
+        const char *body;
+} _targets[] = {
+        {"home",    "GET",  "/",                  NULL},
+        {"status",  "GET",  "/_status?format=xml", NULL},
+        {"summary", "GET",  "/_summary",          NULL},
+        {"action",  "POST", "/benchhost",         "action=monitor&securitytoken=bench"}
+};
+
+
+static struct {
+        int clients;                        /**< Number of the concurrent clients */
+        int seconds;                     /**< Duration of each scenario in seconds */
+        int port;                                     /**< The HTTP server TCP port */
+        char *dir;                    /**< Directory with the socket and the PEM file */
+        FILE *out;          /**< The report stream, stdout is redirected to /dev/null */
+        struct SslOptions_T tls;           /**< The TLS options parsed from the control file */
+        volatile bool running;                /**< The clients and the validator run */
+        struct {
+                long long *duration;                         /**< The cycle durations */
+                int count;
+                int size;
+        } validate;
+} _http = {.clients = 8, .seconds = 2};
+
+
+typedef struct HttpClient_T {
+        Transport_Type transport;
+        bool keepalive;
+        int target;
+        char *request;
+        int length;
+        int errors;
+        int count;                                 /**< Number of the measured requests */
+        int size;
+        long long *latency;                                          /**< [ns] */
+        Thread_T thread;
+} *HttpClient_T;
+
+
+static void _append(long long **array, int *count, int *size, long long value) {
+        if (*count == *size) {
+                *size = *size ? *size * 2 : 1024;
+                RESIZE(*array, *size * sizeof(long long));
+        }
+        (*array)[(*count)++] = value;
+}
+
+
+/**
+ * Get a free TCP port on the loopback interface
+ * @return The port or -1 if failed
+ */
+static int _freePort(void) {
+        int port = -1;
+        int s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s >= 0) {
+                struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+                socklen_t length = sizeof(addr);
+                if (bind(s, (struct sockaddr *)&addr, length) == 0 && getsockname(s, (struct sockaddr *)&addr, &length) == 0)
+                        port = ntohs(addr.sin_port);
+                close(s);
+        }
+        return port;
+}
+
+
+#ifdef HAVE_OPENSSL
+/**
+ * Write the private key and the self-signed certificate of the TLS server to the PEM file
+ * @return true if succeeded, otherwise false
+ */
+static bool _createPem(const char *path) {
+        bool rv = false;
+        EVP_PKEY *key = NULL;
+        X509 *certificate = X509_new();
+        EVP_PKEY_CTX *context = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+        if (certificate && context && EVP_PKEY_keygen_init(context) > 0 && EVP_PKEY_CTX_set_rsa_keygen_bits(context, 2048) > 0 && EVP_PKEY_keygen(context, &key) > 0) {
+                ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+                X509_gmtime_adj(X509_get_notBefore(certificate), 0);
+                X509_gmtime_adj(X509_get_notAfter(certificate), 86400);
+                X509_set_pubkey(certificate, key);
+                X509_NAME *name = X509_get_subject_name(certificate);
+                X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"localhost", -1, -1, 0);
+                X509_set_issuer_name(certificate, name);
+                if (X509_sign(certificate, key, EVP_sha256()) > 0) {
+                        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+                        FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+                        if (f) {
+                                rv = PEM_write_PrivateKey(f, key, NULL, NULL, 0, NULL, NULL) && PEM_write_X509(f, certificate);
+                                fclose(f);
+                        }
+                }
+        }
+        EVP_PKEY_CTX_free(context);
+        EVP_PKEY_free(key);
+        X509_free(certificate);
+        return rv;
+}
+#endif
+
+
+/**
+ * The control file of the HTTP load test: the HTTP server listening on the loopback TCP port (with TLS
+ * if available) and the unix socket, the system service and BENCH_SERVICES directory services
+ */
+static void _generateHttp(FILE *f) {
+        fprintf(f, "set httpd port %d and use address 127.0.0.1\n", _http.port);
+#ifdef HAVE_OPENSSL
+        fprintf(f, "    with ssl { pemfile: %s/bench.pem }\n", _http.dir);
+#endif
+        fprintf(f, "    unixsocket %s/monit.sock\n    allow 127.0.0.1\n", _http.dir);
+        fprintf(f, "check system benchhost\n    if loadavg (1min) > 1000 then alert\n");
+        for (int i = 0; i < BENCH_SERVICES; i++)
+                fprintf(f, "check directory directory%d with path %s\n    if changed timestamp then alert\n", i, _http.dir);
+}
+
+
+static Socket_T _connect(Transport_Type transport) {
+        if (transport == Transport_Unix)
+                return Socket_createUnix(Run.httpd.socket.unix.path, Socket_Tcp, Run.limits.networkTimeout);
+        return Socket_create("127.0.0.1", _http.port, Socket_Tcp, Socket_Ip4, &(Run.httpd.socket.net.ssl), Run.limits.networkTimeout);
+}
+
+
+/**
+ * Send the request and read the whole response, the body is read according to the Content-Length or
+ * the chunked transfer encoding, otherwise until the server closes the connection
+ * @return true if the server keeps the connection open, otherwise false
+ * @exception IOException if the request failed
+ */
+static bool _request(Socket_T S, HttpClient_T C) {
+        // The request is sent in one write, so the client doesn't wait for the delayed ACK of the first segment
+        if (Socket_write(S, C->request, C->length) != C->length)
+                THROW(IOException, "Cannot send the request -- %s", STRERROR);
+        char line[STRLEN], buffer[65536];
+        int status = 0;
+        if (! Socket_readLine(S, line, sizeof(line)) || sscanf(line, "HTTP/%*s %d", &status) != 1 || status >= 400)
+                THROW(IOException, "Invalid response -- %s", line);
+        long long length = -1;
+        bool chunked = false, close = ! C->keepalive;
+        while (Socket_readLine(S, line, sizeof(line)) && ! Str_isEqual(line, "\r\n")) {
+                if (Str_startsWith(line, "Content-Length:"))
+                        length = strtoll(line + 15, NULL, 10);
+                else if (Str_startsWith(line, "Transfer-Encoding:") && Str_sub(line, "chunked"))
+                        chunked = true;
+                else if (Str_startsWith(line, "Connection:") && Str_sub(line, "close"))
+                        close = true;
+        }
+        if (chunked) {
+                while (Socket_readLine(S, line, sizeof(line)) && (length = strtoll(line, NULL, 16)) > 0) {
+                        for (int n; length > 0; length -= n)
+                                if ((n = Socket_read(S, buffer, (int)MIN(length, (long long)sizeof(buffer)))) <= 0)
+                                        THROW(IOException, "Incomplete chunk");
+                        Socket_readLine(S, line, sizeof(line));
+                }
+                Socket_readLine(S, line, sizeof(line));
+        } else if (length >= 0) {
+                for (int n; length > 0; length -= n)
+                        if ((n = Socket_read(S, buffer, (int)MIN(length, (long long)sizeof(buffer)))) <= 0)
+                                THROW(IOException, "Incomplete body");
+        } else {
+                while (Socket_read(S, buffer, sizeof(buffer)) > 0)
+                        ;
+                close = true;
+        }
+        return ! close;
+}
+
+
+/**
+ * The closed loop client: send the next request as soon as the response is read. The latency of the
+ * request includes the connect and the TLS handshake if the connection is not kept alive
+ */
+static void *_client(void *args) {
+        HttpClient_T C = args;
+        Socket_T S = NULL;
+        for (int i = 0; _http.running; i++) {
+                long long start = _nanos();
+                volatile bool open = false;
+                if (S || (S = _connect(C->transport))) {
+                        TRY
+                        {
+                                open = _request(S, C);
+                                if (i >= BENCH_HTTP_WARMUP)
+                                        _append(&C->latency, &C->count, &C->size, _nanos() - start);
+                        }
+                        ELSE
+                        {
+                                C->errors++;
+                        }
+                        END_TRY;
+                } else {
+                        C->errors++;
+                }
+                if (! open && S)
+                        Socket_free(&S);
+        }
+        if (S)
+                Socket_free(&S);
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        return NULL;
+}
+
+
+/**
+ * Run the validation cycles with all services due while the clients run
+ */
+static void *_validator(__attribute__ ((unused)) void *args) {
+        _http.validate.count = 0;
+        while (_http.running) {
+                validate_reset();
+                long long start = _nanos();
+                validate();
+                _append(&_http.validate.duration, &_http.validate.count, &_http.validate.size, _nanos() - start);
+        }
+        return NULL;
+}
+
+
+static long long _median(long long *array, int count) {
+        if (! count)
+                return 0;
+        qsort(array, count, sizeof(long long), _compareDuration);
+        return array[count / 2];
+}
+
+
+/**
+ * Run the clients for the given target and transport and report the throughput, the latency
+ * percentiles and the validation cycle time during the load
+ */
+static void _scenario(Transport_Type transport, bool keepalive, int target) {
+        HttpClient_T clients = CALLOC(_http.clients, sizeof(struct HttpClient_T));
+        Thread_T validator;
+        _http.running = true;
+        Thread_create(validator, _validator, NULL);
+        for (int i = 0; i < _http.clients; i++) {
+                clients[i].transport = transport;
+                clients[i].keepalive = keepalive;
+                clients[i].target = target;
+                clients[i].request = _targets[target].body ?
+                        Str_cat("%s %s HTTP/1.1\r\nHost: localhost\r\nConnection: %s\r\nCookie: securitytoken=bench\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: %zu\r\n\r\n%s",
+                                _targets[target].method, _targets[target].path, keepalive ? "keep-alive" : "close", strlen(_targets[target].body), _targets[target].body) :
+                        Str_cat("%s %s HTTP/1.1\r\nHost: localhost\r\nConnection: %s\r\n\r\n", _targets[target].method, _targets[target].path, keepalive ? "keep-alive" : "close");
+                clients[i].length = (int)strlen(clients[i].request);
+                Thread_create(clients[i].thread, _client, &clients[i]);
+        }
+        sleep(_http.seconds);
+        _http.running = false;
+        int count = 0, errors = 0, size = 0;
+        long long *latency = NULL;
+        for (int i = 0; i < _http.clients; i++) {
+                Thread_join(clients[i].thread);
+                for (int j = 0; j < clients[i].count; j++)
+                        _append(&latency, &count, &size, clients[i].latency[j]);
+                errors += clients[i].errors;
+                FREE(clients[i].latency);
+                FREE(clients[i].request);
+        }
+        Thread_join(validator);
+        FREE(clients);
+        qsort(latency, count, sizeof(long long), _compareDuration);
+        fprintf(_http.out, "{\"suite\":\"http\",\"name\":\"%s\",\"transport\":\"%s\",\"keepalive\":%s,\"clients\":%d,\"requests\":%d,\"errors\":%d,\"rps\":%.1f",
+                _targets[target].name, transportnames[transport], keepalive ? "true" : "false", _http.clients, count, errors, (double)count / _http.seconds);
+        if (count)
+                fprintf(_http.out, ",\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f", latency[count / 2] / 1e3, latency[count * 9 / 10] / 1e3, latency[count * 99 / 100] / 1e3, latency[count - 1] / 1e3);
+        fprintf(_http.out, ",\"validate_cycles\":%d,\"validate_median_ms\":%.3f}\n", _http.validate.count, _median(_http.validate.duration, _http.validate.count) / 1e6);
+        fflush(_http.out);
+        FREE(latency);
+}
+
+
+/**
+ * Run the scenarios of the transport, the HTTP server is restarted for each transport as TLS and
+ * plain TCP share the port
+ */
+static void _transport(Transport_Type transport) {
+        Run.httpd.socket.net.ssl = _http.tls;
+        if (transport != Transport_Tls)
+                Run.httpd.socket.net.ssl.flags = SSL_Disabled;
+        monit_http(Httpd_Start);
+        // Wait for the server to listen, the unix socket is created after the TCP sockets
+        for (int i = 0; i < 100 && access(Run.httpd.socket.unix.path, F_OK) != 0; i++)
+                usleep(10000);
+        Socket_T S = _connect(transport);
+        if (S) {
+                Socket_free(&S);
+                for (int keepalive = 1; keepalive >= 0; keepalive--)
+                        for (int target = 0; target < (int)(sizeof(_targets) / sizeof(_targets[0])); target++)
+                                _scenario(transport, keepalive, target);
+        } else {
+                fprintf(stderr, "Cannot connect to the HTTP server over %s\n", transportnames[transport]);
+        }
+        monit_http(Httpd_Stop);
+}
+
+
+/**
+ * The HTTP load test: start the HTTP server with the generated services and drive it with the closed
+ * loop clients over each transport. Arguments: [clients [seconds]]
+ */
+static int _httpTest(int argc, char **argv) {
+        int *parameter[] = {&_http.clients, &_http.seconds};
+        for (int i = 1; i < argc; i++) {
+                if (i > 2 || (*parameter[i - 1] = atoi(argv[i])) < 1) {
+                        fprintf(stderr, "Usage: %s http [clients [seconds]]\n", prog);
+                        return 1;
+                }
+        }
+        _http.dir = Str_dup("/tmp/monit-http.XXXXXX");
+        if (! mkdtemp(_http.dir) || (_http.port = _freePort()) < 0) {
+                fprintf(stderr, "Cannot create the HTTP test directory or find a free port -- %s\n", STRERROR);
+                return 1;
+        }
+        char *pem = Str_cat("%s/bench.pem", _http.dir);
+#ifdef HAVE_OPENSSL
+        if (! _createPem(pem)) {
+                fprintf(stderr, "Cannot create the TLS certificate\n");
+                return 1;
+        }
+#endif
+        _parseControlFile(_generateHttp);
+        _http.tls = Run.httpd.socket.net.ssl;
+        // The action requests must not wake up a running monit daemon
+        Run.files.pid = Str_cat("%s/monit.pid", _http.dir);
+        signal(SIGPIPE, SIG_IGN);
+        // The server and validation log goes to stdout, keep only the report there
+        fflush(stdout);
+        int null = open("/dev/null", O_WRONLY);
+        _http.out = fdopen(dup(STDOUT_FILENO), "w");
+        dup2(null, STDOUT_FILENO);
+        close(null);
+        Thread_T validator;
+        _http.running = true;
+        Thread_create(validator, _validator, NULL);
+        sleep(_http.seconds);
+        _http.running = false;
+        Thread_join(validator);
+        fprintf(_http.out, "{\"suite\":\"http\",\"name\":\"idle\",\"validate_cycles\":%d,\"validate_median_ms\":%.3f}\n", _http.validate.count, _median(_http.validate.duration, _http.validate.count) / 1e6);
+        fflush(_http.out);
+        _transport(Transport_Tcp);
+#ifdef HAVE_OPENSSL
+        _transport(Transport_Tls);
+#endif
+        _transport(Transport_Unix);
+        fflush(_http.out);
+        dup2(fileno(_http.out), STDOUT_FILENO);
+        fclose(_http.out);
+        FREE(_http.validate.duration);
+        unlink(pem);
+        FREE(pem);
+        unlink(Run.files.pid);
+        rmdir(_http.dir);
+        FREE(_http.dir);
+        return 0;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int main(int argc, char **argv) {
+        Bootstrap(); // Bootstrap libmonit
+        Bootstrap_setAbortHandler(Log_abort_handler);
+        Bootstrap_setErrorHandler(Log_verror);
+        setlocale(LC_ALL, "C");
+        prog = "monitbench";
+        Mutex_init(Run.mutex);
+        if (! init_system_info()) {
+                fprintf(stderr, "Cannot initialize the system information\n");
+                exit(1);
+        }
+        Run.flags |= Run_ProcessEngineEnabled;
+        update_system_info();
+        if (argc > 1 && IS(argv[1], "http"))
+                return _httpTest(argc - 1, argv + 1);
+        if (argc > 1 && (IS(argv[1], "load") || IS(argv[1], "replay"))) {
+#ifdef LINUX
+                if (IS(argv[1], "load"))
+                        return _loadTest(argc - 1, argv + 1);
+                if (argc == 3)
+                        return _replay(argv[2]);
+                fprintf(stderr, "Usage: %s replay <archive>\n", prog);
+                return 1;
+#else
+                fprintf(stderr, "The %s test requires the Linux /proc\n", argv[1]);
+                return 1;
+#endif
+        }
+        _setup();
+
+        _run("Checksum_md5_1MiB", CHECKSUM_SIZE, _checksumMd5);
+        _run("Checksum_sha1_1MiB", CHECKSUM_SIZE, _checksumSha1);
+        _run("Checksum_sha256_1MiB", CHECKSUM_SIZE, _checksumSha256);
+        _run("Checksum_hmacSHA256_256B", 256, _hmacSha256);
+#ifdef LINUX
+        Run.procfs = _createProcfs(BENCH_PROCESSES);
+        _run("ProcessTree_init_4096_processes", 0, _processTreeInit);
+        _removeProcfs(Run.procfs);
+        Run.procfs = NULL;
+#endif
+        _run("status_xml_1002_services", _statusXmlLength(), _statusXml);
+        _run("ContentMatch_100_patterns_per_line", 0, _contentMatch);
+
+        _cleanup();
+        return 0;
+}
+
@@ -28,9 +28,30 @@
 #include <sys/types.h>
 #endif
 
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
 #include "monit.h"
 #include "md5.h"
 #include "sha1.h"
+#include "sha256.h"
 #include "checksum.h"
 
 // libmonit
@@ -41,6 +62,130 @@
 #define T ChecksumContext_T
 
 
+// Read size for the file digest path. It is a multiple of any page size and large enough to keep the disk busy with the readahead of the next block
+#define FILEBLOCKSIZE 1048576
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Test which pages of the file range [offset, offset + length) are in the page cache before we read them, so we can later drop only
+ * the pages we brought in ourselves and leave pages used by other applications (such as a database's hot set) in place. Return false
+ * if the residency cannot be tested, the caller then assumes no page was cached.
+ */
+static bool _residency(int fd, off_t offset, size_t length, long pagesize, unsigned char *vec) {
+#if defined HAVE_MINCORE && defined HAVE_SYS_MMAN_H
+        // Mapping a file range doesn't fault the pages in, mincore only inspects the page cache
+        void *map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, offset);
+        if (map != MAP_FAILED) {
+                bool rv = mincore(map, length, (void *)vec) == 0;
+                munmap(map, length);
+                return rv;
+        }
+#endif
+        memset(vec, 0, (length + pagesize - 1) / pagesize);
+        return false;
+}
+
+
+/**
+ * Drop the pages of the range [offset, offset + length) behind the read position, except the pages which were cached before we read
+ * the range.
+ */
+static void _dropBehind(int fd, off_t offset, size_t length, long pagesize, unsigned char *vec) {
+#if defined HAVE_POSIX_FADVISE && defined POSIX_FADV_DONTNEED
+        size_t pages = (length + pagesize - 1) / pagesize;
+        for (size_t i = 0; i < pages;) {
+                if (vec[i] & 1) {
+                        i++;
+                        continue;
+                }
+                size_t j = i;
+                while (j < pages && ! (vec[j] & 1))
+                        j++;
+                posix_fadvise(fd, offset + (off_t)i * pagesize, (off_t)(j - i) * pagesize, POSIX_FADV_DONTNEED);
+                i = j;
+        }
+#endif
+}
+
+
+/**
+ * Ask the kernel to read the range [offset, offset + length) into the page cache asynchronously.
+ */
+static void _readahead(int fd, off_t offset, size_t length) {
+#if defined HAVE_POSIX_FADVISE && defined POSIX_FADV_WILLNEED
+        posix_fadvise(fd, offset, (off_t)length, POSIX_FADV_WILLNEED);
+#endif
+}
+
+
+/**
+ * Compute the digest of a regular file. The file is read sequentially in large blocks with read(2) rather than through stdio and the
+ * pages which the computation brought into the page cache are dropped behind the read position, so checksumming large files doesn't
+ * evict the cache of other applications. The page cache residency of a block must be sampled before any of its pages are read, so
+ * the kernel readahead heuristic is disabled and the next block is read ahead explicitly, after its residency was sampled, while the
+ * current block is hashed. A mmap based read is not used on purpose: a file truncated while being mapped would kill the daemon with
+ * SIGBUS.
+ */
+static bool _getFileDigest(int fd, Hash_Type hashtype, unsigned char *digest, int hashlength) {
+        long pagesize = sysconf(_SC_PAGESIZE);
+        if (pagesize <= 0 || FILEBLOCKSIZE % pagesize)
+                pagesize = 4096;
+        // Allocated as the function runs in threads with small stack too
+        char *buffer = ALLOC(FILEBLOCKSIZE);
+        // The residency of the current and of the next block
+        unsigned char *vec = ALLOC(FILEBLOCKSIZE / pagesize + 1);
+        unsigned char *next = ALLOC(FILEBLOCKSIZE / pagesize + 1);
+        struct ChecksumContext_T context;
+        Checksum_init(&context, hashtype);
+#if defined HAVE_POSIX_FADVISE && defined POSIX_FADV_RANDOM
+        posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+#endif
+#if defined HAVE_POSIX_FADVISE && defined POSIX_FADV_NOREUSE
+        posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+#endif
+        bool rv = true;
+        off_t offset = 0;
+        _residency(fd, offset, FILEBLOCKSIZE, pagesize, vec);
+        while (true) {
+                ssize_t sum = 0;
+                _residency(fd, offset + FILEBLOCKSIZE, FILEBLOCKSIZE, pagesize, next);
+                _readahead(fd, offset + FILEBLOCKSIZE, FILEBLOCKSIZE);
+                // Read a full block, take care for partial reads
+                while (sum < FILEBLOCKSIZE) {
+                        ssize_t n = read(fd, buffer + sum, FILEBLOCKSIZE - sum);
+                        if (n < 0) {
+                                if (errno == EINTR)
+                                        continue;
+                                rv = false;
+                                goto done;
+                        } else if (n == 0) {
+                                break;
+                        }
+                        sum += n;
+                }
+                if (sum > 0) {
+                        Checksum_append(&context, buffer, (int)sum);
+                        _dropBehind(fd, offset, sum, pagesize, vec);
+                        offset += sum;
+                }
+                if (sum < FILEBLOCKSIZE)
+                        break;
+                unsigned char *t = vec;
+                vec = next;
+                next = t;
+        }
+        memcpy(digest, Checksum_finish(&context), hashlength);
+done:
+        FREE(next);
+        FREE(vec);
+        FREE(buffer);
+        return rv;
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -53,6 +198,9 @@ void Checksum_init(T context, Hash_Type type) {
                 case Hash_Sha1:
                         sha1_init(&(context->data.sha1));
                         break;
+                case Hash_Sha256:
+                        sha256_init(&(context->data.sha256));
+                        break;
                 default:
                         THROW(AssertException, "Checksum error: Unknown hash type");
                         break;
@@ -72,6 +220,9 @@ unsigned char *Checksum_finish(T context) {
                         case Hash_Sha1:
                                 sha1_finish(&(context->data.sha1), (unsigned char *)context->hash);
                                 break;
+                        case Hash_Sha256:
+                                sha256_finish(&(context->data.sha256), (unsigned char *)context->hash);
+                                break;
                         default:
                                 THROW(AssertException, "Checksum error: Unknown hash type");
                                 break;
@@ -94,6 +245,9 @@ void Checksum_append(T context, const char *input, int inputLength) {
                 case Hash_Sha1:
                         sha1_append(&(context->data.sha1), (const unsigned char *)input, inputLength);
                         break;
+                case Hash_Sha256:
+                        sha256_append(&(context->data.sha256), (const unsigned char *)input, inputLength);
+                        break;
                 default:
                         THROW(AssertException, "Checksum error: Unknown hash type");
                         break;
@@ -113,6 +267,9 @@ void Checksum_verify(T context, const char *checksum) {
                 case Hash_Sha1:
                         keyLength = 20;
                         break;
+                case Hash_Sha256:
+                        keyLength = 32;
+                        break;
                 default:
                         THROW(AssertException, "Checksum error: Unknown hash type");
                         break;
@@ -137,11 +294,12 @@ char *Checksum_digest2Bytes(unsigned char *digest, int mdlen, MD_T result) {
 }
 
 
-bool Checksum_getStreamDigests(FILE *stream, void *sha1_resblock, void *md5_resblock) {
-#define HASHBLOCKSIZE 4096
+bool Checksum_getStreamDigests(FILE *stream, void *sha1_resblock, void *md5_resblock, void *sha256_resblock) {
+#define HASHBLOCKSIZE 65536
         md5_context_t ctx_md5;
         sha1_context_t ctx_sha1;
-        unsigned char buffer[HASHBLOCKSIZE + 72];
+        sha256_context_t ctx_sha256;
+        unsigned char *buffer = ALLOC(HASHBLOCKSIZE + 72); // Large block for throughput, allocated as the function runs in threads with small stack too
         size_t sum;
 
         /* Initialize the computation contexts */
@@ -149,6 +307,8 @@ bool Checksum_getStreamDigests(FILE *stream, void *sha1_resblock, void *md5_resb
                 md5_init(&ctx_md5);
         if (sha1_resblock)
                 sha1_init(&ctx_sha1);
+        if (sha256_resblock)
+                sha256_init(&ctx_sha256);
 
         /* Iterate over full file contents */
         while (1)  {
@@ -164,8 +324,10 @@ bool Checksum_getStreamDigests(FILE *stream, void *sha1_resblock, void *md5_resb
                                 break;
                         if (n == 0) {
                                 /* Check for the error flag IFF N == 0, so that we don't exit the loop after a partial read due to e.g., EAGAIN or EWOULDBLOCK */
-                                if (ferror(stream))
+                                if (ferror(stream)) {
+                                        FREE(buffer);
                                         return false;
+                                }
                                 goto process_partial_block;
                         }
 
@@ -179,6 +341,8 @@ bool Checksum_getStreamDigests(FILE *stream, void *sha1_resblock, void *md5_resb
                         md5_append(&ctx_md5, (const md5_byte_t *)buffer, HASHBLOCKSIZE);
                 if (sha1_resblock)
                         sha1_append(&ctx_sha1, buffer, HASHBLOCKSIZE);
+                if (sha256_resblock)
+                        sha256_append(&ctx_sha256, buffer, HASHBLOCKSIZE);
         }
 
 process_partial_block:
@@ -188,31 +352,37 @@ process_partial_block:
                         md5_append(&ctx_md5, (const md5_byte_t *)buffer, (int)sum);
                 if (sha1_resblock)
                         sha1_append(&ctx_sha1, buffer, sum);
+                if (sha256_resblock)
+                        sha256_append(&ctx_sha256, buffer, sum);
         }
         /* Construct result in desired memory */
         if (md5_resblock)
                 md5_finish(&ctx_md5, md5_resblock);
         if (sha1_resblock)
                 sha1_finish(&ctx_sha1, sha1_resblock);
+        if (sha256_resblock)
+                sha256_finish(&ctx_sha256, sha256_resblock);
+        FREE(buffer);
         return true;
 }
 
 
 void Checksum_printHash(char *file) {
         MD_T hash;
-        unsigned char sha1[STRLEN], md5[STRLEN];
+        unsigned char sha1[STRLEN], md5[STRLEN], sha256[STRLEN];
         FILE *fhandle = NULL;
 
-        if (! (fhandle = file ? fopen(file, "r") : stdin) || ! Checksum_getStreamDigests(fhandle, sha1, md5) || (file && fclose(fhandle))) {
+        if (! (fhandle = file ? fopen(file, "r") : stdin) || ! Checksum_getStreamDigests(fhandle, sha1, md5, sha256) || (file && fclose(fhandle))) {
                 printf("%s: %s\n", file, STRERROR);
                 exit(1);
         }
-        printf("SHA1(%s) = %s\n", file ? file : "stdin", Checksum_digest2Bytes(sha1, 20, hash));
-        printf("MD5(%s)  = %s\n", file ? file : "stdin", Checksum_digest2Bytes(md5, 16, hash));
+        printf("SHA256(%s) = %s\n", file ? file : "stdin", Checksum_digest2Bytes(sha256, 32, hash));
+        printf("SHA1(%s)   = %s\n", file ? file : "stdin", Checksum_digest2Bytes(sha1, 20, hash));
+        printf("MD5(%s)    = %s\n", file ? file : "stdin", Checksum_digest2Bytes(md5, 16, hash));
 }
 
 
-bool Checksum_getChecksum(char *file, Hash_Type hashtype, char *buf, unsigned long bufsize) {
+bool Checksum_getChecksum(const char *file, Hash_Type hashtype, char *buf, unsigned long bufsize) {
         int hashlength = 16;
 
         ASSERT(file);
@@ -226,39 +396,27 @@ bool Checksum_getChecksum(char *file, Hash_Type hashtype, char *buf, unsigned lo
                 case Hash_Sha1:
                         hashlength = 20;
                         break;
+                case Hash_Sha256:
+                        hashlength = 32;
+                        break;
                 default:
                         Log_error("checksum: invalid hash type: 0x%x\n", hashtype);
                         return false;
         }
 
         if (File_isFile(file)) {
-                FILE *f = fopen(file, "r");
-                if (f) {
-                        bool fresult = false;
+                int fd = open(file, O_RDONLY | O_NOCTTY);
+                if (fd >= 0) {
                         MD_T sum;
-
-                        switch (hashtype) {
-                                case Hash_Md5:
-                                        fresult = Checksum_getStreamDigests(f, NULL, sum);
-                                        break;
-                                case Hash_Sha1:
-                                        fresult = Checksum_getStreamDigests(f, sum, NULL);
-                                        break;
-                                default:
-                                        break;
-                        }
-
-                        if (fclose(f))
+                        bool fresult = _getFileDigest(fd, hashtype, (unsigned char *)sum, hashlength);
+                        if (! fresult)
+                                Log_error("checksum: file %s read error -- %s\n", file, STRERROR);
+                        if (close(fd))
                                 Log_error("checksum: error closing file '%s' -- %s\n", file, STRERROR);
-
-                        if (! fresult) {
-                                Log_error("checksum: file %s stream error (0x%x)\n", file, fresult);
+                        if (! fresult)
                                 return false;
-                        }
-
                         Checksum_digest2Bytes((unsigned char *)sum, hashlength, buf);
                         return true;
-
                 } else
                         Log_error("checksum: failed to open file %s -- %s\n", file, STRERROR);
         } else
@@ -303,3 +461,37 @@ void Checksum_hmacMD5(const unsigned char *data, int datalen, const unsigned cha
         md5_finish(&ctx, digest);
 }
 
+
+void Checksum_hmacSHA256(const unsigned char *data, int datalen, const unsigned char *key, int keylen, unsigned char *digest) {
+        sha256_context_t ctx;
+        unsigned char k_ipad[65] = {};
+        unsigned char k_opad[65] = {};
+        unsigned char tk[SHA256_DIGEST_SIZE];
+
+        if (keylen > 64) {
+                sha256_init(&ctx);
+                sha256_append(&ctx, key, keylen);
+                sha256_finish(&ctx, tk);
+                key = tk;
+                keylen = SHA256_DIGEST_SIZE;
+        }
+
+        memcpy(k_ipad, key, keylen);
+        memcpy(k_opad, key, keylen);
+
+        for (int i = 0; i < 64; i++) {
+                k_ipad[i] ^= 0x36;
+                k_opad[i] ^= 0x5c;
+        }
+
+        sha256_init(&ctx);
+        sha256_append(&ctx, k_ipad, 64);
+        sha256_append(&ctx, data, datalen);
+        sha256_finish(&ctx, digest);
+
+        sha256_init(&ctx);
+        sha256_append(&ctx, k_opad, 64);
+        sha256_append(&ctx, digest, SHA256_DIGEST_SIZE);
+        sha256_finish(&ctx, digest);
+}
+
@@ -42,8 +42,9 @@ typedef struct T {
         Hash_Type type;
         MD_T      hash;
         union {
-                md5_context_t  md5;
-                sha1_context_t sha1;
+                md5_context_t    md5;
+                sha1_context_t   sha1;
+                sha256_context_t sha256;
         } data;
 } *T;
 
@@ -89,27 +90,28 @@ void Checksum_verify(T context, const char *checksum);
  * Convert a digest buffer to a char string
  * @param digest buffer containing a MD digest
  * @param mdlen digest length
- * @param result buffer to write the result to. Must be at least 41 bytes long.
+ * @param result buffer to write the result to. Must be at least 65 bytes long.
  * @return pointer to result buffer
  */
 char *Checksum_digest2Bytes(unsigned char *digest, int mdlen, MD_T result);
 
 
 /**
- * Compute SHA1 and MD5 message digests simultaneously for bytes read
- * from STREAM (suitable for stdin, which is not always rewindable).
+ * Compute SHA1, MD5 and SHA256 message digests simultaneously for bytes
+ * read from STREAM (suitable for stdin, which is not always rewindable).
  * The resulting message digest numbers will be written into the first
  * bytes of resblock buffers.
  * @param stream The stream from where the digests are computed
  * @param sha_resblock The buffer to write the SHA1 result to or NULL to skip the SHA1
  * @param md5_resblock The buffer to write the MD5 result to or NULL to skip the MD5
+ * @param sha256_resblock The buffer to write the SHA256 result to or NULL to skip the SHA256
  * @return false if failed, otherwise true
  */
-bool Checksum_getStreamDigests(FILE *stream, void *sha_resblock, void *md5_resblock);
+bool Checksum_getStreamDigests(FILE *stream, void *sha_resblock, void *md5_resblock, void *sha256_resblock);
 
 
 /**
- * Print MD5 and SHA1 hashes to standard output for given file or standard input
+ * Print MD5, SHA1 and SHA256 hashes to standard output for given file or standard input
  * @param file The file for which the hashes will be printed or NULL for stdin
  */
 void Checksum_printHash(char *file);
@@ -118,12 +120,12 @@ void Checksum_printHash(char *file);
 /**
  * Store the checksum of given file in supplied buffer
  * @param file The file for which to compute the checksum
- * @param hashtype The hash type (Hash_Md5 or Hash_Sha1)
+ * @param hashtype The hash type (Hash_Md5, Hash_Sha1 or Hash_Sha256)
  * @param buf The buffer where the result will be stored
  * @param bufsize The size of the buffer
  * @return false if failed, otherwise true
  */
-bool Checksum_getChecksum(char *file, Hash_Type hashtype, char *buf, unsigned long bufsize);
+bool Checksum_getChecksum(const char *file, Hash_Type hashtype, char *buf, unsigned long bufsize);
 
 
 /**
@@ -137,6 +139,17 @@ bool Checksum_getChecksum(char *file, Hash_Type hashtype, char *buf, unsigned lo
 void Checksum_hmacMD5(const unsigned char *data, int datalen, const unsigned char *key, int keylen, unsigned char *digest);
 
 
+/**
+ * Get the HMAC-SHA256 signature
+ * @param data The data to sign
+ * @param datalen The length of the data to sign
+ * @param key The key used for the signature
+ * @param keylen The length of the key
+ * @param digest Buffer containing a signature. Must be at least 32 bytes long.
+ */
+void Checksum_hmacSHA256(const unsigned char *data, int datalen, const unsigned char *key, int keylen, unsigned char *digest);
+
+
 #undef T
 #endif
 
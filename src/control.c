@@ -54,6 +54,10 @@
 
 #include "monit.h"
 #include "ProcessTree.h"
+#include "ProcessEvent.h"
+#include "FileEvent.h"
+#include "Cluster.h"
+#include "ServiceStatus.h"
 #include "event.h"
 #include "util.h"
 #include "system/Time.h"
@@ -66,6 +70,13 @@
 /**
  *  Methods for controlling services managed by monit.
  *
+ *  The monit daemon executes the service actions in the background: the
+ *  action is queued as an operation of the group of services connected by
+ *  dependencies, the operation thread runs the action including the wait
+ *  for the process start or stop and wakes up the daemon when finished.
+ *  The services of the group are not checked while the operation is in
+ *  progress, the other services are checked as usual.
+ *
  *  @file
  */
 
@@ -82,6 +93,49 @@ typedef enum {
 #define RETRY_INTERVAL 100000 // 100ms
 
 
+typedef struct Step_T {
+        Service_T service;
+        Action_Type action;
+        bool scheduled;                       /**< Scheduled by Service_T.doaction */
+        struct Step_T *next;
+} *Step_T;
+
+
+typedef struct Operation_T {
+        bool started;
+        bool done;
+        Thread_T thread;
+        List_T services;             /**< The services of the dependency group */
+        Step_T steps;                              /**< The actions to execute */
+        struct Operation_T *next;
+} *Operation_T;
+
+
+typedef struct DependJob_T {
+        Service_T service;
+        int level;                   /**< The dependency path length from the service */
+        int position;                            /**< The servicelist position */
+        bool rv;
+        StringBuffer_T sb;          /**< The dependencies which failed to start */
+} DependJob_T;
+
+
+typedef struct DependLevel_T {
+        Action_Type action;
+        bool unmonitor;
+        Mutex_T mutex;
+        int cursor;                              /**< The next job to execute */
+        int count;
+        DependJob_T *jobs;
+} DependLevel_T;
+
+
+static struct {
+        Mutex_T mutex;
+        Operation_T list;
+} _operations = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
 /* ----------------------------------------------------------------- Private */
 
 
@@ -97,25 +151,31 @@ static int _commandExecute(Service_T S, command_t c, char *msg, int msglen, long
         ASSERT(msg);
         msg[0] = 0;
         int status = -1;
-        Command_T C = NULL;
-        TRY
-        {
-                // May throw exception if the program doesn't exist (was removed while Monit was up)
-                C = Command_new(c->arg[0], NULL);
-        }
-        ELSE
-        {
-                snprintf(msg, msglen, "Program %s failed: %s", c->arg[0], Exception_frame.message);
+        // The Command is built once and reused, just the MONIT_xxx variables are updated for each execution
+        Command_T C = c->C;
+        if (! C) {
+                TRY
+                {
+                        // May throw exception if the program doesn't exist (was removed while Monit was up)
+                        C = Command_new(c->arg[0], NULL);
+                }
+                ELSE
+                {
+                        snprintf(msg, msglen, "Program %s failed: %s", c->arg[0], Exception_frame.message);
+                }
+                END_TRY;
+                if (C) {
+                        for (int i = 1; i < c->length; i++)
+                                Command_appendArgument(C, c->arg[i]);
+                        if (c->has_uid)
+                                Command_setUid(C, c->uid);
+                        if (c->has_gid)
+                                Command_setGid(C, c->gid);
+                        c->C = C;
+                }
         }
-        END_TRY;
         if (C) {
                 long long _timeoutMilli = *timeout / 1000.;
-                for (int i = 1; i < c->length; i++)
-                        Command_appendArgument(C, c->arg[i]);
-                if (c->has_uid)
-                        Command_setUid(C, c->uid);
-                if (c->has_gid)
-                        Command_setGid(C, c->gid);
                 Command_setEnv(C, "MONIT_DATE", Time_string(Time_now(), (char[26]){}));
                 Command_setEnv(C, "MONIT_SERVICE", S->name);
                 Command_setEnv(C, "MONIT_HOST", Run.system->name);
@@ -135,8 +195,9 @@ static int _commandExecute(Service_T S, command_t c, char *msg, int msglen, long
                                 break;
                 }
                 Process_T P = Command_execute(C);
-                Command_free(&C);
-                if (P) {
+                if (! P) {
+                        snprintf(msg, msglen, "Program %s failed: %s", c->arg[0], STRERROR);
+                } else {
                         do {
                                 Time_usleep(RETRY_INTERVAL);
                                 *timeout -= RETRY_INTERVAL;
@@ -164,29 +225,45 @@ static int _commandExecute(Service_T S, command_t c, char *msg, int msglen, long
 }
 
 
+/*
+ * Wait for the process start. The pidfile is tested on each change of its
+ * directory (or every 100ms if it cannot be watched), the command line match
+ * and the cgroup scope require the process table scan, so the wait is doubled
+ * up to 1s
+ */
 static Process_Status _waitProcessStart(Service_T s, long long *timeout) {
+        bool scan = s->matchlist || s->cgroup;
+        int watch = scan ? -1 : FileEvent_watchFile(s->path);
+        Process_Status status = Process_Stopped;
         long wait = RETRY_INTERVAL;
         do {
-                Time_usleep(wait);
+                long long started = Time_micro();
+                FileEvent_wait(watch, (int)(wait / USEC_PER_MSEC));
+                if (scan)
+                        ProcessTree_refresh(RETRY_INTERVAL / USEC_PER_MSEC); // Refresh the command lines, the shared snapshot predates the start
                 pid_t pid = ProcessTree_findProcess(s);
                 if (pid) {
                         ProcessTree_init(ProcessEngine_None);
                         ProcessTree_updateProcess(s, pid);
-                        return Process_Started;
+                        status = Process_Started;
+                        break;
                 }
-                *timeout -= wait;
-                wait = wait < 1000000 ? wait * 2 : 1000000; // double the wait during each cycle until 1s is reached (ProcessTree_findProcess can be heavy and we don't want to drain power every 100ms on mobile devices)
+                *timeout -= Time_micro() - started;
+                if (scan)
+                        wait = wait < 1000000 ? wait * 2 : 1000000; // double the wait during each cycle until 1s is reached (ProcessTree_findProcess can be heavy and we don't want to drain power every 100ms on mobile devices)
         } while (*timeout > 0 && ! (Run.flags & Run_Stopped));
-        return Process_Stopped;
+        FileEvent_unwatchFile(watch);
+        return status;
 }
 
 
+// Wait for the process exit, the timeout is checked every 100ms
 static Process_Status _waitProcessStop(int pid, long long *timeout) {
         do {
-                Time_usleep(RETRY_INTERVAL);
-                if (! pid || (getpgid(pid) == -1 && errno != EPERM))
+                long long started = Time_micro();
+                if (! pid || ProcessEvent_waitExit(pid, RETRY_INTERVAL / USEC_PER_MSEC))
                         return Process_Stopped;
-                *timeout -= RETRY_INTERVAL;
+                *timeout -= Time_micro() - started;
         } while (*timeout > 0 && ! (Run.flags & Run_Stopped));
         return Process_Started;
 }
@@ -199,7 +276,13 @@ static State_Type _check(Service_T s) {
         Monitor_Mode original = s->mode;
         s->mode = Monitor_Passive;
         rv = s->check(s);
-        if (s->type == Service_Program && s->program->P) {
+        if (s->type == Service_Program && s->program->worker) {
+                // check program sent the request to the worker and needs to be called again to collect the response
+                for (long long timeout = s->program->timeout * USEC_PER_MSEC; rv == State_Init && timeout > 0LL && ! (Run.flags & Run_Stopped); timeout -= RETRY_INTERVAL) {
+                        Time_usleep(RETRY_INTERVAL);
+                        rv = s->check(s);
+                }
+        } else if (s->type == Service_Program && s->program->P) {
                 // check program executes the program and needs to be called again to collect the exit value and evaluate the status
                 long long timeout = s->program->timeout * USEC_PER_MSEC;
                 do {
@@ -213,18 +296,14 @@ static State_Type _check(Service_T s) {
 }
 
 
-/*
- * This is a post-fix recursive function for starting every service
- * that s depends on before starting s.
- * @param s A Service_T object
- * @return true if the service was started otherwise false
- */
-static bool _doStart(Service_T s) {
-        ASSERT(s);
+static bool _doStart(Service_T s);
+
+
+// Start the services which s depends on, the names of the services which failed are appended to sb
+static bool _doStartDependencies(Service_T s, StringBuffer_T sb) {
         bool rv = true;
-        StringBuffer_T sb = StringBuffer_create(64);
         for (Dependant_T d = s->dependantlist; d; d = d->next ) {
-                Service_T parent = Util_getService(d->dependant);
+                Service_T parent = d->service;
                 ASSERT(parent);
                 if (parent->monitor != Monitor_Yes || parent->error) {
                         if (_doStart(parent)) {
@@ -236,8 +315,16 @@ static bool _doStart(Service_T s) {
                         StringBuffer_append(sb, "%s%s", StringBuffer_length(sb) ? ", " : "", parent->name);
                 }
         }
+        return rv;
+}
+
+
+// Start the service itself if its dependencies started (rv is true)
+static bool _doStartService(Service_T s, bool rv, StringBuffer_T sb) {
         if (rv) {
-                if (s->start) {
+                if (s->start && ! Cluster_isOwner(s)) {
+                        Log_info("'%s' start skipped -- the service is owned by another cluster node\n", s->name);
+                } else if (s->start) {
                         if (s->type != Service_Process || ! ProcessTree_findProcess(s)) {
                                 Log_info("'%s' start: '%s'\n", s->name, Util_commandDescription(s->start, (char[STRLEN]){}));
                                 char msg[1024];
@@ -259,6 +346,20 @@ static bool _doStart(Service_T s) {
                 s->doaction = Action_Start; // Retry the start next cycle
         }
         Util_monitorSet(s);
+        return rv;
+}
+
+
+/*
+ * This is a post-fix recursive function for starting every service
+ * that s depends on before starting s.
+ * @param s A Service_T object
+ * @return true if the service was started otherwise false
+ */
+static bool _doStart(Service_T s) {
+        ASSERT(s);
+        StringBuffer_T sb = StringBuffer_create(64);
+        bool rv = _doStartService(s, _doStartDependencies(s, sb), sb);
         StringBuffer_free(&sb);
         return rv;
 }
@@ -325,7 +426,9 @@ static bool _doStop(Service_T s, bool unmonitor) {
 static bool _doRestart(Service_T s) {
         ASSERT(s);
         bool rv = true;
-        if (s->restart) {
+        if (s->restart && ! Cluster_isOwner(s)) {
+                Log_info("'%s' restart skipped -- the service is owned by another cluster node\n", s->name);
+        } else if (s->restart) {
                 Log_info("'%s' restart: '%s'\n", s->name, Util_commandDescription(s->restart, (char[STRLEN]){}));
                 Util_resetInfo(s);
                 char msg[1024];
@@ -353,7 +456,7 @@ static bool _doRestart(Service_T s) {
 static void _doMonitor(Service_T s) {
         ASSERT(s);
         for (Dependant_T d = s->dependantlist; d; d = d->next ) {
-                Service_T parent = Util_getService(d->dependant);
+                Service_T parent = d->service;
                 ASSERT(parent);
                 _doMonitor(parent);
         }
@@ -371,8 +474,132 @@ static void _doUnmonitor(Service_T s) {
 }
 
 
+static int _compareDependLevel(const void *a, const void *b) {
+        const DependJob_T *x = a, *y = b;
+        return x->level != y->level ? x->level - y->level : x->position - y->position;
+}
+
+
+/*
+ * Collect the services which depend on s directly or indirectly. The level is the longest dependency path from s,
+ * so the services of one level don't depend on each other. The jobs are sorted by the level, s itself is first
+ * @return The number of jobs
+ */
+static int _dependLevels(Service_T s, DependJob_T *jobs) {
+        int count = 1;
+        jobs[0] = (DependJob_T){.service = s};
+        // Relax the levels until no service moves deeper, the dependency graph is acyclic
+        for (bool changed = true; changed;) {
+                changed = false;
+                for (int i = 0; i < count; i++) {
+                        for (int k = 0; k < jobs[i].service->children.count; k++) {
+                                Service_T child = jobs[i].service->children.list[k];
+                                int j = 0;
+                                while (j < count && jobs[j].service != child)
+                                        j++;
+                                if (j == count)
+                                        jobs[count++] = (DependJob_T){.service = child, .position = child->position, .level = -1};
+                                if (jobs[j].level <= jobs[i].level) {
+                                        jobs[j].level = jobs[i].level + 1;
+                                        changed = true;
+                                }
+                        }
+                }
+        }
+        qsort(jobs, count, sizeof(DependJob_T), _compareDependLevel);
+        return count;
+}
+
+
+static void _doDependService(DependLevel_T *L, DependJob_T *job) {
+        Service_T s = job->service;
+        switch (L->action) {
+                case Action_Start:
+                        // (re)start children only if it's monitoring is enabled (we keep monitoring flag during restart, allowing to restore original pre-restart configuration)
+                        if (s->monitor != Monitor_Not)
+                                job->rv = _doStartService(s, job->rv, job->sb);
+                        break;
+                case Action_Stop:
+                        if (s->monitor != Monitor_Not)
+                                job->rv = _doStop(s, L->unmonitor);
+                        break;
+                case Action_Monitor:
+                        _doMonitor(s);
+                        break;
+                case Action_Unmonitor:
+                        _doUnmonitor(s);
+                        break;
+                default:
+                        break;
+        }
+}
+
+
+static void *_dependWorker(void *args) {
+        set_signal_block();
+        DependLevel_T *L = args;
+        while (true) {
+                int i;
+                LOCK(L->mutex)
+                {
+                        i = L->cursor < L->count ? L->cursor++ : -1;
+                }
+                END_LOCK;
+                if (i < 0)
+                        break;
+                _doDependService(L, &L->jobs[i]);
+        }
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        return NULL;
+}
+
+
+/*
+ * Execute the action for the services of one dependency level. The start and stop programs run in parallel
+ * using up to Run.workers threads, the start of the dependencies outside of the level is serialized up front
+ * @return true if the action succeeded for all services otherwise false
+ */
+static bool _doDependLevel(DependLevel_T *L) {
+        bool rv = true;
+        for (int i = 0; i < L->count; i++) {
+                DependJob_T *job = &L->jobs[i];
+                job->rv = true;
+                if (L->action == Action_Start && job->service->monitor != Monitor_Not) {
+                        job->sb = StringBuffer_create(64);
+                        job->rv = _doStartDependencies(job->service, job->sb);
+                }
+        }
+        int workers = (L->action == Action_Start || L->action == Action_Stop) ? MIN(Run.workers, L->count) : 1;
+        if (workers > 1) {
+                Thread_T *threads = CALLOC(workers, sizeof(Thread_T));
+                for (int i = 0; i < workers; i++)
+                        Thread_create(threads[i], _dependWorker, L);
+                for (int i = 0; i < workers; i++)
+                        Thread_join(threads[i]);
+                FREE(threads);
+        } else {
+                for (int i = 0; i < L->count; i++)
+                        _doDependService(L, &L->jobs[i]);
+        }
+        for (int i = 0; i < L->count; i++) {
+                DependJob_T *job = &L->jobs[i];
+                if (! job->rv)
+                        rv = false;
+                if (job->service->doaction == L->action)
+                        job->service->doaction = Action_Ignored;
+                if (job->sb)
+                        StringBuffer_free(&job->sb);
+        }
+        return rv;
+}
+
+
 /*
- * This is an in-fix recursive function for control of services that depend on s
+ * Control the services that depend on s. The dependants are ordered into levels by the dependency path length
+ * from s: the start and monitor go from the nearest level, the stop and unmonitor from the farthest level. The
+ * next level is processed only if the action succeeded for all services in the previous level
  * @param s A Service_T object
  * @param action An action for the dependant services
  * @param unmonitor Disable service monitoring: used for stop action only to differentiate hard/soft stop - see _doStop()
@@ -381,53 +608,242 @@ static void _doUnmonitor(Service_T s) {
 static bool _doDepend(Service_T s, Action_Type action, bool unmonitor) {
         ASSERT(s);
         bool rv = true;
-        for (Service_T child = servicelist; child; child = child->next) {
-                for (Dependant_T d = child->dependantlist; d; d = d->next) {
-                        if (IS(d->dependant, s->name)) {
-                                if (action == Action_Start) {
-                                        // (re)start children only if it's monitoring is enabled (we keep monitoring flag during restart, allowing to restore original pre-restart configuration)
-                                        if (child->monitor != Monitor_Not && ! _doStart(child))
-                                                rv = false;
-                                } else if (action == Action_Monitor) {
-                                        _doMonitor(child);
-                                }
-                                // We can start children of current child (2nd+ dependency level) only if the child itself started
-                                if (rv) {
-                                        if (! _doDepend(child, action, unmonitor)) {
-                                                rv = false;
-                                        } else {
-                                                // Stop this service only if all children stopped
-                                                if (action == Action_Stop && child->monitor != Monitor_Not) {
-                                                        if (! _doStop(child, unmonitor))
-                                                                rv = false;
-                                                } else if (action == Action_Unmonitor) {
-                                                        _doUnmonitor(child);
-                                                }
-                                        }
-                                }
-                                if (child->doaction == action) {
-                                        child->doaction = Action_Ignored;
-                                }
-                                break;
-                        }
+        int size = 0;
+        for (Service_T x = servicelist; x; x = x->next)
+                size++;
+        DependJob_T *jobs = CALLOC(size + 1, sizeof(DependJob_T));
+        int count = _dependLevels(s, jobs);
+        // Slice the jobs into the levels, skip the service s (level 0)
+        bool forward = action == Action_Start || action == Action_Monitor;
+        for (int n = 0; n < count - 1 && rv;) {
+                int first = forward ? 1 + n : count - 1 - n, last = first;
+                if (forward) {
+                        while (last + 1 < count && jobs[last + 1].level == jobs[first].level)
+                                last++;
+                } else {
+                        while (first - 1 > 0 && jobs[first - 1].level == jobs[last].level)
+                                first--;
                 }
+                DependLevel_T L = {.action = action, .unmonitor = unmonitor, .mutex = PTHREAD_MUTEX_INITIALIZER, .count = last - first + 1, .jobs = jobs + first};
+                rv = _doDependLevel(&L);
+                n += L.count;
         }
+        FREE(jobs);
         return rv;
 }
 
 
+static void _execute(Service_T s, Action_Type action, bool scheduled) {
+        bool rv = control_service(s->name, action);
+        if (scheduled) {
+                Event_post(s, Event_Action, State_Changed, s->action_ACTION, "%s action %s", actionnames[action], rv ? "done" : "failed");
+                FREE(s->token);
+        }
+}
+
+
+static void _addStep(Operation_T o, Service_T s, Action_Type action, bool scheduled) {
+        Step_T step;
+        NEW(step);
+        step->service = s;
+        step->action = action;
+        step->scheduled = scheduled;
+        Step_T *last = &o->steps;
+        while (*last)
+                last = &(*last)->next;
+        *last = step;
+}
+
+
+static void _addBusy(Operation_T o, Service_T s) {
+        if (! s->busy) {
+                s->busy = true;
+                List_append(o->services, s);
+        }
+}
+
+
+// Mark the service and all services connected with it by dependencies as busy. The services appended to the list are visited too
+static void _addGroup(Operation_T o, Service_T s) {
+        _addBusy(o, s);
+        for (list_t e = o->services->head; e; e = e->next) {
+                Service_T a = e->e;
+                for (Dependant_T d = a->dependantlist; d; d = d->next)
+                        _addBusy(o, d->service);
+                for (int i = 0; i < a->children.count; i++)
+                        _addBusy(o, a->children.list[i]);
+        }
+}
+
+
+static Operation_T _getOperation(Service_T s) {
+        for (Operation_T o = _operations.list; o; o = o->next)
+                for (list_t e = o->services->head; e; e = e->next)
+                        if (e->e == s)
+                                return o;
+        return NULL;
+}
+
+
+static void *_operationThread(void *args) {
+        set_signal_block();
+        Operation_T o = args;
+        while (true) {
+                Step_T step = NULL;
+                LOCK(_operations.mutex)
+                {
+                        if ((step = o->steps))
+                                o->steps = step->next;
+                        else
+                                o->done = true;
+                }
+                END_LOCK;
+                if (! step)
+                        break;
+                _execute(step->service, step->action, step->scheduled);
+                FREE(step);
+        }
+        // Wake up the daemon to collect the operation and check the services
+        kill(getpid(), SIGUSR1);
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        return NULL;
+}
 
 
 /* ------------------------------------------------------------------ Public */
 
 
 /**
- * Apply given action to the services list.
- * @param services A services list
+ * Execute the action of the service. The daemon runs the action in the
+ * background, see control_run(), otherwise the action is executed now
+ * @param s A service
+ * @param action An action id describing the action to execute
+ * @param scheduled true if the action was requested via Service_T.doaction
+ */
+void control_queue(Service_T s, Action_Type action, bool scheduled) {
+        ASSERT(s);
+        bool now = false;
+        LOCK(_operations.mutex)
+        {
+                Operation_T o = s->busy ? _getOperation(s) : NULL;
+                if (o && ! o->done) {
+                        // The action was requested during the operation (for example by the event of its action) => append it to the same group
+                        _addStep(o, s, action, scheduled);
+                } else if (! o && (Run.flags & Run_Daemon) && ! (Run.flags & Run_Once) && ! (Run.flags & Run_Stopped)) {
+                        NEW(o);
+                        o->services = List_new();
+                        _addGroup(o, s);
+                        _addStep(o, s, action, scheduled);
+                        o->next = _operations.list;
+                        _operations.list = o;
+                        DEBUG("'%s' %s action queued\n", s->name, actionnames[action]);
+                } else {
+                        now = true;
+                }
+        }
+        END_LOCK;
+        if (now)
+                _execute(s, action, scheduled);
+}
+
+
+/**
+ * Start the queued operations
+ */
+void control_run() {
+        LOCK(_operations.mutex)
+        {
+                for (Operation_T o = _operations.list; o; o = o->next) {
+                        if (! o->started) {
+                                o->started = true;
+                                Thread_create(o->thread, _operationThread, o);
+                        }
+                }
+        }
+        END_LOCK;
+}
+
+
+/**
+ * Release the services of the finished operations and schedule their check
+ * @return true if some operation finished, otherwise false
+ */
+bool control_collect() {
+        bool collected = false;
+        LOCK(_operations.mutex)
+        {
+                for (Operation_T *o = &_operations.list; *o;) {
+                        if ((*o)->done) {
+                                Operation_T done = *o;
+                                *o = done->next;
+                                // The thread doesn't use the mutex once done
+                                Thread_join(done->thread);
+                                for (list_t e = done->services->head; e; e = e->next) {
+                                        Service_T s = e->e;
+                                        s->busy = false;
+                                        s->every.next = 0;
+                                }
+                                List_free(&done->services);
+                                FREE(done);
+                                collected = true;
+                        } else {
+                                o = &(*o)->next;
+                        }
+                }
+        }
+        END_LOCK;
+        return collected;
+}
+
+
+/**
+ * Check if some operation finished and wasn't collected yet
+ * @return true if there is a finished operation, otherwise false
+ */
+bool control_pending() {
+        bool pending = false;
+        LOCK(_operations.mutex)
+        {
+                for (Operation_T o = _operations.list; o && ! pending; o = o->next)
+                        pending = o->done;
+        }
+        END_LOCK;
+        return pending;
+}
+
+
+/**
+ * Start the queued operations and wait for all operations to finish
+ */
+void control_wait() {
+        control_run();
+        while (true) {
+                bool active = false;
+                LOCK(_operations.mutex)
+                {
+                        active = _operations.list != NULL;
+                }
+                END_LOCK;
+                if (! active)
+                        break;
+                if (! control_collect())
+                        Time_usleep(RETRY_INTERVAL);
+        }
+}
+
+
+
+/**
+ * Apply given action to the services of the group and to the services
+ * selected by the names or glob patterns
+ * @param group A service group name or NULL
+ * @param services A list of the service names or patterns
  * @param action A string describing the action to execute
  * @return number of errors
  */
-bool control_service_string(List_T services, const char *action) {
+bool control_service_string(const char *group, List_T services, const char *action) {
         ASSERT(services);
         ASSERT(action);
         Action_Type a = Util_getAction(action);
@@ -436,9 +852,22 @@ bool control_service_string(List_T services, const char *action) {
                 return 1;
         }
         int errors = 0;
-        for (list_t s = services->head; s; s = s->next)
-                if (control_service(s->e, a) == false)
+        List_T selected = List_new();
+        if (group && ! Util_selectServices(selected, Select_Group, group)) {
+                Log_error("Group '%s' not found\n", group);
+                errors++;
+        }
+        for (list_t e = services->head; e; e = e->next) {
+                Select_Type type = Util_getSelectType(e->e);
+                if (! Util_selectServices(selected, type, e->e)) {
+                        Log_error(type == Select_Pattern ? "No service matches '%s'\n" : "Service '%s' -- doesn't exist\n", (char *)e->e);
+                        errors++;
+                }
+        }
+        for (list_t e = selected->head; e; e = e->next)
+                if (control_service(((Service_T)e->e)->name, a) == false)
                         errors++;
+        List_free(&selected);
         return errors;
 }
 
@@ -505,6 +934,8 @@ bool control_service(const char *S, Action_Type A) {
         if (s->doaction == A) {
                 s->doaction = Action_Ignored;
         }
+        // The validator skips the service while the action is in progress, publish the status changed by the action
+        ServiceStatus_publish(s);
         return rv;
 }
 
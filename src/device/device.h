@@ -27,6 +27,8 @@
 
 
 bool filesystem_usage(Service_T);
+bool filesystem_hung(Service_T s, unsigned long long *hung, unsigned long long *age);
+void filesystem_release(Service_T);
 bool Filesystem_getByMountpoint(Info_T inf, const char *path);
 bool Filesystem_getByDevice(Info_T inf, const char *path);
 
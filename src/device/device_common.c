@@ -62,18 +62,47 @@
 #include "monit.h"
 #include "device.h"
 
+// libmonit
+#include "system/Time.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
 
-bool filesystem_usage(Service_T s) {
-        ASSERT(s);
+
+/* ------------------------------------------------------------- Definitions */
+
+
+/**
+ * Filesystem statistics collection job. The statistics are collected by a helper thread, so a hung
+ * network filesystem (NFS, CIFS, etc.) blocks the helper only and not the validation. The helper works
+ * on a private copy of the filesystem info, which is copied back to the service when the job is done
+ */
+typedef struct FilesystemJob_T {
+        char *path;                          // The filesystem path
+        struct FileSystemInfo_T inf;         // Private copy of the filesystem info
+        bool rv;                             // Collection result
+        bool done;                           // True when the helper finished the job
+        bool orphaned;                       // The service was removed while the helper was hung, the helper frees the job
+        unsigned long long started;          // Job start timestamp [ms]
+} *FilesystemJob_T;
+
+
+static Mutex_T _mutex = PTHREAD_MUTEX_INITIALIZER;
+static Sem_T _done = PTHREAD_COND_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static bool _filesystemUsage(const char *path, Info_T inf) {
         struct stat sb;
         bool rv = false;
-        int st = lstat(s->path, &sb);
+        int st = lstat(path, &sb);
         if (st == 0) {
                 if (S_ISLNK(sb.st_mode)) {
                         // Symbolic link: dereference
                         char buf[PATH_MAX] = {};
-                        if (! realpath(s->path, buf)) {
-                                Log_error("Cannot dereference filesystem '%s' (symlink) -- %s\n", s->path, STRERROR);
+                        if (! realpath(path, buf)) {
+                                Log_error("Cannot dereference filesystem '%s' (symlink) -- %s\n", path, STRERROR);
                                 return false;
                         }
                         st = stat(buf, &sb);
@@ -85,43 +114,169 @@ bool filesystem_usage(Service_T s) {
                 //   2. or it is mountpoint which doesn't exist (subdirectory of parent filesystem which is not mounted itself or the mountpoint was deleted)
                 //   3. or it is a hotplug device which was unconfigured from the system
                 // Try to use the Filesystem_getByDevice() which will find case #1 above and keep the error for cases #2 and #3
-                if (Filesystem_getByDevice(&(s->inf), s->path)) {
+                if (Filesystem_getByDevice(inf, path)) {
                         // If the device connection string was found, get uid/gid/mode of the mountpoint (connection string itself cannot be stated)
-                        if (stat(s->inf.filesystem->object.mountpoint, &sb) == 0) {
+                        if (stat(inf->filesystem->object.mountpoint, &sb) == 0) {
                                 rv = true;
                         }
                 }
         } else {
                 char buf[PATH_MAX] = {};
-                if (realpath(s->path, buf)) {
+                if (realpath(path, buf)) {
                         if (S_ISDIR(sb.st_mode)) {
                                 // Directory -> mountpoint
-                                rv = Filesystem_getByMountpoint(&(s->inf), buf);
+                                rv = Filesystem_getByMountpoint(inf, buf);
                         } else if (S_ISBLK(sb.st_mode) || S_ISCHR(sb.st_mode)) {
                                 // Block or character device
-                                rv = Filesystem_getByDevice(&(s->inf), buf);
+                                rv = Filesystem_getByDevice(inf, buf);
                         }
                 }
         }
         if (rv) {
-                s->inf.filesystem->mode = sb.st_mode;
-                s->inf.filesystem->uid = sb.st_uid;
-                s->inf.filesystem->gid = sb.st_gid;
-                s->inf.filesystem->f_filesused = s->inf.filesystem->f_filesfree > 0 ? s->inf.filesystem->f_files - s->inf.filesystem->f_filesfree : s->inf.filesystem->f_files;
-                s->inf.filesystem->f_blocksused = s->inf.filesystem->f_blocks - s->inf.filesystem->f_blocksfreetotal;
-                s->inf.filesystem->inode_percent = s->inf.filesystem->f_files > 0 ? 100. * (double)s->inf.filesystem->f_filesused / (double)s->inf.filesystem->f_files : 0.;
-                s->inf.filesystem->space_percent = s->inf.filesystem->f_blocks > 0 ? 100. * (double)s->inf.filesystem->f_blocksused / (double)s->inf.filesystem->f_blocks : 0.;
+                inf->filesystem->mode = sb.st_mode;
+                inf->filesystem->uid = sb.st_uid;
+                inf->filesystem->gid = sb.st_gid;
+                inf->filesystem->f_filesused = inf->filesystem->f_filesfree > 0 ? inf->filesystem->f_files - inf->filesystem->f_filesfree : inf->filesystem->f_files;
+                inf->filesystem->f_blocksused = inf->filesystem->f_blocks - inf->filesystem->f_blocksfreetotal;
+                inf->filesystem->inode_percent = inf->filesystem->f_files > 0 ? 100. * (double)inf->filesystem->f_filesused / (double)inf->filesystem->f_files : 0.;
+                inf->filesystem->space_percent = inf->filesystem->f_blocks > 0 ? 100. * (double)inf->filesystem->f_blocksused / (double)inf->filesystem->f_blocks : 0.;
         } else {
-                Statistics_reset(&(s->inf.filesystem->read.bytes));
-                Statistics_reset(&(s->inf.filesystem->read.operations));
-                Statistics_reset(&(s->inf.filesystem->write.bytes));
-                Statistics_reset(&(s->inf.filesystem->write.operations));
-                Statistics_reset(&(s->inf.filesystem->time.read));
-                Statistics_reset(&(s->inf.filesystem->time.write));
-                Statistics_reset(&(s->inf.filesystem->time.wait));
-                Statistics_reset(&(s->inf.filesystem->time.run));
-                Log_error("Filesystem '%s' not mounted\n", s->path);
+                Statistics_reset(&(inf->filesystem->read.bytes));
+                Statistics_reset(&(inf->filesystem->read.operations));
+                Statistics_reset(&(inf->filesystem->write.bytes));
+                Statistics_reset(&(inf->filesystem->write.operations));
+                Statistics_reset(&(inf->filesystem->time.read));
+                Statistics_reset(&(inf->filesystem->time.write));
+                Statistics_reset(&(inf->filesystem->time.wait));
+                Statistics_reset(&(inf->filesystem->time.run));
+                Statistics_reset(&(inf->filesystem->time.io));
+                Log_error("Filesystem '%s' not mounted\n", path);
         }
         return rv;
 }
 
+
+static void _jobFree(FilesystemJob_T *job) {
+        FREE((*job)->path);
+        FREE(*job);
+}
+
+
+static void *_jobThread(void *arg) {
+        set_signal_block();
+        FilesystemJob_T job = arg;
+        union Info_T inf = {.filesystem = &(job->inf)};
+        bool rv = _filesystemUsage(job->path, &inf);
+        LOCK(_mutex)
+        {
+                job->rv = rv;
+                job->done = true;
+                if (job->orphaned)
+                        _jobFree(&job);
+                else
+                        Sem_broadcast(_done);
+        }
+        END_LOCK;
+        return NULL;
+}
+
+
+// Start the collection job for the service, the caller holds the mutex. If the helper thread cannot be created, the statistics are collected synchronously
+static FilesystemJob_T _jobStart(Service_T s) {
+        FilesystemJob_T job;
+        NEW(job);
+        job->path = Str_dup(s->path);
+        job->inf = *(s->inf.filesystem);
+        job->inf.job = NULL;
+        job->started = (unsigned long long)Time_milli();
+        Thread_T thread;
+        int status = pthread_create(&thread, NULL, _jobThread, job);
+        if (status == 0) {
+                pthread_detach(thread);
+        } else {
+                Log_warning("Filesystem '%s' -- cannot create the statistics collector thread: %s\n", s->path, System_getError(status));
+                union Info_T inf = {.filesystem = &(job->inf)};
+                job->rv = _filesystemUsage(job->path, &inf);
+                job->done = true;
+        }
+        return job;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool filesystem_usage(Service_T s) {
+        ASSERT(s);
+        bool rv = false;
+        LOCK(_mutex)
+        {
+                FilesystemJob_T job = s->inf.filesystem->job;
+                for (bool fresh = false; ! fresh;) {
+                        if (! job) {
+                                job = _jobStart(s);
+                                fresh = true;
+                        }
+                        struct timespec deadline = {.tv_sec = (job->started + Run.limits.filesystemTimeout) / 1000, .tv_nsec = ((job->started + Run.limits.filesystemTimeout) % 1000) * 1000000};
+                        while (! job->done && (unsigned long long)Time_milli() < job->started + Run.limits.filesystemTimeout)
+                                Sem_timeWait(_done, _mutex, deadline);
+                        if (! job->done) {
+                                // The helper is hung, keep the job attached to the service and don't start another one until it returns
+                                s->inf.filesystem->job = job;
+                                break;
+                        }
+                        if (fresh) {
+                                // Take the statistics collected by the helper
+                                *(s->inf.filesystem) = job->inf;
+                                s->inf.filesystem->job = NULL;
+                                s->inf.filesystem->collected = job->started;
+                                rv = job->rv;
+                        } else {
+                                // The job which hung in some previous cycle finally returned, its data are stale => collect again
+                                DEBUG("Filesystem '%s' statistics collection returned after %llums, collecting again\n", s->path, (unsigned long long)Time_milli() - job->started);
+                                s->inf.filesystem->job = NULL;
+                        }
+                        _jobFree(&job);
+                }
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+bool filesystem_hung(Service_T s, unsigned long long *hung, unsigned long long *age) {
+        ASSERT(s);
+        ASSERT(hung);
+        ASSERT(age);
+        bool rv = false;
+        LOCK(_mutex)
+        {
+                FilesystemJob_T job = s->inf.filesystem->job;
+                if (job && ! job->done) {
+                        unsigned long long now = (unsigned long long)Time_milli();
+                        *hung = now - job->started;
+                        *age = s->inf.filesystem->collected ? now - s->inf.filesystem->collected : 0ULL;
+                        rv = true;
+                }
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+void filesystem_release(Service_T s) {
+        ASSERT(s);
+        LOCK(_mutex)
+        {
+                FilesystemJob_T job = s->inf.filesystem->job;
+                if (job) {
+                        if (job->done)
+                                _jobFree(&job);
+                        else
+                                job->orphaned = true; // The helper frees the job when it returns
+                        s->inf.filesystem->job = NULL;
+                }
+        }
+        END_LOCK;
+}
+
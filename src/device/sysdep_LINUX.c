@@ -74,12 +74,17 @@
 #include <sys/sysmacros.h>
 #endif
 
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
 #include "monit.h"
 #include "device.h"
 
 // libmonit
 #include "io/File.h"
 #include "system/Time.h"
+#include "thread/Thread.h"
 #include "exceptions/AssertException.h"
 
 
@@ -90,19 +95,267 @@
 #define CIFSSTAT "/proc/fs/cifs/Stats"
 #define DISKSTAT "/proc/diskstats"
 #define NFSSTAT  "/proc/self/mountstats"
+#define ZFSSTAT  "/proc/spl/kstat/zfs"
 
 
 static struct {
         int fd;                                    // /proc/self/mounts filedescriptor (needed for mount/unmount notification)
         int generation;                            // Increment each time the mount table is changed
-        bool (*getBlockDiskActivity)(void *); // Disk activity callback: _getProcfsBlockDiskActivity (old kernels), _getSysfsBlockDiskActivity (new kernels)
+        bool (*getBlockDiskActivity)(void *); // Disk activity callback: _getProcfsBlockDiskActivity (old kernels), _getDiskstatsBlockDiskActivity (new kernels)
         bool (*getCifsDiskActivity)(void *);  // Disk activity callback: _getCifsDiskActivity if /proc/fs/cifs/Stats is present, otherwise _getDummyDiskActivity
 } _statistics = {};
 
 
+/**
+ * Mount table entry. The /proc/self/mounts content is parsed once per mount table generation
+ */
+typedef struct MountEntry_T {
+        char *device;                              // Mounted device (mnt_fsname)
+        char *target;                              // The device resolved by realpath if it differs from the device, otherwise NULL
+        char *mountpoint;                          // Mount point (mnt_dir)
+        char *type;                                // Filesystem type (mnt_type)
+        char *options;                             // Mount options (mnt_opts)
+} MountEntry_T;
+
+
+/**
+ * Open addressing hash index of the mount table or the disk statistics by name. The slot holds the entry index + 1
+ * or 0 if empty. If several entries have the same key (overlay mounts), the slot has the last one, which is the top-most mount
+ */
+typedef struct NameIndex_T {
+        int bits;
+        int *slot;
+} NameIndex_T;
+
+
+static struct {
+        int generation;                            // Mount table generation of the parsed table or 0 if not loaded
+        int count;                                 // Number of entries
+        int size;                                  // Allocated entries
+        MountEntry_T *entries;                     // The entries in the /proc/self/mounts order
+        NameIndex_T mountpoint;                    // Index by mount point
+        NameIndex_T device;                        // Index by device and the resolved device path, built on the first device lookup
+        Mutex_T mutex;                             // Filesystem services can be checked by parallel workers
+} _mounts = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/**
+ * Block device statistics from one /proc/diskstats line (kernel >= 2.6.25 format)
+ */
+typedef struct DiskStatistics_T {
+        char name[64];                             // Device name, such as "sda1"
+        unsigned int major;
+        unsigned int minor;
+        unsigned long long readOperations;
+        unsigned long long readSectors;
+        unsigned long long readTime;               // [ms]
+        unsigned long long writeOperations;
+        unsigned long long writeSectors;
+        unsigned long long writeTime;              // [ms]
+        unsigned long long ioTime;                 // Time spent doing I/O [ms]
+} DiskStatistics_T;
+
+
+/**
+ * The /proc/diskstats snapshot, shared by all filesystem services. The snapshot is read once per validation
+ * cycle (the cycle is identified by the systeminfo.collected timestamp), using the kept-open descriptor
+ */
+static struct {
+        int fd;                                    // The /proc/diskstats descriptor or -1 if not open
+        struct timeval collected;                  // The systeminfo.collected value of the cycle which read the snapshot
+        unsigned long long time;                   // Snapshot timestamp [ms]
+        int count;                                 // Number of entries
+        int size;                                  // Allocated entries
+        DiskStatistics_T *entries;
+        NameIndex_T index;                         // Index by device name
+        struct {
+                int size;
+                char *data;
+        } buffer;                                  // Read buffer, grown as needed
+        Mutex_T mutex;
+} _diskstats = {.fd = -1, .mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/**
+ * ZFS I/O statistics of a pool (the <pool>/io kstat, if the module provides it) or a dataset (the <pool>/objset-0x<id>
+ * kstat, OpenZFS >= 0.8)
+ */
+typedef struct ZfsStatistics_T {
+        char name[256];                            // Pool or dataset name
+        bool hasTime;                              // The wait and run time are available (pool only)
+        unsigned long long readBytes;
+        unsigned long long readOperations;
+        unsigned long long writeBytes;
+        unsigned long long writeOperations;
+        unsigned long long waitTime;               // [ns]
+        unsigned long long runTime;                // [ns]
+} ZfsStatistics_T;
+
+
+/**
+ * The ZFS kstat snapshot of all pools and datasets, shared by all zfs filesystem services. Like the diskstats, the
+ * snapshot is read once per validation cycle, so the services on the same pool don't read the kstats each
+ */
+static struct {
+        struct timeval collected;                  // The systeminfo.collected value of the cycle which read the snapshot
+        unsigned long long time;                   // Snapshot timestamp [ms]
+        int count;                                 // Number of entries
+        int size;                                  // Allocated entries
+        ZfsStatistics_T *entries;
+        NameIndex_T pool;                          // Index of the pool entries by the pool name
+        NameIndex_T dataset;                       // Index of the dataset entries by the dataset name (the root dataset has the pool name)
+        Mutex_T mutex;
+} _zfs = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
 /* ----------------------------------------------------------------- Private */
 
 
+// FNV-1a string hash reduced to the index size
+static unsigned int _hash(const char *key, int bits) {
+        unsigned int h = 2166136261u;
+        for (const unsigned char *p = (const unsigned char *)key; *p; p++)
+                h = (h ^ *p) * 16777619u;
+        return (h * 2654435761u) >> (32 - bits);
+}
+
+
+static void _indexInit(NameIndex_T *index, int size) {
+        index->bits = 4;
+        while ((1 << index->bits) < 4 * size && index->bits < 30)
+                index->bits++;
+        index->slot = CALLOC(1 << index->bits, sizeof(int));
+}
+
+
+static void _indexFree(NameIndex_T *index) {
+        FREE(index->slot);
+        index->bits = 0;
+}
+
+
+// Add the entry under the key. The entries are added in the mount table order, so the later entry replaces the earlier one
+static void _indexAdd(NameIndex_T *index, const char *key, int i, const char *(*keyOf)(int slot, const char *key)) {
+        unsigned int mask = (1u << index->bits) - 1;
+        for (unsigned int h = _hash(key, index->bits); ; h = (h + 1) & mask) {
+                if (! index->slot[h] || keyOf(index->slot[h] - 1, key)) {
+                        index->slot[h] = i + 1;
+                        return;
+                }
+        }
+}
+
+
+// Return the index of the entry with the key or -1 if not found
+static int _indexFind(NameIndex_T *index, const char *key, const char *(*keyOf)(int slot, const char *key)) {
+        if (index->slot) {
+                unsigned int mask = (1u << index->bits) - 1;
+                for (unsigned int h = _hash(key, index->bits); index->slot[h]; h = (h + 1) & mask)
+                        if (keyOf(index->slot[h] - 1, key))
+                                return index->slot[h] - 1;
+        }
+        return -1;
+}
+
+
+// Return the entry device name if it matches the key, otherwise NULL
+static const char *_diskNameOf(int i, const char *key) {
+        return IS(_diskstats.entries[i].name, key) ? _diskstats.entries[i].name : NULL;
+}
+
+
+// Read the /proc/diskstats snapshot if the current validation cycle didn't read it yet
+static bool _updateDiskStatistics(void) {
+        if (_diskstats.time && _diskstats.collected.tv_sec == systeminfo.collected.tv_sec && _diskstats.collected.tv_usec == systeminfo.collected.tv_usec)
+                return true;
+        if (_diskstats.fd == -1 && (_diskstats.fd = open(DISKSTAT, O_RDONLY | O_CLOEXEC)) == -1) {
+                Log_error("filesystem statistic error: cannot open %s -- %s\n", DISKSTAT, STRERROR);
+                return false;
+        }
+        if (! _diskstats.buffer.size) {
+                _diskstats.buffer.size = 16384;
+                _diskstats.buffer.data = ALLOC(_diskstats.buffer.size);
+        }
+        ssize_t bytes;
+        while ((bytes = pread(_diskstats.fd, _diskstats.buffer.data, _diskstats.buffer.size - 1, 0)) >= _diskstats.buffer.size - 1) {
+                // The content didn't fit into the buffer, grow it and read again
+                _diskstats.buffer.size *= 2;
+                RESIZE(_diskstats.buffer.data, _diskstats.buffer.size);
+        }
+        if (bytes < 0) {
+                Log_error("filesystem statistic error: cannot read %s -- %s\n", DISKSTAT, STRERROR);
+                close(_diskstats.fd);
+                _diskstats.fd = -1;
+                return false;
+        }
+        _diskstats.buffer.data[bytes] = 0;
+        _diskstats.time = Time_milli();
+        _diskstats.collected = systeminfo.collected;
+        _diskstats.count = 0;
+        for (char *line = _diskstats.buffer.data; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+                if (_diskstats.count == _diskstats.size) {
+                        _diskstats.size = _diskstats.size ? _diskstats.size * 2 : 64;
+                        RESIZE(_diskstats.entries, _diskstats.size * sizeof(DiskStatistics_T));
+                }
+                DiskStatistics_T *d = &(_diskstats.entries[_diskstats.count]);
+                // The kernels >= 2.6.25 format with 11 statistics fields is supported only
+                if (sscanf(line, "%u %u %63s %llu %*u %llu %llu %llu %*u %llu %llu %*u %llu", &(d->major), &(d->minor), d->name, &(d->readOperations), &(d->readSectors), &(d->readTime), &(d->writeOperations), &(d->writeSectors), &(d->writeTime), &(d->ioTime)) == 10)
+                        _diskstats.count++;
+        }
+        _indexFree(&(_diskstats.index));
+        _indexInit(&(_diskstats.index), _diskstats.count);
+        for (int i = 0; i < _diskstats.count; i++)
+                _indexAdd(&(_diskstats.index), _diskstats.entries[i].name, i, _diskNameOf);
+        return true;
+}
+
+
+static void _setDiskActivity(Info_T inf, DiskStatistics_T *d, unsigned long long now) {
+        // The filesystem lookup tests the statistics availability before the regular update, don't apply the same snapshot twice, it would reset the delta
+        if (inf->filesystem->time.io.current.time == now)
+                return;
+        Statistics_update(&(inf->filesystem->time.read), now, d->readTime);
+        Statistics_update(&(inf->filesystem->read.bytes), now, d->readSectors * 512);
+        Statistics_update(&(inf->filesystem->read.operations), now, d->readOperations);
+        Statistics_update(&(inf->filesystem->time.write), now, d->writeTime);
+        Statistics_update(&(inf->filesystem->write.bytes), now, d->writeSectors * 512);
+        Statistics_update(&(inf->filesystem->write.operations), now, d->writeOperations);
+        Statistics_update(&(inf->filesystem->time.io), now, d->ioTime);
+}
+
+
+/**
+ * Lookup the block device statistics in the diskstats snapshot
+ * @param inf The filesystem info
+ * @param name The device name or NULL to lookup by the device number
+ * @param major The device major number
+ * @param minor The device minor number
+ * @return true if the statistics were found otherwise false
+ */
+static bool _getDiskStatistics(Info_T inf, const char *name, unsigned int major, unsigned int minor) {
+        bool found = false;
+        LOCK(_diskstats.mutex)
+        {
+                if (_updateDiskStatistics()) {
+                        int i = -1;
+                        if (name) {
+                                i = _indexFind(&(_diskstats.index), name, _diskNameOf);
+                        } else {
+                                for (int j = 0; j < _diskstats.count && i < 0; j++)
+                                        if (_diskstats.entries[j].major == major && _diskstats.entries[j].minor == minor)
+                                                i = j;
+                        }
+                        if (i >= 0) {
+                                _setDiskActivity(inf, &(_diskstats.entries[i]), _diskstats.time);
+                                found = true;
+                        }
+                }
+        }
+        END_LOCK;
+        return found;
+}
+
+
 static bool _getDiskUsage(void *_inf) {
         Info_T inf = _inf;
         struct statvfs usage;
@@ -204,132 +457,186 @@ static bool _getNfsDiskActivity(void *_inf) {
 }
 
 
-static bool _getZfsDiskActivity(void *_inf) {
-        Info_T inf = _inf;
-        char path[2 * PATH_MAX];
-        snprintf(path, sizeof(path), "/proc/spl/kstat/zfs/%s/io", inf->filesystem->object.key);
-        FILE *f = fopen(path, "r");
-        if (f) {
-                char line[STRLEN];
-                unsigned long long now = Time_milli();
-                unsigned long long waitTime = 0ULL, runTime = 0ULL;
-                unsigned long long readOperations = 0ULL, readBytes = 0ULL;
-                unsigned long long writeOperations = 0ULL, writeBytes = 0ULL;
-                while (fgets(line, sizeof(line), f)) {
-                        if (sscanf(line, "%llu %llu %llu %llu %llu %*u %*u %llu", &readBytes, &writeBytes, &readOperations, &writeOperations, &waitTime, &runTime) == 6) {
-                                Statistics_update(&(inf->filesystem->read.bytes), now, readBytes);
-                                Statistics_update(&(inf->filesystem->read.operations), now, readOperations);
-                                Statistics_update(&(inf->filesystem->write.bytes), now, writeBytes);
-                                Statistics_update(&(inf->filesystem->write.operations), now, writeOperations);
-                                Statistics_update(&(inf->filesystem->time.wait), now, (double)waitTime / 1000000.); // ns -> ms
-                                Statistics_update(&(inf->filesystem->time.run), now, (double)runTime / 1000000.); // ns -> ms
-                                break;
-                        }
-                }
-                fclose(f);
-                return true;
-        }
-        Log_error("filesystem statistic error: cannot read %s -- %s\n", path, STRERROR);
-        return false;
+// Return the entry name if it matches the key, otherwise NULL
+static const char *_zfsNameOf(int i, const char *key) {
+        return IS(_zfs.entries[i].name, key) ? _zfs.entries[i].name : NULL;
 }
 
 
-static bool _getVxfsDiskActivity(void *_inf) {
-        Info_T inf = _inf;
+// Read the kstat file relative to the directory descriptor
+static bool _readKstat(int dir, const char *name, char *buf, size_t size) {
+        int fd = openat(dir, name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return false;
+        ssize_t bytes = read(fd, buf, size - 1);
+        close(fd);
+        if (bytes < 0)
+                return false;
+        buf[bytes] = 0;
+        return true;
+}
 
-        // Get the major and minor node number to find the statistic data.
-        struct stat statbuf;
-        unsigned int st_major, st_minor;
-        unsigned int major = 0, minor = 0;
 
-        if (stat(inf->filesystem->object.device, &statbuf) < 0) {
-                return false;
+static ZfsStatistics_T *_zfsAdd(void) {
+        if (_zfs.count == _zfs.size) {
+                _zfs.size = _zfs.size ? _zfs.size * 2 : 64;
+                RESIZE(_zfs.entries, _zfs.size * sizeof(ZfsStatistics_T));
         }
-        st_major = major(statbuf.st_rdev);
-        st_minor = minor(statbuf.st_rdev);
+        ZfsStatistics_T *z = &(_zfs.entries[_zfs.count]);
+        memset(z, 0, sizeof(ZfsStatistics_T));
+        return z;
+}
 
-        // Try to find the statistic data in the sysfs first.
-        char path[PATH_MAX];
-        snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/stat", st_major, st_minor);
-        FILE *f = fopen(path, "r");
-        if (f) {
-                unsigned long long now = Time_milli();
-                unsigned long long readOperations = 0ULL, readSectors = 0ULL, readTime = 0ULL;
-                unsigned long long writeOperations = 0ULL, writeSectors = 0ULL, writeTime = 0ULL;
-                if (fscanf(f, "%llu %*u %llu %llu %llu %*u %llu %llu %*u %*u %*u", &readOperations, &readSectors, &readTime, &writeOperations, &writeSectors, &writeTime) != 6) {
-                        Log_error("filesystem statistic error: cannot parse %s -- %s\n", path, STRERROR);
-                        fclose(f);
-                        return false;
+
+/**
+ * Parse the named objset kstat, which has one "<name> <type> <value>" line per statistic after the kstat header:
+ * dataset_name, writes, nwritten, reads, nread, ...
+ */
+static bool _parseZfsObjset(char *buf, ZfsStatistics_T *z) {
+        int found = 0;
+        for (char *line = buf; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+                char name[64];
+                int value;
+                if (sscanf(line, "%63s %*u %n", name, &value) != 1)
+                        continue;
+                if (IS(name, "dataset_name")) {
+                        // The dataset name may contain spaces, it's the rest of the line
+                        size_t length = strcspn(line + value, "\n");
+                        snprintf(z->name, sizeof(z->name), "%.*s", (int)length, line + value);
+                        found++;
+                } else if (IS(name, "writes")) {
+                        found += sscanf(line + value, "%llu", &(z->writeOperations));
+                } else if (IS(name, "nwritten")) {
+                        found += sscanf(line + value, "%llu", &(z->writeBytes));
+                } else if (IS(name, "reads")) {
+                        found += sscanf(line + value, "%llu", &(z->readOperations));
+                } else if (IS(name, "nread")) {
+                        found += sscanf(line + value, "%llu", &(z->readBytes));
                 }
-                Statistics_update(&(inf->filesystem->time.read), now, readTime);
-                Statistics_update(&(inf->filesystem->read.bytes), now, readSectors * 512);
-                Statistics_update(&(inf->filesystem->read.operations), now, readOperations);
-                Statistics_update(&(inf->filesystem->time.write), now, writeTime);
-                Statistics_update(&(inf->filesystem->write.bytes), now, writeSectors * 512);
-                Statistics_update(&(inf->filesystem->write.operations), now, writeOperations);
-                fclose(f);
+        }
+        return found == 5;
+}
+
+
+// Read the statistics of the pool and its datasets
+static void _updateZfsPool(int root, const char *pool) {
+        int dir = openat(root, pool, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir < 0)
+                return;
+        char buf[4096];
+        // The pool I/O kstat (removed in OpenZFS 2.2, the datasets have the I/O statistics then)
+        if (_readKstat(dir, "io", buf, sizeof(buf))) {
+                ZfsStatistics_T *z = _zfsAdd();
+                for (char *line = buf; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+                        if (sscanf(line, "%llu %llu %llu %llu %llu %*u %*u %llu", &(z->readBytes), &(z->writeBytes), &(z->readOperations), &(z->writeOperations), &(z->waitTime), &(z->runTime)) == 6) {
+                                snprintf(z->name, sizeof(z->name), "%s", pool);
+                                z->hasTime = true;
+                                _zfs.count++;
+                                break;
+                        }
+                }
+        }
+        int fd = dup(dir);
+        DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+        if (d) {
+                struct dirent *de;
+                while ((de = readdir(d))) {
+                        if (Str_startsWith(de->d_name, "objset-") && _readKstat(dir, de->d_name, buf, sizeof(buf))) {
+                                ZfsStatistics_T *z = _zfsAdd();
+                                if (_parseZfsObjset(buf, z))
+                                        _zfs.count++;
+                        }
+                }
+                closedir(d);
+        } else if (fd >= 0) {
+                close(fd);
+        }
+        close(dir);
+}
+
+
+// Read the ZFS kstat snapshot of all pools if the current validation cycle didn't read it yet
+static bool _updateZfsStatistics(void) {
+        if (_zfs.time && _zfs.collected.tv_sec == systeminfo.collected.tv_sec && _zfs.collected.tv_usec == systeminfo.collected.tv_usec)
                 return true;
+        DIR *d = opendir(ZFSSTAT);
+        if (! d) {
+                Log_error("filesystem statistic error: cannot read %s -- %s\n", ZFSSTAT, STRERROR);
+                return false;
+        }
+        _zfs.count = 0;
+        struct dirent *de;
+        while ((de = readdir(d))) {
+                // The pools are the subdirectories, the module wide kstats (arcstats, ...) are files
+                if (*de->d_name != '.' && (de->d_type == DT_DIR || de->d_type == DT_UNKNOWN))
+                        _updateZfsPool(dirfd(d), de->d_name);
         }
-        DEBUG("filesystem statistic error: cannot read %s -- %s\n", path, STRERROR);
+        closedir(d);
+        _zfs.time = Time_milli();
+        _zfs.collected = systeminfo.collected;
+        _indexFree(&(_zfs.pool));
+        _indexFree(&(_zfs.dataset));
+        _indexInit(&(_zfs.pool), _zfs.count);
+        _indexInit(&(_zfs.dataset), _zfs.count);
+        for (int i = 0; i < _zfs.count; i++)
+                _indexAdd(_zfs.entries[i].hasTime ? &(_zfs.pool) : &(_zfs.dataset), _zfs.entries[i].name, i, _zfsNameOf);
+        return true;
+}
 
-        // Use the procfs file for backup purpose only.
-        // It should not used as main data collector, it support kernels >= 2.6.25 format only, too.
-        f = fopen(DISKSTAT, "r");
-        if (f) {
-                unsigned long long now = Time_milli();
-                unsigned long long readOperations = 0ULL, readSectors = 0ULL, readTime = 0ULL;
-                unsigned long long writeOperations = 0ULL, writeSectors = 0ULL, writeTime = 0ULL;
-                char line[PATH_MAX];
-                while (fgets(line, sizeof(line), f)) {
-                        char name[256] = {};
 
-                        // Traverse the /proc/diskstats to have the statistics.
-                        // The kernels >= 2.6.25 format with 11 fields is supported only.
-                        if (fscanf(f, "%u %u %255s %llu %*u %llu %llu %llu %*u %llu %llu %*u %*u %*u", &major, &minor, name, &readOperations, &readSectors, &readTime, &writeOperations, &writeSectors, &writeTime) == 9 && major == st_major && minor == st_minor) {
-                                Statistics_update(&(inf->filesystem->time.read), now, readTime);
-                                Statistics_update(&(inf->filesystem->read.bytes), now, readSectors * 512);
-                                Statistics_update(&(inf->filesystem->read.operations), now, readOperations);
-                                Statistics_update(&(inf->filesystem->time.write), now, writeTime);
-                                Statistics_update(&(inf->filesystem->write.bytes), now, writeSectors * 512);
-                                Statistics_update(&(inf->filesystem->write.operations), now, writeOperations);
-                                fclose(f);
-                                return true;
+/**
+ * The ZFS filesystem uses the I/O statistics of its dataset if available (OpenZFS >= 0.8), otherwise of its pool. The
+ * wait and run time are available per pool only
+ */
+static bool _getZfsDiskActivity(void *_inf) {
+        Info_T inf = _inf;
+        bool found = false;
+        LOCK(_zfs.mutex)
+        {
+                if (_updateZfsStatistics()) {
+                        int pool = _indexFind(&(_zfs.pool), inf->filesystem->object.key, _zfsNameOf);
+                        int dataset = _indexFind(&(_zfs.dataset), inf->filesystem->object.device, _zfsNameOf);
+                        ZfsStatistics_T *z = dataset >= 0 ? &(_zfs.entries[dataset]) : pool >= 0 ? &(_zfs.entries[pool]) : NULL;
+                        if (z) {
+                                unsigned long long now = _zfs.time;
+                                Statistics_update(&(inf->filesystem->read.bytes), now, z->readBytes);
+                                Statistics_update(&(inf->filesystem->read.operations), now, z->readOperations);
+                                Statistics_update(&(inf->filesystem->write.bytes), now, z->writeBytes);
+                                Statistics_update(&(inf->filesystem->write.operations), now, z->writeOperations);
+                                if (pool >= 0) {
+                                        Statistics_update(&(inf->filesystem->time.wait), now, (double)_zfs.entries[pool].waitTime / 1000000.); // ns -> ms
+                                        Statistics_update(&(inf->filesystem->time.run), now, (double)_zfs.entries[pool].runTime / 1000000.); // ns -> ms
+                                }
+                                found = true;
                         }
                 }
-                fclose(f);
-                DEBUG("filesystem statistic error: cannot find device number %u %u for %s\n", st_major, st_minor, inf->filesystem->object.device);
-        } else {
-                DEBUG("filesystem statistic error: cannot read %s -- %s\n", DISKSTAT, STRERROR);
         }
+        END_LOCK;
+        if (! found)
+                Log_error("filesystem statistic error: cannot find the I/O statistics of the ZFS dataset %s in %s\n", inf->filesystem->object.device, ZFSSTAT);
+        return found;
+}
+
+
+static bool _getVxfsDiskActivity(void *_inf) {
+        Info_T inf = _inf;
+        // Get the major and minor node number to find the statistic data.
+        struct stat statbuf;
+        if (stat(inf->filesystem->object.device, &statbuf) < 0) {
+                return false;
+        }
+        if (! _getDiskStatistics(inf, NULL, major(statbuf.st_rdev), minor(statbuf.st_rdev)))
+                DEBUG("filesystem statistic error: cannot find device number %u %u for %s\n", major(statbuf.st_rdev), minor(statbuf.st_rdev), inf->filesystem->object.device);
         // Always true to get the disk usage, at least.
         return true;
 }
 
 
-static bool _getSysfsBlockDiskActivity(void *_inf) {
+static bool _getDiskstatsBlockDiskActivity(void *_inf) {
         Info_T inf = _inf;
-        char path[2 * PATH_MAX];
-        snprintf(path, sizeof(path), "/sys/class/block/%s/stat", inf->filesystem->object.key);
-        FILE *f = fopen(path, "r");
-        if (f) {
-                unsigned long long now = Time_milli();
-                unsigned long long readOperations = 0ULL, readSectors = 0ULL, readTime = 0ULL;
-                unsigned long long writeOperations = 0ULL, writeSectors = 0ULL, writeTime = 0ULL;
-                if (fscanf(f, "%llu %*u %llu %llu %llu %*u %llu %llu %*u %*u %*u", &readOperations, &readSectors, &readTime, &writeOperations, &writeSectors, &writeTime) != 6) {
-                        fclose(f);
-                        Log_error("filesystem statistic error: cannot parse %s -- %s\n", path, STRERROR);
-                        return false;
-                }
-                Statistics_update(&(inf->filesystem->time.read), now, readTime);
-                Statistics_update(&(inf->filesystem->read.bytes), now, readSectors * 512);
-                Statistics_update(&(inf->filesystem->read.operations), now, readOperations);
-                Statistics_update(&(inf->filesystem->time.write), now, writeTime);
-                Statistics_update(&(inf->filesystem->write.bytes), now, writeSectors * 512);
-                Statistics_update(&(inf->filesystem->write.operations), now, writeOperations);
-                fclose(f);
+        if (_getDiskStatistics(inf, inf->filesystem->object.key, 0, 0))
                 return true;
-        }
-        Log_error("filesystem statistic error: cannot read %s -- %s\n", path, STRERROR);
+        DEBUG("filesystem statistic error: cannot find %s in %s\n", inf->filesystem->object.key, DISKSTAT);
         return false;
 }
 
@@ -344,9 +651,8 @@ static bool _getProcfsBlockDiskActivity(void *_inf) {
                 char line[PATH_MAX];
                 while (fgets(line, sizeof(line), f)) {
                         char name[256] = {};
-                        // Fallback for kernels < 2.6.25: the /proc/diskstats used to have just 4 statistics, the file is present on >= 2.6.25 too and has 11 fields (same format as /sys/class/block/<NAME>/stat), but we use sysfs for it
-                        // as we read the given partition directly instead of traversing the whole filesystems list. In this function we expect the old 4-statistics format - if it should be ever used as main data collector, it needs to
-                        // be modified to support >= 2.6.25 format too.
+                        // Fallback for kernels < 2.6.25: the /proc/diskstats used to have just 4 statistics for partitions. The >= 2.6.25 format with 11 fields is read
+                        // once per cycle into the shared snapshot by _getDiskstatsBlockDiskActivity. In this function we expect the old 4-statistics format.
                         if (fscanf(f, " %*d %*d %255s %llu %llu %llu %llu", name, &readOperations, &readSectors, &writeOperations, &writeSectors) == 5 && Str_isEqual(name, inf->filesystem->object.key)) {
                                 Statistics_update(&(inf->filesystem->read.bytes), now, readSectors * 512);
                                 Statistics_update(&(inf->filesystem->read.operations), now, readOperations);
@@ -363,110 +669,183 @@ static bool _getProcfsBlockDiskActivity(void *_inf) {
 }
 
 
-static bool _compareMountpoint(const char *mountpoint, struct mntent *mnt) {
-        return IS(mountpoint, mnt->mnt_dir);
+// Return the entry mount point if it matches the key, otherwise NULL
+static const char *_mountpointOf(int i, const char *key) {
+        return IS(_mounts.entries[i].mountpoint, key) ? _mounts.entries[i].mountpoint : NULL;
+}
+
+
+// Return the entry device or the resolved device path if it matches the key, otherwise NULL
+static const char *_deviceOf(int i, const char *key) {
+        MountEntry_T *e = &(_mounts.entries[i]);
+        if (IS(e->device, key))
+                return e->device;
+        if (e->target && IS(e->target, key))
+                return e->target;
+        return NULL;
 }
 
 
-static bool _compareDevice(const char *device, struct mntent *mnt) {
-        char target[PATH_MAX] = {};
-        // The device listed in /etc/mtab can be a device mapper symlink (e.g. /dev/mapper/centos-root -> /dev/dm-1) ... lookup the device as is first (support for NFS/CIFS/SSHFS/etc.) and fallback to realpath if it didn't match
-        return (Str_isEqual(device, mnt->mnt_fsname) || (realpath(mnt->mnt_fsname, target) && Str_isEqual(device, target)));
+static void _unloadMounts(void) {
+        for (int i = 0; i < _mounts.count; i++) {
+                FREE(_mounts.entries[i].device);
+                FREE(_mounts.entries[i].target);
+                FREE(_mounts.entries[i].mountpoint);
+                FREE(_mounts.entries[i].type);
+                FREE(_mounts.entries[i].options);
+        }
+        _mounts.count = 0;
+        _mounts.generation = 0;
+        _indexFree(&(_mounts.mountpoint));
+        _indexFree(&(_mounts.device));
 }
 
 
-static bool _setDevice(Info_T inf, const char *path, bool (*compare)(const char *path, struct mntent *mnt)) {
+// Parse the mount table and index it by mount point
+static bool _loadMounts(void) {
+        _unloadMounts();
         FILE *f = setmntent(MOUNTS, "r");
         if (! f) {
                 Log_error("Cannot open %s\n", MOUNTS);
                 return false;
         }
-        inf->filesystem->object.generation = _statistics.generation;
-        bool mounted = false;
         struct mntent *mnt;
-        char flags[STRLEN];
         while ((mnt = getmntent(f))) {
-                // Scan all entries for overlay mounts (common for rootfs)
-                if (compare(path, mnt)) {
-                        snprintf(inf->filesystem->object.device, sizeof(inf->filesystem->object.device), "%s", mnt->mnt_fsname);
-                        snprintf(inf->filesystem->object.mountpoint, sizeof(inf->filesystem->object.mountpoint), "%s", mnt->mnt_dir);
-                        snprintf(inf->filesystem->object.type, sizeof(inf->filesystem->object.type), "%s", mnt->mnt_type);
-                        snprintf(flags, sizeof(flags), "%s", mnt->mnt_opts);
-                        inf->filesystem->object.getDiskUsage = _getDiskUsage; // The disk usage method is common for all filesystem types
-                        inf->filesystem->object.getDiskActivity = _getDummyDiskActivity; // Set to dummy IO statistics method by default (can be overridden bellow if statistics method is available for this filesystem)
-                        if (Str_startsWith(mnt->mnt_type, "nfs")) {
-                                // NFS
-                                inf->filesystem->object.getDiskActivity = _getNfsDiskActivity;
-                        } else if (IS(mnt->mnt_type, "cifs")) {
-                                // CIFS
-                                inf->filesystem->object.getDiskActivity = _statistics.getCifsDiskActivity;
-                                // Need Windows style name - replace '/' with '\' so we can lookup the filesystem activity in /proc/fs/cifs/Stats
-                                snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", inf->filesystem->object.device);
-                                Str_replaceChar(inf->filesystem->object.key, '/', '\\');
-                        } else if (IS(mnt->mnt_type, "zfs")) {
-                                // ZFS
-                                inf->filesystem->object.getDiskActivity = _getZfsDiskActivity;
-                                // Need base zpool name for /proc/spl/kstat/zfs/<NAME>/io lookup:
-                                snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", inf->filesystem->object.device);
-                                Str_replaceChar(inf->filesystem->object.key, '/', 0);
-                        } else if (IS(mnt->mnt_type, "vxfs")) {
-                                // VXFS, Veritas FS
-                                inf->filesystem->object.getDiskActivity = _getVxfsDiskActivity;
-                                // Use device major and minor number lookup in sysfs or procfs.
-                                snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", inf->filesystem->object.device);
-                        } else {
-                                if (realpath(mnt->mnt_fsname, inf->filesystem->object.key)) {
-                                        // Need base name for /sys/class/block/<NAME>/stat or /proc/diskstats lookup:
-                                        snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", File_basename(inf->filesystem->object.key));
-                                        // Test if block device statistics are available for the given filesystem
-                                        if (_statistics.getBlockDiskActivity(inf)) {
-                                                // Block device
-                                                inf->filesystem->object.getDiskActivity = _statistics.getBlockDiskActivity;
-                                        }
-                                }
-                        }
-                        mounted = true;
+                if (_mounts.count == _mounts.size) {
+                        _mounts.size = _mounts.size ? _mounts.size * 2 : 64;
+                        RESIZE(_mounts.entries, _mounts.size * sizeof(MountEntry_T));
                 }
+                MountEntry_T *e = &(_mounts.entries[_mounts.count++]);
+                e->device = Str_dup(mnt->mnt_fsname);
+                e->target = NULL;
+                e->mountpoint = Str_dup(mnt->mnt_dir);
+                e->type = Str_dup(mnt->mnt_type);
+                e->options = Str_dup(mnt->mnt_opts);
         }
         endmntent(f);
-        inf->filesystem->object.mounted = mounted;
-        if (! mounted) {
+        _indexInit(&(_mounts.mountpoint), _mounts.count);
+        for (int i = 0; i < _mounts.count; i++)
+                _indexAdd(&(_mounts.mountpoint), _mounts.entries[i].mountpoint, i, _mountpointOf);
+        _mounts.generation = _statistics.generation;
+        DEBUG("Mount table loaded (%d entries)\n", _mounts.count);
+        return true;
+}
+
+
+static MountEntry_T *_findMountpoint(const char *mountpoint) {
+        int i = _indexFind(&(_mounts.mountpoint), mountpoint, _mountpointOf);
+        return i >= 0 ? &(_mounts.entries[i]) : NULL;
+}
+
+
+static MountEntry_T *_findDevice(const char *device) {
+        if (! _mounts.device.slot) {
+                // The device listed in /etc/mtab can be a device mapper symlink (e.g. /dev/mapper/centos-root -> /dev/dm-1) ... index the device as is (support
+                // for NFS/CIFS/SSHFS/etc.) and the realpath if it differs. The paths are resolved for the first device lookup only, most services use the mount point
+                char target[PATH_MAX];
+                _indexInit(&(_mounts.device), 2 * _mounts.count);
+                for (int i = 0; i < _mounts.count; i++) {
+                        MountEntry_T *e = &(_mounts.entries[i]);
+                        if (*e->device == '/' && realpath(e->device, target) && ! IS(target, e->device))
+                                e->target = Str_dup(target);
+                        _indexAdd(&(_mounts.device), e->device, i, _deviceOf);
+                        if (e->target)
+                                _indexAdd(&(_mounts.device), e->target, i, _deviceOf);
+                }
+        }
+        int i = _indexFind(&(_mounts.device), device, _deviceOf);
+        return i >= 0 ? &(_mounts.entries[i]) : NULL;
+}
+
+
+static bool _setDevice(Info_T inf, const char *path, MountEntry_T *(*find)(const char *path)) {
+        if (_mounts.generation != _statistics.generation || _statistics.fd == -1) {
+                // Without the mount table notification (not in daemon mode) the table is loaded for each lookup
+                if (! _loadMounts())
+                        return false;
+        }
+        inf->filesystem->object.generation = _statistics.generation;
+        // The index has the last matching entry for overlay mounts (common for rootfs)
+        MountEntry_T *mnt = find(path);
+        if (! mnt) {
+                inf->filesystem->object.mounted = false;
                 Log_error("Lookup for '%s' filesystem failed  -- not found in %s\n", path, MOUNTS);
+                return false;
+        }
+        snprintf(inf->filesystem->object.device, sizeof(inf->filesystem->object.device), "%s", mnt->device);
+        snprintf(inf->filesystem->object.mountpoint, sizeof(inf->filesystem->object.mountpoint), "%s", mnt->mountpoint);
+        snprintf(inf->filesystem->object.type, sizeof(inf->filesystem->object.type), "%s", mnt->type);
+        inf->filesystem->object.getDiskUsage = _getDiskUsage; // The disk usage method is common for all filesystem types
+        inf->filesystem->object.getDiskActivity = _getDummyDiskActivity; // Set to dummy IO statistics method by default (can be overridden bellow if statistics method is available for this filesystem)
+        if (Str_startsWith(mnt->type, "nfs")) {
+                // NFS
+                inf->filesystem->object.getDiskActivity = _getNfsDiskActivity;
+        } else if (IS(mnt->type, "cifs")) {
+                // CIFS
+                inf->filesystem->object.getDiskActivity = _statistics.getCifsDiskActivity;
+                // Need Windows style name - replace '/' with '\' so we can lookup the filesystem activity in /proc/fs/cifs/Stats
+                snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", inf->filesystem->object.device);
+                Str_replaceChar(inf->filesystem->object.key, '/', '\\');
+        } else if (IS(mnt->type, "zfs")) {
+                // ZFS
+                inf->filesystem->object.getDiskActivity = _getZfsDiskActivity;
+                // Need base zpool name for /proc/spl/kstat/zfs/<NAME>/io lookup, the dataset statistics are looked up by the device (dataset name)
+                snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", inf->filesystem->object.device);
+                Str_replaceChar(inf->filesystem->object.key, '/', 0);
+        } else if (IS(mnt->type, "vxfs")) {
+                // VXFS, Veritas FS
+                inf->filesystem->object.getDiskActivity = _getVxfsDiskActivity;
+                // Use device major and minor number lookup in sysfs or procfs.
+                snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", inf->filesystem->object.device);
         } else {
-                // Evaluate filesystem flags for the last matching mount (overlay mounts for the same filesystem may have different mount flags)
-                if (! IS(flags, inf->filesystem->flags)) {
-                        if (*(inf->filesystem->flags)) {
-                                inf->filesystem->flagsChanged = true;
+                if (realpath(mnt->device, inf->filesystem->object.key)) {
+                        // Need base name for /sys/class/block/<NAME>/stat or /proc/diskstats lookup:
+                        snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", File_basename(inf->filesystem->object.key));
+                        // Test if block device statistics are available for the given filesystem
+                        if (_statistics.getBlockDiskActivity(inf)) {
+                                // Block device
+                                inf->filesystem->object.getDiskActivity = _statistics.getBlockDiskActivity;
                         }
-                        snprintf(inf->filesystem->flags, sizeof(inf->filesystem->flags), "%s", flags);
                 }
         }
-        return mounted;
+        inf->filesystem->object.mounted = true;
+        // Evaluate filesystem flags for the last matching mount (overlay mounts for the same filesystem may have different mount flags)
+        if (! IS(mnt->options, inf->filesystem->flags)) {
+                if (*(inf->filesystem->flags)) {
+                        inf->filesystem->flagsChanged = true;
+                }
+                snprintf(inf->filesystem->flags, sizeof(inf->filesystem->flags), "%s", mnt->options);
+        }
+        return true;
 }
 
 
-static bool _getDevice(Info_T inf, const char *path, bool (*compare)(const char *path, struct mntent *mnt)) {
+static bool _getDevice(Info_T inf, const char *path, MountEntry_T *(*find)(const char *path)) {
         // Mount/unmount notification: open the /proc/self/mounts file if we're in daemon mode and keep it open until monit
         // stops, so we can poll for mount table changes
         // FIXME: when libev is added register the mount table handler in libev and stop polling here
-        if (_statistics.fd == -1 && (Run.flags & Run_Daemon) && ! (Run.flags & Run_Once)) {
-                _statistics.fd = open(MOUNTS, O_RDONLY);
-        }
-        if (_statistics.fd != -1) {
-                struct pollfd mountNotify = {.fd = _statistics.fd, .events = POLLPRI, .revents = 0};
-                if (poll(&mountNotify, 1, 0) != -1) {
-                        if (mountNotify.revents & POLLERR) {
-                                DEBUG("Mount table change detected\n");
-                                _statistics.generation++;
+        LOCK(_mounts.mutex)
+        {
+                if (_statistics.fd == -1 && (Run.flags & Run_Daemon) && ! (Run.flags & Run_Once)) {
+                        _statistics.fd = open(MOUNTS, O_RDONLY | O_CLOEXEC);
+                }
+                if (_statistics.fd != -1) {
+                        struct pollfd mountNotify = {.fd = _statistics.fd, .events = POLLPRI, .revents = 0};
+                        if (poll(&mountNotify, 1, 0) != -1) {
+                                if (mountNotify.revents & POLLERR) {
+                                        DEBUG("Mount table change detected\n");
+                                        _statistics.generation++;
+                                }
+                        } else {
+                                Log_error("Mount table polling failed -- %s\n", STRERROR);
                         }
-                } else {
-                        Log_error("Mount table polling failed -- %s\n", STRERROR);
+                }
+                if (inf->filesystem->object.generation != _statistics.generation || _statistics.fd == -1) {
+                        DEBUG("Reloading mount information for filesystem '%s'\n", path);
+                        _setDevice(inf, path, find);
                 }
         }
-        if (inf->filesystem->object.generation != _statistics.generation || _statistics.fd == -1) {
-                DEBUG("Reloading mount information for filesystem '%s'\n", path);
-                _setDevice(inf, path, compare);
-        }
+        END_LOCK;
         if (inf->filesystem->object.mounted) {
                 return (inf->filesystem->object.getDiskUsage(inf) && inf->filesystem->object.getDiskActivity(inf));
         }
@@ -481,7 +860,7 @@ static void __attribute__ ((constructor)) _constructor(void) {
         struct stat sb;
         _statistics.fd = -1;
         _statistics.generation++; // First generation
-        _statistics.getBlockDiskActivity = stat("/sys/class/block", &sb) == 0 ? _getSysfsBlockDiskActivity : _getProcfsBlockDiskActivity;
+        _statistics.getBlockDiskActivity = stat("/sys/class/block", &sb) == 0 ? _getDiskstatsBlockDiskActivity : _getProcfsBlockDiskActivity;
         _statistics.getCifsDiskActivity = stat(CIFSSTAT, &sb) == 0 ? _getCifsDiskActivity : _getDummyDiskActivity;
 }
 
@@ -490,6 +869,14 @@ static void __attribute__ ((destructor)) _destructor(void) {
         if (_statistics.fd > -1) {
                   close(_statistics.fd);
         }
+        _unloadMounts();
+        FREE(_mounts.entries);
+        if (_diskstats.fd > -1) {
+                close(_diskstats.fd);
+        }
+        _indexFree(&(_diskstats.index));
+        FREE(_diskstats.entries);
+        FREE(_diskstats.buffer.data);
 }
 
 
@@ -499,13 +886,13 @@ static void __attribute__ ((destructor)) _destructor(void) {
 bool Filesystem_getByMountpoint(Info_T inf, const char *path) {
         ASSERT(inf);
         ASSERT(path);
-        return _getDevice(inf, path, _compareMountpoint);
+        return _getDevice(inf, path, _findMountpoint);
 }
 
 
 bool Filesystem_getByDevice(Info_T inf, const char *path) {
         ASSERT(inf);
         ASSERT(path);
-        return _getDevice(inf, path, _compareDevice);
+        return _getDevice(inf, path, _findDevice);
 }
 
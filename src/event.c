@@ -63,6 +63,10 @@
 #include "state.h"
 #include "ProcessTree.h"
 #include "MMonit.h"
+#include "Webhook.h"
+#include "EventQueue.h"
+#include "eventstream.h"
+#include "probe.h"
 
 // libmonit
 #include "io/File.h"
@@ -114,20 +118,36 @@ EventTable_T Event_Table[] = {
 };
 
 
+/* Event handling is serialized as the services may be validated in parallel. The mutex is recursive, as
+ * the event action may i.e. restart a service, whose check can post other events from the same thread */
+static Mutex_T _mutex;
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+
+
+/* The events which update the state file, by the posted state. The success (zero) state never does, so the
+ * success posted by every passing rule costs no table lookup */
+static long _saveStateEvents[State_Init + 1];
+
+
 /* ----------------------------------------------------------------- Private */
 
 
-static void _saveState(long id, State_Type state) {
-        EventTable_T *et = Event_Table;
-        while ((*et).id) {
-                if ((*et).id == id) {
-                        if ((*et).saveState & state) {
-                                State_dirty();
-                        }
-                        break;
-                }
-                et++;
-        }
+static void _init(void) {
+        for (EventTable_T *et = Event_Table; (*et).id; et++)
+                for (int state = 0; state <= State_Init; state++)
+                        if ((*et).saveState & state)
+                                _saveStateEvents[state] |= (*et).id;
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&_mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+}
+
+
+static void _saveState(Service_T S, long id, State_Type state) {
+        if (_saveStateEvents[state] & id)
+                State_dirty(S);
 }
 
 
@@ -139,7 +159,6 @@ static void _saveState(long id, State_Type state) {
  */
 static bool _checkState(Event_T E, State_Type S) {
         ASSERT(E);
-        int count = 0;
         State_Type state = (S == State_Succeeded || S == State_ChangedNot) ? State_Succeeded : State_Failed; /* translate to 0/1 class */
 
         /* Only failed/changed state condition can change the initial state */
@@ -148,15 +167,9 @@ static bool _checkState(Event_T E, State_Type S) {
 
         Action_T action = ! state ? E->action->succeeded : E->action->failed;
 
-        /* Compare as many bits as cycles able to trigger the action */
-        for (int i = 0; i < action->cycles; i++) {
-                /* Check the state of the particular cycle given by the bit position */
-                long long flag = (E->state_map >> i) & 0x1;
-
-                /* Count occurrences of the posted state */
-                if (flag == state)
-                        count++;
-        }
+        /* Count occurrences of the posted state within the cycles window given by the action's precomputed mask */
+        int failures = __builtin_popcountll((unsigned long long)E->state_map & action->mask);
+        int count = state ? failures : action->cycles - failures;
 
         /* the internal instance and action events are handled as changed any time since we need to deliver alert whenever it occurs */
         if (E->id == Event_Instance || E->id == Event_Action || (count >= action->count && (S != E->state || S == State_Changed))) {
@@ -171,125 +184,108 @@ static bool _checkState(Event_T E, State_Type S) {
 /**
  * Add the partially handled event to the global queue
  * @param E An event object
+ * @param webhooks The webhooks which didn't take the event
  */
-static void _queueAdd(Event_T E) {
+static void _queueAdd(Event_T E, unsigned webhooks) {
         ASSERT(E);
         ASSERT(E->flag != Handler_Succeeded);
 
-        if (! file_checkQueueDirectory(Run.eventlist_dir)) {
-                Log_error("Aborting event - cannot access the event queue directory %s\n", Run.eventlist_dir);
-                return;
-        }
-
-        if (! file_checkQueueLimit(Run.eventlist_dir, Run.eventlist_slots)) {
-                Log_error("Aborting event - queue over quota\n");
-                return;
-        }
-
-        /* compose the file name of actual timestamp and service name */
-        char file_name[PATH_MAX];
-        snprintf(file_name, PATH_MAX, "%s/%lld_%lx", Run.eventlist_dir, (long long)Time_now(), (long unsigned)E->source->name);
-
-        Log_info("Adding event to the queue file %s for later delivery\n", file_name);
-
-        FILE *file = fopen(file_name, "w");
-        if (! file) {
-                Log_error("Aborting event - cannot create event file %s -- %s\n", file_name, STRERROR);
+        if (! EventQueue_add(E, webhooks)) {
+                Log_error("Aborting event - cannot add the event to the queue %s\n", Run.eventlist_dir);
                 return;
         }
 
-        bool rv;
-
-        /* write event structure version */
-        int version = EVENT_VERSION;
-        if (! (rv = file_writeQueue(file, &version, sizeof(int))))
-                goto error;
-
-        /* write event structure */
-        if (! (rv = file_writeQueue(file, E, sizeof(*E))))
-                goto error;
-
-        /* write source */
-        if (! (rv = file_writeQueue(file, E->source->name, strlen(E->source->name) + 1)))
-                goto error;
+        Log_info("Adding event to the queue %s for later delivery\n", Run.eventlist_dir);
 
-        /* write message */
-        if (! (rv = file_writeQueue(file, E->message, E->message ? strlen(E->message) + 1 : 0)))
-                goto error;
+        if (! (Run.flags & Run_HandlerInit) && E->flag & Handler_Alert)
+                Run.handler_queue[Handler_Alert]++;
+        if (! (Run.flags & Run_HandlerInit) && E->flag & Handler_Mmonit)
+                Run.handler_queue[Handler_Mmonit]++;
+        if (! (Run.flags & Run_HandlerInit) && E->flag & Handler_Webhook)
+                Run.handler_queue[Handler_Webhook]++;
+}
 
-        /* write event action */
-        Action_Type action = Event_get_action(E);
-        if (! (rv = file_writeQueue(file, &action, sizeof(Action_Type))))
-                goto error;
 
-error:
-        fclose(file);
-        if (! rv) {
-                Log_error("Aborting event - unable to save event information to %s\n",  file_name);
-                if (unlink(file_name) < 0)
-                        Log_error("Failed to remove event file '%s' -- %s\n", file_name, STRERROR);
-        } else {
-                if (! (Run.flags & Run_HandlerInit) && E->flag & Handler_Alert)
-                        Run.handler_queue[Handler_Alert]++;
-                if (! (Run.flags & Run_HandlerInit) && E->flag & Handler_Mmonit)
-                        Run.handler_queue[Handler_Mmonit]++;
-        }
+/**
+ * Get the handlers which can still take the queued events in this cycle. The handlers deliver
+ * in the background, each through its bounded send queue, so a handler which failed or whose
+ * send queue is full (flagged in Run.handler_flag) takes no more events until the next cycle.
+ * The handler without pending events is skipped too, the counters are valid once the first
+ * replay counted them (until then all configured handlers are assumed to have pending events)
+ * @return The handlers bitmap, Handler_Succeeded if none
+ */
+static Handler_Type _queueHandlers(void) {
+        Handler_Type handlers = Handler_Alert; // Alert handler is defined anytime (either explicitly or localhost by default)
+        if (Run.mmonits)
+                handlers |= Handler_Mmonit;
+        if (Run.webhooks)
+                handlers |= Handler_Webhook;
+        if (! (Run.flags & Run_HandlerInit))
+                for (int h = Handler_Alert; h <= Handler_Max; h <<= 1)
+                        if (Run.handler_queue[h] <= 0)
+                                handlers &= ~h;
+        return handlers & ~Run.handler_flag;
 }
 
 
 /**
- * Update the partially handled event in the global queue
- * @param E An event object
- * @param file_name File name
+ * Retry the remaining handlers of the queued event
+ * @param e A queued event object, the flag is updated with the failed handlers
+ * @param webhooks The webhooks which didn't take the event, updated with those which still failed
+ * @return false if all handlers failed and the queue processing should stop in this cycle
  */
-static void _queueUpdate(Event_T E, const char *file_name) {
-        int version = EVENT_VERSION;
-        Action_Type action = Event_get_action(E);
-        bool rv;
+static bool _queueDeliver(Event_T e, unsigned *webhooks) {
+        /* In the case that all handlers with pending events failed or are busy, stop the replay in this cycle, so the rest of the queue isn't read for nothing */
+        if (! _queueHandlers())
+                return false;
 
-        ASSERT(E);
-        ASSERT(E->flag != Handler_Succeeded);
+        DEBUG("Processing queued event '%s' for the service %s\n", Event_get_description(e), e->source->name);
 
-        if (! file_checkQueueDirectory(Run.eventlist_dir)) {
-                Log_error("Aborting event - cannot access the event queue directory %s\n", Run.eventlist_dir);
-                return;
+        /* alert */
+        if (e->flag & Handler_Alert) {
+                if (Run.flags & Run_HandlerInit)
+                        Run.handler_queue[Handler_Alert]++;
+                if ((Run.handler_flag & Handler_Alert) != Handler_Alert) {
+                        if (handle_alert(e) != Handler_Alert) {
+                                e->flag &= ~Handler_Alert;
+                                Run.handler_queue[Handler_Alert]--;
+                        } else {
+                                Log_error("Alert handler failed, retry scheduled for next cycle\n");
+                                Run.handler_flag |= Handler_Alert;
+                        }
+                }
         }
 
-        DEBUG("Updating event in the queue file %s for later delivery\n", file_name);
-
-        FILE *file = fopen(file_name, "w");
-        if (! file) {
-                Log_error("Aborting event - cannot open the event file %s -- %s\n", file_name, STRERROR);
-                return;
+        /* mmonit */
+        if (e->flag & Handler_Mmonit) {
+                if (Run.flags & Run_HandlerInit)
+                        Run.handler_queue[Handler_Mmonit]++;
+                if ((Run.handler_flag & Handler_Mmonit) != Handler_Mmonit) {
+                        if (MMonit_send(e) != Handler_Mmonit) {
+                                e->flag &= ~Handler_Mmonit;
+                                Run.handler_queue[Handler_Mmonit]--;
+                        } else {
+                                Log_error("M/Monit handler failed, retry scheduled for next cycle\n");
+                                Run.handler_flag |= Handler_Mmonit;
+                        }
+                }
         }
 
-        /* write event structure version */
-        if (! (rv = file_writeQueue(file, &version, sizeof(int))))
-                goto error;
-
-        /* write event structure */
-        if (! (rv = file_writeQueue(file, E, sizeof(*E))))
-                goto error;
-
-        /* write source */
-        if (! (rv = file_writeQueue(file, E->source->name, strlen(E->source->name) + 1)))
-                goto error;
-
-        /* write message */
-        if (! (rv = file_writeQueue(file, E->message, E->message ? strlen(E->message) + 1 : 0)))
-                goto error;
-
-        /* write event action */
-        if (! (rv = file_writeQueue(file, &action, sizeof(Action_Type))))
-                goto error;
-
-error:
-        fclose(file);
-        if (! rv) {
-                Log_error("Aborting event - unable to update event information in '%s'\n", file_name);
-                if (unlink(file_name) < 0)
-                        Log_error("Failed to remove event file '%s' -- %s\n", file_name, STRERROR);
+        /* webhook */
+        if (e->flag & Handler_Webhook) {
+                if (Run.flags & Run_HandlerInit)
+                        Run.handler_queue[Handler_Webhook]++;
+                if ((Run.handler_flag & Handler_Webhook) != Handler_Webhook) {
+                        if (Webhook_send(e, webhooks) != Handler_Webhook) {
+                                e->flag &= ~Handler_Webhook;
+                                Run.handler_queue[Handler_Webhook]--;
+                        } else {
+                                Log_error("Webhook handler failed, retry scheduled for next cycle\n");
+                                Run.handler_flag |= Handler_Webhook;
+                        }
+                }
         }
+        return true;
 }
 
 
@@ -301,12 +297,14 @@ static void _handleAction(Event_T E, Action_T A) {
 
         if (A->id != Action_Ignored) {
                 /* Alert and mmonit event notification are common actions */
+                unsigned webhooks = WEBHOOK_ALL;
                 E->flag |= MMonit_send(E);
+                E->flag |= Webhook_send(E, &webhooks);
                 E->flag |= handle_alert(E);
                 /* In the case that some subhandler failed, enqueue the event for partial reprocessing */
                 if (E->flag != Handler_Succeeded) {
                         if (Run.eventlist_dir)
-                                _queueAdd(E);
+                                _queueAdd(E, webhooks);
                         else
                                 Log_error("Aborting event\n");
                 }
@@ -322,11 +320,11 @@ static void _handleAction(Event_T E, Action_T A) {
                 } else {
                         if (E->source->actionratelist && (A->id == Action_Start || A->id == Action_Restart)) {
                                 E->source->nstart++;
-                                State_dirty();
+                                State_dirty(E->source);
                         }
                         if (E->source->mode == Monitor_Passive && (A->id == Action_Start || A->id == Action_Stop  || A->id == Action_Restart))
                                 return;
-                        control_service(E->source->name, A->id);
+                        control_queue(E->source, A->id, false);
                 }
         }
 }
@@ -349,23 +347,23 @@ static void _handleEvent(Service_T S, Event_T E) {
         if (E->message) {
                 if (E->id == Event_Instance || E->id == Event_Action) {
                         // Instance and action events are logged always with priority info
-                        Log_info("'%s' %s\n", S->name, E->message);
+                        Log_event(LOG_INFO, S, E);
                 } else if (E->state == State_Succeeded || E->state == State_ChangedNot) {
                         if (E->state_map & 0x1) {
                                 // Failure, but didn't reach the error threshold yet
-                                Log_warning("'%s' %s\n", S->name, E->message);
+                                Log_event(LOG_WARNING, S, E);
                         } else {
                                 // Success
-                                Log_info("'%s' %s\n", S->name, E->message);
+                                Log_event(LOG_INFO, S, E);
                         }
                 } else if (E->state == State_Init) {
                         if (E->state_map & 0x1) {
                                 // Log error which occur while the service is initializing as warnings, success is not logged in the initializing state
-                                Log_warning("'%s' %s\n", S->name, E->message);
+                                Log_event(LOG_WARNING, S, E);
                         }
                         return;
                 } else {
-                        Log_error("'%s' %s\n", S->name, E->message);
+                        Log_event(LOG_ERR, S, E);
                 }
         }
 
@@ -386,51 +384,94 @@ static void _handleEvent(Service_T S, Event_T E) {
 }
 
 
-/* ------------------------------------------------------------------ Public */
+static unsigned int _hash(long id, EventAction_T action) {
+        unsigned long h = ((unsigned long)action >> 4) ^ ((unsigned long)id * 2654435761u);
+        return (unsigned int)(h ^ (h >> 16));
+}
+
+
+static void _indexAdd(Service_T S, Event_T e) {
+        unsigned int mask = S->eventindex.size - 1;
+        unsigned int i = _hash(e->id, e->action) & mask;
+        while (S->eventindex.table[i])
+                i = (i + 1) & mask;
+        S->eventindex.table[i] = e;
+}
+
+
+static void _index(Service_T S, Event_T e) {
+        if ((S->eventindex.count + 1) * 2 > S->eventindex.size) {
+                // Grow the table and reindex the event list
+                FREE(S->eventindex.table);
+                S->eventindex.size = S->eventindex.size ? S->eventindex.size * 2 : 8;
+                S->eventindex.table = CALLOC(S->eventindex.size, sizeof(Event_T));
+                S->eventindex.count = 0;
+                for (Event_T l = S->eventlist; l; l = l->next) {
+                        if (l != e) {
+                                _indexAdd(S, l);
+                                S->eventindex.count++;
+                        }
+                }
+        }
+        _indexAdd(S, e);
+        S->eventindex.count++;
+}
 
 
 /**
- * Post a new Event
- * @param service The Service the event belongs to
- * @param id The event identification
- * @param state The event state
- * @param action Description of the event action
- * @param s Optional message describing the event
+ * Find the service event by the event id and action (the rule which posted the event)
  */
-void Event_post(Service_T service, long id, State_Type state, EventAction_T action, const char *s, ...) {
-        ASSERT(service);
-        ASSERT(action);
-        ASSERT(s);
-        ASSERT(state == State_Failed || state == State_Succeeded || state == State_Changed || state == State_ChangedNot);
-
-        _saveState(id, state);
+static Event_T _find(Service_T S, long id, EventAction_T action) {
+        if (S->eventindex.size && S->eventlist) {
+                unsigned int mask = S->eventindex.size - 1;
+                for (unsigned int i = _hash(id, action) & mask; S->eventindex.table[i]; i = (i + 1) & mask) {
+                        Event_T e = S->eventindex.table[i];
+                        if (e->action == action && e->id == id)
+                                return e;
+                }
+        }
+        return NULL;
+}
 
-        va_list ap;
-        va_start(ap, s);
-        char *message = Str_vcat(s, ap);
-        va_end(ap);
 
-        Event_T e = service->eventlist;
-        while (e) {
-                if (e->action == action && e->id == id) {
-                        gettimeofday(&e->collected, NULL);
+/**
+ * Post the event. The message is formatted only if some handler or the log needs it, so the rules which keep
+ * succeeding don't pay the formatting every cycle
+ */
+static void _post(Service_T service, long id, State_Type state, EventAction_T action, const char *s, va_list ap) {
+        PROBE3(event__post, service->name, id, state);
+        _saveState(service, id, state);
 
-                        /* Shift the existing event flags to the left and set the first bit based on actual state */
-                        e->state_map <<= 1;
-                        e->state_map |= ((state == State_Succeeded || state == State_ChangedNot) ? 0 : 1);
+        bool failed = ! (state == State_Succeeded || state == State_ChangedNot);
+        Event_T e = _find(service, id, action);
+        if (e) {
+                gettimeofday(&e->collected, NULL);
 
-                        /* Update the message */
-                        FREE(e->message);
-                        e->message = message;
-                        break;
+                /* Shift the existing event flags to the left and set the first bit based on actual state */
+                e->state_map <<= 1;
+                e->state_map |= failed ? 1 : 0;
+
+                e->state_changed = _checkState(e, state);
+                // The posted state differs from the event state, but the X of Y cycles window didn't resolve yet
+                if (! e->state_changed && failed != (e->state == State_Failed || e->state == State_Changed))
+                        service->every.recheck = true;
+                if (! e->state_changed && ! Run.debug && (! failed || e->state == State_Succeeded || e->state == State_ChangedNot)) {
+                        // Fast path: the event is ignored by _handleEvent() and the message would be logged in debug mode only
+                        e->count++;
+                        return;
                 }
-                e = e->next;
-        }
-        if (! e) {
+
+                /* Update the message */
+                FREE(e->message);
+                e->message = Str_vcat(s, ap);
+        } else {
                 /* Only first failed/changed event can initialize the queue for given event type, thus succeeded events are ignored until first error. */
-                if (state == State_Succeeded || state == State_ChangedNot) {
-                        DEBUG("'%s' %s\n", service->name, message);
-                        FREE(message);
+                if (! failed) {
+                        if (Run.debug) {
+                                char *message = Str_vcat(s, ap);
+                                DEBUG("'%s' %s\n", service->name, message);
+                                FREE(message);
+                        }
                         return;
                 }
                 /* Initialize the event. The mandatory information is cloned so the event is as standalone as possible and may be saved
@@ -444,15 +485,20 @@ void Event_post(Service_T service, long id, State_Type state, EventAction_T acti
                 e->state = State_Init;
                 e->state_map = 1;
                 e->action = action;
-                e->message = message;
+                e->message = Str_vcat(s, ap);
                 e->next = service->eventlist;
                 service->eventlist = e;
+                _index(service, e);
+                e->state_changed = _checkState(e, state);
+                if (! e->state_changed)
+                        service->every.recheck = true;
         }
-        e->state_changed = _checkState(e, state);
         /* In the case that the state changed, update it and reset the counter */
         if (e->state_changed) {
                 e->state = state;
                 e->count = 1;
+                service->events++;
+                EventStream_post(e);
         } else {
                 e->count++;
         }
@@ -460,6 +506,48 @@ void Event_post(Service_T service, long id, State_Type state, EventAction_T acti
 }
 
 
+/* ------------------------------------------------------------------ Public */
+
+
+/**
+ * Post a new Event
+ * @param service The Service the event belongs to
+ * @param id The event identification
+ * @param state The event state
+ * @param action Description of the event action
+ * @param s Optional message describing the event
+ */
+void Event_post(Service_T service, long id, State_Type state, EventAction_T action, const char *s, ...) {
+        ASSERT(service);
+        ASSERT(action);
+        ASSERT(s);
+        ASSERT(state == State_Failed || state == State_Succeeded || state == State_Changed || state == State_ChangedNot);
+
+        va_list ap;
+        va_start(ap, s);
+        pthread_once(&_once, _init);
+        LOCK(_mutex)
+        {
+                _post(service, id, state, action, s, ap);
+        }
+        END_LOCK;
+        va_end(ap);
+}
+
+
+/**
+ * Free the events of the service
+ * @param S A service object
+ */
+void Event_free(Service_T S) {
+        ASSERT(S);
+        if (S->eventlist)
+                gc_event(&S->eventlist);
+        FREE(S->eventindex.table);
+        S->eventindex.size = S->eventindex.count = 0;
+}
+
+
 /**
  * Get a textual description of actual event type.
  * @param E An event object
@@ -542,168 +630,35 @@ const char *Event_get_action_description(Event_T E) {
  */
 void Event_queue_process() {
         /* return in the case that the eventqueue is not enabled or empty */
-        if (! Run.eventlist_dir || (! (Run.flags & Run_HandlerInit) && ! Run.handler_queue[Handler_Alert] && ! Run.handler_queue[Handler_Mmonit]))
+        if (! Run.eventlist_dir || (! (Run.flags & Run_HandlerInit) && ! Run.handler_queue[Handler_Alert] && ! Run.handler_queue[Handler_Mmonit] && ! Run.handler_queue[Handler_Webhook]))
                 return;
 
-        DIR *dir = opendir(Run.eventlist_dir);
-        if (! dir) {
-                if (errno != ENOENT)
-                        Log_error("Cannot open the directory %s -- %s\n", Run.eventlist_dir, STRERROR);
-                return;
+        pthread_once(&_once, _init);
+        LOCK(_mutex)
+        {
+                EventQueue_replay(_queueDeliver);
         }
+        END_LOCK;
+        Run.flags &= ~Run_HandlerInit;
+}
 
-        struct dirent *de = readdir(dir);
-        if (de)
-                DEBUG("Processing postponed events queue\n");
-
-        Action_T a;
-        NEW(a);
-
-        EventAction_T ea;
-        NEW(ea);
-
-        while (de) {
-                int handlers_passed = 0;
-
-                /* In the case that all handlers failed, skip the further processing in this cycle. Alert handler is currently defined anytime (either explicitly or localhost by default) */
-                if ( (Run.mmonits && FLAG(Run.handler_flag, Handler_Mmonit) && FLAG(Run.handler_flag, Handler_Alert)) || FLAG(Run.handler_flag, Handler_Alert))
-                        break;
-
-                char file_name[PATH_MAX];
-                snprintf(file_name, sizeof(file_name), "%s/%s", Run.eventlist_dir, de->d_name);
-
-                if (File_isFile(file_name)) {
-                        DEBUG("Processing queued event '%s'\n", file_name);
-
-                        FILE *file = fopen(file_name, "r");
-                        if (! file) {
-                                Log_error("Queued event processing failed - cannot open the file '%s' -- %s\n", file_name, STRERROR);
-                                goto error1;
-                        }
-
-                        size_t size;
-
-                        /* read event structure version */
-                        int *version = file_readQueue(file, &size);
-                        if (! version) {
-                                DEBUG("Skipping file '%s' - not event queue data formatted\n", file_name);
-                                goto error2;
-                        }
-                        if (size != sizeof(int)) {
-                                Log_error("Aborting queued event %s - invalid size %lu\n", file_name, (unsigned long)size);
-                                goto error3;
-                        }
-                        if (*version != EVENT_VERSION) {
-                                Log_error("Aborting queued event %s - incompatible data format version %d\n", file_name, *version);
-                                goto error3;
-                        }
-
-                        /* read event structure */
-                        Event_T e = file_readQueue(file, &size);
-                        if (! e)
-                                goto error3;
-                        if (size != sizeof(*e))
-                                goto error4;
-
-                        /* read source */
-                        char *service = file_readQueue(file, &size);
-                        if (! service)
-                                goto error4;
-                        if (! (e->source = Util_getService(service))) {
-                                Log_error("Aborting queued event '%s' - service %s not found in monit configuration\n", file_name, service);
-                                FREE(service);
-                                goto error4;
-                        }
-                        FREE(service);
-
-                        /* read message */
-                        if (! (e->message = file_readQueue(file, &size)))
-                                goto error4;
-
-                        /* read event action */
-                        Action_Type *action = file_readQueue(file, &size);
-                        if (! action)
-                                goto error5;
-                        if (size != sizeof(Action_Type))
-                                goto error6;
-                        a->id = *action;
-                        switch (e->state) {
-                                case State_Succeeded:
-                                case State_ChangedNot:
-                                        ea->succeeded = a;
-                                        break;
-                                case State_Failed:
-                                case State_Changed:
-                                case State_Init:
-                                        ea->failed = a;
-                                        break;
-                                default:
-                                        Log_error("Aborting queue event %s -- invalid state: %d\n", file_name, e->state);
-                                        goto error6;
-                        }
-                        e->action = ea;
-
-                        /* Retry all remaining handlers */
-
-                        /* alert */
-                        if (e->flag & Handler_Alert) {
-                                if (Run.flags & Run_HandlerInit)
-                                        Run.handler_queue[Handler_Alert]++;
-                                if ((Run.handler_flag & Handler_Alert) != Handler_Alert) {
-                                        if (handle_alert(e) != Handler_Alert) {
-                                                e->flag &= ~Handler_Alert;
-                                                Run.handler_queue[Handler_Alert]--;
-                                                handlers_passed++;
-                                        } else {
-                                                Log_error("Alert handler failed, retry scheduled for next cycle\n");
-                                                Run.handler_flag |= Handler_Alert;
-                                        }
-                                }
-                        }
-
-                        /* mmonit */
-                        if (e->flag & Handler_Mmonit) {
-                                if (Run.flags & Run_HandlerInit)
-                                        Run.handler_queue[Handler_Mmonit]++;
-                                if ((Run.handler_flag & Handler_Mmonit) != Handler_Mmonit) {
-                                        if (MMonit_send(e) != Handler_Mmonit) {
-                                                e->flag &= ~Handler_Mmonit;
-                                                Run.handler_queue[Handler_Mmonit]--;
-                                                handlers_passed++;
-                                        } else {
-                                                Log_error("M/Monit handler failed, retry scheduled for next cycle\n");
-                                                Run.handler_flag |= Handler_Mmonit;
-                                        }
-                                }
-                        }
-
-                        /* If no error persists, remove it from the queue */
-                        if (e->flag == Handler_Succeeded) {
-                                DEBUG("Removing queued event %s\n", file_name);
-                                if (unlink(file_name) < 0)
-                                        Log_error("Failed to remove queued event file '%s' -- %s\n", file_name, STRERROR);
-                        } else if (handlers_passed > 0) {
-                                DEBUG("Updating queued event %s (some handlers passed)\n", file_name);
-                                _queueUpdate(e, file_name);
-                        }
 
-                error6:
-                        FREE(action);
-                error5:
-                        FREE(e->message);
-                error4:
-                        FREE(e);
-                error3:
-                        FREE(version);
-                error2:
-                        fclose(file);
-                }
-        error1:
-                de = readdir(dir);
+/**
+ * Save the partially handled event to the event queue
+ * @param E An event object
+ * @param webhooks The webhooks which didn't take the event
+ */
+void Event_queue_add(Event_T E, unsigned webhooks) {
+        ASSERT(E);
+        if (! Run.eventlist_dir) {
+                Log_error("Aborting event\n");
+                return;
         }
-        Run.flags &= ~Run_HandlerInit;
-        closedir(dir);
-        FREE(a);
-        FREE(ea);
+        pthread_once(&_once, _init);
+        LOCK(_mutex)
+        {
+                _queueAdd(E, webhooks);
+        }
+        END_LOCK;
 }
 
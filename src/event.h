@@ -138,10 +138,27 @@ Action_Type Event_get_action(Event_T E);
 const char *Event_get_action_description(Event_T E);
 
 
+/**
+ * Free the events of the service
+ * @param S A service object
+ */
+void Event_free(Service_T S);
+
+
 /**
  * Reprocess the partially handled event queue
  */
 void Event_queue_process(void);
 
 
+/**
+ * Save the partially handled event to the event queue for a later
+ * delivery. The event is dropped if the event queue is not enabled
+ * @param E An event object, E->flag sets the handlers to retry
+ * @param webhooks The webhooks which didn't take the event, if E->flag
+ * has the Handler_Webhook flag (see Webhook_send())
+ */
+void Event_queue_add(Event_T E, unsigned webhooks);
+
+
 #endif
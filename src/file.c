@@ -188,55 +188,6 @@ bool file_checkQueueDirectory(const char *path) {
 }
 
 
-bool file_checkQueueLimit(const char *path, int limit) {
-        if (limit >= 0) {
-                DIR *dir = opendir(path);
-                if (! dir) {
-                        Log_error("Cannot open the event queue directory '%s' -- %s\n", path, STRERROR);
-                        return false;
-                }
-                int used = 0;
-                struct dirent *de = NULL;
-                while ((de = readdir(dir)) ) {
-                        char buf[PATH_MAX];
-                        snprintf(buf, sizeof(buf), "%s/%s", path, de->d_name);
-                        if (File_isFile(buf) && ++used > limit) {
-                                Log_error("Event queue is full\n");
-                                closedir(dir);
-                                return false;
-                        }
-                }
-                closedir(dir);
-        }
-        return true;
-}
-
-
-bool file_writeQueue(FILE *file, const void *data, size_t size) {
-        ASSERT(file);
-        /* write size */
-        size_t rv = fwrite(&size, 1, sizeof(size_t), file);
-        if (rv != sizeof(size_t)) {
-                if (feof(file) || ferror(file))
-                        Log_error("Queued event file: unable to write event size -- %s\n", feof(file) ? "end of file" : "stream error");
-                else
-                        Log_error("Queued event file: unable to write event size -- read returned %lu bytes\n", (unsigned long)rv);
-                return false;
-        }
-        /* write data if any */
-        if (size > 0) {
-                if ((rv = fwrite(data, 1, size, file)) != size) {
-                        if (feof(file) || ferror(file))
-                                Log_error("Queued event file: unable to write event size -- %s\n", feof(file) ? "end of file" : "stream error");
-                        else
-                                Log_error("Queued event file: unable to write event size -- read returned %lu bytes\n", (unsigned long)rv);
-                        return false;
-                }
-        }
-        return true;
-}
-
-
 void *file_readQueue(FILE *file, size_t *size) {
         ASSERT(file);
         /* read size */
@@ -32,21 +32,39 @@
 #include <stdlib.h>
 #endif
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 // libmonit
 #include "util/List.h"
 
 #include "monit.h"
+#include "util.h"
 #include "protocol.h"
 #include "ProcessTree.h"
 #include "engine.h"
+#include "device.h"
+#include "ContentMatch.h"
+#include "DirectoryTree.h"
+#include "event.h"
+#include "EventQueue.h"
+#include "ServiceStatus.h"
+#include "ProgramOutput.h"
+#include "RegexCache.h"
+#include "Watchdog.h"
 
 
 /* Private prototypes */
+static void _gc_configuration(void);
+static void _carryover(Service_T, Service_T);
+static void _carryoverPorts(Port_T, Port_T);
 static void _gc_service_list(Service_T *);
 static void _gc_service(Service_T *);
 static void _gc_servicegroup(ServiceGroup_T *);
 static void _gc_mail_server(MailServer_T *);
 static void _gcportlist(Port_T *);
+static void _closeports(Port_T);
 static void _gcfilesystem(FileSystem_T *);
 static void _gcicmp(Icmp_T *);
 static void _gcpql(Resource_T *);
@@ -56,6 +74,10 @@ static void _gc_action(Action_T *);
 static void _gc_eventaction(EventAction_T *);
 static void _gcpdl(Dependant_T *);
 static void _gcso(Size_T *);
+static void _gccertificate(Certificate_T *);
+static void _gcfilecount(FileCount_T *);
+static void _gclatency(Latency_T *);
+static void _gctrend(Trend_T *);
 static void _gclinkstatus(LinkStatus_T *);
 static void _gclinkspeed(LinkSpeed_T *);
 static void _gclinksaturation(LinkSaturation_T *);
@@ -74,6 +96,9 @@ static void _gcexist(Exist_T *);
 static void _gcgeneric(Generic_T *);
 static void _gcath(Auth_T *);
 static void _gc_mmonit(Mmonit_T *);
+static void _gc_clusterpeer(ClusterPeer_T *);
+static void _gc_webhook(Webhook_T *);
+static void _gc_mqtt(Mqtt_T *);
 static void _gc_url(URL_T *);
 static void _gc_request(Request_T *);
 static void _gcssloptions(SslOptions_T o);
@@ -93,35 +118,76 @@ static void _gcfiledescriptors(Filedescriptors_T *);
 
 void gc() {
         Engine_destroyAllow();
+        validate_reset();
         if (Run.flags & Run_ProcessEngineEnabled)
                 ProcessTree_delete();
+        Util_resetServiceIndex();
         if (servicelist)
                 _gc_service_list(&servicelist);
-        if (servicegrouplist)
-                _gc_servicegroup(&servicegrouplist);
-        if (Run.httpd.credentials)
-                _gcath(&Run.httpd.credentials);
-        if (Run.maillist)
-                gc_mail_list(&Run.maillist);
-        if (Run.mailservers)
-                _gc_mail_server(&Run.mailservers);
-        if (Run.mmonits)
-                _gc_mmonit(&Run.mmonits);
-        FREE(Run.eventlist_dir);
-        FREE(Run.mygroup);
-        if (Run.httpd.flags & Httpd_Net) {
-                FREE(Run.httpd.socket.net.address);
-                _gcssloptions(&(Run.httpd.socket.net.ssl));
+        _gc_configuration();
+}
+
+
+/**
+ * Release only the resources which need a shutdown before exit: stop the
+ * running programs, close the pooled connections (incl. the TLS session
+ * shutdown) and the event queue. The memory is released by the process
+ * exit, walking every list of thousands of services would just delay it
+ */
+void gc_exit() {
+        for (Service_T s = servicelist; s; s = s->next) {
+                if (s->watchdog.hangs && Watchdog_isHung(s, NULL))
+                        continue;
+                if (s->program && s->program->P)
+                        Process_free(&s->program->P);
+                _closeports(s->portlist);
+                _closeports(s->socketlist);
         }
-        if (Run.httpd.flags & Httpd_Unix)
-                FREE(Run.httpd.socket.unix.path);
-        if (Run.MailFormat.from)
-                Address_free(&(Run.MailFormat.from));
-        if (Run.MailFormat.replyto)
-                Address_free(&(Run.MailFormat.replyto));
-        FREE(Run.MailFormat.subject);
-        FREE(Run.MailFormat.message);
-        FREE(Run.mail_hostname);
+        for (Mmonit_T m = Run.mmonits; m; m = m->next)
+                if (m->socket)
+                        Socket_free(&m->socket);
+        EventQueue_close();
+}
+
+
+/**
+ * Release the configuration before reload. The service list is detached
+ * and returned to the caller instead, so the runtime data of the services,
+ * which were not changed, can be carried over to the new service list by
+ * gc_carryover(). The process tree is kept for the CPU usage computation
+ */
+Service_T gc_reload() {
+        Engine_destroyAllow();
+        validate_reset();
+        if (Run.flags & Run_ProcessEngineEnabled)
+                ProcessTree_resetMatches();
+        Util_resetServiceIndex();
+        Service_T previous = servicelist;
+        servicelist = servicelist_conf = NULL;
+        _gc_configuration();
+        return previous;
+}
+
+
+/**
+ * Carry over the runtime data from the previous service list detached by
+ * gc_reload() to the services of the new list, which have the same name,
+ * type and statement fingerprint, then release the previous list. The
+ * services which were changed start from scratch
+ */
+void gc_carryover(Service_T *previous) {
+        ASSERT(previous);
+        int carried = 0, count = 0;
+        for (Service_T o = *previous; o; o = o->next, count++) {
+                Service_T s = Util_getService(o->name);
+                if (s && s->type == o->type && s->fingerprint == o->fingerprint && ! (o->watchdog.hangs && Watchdog_isHung(o, NULL))) {
+                        _carryover(s, o);
+                        carried++;
+                }
+        }
+        DEBUG("Reload: %d of %d services were not changed, their runtime data was kept\n", carried, count);
+        if (*previous)
+                _gc_service_list(previous);
 }
 
 
@@ -144,6 +210,9 @@ void gccmd(command_t *c) {
         ASSERT(c && *c);
         for (int i = 0; (*c)->arg[i]; i++)
                 FREE((*c)->arg[i]);
+        FREE((*c)->arg);
+        if ((*c)->C)
+                Command_free(&(*c)->C);
         FREE(*c);
 }
 
@@ -173,6 +242,74 @@ static void _gcssloptions(SslOptions_T o) {
 }
 
 
+// Release the global configuration
+static void _gc_configuration() {
+        if (servicegrouplist)
+                _gc_servicegroup(&servicegrouplist);
+        if (Run.httpd.credentials)
+                _gcath(&Run.httpd.credentials);
+        if (Run.maillist)
+                gc_mail_list(&Run.maillist);
+        if (Run.mailservers)
+                _gc_mail_server(&Run.mailservers);
+        if (Run.mmonits)
+                _gc_mmonit(&Run.mmonits);
+        if (Run.webhooks)
+                _gc_webhook(&Run.webhooks);
+        if (Run.mqtt)
+                _gc_mqtt(&Run.mqtt);
+        if (Run.cluster.peers)
+                _gc_clusterpeer(&Run.cluster.peers);
+        FREE(Run.cluster.group);
+        EventQueue_close();
+        FREE(Run.eventlist_dir);
+        FREE(Run.procfs);
+        FREE(Run.mygroup);
+        if (Run.httpd.flags & Httpd_Net) {
+                FREE(Run.httpd.socket.net.address);
+                _gcssloptions(&(Run.httpd.socket.net.ssl));
+        }
+        if (Run.httpd.flags & Httpd_Unix)
+                FREE(Run.httpd.socket.unix.path);
+        if (Run.MailFormat.from)
+                Address_free(&(Run.MailFormat.from));
+        if (Run.MailFormat.replyto)
+                Address_free(&(Run.MailFormat.replyto));
+        FREE(Run.MailFormat.subject);
+        FREE(Run.MailFormat.message);
+        FREE(Run.mail_hostname);
+}
+
+
+static void _carryover(Service_T s, Service_T o) {
+        // The data collected by the check functions, incl. the file read position, the tailed file descriptor, the directory tree cache, the network link and the process CPU usage
+        union Info_T inf = s->inf;
+        s->inf = o->inf;
+        o->inf = inf;
+        Series_T series = s->series;
+        s->series = o->series;
+        o->series = series;
+        s->collected = o->collected;
+        _carryoverPorts(s->portlist, o->portlist);
+        _carryoverPorts(s->socketlist, o->socketlist);
+}
+
+
+// The port lists are equal, the ports are in the same order
+static void _carryoverPorts(Port_T p, Port_T q) {
+        for (; p && q; p = p->next, q = q->next) {
+                Histogram_T latency = p->latency;
+                p->latency = q->latency;
+                q->latency = latency;
+                Socket_T pooled = p->pooled;
+                p->pooled = q->pooled;
+                q->pooled = pooled;
+                p->is_available = q->is_available;
+                p->response = q->response;
+        }
+}
+
+
 static void _gc_service_list(Service_T *s) {
         ASSERT(s&&*s);
         if ((*s)->next)
@@ -183,7 +320,15 @@ static void _gc_service_list(Service_T *s) {
 
 static void _gc_service(Service_T *s) {
         ASSERT(s&&*s);
+        if ((*s)->watchdog.hangs && Watchdog_isHung(*s, NULL)) {
+                // The hung check still uses the service, it is left allocated
+                Log_warning("'%s' check is hung, the service memory is not released\n", (*s)->name);
+                *s = NULL;
+                return;
+        }
         if ((*s)->program) {
+                if ((*s)->program->output)
+                        ProgramOutput_free(&(*s)->program->output);
                 if ((*s)->program->P)
                         Process_free(&(*s)->program->P);
                 if ((*s)->program->C)
@@ -212,6 +357,14 @@ static void _gc_service(Service_T *s) {
                 _gcparl(&(*s)->actionratelist);
         if ((*s)->sizelist)
                 _gcso(&(*s)->sizelist);
+        if ((*s)->certificatelist)
+                _gccertificate(&(*s)->certificatelist);
+        if ((*s)->filecountlist)
+                _gcfilecount(&(*s)->filecountlist);
+        if ((*s)->latencylist)
+                _gclatency(&(*s)->latencylist);
+        if ((*s)->trendlist)
+                _gctrend(&(*s)->trendlist);
         if ((*s)->linkstatuslist)
                 _gclinkstatus(&(*s)->linkstatuslist);
         if ((*s)->linkspeedlist)
@@ -230,6 +383,8 @@ static void _gc_service(Service_T *s) {
                 _gcmatch(&(*s)->matchlist);
         if ((*s)->matchignorelist)
                 _gcmatch(&(*s)->matchignorelist);
+        if ((*s)->contentMatch)
+                ContentMatch_free(&(*s)->contentMatch);
         if ((*s)->checksum)
                 _gcchecksum(&(*s)->checksum);
         if ((*s)->perm)
@@ -237,7 +392,7 @@ static void _gc_service(Service_T *s) {
         if ((*s)->statuslist)
                 _gcstatus(&(*s)->statuslist);
         if ((*s)->every.type == Every_Cron || (*s)->every.type == Every_NotInCron)
-                FREE((*s)->every.spec.cron);
+                FREE((*s)->every.spec.cron.string);
         if ((*s)->uid)
                 _gcuid(&(*s)->uid);
         if ((*s)->euid)
@@ -256,6 +411,7 @@ static void _gc_service(Service_T *s) {
                 _gcexist(&(*s)->existlist);
         if ((*s)->dependantlist)
                 _gcpdl(&(*s)->dependantlist);
+        FREE((*s)->children.list);
         if ((*s)->start)
                 gccmd(&(*s)->start);
         if ((*s)->stop)
@@ -274,23 +430,26 @@ static void _gc_service(Service_T *s) {
                 _gc_eventaction(&(*s)->action_MONIT_STOP);
         if ((*s)->action_ACTION)
                 _gc_eventaction(&(*s)->action_ACTION);
-        if ((*s)->eventlist)
-                gc_event(&(*s)->eventlist);
+        Event_free(*s);
         if ((*s)->secattrlist)
                 _gcsecattr(&(*s)->secattrlist);
         if ((*s)->filedescriptorslist)
                 _gcfiledescriptors(&(*s)->filedescriptorslist);
         switch ((*s)->type) {
                 case Service_Directory:
+                        DirectoryTree_free(*s);
                         FREE((*s)->inf.directory);
                         break;
                 case Service_Fifo:
                         FREE((*s)->inf.fifo);
                         break;
                 case Service_File:
+                        if ((*s)->inf.file->tail.open)
+                                close((*s)->inf.file->tail.fd);
                         FREE((*s)->inf.file);
                         break;
                 case Service_Filesystem:
+                        filesystem_release(*s);
                         FREE((*s)->inf.filesystem);
                         break;
                 case Service_Net:
@@ -303,10 +462,15 @@ static void _gc_service(Service_T *s) {
                 default:
                         break;
         }
+        ServiceStatus_free(*s);
+        if ((*s)->series)
+                Series_free(&(*s)->series);
+        Profile_free(&(*s)->profile);
         StringBuffer_free(&((*s)->name_htmlescaped));
         FREE((*s)->name_urlescaped);
-        FREE((*s)->name);
-        FREE((*s)->path);
+        Atom_free(&(*s)->name);
+        Atom_free(&(*s)->path);
+        FREE((*s)->cgroup);
         (*s)->next = NULL;
         FREE(*s);
 }
@@ -326,9 +490,7 @@ static void _gc_request(Request_T *r) {
         ASSERT(r);
         if ((*r)->url)
                 _gc_url(&(*r)->url);
-        if ((*r)->regex)
-                regfree((*r)->regex);
-        FREE((*r)->regex);
+        RegexCache_release(&(*r)->regex);
         FREE(*r);
 }
 
@@ -375,6 +537,18 @@ static void _gc_eventaction(EventAction_T *e) {
 }
 
 
+static void _closeports(Port_T p) {
+        for (; p; p = p->next) {
+                if (p->pooled)
+                        Socket_free(&(p->pooled));
+                if (p->prepared.connected) {
+                        close(p->prepared.socket);
+                        p->prepared.connected = false;
+                }
+        }
+}
+
+
 static void _gcportlist(Port_T *p) {
         ASSERT(p&&*p);
         if ((*p)->next)
@@ -383,17 +557,26 @@ static void _gcportlist(Port_T *p) {
                 _gc_eventaction(&(*p)->action);
         if ((*p)->url_request)
                 _gc_request(&(*p)->url_request);
+        if ((*p)->pooled)
+                Socket_free(&((*p)->pooled));
+        if ((*p)->latency)
+                Histogram_free(&((*p)->latency));
         if ((*p)->family == Socket_Unix)
                 FREE((*p)->target.unix.pathname);
         else
                 _gcssloptions(&((*p)->target.net.ssl.options));
         FREE((*p)->hostname);
         FREE((*p)->outgoing.ip);
+        if ((*p)->prepared.connected)
+                close((*p)->prepared.socket);
+        FREE((*p)->prepared.error);
         if ((*p)->protocol->check == check_http) {
                 FREE((*p)->parameters.http.username);
                 FREE((*p)->parameters.http.password);
                 FREE((*p)->parameters.http.request);
                 FREE((*p)->parameters.http.checksum);
+                FREE((*p)->parameters.http.etag);
+                FREE((*p)->parameters.http.lastModified);
                 if ((*p)->parameters.http.headers) {
                         List_T l = (*p)->parameters.http.headers;
                         while (List_length(l) > 0) {
@@ -412,6 +595,36 @@ static void _gcportlist(Port_T *p) {
                 FREE((*p)->parameters.mysql.username);
                 FREE((*p)->parameters.mysql.password);
                 FREE((*p)->parameters.mysql.rsaChecksum);
+        } else if ((*p)->protocol->check == check_dns) {
+                while ((*p)->parameters.dns.queries) {
+                        DnsQuery_T q = (*p)->parameters.dns.queries;
+                        (*p)->parameters.dns.queries = q->next;
+                        FREE(q->name);
+                        FREE(q->type);
+                        FREE(q->answer);
+                        FREE(q);
+                }
+        } else if ((*p)->protocol->check == check_kafka) {
+                if ((*p)->parameters.kafka.topics) {
+                        List_T l = (*p)->parameters.kafka.topics;
+                        while (List_length(l) > 0) {
+                                char *s = List_pop(l);
+                                FREE(s);
+                        }
+                        List_free(&(*p)->parameters.kafka.topics);
+                }
+        } else if ((*p)->protocol->check == check_nats) {
+                FREE((*p)->parameters.nats.username);
+                FREE((*p)->parameters.nats.password);
+                FREE((*p)->parameters.nats.cluster);
+        } else if ((*p)->protocol->check == check_grpc) {
+                FREE((*p)->parameters.grpc.service);
+        } else if ((*p)->protocol->check == check_pgsql) {
+                FREE((*p)->parameters.pgsql.username);
+                FREE((*p)->parameters.pgsql.password);
+                FREE((*p)->parameters.pgsql.database);
+        } else if ((*p)->protocol->check == check_redis) {
+                FREE((*p)->parameters.redis.password);
         } else if ((*p)->protocol->check == check_sip) {
                 FREE((*p)->parameters.sip.target);
         } else if ((*p)->protocol->check == check_smtp) {
@@ -492,6 +705,46 @@ static void _gcso(Size_T *s) {
         FREE(*s);
 }
 
+
+static void _gccertificate(Certificate_T *s) {
+        ASSERT(s);
+        if ((*s)->next)
+                _gccertificate(&(*s)->next);
+        if ((*s)->action)
+                _gc_eventaction(&(*s)->action);
+        FREE(*s);
+}
+
+
+static void _gcfilecount(FileCount_T *s) {
+        ASSERT(s);
+        if ((*s)->next)
+                _gcfilecount(&(*s)->next);
+        if ((*s)->action)
+                _gc_eventaction(&(*s)->action);
+        FREE(*s);
+}
+
+static void _gclatency(Latency_T *l) {
+        ASSERT(l);
+        if ((*l)->next)
+                _gclatency(&(*l)->next);
+        if ((*l)->action)
+                _gc_eventaction(&(*l)->action);
+        FREE(*l);
+}
+
+
+static void _gctrend(Trend_T *t) {
+        ASSERT(t);
+        if ((*t)->next)
+                _gctrend(&(*t)->next);
+        if ((*t)->action)
+                _gc_eventaction(&(*t)->action);
+        FREE(*t);
+}
+
+
 static void _gclinkstatus(LinkStatus_T *l) {
         ASSERT(l);
         if ((*l)->next)
@@ -537,12 +790,10 @@ static void _gcmatch(Match_T *s) {
                 _gcmatch(&(*s)->next);
         if ((*s)->action)
                 _gc_eventaction(&(*s)->action);
-        FREE((*s)->match_path);
-        FREE((*s)->match_string);
-        if ((*s)->regex_comp) {
-                regfree((*s)->regex_comp);
-                FREE((*s)->regex_comp);
-        }
+        Atom_free(&(*s)->match_path);
+        Atom_free(&(*s)->match_string);
+        FREE((*s)->literal);
+        RegexCache_release(&(*s)->regex_comp);
         FREE(*s);
 }
 
@@ -645,7 +896,7 @@ static void _gcpdl(Dependant_T *d) {
                 _gcpdl(&(*d)->next);
         StringBuffer_free(&((*d)->dependant_htmlescaped));
         FREE((*d)->dependant_urlescaped);
-        FREE((*d)->dependant);
+        Atom_free(&(*d)->dependant);
         FREE(*d);
 }
 
@@ -655,9 +906,8 @@ static void _gcgeneric(Generic_T *g) {
         if ((*g)->next)
                 _gcgeneric(&(*g)->next);
         FREE((*g)->send);
-        if ((*g)->expect != NULL)
-                regfree((*g)->expect);
-        FREE((*g)->expect);
+        RegexCache_release(&(*g)->expect);
+        FREE((*g)->literal);
         FREE(*g);
 
 }
@@ -678,12 +928,48 @@ static void _gc_mmonit(Mmonit_T *recv) {
         ASSERT(recv);
         if ((*recv)->next)
                 _gc_mmonit(&(*recv)->next);
+        if ((*recv)->socket)
+                Socket_free(&(*recv)->socket);
+        FREE((*recv)->delta.digests);
         _gc_url(&(*recv)->url);
         _gcssloptions(&((*recv)->ssl));
         FREE(*recv);
 }
 
 
+static void _gc_clusterpeer(ClusterPeer_T *p) {
+        ASSERT(p);
+        if ((*p)->next)
+                _gc_clusterpeer(&(*p)->next);
+        FREE((*p)->id);
+        FREE((*p)->status);
+        if ((*p)->services)
+                HashMap_free(&(*p)->services);
+        _gc_url(&(*p)->url);
+        _gcssloptions(&((*p)->ssl));
+        FREE(*p);
+}
+
+
+static void _gc_webhook(Webhook_T *w) {
+        ASSERT(w);
+        if ((*w)->next)
+                _gc_webhook(&(*w)->next);
+        _gc_url(&(*w)->url);
+        _gcssloptions(&((*w)->ssl));
+        FREE(*w);
+}
+
+
+static void _gc_mqtt(Mqtt_T *m) {
+        ASSERT(m);
+        _gc_url(&(*m)->url);
+        _gcssloptions(&((*m)->ssl));
+        FREE((*m)->topic);
+        FREE(*m);
+}
+
+
 static void _gcsecattr(SecurityAttribute_T *s) {
         ASSERT(s && *s);
         if ((*s)->next)
@@ -0,0 +1,699 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+// libmonit
+#include "util/List.h"
+#include "system/Time.h"
+
+#include "monit.h"
+#include "event.h"
+#include "ProcessTree.h"
+#include "protocol.h"
+#include "ServiceStatus.h"
+
+
+/**
+ *  CBOR (RFC 8949) routines for status and event notification message
+ *  handling.
+ *
+ *  The message has the same structure and element names as the version 2
+ *  XML status (see xml.c), each XML element is a CBOR map entry with a text
+ *  key. Numbers are sent as CBOR integers or double precision floats, the
+ *  file mode as an integer rather than an octal string. Free form text (the
+ *  program output and the event message) is sent as a byte string as it
+ *  may not be valid UTF-8. Maps and arrays use the indefinite length
+ *  encoding, so the message is generated in one pass without having to
+ *  count the items first.
+ *
+ *  The top-level map has a "schema" entry with the message format version,
+ *  it is incremented on an incompatible change. New entries may be added
+ *  without a change of the schema version, so the parser should ignore
+ *  unknown keys.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define SCHEMA 1
+
+
+typedef enum {
+        Cbor_Unsigned = 0,
+        Cbor_Negative,
+        Cbor_Bytes,
+        Cbor_Text,
+        Cbor_Array,
+        Cbor_Map,
+        Cbor_Tag,
+        Cbor_Simple
+} __attribute__((__packed__)) Cbor_Type;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Append the data item head of the given major type and argument
+ * @param B StringBuffer object
+ * @param type The major type
+ * @param value The item value or length
+ */
+static void _head(StringBuffer_T B, Cbor_Type type, uint64_t value) {
+        unsigned char head[9];
+        int length = 1;
+        if (value < 24) {
+                head[0] = (unsigned char)(type << 5 | value);
+        } else {
+                int size = value <= 0xff ? 1 : value <= 0xffff ? 2 : value <= 0xffffffff ? 4 : 8;
+                head[0] = (unsigned char)(type << 5 | (size == 1 ? 24 : size == 2 ? 25 : size == 4 ? 26 : 27));
+                for (int i = size; i > 0; i--, value >>= 8)
+                        head[i] = (unsigned char)(value & 0xff);
+                length += size;
+        }
+        StringBuffer_appendBytes(B, head, length);
+}
+
+
+static void _string(StringBuffer_T B, Cbor_Type type, const char *s) {
+        size_t length = s ? strlen(s) : 0;
+        _head(B, type, length);
+        StringBuffer_appendBytes(B, s, (int)length);
+}
+
+
+static void _integer(StringBuffer_T B, long long value) {
+        if (value >= 0)
+                _head(B, Cbor_Unsigned, (uint64_t)value);
+        else
+                _head(B, Cbor_Negative, (uint64_t)(-(value + 1)));
+}
+
+
+static void _double(StringBuffer_T B, double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        unsigned char item[9] = {Cbor_Simple << 5 | 27};
+        for (int i = 8; i > 0; i--, bits >>= 8)
+                item[i] = (unsigned char)(bits & 0xff);
+        StringBuffer_appendBytes(B, item, sizeof(item));
+}
+
+
+static void _open(StringBuffer_T B, Cbor_Type type) {
+        StringBuffer_appendBytes(B, &(unsigned char){type << 5 | 31}, 1);
+}
+
+
+static void _close(StringBuffer_T B) {
+        StringBuffer_appendBytes(B, &(unsigned char){0xff}, 1);
+}
+
+
+/* Map entries */
+
+
+static void _map(StringBuffer_T B, const char *key) {
+        _string(B, Cbor_Text, key);
+        _open(B, Cbor_Map);
+}
+
+
+static void _array(StringBuffer_T B, const char *key) {
+        _string(B, Cbor_Text, key);
+        _open(B, Cbor_Array);
+}
+
+
+static void _int(StringBuffer_T B, const char *key, long long value) {
+        _string(B, Cbor_Text, key);
+        _integer(B, value);
+}
+
+
+static void _unsigned(StringBuffer_T B, const char *key, unsigned long long value) {
+        _string(B, Cbor_Text, key);
+        _head(B, Cbor_Unsigned, value);
+}
+
+
+static void _float(StringBuffer_T B, const char *key, double value) {
+        _string(B, Cbor_Text, key);
+        _double(B, value);
+}
+
+
+static void _text(StringBuffer_T B, const char *key, const char *value) {
+        _string(B, Cbor_Text, key);
+        _string(B, Cbor_Text, value);
+}
+
+
+static void _bytes(StringBuffer_T B, const char *key, const char *value) {
+        _string(B, Cbor_Text, key);
+        _string(B, Cbor_Bytes, value);
+}
+
+
+/**
+ * Prints a document header into the given buffer.
+ * @param B StringBuffer object
+ * @param myip The client-side IP address
+ */
+static void document_head(StringBuffer_T B, const char *myip) {
+        _head(B, Cbor_Tag, 55799); // Self-described CBOR
+        _open(B, Cbor_Map);
+        _int(B, "schema", SCHEMA);
+        _text(B, "id", Run.id);
+        _int(B, "incarnation", (long long)Run.incarnation);
+        _text(B, "version", VERSION);
+        _map(B, "server");
+        _int(B, "uptime", (long long)(Time_now() - Run.incarnation));
+        _int(B, "poll", Run.polltime);
+        _int(B, "startdelay", Run.startdelay);
+        _text(B, "localhostname", Run.system->name);
+        _text(B, "controlfile", Run.files.control);
+        if (Run.httpd.flags & Httpd_Net || Run.httpd.flags & Httpd_Unix) {
+                _map(B, "httpd");
+                if (Run.httpd.flags & Httpd_Net) {
+                        _text(B, "address", Run.httpd.socket.net.address ? Run.httpd.socket.net.address : myip);
+                        _int(B, "port", Run.httpd.socket.net.port);
+                        _int(B, "ssl", Run.httpd.socket.net.ssl.flags & SSL_Enabled);
+                } else {
+                        _text(B, "unixsocket", Run.httpd.socket.unix.path);
+                }
+                _close(B);
+                if (Run.mmonitcredentials) {
+                        _map(B, "credentials");
+                        _text(B, "username", Run.mmonitcredentials->uname);
+                        _text(B, "password", Run.mmonitcredentials->passwd);
+                        _close(B);
+                }
+        }
+        _close(B);
+        _map(B, "platform");
+        _text(B, "name", systeminfo.uname.sysname);
+        _text(B, "release", systeminfo.uname.release);
+        _text(B, "version", systeminfo.uname.version);
+        _text(B, "machine", systeminfo.uname.machine);
+        _int(B, "cpu", systeminfo.cpu.count);
+        _unsigned(B, "memory", (unsigned long long)((double)systeminfo.memory.size / 1024.)); // Send as kB to match the XML status
+        _unsigned(B, "swap", (unsigned long long)((double)systeminfo.swap.size / 1024.));     // Send as kB to match the XML status
+        _close(B);
+}
+
+
+static void _counter(StringBuffer_T B, const char *name, long long now, long long total) {
+        _map(B, name);
+        _int(B, "now", now);
+        _int(B, "total", total);
+        _close(B);
+}
+
+
+static void _statistics(StringBuffer_T B, const char *name, Statistics_T statistics) {
+        if (Statistics_initialized(statistics)) {
+                _map(B, name);
+                _float(B, "count", Statistics_deltaNormalize(statistics)); // per second
+                _unsigned(B, "total", Statistics_raw(statistics));         // since boot
+                _close(B);
+        }
+}
+
+
+static void _ioStatistics(StringBuffer_T B, const char *name, IOStatistics_T statistics) {
+        _map(B, name);
+        _statistics(B, "bytesgeneric", &(statistics->bytes));
+        _statistics(B, "bytes", &(statistics->bytesPhysical));
+        _statistics(B, "operations", &(statistics->operations));
+        _close(B);
+}
+
+
+static void _timestamps(StringBuffer_T B, unsigned long long access, unsigned long long change, unsigned long long modify) {
+        _map(B, "timestamps");
+        _unsigned(B, "access", access);
+        _unsigned(B, "change", change);
+        _unsigned(B, "modify", modify);
+        _close(B);
+}
+
+
+static void _ownership(StringBuffer_T B, int mode, int uid, int gid) {
+        _int(B, "mode", mode & 07777);
+        _int(B, "uid", uid);
+        _int(B, "gid", gid);
+}
+
+
+/**
+ * Prints a service status into the given buffer.
+ * @param S Service object
+ * @param B StringBuffer object
+ */
+static void status_service(Service_T S, StringBuffer_T B) {
+        _open(B, Cbor_Map);
+        _text(B, "name", S->name);
+        _int(B, "type", S->type);
+        _int(B, "collected_sec", (long long)S->collected.tv_sec);
+        _int(B, "collected_usec", (long long)S->collected.tv_usec);
+        _int(B, "status", S->error);
+        _int(B, "status_hint", S->error_hint);
+        _int(B, "monitor", S->monitor);
+        _int(B, "monitormode", S->mode);
+        _int(B, "onreboot", S->onreboot);
+        _int(B, "pendingaction", S->doaction);
+        if (S->every.type != Every_Cycle) {
+                _map(B, "every");
+                _int(B, "type", S->every.type);
+                if (S->every.type == Every_SkipCycles) {
+                        _int(B, "counter", S->every.spec.cycle.counter);
+                        _int(B, "number", S->every.spec.cycle.number);
+                } else if (S->every.type == Every_Interval) {
+                        _int(B, "interval", S->every.spec.interval);
+                } else {
+                        _text(B, "cron", S->every.spec.cron.string);
+                }
+                _close(B);
+        }
+        if (Util_hasServiceStatus(S)) {
+                switch (S->type) {
+                        case Service_System:
+                                _map(B, "filedescriptors");
+                                _int(B, "allocated", systeminfo.filedescriptors.allocated);
+                                _int(B, "unused", systeminfo.filedescriptors.unused);
+                                _int(B, "maximum", systeminfo.filedescriptors.maximum);
+                                _close(B);
+                                break;
+
+                        case Service_File:
+                                _ownership(B, S->inf.file->mode, S->inf.file->uid, S->inf.file->gid);
+                                _timestamps(B, S->inf.file->timestamp.access, S->inf.file->timestamp.change, S->inf.file->timestamp.modify);
+                                _int(B, "size", (long long)S->inf.file->size);
+                                if (S->checksum) {
+                                        _map(B, "checksum");
+                                        _text(B, "type", checksumnames[S->checksum->type]);
+                                        _text(B, "value", S->inf.file->cs_sum);
+                                        _close(B);
+                                }
+                                break;
+
+                        case Service_Directory:
+                                _ownership(B, S->inf.directory->mode, S->inf.directory->uid, S->inf.directory->gid);
+                                _timestamps(B, S->inf.directory->timestamp.access, S->inf.directory->timestamp.change, S->inf.directory->timestamp.modify);
+                                if (S->inf.directory->tree.collected) {
+                                        _map(B, "tree");
+                                        _unsigned(B, "size", S->inf.directory->tree.size);
+                                        _unsigned(B, "files", S->inf.directory->tree.files);
+                                        _int(B, "oldest", (long long)S->inf.directory->tree.oldest);
+                                        _int(B, "newest", (long long)S->inf.directory->tree.newest);
+                                        _close(B);
+                                }
+                                break;
+
+                        case Service_Fifo:
+                                _ownership(B, S->inf.fifo->mode, S->inf.fifo->uid, S->inf.fifo->gid);
+                                _timestamps(B, S->inf.fifo->timestamp.access, S->inf.fifo->timestamp.change, S->inf.fifo->timestamp.modify);
+                                break;
+
+                        case Service_Filesystem:
+                                _text(B, "fstype", S->inf.filesystem->object.type);
+                                _text(B, "fsflags", S->inf.filesystem->flags);
+                                _ownership(B, S->inf.filesystem->mode, S->inf.filesystem->uid, S->inf.filesystem->gid);
+                                _map(B, "block");
+                                _float(B, "percent", S->inf.filesystem->space_percent);
+                                _float(B, "usage", S->inf.filesystem->f_bsize > 0 ? (double)S->inf.filesystem->f_blocksused / 1048576. * (double)S->inf.filesystem->f_bsize : 0.);
+                                _float(B, "total", S->inf.filesystem->f_bsize > 0 ? (double)S->inf.filesystem->f_blocks / 1048576. * (double)S->inf.filesystem->f_bsize : 0.);
+                                _close(B);
+                                if (S->inf.filesystem->f_files > 0) {
+                                        _map(B, "inode");
+                                        _float(B, "percent", S->inf.filesystem->inode_percent);
+                                        _int(B, "usage", S->inf.filesystem->f_filesused);
+                                        _int(B, "total", S->inf.filesystem->f_files);
+                                        _close(B);
+                                }
+                                _ioStatistics(B, "read", &(S->inf.filesystem->read));
+                                _ioStatistics(B, "write", &(S->inf.filesystem->write));
+                                if (Statistics_initialized(&(S->inf.filesystem->time.read)) || Statistics_initialized(&(S->inf.filesystem->time.write)) || Statistics_initialized(&(S->inf.filesystem->time.wait)) || Statistics_initialized(&(S->inf.filesystem->time.run))) {
+                                        _map(B, "servicetime");
+                                        if (Statistics_initialized(&(S->inf.filesystem->time.read)))
+                                                _float(B, "read", Statistics_deltaNormalize(&(S->inf.filesystem->time.read)));
+                                        if (Statistics_initialized(&(S->inf.filesystem->time.write)))
+                                                _float(B, "write", Statistics_deltaNormalize(&(S->inf.filesystem->time.write)));
+                                        if (Statistics_initialized(&(S->inf.filesystem->time.wait)))
+                                                _float(B, "wait", Statistics_deltaNormalize(&(S->inf.filesystem->time.wait)));
+                                        if (Statistics_initialized(&(S->inf.filesystem->time.run)))
+                                                _float(B, "run", Statistics_deltaNormalize(&(S->inf.filesystem->time.run)));
+                                        _close(B);
+                                }
+                                break;
+
+                        case Service_Net:
+                                _map(B, "link");
+                                _int(B, "state", Link_getState(S->inf.net->stats));
+                                _int(B, "speed", Link_getSpeed(S->inf.net->stats));
+                                _int(B, "duplex", Link_getDuplex(S->inf.net->stats));
+                                _map(B, "download");
+                                _counter(B, "packets", Link_getPacketsInPerSecond(S->inf.net->stats), Link_getPacketsInTotal(S->inf.net->stats));
+                                _counter(B, "bytes", Link_getBytesInPerSecond(S->inf.net->stats), Link_getBytesInTotal(S->inf.net->stats));
+                                _counter(B, "errors", Link_getErrorsInPerSecond(S->inf.net->stats), Link_getErrorsInTotal(S->inf.net->stats));
+                                _close(B);
+                                _map(B, "upload");
+                                _counter(B, "packets", Link_getPacketsOutPerSecond(S->inf.net->stats), Link_getPacketsOutTotal(S->inf.net->stats));
+                                _counter(B, "bytes", Link_getBytesOutPerSecond(S->inf.net->stats), Link_getBytesOutTotal(S->inf.net->stats));
+                                _counter(B, "errors", Link_getErrorsOutPerSecond(S->inf.net->stats), Link_getErrorsOutTotal(S->inf.net->stats));
+                                _close(B);
+                                _close(B);
+                                break;
+
+                        case Service_Process:
+                                _int(B, "pid", S->inf.process->pid);
+                                _int(B, "ppid", S->inf.process->ppid);
+                                _int(B, "uid", S->inf.process->uid);
+                                _int(B, "euid", S->inf.process->euid);
+                                _int(B, "gid", S->inf.process->gid);
+                                _int(B, "uptime", (long long)S->inf.process->uptime);
+                                if (Run.flags & Run_ProcessEngineEnabled) {
+                                        _int(B, "threads", S->inf.process->threads);
+                                        _int(B, "children", S->inf.process->children);
+                                        _map(B, "memory");
+                                        _float(B, "percent", S->inf.process->mem_percent);
+                                        _float(B, "percenttotal", S->inf.process->total_mem_percent);
+                                        _unsigned(B, "kilobyte", (unsigned long long)((double)S->inf.process->mem / 1024.));
+                                        _unsigned(B, "kilobytetotal", (unsigned long long)((double)S->inf.process->total_mem / 1024.));
+                                        _close(B);
+                                        _map(B, "cpu");
+                                        _float(B, "percent", S->inf.process->cpu_percent);
+                                        _float(B, "percenttotal", S->inf.process->total_cpu_percent);
+                                        _close(B);
+                                        _map(B, "filedescriptors");
+                                        _int(B, "open", S->inf.process->filedescriptors.open);
+                                        _int(B, "opentotal", S->inf.process->filedescriptors.openTotal);
+                                        _map(B, "limit");
+                                        _int(B, "soft", S->inf.process->filedescriptors.limit.soft);
+                                        _int(B, "hard", S->inf.process->filedescriptors.limit.hard);
+                                        _close(B);
+                                        _close(B);
+                                }
+                                _ioStatistics(B, "read", &(S->inf.process->read));
+                                _ioStatistics(B, "write", &(S->inf.process->write));
+                                break;
+
+                        default:
+                                break;
+                }
+                if (S->icmplist) {
+                        _array(B, "icmp");
+                        for (Icmp_T i = S->icmplist; i; i = i->next) {
+                                _open(B, Cbor_Map);
+                                _text(B, "type", icmpnames[i->type]);
+                                _float(B, "responsetime", i->is_available == Connection_Ok ? i->response / 1000. : -1.); // [s] to match the XML status
+                                _close(B);
+                        }
+                        _close(B);
+                }
+                if (S->portlist) {
+                        _array(B, "port");
+                        for (Port_T p = S->portlist; p; p = p->next) {
+                                _open(B, Cbor_Map);
+                                _text(B, "hostname", p->hostname);
+                                _int(B, "portnumber", p->target.net.port);
+                                _text(B, "request", Util_portRequestDescription(p));
+                                _text(B, "protocol", p->protocol->name);
+                                _text(B, "type", Util_portTypeDescription(p));
+                                _float(B, "responsetime", p->is_available == Connection_Ok ? p->response / 1000. : -1.); // [s] to match the XML status
+                                if (p->target.net.ssl.options.flags) {
+                                        _map(B, "certificate");
+                                        _int(B, "valid", p->target.net.ssl.certificate.validDays);
+                                        _close(B);
+                                }
+                                _close(B);
+                        }
+                        _close(B);
+                }
+                if (S->socketlist) {
+                        _array(B, "unix");
+                        for (Port_T p = S->socketlist; p; p = p->next) {
+                                _open(B, Cbor_Map);
+                                _text(B, "path", p->target.unix.pathname);
+                                _text(B, "protocol", p->protocol->name);
+                                _float(B, "responsetime", p->is_available == Connection_Ok ? p->response / 1000. : -1.); // [s] to match the XML status
+                                _close(B);
+                        }
+                        _close(B);
+                }
+                if (S->type == Service_System) {
+                        _map(B, "system");
+                        _map(B, "load");
+                        _float(B, "avg01", systeminfo.loadavg[0]);
+                        _float(B, "avg05", systeminfo.loadavg[1]);
+                        _float(B, "avg15", systeminfo.loadavg[2]);
+                        _close(B);
+                        _map(B, "cpu");
+                        if (systeminfo.statisticsAvailable & Statistics_CpuUser)
+                                _float(B, "user", systeminfo.cpu.usage.user > 0. ? systeminfo.cpu.usage.user : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuSystem)
+                                _float(B, "system", systeminfo.cpu.usage.system > 0. ? systeminfo.cpu.usage.system : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuNice)
+                                _float(B, "nice", systeminfo.cpu.usage.nice > 0. ? systeminfo.cpu.usage.nice : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuIOWait)
+                                _float(B, "wait", systeminfo.cpu.usage.iowait > 0. ? systeminfo.cpu.usage.iowait : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuHardIRQ)
+                                _float(B, "hardirq", systeminfo.cpu.usage.hardirq > 0. ? systeminfo.cpu.usage.hardirq : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuSoftIRQ)
+                                _float(B, "softirq", systeminfo.cpu.usage.softirq > 0. ? systeminfo.cpu.usage.softirq : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuSteal)
+                                _float(B, "steal", systeminfo.cpu.usage.steal > 0. ? systeminfo.cpu.usage.steal : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuGuest)
+                                _float(B, "guest", systeminfo.cpu.usage.guest > 0. ? systeminfo.cpu.usage.guest : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuGuestNice)
+                                _float(B, "guestnice", systeminfo.cpu.usage.guest_nice > 0. ? systeminfo.cpu.usage.guest_nice : 0.);
+                        _close(B);
+                        _map(B, "memory");
+                        _float(B, "percent", systeminfo.memory.usage.percent);
+                        _unsigned(B, "kilobyte", (unsigned long long)((double)systeminfo.memory.usage.bytes / 1024.));
+                        _close(B);
+                        _map(B, "swap");
+                        _float(B, "percent", systeminfo.swap.usage.percent);
+                        _unsigned(B, "kilobyte", (unsigned long long)((double)systeminfo.swap.usage.bytes / 1024.));
+                        _close(B);
+                        _close(B);
+                }
+                if (S->type == Service_Program && S->program->started) {
+                        _map(B, "program");
+                        _int(B, "started", (long long)S->program->started);
+                        _int(B, "status", S->program->exitStatus);
+                        _bytes(B, "output", StringBuffer_toString(S->program->lastOutput));
+                        _close(B);
+                }
+        }
+        _close(B);
+}
+
+
+/**
+ * Prints a servicegroups into the given buffer.
+ * @param SG ServiceGroup object
+ * @param B StringBuffer object
+ */
+static void status_servicegroup(ServiceGroup_T SG, StringBuffer_T B) {
+        _open(B, Cbor_Map);
+        _text(B, "name", SG->name);
+        _array(B, "services");
+        for (list_t m = SG->members->head; m; m = m->next)
+                _string(B, Cbor_Text, ((Service_T)m->e)->name);
+        _close(B);
+        _close(B);
+}
+
+
+/**
+ * Prints a event description into the given buffer.
+ * @param E Event object
+ * @param B StringBuffer object
+ */
+static void status_event(Event_T E, StringBuffer_T B) {
+        _map(B, "event");
+        _int(B, "collected_sec", (long long)E->collected.tv_sec);
+        _int(B, "collected_usec", (long long)E->collected.tv_usec);
+        _text(B, "service", E->id == Event_Instance ? "Monit" : E->source->name);
+        _int(B, "type", E->type);
+        _int(B, "id", E->id);
+        _int(B, "state", E->state);
+        _int(B, "action", Event_get_action(E));
+        _bytes(B, "message", E->message);
+        if (E->source->token)
+                _text(B, "token", E->source->token);
+        _close(B);
+}
+
+
+/**
+ * Append the CBOR status of the service, the fragment cached with the service status snapshot is used if the service
+ * didn't publish a new status since it was encoded
+ */
+static void _statusService(ServiceStatus_T status, Service_T s, StringBuffer_T B) {
+        Service_T S = ServiceStatus_get(status, s);
+        if (! ServiceStatus_getFragment(status, StatusFormat_Cbor, B)) {
+                int start = StringBuffer_length(B);
+                status_service(S, B);
+                ServiceStatus_setFragment(status, StatusFormat_Cbor, StringBuffer_toString(B) + start, StringBuffer_length(B) - start);
+        }
+}
+
+
+/**
+ * Get the size of the encoded data item. Only the items without nested
+ * items are supported (integer, string, simple value)
+ * @param item The item
+ * @return The item size in bytes
+ */
+static int _itemSize(const unsigned char *item) {
+        int info = *item & 0x1f, type = *item >> 5;
+        int size = info < 24 ? 0 : info == 24 ? 1 : info == 25 ? 2 : info == 26 ? 4 : 8;
+        uint64_t value = info < 24 ? (uint64_t)info : 0;
+        for (int i = 1; i <= size; i++)
+                value = value << 8 | item[i];
+        return 1 + size + (type == Cbor_Bytes || type == Cbor_Text ? (int)value : 0);
+}
+
+
+/**
+ * Compute the digest of the service status, the collection timestamp is not
+ * included as it changes every cycle. The service map starts with the name,
+ * type, collected_sec and collected_usec entries (see status_service())
+ * @param status The CBOR encoded service status
+ * @param length The status length
+ * @return The status digest
+ */
+static uint64_t _serviceDigest(const unsigned char *status, int length) {
+        uint64_t hash = 14695981039346656037ULL; // FNV-1a
+        int skip = 1, resume;
+        for (int i = 0; i < 4 && skip < length; i++)
+                skip += _itemSize(status + skip);
+        resume = skip;
+        for (int i = 0; i < 4 && resume < length; i++)
+                resume += _itemSize(status + resume);
+        if (resume > length)
+                skip = resume = length;
+        for (int i = 0; i < length; i++) {
+                if (i == skip)
+                        i = resume;
+                if (i < length) {
+                        hash ^= status[i];
+                        hash *= 1099511628211ULL;
+                }
+        }
+        return hash;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+/**
+ * Get a CBOR encoded message for event notification or general status
+ * of monitored services and resources.
+ * @param E An event object or NULL for general status
+ * @param myip The client-side IP address
+ */
+void status_cbor(StringBuffer_T B, Event_T E, const char *myip) {
+        ServiceStatus_T status = ServiceStatus_new();
+        document_head(B, myip);
+        _array(B, "services");
+        for (Service_T S = servicelist_conf; S; S = S->next_conf)
+                _statusService(status, S, B);
+        _close(B);
+        ServiceStatus_delete(&status);
+        _array(B, "servicegroups");
+        for (ServiceGroup_T SG = servicegrouplist; SG; SG = SG->next)
+                status_servicegroup(SG, B);
+        _close(B);
+        if (E)
+                status_event(E, B);
+        _close(B);
+}
+
+
+/**
+ * Get the CBOR encoded status message with the services whose status
+ * changed since the last message, for the MQTT publisher (see Mqtt.c). The
+ * digests array holds the status digest of each service (in the
+ * configuration order) sent last time and is updated with the current
+ * digests. The service maps are the same as in status_cbor()
+ * @param B StringBuffer object
+ * @param digests The service status digests
+ * @param count The number of digests, must match the number of services
+ * @param full true to send all services
+ * @return The number of services in the message
+ */
+int status_cbor_changes(StringBuffer_T B, uint64_t *digests, int count, bool full) {
+        int i = 0, changed = 0;
+        ServiceStatus_T status = ServiceStatus_new();
+        _head(B, Cbor_Tag, 55799); // Self-described CBOR
+        _open(B, Cbor_Map);
+        _int(B, "schema", SCHEMA);
+        _text(B, "id", Run.id);
+        _int(B, "incarnation", (long long)Run.incarnation);
+        _text(B, "localhostname", Run.system->name);
+        _int(B, "full", full);
+        _array(B, "services");
+        for (Service_T S = servicelist_conf; S && i < count; S = S->next_conf, i++) {
+                int start = StringBuffer_length(B);
+                _statusService(status, S, B);
+                uint64_t digest = _serviceDigest((const unsigned char *)StringBuffer_toString(B) + start, StringBuffer_length(B) - start);
+                if (full || digest != digests[i]) {
+                        digests[i] = digest;
+                        changed++;
+                } else {
+                        StringBuffer_delete(B, start);
+                }
+        }
+        _close(B);
+        ServiceStatus_delete(&status);
+        _close(B);
+        return changed;
+}
+
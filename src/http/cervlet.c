@@ -64,10 +64,18 @@
 #include <sys/time.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
 #ifdef HAVE_CTYPE_H
 #include <ctype.h>
 #endif
 
+#ifdef HAVE_MATH_H
+#include <math.h>
+#endif
+
 // libmonit
 #include "system/Time.h"
 #include "util/Convert.h"
@@ -85,6 +93,10 @@
 #include "protocol.h"
 #include "Color.h"
 #include "Box.h"
+#include "ServiceStatus.h"
+#include "MMonit.h"
+#include "Cluster.h"
+#include "eventstream.h"
 
 
 #define ACTION(c) ! strncasecmp(req->url, c, sizeof(c))
@@ -96,14 +108,27 @@
 #define ABOUT       "/_about"
 #define PING        "/_ping"
 #define GETID       "/_getid"
+#define GETCLUSTER  "/_cluster"
 #define STATUS      "/_status"
 #define STATUS2     "/_status2"
 #define SUMMARY     "/_summary"
 #define REPORT      "/_report"
 #define RUNTIME     "/_runtime"
+#define PROFILE     "/_runtime/profile"
 #define VIEWLOG     "/_viewlog"
 #define DOACTION    "/_doaction"
 #define FAVICON     "/favicon.ico"
+#define METRICS     "/metrics"
+#define SERIES      "/_series"
+#define MEMORY      "/_memory"
+#define EVENTS      "/_events"
+#define PROCESSES   "/_processes"
+
+/* Default number of log lines shown on the view log page */
+#define LOG_LINES   1000
+
+/* Default number of the processes shown by the top processes view */
+#define TOP_PROCESSES 20
 
 
 typedef enum {
@@ -120,23 +145,16 @@ static void doPost(HttpRequest, HttpResponse);
 static void do_head(HttpResponse res, const char *path, const char *name, int refresh);
 static void do_foot(HttpResponse res);
 static void do_home(HttpResponse);
-static void do_home_system(HttpResponse);
-static void do_home_filesystem(HttpResponse);
-static void do_home_directory(HttpResponse);
-static void do_home_file(HttpResponse);
-static void do_home_fifo(HttpResponse);
-static void do_home_net(HttpResponse);
-static void do_home_process(HttpResponse);
-static void do_home_program(HttpResponse);
-static void do_home_host(HttpResponse);
 static void do_about(HttpResponse);
 static void do_ping(HttpResponse);
 static void do_getid(HttpResponse);
+static void do_getcluster(HttpResponse);
 static void do_runtime(HttpRequest, HttpResponse);
 static void do_viewlog(HttpRequest, HttpResponse);
 static void handle_service(HttpRequest, HttpResponse);
 static void handle_service_action(HttpRequest, HttpResponse);
 static void handle_doaction(HttpRequest, HttpResponse);
+static void handle_collector(HttpRequest, HttpResponse);
 static void handle_runtime(HttpRequest, HttpResponse);
 static void handle_runtime_action(HttpRequest, HttpResponse);
 static void is_monit_running(HttpResponse);
@@ -157,6 +175,7 @@ static void print_service_rules_timestamp(HttpResponse, Service_T);
 static void print_service_rules_fsflags(HttpResponse, Service_T);
 static void print_service_rules_filesystem(HttpResponse, Service_T);
 static void print_service_rules_size(HttpResponse, Service_T);
+static void print_service_rules_filecount(HttpResponse, Service_T);
 static void print_service_rules_linkstatus(HttpResponse, Service_T);
 static void print_service_rules_linkspeed(HttpResponse, Service_T);
 static void print_service_rules_linksaturation(HttpResponse, Service_T);
@@ -165,6 +184,7 @@ static void print_service_rules_uploadpackets(HttpResponse, Service_T);
 static void print_service_rules_downloadbytes(HttpResponse, Service_T);
 static void print_service_rules_downloadpackets(HttpResponse, Service_T);
 static void print_service_rules_uptime(HttpResponse, Service_T);
+static void print_service_rules_latency(HttpResponse, Service_T);
 static void print_service_rules_content(HttpResponse, Service_T);
 static void print_service_rules_checksum(HttpResponse, Service_T);
 static void print_service_rules_pid(HttpResponse, Service_T);
@@ -174,7 +194,15 @@ static void print_service_rules_resource(HttpResponse, Service_T);
 static void print_service_rules_secattr(HttpResponse, Service_T);
 static void print_service_rules_filedescriptors(HttpResponse, Service_T);
 static void print_status(HttpRequest, HttpResponse, int);
+static void _printStatusText(HttpRequest, HttpResponse);
+static void print_status_json(HttpRequest, HttpResponse);
 static void print_summary(HttpRequest, HttpResponse);
+static void print_metrics(HttpResponse);
+static void print_series(HttpRequest, HttpResponse);
+static void print_profile(HttpResponse);
+static void print_memory(HttpRequest, HttpResponse);
+static void print_events(HttpRequest, HttpResponse);
+static void print_processes(HttpRequest, HttpResponse);
 static void _printReport(HttpRequest req, HttpResponse res);
 static void status_service_txt(Service_T, HttpResponse);
 static char *get_monitoring_status(Output_Type, Service_T s, char *, int);
@@ -203,33 +231,43 @@ void init_service() {
 }
 
 
+char *get_service_status_text(Service_T s, char *buf, int buflen) {
+        return get_service_status(TXT, s, buf, buflen);
+}
+
+
 /* ----------------------------------------------------------------- Private */
 
 
-static char *_getUptime(time_t delta, char s[256]) {
-        static int min = 60;
-        static int hour = 3600;
-        static int day = 86400;
-        long rest_d;
-        long rest_h;
-        long rest_m;
-        char *p = s;
+/**
+ * Get the reader buffer of the status snapshots published by the validator.
+ * The cervlet is serialized by the processor, so one buffer is enough: the
+ * snapshot is valid until the next call
+ */
+static ServiceStatus_T _getBuffer(void) {
+        static ServiceStatus_T buffer = NULL;
+        if (! buffer)
+                buffer = ServiceStatus_new();
+        return buffer;
+}
 
-        if (delta < 0) {
-                *s = 0;
-        } else {
-                if ((rest_d = delta / day) > 0) {
-                        p += snprintf(p, 256 - (p - s), "%ldd ", rest_d);
-                        delta -= rest_d * day;
-                }
-                if ((rest_h = delta / hour) > 0 || (rest_d > 0)) {
-                        p += snprintf(p, 256 - (p - s), "%ldh ", rest_h);
-                        delta -= rest_h * hour;
-                }
-                rest_m = delta / min;
-                snprintf(p, 256 - (p - s), "%ldm", rest_m);
+
+static Service_T _getStatus(Service_T s) {
+        return ServiceStatus_get(_getBuffer(), s);
+}
+
+
+/**
+ * Print the text status of the service, the fragment cached with the status
+ * snapshot is used if the service didn't publish a new status since
+ */
+static void _statusServiceText(ServiceStatus_T status, Service_T s, HttpResponse res) {
+        Service_T S = ServiceStatus_get(status, s);
+        if (! ServiceStatus_getFragment(status, StatusFormat_Text, res->outputbuffer)) {
+                int start = StringBuffer_length(res->outputbuffer);
+                status_service_txt(S, res);
+                ServiceStatus_setFragment(status, StatusFormat_Text, StringBuffer_toString(res->outputbuffer) + start, StringBuffer_length(res->outputbuffer) - start);
         }
-        return s;
 }
 
 
@@ -270,7 +308,7 @@ __attribute__((format (printf, 7, 8))) static void _formatStatus(const char *nam
                                         column = 0;
                                         continue;
                                 } else if (column <= 200) {
-                                        StringBuffer_append(res->outputbuffer, "%c", _value[i]);
+                                        StringBuffer_appendChar(res->outputbuffer, _value[i]);
                                         column++;
                                 }
                         }
@@ -302,6 +340,15 @@ static void _printIOStatistics(Output_Type type, HttpResponse res, Service_T s,
 }
 
 
+static void _printTcpStatistics(Output_Type type, HttpResponse res, Service_T s, Statistics_T statistics, const char *name) {
+        if (Statistics_initialized(statistics)) {
+                char header[STRLEN];
+                snprintf(header, sizeof(header), "tcp %s bytes", name);
+                _formatStatus(header, Event_Resource, type, res, s, true, "%s/s [%s total]", Convert_bytes2str(Statistics_deltaNormalize(statistics), (char[10]){}), Convert_bytes2str(Statistics_raw(statistics), (char[10]){}));
+        }
+}
+
+
 static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
         if (Util_hasServiceStatus(s)) {
                 switch (s->type) {
@@ -331,7 +378,11 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                         StringBuffer_free(&sb);
                                         _formatStatus("memory usage", Event_Resource, type, res, s, true, "%s [%.1f%%]", Convert_bytes2str(systeminfo.memory.usage.bytes, (char[10]){}), systeminfo.memory.usage.percent);
                                         _formatStatus("swap usage", Event_Resource, type, res, s, true, "%s [%.1f%%]", Convert_bytes2str(systeminfo.swap.usage.bytes, (char[10]){}), systeminfo.swap.usage.percent);
-                                        _formatStatus("uptime", Event_Uptime, type, res, s, systeminfo.booted > 0, "%s", _getUptime(Time_now() - systeminfo.booted, (char[256]){}));
+                                        if (systeminfo.memory.hugepages.size > 0ULL)
+                                                _formatStatus("hugepages usage", Event_Resource, type, res, s, true, "%s [%.1f%% of %s]", Convert_bytes2str(systeminfo.memory.hugepages.usage.bytes, (char[10]){}), systeminfo.memory.hugepages.usage.percent, Convert_bytes2str(systeminfo.memory.hugepages.size, (char[10]){}));
+                                        if (systeminfo.memory.hugepages.anonymous > 0ULL)
+                                                _formatStatus("transparent hugepages", Event_Null, type, res, s, true, "%s", Convert_bytes2str(systeminfo.memory.hugepages.anonymous, (char[10]){}));
+                                        _formatStatus("uptime", Event_Uptime, type, res, s, systeminfo.booted > 0, "%s", Util_getUptime(Time_now() - systeminfo.booted, (char[256]){}));
                                         _formatStatus("boot time", Event_Null, type, res, s, true, "%s", Time_string(systeminfo.booted, (char[32]){}));
                                         if (systeminfo.statisticsAvailable & Statistics_FiledescriptorsPerSystem) {
                                                 if (systeminfo.filedescriptors.maximum > 0)
@@ -363,6 +414,12 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                 _formatStatus("access timestamp", Event_Timestamp, type, res, s, s->inf.directory->timestamp.access > 0, "%s", Time_string(s->inf.directory->timestamp.access, (char[32]){}));
                                 _formatStatus("change timestamp", Event_Timestamp, type, res, s, s->inf.directory->timestamp.change > 0, "%s", Time_string(s->inf.directory->timestamp.change, (char[32]){}));
                                 _formatStatus("modify timestamp", Event_Timestamp, type, res, s, s->inf.directory->timestamp.modify > 0, "%s", Time_string(s->inf.directory->timestamp.modify, (char[32]){}));
+                                if (s->inf.directory->tree.collected) {
+                                        _formatStatus("size", Event_Size, type, res, s, true, "%s", Convert_bytes2str(s->inf.directory->tree.size, (char[10]){}));
+                                        _formatStatus("files", Event_Resource, type, res, s, true, "%llu", s->inf.directory->tree.files);
+                                        _formatStatus("oldest file timestamp", Event_Timestamp, type, res, s, s->inf.directory->tree.oldest > 0, "%s", Time_string(s->inf.directory->tree.oldest, (char[32]){}));
+                                        _formatStatus("newest file timestamp", Event_Timestamp, type, res, s, s->inf.directory->tree.newest > 0, "%s", Time_string(s->inf.directory->tree.newest, (char[32]){}));
+                                }
                                 break;
 
                         case Service_Fifo:
@@ -444,14 +501,20 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                 _formatStatus("uid", Event_Uid, type, res, s, s->inf.process->uid >= 0, "%d", s->inf.process->uid);
                                 _formatStatus("effective uid", Event_Uid, type, res, s, s->inf.process->euid >= 0, "%d", s->inf.process->euid);
                                 _formatStatus("gid", Event_Gid, type, res, s, s->inf.process->gid >= 0, "%d", s->inf.process->gid);
-                                _formatStatus("uptime", Event_Uptime, type, res, s, s->inf.process->uptime >= 0, "%s", _getUptime(s->inf.process->uptime, (char[256]){}));
+                                _formatStatus("uptime", Event_Uptime, type, res, s, s->inf.process->uptime >= 0, "%s", Util_getUptime(s->inf.process->uptime, (char[256]){}));
                                 if (Run.flags & Run_ProcessEngineEnabled) {
                                         _formatStatus("threads", Event_Resource, type, res, s, s->inf.process->threads >= 0, "%d", s->inf.process->threads);
                                         _formatStatus("children", Event_Resource, type, res, s, s->inf.process->children >= 0, "%d", s->inf.process->children);
                                         _formatStatus("cpu", Event_Resource, type, res, s, s->inf.process->cpu_percent >= 0, "%.1f%%", s->inf.process->cpu_percent);
                                         _formatStatus("cpu total", Event_Resource, type, res, s, s->inf.process->total_cpu_percent >= 0, "%.1f%%", s->inf.process->total_cpu_percent);
+                                        if (s->inf.process->thread_cpu_percent >= 0)
+                                                _formatStatus("cpu max thread", Event_Resource, type, res, s, true, "%.1f%%", s->inf.process->thread_cpu_percent);
                                         _formatStatus("memory", Event_Resource, type, res, s, s->inf.process->mem_percent >= 0, "%.1f%% [%s]", s->inf.process->mem_percent, Convert_bytes2str(s->inf.process->mem, (char[10]){}));
                                         _formatStatus("memory total", Event_Resource, type, res, s, s->inf.process->total_mem_percent >= 0, "%.1f%% [%s]", s->inf.process->total_mem_percent, Convert_bytes2str(s->inf.process->total_mem, (char[10]){}));
+                                        if (s->inf.process->pss >= 0)
+                                                _formatStatus("memory pss", Event_Resource, type, res, s, true, "%s", Convert_bytes2str(s->inf.process->pss, (char[10]){}));
+                                        if (s->inf.process->uss >= 0)
+                                                _formatStatus("memory uss", Event_Resource, type, res, s, true, "%s", Convert_bytes2str(s->inf.process->uss, (char[10]){}));
 #ifdef LINUX
                                         _formatStatus("security attribute", Event_Invalid, type, res, s, *(s->inf.process->secattr), "%s", s->inf.process->secattr);
                                         long long limit = s->inf.process->filedescriptors.limit.soft < s->inf.process->filedescriptors.limit.hard ? s->inf.process->filedescriptors.limit.soft : s->inf.process->filedescriptors.limit.hard;
@@ -464,6 +527,13 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                 }
                                 _printIOStatistics(type, res, s, &(s->inf.process->read), "read");
                                 _printIOStatistics(type, res, s, &(s->inf.process->write), "write");
+                                _printTcpStatistics(type, res, s, &(s->inf.process->tcp.sent), "sent");
+                                _printTcpStatistics(type, res, s, &(s->inf.process->tcp.received), "received");
+                                // The delay [ns] per second of the wall time
+                                if (Statistics_initialized(&(s->inf.process->ioDelay)))
+                                        _formatStatus("io delay", Event_Resource, type, res, s, true, "%.1f%%", Statistics_deltaNormalize(&(s->inf.process->ioDelay)) / 1e7);
+                                if (s->inf.process->connections.total >= 0)
+                                        _formatStatus("tcp connections", Event_Resource, type, res, s, true, "%d [%d established, %d close wait, %d listening]", s->inf.process->connections.total, s->inf.process->connections.established, s->inf.process->connections.closeWait, s->inf.process->connections.listen);
                                 break;
 
                         case Service_Program:
@@ -480,7 +550,7 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                         if (i->is_available == Connection_Failed)
                                 _formatStatus("ping response time", Event_Icmp, type, res, s, true, "connection failed");
                         else
-                                _formatStatus("ping response time", Event_Null, type, res, s, i->is_available != Connection_Init && i->response >= 0., "%s", Convert_time2str(i->response, (char[11]){}));
+                                _formatStatus("ping response time", Event_Null, type, res, s, i->is_available != Connection_Init && i->response >= 0., "%s (min %s, max %s, packet loss %.0f%%)", Convert_time2str(i->response, (char[11]){}), Convert_time2str(i->statistics.min, (char[11]){}), Convert_time2str(i->statistics.max, (char[11]){}), i->statistics.loss);
                 }
                 for (Port_T p = s->portlist; p; p = p->next) {
                         if (p->is_available == Connection_Failed) {
@@ -489,7 +559,7 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                 char buf[STRLEN] = {};
                                 if (p->target.net.ssl.options.flags)
                                         snprintf(buf, sizeof(buf), "using TLS (certificate valid for %d days) ", p->target.net.ssl.certificate.validDays);
-                                _formatStatus("port response time", p->target.net.ssl.certificate.validDays < p->target.net.ssl.certificate.minimumDays ? Event_Timestamp : Event_Null, type, res, s, p->is_available != Connection_Init, "%s to %s:%d%s type %s/%s %sprotocol %s", Convert_time2str(p->response, (char[11]){}), p->hostname, p->target.net.port, Util_portRequestDescription(p), Util_portTypeDescription(p), Util_portIpDescription(p), buf, p->protocol->name);
+                                _formatStatus("port response time", p->target.net.ssl.certificate.validDays < p->target.net.ssl.certificate.minimumDays ? Event_Timestamp : Event_Null, type, res, s, p->is_available != Connection_Init, "%s to %s:%d%s type %s/%s %sprotocol %s (name resolution %s)", Convert_time2str(p->response, (char[11]){}), p->hostname, p->target.net.port, Util_portRequestDescription(p), Util_portTypeDescription(p), Util_portIpDescription(p), buf, p->protocol->name, Convert_time2str(p->resolution, (char[11]){}));
                         }
                 }
                 for (Port_T p = s->socketlist; p; p = p->next) {
@@ -499,6 +569,46 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                 _formatStatus("unix socket response time", Event_Null, type, res, s, p->is_available != Connection_Init, "%s to %s type %s protocol %s", Convert_time2str(p->response, (char[11]){}), p->target.unix.pathname, Util_portTypeDescription(p), p->protocol->name);
                         }
                 }
+                Port_T lists[] = {s->portlist, s->socketlist};
+                for (int i = 0; i < 2; i++) {
+                        for (Port_T p = lists[i]; p; p = p->next) {
+                                if (p->protocol->check == check_redis && p->is_available == Connection_Ok && p->statistics.redis.available) {
+                                        char lag[32] = "link down";
+                                        if (p->statistics.redis.lag >= 0)
+                                                snprintf(lag, sizeof(lag), "%d s", p->statistics.redis.lag);
+                                        _formatStatus("redis statistics", Event_Null, type, res, s, true, "used memory %s, %d clients, %d operations/s, replication lag %s", Convert_bytes2str(p->statistics.redis.memory, (char[10]){}), p->statistics.redis.clients, p->statistics.redis.operations, lag);
+                                } else if (p->protocol->check == check_mysql && p->is_available == Connection_Ok && p->statistics.mysql.available) {
+                                        char lag[32] = "not a replica";
+                                        if (p->statistics.mysql.replica) {
+                                                if (p->statistics.mysql.lag >= 0)
+                                                        snprintf(lag, sizeof(lag), "%d s", p->statistics.mysql.lag);
+                                                else
+                                                        snprintf(lag, sizeof(lag), "replication stopped");
+                                        }
+                                        _formatStatus("mysql statistics", Event_Null, type, res, s, true, "%d threads running, replication lag %s", p->statistics.mysql.threads, lag);
+                                } else if (p->protocol->check == check_dns && p->is_available != Connection_Init && p->statistics.dns.queries && p->statistics.dns.maximum >= 0) {
+                                        _formatStatus("dns queries", Event_Null, type, res, s, true, "%d queries, %d failed, latency median %s, p95 %s, max %s", p->statistics.dns.queries, p->statistics.dns.failed, Convert_time2str(p->statistics.dns.median / 1000., (char[11]){}), Convert_time2str(p->statistics.dns.p95 / 1000., (char[11]){}), Convert_time2str(p->statistics.dns.maximum / 1000., (char[11]){}));
+                                } else if (p->protocol->check == check_pgsql && p->is_available == Connection_Ok && p->statistics.pgsql.available) {
+                                        if (! p->statistics.pgsql.recovery)
+                                                _formatStatus("pgsql statistics", Event_Null, type, res, s, true, "primary");
+                                        else if (p->statistics.pgsql.lag >= 0)
+                                                _formatStatus("pgsql statistics", Event_Null, type, res, s, true, "in recovery, replication lag %d s", p->statistics.pgsql.lag);
+                                        else
+                                                _formatStatus("pgsql statistics", Event_Null, type, res, s, true, "in recovery, no transaction replayed");
+                                } else if (p->protocol->check == check_memcache && p->is_available != Connection_Init && p->statistics.memcache.available) {
+                                        char ratio[16] = "n/a";
+                                        if (p->statistics.memcache.hitRatio >= 0)
+                                                snprintf(ratio, sizeof(ratio), "%.1f%%", p->statistics.memcache.hitRatio);
+                                        _formatStatus("memcache statistics", Event_Null, type, res, s, true, "hit ratio %s, %lld evictions, %d connections", ratio, p->statistics.memcache.evictions, p->statistics.memcache.connections);
+                                } else if (p->protocol->check == check_websocket && p->is_available == Connection_Ok && p->parameters.websocket.pings > 1 && p->statistics.websocket.pings) {
+                                        _formatStatus("websocket round trip", Event_Null, type, res, s, true, "%d pings, min %s, avg %s, max %s, jitter %s", p->statistics.websocket.pings, Convert_time2str(p->statistics.websocket.minimum, (char[11]){}), Convert_time2str(p->statistics.websocket.average, (char[11]){}), Convert_time2str(p->statistics.websocket.maximum, (char[11]){}), Convert_time2str(p->statistics.websocket.jitter, (char[11]){}));
+                                } else if (p->protocol->check == check_kafka && p->is_available != Connection_Init && p->statistics.kafka.available) {
+                                        _formatStatus("kafka statistics", Event_Null, type, res, s, true, "%d brokers, controller %d, %d partitions, %d under-replicated", p->statistics.kafka.brokers, p->statistics.kafka.controller, p->statistics.kafka.partitions, p->statistics.kafka.underReplicated);
+                                } else if (p->protocol->check == check_nats && p->is_available != Connection_Init && *p->statistics.nats.version) {
+                                        _formatStatus("nats statistics", Event_Null, type, res, s, true, "version %s, cluster %s, %d servers", p->statistics.nats.version, *p->statistics.nats.cluster ? p->statistics.nats.cluster : "none", p->statistics.nats.servers);
+                                }
+                        }
+                }
         }
         _formatStatus("data collected", Event_Null, type, res, s, true, "%s", Time_string(s->collected.tv_sec, (char[32]){}));
 }
@@ -566,8 +676,14 @@ static void doPost(HttpRequest req, HttpResponse res) {
                 print_summary(req, res);
         else if (ACTION(REPORT))
                 _printReport(req, res);
+        else if (ACTION(PROFILE))
+                print_profile(res);
+        else if (ACTION(PROCESSES))
+                print_processes(req, res);
         else if (ACTION(DOACTION))
                 handle_doaction(req, res);
+        else if (ACTION(COLLECTOR_URL))
+                handle_collector(req, res);
         else
                 handle_service_action(req, res);
 }
@@ -580,9 +696,7 @@ static void doPost(HttpRequest req, HttpResponse res) {
 static void doGet(HttpRequest req, HttpResponse res) {
         set_content_type(res, "text/html");
         if (ACTION(HOME)) {
-                LOCK(Run.mutex)
                 do_home(res);
-                END_LOCK;
         } else if (ACTION(RUNTIME)) {
                 handle_runtime(req, res);
         } else if (ACTION(TEST)) {
@@ -595,6 +709,8 @@ static void doGet(HttpRequest req, HttpResponse res) {
                 do_ping(res);
         } else if (ACTION(GETID)) {
                 do_getid(res);
+        } else if (ACTION(GETCLUSTER)) {
+                do_getcluster(res);
         } else if (ACTION(STATUS)) {
                 print_status(req, res, 1);
         } else if (ACTION(STATUS2)) {
@@ -603,6 +719,18 @@ static void doGet(HttpRequest req, HttpResponse res) {
                 print_summary(req, res);
         } else if (ACTION(REPORT)) {
                 _printReport(req, res);
+        } else if (ACTION(METRICS)) {
+                print_metrics(res);
+        } else if (ACTION(SERIES)) {
+                print_series(req, res);
+        } else if (ACTION(PROFILE)) {
+                print_profile(res);
+        } else if (ACTION(MEMORY)) {
+                print_memory(req, res);
+        } else if (ACTION(EVENTS)) {
+                print_events(req, res);
+        } else if (ACTION(PROCESSES)) {
+                print_processes(req, res);
         } else {
                 handle_service(req, res);
         }
@@ -639,7 +767,14 @@ static void printFavicon(HttpResponse res) {
 }
 
 
+/**
+ * Print the page head, the page is reloaded after the refresh interval
+ * unless it is zero (the page refreshes its content itself)
+ */
 static void do_head(HttpResponse res, const char *path, const char *name, int refresh) {
+        char meta[STRLEN] = {};
+        if (refresh > 0)
+                snprintf(meta, sizeof(meta), "<meta HTTP-EQUIV='REFRESH' CONTENT=%d> ", refresh);
         StringBuffer_T system_htmlescaped = escapeHTML(StringBuffer_create(16), Run.system->name);
         StringBuffer_append(res->outputbuffer,
                             "<!DOCTYPE html>"\
@@ -687,7 +822,7 @@ static void do_head(HttpResponse res, const char *path, const char *name, int re
                             " #buttons td {padding-right:50px;} "\
                             " #buttons input {font-size:18px;padding:5px;} "\
                             "</style>"\
-                            "<meta HTTP-EQUIV='REFRESH' CONTENT=%d> "\
+                            "%s"\
                             "<meta HTTP-EQUIV='Expires' Content=0> "\
                             "<meta HTTP-EQUIV='Pragma' CONTENT='no-cache'> "\
                             "<meta charset='UTF-8'>" \
@@ -702,7 +837,7 @@ static void do_head(HttpResponse res, const char *path, const char *name, int re
                             "  </tr>"\
                             "</table>"\
                             "<center>",
-                            StringBuffer_toString(system_htmlescaped), refresh, path, name, VERSION);
+                            StringBuffer_toString(system_htmlescaped), meta, path, name, VERSION);
         StringBuffer_free(&system_htmlescaped);
 }
 
@@ -720,8 +855,71 @@ static void do_foot(HttpResponse res) {
 }
 
 
+/**
+ * The dashboard script. The page fetches the selected page of the services
+ * from the JSON status (see json.c) and renders the rows itself, so the
+ * daemon's work per page view doesn't depend on the number of services.
+ * The status is polled with the ETag, so an unchanged status costs 304
+ */
+static const char *_dashboard =
+        "var Q={match:'',type:-1,failed:false,sort:'',offset:0},L=100,tag='',last='',timer=null,delay=null;"
+        "function $(i){return document.getElementById(i);}"
+        "function esc(s){return String(s).replace(/[&<>\"']/g,function(c){return '&#'+c.charCodeAt(0)+';';});}"
+        "function pct(v){return v.toFixed(1)+'%';}"
+        "function bytes(n){var u=['B','kB','MB','GB','TB','PB'],i=0;while(n>=1024&&i<5){n/=1024;i++;}return (i?n.toFixed(1):n)+'&nbsp;'+u[i];}"
+        "function uptime(t){var d=Math.floor(t/86400),h=Math.floor(t%86400/3600),m=Math.floor(t%3600/60);return (d?d+'d ':'')+(d||h?h+'h ':'')+m+'m';}"
+        "function state(s){"
+        " var m=s.monitor,t,a=[];"
+        " if(m==0)t=\"<span class='gray-text'>Not monitored</span>\";"
+        " else if(m&2)t=m&4?'<span>Waiting</span>':\"<span class='blue-text'>Initializing</span>\";"
+        " else if(!s.status)t=\"<span class='green-text'>OK</span>\";"
+        " else{for(var i=0;i<E.length;i++)if(s.status&E[i][0])a.push(s.status_hint&E[i][0]?\"<span class='orange-text'>\"+E[i][2]+'</span>':\"<span class='red-text'>\"+E[i][1]+'</span>');t=a.join(' | ');}"
+        " return s.pendingaction?t+' - '+A[s.pendingaction]+' pending':t;"
+        "}"
+        "function details(s){"
+        " var d=[],x,i;"
+        " switch(s.type){"
+        " case 0:if(s.block)d.push('Space '+pct(s.block.percent)+' ['+bytes(s.block.usage*1048576)+' of '+bytes(s.block.total*1048576)+']');if(s.inode)d.push('Inodes '+pct(s.inode.percent));break;"
+        " case 2:if(s.size!=null)d.push('Size '+bytes(s.size));"
+        " case 1:case 6:if(s.mode!=null)d.push('Permission '+s.mode.toString(8)+', UID '+s.uid+', GID '+s.gid);break;"
+        " case 3:if(s.pid>0&&s.uptime>=0)d.push('Uptime '+uptime(s.uptime));if(s.cpu)d.push('CPU '+pct(s.cpu.percenttotal));if(s.memory)d.push('Memory '+pct(s.memory.percenttotal)+' ['+bytes(s.memory.kilobytetotal*1024)+']');break;"
+        " case 4:for(i=0;s.icmp&&i<s.icmp.length;i++)d.push(esc(s.icmp[i].type)+' '+(s.icmp[i].responsetime<0?'failed':(s.icmp[i].responsetime*1000).toFixed(3)+' ms'));"
+        "  for(i=0;s.port&&i<s.port.length;i++)d.push(esc(s.port[i].hostname+':'+s.port[i].portnumber)+' '+(s.port[i].responsetime<0?'failed':(s.port[i].responsetime*1000).toFixed(3)+' ms'));break;"
+        " case 5:if(x=s.system){d.push('Load ['+x.load.avg01.toFixed(2)+'] ['+x.load.avg05.toFixed(2)+'] ['+x.load.avg15.toFixed(2)+']');if(x.cpu.user!=null)d.push('CPU '+pct(x.cpu.user)+'us '+pct(x.cpu.system||0)+'sy');d.push('Memory '+pct(x.memory.percent)+' ['+bytes(x.memory.kilobyte*1024)+']');d.push('Swap '+pct(x.swap.percent)+' ['+bytes(x.swap.kilobyte*1024)+']');}break;"
+        " case 7:if(s.program)d.push('Exit value '+s.program.status+', last started '+new Date(s.program.started*1000).toLocaleString());break;"
+        " case 8:if(s.link){d.push(s.link.state==1?'Link up':s.link.state==0?'Link down':'Link state unknown');d.push('Download '+bytes(s.link.download.bytes.now)+'/s');d.push('Upload '+bytes(s.link.upload.bytes.now)+'/s');}break;"
+        " }"
+        " return d.join(', ');"
+        "}"
+        "function render(j){"
+        " if(!j.count&&j.offset){Q.offset=Math.max(0,j.total-L);load();return;}"
+        " var h='',i,s;"
+        " for(i=0;i<j.services.length;i++){s=j.services[i];h+='<tr'+(i%2?'':\" class='stripe'\")+\"><td class='left'><a href='\"+encodeURIComponent(s.name)+\"'>\"+esc(s.name)+\"</a></td><td class='left'>\"+T[s.type]+\"</td><td class='left'>\"+state(s)+\"</td><td class='left'>\"+details(s)+'</td></tr>';}"
+        " $('rows').innerHTML=h||\"<tr><td colspan=4 class='center'>No service found</td></tr>\";"
+        " $('page').innerHTML=j.total?(j.offset+1)+'-'+(j.offset+j.count)+' of '+j.total:'';"
+        " $('prev').disabled=j.offset==0;$('next').disabled=j.offset+j.count>=j.total;"
+        "}"
+        "function load(){"
+        " clearTimeout(timer);"
+        " var u='_status?format=json&fields=name,type,status,status_hint,monitor,pendingaction,pid,uptime,cpu,memory,block,inode,size,mode,uid,gid,icmp,port,system,program,link&offset='+Q.offset+'&limit='+L,r=new XMLHttpRequest();"
+        " if(Q.match)u+='&match='+encodeURIComponent(Q.match);"
+        " if(Q.type>=0)u+='&type='+Q.type;"
+        " if(Q.failed)u+='&status=failed';"
+        " if(Q.sort)u+='&sort='+Q.sort;"
+        " r.open('GET',u);"
+        " if(u==last&&tag)r.setRequestHeader('If-None-Match',tag);"
+        " r.onload=function(){if(r.status==200){tag=r.getResponseHeader('ETag');last=u;render(JSON.parse(r.responseText));}timer=setTimeout(load,P*1000);};"
+        " r.onerror=function(){timer=setTimeout(load,P*1000);};"
+        " r.send();"
+        "}"
+        "function filter(){clearTimeout(delay);delay=setTimeout(function(){Q.match=$('match').value;Q.type=+$('type').value;Q.failed=$('failed').checked;Q.offset=0;load();},300);}"
+        "function sort(k){Q.sort=Q.sort==k?'-'+k:k;Q.offset=0;load();}"
+        "function page(n){Q.offset=Math.max(0,Q.offset+n*L);load();}"
+        "load();";
+
+
 static void do_home(HttpResponse res) {
-        do_head(res, "", "", Run.polltime);
+        do_head(res, "", "", 0);
         StringBuffer_T system_htmlescaped = escapeHTML(StringBuffer_create(16), Run.system->name);
         StringBuffer_append(res->outputbuffer,
                             "<table id='header' width='100%%'>"
@@ -731,20 +929,47 @@ static void do_home(HttpResponse res) {
                             "  <p class='center'>Monit is <a href='_runtime'>running</a> on %s and monitoring:</p><br>"
                             "  </td>"
                             " </tr>"
-                            "</table>",
+                            "</table>"
+                            "<table id='header-row'>"
+                            "<tr>"
+                            "<td class='left'>"
+                            "<input id='match' type='search' placeholder='Filter by name' oninput='filter()'> "
+                            "<select id='type' onchange='filter()'><option value='-1'>All types</option>",
                             StringBuffer_toString(system_htmlescaped));
         StringBuffer_free(&system_htmlescaped);
-
-        do_home_system(res);
-        do_home_process(res);
-        do_home_program(res);
-        do_home_filesystem(res);
-        do_home_file(res);
-        do_home_fifo(res);
-        do_home_directory(res);
-        do_home_net(res);
-        do_home_host(res);
-
+        for (int i = 0; i <= Service_Last; i++)
+                StringBuffer_append(res->outputbuffer, "<option value='%d'>%s</option>", i, servicetypes[i]);
+        StringBuffer_append(res->outputbuffer,
+                            "</select> "
+                            "<label><input id='failed' type='checkbox' onchange='filter()'> Failed only</label>"
+                            "</td>"
+                            "<td class='right'>"
+                            "<span id='page'></span> "
+                            "<button id='prev' onclick='page(-1)' disabled>&lt;</button> "
+                            "<button id='next' onclick='page(1)' disabled>&gt;</button>"
+                            "</td>"
+                            "</tr>"
+                            "</table>"
+                            "<table id='status-table'>"
+                            "<thead><tr>"
+                            "<th style='cursor:pointer' onclick=\"sort('name')\">Service</th>"
+                            "<th style='cursor:pointer' onclick=\"sort('type')\">Type</th>"
+                            "<th style='cursor:pointer' onclick=\"sort('status')\">Status</th>"
+                            "<th>Details</th>"
+                            "</tr></thead>"
+                            "<tbody id='rows'></tbody>"
+                            "</table>"
+                            "<noscript><p>The dashboard requires JavaScript, the status is available at <a href='_status'>_status</a></p></noscript>"
+                            "<script>var P=%d,T=[", Run.polltime > 0 ? Run.polltime : 30);
+        for (int i = 0; i <= Service_Last; i++)
+                StringBuffer_append(res->outputbuffer, "%s'%s'", i ? "," : "", servicetypes[i]);
+        StringBuffer_append(res->outputbuffer, "],A=[");
+        for (int i = 0; *actionnames[i]; i++)
+                StringBuffer_append(res->outputbuffer, "%s'%s'", i ? "," : "", actionnames[i]);
+        StringBuffer_append(res->outputbuffer, "],E=[");
+        for (EventTable_T *et = Event_Table; (*et).id; et++)
+                StringBuffer_append(res->outputbuffer, "%s[%d,\"%s\",\"%s\"]", et == Event_Table ? "" : ",", (*et).id, (*et).description_failed, (*et).description_changed);
+        StringBuffer_append(res->outputbuffer, "];%s</script>", _dashboard);
         do_foot(res);
 }
 
@@ -783,6 +1008,24 @@ static void do_getid(HttpResponse res) {
 }
 
 
+static void do_getcluster(HttpResponse res) {
+        set_content_type(res, "text/plain");
+        Cluster_printStatus(res->outputbuffer, _getStatus);
+}
+
+
+static const char *_overrunLevel() {
+        switch (Run.overrun.level) {
+                case 0:
+                        return "";
+                case 1:
+                        return ", low priority services deferred";
+                default:
+                        return ", low and normal priority services deferred";
+        }
+}
+
+
 static void do_runtime(HttpRequest req, HttpResponse res) {
         int pid = exist_daemon();
         char buf[STRLEN];
@@ -880,6 +1123,7 @@ static void do_runtime(HttpRequest req, HttpResponse res) {
                 _displayTableRow(res, true, NULL, "Default mail message", "%s", Run.MailFormat.message);
         _displayTableRow(res, false, NULL, "Limit for Send/Expect buffer",      "%s", Convert_bytes2str(Run.limits.sendExpectBuffer, buf));
         _displayTableRow(res, false, NULL, "Limit for file content buffer",     "%s", Convert_bytes2str(Run.limits.fileContentBuffer, buf));
+        _displayTableRow(res, false, NULL, "Limit for file content per cycle",  "%s", Convert_bytes2str(Run.limits.fileContentBudget, buf));
         _displayTableRow(res, false, NULL, "Limit for HTTP content buffer",     "%s", Convert_bytes2str(Run.limits.httpContentBuffer, buf));
         _displayTableRow(res, false, NULL, "Limit for program output",          "%s", Convert_bytes2str(Run.limits.programOutput, buf));
         _displayTableRow(res, false, NULL, "Limit for network timeout",         "%s", Convert_time2str(Run.limits.networkTimeout, (char[11]){}));
@@ -887,8 +1131,11 @@ static void do_runtime(HttpRequest req, HttpResponse res) {
         _displayTableRow(res, false, NULL, "Limit for service stop timeout",    "%s", Convert_time2str(Run.limits.stopTimeout, (char[11]){}));
         _displayTableRow(res, false, NULL, "Limit for service start timeout",   "%s", Convert_time2str(Run.limits.startTimeout, (char[11]){}));
         _displayTableRow(res, false, NULL, "Limit for service restart timeout", "%s", Convert_time2str(Run.limits.restartTimeout, (char[11]){}));
+        _displayTableRow(res, false, NULL, "Limit for filesystem timeout", "%s", Convert_time2str(Run.limits.filesystemTimeout, (char[11]){}));
         _displayTableRow(res, false, NULL, "On reboot",                         "%s", onrebootnames[Run.onreboot]);
         _displayTableRow(res, false, NULL, "Poll time",                         "%d seconds with start delay %d seconds", Run.polltime, Run.startdelay);
+        if (Run.overrun.count)
+                _displayTableRow(res, false, NULL, "Cycle overruns",            "%llu, the last took %s%s", Run.overrun.count, Convert_time2str(Run.overrun.duration, (char[11]){}), _overrunLevel());
         if (Run.httpd.flags & Httpd_Net) {
                 _displayTableRow(res, true,  NULL, "httpd bind address", "%s", Run.httpd.socket.net.address ? Run.httpd.socket.net.address : "Any/All");
                 _displayTableRow(res, false, NULL, "httpd portnumber",   "%d", Run.httpd.socket.net.port);
@@ -944,21 +1191,154 @@ static void do_runtime(HttpRequest req, HttpResponse res) {
 }
 
 
+/**
+ * Returns the offset of the last lines in the log file. The file is read
+ * backwards from the end, so the cost doesn't depend on the file size.
+ */
+static off_t _getLogTail(FILE *f, int lines) {
+        char buf[8192];
+        if (fseeko(f, 0, SEEK_END) != 0)
+                return 0;
+        // The last character ends the last line (if it is a newline), skip it
+        off_t offset = ftello(f) - 1;
+        while (offset > 0) {
+                size_t n = (size_t)MIN((off_t)sizeof(buf), offset);
+                offset -= n;
+                if (fseeko(f, offset, SEEK_SET) != 0 || fread(buf, 1, n, f) != n)
+                        return 0;
+                for (size_t i = n; i > 0; i--)
+                        if (buf[i - 1] == '\n' && --lines == 0)
+                                return offset + i;
+        }
+        return 0;
+}
+
+
+/**
+ * Parses a single byte range from the Range header: "bytes=first-last",
+ * "bytes=first-" or "bytes=-suffix".
+ * @return SC_PARTIAL_CONTENT if the range is valid, SC_RANGE_NOT_SATISFIABLE
+ * if it is outside the file or SC_OK if the header should be ignored (the
+ * header is invalid or it contains multiple ranges)
+ */
+static int _getRange(const char *range, off_t size, off_t *offset, off_t *length) {
+        char *end;
+        long long first, last;
+        if (! Str_startsWith(range, "bytes=") || strchr(range, ','))
+                return SC_OK;
+        const char *p = range + 6;
+        if (*p == '-') {
+                long long suffix = strtoll(p + 1, &end, 10);
+                if (end == p + 1 || *end)
+                        return SC_OK;
+                if (suffix <= 0 || size == 0)
+                        return SC_RANGE_NOT_SATISFIABLE;
+                first = size > suffix ? size - suffix : 0;
+                last = size - 1;
+        } else {
+                first = strtoll(p, &end, 10);
+                if (end == p || *end != '-' || first < 0)
+                        return SC_OK;
+                p = end + 1;
+                if (*p) {
+                        last = strtoll(p, &end, 10);
+                        if (end == p || *end || last < first)
+                                return SC_OK;
+                        if (last >= size)
+                                last = size - 1;
+                } else {
+                        last = size - 1;
+                }
+                if (first >= size)
+                        return SC_RANGE_NOT_SATISFIABLE;
+        }
+        *offset = first;
+        *length = last - first + 1;
+        return SC_PARTIAL_CONTENT;
+}
+
+
+/**
+ * Send the log file as is. A single byte range is supported, e.g. to
+ * fetch only the data appended since the last download.
+ */
+static void _sendLog(HttpRequest req, HttpResponse res) {
+        int fd = open(Run.files.log, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                send_error(req, res, SC_INTERNAL_SERVER_ERROR, "Error opening logfile: %s", STRERROR);
+                return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+                off_t offset = 0;
+                off_t length = st.st_size;
+                const char *range = get_header(req, "Range");
+                int status = range ? _getRange(range, st.st_size, &offset, &length) : SC_OK;
+                if (status == SC_RANGE_NOT_SATISFIABLE) {
+                        send_error(req, res, SC_RANGE_NOT_SATISFIABLE, "Invalid range: %s", range);
+                        set_header(res, "Content-Range", "bytes */%lld", (long long)st.st_size);
+                } else {
+                        set_content_type(res, "text/plain");
+                        set_header(res, "Accept-Ranges", "bytes");
+                        if (status == SC_PARTIAL_CONTENT) {
+                                set_status(res, SC_PARTIAL_CONTENT);
+                                set_header(res, "Content-Range", "bytes %lld-%lld/%lld", (long long)offset, (long long)(offset + length - 1), (long long)st.st_size);
+                        }
+                        // The file is sent after the request was processed, outside the cervlet lock
+                        set_file(res, fd, offset, length);
+                        return;
+                }
+        } else {
+                send_error(req, res, SC_INTERNAL_SERVER_ERROR, "Error reading logfile: %s", STRERROR);
+        }
+        close(fd);
+}
+
+
 static void do_viewlog(HttpRequest req, HttpResponse res) {
         if (is_readonly(req)) {
                 send_error(req, res, SC_FORBIDDEN, "You do not have sufficient privileges to access this page");
                 return;
         }
+        bool hasLog = (Run.flags & Run_Log) && ! (Run.flags & Run_UseSyslog);
+        if (hasLog && IS(get_parameter(req, "format"), "raw")) {
+                _sendLog(req, res);
+                return;
+        }
         do_head(res, "_viewlog", "View log", 100);
-        if ((Run.flags & Run_Log) && ! (Run.flags & Run_UseSyslog)) {
+        if (hasLog) {
                 FILE *f = fopen(Run.files.log, "r");
                 if (f) {
+                        const char *parameter = get_parameter(req, "lines");
+                        int lines = parameter ? (int)strtol(parameter, NULL, 10) : LOG_LINES;
+                        if (lines <= 0)
+                                lines = LOG_LINES;
+                        StringBuffer_append(res->outputbuffer,
+                                            "<table id='buttons'><tr>"
+                                            "<td>"
+                                            "<form method=POST action='_viewlog'>Show the last "
+                                            "<input type=hidden name='securitytoken' value='%s'>"
+                                            "<input type=number name='lines' min=1 value='%d'> lines "
+                                            "<input type=submit value='Go'>"
+                                            "</form>"
+                                            "</td>"
+                                            "<td>"
+                                            "<form method=POST action='_viewlog'>Download the logfile? "
+                                            "<input type=hidden name='securitytoken' value='%s'>"
+                                            "<input type=hidden name='format' value='raw'>"
+                                            "<input type=submit value='Go'>"
+                                            "</form>"
+                                            "</td>"
+                                            "</tr></table>",
+                                            res->token, lines, res->token);
                         size_t n;
-                        char buf[512];
+                        char buf[8192];
                         StringBuffer_append(res->outputbuffer, "<br><p><form><textarea cols=120 rows=30 readonly>");
-                        while ((n = fread(buf, sizeof(char), sizeof(buf) - 1, f)) > 0) {
-                                buf[n] = 0;
-                                escapeHTML(res->outputbuffer, buf);
+                        if (fseeko(f, _getLogTail(f, lines), SEEK_SET) == 0) {
+                                while ((n = fread(buf, sizeof(char), sizeof(buf) - 1, f)) > 0) {
+                                        buf[n] = 0;
+                                        escapeHTML(res->outputbuffer, buf);
+                                }
                         }
                         fclose(f);
                         StringBuffer_append(res->outputbuffer, "</textarea></form>");
@@ -988,7 +1368,7 @@ static void handle_service(HttpRequest req, HttpResponse res) {
                 send_error(req, res, SC_NOT_FOUND, "There is no service named \"%s\"", name);
                 return;
         }
-        do_service(req, res, s);
+        do_service(req, res, _getStatus(s));
 }
 
 
@@ -1024,7 +1404,7 @@ static void handle_service_action(HttpRequest req, HttpResponse res) {
                 Run.flags |= Run_ActionPending; /* set the global flag */
                 do_wakeupcall();
         }
-        do_service(req, res, s);
+        do_service(req, res, _getStatus(s));
 }
 
 
@@ -1042,17 +1422,33 @@ static void handle_doaction(HttpRequest req, HttpResponse res) {
                         send_error(req, res, SC_BAD_REQUEST, "Invalid action \"%s\"", action);
                         return;
                 }
+                // Select the services by the names, glob patterns and groups first, the action is scheduled only if all selectors matched
+                List_T services = List_new();
                 for (HttpParameter p = req->params; p; p = p->next) {
-                        if (IS(p->name, "service")) {
-                                s  = Util_getService(p->value);
-                                if (! s) {
-                                        send_error(req, res, SC_BAD_REQUEST, "There is no service named \"%s\"", p->value ? p->value : "");
-                                        return;
-                                }
+                        Select_Type type;
+                        if (IS(p->name, "service"))
+                                type = Select_Service;
+                        else if (IS(p->name, "pattern"))
+                                type = Select_Pattern;
+                        else if (IS(p->name, "group"))
+                                type = Select_Group;
+                        else
+                                continue;
+                        if (! Util_selectServices(services, type, p->value ? p->value : "")) {
+                                List_free(&services);
+                                send_error(req, res, SC_BAD_REQUEST, type == Select_Group ? "There is no group named \"%s\"" : type == Select_Pattern ? "There is no service matching \"%s\"" : "There is no service named \"%s\"", p->value ? p->value : "");
+                                return;
+                        }
+                }
+                for (list_t e = services->head; e; e = e->next) {
+                        s = e->e;
+                        // The service selected more than once is logged once
+                        if (s->doaction != doaction) {
                                 s->doaction = doaction;
                                 Log_info("'%s' %s on user request\n", s->name, action);
                         }
                 }
+                List_free(&services);
                 /* Set token for last service only so we'll get it back after all services were handled */
                 if (token) {
                         Service_T q = NULL;
@@ -1070,6 +1466,22 @@ static void handle_doaction(HttpRequest req, HttpResponse res) {
 }
 
 
+/**
+ * Accept the M/Monit message of a downstream monit and queue it for forwarding to M/Monit
+ */
+static void handle_collector(HttpRequest req, HttpResponse res) {
+        if (! req->content || ! Str_startsWith(req->content, "<?xml") || ! strstr(req->content, "<monit")) {
+                send_error(req, res, SC_BAD_REQUEST, "Expected the M/Monit XML message");
+                return;
+        }
+        if (! MMonit_relay(req->content, req->content_length)) {
+                send_error(req, res, SC_SERVICE_UNAVAILABLE, "Cannot relay the message to M/Monit");
+                return;
+        }
+        set_content_type(res, "text/plain");
+}
+
+
 static void handle_runtime(HttpRequest req, HttpResponse res) {
         LOCK(Run.mutex)
         do_runtime(req, res);
@@ -1112,9 +1524,12 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
                             "</tr>",
                             servicetypes[s->type]);
         _displayTableRow(res, true, NULL, "Name", "%s", s->name);
-        if (s->type == Service_Process)
-                _displayTableRow(res, true, NULL, s->matchlist ? "Match" : "Pid file", "%s", s->path);
-        else if (s->type == Service_Host)
+        if (s->type == Service_Process) {
+                if (s->matchlist || ! s->cgroup)
+                        _displayTableRow(res, true, NULL, s->matchlist ? "Match" : "Pid file", "%s", s->path);
+                if (s->cgroup)
+                        _displayTableRow(res, true, NULL, "Cgroup", "%s", s->cgroup);
+        } else if (s->type == Service_Host)
                 _displayTableRow(res, true, NULL, "Address", "%s", s->path);
         else if (s->type == Service_Net)
                 _displayTableRow(res, true, NULL, "Interface", "%s", s->path);
@@ -1123,12 +1538,13 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
         _displayTableRow(res, false, NULL, "Status", "%s", get_service_status(HTML, s, buf, sizeof(buf)));
         for (ServiceGroup_T sg = servicegrouplist; sg; sg = sg->next) {
                 for (list_t m = sg->members->head; m; m = m->next)
-                        if (m->e == s)
+                        if (((Service_T)m->e)->name == s->name)
                                 _displayTableRow(res, false, NULL, "Group", "%s",  sg->name);
         }
         _displayTableRow(res, false, NULL, "Monitoring status", "%s", get_monitoring_status(HTML, s, buf, sizeof(buf)));
         _displayTableRow(res, false, NULL, "Monitoring mode",   "%s", modenames[s->mode]);
         _displayTableRow(res, false, NULL, "On reboot",         "%s", onrebootnames[s->onreboot]);
+        _displayTableRow(res, false, NULL, "Priority",          "%s", prioritynames[s->priority]);
         for (Dependant_T d = s->dependantlist; d; d = d->next) {
                 if (d->dependant != NULL)
                         _displayTableRow(res, false, NULL, "Depends on service", "<a href='%s'>%s</a>", d->dependant_urlescaped, StringBuffer_toString(d->dependant_htmlescaped));
@@ -1143,9 +1559,11 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
                 if (s->every.type == Every_SkipCycles)
                         _displayTableRow(res, false, NULL, "Check service", "every %d cycle", s->every.spec.cycle.number);
                 else if (s->every.type == Every_Cron)
-                        _displayTableRow(res, false, NULL, "Check service", "every <code>\"%s\"</code>", s->every.spec.cron);
+                        _displayTableRow(res, false, NULL, "Check service", "every <code>\"%s\"</code>", s->every.spec.cron.string);
                 else if (s->every.type == Every_NotInCron)
-                        _displayTableRow(res, false, NULL, "Check service", "not every <code>\"%s\"</code>", s->every.spec.cron);
+                        _displayTableRow(res, false, NULL, "Check service", "not every <code>\"%s\"</code>", s->every.spec.cron.string);
+                else if (s->every.type == Every_Interval)
+                        _displayTableRow(res, false, NULL, "Check service", "every %s", Convert_time2str(s->every.spec.interval * 1000., (char[11]){}));
         }
         _printStatus(HTML, res, s);
         // Rules
@@ -1165,6 +1583,7 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
         print_service_rules_fsflags(res, s);
         print_service_rules_filesystem(res, s);
         print_service_rules_size(res, s);
+        print_service_rules_filecount(res, s);
         print_service_rules_linkstatus(res, s);
         print_service_rules_linkspeed(res, s);
         print_service_rules_linksaturation(res, s);
@@ -1173,6 +1592,7 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
         print_service_rules_downloadbytes(res, s);
         print_service_rules_downloadpackets(res, s);
         print_service_rules_uptime(res, s);
+        print_service_rules_latency(res, s);
         print_service_rules_content(res, s);
         print_service_rules_checksum(res, s);
         print_service_rules_pid(res, s);
@@ -1186,520 +1606,6 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
 }
 
 
-static void do_home_system(HttpResponse res) {
-        Service_T s = Run.system;
-        char buf[STRLEN];
-
-        StringBuffer_append(res->outputbuffer,
-                            "<table id='header-row'>"
-                            "<tr>"
-                            "<th class='left first'>System</th>"
-                            "<th class='left'>Status</th>"
-                            "<th class='right column'>Load</th>"
-                            "<th class='right column'>CPU</th>"
-                            "<th class='right column'>Memory</th>"
-                            "<th class='right column'>Swap</th>"
-                            "</tr>"
-                            "<tr class='stripe'>"
-                            "<td class='left'><a href='%s'>%s</a></td>"
-                            "<td class='left'>%s</td>"
-                            "<td class='right column'>[%.2f]&nbsp;[%.2f]&nbsp;[%.2f]</td>"
-                            "<td class='right column'>",
-                            s->name_urlescaped, StringBuffer_toString(s->name_htmlescaped),
-                            get_service_status(HTML, s, buf, sizeof(buf)),
-                            systeminfo.loadavg[0], systeminfo.loadavg[1], systeminfo.loadavg[2]);
-        if (systeminfo.statisticsAvailable & Statistics_CpuUser)
-                StringBuffer_append(res->outputbuffer, "%.1f%%us&nbsp;", systeminfo.cpu.usage.user > 0. ? systeminfo.cpu.usage.user : 0.);
-        if (systeminfo.statisticsAvailable & Statistics_CpuSystem)
-                StringBuffer_append(res->outputbuffer, "%.1f%%sy&nbsp;", systeminfo.cpu.usage.system > 0. ? systeminfo.cpu.usage.system : 0.);
-        if (systeminfo.statisticsAvailable & Statistics_CpuNice)
-                StringBuffer_append(res->outputbuffer, "%.1f%%ni&nbsp;", systeminfo.cpu.usage.nice > 0. ? systeminfo.cpu.usage.nice : 0.);
-        if (systeminfo.statisticsAvailable & Statistics_CpuIOWait)
-                StringBuffer_append(res->outputbuffer, "%.1f%%wa&nbsp;", systeminfo.cpu.usage.iowait > 0. ? systeminfo.cpu.usage.iowait : 0.);
-        StringBuffer_append(res->outputbuffer,
-                            "</td>");
-        StringBuffer_append(res->outputbuffer,
-                            "<td class='right column'>%.1f%% [%s]</td>",
-                            systeminfo.memory.usage.percent, Convert_bytes2str(systeminfo.memory.usage.bytes, buf));
-        StringBuffer_append(res->outputbuffer,
-                            "<td class='right column'>%.1f%% [%s]</td>",
-                            systeminfo.swap.usage.percent, Convert_bytes2str(systeminfo.swap.usage.bytes, buf));
-        StringBuffer_append(res->outputbuffer,
-                            "</tr>"
-                            "</table>");
-}
-
-
-static void do_home_process(HttpResponse res) {
-        char      buf[STRLEN];
-        bool on = true;
-        bool header = true;
-
-        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                if (s->type != Service_Process)
-                        continue;
-                if (header) {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<table id='header-row'>"
-                                            "<tr>"
-                                            "<th class='left' class='first'>Process</th>"
-                                            "<th class='left'>Status</th>"
-                                            "<th class='right'>Uptime</th>"
-                                            "<th class='right'>CPU Total</b></th>"
-                                            "<th class='right'>Memory Total</th>"
-                                            "<th class='right column'>Read</th>"
-                                            "<th class='right column'>Write</th>"
-                                            "</tr>");
-                        header = false;
-                }
-                StringBuffer_append(res->outputbuffer,
-                                    "<tr%s>"
-                                    "<td class='left'><a href='%s'>%s</a></td>"
-                                    "<td class='left'>%s</td>",
-                                    on ? " class='stripe'" : "",
-                                    s->name_urlescaped, StringBuffer_toString(s->name_htmlescaped),
-                                    get_service_status(HTML, s, buf, sizeof(buf)));
-                if (! (Run.flags & Run_ProcessEngineEnabled) || ! Util_hasServiceStatus(s) || s->inf.process->uptime < 0) {
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                } else {
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%s</td>", _getUptime(s->inf.process->uptime, (char[256]){}));
-                }
-                if (! (Run.flags & Run_ProcessEngineEnabled) || ! Util_hasServiceStatus(s) || s->inf.process->total_cpu_percent < 0) {
-                                StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                } else {
-                        StringBuffer_append(res->outputbuffer, "<td class='right%s'>%.1f%%</td>", (s->error & Event_Resource) ? " red-text" : "", s->inf.process->total_cpu_percent);
-                }
-                if (! (Run.flags & Run_ProcessEngineEnabled) || ! Util_hasServiceStatus(s) || s->inf.process->total_mem_percent < 0) {
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                } else {
-                        StringBuffer_append(res->outputbuffer, "<td class='right%s'>%.1f%% [%s]</td>", (s->error & Event_Resource) ? " red-text" : "", s->inf.process->total_mem_percent, Convert_bytes2str(s->inf.process->total_mem, buf));
-                }
-                bool hasReadBytes = Statistics_initialized(&(s->inf.process->read.bytes));
-                bool hasReadOperations = Statistics_initialized(&(s->inf.process->read.operations));
-                if (! (Run.flags & Run_ProcessEngineEnabled) || ! Util_hasServiceStatus(s) || (! hasReadBytes && ! hasReadOperations)) {
-                        StringBuffer_append(res->outputbuffer, "<td class='right column'>-</td>");
-                } else if (hasReadBytes) {
-                        StringBuffer_append(res->outputbuffer, "<td class='right column%s'>%s/s</td>", (s->error & Event_Resource) ? " red-text" : "", Convert_bytes2str(Statistics_deltaNormalize(&(s->inf.process->read.bytes)), (char[10]){}));
-                } else if (hasReadOperations) {
-                        StringBuffer_append(res->outputbuffer, "<td class='right column%s'>%.1f/s</td>", (s->error & Event_Resource) ? " red-text" : "", Statistics_deltaNormalize(&(s->inf.process->read.operations)));
-                }
-                bool hasWriteBytes = Statistics_initialized(&(s->inf.process->write.bytes));
-                bool hasWriteOperations = Statistics_initialized(&(s->inf.process->write.operations));
-                if (! (Run.flags & Run_ProcessEngineEnabled) || ! Util_hasServiceStatus(s) || (! hasWriteBytes && ! hasWriteOperations)) {
-                        StringBuffer_append(res->outputbuffer, "<td class='right column'>-</td>");
-                } else if (hasWriteBytes) {
-                        StringBuffer_append(res->outputbuffer, "<td class='right column%s'>%s/s</td>", (s->error & Event_Resource) ? " red-text" : "", Convert_bytes2str(Statistics_deltaNormalize(&(s->inf.process->write.bytes)), (char[10]){}));
-                } else if (hasWriteOperations) {
-                        StringBuffer_append(res->outputbuffer, "<td class='right column%s'>%.1f/s</td>", (s->error & Event_Resource) ? " red-text" : "", Statistics_deltaNormalize(&(s->inf.process->write.operations)));
-                }
-                StringBuffer_append(res->outputbuffer, "</tr>");
-                on = ! on;
-        }
-        if (! header)
-                StringBuffer_append(res->outputbuffer, "</table>");
-}
-
-
-static void do_home_program(HttpResponse res) {
-        char buf[STRLEN];
-        bool on = true;
-        bool header = true;
-
-        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                if (s->type != Service_Program)
-                        continue;
-                if (header) {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<table id='header-row'>"
-                                            "<tr>"
-                                            "<th class='left' class='first'>Program</th>"
-                                            "<th class='left'>Status</th>"
-                                            "<th class='left'>Output</th>"
-                                            "<th class='right'>Last started</th>"
-                                            "<th class='right'>Exit value</th>"
-                                            "</tr>");
-                        header = false;
-                }
-                StringBuffer_append(res->outputbuffer,
-                                    "<tr %s>"
-                                    "<td class='left'><a href='%s'>%s</a></td>"
-                                    "<td class='left'>%s</td>",
-                                    on ? "class='stripe'" : "",
-                                    s->name_urlescaped, StringBuffer_toString(s->name_htmlescaped),
-                                    get_service_status(HTML, s, buf, sizeof(buf)));
-                if (! Util_hasServiceStatus(s)) {
-                        StringBuffer_append(res->outputbuffer, "<td class='left'>-</td>");
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                } else {
-                        if (s->program->started) {
-                                StringBuffer_append(res->outputbuffer, "<td class='left short'>");
-                                if (StringBuffer_length(s->program->lastOutput)) {
-                                        // Print first line only (escape HTML characters if any)
-                                        const char *output = StringBuffer_toString(s->program->lastOutput);
-                                        for (int i = 0; output[i]; i++) {
-                                                if (output[i] == '<')
-                                                        StringBuffer_append(res->outputbuffer, "&lt;");
-                                                else if (output[i] == '>')
-                                                        StringBuffer_append(res->outputbuffer, "&gt;");
-                                                else if (output[i] == '&')
-                                                        StringBuffer_append(res->outputbuffer, "&amp;");
-                                                else if (output[i] == '\r' || output[i] == '\n')
-                                                        break;
-                                                else
-                                                        StringBuffer_append(res->outputbuffer, "%c", output[i]);
-                                        }
-                                } else {
-                                        StringBuffer_append(res->outputbuffer, "no output");
-                                }
-                                StringBuffer_append(res->outputbuffer, "</td>");
-                                StringBuffer_append(res->outputbuffer, "<td class='right'>%s</td>", Time_fmt((char[32]){}, 32, "%d %b %Y %H:%M:%S", s->program->started));
-                                StringBuffer_append(res->outputbuffer, "<td class='right'>%d</td>", s->program->exitStatus);
-                        } else {
-                                StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                                StringBuffer_append(res->outputbuffer, "<td class='right'>Not yet started</td>");
-                                StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                        }
-                }
-                StringBuffer_append(res->outputbuffer, "</tr>");
-                on = ! on;
-        }
-        if (! header)
-                StringBuffer_append(res->outputbuffer, "</table>");
-
-}
-
-
-static void do_home_net(HttpResponse res) {
-        char buf[STRLEN];
-        bool on = true;
-        bool header = true;
-
-        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                if (s->type != Service_Net)
-                        continue;
-                if (header) {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<table id='header-row'>"
-                                            "<tr>"
-                                            "<th class='left first'>Net</th>"
-                                            "<th class='left'>Status</th>"
-                                            "<th class='right'>Upload</th>"
-                                            "<th class='right'>Download</th>"
-                                            "</tr>");
-                        header = false;
-                }
-                StringBuffer_append(res->outputbuffer,
-                                    "<tr %s>"
-                                    "<td class='left'><a href='%s'>%s</a></td>"
-                                    "<td class='left'>%s</td>",
-                                    on ? "class='stripe'" : "",
-                                    s->name_urlescaped, StringBuffer_toString(s->name_htmlescaped),
-                                    get_service_status(HTML, s, buf, sizeof(buf)));
-                if (! Util_hasServiceStatus(s) || Link_getState(s->inf.net->stats) != 1) {
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                } else {
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%s&#47;s</td>", Convert_bytes2str(Link_getBytesOutPerSecond(s->inf.net->stats), buf));
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%s&#47;s</td>", Convert_bytes2str(Link_getBytesInPerSecond(s->inf.net->stats), buf));
-                }
-                StringBuffer_append(res->outputbuffer, "</tr>");
-                on = ! on;
-        }
-        if (! header)
-                StringBuffer_append(res->outputbuffer, "</table>");
-}
-
-
-static void do_home_filesystem(HttpResponse res) {
-        char buf[STRLEN];
-        bool on = true;
-        bool header = true;
-
-        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                if (s->type != Service_Filesystem)
-                        continue;
-                if (header) {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<table id='header-row'>"
-                                            "<tr>"
-                                            "<th class='left first'>Filesystem</th>"
-                                            "<th class='left'>Status</th>"
-                                            "<th class='right'>Space usage</th>"
-                                            "<th class='right'>Inodes usage</th>"
-                                            "<th class='right column'>Read</th>"
-                                            "<th class='right column'>Write</th>"
-                                            "</tr>");
-                        header = false;
-                }
-                StringBuffer_append(res->outputbuffer,
-                                    "<tr %s>"
-                                    "<td class='left'><a href='%s'>%s</a></td>"
-                                    "<td class='left'>%s</td>",
-                                    on ? "class='stripe'" : "",
-                                    s->name_urlescaped, StringBuffer_toString(s->name_htmlescaped),
-                                    get_service_status(HTML, s, buf, sizeof(buf)));
-                if (! Util_hasServiceStatus(s)) {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<td class='right'>- [-]</td>"
-                                            "<td class='right'>- [-]</td>"
-                                            "<td class='right column'>- [-]</td>"
-                                            "<td class='right column'>- [-]</td>");
-                } else {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<td class='right column%s'>%.1f%% [%s]</td>",
-                                            (s->error & Event_Resource) ? " red-text" : "",
-                                            s->inf.filesystem->space_percent,
-                                            s->inf.filesystem->f_bsize > 0 ? Convert_bytes2str(s->inf.filesystem->f_blocksused * s->inf.filesystem->f_bsize, buf) : "0 MB");
-                        if (s->inf.filesystem->f_files > 0) {
-                                StringBuffer_append(res->outputbuffer,
-                                                    "<td class='right column%s'>%.1f%% [%lld objects]</td>",
-                                                    (s->error & Event_Resource) ? " red-text" : "",
-                                                    s->inf.filesystem->inode_percent,
-                                                    s->inf.filesystem->f_filesused);
-                        } else {
-                                StringBuffer_append(res->outputbuffer,
-                                                    "<td class='right column'>not supported by filesystem</td>");
-                        }
-                        StringBuffer_append(res->outputbuffer,
-                                            "<td class='right column%s'>%s/s</td>"
-                                            "<td class='right column%s'>%s/s</td>",
-                                            (s->error & Event_Resource) ? " red-text" : "",
-                                            Convert_bytes2str(Statistics_deltaNormalize(&(s->inf.filesystem->read.bytes)), (char[10]){}),
-                                            (s->error & Event_Resource) ? " red-text" : "",
-                                            Convert_bytes2str(Statistics_deltaNormalize(&(s->inf.filesystem->write.bytes)), (char[10]){}));
-                }
-                StringBuffer_append(res->outputbuffer, "</tr>");
-                on = ! on;
-        }
-        if (! header)
-                StringBuffer_append(res->outputbuffer, "</table>");
-}
-
-
-static void do_home_file(HttpResponse res) {
-        char buf[STRLEN];
-        bool on = true;
-        bool header = true;
-
-        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                if (s->type != Service_File)
-                        continue;
-                if (header) {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<table id='header-row'>"
-                                            "<tr>"
-                                            "<th class='left first'>File</th>"
-                                            "<th class='left'>Status</th>"
-                                            "<th class='right'>Size</th>"
-                                            "<th class='right'>Permission</th>"
-                                            "<th class='right'>UID</th>"
-                                            "<th class='right'>GID</th>"
-                                            "</tr>");
-
-                        header = false;
-                }
-                StringBuffer_append(res->outputbuffer,
-                                    "<tr %s>"
-                                    "<td class='left'><a href='%s'>%s</a></td>"
-                                    "<td class='left'>%s</td>",
-                                    on ? "class='stripe'" : "",
-                                    s->name_urlescaped, StringBuffer_toString(s->name_htmlescaped),
-                                    get_service_status(HTML, s, buf, sizeof(buf)));
-                if (! Util_hasServiceStatus(s) || s->inf.file->size < 0)
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%s</td>", Convert_bytes2str(s->inf.file->size, (char[10]){}));
-                if (! Util_hasServiceStatus(s) || s->inf.file->mode < 0)
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%04o</td>", s->inf.file->mode & 07777);
-                if (! Util_hasServiceStatus(s) || s->inf.file->uid < 0)
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%d</td>", s->inf.file->uid);
-                if (! Util_hasServiceStatus(s) || s->inf.file->gid < 0)
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%d</td>", s->inf.file->gid);
-                StringBuffer_append(res->outputbuffer, "</tr>");
-                on = ! on;
-        }
-        if (! header)
-                StringBuffer_append(res->outputbuffer, "</table>");
-}
-
-
-static void do_home_fifo(HttpResponse res) {
-        char buf[STRLEN];
-        bool on = true;
-        bool header = true;
-
-        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                if (s->type != Service_Fifo)
-                        continue;
-                if (header) {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<table id='header-row'>"
-                                            "<tr>"
-                                            "<th class='left first'>Fifo</th>"
-                                            "<th class='left'>Status</th>"
-                                            "<th class='right'>Permission</th>"
-                                            "<th class='right'>UID</th>"
-                                            "<th class='right'>GID</th>"
-                                            "</tr>");
-                        header = false;
-                }
-                StringBuffer_append(res->outputbuffer,
-                                    "<tr %s>"
-                                    "<td class='left'><a href='%s'>%s</a></td>"
-                                    "<td class='left'>%s</td>",
-                                    on ? "class='stripe'" : "",
-                                    s->name_urlescaped, StringBuffer_toString(s->name_htmlescaped),
-                                    get_service_status(HTML, s, buf, sizeof(buf)));
-                if (! Util_hasServiceStatus(s) || s->inf.fifo->mode < 0)
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%04o</td>", s->inf.fifo->mode & 07777);
-                if (! Util_hasServiceStatus(s) || s->inf.fifo->uid < 0)
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%d</td>", s->inf.fifo->uid);
-                if (! Util_hasServiceStatus(s) || s->inf.fifo->gid < 0)
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%d</td>", s->inf.fifo->gid);
-                StringBuffer_append(res->outputbuffer, "</tr>");
-                on = ! on;
-        }
-        if (! header)
-                StringBuffer_append(res->outputbuffer, "</table>");
-}
-
-
-static void do_home_directory(HttpResponse res) {
-        char buf[STRLEN];
-        bool on = true;
-        bool header = true;
-
-        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                if (s->type != Service_Directory)
-                        continue;
-                if (header) {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<table id='header-row'>"
-                                            "<tr>"
-                                            "<th class='left first'>Directory</th>"
-                                            "<th class='left'>Status</th>"
-                                            "<th class='right'>Permission</th>"
-                                            "<th class='right'>UID</th>"
-                                            "<th class='right'>GID</th>"
-                                            "</tr>");
-                        header = false;
-                }
-                StringBuffer_append(res->outputbuffer,
-                                    "<tr %s>"
-                                    "<td class='left'><a href='%s'>%s</a></td>"
-                                    "<td class='left'>%s</td>",
-                                    on ? "class='stripe'" : "",
-                                    s->name_urlescaped, StringBuffer_toString(s->name_htmlescaped),
-                                    get_service_status(HTML, s, buf, sizeof(buf)));
-                if (! Util_hasServiceStatus(s) || s->inf.directory->mode < 0)
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%04o</td>", s->inf.directory->mode & 07777);
-                if (! Util_hasServiceStatus(s) || s->inf.directory->uid < 0)
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%d</td>", s->inf.directory->uid);
-                if (! Util_hasServiceStatus(s) || s->inf.directory->gid < 0)
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td class='right'>%d</td>", s->inf.directory->gid);
-                StringBuffer_append(res->outputbuffer, "</tr>");
-                on = ! on;
-        }
-        if (! header)
-                StringBuffer_append(res->outputbuffer, "</table>");
-}
-
-
-static void do_home_host(HttpResponse res) {
-        char buf[STRLEN];
-        bool on = true;
-        bool header = true;
-
-        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                if (s->type != Service_Host)
-                        continue;
-                if (header) {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<table id='header-row'>"
-                                            "<tr>"
-                                            "<th class='left first'>Host</th>"
-                                            "<th class='left'>Status</th>"
-                                            "<th class='right'>Protocol(s)</th>"
-                                            "</tr>");
-                        header = false;
-                }
-                StringBuffer_append(res->outputbuffer,
-                                    "<tr %s>"
-                                    "<td class='left'><a href='%s'>%s</a></td>"
-                                    "<td class='left'>%s</td>",
-                                    on ? "class='stripe'" : "",
-                                    s->name_urlescaped, StringBuffer_toString(s->name_htmlescaped),
-                                    get_service_status(HTML, s, buf, sizeof(buf)));
-                if (! Util_hasServiceStatus(s)) {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<td class='right'>-</td>");
-                } else {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<td class='right'>");
-                        for (Icmp_T icmp = s->icmplist; icmp; icmp = icmp->next) {
-                                if (icmp != s->icmplist)
-                                        StringBuffer_append(res->outputbuffer, "&nbsp;&nbsp;<b>|</b>&nbsp;&nbsp;");
-                                switch (icmp->is_available) {
-                                        case Connection_Init:
-                                                StringBuffer_append(res->outputbuffer, "<span class='gray-text'>[Ping]</span>");
-                                                break;
-                                        case Connection_Failed:
-                                                StringBuffer_append(res->outputbuffer, "<span class='red-text'>[Ping]</span>");
-                                                break;
-                                        default:
-                                                StringBuffer_append(res->outputbuffer, "<span>[Ping]</span>");
-                                                break;
-                                }
-                        }
-                        if (s->icmplist && s->portlist)
-                                StringBuffer_append(res->outputbuffer, "&nbsp;&nbsp;<b>|</b>&nbsp;&nbsp;");
-                        for (Port_T port = s->portlist; port; port = port->next) {
-                                if (port != s->portlist)
-                                        StringBuffer_append(res->outputbuffer, "&nbsp;&nbsp;<b>|</b>&nbsp;&nbsp;");
-                                switch (port->is_available) {
-                                        case Connection_Init:
-                                                StringBuffer_append(res->outputbuffer, "<span class='gray-text'>[%s] at port %d</span>", port->protocol->name, port->target.net.port);
-                                                break;
-                                        case Connection_Failed:
-                                                StringBuffer_append(res->outputbuffer, "<span class='red-text'>[%s] at port %d</span>", port->protocol->name, port->target.net.port);
-                                                break;
-                                        default:
-                                                if (port->target.net.ssl.options.flags && port->target.net.ssl.certificate.validDays < port->target.net.ssl.certificate.minimumDays)
-                                                        StringBuffer_append(res->outputbuffer, "<span class='red-text'>[%s] at port %d</span>", port->protocol->name, port->target.net.port);
-                                                else
-                                                        StringBuffer_append(res->outputbuffer, "<span>[%s] at port %d</span>", port->protocol->name, port->target.net.port);
-                                                break;
-                                }
-                        }
-                        StringBuffer_append(res->outputbuffer, "</td>");
-                }
-                StringBuffer_append(res->outputbuffer, "</tr>");
-                on = ! on;
-        }
-        if (! header)
-                StringBuffer_append(res->outputbuffer, "</table>");
-}
-
-
 /* ------------------------------------------------------------------------- */
 
 
@@ -2061,6 +1967,9 @@ static void print_service_rules_filesystem(HttpResponse res, Service_T s) {
                 case Resource_ServiceTime:
                         _displayTableRow(res, true, "rule", "Service time limit", "%s", StringBuffer_toString(Util_printRule(sb, dl->action, "If service time %s %s/operation", operatornames[dl->operator], Convert_time2str(dl->limit_absolute, (char[11]){}))));
                         break;
+                case Resource_Utilization:
+                        _displayTableRow(res, true, "rule", "Utilization limit", "%s", StringBuffer_toString(Util_printRule(sb, dl->action, "If utilization %s %.1f%%", operatornames[dl->operator], dl->limit_percent)));
+                        break;
                 default:
                         break;
                 }
@@ -2082,6 +1991,15 @@ static void print_service_rules_size(HttpResponse res, Service_T s) {
 }
 
 
+static void print_service_rules_filecount(HttpResponse res, Service_T s) {
+        for (FileCount_T fc = s->filecountlist; fc; fc = fc->next) {
+                StringBuffer_T sb = StringBuffer_create(256);
+                _displayTableRow(res, true, "rule", "File count", "%s", StringBuffer_toString(Util_printRule(sb, fc->action, "If %s %llu", operatornames[fc->operator], fc->limit)));
+                StringBuffer_free(&sb);
+        }
+}
+
+
 static void print_service_rules_linkstatus(HttpResponse res, Service_T s) {
         for (LinkStatus_T l = s->linkstatuslist; l; l = l->next) {
                 StringBuffer_T sb = StringBuffer_create(256);
@@ -2160,7 +2078,16 @@ static void print_service_rules_downloadpackets(HttpResponse res, Service_T s) {
 static void print_service_rules_uptime(HttpResponse res, Service_T s) {
         for (Uptime_T ul = s->uptimelist; ul; ul = ul->next) {
                 StringBuffer_T sb = StringBuffer_create(256);
-                _displayTableRow(res, true, "rule", "Uptime", "%s", StringBuffer_toString(Util_printRule(sb, ul->action, "If %s %s", operatornames[ul->operator], _getUptime(ul->uptime, (char[256]){}))));
+                _displayTableRow(res, true, "rule", "Uptime", "%s", StringBuffer_toString(Util_printRule(sb, ul->action, "If %s %s", operatornames[ul->operator], Util_getUptime(ul->uptime, (char[256]){}))));
+                StringBuffer_free(&sb);
+        }
+}
+
+
+static void print_service_rules_latency(HttpResponse res, Service_T s) {
+        for (Latency_T ll = s->latencylist; ll; ll = ll->next) {
+                StringBuffer_T sb = StringBuffer_create(256);
+                _displayTableRow(res, true, "rule", "Response time", "%s", StringBuffer_toString(Util_printRule(sb, ll->action, "If p%g %s %s", ll->percentile, operatornames[ll->operator], Convert_time2str(ll->limit, (char[11]){}))));
                 StringBuffer_free(&sb);
         }
 }
@@ -2242,6 +2169,10 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
                                 key = "CPU usage limit (incl. children)";
                                 break;
 
+                        case Resource_CpuPercentThread:
+                                key = "Thread CPU usage limit";
+                                break;
+
                         case Resource_CpuUser:
                                 key = "CPU user limit";
                                 break;
@@ -2278,6 +2209,38 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
                                 key = "CPU guest nice limit";
                                 break;
 
+                        case Resource_CpuPerCore:
+                                key = "CPU usage limit per core";
+                                break;
+
+                        case Resource_CpuPerNode:
+                                key = "CPU usage limit per NUMA node";
+                                break;
+
+                        case Resource_PressureCpuSome:
+                                key = "CPU pressure (some) limit";
+                                break;
+
+                        case Resource_PressureCpuFull:
+                                key = "CPU pressure (full) limit";
+                                break;
+
+                        case Resource_PressureMemorySome:
+                                key = "Memory pressure (some) limit";
+                                break;
+
+                        case Resource_PressureMemoryFull:
+                                key = "Memory pressure (full) limit";
+                                break;
+
+                        case Resource_PressureIoSome:
+                                key = "I/O pressure (some) limit";
+                                break;
+
+                        case Resource_PressureIoFull:
+                                key = "I/O pressure (full) limit";
+                                break;
+
                         case Resource_MemoryPercent:
                                 key = "Memory usage limit";
                                 break;
@@ -2290,6 +2253,22 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
                                 key = "Swap usage limit";
                                 break;
 
+                        case Resource_HugepagesPercent:
+                                key = "Hugepages usage limit";
+                                break;
+
+                        case Resource_MemoryPss:
+                                key = "PSS amount limit";
+                                break;
+
+                        case Resource_MemoryUss:
+                                key = "USS amount limit";
+                                break;
+
+                        case Resource_CgroupMemoryPercent:
+                                key = "Cgroup memory limit";
+                                break;
+
                         case Resource_SwapKbyte:
                                 key = "Swap amount limit";
                                 break;
@@ -2350,6 +2329,34 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
                                 key = "Disk write limit";
                                 break;
 
+                        case Resource_Connections:
+                                key = "Connections";
+                                break;
+
+                        case Resource_ConnectionsEstablished:
+                                key = "Established connections";
+                                break;
+
+                        case Resource_ConnectionsListen:
+                                key = "Listening sockets";
+                                break;
+
+                        case Resource_ConnectionsCloseWait:
+                                key = "Close wait connections";
+                                break;
+
+                        case Resource_TcpSent:
+                                key = "TCP sent limit";
+                                break;
+
+                        case Resource_TcpReceived:
+                                key = "TCP received limit";
+                                break;
+
+                        case Resource_IoDelay:
+                                key = "I/O delay limit";
+                                break;
+
                         default:
                                 break;
                 }
@@ -2366,14 +2373,28 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
                         case Resource_CpuSteal:
                         case Resource_CpuGuest:
                         case Resource_CpuGuestNice:
+                        case Resource_CpuPerCore:
+                        case Resource_CpuPerNode:
+                        case Resource_PressureCpuSome:
+                        case Resource_PressureCpuFull:
+                        case Resource_PressureMemorySome:
+                        case Resource_PressureMemoryFull:
+                        case Resource_PressureIoSome:
+                        case Resource_PressureIoFull:
                         case Resource_MemoryPercent:
                         case Resource_SwapPercent:
+                        case Resource_IoDelay:
+                        case Resource_CpuPercentThread:
+                        case Resource_HugepagesPercent:
+                        case Resource_CgroupMemoryPercent:
                                 Util_printRule(sb, q->action, "If %s %.1f%%", operatornames[q->operator], q->limit);
                                 break;
 
                         case Resource_MemoryKbyte:
                         case Resource_SwapKbyte:
                         case Resource_MemoryKbyteTotal:
+                        case Resource_MemoryPss:
+                        case Resource_MemoryUss:
                                 Util_printRule(sb, q->action, "If %s %s", operatornames[q->operator], Convert_bytes2str(q->limit, buf));
                                 break;
 
@@ -2388,9 +2409,18 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
 
                         case Resource_Threads:
                         case Resource_Children:
+                        case Resource_Connections:
+                        case Resource_ConnectionsEstablished:
+                        case Resource_ConnectionsListen:
+                        case Resource_ConnectionsCloseWait:
                                 Util_printRule(sb, q->action, "If %s %.0f", operatornames[q->operator], q->limit);
                                 break;
 
+                        case Resource_TcpSent:
+                        case Resource_TcpReceived:
+                                Util_printRule(sb, q->action, "If %s %s/s", operatornames[q->operator], Convert_bytes2str(q->limit, (char[10]){}));
+                                break;
+
                         case Resource_ReadBytes:
                         case Resource_ReadBytesPhysical:
                         case Resource_WriteBytes:
@@ -2430,50 +2460,302 @@ static void print_status(HttpRequest req, HttpResponse res, int version) {
         const char *stringFormat = get_parameter(req, "format");
         if (stringFormat && Str_startsWith(stringFormat, "xml")) {
                 char buf[STRLEN];
-                StringBuffer_T sb = StringBuffer_create(256);
-                status_xml(sb, NULL, version, Socket_getLocalHost(req->S, buf, sizeof(buf)));
-                StringBuffer_append(res->outputbuffer, "%s", StringBuffer_toString(sb));
-                StringBuffer_free(&sb);
+                status_xml(res->outputbuffer, NULL, version, Socket_getLocalHost(req->S, buf, sizeof(buf)));
                 set_content_type(res, "text/xml");
+        } else if (stringFormat && Str_startsWith(stringFormat, "cbor")) {
+                char buf[STRLEN];
+                status_cbor(res->outputbuffer, NULL, Socket_getLocalHost(req->S, buf, sizeof(buf)));
+                set_content_type(res, "application/cbor");
+        } else if (stringFormat && Str_startsWith(stringFormat, "json")) {
+                print_status_json(req, res);
         } else {
-                set_content_type(res, "text/plain");
-
-                StringBuffer_append(res->outputbuffer, "Monit %s uptime: %s\n\n", VERSION, _getUptime(ProcessTree_getProcessUptime(getpid()), (char[256]){}));
-
-                int found = 0;
+                // Only the selection is checked here, the status is rendered by _printStatusText() after the cervlet lock is released
                 const char *stringGroup = Util_urlDecode((char *)get_parameter(req, "group"));
                 const char *stringService = Util_urlDecode((char *)get_parameter(req, "service"));
                 if (stringGroup) {
-                        for (ServiceGroup_T sg = servicegrouplist; sg; sg = sg->next) {
-                                if (IS(stringGroup, sg->name)) {
-                                        for (list_t m = sg->members->head; m; m = m->next) {
-                                                status_service_txt(m->e, res);
-                                                found++;
-                                        }
-                                        break;
-                                }
+                        ServiceGroup_T sg = Util_getServiceGroup(stringGroup);
+                        if (! sg || ! sg->members->head) {
+                                send_error(req, res, SC_BAD_REQUEST, "Service group '%s' not found", stringGroup);
+                                return;
                         }
-                } else {
-                        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                                if (! stringService || IS(stringService, s->name)) {
-                                        status_service_txt(s, res);
-                                        found++;
-                                }
+                } else if (stringService) {
+                        if (! Util_getService(stringService)) {
+                                send_error(req, res, SC_BAD_REQUEST, "Service '%s' not found", stringService);
+                                return;
                         }
+                } else if (! servicelist_conf) {
+                        send_error(req, res, SC_BAD_REQUEST, "No service found");
+                        return;
                 }
-                if (found == 0) {
-                        if (stringGroup)
-                                send_error(req, res, SC_BAD_REQUEST, "Service group '%s' not found", stringGroup);
-                        else if (stringService)
-                                send_error(req, res, SC_BAD_REQUEST, "Service '%s' not found", stringService);
+                set_content_type(res, "text/plain");
+                set_writer(res, _printStatusText);
+        }
+}
+
+
+/**
+ * Render the text status selected by the group or service parameter (URL decoded by print_status()). The writer runs
+ * without the cervlet lock and reads the status snapshots with its own reader buffer; the body is flushed after each
+ * service, so the HTTP/1.1 client gets a large status in chunks
+ */
+static void _printStatusText(HttpRequest req, HttpResponse res) {
+        ServiceStatus_T status = ServiceStatus_new();
+        StringBuffer_append(res->outputbuffer, "Monit %s uptime: %s\n\n", VERSION, Util_getUptime(ProcessTree_getProcessUptime(getpid()), (char[256]){}));
+        const char *stringGroup = get_parameter(req, "group");
+        const char *stringService = get_parameter(req, "service");
+        if (stringGroup) {
+                ServiceGroup_T sg = Util_getServiceGroup(stringGroup);
+                if (sg) {
+                        for (list_t m = sg->members->head; m; m = m->next) {
+                                _statusServiceText(status, m->e, res);
+                                flush_response(res);
+                        }
+                }
+        } else {
+                // The service names are atoms
+                const char *atom = stringService ? Atom_find(stringService) : NULL;
+                for (Service_T s = servicelist_conf; s; s = s->next_conf) {
+                        if (! stringService || s->name == atom) {
+                                _statusServiceText(status, s, res);
+                                flush_response(res);
+                        }
+                }
+        }
+        ServiceStatus_delete(&status);
+}
+
+
+/* Print the JSON status, unless the status didn't change since the version the client has */
+static void print_status_json(HttpRequest req, HttpResponse res) {
+        const char *stringOffset = get_parameter(req, "offset");
+        const char *stringLimit = get_parameter(req, "limit");
+        const char *stringType = get_parameter(req, "type");
+        const char *stringStatus = get_parameter(req, "status");
+        const char *stringSort = get_parameter(req, "sort");
+        StatusQuery_T query = {
+                .offset = stringOffset ? (int)strtol(stringOffset, NULL, 10) : 0,
+                .limit = stringLimit ? (int)strtol(stringLimit, NULL, 10) : -1,
+                .type = stringType ? (int)strtol(stringType, NULL, 10) : -1,
+                .failed = stringStatus && IS(stringStatus, "failed"),
+                .sort = stringSort
+        };
+        if (query.offset < 0 || (stringLimit && query.limit < 0)) {
+                send_error(req, res, SC_BAD_REQUEST, "Invalid offset or limit");
+                return;
+        }
+        if (stringType && (query.type < 0 || query.type > Service_Last)) {
+                send_error(req, res, SC_BAD_REQUEST, "Invalid service type");
+                return;
+        }
+        const char *sortKey = stringSort && *stringSort == '-' ? stringSort + 1 : stringSort;
+        if ((stringStatus && ! query.failed) || (sortKey && ! IS(sortKey, "name") && ! IS(sortKey, "type") && ! IS(sortKey, "status"))) {
+                send_error(req, res, SC_BAD_REQUEST, "Invalid status or sort");
+                return;
+        }
+        char etag[STRLEN];
+        status_json_etag(etag, sizeof(etag));
+        set_header(res, "ETag", "%s", etag);
+        const char *match = get_header(req, "If-None-Match");
+        if (match && (strstr(match, etag) || IS(match, "*"))) {
+                set_status(res, SC_NOT_MODIFIED);
+                return;
+        }
+        set_content_type(res, "application/json");
+        query.services = Util_urlDecode((char *)get_parameter(req, "services"));
+        query.fields = Util_urlDecode((char *)get_parameter(req, "fields"));
+        query.match = Util_urlDecode((char *)get_parameter(req, "match"));
+        status_json(res->outputbuffer, &query);
+}
+
+
+static void print_metrics(HttpResponse res) {
+        set_content_type(res, "application/openmetrics-text; version=1.0.0; charset=utf-8");
+        status_metrics(res->outputbuffer);
+}
+
+
+static void print_memory(HttpRequest req, HttpResponse res) {
+        set_content_type(res, "text/plain");
+        if (! Util_printMemoryStatistics(res->outputbuffer, 0))
+                send_error(req, res, SC_NOT_IMPLEMENTED, "The allocation statistics are not available, configure monit with --enable-memstat");
+}
+
+
+/**
+ * Append the string as a quoted JSON string
+ */
+static void _appendJsonString(StringBuffer_T B, const char *s) {
+        StringBuffer_appendChar(B, '"');
+        for (const char *c = s; *c; c++) {
+                if (*c == '"' || *c == '\\')
+                        StringBuffer_append(B, "\\%c", *c);
+                else if ((unsigned char)*c < 0x20)
+                        StringBuffer_append(B, "\\u%04x", *c);
+                else
+                        StringBuffer_appendChar(B, *c);
+        }
+        StringBuffer_appendChar(B, '"');
+}
+
+
+typedef struct ProcessTop_T {
+        StringBuffer_T B;
+        Box_T box;                                /**< The text table or NULL for JSON */
+        int count;
+} ProcessTop_T;
+
+
+static const char *_processSortNames[] = {"cpu", "memory", "threads", "files", NULL};
+
+
+static void _printProcess(const ProcessTree_T *pt, void *context) {
+        ProcessTop_T *top = context;
+        float cpu = pt->cpu.usage.self > 0 ? pt->cpu.usage.self : 0;
+        if (top->box) {
+                Box_setColumn(top->box, 1, "%d", pt->pid);
+                Box_setColumn(top->box, 2, "%d", pt->ppid);
+                Box_setColumn(top->box, 3, "%.1f%%", cpu);
+                Box_setColumn(top->box, 4, "%s", Convert_bytes2str(pt->memory.usage, (char[10]){}));
+                Box_setColumn(top->box, 5, "%d", pt->threads.self);
+                if (pt->filedescriptors.usage >= 0)
+                        Box_setColumn(top->box, 6, "%lld", pt->filedescriptors.usage);
+                else
+                        Box_setColumn(top->box, 6, "-");
+                Box_setColumn(top->box, 7, "%s", STR_DEF(pt->cmdline) ? pt->cmdline : "-");
+                Box_printRow(top->box);
+        } else {
+                StringBuffer_append(top->B, "%s{\"pid\":%d,\"ppid\":%d,\"uid\":%d,\"cpu\":%.1f,\"memory\":%llu,\"threads\":%d,\"files\":%lld,\"uptime\":%lld,\"command\":",
+                        top->count ? "," : "", pt->pid, pt->ppid, pt->cred.uid, cpu, pt->memory.usage, pt->threads.self, pt->filedescriptors.usage, (long long)pt->uptime);
+                if (pt->cmdline)
+                        _appendJsonString(top->B, pt->cmdline);
+                else
+                        StringBuffer_append(top->B, "null");
+                StringBuffer_appendChar(top->B, '}');
+        }
+        top->count++;
+}
+
+
+/**
+ * Print the processes with the highest usage of the resource from the current process tree snapshot as a table, or as JSON with format=json
+ */
+static void print_processes(HttpRequest req, HttpResponse res) {
+        const char *stringSort = get_parameter(req, "sort");
+        const char *stringLimit = get_parameter(req, "limit");
+        const char *format = get_parameter(req, "format");
+        int sort = 0;
+        if (stringSort)
+                for (sort = 0; _processSortNames[sort] && ! IS(stringSort, _processSortNames[sort]); sort++)
+                        ;
+        int limit = stringLimit ? (int)strtol(stringLimit, NULL, 10) : TOP_PROCESSES;
+        if (! _processSortNames[sort] || limit < 0) {
+                send_error(req, res, SC_BAD_REQUEST, "Invalid sort or limit, the processes can be sorted by cpu, memory, threads or files");
+                return;
+        }
+        if (! (Run.flags & Run_ProcessEngineEnabled)) {
+                send_error(req, res, SC_SERVICE_UNAVAILABLE, "The process engine is not available");
+                return;
+        }
+        bool json = format && IS(format, "json");
+        ProcessTop_T top = {.B = res->outputbuffer};
+        if (json) {
+                set_content_type(res, "application/json");
+                StringBuffer_append(res->outputbuffer, "{\"sort\":\"%s\",\"processes\":[", _processSortNames[sort]);
+        } else {
+                set_content_type(res, "text/plain");
+                top.box = Box_new(res->outputbuffer, 7, (BoxColumn_T []){
+                                {.name = "PID",     .width = 8,  .wrap = false, .align = BoxAlign_Right},
+                                {.name = "PPID",    .width = 8,  .wrap = false, .align = BoxAlign_Right},
+                                {.name = "CPU",     .width = 7,  .wrap = false, .align = BoxAlign_Right},
+                                {.name = "Memory",  .width = 10, .wrap = false, .align = BoxAlign_Right},
+                                {.name = "Threads", .width = 7,  .wrap = false, .align = BoxAlign_Right},
+                                {.name = "Files",   .width = 7,  .wrap = false, .align = BoxAlign_Right},
+                                {.name = "Command", .width = 40, .wrap = false, .align = BoxAlign_Left}
+                          }, true);
+        }
+        int total = ProcessTree_top(sort, limit, _printProcess, &top);
+        if (json) {
+                StringBuffer_append(res->outputbuffer, "],\"total\":%d}", MAX(total, 0));
+        } else {
+                Box_free(&top.box);
+                StringBuffer_append(res->outputbuffer, "Top %d of %d processes by %s\n", top.count, MAX(total, 0), _processSortNames[sort]);
+        }
+}
+
+
+/**
+ * Start the server-sent events stream of the state changes. The stream
+ * is served by the event stream thread, the connection is detached from
+ * the HTTP engine after the headers
+ */
+static void print_events(HttpRequest req, HttpResponse res) {
+        if (! IS(req->protocol, "1.1")) {
+                send_error(req, res, SC_BAD_REQUEST, "The event stream requires HTTP/1.1");
+                return;
+        }
+        set_content_type(res, "text/event-stream");
+        set_header(res, "Cache-Control", "no-cache");
+        if (start_stream(res))
+                res->is_detached = EventStream_add(res->S, get_header(req, "Last-Event-ID"));
+}
+
+
+/**
+ * Print the recent metrics of the service as JSON with one array per
+ * metric (null if the value wasn't available), oldest sample first
+ */
+static void print_series(HttpRequest req, HttpResponse res) {
+        const char *name = Util_urlDecode((char *)get_parameter(req, "service"));
+        if (! name) {
+                send_error(req, res, SC_BAD_REQUEST, "Service name required");
+                return;
+        }
+        Service_T s = Util_getService(name);
+        if (! s) {
+                send_error(req, res, SC_NOT_FOUND, "There is no service named \"%s\"", name);
+                return;
+        }
+        set_content_type(res, "application/json");
+        StringBuffer_append(res->outputbuffer, "{\"service\":");
+        _appendJsonString(res->outputbuffer, s->name);
+        StringBuffer_append(res->outputbuffer, ",\"time\":[");
+        Series_T series = Series_new();
+        if (s->series)
+                Series_copy(s->series, series);
+        int count = Series_getCount(series);
+        for (int i = 0; i < count; i++) {
+                if (i)
+                        StringBuffer_appendChar(res->outputbuffer, ',');
+                StringBuffer_appendInt(res->outputbuffer, (long long)Series_getTime(series, i));
+        }
+        StringBuffer_append(res->outputbuffer, "]");
+        for (Series_Metric m = 0; m < Series_Last; m++) {
+                StringBuffer_append(res->outputbuffer, ",\"%s\":[", Series_getName(m));
+                for (int i = 0; i < count; i++) {
+                        double value = Series_getValue(series, m, i);
+                        if (isnan(value))
+                                StringBuffer_append(res->outputbuffer, "%snull", i ? "," : "");
                         else
-                                send_error(req, res, SC_BAD_REQUEST, "No service found");
+                                StringBuffer_append(res->outputbuffer, "%s%.7g", i ? "," : "", value);
                 }
+                StringBuffer_append(res->outputbuffer, "]");
         }
+        StringBuffer_append(res->outputbuffer, "}\n");
+        Series_free(&series);
+}
+
+
+static void print_profile(HttpResponse res) {
+        set_content_type(res, "text/plain");
+        StringBuffer_append(res->outputbuffer, "Monit %s uptime: %s\n", VERSION, Util_getUptime(ProcessTree_getProcessUptime(getpid()), (char[256]){}));
+        if (Run.overrun.count)
+                StringBuffer_append(res->outputbuffer, "Cycle overruns: %llu, the last took %s%s\n", Run.overrun.count, Convert_time2str(Run.overrun.duration, (char[11]){}), _overrunLevel());
+        Profile_print(res->outputbuffer);
 }
 
 
 static void _printServiceSummary(Box_T t, Service_T s) {
+        s = _getStatus(s);
         Box_setColumn(t, 1, "%s", s->name);
         Box_setColumn(t, 2, "%s", get_service_status(TXT, s, (char[STRLEN]){}, STRLEN));
         Box_setColumn(t, 3, "%s", servicetypes[s->type]);
@@ -2496,7 +2778,7 @@ static int _printServiceSummaryByType(Box_T t, Service_Type type) {
 static void print_summary(HttpRequest req, HttpResponse res) {
         set_content_type(res, "text/plain");
 
-        StringBuffer_append(res->outputbuffer, "Monit %s uptime: %s\n", VERSION, _getUptime(ProcessTree_getProcessUptime(getpid()), (char[256]){}));
+        StringBuffer_append(res->outputbuffer, "Monit %s uptime: %s\n", VERSION, Util_getUptime(ProcessTree_getProcessUptime(getpid()), (char[256]){}));
 
         int found = 0;
         const char *stringGroup = Util_urlDecode((char *)get_parameter(req, "group"));
@@ -2507,18 +2789,17 @@ static void print_summary(HttpRequest req, HttpResponse res) {
                         {.name = "Type",         .width = 13, .wrap = false, .align = BoxAlign_Left}
                   }, true);
         if (stringGroup) {
-                for (ServiceGroup_T sg = servicegrouplist; sg; sg = sg->next) {
-                        if (IS(stringGroup, sg->name)) {
-                                for (list_t m = sg->members->head; m; m = m->next) {
-                                        _printServiceSummary(t, m->e);
-                                        found++;
-                                }
-                                break;
+                ServiceGroup_T sg = Util_getServiceGroup(stringGroup);
+                if (sg) {
+                        for (list_t m = sg->members->head; m; m = m->next) {
+                                _printServiceSummary(t, m->e);
+                                found++;
                         }
                 }
         } else if (stringService) {
+                const char *atom = Atom_find(stringService);
                 for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                        if (IS(stringService, s->name)) {
+                        if (s->name == atom) {
                                 _printServiceSummary(t, s);
                                 found++;
                         }
@@ -2549,20 +2830,20 @@ static void print_summary(HttpRequest req, HttpResponse res) {
 static void _printReport(HttpRequest req, HttpResponse res) {
         set_content_type(res, "text/plain");
         const char *type = get_parameter(req, "type");
-        int count = 0;
+        float up = 0, down = 0, init = 0, unmonitored = 0, total = 0;
+        for (Service_T c = servicelist; c; c = c->next) {
+                Service_T s = _getStatus(c);
+                if (s->monitor == Monitor_Not)
+                        unmonitored++;
+                else if (s->monitor & Monitor_Init)
+                        init++;
+                else if (s->error)
+                        down++;
+                else
+                        up++;
+                total++;
+        }
         if (! type) {
-                float up = 0, down = 0, init = 0, unmonitored = 0, total = 0;
-                for (Service_T s = servicelist; s; s = s->next) {
-                        if (s->monitor == Monitor_Not)
-                                unmonitored++;
-                        else if (s->monitor & Monitor_Init)
-                                init++;
-                        else if (s->error)
-                                down++;
-                        else
-                                up++;
-                        total++;
-                }
                 StringBuffer_append(res->outputbuffer,
                         "up:           %*.0f (%.1f%%)\n"
                         "down:         %*.0f (%.1f%%)\n"
@@ -2575,29 +2856,15 @@ static void _printReport(HttpRequest req, HttpResponse res) {
                         3, unmonitored, 100. * unmonitored / total,
                         3, total);
         } else if (Str_isEqual(type, "up")) {
-                for (Service_T s = servicelist; s; s = s->next)
-                        if (s->monitor != Monitor_Not && ! (s->monitor & Monitor_Init) && ! s->error)
-                                count++;
-                StringBuffer_append(res->outputbuffer, "%d\n", count);
+                StringBuffer_append(res->outputbuffer, "%.0f\n", up);
         } else if (Str_isEqual(type, "down")) {
-                for (Service_T s = servicelist; s; s = s->next)
-                        if (s->monitor != Monitor_Not && ! (s->monitor & Monitor_Init) && s->error)
-                                count++;
-                StringBuffer_append(res->outputbuffer, "%d\n", count);
+                StringBuffer_append(res->outputbuffer, "%.0f\n", down);
         } else if (Str_startsWith(type, "initiali")) { // allow 'initiali(s|z)ing'
-                for (Service_T s = servicelist; s; s = s->next)
-                        if (s->monitor & Monitor_Init)
-                                count++;
-                StringBuffer_append(res->outputbuffer, "%d\n", count);
+                StringBuffer_append(res->outputbuffer, "%.0f\n", init);
         } else if (Str_isEqual(type, "unmonitored")) {
-                for (Service_T s = servicelist; s; s = s->next)
-                        if (s->monitor == Monitor_Not)
-                                count++;
-                StringBuffer_append(res->outputbuffer, "%d\n", count);
+                StringBuffer_append(res->outputbuffer, "%.0f\n", unmonitored);
         } else if (Str_isEqual(type, "total")) {
-                for (Service_T s = servicelist; s; s = s->next)
-                        count++;
-                StringBuffer_append(res->outputbuffer, "%d\n", count);
+                StringBuffer_append(res->outputbuffer, "%.0f\n", total);
         } else {
                 send_error(req, res, SC_BAD_REQUEST, "Invalid report type: '%s'", type);
         }
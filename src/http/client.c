@@ -58,6 +58,8 @@
 #include "Color.h"
 #include "Box.h"
 #include "client.h"
+#include "rpc.h"
+#include "StatusFile.h"
 
 // libmonit
 #include "exceptions/AssertException.h"
@@ -160,15 +162,19 @@ static void _send(Socket_T S, const char *request, StringBuffer_T data) {
 }
 
 
+static void _print(char *line, bool strip) {
+        if (strip)
+                Color_strip(Box_strip(line));
+        printf("%s", line);
+}
+
+
 static void _receive(Socket_T S) {
         char buf[1024];
         _parseHttpResponse(S);
         bool strip = (Run.flags & Run_Batch || ! Color_support()) ? true : false;
-        while (Socket_readLine(S, buf, sizeof(buf))) {
-                if (strip)
-                        Color_strip(Box_strip(buf));
-                printf("%s", buf);
-        }
+        while (Socket_readLine(S, buf, sizeof(buf)))
+                _print(buf, strip);
 }
 
 
@@ -207,17 +213,26 @@ static bool _client(const char *request, StringBuffer_T data) {
 /* ------------------------------------------------------------------ Public */
 
 
-bool HttpClient_action(const char *action, List_T services) {
+bool HttpClient_action(const char *action, const char *group, List_T services) {
         ASSERT(services);
         ASSERT(action);
-        if (Util_getAction(action) == Action_Ignored) {
+        Action_Type doaction = Util_getAction(action);
+        if (doaction == Action_Ignored) {
                 Log_error("Invalid action %s\n", action);
                 return false;
         }
+        // Use the control RPC over the unix socket if possible, all services are sent in one request
+        if (exist_daemon()) {
+                Rpc_Status status = Rpc_action(doaction, group, services);
+                if (status != Rpc_Unavailable)
+                        return status == Rpc_Ok;
+        }
         StringBuffer_T data = StringBuffer_create(64);
         _argument(data, "action", action);
+        if (group)
+                _argument(data, "group", group);
         for (list_t s = services->head; s; s = s->next)
-                _argument(data, "service", s->e);
+                _argument(data, Util_getSelectType(s->e) == Select_Pattern ? "pattern" : "service", s->e);
         bool rv = _client("/_doaction", data);
         StringBuffer_free(&data);
         return rv;
@@ -247,6 +262,15 @@ bool HttpClient_status(const char *group, const char *service) {
 
 
 bool HttpClient_summary(const char *group, const char *service) {
+        // Read the summary from the daemon's status file if available. The table is rendered plain if the output should be stripped, so it is written at once
+        StringBuffer_T summary = StringBuffer_create(1024);
+        bool strip = (Run.flags & Run_Batch || ! Color_support()) ? true : false;
+        if (StatusFile_summary(summary, STR_DEF(group) ? group : NULL, STR_DEF(service) ? service : NULL, strip)) {
+                fwrite(StringBuffer_toString(summary), 1, StringBuffer_length(summary), stdout);
+                StringBuffer_free(&summary);
+                return true;
+        }
+        StringBuffer_free(&summary);
         StringBuffer_T data = StringBuffer_create(64);
         if (STR_DEF(service))
                 _argument(data, "service", service);
@@ -257,3 +281,23 @@ bool HttpClient_summary(const char *group, const char *service) {
         return rv;
 }
 
+
+bool HttpClient_profile() {
+        StringBuffer_T data = StringBuffer_create(64);
+        bool rv = _client("/_runtime/profile", data);
+        StringBuffer_free(&data);
+        return rv;
+}
+
+
+bool HttpClient_top(const char *sort, const char *limit) {
+        StringBuffer_T data = StringBuffer_create(64);
+        if (STR_DEF(sort))
+                _argument(data, "sort", sort);
+        if (STR_DEF(limit))
+                _argument(data, "limit", limit);
+        bool rv = _client("/_processes", data);
+        StringBuffer_free(&data);
+        return rv;
+}
+
@@ -27,12 +27,14 @@
 
 
 /**
- * Do service action
+ * Do service action. The daemon selects the services and schedules the
+ * action for all of them at once
  * @param action A string representation of Action_Type
- * @param services List of services
+ * @param group Service group or NULL
+ * @param services List of service names or glob patterns
  * @return true if succeeded otherwise false
  */
-bool HttpClient_action(const char *action, List_T services);
+bool HttpClient_action(const char *action, const char *group, List_T services);
 
 
 /**
@@ -61,4 +63,20 @@ bool HttpClient_status(const char *group, const char *service);
 bool HttpClient_summary(const char *group, const char *service);
 
 
+/**
+ * Print the profile of the service checks and of the validation cycle
+ * @return true if succeeded otherwise false
+ */
+bool HttpClient_profile(void);
+
+
+/**
+ * Print the processes with the highest resource usage
+ * @param sort The resource (cpu, memory, threads or files) or NULL for cpu
+ * @param limit The number of the processes or NULL for the default
+ * @return true if succeeded otherwise false
+ */
+bool HttpClient_top(const char *sort, const char *limit);
+
+
 #endif
@@ -88,11 +88,15 @@
 #include "engine.h"
 #include "processor.h"
 #include "cervlet.h"
+#include "rpc.h"
+#include "eventstream.h"
 #include "net/net.h"
 #include "SslServer.h"
 
 // libmonit
 #include "system/Net.h"
+#include "system/Time.h"
+#include "thread/Thread.h"
 #include "exceptions/AssertException.h"
 #include "exceptions/IOException.h"
 
@@ -102,9 +106,12 @@
  *  request and response to the processor module.
  *
  *  NOTE
- *    This server does not use threads or forks; Requests are
- *    serialized and pending requests will be popped from the
- *    connection queue when the current request finish.
+ *    The engine thread accepts the connections and polls them until the
+ *    client sends the request, then it passes the connection to a small
+ *    pool of worker threads which read the request and send the response.
+ *    A slow client thus blocks only one worker, not the whole server. The
+ *    number of open connections is limited, when the limit is reached new
+ *    connections wait in the listen queue until some connection is closed.
  *
  *    Since this server is written for monit, low traffic is expected.
  *    Connect from not-authenticated clients will be closed down
@@ -128,8 +135,35 @@ typedef struct HostsAllow_T {
 } *HostsAllow_T;
 
 
+/* Path compressed binary trie of the allowed networks, keyed by the network prefix */
+typedef struct AllowNode_T {
+        uint32_t prefix[4];       // IPv4 (mapped to IPv6) or IPv6 network address
+        int length;               // prefix length [bits]
+        bool allowed;             // false if the node is only a branch
+        struct AllowNode_T *child[2];
+} *AllowNode_T;
+
+
 #define MAX_SERVER_SOCKETS 3
 
+// Time to wait for the request after the connection was accepted [ms]
+#define REQUEST_WAIT 500
+
+
+typedef struct Connection_T {
+        int socket;
+        int server;                       /**< Index of the server socket */
+        int requests;                 /**< Number of requests on the connection */
+        long long deadline;   /**< Close the connection if no request until [ms] */
+        Socket_T S;               /**< The connection socket after the first request */
+        union {
+                struct sockaddr_storage addr_in;
+                struct sockaddr_un addr_un;
+        } _addr;
+        /* For internal use */
+        struct Connection_T *next;
+} *Connection_T;
+
 
 static struct {
         Socket_Family family;
@@ -148,12 +182,135 @@ static struct {
 static volatile bool stopped = false;
 static int myServerSocketsCount = 0;
 static struct pollfd myServerSockets[3] = {};
-static HostsAllow_T allowlist = NULL;
+static HostsAllow_T allowlist = NULL; // Entries with a non-contiguous netmask
+static AllowNode_T allowtree = NULL;
+
+
+static struct {
+        int count;                              /**< Number of open connections */
+        int workers;                              /**< Number of worker threads */
+        int wakeup[2];                     /**< Pipe to wake up the engine thread */
+        bool stop;
+        Connection_T waiting;        /**< Connections waiting for the request */
+        Connection_T idle;   /**< Persistent connections returned by the workers */
+        Connection_T head;               /**< Connections ready for a worker */
+        Connection_T tail;
+        struct pollfd *fds;
+        Connection_T *polled;       /**< The connection of the poll descriptor */
+        Thread_T *threads;
+        Mutex_T mutex;
+        Sem_T ready;
+} _pool = {.wakeup = {-1, -1}};
 
 
 /* ----------------------------------------------------------------- Private */
 
 
+static int _getBit(const uint32_t address[4], int bit) {
+        return (ntohl(address[bit / 32]) >> (31 - bit % 32)) & 1;
+}
+
+
+/**
+ * Returns the number of leading bits, up to limit, which are equal in both addresses
+ */
+static int _getCommonPrefix(const uint32_t address1[4], const uint32_t address2[4], int limit) {
+        int bits = 0;
+        for (int i = 0; i < 4 && bits < limit; i++) {
+                uint32_t diff = ntohl(address1[i] ^ address2[i]);
+                if (diff) {
+                        for (; ! (diff & 0x80000000); diff <<= 1)
+                                bits++;
+                        break;
+                }
+                bits += 32;
+        }
+        return MIN(bits, limit);
+}
+
+
+/**
+ * Returns the prefix length of the mask or -1 if the mask is not contiguous
+ */
+static int _getPrefixLength(const uint32_t mask[4]) {
+        int length = 0;
+        while (length < 128 && _getBit(mask, length))
+                length++;
+        for (int i = length; i < 128; i++)
+                if (_getBit(mask, i))
+                        return -1;
+        return length;
+}
+
+
+static AllowNode_T _newAllowNode(const uint32_t address[4], int length, bool allowed) {
+        AllowNode_T node;
+        NEW(node);
+        for (int i = 0; i < 4; i++) {
+                int bits = MIN(MAX(length - i * 32, 0), 32);
+                node->prefix[i] = bits ? address[i] & htonl(0xffffffff << (32 - bits)) : 0;
+        }
+        node->length = length;
+        node->allowed = allowed;
+        return node;
+}
+
+
+/**
+ * Add the network to the trie
+ * @return false if the network is present already
+ */
+static bool _insertAllow(const uint32_t address[4], int length) {
+        AllowNode_T *link = &allowtree;
+        while (*link) {
+                AllowNode_T node = *link;
+                int common = _getCommonPrefix(node->prefix, address, MIN(node->length, length));
+                if (common < node->length) {
+                        // The new network diverges within the node prefix (or is its supernet): split the node
+                        AllowNode_T parent = _newAllowNode(address, common, common == length);
+                        parent->child[_getBit(node->prefix, common)] = node;
+                        if (common < length)
+                                parent->child[_getBit(address, common)] = _newAllowNode(address, length, true);
+                        *link = parent;
+                        return true;
+                }
+                if (node->length == length) {
+                        if (node->allowed)
+                                return false;
+                        node->allowed = true;
+                        return true;
+                }
+                link = &node->child[_getBit(address, node->length)];
+        }
+        *link = _newAllowNode(address, length, true);
+        return true;
+}
+
+
+/**
+ * Returns true if the address is in some network in the trie. The cost is
+ * bound by the address length, regardless of the number of networks.
+ */
+static bool _lookupAllow(const uint32_t address[4]) {
+        for (AllowNode_T node = allowtree; node; node = node->length < 128 ? node->child[_getBit(address, node->length)] : NULL) {
+                if (_getCommonPrefix(node->prefix, address, node->length) < node->length)
+                        return false;
+                if (node->allowed)
+                        return true;
+        }
+        return false;
+}
+
+
+static void _freeAllowTree(AllowNode_T *node) {
+        if (*node) {
+                _freeAllowTree(&(*node)->child[0]);
+                _freeAllowTree(&(*node)->child[1]);
+                FREE(*node);
+        }
+}
+
+
 static bool _hasAllow(HostsAllow_T host) {
         for (HostsAllow_T p = allowlist; p; p = p->next)
                 if (memcmp(p->address, &(host->address), 16) == 0 && memcmp(p->mask, &(host->mask), 16) == 0)
@@ -166,7 +323,8 @@ static void _pushAllow(HostsAllow_T h, const char *pattern) {
         char buf[INET6_ADDRSTRLEN] = {};
         if (! Str_sub(pattern, "/"))
                 inet_ntop(AF_INET6, &(h->address), buf, sizeof(buf));
-        if (_hasAllow(h))  {
+        int length = _getPrefixLength(h->mask);
+        if (length >= 0 ? ! _insertAllow(h->address, length) : _hasAllow(h)) {
                 if (*buf)
                         Log_warning("Skipping 'allow %s' -- host resolved to [%s] which is present in ACL already\n", pattern, buf);
                 else
@@ -177,8 +335,12 @@ static void _pushAllow(HostsAllow_T h, const char *pattern) {
                         DEBUG("Adding 'allow %s' -- host resolved to [%s]\n", pattern, buf);
                 else
                         DEBUG("Adding 'allow %s'\n", pattern);
-                h->next = allowlist;
-                allowlist = h;
+                if (length >= 0) {
+                        FREE(h);
+                } else {
+                        h->next = allowlist;
+                        allowlist = h;
+                }
         }
 }
 
@@ -192,7 +354,9 @@ static bool _matchAllow(uint32_t address1[4], uint32_t address2[4], uint32_t mas
 
 
 static bool _isAllowed(uint32_t address[4]) {
-        if (allowlist) {
+        if (allowtree || allowlist) {
+                if (_lookupAllow(address))
+                        return true;
                 for (HostsAllow_T p = allowlist; p; p = p->next)
                         if (_matchAllow(p->address, address, p->mask))
                                 return true;
@@ -329,7 +493,9 @@ static bool _parseNetwork(char *pattern) {
                 struct sockaddr_in addr;
                 if (! inet_aton(longmask, &(addr.sin_addr)))
                         return false;
-                _mapIPv4toIPv6((uint32_t *)&(addr.sin_addr), net.mask);
+                // Compare all mapped IPv6 prefix bits, as with the CIDR notation
+                memset(net.mask, 0xff, 12);
+                net.mask[3] = addr.sin_addr.s_addr;
         }
         _pushAllow(_copyAllow(&net), pattern);
         return true;
@@ -395,35 +561,282 @@ static bool _authenticateHost(struct sockaddr *addr) {
 }
 
 
-static Socket_T _socketProducer(void) {
-        int r = 0;
-        do {
-                r = poll(myServerSockets, myServerSocketsCount, 1000);
-        } while (r == -1 && errno == EINTR);
-        if (r > 0) {
-                for (int i = 0; i < myServerSocketsCount; i++) {
-                        if (myServerSockets[i].revents & POLLIN) {
-                                int client = accept(myServerSockets[i].fd, data[i].addr, &(data[i].addrlen));
-                                if (client < 0) {
-                                        Log_error("HTTP server: cannot accept connection -- %s\n", stopped ? "service stopped" : STRERROR);
-                                        return NULL;
-                                }
-                                if (!Net_setNonBlocking(client) || !Net_canRead(client, 500) || !Net_canWrite(client, 500) || ! _authenticateHost(data[i].addr)) {
-                                        Net_abort(client);
-                                        return NULL;
-                                }
+static void _wakeup(void) {
+        char byte = 0;
+        if (write(_pool.wakeup[1], &byte, 1) < 0 && errno != EAGAIN)
+                DEBUG("HTTP server: cannot wake up the engine -- %s\n", STRERROR);
+}
+
+
+static void _close(Connection_T *C) {
+        if ((*C)->S)
+                Socket_free(&((*C)->S));
+        else if ((*C)->socket >= 0)
+                Net_abort((*C)->socket);
+        FREE(*C);
+        LOCK(_pool.mutex)
+        {
+                _pool.count--;
+        }
+        END_LOCK;
+}
+
+
+static void _dispatch(Connection_T C) {
+        LOCK(_pool.mutex)
+        {
+                C->next = NULL;
+                if (_pool.tail)
+                        _pool.tail->next = C;
+                else
+                        _pool.head = C;
+                _pool.tail = C;
+                Sem_signal(_pool.ready);
+        }
+        END_LOCK;
+}
+
+
+static void *_worker(__attribute__ ((unused)) void *args) {
+        set_signal_block();
+        while (true) {
+                Connection_T C = NULL;
+                LOCK(_pool.mutex)
+                {
+                        while (! _pool.head && ! _pool.stop)
+                                Sem_wait(_pool.ready, _pool.mutex);
+                        if ((C = _pool.head)) {
+                                _pool.head = C->next;
+                                if (! _pool.head)
+                                        _pool.tail = NULL;
+                        }
+                }
+                END_LOCK;
+                if (! C)
+                        break;
+                Processor_Result result = Processor_Close;
+                if (! C->S) {
 #ifdef HAVE_OPENSSL
-                                return Socket_createAccepted(client, data[i].addr, data[i].ssl);
+                        C->S = Socket_createAccepted(C->socket, (struct sockaddr *)&(C->_addr), data[C->server].ssl);
 #else
-                                return Socket_createAccepted(client, data[i].addr, NULL);
+                        C->S = Socket_createAccepted(C->socket, (struct sockaddr *)&(C->_addr), NULL);
 #endif
+                        if (! C->S)
+                                C->socket = -1; // Closed by Socket_createAccepted
+                }
+                if (C->S && C->requests == 0 && data[C->server].family == Socket_Unix && Rpc_isRequest(C->S)) {
+                        // The control RPC from the CLI, one request per connection
+                        C->requests++;
+                        Rpc_process(C->S);
+                        _close(&C);
+                        _wakeup();
+                } else if ((result = C->S ? http_processor(C->S, ++C->requests < KEEPALIVE_REQUESTS && ! stopped) : Processor_Close) == Processor_KeepAlive) {
+                        C->deadline = Time_milli() + KEEPALIVE_TIMEOUT * 1000;
+                        if (Socket_hasPendingData(C->S)) {
+                                // The next request was received with the previous one already (pipelining)
+                                _dispatch(C);
+                        } else {
+                                // Return the connection to the engine thread to wait for the next request
+                                LOCK(_pool.mutex)
+                                {
+                                        C->next = _pool.idle;
+                                        _pool.idle = C;
+                                }
+                                END_LOCK;
+                                _wakeup();
+                        }
+                } else {
+                        if (result == Processor_Detached) {
+                                // The connection is served by the event stream now, release the slot only
+                                C->S = NULL;
+                                C->socket = -1;
                         }
+                        _close(&C);
+                        _wakeup();
                 }
         }
         return NULL;
 }
 
 
+static void _accept(int server) {
+        bool full;
+        LOCK(_pool.mutex)
+        {
+                if (! (full = _pool.count >= Run.httpd.connections))
+                        _pool.count++;
+        }
+        END_LOCK;
+        if (full)
+                return;
+        socklen_t addrlen = data[server].addrlen;
+        int client = accept(myServerSockets[server].fd, data[server].addr, &addrlen);
+        if (client < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                        Log_error("HTTP server: cannot accept connection -- %s\n", stopped ? "service stopped" : STRERROR);
+        } else if (Net_setNonBlocking(client) && _authenticateHost(data[server].addr)) {
+                Connection_T C;
+                NEW(C);
+                C->socket = client;
+                C->server = server;
+                C->deadline = Time_milli() + REQUEST_WAIT;
+                memcpy(&(C->_addr), data[server].addr, MIN(addrlen, sizeof(C->_addr)));
+                C->next = _pool.waiting;
+                _pool.waiting = C;
+                return;
+        } else {
+                Net_abort(client);
+        }
+        LOCK(_pool.mutex)
+        {
+                _pool.count--;
+        }
+        END_LOCK;
+}
+
+
+/**
+ * Poll the server sockets and the connections waiting for the request. The connections with a request are passed to the workers.
+ */
+static void _poll(void) {
+        int count;
+        LOCK(_pool.mutex)
+        {
+                count = _pool.count;
+        }
+        END_LOCK;
+        int n = 0;
+        for (int i = 0; i < myServerSocketsCount; i++, n++) {
+                _pool.fds[n].fd = myServerSockets[i].fd;
+                _pool.fds[n].events = count < Run.httpd.connections ? POLLIN : 0; // Leave new connections in the listen queue if the limit was reached
+                _pool.fds[n].revents = 0;
+        }
+        _pool.fds[n].fd = _pool.wakeup[0];
+        _pool.fds[n].events = POLLIN;
+        _pool.fds[n].revents = 0;
+        n++;
+        // Wait for the next request on the persistent connections returned by the workers
+        LOCK(_pool.mutex)
+        {
+                while (_pool.idle) {
+                        Connection_T C = _pool.idle;
+                        _pool.idle = C->next;
+                        C->next = _pool.waiting;
+                        _pool.waiting = C;
+                }
+        }
+        END_LOCK;
+        long long now = Time_milli();
+        int timeout = -1; // With no connection waiting, sleep until a client connects or the engine is woken up
+        for (Connection_T C = _pool.waiting; C; C = C->next, n++) {
+                _pool.fds[n].fd = C->socket;
+                _pool.fds[n].events = POLLIN;
+                _pool.fds[n].revents = 0;
+                _pool.polled[n] = C;
+                int expires = MAX(0, (int)(C->deadline - now));
+                timeout = timeout < 0 ? expires : MIN(timeout, expires);
+        }
+        int r = poll(_pool.fds, n, timeout);
+        if (r < 0) {
+                if (errno != EINTR)
+                        Log_error("HTTP server: poll failed -- %s\n", STRERROR);
+                return;
+        }
+        if (_pool.fds[myServerSocketsCount].revents & POLLIN) {
+                char buf[256];
+                while (read(_pool.wakeup[0], buf, sizeof(buf)) > 0)
+                        ;
+        }
+        // Pass the ready connections to the workers and close the expired ones
+        now = Time_milli();
+        for (int i = myServerSocketsCount + 1; i < n; i++) {
+                Connection_T C = _pool.polled[i];
+                if (_pool.fds[i].revents || C->deadline <= now) {
+                        for (Connection_T *p = &_pool.waiting; *p; p = &(*p)->next) {
+                                if (*p == C) {
+                                        *p = C->next;
+                                        break;
+                                }
+                        }
+                        if (_pool.fds[i].revents & POLLIN)
+                                _dispatch(C);
+                        else
+                                _close(&C);
+                }
+        }
+        for (int i = 0; i < myServerSocketsCount; i++)
+                if (_pool.fds[i].revents & POLLIN)
+                        _accept(i);
+}
+
+
+static bool _startPool(void) {
+        Mutex_init(_pool.mutex);
+        Sem_init(_pool.ready);
+        // The wakeup pipe is kept open when the server stops, so Engine_stop() can write to it at any time
+        if (_pool.wakeup[0] < 0) {
+                if (pipe(_pool.wakeup) != 0) {
+                        Log_error("HTTP server: cannot create the wakeup pipe -- %s\n", STRERROR);
+                        return false;
+                }
+                for (int i = 0; i < 2; i++) {
+                        Net_setNonBlocking(_pool.wakeup[i]);
+                        fcntl(_pool.wakeup[i], F_SETFD, FD_CLOEXEC);
+                }
+        }
+        _pool.stop = false;
+        _pool.count = 0;
+        _pool.fds = CALLOC(MAX_SERVER_SOCKETS + 1 + Run.httpd.connections, sizeof(struct pollfd));
+        _pool.polled = CALLOC(MAX_SERVER_SOCKETS + 1 + Run.httpd.connections, sizeof(Connection_T));
+        _pool.threads = CALLOC(Run.httpd.workers, sizeof(Thread_T));
+        TRY
+        {
+                for (_pool.workers = 0; _pool.workers < Run.httpd.workers; _pool.workers++)
+                        Thread_create(_pool.threads[_pool.workers], _worker, NULL);
+        }
+        ELSE
+        {
+                Log_error("HTTP server: cannot create the worker thread -- %s\n", Exception_frame.message);
+        }
+        END_TRY;
+        return _pool.workers > 0;
+}
+
+
+static void _stopPool(void) {
+        LOCK(_pool.mutex)
+        {
+                _pool.stop = true;
+                Sem_broadcast(_pool.ready);
+        }
+        END_LOCK;
+        for (int i = 0; i < _pool.workers; i++)
+                Thread_join(_pool.threads[i]);
+        _pool.workers = 0;
+        while (_pool.waiting) {
+                Connection_T C = _pool.waiting;
+                _pool.waiting = C->next;
+                _close(&C);
+        }
+        while (_pool.head) {
+                Connection_T C = _pool.head;
+                _pool.head = C->next;
+                _close(&C);
+        }
+        while (_pool.idle) {
+                Connection_T C = _pool.idle;
+                _pool.idle = C->next;
+                _close(&C);
+        }
+        _pool.tail = NULL;
+        FREE(_pool.fds);
+        FREE(_pool.polled);
+        FREE(_pool.threads);
+        Sem_destroy(_pool.ready);
+        Mutex_destroy(_pool.mutex);
+}
+
+
 static void _createTcpServer(Socket_Family family, char error[STRLEN]) {
         myServerSockets[myServerSocketsCount].fd = create_server_socket_tcp(Run.httpd.socket.net.address, Run.httpd.socket.net.port, family, 1024, error);
         if (myServerSockets[myServerSocketsCount].fd != -1) {
@@ -488,6 +901,7 @@ void Engine_start() {
         }
         Engine_cleanup();
         init_service();
+        Processor_flushCredentials();
         char error[MAX_SERVER_SOCKETS][STRLEN] = {};
         if (Run.httpd.flags & Httpd_Net) {
                 _createTcpServer(Socket_Ip4, error[0]);
@@ -502,11 +916,13 @@ void Engine_start() {
                         if (STR_DEF(error[i]))
                                 Log_error("HTTP server -- %s\n", error[i]);
         } else {
-                while (! stopped) {
-                        Socket_T S = _socketProducer();
-                        if (S)
-                                http_processor(S);
+                if (_startPool()) {
+                        EventStream_start();
+                        while (! stopped)
+                                _poll();
                 }
+                _stopPool();
+                EventStream_stop();
                 for (int i = 0; i < myServerSocketsCount; i++) {
 #ifdef HAVE_OPENSSL
                         if (data[i].ssl)
@@ -526,6 +942,9 @@ void Engine_setStopped(bool stop) {
 
 void Engine_stop() {
         Engine_setStopped(true);
+        // The idle engine thread sleeps in poll without a timeout
+        if (_pool.wakeup[1] >= 0)
+                _wakeup();
 }
 
 
@@ -545,7 +964,7 @@ bool Engine_addAllow(char *pattern) {
 
 
 bool Engine_hasAllow() {
-        return allowlist ? true : false;
+        return allowtree || allowlist ? true : false;
 }
 
 
@@ -555,5 +974,6 @@ void Engine_destroyAllow() {
                 FREE(current);
         }
         allowlist = NULL;
+        _freeAllowTree(&allowtree);
 }
 
@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#include <stdatomic.h>
+
+#include "monit.h"
+#include "eventstream.h"
+
+// libmonit
+#include "system/Net.h"
+#include "system/Time.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ *  Implementation of the event stream.
+ *
+ *  The posted events are kept in the backlog ring by their sequence
+ *  number, each stream remembers the sequence of the last event it sent.
+ *  The stream thread polls the client connections and wakes up when an
+ *  event is posted, the pending events are sent to each stream as one
+ *  chunk, formatted once for all streams at the same position. The event
+ *  id is "incarnation-sequence", so the client which reconnects to the
+ *  restarted monit doesn't resume at a wrong position.
+ *
+ *  The client is not expected to send anything after the request: the
+ *  stream is closed when the connection becomes readable (the client
+ *  closed it), on error or if the client doesn't read the events and the
+ *  write times out.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+// The number of the recent events kept for the reconnecting clients
+#define EVENTSTREAM_BACKLOG 256
+
+
+// The maximum number of streams
+#define EVENTSTREAM_LIMIT 4096
+
+
+// The idle stream sends a comment in this interval, so the proxies keep the connection open [ms]
+#define EVENTSTREAM_HEARTBEAT 15000
+
+
+// The client which doesn't accept the data in this time is disconnected [ms]
+#define EVENTSTREAM_TIMEOUT 1000
+
+
+typedef struct Stream_T {
+        Socket_T S;
+        bool closed;
+        unsigned long long sequence;         /**< The last event sent */
+        long long heartbeat;         /**< The time of the next heartbeat [ms] */
+        struct Stream_T *next;
+} *Stream_T;
+
+
+static struct {
+        atomic_int count;                             /**< Number of streams */
+        int wakeup[2];                     /**< Pipe to wake up the stream thread */
+        bool running;
+        bool stop;
+        unsigned long long sequence;           /**< The last posted event */
+        char *backlog[EVENTSTREAM_BACKLOG];        /**< The recent events data */
+        Stream_T streams;                   /**< The streams served by the thread */
+        Stream_T added;                  /**< The streams added since the last poll */
+        Thread_T thread;
+        Mutex_T mutex;
+} _stream = {.wakeup = {-1, -1}, .mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+// Must be called with the mutex locked
+static void _wakeup(void) {
+        char byte = 0;
+        if (_stream.wakeup[1] >= 0 && write(_stream.wakeup[1], &byte, 1) < 0 && errno != EAGAIN)
+                DEBUG("Event stream: cannot wake up the thread -- %s\n", STRERROR);
+}
+
+
+static void _free(Stream_T *S) {
+        Socket_free(&((*S)->S));
+        FREE(*S);
+        atomic_fetch_sub_explicit(&_stream.count, 1, memory_order_relaxed);
+}
+
+
+/**
+ * Append the events after the sequence up to the last sequence to the buffer. The events which were
+ * overwritten in the backlog already are lost
+ */
+static void _pending(unsigned long long sequence, unsigned long long last, StringBuffer_T B) {
+        LOCK(_stream.mutex)
+        {
+                if (_stream.sequence > EVENTSTREAM_BACKLOG && sequence < _stream.sequence - EVENTSTREAM_BACKLOG)
+                        sequence = _stream.sequence - EVENTSTREAM_BACKLOG;
+                for (unsigned long long id = sequence + 1; id <= last; id++)
+                        StringBuffer_append(B, "id: %llx-%llu\ndata: %s\n\n", (unsigned long long)Run.incarnation, id, _stream.backlog[id % EVENTSTREAM_BACKLOG]);
+        }
+        END_LOCK;
+}
+
+
+/**
+ * Send the data as one chunk of the chunked transfer encoding
+ * @return false if the chunk could not be sent
+ */
+static bool _send(Stream_T S, const char *data, size_t length) {
+        S->heartbeat = Time_milli() + EVENTSTREAM_HEARTBEAT;
+        return Socket_print(S->S, "%zx\r\n", length) >= 0 && Socket_write(S->S, data, length) == (int)length && Socket_print(S->S, "\r\n") >= 0;
+}
+
+
+/**
+ * Send the pending events and the heartbeats, close the streams which failed
+ * @return The time to the next heartbeat [ms]
+ */
+static int _serve(StringBuffer_T B) {
+        unsigned long long last, cached = 0;
+        LOCK(_stream.mutex)
+        {
+                last = _stream.sequence;
+        }
+        END_LOCK;
+        StringBuffer_clear(B);
+        long long now = Time_milli(), next = now + EVENTSTREAM_HEARTBEAT;
+        for (Stream_T *S = &_stream.streams; *S;) {
+                if (! (*S)->closed) {
+                        if ((*S)->sequence < last) {
+                                // The streams at the same position share the formatted events
+                                if (! StringBuffer_length(B) || (*S)->sequence != cached) {
+                                        StringBuffer_clear(B);
+                                        _pending((*S)->sequence, last, B);
+                                        cached = (*S)->sequence;
+                                }
+                                (*S)->sequence = last;
+                                (*S)->closed = StringBuffer_length(B) && ! _send(*S, StringBuffer_toString(B), StringBuffer_length(B));
+                        } else if ((*S)->heartbeat <= now) {
+                                (*S)->closed = ! _send(*S, ":\n\n", 3);
+                        }
+                }
+                if ((*S)->closed) {
+                        Stream_T closed = *S;
+                        *S = closed->next;
+                        _free(&closed);
+                } else {
+                        next = MIN(next, (*S)->heartbeat);
+                        S = &(*S)->next;
+                }
+        }
+        return (int)MAX(next - now, 0);
+}
+
+
+static void *_run(__attribute__ ((unused)) void *args) {
+        set_signal_block();
+        int size = 0;
+        struct pollfd *fds = NULL;
+        Stream_T *polled = NULL;
+        StringBuffer_T B = StringBuffer_create(1024);
+        while (true) {
+                bool stop;
+                LOCK(_stream.mutex)
+                {
+                        if (! (stop = _stream.stop)) {
+                                while (_stream.added) {
+                                        Stream_T S = _stream.added;
+                                        _stream.added = S->next;
+                                        S->next = _stream.streams;
+                                        _stream.streams = S;
+                                }
+                        }
+                }
+                END_LOCK;
+                if (stop)
+                        break;
+                int timeout = _serve(B);
+                int count = 1;
+                for (Stream_T S = _stream.streams; S; S = S->next)
+                        count++;
+                if (count > size) {
+                        size = count * 2;
+                        RESIZE(fds, size * sizeof(struct pollfd));
+                        RESIZE(polled, size * sizeof(Stream_T));
+                }
+                fds[0] = (struct pollfd){.fd = _stream.wakeup[0], .events = POLLIN};
+                count = 1;
+                for (Stream_T S = _stream.streams; S; S = S->next, count++) {
+                        fds[count] = (struct pollfd){.fd = Socket_getSocket(S->S), .events = POLLIN};
+                        polled[count] = S;
+                }
+                if (poll(fds, count, timeout) > 0) {
+                        if (fds[0].revents) {
+                                char buf[256];
+                                while (read(_stream.wakeup[0], buf, sizeof(buf)) > 0)
+                                        ;
+                        }
+                        for (int i = 1; i < count; i++)
+                                if (fds[i].revents)
+                                        polled[i]->closed = true;
+                }
+        }
+        StringBuffer_free(&B);
+        FREE(fds);
+        FREE(polled);
+        LOCK(_stream.mutex)
+        {
+                while (_stream.added) {
+                        Stream_T S = _stream.added;
+                        _stream.added = S->next;
+                        _free(&S);
+                }
+        }
+        END_LOCK;
+        while (_stream.streams) {
+                Stream_T S = _stream.streams;
+                _stream.streams = S->next;
+                _free(&S);
+        }
+        return NULL;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool EventStream_start(void) {
+        volatile bool running = false;
+        LOCK(_stream.mutex)
+        {
+                if (pipe(_stream.wakeup) != 0) {
+                        Log_error("Event stream: cannot create the wakeup pipe -- %s\n", STRERROR);
+                } else {
+                        for (int i = 0; i < 2; i++) {
+                                Net_setNonBlocking(_stream.wakeup[i]);
+                                fcntl(_stream.wakeup[i], F_SETFD, FD_CLOEXEC);
+                        }
+                        _stream.stop = false;
+                        TRY
+                        {
+                                Thread_create(_stream.thread, _run, NULL);
+                                running = _stream.running = true;
+                        }
+                        ELSE
+                        {
+                                Log_error("Event stream: cannot create the thread -- %s\n", Exception_frame.message);
+                        }
+                        END_TRY;
+                        if (! running) {
+                                for (int i = 0; i < 2; i++) {
+                                        close(_stream.wakeup[i]);
+                                        _stream.wakeup[i] = -1;
+                                }
+                        }
+                }
+        }
+        END_LOCK;
+        return running;
+}
+
+
+void EventStream_stop(void) {
+        bool running;
+        LOCK(_stream.mutex)
+        {
+                if ((running = _stream.running)) {
+                        _stream.stop = true;
+                        _wakeup();
+                }
+        }
+        END_LOCK;
+        if (running) {
+                Thread_join(_stream.thread);
+                LOCK(_stream.mutex)
+                {
+                        for (int i = 0; i < 2; i++) {
+                                close(_stream.wakeup[i]);
+                                _stream.wakeup[i] = -1;
+                        }
+                        _stream.running = false;
+                }
+                END_LOCK;
+        }
+}
+
+
+bool EventStream_add(Socket_T S, const char *lastEventId) {
+        ASSERT(S);
+        bool added = false;
+        Socket_setTimeout(S, EVENTSTREAM_TIMEOUT);
+        LOCK(_stream.mutex)
+        {
+                if (_stream.running && ! _stream.stop && atomic_load_explicit(&_stream.count, memory_order_relaxed) < EVENTSTREAM_LIMIT) {
+                        Stream_T stream;
+                        NEW(stream);
+                        stream->S = S;
+                        stream->sequence = _stream.sequence;
+                        stream->heartbeat = Time_milli() + EVENTSTREAM_HEARTBEAT;
+                        // Resume after the last event the client received, if it was sent by this monit instance
+                        unsigned long long incarnation, sequence;
+                        if (lastEventId && sscanf(lastEventId, "%llx-%llu", &incarnation, &sequence) == 2 && incarnation == (unsigned long long)Run.incarnation && sequence < _stream.sequence)
+                                stream->sequence = sequence;
+                        stream->next = _stream.added;
+                        _stream.added = stream;
+                        atomic_fetch_add_explicit(&_stream.count, 1, memory_order_relaxed);
+                        _wakeup();
+                        added = true;
+                }
+        }
+        END_LOCK;
+        return added;
+}
+
+
+void EventStream_post(Event_T E) {
+        ASSERT(E);
+        if (! atomic_load_explicit(&_stream.count, memory_order_relaxed))
+                return;
+        StringBuffer_T B = StringBuffer_create(256);
+        status_json_event(B, E);
+        char *data = Str_dup(StringBuffer_toString(B));
+        StringBuffer_free(&B);
+        LOCK(_stream.mutex)
+        {
+                _stream.sequence++;
+                FREE(_stream.backlog[_stream.sequence % EVENTSTREAM_BACKLOG]);
+                _stream.backlog[_stream.sequence % EVENTSTREAM_BACKLOG] = data;
+                _wakeup();
+        }
+        END_LOCK;
+}
+
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef EVENTSTREAM_H
+#define EVENTSTREAM_H
+
+
+/**
+ *  The event stream: the HTTP clients of /_events receive the service
+ *  state changes as server-sent events when they are posted, instead of
+ *  polling the status.
+ *
+ *  The connection of the client is detached from the HTTP engine after
+ *  the response headers were sent. One thread serves all streams, so the
+ *  idle clients don't occupy the HTTP workers nor count to the httpd
+ *  connections limit. The event is formatted once and the recent events
+ *  are kept, so the client which reconnects with the Last-Event-ID header
+ *  receives the events it missed.
+ *
+ *  @file
+ */
+
+
+/**
+ * Start the event stream thread
+ * @return true if the thread was started, otherwise false
+ */
+bool EventStream_start(void);
+
+
+/**
+ * Stop the event stream thread and close all streams
+ */
+void EventStream_stop(void);
+
+
+/**
+ * Add the client stream. The response headers must be sent already, the
+ * event stream owns the connection if the stream was added
+ * @param S The client connection
+ * @param lastEventId The Last-Event-ID header of the request or NULL
+ * @return true if the stream was added, false if the event stream is not
+ * running or the streams limit was reached
+ */
+bool EventStream_add(Socket_T S, const char *lastEventId);
+
+
+/**
+ * Send the event state change to the streams. Returns immediately if no
+ * client is connected
+ * @param E The event which changed the state
+ */
+void EventStream_post(Event_T E);
+
+
+#endif
+
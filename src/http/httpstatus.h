@@ -66,6 +66,7 @@
 #define SC_UNPROCESSABLE_ENTITY          422
 #define SC_LOCKED                        423
 #define SC_FAILED_DEPENDENCY             424
+#define SC_HEADER_FIELDS_TOO_LARGE       431
 #define SC_INTERNAL_SERVER_ERROR         500
 #define SC_NOT_IMPLEMENTED               501
 #define SC_BAD_GATEWAY                   502
@@ -0,0 +1,843 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STRINGS_H
+#include <strings.h>
+#endif
+
+#ifdef HAVE_MATH_H
+#include <math.h>
+#endif
+
+// libmonit
+#include "util/List.h"
+#include "exceptions/AssertException.h"
+
+#include "monit.h"
+#include "event.h"
+#include "ProcessTree.h"
+#include "protocol.h"
+#include "ServiceStatus.h"
+
+
+/**
+ *  JSON status of the monitored services for the dashboards and other
+ *  pollers.
+ *
+ *  The service objects have the same structure and member names as the
+ *  services of the CBOR status (see cbor.c). The request may select the
+ *  services by name, type, status or a part of the name, the service
+ *  members (the name is always included), the sort order and a page of the
+ *  selected services. The document is written in one pass by a streaming
+ *  writer, which tracks the nesting and the separators and drops the
+ *  members which were not selected together with their content.
+ *
+ *  The status version (see status_json_etag()) changes whenever a service
+ *  publishes a new status, so a poller can send the version back in the
+ *  If-None-Match header and gets 304 Not Modified without the document if
+ *  nothing changed.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define SCHEMA 1
+
+
+// The maximum nesting depth of the document
+#define JSON_MAXDEPTH 16
+
+
+// The depth of the service object members, which may be selected
+#define SERVICE_DEPTH 3
+
+
+typedef struct Json_T {
+        StringBuffer_T B;
+        int depth;                       /**< The nesting depth, 0 = top-level */
+        int skip;        /**< The depth of the dropped container, 0 = none */
+        const char *fields;    /**< The selected service members or NULL for all */
+        int items[JSON_MAXDEPTH];        /**< The number of items at the depth */
+        char close[JSON_MAXDEPTH];   /**< The closing character at the depth */
+} Json_T;
+
+
+typedef enum {
+        Sort_None = 0,
+        Sort_ByName,
+        Sort_ByType,
+        Sort_ByStatus
+} __attribute__((__packed__)) Sort_Type;
+
+
+typedef struct Selected_T {
+        Service_T service;
+        int index;                         /**< The order in the configuration */
+        int rank;              /**< The status rank if sorted or filtered by status */
+        Sort_Type sort;
+        bool descending;
+} Selected_T;
+
+
+typedef struct Selection_T {
+        ServiceStatus_T status;
+        StatusQuery_T *query;
+        Sort_Type sort;
+        int total;
+        int size;
+        Selected_T *items;
+} Selection_T;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Check if the item is in the comma separated list
+ */
+static bool _isListed(const char *list, const char *item) {
+        size_t length = strlen(item);
+        for (const char *p = list; (p = strstr(p, item)); p += length)
+                if ((p == list || p[-1] == ',') && (p[length] == ',' || p[length] == 0))
+                        return true;
+        return false;
+}
+
+
+/**
+ * Get the length of the valid UTF-8 sequence at the string position
+ * @return The sequence length or 0 if the sequence is not valid
+ */
+static int _utf8Length(const unsigned char *s) {
+        int length = *s >= 0xf0 && *s <= 0xf4 ? 4 : *s >= 0xe0 ? 3 : *s >= 0xc2 && *s <= 0xdf ? 2 : 0;
+        if (length == 3 && *s > 0xef)
+                return 0;
+        for (int i = 1; i < length; i++)
+                if ((s[i] & 0xc0) != 0x80)
+                        return 0;
+        return length;
+}
+
+
+/**
+ * Append the JSON string. The free form text (the program output, the
+ * event message) may not be valid UTF-8, the invalid bytes are replaced
+ * with U+FFFD
+ */
+static void _string(StringBuffer_T B, const char *s) {
+        if (! s) {
+                StringBuffer_append(B, "null");
+                return;
+        }
+        StringBuffer_appendChar(B, '"');
+        for (const unsigned char *c = (const unsigned char *)s; *c; c++) {
+                if (*c == '"' || *c == '\\') {
+                        StringBuffer_appendChar(B, '\\');
+                        StringBuffer_appendChar(B, *c);
+                } else if (*c < 0x20) {
+                        StringBuffer_append(B, "\\u%04x", *c);
+                } else if (*c < 0x80) {
+                        StringBuffer_appendChar(B, *c);
+                } else {
+                        int length = _utf8Length(c);
+                        if (length) {
+                                StringBuffer_appendBytes(B, c, length);
+                                c += length - 1;
+                        } else {
+                                StringBuffer_append(B, "\\ufffd");
+                        }
+                }
+        }
+        StringBuffer_appendChar(B, '"');
+}
+
+
+static void _separator(Json_T *J) {
+        if (J->items[J->depth]++)
+                StringBuffer_appendChar(J->B, ',');
+}
+
+
+/**
+ * Append the member key
+ * @return false if the member is dropped (not selected or inside a dropped
+ * container)
+ */
+static bool _key(Json_T *J, const char *key) {
+        if (J->skip || (J->depth == SERVICE_DEPTH && J->fields && ! IS(key, "name") && ! _isListed(J->fields, key)))
+                return false;
+        _separator(J);
+        _string(J->B, key);
+        StringBuffer_appendChar(J->B, ':');
+        return true;
+}
+
+
+static void _push(Json_T *J, char open, char close, bool visible) {
+        ASSERT(J->depth < JSON_MAXDEPTH - 1);
+        J->depth++;
+        J->items[J->depth] = 0;
+        J->close[J->depth] = close;
+        if (visible)
+                StringBuffer_appendChar(J->B, open);
+        else if (! J->skip)
+                J->skip = J->depth;
+}
+
+
+/* Containers */
+
+
+static void _open(Json_T *J) {
+        bool visible = ! J->skip;
+        if (visible)
+                _separator(J);
+        _push(J, '{', '}', visible);
+}
+
+
+static void _map(Json_T *J, const char *key) {
+        _push(J, '{', '}', _key(J, key));
+}
+
+
+static void _array(Json_T *J, const char *key) {
+        _push(J, '[', ']', _key(J, key));
+}
+
+
+static void _close(Json_T *J) {
+        ASSERT(J->depth > 0);
+        if (! J->skip)
+                StringBuffer_appendChar(J->B, J->close[J->depth]);
+        else if (J->skip == J->depth)
+                J->skip = 0;
+        J->depth--;
+}
+
+
+/* Members */
+
+
+static void _int(Json_T *J, const char *key, long long value) {
+        if (_key(J, key))
+                StringBuffer_appendInt(J->B, value);
+}
+
+
+static void _unsigned(Json_T *J, const char *key, unsigned long long value) {
+        if (_key(J, key))
+                StringBuffer_append(J->B, "%llu", value);
+}
+
+
+static void _float(Json_T *J, const char *key, double value) {
+        if (_key(J, key)) {
+                if (isfinite(value))
+                        StringBuffer_append(J->B, "%.7g", value);
+                else
+                        StringBuffer_append(J->B, "null");
+        }
+}
+
+
+static void _text(Json_T *J, const char *key, const char *value) {
+        if (_key(J, key))
+                _string(J->B, value);
+}
+
+
+/**
+ * Prints a document header into the given buffer.
+ * @param J JSON writer
+ */
+static void document_head(Json_T *J) {
+        _push(J, '{', '}', true);
+        _int(J, "schema", SCHEMA);
+        _text(J, "id", Run.id);
+        _int(J, "incarnation", (long long)Run.incarnation);
+        _text(J, "version", VERSION);
+        _text(J, "localhostname", Run.system->name);
+        _int(J, "poll", Run.polltime);
+}
+
+
+static void _counter(Json_T *J, const char *name, long long now, long long total) {
+        _map(J, name);
+        _int(J, "now", now);
+        _int(J, "total", total);
+        _close(J);
+}
+
+
+static void _statistics(Json_T *J, const char *name, Statistics_T statistics) {
+        if (Statistics_initialized(statistics)) {
+                _map(J, name);
+                _float(J, "count", Statistics_deltaNormalize(statistics)); // per second
+                _unsigned(J, "total", Statistics_raw(statistics));         // since boot
+                _close(J);
+        }
+}
+
+
+static void _ioStatistics(Json_T *J, const char *name, IOStatistics_T statistics) {
+        _map(J, name);
+        _statistics(J, "bytesgeneric", &(statistics->bytes));
+        _statistics(J, "bytes", &(statistics->bytesPhysical));
+        _statistics(J, "operations", &(statistics->operations));
+        _close(J);
+}
+
+
+static void _timestamps(Json_T *J, unsigned long long access, unsigned long long change, unsigned long long modify) {
+        _map(J, "timestamps");
+        _unsigned(J, "access", access);
+        _unsigned(J, "change", change);
+        _unsigned(J, "modify", modify);
+        _close(J);
+}
+
+
+static void _ownership(Json_T *J, int mode, int uid, int gid) {
+        _int(J, "mode", mode & 07777);
+        _int(J, "uid", uid);
+        _int(J, "gid", gid);
+}
+
+
+/**
+ * Prints a service status into the given buffer.
+ * @param S Service object
+ * @param J JSON writer
+ */
+static void status_service(Service_T S, Json_T *J) {
+        _open(J);
+        _text(J, "name", S->name);
+        _int(J, "type", S->type);
+        _int(J, "collected_sec", (long long)S->collected.tv_sec);
+        _int(J, "collected_usec", (long long)S->collected.tv_usec);
+        _int(J, "status", S->error);
+        _int(J, "status_hint", S->error_hint);
+        _int(J, "monitor", S->monitor);
+        _int(J, "monitormode", S->mode);
+        _int(J, "onreboot", S->onreboot);
+        _int(J, "pendingaction", S->doaction);
+        if (S->every.type != Every_Cycle) {
+                _map(J, "every");
+                _int(J, "type", S->every.type);
+                if (S->every.type == Every_SkipCycles) {
+                        _int(J, "counter", S->every.spec.cycle.counter);
+                        _int(J, "number", S->every.spec.cycle.number);
+                } else if (S->every.type == Every_Interval) {
+                        _int(J, "interval", S->every.spec.interval);
+                } else {
+                        _text(J, "cron", S->every.spec.cron.string);
+                }
+                _close(J);
+        }
+        if (Util_hasServiceStatus(S)) {
+                switch (S->type) {
+                        case Service_System:
+                                _map(J, "filedescriptors");
+                                _int(J, "allocated", systeminfo.filedescriptors.allocated);
+                                _int(J, "unused", systeminfo.filedescriptors.unused);
+                                _int(J, "maximum", systeminfo.filedescriptors.maximum);
+                                _close(J);
+                                break;
+
+                        case Service_File:
+                                _ownership(J, S->inf.file->mode, S->inf.file->uid, S->inf.file->gid);
+                                _timestamps(J, S->inf.file->timestamp.access, S->inf.file->timestamp.change, S->inf.file->timestamp.modify);
+                                _int(J, "size", (long long)S->inf.file->size);
+                                if (S->checksum) {
+                                        _map(J, "checksum");
+                                        _text(J, "type", checksumnames[S->checksum->type]);
+                                        _text(J, "value", S->inf.file->cs_sum);
+                                        _close(J);
+                                }
+                                break;
+
+                        case Service_Directory:
+                                _ownership(J, S->inf.directory->mode, S->inf.directory->uid, S->inf.directory->gid);
+                                _timestamps(J, S->inf.directory->timestamp.access, S->inf.directory->timestamp.change, S->inf.directory->timestamp.modify);
+                                if (S->inf.directory->tree.collected) {
+                                        _map(J, "tree");
+                                        _unsigned(J, "size", S->inf.directory->tree.size);
+                                        _unsigned(J, "files", S->inf.directory->tree.files);
+                                        _int(J, "oldest", (long long)S->inf.directory->tree.oldest);
+                                        _int(J, "newest", (long long)S->inf.directory->tree.newest);
+                                        _close(J);
+                                }
+                                break;
+
+                        case Service_Fifo:
+                                _ownership(J, S->inf.fifo->mode, S->inf.fifo->uid, S->inf.fifo->gid);
+                                _timestamps(J, S->inf.fifo->timestamp.access, S->inf.fifo->timestamp.change, S->inf.fifo->timestamp.modify);
+                                break;
+
+                        case Service_Filesystem:
+                                _text(J, "fstype", S->inf.filesystem->object.type);
+                                _text(J, "fsflags", S->inf.filesystem->flags);
+                                _ownership(J, S->inf.filesystem->mode, S->inf.filesystem->uid, S->inf.filesystem->gid);
+                                _map(J, "block");
+                                _float(J, "percent", S->inf.filesystem->space_percent);
+                                _float(J, "usage", S->inf.filesystem->f_bsize > 0 ? (double)S->inf.filesystem->f_blocksused / 1048576. * (double)S->inf.filesystem->f_bsize : 0.);
+                                _float(J, "total", S->inf.filesystem->f_bsize > 0 ? (double)S->inf.filesystem->f_blocks / 1048576. * (double)S->inf.filesystem->f_bsize : 0.);
+                                _close(J);
+                                if (S->inf.filesystem->f_files > 0) {
+                                        _map(J, "inode");
+                                        _float(J, "percent", S->inf.filesystem->inode_percent);
+                                        _int(J, "usage", S->inf.filesystem->f_filesused);
+                                        _int(J, "total", S->inf.filesystem->f_files);
+                                        _close(J);
+                                }
+                                _ioStatistics(J, "read", &(S->inf.filesystem->read));
+                                _ioStatistics(J, "write", &(S->inf.filesystem->write));
+                                if (Statistics_initialized(&(S->inf.filesystem->time.read)) || Statistics_initialized(&(S->inf.filesystem->time.write)) || Statistics_initialized(&(S->inf.filesystem->time.wait)) || Statistics_initialized(&(S->inf.filesystem->time.run))) {
+                                        _map(J, "servicetime");
+                                        if (Statistics_initialized(&(S->inf.filesystem->time.read)))
+                                                _float(J, "read", Statistics_deltaNormalize(&(S->inf.filesystem->time.read)));
+                                        if (Statistics_initialized(&(S->inf.filesystem->time.write)))
+                                                _float(J, "write", Statistics_deltaNormalize(&(S->inf.filesystem->time.write)));
+                                        if (Statistics_initialized(&(S->inf.filesystem->time.wait)))
+                                                _float(J, "wait", Statistics_deltaNormalize(&(S->inf.filesystem->time.wait)));
+                                        if (Statistics_initialized(&(S->inf.filesystem->time.run)))
+                                                _float(J, "run", Statistics_deltaNormalize(&(S->inf.filesystem->time.run)));
+                                        _close(J);
+                                }
+                                break;
+
+                        case Service_Net:
+                                _map(J, "link");
+                                _int(J, "state", Link_getState(S->inf.net->stats));
+                                _int(J, "speed", Link_getSpeed(S->inf.net->stats));
+                                _int(J, "duplex", Link_getDuplex(S->inf.net->stats));
+                                _map(J, "download");
+                                _counter(J, "packets", Link_getPacketsInPerSecond(S->inf.net->stats), Link_getPacketsInTotal(S->inf.net->stats));
+                                _counter(J, "bytes", Link_getBytesInPerSecond(S->inf.net->stats), Link_getBytesInTotal(S->inf.net->stats));
+                                _counter(J, "errors", Link_getErrorsInPerSecond(S->inf.net->stats), Link_getErrorsInTotal(S->inf.net->stats));
+                                _close(J);
+                                _map(J, "upload");
+                                _counter(J, "packets", Link_getPacketsOutPerSecond(S->inf.net->stats), Link_getPacketsOutTotal(S->inf.net->stats));
+                                _counter(J, "bytes", Link_getBytesOutPerSecond(S->inf.net->stats), Link_getBytesOutTotal(S->inf.net->stats));
+                                _counter(J, "errors", Link_getErrorsOutPerSecond(S->inf.net->stats), Link_getErrorsOutTotal(S->inf.net->stats));
+                                _close(J);
+                                _close(J);
+                                break;
+
+                        case Service_Process:
+                                _int(J, "pid", S->inf.process->pid);
+                                _int(J, "ppid", S->inf.process->ppid);
+                                _int(J, "uid", S->inf.process->uid);
+                                _int(J, "euid", S->inf.process->euid);
+                                _int(J, "gid", S->inf.process->gid);
+                                _int(J, "uptime", (long long)S->inf.process->uptime);
+                                if (Run.flags & Run_ProcessEngineEnabled) {
+                                        _int(J, "threads", S->inf.process->threads);
+                                        _int(J, "children", S->inf.process->children);
+                                        _map(J, "memory");
+                                        _float(J, "percent", S->inf.process->mem_percent);
+                                        _float(J, "percenttotal", S->inf.process->total_mem_percent);
+                                        _unsigned(J, "kilobyte", (unsigned long long)((double)S->inf.process->mem / 1024.));
+                                        _unsigned(J, "kilobytetotal", (unsigned long long)((double)S->inf.process->total_mem / 1024.));
+                                        _close(J);
+                                        _map(J, "cpu");
+                                        _float(J, "percent", S->inf.process->cpu_percent);
+                                        _float(J, "percenttotal", S->inf.process->total_cpu_percent);
+                                        _close(J);
+                                        _map(J, "filedescriptors");
+                                        _int(J, "open", S->inf.process->filedescriptors.open);
+                                        _int(J, "opentotal", S->inf.process->filedescriptors.openTotal);
+                                        _map(J, "limit");
+                                        _int(J, "soft", S->inf.process->filedescriptors.limit.soft);
+                                        _int(J, "hard", S->inf.process->filedescriptors.limit.hard);
+                                        _close(J);
+                                        _close(J);
+                                }
+                                _ioStatistics(J, "read", &(S->inf.process->read));
+                                _ioStatistics(J, "write", &(S->inf.process->write));
+                                break;
+
+                        default:
+                                break;
+                }
+                if (S->icmplist) {
+                        _array(J, "icmp");
+                        for (Icmp_T i = S->icmplist; i; i = i->next) {
+                                _open(J);
+                                _text(J, "type", icmpnames[i->type]);
+                                _float(J, "responsetime", i->is_available == Connection_Ok ? i->response / 1000. : -1.); // [s] to match the XML status
+                                _close(J);
+                        }
+                        _close(J);
+                }
+                if (S->portlist) {
+                        _array(J, "port");
+                        for (Port_T p = S->portlist; p; p = p->next) {
+                                _open(J);
+                                _text(J, "hostname", p->hostname);
+                                _int(J, "portnumber", p->target.net.port);
+                                _text(J, "request", Util_portRequestDescription(p));
+                                _text(J, "protocol", p->protocol->name);
+                                _text(J, "type", Util_portTypeDescription(p));
+                                _float(J, "responsetime", p->is_available == Connection_Ok ? p->response / 1000. : -1.); // [s] to match the XML status
+                                if (p->target.net.ssl.options.flags) {
+                                        _map(J, "certificate");
+                                        _int(J, "valid", p->target.net.ssl.certificate.validDays);
+                                        _close(J);
+                                }
+                                _close(J);
+                        }
+                        _close(J);
+                }
+                if (S->socketlist) {
+                        _array(J, "unix");
+                        for (Port_T p = S->socketlist; p; p = p->next) {
+                                _open(J);
+                                _text(J, "path", p->target.unix.pathname);
+                                _text(J, "protocol", p->protocol->name);
+                                _float(J, "responsetime", p->is_available == Connection_Ok ? p->response / 1000. : -1.); // [s] to match the XML status
+                                _close(J);
+                        }
+                        _close(J);
+                }
+                if (S->type == Service_System) {
+                        _map(J, "system");
+                        _map(J, "load");
+                        _float(J, "avg01", systeminfo.loadavg[0]);
+                        _float(J, "avg05", systeminfo.loadavg[1]);
+                        _float(J, "avg15", systeminfo.loadavg[2]);
+                        _close(J);
+                        _map(J, "cpu");
+                        if (systeminfo.statisticsAvailable & Statistics_CpuUser)
+                                _float(J, "user", systeminfo.cpu.usage.user > 0. ? systeminfo.cpu.usage.user : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuSystem)
+                                _float(J, "system", systeminfo.cpu.usage.system > 0. ? systeminfo.cpu.usage.system : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuNice)
+                                _float(J, "nice", systeminfo.cpu.usage.nice > 0. ? systeminfo.cpu.usage.nice : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuIOWait)
+                                _float(J, "wait", systeminfo.cpu.usage.iowait > 0. ? systeminfo.cpu.usage.iowait : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuHardIRQ)
+                                _float(J, "hardirq", systeminfo.cpu.usage.hardirq > 0. ? systeminfo.cpu.usage.hardirq : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuSoftIRQ)
+                                _float(J, "softirq", systeminfo.cpu.usage.softirq > 0. ? systeminfo.cpu.usage.softirq : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuSteal)
+                                _float(J, "steal", systeminfo.cpu.usage.steal > 0. ? systeminfo.cpu.usage.steal : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuGuest)
+                                _float(J, "guest", systeminfo.cpu.usage.guest > 0. ? systeminfo.cpu.usage.guest : 0.);
+                        if (systeminfo.statisticsAvailable & Statistics_CpuGuestNice)
+                                _float(J, "guestnice", systeminfo.cpu.usage.guest_nice > 0. ? systeminfo.cpu.usage.guest_nice : 0.);
+                        _close(J);
+                        _map(J, "memory");
+                        _float(J, "percent", systeminfo.memory.usage.percent);
+                        _unsigned(J, "kilobyte", (unsigned long long)((double)systeminfo.memory.usage.bytes / 1024.));
+                        _close(J);
+                        _map(J, "swap");
+                        _float(J, "percent", systeminfo.swap.usage.percent);
+                        _unsigned(J, "kilobyte", (unsigned long long)((double)systeminfo.swap.usage.bytes / 1024.));
+                        _close(J);
+                        _close(J);
+                }
+                if (S->type == Service_Program && S->program->started) {
+                        _map(J, "program");
+                        _int(J, "started", (long long)S->program->started);
+                        _int(J, "status", S->program->exitStatus);
+                        _text(J, "output", StringBuffer_toString(S->program->lastOutput));
+                        _close(J);
+                }
+        }
+        _close(J);
+}
+
+
+static Sort_Type _sortType(const char *sort) {
+        if (sort) {
+                if (*sort == '-')
+                        sort++;
+                if (IS(sort, "name"))
+                        return Sort_ByName;
+                if (IS(sort, "type"))
+                        return Sort_ByType;
+                if (IS(sort, "status"))
+                        return Sort_ByStatus;
+        }
+        return Sort_None;
+}
+
+
+/**
+ * Rank the service status as displayed: failed first, then the services
+ * being initialized, not monitored and finally the services which are OK
+ */
+static int _statusRank(Service_T S) {
+        if (S->monitor == Monitor_Not)
+                return 2;
+        if (S->monitor & (Monitor_Init | Monitor_Waiting))
+                return 1;
+        return S->error ? 0 : 3;
+}
+
+
+/**
+ * Add the service to the selection if it matches the query. The status
+ * snapshot is read only if the query filters or sorts by the status
+ */
+static void _select(Selection_T *selection, Service_T s) {
+        StatusQuery_T *query = selection->query;
+        if (query->match && *query->match && ! Str_sub(s->name, query->match))
+                return;
+        if (query->type >= 0 && (int)s->type != query->type)
+                return;
+        int rank = query->failed || selection->sort == Sort_ByStatus ? _statusRank(ServiceStatus_get(selection->status, s)) : 0;
+        if (query->failed && rank != 0)
+                return;
+        if (selection->total == selection->size) {
+                selection->size = selection->size ? selection->size * 2 : 64;
+                RESIZE(selection->items, selection->size * sizeof(Selected_T));
+        }
+        selection->items[selection->total] = (Selected_T){.service = s, .index = selection->total, .rank = rank, .sort = selection->sort, .descending = query->sort && *query->sort == '-'};
+        selection->total++;
+}
+
+
+static int _compareSelected(const void *a, const void *b) {
+        const Selected_T *x = a, *y = b;
+        int rv = 0;
+        switch (x->sort) {
+                case Sort_ByName:
+                        rv = strcasecmp(x->service->name, y->service->name);
+                        break;
+                case Sort_ByType:
+                        rv = (int)x->service->type - (int)y->service->type;
+                        break;
+                case Sort_ByStatus:
+                        rv = x->rank - y->rank;
+                        break;
+                default:
+                        break;
+        }
+        if (x->descending)
+                rv = -rv;
+        // Keep the configuration order of the equal services
+        return rv ? rv : x->index - y->index;
+}
+
+
+/**
+ * Append the JSON status of the service. The fragment with all members is
+ * cached with the service status snapshot and used if the service didn't
+ * publish a new status since it was rendered
+ */
+static void _statusService(ServiceStatus_T status, Service_T s, Json_T *J) {
+        Service_T S = ServiceStatus_get(status, s);
+        if (J->fields) {
+                status_service(S, J);
+        } else {
+                _separator(J);
+                if (! ServiceStatus_getFragment(status, StatusFormat_Json, J->B)) {
+                        // Render the service as the first item of its own array, so the separator isn't part of the fragment
+                        int start = StringBuffer_length(J->B), items = J->items[J->depth];
+                        J->items[J->depth] = 0;
+                        status_service(S, J);
+                        J->items[J->depth] = items;
+                        ServiceStatus_setFragment(status, StatusFormat_Json, StringBuffer_toString(J->B) + start, StringBuffer_length(J->B) - start);
+                }
+        }
+}
+
+
+/**
+ * Compute the digest of the service status, the collection timestamp is not
+ * included as it changes every cycle
+ * @param status The JSON formatted service status
+ * @return The status digest
+ */
+static uint64_t _serviceDigest(const char *status) {
+        uint64_t hash = 14695981039346656037ULL; // FNV-1a
+        const char *skip = strstr(status, "\"collected_sec\":");
+        const char *resume = skip ? strstr(skip, "\"status\":") : NULL;
+        for (const char *p = status; *p; p++) {
+                if (p == skip && resume) {
+                        p = resume - 1;
+                        continue;
+                }
+                hash ^= (unsigned char)*p;
+                hash *= 1099511628211ULL;
+        }
+        return hash;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+/**
+ * Get the JSON formatted status of the selected services. The services
+ * are selected by the query (see StatusQuery_T), in the configuration
+ * order (or the order of the services list) unless a sort key is given.
+ * The offset and limit select a page of the selected services, the total
+ * is the number of all selected services
+ * @param B StringBuffer object
+ * @param query The selection of the services
+ */
+void status_json(StringBuffer_T B, StatusQuery_T *query) {
+        ASSERT(B);
+        ASSERT(query);
+        ASSERT(query->offset >= 0);
+        Json_T J = {.B = B, .fields = query->fields && *query->fields ? query->fields : NULL};
+        ServiceStatus_T status = ServiceStatus_new();
+        Selection_T selection = {.status = status, .query = query, .sort = _sortType(query->sort)};
+        if (query->services) {
+                char *names = Str_dup(query->services);
+                char *saveptr = NULL;
+                for (char *name = strtok_r(names, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+                        Service_T s = Util_getService(name);
+                        if (s)
+                                _select(&selection, s);
+                }
+                FREE(names);
+        } else {
+                for (Service_T s = servicelist_conf; s; s = s->next_conf)
+                        _select(&selection, s);
+        }
+        if (selection.sort != Sort_None)
+                qsort(selection.items, selection.total, sizeof(Selected_T), _compareSelected);
+        int count = 0;
+        document_head(&J);
+        _array(&J, "services");
+        for (int i = query->offset; i < selection.total && (query->limit < 0 || count < query->limit); i++, count++)
+                _statusService(status, selection.items[i].service, &J);
+        _close(&J);
+        FREE(selection.items);
+        ServiceStatus_delete(&status);
+        _int(&J, "total", selection.total);
+        _int(&J, "offset", query->offset);
+        _int(&J, "count", count);
+        _close(&J);
+        StringBuffer_appendChar(B, '\n');
+}
+
+
+/**
+ * Get the JSON formatted status message with the services whose status
+ * changed since the last message, for the MQTT publisher (see Mqtt.c). The
+ * digests array holds the status digest of each service (in the
+ * configuration order) sent last time and is updated with the current
+ * digests. The service objects are the same as in status_json()
+ * @param B StringBuffer object
+ * @param digests The service status digests
+ * @param count The number of digests, must match the number of services
+ * @param full true to send all services
+ * @return The number of services in the message
+ */
+int status_json_changes(StringBuffer_T B, uint64_t *digests, int count, bool full) {
+        ASSERT(B);
+        int i = 0, changed = 0;
+        Json_T J = {.B = B};
+        ServiceStatus_T status = ServiceStatus_new();
+        _push(&J, '{', '}', true);
+        _int(&J, "schema", SCHEMA);
+        _text(&J, "id", Run.id);
+        _int(&J, "incarnation", (long long)Run.incarnation);
+        _text(&J, "localhostname", Run.system->name);
+        _int(&J, "full", full);
+        _array(&J, "services");
+        for (Service_T S = servicelist_conf; S && i < count; S = S->next_conf, i++) {
+                int start = StringBuffer_length(B), items = J.items[J.depth];
+                _statusService(status, S, &J);
+                uint64_t digest = _serviceDigest(StringBuffer_toString(B) + start + (items ? 1 : 0));
+                if (full || digest != digests[i]) {
+                        digests[i] = digest;
+                        changed++;
+                } else {
+                        // Unchanged, drop the service and its separator
+                        StringBuffer_delete(B, start);
+                        J.items[J.depth] = items;
+                }
+        }
+        _close(&J);
+        ServiceStatus_delete(&status);
+        _close(&J);
+        return changed;
+}
+
+
+/**
+ * Get the JSON formatted event for the event stream. The event object has
+ * the same members as the event of the CBOR notification (see cbor.c) plus
+ * the event description
+ * @param B StringBuffer object
+ * @param E An event object
+ */
+void status_json_event(StringBuffer_T B, Event_T E) {
+        ASSERT(B);
+        ASSERT(E);
+        Json_T J = {.B = B};
+        _push(&J, '{', '}', true);
+        _int(&J, "collected_sec", (long long)E->collected.tv_sec);
+        _int(&J, "collected_usec", (long long)E->collected.tv_usec);
+        _text(&J, "service", E->id == Event_Instance ? "Monit" : E->source->name);
+        _int(&J, "type", E->type);
+        _int(&J, "id", E->id);
+        _int(&J, "state", E->state);
+        _int(&J, "action", Event_get_action(E));
+        _text(&J, "description", Event_get_description(E));
+        _text(&J, "message", E->message);
+        _close(&J);
+}
+
+
+/**
+ * Get the status version as the HTTP entity tag. It changes when monit is
+ * restarted or reloaded, when some service publishes a new status or when
+ * an action is scheduled for some service
+ * @param buf The buffer for the entity tag
+ * @param buflen The buffer size
+ * @return The buffer
+ */
+char *status_json_etag(char *buf, int buflen) {
+        ASSERT(buf);
+        uint64_t actions = 14695981039346656037ULL; // FNV-1a of the pending actions
+        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
+                actions ^= (uint64_t)s->doaction;
+                actions *= 1099511628211ULL;
+        }
+        snprintf(buf, buflen, "\"%llx-%llx-%llx\"", (unsigned long long)Run.incarnation, ServiceStatus_getVersion(), (unsigned long long)actions);
+        return buf;
+}
@@ -0,0 +1,623 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+// libmonit
+#include "util/List.h"
+
+#include "monit.h"
+#include "event.h"
+#include "protocol.h"
+#include "ServiceStatus.h"
+
+
+/**
+ *  OpenMetrics (Prometheus) exposition of the service statistics.
+ *
+ *  The samples of one metric family must be grouped together, so the
+ *  service list is walked once per family. Each sample has the service
+ *  name label, the service is left out if its statistics are not
+ *  available (e.g. the service is not monitored). The values use the
+ *  base units (bytes, seconds) and the counters have the "_total" suffix.
+ *
+ *  The service list doesn't change while the HTTP interface is running
+ *  (it is stopped on reload). The values are read from the service status
+ *  snapshots published by the validator, like the XML status.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef enum {
+        Metric_Monitored = 0,
+        Metric_Status,
+        Metric_Collected,
+        Metric_Events,
+        Metric_ProcessCpu,
+        Metric_ProcessCpuTotal,
+        Metric_ProcessMemory,
+        Metric_ProcessMemoryTotal,
+        Metric_ProcessThreads,
+        Metric_ProcessChildren,
+        Metric_ProcessUptime,
+        Metric_ProcessFiledescriptors,
+        Metric_FileSize,
+        Metric_DirectorySize,
+        Metric_DirectoryFiles,
+        Metric_FilesystemSpaceUsed,
+        Metric_FilesystemSpaceTotal,
+        Metric_FilesystemInodesUsed,
+        Metric_FilesystemInodesTotal,
+        Metric_NetLinkState,
+        Metric_NetLinkSpeed,
+        Metric_ProgramStatus,
+        Metric_SystemLoad1,
+        Metric_SystemLoad5,
+        Metric_SystemLoad15,
+        Metric_SystemMemory,
+        Metric_SystemMemoryTotal,
+        Metric_SystemSwap,
+        Metric_SystemSwapTotal,
+        Metric_SystemFiledescriptors
+} __attribute__((__packed__)) Metric_Type;
+
+
+static struct {
+        Metric_Type type;
+        const char *name;
+        const char *kind;
+        const char *help;
+} _metrics[] = {
+        {Metric_Monitored,              "monit_service_monitored",              "gauge",   "1 if the service is monitored"},
+        {Metric_Status,                 "monit_service_status",                 "gauge",   "Bitmap of the failed event types, 0 if the service is OK"},
+        {Metric_Collected,              "monit_service_collected_seconds",      "gauge",   "Time of the last service check"},
+        {Metric_Events,                 "monit_service_events",                 "counter", "Number of the service event state changes"},
+        {Metric_ProcessCpu,             "monit_process_cpu_percent",            "gauge",   "Process CPU usage"},
+        {Metric_ProcessCpuTotal,        "monit_process_cpu_total_percent",      "gauge",   "Process and children CPU usage"},
+        {Metric_ProcessMemory,          "monit_process_memory_bytes",           "gauge",   "Process memory usage"},
+        {Metric_ProcessMemoryTotal,     "monit_process_memory_total_bytes",     "gauge",   "Process and children memory usage"},
+        {Metric_ProcessThreads,         "monit_process_threads",                "gauge",   "Number of the process threads"},
+        {Metric_ProcessChildren,        "monit_process_children",               "gauge",   "Number of the process children"},
+        {Metric_ProcessUptime,          "monit_process_uptime_seconds",         "gauge",   "Process uptime"},
+        {Metric_ProcessFiledescriptors, "monit_process_filedescriptors",        "gauge",   "Number of the process open filedescriptors"},
+        {Metric_FileSize,               "monit_file_size_bytes",                "gauge",   "File size"},
+        {Metric_DirectorySize,          "monit_directory_tree_size_bytes",      "gauge",   "Size of the files in the directory tree"},
+        {Metric_DirectoryFiles,         "monit_directory_tree_files",           "gauge",   "Number of the files in the directory tree"},
+        {Metric_FilesystemSpaceUsed,    "monit_filesystem_space_used_bytes",    "gauge",   "Filesystem used space"},
+        {Metric_FilesystemSpaceTotal,   "monit_filesystem_space_total_bytes",   "gauge",   "Filesystem size"},
+        {Metric_FilesystemInodesUsed,   "monit_filesystem_inodes_used",         "gauge",   "Filesystem used inodes"},
+        {Metric_FilesystemInodesTotal,  "monit_filesystem_inodes_total",        "gauge",   "Filesystem inodes"},
+        {Metric_NetLinkState,           "monit_net_link_up",                    "gauge",   "1 if the network link is up"},
+        {Metric_NetLinkSpeed,           "monit_net_link_speed_bits",            "gauge",   "Network link speed per second"},
+        {Metric_ProgramStatus,          "monit_program_exit_status",            "gauge",   "Program exit status"},
+        {Metric_SystemLoad1,            "monit_system_load1",                   "gauge",   "System load average over 1 minute"},
+        {Metric_SystemLoad5,            "monit_system_load5",                   "gauge",   "System load average over 5 minutes"},
+        {Metric_SystemLoad15,           "monit_system_load15",                  "gauge",   "System load average over 15 minutes"},
+        {Metric_SystemMemory,           "monit_system_memory_used_bytes",       "gauge",   "System memory usage"},
+        {Metric_SystemMemoryTotal,      "monit_system_memory_total_bytes",      "gauge",   "System memory size"},
+        {Metric_SystemSwap,             "monit_system_swap_used_bytes",         "gauge",   "System swap usage"},
+        {Metric_SystemSwapTotal,        "monit_system_swap_total_bytes",        "gauge",   "System swap size"},
+        {Metric_SystemFiledescriptors,  "monit_system_filedescriptors",         "gauge",   "Number of the allocated filedescriptors"}
+};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Get the status snapshot of the service. The metrics are rendered by the
+ * cervlet, which is serialized by the processor, so one buffer is enough
+ */
+static Service_T _getStatus(Service_T s) {
+        static ServiceStatus_T buffer = NULL;
+        if (! buffer)
+                buffer = ServiceStatus_new();
+        return ServiceStatus_get(buffer, s);
+}
+
+
+static void _family(StringBuffer_T B, const char *name, const char *kind, const char *help) {
+        StringBuffer_append(B, "# TYPE %s %s\n# HELP %s %s\n", name, kind, name, help);
+}
+
+
+static const char *_labelEscape(int c) {
+        switch (c) {
+                case '\\':
+                        return "\\\\";
+                case '"':
+                        return "\\\"";
+                case '\n':
+                        return "\\n";
+                default:
+                        return NULL;
+        }
+}
+
+
+/**
+ * Append the label value, the backslash, double quote and line feed are escaped. The runs of the characters without
+ * escaping are appended at once
+ */
+static void _label(StringBuffer_T B, const char *value) {
+        StringBuffer_appendEscaped(B, value, _labelEscape);
+}
+
+
+/**
+ * Start the sample with the service name label, further labels may be appended before the value
+ */
+static void _sample(StringBuffer_T B, const char *name, const char *suffix, Service_T S) {
+        StringBuffer_append(B, "%s%s{service=\"", name, suffix);
+        _label(B, S->name);
+        StringBuffer_append(B, "\"");
+}
+
+
+static void _value(StringBuffer_T B, double value) {
+        StringBuffer_append(B, "} %.15g\n", value);
+}
+
+
+static void _counter(StringBuffer_T B, unsigned long long value) {
+        StringBuffer_append(B, "} %llu\n", value);
+}
+
+
+/**
+ * Get the metric value of the service
+ * @return true if the value is available
+ */
+static bool _get(Service_T S, Metric_Type type, double *value) {
+        switch (type) {
+                case Metric_Monitored:
+                        *value = S->monitor != Monitor_Not;
+                        return true;
+                case Metric_Status:
+                        *value = S->error;
+                        return true;
+                case Metric_Collected:
+                        *value = (double)S->collected.tv_sec + (double)S->collected.tv_usec / 1000000.;
+                        return S->collected.tv_sec > 0;
+                case Metric_Events:
+                        *value = S->events;
+                        return true;
+                default:
+                        break;
+        }
+        if (! Util_hasServiceStatus(S))
+                return false;
+        switch (S->type) {
+                case Service_Process:
+                        if (type == Metric_ProcessUptime) {
+                                *value = S->inf.process->uptime;
+                                return true;
+                        }
+                        if (! (Run.flags & Run_ProcessEngineEnabled))
+                                return false;
+                        switch (type) {
+                                case Metric_ProcessCpu:
+                                        *value = S->inf.process->cpu_percent;
+                                        return S->inf.process->cpu_percent >= 0;
+                                case Metric_ProcessCpuTotal:
+                                        *value = S->inf.process->total_cpu_percent;
+                                        return S->inf.process->total_cpu_percent >= 0;
+                                case Metric_ProcessMemory:
+                                        *value = S->inf.process->mem;
+                                        return true;
+                                case Metric_ProcessMemoryTotal:
+                                        *value = S->inf.process->total_mem;
+                                        return true;
+                                case Metric_ProcessThreads:
+                                        *value = S->inf.process->threads;
+                                        return S->inf.process->threads >= 0;
+                                case Metric_ProcessChildren:
+                                        *value = S->inf.process->children;
+                                        return true;
+                                case Metric_ProcessFiledescriptors:
+                                        *value = S->inf.process->filedescriptors.open;
+                                        return S->inf.process->filedescriptors.open >= 0;
+                                default:
+                                        return false;
+                        }
+                case Service_File:
+                        *value = S->inf.file->size;
+                        return type == Metric_FileSize && S->inf.file->size >= 0;
+                case Service_Directory:
+                        *value = type == Metric_DirectorySize ? S->inf.directory->tree.size : S->inf.directory->tree.files;
+                        return (type == Metric_DirectorySize || type == Metric_DirectoryFiles) && S->inf.directory->tree.collected;
+                case Service_Filesystem:
+                        switch (type) {
+                                case Metric_FilesystemSpaceUsed:
+                                        *value = (double)S->inf.filesystem->f_blocksused * (double)S->inf.filesystem->f_bsize;
+                                        return S->inf.filesystem->f_bsize > 0;
+                                case Metric_FilesystemSpaceTotal:
+                                        *value = (double)S->inf.filesystem->f_blocks * (double)S->inf.filesystem->f_bsize;
+                                        return S->inf.filesystem->f_bsize > 0;
+                                case Metric_FilesystemInodesUsed:
+                                        *value = S->inf.filesystem->f_filesused;
+                                        return S->inf.filesystem->f_files > 0;
+                                case Metric_FilesystemInodesTotal:
+                                        *value = S->inf.filesystem->f_files;
+                                        return S->inf.filesystem->f_files > 0;
+                                default:
+                                        return false;
+                        }
+                case Service_Net:
+                        switch (type) {
+                                case Metric_NetLinkState:
+                                        *value = Link_getState(S->inf.net->stats) == 1;
+                                        return true;
+                                case Metric_NetLinkSpeed:
+                                        *value = Link_getSpeed(S->inf.net->stats);
+                                        return *value > 0;
+                                default:
+                                        return false;
+                        }
+                case Service_Program:
+                        *value = S->program->exitStatus;
+                        return type == Metric_ProgramStatus && S->program->started;
+                case Service_System:
+                        switch (type) {
+                                case Metric_SystemLoad1:
+                                        *value = systeminfo.loadavg[0];
+                                        return true;
+                                case Metric_SystemLoad5:
+                                        *value = systeminfo.loadavg[1];
+                                        return true;
+                                case Metric_SystemLoad15:
+                                        *value = systeminfo.loadavg[2];
+                                        return true;
+                                case Metric_SystemMemory:
+                                        *value = systeminfo.memory.usage.bytes;
+                                        return true;
+                                case Metric_SystemMemoryTotal:
+                                        *value = systeminfo.memory.size;
+                                        return true;
+                                case Metric_SystemSwap:
+                                        *value = systeminfo.swap.usage.bytes;
+                                        return true;
+                                case Metric_SystemSwapTotal:
+                                        *value = systeminfo.swap.size;
+                                        return true;
+                                case Metric_SystemFiledescriptors:
+                                        *value = systeminfo.filedescriptors.allocated;
+                                        return systeminfo.filedescriptors.allocated > 0;
+                                default:
+                                        return false;
+                        }
+                default:
+                        return false;
+        }
+}
+
+
+static void _systemCpu(StringBuffer_T B) {
+        static struct {
+                Statistics_Flags flag;
+                const char *mode;
+        } modes[] = {
+                {Statistics_CpuUser, "user"},
+                {Statistics_CpuSystem, "system"},
+                {Statistics_CpuNice, "nice"},
+                {Statistics_CpuIOWait, "iowait"},
+                {Statistics_CpuHardIRQ, "hardirq"},
+                {Statistics_CpuSoftIRQ, "softirq"},
+                {Statistics_CpuSteal, "steal"},
+                {Statistics_CpuGuest, "guest"},
+                {Statistics_CpuGuestNice, "guestnice"}
+        };
+        float usage[] = {
+                systeminfo.cpu.usage.user,
+                systeminfo.cpu.usage.system,
+                systeminfo.cpu.usage.nice,
+                systeminfo.cpu.usage.iowait,
+                systeminfo.cpu.usage.hardirq,
+                systeminfo.cpu.usage.softirq,
+                systeminfo.cpu.usage.steal,
+                systeminfo.cpu.usage.guest,
+                systeminfo.cpu.usage.guest_nice
+        };
+        _family(B, "monit_system_cpu_percent", "gauge", "System CPU usage by mode");
+        for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                Service_T S = _getStatus(c);
+                if (S->type == Service_System && Util_hasServiceStatus(S)) {
+                        for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+                                if (systeminfo.statisticsAvailable & modes[i].flag) {
+                                        _sample(B, "monit_system_cpu_percent", "", S);
+                                        StringBuffer_append(B, ",mode=\"%s\"", modes[i].mode);
+                                        _value(B, usage[i] > 0. ? usage[i] : 0.);
+                                }
+                        }
+                }
+        }
+}
+
+
+static void _io(StringBuffer_T B, Service_T S, const char *name, const char *direction, Statistics_T statistics) {
+        if (Statistics_initialized(statistics)) {
+                _sample(B, name, "_total", S);
+                StringBuffer_append(B, ",direction=\"%s\"", direction);
+                _counter(B, Statistics_raw(statistics));
+        }
+}
+
+
+static void _ioStatistics(StringBuffer_T B) {
+        _family(B, "monit_process_io_bytes", "counter", "Process I/O bytes");
+        for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                Service_T S = _getStatus(c);
+                if (S->type == Service_Process && Util_hasServiceStatus(S)) {
+                        _io(B, S, "monit_process_io_bytes", "read", &(S->inf.process->read.bytes));
+                        _io(B, S, "monit_process_io_bytes", "write", &(S->inf.process->write.bytes));
+                }
+        }
+        _family(B, "monit_process_io_operations", "counter", "Process I/O operations");
+        for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                Service_T S = _getStatus(c);
+                if (S->type == Service_Process && Util_hasServiceStatus(S)) {
+                        _io(B, S, "monit_process_io_operations", "read", &(S->inf.process->read.operations));
+                        _io(B, S, "monit_process_io_operations", "write", &(S->inf.process->write.operations));
+                }
+        }
+        _family(B, "monit_filesystem_io_bytes", "counter", "Filesystem I/O bytes");
+        for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                Service_T S = _getStatus(c);
+                if (S->type == Service_Filesystem && Util_hasServiceStatus(S)) {
+                        _io(B, S, "monit_filesystem_io_bytes", "read", &(S->inf.filesystem->read.bytes));
+                        _io(B, S, "monit_filesystem_io_bytes", "write", &(S->inf.filesystem->write.bytes));
+                }
+        }
+        _family(B, "monit_filesystem_io_operations", "counter", "Filesystem I/O operations");
+        for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                Service_T S = _getStatus(c);
+                if (S->type == Service_Filesystem && Util_hasServiceStatus(S)) {
+                        _io(B, S, "monit_filesystem_io_operations", "read", &(S->inf.filesystem->read.operations));
+                        _io(B, S, "monit_filesystem_io_operations", "write", &(S->inf.filesystem->write.operations));
+                }
+        }
+}
+
+
+static void _netCounter(StringBuffer_T B, const char *name, const char *help, long long (*download)(Link_T), long long (*upload)(Link_T)) {
+        _family(B, name, "counter", help);
+        for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                Service_T S = _getStatus(c);
+                if (S->type == Service_Net && Util_hasServiceStatus(S) && Link_getState(S->inf.net->stats) == 1) {
+                        _sample(B, name, "_total", S);
+                        StringBuffer_append(B, ",direction=\"download\"");
+                        _counter(B, (unsigned long long)download(S->inf.net->stats));
+                        _sample(B, name, "_total", S);
+                        StringBuffer_append(B, ",direction=\"upload\"");
+                        _counter(B, (unsigned long long)upload(S->inf.net->stats));
+                }
+        }
+}
+
+
+static void _responseTime(StringBuffer_T B) {
+        _family(B, "monit_port_up", "gauge", "1 if the port connection test succeeded");
+        for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                Service_T S = _getStatus(c);
+                if (Util_hasServiceStatus(S)) {
+                        for (Port_T p = S->portlist; p; p = p->next) {
+                                _sample(B, "monit_port_up", "", S);
+                                StringBuffer_append(B, ",hostname=\"");
+                                _label(B, p->hostname);
+                                StringBuffer_append(B, "\",port=\"%d\",protocol=\"", p->target.net.port);
+                                _label(B, p->protocol->name);
+                                StringBuffer_append(B, "\"");
+                                _value(B, p->is_available == Connection_Ok);
+                        }
+                        for (Port_T p = S->socketlist; p; p = p->next) {
+                                _sample(B, "monit_port_up", "", S);
+                                StringBuffer_append(B, ",path=\"");
+                                _label(B, p->target.unix.pathname);
+                                StringBuffer_append(B, "\",protocol=\"");
+                                _label(B, p->protocol->name);
+                                StringBuffer_append(B, "\"");
+                                _value(B, p->is_available == Connection_Ok);
+                        }
+                }
+        }
+        _family(B, "monit_port_response_seconds", "gauge", "Port connection test response time");
+        for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                Service_T S = _getStatus(c);
+                if (Util_hasServiceStatus(S)) {
+                        for (Port_T p = S->portlist; p; p = p->next) {
+                                if (p->is_available == Connection_Ok) {
+                                        _sample(B, "monit_port_response_seconds", "", S);
+                                        StringBuffer_append(B, ",hostname=\"");
+                                        _label(B, p->hostname);
+                                        StringBuffer_append(B, "\",port=\"%d\",protocol=\"", p->target.net.port);
+                                        _label(B, p->protocol->name);
+                                        StringBuffer_append(B, "\"");
+                                        _value(B, p->response / 1000.);
+                                }
+                        }
+                        for (Port_T p = S->socketlist; p; p = p->next) {
+                                if (p->is_available == Connection_Ok) {
+                                        _sample(B, "monit_port_response_seconds", "", S);
+                                        StringBuffer_append(B, ",path=\"");
+                                        _label(B, p->target.unix.pathname);
+                                        StringBuffer_append(B, "\",protocol=\"");
+                                        _label(B, p->protocol->name);
+                                        StringBuffer_append(B, "\"");
+                                        _value(B, p->response / 1000.);
+                                }
+                        }
+                }
+        }
+        _family(B, "monit_port_resolution_seconds", "gauge", "Port connection test host name resolution time");
+        for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                Service_T S = _getStatus(c);
+                if (Util_hasServiceStatus(S)) {
+                        for (Port_T p = S->portlist; p; p = p->next) {
+                                if (p->is_available == Connection_Ok) {
+                                        _sample(B, "monit_port_resolution_seconds", "", S);
+                                        StringBuffer_append(B, ",hostname=\"");
+                                        _label(B, p->hostname);
+                                        StringBuffer_append(B, "\",port=\"%d\",protocol=\"", p->target.net.port);
+                                        _label(B, p->protocol->name);
+                                        StringBuffer_append(B, "\"");
+                                        _value(B, p->resolution / 1000.);
+                                }
+                        }
+                }
+        }
+        _family(B, "monit_icmp_response_seconds", "gauge", "Ping test response time");
+        for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                Service_T S = _getStatus(c);
+                if (Util_hasServiceStatus(S)) {
+                        for (Icmp_T i = S->icmplist; i; i = i->next) {
+                                if (i->is_available == Connection_Ok) {
+                                        _sample(B, "monit_icmp_response_seconds", "", S);
+                                        StringBuffer_append(B, ",type=\"%s\"", icmpnames[i->type]);
+                                        _value(B, i->response / 1000.);
+                                }
+                        }
+                }
+        }
+        _family(B, "monit_icmp_loss_ratio", "gauge", "Ping test packet loss");
+        for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                Service_T S = _getStatus(c);
+                if (Util_hasServiceStatus(S)) {
+                        for (Icmp_T i = S->icmplist; i; i = i->next) {
+                                if (i->is_available != Connection_Init) {
+                                        _sample(B, "monit_icmp_loss_ratio", "", S);
+                                        StringBuffer_append(B, ",type=\"%s\"", icmpnames[i->type]);
+                                        _value(B, i->statistics.loss / 100.);
+                                }
+                        }
+                }
+        }
+}
+
+
+static void _redisSample(StringBuffer_T B, const char *name, Service_T S, Port_T p) {
+        _sample(B, name, "", S);
+        if (p->family == Socket_Unix) {
+                StringBuffer_append(B, ",path=\"");
+                _label(B, p->target.unix.pathname);
+        } else {
+                StringBuffer_append(B, ",hostname=\"");
+                _label(B, p->hostname);
+                StringBuffer_append(B, "\",port=\"%d", p->target.net.port);
+        }
+        StringBuffer_append(B, "\"");
+}
+
+
+static void _redis(StringBuffer_T B, const char *name, const char *help, double (*get)(Port_T p)) {
+        _family(B, name, "gauge", help);
+        for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                Service_T S = _getStatus(c);
+                if (Util_hasServiceStatus(S)) {
+                        Port_T lists[] = {S->portlist, S->socketlist};
+                        for (int i = 0; i < 2; i++) {
+                                for (Port_T p = lists[i]; p; p = p->next) {
+                                        if (p->protocol->check == check_redis && p->is_available == Connection_Ok && p->statistics.redis.available) {
+                                                double value = get(p);
+                                                if (value >= 0) {
+                                                        _redisSample(B, name, S, p);
+                                                        _value(B, value);
+                                                }
+                                        }
+                                }
+                        }
+                }
+        }
+}
+
+
+static double _redisMemory(Port_T p) {
+        return p->statistics.redis.memory;
+}
+
+
+static double _redisClients(Port_T p) {
+        return p->statistics.redis.clients;
+}
+
+
+static double _redisOperations(Port_T p) {
+        return p->statistics.redis.operations;
+}
+
+
+static double _redisLag(Port_T p) {
+        return p->statistics.redis.lag;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+/**
+ * Get the service statistics in the OpenMetrics text format
+ * @param B StringBuffer object
+ */
+void status_metrics(StringBuffer_T B) {
+        for (size_t i = 0; i < sizeof(_metrics) / sizeof(_metrics[0]); i++) {
+                bool counter = IS(_metrics[i].kind, "counter");
+                _family(B, _metrics[i].name, _metrics[i].kind, _metrics[i].help);
+                for (Service_T c = servicelist_conf; c; c = c->next_conf) {
+                        Service_T S = _getStatus(c);
+                        double value;
+                        if (_get(S, _metrics[i].type, &value)) {
+                                _sample(B, _metrics[i].name, counter ? "_total" : "", S);
+                                _value(B, value);
+                        }
+                }
+        }
+        _systemCpu(B);
+        _ioStatistics(B);
+        _netCounter(B, "monit_net_bytes", "Network link bytes", Link_getBytesInTotal, Link_getBytesOutTotal);
+        _netCounter(B, "monit_net_packets", "Network link packets", Link_getPacketsInTotal, Link_getPacketsOutTotal);
+        _netCounter(B, "monit_net_errors", "Network link errors", Link_getErrorsInTotal, Link_getErrorsOutTotal);
+        _responseTime(B);
+        _redis(B, "monit_redis_memory_bytes", "Redis used memory", _redisMemory);
+        _redis(B, "monit_redis_clients", "Redis connected clients", _redisClients);
+        _redis(B, "monit_redis_operations_per_second", "Redis operations per second", _redisOperations);
+        _redis(B, "monit_redis_replication_lag_seconds", "Redis replication lag", _redisLag);
+        StringBuffer_append(B, "# EOF\n");
+}
+
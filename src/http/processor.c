@@ -68,13 +68,28 @@
 #include <limits.h>
 #endif
 
+#ifdef HAVE_CTYPE_H
+#include <ctype.h>
+#endif
+
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
 #include "monit.h"
 #include "processor.h"
 #include "base64.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "checksum.h"
+#include "probe.h"
 
 // libmonit
 #include "util/Str.h"
 #include "system/Net.h"
+#include "system/System.h"
+#include "system/Time.h"
 
 
 /**
@@ -100,30 +115,67 @@
  */
 
 
+typedef enum {
+        Encoding_Identity = 0,
+        Encoding_Gzip,
+        Encoding_Deflate
+} Encoding_Type;
+
+
 static int _httpPostLimit;
 
 
+// The maximum size of the M/Monit message posted to the collector, 0 if the relay is not enabled
+static int _httpCollectorLimit;
+
+
+/* The requests are read and the responses sent by parallel HTTP workers, the authentication and the cervlet are serialized */
+static Mutex_T _mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* The verified Authorization headers by the HMAC of the header, so the password check (PAM, crypt) is not repeated for
+ * every request of the client. The key is random, so the digest cannot be computed from a guessed header */
+static struct {
+        bool initialized;
+        unsigned char key[SHA256_DIGEST_SIZE];
+        struct {
+                unsigned char digest[SHA256_DIGEST_SIZE];
+                char *user;                         /**< The authenticated user or NULL */
+                long long expires;                       /**< [ms] */
+        } entry[AUTH_CACHE_SIZE];
+} _authCache;
+
+
 /* -------------------------------------------------------------- Prototypes */
 
 
-static void do_service(Socket_T);
+static Processor_Result do_service(Socket_T, bool);
+static const char *_htmlEntity(int);
+static unsigned _hash(const char *);
+static bool is_keepalive(HttpRequest);
+static Encoding_Type get_encoding(HttpRequest);
+static bool send_head(HttpResponse, long long);
+static bool send_file(HttpResponse);
+static bool send_chunk(Socket_T, const void *, size_t);
 static void destroy_entry(void *);
 static char *get_date(char *, int);
 static char *get_server(char *, int);
-static void create_headers(HttpRequest);
+static int read_line(Socket_T, char *, char *);
+static int parse_headers(HttpRequest, char *, char *);
 static void send_response(HttpRequest, HttpResponse);
-static bool basic_authenticate(HttpRequest);
+static bool authenticate(HttpRequest);
+static bool basic_authenticate(HttpRequest, const char *);
+static bool bearer_authenticate(HttpRequest, const char *);
 static void done(HttpRequest, HttpResponse);
 static void destroy_HttpRequest(HttpRequest);
 static void reset_response(HttpResponse res);
-static HttpParameter parse_parameters(char *);
-static bool create_parameters(HttpRequest req);
+static bool parse_parameters(HttpRequest, char *);
+static bool create_parameters(HttpRequest req, char *);
 static void destroy_HttpResponse(HttpResponse);
 static HttpRequest create_HttpRequest(Socket_T);
 static void internal_error(Socket_T, int, const char *);
 static HttpResponse create_HttpResponse(Socket_T);
 static bool is_authenticated(HttpRequest, HttpResponse);
-static int get_next_token(char *s, int *cursor, char **r);
 
 
 /*
@@ -143,16 +195,21 @@ struct  ServiceImpl {
 
 /**
  * Process a HTTP request. This is done by dispatching to the service
- * function.
+ * function. The caller owns the connection and should close it unless
+ * it can be used for the next request.
  * @param s A Socket_T representing the client connection
+ * @param keepalive true if the connection may be kept open for the next
+ * request
+ * @return Processor_KeepAlive if the connection was kept open (the client
+ * asked for a persistent connection and the response was sent) or
+ * Processor_Detached if the cervlet took over the connection
  */
-void *http_processor(Socket_T s) {
-        if (! Net_canRead(Socket_getSocket(s), REQUEST_TIMEOUT * 1000))
+Processor_Result http_processor(Socket_T s, bool keepalive) {
+        if (! Socket_hasPendingData(s) && ! Net_canRead(Socket_getSocket(s), REQUEST_TIMEOUT * 1000)) {
                 internal_error(s, SC_REQUEST_TIMEOUT, "Time out when handling the Request");
-        else
-                do_service(s);
-        Socket_free(&s);
-        return NULL;
+                return Processor_Close;
+        }
+        return do_service(s, keepalive);
 }
 
 
@@ -173,21 +230,30 @@ void Processor_setHttpPostLimit() {
         // Add space for each service
         for (Service_T s = servicelist; s; s = s->next)
                 _httpPostLimit += strlen("&service=") + strlen(s->name);
+        _httpCollectorLimit = 0;
+        for (Mmonit_T C = Run.mmonits; C; C = C->next)
+                if (C->relay)
+                        _httpCollectorLimit = COLLECTOR_LIMIT;
 }
 
 
-StringBuffer_T escapeHTML(StringBuffer_T sb, const char *s) {
-        for (int i = 0; s[i]; i++) {
-                if (s[i] == '<')
-                        StringBuffer_append(sb, "&lt;");
-                else if (s[i] == '>')
-                        StringBuffer_append(sb, "&gt;");
-                else if (s[i] == '&')
-                        StringBuffer_append(sb, "&amp;");
-                else
-                        StringBuffer_append(sb, "%c", s[i]);
+/**
+ * Forget the verified credentials, called when the HTTP server starts
+ * with the new configuration
+ */
+void Processor_flushCredentials(void) {
+        LOCK(_mutex)
+        {
+                for (int i = 0; i < AUTH_CACHE_SIZE; i++)
+                        FREE(_authCache.entry[i].user);
+                memset(&_authCache, 0, sizeof(_authCache));
         }
-        return sb;
+        END_LOCK;
+}
+
+
+StringBuffer_T escapeHTML(StringBuffer_T sb, const char *s) {
+        return StringBuffer_appendEscaped(sb, s, _htmlEntity);
 }
 
 
@@ -301,7 +367,7 @@ void set_content_type(HttpResponse res, const char *mime) {
  * @return The value of the specified header, NULL if not found
  */
 const char *get_header(HttpRequest req, const char *name) {
-        for (HttpHeader p = req->headers; p; p = p->next)
+        for (HttpHeader p = req->headers[_hash(name)]; p; p = p->chain)
                 if (IS(p->name, name))
                         return (p->value);
         return NULL;
@@ -315,7 +381,7 @@ const char *get_header(HttpRequest req, const char *name) {
  * @return The value of the specified parameter, or NULL if not found
  */
 const char *get_parameter(HttpRequest req, const char *name) {
-        for (HttpParameter p = req->params; p; p = p->next)
+        for (HttpParameter p = req->paramIndex[_hash(name)]; p; p = p->chain)
                 if (IS(p->name, name))
                         return (p->value);
         return NULL;
@@ -370,6 +436,8 @@ const char *get_status_string(int status) {
                         return "Gateway Timeout";
                 case SC_GONE:
                         return "Gone";
+                case SC_HEADER_FIELDS_TOO_LARGE:
+                        return "Request Header Fields Too Large";
                 case SC_VERSION_NOT_SUPPORTED:
                         return "HTTP Version Not Supported";
                 case SC_INTERNAL_SERVER_ERROR:
@@ -436,28 +504,202 @@ const char *get_status_string(int status) {
 /* ----------------------------------------------------------------- Private */
 
 
+/**
+ * Get the hash table slot of the request header or parameter name, the
+ * names are compared case-insensitive
+ */
+static unsigned _hash(const char *name) {
+        unsigned hash = 2166136261U; // FNV-1a
+        for (const unsigned char *c = (const unsigned char *)name; *c; c++) {
+                hash ^= tolower(*c);
+                hash *= 16777619U;
+        }
+        return hash & (REQ_TABLE_SIZE - 1);
+}
+
+
+/* Entity for the characters escapeHTML must replace, NULL otherwise */
+static const char *_htmlEntity(int c) {
+        switch (c) {
+                case '<': return "&lt;";
+                case '>': return "&gt;";
+                case '&': return "&amp;";
+                default: return NULL;
+        }
+}
+
+
 /**
  * Receives standard HTTP requests from a client socket and dispatches
  * them to the doXXX methods defined in a cervlet module.
  */
-static void do_service(Socket_T s) {
+static Processor_Result do_service(Socket_T s, bool keepalive) {
+        volatile Processor_Result result = Processor_Close;
         volatile HttpResponse res = create_HttpResponse(s);
         volatile HttpRequest req = create_HttpRequest(s);
         if (res && req) {
+                PROBE2(http__request__start, req->method, req->url);
+                res->keepalive = keepalive && is_keepalive(req);
+                if (IS(req->protocol, "1.1"))
+                        res->protocol = SERVER_PROTOCOL11;
                 if (Run.httpd.socket.net.ssl.flags & SSL_Enabled)
                         set_header(res, "Strict-Transport-Security", "max-age=63072000; includeSubdomains; preload");
-                if (is_authenticated(req, res)) {
-                        set_header(res, "Set-Cookie", "securitytoken=%s; Max-Age=600; HttpOnly; SameSite=strict%s", res->token, (Run.httpd.socket.net.ssl.flags & SSL_Enabled) ? "; Secure" : "");
-                        if (IS(req->method, METHOD_GET))
-                                Impl.doGet(req, res);
-                        else if (IS(req->method, METHOD_POST))
-                                Impl.doPost(req, res);
-                        else
-                                send_error(req, res, SC_NOT_IMPLEMENTED, "Method not implemented");
+                LOCK(_mutex)
+                {
+                        if (is_authenticated(req, res)) {
+                                set_header(res, "Set-Cookie", "securitytoken=%s; Max-Age=600; HttpOnly; SameSite=strict%s", res->token, (Run.httpd.socket.net.ssl.flags & SSL_Enabled) ? "; Secure" : "");
+                                if (IS(req->method, METHOD_GET))
+                                        Impl.doGet(req, res);
+                                else if (IS(req->method, METHOD_POST))
+                                        Impl.doPost(req, res);
+                                else
+                                        send_error(req, res, SC_NOT_IMPLEMENTED, "Method not implemented");
+                        }
                 }
+                END_LOCK;
                 send_response(req, res);
+                PROBE3(http__request__done, req->method, req->url, res->status);
+                if (res->is_detached)
+                        result = Processor_Detached;
+                else if (res->keepalive)
+                        result = Processor_KeepAlive;
         }
         done(req, res);
+        return result;
+}
+
+
+/**
+ * Set length bytes of the file starting at offset as the response body,
+ * instead of the output buffer. The response takes over the file
+ * descriptor. The file is sent after the request was processed, when the
+ * cervlet lock is released, so a slow client doesn't block the other
+ * requests. The response status and headers must be set before.
+ * @param res HttpResponse object
+ * @param fd The file descriptor of the file to send
+ * @param offset The file offset where the body starts
+ * @param length The number of bytes to send
+ */
+void set_file(HttpResponse res, int fd, off_t offset, off_t length) {
+        if (res->file.fd >= 0)
+                close(res->file.fd);
+        res->file.fd = fd;
+        res->file.offset = offset;
+        res->file.length = length;
+}
+
+
+/**
+ * Set the function which renders the response body after the request was
+ * processed, when the cervlet lock is released. The writer must only use
+ * the data which is safe to read without the lock, such as the service
+ * status snapshots, and may call flush_response() between the parts of
+ * the body. The response status and headers must be set before.
+ * @param res HttpResponse object
+ * @param writer The body writer
+ */
+void set_writer(HttpResponse res, void (*writer)(HttpRequest, HttpResponse)) {
+        res->writer = writer;
+}
+
+
+/**
+ * Send the buffered part of the response body as a chunk, if the buffer
+ * is large enough and the client supports the chunked transfer encoding.
+ * The headers are sent with the first chunk. Only the writer set by
+ * set_writer() may call this function, the cervlet lock is not held then,
+ * so a slow client doesn't block the other requests.
+ * @param res HttpResponse object
+ */
+void flush_response(HttpResponse res) {
+        if (! res->can_stream || StringBuffer_length(res->outputbuffer) < RESPONSE_CHUNK)
+                return;
+        if (! res->is_streaming) {
+                res->is_committed = res->is_streaming = true;
+                if (! send_head(res, -1))
+                        res->keepalive = false;
+        }
+        if (! send_chunk(res->S, StringBuffer_toString(res->outputbuffer), StringBuffer_length(res->outputbuffer)))
+                res->keepalive = false;
+        StringBuffer_clear(res->outputbuffer);
+}
+
+
+/**
+ * Send the response headers followed by the file set by set_file(). On
+ * plain connections the file is sent with sendfile(2) where available, so
+ * the data is not copied to user space.
+ * @param res HttpResponse object
+ * @return true if the whole body was sent, otherwise false
+ */
+static bool send_file(HttpResponse res) {
+        Socket_T S = res->S;
+        int fd = res->file.fd;
+        off_t offset = res->file.offset;
+        off_t length = res->file.length;
+        res->is_committed = true;
+        if (! send_head(res, length)) {
+                res->keepalive = false;
+                return false;
+        }
+#ifdef HAVE_SYS_SENDFILE_H
+        if (! Socket_isSecure(S)) {
+                int socket = Socket_getSocket(S);
+                while (length > 0) {
+                        ssize_t n = sendfile(socket, fd, &offset, length);
+                        if (n > 0)
+                                length -= n;
+                        else if (n < 0 && errno == EINTR)
+                                continue;
+                        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && Net_canWrite(socket, Socket_getTimeout(S)))
+                                continue;
+                        else
+                                break; // Error, timeout or the file was truncated
+                }
+        } else
+#endif
+        {
+                unsigned char buf[16384];
+                while (length > 0) {
+                        ssize_t n = pread(fd, buf, MIN((off_t)sizeof(buf), length), offset);
+                        if (n <= 0 || Socket_write(S, buf, n) != n)
+                                break;
+                        offset += n;
+                        length -= n;
+                }
+        }
+        if (length > 0)
+                res->keepalive = false;
+        return length == 0;
+}
+
+
+/**
+ * Send the response headers of the body which is sent by the cervlet
+ * using the chunked transfer encoding after the request was processed,
+ * such as the event stream. The body is not compressed. The response
+ * status and headers must be set before. The connection is not persistent; the cervlet which takes over
+ * the connection sets res->is_detached, otherwise the connection is
+ * closed after the headers.
+ * @param res HttpResponse object
+ * @return true if the headers were sent, otherwise false
+ */
+bool start_stream(HttpResponse res) {
+        res->is_committed = res->is_complete = true;
+        res->keepalive = false;
+        return send_head(res, -1);
+}
+
+
+/**
+ * Returns true if the client asked for a persistent connection. The
+ * HTTP/1.1 connections are persistent by default.
+ */
+static bool is_keepalive(HttpRequest req) {
+        const char *connection = get_header(req, "Connection");
+        if (connection)
+                return Str_startsWith(connection, "keep-alive") || (IS(req->protocol, "1.1") && ! Str_startsWith(connection, "close"));
+        return IS(req->protocol, "1.1");
 }
 
 
@@ -485,45 +727,138 @@ static char *get_server(char *result, int size) {
 
 /**
  * Send the response to the client. If the response has already been
- * committed, this function does nothing.
+ * committed, this function does nothing, except that the connection
+ * cannot be kept open then.
  */
 static void send_response(HttpRequest req, HttpResponse res) {
         Socket_T S = res->S;
 
-        if (! res->is_committed) {
-                char date[STRLEN];
-                char server[STRLEN];
+        if (res->is_complete) {
+                return;
+        } else if (res->is_committed) {
+                res->keepalive = false;
+        } else if (res->file.fd >= 0) {
+                if (! send_file(res))
+                        DEBUG("HttpRequest: error sending file -- %s\n", STRERROR);
+        } else {
+                if (res->writer) {
+                        // The compressed body is sent at once, otherwise the HTTP/1.1 client gets the body in chunks as it is rendered
+                        res->can_stream = IS(req->protocol, "1.1") && get_encoding(req) == Encoding_Identity;
+                        res->writer(req, res);
+                        if (res->is_streaming) {
+                                // Send the rest of the body and the last chunk
+                                size_t length = StringBuffer_length(res->outputbuffer);
+                                if ((length && ! send_chunk(S, StringBuffer_toString(res->outputbuffer), length)) || Socket_print(S, "0\r\n\r\n") < 0)
+                                        res->keepalive = false;
+                                return;
+                        }
+                }
+                const void *body = StringBuffer_toString(res->outputbuffer);
+                size_t bodyLength = StringBuffer_length(res->outputbuffer);
+                // Small responses are sent as is, compression would hardly save anything
+                if (bodyLength >= COMPRESS_THRESHOLD) {
+                        switch (get_encoding(req)) {
+                                case Encoding_Gzip:
+                                        body = StringBuffer_toCompressed(res->outputbuffer, 6, &bodyLength);
+                                        set_header(res, "Content-Encoding", "gzip");
+                                        break;
+                                case Encoding_Deflate:
+                                        body = StringBuffer_toDeflated(res->outputbuffer, 6, &bodyLength);
+                                        set_header(res, "Content-Encoding", "deflate");
+                                        break;
+                                default:
+                                        break;
+                        }
 #ifdef HAVE_LIBZ
-                const char *acceptEncoding = get_header(req, "Accept-Encoding");
-                bool canCompress = acceptEncoding && Str_sub(acceptEncoding, "gzip");
-#else
-                bool canCompress = false;
+                        set_header(res, "Vary", "Accept-Encoding");
 #endif
-                const void *body = NULL;
-                size_t bodyLength = 0;
-                if (canCompress && StringBuffer_length(res->outputbuffer) > 0) {
-                        body = StringBuffer_toCompressed(res->outputbuffer, 6, &bodyLength);
-                        set_header(res, "Content-Encoding", "gzip");
-                } else {
-                        body = StringBuffer_toString(res->outputbuffer);
-                        bodyLength = StringBuffer_length(res->outputbuffer);
                 }
-                char *headers = get_headers(res);
                 res->is_committed = true;
-                get_date(date, STRLEN);
-                get_server(server, STRLEN);
-                Socket_print(S, "%s %d %s\r\n", res->protocol, res->status, res->status_msg);
-                Socket_print(S, "Date: %s\r\n", date);
-                Socket_print(S, "Server: %s\r\n", server);
-                Socket_print(S, "Content-Length: %zu\r\n", bodyLength);
-                Socket_print(S, "Connection: close\r\n");
-                if (headers)
-                        Socket_print(S, "%s", headers);
-                Socket_print(S, "\r\n");
-                if (bodyLength)
-                        Socket_write(S, (unsigned char *)body, bodyLength);
-                FREE(headers);
+                if (! send_head(res, bodyLength) || (bodyLength && Socket_write(S, (unsigned char *)body, bodyLength) != (int)bodyLength))
+                        res->keepalive = false;
+        }
+}
+
+
+/**
+ * Returns the content-coding the response body can be compressed with,
+ * based on the Accept-Encoding header. Gzip is preferred over deflate.
+ * The coding with q=0 is refused, the explicitly listed coding overrides
+ * the "*" wildcard in both directions.
+ */
+static Encoding_Type get_encoding(HttpRequest req) {
+        Encoding_Type encoding = Encoding_Identity;
+#ifdef HAVE_LIBZ
+        const char *acceptEncoding = get_header(req, "Accept-Encoding");
+        if (acceptEncoding) {
+                // The acceptance of the coding: -1 not listed, 0 refused (q=0), 1 accepted
+                int gzip = -1, deflate = -1, any = -1;
+                char *codings = Str_dup(acceptEncoding);
+                char *saveptr = NULL;
+                for (char *coding = strtok_r(codings, ",", &saveptr); coding; coding = strtok_r(NULL, ",", &saveptr)) {
+                        int accepted = 1;
+                        char *parameters = strchr(coding, ';');
+                        if (parameters) {
+                                *parameters++ = 0;
+                                char *q = strstr(parameters, "q=");
+                                if (q && strtod(q + 2, NULL) <= 0.)
+                                        accepted = 0;
+                        }
+                        Str_trim(coding);
+                        if (IS(coding, "gzip") || IS(coding, "x-gzip"))
+                                gzip = accepted;
+                        else if (IS(coding, "deflate"))
+                                deflate = accepted;
+                        else if (IS(coding, "*"))
+                                any = accepted;
+                }
+                FREE(codings);
+                if (gzip == 1 || (gzip < 0 && any == 1))
+                        encoding = Encoding_Gzip;
+                else if (deflate == 1 || (deflate < 0 && any == 1))
+                        encoding = Encoding_Deflate;
         }
+#endif
+        return encoding;
+}
+
+
+/**
+ * Send the status line and the headers. If the length is negative, the
+ * body is sent using the chunked transfer encoding.
+ * @return false if the headers could not be sent
+ */
+static bool send_head(HttpResponse res, long long length) {
+        Socket_T S = res->S;
+        char date[STRLEN];
+        char server[STRLEN];
+        char *headers = get_headers(res);
+        get_date(date, STRLEN);
+        get_server(server, STRLEN);
+        Socket_print(S, "%s %d %s\r\n", res->protocol, res->status, res->status_msg);
+        Socket_print(S, "Date: %s\r\n", date);
+        Socket_print(S, "Server: %s\r\n", server);
+        if (length < 0)
+                Socket_print(S, "Transfer-Encoding: chunked\r\n");
+        else
+                Socket_print(S, "Content-Length: %lld\r\n", length);
+        if (res->keepalive)
+                Socket_print(S, "Connection: keep-alive\r\nKeep-Alive: timeout=%d\r\n", KEEPALIVE_TIMEOUT);
+        else
+                Socket_print(S, "Connection: close\r\n");
+        if (headers)
+                Socket_print(S, "%s", headers);
+        FREE(headers);
+        return Socket_print(S, "\r\n") >= 0;
+}
+
+
+/**
+ * Send one chunk of the chunked transfer encoding
+ * @return false if the chunk could not be sent
+ */
+static bool send_chunk(Socket_T S, const void *data, size_t length) {
+        return Socket_print(S, "%zx\r\n", length) >= 0 && Socket_write(S, data, length) == (int)length && Socket_print(S, "\r\n") >= 0;
 }
 
 
@@ -534,32 +869,64 @@ static void send_response(HttpRequest req, HttpResponse res) {
  * Returns a new HttpRequest object wrapping the client request
  */
 static HttpRequest create_HttpRequest(Socket_T S) {
-        char line[REQ_STRLEN];
-        if (Socket_readLine(S, line, sizeof(line)) == NULL) {
-                internal_error(S, SC_BAD_REQUEST, "No request found");
+        // The request and all its strings live in one arena, released at once by destroy_HttpRequest. The request head is read
+        // into one buffer in the arena, the request line and header fields are terminated in place and used as they are
+        Arena_T arena = Arena_new(REQ_ARENA_SIZE);
+        HttpRequest req = Arena_calloc(arena, 1, sizeof(*req));
+        req->arena = arena;
+        req->S = S;
+        char *head = Arena_alloc(arena, REQ_HEAD_LIMIT);
+        char *end = head + REQ_HEAD_LIMIT;
+        int length = read_line(S, head, end);
+        if (length <= 0) {
+                destroy_HttpRequest(req);
+                internal_error(S, length < -1 ? SC_REQUEST_URI_TOO_LARGE : SC_BAD_REQUEST, length < -1 ? "[error] URL too long" : "No request found");
                 return NULL;
         }
-        Str_chomp(line);
-        char method[STRLEN];
-        char url[REQ_STRLEN];
-        char protocol[STRLEN];
-        if (sscanf(line, "%255s %1023s HTTP/%3[1.0]", method, url, protocol) != 3) {
+        // method SP request-target SP HTTP-version
+        char *url = strchr(head, ' ');
+        char *protocol = url ? strchr(url + 1, ' ') : NULL;
+        if (! protocol || url == head || ! Str_startsWith(protocol, " HTTP/") || ! (IS(protocol + 6, "1.0") || IS(protocol + 6, "1.1"))) {
+                destroy_HttpRequest(req);
                 internal_error(S, SC_BAD_REQUEST, "Cannot parse request");
                 return NULL;
         }
-        if (strlen(url) >= MAX_URL_LENGTH) {
-                internal_error(S, SC_BAD_REQUEST, "[error] URL too long");
+        *url++ = 0;
+        *protocol = 0;
+        for (char *c = head; *c; c++) {
+                if (! isupper((unsigned char)*c)) {
+                        destroy_HttpRequest(req);
+                        internal_error(S, SC_BAD_REQUEST, "Cannot parse request");
+                        return NULL;
+                }
+        }
+        for (char *c = url; *c; c++) {
+                if (iscntrl((unsigned char)*c) || *c == ' ') {
+                        destroy_HttpRequest(req);
+                        internal_error(S, SC_BAD_REQUEST, "Cannot parse request");
+                        return NULL;
+                }
+        }
+        if (protocol - url >= MAX_URL_LENGTH) {
+                destroy_HttpRequest(req);
+                internal_error(S, SC_REQUEST_URI_TOO_LARGE, "[error] URL too long");
+                return NULL;
+        }
+        req->method = head;
+        req->url = url;
+        req->protocol = protocol + 6;
+        int status = parse_headers(req, head + length + 1, end);
+        if (status != SC_OK) {
+                destroy_HttpRequest(req);
+                internal_error(S, status, status == SC_HEADER_FIELDS_TOO_LARGE ? "Request headers too large" : "Cannot parse Request headers");
                 return NULL;
         }
-        HttpRequest req = NULL;
-        NEW(req);
-        req->S = S;
-        Util_urlDecode(url);
-        req->url = Str_dup(url);
-        req->method = Str_dup(method);
-        req->protocol = Str_dup(protocol);
-        create_headers(req);
-        if (! create_parameters(req)) {
+        // The query string of GET is split off before the URL is decoded, so the encoded '?' and '&' don't split the URL
+        char *query = NULL;
+        if (IS(req->method, METHOD_GET) && (query = strchr(req->url, '?')))
+                *query++ = 0;
+        Util_urlDecode(req->url);
+        if (! create_parameters(req, query)) {
                 destroy_HttpRequest(req);
                 internal_error(S, SC_BAD_REQUEST, "Cannot parse Request parameters");
                 return NULL;
@@ -581,70 +948,111 @@ static HttpResponse create_HttpResponse(Socket_T S) {
         res->is_committed = false;
         res->protocol = SERVER_PROTOCOL;
         res->status_msg = get_status_string(SC_OK);
+        res->file.fd = -1;
         Util_getToken(res->token);
         return res;
 }
 
 
 /**
- * Create HTTP headers for the given request
+ * Read the next line of the request head into the buffer and terminate
+ * it in place without the CRLF
+ * @return The line length, -1 if the line is not complete (the connection
+ * was closed or the line has \0) or -2 if the line doesn't fit the buffer
  */
-static void create_headers(HttpRequest req) {
-        char line[REQ_STRLEN] = {0};
-        while (Socket_readLine(req->S, line, sizeof(line)) && ! (Str_isEqual(line, "\r\n") || Str_isEqual(line, "\n"))) {
+static int read_line(Socket_T S, char *line, char *end) {
+        if (end - line < 2 || ! Socket_readLine(S, line, (int)(end - line)))
+                return end - line < 2 ? -2 : -1;
+        int length = (int)strlen(line);
+        if (! length || line[length - 1] != '\n')
+                return length == end - line - 1 ? -2 : -1;
+        line[--length] = 0;
+        if (length && line[length - 1] == '\r')
+                line[--length] = 0;
+        return length;
+}
+
+
+/**
+ * Read the request headers into the head buffer up to the empty line. The
+ * header names and values are the slices of the buffer, indexed by the
+ * name hash. The folded lines, the names with whitespace and the repeated
+ * Content-Length with different values are rejected
+ * @return SC_OK or the error status
+ */
+static int parse_headers(HttpRequest req, char *line, char *end) {
+        int count = 0;
+        while (true) {
+                int length = read_line(req->S, line, end);
+                if (length < 0)
+                        return length < -1 ? SC_HEADER_FIELDS_TOO_LARGE : SC_BAD_REQUEST;
+                if (length == 0)
+                        return SC_OK;
+                if (++count > REQ_MAX_HEADERS)
+                        return SC_HEADER_FIELDS_TOO_LARGE;
                 char *value = strchr(line, ':');
-                if (value) {
-                        HttpHeader header = NULL;
-                        NEW(header);
-                        *value++ = 0;
-                        Str_trim(line);
-                        Str_trim(value);
-                        Str_chomp(value);
-                        header->name = Str_dup(line);
-                        header->value = Str_dup(value);
-                        header->next = req->headers;
-                        req->headers = header;
+                if (! value || value == line || strpbrk(line, " \t") < value)
+                        return SC_BAD_REQUEST;
+                *value++ = 0;
+                // Trim the optional whitespace around the value
+                char *last = line + length - 1;
+                while (last >= value && (*last == ' ' || *last == '\t'))
+                        *last-- = 0;
+                while (*value == ' ' || *value == '\t')
+                        value++;
+                if (IS(line, "Content-Length")) {
+                        const char *previous = get_header(req, line);
+                        if (previous && ! IS(previous, value))
+                                return SC_BAD_REQUEST;
                 }
+                unsigned slot = _hash(line);
+                HttpHeader header = Arena_calloc(req->arena, 1, sizeof(*header));
+                header->name = line;
+                header->value = value;
+                header->chain = req->headers[slot];
+                req->headers[slot] = header;
+                line += length + 1;
         }
 }
 
 
 /**
- * Create parameters for the given request. Returns false if an error
- * occurs.
+ * Create parameters for the given request from the GET query string or
+ * the POST body. Returns false if an error occurs.
  */
-static bool create_parameters(HttpRequest req) {
-        char *query_string = NULL;
+static bool create_parameters(HttpRequest req, char *query_string) {
         if (IS(req->method, METHOD_POST)) {
                 int len;
                 const char *content_length = get_header(req, "Content-Length");
-                if (! content_length || sscanf(content_length, "%d", &len) != 1 || len < 0 || len > _httpPostLimit)
+                const char *content_type = get_header(req, "Content-Type");
+                const char *content_encoding = get_header(req, "Content-Encoding");
+                // The M/Monit message of a downstream monit is kept as is for the relay
+                bool message = _httpCollectorLimit && IS(req->url, COLLECTOR_URL) && content_type && Str_startsWith(content_type, "text/xml");
+                // The chunked body is not supported, the request could be read differently by a proxy in front of monit
+                if (get_header(req, "Transfer-Encoding"))
+                        return false;
+                if (! content_length || sscanf(content_length, "%d", &len) != 1 || len < 0 || len > (message ? _httpCollectorLimit : _httpPostLimit))
+                        return false;
+                if (message && content_encoding && ! Str_isEqual(content_encoding, "identity"))
                         return false;
                 if (len != 0) {
-                        query_string = CALLOC(1, _httpPostLimit + 1);
-                        int n = Socket_read(req->S, query_string, len);
-                        if (n != len) {
-                                FREE(query_string);
+                        query_string = Arena_calloc(req->arena, 1, len + 1);
+                        if (Socket_read(req->S, query_string, len) != len)
                                 return false;
-                        }
                 }
-        } else if (IS(req->method, METHOD_GET)) {
-                char *p = strchr(req->url, '?');
-                if (p) {
-                        *p++ = 0;
-                        query_string = Str_dup(p);
+                if (message) {
+                        req->content = query_string;
+                        req->content_length = len;
+                        return true;
                 }
         }
-        if (query_string) {
-                if (*query_string) {
-                        char *p = strchr(query_string, '/');
-                        if (p) {
-                                *p++ = 0;
-                                req->pathinfo = Str_dup(p);
-                        }
-                        req->params = parse_parameters(query_string);
+        if (query_string && *query_string) {
+                char *p = strchr(query_string, '/');
+                if (p) {
+                        *p++ = 0;
+                        req->pathinfo = p;
                 }
-                FREE(query_string);
+                return parse_parameters(req, query_string);
         }
         return true;
 }
@@ -661,6 +1069,11 @@ static void reset_response(HttpResponse res) {
                 destroy_entry(res->headers);
                 res->headers = NULL; /* Release Pragma */
         }
+        if (res->file.fd >= 0) {
+                close(res->file.fd);
+                res->file.fd = -1;
+        }
+        res->writer = NULL;
         StringBuffer_clear(res->outputbuffer);
 }
 
@@ -679,16 +1092,8 @@ static void done(HttpRequest req, HttpResponse res) {
  */
 static void destroy_HttpRequest(HttpRequest req) {
         if (req) {
-                FREE(req->method);
-                FREE(req->url);
-                FREE(req->pathinfo);
-                FREE(req->protocol);
-                FREE(req->remote_user);
-                if (req->headers)
-                        destroy_entry(req->headers);
-                if (req->params)
-                        destroy_entry(req->params);
-                FREE(req);
+                Arena_T arena = req->arena;
+                Arena_free(&arena);
         }
 }
 
@@ -699,6 +1104,8 @@ static void destroy_HttpRequest(HttpRequest req) {
 static void destroy_HttpResponse(HttpResponse res) {
         if (res) {
                 StringBuffer_free(&(res->outputbuffer));
+                if (res->file.fd >= 0)
+                        close(res->file.fd);
                 if (res->headers)
                         destroy_entry(res->headers);
                 FREE(res);
@@ -730,14 +1137,15 @@ static bool _isCookieSeparator(int c) {
 
 static bool is_authenticated(HttpRequest req, HttpResponse res) {
         if (Run.httpd.credentials) {
-                if (! basic_authenticate(req)) {
+                if (! authenticate(req)) {
                         // Send just generic error message to the client to not disclose e.g. username existence in case of credentials harvesting attack
                         send_error(req, res, SC_UNAUTHORIZED, "You are not authorized to access monit. Either you supplied the wrong credentials (e.g. bad password), or your browser doesn't understand how to supply the credentials required");
                         set_header(res, "WWW-Authenticate", "Basic realm=\"monit\"");
                         return false;
                 }
         }
-        if (IS(req->method, METHOD_POST)) {
+        // The M/Monit message of a downstream monit posted to the collector is not a browser form, only the credentials are checked
+        if (IS(req->method, METHOD_POST) && ! (req->content && IS(req->url, COLLECTOR_URL))) {
                 // Check CSRF double-submit cookie (https://www.owasp.org/index.php/Cross-Site_Request_Forgery_(CSRF)_Prevention_Cheat_Sheet#Double_Submit_Cookie)
                 const char *token = get_parameter(req, "securitytoken");
                 if (! token) {
@@ -793,17 +1201,69 @@ static bool is_authenticated(HttpRequest req, HttpResponse res) {
 
 
 /**
- * Authenticate the basic-credentials (uname/password) submitted by
- * the user.
+ * Authenticate the client by the Authorization header, which has either
+ * the basic-credentials or a bearer token. The verified header is cached
+ * for AUTH_CACHE_TTL seconds, the failed attempts are not cached.
  */
-static bool basic_authenticate(HttpRequest req) {
+static bool authenticate(HttpRequest req) {
         const char *credentials = get_header(req, "Authorization");
-        if (! (credentials && Str_startsWith(credentials, "Basic "))) {
-                Log_debug("HttpRequest: access denied -- client [%s]: missing or invalid Authorization header\n", NVLSTR(Socket_getRemoteHost(req->S)));
+        if (! credentials) {
+                Log_debug("HttpRequest: access denied -- client [%s]: missing Authorization header\n", NVLSTR(Socket_getRemoteHost(req->S)));
+                return false;
+        }
+        if (! _authCache.initialized)
+                _authCache.initialized = System_random(_authCache.key, sizeof(_authCache.key));
+        unsigned char digest[SHA256_DIGEST_SIZE];
+        Checksum_hmacSHA256((const unsigned char *)credentials, (int)strlen(credentials), _authCache.key, sizeof(_authCache.key), digest);
+        long long now = Time_monotonicMilli();
+        int slot = (digest[0] | digest[1] << 8) & (AUTH_CACHE_SIZE - 1);
+        if (_authCache.initialized && _authCache.entry[slot].user && _authCache.entry[slot].expires > now && ! memcmp(_authCache.entry[slot].digest, digest, sizeof(digest))) {
+                req->remote_user = Arena_strdup(req->arena, _authCache.entry[slot].user);
+                return true;
+        }
+        bool authenticated;
+        if (Str_startsWith(credentials, "Bearer "))
+                authenticated = bearer_authenticate(req, credentials + 7);
+        else if (Str_startsWith(credentials, "Basic "))
+                authenticated = basic_authenticate(req, credentials + 6);
+        else {
+                Log_debug("HttpRequest: access denied -- client [%s]: unsupported Authorization scheme\n", NVLSTR(Socket_getRemoteHost(req->S)));
                 return false;
         }
+        if (authenticated && _authCache.initialized) {
+                FREE(_authCache.entry[slot].user);
+                memcpy(_authCache.entry[slot].digest, digest, sizeof(digest));
+                _authCache.entry[slot].user = Str_dup(req->remote_user);
+                _authCache.entry[slot].expires = now + AUTH_CACHE_TTL * 1000;
+        }
+        return authenticated;
+}
+
+
+/**
+ * Authenticate the bearer token submitted by the client
+ */
+static bool bearer_authenticate(HttpRequest req, const char *token) {
+        while (*token == ' ')
+                token++;
+        for (Auth_T c = Run.httpd.credentials; c; c = c->next) {
+                if (c->digesttype == Digest_Token && Str_compareConstantTime(token, c->passwd) == 0) {
+                        req->remote_user = Arena_strdup(req->arena, c->uname);
+                        return true;
+                }
+        }
+        Log_error("HttpRequest: access denied -- client [%s]: invalid bearer token\n", NVLSTR(Socket_getRemoteHost(req->S)));
+        return false;
+}
+
+
+/**
+ * Authenticate the basic-credentials (uname/password) submitted by
+ * the user.
+ */
+static bool basic_authenticate(HttpRequest req, const char *credentials) {
         char buf[STRLEN] = {0};
-        strncpy(buf, &credentials[6], sizeof(buf) - 1);
+        strncpy(buf, credentials, sizeof(buf) - 1);
         char uname[STRLEN] = {0};
         if (decode_base64((unsigned char *)uname, buf) <= 0) {
                 Log_debug("HttpRequest: access denied -- client [%s]: invalid Authorization header\n", NVLSTR(Socket_getRemoteHost(req->S)));
@@ -829,7 +1289,7 @@ static bool basic_authenticate(HttpRequest req) {
                 Log_error("HttpRequest: access denied -- client [%s]: wrong password for user '%s'\n", NVLSTR(Socket_getRemoteHost(req->S)), uname);
                 return false;
         }
-        req->remote_user = Str_dup(uname);
+        req->remote_user = Arena_strdup(req->arena, uname);
         return true;
 }
 
@@ -867,69 +1327,32 @@ static void internal_error(Socket_T S, int status, const char *msg) {
 
 
 /**
- * Parse request parameters from the given query string and return a
- * linked list of HttpParameters
- */
-static HttpParameter parse_parameters(char *query_string) {
-#define KEY 1
-#define VALUE 2
-        int token;
-        int cursor = 0;
-        char *key = NULL;
-        char *value = NULL;
-        HttpParameter head = NULL;
-
-        while ((token = get_next_token(query_string, &cursor, &value))) {
-                if (token == KEY)
-                        key = value;
-                else if (token == VALUE) {
-                        HttpParameter p = NULL;
-                        if (! key)
-                                goto error;
-                        NEW(p);
-                        p->name = key;
-                        p->value = Util_urlDecode(value);
-                        p->next = head;
-                        head = p;
-                        key = NULL;
-                }
-        }
-        if (key)
-                FREE(key);
-        return head;
-error:
-        FREE(key);
-        FREE(value);
-        if (head != NULL)
-                destroy_entry(head);
-        return NULL;
-}
-
-
-/**
- * A mini-scanner for tokenizing a query string
+ * Parse the name=value pairs of the query string in place. The names and
+ * values are decoded and indexed by the name hash, the parameters list
+ * keeps the request order. A pair without the value has an empty value
+ * @return false if some pair has no name
  */
-static int get_next_token(char *s, int *cursor, char **r) {
-        int i = *cursor;
-
-        while (s[*cursor]) {
-                if (s[*cursor+1] == '=') {
-                        *cursor += 1;
-                        *r = Str_ndup(&s[i], (*cursor-i));
-                        return KEY;
-                }
-                if (s[*cursor] == '=') {
-                        while (s[*cursor] && s[*cursor] != '&') *cursor += 1;
-                        if (s[*cursor] == '&') {
-                                *r = Str_ndup(&s[i+1], (*cursor-i)-1);
-                                *cursor += 1;
-                        }  else {
-                                *r = Str_ndup(&s[i+1], (*cursor-i));
-                        }
-                        return VALUE;
-                }
-                *cursor += 1;
+static bool parse_parameters(HttpRequest req, char *query_string) {
+        HttpParameter *tail = &req->params;
+        for (char *pair = query_string, *next = NULL; pair; pair = next) {
+                if ((next = strchr(pair, '&')))
+                        *next++ = 0;
+                if (! *pair)
+                        continue;
+                char *value = strchr(pair, '=');
+                if (value)
+                        *value++ = 0;
+                if (! *pair)
+                        return false;
+                HttpParameter p = Arena_calloc(req->arena, 1, sizeof(*p));
+                p->name = Util_urlDecode(pair);
+                p->value = value ? Util_urlDecode(value) : pair + strlen(pair);
+                unsigned slot = _hash(p->name);
+                p->chain = req->paramIndex[slot];
+                req->paramIndex[slot] = p;
+                *tail = p;
+                tail = &p->next;
         }
-        return 0;
+        return true;
 }
 
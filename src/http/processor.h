@@ -32,11 +32,15 @@
 #include "monit.h"
 #include "httpstatus.h"
 
+// libmonit
+#include "system/Arena.h"
+
 /* Server masquerade */
 #define SERVER_NAME        "monit"
 #define SERVER_VERSION     VERSION
 #define SERVER_URL         "http://mmonit.com/monit/"
 #define SERVER_PROTOCOL    "HTTP/1.0"
+#define SERVER_PROTOCOL11  "HTTP/1.1"
 #define DATEFMT             "%a, %d %b %Y %H:%M:%S GMT"
 
 /* Protocol methods supported */
@@ -46,18 +50,46 @@
 
 /* Initial buffer sizes */
 #define STRLEN             256
-#define REQ_STRLEN         1024
 #define RES_STRLEN         2048
 #define MAX_URL_LENGTH     512
 
+/* Block size of the request arena, which holds the request head and the headers and parameters [B] */
+#define REQ_ARENA_SIZE     16384
+
+/* Maximum size of the request line and the headers [B] and the maximum number of the headers */
+#define REQ_HEAD_LIMIT     8192
+#define REQ_MAX_HEADERS    64
+
+/* Number of the hash table slots for the request headers and parameters lookup (power of 2) */
+#define REQ_TABLE_SIZE     32
+
 /* Request timeout in seconds */
 #define REQUEST_TIMEOUT    30
 
+/* The body rendered by the response writer is sent in chunks when the buffered output reaches this size [B] (HTTP/1.1 clients only) */
+#define RESPONSE_CHUNK     65536
+
+/* Responses smaller than this size [B] are not compressed */
+#define COMPRESS_THRESHOLD 1024
+
+/* The URL and the maximum size of the M/Monit message posted by a downstream monit to the relay [B] */
+#define COLLECTOR_URL      "/collector"
+#define COLLECTOR_LIMIT    16777216
+
+/* Number of the verified Authorization headers cached (power of 2) and their time to live [s] */
+#define AUTH_CACHE_SIZE    64
+#define AUTH_CACHE_TTL     30
+
+/* Persistent connection idle timeout in seconds and maximum number of requests */
+#define KEEPALIVE_TIMEOUT  5
+#define KEEPALIVE_REQUESTS 100
+
 struct entry {
         char *name;
         char *value;
         /* For internal use */
         struct entry *next;
+        struct entry *chain;          /**< Next request entry in the hash slot */
 };
 
 
@@ -73,9 +105,13 @@ typedef struct request {
         char *protocol;
         char *pathinfo;
         char *remote_user;
-        HttpHeader headers;
-        HttpParameter params;
+        HttpHeader headers[REQ_TABLE_SIZE];       /**< Headers by the name hash */
+        HttpParameter params;          /**< Parameters in the request order */
+        HttpParameter paramIndex[REQ_TABLE_SIZE];  /**< Parameters by the name hash */
+        char *content;      /**< The M/Monit message posted to the relay or NULL */
+        int content_length;
         Ssl_T ssl;
+        Arena_T arena;
 } *HttpRequest;
 
 
@@ -89,11 +125,29 @@ typedef struct response {
         StringBuffer_T outputbuffer;
         MD_T token;
         Ssl_T ssl;
+        bool keepalive;
+        bool is_complete;           /**< The headers were sent by start_stream() */
+        struct {
+                int fd;                      /**< The file set by set_file() or -1 */
+                off_t offset;
+                off_t length;
+        } file;
+        bool is_detached;       /**< The connection was handed over by the cervlet */
+        void (*writer)(struct request *, struct response *); /**< The body writer set by set_writer() or NULL */
+        bool can_stream;               /**< The writer may send the body in chunks */
+        bool is_streaming;             /**< The headers and some chunks were sent */
 } *HttpResponse;
 
 
+typedef enum {
+        Processor_Close = 0,              /**< The connection should be closed */
+        Processor_KeepAlive,          /**< The connection is kept for the next request */
+        Processor_Detached          /**< The connection is owned by the cervlet now */
+} Processor_Result;
+
+
 /* Public prototypes */
-void *http_processor(Socket_T);
+Processor_Result http_processor(Socket_T, bool);
 char *get_headers(HttpResponse res);
 void set_status(HttpResponse res, int status);
 const char *get_status_string(int status_code);
@@ -102,8 +156,13 @@ void set_content_type(HttpResponse res, const char *mime);
 const char *get_header(HttpRequest req, const char *header_name);
 StringBuffer_T escapeHTML(StringBuffer_T sb, const char *s);
 void send_error(HttpRequest, HttpResponse, int status, const char *message, ...) __attribute__((format (printf, 4, 5)));
+void set_file(HttpResponse res, int fd, off_t offset, off_t length);
+void set_writer(HttpResponse res, void (*writer)(HttpRequest, HttpResponse));
+void flush_response(HttpResponse res);
+bool start_stream(HttpResponse res);
 const char *get_parameter(HttpRequest req, const char *parameter_name);
 void set_header(HttpResponse res, const char *name, const char *value, ...) __attribute__((format (printf, 3, 4)));
 void Processor_setHttpPostLimit(void);
+void Processor_flushCredentials(void);
 
 #endif
@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "monit.h"
+#include "rpc.h"
+
+// libmonit
+#include "exceptions/AssertException.h"
+#include "exceptions/IOException.h"
+
+
+/**
+ *  Implementation of the control RPC
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define RPC_MAGIC "MRPC"
+#define RPC_MAGIC_LENGTH 4
+#define RPC_VERSION 1
+
+// The peer credentials of the unix socket connection are available
+#if (defined(LINUX) && defined(SO_PEERCRED)) || defined(HAVE_GETPEEREID)
+#define RPC_SUPPORTED 1
+#endif
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _putShort(StringBuffer_T B, int value) {
+        unsigned char bytes[2] = {(value >> 8) & 0xff, value & 0xff};
+        StringBuffer_appendBytes(B, bytes, 2);
+}
+
+
+#ifdef RPC_SUPPORTED
+
+
+static int _getShort(const unsigned char *bytes) {
+        return bytes[0] << 8 | bytes[1];
+}
+
+
+/**
+ * Read exactly length bytes, the socket read returns what is available
+ * @return true if all bytes were read, false on EOF or error
+ */
+static bool _read(Socket_T S, void *data, int length) {
+        for (int n = 0; n < length;) {
+                int rv = Socket_read(S, (unsigned char *)data + n, length - n);
+                if (rv <= 0)
+                        return false;
+                n += rv;
+        }
+        return true;
+}
+
+
+/**
+ * Test if the action can be requested by the command line client
+ */
+static bool _isAction(Action_Type action) {
+        switch (action) {
+                case Action_Start:
+                case Action_Stop:
+                case Action_Restart:
+                case Action_Monitor:
+                case Action_Unmonitor:
+                        return true;
+                default:
+                        return false;
+        }
+}
+
+
+static bool _putEntry(StringBuffer_T B, Select_Type type, const char *name) {
+        int length = (int)strlen(name);
+        if (length > 65535)
+                return false;
+        StringBuffer_appendBytes(B, (unsigned char []){type}, 1);
+        _putShort(B, length);
+        StringBuffer_appendBytes(B, name, length);
+        return true;
+}
+
+
+static bool _getPeerUid(int socket, uid_t *uid) {
+#if defined(LINUX) && defined(SO_PEERCRED)
+        struct ucred cred;
+        socklen_t length = sizeof(cred);
+        if (getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &cred, &length) == 0) {
+                *uid = cred.uid;
+                return true;
+        }
+#else
+        gid_t gid;
+        if (getpeereid(socket, uid, &gid) == 0)
+                return true;
+#endif
+        return false;
+}
+
+
+/**
+ * The peer may control the daemon if it runs as root, as the daemon user or as the owner of the unix socket set by 'set httpd unixsocket ... uid'
+ */
+static bool _authenticate(Socket_T S) {
+        uid_t uid;
+        if (! _getPeerUid(Socket_getSocket(S), &uid)) {
+                Log_error("RPC: cannot get the peer credentials -- %s\n", STRERROR);
+                return false;
+        }
+        if (uid == 0 || uid == geteuid() || ((Run.httpd.flags & Httpd_UnixUid) && uid == (uid_t)Run.httpd.socket.unix.uid))
+                return true;
+        // Not an error, the client falls back to the HTTP interface with the basic authentication
+        DEBUG("RPC: access denied -- peer uid %d\n", (int)uid);
+        return false;
+}
+
+
+/**
+ * Read the entries and select the services
+ * @return Rpc_Ok if all entries matched some service, otherwise the type
+ * and the name of the failed entry are left in type and name
+ */
+static Rpc_Status _readServices(Socket_T S, int count, List_T services, Select_Type *type, char name[65536]) {
+        for (int i = 0; i < count; i++) {
+                unsigned char entry[3];
+                if (! _read(S, entry, 3) || entry[0] > Select_Group)
+                        return Rpc_Invalid;
+                *type = entry[0];
+                int n = _getShort(entry + 1);
+                if (! _read(S, name, n))
+                        return Rpc_Invalid;
+                name[n] = 0;
+                if (! Util_selectServices(services, *type, name))
+                        return Rpc_NotFound;
+        }
+        return Rpc_Ok;
+}
+
+
+#endif
+
+
+static void _reply(Socket_T S, Rpc_Status status, const char *message, ...) __attribute__((format (printf, 3, 4)));
+static void _reply(Socket_T S, Rpc_Status status, const char *message, ...) {
+        char text[STRLEN];
+        va_list ap;
+        va_start(ap, message);
+        vsnprintf(text, sizeof(text), message, ap);
+        va_end(ap);
+        StringBuffer_T B = StringBuffer_create(STRLEN);
+        StringBuffer_appendBytes(B, RPC_MAGIC, RPC_MAGIC_LENGTH);
+        StringBuffer_appendBytes(B, (unsigned char []){status}, 1);
+        _putShort(B, (int)strlen(text));
+        StringBuffer_appendBytes(B, text, (int)strlen(text));
+        if (Socket_write(S, StringBuffer_toString(B), StringBuffer_length(B)) < 0)
+                DEBUG("RPC: cannot send the response -- %s\n", STRERROR);
+        StringBuffer_free(&B);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool Rpc_isRequest(Socket_T S) {
+        ASSERT(S);
+#ifdef RPC_SUPPORTED
+        int length;
+        const void *data = Socket_peek(S, &length);
+        return data && length >= RPC_MAGIC_LENGTH && memcmp(data, RPC_MAGIC, RPC_MAGIC_LENGTH) == 0;
+#else
+        return false;
+#endif
+}
+
+
+void Rpc_process(Socket_T S) {
+        ASSERT(S);
+#ifdef RPC_SUPPORTED
+        unsigned char header[RPC_MAGIC_LENGTH + 4];
+        if (! _read(S, header, sizeof(header)) || memcmp(header, RPC_MAGIC, RPC_MAGIC_LENGTH) || header[4] != RPC_VERSION) {
+                _reply(S, Rpc_Invalid, "Invalid request");
+                return;
+        }
+        if (! _authenticate(S)) {
+                _reply(S, Rpc_Denied, "Access denied");
+                return;
+        }
+        Action_Type action = header[5];
+        int count = _getShort(header + 6);
+        if (! _isAction(action) || count == 0) {
+                _reply(S, Rpc_Invalid, "Invalid action");
+                return;
+        }
+        char *name = ALLOC(65536);
+        Select_Type type = Select_Service;
+        List_T services = List_new();
+        Rpc_Status status = _readServices(S, count, services, &type, name);
+        if (status == Rpc_NotFound) {
+                _reply(S, status, type == Select_Group ? "Group '%s' not found" : type == Select_Pattern ? "No service matches '%s'" : "There is no service named \"%s\"", name);
+        } else if (status != Rpc_Ok) {
+                _reply(S, status, "Invalid request");
+        } else {
+                // All entries were resolved, schedule the action for all services at once
+                for (list_t e = services->head; e; e = e->next) {
+                        Service_T s = e->e;
+                        // The service selected by more entries is logged once
+                        if (s->doaction != action) {
+                                s->doaction = action;
+                                Log_info("'%s' %s on user request\n", s->name, actionnames[action]);
+                        }
+                }
+                Run.flags |= Run_ActionPending;
+                do_wakeupcall();
+                _reply(S, Rpc_Ok, "OK");
+        }
+        List_free(&services);
+        FREE(name);
+#else
+        _reply(S, Rpc_Unavailable, "Not supported");
+#endif
+}
+
+
+Rpc_Status Rpc_action(Action_Type action, const char *group, List_T services) {
+        ASSERT(services);
+#ifdef RPC_SUPPORTED
+        int count = services->length + (group ? 1 : 0);
+        if (! (Run.httpd.flags & Httpd_Unix) || count == 0 || count > 65535)
+                return Rpc_Unavailable;
+        StringBuffer_T B = StringBuffer_create(STRLEN);
+        StringBuffer_appendBytes(B, RPC_MAGIC, RPC_MAGIC_LENGTH);
+        StringBuffer_appendBytes(B, (unsigned char []){RPC_VERSION, action}, 2);
+        _putShort(B, count);
+        bool valid = group ? _putEntry(B, Select_Group, group) : true;
+        for (list_t s = services->head; valid && s; s = s->next)
+                valid = _putEntry(B, Util_getSelectType(s->e), s->e);
+        if (! valid) {
+                StringBuffer_free(&B);
+                return Rpc_Unavailable;
+        }
+        volatile Rpc_Status status = Rpc_Unavailable;
+        Socket_T S = Socket_createUnix(Run.httpd.socket.unix.path, Socket_Tcp, Run.limits.networkTimeout);
+        if (S) {
+                TRY
+                {
+                        unsigned char header[RPC_MAGIC_LENGTH + 3];
+                        if (Socket_write(S, StringBuffer_toString(B), StringBuffer_length(B)) < 0)
+                                THROW(IOException, "Monit: cannot send command to the monit daemon -- %s", STRERROR);
+                        // The daemon without the RPC support responds with a HTTP error
+                        if (_read(S, header, sizeof(header)) && memcmp(header, RPC_MAGIC, RPC_MAGIC_LENGTH) == 0) {
+                                char message[STRLEN] = {};
+                                int length = MIN(_getShort(header + 5), (int)sizeof(message) - 1);
+                                if (! _read(S, message, length))
+                                        THROW(IOException, "Monit: cannot read the response from the monit daemon");
+                                switch (header[4]) {
+                                        case Rpc_Ok:
+                                                status = Rpc_Ok;
+                                                break;
+                                        case Rpc_Denied:
+                                        case Rpc_Unavailable:
+                                                // Let the HTTP interface authenticate the user
+                                                break;
+                                        default:
+                                                status = header[4];
+                                                Log_error("%s\n", message);
+                                                break;
+                                }
+                        }
+                }
+                ELSE
+                {
+                        Log_error("%s\n", Exception_frame.message);
+                        status = Rpc_Invalid;
+                }
+                END_TRY;
+                Socket_free(&S);
+        }
+        StringBuffer_free(&B);
+        return status;
+#else
+        return Rpc_Unavailable;
+#endif
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef RPC_H
+#define RPC_H
+
+
+/**
+ *  The control RPC: a compact binary request to run an action on a list
+ *  of services, groups and service name patterns, sent by the CLI to the daemon over the httpd unix socket.
+ *  The client is authenticated by the peer credentials of the unix socket
+ *  connection instead of the HTTP basic authentication, and any number of
+ *  services is handled in one request.
+ *
+ *  The request and the response start with the "MRPC" magic, the numbers
+ *  are in the network byte order:
+ *
+ *    request:  magic[4] version[1] action[1] count[2] {type[1] length[2] name[length]}*count
+ *    response: magic[4] status[1] length[2] message[length]
+ *
+ *  The entry type is the Select_Type of the name: a service name, a glob
+ *  pattern or a group name. The daemon resolves all entries before the
+ *  action is scheduled, so the request is applied either completely or
+ *  not at all.
+ *
+ *  The daemon which doesn't know the RPC responds with a HTTP error, the
+ *  client then falls back to the HTTP interface.
+ *
+ *  @file
+ */
+
+
+typedef enum {
+        Rpc_Ok = 0,
+        Rpc_Denied,                 /**< The peer is not allowed to control the daemon */
+        Rpc_Invalid,                                    /**< Malformed request */
+        Rpc_NotFound,         /**< Unknown service, group or unmatched pattern */
+        Rpc_Unavailable     /**< RPC not supported, the caller should use HTTP */
+} __attribute__((__packed__)) Rpc_Status;
+
+
+/**
+ * Test if the request pending on the connection is a control RPC
+ * @param S The accepted unix socket connection
+ * @return true if the connection starts with the RPC magic
+ */
+bool Rpc_isRequest(Socket_T S);
+
+
+/**
+ * Read the control RPC request, authenticate the peer, schedule the action
+ * and send the response
+ * @param S The accepted unix socket connection
+ */
+void Rpc_process(Socket_T S);
+
+
+/**
+ * Send the action request for the services to the daemon over the httpd
+ * unix socket. An error reported by the daemon is logged
+ * @param action The action
+ * @param group Optional group name, may be NULL
+ * @param services List of service names or glob patterns
+ * @return The status, Rpc_Unavailable if the RPC cannot be used and the
+ * caller should fall back to the HTTP interface
+ */
+Rpc_Status Rpc_action(Action_Type action, const char *group, List_T services);
+
+
+#endif
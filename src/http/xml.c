@@ -57,6 +57,7 @@
 #include "event.h"
 #include "ProcessTree.h"
 #include "protocol.h"
+#include "ServiceStatus.h"
 
 
 /**
@@ -75,12 +76,11 @@
  * @param buf String to escape
  */
 static void _escapeCDATA(StringBuffer_T B, const char *buf) {
-        for (int i = 0; buf[i]; i++) {
-                if (buf[i] == '>' && i > 1 && (buf[i - 1] == ']' && buf[i - 2] == ']'))
-                        StringBuffer_append(B, "&gt;");
-                else
-                        StringBuffer_append(B, "%c", buf[i]);
+        for (const char *end; (end = strstr(buf, "]]>")); buf = end + 3) {
+                StringBuffer_appendBytes(B, buf, (int)(end - buf));
+                StringBuffer_appendString(B, "]]&gt;");
         }
+        StringBuffer_appendString(B, buf);
 }
 
 
@@ -219,10 +219,12 @@ static void status_service(Service_T S, StringBuffer_T B, int V) {
                             S->doaction);
         if (S->every.type != Every_Cycle) {
                 StringBuffer_append(B, "<every><type>%d</type>", S->every.type);
-                if (S->every.type == 1)
+                if (S->every.type == Every_SkipCycles)
                         StringBuffer_append(B, "<counter>%d</counter><number>%d</number>", S->every.spec.cycle.counter, S->every.spec.cycle.number);
+                else if (S->every.type == Every_Interval)
+                        StringBuffer_append(B, "<interval>%d</interval>", S->every.spec.interval);
                 else
-                        StringBuffer_append(B, "<cron>%s</cron>", S->every.spec.cron);
+                        StringBuffer_append(B, "<cron>%s</cron>", S->every.spec.cron.string);
                 StringBuffer_append(B, "</every>");
         }
         if (Util_hasServiceStatus(S)) {
@@ -277,6 +279,18 @@ static void status_service(Service_T S, StringBuffer_T B, int V) {
                                         S->inf.directory->timestamp.access,
                                         S->inf.directory->timestamp.change,
                                         S->inf.directory->timestamp.modify);
+                                if (S->inf.directory->tree.collected)
+                                        StringBuffer_append(B,
+                                                "<tree>"
+                                                "<size>%llu</size>"
+                                                "<files>%llu</files>"
+                                                "<oldest>%llu</oldest>"
+                                                "<newest>%llu</newest>"
+                                                "</tree>",
+                                                S->inf.directory->tree.size,
+                                                S->inf.directory->tree.files,
+                                                (unsigned long long)S->inf.directory->tree.oldest,
+                                                (unsigned long long)S->inf.directory->tree.newest);
                                 break;
 
                         case Service_Fifo:
@@ -611,6 +625,42 @@ static void status_event(Event_T E, StringBuffer_T B) {
 }
 
 
+/**
+ * Compute the digest of the service status, the collection timestamp is not included as it changes every cycle
+ * @param status The XML formatted service status
+ * @return The status digest
+ */
+static uint64_t _serviceDigest(const char *status) {
+        uint64_t hash = 14695981039346656037ULL; // FNV-1a
+        const char *skip = strstr(status, "<collected_sec>");
+        const char *resume = skip ? strstr(skip, "</collected_usec>") : NULL;
+        for (const char *p = status; *p; p++) {
+                if (p == skip && resume) {
+                        p = resume + strlen("</collected_usec>") - 1;
+                        continue;
+                }
+                hash ^= (unsigned char)*p;
+                hash *= 1099511628211ULL;
+        }
+        return hash;
+}
+
+
+/**
+ * Append the XML status of the service, the fragment cached with the service status snapshot is used if the service
+ * didn't publish a new status since it was rendered
+ */
+static void _statusService(ServiceStatus_T status, Service_T s, StringBuffer_T B, int V) {
+        Service_T S = ServiceStatus_get(status, s);
+        StatusFormat_Type format = V == 2 ? StatusFormat_Xml2 : StatusFormat_Xml1;
+        if (! ServiceStatus_getFragment(status, format, B)) {
+                int start = StringBuffer_length(B);
+                status_service(S, B, V);
+                ServiceStatus_setFragment(status, format, StringBuffer_toString(B) + start, StringBuffer_length(B) - start);
+        }
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -624,12 +674,14 @@ static void status_event(Event_T E, StringBuffer_T B) {
 void status_xml(StringBuffer_T B, Event_T E, int V, const char *myip) {
         Service_T S;
         ServiceGroup_T SG;
+        ServiceStatus_T status = ServiceStatus_new();
 
         document_head(B, V, myip);
         if (V == 2)
                 StringBuffer_append(B, "<services>");
         for (S = servicelist_conf; S; S = S->next_conf)
-                status_service(S, B, V);
+                _statusService(status, S, B, V);
+        ServiceStatus_delete(&status);
         if (V == 2) {
                 StringBuffer_append(B, "</services><servicegroups>");
                 for (SG = servicegrouplist; SG; SG = SG->next)
@@ -641,3 +693,47 @@ void status_xml(StringBuffer_T B, Event_T E, int V, const char *myip) {
         document_foot(B);
 }
 
+
+/**
+ * Get a XML formatted general status message with the services whose
+ * status changed since the last message. The digests array holds the
+ * status digest of each service (in the configuration order) sent last
+ * time and is updated with the current digests.
+ * @param V Format version
+ * @param myip The client-side IP address
+ * @param digests The service status digests
+ * @param count The number of digests, must match the number of services
+ * @param full true to send all services
+ * @return The number of services in the message
+ */
+int status_xml_changes(StringBuffer_T B, int V, const char *myip, uint64_t *digests, int count, bool full) {
+        int i = 0, changed = 0;
+        StringBuffer_T service = StringBuffer_create(256);
+        ServiceStatus_T status = ServiceStatus_new();
+        document_head(B, V, myip);
+        if (V == 2)
+                StringBuffer_append(B, "<services>");
+        for (Service_T S = servicelist_conf; S && i < count; S = S->next_conf, i++) {
+                StringBuffer_clear(service);
+                _statusService(status, S, service, V);
+                uint64_t digest = _serviceDigest(StringBuffer_toString(service));
+                if (full || digest != digests[i]) {
+                        StringBuffer_append(B, "%s", StringBuffer_toString(service));
+                        digests[i] = digest;
+                        changed++;
+                }
+        }
+        if (V == 2) {
+                StringBuffer_append(B, "</services>");
+                if (full) {
+                        StringBuffer_append(B, "<servicegroups>");
+                        for (ServiceGroup_T SG = servicegrouplist; SG; SG = SG->next)
+                                status_servicegroup(SG, B);
+                        StringBuffer_append(B, "</servicegroups>");
+                }
+        }
+        document_foot(B);
+        StringBuffer_free(&service);
+        ServiceStatus_delete(&status);
+        return changed;
+}
@@ -68,10 +68,24 @@
 #include <sys/stat.h>
 #endif
 
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#include <poll.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+
 #include "monit.h"
+#include "event.h"
 
 // libmonit
 #include "system/Time.h"
+#include "exceptions/AssertException.h"
 
 
 /**
@@ -79,6 +93,18 @@
  *  with a preceding timestamp. Methods support both syslog or own
  *  logfile.
  *
+ *  The daemon logs asynchronously once Log_start() was called: the
+ *  caller formats the record into a bounded lock-free queue and a writer
+ *  thread writes the queued records in batches. If the queue is full the
+ *  record is dropped and counted, the writer logs the number of dropped
+ *  records. Critical and higher priority messages flush the queue and
+ *  are written synchronously.
+ *
+ *  The record is either the text line or a JSON object (set log ...
+ *  format json). Identical messages can be limited per minute (set log
+ *  ... repeat <n> times per minute), the number of suppressed messages
+ *  is logged with the next identical message in the following minute.
+ *
  *  @file
  */
 
@@ -86,8 +112,61 @@
 /* ------------------------------------------------------------- Definitions */
 
 
+#define LOG_QUEUE_SIZE  512  /**< Number of records in the queue, must be a power of 2 */
+#define LOG_RECORD_SIZE 256  /**< Record buffer size, a longer record is allocated */
+#define LOG_SAMPLES     64   /**< Number of the distinct messages tracked by the sampling */
+#if defined(IOV_MAX) && IOV_MAX < 64
+#define LOG_BATCH IOV_MAX
+#else
+#define LOG_BATCH 64         /**< Maximum number of records written at once */
+#endif
+
+
+typedef struct LogMessage_T {
+        int priority;
+        int length;
+        int suppressed;            /**< Number of suppressed identical messages, -1 if this one is suppressed */
+        const char *service;
+        Event_T event;
+        char *text;                /**< The formatted message */
+} *LogMessage_T;
+
+
+typedef struct LogRecord_T {
+        atomic_size_t sequence;    /**< The queue position the record is free/ready for */
+        int priority;
+        int prefix;                /**< Length of the timestamp and priority prefix */
+        int length;
+        char *data;                /**< The record text, the buffer or allocated memory */
+        char buffer[LOG_RECORD_SIZE];
+} *LogRecord_T;
+
+
 static FILE *_LOG = NULL;
 static Mutex_T _mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+        bool enabled;                           /**< Log_start() was called */
+        atomic_bool running;                    /**< The writer thread is running */
+        atomic_bool sleeping;                   /**< The writer waits for a wakeup */
+        atomic_bool stalled;                    /**< The queue was full and the writer did not catch up */
+        atomic_size_t tail;                     /**< The next position to produce */
+        atomic_size_t written;                  /**< The next position to write */
+        atomic_ullong dropped;                  /**< Number of dropped records */
+        int wakeup[2];                          /**< Wakeup pipe of the writer */
+        Thread_T thread;
+        struct LogRecord_T *queue;
+} _async = {.wakeup = {-1, -1}};
+typedef struct LogSample_T {
+        unsigned long long key;                 /**< Hash of the message */
+        long long window;                       /**< The minute of the counters */
+        int count;
+        int suppressed;
+} LogSample_T;
+static struct {
+        Mutex_T mutex;
+        LogSample_T entries[LOG_SAMPLES];
+} _sampling = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+static __thread char _scratch[1024];
 
 
 static struct mylogpriority {
@@ -147,36 +226,426 @@ static const char *_priorityDescription(int p) {
 
 
 /**
- * Log a message to monits logfile or syslog.
- * @param priority A message priority
- * @param s A formatted (printf-style) string to log
+ * Format the message into the thread local scratch buffer, a longer message is allocated
  */
 __attribute__((format (printf, 2, 0)))
-static void _log(int priority, const char *s, va_list ap) {
-        ASSERT(s);
+static void _message(LogMessage_T m, const char *s, va_list ap) {
         va_list ap_copy;
-        LOCK(_mutex)
-        {
-
-                FILE *output = priority < LOG_INFO ? stderr : stdout;
+        va_copy(ap_copy, ap);
+        m->length = vsnprintf(_scratch, sizeof(_scratch), s, ap_copy);
+        va_end(ap_copy);
+        m->length = MAX(m->length, 0);
+        m->text = _scratch;
+        if (m->length >= (int)sizeof(_scratch)) {
+                m->text = ALLOC(m->length + 1);
                 va_copy(ap_copy, ap);
-                vfprintf(output, s, ap_copy);
+                vsnprintf(m->text, m->length + 1, s, ap_copy);
                 va_end(ap_copy);
-                fflush(output);
-                if (Run.flags & Run_Log) {
-                        if (Run.flags & Run_UseSyslog) {
-                                va_copy(ap_copy, ap);
-                                vsyslog(priority, s, ap_copy);
-                                va_end(ap_copy);
-                        } else if (_LOG) {
-                                fprintf(_LOG, "[%s] %-8s : ", Time_fmt((char[STRLEN]){}, STRLEN, TIMEFORMAT, Time_now()), _priorityDescription(priority));
-                                va_copy(ap_copy, ap);
-                                vfprintf(_LOG, s, ap_copy);
-                                va_end(ap_copy);
-                        }
+        }
+}
+
+
+/**
+ * Rate based sampling of identical messages: at most Run.logrepeat identical messages are logged per minute.
+ * Returns -1 if the message should be suppressed, otherwise the number of messages suppressed in the previous
+ * minute
+ */
+static int _sample(LogMessage_T m) {
+        int rv = 0;
+        unsigned long long key = 14695981039346656037ULL;
+        for (const unsigned char *t = (const unsigned char *)m->text; *t; t++)
+                key = (key ^ *t) * 1099511628211ULL;
+        if (m->service)
+                for (const unsigned char *t = (const unsigned char *)m->service; *t; t++)
+                        key = (key ^ *t) * 1099511628211ULL;
+        long long window = Time_monotonicMilli() / 60000;
+        LOCK(_sampling.mutex)
+        {
+                LogSample_T *e = &_sampling.entries[key % LOG_SAMPLES];
+                if (e->key != key) {
+                        *e = (LogSample_T){.key = key, .window = window, .count = 1};
+                } else if (e->window != window) {
+                        rv = e->suppressed;
+                        e->window = window;
+                        e->count = 1;
+                        e->suppressed = 0;
+                } else if (e->count < Run.logrepeat) {
+                        e->count++;
+                } else {
+                        e->suppressed++;
+                        rv = -1;
                 }
         }
         END_LOCK;
+        return rv;
+}
+
+
+static const char *_stateDescription(State_Type state) {
+        switch (state) {
+                case State_Succeeded:
+                        return "succeeded";
+                case State_Failed:
+                        return "failed";
+                case State_Changed:
+                        return "changed";
+                case State_ChangedNot:
+                        return "changed not";
+                default:
+                        return "init";
+        }
+}
+
+
+/**
+ * Write the JSON string to d, which must have space for 6 bytes per input byte plus 2. Returns the end of the string
+ */
+static char *_jsonString(char *d, const char *s, int length) {
+        static const char hex[] = "0123456789abcdef";
+        *d++ = '"';
+        for (int i = 0; i < length; i++) {
+                unsigned char c = s[i];
+                if (c == '"' || c == '\\') {
+                        *d++ = '\\';
+                        *d++ = c;
+                } else if (c == '\n') {
+                        *d++ = '\\';
+                        *d++ = 'n';
+                } else if (c < 0x20) {
+                        memcpy(d, "\\u00", 4);
+                        d += 4;
+                        *d++ = hex[c >> 4];
+                        *d++ = hex[c & 0xf];
+                } else {
+                        *d++ = c;
+                }
+        }
+        *d++ = '"';
+        return d;
+}
+
+
+/**
+ * Format a log record: the timestamp and priority prefix followed by the message, or the JSON object if the
+ * JSON log format is set
+ */
+static void _format(LogRecord_T r, LogMessage_T m) {
+        char timestamp[STRLEN];
+        const char *priority = _priorityDescription(m->priority);
+        Time_fmt(timestamp, STRLEN, TIMEFORMAT, Time_now());
+        r->priority = m->priority;
+        r->data = r->buffer;
+        if (Run.flags & Run_LogJson) {
+                const char *message = m->event ? m->event->message : m->text;
+                int length = m->event ? (int)strlen(message) : m->length;
+                if (length && message[length - 1] == '\n')
+                        length--;
+                int service = m->service ? (int)strlen(m->service) : 0;
+                // The upper bound of the record size, the JSON string escape can expand a byte to 6 bytes
+                size_t size = 192 + strlen(timestamp) + 6 * (length + service) + (m->event ? strlen(NVLSTR(Event_get_description(m->event))) * 6 : 0);
+                if (size > sizeof(r->buffer))
+                        r->data = ALLOC(size);
+                char *d = r->data;
+                d += sprintf(d, "{\"time\":\"%s\",\"priority\":\"%s\"", timestamp, priority);
+                if (m->service) {
+                        memcpy(d, ",\"service\":", 11);
+                        d += 11;
+                        d = _jsonString(d, m->service, service);
+                }
+                if (m->event) {
+                        const char *description = NVLSTR(Event_get_description(m->event));
+                        d += sprintf(d, ",\"event\":%ld,\"state\":\"%s\",\"description\":", m->event->id, _stateDescription(m->event->state));
+                        d = _jsonString(d, description, (int)strlen(description));
+                }
+                memcpy(d, ",\"message\":", 11);
+                d += 11;
+                d = _jsonString(d, message, length);
+                if (m->suppressed)
+                        d += sprintf(d, ",\"suppressed\":%d", m->suppressed);
+                memcpy(d, "}\n", 3);
+                d += 2;
+                r->prefix = 0;
+                r->length = (int)(d - r->data);
+        } else {
+                char suppressed[64] = "";
+                int length = m->length;
+                if (m->suppressed) {
+                        // Append the note before the newline
+                        if (length && m->text[length - 1] == '\n')
+                                length--;
+                        snprintf(suppressed, sizeof(suppressed), " [%d identical messages suppressed]\n", m->suppressed);
+                }
+                r->prefix = snprintf(r->buffer, sizeof(r->buffer), "[%s] %-8s : ", timestamp, priority);
+                r->prefix = MIN(r->prefix, (int)sizeof(r->buffer) - 1);
+                int extra = (int)strlen(suppressed);
+                r->length = r->prefix + length + extra;
+                if (r->length >= (int)sizeof(r->buffer)) {
+                        r->data = ALLOC(r->length + 1);
+                        memcpy(r->data, r->buffer, r->prefix);
+                }
+                memcpy(r->data + r->prefix, m->text, length);
+                memcpy(r->data + r->prefix + length, suppressed, extra + 1);
+        }
+}
+
+
+static void _wakeup(void) {
+        if (atomic_exchange(&_async.sleeping, false)) {
+                ssize_t n = write(_async.wakeup[1], "", 1);
+                (void)n;
+        }
+}
+
+
+/**
+ * Add the record to the queue (multiple producers). If the queue is full, wait up to 1ms for the writer, unless
+ * the writer is stalled already. Returns false if the record was dropped
+ */
+static bool _enqueue(LogMessage_T m) {
+        LogRecord_T r;
+        int wait = 0;
+        size_t position = atomic_load_explicit(&_async.tail, memory_order_relaxed);
+        while (true) {
+                r = &_async.queue[position & (LOG_QUEUE_SIZE - 1)];
+                long long delta = (long long)atomic_load_explicit(&r->sequence, memory_order_acquire) - (long long)position;
+                if (delta == 0) {
+                        if (atomic_compare_exchange_weak_explicit(&_async.tail, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+                                break;
+                } else if (delta < 0) {
+                        if (wait++ == 20 || atomic_load_explicit(&_async.stalled, memory_order_relaxed)) {
+                                atomic_store_explicit(&_async.stalled, true, memory_order_relaxed);
+                                atomic_fetch_add_explicit(&_async.dropped, 1, memory_order_relaxed);
+                                return false;
+                        }
+                        _wakeup();
+                        Time_usleep(50);
+                        position = atomic_load_explicit(&_async.tail, memory_order_relaxed);
+                } else {
+                        position = atomic_load_explicit(&_async.tail, memory_order_relaxed);
+                }
+        }
+        _format(r, m);
+        atomic_store_explicit(&r->sequence, position + 1, memory_order_release);
+        _wakeup();
+        return true;
+}
+
+
+static void _writev(int fd, struct iovec *iov, int count) {
+        while (count > 0) {
+                ssize_t n = writev(fd, iov, count);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return;
+                }
+                while (count > 0 && (size_t)n >= iov->iov_len) {
+                        n -= iov->iov_len;
+                        iov++;
+                        count--;
+                }
+                if (count > 0) {
+                        iov->iov_base = (char *)iov->iov_base + n;
+                        iov->iov_len -= n;
+                }
+        }
+}
+
+
+/**
+ * Write a batch of records to the console and to the log file or syslog
+ */
+static void _write(LogRecord_T *batch, int count) {
+        struct iovec iov[LOG_BATCH];
+        for (int i = 0; i < count; i++) {
+                fwrite(batch[i]->data + batch[i]->prefix, 1, batch[i]->length - batch[i]->prefix, batch[i]->priority < LOG_INFO ? stderr : stdout);
+                iov[i].iov_base = batch[i]->data;
+                iov[i].iov_len = batch[i]->length;
+        }
+        fflush(stdout);
+        fflush(stderr);
+        if (Run.flags & Run_Log) {
+                if (Run.flags & Run_UseSyslog) {
+                        for (int i = 0; i < count; i++)
+                                syslog(batch[i]->priority, "%s", batch[i]->data + batch[i]->prefix);
+                } else if (_LOG) {
+                        _writev(fileno(_LOG), iov, count);
+                }
+        }
+}
+
+
+static void _writeRecord(LogMessage_T m) {
+        struct LogRecord_T record;
+        LogRecord_T r = &record;
+        _format(r, m);
+        _write(&r, 1);
+        if (r->data != r->buffer)
+                FREE(r->data);
+}
+
+
+__attribute__((format (printf, 2, 3)))
+static void _writeMessage(int priority, const char *s, ...) {
+        struct LogMessage_T message = {.priority = priority};
+        va_list ap;
+        va_start(ap, s);
+        _message(&message, s, ap);
+        va_end(ap);
+        _writeRecord(&message);
+        if (message.text != _scratch)
+                FREE(message.text);
+}
+
+
+static void *_writer(__attribute__ ((unused)) void *args) {
+        int stopping = 0;
+        LogRecord_T batch[LOG_BATCH];
+        set_signal_block();
+        size_t head = atomic_load_explicit(&_async.written, memory_order_relaxed);
+        while (true) {
+                int count = 0;
+                while (count < LOG_BATCH) {
+                        LogRecord_T r = &_async.queue[(head + count) & (LOG_QUEUE_SIZE - 1)];
+                        if (atomic_load_explicit(&r->sequence, memory_order_acquire) != head + count + 1)
+                                break;
+                        batch[count++] = r;
+                }
+                if (count) {
+                        _write(batch, count);
+                        for (int i = 0; i < count; i++) {
+                                if (batch[i]->data != batch[i]->buffer)
+                                        FREE(batch[i]->data);
+                                atomic_store_explicit(&batch[i]->sequence, head + i + LOG_QUEUE_SIZE, memory_order_release);
+                        }
+                        head += count;
+                        atomic_store_explicit(&_async.written, head, memory_order_release);
+                        atomic_store_explicit(&_async.stalled, false, memory_order_relaxed);
+                        continue;
+                }
+                unsigned long long dropped = atomic_exchange_explicit(&_async.dropped, 0, memory_order_relaxed);
+                if (dropped)
+                        _writeMessage(LOG_WARNING, "%llu log messages were dropped, the log queue was full\n", dropped);
+                if (! atomic_load(&_async.running)) {
+                        // Stopping: wait for the producers which claimed a record before they saw the stop
+                        if (head == atomic_load(&_async.tail) || ++stopping > 1000)
+                                break;
+                        Time_usleep(1000);
+                        continue;
+                }
+                // Recheck the queue after the sleeping flag is set, a producer which added a record before it saw the flag is found here
+                atomic_store(&_async.sleeping, true);
+                if (atomic_load_explicit(&_async.queue[head & (LOG_QUEUE_SIZE - 1)].sequence, memory_order_seq_cst) == head + 1 || ! atomic_load(&_async.running)) {
+                        atomic_store(&_async.sleeping, false);
+                        continue;
+                }
+                char buffer[64];
+                struct pollfd fds = {.fd = _async.wakeup[0], .events = POLLIN};
+                if (poll(&fds, 1, -1) > 0 && read(_async.wakeup[0], buffer, sizeof(buffer)) < 0 && errno != EAGAIN && errno != EINTR)
+                        break;
+                atomic_store(&_async.sleeping, false);
+        }
+        return NULL;
+}
+
+
+/**
+ * Wait until the writer wrote the records queued so far
+ */
+static void _flush(void) {
+        size_t tail = atomic_load(&_async.tail);
+        for (int i = 0; i < 2000 && atomic_load_explicit(&_async.written, memory_order_acquire) < tail; i++) {
+                _wakeup();
+                Time_usleep(1000);
+        }
+}
+
+
+/**
+ * The child of fork logs synchronously, the writer thread does not exist there
+ */
+static void _asyncChild(void) {
+        atomic_store(&_async.running, false);
+        _async.enabled = false;
+}
+
+
+/**
+ * Start the writer thread. The queue is created once and kept when the writer is restarted after reload
+ */
+static void _asyncStart(void) {
+        if (! _async.queue) {
+                if (pipe(_async.wakeup) != 0) {
+                        Log_error("Cannot create the log writer pipe -- %s\n", STRERROR);
+                        return;
+                }
+                for (int i = 0; i < 2; i++) {
+                        fcntl(_async.wakeup[i], F_SETFL, fcntl(_async.wakeup[i], F_GETFL) | O_NONBLOCK);
+                        fcntl(_async.wakeup[i], F_SETFD, FD_CLOEXEC);
+                }
+                _async.queue = CALLOC(LOG_QUEUE_SIZE, sizeof(struct LogRecord_T));
+                for (size_t i = 0; i < LOG_QUEUE_SIZE; i++)
+                        atomic_init(&_async.queue[i].sequence, i);
+                pthread_atfork(NULL, NULL, _asyncChild);
+        }
+        atomic_store(&_async.running, true);
+        Thread_create(_async.thread, _writer, NULL);
+}
+
+
+static void _asyncStop(void) {
+        if (atomic_load(&_async.running)) {
+                // The synchronous writers wait on the mutex until the queued records were written
+                LOCK(_mutex)
+                {
+                        atomic_store(&_async.running, false);
+                        ssize_t n = write(_async.wakeup[1], "", 1);
+                        (void)n;
+                        Thread_join(_async.thread);
+                }
+                END_LOCK;
+        }
+}
+
+
+/**
+ * Log a message to monits logfile or syslog.
+ * @param priority A message priority
+ * @param S The service the message is about or NULL
+ * @param E The event the message is about or NULL
+ * @param s A formatted (printf-style) string to log
+ */
+__attribute__((format (printf, 4, 0)))
+static void _log(int priority, Service_T S, Event_T E, const char *s, va_list ap) {
+        ASSERT(s);
+        struct LogMessage_T message = {.priority = priority, .service = S ? S->name : NULL, .event = E};
+        _message(&message, s, ap);
+        if (Run.logrepeat && priority > LOG_CRIT)
+                message.suppressed = _sample(&message);
+        if (message.suppressed >= 0) {
+                if (atomic_load_explicit(&_async.running, memory_order_acquire) && priority > LOG_CRIT) {
+                        _enqueue(&message);
+                } else {
+                        if (atomic_load_explicit(&_async.running, memory_order_acquire))
+                                _flush();
+                        LOCK(_mutex)
+                        {
+                                _writeRecord(&message);
+                        }
+                        END_LOCK;
+                }
+        }
+        if (message.text != _scratch)
+                FREE(message.text);
+}
+
+
+__attribute__((format (printf, 4, 5)))
+static void _logEvent(int priority, Service_T S, Event_T E, const char *s, ...) {
+        va_list ap;
+        va_start(ap, s);
+        _log(priority, S, E, s, ap);
+        va_end(ap);
 }
 
 
@@ -227,10 +696,25 @@ bool Log_init() {
                 return false;
         /* Register Log_close to be called at program termination */
         atexit(Log_close);
+        if (_async.enabled)
+                _asyncStart();
         return true;
 }
 
 
+/**
+ * Switch to the asynchronous logging: the log records are written by a
+ * writer thread from now on. Must be called after daemonize(), the writer
+ * is stopped in Log_close() and started again in Log_init()
+ */
+void Log_start() {
+        if (! _async.enabled && (Run.flags & Run_Log)) {
+                _async.enabled = true;
+                _asyncStart();
+        }
+}
+
+
 /**
  * Logging interface with priority support
  * @param s A formatted (printf-style) string to log
@@ -239,7 +723,7 @@ void Log_emergency(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        _log(LOG_EMERG, s, ap);
+        _log(LOG_EMERG, NULL, NULL, s, ap);
         va_end(ap);
         _backtrace();
 }
@@ -254,7 +738,7 @@ void Log_vemergency(const char *s, va_list ap) {
         ASSERT(s);
         va_list ap_copy;
         va_copy(ap_copy, ap);
-        _log(LOG_EMERG, s, ap);
+        _log(LOG_EMERG, NULL, NULL, s, ap);
         va_end(ap_copy);
         _backtrace();
 }
@@ -268,7 +752,7 @@ void Log_alert(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        _log(LOG_ALERT, s, ap);
+        _log(LOG_ALERT, NULL, NULL, s, ap);
         va_end(ap);
         _backtrace();
 }
@@ -283,7 +767,7 @@ void Log_valert(const char *s, va_list ap) {
         ASSERT(s);
         va_list ap_copy;
         va_copy(ap_copy, ap);
-        _log(LOG_ALERT, s, ap);
+        _log(LOG_ALERT, NULL, NULL, s, ap);
         va_end(ap_copy);
         _backtrace();
 }
@@ -297,7 +781,7 @@ void Log_critical(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        _log(LOG_CRIT, s, ap);
+        _log(LOG_CRIT, NULL, NULL, s, ap);
         va_end(ap);
         _backtrace();
 }
@@ -312,7 +796,7 @@ void Log_vcritical(const char *s, va_list ap) {
         ASSERT(s);
         va_list ap_copy;
         va_copy(ap_copy, ap);
-        _log(LOG_CRIT, s, ap);
+        _log(LOG_CRIT, NULL, NULL, s, ap);
         va_end(ap_copy);
         _backtrace();
 }
@@ -326,7 +810,7 @@ void Log_abort_handler(const char *s, va_list ap) {
         ASSERT(s);
         va_list ap_copy;
         va_copy(ap_copy, ap);
-        _log(LOG_CRIT, s, ap);
+        _log(LOG_CRIT, NULL, NULL, s, ap);
         va_end(ap_copy);
         if (Run.debug)
                 abort();
@@ -342,7 +826,7 @@ void Log_error(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        _log(LOG_ERR, s, ap);
+        _log(LOG_ERR, NULL, NULL, s, ap);
         va_end(ap);
         _backtrace();
 }
@@ -357,7 +841,7 @@ void Log_verror(const char *s, va_list ap) {
         ASSERT(s);
         va_list ap_copy;
         va_copy(ap_copy, ap);
-        _log(LOG_ERR, s, ap);
+        _log(LOG_ERR, NULL, NULL, s, ap);
         va_end(ap_copy);
         _backtrace();
 }
@@ -371,7 +855,7 @@ void Log_warning(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        _log(LOG_WARNING, s, ap);
+        _log(LOG_WARNING, NULL, NULL, s, ap);
         va_end(ap);
 }
 
@@ -385,7 +869,7 @@ void Log_vwarning(const char *s, va_list ap) {
         ASSERT(s);
         va_list ap_copy;
         va_copy(ap_copy, ap);
-        _log(LOG_WARNING, s, ap);
+        _log(LOG_WARNING, NULL, NULL, s, ap);
         va_end(ap_copy);
 }
 
@@ -398,7 +882,7 @@ void Log_notice(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        _log(LOG_NOTICE, s, ap);
+        _log(LOG_NOTICE, NULL, NULL, s, ap);
         va_end(ap);
 }
 
@@ -412,7 +896,7 @@ void Log_vnotice(const char *s, va_list ap) {
         ASSERT(s);
         va_list ap_copy;
         va_copy(ap_copy, ap);
-        _log(LOG_NOTICE, s, ap);
+        _log(LOG_NOTICE, NULL, NULL, s, ap);
         va_end(ap_copy);
 }
 
@@ -425,7 +909,7 @@ void Log_info(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        _log(LOG_INFO, s, ap);
+        _log(LOG_INFO, NULL, NULL, s, ap);
         va_end(ap);
 }
 
@@ -439,7 +923,7 @@ void Log_vinfo(const char *s, va_list ap) {
         ASSERT(s);
         va_list ap_copy;
         va_copy(ap_copy, ap);
-        _log(LOG_INFO, s, ap);
+        _log(LOG_INFO, NULL, NULL, s, ap);
         va_end(ap_copy);
 }
 
@@ -453,7 +937,7 @@ void Log_debug(const char *s, ...) {
         if (Run.debug) {
                 va_list ap;
                 va_start(ap, s);
-                _log(LOG_DEBUG, s, ap);
+                _log(LOG_DEBUG, NULL, NULL, s, ap);
                 va_end(ap);
         }
 }
@@ -469,16 +953,33 @@ void Log_vdebug(const char *s, va_list ap) {
         if (Run.debug) {
                 va_list ap_copy;
                 va_copy(ap_copy, ap);
-                _log(LOG_NOTICE, s, ap);
+                _log(LOG_NOTICE, NULL, NULL, s, ap);
                 va_end(ap_copy);
         }
 }
 
 
+/**
+ * Log the message of a service event. The JSON log format includes
+ * the service name, event id and state as separate fields
+ * @param priority A message priority
+ * @param S The service
+ * @param E The event
+ */
+void Log_event(int priority, Service_T S, Event_T E) {
+        ASSERT(S);
+        ASSERT(E);
+        _logEvent(priority, S, E, "'%s' %s\n", S->name, NVLSTR(E->message));
+        if (priority <= LOG_ERR)
+                _backtrace();
+}
+
+
 /**
  * Close the log file or syslog
  */
 void Log_close() {
+        _asyncStop();
         if (Run.flags & Run_UseSyslog) {
                 closelog();
         }
@@ -74,15 +74,30 @@
 #include <sys/wait.h>
 #endif
 
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
 #include "monit.h"
 #include "ProcessTree.h"
+#include "ProcessEvent.h"
+#include "ProcessBPF.h"
+#include "ProcessSnapshot.h"
+#include "FileEvent.h"
+#include "Cluster.h"
+#include "net/Resolver.h"
 #include "state.h"
+#include "StatusFile.h"
 #include "event.h"
+#include "alert.h"
 #include "engine.h"
 #include "client.h"
 #include "MMonit.h"
+#include "Webhook.h"
+#include "Mqtt.h"
 #include "md5.h"
 #include "sha1.h"
+#include "sha256.h"
 #include "checksum.h"
 
 // libmonit
@@ -116,10 +131,12 @@ static void  do_default(void);                          /* Do default action */
 static void  handle_options(int, char **, List_T); /* Handle program options */
 static void  help(void);             /* Print program help message to stdout */
 static void  version(void);                     /* Print version information */
-static void *heartbeat(void *args);              /* M/Monit heartbeat thread */
 static void do_reload(int);             /* Signalhandler for a daemon reload */
 static void do_destroy(int);         /* Signalhandler for monit finalization */
 static void do_wakeup(int);        /* Signalhandler for a daemon wakeup call */
+#ifdef HAVE_MEMSTAT
+static void do_memoryreport(int);   /* Signalhandler for the allocation report */
+#endif
 static void waitforchildren(void); /* Wait for any child process not running */
 
 
@@ -134,28 +151,29 @@ Service_T servicelist_conf;   /**< The service list in conf file (c. in p.y) */
 ServiceGroup_T servicegrouplist;/**< The service group list (created in p.y) */
 SystemInfo_T systeminfo;                             /**< System information */
 
-Thread_T heartbeatThread;
-Sem_T    heartbeatCond;
-Mutex_T  heartbeatMutex;
-static volatile bool heartbeatRunning = false;
-
 const char *actionnames[] = {"ignore", "alert", "restart", "stop", "exec", "unmonitor", "start", "monitor", ""};
 const char *modenames[] = {"active", "passive"};
 const char *onrebootnames[] = {"start", "nostart", "laststate"};
-const char *checksumnames[] = {"UNKNOWN", "MD5", "SHA1"};
+const char *prioritynames[] = {"normal", "low", "high"};
+const char *checksumnames[] = {"UNKNOWN", "MD5", "SHA1", "SHA256"};
 const char *operatornames[] = {"less than", "less than or equal to", "greater than", "greater than or equal to", "equal to", "not equal to", "changed"};
 const char *operatorshortnames[] = {"<", "<=", ">", ">=", "=", "!=", "<>"};
 const char *servicetypes[] = {"Filesystem", "Directory", "File", "Process", "Remote Host", "System", "Fifo", "Program", "Network"};
 const char *pathnames[] = {"Path", "Path", "Path", "Pid file", "Path", "", "Path"};
 const char *icmpnames[] = {"Reply", "", "", "Destination Unreachable", "Source Quench", "Redirect", "", "", "Ping", "", "", "Time Exceeded", "Parameter Problem", "Timestamp Request", "Timestamp Reply", "Information Request", "Information Reply", "Address Mask Request", "Address Mask Reply"};
 const char *socketnames[] = {"unix", "IP", "IPv4", "IPv6"};
-const char *timestampnames[] = {"modify/change time", "access time", "change time", "modify time"};
+const char *timestampnames[] = {"modify/change time", "access time", "change time", "modify time", "oldest file modify time", "newest file modify time"};
 const char *httpmethod[] = {"", "HEAD", "GET"};
 
 
 /* ------------------------------------------------------------------ Public */
 
 
+#ifdef MONIT_BENCH
+#define main monit_main // The benchmark (make bench) links the monit objects with its own main
+#endif
+
+
 /**
  * The Prime mover
  */
@@ -235,6 +253,14 @@ static void do_init() {
          */
         signal(SIGUSR1, do_wakeup);
 
+#ifdef HAVE_MEMSTAT
+        /*
+         * Register interest for the SIGUSR2 signal, monit built with
+         * --enable-memstat logs the allocation statistics
+         */
+        signal(SIGUSR2, do_memoryreport);
+#endif
+
         /*
          * Register interest for the SIGINT signal,
          * in case we run as a server but not as a daemon
@@ -267,12 +293,6 @@ static void do_init() {
          */
         Mutex_init(Run.mutex);
 
-        /*
-         * Initialize heartbeat mutex and condition
-         */
-        Mutex_init(heartbeatMutex);
-        Sem_init(heartbeatCond);
-
         /*
          * Get the position of the control file
          */
@@ -341,14 +361,26 @@ static void do_reinit() {
          globale process table which a sigchld handler can check */
         waitforchildren();
 
-        if (Run.mmonits && heartbeatRunning) {
-                Sem_signal(heartbeatCond);
-                Thread_join(heartbeatThread);
-                heartbeatRunning = false;
-        }
+        // The services are replaced => finish the actions in progress
+        control_wait();
+
+        MMonit_stop();
+        alert_stop();
+        Webhook_stop();
+        Mqtt_stop();
+
+        ProcessEvent_stop();
+        ProcessBPF_stop();
+        FileEvent_stop();
+        Cluster_stop();
 
         Run.flags &= ~Run_DoReload;
 
+        Resolver_flush();
+#ifdef HAVE_OPENSSL
+        Ssl_reload();
+#endif
+
         /* Stop http interface */
         if (Run.httpd.flags & Httpd_Net || Run.httpd.flags & Httpd_Unix)
                 monit_http(Httpd_Stop);
@@ -356,15 +388,22 @@ static void do_reinit() {
         /* Save the current state (no changes are possible now since the http thread is stopped) */
         State_save();
         State_close();
+        StatusFile_close();
 
-        /* Run the garbage collector */
-        gc();
+        /* Deliver the pending alert digests, the mail servers are replaced */
+        alert_flush(true);
+
+        /* Run the garbage collector, the services are kept until the new configuration is parsed */
+        Service_T previous = gc_reload();
 
         if (! parse(Run.files.control)) {
                 Log_error("%s stopped -- error parsing configuration file\n", prog);
                 exit(1);
         }
 
+        /* Keep the runtime data of the services which were not changed */
+        gc_carryover(&previous);
+
         /* Close the current log */
         Log_close();
 
@@ -390,6 +429,7 @@ static void do_reinit() {
         if (! State_open())
                 exit(1);
         State_restore();
+        StatusFile_open();
 
         /* Start http interface */
         if (can_http())
@@ -398,10 +438,18 @@ static void do_reinit() {
         /* send the monit startup notification */
         Event_post(Run.system, Event_Instance, State_Changed, Run.system->action_MONIT_START, "Monit reloaded");
 
-        if (Run.mmonits) {
-                Thread_create(heartbeatThread, heartbeat, NULL);
-                heartbeatRunning = true;
-        }
+        MMonit_start();
+        alert_start();
+        Webhook_start();
+        Mqtt_start();
+
+        if (Run.flags & Run_ProcessEvents)
+                ProcessEvent_start();
+        if (Run.flags & Run_ProcessAccounting)
+                ProcessBPF_start();
+        if (Run.flags & Run_FileEvents)
+                FileEvent_start();
+        Cluster_start();
 }
 
 
@@ -420,36 +468,17 @@ static void do_action(List_T arguments) {
                    IS(action, "monitor")   ||
                    IS(action, "unmonitor") ||
                    IS(action, "restart")) {
-                char *service = List_pop(arguments);
-                if (Run.mygroup || service) {
-                        int errors = 0;
-                        List_T services = List_new();
-                        if (Run.mygroup) {
-                                for (ServiceGroup_T sg = servicegrouplist; sg; sg = sg->next) {
-                                        if (IS(Run.mygroup, sg->name)) {
-                                                for (list_t m = sg->members->head; m; m = m->next) {
-                                                        Service_T s = m->e;
-                                                        List_append(services, s->name);
-                                                }
-                                                break;
-                                        }
-                                }
-                                if (List_length(services) == 0) {
-                                        List_free(&services);
-                                        Log_error("Group '%s' not found\n", Run.mygroup);
-                                        exit(1);
-                                }
-                        } else if (IS(service, "all")) {
-                                for (Service_T s = servicelist; s; s = s->next)
-                                        List_append(services, s->name);
-                        } else {
-                                List_append(services, service);
-                        }
-                        errors = exist_daemon() ? (HttpClient_action(action, services) ? 0 : 1) : control_service_string(services, action);
+                // The services are selected by the group and by the names or glob patterns, 'all' selects all services
+                List_T services = List_new();
+                for (char *service = List_pop(arguments); service; service = List_pop(arguments))
+                        List_append(services, IS(service, "all") ? "*" : service);
+                if (Run.mygroup || List_length(services)) {
+                        int errors = exist_daemon() ? (HttpClient_action(action, Run.mygroup, services) ? 0 : 1) : control_service_string(Run.mygroup, services, action);
                         List_free(&services);
                         if (errors)
                                 exit(1);
                 } else {
+                        List_free(&services);
                         Log_error("Please specify a service name or 'all' after %s\n", action);
                         exit(1);
                 }
@@ -468,13 +497,66 @@ static void do_action(List_T arguments) {
                 char *type = List_pop(arguments);
                 if (! HttpClient_report(type))
                         exit(1);
+        } else if (IS(action, "profile")) {
+                if (! HttpClient_profile())
+                        exit(1);
+        } else if (IS(action, "top")) {
+                char *sort = List_pop(arguments);
+                char *limit = List_pop(arguments);
+                if (! HttpClient_top(sort, limit))
+                        exit(1);
         } else if (IS(action, "procmatch")) {
                 char *pattern = List_pop(arguments);
                 if (! pattern) {
-                        printf("Invalid syntax - usage: procmatch \"<pattern>\"\n");
+                        printf("Invalid syntax - usage: procmatch \"<pattern>\" or procmatch -f <file>\n");
+                        exit(1);
+                }
+                if (IS(pattern, "-f")) {
+                        char *file = List_pop(arguments);
+                        if (! file) {
+                                printf("Invalid syntax - usage: procmatch -f <file>\n");
+                                exit(1);
+                        }
+                        if (! ProcessTree_testMatchFile(file))
+                                exit(1);
+                } else {
+                        ProcessTree_testMatch(pattern);
+                }
+        } else if (IS(action, "memory")) {
+                char *service = List_pop(arguments);
+                StringBuffer_T B = StringBuffer_create(8192);
+                bool rv = Util_printMemoryFootprint(B, service);
+                if (rv)
+                        printf("%s", StringBuffer_toString(B));
+                else if (service)
+                        printf("Service '%s' not found\n", service);
+                else
+                        printf("No services found\n");
+                StringBuffer_free(&B);
+                if (! rv)
+                        exit(1);
+        } else if (IS(action, "procfs")) {
+                char *command = List_pop(arguments);
+                char *archive = List_pop(arguments);
+                if (IS(command, "record") && archive) {
+                        int count = ProcessSnapshot_record(archive);
+                        if (count < 0)
+                                exit(1);
+                        printf("Recorded %d processes of %s to %s\n", count, PROCFS_ROOT, archive);
+                } else if (IS(command, "extract") && archive) {
+                        char *directory = List_pop(arguments);
+                        if (! directory) {
+                                printf("Invalid syntax - usage: procfs extract <archive> <directory>\n");
+                                exit(1);
+                        }
+                        int count = ProcessSnapshot_extract(archive, directory);
+                        if (count < 0)
+                                exit(1);
+                        printf("Extracted %d processes to %s, use 'set procfs %s' to replay the snapshot\n", count, directory, directory);
+                } else {
+                        printf("Invalid syntax - usage: procfs record <archive> | procfs extract <archive> <directory>\n");
                         exit(1);
                 }
-                ProcessTree_testMatch(pattern);
         } else if (IS(action, "quit")) {
                 kill_daemon(SIGTERM);
         } else if (IS(action, "validate")) {
@@ -502,11 +584,17 @@ static void do_exit(bool saveState) {
                 if (can_http())
                         monit_http(Httpd_Stop);
 
-                if (Run.mmonits && heartbeatRunning) {
-                        Sem_signal(heartbeatCond);
-                        Thread_join(heartbeatThread);
-                        heartbeatRunning = false;
-                }
+                MMonit_stop();
+                alert_stop();
+                Webhook_stop();
+                Mqtt_stop();
+
+                ProcessEvent_stop();
+                ProcessBPF_stop();
+                FileEvent_stop();
+                Cluster_stop();
+
+                control_wait();
 
                 Log_info("Monit daemon with pid [%d] stopped\n", (int)getpid());
 
@@ -516,7 +604,13 @@ static void do_exit(bool saveState) {
         if (saveState) {
                 State_save();
         }
-        gc();
+        StatusFile_close();
+        alert_flush(true);
+        // The full release is kept for debugging, so the leak checkers report only the real leaks
+        if (Run.debug)
+                gc();
+        else
+                gc_exit();
 #ifdef HAVE_OPENSSL
         Ssl_stop();
 #endif
@@ -547,6 +641,11 @@ static void do_default() {
                 if (! (Run.flags & Run_Foreground))
                         daemonize();
 
+                /* The log writer thread must be started after daemonize as it does not survive fork */
+                Log_start();
+
+                set_signal_wakeup();
+
                 if (! file_createPidFile(Run.files.pid)) {
                         Log_error("Monit daemon died\n");
                         exit(1);
@@ -555,6 +654,7 @@ static void do_default() {
                 if (! State_open())
                         exit(1);
                 State_restore();
+                StatusFile_open();
 
                 atexit(file_finalize);
 
@@ -579,21 +679,54 @@ static void do_default() {
                 /* send the monit startup notification */
                 Event_post(Run.system, Event_Instance, State_Changed, Run.system->action_MONIT_START, "Monit %s started", VERSION);
 
-                if (Run.mmonits) {
-                        Thread_create(heartbeatThread, heartbeat, NULL);
-                        heartbeatRunning = true;
-                }
+                MMonit_start();
+                alert_start();
+                Webhook_start();
+                Mqtt_start();
+
+                if (Run.flags & Run_ProcessEvents)
+                        ProcessEvent_start();
+                if (Run.flags & Run_ProcessAccounting)
+                        ProcessBPF_start();
+                if (Run.flags & Run_FileEvents)
+                        FileEvent_start();
+                Cluster_start();
 
                 while (true) {
                         validate();
-
-                        /* In the case that there is no pending action then sleep */
-                        if (! (Run.flags & Run_ActionPending) && ! interrupt())
-                                sleep(Run.polltime);
+                        control_run();
+                        spawn_reap();
+                        StatusFile_update();
+                        Mqtt_update();
+                        ProcessEvent_update();
+                        FileEvent_update();
+
+                        /* In the case that there is no pending action then sleep until the next service check is due (at most one poll cycle). The signal received
+                           during the cycle was written to the signal wakeup pipe and ends the sleep at once */
+                        if (! (Run.flags & Run_ActionPending) && ! (Run.flags & Run_DoWakeup) && ! interrupt()) {
+                                long long wait = MIN(validate_next() - Time_monotonicMilli(), Run.polltime * 1000LL);
+                                if (wait > 0)
+                                        signal_sleep(wait);
+                        }
 
                         if (Run.flags & Run_DoWakeup) {
                                 Run.flags &= ~Run_DoWakeup;
-                                Log_info("Awakened by User defined signal 1\n");
+                                // The process and file event engines and the finished service actions wake up the daemon with the same signal, only the affected services are checked then
+                                if (Cluster_changed()) {
+                                        // Some cluster node went down or up, check the services it owned or owns now at once
+                                        validate_reset();
+                                } else if (! ProcessEvent_pending() && ! FileEvent_pending() && ! control_pending()) {
+                                        Log_info("Awakened by User defined signal 1\n");
+                                        validate_reset();
+                                }
+                        }
+
+                        if (Run.flags & Run_DoMemoryReport) {
+                                Run.flags &= ~Run_DoMemoryReport;
+                                StringBuffer_T B = StringBuffer_create(4096);
+                                Util_printMemoryStatistics(B, 50);
+                                Log_info("%s", StringBuffer_toString(B));
+                                StringBuffer_free(&B);
                         }
 
                         if (Run.flags & Run_Stopped) {
@@ -601,7 +734,9 @@ static void do_default() {
                         } else if (Run.flags & Run_DoReload) {
                                 do_reinit();
                         } else {
+                                long long start = Profile_start();
                                 State_saveIfDirty();
+                                Profile_phase(Profile_StateSave, start);
                         }
                 }
         } else {
@@ -828,13 +963,14 @@ static void help() {
                " -t            Run syntax check for the control file\n"
                " -v            Verbose mode, work noisy (diagnostic output)\n"
                " -vv           Very verbose mode, same as -v plus log stacktrace on error\n"
-               " -H [filename] Print SHA1 and MD5 hashes of the file or of stdin if the\n"
+               " -H [filename] Print SHA256, SHA1 and MD5 hashes of the file or of stdin if the\n"
                "               filename is omitted; monit will exit afterwards\n"
                " -V            Print version number and patchlevel\n"
                " -h            Print this text\n"
                "Optional commands are as follows:\n"
                " start all             - Start all services\n"
-               " start <name>          - Only start the named service\n"
+               " start <name>          - Only start the named service, the names may be\n"
+               "                         repeated or glob patterns, such as 'web-*'\n"
                " stop all              - Stop all services\n"
                " stop <name>           - Stop the named service\n"
                " restart all           - Stop and start all services\n"
@@ -847,9 +983,17 @@ static void help() {
                " status [name]         - Print full status information for service(s)\n"
                " summary [name]        - Print short status information for service(s)\n"
                " report [up|down|..]   - Report state of services. See manual for options\n"
+               " profile               - Print the duration of the service checks and cycle phases\n"
+               " top [cpu|memory|..] [count]\n"
+               "                       - Print the processes with the highest resource usage\n"
                " quit                  - Kill the monit daemon process\n"
                " validate              - Check all services and start if not running\n"
-               " procmatch <pattern>   - Test process matching pattern\n",
+               " procmatch <pattern>   - Test process matching pattern\n"
+               " procmatch -f <file>   - Test the patterns from the file (one per line) at once\n"
+               " memory [name]         - Print the memory footprint of the service(s)\n"
+               " procfs record <file>  - Record the /proc snapshot of the process engine (Linux)\n"
+               " procfs extract <file> <directory>\n"
+               "                       - Extract the /proc snapshot for replay with set procfs\n",
                prog);
 }
 
@@ -879,30 +1023,10 @@ static void version() {
         printf("out");
 #endif
         printf(" large files\n");
-        printf("Copyright (C) 2001-2020 Tildeslash Ltd. All Rights Reserved.\n");
-}
-
-
-/**
- * M/Monit heartbeat thread
- */
-static void *heartbeat(__attribute__ ((unused)) void *args) {
-        set_signal_block();
-        Log_info("M/Monit heartbeat started\n");
-        LOCK(heartbeatMutex)
-        {
-                while (! interrupt()) {
-                        MMonit_send(NULL);
-                        struct timespec wait = {.tv_sec = Time_now() + Run.polltime, .tv_nsec = 0};
-                        Sem_timeWait(heartbeatCond, heartbeatMutex, wait);
-                }
-        }
-        END_LOCK;
-#ifdef HAVE_OPENSSL
-        Ssl_threadCleanup();
+#ifdef HAVE_MEMSTAT
+        printf("Built with the allocation statistics\n");
 #endif
-        Log_info("M/Monit heartbeat stopped\n");
-        return NULL;
+        printf("Copyright (C) 2001-2020 Tildeslash Ltd. All Rights Reserved.\n");
 }
 
 
@@ -911,6 +1035,7 @@ static void *heartbeat(__attribute__ ((unused)) void *args) {
  */
 static void do_reload(__attribute__ ((unused)) int sig) {
         Run.flags |= Run_DoReload;
+        signal_wakeup();
 }
 
 
@@ -919,6 +1044,7 @@ static void do_reload(__attribute__ ((unused)) int sig) {
  */
 static void do_destroy(__attribute__ ((unused)) int sig) {
         Run.flags |= Run_Stopped;
+        signal_wakeup();
 }
 
 
@@ -927,9 +1053,21 @@ static void do_destroy(__attribute__ ((unused)) int sig) {
  */
 static void do_wakeup(__attribute__ ((unused)) int sig) {
         Run.flags |= Run_DoWakeup;
+        signal_wakeup();
 }
 
 
+#ifdef HAVE_MEMSTAT
+/**
+ * Signalhandler for the allocation statistics report
+ */
+static void do_memoryreport(__attribute__ ((unused)) int sig) {
+        Run.flags |= Run_DoMemoryReport;
+        signal_wakeup();
+}
+#endif
+
+
 /* A simple non-blocking reaper to ensure that we wait-for and reap all/any stray child processes
  we may have created and not waited on, so we do not create any zombie processes at exit */
 static void waitforchildren(void) {
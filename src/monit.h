@@ -104,12 +104,19 @@
 #include "statistics/Statistics.h"
 #include "net/socket.h"
 #include "net/Link.h"
+#include "Histogram.h"
+#include "Series.h"
+#include "Profile.h"
 
 // libmonit
 #include "system/Command.h"
 #include "system/Process.h"
+#include "system/Time.h"
 #include "util/Str.h"
 #include "util/StringBuffer.h"
+#include "util/Vector.h"
+#include "util/HashMap.h"
+#include "util/Atom.h"
 #include "thread/Thread.h"
 
 
@@ -128,6 +135,7 @@
 #define MYSTATEFILE        "monit.state"
 #define MYIDFILE           "monit.id"
 #define MYEVENTLISTBASE    "/var/monit"
+#define PROCFS_ROOT        (Run.procfs ? Run.procfs : "/proc")
 
 #define LOCALHOST          "localhost"
 
@@ -139,6 +147,15 @@
 #define SSL_TIMEOUT        15000
 #define SMTP_TIMEOUT       30000
 
+#define MMONIT_SNAPSHOT    10
+
+#define CLUSTER_TIMEOUT    6
+
+#define TIMER_SLACK        250
+
+#define HTTPD_WORKERS      4
+#define HTTPD_CONNECTIONS  32
+
 
 //FIXME: refactor Run_Flags to bit field
 typedef enum {
@@ -155,13 +172,26 @@ typedef enum {
         Run_Stopped              = 0x400,                          /**< Stop Monit */
         Run_DoReload             = 0x800,                        /**< Reload Monit */
         Run_DoWakeup             = 0x1000,                       /**< Wakeup Monit */
-        Run_Batch                = 0x2000                      /**< CLI batch mode */
+        Run_Batch                = 0x2000,                     /**< CLI batch mode */
+        Run_ProcessEvents        = 0x4000,            /**< Process event engine enabled */
+        Run_FileEvents           = 0x8000,               /**< File event engine enabled */
+        Run_DoMemoryReport       = 0x10000,    /**< Log the allocation statistics */
+        Run_LogJson              = 0x20000,          /**< Log in the JSON format */
+        Run_ProcessAccounting    = 0x40000          /**< eBPF process accounting */
 } __attribute__((__packed__)) Run_Flags;
 
 
 typedef enum {
-        ProcessEngine_None               = 0x0,
-        ProcessEngine_CollectCommandLine = 0x1
+        ProcessEngine_None                    = 0x0,
+        ProcessEngine_CollectCommandLine      = 0x1,
+        ProcessEngine_CollectFiledescriptors  = 0x2,     /**< Some rule tests filedescriptors */
+        ProcessEngine_CollectMonitoredOnly    = 0x4, /**< Collect details of monitored subtrees only */
+        ProcessEngine_CollectCgroup           = 0x8,  /**< Some service is scoped by cgroup */
+        ProcessEngine_CollectPhysicalIO       = 0x10,  /**< Some rule tests physical I/O */
+        ProcessEngine_CollectConnections      = 0x20, /**< Some rule tests TCP connections */
+        ProcessEngine_CollectDelay            = 0x40,     /**< Some rule tests I/O delay */
+        ProcessEngine_CollectThreads          = 0x80, /**< Some rule tests the thread CPU usage */
+        ProcessEngine_CollectSmaps            = 0x100 /**< Some rule tests the PSS or USS memory */
 } __attribute__((__packed__)) ProcessEngine_Flags;
 
 
@@ -175,7 +205,8 @@ typedef enum {
         Every_Cycle = 0,
         Every_SkipCycles,
         Every_Cron,
-        Every_NotInCron
+        Every_NotInCron,
+        Every_Interval
 } __attribute__((__packed__)) Every_Type;
 
 
@@ -204,7 +235,9 @@ typedef enum {
         Timestamp_Default = 0,
         Timestamp_Access,
         Timestamp_Change,
-        Timestamp_Modification
+        Timestamp_Modification,
+        Timestamp_Oldest,
+        Timestamp_Newest
 } __attribute__((__packed__)) Timestamp_Type;
 
 
@@ -246,6 +279,13 @@ typedef enum {
 } __attribute__((__packed__)) Action_Type;
 
 
+typedef enum {
+        Select_Service = 0,                                  /**< Service name */
+        Select_Pattern,                       /**< Service name glob pattern */
+        Select_Group                                   /**< Service group name */
+} __attribute__((__packed__)) Select_Type;
+
+
 typedef enum {
         Monitor_Active = 0,
         Monitor_Passive
@@ -259,6 +299,13 @@ typedef enum {
 } __attribute__((__packed__)) Onreboot_Type;
 
 
+typedef enum {
+        Priority_Normal = 0,
+        Priority_Low,
+        Priority_High
+} __attribute__((__packed__)) Priority_Type;
+
+
 typedef enum {
         Monitor_Not     = 0x0,
         Monitor_Yes     = 0x1,
@@ -324,7 +371,28 @@ typedef enum {
         Resource_ServiceTime,
         Resource_LoadAveragePerCore1m,
         Resource_LoadAveragePerCore5m,
-        Resource_LoadAveragePerCore15m
+        Resource_LoadAveragePerCore15m,
+        Resource_CpuPerCore,
+        Resource_CpuPerNode,
+        Resource_PressureCpuSome,
+        Resource_PressureCpuFull,
+        Resource_PressureMemorySome,
+        Resource_PressureMemoryFull,
+        Resource_PressureIoSome,
+        Resource_PressureIoFull,
+        Resource_Utilization,
+        Resource_Connections,
+        Resource_ConnectionsEstablished,
+        Resource_ConnectionsListen,
+        Resource_ConnectionsCloseWait,
+        Resource_TcpSent,
+        Resource_TcpReceived,
+        Resource_IoDelay,
+        Resource_CpuPercentThread,
+        Resource_HugepagesPercent,
+        Resource_MemoryPss,
+        Resource_MemoryUss,
+        Resource_CgroupMemoryPercent
 } __attribute__((__packed__)) Resource_Type;
 
 
@@ -333,7 +401,8 @@ typedef enum {
         Digest_Cleartext = 1,
         Digest_Crypt,
         Digest_Md5,
-        Digest_Pam
+        Digest_Pam,
+        Digest_Token                        // Bearer token, not a password
 } __attribute__((__packed__)) Digest_Type;
 
 
@@ -349,6 +418,7 @@ typedef enum {
         Hash_Unknown = 0,
         Hash_Md5,
         Hash_Sha1,
+        Hash_Sha256,
         Hash_Default = Hash_Md5
 } __attribute__((__packed__)) Hash_Type;
 
@@ -357,7 +427,8 @@ typedef enum {
         Handler_Succeeded = 0x0,
         Handler_Alert     = 0x1,
         Handler_Mmonit    = 0x2,
-        Handler_Max       = Handler_Mmonit
+        Handler_Webhook   = 0x4,
+        Handler_Max       = Handler_Webhook
 } __attribute__((__packed__)) Handler_Type;
 
 
@@ -368,6 +439,12 @@ typedef enum {
 } __attribute__((__packed__)) MmonitCompress_Type;
 
 
+typedef enum {
+        MqttFormat_Json = 0,
+        MqttFormat_Cbor
+} __attribute__((__packed__)) MqttFormat_Type;
+
+
 typedef enum {
         Statistics_CpuUser                      = 0x1,
         Statistics_CpuNice                      = 0x2,
@@ -380,10 +457,20 @@ typedef enum {
         Statistics_CpuGuestNice                 = 0x100,
         Statistics_FiledescriptorsPerSystem     = 0x200,
         Statistics_FiledescriptorsPerProcess    = 0x400,
-        Statistics_FiledescriptorsPerProcessMax = 0x800
+        Statistics_FiledescriptorsPerProcessMax = 0x800,
+        Statistics_CpuPerCore                   = 0x1000,
+        Statistics_CpuPerNode                   = 0x2000
 } __attribute__((__packed__)) Statistics_Flags;
 
 
+typedef enum {
+        Pressure_Cpu = 0,
+        Pressure_Memory,
+        Pressure_Io,
+        Pressure_Count
+} __attribute__((__packed__)) Pressure_Type;
+
+
 /* Length of the longest message digest in bytes */
 #define MD_SIZE 65
 
@@ -396,6 +483,7 @@ typedef enum {
 /* Default limits */
 #define LIMIT_SENDEXPECTBUFFER  256
 #define LIMIT_FILECONTENTBUFFER 512
+#define LIMIT_FILECONTENTBUDGET 67108864
 #define LIMIT_PROGRAMOUTPUT     512
 #define LIMIT_HTTPCONTENTBUFFER 1048576
 #define LIMIT_NETWORKTIMEOUT    5000
@@ -403,6 +491,9 @@ typedef enum {
 #define LIMIT_STOPTIMEOUT       30000
 #define LIMIT_STARTTIMEOUT      30000
 #define LIMIT_RESTARTTIMEOUT    30000
+#define LIMIT_FILESYSTEMTIMEOUT 10000
+#define LIMIT_CHECKTIMEOUT      0
+#define LIMIT_CHECKQUARANTINE   3
 
 
 
@@ -449,6 +540,7 @@ typedef char MD_T[MD_SIZE];
 typedef struct Limits_T {
         int      programOutput;           /**< Program output truncate limit [B] */
         size_t   fileContentBuffer;  /**< Maximum tested file content length [B] */
+        size_t   fileContentBudget;  /**< Maximum file content read per cycle [B] */
         uint32_t sendExpectBuffer;  /**< Maximum send/expect response length [B] */
         uint32_t httpContentBuffer;  /**< Maximum tested HTTP content length [B] */
         uint32_t networkTimeout;               /**< Default network timeout [ms] */
@@ -456,25 +548,29 @@ typedef struct Limits_T {
         uint32_t stopTimeout;                     /**< Default stop timeout [ms] */
         uint32_t startTimeout;                   /**< Default start timeout [ms] */
         uint32_t restartTimeout;               /**< Default restart timeout [ms] */
+        uint32_t filesystemTimeout; /**< Filesystem statistics timeout [ms] */
+        uint32_t checkTimeout;   /**< Service check timeout [ms], 0 = no watchdog */
+        uint32_t checkQuarantine; /**< Hung checks before the service is unmonitored */
 } Limits_T;
 
 
 /**
- * Defines a Command with ARGMAX optional arguments. The arguments
- * array must be NULL terminated and the first entry is the program
- * itself. In addition, a user and group may be set for the Command
+ * Defines a Command with up to ARGMAX arguments. The arguments array
+ * is allocated to the number of arguments, must be NULL terminated and
+ * the first entry is the program itself. In addition, a user and group may be set for the Command
  * which means that the Command should run as a certain user and with
  * certain group. To avoid name collision with Command_T in libmonit
  * this structure uses lower case.
  */
 typedef struct command_t {
-        char *arg[ARGMAX];                             /**< Program with arguments */
+        char **arg;                                    /**< Program with arguments */
         short length;                       /**< The length of the arguments array */
         bool has_uid;      /**< true if a new uid is defined for this Command */
         bool has_gid;      /**< true if a new gid is defined for this Command */
         uid_t uid;         /**< The user id to switch to when running this Command */
         gid_t gid;        /**< The group id to switch to when running this Command */
         unsigned int timeout;     /**< Max seconds which we wait for method to execute */
+        Command_T C;              /**< The Command built on the first execution (internal) */
 } *command_t;
 
 
@@ -483,6 +579,7 @@ typedef struct Action_T {
         Action_Type id;                                   /**< Action to be done */
         int count;                 /**< Event count needed to trigger the action */
         int cycles;          /**< Cycles during which count limit can be reached */
+        unsigned long long mask;      /**< State map bits of the cycles window */
         int repeat;                             /*< Repeat action each Xth cycle */
         command_t exec;                     /**< Optional command to be executed */
 } *Action_T;
@@ -517,14 +614,75 @@ typedef struct Request_T {
 } *Request_T;
 
 
+/** Defines a webhook event receiver object */
+typedef struct Webhook_T {
+        URL_T url;                                             /**< URL definition */
+        struct SslOptions_T ssl;                               /**< SSL definition */
+        int timeout;                /**< The timeout to wait for connection or i/o */
+        int interval;            /**< The batch interval [s], 0 = send immediately */
+        int workers;                          /**< Number of concurrent requests */
+
+        /** For internal use */
+        struct {
+                bool stop;                    /**< Stop request for the sender threads */
+                int count;                                /**< Number of queued events */
+                int backoff;                       /**< The current retry delay [s] */
+                unsigned long long sequence;      /**< The last event sequence number */
+                time_t flushed;                       /**< When the last batch was sent */
+                time_t retry;                  /**< When the failed batch is retried */
+                struct WebhookMessage_T *head;
+                struct WebhookMessage_T *tail;
+                Thread_T *threads;
+                Mutex_T mutex;
+                Sem_T cond;
+        } sender;
+        struct Webhook_T *next;                         /**< next receiver in chain */
+} *Webhook_T;
+
+
+/** Defines the MQTT broker which the service status is published to */
+typedef struct Mqtt_T {
+        URL_T url;                                             /**< URL definition */
+        struct SslOptions_T ssl;                               /**< SSL definition */
+        int timeout;                /**< The timeout to wait for connection or i/o */
+        int qos;                   /**< The QoS of the status messages, 0 or 1 */
+        int snapshot;  /**< Publish all services every n messages, 0 = on connect */
+        MqttFormat_Type format;                       /**< The status message format */
+        char *topic;                          /**< The topic prefix, "monit" default */
+} *Mqtt_T;
+
+
+/** Defines a cluster peer node */
+typedef struct ClusterPeer_T {
+        URL_T url;                                /**< The peer httpd URL */
+        struct SslOptions_T ssl;                               /**< SSL definition */
+
+        /** For internal use */
+        char *id;                          /**< The peer monit ID from the last reply */
+        time_t seen;                 /**< The time of the last successful reply [s] */
+        bool live;                        /**< true if the peer was live at the last poll */
+        char *status;          /**< The service status lines from the last reply */
+        HashMap_T services;      /**< The status lines by the service name (internal) */
+        struct ClusterPeer_T *next;                       /**< next peer in chain */
+} *ClusterPeer_T;
+
+
 /** Defines an event notification and status receiver object */
 typedef struct Mmonit_T {
         URL_T url;                                             /**< URL definition */
         struct SslOptions_T ssl;                               /**< SSL definition */
         int timeout;                /**< The timeout to wait for connection or i/o */
         MmonitCompress_Type compress;                        /**< Compression flag */
+        int snapshot;      /**< Delta mode full status interval [cycles], 0 = off */
+        bool relay;          /**< Forward the messages of the downstream monits */
 
         /** For internal use */
+        Socket_T socket;           /**< Persistent connection of the sender thread */
+        struct {
+                int cycle;                       /**< Status messages counter */
+                int count;                        /**< Number of service digests */
+                uint64_t *digests;         /**< Service status digests sent last time */
+        } delta;
         struct Mmonit_T *next;                         /**< next receiver in chain */
 } *Mmonit_T;
 
@@ -569,6 +727,13 @@ typedef struct Auth_T {
 } *Auth_T;
 
 
+/** Defines the pressure stall information (PSI) of a resource */
+typedef struct Pressure_T {
+        float some;           /**< Time some tasks were stalled on the resource, 10 seconds average [%] (-1 if not available) */
+        float full;           /**< Time all non-idle tasks were stalled on the resource, 10 seconds average [%] (-1 if not available) */
+} Pressure_T;
+
+
 /** Defines data for systemwide statistic */
 typedef struct SystemInfo_T {
         Statistics_Flags statisticsAvailable; /**< List of statistics that are available on this system */
@@ -586,6 +751,14 @@ typedef struct SystemInfo_T {
                         float guest_nice; /**< Time spent running a niced guest (virtual CPU for guest operating systems under the control of the kernel) [%] */
                         float idle;       /**< Idle time [%] */
                 } usage;
+                struct {
+                        int count;        /**< Number of CPU slots */
+                        float *usage;     /**< Usage of each CPU, indexed by the CPU number [%] (-1 if not initialized yet) */
+                } cores;
+                struct {
+                        int count;        /**< Number of NUMA nodes */
+                        float *usage;     /**< Usage of each NUMA node [%] (-1 if not initialized yet) */
+                } nodes;
         } cpu;
         struct {
                 unsigned long long size;                      /**< Maximal system real memory */
@@ -593,6 +766,14 @@ typedef struct SystemInfo_T {
                         float percent;  /**< Total real memory in use in the system */
                         unsigned long long bytes; /**< Total real memory in use in the system */
                 } usage;
+                struct {
+                        unsigned long long size;      /**< Hugepages pool size (0 if no pool) */
+                        struct {
+                                float percent;       /**< Hugepages pool in use */
+                                unsigned long long bytes; /**< Hugepages pool in use */
+                        } usage;
+                        unsigned long long anonymous; /**< Transparent hugepages in use */
+                } hugepages;
         } memory;
         struct {
                 unsigned long long size;                                       /**< Swap size */
@@ -608,6 +789,7 @@ typedef struct SystemInfo_T {
         } filedescriptors;
         size_t argmax;                                                   /**< Program arguments maximum [B] */
         double loadavg[3];                                                         /**< Load average triple */
+        Pressure_T pressure[Pressure_Count];    /**< Pressure stall information, indexed by Pressure_Type */
         struct utsname uname;                                 /**< Platform information provided by uname() */
         struct timeval collected;                                             /**< When were data collected */
         unsigned long long booted; /**< System boot time (seconds since UNIX epoch, using platform-agnostic unsigned long long) */
@@ -620,18 +802,32 @@ typedef struct SystemInfo_T {
 typedef struct Protocol_T {
         const char *name;                                       /**< Protocol name */
         void (*check)(Socket_T);          /**< Protocol verification function */
+        void (*ping)(Socket_T);   /**< Keepalive connection test (NULL if not supported) */
 } *Protocol_T;
 
 
 /** Defines a send/expect object used for generic protocol tests */
 typedef struct Generic_T {
-        char *send;                           /* string to send, or NULL if expect */
+        char *send;        /* data to send (\0x escapes resolved), or NULL if expect */
+        int length;                                      /* length of the send data */
         regex_t *expect;                  /* regex code to expect, or NULL if send */
+        char *literal;   /* expect string if it has no regex metacharacters or NULL */
         /** For internal use */
         struct Generic_T *next;
 } *Generic_T;
 
 
+/** Defines a DNS query of the dns protocol test */
+typedef struct DnsQuery_T {
+        char *name;                                        /**< Queried domain name */
+        char *type;                                      /**< Record type name, e.g. MX */
+        char *answer;            /**< Expected answer record data or NULL for any answer */
+        unsigned short rrtype;                                  /**< Record type code */
+        /** For internal use */
+        struct DnsQuery_T *next;
+} *DnsQuery_T;
+
+
 typedef struct Outgoing_T {
         char *ip;                                         /**< Outgoing IP address */
         struct sockaddr_storage addr;
@@ -660,12 +856,25 @@ typedef struct Port_T {
         Outgoing_T outgoing;                                 /**< Outgoing address */
         int timeout;      /**< The timeout in [ms] to wait for connect or read i/o */
         int retry;       /**< Number of connection retry before reporting an error */
+        bool keepalive;        /**< Keep the connection open across the test cycles */
+        Socket_T pooled;                  /**< The connection kept open by keepalive */
+        struct Port_T *shared;   /**< The port whose keepalive connection is shared */
         volatile int socket;                       /**< Socket used for connection */
         double response;                 /**< Socket connection response time [ms] */
+        double resolution;                   /**< Host name resolution time [ms] */
+        Histogram_T latency;         /**< Recent response times histogram [μs] */
         Socket_Type type;           /**< Socket type used for connection (UDP/TCP) */
         Socket_Family family;    /**< Socket family used for connection (NET/UNIX) */
         Connection_State is_available;               /**< Server/port availability */
         EventAction_T action; /**< Description of the action upon event occurrence */
+        struct {
+                bool connected;    /**< The socket was connected by Socket_connectPorts() */
+                int socket;                                 /**< The connected socket */
+                long long duration;                           /**< Connection time [μs] */
+                struct sockaddr_storage addr;           /**< The address connected to */
+                socklen_t addrlen;
+                char *error;        /**< Connection error from Socket_connectPorts() */
+        } prepared;
         /** Protocol specific parameters */
         union {
                 struct {
@@ -696,6 +905,9 @@ typedef struct Port_T {
                 struct {
                         Generic_T sendexpect;
                 } generic;
+                struct {
+                        char *service;       /**< Health checked service name (optional) */
+                } grpc;
                 struct {
                         Hash_Type hashtype;           /**< Type of hash for a checksum (optional) */
                         bool hasStatus;                    /**< Is explicit HTTP status set? */
@@ -707,20 +919,67 @@ typedef struct Port_T {
                         char *request;                                          /**< HTTP request */
                         char *checksum;                         /**< Document checksum (optional) */
                         List_T headers;      /**< List of headers to send with request (optional) */
+                        char *etag;             /**< ETag of the last verified content (internal) */
+                        char *lastModified; /**< Last-Modified of the last verified content (internal) */
                 } http;
+                struct {
+                        List_T topics;                      /**< Topics to check (optional) */
+                        int brokers;                               /**< Brokers limit */
+                        Operator_Type brokersOP;                    /**< brokers operator */
+                } kafka;
+                struct {
+                        long long evictions;       /**< Evictions since the last test limit */
+                        double hitRatio;                         /**< Hit ratio limit [%] */
+                        int connections;                /**< Current connections limit */
+                        Operator_Type evictionsOP;                /**< evictions operator */
+                        Operator_Type hitRatioOP;                 /**< hit ratio operator */
+                        Operator_Type connectionsOP;            /**< connections operator */
+                } memcache;
                 struct {
                         char *username;
                         char *password;
                 } mqtt;
+                struct {
+                        char *username;
+                        char *password;         /**< Password or token if no username */
+                        char *cluster;                  /**< Expected cluster name (optional) */
+                        int servers;                        /**< Cluster servers limit */
+                        Operator_Type serversOP;                    /**< servers operator */
+                } nats;
                 struct {
                         char *username;
                         char *password;
                         char *rsaChecksum;
                         Hash_Type rsaChecksumType;
+                        int threads;                         /**< Threads_running limit */
+                        int lag;                        /**< Replication lag limit [s] */
+                        Operator_Type threadsOP;                    /**< threads operator */
+                        Operator_Type lagOP;                            /**< lag operator */
                 } mysql;
+                struct {
+                        char *username;
+                        char *password;
+                        char *database;
+                        int lag;                        /**< Replication lag limit [s] */
+                        Operator_Type lagOP;                            /**< lag operator */
+                } pgsql;
+                struct {
+                        DnsQuery_T queries;          /**< Queries sent in one batch or NULL */
+                } dns;
                 struct {
                         char *secret;
                 } radius;
+                struct {
+                        char *password;
+                        long long memory;                      /**< Used memory limit [B] */
+                        int clients;                       /**< Connected clients limit */
+                        int operations;              /**< Operations per second limit */
+                        int lag;                        /**< Replication lag limit [s] */
+                        Operator_Type memoryOP;                      /**< memory operator */
+                        Operator_Type clientsOP;                    /**< clients operator */
+                        Operator_Type operationsOP;              /**< operations operator */
+                        Operator_Type lagOP;                            /**< lag operator */
+                } redis;
                 struct {
                         int maxforward;
                         char *target;
@@ -734,8 +993,71 @@ typedef struct Port_T {
                         char *host;
                         char *origin;
                         char *request;
+                        int pings;               /**< Number of pings to send (optional) */
                 } websocket;
         } parameters;
+        /** Protocol specific statistics collected by the test */
+        union {
+                struct {
+                        bool available;          /**< INFO statistics were collected */
+                        long long memory;                           /**< Used memory [B] */
+                        int clients;                              /**< Connected clients */
+                        int operations;                     /**< Operations per second */
+                        int lag;      /**< Replication lag [s], -1 if the link is down */
+                } redis;
+                struct {
+                        bool available;              /**< Server status was collected */
+                        bool replica;                        /**< The server is a replica */
+                        int threads;                                /**< Threads_running */
+                        int lag; /**< Replication lag [s], -1 if the replication stopped */
+                } mysql;
+                struct {
+                        bool available;          /**< Probe query result was collected */
+                        bool recovery;            /**< The server is in recovery (replica) */
+                        int lag;         /**< Replication lag [s], -1 if nothing was replayed */
+                } pgsql;
+                struct {
+                        int queries;                          /**< Number of queries sent */
+                        int failed;                         /**< Number of failed queries */
+                        long long median;              /**< Median query latency [us] */
+                        long long p95;       /**< 95th percentile of query latency [us] */
+                        long long maximum;            /**< Maximum query latency [us] */
+                } dns;
+                struct {
+                        int pings;                               /**< Number of pings sent */
+                        double minimum;                 /**< Minimum round trip time [ms] */
+                        double average;                 /**< Average round trip time [ms] */
+                        double maximum;                 /**< Maximum round trip time [ms] */
+                        double jitter; /**< Mean difference of consecutive round trips [ms] */
+                } websocket;
+                struct {
+                        int stream;   /**< Last stream id used on the keepalive connection */
+                        int window;   /**< Received data to return to the flow-control window */
+                        int status;               /**< Health check serving status */
+                } grpc;
+                struct {
+                        bool available;              /**< Statistics were collected */
+                        long long evictions;              /**< Evictions since the last test */
+                        double hitRatio;  /**< Hit ratio since the last test [%], -1 if no gets */
+                        int connections;                     /**< Current connections */
+                        long long hits;                     /**< get_hits counter */
+                        long long misses;                 /**< get_misses counter */
+                        long long evictionsTotal;          /**< evictions counter */
+                } memcache;
+                struct {
+                        bool available;                 /**< Metadata were collected */
+                        int brokers;                              /**< Number of brokers */
+                        int controller;       /**< Controller broker id, -1 if none */
+                        int partitions;               /**< Partitions of the topics */
+                        int leaderless;            /**< Partitions without leader */
+                        int underReplicated;       /**< Under-replicated partitions */
+                } kafka;
+                struct {
+                        char version[16];                           /**< Server version */
+                        char cluster[64];                  /**< Cluster name or empty */
+                        int servers;                    /**< Number of cluster servers */
+                } nats;
+        } statistics;
         Protocol_T protocol;     /**< Protocol object for testing a port's service */
         Request_T url_request;             /**< Optional url client request object */
 
@@ -753,29 +1075,42 @@ typedef struct Icmp_T {
         Connection_State is_available;    /**< Flag for the server is availability */
         Socket_Family family;                 /**< ICMP family used for connection */
         double response;                         /**< ICMP ECHO response time [ms] */
+        struct {
+                double min;                /**< Minimum ICMP ECHO response time [ms] */
+                double max;                /**< Maximum ICMP ECHO response time [ms] */
+                double loss;                       /**< ICMP ECHO packet loss [%] */
+        } statistics;
         Outgoing_T outgoing;                                 /**< Outgoing address */
         EventAction_T action; /**< Description of the action upon event occurrence */
 
         /** For internal use */
+        bool is_prepared;       /**< The batch pinger has the result for this cycle */
         struct Icmp_T *next;                               /**< next icmp in chain */
 } *Icmp_T;
 
 
 typedef struct Dependant_T {
-        char *dependant;                            /**< name of dependant service */
+        const char *dependant;              /**< name of dependant service (atom) */
         char *dependant_urlescaped;     /**< URL escaped name of dependant service */
         StringBuffer_T dependant_htmlescaped; /**< HTML escaped name of dependant service */
 
         /** For internal use */
+        struct Service_T *service;    /**< The dependant service, resolved at parse */
         struct Dependant_T *next;             /**< next dependant service in chain */
 } *Dependant_T;
 
 
+/** The qualification expression with the operator resolved, see Util_getDoubleQExpression() */
+typedef bool (*DoubleQExpression_T)(double left, double right);
+
+
 /** Defines resource data */
 typedef struct Resource_T {
         Resource_Type resource_id;                     /**< Which value is checked */
         Operator_Type operator;                           /**< Comparison operator */
+        DoubleQExpression_T match;  /**< The comparison resolved from the operator */
         double limit;                                   /**< Limit of the resource */
+        Statistics_Rate_T statistic;     /**< Rate function of the I/O rate tests */
         EventAction_T action; /**< Description of the action upon event occurrence */
 
         /** For internal use */
@@ -812,14 +1147,21 @@ typedef struct ActionRate_T {
 /** Defines when to run a check for a service. This type supports both the old
  cycle based every statement and the new cron-format version */
 typedef struct Every_T {
-        Every_Type type; /**< 0 = not set, 1 = cycle, 2 = cron, 3 = negated cron */
+        Every_Type type; /**< 0 = not set, 1 = cycle, 2 = cron, 3 = negated cron, 4 = interval */
         time_t last_run;
+        long long next; /**< Monotonic clock time [ms] when the service check is due */
+        bool recheck; /**< Some rule is within its X of Y cycles window, check the service soon */
+        int stable; /**< Number of the consecutive checks without a failure */
         union {
                 struct {
                         int number; /**< Check this program at a given cycles */
                         int counter; /**< Counter for number. When counter == number, check */
                 } cycle; /**< Old cycle based every check */
-                char *cron; /* A crontab format string */
+                struct {
+                        char *string; /**< A crontab format string */
+                        TimeCron_T spec; /**< The crontab string parsed at the config load */
+                } cron;
+                int interval; /**< Check interval in seconds */
         } spec;
 } Every_T;
 
@@ -842,8 +1184,11 @@ typedef struct Program_T {
         time_t started;                      /**< When the sub-process was started */
         int timeout;           /**< Seconds the program may run until it is killed */
         int exitStatus;                 /**< Sub-process exit status for reporting */
+        bool worker;     /**< The sub-process is a persistent worker answering the checks */
+        bool pending;                 /**< The worker request was sent, not answered */
         StringBuffer_T lastOutput;                        /**< Last program output */
         StringBuffer_T inprogressOutput; /**< Output of the pending program instance */
+        struct ProgramOutput_T *output;        /**< The output capture of the program */
 } *Program_T;
 
 
@@ -853,6 +1198,9 @@ typedef struct Size_T {
         bool test_changes;       /**< true if we only should test for changes */
         Operator_Type operator;                           /**< Comparison operator */
         unsigned long long size;                               /**< Size watermark */
+        int growth;       /**< The growth rate interval [s] or 0 if not a rate test */
+        unsigned long long lastSize;       /**< The size in the last cycle (growth) */
+        long long lastTime;  /**< The monotonic time of the last size [ms] (growth) */
         EventAction_T action; /**< Description of the action upon event occurrence */
 
         /** For internal use */
@@ -860,6 +1208,17 @@ typedef struct Size_T {
 } *Size_T;
 
 
+/** Defines directory tree file count object */
+typedef struct FileCount_T {
+        Operator_Type operator;                           /**< Comparison operator */
+        unsigned long long limit;                        /**< File count watermark */
+        EventAction_T action; /**< Description of the action upon event occurrence */
+
+        /** For internal use */
+        struct FileCount_T *next;                    /**< next file count in chain */
+} *FileCount_T;
+
+
 /** Defines uptime object */
 typedef struct Uptime_T {
         Operator_Type operator;                           /**< Comparison operator */
@@ -871,6 +1230,30 @@ typedef struct Uptime_T {
 } *Uptime_T;
 
 
+/** Defines a response time percentile object */
+typedef struct Latency_T {
+        Operator_Type operator;                           /**< Comparison operator */
+        double percentile;                       /**< The percentile, e.g. 95 for p95 */
+        double limit;                                /**< Response time limit [ms] */
+        EventAction_T action; /**< Description of the action upon event occurrence */
+
+        /** For internal use */
+        struct Latency_T *next;                         /**< next latency in chain */
+} *Latency_T;
+
+
+typedef struct Trend_T {
+        Series_Metric metric;                                /**< Which value is checked */
+        Operator_Type operator;                           /**< Comparison operator */
+        double limit;                                        /**< Change limit [%] */
+        int period;                                     /**< Trend period [seconds] */
+        EventAction_T action; /**< Description of the action upon event occurrence */
+
+        /** For internal use */
+        struct Trend_T *next;                             /**< next trend in chain */
+} *Trend_T;
+
+
 typedef struct LinkStatus_T {
         EventAction_T action; /**< Description of the action upon event occurrence */
 
@@ -917,6 +1300,8 @@ typedef struct Checksum_T {
         bool test_changes;       /**< true if we only should test for changes */
         Hash_Type type;                   /**< The type of hash (e.g. md5 or sha1) */
         int   length;                                      /**< Length of the hash */
+        int   verify;   /**< Full verification interval [cycles], 0 if verified on change only */
+        int   cycles;             /**< Number of cycles since the last computation */
         MD_T  hash;                     /**< A checksum hash computed for the path */
         EventAction_T action; /**< Description of the action upon event occurrence */
 } *Checksum_T;
@@ -933,9 +1318,11 @@ typedef struct Perm_T {
 typedef struct Match_T {
         bool ignore;                                        /**< Ignore match */
         bool not;                                           /**< Invert match */
-        char    *match_string;                                   /**< Match string */ //FIXME: union?
-        char    *match_path;                         /**< File with matching rules */ //FIXME: union?
+        const char *match_string;                         /**< Match string (atom) */ //FIXME: union?
+        const char *match_path;             /**< File with matching rules (atom) */ //FIXME: union?
         regex_t *regex_comp;                                    /**< Match compile */
+        char *literal;          /**< Literal string required by the regex or NULL */
+        int index;                        /**< Literal index in the ContentMatch_T */
         StringBuffer_T log;   /**< The temporary buffer used to record the matches */
         EventAction_T action; /**< Description of the action upon event occurrence */
 
@@ -1017,6 +1404,7 @@ typedef struct FileSystem_T {
         //FIXME: union
         long long limit_absolute;                          /**< Watermark - blocks */
         float limit_percent;                              /**< Watermark - percent */
+        Statistics_Rate_T statistic;     /**< Rate function of the I/O rate tests */
         EventAction_T action; /**< Description of the action upon event occurrence */
 
         /** For internal use */
@@ -1077,11 +1465,35 @@ typedef struct FileSystemInfo_T {
                 struct Statistics_T write;       /**< Time spend by write [ms] */
                 struct Statistics_T wait;   /**< Time spend in wait queue [ms] */
                 struct Statistics_T run;     /**< Time spend in run queue [ms] */
+                struct Statistics_T io;          /**< Time spent doing I/O [ms] */
         } time;
         struct Device_T object;                             /**< Device object */
+        unsigned long long collected; /**< Last statistics collection start [ms] */
+        struct FilesystemJob_T *job;   /**< Pending statistics collection job */
 } *FileSystemInfo_T;
 
 
+/** The file identity and version, if unchanged, the file content is considered unchanged */
+typedef struct Fingerprint_T {
+        unsigned long long inode;
+        unsigned long long size;
+        unsigned long long mtime;                    /**< Modification time [ns] */
+        unsigned long long ctime;                       /**< Inode change time [ns] */
+} Fingerprint_T;
+
+
+/** Defines certificate file expiry check object */
+typedef struct Certificate_T {
+        int minimumDays;                /**< Minimum days the certificate remains valid */
+        EventAction_T action; /**< Description of the action upon event occurrence */
+
+        /** For internal use */
+        time_t expiry;                      /**< The certificate notAfter time [s] */
+        Fingerprint_T fingerprint;    /**< The file fingerprint when it was parsed */
+        struct Certificate_T *next;                 /**< next certificate in chain */
+} *Certificate_T;
+
+
 typedef struct FileInfo_T {
         struct TimestampInfo_T timestamp;
         int mode;                                              /**< Permission */
@@ -1092,6 +1504,15 @@ typedef struct FileInfo_T {
         ino_t inode;                                                /**< Inode */
         ino_t inode_prev;               /**< Previous inode for regex matching */
         MD_T  cs_sum;                                            /**< Checksum */ //FIXME: allocate dynamically only when necessary
+        Fingerprint_T fingerprint;                /**< Fingerprint from the last stat */
+        Fingerprint_T cs_fingerprint;      /**< Fingerprint when cs_sum was computed */
+        struct {
+                bool open;                       /**< The file is tailed via fd */
+                int fd;                     /**< Descriptor of the tailed file */
+                ino_t inode;                     /**< Inode of the tailed file */
+                int length;                             /**< Signature length */
+                char signature[32];   /**< Content preceding the read position */
+        } tail;
 } *FileInfo_T;
 
 
@@ -1100,6 +1521,14 @@ typedef struct DirectoryInfo_T {
         int mode;                                              /**< Permission */
         int uid;                                              /**< Owner's uid */
         int gid;                                              /**< Owner's gid */
+        struct {
+                bool collected;      /**< true if the tree statistics are valid */
+                unsigned long long size;     /**< Size of the files in the tree */
+                unsigned long long files;         /**< Number of files in the tree */
+                time_t oldest;      /**< Modification time of the oldest file */
+                time_t newest;      /**< Modification time of the newest file */
+                struct DirectoryTree_T *cache;   /**< Cache of the tree walk */
+        } tree;
 } *DirectoryInfo_T;
 
 
@@ -1124,13 +1553,31 @@ typedef struct ProcessInfo_T {
         int children;
         unsigned long long mem;
         unsigned long long total_mem;
+        long long pss;           /**< Proportional set size [B] (-1 if unknown) */
+        long long uss;                /**< Unique set size [B] (-1 if unknown) */
         float mem_percent;                                     /**< percentage */
         float total_mem_percent;                               /**< percentage */
         float cpu_percent;                                     /**< percentage */
         float total_cpu_percent;                               /**< percentage */
+        float thread_cpu_percent;   /**< Busiest thread, percentage of one CPU */
         time_t uptime;                                     /**< Process uptime */
         struct IOStatistics_T read;                       /**< Read statistics */
         struct IOStatistics_T write;                     /**< Write statistics */
+        struct {
+                struct Statistics_T sent;                          /**< TCP bytes sent */
+                struct Statistics_T received;                  /**< TCP bytes received */
+        } tcp;
+        struct Statistics_T ioDelay;          /**< Time waiting for the block I/O [ns] */
+        struct {
+                int total;           /**< TCP connections (-1 if not collected) */
+                int established;                    /**< Established connections */
+                int listen;                                /**< Listening sockets */
+                int closeWait;                  /**< Connections in CLOSE_WAIT */
+        } connections;
+        struct {
+                unsigned long long time;  /**< Timestamp of the previous cpu time [ms] */
+                unsigned long long cpu;       /**< Previous cgroup cpu time [us] */
+        } cgroup;
         char secattr[STRLEN];                         /**< Security attributes */
         struct {
                 long long open;                        /**< number of opened files */
@@ -1165,26 +1612,39 @@ typedef union Info_T {
 typedef struct Service_T {
 
         /** Common parameters */
-        char *name;                                  /**< Service descriptive name */
+        const char *name;                    /**< Service descriptive name (atom) */
         char *name_urlescaped;                       /**< Service name URL escaped */
         StringBuffer_T name_htmlescaped;            /**< Service name HTML escaped */
         State_Type (*check)(struct Service_T *);/**< Service verification function */
         bool onrebootRestored;
+        bool stateDirty;   /**< Persistent state changed since the last save */
         bool visited; /**< Service visited flag, set if dependencies are used */
+        bool busy;       /**< The action of the service group is in progress */
+        bool cgroupAccounting;      /**< Process totals from the cgroup statistics */
+        bool remote;   /**< The service is checked by another cluster node (internal) */
+        int prefetch;       /**< The batched stat request index + 1 or 0 (internal) */
         Service_Type type;                             /**< Monitored service type */
         Monitor_State monitor;                             /**< Monitor state flag */
         Monitor_Mode mode;                    /**< Monitoring mode for the service */
         Onreboot_Type onreboot;                                /**< On reboot mode */
+        Priority_Type priority;      /**< Which services are deferred on overload */
         Action_Type doaction;                 /**< Action scheduled by http thread */
         int  ncycle;                          /**< The number of the current cycle */
         int  nstart;           /**< The number of current starts with this service */
+        unsigned long long events;          /**< The number of event state changes */
         Every_T every;              /**< Timespec for when to run check of service */
+        int fileEvent;                    /**< File event engine watch (internal) */
         command_t start;                    /**< The start command for the service */
         command_t stop;                      /**< The stop command for the service */
         command_t restart;                /**< The restart command for the service */
         Program_T program;                            /**< Program execution check */
 
         Dependant_T dependantlist;                     /**< Dependant service list */
+        /** The services which depend on this service (reverse of dependantlist) */
+        struct {
+                int count;                   /**< Number of the depending services */
+                struct Service_T **list;  /**< Depending services in the list order */
+        } children;
         Mail_T maillist;                       /**< Alert notification mailinglist */
 
         /** Test rules and event handlers */
@@ -1197,9 +1657,14 @@ typedef struct Service_T {
         Port_T      socketlist;                         /**< Unix sockets to check */
         Resource_T  resourcelist;                         /**< Resource check list */
         Size_T      sizelist;                                 /**< Size check list */
+        Certificate_T certificatelist;       /**< Certificate expiry check list */
+        FileCount_T filecountlist;             /**< Directory file count check list */
         Uptime_T    uptimelist;                             /**< Uptime check list */
+        Latency_T   latencylist;                     /**< Response time check list */
+        Trend_T     trendlist;                               /**< Trend check list */
         Match_T     matchlist;                             /**< Content Match list */
         Match_T     matchignorelist;                /**< Content Match ignore list */
+        struct ContentMatch_T *contentMatch;  /**< Content Match automaton (internal) */
         Timestamp_T timestamplist;                       /**< Timestamp check list */
         Pid_T       pidlist;                                   /**< Pid check list */
         Pid_T       ppidlist;                                 /**< PPid check list */
@@ -1236,6 +1701,13 @@ typedef struct Service_T {
         union Info_T       inf;                          /**< Service check result */
         struct timeval     collected;                /**< When were data collected */ //FIXME: replace with unsigned long long? (all places where timeval is used) ... Time_milli()?
         char              *token;                                /**< Action token */
+        Series_T           series;                   /**< Recent metrics (internal) */
+        Profile_T          profile;          /**< Check duration profile (internal) */
+        struct {
+                bool hung;      /**< The check is running over the check timeout */
+                int hangs;           /**< Number of the consecutive hung checks */
+                long long started;      /**< Start of the hung check [ms] (internal) */
+        } watchdog;
 
         /** Events */
         struct myevent {
@@ -1256,11 +1728,22 @@ typedef struct Service_T {
                 struct myevent   *next;                         /**< next event in chain */
         } *eventlist;                                     /**< Pending events list */
 
+        /** Index of the events by the event id and action (see event.c) */
+        struct {
+                int size;                 /**< Table size (power of 2), 0 = empty */
+                int count;                         /**< Number of indexed events */
+                struct myevent **table;              /**< Open addressing table */
+        } eventindex;
+
         /** Context specific parameters */
-        char *path;  /**< Path to the filesys, file, directory or process pid file */
+        const char *path; /**< Path to the filesys, file, directory or process pid file (atom) */
+        char *cgroup;        /**< The cgroup path or container ID of the process */
 
         /** For internal use */
         Mutex_T mutex;                  /**< Mutex used for action synchronization */
+        struct ServiceStatus_T *status;  /**< Status snapshot for the readers */
+        unsigned long long fingerprint;   /**< Hash of the service statement */
+        int position;                   /**< Position of the service in servicelist */
         struct Service_T *next;                         /**< next service in chain */
         struct Service_T *next_conf;      /**< next service according to conf file */
         struct Service_T *next_depend;           /**< next depend service in chain */
@@ -1279,6 +1762,19 @@ typedef struct ServiceGroup_T {
 } *ServiceGroup_T;
 
 
+/** The selection of the services in the JSON status, see status_json() */
+typedef struct StatusQuery_T {
+        const char *services;   /**< Comma separated service names or NULL for all */
+        const char *fields;    /**< Comma separated service members or NULL for all */
+        const char *match;    /**< Case-insensitive substring of the name or NULL */
+        int type;                             /**< The service type or -1 for all */
+        bool failed;                           /**< Select the failed services only */
+        const char *sort;   /**< "name", "type" or "status", "-" prefix descending */
+        int offset;                  /**< The number of the selected services to skip */
+        int limit;                 /**< The maximum number of services, negative for all */
+} StatusQuery_T;
+
+
 /** Data for application runtime */
 struct Run_T {
         uint8_t debug;                                            /**< Debug level */
@@ -1298,9 +1794,25 @@ struct Run_T {
         struct SslOptions_T ssl;                          /**< Default SSL options */
         int  polltime;        /**< In daemon mode, the sleeptime (sec) between run */
         int  startdelay;  /**< the sleeptime [s] on first start after machine boot */
+        int  workers;             /**< Number of threads used to validate services */
+        int  jitter;    /**< The schedule phase window in percent of the interval */
+        int  ratelimit;        /**< Max checks of one remote host per second, 0 = no limit */
+        int  recheck;   /**< The interval [s] while some rule changes state, 0 = off */
+        int  backoff;   /**< The stable checks which double the interval, 0 = off */
+        /** The validation cycles which took longer than the poll time */
+        struct {
+                int level;         /**< 0 = none, 1 = low, 2 = also normal priority deferred */
+                unsigned long long count;               /**< Number of the overruns */
+                long long duration;          /**< Duration of the last overrun [ms] */
+        } overrun;
+        int  processscanners;  /**< Number of threads reading the process table, 0 = auto */
+        char *procfs;            /**< The procfs root (Linux), NULL = /proc */
         int  facility;              /** The facility to use when running openlog() */
+        int  logrepeat;             /**< Max identical log messages per minute, 0 = no limit */
         int  eventlist_slots;          /**< The event queue size - number of slots */
+        int  eventlist_used;  /**< The number of queued events, -1 if not known */
         int mailserver_timeout; /**< Connect and read timeout ms for a SMTP server */
+        int mail_digest;      /**< Alert digest window in seconds, 0 = disabled */
         time_t incarnation;              /**< Unique ID for running monit instance */
         int  handler_queue[Handler_Max + 1];       /**< The handlers queue counter */
         Service_T system;                          /**< The general system service */
@@ -1323,8 +1835,17 @@ struct Run_T {
                         } unix;
                 } socket;
                 Auth_T credentials;
+                int workers;                 /**< Number of request handling threads */
+                int connections;               /**< Maximum number of open connections */
         } httpd;
 
+        /** Cluster mode, the services of the group are owned by one of the live nodes */
+        struct {
+                char *group;            /**< The group of the cluster services or NULL */
+                int timeout;             /**< The peer is down if it didn't reply [s] */
+                ClusterPeer_T peers;                        /**< The other cluster nodes */
+        } cluster;
+
         /** An object holding program relevant "environment" data, see: env.c */
         struct myenvironment {
                 char *user;             /**< The the effective user running this program */
@@ -1336,6 +1857,8 @@ struct Run_T {
         Mail_T maillist;                /**< Global alert notification mailinglist */
         MailServer_T mailservers;    /**< List of MTAs used for alert notification */
         Mmonit_T mmonits;        /**< Event notification and status receivers list */
+        Webhook_T webhooks;                    /**< Event notification webhooks list */
+        Mqtt_T mqtt;                 /**< The MQTT broker for the status or NULL */
         Auth_T mmonitcredentials;     /**< Pointer to selected credentials or NULL */
         /** User selected standard mail format */
         struct myformat {
@@ -1362,6 +1885,7 @@ extern SystemInfo_T   systeminfo;
 extern const char *actionnames[];
 extern const char *modenames[];
 extern const char *onrebootnames[];
+extern const char *prioritynames[];
 extern const char *checksumnames[];
 extern const char *operatornames[];
 extern const char *operatorshortnames[];
@@ -1386,9 +1910,16 @@ extern const char *httpmethod[];
 
 bool parse(char *);
 bool control_service(const char *, Action_Type);
-bool control_service_string(List_T, const char *);
+bool control_service_string(const char *, List_T, const char *);
+void control_queue(Service_T, Action_Type, bool);
+void control_run(void);
+bool control_collect(void);
+bool control_pending(void);
+void control_wait(void);
 void spawn(Service_T, command_t, Event_T);
+void spawn_reap(void);
 bool Log_init(void);
+void Log_start(void);
 void Log_emergency(const char *, ...) __attribute__((format (printf, 1, 2)));
 void Log_alert(const char *, ...) __attribute__((format (printf, 1, 2)));
 void Log_critical(const char *, ...) __attribute__((format (printf, 1, 2)));
@@ -1405,11 +1936,17 @@ void Log_vwarning(const char *,va_list ap) __attribute__((format (printf, 1, 0))
 void Log_vnotice(const char *, va_list ap) __attribute__((format (printf, 1, 0)));
 void Log_vinfo(const char *, va_list ap) __attribute__((format (printf, 1, 0)));
 void Log_vdebug(const char *, va_list ap) __attribute__((format (printf, 1, 0)));
+void Log_event(int priority, Service_T S, Event_T E);
 void Log_abort_handler(const char *s, va_list ap) __attribute__((format (printf, 1, 0))) __attribute__((noreturn));
 void Log_close(void);
 int   validate(void);
+long long validate_next(void);
+void  validate_reset(void);
 void  daemonize(void);
 void  gc(void);
+void  gc_exit(void);
+Service_T gc_reload(void);
+void  gc_carryover(Service_T *);
 void  gc_mail_list(Mail_T *);
 void  gccmd(command_t *);
 void  gc_event(Event_T *e);
@@ -1420,6 +1957,9 @@ void  init_env(void);
 void  monit_http(Httpd_Action);
 bool can_http(void);
 void set_signal_block(void);
+bool set_signal_wakeup(void);
+void signal_wakeup(void);
+bool signal_sleep(long long);
 State_Type check_process(Service_T);
 State_Type check_filesystem(Service_T);
 State_Type check_file(Service_T);
@@ -1431,6 +1971,14 @@ State_Type check_program(Service_T);
 State_Type check_net(Service_T);
 int  check_URL(Service_T s);
 void status_xml(StringBuffer_T, Event_T, int, const char *);
+int  status_xml_changes(StringBuffer_T, int, const char *, uint64_t *, int, bool);
+void status_cbor(StringBuffer_T, Event_T, const char *);
+int  status_cbor_changes(StringBuffer_T, uint64_t *, int, bool);
+void status_json(StringBuffer_T, StatusQuery_T *);
+int  status_json_changes(StringBuffer_T, uint64_t *, int, bool);
+char *status_json_etag(char *, int);
+void status_json_event(StringBuffer_T, Event_T);
+void status_metrics(StringBuffer_T);
 bool  do_wakeupcall(void);
 bool interrupt(void);
 
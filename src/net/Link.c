@@ -26,6 +26,8 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
@@ -91,14 +93,24 @@ static struct {
 } _stats = {};
 
 
+/*
+ * The history slots keep the counter value at the given minute and hour,
+ * so the delta over the last N minutes or hours is the difference of two
+ * slots. The slots are 32-bit fixed-point offsets from the base value:
+ * value = base + (slot << shift). The shift is raised only if the history
+ * spans more than 2^32 units, e.g. for bytes on fast links, where the
+ * precision loss of 2^shift is negligible against the delta.
+ */
 typedef struct LinkData_T {
 #ifndef __LP64__
         unsigned long long raw;
 #endif
         long long now;
         long long last;
-        unsigned long long minute[60];
-        unsigned long long hour[24];
+        unsigned long long base;
+        unsigned int shift;
+        uint32_t minute[60];
+        uint32_t hour[24];
 } LinkData_T;
 
 
@@ -173,10 +185,51 @@ static void _resetData(LinkData_T *data, unsigned long long value) {
         data->raw = value;
 #endif
         data->last = data->now = value;
+        data->base = value;
+        data->shift = 0;
+        memset(data->minute, 0, sizeof(data->minute));
+        memset(data->hour, 0, sizeof(data->hour));
+}
+
+
+static unsigned long long _getSlot(LinkData_T *data, uint32_t slot) {
+        return data->base + ((unsigned long long)slot << data->shift);
+}
+
+
+/**
+ * Re-encode the history, so the value fits the slots: the base is moved to
+ * the lowest value and the shift is the smallest which fits the range
+ */
+static void _rebase(LinkData_T *data, unsigned long long value) {
+        unsigned long long low = value, high = value;
+        for (int i = 0; i < 60; i++) {
+                unsigned long long v = _getSlot(data, data->minute[i]);
+                low = MIN(low, v);
+                high = MAX(high, v);
+        }
+        for (int i = 0; i < 24; i++) {
+                unsigned long long v = _getSlot(data, data->hour[i]);
+                low = MIN(low, v);
+                high = MAX(high, v);
+        }
+        unsigned int shift = 0;
+        while ((high - low) >> shift > UINT32_MAX)
+                shift++;
         for (int i = 0; i < 60; i++)
-                data->minute[i] = value;
+                data->minute[i] = (uint32_t)((_getSlot(data, data->minute[i]) - low) >> shift);
         for (int i = 0; i < 24; i++)
-                data->hour[i] = value;
+                data->hour[i] = (uint32_t)((_getSlot(data, data->hour[i]) - low) >> shift);
+        data->base = low;
+        data->shift = shift;
+}
+
+
+static void _updateData(LinkData_T *data, int minute, int hour) {
+        unsigned long long value = data->now;
+        if (value < data->base || (value - data->base) >> data->shift > UINT32_MAX)
+                _rebase(data, value);
+        data->minute[minute] = data->hour[hour] = (uint32_t)((value - data->base) >> data->shift);
 }
 
 
@@ -209,7 +262,7 @@ static long long _deltaMinute(T L, LinkData_T *data, int count) {
                 start = start < 59 ? start + 1 : 0;
         assert(start >= 0 && start < 60);
         assert(stop >= 0 && stop < 60);
-        return data->minute[stop] - data->minute[start];
+        return (long long)(_getSlot(data, data->minute[stop]) - _getSlot(data, data->minute[start]));
 }
 
 
@@ -221,12 +274,32 @@ static long long _deltaHour(T L, LinkData_T *data, int count) {
                 start = start < 23 ? start + 1 : 0;
         assert(start >= 0 && start < 24);
         assert(stop >= 0 && stop < 24);
-        return data->hour[stop] - data->hour[start];
+        return (long long)(_getSlot(data, data->hour[stop]) - _getSlot(data, data->hour[start]));
+}
+
+
+static void _updateCache(void) {
+#ifdef HAVE_IFADDRS_H
+        unsigned long long now = Time_milli();
+        // Refresh only if the statistics are older then 1 second (handle also backward time jumps)
+        if (now > _stats.timestamp + 1000 || now < _stats.timestamp - 1000) {
+                _stats.timestamp = now;
+                if (_stats.addrs) {
+                        freeifaddrs(_stats.addrs);
+                        _stats.addrs = NULL;
+                }
+                if (getifaddrs(&(_stats.addrs)) == -1) {
+                        _stats.timestamp = 0ULL;
+                        THROW(AssertException, "Cannot get network statistics -- %s", System_getError(errno));
+                }
+        }
+#endif
 }
 
 
 static const char *_findInterfaceForAddress(const char *address) {
 #ifdef HAVE_IFADDRS_H
+        _updateCache();
         for (struct ifaddrs *a = _stats.addrs; a != NULL; a = a->ifa_next) {
                 if (a->ifa_addr == NULL)
                         continue;
@@ -272,32 +345,13 @@ static void _updateHistory(T L) {
                 time_t now = L->timestamp.now / 1000.;
                 int minute = Time_minutes(now);
                 int hour =  Time_hour(now);
-                L->ibytes.minute[minute] = L->ibytes.hour[hour] = L->ibytes.now;
-                L->ipackets.minute[minute] = L->ipackets.hour[hour] = L->ipackets.now;
-                L->ierrors.minute[minute] = L->ierrors.hour[hour] = L->ierrors.now;
-                L->obytes.minute[minute] = L->obytes.hour[hour] = L->obytes.now;
-                L->opackets.minute[minute] = L->opackets.hour[hour] = L->opackets.now;
-                L->oerrors.minute[minute] = L->oerrors.hour[hour] = L->oerrors.now;
-        }
-}
-
-
-static void _updateCache(void) {
-#ifdef HAVE_IFADDRS_H
-        unsigned long long now = Time_milli();
-        // Refresh only if the statistics are older then 1 second (handle also backward time jumps)
-        if (now > _stats.timestamp + 1000 || now < _stats.timestamp - 1000) {
-                _stats.timestamp = now;
-                if (_stats.addrs) {
-                        freeifaddrs(_stats.addrs);
-                        _stats.addrs = NULL;
-                }
-                if (getifaddrs(&(_stats.addrs)) == -1) {
-                        _stats.timestamp = 0ULL;
-                        THROW(AssertException, "Cannot get network statistics -- %s", System_getError(errno));
-                }
+                _updateData(&(L->ibytes), minute, hour);
+                _updateData(&(L->ipackets), minute, hour);
+                _updateData(&(L->ierrors), minute, hour);
+                _updateData(&(L->obytes), minute, hour);
+                _updateData(&(L->opackets), minute, hour);
+                _updateData(&(L->oerrors), minute, hour);
         }
-#endif
 }
 
 
@@ -347,7 +401,9 @@ bool Link_isGetByAddressSupported(void) {
 
 
 void Link_update(T L) {
-        _updateCache();
+#ifndef LINUX
+        _updateCache(); // The statistics are read from the getifaddrs() data, on Linux the data are needed only to find the interface by address
+#endif
         const char *interface = L->resolve(L->object);
         if (_update(L, interface))
                 _updateHistory(L);
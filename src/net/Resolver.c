@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_CTYPE_H
+#include <ctype.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+
+#include "monit.h"
+#include "Resolver.h"
+
+// libmonit
+#include "system/Time.h"
+#include "util/Str.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ * Implementation of the caching host name resolver.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+// Lifetime of a resolved address [ms]
+#define TTL 60000
+
+// Lifetime of a resolution failure [ms]
+#define NEGATIVE_TTL 10000
+
+// How long an expired address may be used while it is refreshed [ms]
+#define STALE_TTL 60000
+
+#define BUCKETS 127
+
+
+typedef struct Entry_T {
+        char *hostname;
+        int family;
+        int socktype;
+        int protocol;
+        int flags;
+        int status;                         /**< getaddrinfo() status, 0 = OK */
+        bool refreshing;                  /**< A background refresh is running */
+        long long expires;
+        struct addrinfo *addresses;
+        /* For internal use */
+        struct Entry_T *next;
+} *Entry_T;
+
+
+static Entry_T _cache[BUCKETS] = {};
+static Mutex_T _mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static unsigned int _hash(const char *hostname, const struct addrinfo *hints) {
+        unsigned int h = hints->ai_family * 31 + hints->ai_socktype * 7 + hints->ai_protocol;
+        for (const char *p = hostname; *p; p++)
+                h = h * 33 + tolower((unsigned char)*p);
+        return h % BUCKETS;
+}
+
+
+static Entry_T _find(const char *hostname, const struct addrinfo *hints) {
+        for (Entry_T e = _cache[_hash(hostname, hints)]; e; e = e->next)
+                if (e->family == hints->ai_family && e->socktype == hints->ai_socktype && e->protocol == hints->ai_protocol && e->flags == hints->ai_flags && Str_isEqual(e->hostname, hostname))
+                        return e;
+        return NULL;
+}
+
+
+/* Copy the address list, each entry is allocated as one block with its address */
+static struct addrinfo *_copy(const struct addrinfo *source, int port) {
+        struct addrinfo *head = NULL, **tail = &head;
+        for (const struct addrinfo *s = source; s; s = s->ai_next) {
+                struct addrinfo *a = CALLOC(1, sizeof(struct addrinfo) + s->ai_addrlen);
+                a->ai_flags = s->ai_flags;
+                a->ai_family = s->ai_family;
+                a->ai_socktype = s->ai_socktype;
+                a->ai_protocol = s->ai_protocol;
+                a->ai_addrlen = s->ai_addrlen;
+                a->ai_addr = (struct sockaddr *)(a + 1);
+                memcpy(a->ai_addr, s->ai_addr, s->ai_addrlen);
+                if (port >= 0) {
+                        if (a->ai_family == AF_INET)
+                                ((struct sockaddr_in *)a->ai_addr)->sin_port = htons(port);
+#ifdef HAVE_IPV6
+                        else if (a->ai_family == AF_INET6)
+                                ((struct sockaddr_in6 *)a->ai_addr)->sin6_port = htons(port);
+#endif
+                }
+                *tail = a;
+                tail = &a->ai_next;
+        }
+        return head;
+}
+
+
+static int _resolve(const char *hostname, const struct addrinfo *hints, struct addrinfo **result) {
+        struct addrinfo *addresses = NULL;
+        long long start = Time_milli();
+        int status = getaddrinfo(hostname, NULL, hints, &addresses);
+        if (status == 0) {
+                *result = _copy(addresses, -1);
+                freeaddrinfo(addresses);
+        }
+        DEBUG("Resolved %s in %lldms%s\n", hostname, Time_milli() - start, status ? " (failed)" : "");
+        return status;
+}
+
+
+/* Store the result in the entry, must be called with the mutex locked */
+static void _update(Entry_T e, int status, struct addrinfo *addresses) {
+        long long now = Time_milli();
+        if (status == 0) {
+                Resolver_free(&e->addresses);
+                e->addresses = addresses;
+                e->status = 0;
+                e->expires = now + TTL;
+        } else if (status == EAI_AGAIN && e->addresses) {
+                // Temporary failure, keep using the last known addresses for a while
+                e->expires = now + NEGATIVE_TTL;
+        } else {
+                Resolver_free(&e->addresses);
+                e->status = status;
+                e->expires = now + NEGATIVE_TTL;
+        }
+}
+
+
+static void *_refresh(void *args) {
+        Entry_T key = args;
+        struct addrinfo hints = {.ai_family = key->family, .ai_socktype = key->socktype, .ai_protocol = key->protocol, .ai_flags = key->flags};
+        struct addrinfo *addresses = NULL;
+        int status = _resolve(key->hostname, &hints, &addresses);
+        LOCK(_mutex)
+        {
+                // The entry may have been flushed in the meantime
+                Entry_T e = _find(key->hostname, &hints);
+                if (e && status != EAI_SYSTEM) {
+                        _update(e, status, addresses);
+                        addresses = NULL;
+                }
+                if (e)
+                        e->refreshing = false;
+        }
+        END_LOCK;
+        Resolver_free(&addresses);
+        FREE(key->hostname);
+        FREE(key);
+        return NULL;
+}
+
+
+static void _startRefresh(Entry_T e) {
+        Entry_T key;
+        NEW(key);
+        key->hostname = Str_dup(e->hostname);
+        key->family = e->family;
+        key->socktype = e->socktype;
+        key->protocol = e->protocol;
+        key->flags = e->flags;
+        TRY
+        {
+                Thread_T thread;
+                Thread_createDetached(&thread, _refresh, key);
+                e->refreshing = true;
+        }
+        ELSE
+        {
+                Log_error("Cannot start the DNS refresh thread for %s -- %s\n", e->hostname, Exception_frame.message);
+                FREE(key->hostname);
+                FREE(key);
+        }
+        END_TRY;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int Resolver_getAddress(const char *hostname, int port, const struct addrinfo *hints, struct addrinfo **result) {
+        ASSERT(hostname);
+        ASSERT(hints);
+        ASSERT(result);
+        int status = 0;
+        bool cached = false;
+        *result = NULL;
+        LOCK(_mutex)
+        {
+                Entry_T e = _find(hostname, hints);
+                if (e) {
+                        long long now = Time_milli();
+                        if (now < e->expires) {
+                                cached = true;
+                                status = e->status;
+                        } else if (e->status == 0 && now < e->expires + STALE_TTL) {
+                                // Use the expired addresses while the entry is refreshed
+                                if (! e->refreshing)
+                                        _startRefresh(e);
+                                cached = true;
+                        }
+                        if (cached && status == 0)
+                                *result = _copy(e->addresses, port);
+                }
+        }
+        END_LOCK;
+        if (cached)
+                return status;
+        struct addrinfo *addresses = NULL;
+        status = _resolve(hostname, hints, &addresses);
+        if (status != EAI_SYSTEM) {
+                LOCK(_mutex)
+                {
+                        Entry_T e = _find(hostname, hints);
+                        if (! e) {
+                                NEW(e);
+                                e->hostname = Str_dup(hostname);
+                                e->family = hints->ai_family;
+                                e->socktype = hints->ai_socktype;
+                                e->protocol = hints->ai_protocol;
+                                e->flags = hints->ai_flags;
+                                unsigned int bucket = _hash(hostname, hints);
+                                e->next = _cache[bucket];
+                                _cache[bucket] = e;
+                        }
+                        _update(e, status, addresses);
+                        status = e->status;
+                        if (status == 0)
+                                *result = _copy(e->addresses, port);
+                }
+                END_LOCK;
+        } else {
+                Resolver_free(&addresses);
+        }
+        return status;
+}
+
+
+void Resolver_free(struct addrinfo **result) {
+        ASSERT(result);
+        for (struct addrinfo *a = *result, *next = NULL; a; a = next) {
+                next = a->ai_next;
+                FREE(a);
+        }
+        *result = NULL;
+}
+
+
+void Resolver_flush(void) {
+        LOCK(_mutex)
+        {
+                for (int i = 0; i < BUCKETS; i++) {
+                        for (Entry_T e = _cache[i], next = NULL; e; e = next) {
+                                next = e->next;
+                                Resolver_free(&e->addresses);
+                                FREE(e->hostname);
+                                FREE(e);
+                        }
+                        _cache[i] = NULL;
+                }
+        }
+        END_LOCK;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#ifndef RESOLVER_INCLUDED
+#define RESOLVER_INCLUDED
+
+
+/**
+ * Caching host name resolver. The getaddrinfo(3) results are cached in
+ * the process for a minute, failures for ten seconds. An expired entry
+ * is returned for one more minute while it is refreshed in the
+ * background, so a slow DNS server doesn't delay the checks.
+ *
+ * The system resolver doesn't expose the DNS record TTL, so a fixed TTL
+ * is used.
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/**
+ * Translate the hostname to a list of addresses like getaddrinfo(3).
+ * @param hostname The name of the host
+ * @param port The port number to set in the addresses (0 for none)
+ * @param hints The address family, socket type, protocol and flags
+ * @param result The address list is stored in result. It must be
+ * released with Resolver_free()
+ * @return 0 on success, otherwise a getaddrinfo(3) error code (the
+ * EAI_SYSTEM error is not cached and errno is set)
+ */
+int Resolver_getAddress(const char *hostname, int port, const struct addrinfo *hints, struct addrinfo **result);
+
+
+/**
+ * Release the address list returned by Resolver_getAddress()
+ * @param result The address list reference
+ */
+void Resolver_free(struct addrinfo **result);
+
+
+/**
+ * Remove all entries from the cache (e.g. on reload)
+ */
+void Resolver_flush(void);
+
+
+#endif
@@ -64,6 +64,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
@@ -138,6 +142,7 @@
 
 #include "monit.h"
 #include "net.h"
+#include "Resolver.h"
 
 // libmonit
 #include "util/Convert.h"
@@ -157,6 +162,22 @@
 /* ----------------------------------------------------------------- Private */
 
 
+#define PING_INTERVAL 200000  // Minimum spacing of the batch ping rounds [us]
+#define PING_RATE     500     // Maximum batch ping send rate [packets per second]
+
+
+typedef struct PingTarget_T {
+        Service_T service;
+        Icmp_T icmp;
+        struct addrinfo *result;
+        int socket;
+        uint16_t id;
+        int received;
+        double sum;
+        long long *sent;   // Timestamp of the echo request per sequence [us], 0 if not sent, -1 if answered
+} *PingTarget_T;
+
+
 /*
  * Compute Internet Checksum for "count" bytes beginning at location "addr".
  * Based on RFC1071.
@@ -381,29 +402,66 @@ static bool _sendPing(const char *hostname, int socket, struct addrinfo *addr, i
 }
 
 
-static double _receivePing(const char *hostname, int socket, struct addrinfo *addr, int retry, int maxretries, int out_id, long long started, int timeout) {
-        int in_len = 0, read_timeout = timeout;
-        uint16_t in_id = 0, in_seq = 0;
-        unsigned char *data = NULL;
+/*
+ * Check whether the packet read from the raw socket is an ICMP echo reply and get its id, sequence and payload
+ */
+static bool _isPingReply(struct sockaddr_storage *in_addr, char *buf, ssize_t n, uint16_t *in_id, uint16_t *in_seq, unsigned char **data) {
         struct icmp *in_icmp4;
-        struct ip *in_iphdr4;
 #ifdef HAVE_IPV6
         struct icmp6_hdr *in_icmp6;
 #endif
-        ssize_t n;
-        char buf[ICMP_MAXSIZE] = {};
-        switch (addr->ai_family) {
+        switch (in_addr->ss_family) {
                 case AF_INET:
-                        in_len = 36; // 20 bytes for IP header + 8 bytes for minimum ICMP fields (type, code, checksum, id, seq) + 8 bytes for data payload
-                        break;
+                        if (n < 36) // 20 bytes for IP header + 8 bytes for minimum ICMP fields (type, code, checksum, id, seq) + 8 bytes for data payload
+                                return false;
+                        in_icmp4 = (struct icmp *)(buf + ((struct ip *)buf)->ip_hl * 4);
+                        if ((char *)in_icmp4 + offsetof(struct icmp, icmp_data) > buf + n)
+                                return false;
+                        *in_id = ntohs(in_icmp4->icmp_id);
+                        *in_seq = ntohs(in_icmp4->icmp_seq);
+                        *data = (unsigned char *)in_icmp4->icmp_data;
+                        return in_icmp4->icmp_type == ICMP_ECHOREPLY;
 #ifdef HAVE_IPV6
                 case AF_INET6:
-                        in_len = sizeof(struct icmp6_hdr);
-                        break;
+                        if (n < (ssize_t)sizeof(struct icmp6_hdr))
+                                return false;
+                        in_icmp6 = (struct icmp6_hdr *)buf;
+                        *in_id = ntohs(in_icmp6->icmp6_id);
+                        *in_seq = ntohs(in_icmp6->icmp6_seq);
+                        *data = (unsigned char *)(in_icmp6 + 1);
+                        return in_icmp6->icmp6_type == ICMP6_ECHO_REPLY;
 #endif
                 default:
-                        break;
+                        return false;
+        }
+}
+
+
+/*
+ * Check whether the packet read from the raw socket came from the pinged address
+ */
+static bool _isPingAddress(struct sockaddr_storage *in_addr, struct addrinfo *addr) {
+        if (in_addr->ss_family != addr->ai_family)
+                return false;
+        switch (in_addr->ss_family) {
+                case AF_INET:
+                        return memcmp(&((struct sockaddr_in *)in_addr)->sin_addr, &((struct sockaddr_in *)(addr->ai_addr))->sin_addr, sizeof(struct in_addr)) ? false : true;
+#ifdef HAVE_IPV6
+                case AF_INET6:
+                        return memcmp(&((struct sockaddr_in6 *)in_addr)->sin6_addr, &((struct sockaddr_in6 *)(addr->ai_addr))->sin6_addr, sizeof(struct in6_addr)) ? false : true;
+#endif
+                default:
+                        return false;
         }
+}
+
+
+static double _receivePing(const char *hostname, int socket, struct addrinfo *addr, int retry, int maxretries, int out_id, long long started, int timeout) {
+        int read_timeout = timeout;
+        uint16_t in_id = 0, in_seq = 0;
+        unsigned char *data = NULL;
+        ssize_t n;
+        char buf[ICMP_MAXSIZE] = {};
         while (read_timeout > 0 && Net_canRead(socket, read_timeout)) {
                 if (Run.flags & Run_Stopped) {
                         return -1.;
@@ -411,41 +469,15 @@ static double _receivePing(const char *hostname, int socket, struct addrinfo *ad
                 long long stopped = Time_micro();
                 struct sockaddr_storage in_addr;
                 socklen_t addrlen = sizeof(in_addr);
-                bool in_addrmatch = false, in_typematch = false;
                 do {
                         n = recvfrom(socket, buf, sizeof(buf), 0, (struct sockaddr *)&in_addr, &addrlen);
                 } while (n == -1 && errno == EINTR);
                 if (n < 0) {
                         _log_warningOrError(retry, maxretries, "Ping response from %s %d/%d failed -- %s\n", hostname, retry, maxretries, STRERROR);
                         return -1.;
-                } else if (n >= in_len) {
-                        /* read from raw socket via recvfrom() provides messages regardless of origin, we have to check the IP and skip responses belonging to other conversations or different ICMP types (n < in_len) */
-                        switch (in_addr.ss_family) {
-                                case AF_INET:
-                                        in_addrmatch = memcmp(&((struct sockaddr_in *)&in_addr)->sin_addr, &((struct sockaddr_in *)(addr->ai_addr))->sin_addr, sizeof(struct in_addr)) ? false : true;
-                                        in_iphdr4 = (struct ip *)buf;
-                                        in_icmp4 = (struct icmp *)(buf + in_iphdr4->ip_hl * 4);
-                                        in_typematch = in_icmp4->icmp_type == ICMP_ECHOREPLY ? true : false;
-                                        in_id = ntohs(in_icmp4->icmp_id);
-                                        in_seq = ntohs(in_icmp4->icmp_seq);
-                                        data = (unsigned char *)in_icmp4->icmp_data;
-                                        break;
-#ifdef HAVE_IPV6
-                                case AF_INET6:
-                                        in_addrmatch = memcmp(&((struct sockaddr_in6 *)&in_addr)->sin6_addr, &((struct sockaddr_in6 *)(addr->ai_addr))->sin6_addr, sizeof(struct in6_addr)) ? false : true;
-                                        in_icmp6 = (struct icmp6_hdr *)buf;
-                                        in_typematch = in_icmp6->icmp6_type == ICMP6_ECHO_REPLY ? true : false;
-                                        in_id = ntohs(in_icmp6->icmp6_id);
-                                        in_seq = ntohs(in_icmp6->icmp6_seq);
-                                        data = (unsigned char *)(in_icmp6 + 1);
-                                        break;
-#endif
-                                default:
-                                        Log_error("Invalid address family: %d\n", in_addr.ss_family);
-                                        return -1.;
-                        }
                 }
-                if (n < in_len || in_addr.ss_family != addr->ai_family || ! in_addrmatch || ! in_typematch || in_id != out_id || in_seq > (uint16_t)maxretries) {
+                /* read from raw socket via recvfrom() provides messages regardless of origin, we have to check the IP and skip responses belonging to other conversations or different ICMP types */
+                if (! _isPingReply(&in_addr, buf, n, &in_id, &in_seq, &data) || ! _isPingAddress(&in_addr, addr) || in_id != out_id || in_seq > (uint16_t)maxretries) {
                         // Try to read next packet, but don't exceed the timeout while waiting for our response so we won't loop forever if the socket is flooded with other ICMP packets
                         if (stopped < started) {
                                 // Time jumped
@@ -465,31 +497,91 @@ static double _receivePing(const char *hostname, int socket, struct addrinfo *ad
 }
 
 
-double icmp_echo(const char *hostname, Socket_Family family, Outgoing_T *outgoing, int size, int timeout, int maxretries) {
-        ASSERT(hostname);
-        ASSERT(size > 0);
-        double response = -1.;
-        struct addrinfo *result, hints = {
-                /* filter for only one sockettype to not get back one address multiple times for each protocol and sockettype */
-                .ai_socktype = SOCK_RAW,
-        };
+static bool _setPingHints(Socket_Family family, struct addrinfo *hints) {
         switch (family) {
                 case Socket_Ip:
-                        hints.ai_family = AF_UNSPEC;
-                        break;
+                        hints->ai_family = AF_UNSPEC;
+                        return true;
                 case Socket_Ip4:
-                        hints.ai_family = AF_INET;
-                        break;
+                        hints->ai_family = AF_INET;
+                        return true;
 #ifdef HAVE_IPV6
                 case Socket_Ip6:
-                        hints.ai_family = AF_INET6;
-                        break;
+                        hints->ai_family = AF_INET6;
+                        return true;
 #endif
                 default:
                         Log_error("Invalid socket family %d\n", family);
-                        return response;
+                        return false;
         }
-        int status = getaddrinfo(hostname, NULL, &hints, &result);
+}
+
+
+static int _newPingSocket(int family) {
+        switch (family) {
+                case AF_INET:
+                        return socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+#ifdef HAVE_IPV6
+                case AF_INET6:
+                        return socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6);
+#endif
+                default:
+                        errno = EAFNOSUPPORT;
+                        return -1;
+        }
+}
+
+
+/*
+ * Read one packet from the batch ping socket and match it to the target by the ICMP id, the sequence and the source address
+ */
+static int _receiveBatchPing(int socket, PingTarget_T targets, int count, uint16_t base) {
+        char buf[ICMP_MAXSIZE];
+        struct sockaddr_storage in_addr;
+        socklen_t addrlen = sizeof(in_addr);
+        uint16_t in_id = 0, in_seq = 0;
+        unsigned char *data = NULL;
+        ssize_t n;
+        do {
+                n = recvfrom(socket, buf, sizeof(buf), 0, (struct sockaddr *)&in_addr, &addrlen);
+        } while (n == -1 && errno == EINTR);
+        long long stopped = Time_micro();
+        if (n < 0) {
+                DEBUG("Ping response read failed -- %s\n", STRERROR);
+        } else if (_isPingReply(&in_addr, buf, n, &in_id, &in_seq, &data)) {
+                int i = (uint16_t)(in_id - base);
+                if (i < count) {
+                        PingTarget_T t = &targets[i];
+                        if (in_seq > 0 && in_seq <= t->icmp->count && t->sent[in_seq - 1] > 0 && _isPingAddress(&in_addr, t->result) && stopped - t->sent[in_seq - 1] <= t->icmp->timeout * 1000LL) {
+                                double response = (double)(stopped - t->sent[in_seq - 1]) / 1000.;
+                                t->sent[in_seq - 1] = -1;
+                                if (! t->received++) {
+                                        t->icmp->statistics.min = t->icmp->statistics.max = response;
+                                } else {
+                                        t->icmp->statistics.min = MIN(t->icmp->statistics.min, response);
+                                        t->icmp->statistics.max = MAX(t->icmp->statistics.max, response);
+                                }
+                                t->sum += response;
+                                DEBUG("Ping response for %s %d/%d succeeded -- received id=%d sequence=%d response_time=%s\n", t->service->path, in_seq, t->icmp->count, in_id, in_seq, Convert_time2str(response, (char[11]){}));
+                                return 1;
+                        }
+                }
+        }
+        return 0;
+}
+
+
+double icmp_echo(const char *hostname, Socket_Family family, Outgoing_T *outgoing, int size, int timeout, int maxretries) {
+        ASSERT(hostname);
+        ASSERT(size > 0);
+        double response = -1.;
+        struct addrinfo *result, hints = {
+                /* filter for only one sockettype to not get back one address multiple times for each protocol and sockettype */
+                .ai_socktype = SOCK_RAW,
+        };
+        if (! _setPingHints(family, &hints))
+                return response;
+        int status = Resolver_getAddress(hostname, 0, &hints, &result);
         if (status) {
                 Log_error("Ping for %s -- getaddrinfo failed: %s\n", hostname, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
                 return response;
@@ -497,20 +589,15 @@ double icmp_echo(const char *hostname, Socket_Family family, Outgoing_T *outgoin
         int s = -1;
         for (struct addrinfo *addr = result; addr && response < 0.; addr = addr->ai_next) {
                 if (outgoing->addrlen == 0 || outgoing->addrlen == addr->ai_addrlen) {
-                        switch (addr->ai_family) {
-                                case AF_INET:
-                                        s = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
-                                        break;
+                        if (addr->ai_family != AF_INET
 #ifdef HAVE_IPV6
-                                case AF_INET6:
-                                        s = socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6);
-                                        break;
+                            && addr->ai_family != AF_INET6
 #endif
-                                default:
-                                        Log_error("Ping for %s -- unknown address family: %d\n", hostname, addr->ai_family);
-                                        continue;
+                           ) {
+                                Log_error("Ping for %s -- unknown address family: %d\n", hostname, addr->ai_family);
+                                continue;
                         }
-                        if (s >= 0) {
+                        if ((s = _newPingSocket(addr->ai_family)) >= 0) {
                                 if (outgoing->ip && bind(s, (struct sockaddr *)&(outgoing->addr), outgoing->addrlen) < 0) {
                                         Log_error("Cannot bind to outgoing address -- %s\n", STRERROR);
                                 } else {
@@ -538,7 +625,113 @@ double icmp_echo(const char *hostname, Socket_Family family, Outgoing_T *outgoin
                 }
         }
 error:
-        freeaddrinfo(result);
+        Resolver_free(&result);
         return response;
 }
 
+
+
+void icmp_echo_batch(Service_T *hosts, int count) {
+        ASSERT(hosts);
+        int targets = 0, rounds = 0, outstanding = 0;
+        int sockets[2] = {-1, -1}; // AF_INET and AF_INET6 socket shared by all targets of the family
+        bool failed[2] = {};
+        for (int i = 0; i < count; i++)
+                for (Icmp_T icmp = hosts[i]->icmplist; icmp; icmp = icmp->next)
+                        targets++;
+        PingTarget_T target = CALLOC(targets ? targets : 1, sizeof(struct PingTarget_T));
+        uint16_t base = getpid() & 0xFFFF;
+        targets = 0;
+        for (int i = 0; i < count; i++) {
+                for (Icmp_T icmp = hosts[i]->icmplist; icmp; icmp = icmp->next) {
+                        // Hosts with an outgoing address or with multiple addresses are left to the serial icmp_echo(), which binds the socket and tries the addresses in turn
+                        if (icmp->type != ICMP_ECHO || icmp->outgoing.ip || icmp->count < 1)
+                                continue;
+                        struct addrinfo *result, hints = {
+                                .ai_socktype = SOCK_RAW,
+                        };
+                        if (! _setPingHints(icmp->family, &hints) || Resolver_getAddress(hosts[i]->path, 0, &hints, &result))
+                                continue;
+                        int f = result->ai_family == AF_INET ? 0 : 1;
+                        if (result->ai_next || failed[f]) {
+                                Resolver_free(&result);
+                                continue;
+                        }
+                        if (sockets[f] < 0) {
+                                if ((sockets[f] = _newPingSocket(result->ai_family)) < 0) {
+                                        DEBUG("Ping -- cannot create socket: %s\n", STRERROR);
+                                        failed[f] = true;
+                                        Resolver_free(&result);
+                                        continue;
+                                }
+                                _setPingOptions(sockets[f], result);
+                        }
+                        PingTarget_T t = &target[targets];
+                        t->service = hosts[i];
+                        t->icmp = icmp;
+                        t->result = result;
+                        t->socket = sockets[f];
+                        t->id = (uint16_t)(base + targets);
+                        t->sent = CALLOC(icmp->count, sizeof(long long));
+                        rounds = MAX(rounds, icmp->count);
+                        targets++;
+                }
+        }
+        // Send the echo requests round by round to all targets at the PING_RATE and demultiplex the replies while waiting for the next send slot
+        int round = 1, cursor = 0;
+        long long now = Time_micro(), next = now, started = now, deadline = now;
+        while (targets && ! (Run.flags & Run_Stopped)) {
+                now = Time_micro();
+                if (round <= rounds && now >= next) {
+                        PingTarget_T t = &target[cursor];
+                        if (round <= t->icmp->count) {
+                                if (_sendPing(t->service->path, t->socket, t->result, t->icmp->size, round, t->icmp->count, t->id, now)) {
+                                        t->sent[round - 1] = now;
+                                        deadline = MAX(deadline, now + t->icmp->timeout * 1000LL);
+                                        outstanding++;
+                                }
+                                next = now + 1000000 / PING_RATE;
+                        }
+                        if (++cursor == targets) {
+                                cursor = 0;
+                                round++;
+                                next = started = MAX(next, started + PING_INTERVAL);
+                        }
+                        continue;
+                }
+                if (round > rounds && (outstanding == 0 || now >= deadline))
+                        break;
+                long long wait = round <= rounds ? next - now : deadline - now;
+                struct pollfd fds[2] = {
+                        {.fd = sockets[0], .events = POLLIN},
+                        {.fd = sockets[1], .events = POLLIN}
+                };
+                int n = poll(fds, 2, (int)((wait + 999) / 1000));
+                if (n < 0 && errno != EINTR) {
+                        Log_error("Ping -- poll failed: %s\n", STRERROR);
+                        break;
+                }
+                for (int i = 0; i < 2 && n > 0; i++)
+                        if (fds[i].revents & POLLIN)
+                                outstanding -= _receiveBatchPing(fds[i].fd, target, targets, base);
+        }
+        for (int i = 0; i < targets; i++) {
+                PingTarget_T t = &target[i];
+                if (! (Run.flags & Run_Stopped)) {
+                        t->icmp->is_prepared = true;
+                        t->icmp->statistics.loss = 100. * (t->icmp->count - t->received) / t->icmp->count;
+                        if (t->received) {
+                                t->icmp->response = t->sum / t->received;
+                        } else {
+                                t->icmp->response = t->icmp->statistics.min = t->icmp->statistics.max = -1.;
+                                Log_error("Ping for %s failed -- no response within %s\n", t->service->path, Convert_time2str(t->icmp->timeout, (char[11]){}));
+                        }
+                }
+                Resolver_free(&t->result);
+                FREE(t->sent);
+        }
+        FREE(target);
+        for (int i = 0; i < 2; i++)
+                if (sockets[i] >= 0)
+                        Net_close(sockets[i]);
+}
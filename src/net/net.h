@@ -78,4 +78,19 @@ int create_server_socket_unix(const char *path, int backlog, char error[STRLEN])
  */
 double icmp_echo(const char *hostname, Socket_Family family, Outgoing_T *outgoing, int size, int timeout, int count);
 
+
+/**
+ * Ping the hosts at once: the echo requests are sent in rounds to all
+ * hosts through one raw socket per address family at a limited rate and
+ * the replies are matched to the host by the ICMP id and sequence. The
+ * result is stored in the host's Icmp_T object (response time average,
+ * minimum, maximum and packet loss) and the object is marked as prepared.
+ * Ping tests which use an outgoing address, whose host has more than one
+ * address or which cannot create the socket are left unprepared for the
+ * icmp_echo() test.
+ * @param hosts The remote host services to ping
+ * @param count The number of services
+ */
+void icmp_echo_batch(Service_T *hosts, int count);
+
 #endif
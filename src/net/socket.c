@@ -76,6 +76,8 @@
 #include "monit.h"
 #include "socket.h"
 #include "SslServer.h"
+#include "Resolver.h"
+#include "probe.h"
 
 // libmonit
 #include "exceptions/assert.h"
@@ -102,9 +104,15 @@ typedef enum {
 } __attribute__((__packed__)) Connection_Type;
 
 
-// One TCP frame data size
+// Initial read buffer size: one TCP frame data size
 #define RBUFFER_SIZE 1460
 
+// Maximum read buffer size. The buffer grows when a read fills it up, i.e. when more data is likely pending
+#define RBUFFER_MAX 65536
+
+// Delay before connecting to the next address of the host if the previous attempt didn't finish yet [ms] (RFC 8305)
+#define CONNECT_DELAY 250
+
 
 #define T Socket_T
 struct T {
@@ -116,41 +124,81 @@ struct T {
         int timeout; // milliseconds
         int length;
         int offset;
+        int capacity;
         char *host;
         Port_T Port;
 #ifdef HAVE_OPENSSL
         Ssl_T ssl;
         SslServer_T sslserver;
 #endif
-        unsigned char buffer[RBUFFER_SIZE + 1];
+        unsigned char *buffer;
 };
 
 
+/* State of the connection to one port in Socket_connectPorts() */
+typedef struct Target_T {
+        Port_T port;
+        struct addrinfo *result;
+        struct addrinfo *next;               /**< The next address to connect to */
+        int pending;                      /**< Number of connections in progress */
+        bool done;
+        long long start;                                      /**< Start time [μs] */
+        long long deadline;                                          /**< Timeout [ms] */
+        long long launch;           /**< Time to connect to the next address [ms] */
+        char error[STRLEN];
+} *Target_T;
+
+
+/* A connection in progress in Socket_connectPorts() */
+typedef struct Attempt_T {
+        int socket;
+        struct addrinfo *address;
+        Target_T target;
+} *Attempt_T;
+
+
 /* --------------------------------------------------------------- Private */
 
 
 /*
- * Fill the internal buffer. If an error occurs or if the read
- * operation timed out -1 is returned.
+ * Fill the internal buffer. The unread data are moved to the start of
+ * the buffer and new data are appended. The buffer is allocated on the
+ * first read and doubles up to RBUFFER_MAX whenever a read fills it up.
+ * If an error occurs or if the read operation timed out -1 is returned.
  * @param S A Socket object
  * @param timeout The number of milliseconds to wait for data to be read
  * @return the length of data read or -1 if an error occurred
  */
 static int _fill(T S, int timeout) {
-        S->offset = 0;
-        S->length = 0;
+        if (S->offset > 0) {
+                S->length -= S->offset;
+                if (S->length > 0)
+                        memmove(S->buffer, S->buffer + S->offset, S->length);
+                S->offset = 0;
+        }
+        if (! S->buffer) {
+                S->capacity = RBUFFER_SIZE;
+                S->buffer = ALLOC(S->capacity);
+        } else if (S->length == S->capacity && S->capacity < RBUFFER_MAX) {
+                S->capacity = MIN(S->capacity * 2, RBUFFER_MAX);
+                RESIZE(S->buffer, S->capacity);
+        }
         if (S->type == Socket_Udp)
                 timeout = 500;
         int n;
 #ifdef HAVE_OPENSSL
         if (S->ssl)
-                n = Ssl_read(S->ssl, S->buffer + S->length, RBUFFER_SIZE - S->length, timeout);
+                n = Ssl_read(S->ssl, S->buffer + S->length, S->capacity - S->length, timeout);
         else
 #endif
-                n = (int)Net_read(S->socket, S->buffer + S->length,  RBUFFER_SIZE - S->length, timeout);
-        if (n > 0)
+                n = (int)Net_read(S->socket, S->buffer + S->length, S->capacity - S->length, timeout);
+        if (n > 0) {
                 S->length += n;
-        else if (n < 0)
+                if (S->length == S->capacity && S->capacity < RBUFFER_MAX) {
+                        S->capacity = MIN(S->capacity * 2, RBUFFER_MAX);
+                        RESIZE(S->buffer, S->capacity);
+                }
+        } else if (n < 0)
                 return -1;
         else if (! (errno == EAGAIN || errno == EWOULDBLOCK)) // Peer closed connection
                 return -1;
@@ -226,9 +274,24 @@ static bool _doConnect(int s, const struct sockaddr *addr, socklen_t addrlen, in
 }
 
 
+static T _newIpSocket(int s, int family, int type, const char *host, int port, int timeout) {
+        T S;
+        NEW(S);
+        S->socket = s;
+        S->type = type;
+        S->family = family == AF_INET ? Socket_Ip4 : Socket_Ip6;
+        S->timeout = timeout;
+        S->host = Str_dup(host);
+        S->port = port;
+        S->connection_type = Connection_Client;
+        return S;
+}
+
+
 static T _createIpSocket(const char *host, const struct sockaddr *addr, socklen_t addrlen, const struct sockaddr *localaddr, socklen_t localaddrlen, int family, int type, int protocol, int timeout) {
         ASSERT(host);
         char error[STRLEN];
+        PROBE2(connect__start, host, _getPort(addr));
         int s = socket(family, type, protocol);
         if (s >= 0) {
                 if (localaddr) {
@@ -240,16 +303,8 @@ static T _createIpSocket(const char *host, const struct sockaddr *addr, socklen_
                 if (Net_setNonBlocking(s)) {
                         if (fcntl(s, F_SETFD, FD_CLOEXEC) != -1) {
                                 if (_doConnect(s, addr, addrlen, timeout, error, sizeof(error))) {
-                                        T S;
-                                        NEW(S);
-                                        S->socket = s;
-                                        S->type = type;
-                                        S->family = family == AF_INET ? Socket_Ip4 : Socket_Ip6;
-                                        S->timeout = timeout;
-                                        S->host = Str_dup(host);
-                                        S->port = _getPort(addr);
-                                        S->connection_type = Connection_Client;
-                                        return S;
+                                        PROBE3(connect__done, host, _getPort(addr), 1);
+                                        return _newIpSocket(s, family, type, host, _getPort(addr), timeout);
                                 }
                         } else {
                                 snprintf(error, sizeof(error), "Cannot set socket close on exec -- %s", STRERROR);
@@ -262,12 +317,13 @@ error:
         } else {
                 snprintf(error, sizeof(error), "Cannot create socket to %s -- %s", _addressToString(addr, addrlen, (char[2048]){}, 2048), STRERROR);
         }
+        PROBE3(connect__done, host, _getPort(addr), 0);
         THROW(IOException, "%s", error);
         return NULL;
 }
 
 
-static struct addrinfo *_resolve(const char *hostname, int port, Socket_Type type, Socket_Family family) {
+static struct addrinfo *_resolve(const char *hostname, int port, Socket_Type type, Socket_Family family, double *duration) {
         ASSERT(hostname);
         struct addrinfo *result, hints = {
                 .ai_socktype = type,
@@ -292,9 +348,10 @@ static struct addrinfo *_resolve(const char *hostname, int port, Socket_Type typ
                         Log_error("Invalid socket family %d\n", family);
                         return NULL;
         }
-        char _port[6];
-        snprintf(_port, sizeof(_port), "%d", port);
-        int status = getaddrinfo(hostname, _port, &hints, &result);
+        long long start = Time_micro();
+        int status = Resolver_getAddress(hostname, port, &hints, &result);
+        if (duration)
+                *duration += (double)(Time_micro() - start) / 1000.;
         if (status != 0) {
                 Log_error("Cannot translate '%s' to IP address -- %s\n", hostname, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
                 return NULL;
@@ -316,7 +373,7 @@ T Socket_create(const char *host, int port, Socket_Type type, Socket_Family fami
         ASSERT(host);
         ASSERT(timeout > 0);
         volatile T S = NULL;
-        struct addrinfo *result = _resolve(host, port, type, family);
+        struct addrinfo *result = _resolve(host, port, type, family, NULL);
         if (result) {
                 char error[512] = {};
                 // The host may resolve to multiple IPs and if at least one succeeded, we have no problem and don't have to flood the log with partial errors => log only the last error
@@ -336,7 +393,7 @@ T Socket_create(const char *host, int port, Socket_Type type, Socket_Family fami
                         }
                         END_TRY;
                 }
-                freeaddrinfo(result);
+                Resolver_free(&result);
                 if (! S)
                         Log_error("Cannot connect to [%s]:%d -- %s\n", host, port, error);
         }
@@ -461,6 +518,7 @@ void Socket_free(T *S) {
                 Net_shutdown((*S)->socket, SHUT_RDWR);
                 Net_close((*S)->socket);
         }
+        FREE((*S)->buffer);
         FREE((*S)->host);
         FREE(*S);
 }
@@ -549,17 +607,67 @@ const char *Socket_getLocalHost(T S, char *host, int hostlen) {
 }
 
 
+/*
+ * Keep the connection open for the next test if the port uses keepalive
+ */
+/*
+ * Get the port which holds the keepalive connection of the given port. The
+ * ports of a service with the same target and protocol share one connection.
+ */
+static Port_T _owner(Port_T p) {
+        return p->shared ? p->shared : p;
+}
+
+
+static void _pool(Port_T p, T *S) {
+        Port_T o = _owner(p);
+        if (p->keepalive && ! o->pooled) {
+                o->pooled = *S;
+                *S = NULL;
+        }
+}
+
+
+/*
+ * Test the connection kept open by keepalive using the protocol's ping. If the
+ * test fails, the connection is closed and the caller reconnects.
+ */
+static bool _testPooled(Port_T p) {
+        volatile bool rv = false;
+        Port_T volatile o = _owner(p);
+        TRY
+        {
+                o->pooled->Port = p;
+                p->protocol->ping(o->pooled);
+                rv = true;
+        }
+        ELSE
+        {
+                DEBUG("Keepalive connection to %s failed, reconnecting -- %s\n", p->family == Socket_Unix ? p->target.unix.pathname : p->hostname, Exception_frame.message);
+                Socket_free(&(o->pooled));
+        }
+        END_TRY;
+        return rv;
+}
+
+
 static void _testUnix(Port_T p) {
-        T S = Socket_createUnix(p->target.unix.pathname, p->type, p->timeout);
+        volatile int ok = 0;
+        volatile T S = Socket_createUnix(p->target.unix.pathname, p->type, p->timeout);
         if (S) {
                 S->Port = p;
+                PROBE3(protocol__start, p->target.unix.pathname, 0, p->protocol->name);
                 TRY
                 {
                         p->protocol->check(S);
+                        ok = 1;
+                        _pool(p, (T *)&S);
                 }
                 FINALLY
                 {
-                        Socket_free(&S);
+                        PROBE3(protocol__done, p->target.unix.pathname, 0, ok);
+                        if (S)
+                                Socket_free((T *)&S);
                 }
                 END_TRY;
         } else {
@@ -568,36 +676,99 @@ static void _testUnix(Port_T p) {
 }
 
 
+static void _checkProtocol(Port_T p, T S) {
+        volatile int ok = 0;
+        S->Port = p;
+        PROBE3(protocol__start, p->hostname, p->target.net.port, p->protocol->name);
+        TRY
+        {
+                if (p->target.net.ssl.options.flags == SSL_Enabled) {
+                        Socket_enableSsl(S, &(p->target.net.ssl.options), p->hostname);
+                }
+                p->protocol->check(S);
+                ok = 1;
+        }
+        FINALLY
+        {
+                PROBE3(protocol__done, p->hostname, p->target.net.port, ok);
+                // Set the minimum valid days past the protocol check as if the connection uses STARTTLS to switch plain->SSL, we have no SSL certificate information until the STARTTTLS is performed.
+                // Try to collect the certificate validDays even on protocol exception - the protocol test may fail on higher level (e.g. when HTTP returns 400), but we can still get certificate info
+#ifdef HAVE_OPENSSL
+                if (S->ssl)
+                        p->target.net.ssl.certificate.validDays = Ssl_getCertificateValidDays(S->ssl);
+#endif
+        }
+        END_TRY;
+}
+
+
+static void _resetPrepared(Port_T p) {
+        if (p->prepared.connected)
+                Net_close(p->prepared.socket);
+        p->prepared.connected = false;
+        FREE(p->prepared.error);
+}
+
+
+/*
+ * Test the protocol using the connection prepared by Socket_connectPorts().
+ * If the test fails, the other addresses of the host are tested the usual way
+ * (the address tested already is stored in tested).
+ */
+static bool _testPrepared(Port_T p, struct sockaddr_storage *tested, socklen_t *testedlen, char *error, int errorlen) {
+        volatile bool rv = false;
+        volatile T S = _newIpSocket(p->prepared.socket, p->prepared.addr.ss_family, SOCK_STREAM, p->hostname, p->target.net.port, p->timeout);
+        memcpy(tested, &(p->prepared.addr), p->prepared.addrlen);
+        *testedlen = p->prepared.addrlen;
+        p->prepared.connected = false; // The socket is owned by S now
+        TRY
+        {
+                _checkProtocol(p, S);
+                _pool(p, (T *)&S);
+                rv = true;
+        }
+        ELSE
+        {
+                snprintf(error, errorlen, "%s", Exception_frame.message);
+                DEBUG("Socket test failed for %s -- %s\n", _addressToString((struct sockaddr *)tested, *testedlen, (char[STRLEN]){}, STRLEN), error);
+        }
+        FINALLY
+        {
+                if (S)
+                        Socket_free((Socket_T *)&S);
+        }
+        END_TRY;
+        return rv;
+}
+
+
 static void _testIp(Port_T p) {
         char error[512];
+        struct sockaddr_storage tested;
+        socklen_t testedlen = 0;
         volatile Connection_State is_available = Connection_Failed;
-        struct addrinfo *result = _resolve(p->hostname, p->target.net.port, p->type, p->family);
+        if (p->prepared.error) {
+                // Socket_connectPorts() tried all addresses of the host already
+                snprintf(error, sizeof(error), "%s", p->prepared.error);
+                FREE(p->prepared.error);
+                THROW(IOException, "%s", error);
+        } else if (p->prepared.connected) {
+                if (_testPrepared(p, &tested, &testedlen, error, sizeof(error)))
+                        return;
+        }
+        struct addrinfo *result = _resolve(p->hostname, p->target.net.port, p->type, p->family, &(p->resolution));
         if (result) {
                 // The host may resolve to multiple IPs and if at least one succeeded, we have no problem and don't have to flood the log with partial errors => log only the last error
                 for (struct addrinfo *r = result; r && is_available != Connection_Ok; r = r->ai_next) {
-                        if (p->outgoing.addrlen == 0 || p->outgoing.addrlen == r->ai_addrlen) {
+                        if (testedlen && r->ai_addrlen == testedlen && memcmp(r->ai_addr, &tested, testedlen) == 0) {
+                                continue;
+                        } else if (p->outgoing.addrlen == 0 || p->outgoing.addrlen == r->ai_addrlen) {
                                 volatile T S = NULL;
                                 TRY
                                 {
                                         S = _createIpSocket(p->hostname, r->ai_addr, r->ai_addrlen, p->outgoing.addrlen ? (struct sockaddr *)&(p->outgoing.addr) : NULL, p->outgoing.addrlen, r->ai_family, r->ai_socktype, r->ai_protocol, p->timeout);
-                                        S->Port = p;
-                                        TRY
-                                        {
-                                                if (p->target.net.ssl.options.flags == SSL_Enabled) {
-                                                        Socket_enableSsl(S, &(p->target.net.ssl.options), p->hostname);
-                                                }
-                                                p->protocol->check(S);
-                                        }
-                                        FINALLY
-                                        {
-                                                // Set the minimum valid days past the protocol check as if the connection uses STARTTLS to switch plain->SSL, we have no SSL certificate information until the STARTTTLS is performed.
-                                                // Try to collect the certificate validDays even on protocol exception - the protocol test may fail on higher level (e.g. when HTTP returns 400), but we can still get certificate info
-#ifdef HAVE_OPENSSL
-                                                if (S->ssl)
-                                                        p->target.net.ssl.certificate.validDays = Ssl_getCertificateValidDays(S->ssl);
-#endif
-                                        }
-                                        END_TRY;
+                                        _checkProtocol(p, S);
+                                        _pool(p, (T *)&S);
                                         is_available = Connection_Ok;
 
                                 }
@@ -617,38 +788,229 @@ static void _testIp(Port_T p) {
                                 snprintf(error, sizeof(error), "No IP address matching '%s' was found", p->outgoing.ip);
                         }
                 }
-                freeaddrinfo(result);
+                Resolver_free(&result);
                 if (is_available != Connection_Ok)
                         THROW(IOException, "%s", error);
+        } else if (testedlen) {
+                THROW(IOException, "%s", error);
         } else {
                 THROW(IOException, "Cannot resolve [%s]:%d", p->hostname, p->target.net.port);
         }
 }
 
 
+/*
+ * Start a non-blocking connection to the address
+ * @return The socket or -1 if the connection failed immediately. If the
+ * connection was established already, connected is set to true
+ */
+static int _startConnect(Port_T p, struct addrinfo *r, bool *connected, char *error, int errorlen) {
+        int s = socket(r->ai_family, r->ai_socktype, r->ai_protocol);
+        if (s < 0) {
+                snprintf(error, errorlen, "Cannot create socket to %s -- %s", _addressToString(r->ai_addr, r->ai_addrlen, (char[STRLEN]){}, STRLEN), STRERROR);
+                return -1;
+        }
+        if (p->outgoing.addrlen && bind(s, (struct sockaddr *)&(p->outgoing.addr), p->outgoing.addrlen) < 0) {
+                snprintf(error, errorlen, "Cannot bind to outgoing address -- %s", STRERROR);
+        } else if (! Net_setNonBlocking(s)) {
+                snprintf(error, errorlen, "Cannot set nonblocking socket -- %s", STRERROR);
+        } else if (fcntl(s, F_SETFD, FD_CLOEXEC) == -1) {
+                snprintf(error, errorlen, "Cannot set socket close on exec -- %s", STRERROR);
+        } else if (connect(s, r->ai_addr, r->ai_addrlen) == 0) {
+                *connected = true;
+                return s;
+        } else if (errno == EINPROGRESS) {
+                return s;
+        } else {
+                snprintf(error, errorlen, "%s", STRERROR);
+        }
+        Net_close(s);
+        return -1;
+}
+
+
+static void _setConnected(Target_T t, int socket, struct addrinfo *r, Attempt_T attempts, int count) {
+        Port_T p = t->port;
+        p->prepared.connected = true;
+        p->prepared.socket = socket;
+        p->prepared.duration = Time_micro() - t->start;
+        memcpy(&(p->prepared.addr), r->ai_addr, r->ai_addrlen);
+        p->prepared.addrlen = r->ai_addrlen;
+        t->done = true;
+        // Cancel the connections to the other addresses of the host, the connected socket is owned by the port now
+        for (int i = 0; i < count; i++) {
+                if (attempts[i].target == t && attempts[i].socket >= 0) {
+                        if (attempts[i].socket != socket)
+                                Net_close(attempts[i].socket);
+                        attempts[i].socket = -1;
+                }
+        }
+        t->pending = 0;
+}
+
+
+static void _setFailed(Target_T t, Attempt_T attempts, int count) {
+        t->port->prepared.error = Str_dup(*t->error ? t->error : "Connection timed out");
+        t->done = true;
+        for (int i = 0; i < count; i++) {
+                if (attempts[i].target == t && attempts[i].socket >= 0) {
+                        Net_close(attempts[i].socket);
+                        attempts[i].socket = -1;
+                }
+        }
+        t->pending = 0;
+}
+
+
 /* ---------------------------------------------------------------- Public */
 
 
+void Socket_connectPorts(void *portlist) {
+        int count = 0;
+        for (Port_T p = portlist; p; p = p->next) {
+                _resetPrepared(p);
+                if (p->family != Socket_Unix && p->type == Socket_Tcp && ! _owner(p)->pooled)
+                        count++;
+        }
+        if (count == 0)
+                return;
+        int n = 0, addresses = 0;
+        Target_T targets = CALLOC(count, sizeof(struct Target_T));
+        for (Port_T p = portlist; p; p = p->next) {
+                if (p->family != Socket_Unix && p->type == Socket_Tcp && ! _owner(p)->pooled) {
+                        Target_T t = &targets[n++];
+                        t->port = p;
+                        p->resolution = 0.;
+                        t->result = t->next = _resolve(p->hostname, p->target.net.port, p->type, p->family, &(p->resolution));
+                        t->start = Time_micro();
+                        t->deadline = t->start / 1000 + p->timeout;
+                        if (! t->result)
+                                snprintf(t->error, sizeof(t->error), "Cannot resolve [%s]:%d", p->hostname, p->target.net.port);
+                        for (struct addrinfo *r = t->result; r; r = r->ai_next)
+                                addresses++;
+                }
+        }
+        int attempted = 0;
+        Attempt_T attempts = CALLOC(addresses + 1, sizeof(struct Attempt_T));
+        struct pollfd *fds = CALLOC(addresses + 1, sizeof(struct pollfd));
+        while (true) {
+                bool running = false;
+                long long now = Time_milli();
+                long long wakeup = now + 1000;
+                for (int i = 0; i < count; i++) {
+                        Target_T t = &targets[i];
+                        if (t->done)
+                                continue;
+                        if (now >= t->deadline) {
+                                snprintf(t->error, sizeof(t->error), "Connection timed out");
+                                _setFailed(t, attempts, attempted);
+                                continue;
+                        }
+                        // Connect to the next address if no connection is in progress or the previous one takes too long
+                        while (t->next && (t->pending == 0 || now >= t->launch)) {
+                                struct addrinfo *r = t->next;
+                                t->next = r->ai_next;
+                                if (t->port->outgoing.addrlen && t->port->outgoing.addrlen != r->ai_addrlen) {
+                                        snprintf(t->error, sizeof(t->error), "No IP address matching '%s' was found", t->port->outgoing.ip);
+                                        continue;
+                                }
+                                bool connected = false;
+                                int s = _startConnect(t->port, r, &connected, t->error, sizeof(t->error));
+                                if (s >= 0) {
+                                        attempts[attempted++] = (struct Attempt_T){.socket = s, .address = r, .target = t};
+                                        t->pending++;
+                                        t->launch = now + CONNECT_DELAY;
+                                        if (connected)
+                                                _setConnected(t, s, r, attempts, attempted);
+                                        break;
+                                }
+                        }
+                        if (t->done)
+                                continue;
+                        if (t->pending == 0 && ! t->next) {
+                                _setFailed(t, attempts, attempted);
+                                continue;
+                        }
+                        running = true;
+                        wakeup = MIN(wakeup, t->deadline);
+                        if (t->next)
+                                wakeup = MIN(wakeup, t->launch);
+                }
+                if (! running)
+                        break;
+                for (int i = 0; i < attempted; i++) {
+                        fds[i].fd = attempts[i].socket; // Negative descriptors are ignored by poll
+                        fds[i].events = POLLOUT;
+                        fds[i].revents = 0;
+                }
+                int rv = poll(fds, attempted, (int)MAX(wakeup - now, 0));
+                if (rv < 0 && errno != EINTR) {
+                        for (int i = 0; i < count; i++) {
+                                if (! targets[i].done) {
+                                        snprintf(targets[i].error, sizeof(targets[i].error), "Poll failed: %s", STRERROR);
+                                        _setFailed(&targets[i], attempts, attempted);
+                                }
+                        }
+                        break;
+                }
+                for (int i = 0; i < attempted && rv > 0; i++) {
+                        Attempt_T a = &attempts[i];
+                        if (a->socket >= 0 && fds[i].revents) {
+                                int error = 0;
+                                socklen_t errorlen = sizeof(error);
+                                if (getsockopt(a->socket, SOL_SOCKET, SO_ERROR, &error, &errorlen) < 0)
+                                        error = errno;
+                                if (error) {
+                                        snprintf(a->target->error, sizeof(a->target->error), "%s", strerror(error));
+                                        DEBUG("Cannot connect to %s -- %s\n", _addressToString(a->address->ai_addr, a->address->ai_addrlen, (char[STRLEN]){}, STRLEN), a->target->error);
+                                        Net_close(a->socket);
+                                        a->socket = -1;
+                                        a->target->pending--;
+                                        a->target->launch = 0; // Try the next address now
+                                } else {
+                                        _setConnected(a->target, a->socket, a->address, attempts, attempted);
+                                }
+                        }
+                }
+        }
+        for (int i = 0; i < count; i++)
+                if (targets[i].result)
+                        Resolver_free(&(targets[i].result));
+        FREE(fds);
+        FREE(attempts);
+        FREE(targets);
+}
+
+
 void Socket_test(void *P) {
         ASSERT(P);
         Port_T p = P;
         TRY
         {
-                long long start = Time_micro();
-                switch (p->family) {
-                        case Socket_Unix:
-                                _testUnix(p);
-                                break;
-                        case Socket_Ip:
-                        case Socket_Ip4:
-                        case Socket_Ip6:
-                                _testIp(p);
-                                break;
-                        default:
-                                THROW(IOException, "Invalid socket family %d\n", p->family);
-                                break;
+                // Include the connection time if the connection was made in advance by Socket_connectPorts(), the host name resolution time is reported separately
+                long long start = Time_micro() - (p->prepared.connected ? p->prepared.duration : 0);
+                if (! p->prepared.connected && ! p->prepared.error)
+                        p->resolution = 0.;
+                double resolution = p->resolution;
+                if (_owner(p)->pooled && _testPooled(p)) {
+                        // The connection kept open by keepalive is alive, no name resolution was needed
+                        p->resolution = resolution = 0.;
+                } else {
+                        switch (p->family) {
+                                case Socket_Unix:
+                                        _testUnix(p);
+                                        break;
+                                case Socket_Ip:
+                                case Socket_Ip4:
+                                case Socket_Ip6:
+                                        _testIp(p);
+                                        break;
+                                default:
+                                        THROW(IOException, "Invalid socket family %d\n", p->family);
+                                        break;
+                        }
                 }
-                p->response = (double)(Time_micro() - start) / 1000.; // Convert microseconds to milliseconds
+                p->response = (double)(Time_micro() - start) / 1000. - (p->resolution - resolution); // Convert microseconds to milliseconds
                 p->is_available = Connection_Ok;
         }
         ELSE
@@ -713,6 +1075,18 @@ int Socket_write(T S, const void *b, size_t size) {
 }
 
 
+bool Socket_hasPendingData(T S) {
+        ASSERT(S);
+        if (S->offset < S->length)
+                return true;
+#ifdef HAVE_OPENSSL
+        if (S->ssl && Ssl_pending(S->ssl) > 0)
+                return true;
+#endif
+        return false;
+}
+
+
 int Socket_readByte(T S) {
         ASSERT(S);
         if (S->offset >= S->length)
@@ -722,27 +1096,69 @@ int Socket_readByte(T S) {
 }
 
 
+const void *Socket_peek(T S, int *length) {
+        ASSERT(S);
+        ASSERT(length);
+        if (S->offset >= S->length)
+                if (_fill(S, S->timeout) <= 0)
+                        return NULL;
+        *length = S->length - S->offset;
+        return S->buffer + S->offset;
+}
+
+
+void Socket_consume(T S, int length) {
+        ASSERT(S);
+        ASSERT(length >= 0 && length <= S->length - S->offset);
+        S->offset += length;
+}
+
+
 int Socket_read(T S, void *b, int size) {
-        int c;
-        unsigned char *p = b;
+        int n = 0;
         ASSERT(S);
-        while ((size-- > 0) && ((c = Socket_readByte(S)) >= 0))
-                *p++ = c;
-        return (int)((long)p - (long)b);
+        while (n < size) {
+                int length;
+                const void *data = Socket_peek(S, &length);
+                if (! data)
+                        break;
+                length = MIN(length, size - n);
+                memcpy((unsigned char *)b + n, data, length);
+                Socket_consume(S, length);
+                n += length;
+        }
+        return n;
 }
 
 
 char *Socket_readLine(T S, char *s, int size) {
-        int c;
-        unsigned char *p = (unsigned char *)s;
+        int n = 0;
         ASSERT(S);
-        while (--size && ((c = Socket_readByte(S)) > 0)) { // Stop when \0 is read
-                *p++ = c;
-                if (c == '\n')
+        while (n < size - 1) {
+                int length;
+                const unsigned char *data = Socket_peek(S, &length);
+                if (! data)
+                        break;
+                length = MIN(length, size - 1 - n);
+                const unsigned char *newline = memchr(data, '\n', length);
+                if (newline)
+                        length = (int)(newline - data) + 1;
+                const unsigned char *nul = memchr(data, 0, length);
+                if (nul) { // Stop when \0 is read
+                        memcpy(s + n, data, nul - data);
+                        Socket_consume(S, (int)(nul - data) + 1);
+                        n += (int)(nul - data);
+                        break;
+                }
+                memcpy(s + n, data, length);
+                Socket_consume(S, length);
+                n += length;
+                if (newline)
                         break;
         }
-        *p = 0;
-        if (*s)
+        if (size > 0)
+                s[n] = 0;
+        if (n > 0)
                 return s;
         return NULL;
 }
@@ -204,6 +204,18 @@ int Socket_getLocalPort(T S);
 const char *Socket_getLocalHost(T S, char *host, int hostlen);
 
 
+/**
+ * Connect to all TCP ports in the list in parallel. The addresses of
+ * each host are tried concurrently, the next address is tried if the
+ * previous one didn't connect in 250ms (RFC 8305 "Happy Eyeballs").
+ * The connected socket or the error is then used by the following
+ * Socket_test() of each port, so a black-holed host costs one timeout
+ * per service instead of one timeout per port and address.
+ * @param portlist The list of ports (Port_T) to connect
+ */
+void Socket_connectPorts(void *portlist);
+
+
 /**
  * Test a Port_T object
  * @param P A port object to test
@@ -242,6 +254,15 @@ int Socket_print(T S, const char *m, ...) __attribute__((format (printf, 2, 3)))
 int Socket_write(T S, const void *b, size_t size);
 
 
+/**
+ * Check if the socket has data which can be read without waiting,
+ * i.e. data buffered by the socket or the SSL layer
+ * @param S A Socket_T object
+ * @return true if there is buffered data, otherwise false
+ */
+bool Socket_hasPendingData(T S);
+
+
 /**
  * Read a single byte. The byte is returned as an int in the range 0
  * to 255.
@@ -251,6 +272,29 @@ int Socket_write(T S, const void *b, size_t size);
 int Socket_readByte(T S);
 
 
+/**
+ * Get a view of the data buffered by the socket. If the buffer is
+ * empty, more data is read first. The data stays in the buffer until
+ * it is consumed with Socket_consume(), so the caller can scan or hash
+ * it in place without copying. The view is valid until the next read
+ * operation on the socket.
+ * @param S A Socket_T object
+ * @param length Set to the number of bytes available in the view
+ * @return A pointer to the buffered data or NULL if the end of the
+ * stream has been reached or an error occurred
+ */
+const void *Socket_peek(T S, int *length);
+
+
+/**
+ * Consume length bytes of the data returned by Socket_peek()
+ * @param S A Socket_T object
+ * @param length The number of bytes to consume, at most the length
+ * returned by Socket_peek()
+ */
+void Socket_consume(T S, int length);
+
+
 /**
  * Reads size bytes and stores them into the byte buffer pointed to by b.
  * @param S A Socket_T object
@@ -41,14 +41,42 @@
 #include <errno.h>
 #endif
 
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
 #include "monit.h"
 #include "event.h"
 #include "MMonit.h"
 
+// libmonit
+#include "system/Time.h"
+#include "exceptions/AssertException.h"
+
 
 /**
  *  Connect to a data collector servlet and send the event or status message.
  *
+ *  In daemon mode the messages are sent by the sender thread: the events are
+ *  queued in memory and delivered asynchronously, so a slow or unavailable
+ *  M/Monit doesn't delay the validation. The thread sends the heartbeat
+ *  status message every cycle and keeps the connection to M/Monit open
+ *  between the messages if the server supports HTTP keep-alive. The event
+ *  message contains the full status too, so the heartbeat which is due
+ *  after the delivered events is skipped. If the memory queue is full,
+ *  MMonit_send() fails and the event is saved to the event queue (if
+ *  enabled) as in the synchronous mode.
+ *
+ *  In the relay mode, the messages which the downstream monits posted to
+ *  the httpd collector are queued with the own events and forwarded over
+ *  the same connection to the M/Monit servers with the relay option. The
+ *  relayed events are forwarded at once, the relayed status messages wait
+ *  for the next heartbeat. A full status message supersedes the pending
+ *  status and delta messages of the same monit, so the queue holds about
+ *  one status per downstream monit besides the events. If the
+ *  relay queue is full, the collector rejects the message and the
+ *  downstream monit keeps the event in its own event queue.
+ *
  *  @file
  */
 
@@ -58,17 +86,61 @@
 
 #define MMONIT_SERVER_HEADER "Server: mmonit/"
 
+// Maximum number of events waiting in memory for the sender thread
+#define MMONIT_QUEUESIZE 1024
+
+// Maximum number of relayed messages waiting in memory for the sender thread
+#define MMONIT_RELAYSIZE 8192
+
+
+typedef struct Message_T {
+        struct myevent event;                            /**< Copy of the event */
+        struct Action_T action;                          /**< The event action */
+        struct EventAction_T eventAction;
+        struct {
+                char *host;                   /**< ID of the downstream monit */
+                char *document;   /**< Message of the downstream monit or NULL */
+                int length;                           /**< The message length */
+                bool status;               /**< Status message without event */
+        } relay;
+        struct Message_T *next;
+} *Message_T;
+
+
+static struct {
+        bool running;                         /**< true if the sender thread runs */
+        bool stop;                         /**< Stop request for the sender thread */
+        int count;                               /**< Number of queued messages */
+        int relayed;                   /**< Number of queued relayed messages */
+        Message_T head;
+        Message_T tail;
+        Message_T sending;        /**< The message being delivered just now */
+        Thread_T thread;
+        Mutex_T mutex;
+        Sem_T cond;
+} _sender = {};
+
+
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+
 
 /* ----------------------------------------------------------------- Private */
 
 
+static void _init(void) {
+        Mutex_init(_sender.mutex);
+        Sem_init(_sender.cond);
+}
+
+
 /**
  * Send message to the server
  * @param C An mmonit object
  * @param D Data to send
+ * @param persistent true if the connection should be kept open
  * @return true if the message sending succeeded otherwise false
  */
-static bool _send(Socket_T socket, Mmonit_T C, StringBuffer_T sb) {
+static bool _send(Socket_T socket, Mmonit_T C, StringBuffer_T sb, bool persistent) {
         char *auth = Util_getBasicAuthHeader(C->url->user, C->url->password);
         const void *body = NULL;
         size_t bodyLength = 0;
@@ -88,12 +160,14 @@ static bool _send(Socket_T socket, Mmonit_T C, StringBuffer_T sb) {
                               "User-Agent: Monit/%s\r\n"
                               "%s"
                               "%s"
+                              "%s"
                               "\r\n",
                               C->url->path,
                               C->url->ipv6 ? "[" : "", C->url->hostname, C->url->ipv6 ? "]" : "", C->url->port,
                               bodyLength,
                               VERSION,
                               C->compress == MmonitCompress_Yes ? "Content-Encoding: gzip\r\n" : "",
+                              persistent ? "" : "Connection: close\r\n",
                               auth ? auth : "");
         FREE(auth);
         if (rv < 0 || Socket_write(socket, (unsigned char *)body, bodyLength) < 0) {
@@ -105,13 +179,16 @@ static bool _send(Socket_T socket, Mmonit_T C, StringBuffer_T sb) {
 
 
 /**
- * Check that the server returns a valid HTTP response
+ * Check that the server returns a valid HTTP response. The response headers
+ * and body are read, so the connection can be reused for the next message
  * @param C An mmonit object
+ * @param keepalive Set to true if the server keeps the connection open
  * @return true if the response is valid otherwise false
  */
-static bool _receive(Socket_T socket, Mmonit_T C) {
+static bool _receive(Socket_T socket, Mmonit_T C, bool *keepalive) {
         int  status;
         char buf[STRLEN];
+        *keepalive = false;
         if (! Socket_readLine(socket, buf, sizeof(buf))) {
                 Log_error("M/Monit: error receiving data from %s -- %s\n", C->url->url, STRERROR);
                 return false;
@@ -122,61 +199,414 @@ static bool _receive(Socket_T socket, Mmonit_T C) {
                 Log_error("M/Monit: failed to send message to %s -- %s\n", C->url->url, buf);
                 return false;
         }
-        if (C->compress == MmonitCompress_Init) {
+        bool persistent = Str_startsWith(buf, "HTTP/1.1");
+        bool negotiate = C->compress == MmonitCompress_Init;
+        long long contentLength = -1;
+        if (negotiate)
                 C->compress = MmonitCompress_No;
-#ifdef HAVE_LIBZ
-                while (Socket_readLine(socket, buf, sizeof(buf))) {
-                        if ((buf[0] == '\r' && buf[1] == '\n') || (buf[0] == '\n'))
-                                break;
-                        Str_chomp(buf);
-                        if (Str_startsWith(buf, MMONIT_SERVER_HEADER)) {
-                                char *version = buf + strlen(MMONIT_SERVER_HEADER);
-                                if (*version) {
-                                        int major, minor;
-                                        if (sscanf(version, "%d.%d", &major, &minor) == 2 && (major > 3 || (major == 3 && minor >= 6)))
-                                                C->compress = MmonitCompress_Yes;
+        while (Socket_readLine(socket, buf, sizeof(buf))) {
+                if ((buf[0] == '\r' && buf[1] == '\n') || (buf[0] == '\n')) {
+                        // End of headers, skip the body if the connection is kept open
+                        if (persistent && contentLength >= 0) {
+                                while (contentLength > 0) {
+                                        int n = Socket_read(socket, buf, (int)MIN(contentLength, (long long)sizeof(buf)));
+                                        if (n <= 0)
+                                                return true;
+                                        contentLength -= n;
                                 }
-                                break;
+                                *keepalive = true;
                         }
+                        break;
                 }
+                Str_chomp(buf);
+                if (Str_startsWith(buf, "Content-Length:")) {
+                        if (sscanf(buf + 15, "%lld", &contentLength) != 1)
+                                contentLength = -1;
+                } else if (Str_startsWith(buf, "Connection:")) {
+                        if (Str_sub(buf + 11, "close"))
+                                persistent = false;
+                } else if (Str_startsWith(buf, "Transfer-Encoding:")) {
+                        persistent = false; // Not used by M/Monit, close the connection rather than parsing the chunks
+#ifdef HAVE_LIBZ
+                } else if (negotiate && Str_startsWith(buf, MMONIT_SERVER_HEADER)) {
+                        char *version = buf + strlen(MMONIT_SERVER_HEADER);
+                        if (*version) {
+                                int major, minor;
+                                if (sscanf(version, "%d.%d", &major, &minor) == 2 && (major > 3 || (major == 3 && minor >= 6)))
+                                        C->compress = MmonitCompress_Yes;
+                        }
 #endif
+                }
         }
         return true;
 }
 
 
-/* ------------------------------------------------------------------ Public */
+/**
+ * Test if the idle persistent connection is still usable. A readable idle connection was closed by the server
+ */
+static bool _isAlive(Socket_T socket) {
+#ifdef HAVE_POLL_H
+        struct pollfd fds = {.fd = Socket_getSocket(socket), .events = POLLIN};
+        return poll(&fds, 1, 0) == 0;
+#else
+        return true;
+#endif
+}
 
 
-Handler_Type MMonit_send(Event_T E) {
-        Handler_Type rv = Handler_Mmonit;
-        /* The event is sent to mmonit just once - only in the case that the state changed */
-        if (! Run.mmonits || (E && ! E->state_changed))
-                return Handler_Succeeded;
-        StringBuffer_T sb = StringBuffer_create(256);
-        for (Mmonit_T C = Run.mmonits; C; C = C->next) {
-                Socket_T  socket = Socket_create(C->url->hostname, C->url->port, Socket_Tcp, Socket_Ip, &(C->ssl), C->timeout);
+/**
+ * Format the message. In the delta mode, the status message contains only the services whose status changed since
+ * the last message and the full status every C->snapshot cycles
+ * @return The new service digests if the delta status was formatted (the caller owns them) otherwise NULL
+ */
+static uint64_t *_status(Mmonit_T C, Event_T E, StringBuffer_T sb, const char *myip) {
+        if (E || ! C->snapshot) {
+                status_xml(sb, E, 2, myip);
+                return NULL;
+        }
+        int count = 0;
+        for (Service_T s = servicelist_conf; s; s = s->next_conf)
+                count++;
+        bool full = C->delta.cycle % C->snapshot == 0;
+        if (count != C->delta.count || ! C->delta.digests) {
+                // The service list changed, start again with the full status
+                FREE(C->delta.digests);
+                C->delta.digests = CALLOC(count ? count : 1, sizeof(uint64_t));
+                C->delta.count = count;
+                C->delta.cycle = 0;
+                full = true;
+        }
+        uint64_t *digests = ALLOC((count ? count : 1) * sizeof(uint64_t));
+        memcpy(digests, C->delta.digests, count * sizeof(uint64_t));
+        int changed = status_xml_changes(sb, 2, myip, digests, count, full);
+        DEBUG("M/Monit: %s status message with %d of %d services for %s\n", full ? "full" : "delta", changed, count, C->url->url);
+        return digests;
+}
+
+
+/**
+ * Post the message to the M/Monit server: the relayed document if set, otherwise the event or status. If persistent
+ * is true, the connection is reused
+ * @return true if succeeded otherwise false
+ */
+static bool _post(Mmonit_T C, Event_T E, const char *document, int length, StringBuffer_T sb, bool persistent) {
+        const char *kind = document ? "relayed" : E ? "event" : "status";
+        if (C->socket && ! _isAlive(C->socket)) {
+                DEBUG("M/Monit: connection to %s was closed by the server\n", C->url->url);
+                Socket_free(&C->socket);
+        }
+        for (int attempt = 0; attempt < 2; attempt++) {
+                bool reused = persistent && C->socket;
+                Socket_T socket = reused ? C->socket : Socket_create(C->url->hostname, C->url->port, Socket_Tcp, Socket_Ip, &(C->ssl), C->timeout);
+                if (reused)
+                        C->socket = NULL;
                 if (! socket) {
                         Log_error("M/Monit: cannot open a connection to %s\n", C->url->url);
-                        goto error;
-                }
-                status_xml(sb, E, 2, Socket_getLocalHost(socket, (char[STRLEN]){}, STRLEN));
-                if (! _send(socket, C, sb)) {
-                        Log_error("M/Monit: cannot send %s message to %s\n", E ? "event" : "status", C->url->url);
-                        goto error;
+                        return false;
                 }
+                bool rv = false, keepalive = false;
+                uint64_t *digests = NULL;
                 StringBuffer_clear(sb);
-                if (! _receive(socket, C)) {
-                        Log_error("M/Monit: %s message to %s failed\n", E ? "event" : "status", C->url->url);
-                        goto error;
+                if (document)
+                        StringBuffer_appendBytes(sb, document, length);
+                else
+                        digests = _status(C, E, sb, Socket_getLocalHost(socket, (char[STRLEN]){}, STRLEN));
+                if (! _send(socket, C, sb, persistent)) {
+                        Log_error("M/Monit: cannot send %s message to %s\n", kind, C->url->url);
+                } else if (! _receive(socket, C, &keepalive)) {
+                        Log_error("M/Monit: %s message to %s failed\n", kind, C->url->url);
+                } else {
+                        rv = true;
+                        DEBUG("M/Monit: %s message sent to %s\n", kind, C->url->url);
                 }
-                rv = Handler_Succeeded; // Return success if at least one M/Monit succeeded
-                DEBUG("M/Monit: %s message sent to %s\n", E ? "event" : "status", C->url->url);
-        error:
-                if (socket)
+                if (rv && persistent && keepalive)
+                        C->socket = socket;
+                else
                         Socket_free(&socket);
+                if (digests) {
+                        if (rv) {
+                                // The service digests are the baseline of the next delta message
+                                FREE(C->delta.digests);
+                                C->delta.digests = digests;
+                                C->delta.cycle++;
+                        } else {
+                                FREE(digests);
+                        }
+                }
+                // M/Monit may have lost the host state while it was unavailable, resynchronize with the full status
+                if (! rv && ! reused)
+                        C->delta.cycle = 0;
+                // The reused connection may be closed by the server meanwhile, retry with a new connection
+                if (rv || ! reused)
+                        return rv;
         }
+        return false;
+}
+
+
+/**
+ * Post the message to all M/Monit servers, the relayed document to the servers with the relay option only
+ * @return Handler_Succeeded if at least one M/Monit succeeded otherwise Handler_Mmonit
+ */
+static Handler_Type _postAll(Event_T E, const char *document, int length, StringBuffer_T sb, bool persistent) {
+        Handler_Type rv = Handler_Mmonit;
+        for (Mmonit_T C = Run.mmonits; C; C = C->next)
+                if ((! document || C->relay) && _post(C, E, document, length, sb, persistent))
+                        rv = Handler_Succeeded; // Return success if at least one M/Monit succeeded
+        return rv;
+}
+
+
+/**
+ * Get the ID of the monit which sent the message, the attribute of the version 2 format or the server element of the version 1 format
+ * @return The ID (the caller owns it) or NULL if not found
+ */
+static char *_getHost(const char *document) {
+        const char *id = strstr(document, "<monit id=\"");
+        if (id) {
+                id += 11;
+                const char *end = strchr(id, '"');
+                return end && end > id ? Str_ndup(id, end - id) : NULL;
+        }
+        if ((id = strstr(document, "<id>"))) {
+                id += 4;
+                const char *end = strstr(id, "</id>");
+                return end && end > id ? Str_ndup(id, end - id) : NULL;
+        }
+        return NULL;
+}
+
+
+static void _append(Message_T m) {
+        if (_sender.tail)
+                _sender.tail->next = m;
+        else
+                _sender.head = m;
+        _sender.tail = m;
+        _sender.count++;
+        if (m->relay.document)
+                _sender.relayed++;
+}
+
+
+static Message_T _pop(void) {
+        Message_T m = _sender.head;
+        if (m) {
+                _sender.head = m->next;
+                if (! _sender.head)
+                        _sender.tail = NULL;
+                _sender.count--;
+                if (m->relay.document)
+                        _sender.relayed--;
+        }
+        return m;
+}
+
+
+static void _freeMessage(Message_T *m) {
+        FREE((*m)->event.message);
+        FREE((*m)->relay.host);
+        FREE((*m)->relay.document);
+        FREE(*m);
+}
+
+
+/**
+ * Remove the pending status messages of the downstream monit, which are superseded by its new full status. The message
+ * which the sender thread delivers just now is kept
+ */
+static void _supersede(const char *host) {
+        Message_T prev = NULL;
+        for (Message_T m = _sender.head, next; m; m = next) {
+                next = m->next;
+                if (m->relay.status && m != _sender.sending && IS(m->relay.host, host)) {
+                        if (prev)
+                                prev->next = next;
+                        else
+                                _sender.head = next;
+                        if (_sender.tail == m)
+                                _sender.tail = prev;
+                        _sender.count--;
+                        _sender.relayed--;
+                        _freeMessage(&m);
+                } else {
+                        prev = m;
+                }
+        }
+}
+
+
+static void *_thread(__attribute__ ((unused)) void *args) {
+        set_signal_block();
+        Log_info("M/Monit heartbeat started\n");
+        StringBuffer_T sb = StringBuffer_create(256);
+        // The first heartbeat is sent at the host phase within the jitter window, so the fleet restarted at once doesn't report in lockstep
+        int window = Run.polltime * Run.jitter / 100;
+        time_t heartbeat = window > 0 ? Time_now() + (time_t)(Util_hash(Run.id, "heartbeat") % window) : 0, retry = 0;
+        LOCK(_sender.mutex)
+        {
+                while (! _sender.stop) {
+                        // Deliver the queued events in order. If M/Monit failed, the events are retried in the next cycle
+                        if (Time_now() >= retry) {
+                                while (_sender.head && ! _sender.stop) {
+                                        Message_T m = _sender.head;
+                                        bool relayed = m->relay.document != NULL;
+                                        _sender.sending = m;
+                                        Mutex_unlock(_sender.mutex);
+                                        bool sent = (relayed ? _postAll(NULL, m->relay.document, m->relay.length, sb, true) : _postAll(&m->event, NULL, 0, sb, true)) == Handler_Succeeded;
+                                        Mutex_lock(_sender.mutex);
+                                        _sender.sending = NULL;
+                                        if (! sent) {
+                                                retry = Time_now() + Run.polltime;
+                                                break;
+                                        }
+                                        _pop();
+                                        _freeMessage(&m);
+                                        // The own event message contains the full status, the due heartbeat is not needed
+                                        if (! relayed && Time_now() >= heartbeat)
+                                                heartbeat = Time_now() + Run.polltime;
+                                }
+                        }
+                        if (_sender.stop)
+                                break;
+                        if (Time_now() >= heartbeat) {
+                                Mutex_unlock(_sender.mutex);
+                                _postAll(NULL, NULL, 0, sb, true);
+                                Mutex_lock(_sender.mutex);
+                                heartbeat = Time_now() + Run.polltime;
+                        }
+                        if (! _sender.stop && (! _sender.head || Time_now() < retry)) {
+                                struct timespec wait = {.tv_sec = _sender.head ? MIN(heartbeat, retry) : heartbeat, .tv_nsec = 0};
+                                Sem_timeWait(_sender.cond, _sender.mutex, wait);
+                        }
+                }
+        }
+        END_LOCK;
+        for (Mmonit_T C = Run.mmonits; C; C = C->next)
+                if (C->socket)
+                        Socket_free(&C->socket);
         StringBuffer_free(&sb);
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        Log_info("M/Monit heartbeat stopped\n");
+        return NULL;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void MMonit_start(void) {
+        pthread_once(&_once, _init);
+        if (Run.mmonits && ! _sender.running) {
+                _sender.stop = false;
+                Thread_create(_sender.thread, _thread, NULL);
+                _sender.running = true;
+        }
+}
+
+
+void MMonit_stop(void) {
+        if (_sender.running) {
+                LOCK(_sender.mutex)
+                {
+                        _sender.stop = true;
+                        Sem_signal(_sender.cond);
+                }
+                END_LOCK;
+                Thread_join(_sender.thread);
+                _sender.running = false;
+                // Save the events which were not delivered yet to the event queue, the relayed messages are dropped
+                Message_T m;
+                int dropped = 0;
+                while ((m = _pop())) {
+                        if (m->relay.document) {
+                                dropped++;
+                        } else {
+                                m->event.flag = Handler_Mmonit;
+                                Event_queue_add(&m->event, 0);
+                        }
+                        _freeMessage(&m);
+                }
+                if (dropped)
+                        Log_warning("M/Monit: %d relayed messages were not delivered\n", dropped);
+        }
+}
+
+
+Handler_Type MMonit_send(Event_T E) {
+        /* The event is sent to mmonit just once - only in the case that the state changed */
+        if (! Run.mmonits || (E && ! E->state_changed))
+                return Handler_Succeeded;
+        Handler_Type rv = Handler_Mmonit;
+        if (E && _sender.running) {
+                LOCK(_sender.mutex)
+                {
+                        if (_sender.count < MMONIT_QUEUESIZE) {
+                                Message_T m;
+                                NEW(m);
+                                m->event = *E;
+                                m->event.message = E->message ? Str_dup(E->message) : NULL;
+                                m->event.next = NULL;
+                                m->action.id = Event_get_action(E);
+                                m->eventAction.failed = m->eventAction.succeeded = &m->action;
+                                m->event.action = &m->eventAction;
+                                _append(m);
+                                Sem_signal(_sender.cond);
+                                rv = Handler_Succeeded;
+                        } else {
+                                Log_error("M/Monit: the send queue is full\n");
+                        }
+                }
+                END_LOCK;
+        } else {
+                StringBuffer_T sb = StringBuffer_create(256);
+                rv = _postAll(E, NULL, 0, sb, false);
+                StringBuffer_free(&sb);
+        }
+        return rv;
+}
+
+
+bool MMonit_relay(const char *document, int length) {
+        ASSERT(document);
+        char *host = _getHost(document);
+        if (! host) {
+                Log_error("M/Monit: the relayed message has no monit ID\n");
+                return false;
+        }
+        bool rv = false;
+        if (_sender.running) {
+                Message_T m;
+                NEW(m);
+                m->relay.host = host;
+                m->relay.document = Str_ndup(document, length);
+                m->relay.length = length;
+                bool event = strstr(document, "<event>") != NULL;
+                m->relay.status = ! event;
+                LOCK(_sender.mutex)
+                {
+                        // The delta status has no service groups, it doesn't replace the previous status
+                        if (m->relay.status && strstr(document, "<servicegroups>"))
+                                _supersede(host);
+                        if (_sender.relayed < MMONIT_RELAYSIZE) {
+                                _append(m);
+                                // The status messages are forwarded in a batch with the next heartbeat
+                                if (event)
+                                        Sem_signal(_sender.cond);
+                                rv = true;
+                        } else {
+                                Log_error("M/Monit: the relay queue is full\n");
+                        }
+                }
+                END_LOCK;
+                if (! rv)
+                        _freeMessage(&m);
+        } else {
+                FREE(host);
+        }
         return rv;
 }
 
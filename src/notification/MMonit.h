@@ -35,12 +35,41 @@
 
 
 /**
- * Post event or status message to M/Monit
+ * Start the M/Monit sender thread. The thread sends the status message
+ * every cycle and delivers the events posted by MMonit_send()
+ * asynchronously
+ */
+void MMonit_start(void);
+
+
+/**
+ * Stop the M/Monit sender thread. The events which were not delivered
+ * yet are saved to the event queue
+ */
+void MMonit_stop(void);
+
+
+/**
+ * Post event or status message to M/Monit. If the sender thread runs, the
+ * event is queued for the asynchronous delivery
  * @param E An event object or NULL for status
- * @return If failed, return Handler_Mmonit flag or Handler_Succeeded flag if succeeded
+ * @return If failed (or the send queue is full), return Handler_Mmonit flag
+ * or Handler_Succeeded flag if succeeded
  */
 Handler_Type MMonit_send(Event_T);
 
 
+/**
+ * Queue the message posted by a downstream monit to the httpd collector
+ * for forwarding to the M/Monit servers with the relay option. A full
+ * status message replaces the queued status messages of the same monit
+ * @param document The M/Monit XML message
+ * @param length The message length
+ * @return true if the message was queued, false if the message is not
+ * valid, the sender thread doesn't run or the relay queue is full
+ */
+bool MMonit_relay(const char *document, int length);
+
+
 #endif
 
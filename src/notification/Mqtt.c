@@ -0,0 +1,471 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#include "monit.h"
+#include "Mqtt.h"
+
+// libmonit
+#include "system/Time.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ *  Publish the service status to a MQTT broker (MQTT 3.1.1).
+ *
+ *  The publisher thread keeps one persistent connection to the broker and
+ *  publishes one message per validation cycle to the topic
+ *  <prefix>/<monit id>/status. The message contains only the services
+ *  whose status changed since the last message, the collection timestamp
+ *  is ignored. The status of all services is published after each
+ *  (re)connect and every n messages if the snapshot interval is set, so a
+ *  subscriber which joined later gets the complete state. The retained
+ *  topic <prefix>/<monit id>/online is set to 1 after connect and to 0 on
+ *  stop or by the broker (last will) if the connection is lost.
+ *
+ *  With QoS 1 the publisher waits for the broker acknowledgement of each
+ *  message, with QoS 0 the message is sent without waiting. If the broker
+ *  fails, the connection is dropped and the next attempt sends the full
+ *  status, so no resend queue is needed.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef enum {
+        MqttPacket_Connect = 1,
+        MqttPacket_ConnAck = 2,
+        MqttPacket_Publish = 3,
+        MqttPacket_PubAck = 4,
+        MqttPacket_PingReq = 12,
+        MqttPacket_PingResp = 13,
+        MqttPacket_Disconnect = 14
+} __attribute__((__packed__)) MqttPacket_Type;
+
+
+// The maximum retry delay after the broker failed [s]
+#define MQTT_MAXBACKOFF 300
+
+
+static struct {
+        bool running;                      /**< true if the publisher thread runs */
+        bool stop;                      /**< Stop request for the publisher thread */
+        bool update;                       /**< A validation cycle finished */
+        int keepalive;                         /**< The MQTT keep alive [s] */
+        int backoff;                             /**< The current retry delay [s] */
+        int cycle;                /**< Number of messages since the full status */
+        int count;                                  /**< Number of digests */
+        unsigned short packetId;
+        time_t retry;                        /**< When the broker is retried */
+        time_t sent;                            /**< When the last packet was sent */
+        uint64_t *digests;           /**< The service digests of the last message */
+        Socket_T socket;
+        StringBuffer_T body;
+        StringBuffer_T packet;
+        Thread_T thread;
+        Mutex_T mutex;
+        Sem_T cond;
+} _mqtt = {};
+
+
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _init(void) {
+        Mutex_init(_mqtt.mutex);
+        Sem_init(_mqtt.cond);
+}
+
+
+static void _appendShort(StringBuffer_T B, int value) {
+        StringBuffer_appendBytes(B, (unsigned char[]){(value >> 8) & 0xff, value & 0xff}, 2);
+}
+
+
+static void _appendString(StringBuffer_T B, const char *s) {
+        int length = s ? (int)strlen(s) : 0;
+        _appendShort(B, length);
+        StringBuffer_appendBytes(B, s, length);
+}
+
+
+/**
+ * Append the topic <prefix>/<monit id>/<name>
+ */
+static void _appendTopic(StringBuffer_T B, const char *name) {
+        char topic[STRLEN];
+        snprintf(topic, sizeof(topic), "%s/%s/%s", Run.mqtt->topic, Run.id, name);
+        _appendString(B, topic);
+}
+
+
+/**
+ * Append the fixed header and the variable part of the packet to the packet buffer
+ * @param flags The packet type and flags byte
+ * @param variable The variable header and payload
+ * @param length The variable part length
+ */
+static void _frame(int flags, const void *variable, int length) {
+        unsigned char header[5] = {flags};
+        int size = 1;
+        int remaining = length;
+        do {
+                header[size] = remaining % 128;
+                remaining /= 128;
+                if (remaining)
+                        header[size] |= 0x80;
+                size++;
+        } while (remaining && size < 5);
+        StringBuffer_appendBytes(_mqtt.packet, header, size);
+        StringBuffer_appendBytes(_mqtt.packet, variable, length);
+}
+
+
+static bool _write(void) {
+        bool rv = Socket_write(_mqtt.socket, StringBuffer_toString(_mqtt.packet), StringBuffer_length(_mqtt.packet)) == StringBuffer_length(_mqtt.packet);
+        if (rv)
+                _mqtt.sent = Time_now();
+        else
+                Log_error("MQTT: error sending data to %s -- %s\n", Run.mqtt->url->url, STRERROR);
+        StringBuffer_clear(_mqtt.packet);
+        return rv;
+}
+
+
+static bool _readBytes(unsigned char *buf, int length) {
+        for (int n = 0; n < length;) {
+                int rv = Socket_read(_mqtt.socket, buf + n, length - n);
+                if (rv <= 0)
+                        return false;
+                n += rv;
+        }
+        return true;
+}
+
+
+/**
+ * Read the broker packet. The packets sent to the client are short, the
+ * remaining part above the buffer size is skipped
+ * @param type Set to the packet type
+ * @param buf The buffer for the variable part
+ * @param size The buffer size
+ * @return The variable part length or -1 if the read failed
+ */
+static int _read(MqttPacket_Type *type, unsigned char *buf, int size) {
+        int flags = Socket_readByte(_mqtt.socket);
+        if (flags < 0)
+                return -1;
+        *type = (MqttPacket_Type)(flags >> 4);
+        int length = 0;
+        for (int i = 0, byte = 0x80; byte & 0x80; i++) {
+                if (i == 4 || (byte = Socket_readByte(_mqtt.socket)) < 0)
+                        return -1;
+                length |= (byte & 0x7f) << (7 * i);
+        }
+        int n = MIN(length, size);
+        if (! _readBytes(buf, n))
+                return -1;
+        for (int skip = length - n; skip > 0; skip--)
+                if (Socket_readByte(_mqtt.socket) < 0)
+                        return -1;
+        return n;
+}
+
+
+/**
+ * Read the packets which the broker sent meanwhile (ping responses and acknowledgements of QoS 0 messages) without
+ * waiting. A readable socket without data was closed by the broker
+ * @return false if the connection was closed
+ */
+static bool _drain(void) {
+#ifdef HAVE_POLL_H
+        struct pollfd fds = {.fd = Socket_getSocket(_mqtt.socket), .events = POLLIN};
+        while (Socket_hasPendingData(_mqtt.socket) || poll(&fds, 1, 0) > 0) {
+                MqttPacket_Type type;
+                unsigned char buf[8];
+                if (_read(&type, buf, sizeof(buf)) < 0)
+                        return false;
+        }
+#endif
+        return true;
+}
+
+
+static void _disconnect(bool graceful) {
+        if (_mqtt.socket) {
+                if (graceful) {
+                        // The broker doesn't publish the last will on the clean disconnect, set the online flag here
+                        unsigned char payload = '0';
+                        StringBuffer_T B = StringBuffer_create(64);
+                        _appendTopic(B, "online");
+                        StringBuffer_appendBytes(B, &payload, 1);
+                        _frame(MqttPacket_Publish << 4 | 0x1, StringBuffer_toString(B), StringBuffer_length(B));
+                        _frame(MqttPacket_Disconnect << 4, NULL, 0);
+                        StringBuffer_free(&B);
+                        _write();
+                }
+                Socket_free(&_mqtt.socket);
+        }
+}
+
+
+static bool _connect(void) {
+        Mqtt_T M = Run.mqtt;
+        _mqtt.socket = Socket_create(M->url->hostname, M->url->port, Socket_Tcp, Socket_Ip, &(M->ssl), M->timeout);
+        if (! _mqtt.socket) {
+                Log_error("MQTT: cannot open a connection to %s\n", M->url->url);
+                return false;
+        }
+        char clientId[24];
+        snprintf(clientId, sizeof(clientId), "monit-%.17s", Run.id);
+        StringBuffer_T B = StringBuffer_create(128);
+        _appendString(B, "MQTT");
+        // Protocol level 4 (3.1.1), clean session, retained last will with QoS 1
+        int flags = 0x02 | 0x04 | 0x08 | 0x20 | (M->url->user ? 0x80 : 0) | (M->url->password ? 0x40 : 0);
+        StringBuffer_appendBytes(B, (unsigned char[]){4, flags}, 2);
+        _appendShort(B, _mqtt.keepalive);
+        _appendString(B, clientId);
+        _appendTopic(B, "online");
+        _appendString(B, "0");
+        if (M->url->user)
+                _appendString(B, M->url->user);
+        if (M->url->password)
+                _appendString(B, M->url->password);
+        _frame(MqttPacket_Connect << 4, StringBuffer_toString(B), StringBuffer_length(B));
+        StringBuffer_clear(B);
+        bool rv = false;
+        if (_write()) {
+                MqttPacket_Type type;
+                unsigned char buf[8];
+                int n = _read(&type, buf, sizeof(buf));
+                if (n < 2 || type != MqttPacket_ConnAck) {
+                        Log_error("MQTT: invalid connection response from %s\n", M->url->url);
+                } else if (buf[1]) {
+                        Log_error("MQTT: connection to %s was refused -- %s\n", M->url->url,
+                                  buf[1] == 1 ? "unacceptable protocol version" :
+                                  buf[1] == 2 ? "client identifier rejected" :
+                                  buf[1] == 3 ? "server unavailable" :
+                                  buf[1] == 4 ? "bad user name or password" :
+                                  buf[1] == 5 ? "not authorized" : "unknown error");
+                } else {
+                        // Retained online flag, the broker replaces it with the last will if the connection is lost
+                        _appendTopic(B, "online");
+                        StringBuffer_appendBytes(B, "1", 1);
+                        _frame(MqttPacket_Publish << 4 | 0x1, StringBuffer_toString(B), StringBuffer_length(B));
+                        rv = _write();
+                }
+        }
+        StringBuffer_free(&B);
+        if (rv)
+                DEBUG("MQTT: connected to %s\n", M->url->url);
+        else
+                Socket_free(&_mqtt.socket);
+        return rv;
+}
+
+
+/**
+ * Wait for the acknowledgement of the QoS 1 message, the other packets are skipped
+ */
+static bool _waitAck(unsigned short packetId) {
+        MqttPacket_Type type;
+        unsigned char buf[8];
+        int n;
+        while ((n = _read(&type, buf, sizeof(buf))) >= 0) {
+                if (type == MqttPacket_PubAck && n >= 2 && (buf[0] << 8 | buf[1]) == packetId)
+                        return true;
+        }
+        Log_error("MQTT: no acknowledgement from %s -- %s\n", Run.mqtt->url->url, STRERROR);
+        return false;
+}
+
+
+/**
+ * Publish the services whose status changed since the last message, or send the keep alive ping if there was no
+ * message for a while
+ * @return true if succeeded, false if the connection failed
+ */
+static bool _publish(bool update) {
+        Mqtt_T M = Run.mqtt;
+        int count = 0;
+        for (Service_T s = servicelist_conf; s; s = s->next_conf)
+                count++;
+        if (count != _mqtt.count) {
+                FREE(_mqtt.digests);
+                _mqtt.digests = CALLOC(count ? count : 1, sizeof(uint64_t));
+                _mqtt.count = count;
+                _mqtt.cycle = 0;
+        }
+        if (! _drain())
+                return false;
+        if (update) {
+                bool full = _mqtt.cycle == 0 || (M->snapshot > 0 && _mqtt.cycle % M->snapshot == 0);
+                uint64_t *digests = ALLOC(count ? count * sizeof(uint64_t) : sizeof(uint64_t));
+                memcpy(digests, _mqtt.digests, count * sizeof(uint64_t));
+                StringBuffer_clear(_mqtt.body);
+                int changed = M->format == MqttFormat_Cbor ? status_cbor_changes(_mqtt.body, digests, count, full) : status_json_changes(_mqtt.body, digests, count, full);
+                if (changed || full) {
+                        unsigned short packetId = 0;
+                        StringBuffer_T B = StringBuffer_create(StringBuffer_length(_mqtt.body) + 64);
+                        _appendTopic(B, "status");
+                        if (M->qos) {
+                                packetId = ++_mqtt.packetId ? _mqtt.packetId : ++_mqtt.packetId;
+                                _appendShort(B, packetId);
+                        }
+                        StringBuffer_appendBytes(B, StringBuffer_toString(_mqtt.body), StringBuffer_length(_mqtt.body));
+                        _frame(MqttPacket_Publish << 4 | M->qos << 1, StringBuffer_toString(B), StringBuffer_length(B));
+                        StringBuffer_free(&B);
+                        if (! _write() || (M->qos && ! _waitAck(packetId))) {
+                                FREE(digests);
+                                return false;
+                        }
+                        DEBUG("MQTT: published the status of %d services to %s\n", changed, M->url->url);
+                        // The service digests are the baseline of the next message
+                        FREE(_mqtt.digests);
+                        _mqtt.digests = digests;
+                        _mqtt.cycle++;
+                        return true;
+                }
+                FREE(digests);
+        }
+        if (Time_now() - _mqtt.sent >= _mqtt.keepalive / 2) {
+                _frame(MqttPacket_PingReq << 4, NULL, 0);
+                return _write();
+        }
+        return true;
+}
+
+
+static void *_thread(__attribute__ ((unused)) void *args) {
+        set_signal_block();
+        Log_info("MQTT publisher started\n");
+        _mqtt.body = StringBuffer_create(1024);
+        _mqtt.packet = StringBuffer_create(1024);
+        LOCK(_mqtt.mutex)
+        {
+                while (! _mqtt.stop) {
+                        bool update = _mqtt.update;
+                        _mqtt.update = false;
+                        Mutex_unlock(_mqtt.mutex);
+                        if (! _mqtt.socket && Time_now() >= _mqtt.retry) {
+                                if (_connect()) {
+                                        _mqtt.backoff = 0;
+                                        _mqtt.cycle = 0;
+                                        update = true;
+                                } else {
+                                        _mqtt.backoff = _mqtt.backoff ? MIN(_mqtt.backoff * 2, MQTT_MAXBACKOFF) : Run.polltime;
+                                        _mqtt.retry = Time_now() + _mqtt.backoff;
+                                }
+                        }
+                        if (_mqtt.socket && ! _publish(update)) {
+                                // The broker may have lost the messages, resynchronize with the full status after reconnect
+                                Log_error("MQTT: connection to %s failed\n", Run.mqtt->url->url);
+                                _disconnect(false);
+                        }
+                        Mutex_lock(_mqtt.mutex);
+                        if (! _mqtt.stop && ! _mqtt.update) {
+                                time_t wakeup = _mqtt.socket ? _mqtt.sent + _mqtt.keepalive / 2 : _mqtt.retry;
+                                Sem_timeWait(_mqtt.cond, _mqtt.mutex, (struct timespec){.tv_sec = MAX(wakeup, Time_now() + 1)});
+                        }
+                }
+        }
+        END_LOCK;
+        _disconnect(true);
+        StringBuffer_free(&_mqtt.body);
+        StringBuffer_free(&_mqtt.packet);
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        Log_info("MQTT publisher stopped\n");
+        return NULL;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Mqtt_start(void) {
+        pthread_once(&_once, _init);
+        if (Run.mqtt && ! _mqtt.running) {
+                _mqtt.stop = false;
+                _mqtt.update = false;
+                _mqtt.backoff = 0;
+                _mqtt.retry = 0;
+                _mqtt.count = 0;
+                _mqtt.cycle = 0;
+                FREE(_mqtt.digests);
+                _mqtt.keepalive = MIN(MAX(60, 3 * Run.polltime), 65535);
+                Thread_create(_mqtt.thread, _thread, NULL);
+                _mqtt.running = true;
+        }
+}
+
+
+void Mqtt_stop(void) {
+        if (_mqtt.running) {
+                LOCK(_mqtt.mutex)
+                {
+                        _mqtt.stop = true;
+                        Sem_signal(_mqtt.cond);
+                }
+                END_LOCK;
+                Thread_join(_mqtt.thread);
+                _mqtt.running = false;
+                FREE(_mqtt.digests);
+        }
+}
+
+
+void Mqtt_update(void) {
+        if (_mqtt.running) {
+                LOCK(_mqtt.mutex)
+                {
+                        _mqtt.update = true;
+                        Sem_signal(_mqtt.cond);
+                }
+                END_LOCK;
+        }
+}
+
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_MQTT_H
+#define MONIT_MQTT_H
+
+
+/**
+ * MQTT status publisher interface
+ *
+ * @file
+ */
+
+
+/**
+ * Start the MQTT publisher thread if the MQTT broker is set. The first
+ * message after the start contains the status of all services
+ */
+void Mqtt_start(void);
+
+
+/**
+ * Stop the MQTT publisher thread and disconnect from the broker
+ */
+void Mqtt_stop(void);
+
+
+/**
+ * Wake up the MQTT publisher thread to publish the services whose status
+ * changed in the validation cycle. Called after each cycle, it doesn't
+ * wait for the broker
+ */
+void Mqtt_update(void);
+
+
+#endif
+
@@ -101,7 +101,8 @@ typedef enum {
         SMTP_RcptTo,
         SMTP_DataBegin,
         SMTP_DataCommit,
-        SMTP_Quit
+        SMTP_Quit,
+        SMTP_Closed         // The connection is known to be dead, QUIT is not sent
 } __attribute__((__packed__)) SMTP_State;
 
 
@@ -139,8 +140,10 @@ __attribute__((format (printf, 2, 3))) static void _send(T S, const char *data,
         DEBUG("SMTP -> %s\n", msg);
         int rv = Socket_write(S->socket, msg, strlen(msg));
         FREE(msg);
-        if (rv <= 0)
+        if (rv <= 0) {
+                S->state = SMTP_Closed;
                 THROW(IOException, "Error sending data to the mailserver -- %s", STRERROR);
+        }
 }
 
 
@@ -148,12 +151,18 @@ static void _receive(T S, int code, void (*callback)(T S, const char *line)) {
         int status = 0;
         char line[STRLEN];
         do {
-                if (! Socket_readLine(S->socket, line, sizeof(line)))
+                if (! Socket_readLine(S->socket, line, sizeof(line))) {
+                        S->state = SMTP_Closed;
                         THROW(IOException, "Error receiving data from the mailserver -- %s", STRERROR);
+                }
                 Str_chomp(line);
                 DEBUG("SMTP <- %s\n", line);
-                if (strlen(line) < 4 || sscanf(line, "%d", &status) != 1 || status != code)
+                if (strlen(line) < 4 || sscanf(line, "%d", &status) != 1 || status != code) {
+                        // The 421 response announces that the server closes the connection (RFC 5321 section 3.8)
+                        if (status == 421)
+                                S->state = SMTP_Closed;
                         THROW(ProtocolException, "Mailserver response error -- %s", line);
+                }
                 if (callback)
                         callback(S, line);
         } while (line[3] == '-'); // multi-line response
@@ -176,7 +185,7 @@ void SMTP_free(T *S) {
         ASSERT(S && *S);
         TRY
         {
-                if ((*S)->state != SMTP_Quit && (*S)->state > SMTP_Init)
+                if ((*S)->state > SMTP_Init && (*S)->state < SMTP_Quit)
                         SMTP_quit(*S);
         }
         ELSE
@@ -322,6 +331,14 @@ void SMTP_dataCommit(T S) {
 }
 
 
+void SMTP_rset(T S) {
+        ASSERT(S);
+        _send(S, "RSET\r\n");
+        _receive(S, 250, NULL);
+        S->state = SMTP_Helo;
+}
+
+
 void SMTP_quit(T S) {
         _send(S, "QUIT\r\n");
         _receive(S, 221, NULL);
@@ -98,7 +98,9 @@ T SMTP_new(Socket_T socket);
 
 
 /**
- * Destroy the SMTP protocol object.
+ * Destroy the SMTP protocol object. The QUIT command is sent if the
+ * session was started, unless the connection is known to be closed
+ * (a read or write error or the 421 response)
  * @param S A reference to the SMTP protocol object
  * @exception AssertException if reference is NULL
  */
@@ -182,6 +184,16 @@ void SMTP_dataBegin(T S);
 void SMTP_dataCommit(T S);
 
 
+/**
+ * Send a RSET command to the SMTP server and check for status
+ * code 250 in response. The current mail transaction is aborted,
+ * the session can be used for the next message
+ * @param S The SMTP protocol object
+ * @exception AssertException if S is NULL, IOException if failed
+ */
+void SMTP_rset(T S);
+
+
 /**
  * Send a QUIT command to the SMTP server and check for status
  * code 221 in response.
@@ -0,0 +1,472 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#include "monit.h"
+#include "event.h"
+#include "Webhook.h"
+
+// libmonit
+#include "system/Time.h"
+#include "util/Str.h"
+#include "util/StringBuffer.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ *  Post the events to the HTTP webhooks as JSON.
+ *
+ *  The message is a JSON object with the monit instance description and
+ *  the array of events:
+ *
+ *    {"monit":{"id":"...","incarnation":N,"version":"...","host":"..."},
+ *     "events":[{"sequence":N,"service":"...","type":"...","event":"...",
+ *                "state":"...","action":"...","message":"...","time":N}, ...]}
+ *
+ *  In daemon mode the events are queued in memory and the webhook's sender
+ *  threads post them in batches: the batch is sent when the webhook's flush
+ *  interval elapsed since the previous batch or as soon as WEBHOOK_BATCH
+ *  events are waiting. Each sender thread keeps its own connection open
+ *  between the batches if the server supports HTTP keep-alive, the number
+ *  of threads limits the number of concurrent requests. The concurrent
+ *  batches may arrive out of order, the receiver can order the events by
+ *  the sequence number, which each webhook assigns to the events in the
+ *  order they were posted. The failed batch is retried with exponential
+ *  backoff. Each webhook has its own memory queue: if it is full, the
+ *  event is saved to the event queue (if enabled) for this webhook only,
+ *  the other webhooks which took the event don't get it again.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+// Maximum number of events waiting in memory for the sender threads of one webhook
+#define WEBHOOK_QUEUESIZE 1024
+
+// Maximum number of events in one message
+#define WEBHOOK_BATCH 100
+
+// The initial and maximum delay in seconds before the failed batch is retried
+#define WEBHOOK_RETRY_MIN 5
+#define WEBHOOK_RETRY_MAX 600
+
+
+typedef struct WebhookMessage_T {
+        unsigned long long sequence;            /**< The event sequence number */
+        struct myevent event;                            /**< Copy of the event */
+        struct Action_T action;                          /**< The event action */
+        struct EventAction_T eventAction;
+        struct WebhookMessage_T *next;
+} *Message_T;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _appendString(StringBuffer_T sb, const char *s) {
+        StringBuffer_appendChar(sb, '"');
+        for (const char *c = s ? s : ""; *c; c++) {
+                if (*c == '"' || *c == '\\')
+                        StringBuffer_append(sb, "\\%c", *c);
+                else if ((unsigned char)*c < 0x20)
+                        StringBuffer_append(sb, "\\u%04x", *c);
+                else
+                        StringBuffer_appendChar(sb, *c);
+        }
+        StringBuffer_appendChar(sb, '"');
+}
+
+
+static const char *_stateName(State_Type state) {
+        switch (state) {
+                case State_Succeeded:
+                        return "succeeded";
+                case State_Failed:
+                        return "failed";
+                case State_Changed:
+                        return "changed";
+                case State_ChangedNot:
+                        return "changednot";
+                default:
+                        return "init";
+        }
+}
+
+
+static void _format(StringBuffer_T sb, Message_T batch) {
+        StringBuffer_append(sb, "{\"monit\":{\"id\":");
+        _appendString(sb, Run.id);
+        StringBuffer_append(sb, ",\"incarnation\":%lld,\"version\":\"%s\",\"host\":", (long long)Run.incarnation, VERSION);
+        _appendString(sb, Run.system->name);
+        StringBuffer_append(sb, "},\"events\":[");
+        for (Message_T m = batch; m; m = m->next) {
+                StringBuffer_append(sb, "%s{\"sequence\":%llu,\"service\":", m != batch ? "," : "", m->sequence);
+                _appendString(sb, m->event.source->name);
+                StringBuffer_append(sb, ",\"type\":");
+                _appendString(sb, servicetypes[m->event.type]);
+                StringBuffer_append(sb, ",\"event\":");
+                _appendString(sb, Event_get_description(&m->event));
+                StringBuffer_append(sb, ",\"state\":\"%s\",\"action\":", _stateName(m->event.state));
+                _appendString(sb, Event_get_action_description(&m->event));
+                StringBuffer_append(sb, ",\"message\":");
+                _appendString(sb, m->event.message);
+                StringBuffer_append(sb, ",\"time\":%lld}", (long long)m->event.collected.tv_sec);
+        }
+        StringBuffer_append(sb, "]}");
+}
+
+
+static bool _send(Socket_T socket, Webhook_T W, StringBuffer_T sb, bool persistent) {
+        char *auth = Util_getBasicAuthHeader(W->url->user, W->url->password);
+        int rv = Socket_print(socket,
+                              "POST %s%s%s HTTP/1.1\r\n"
+                              "Host: %s%s%s:%d\r\n"
+                              "Content-Type: application/json\r\n"
+                              "Content-Length: %d\r\n"
+                              "Accept: */*\r\n"
+                              "User-Agent: Monit/%s\r\n"
+                              "%s"
+                              "%s"
+                              "\r\n",
+                              W->url->path, W->url->query ? "?" : "", W->url->query ? W->url->query : "",
+                              W->url->ipv6 ? "[" : "", W->url->hostname, W->url->ipv6 ? "]" : "", W->url->port,
+                              StringBuffer_length(sb),
+                              VERSION,
+                              persistent ? "" : "Connection: close\r\n",
+                              auth ? auth : "");
+        FREE(auth);
+        if (rv < 0 || Socket_write(socket, (unsigned char *)StringBuffer_toString(sb), StringBuffer_length(sb)) < 0) {
+                Log_error("Webhook: error sending data to %s -- %s\n", W->url->url, STRERROR);
+                return false;
+        }
+        return true;
+}
+
+
+/**
+ * Check that the server returns a 2xx response. The response headers and
+ * body are read, so the connection can be reused for the next message
+ */
+static bool _receive(Socket_T socket, Webhook_T W, bool *keepalive) {
+        int  status;
+        char buf[STRLEN];
+        *keepalive = false;
+        if (! Socket_readLine(socket, buf, sizeof(buf))) {
+                Log_error("Webhook: error receiving data from %s -- %s\n", W->url->url, STRERROR);
+                return false;
+        }
+        Str_chomp(buf);
+        if (sscanf(buf, "%*s %d", &status) != 1 || status < 200 || status >= 300) {
+                Log_error("Webhook: failed to send message to %s -- %s\n", W->url->url, buf);
+                return false;
+        }
+        bool persistent = Str_startsWith(buf, "HTTP/1.1");
+        long long contentLength = -1;
+        while (Socket_readLine(socket, buf, sizeof(buf))) {
+                if ((buf[0] == '\r' && buf[1] == '\n') || (buf[0] == '\n')) {
+                        // End of headers, skip the body if the connection is kept open
+                        if (persistent && contentLength >= 0) {
+                                while (contentLength > 0) {
+                                        int n = Socket_read(socket, buf, (int)MIN(contentLength, (long long)sizeof(buf)));
+                                        if (n <= 0)
+                                                return true;
+                                        contentLength -= n;
+                                }
+                                *keepalive = true;
+                        }
+                        break;
+                }
+                Str_chomp(buf);
+                if (Str_startsWith(buf, "Content-Length:")) {
+                        if (sscanf(buf + 15, "%lld", &contentLength) != 1)
+                                contentLength = -1;
+                } else if (Str_startsWith(buf, "Connection:")) {
+                        if (Str_sub(buf + 11, "close"))
+                                persistent = false;
+                } else if (Str_startsWith(buf, "Transfer-Encoding:")) {
+                        persistent = false; // Close the connection rather than parsing the chunks
+                }
+        }
+        return true;
+}
+
+
+/**
+ * Test if the idle persistent connection is still usable. A readable idle connection was closed by the server
+ */
+static bool _isAlive(Socket_T socket) {
+#ifdef HAVE_POLL_H
+        struct pollfd fds = {.fd = Socket_getSocket(socket), .events = POLLIN};
+        return poll(&fds, 1, 0) == 0;
+#else
+        return true;
+#endif
+}
+
+
+/**
+ * Post the message to the webhook. If the socket is given, the connection is reused and kept open for the next message
+ * @return true if succeeded otherwise false
+ */
+static bool _post(Webhook_T W, Socket_T *keep, StringBuffer_T sb) {
+        if (keep && *keep && ! _isAlive(*keep)) {
+                DEBUG("Webhook: connection to %s was closed by the server\n", W->url->url);
+                Socket_free(keep);
+        }
+        for (int attempt = 0; attempt < 2; attempt++) {
+                bool reused = keep && *keep;
+                Socket_T socket = reused ? *keep : Socket_create(W->url->hostname, W->url->port, Socket_Tcp, Socket_Ip, &(W->ssl), W->timeout);
+                if (reused)
+                        *keep = NULL;
+                if (! socket) {
+                        Log_error("Webhook: cannot open a connection to %s\n", W->url->url);
+                        return false;
+                }
+                bool rv = false, keepalive = false;
+                if (_send(socket, W, sb, keep != NULL) && _receive(socket, W, &keepalive)) {
+                        rv = true;
+                        DEBUG("Webhook: message sent to %s\n", W->url->url);
+                }
+                if (rv && keep && keepalive)
+                        *keep = socket;
+                else
+                        Socket_free(&socket);
+                // The reused connection may be closed by the server meanwhile, retry with a new connection
+                if (rv || ! reused)
+                        return rv;
+        }
+        return false;
+}
+
+
+static unsigned _bit(int index) {
+        return 1U << MIN(index, 31);
+}
+
+
+static Message_T _copy(Webhook_T W, Event_T E) {
+        Message_T m;
+        NEW(m);
+        m->sequence = ++W->sender.sequence;
+        m->event = *E;
+        m->event.message = E->message ? Str_dup(E->message) : NULL;
+        m->event.next = NULL;
+        m->action.id = Event_get_action(E);
+        m->eventAction.failed = m->eventAction.succeeded = &m->action;
+        m->event.action = &m->eventAction;
+        return m;
+}
+
+
+static void _freeMessages(Message_T *m) {
+        while (*m) {
+                Message_T next = (*m)->next;
+                FREE((*m)->event.message);
+                FREE(*m);
+                *m = next;
+        }
+}
+
+
+// Take up to WEBHOOK_BATCH messages from the queue head
+static Message_T _cut(Webhook_T W, Message_T *last) {
+        Message_T batch = W->sender.head;
+        int count = 1;
+        for (*last = batch; (*last)->next && count < WEBHOOK_BATCH; *last = (*last)->next)
+                count++;
+        W->sender.head = (*last)->next;
+        if (! W->sender.head)
+                W->sender.tail = NULL;
+        W->sender.count -= count;
+        (*last)->next = NULL;
+        return batch;
+}
+
+
+// Return the failed batch to the queue head
+static void _requeue(Webhook_T W, Message_T batch, Message_T last) {
+        int count = 0;
+        for (Message_T m = batch; m; m = m->next)
+                count++;
+        last->next = W->sender.head;
+        if (! W->sender.head)
+                W->sender.tail = last;
+        W->sender.head = batch;
+        W->sender.count += count;
+}
+
+
+static void *_thread(void *args) {
+        Webhook_T W = args;
+        set_signal_block();
+        Socket_T socket = NULL;
+        StringBuffer_T sb = StringBuffer_create(1024);
+        LOCK(W->sender.mutex)
+        {
+                while (! W->sender.stop) {
+                        time_t now = Time_now();
+                        time_t due = W->sender.count >= WEBHOOK_BATCH ? W->sender.retry : MAX(W->sender.retry, W->sender.flushed + W->interval);
+                        if (W->sender.head && now >= due) {
+                                Message_T last;
+                                Message_T batch = _cut(W, &last);
+                                W->sender.flushed = now;
+                                Mutex_unlock(W->sender.mutex);
+                                StringBuffer_clear(sb);
+                                _format(sb, batch);
+                                bool sent = _post(W, &socket, sb);
+                                Mutex_lock(W->sender.mutex);
+                                if (sent) {
+                                        W->sender.backoff = 0;
+                                        _freeMessages(&batch);
+                                } else {
+                                        W->sender.backoff = W->sender.backoff ? MIN(W->sender.backoff * 2, WEBHOOK_RETRY_MAX) : WEBHOOK_RETRY_MIN;
+                                        W->sender.retry = Time_now() + W->sender.backoff;
+                                        Log_error("Webhook: delivery to %s failed, retry scheduled in %d seconds\n", W->url->url, W->sender.backoff);
+                                        _requeue(W, batch, last);
+                                }
+                        } else if (W->sender.head) {
+                                Sem_timeWait(W->sender.cond, W->sender.mutex, ((struct timespec){.tv_sec = due, .tv_nsec = 0}));
+                        } else {
+                                Sem_wait(W->sender.cond, W->sender.mutex);
+                        }
+                }
+        }
+        END_LOCK;
+        if (socket)
+                Socket_free(&socket);
+        StringBuffer_free(&sb);
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        return NULL;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Webhook_start(void) {
+        for (Webhook_T W = Run.webhooks; W; W = W->next) {
+                if (! W->sender.threads) {
+                        Mutex_init(W->sender.mutex);
+                        Sem_init(W->sender.cond);
+                        W->sender.stop = false;
+                        W->sender.threads = CALLOC(W->workers, sizeof(Thread_T));
+                        for (int i = 0; i < W->workers; i++)
+                                Thread_create(W->sender.threads[i], _thread, W);
+                }
+        }
+}
+
+
+void Webhook_stop(void) {
+        int index = 0;
+        for (Webhook_T W = Run.webhooks; W; W = W->next, index++) {
+                if (W->sender.threads) {
+                        LOCK(W->sender.mutex)
+                        {
+                                W->sender.stop = true;
+                                Sem_broadcast(W->sender.cond);
+                        }
+                        END_LOCK;
+                        for (int i = 0; i < W->workers; i++)
+                                Thread_join(W->sender.threads[i]);
+                        FREE(W->sender.threads);
+                        // Save the events which were not delivered yet to the event queue for this webhook
+                        for (Message_T m = W->sender.head; m; m = m->next) {
+                                m->event.flag = Handler_Webhook;
+                                Event_queue_add(&m->event, _bit(index));
+                        }
+                        _freeMessages(&W->sender.head);
+                        W->sender.tail = NULL;
+                        W->sender.count = 0;
+                        Sem_destroy(W->sender.cond);
+                        Mutex_destroy(W->sender.mutex);
+                }
+        }
+}
+
+
+Handler_Type Webhook_send(Event_T E, unsigned *webhooks) {
+        ASSERT(E);
+        ASSERT(webhooks);
+        /* The event is sent just once - only in the case that the state changed */
+        if (! Run.webhooks || ! E->state_changed) {
+                *webhooks = 0;
+                return Handler_Succeeded;
+        }
+        unsigned failed = 0;
+        int index = 0;
+        for (Webhook_T W = Run.webhooks; W; W = W->next, index++) {
+                if (! (*webhooks & _bit(index)))
+                        continue; // The webhook took the event already
+                if (W->sender.threads) {
+                        LOCK(W->sender.mutex)
+                        {
+                                if (W->sender.count < WEBHOOK_QUEUESIZE) {
+                                        Message_T m = _copy(W, E);
+                                        if (W->sender.tail)
+                                                W->sender.tail->next = m;
+                                        else
+                                                W->sender.head = m;
+                                        W->sender.tail = m;
+                                        W->sender.count++;
+                                        Sem_signal(W->sender.cond);
+                                } else {
+                                        Log_error("Webhook: the send queue of %s is full\n", W->url->url);
+                                        failed |= _bit(index);
+                                }
+                        }
+                        END_LOCK;
+                } else {
+                        Message_T m = _copy(W, E);
+                        StringBuffer_T sb = StringBuffer_create(256);
+                        _format(sb, m);
+                        if (! _post(W, NULL, sb))
+                                failed |= _bit(index);
+                        StringBuffer_free(&sb);
+                        _freeMessages(&m);
+                }
+        }
+        // The webhooks which share the last bit retry the event together
+        *webhooks = failed;
+        return *webhooks ? Handler_Webhook : Handler_Succeeded;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_WEBHOOK_H
+#define MONIT_WEBHOOK_H
+
+
+/**
+ * Webhook event receiver interface
+ *
+ * @file
+ */
+
+
+/**
+ * The webhooks bitmap of Webhook_send(), the bit N stands for the Nth
+ * webhook in Run.webhooks (the webhooks from the 32nd on share the last
+ * bit)
+ */
+#define WEBHOOK_ALL 0xFFFFFFFFU
+
+
+/**
+ * Start the sender threads of the webhooks. The events posted by
+ * Webhook_send() are collected and delivered asynchronously in batches
+ */
+void Webhook_start(void);
+
+
+/**
+ * Stop the sender threads. The events which were not delivered yet are
+ * saved to the event queue
+ */
+void Webhook_stop(void);
+
+
+/**
+ * Post the event to the webhooks. If the sender threads run, the event is
+ * queued for the asynchronous delivery. Each webhook takes the event
+ * independently, the event is retried later only for the webhooks which
+ * failed or whose send queue is full
+ * @param E An event object
+ * @param webhooks The bitmap of the webhooks to post the event to, on
+ * return the bitmap of the webhooks which didn't take the event
+ * @return If any webhook failed, return Handler_Webhook flag or
+ * Handler_Succeeded flag if succeeded
+ */
+Handler_Type Webhook_send(Event_T E, unsigned *webhooks);
+
+
+#endif
@@ -130,8 +130,12 @@
 #include "processor.h"
 #include "md5.h"
 #include "sha1.h"
+#include "sha256.h"
 #include "checksum.h"
 #include "process_sysdep.h"
+#include "ServiceStatus.h"
+#include "RegexCache.h"
+#include "LiteralMatch.h"
 
 // libmonit
 #include "io/File.h"
@@ -169,6 +173,8 @@ extern char *argyytext;
 extern char *currentfile;
 extern char *argcurrentfile;
 extern int buffer_stack_ptr;
+extern unsigned long long servicehash;
+extern unsigned long long prevservicehash;
 
 /* Local variables */
 static int cfg_errflag = 0;
@@ -189,7 +195,23 @@ static struct Exist_T existset = {};
 static struct Status_T statusset = {};
 static struct Perm_T permset = {};
 static struct Size_T sizeset = {};
+static struct Certificate_T certificateset = {};
+static struct FileCount_T filecountset = {};
 static struct Uptime_T uptimeset = {};
+static struct Latency_T latencyset = {};
+static struct Trend_T trendset = {};
+static Statistics_Rate_T statisticset = {};
+/* The user and group lookups, the name service (e.g. LDAP) is asked once per name in the parse */
+static struct {
+        int count;
+        int size;
+        struct idcache_t {
+                bool group;
+                char *name;                  /* The name or NULL if looked up by id */
+                long id;
+                long result;               /* The resolved id or -1 if not found */
+        } *list;
+} idcache = {};
 static struct LinkStatus_T linkstatusset = {};
 static struct LinkSpeed_T linkspeedset = {};
 static struct LinkSaturation_T linksaturationset = {};
@@ -201,6 +223,8 @@ static struct SslOptions_T sslset = {};
 static struct Port_T portset = {};
 static struct MailServer_T mailserverset = {};
 static struct Mmonit_T mmonitset = {};
+static struct Webhook_T webhookset = {};
+static struct Mqtt_T mqttset = {};
 static struct FileSystem_T filesystemset = {};
 static struct Resource_T resourceset = {};
 static struct Checksum_T checksumset = {};
@@ -217,6 +241,7 @@ static unsigned int repeat2 = 0;
 static Digest_Type digesttype = Digest_Cleartext;
 
 #define BITMAP_MAX (sizeof(long long) * 8)
+#define WEBSOCKET_PING_MAX 1000
 
 
 /* -------------------------------------------------------------- Prototypes */
@@ -235,7 +260,11 @@ static void  addresource(Resource_T);
 static void  addtimestamp(Timestamp_T);
 static void  addactionrate(ActionRate_T);
 static void  addsize(Size_T);
+static void  addcertificate(Certificate_T);
+static void  addfilecount(FileCount_T);
 static void  adduptime(Uptime_T);
+static void  addlatency(Latency_T);
+static void  addtrend(Trend_T);
 static void  addpid(Pid_T);
 static void  addppid(Pid_T);
 static void  addfsflag(FsFlag_T);
@@ -248,9 +277,14 @@ static void  addbandwidth(Bandwidth_T *, Bandwidth_T);
 static void  addfilesystem(FileSystem_T);
 static void  addicmp(Icmp_T);
 static void  addgeneric(Port_T, char*, char*);
+static void  adddnsquery(Port_T, char *, char *, char *);
 static void  addcommand(int, unsigned);
 static void  addargument(char *);
 static void  addmmonit(Mmonit_T);
+static void  addwebhook(Webhook_T);
+static void  addmqtt(Mqtt_T);
+static void  check_urlprotocol(URL_T, const char *);
+static void  addclusterpeer(URL_T);
 static void  addmailserver(MailServer_T);
 static bool addcredentials(char *, char *, Digest_Type, bool);
 #ifdef HAVE_LIBPAM
@@ -269,6 +303,7 @@ static Gid_T addgid(Gid_T);
 static void  addeuid(uid_t);
 static void  addegid(gid_t);
 static void  addeventaction(EventAction_T *, Action_Type, Action_Type);
+static unsigned long long cyclesmask(int);
 static void  prepare_urlrequest(URL_T U);
 static void  seturlrequest(int, char *);
 static void  setlogfile(char *);
@@ -277,12 +312,19 @@ static void  reset_sslset(void);
 static void  reset_mailset(void);
 static void  reset_mailserverset(void);
 static void  reset_mmonitset(void);
+static void  reset_webhookset(void);
+static void  reset_mqttset(void);
 static void  reset_portset(void);
 static void  reset_resourceset(void);
 static void  reset_timestampset(void);
 static void  reset_actionrateset(void);
 static void  reset_sizeset(void);
+static void  reset_certificateset(void);
+static void  reset_filecountset(void);
 static void  reset_uptimeset(void);
+static void  reset_latencyset(void);
+static void  reset_trendset(void);
+static void  reset_statisticset(void);
 static void  reset_pidset(void);
 static void  reset_ppidset(void);
 static void  reset_fsflagset(void);
@@ -305,11 +347,14 @@ static int   check_perm(int);
 static void  check_exec(char *);
 static int   cleanup_hash_string(char *);
 static void  check_depend(void);
+static long  resolve_id(bool, const char *, long);
+static void  reset_idcache(void);
 static void  setsyslog(char *);
 static command_t copycommand(command_t);
 static int verifyMaxForward(int);
 static void _setPEM(char **store, char *path, const char *description, bool isFile);
 static void _setSSLOptions(SslOptions_T options);
+static bool _isSSLOptionsEqual(SslOptions_T a, SslOptions_T b);
 #ifdef HAVE_OPENSSL
 static void _setSSLVersion(short version);
 #endif
@@ -328,29 +373,36 @@ static void addfiledescriptors(Operator_Type, bool, long long, float, Action_Typ
 }
 
 %token IF ELSE THEN FAILED
-%token SET LOGFILE FACILITY DAEMON SYSLOG MAILSERVER HTTPD ALLOW REJECTOPT ADDRESS INIT TERMINAL BATCH
-%token READONLY CLEARTEXT MD5HASH SHA1HASH CRYPT DELAY
+%token SET LOGFILE FACILITY JSON DAEMON SYSLOG MAILSERVER WEBHOOK HTTPD ALLOW BEARERTOKEN REJECTOPT ADDRESS INIT TERMINAL BATCH WORKERS JITTER RATELIMIT RECHECK BACKOFF PROCESSEVENTS FILEEVENTS PROCESSSCANNERS SETPROCFS CGROUPACCOUNTING CGROUP
+%token <number> PROCESSACCOUNTING
+%token READONLY CLEARTEXT MD5HASH SHA1HASH SHA256HASH CRYPT DELAY
 %token PEMFILE PEMKEY PEMCHAIN ENABLE DISABLE SSLTOKEN CIPHER CLIENTPEMFILE ALLOWSELFCERTIFICATION SELFSIGNED VERIFY CERTIFICATE CACERTIFICATEFILE CACERTIFICATEPATH VALID
 %token INTERFACE LINK PACKET BYTEIN BYTEOUT PACKETIN PACKETOUT SPEED SATURATION UPLOAD DOWNLOAD TOTAL
 %token IDFILE STATEFILE SEND EXPECT CYCLE COUNT REMINDER REPEAT
-%token LIMITS SENDEXPECTBUFFER EXPECTBUFFER FILECONTENTBUFFER HTTPCONTENTBUFFER PROGRAMOUTPUT NETWORKTIMEOUT PROGRAMTIMEOUT STARTTIMEOUT STOPTIMEOUT RESTARTTIMEOUT
+%token LIMITS SENDEXPECTBUFFER EXPECTBUFFER FILECONTENTBUFFER FILECONTENTBUDGET HTTPCONTENTBUFFER PROGRAMOUTPUT NETWORKTIMEOUT PROGRAMTIMEOUT STARTTIMEOUT STOPTIMEOUT RESTARTTIMEOUT FILESYSTEMTIMEOUT CHECKTIMEOUT CHECKQUARANTINE
 %token PIDFILE START STOP PATHTOK RSAKEY
-%token HOST HOSTNAME PORT IPV4 IPV6 TYPE UDP TCP TCPSSL PROTOCOL CONNECTION
+%token HOST HOSTNAME DIGEST PORT IPV4 IPV6 TYPE UDP TCP TCPSSL PROTOCOL CONNECTION
 %token ALERT NOALERT MAILFORMAT UNIXSOCKET SIGNATURE
-%token TIMEOUT RETRY RESTART CHECKSUM EVERY NOTEVERY
-%token DEFAULT HTTP HTTPS APACHESTATUS FTP SMTP SMTPS POP POPS IMAP IMAPS CLAMAV NNTP NTP3 MYSQL MYSQLS DNS WEBSOCKET MQTT
+%token TIMEOUT RETRY KEEPALIVE RESTART CHECKSUM EVERY NOTEVERY RESPONSETIME GROWTH
+%token DEFAULT HTTP HTTPS APACHESTATUS FTP SMTP SMTPS POP POPS IMAP IMAPS CLAMAV NNTP NTP3 MYSQL MYSQLS DNS WEBSOCKET MQTT GRPC KAFKA NATS
 %token SSH DWP LDAP2 LDAP3 RDATE RSYNC TNS PGSQL POSTFIXPOLICY SIP LMTP GPS RADIUS MEMCACHE REDIS MONGODB SIEVE SPAMASSASSIN FAIL2BAN
 %token <string> STRING PATH MAILADDR MAILFROM MAILREPLYTO MAILSUBJECT
 %token <string> MAILBODY SERVICENAME STRINGNAME
+%token <real> PERCENTILE
 %token <number> NUMBER PERCENT LOGLIMIT CLOSELIMIT DNSLIMIT KEEPALIVELIMIT
 %token <number> REPLYLIMIT REQUESTLIMIT STARTLIMIT WAITLIMIT GRACEFULLIMIT
-%token <number> CLEANUPLIMIT
+%token <number> CLEANUPLIMIT RATEFUNCTION
+%token CLIENTS REPLICATIONLAG DATABASE QUERY RECORD ANSWER PLUGIN SERVICE TOPIC BROKERS CLUSTER SETCLUSTER SERVERS EVICTIONS HITRATIO
 %token <real> REAL
 %token CHECKPROC CHECKFILESYS CHECKFILE CHECKDIR CHECKHOST CHECKSYSTEM CHECKFIFO CHECKPROGRAM CHECKNET
-%token THREADS CHILDREN METHOD GET HEAD STATUS ORIGIN VERSIONOPT READ WRITE OPERATION SERVICETIME DISK
+%token THREADS CHILDREN METHOD GET HEAD STATUS ORIGIN VERSIONOPT READ WRITE OPERATION SERVICETIME UTILIZATION DISK
 %token RESOURCE MEMORY TOTALMEMORY LOADAVG1 LOADAVG5 LOADAVG15 SWAP
 %token MODE ACTIVE PASSIVE MANUAL ONREBOOT NOSTART LASTSTATE
-%token CORE CPU TOTALCPU CPUUSER CPUSYSTEM CPUWAIT CPUNICE CPUHARDIRQ CPUSOFTIRQ CPUSTEAL CPUGUEST CPUGUESTNICE
+%token <number> PRIORITY
+%token <number> PRESSURECPU PRESSUREMEMORY PRESSUREIO
+%token FULL IODELAY MAXTHREADCPU
+%token HUGEPAGES PSS USS CGROUPMEMORY
+%token CORE NUMANODE CPU TOTALCPU CPUUSER CPUSYSTEM CPUWAIT CPUNICE CPUHARDIRQ CPUSOFTIRQ CPUSTEAL CPUGUEST CPUGUESTNICE
 %token GROUP REQUEST DEPENDS BASEDIR SLOT EVENTQUEUE SECRET HOSTHEADER
 %token UID EUID GID MMONIT INSTANCE USERNAME PASSWORD
 %token TIME ATIME CTIME MTIME CHANGED MILLISECOND SECOND MINUTE HOUR DAY MONTH 
@@ -368,6 +420,9 @@ static void addfiledescriptors(Operator_Type, bool, long long, float, Action_Typ
 %token FIPS
 %token SECURITY ATTRIBUTE
 %token FILEDESCRIPTORS
+%token FILES OLDEST NEWEST
+%token DELTA RELAY PEER CBOR QOS
+%token CONNECTIONS ESTABLISHED LISTEN CLOSEWAIT SENT RECEIVED
 
 %left GREATER GREATEROREQUAL LESS LESSOREQUAL EQUAL NOTEQUAL
 
@@ -384,10 +439,23 @@ statement_list  : statement
 statement       : setalert
                 | setssl
                 | setdaemon
+                | setworkers
+                | setjitter
+                | setratelimit
+                | setrecheck
+                | setbackoff
+                | setprocessevents
+                | setprocessaccounting
+                | setfileevents
+                | setprocessscanners
+                | setprocfs
                 | setterminal
                 | setlog
                 | seteventqueue
                 | setmmonits
+                | setcluster
+                | setwebhooks
+                | setmqtt
                 | setmailservers
                 | setmailformat
                 | sethttpd
@@ -423,6 +491,7 @@ optproc         : start
                 | uid
                 | euid
                 | secattr
+                | cgroupaccounting
                 | filedescriptorsprocess
                 | filedescriptorsprocesstotal
                 | gid
@@ -430,14 +499,17 @@ optproc         : start
                 | connection
                 | connectionurl
                 | connectionunix
+                | responsetime
                 | actionrate
                 | alert
                 | every
                 | mode
                 | onreboot
+                | priority
                 | group
                 | depend
                 | resourceprocess
+                | trend
                 ;
 
 optfilelist      : /* EMPTY */
@@ -457,9 +529,11 @@ optfile         : start
                 | gid
                 | checksum
                 | size
+                | certificate
                 | match
                 | mode
                 | onreboot
+                | priority
                 | group
                 | depend
                 ;
@@ -480,6 +554,7 @@ optfilesys      : start
                 | gid
                 | mode
                 | onreboot
+                | priority
                 | group
                 | depend
                 | inode
@@ -487,7 +562,9 @@ optfilesys      : start
                 | read
                 | write
                 | servicetime
+                | utilization
                 | fsflag
+                | trend
                 ;
 
 optdirlist      : /* EMPTY */
@@ -499,6 +576,8 @@ optdir          : start
                 | restart
                 | exist
                 | timestamp
+                | size
+                | filecount
                 | actionrate
                 | every
                 | alert
@@ -507,6 +586,7 @@ optdir          : start
                 | gid
                 | mode
                 | onreboot
+                | priority
                 | group
                 | depend
                 ;
@@ -520,14 +600,17 @@ opthost         : start
                 | restart
                 | connection
                 | connectionurl
+                | responsetime
                 | icmp
                 | actionrate
                 | alert
                 | every
                 | mode
                 | onreboot
+                | priority
                 | group
                 | depend
+                | trend
                 ;
 
 optnetlist      : /* EMPTY */
@@ -546,6 +629,7 @@ optnet          : start
                 | every
                 | mode
                 | onreboot
+                | priority
                 | alert
                 | group
                 | depend
@@ -563,11 +647,13 @@ optsystem       : start
                 | every
                 | mode
                 | onreboot
+                | priority
                 | group
                 | depend
                 | resourcesystem
                 | uptime
                 | filedescriptorssystem
+                | trend
                 ;
 
 optfifolist     : /* EMPTY */
@@ -587,6 +673,7 @@ optfifo         : start
                 | gid
                 | mode
                 | onreboot
+                | priority
                 | group
                 | depend
                 ;
@@ -603,9 +690,11 @@ optprogram      : start
                 | every
                 | mode
                 | onreboot
+                | priority
                 | group
                 | depend
                 | statusvalue
+                | match
                 ;
 
 setalert        : SET alertmail formatlist reminder {
@@ -631,6 +720,72 @@ setdaemon       : SET DAEMON NUMBER startdelay {
                   }
                 ;
 
+setworkers      : SET WORKERS NUMBER {
+                        if ($3 < 1)
+                                yyerror2("The number of workers must be greater or equal to 1");
+                        Run.workers = $3;
+                  }
+                ;
+
+setjitter       : SET JITTER NUMBER PERCENT {
+                        if ($3 < 0 || $3 > 100)
+                                yyerror2("The jitter must be between 0 and 100 percent");
+                        Run.jitter = $3;
+                  }
+                ;
+
+setratelimit    : SET RATELIMIT NUMBER SECOND {
+                        if ($3 < 0)
+                                yyerror2("The rate limit must be greater or equal to 0");
+                        Run.ratelimit = $3;
+                  }
+                ;
+
+setrecheck      : SET RECHECK NUMBER SECOND {
+                        if ($3 < 1)
+                                yyerror2("The recheck interval must be greater or equal to 1 second");
+                        Run.recheck = $3;
+                  }
+                ;
+
+setbackoff      : SET BACKOFF NUMBER CYCLE {
+                        if ($3 < 1)
+                                yyerror2("The backoff must be greater or equal to 1 cycle");
+                        Run.backoff = $3;
+                  }
+                ;
+
+setprocessevents : SET PROCESSEVENTS {
+                        Run.flags |= Run_ProcessEvents;
+                  }
+                ;
+
+setprocessaccounting : SET PROCESSACCOUNTING {
+                        if ($<number>2)
+                                Run.flags |= Run_ProcessAccounting;
+                        else
+                                Run.flags &= ~Run_ProcessAccounting;
+                  }
+                ;
+
+setfileevents   : SET FILEEVENTS {
+                        Run.flags |= Run_FileEvents;
+                  }
+                ;
+
+setprocessscanners : SET PROCESSSCANNERS NUMBER {
+                        if ($3 < 1)
+                                yyerror2("The number of process scanners must be greater or equal to 1");
+                        Run.processscanners = $3;
+                  }
+                ;
+
+setprocfs       : SETPROCFS PATH {
+                        FREE(Run.procfs);
+                        Run.procfs = $2;
+                  }
+                ;
+
 setterminal     : SET TERMINAL BATCH {
                         Run.flags |= Run_Batch;
                   }
@@ -679,6 +834,9 @@ limit           : SENDEXPECTBUFFER ':' NUMBER unit {
                 | FILECONTENTBUFFER ':' NUMBER unit {
                         Run.limits.fileContentBuffer = $3 * $<number>4;
                   }
+                | FILECONTENTBUDGET ':' NUMBER unit {
+                        Run.limits.fileContentBudget = (size_t)$3 * $<number>4;
+                  }
                 | HTTPCONTENTBUFFER ':' NUMBER unit {
                         Run.limits.httpContentBuffer = $3 * $<number>4;
                   }
@@ -715,6 +873,21 @@ limit           : SENDEXPECTBUFFER ':' NUMBER unit {
                 | RESTARTTIMEOUT ':' NUMBER SECOND {
                         Run.limits.restartTimeout = $3 * 1000;
                   }
+                | FILESYSTEMTIMEOUT ':' NUMBER MILLISECOND {
+                        Run.limits.filesystemTimeout = $3;
+                  }
+                | FILESYSTEMTIMEOUT ':' NUMBER SECOND {
+                        Run.limits.filesystemTimeout = $3 * 1000;
+                  }
+                | CHECKTIMEOUT ':' NUMBER MILLISECOND {
+                        Run.limits.checkTimeout = $3;
+                  }
+                | CHECKTIMEOUT ':' NUMBER SECOND {
+                        Run.limits.checkTimeout = $3 * 1000;
+                  }
+                | CHECKQUARANTINE ':' NUMBER {
+                        Run.limits.checkQuarantine = $3;
+                  }
                 ;
 
 setfips         : SET FIPS {
@@ -722,7 +895,7 @@ setfips         : SET FIPS {
                   }
                 ;
 
-setlog          : SET LOGFILE PATH   {
+setlog          : SET LOGFILE PATH logoptlist {
                         if (! Run.files.log || ihp.logfile) {
                                 ihp.logfile = true;
                                 setlogfile($3);
@@ -730,14 +903,28 @@ setlog          : SET LOGFILE PATH   {
                                 Run.flags |= Run_Log;
                         }
                   }
-                | SET LOGFILE SYSLOG {
+                | SET LOGFILE SYSLOG logoptlist {
                         setsyslog(NULL);
                   }
-                | SET LOGFILE SYSLOG FACILITY STRING {
+                | SET LOGFILE SYSLOG FACILITY STRING logoptlist {
                         setsyslog($5); FREE($5);
                   }
                 ;
 
+logoptlist      : /* EMPTY */
+                | logoptlist logopt
+                ;
+
+logopt          : JSON {
+                        Run.flags |= Run_LogJson;
+                  }
+                | REPEAT NUMBER MINUTE {
+                        if ($<number>2 < 1)
+                                yyerror2("The log repeat limit must be at least 1");
+                        Run.logrepeat = $<number>2;
+                  }
+                ;
+
 seteventqueue   : SET EVENTQUEUE BASEDIR PATH {
                         Run.eventlist_dir = $4;
                   }
@@ -777,6 +964,7 @@ mmonitlist      : mmonit credentials
                 ;
 
 mmonit          : URLOBJECT mmonitoptlist {
+                        check_urlprotocol($<url>1, "http");
                         mmonitset.url = $<url>1;
                         addmmonit(&mmonitset);
                   }
@@ -789,6 +977,109 @@ mmonitoptlist : /* EMPTY */
 mmonitopt       : TIMEOUT NUMBER SECOND {
                         mmonitset.timeout = $<number>2 * 1000; // net timeout is in milliseconds internally
                   }
+                | DELTA {
+                        mmonitset.snapshot = MMONIT_SNAPSHOT;
+                  }
+                | DELTA FULL NUMBER CYCLE {
+                        if ($<number>3 < 1)
+                                yyerror2("The full status interval must be at least one cycle");
+                        mmonitset.snapshot = $<number>3;
+                  }
+                | RELAY {
+                        mmonitset.relay = true;
+                  }
+                | ssl
+                | sslchecksum
+                | sslversion
+                | certmd5
+                ;
+
+setcluster      : SETCLUSTER clusteroptlist
+                ;
+
+clusteroptlist  : clusteropt
+                | clusteroptlist clusteropt
+                ;
+
+clusteropt      : GROUP STRINGNAME {
+                        FREE(Run.cluster.group);
+                        Run.cluster.group = $2;
+                  }
+                | PEER URLOBJECT {
+                        check_urlprotocol($<url>2, "http");
+                        addclusterpeer($<url>2);
+                  }
+                | TIMEOUT NUMBER SECOND {
+                        if ($<number>2 < 2)
+                                yyerror2("The cluster timeout must be at least 2 seconds");
+                        Run.cluster.timeout = $<number>2;
+                  }
+                ;
+
+setwebhooks     : SET WEBHOOK webhooklist
+                ;
+
+webhooklist     : webhook
+                | webhooklist webhook
+                ;
+
+webhook         : URLOBJECT webhookoptlist {
+                        check_urlprotocol($<url>1, "http");
+                        webhookset.url = $<url>1;
+                        addwebhook(&webhookset);
+                  }
+                ;
+
+webhookoptlist  : /* EMPTY */
+                | webhookoptlist webhookopt
+                ;
+
+webhookopt      : TIMEOUT NUMBER SECOND {
+                        webhookset.timeout = $<number>2 * 1000; // net timeout is in milliseconds internally
+                  }
+                | EVERY NUMBER SECOND {
+                        webhookset.interval = $<number>2;
+                  }
+                | WORKERS NUMBER {
+                        if ($<number>2 < 1)
+                                yyerror2("The number of webhook workers must be at least 1");
+                        webhookset.workers = $<number>2;
+                  }
+                | ssl
+                | sslchecksum
+                | sslversion
+                | certmd5
+                ;
+
+setmqtt         : SET MQTT URLOBJECT mqttoptlist {
+                        mqttset.url = $<url>3;
+                        addmqtt(&mqttset);
+                  }
+                ;
+
+mqttoptlist     : /* EMPTY */
+                | mqttoptlist mqttopt
+                ;
+
+mqttopt         : TIMEOUT NUMBER SECOND {
+                        mqttset.timeout = $<number>2 * 1000; // net timeout is in milliseconds internally
+                  }
+                | JSON {
+                        mqttset.format = MqttFormat_Json;
+                  }
+                | CBOR {
+                        mqttset.format = MqttFormat_Cbor;
+                  }
+                | QOS NUMBER {
+                        if ($<number>2 > 1)
+                                yyerror2("The MQTT QoS must be 0 or 1");
+                        mqttset.qos = $<number>2;
+                  }
+                | FULL NUMBER CYCLE {
+                        if ($<number>2 < 1)
+                                yyerror2("The full status interval must be at least one cycle");
+                        mqttset.snapshot = $<number>2;
+                  }
                 | ssl
                 | sslchecksum
                 | sslversion
@@ -879,8 +1170,11 @@ sslchecksum     : CERTIFICATE CHECKSUM checksumoperator STRING {
                                 case 40:
                                         sslset.checksumType = Hash_Sha1;
                                         break;
+                                case 64:
+                                        sslset.checksumType = Hash_Sha256;
+                                        break;
                                 default:
-                                        yyerror2("Unknown checksum type: [%s] is not MD5 nor SHA1", sslset.checksum);
+                                        yyerror2("Unknown checksum type: [%s] is not MD5, SHA1 nor SHA256", sslset.checksum);
                         }
                   }
                 | CERTIFICATE CHECKSUM MD5HASH checksumoperator STRING {
@@ -897,6 +1191,13 @@ sslchecksum     : CERTIFICATE CHECKSUM checksumoperator STRING {
                                 yyerror2("Unknown checksum type: [%s] is not SHA1", sslset.checksum);
                         sslset.checksumType = Hash_Sha1;
                   }
+                | CERTIFICATE CHECKSUM SHA256HASH checksumoperator STRING {
+                        sslset.flags = SSL_Enabled;
+                        sslset.checksum = $<string>5;
+                        if (cleanup_hash_string(sslset.checksum) != 64)
+                                yyerror2("Unknown checksum type: [%s] is not SHA256", sslset.checksum);
+                        sslset.checksumType = Hash_Sha256;
+                  }
                 ;
 
 checksumoperator : /* EMPTY */
@@ -987,10 +1288,19 @@ certmd5         : CERTMD5 STRING { // Backward compatibility
                   }
                 ;
 
-setmailservers  : SET MAILSERVER mailserverlist nettimeout hostname {
+setmailservers  : SET MAILSERVER mailserverlist nettimeout hostname maildigest {
                         if (($<number>4) > SMTP_TIMEOUT)
                                 Run.mailserver_timeout = $<number>4;
                         Run.mail_hostname = $<string>5;
+                        Run.mail_digest = $<number>6;
+                  }
+                ;
+
+maildigest      : /* EMPTY */ {
+                        $<number>$ = 0;
+                  }
+                | DIGEST NUMBER SECOND {
+                        $<number>$ = $2;
                   }
                 ;
 
@@ -1089,6 +1399,8 @@ httpdoption     : ssl
                 | allow
                 | httpdport
                 | httpdsocket
+                | httpdworkers
+                | httpdconnections
                 ;
 
 /* deprecated by "ssl" options since monit 5.21 (kept for backward compatibility) */
@@ -1116,6 +1428,20 @@ httpdport       : PORT NUMBER {
                   }
                 ;
 
+httpdworkers    : WORKERS NUMBER {
+                        if ($2 < 1)
+                                yyerror2("The number of HTTP workers must be greater or equal to 1");
+                        Run.httpd.workers = $2;
+                  }
+                ;
+
+httpdconnections : CONNECTIONS NUMBER {
+                        if ($2 < 1)
+                                yyerror2("The HTTP connections limit must be greater or equal to 1");
+                        Run.httpd.connections = $2;
+                  }
+                ;
+
 httpdsocket     : UNIXSOCKET PATH httpdsocketoptionlist {
                         Run.httpd.flags |= Httpd_Unix;
                         Run.httpd.socket.unix.path = $2;
@@ -1174,6 +1500,9 @@ bindaddress     : ADDRESS STRING {
 allow           : ALLOW STRING':'STRING readonly {
                         addcredentials($2, $4, Digest_Cleartext, $<number>5);
                   }
+                | BEARERTOKEN STRING':'STRING readonly {
+                        addcredentials($2, $4, Digest_Token, $<number>5);
+                  }
                 | ALLOW '@'STRING readonly {
 #ifdef HAVE_LIBPAM
                         addpamauth($3, $<number>4);
@@ -1261,16 +1590,32 @@ checkproc       : CHECKPROC SERVICENAME PIDFILE PATH {
                         createservice(Service_Process, $<string>2, $4, check_process);
                         matchset.ignore = false;
                         matchset.match_path = NULL;
-                        matchset.match_string = Str_dup($4);
+                        matchset.match_string = current->path;
                         addmatch(&matchset, Action_Ignored, 0);
                   }
                 | CHECKPROC SERVICENAME MATCH PATH {
                         createservice(Service_Process, $<string>2, $4, check_process);
                         matchset.ignore = false;
                         matchset.match_path = NULL;
-                        matchset.match_string = Str_dup($4);
+                        matchset.match_string = current->path;
                         addmatch(&matchset, Action_Ignored, 0);
                   }
+                | CHECKPROC SERVICENAME CGROUP cgroupscope {
+                        createservice(Service_Process, $<string>2, Str_dup($<string>4), check_process);
+                        current->cgroup = $<string>4;
+                  }
+                | CHECKPROC SERVICENAME MATCH STRING CGROUP cgroupscope {
+                        createservice(Service_Process, $<string>2, $4, check_process);
+                        current->cgroup = $<string>6;
+                        matchset.ignore = false;
+                        matchset.match_path = NULL;
+                        matchset.match_string = current->path;
+                        addmatch(&matchset, Action_Ignored, 0);
+                  }
+                ;
+
+cgroupscope     : STRING { $<string>$ = $1; }
+                | PATH   { $<string>$ = $1; }
                 ;
 
 checkfile       : CHECKFILE SERVICENAME PATHTOK PATH {
@@ -1299,14 +1644,14 @@ checkhost       : CHECKHOST SERVICENAME ADDRESS STRING {
 checknet        : CHECKNET SERVICENAME ADDRESS STRING {
                         if (Link_isGetByAddressSupported()) {
                                 createservice(Service_Net, $<string>2, $4, check_net);
-                                current->inf.net->stats = Link_createForAddress($4);
+                                current->inf.net->stats = Link_createForAddress(current->path);
                         } else {
                                 yyerror("Network monitoring by IP address is not supported on this platform, please use 'check network <foo> with interface <bar>' instead");
                         }
                   }
                 | CHECKNET SERVICENAME INTERFACE STRING {
                         createservice(Service_Net, $<string>2, $4, check_net);
-                        current->inf.net->stats = Link_createForInterface($4);
+                        current->inf.net->stats = Link_createForInterface(current->path);
                   }
                 ;
 
@@ -1330,20 +1675,30 @@ checkfifo       : CHECKFIFO SERVICENAME PATHTOK PATH {
                   }
                 ;
 
-checkprogram    : CHECKPROGRAM SERVICENAME PATHTOK argumentlist programtimeout {
+checkprogram    : CHECKPROGRAM SERVICENAME PATHTOK argumentlist programtimeout programworker {
                         createservice(Service_Program, $<string>2, NULL, check_program);
                         current->program->timeout = $<number>5;
+                        current->program->worker = $<number>6;
                         current->program->lastOutput = StringBuffer_create(64);
                         current->program->inprogressOutput = StringBuffer_create(64);
                  }
-                | CHECKPROGRAM SERVICENAME PATHTOK argumentlist useroptionlist programtimeout {
+                | CHECKPROGRAM SERVICENAME PATHTOK argumentlist useroptionlist programtimeout programworker {
                         createservice(Service_Program, $<string>2, NULL, check_program);
                         current->program->timeout = $<number>6;
+                        current->program->worker = $<number>7;
                         current->program->lastOutput = StringBuffer_create(64);
                         current->program->inprogressOutput = StringBuffer_create(64);
                  }
                 ;
 
+programworker   : /* EMPTY */ {
+                        $<number>$ = false;
+                  }
+                | WORKERS {
+                        $<number>$ = true;
+                  }
+                ;
+
 start           : START argumentlist starttimeout {
                         addcommand(START, $<number>3);
                   }
@@ -1443,12 +1798,14 @@ connectionopt   : ip
                 | connectiontimeout
                 | outgoing
                 | retry
+                | keepalive
                 | ssl
                 | sslchecksum
                 | sslexpire
                 ;
 
 connectionurl   : IF FAILED URL URLOBJECT connectionurloptlist rate1 THEN action1 recovery {
+                        check_urlprotocol($<url>4, "http");
                         prepare_urlrequest($<url>4);
                         addeventaction(&(portset).action, $<number>8, $<number>9);
                         addport(&(current->portlist), &portset);
@@ -1482,6 +1839,7 @@ connectionuxopt : type
                 | sendexpect
                 | connectiontimeout
                 | retry
+                | keepalive
                 ;
 
 icmp            : IF FAILED ICMP icmptype icmpoptlist rate1 THEN action1 recovery {
@@ -1575,7 +1933,7 @@ protocol        : PROTOCOL APACHESTATUS apache_stat_list {
                 | PROTOCOL DEFAULT {
                         portset.protocol = Protocol_get(Protocol_DEFAULT);
                   }
-                | PROTOCOL DNS {
+                | PROTOCOL DNS dnslist {
                         portset.protocol = Protocol_get(Protocol_DNS);
                   }
                 | PROTOCOL DWP  {
@@ -1615,6 +1973,9 @@ protocol        : PROTOCOL APACHESTATUS apache_stat_list {
                 | PROTOCOL MONGODB  {
                         portset.protocol = Protocol_get(Protocol_MONGODB);
                   }
+                | KAFKA kafkalist {
+                        portset.protocol = Protocol_get(Protocol_KAFKA);
+                  }
                 | PROTOCOL MQTT mqttlist {
                         portset.protocol = Protocol_get(Protocol_MQTT);
                   }
@@ -1628,6 +1989,9 @@ protocol        : PROTOCOL APACHESTATUS apache_stat_list {
                 | PROTOCOL SIP siplist {
                         portset.protocol = Protocol_get(Protocol_SIP);
                   }
+                | NATS natslist {
+                        portset.protocol = Protocol_get(Protocol_NATS);
+                  }
                 | PROTOCOL NNTP {
                         portset.protocol = Protocol_get(Protocol_NNTP);
                   }
@@ -1666,7 +2030,7 @@ protocol        : PROTOCOL APACHESTATUS apache_stat_list {
                 | PROTOCOL RDATE {
                         portset.protocol = Protocol_get(Protocol_RDATE);
                   }
-                | PROTOCOL REDIS  {
+                | PROTOCOL REDIS redislist {
                         portset.protocol = Protocol_get(Protocol_REDIS);
                   }
                 | PROTOCOL RSYNC {
@@ -1675,7 +2039,24 @@ protocol        : PROTOCOL APACHESTATUS apache_stat_list {
                 | PROTOCOL TNS {
                         portset.protocol = Protocol_get(Protocol_TNS);
                   }
-                | PROTOCOL PGSQL {
+                | PROTOCOL PLUGIN PATH {
+                        if (! (portset.protocol = Protocol_load($3))) {
+                                yyerror2("Cannot load the protocol plugin %s", $3);
+                                portset.protocol = Protocol_get(Protocol_DEFAULT);
+                        }
+                        FREE($3);
+                  }
+                | PROTOCOL PLUGIN STRING {
+                        if (! (portset.protocol = Protocol_load($3))) {
+                                yyerror2("Cannot load the protocol plugin %s", $3);
+                                portset.protocol = Protocol_get(Protocol_DEFAULT);
+                        }
+                        FREE($3);
+                  }
+                | PROTOCOL GRPC grpclist {
+                        portset.protocol = Protocol_get(Protocol_GRPC);
+                  }
+                | PROTOCOL PGSQL pgsqllist {
                         portset.protocol = Protocol_get(Protocol_PGSQL);
                   }
                 | PROTOCOL LMTP {
@@ -1687,7 +2068,7 @@ protocol        : PROTOCOL APACHESTATUS apache_stat_list {
                 | PROTOCOL RADIUS radiuslist {
                         portset.protocol = Protocol_get(Protocol_RADIUS);
                   }
-                | PROTOCOL MEMCACHE {
+                | PROTOCOL MEMCACHE memcachelist {
                         portset.protocol = Protocol_get(Protocol_MEMCACHE);
                   }
                 | PROTOCOL WEBSOCKET websocketlist {
@@ -1729,6 +2110,11 @@ websocket       : ORIGIN STRING {
                 | VERSIONOPT NUMBER {
                         portset.parameters.websocket.version = $<number>2;
                   }
+                | PING COUNT NUMBER {
+                        if ($<number>3 < 1 || $<number>3 > WEBSOCKET_PING_MAX)
+                                yyerror2("The websocket ping count must be between 1 and %d", WEBSOCKET_PING_MAX);
+                        portset.parameters.websocket.pings = $<number>3;
+                  }
                 ;
 
 smtplist        : /* EMPTY */
@@ -1743,6 +2129,58 @@ smtp            : username {
                   }
                 ;
 
+kafkalist       : /* EMPTY */
+                | kafkalist kafka
+                ;
+
+kafka           : TOPIC STRING {
+                        if (! portset.parameters.kafka.topics)
+                                portset.parameters.kafka.topics = List_new();
+                        List_append(portset.parameters.kafka.topics, $2);
+                  }
+                | BROKERS operator NUMBER {
+                        portset.parameters.kafka.brokersOP = $<number>2;
+                        portset.parameters.kafka.brokers = $3;
+                  }
+                ;
+
+natslist        : /* EMPTY */
+                | natslist nats
+                ;
+
+nats            : username {
+                        portset.parameters.nats.username = $<string>1;
+                  }
+                | password {
+                        portset.parameters.nats.password = $<string>1;
+                  }
+                | CLUSTER STRING {
+                        portset.parameters.nats.cluster = $2;
+                  }
+                | SERVERS operator NUMBER {
+                        portset.parameters.nats.serversOP = $<number>2;
+                        portset.parameters.nats.servers = $3;
+                  }
+                ;
+
+memcachelist    : /* EMPTY */
+                | memcachelist memcache
+                ;
+
+memcache        : EVICTIONS operator NUMBER {
+                        portset.parameters.memcache.evictionsOP = $<number>2;
+                        portset.parameters.memcache.evictions = $3;
+                  }
+                | HITRATIO operator value PERCENT {
+                        portset.parameters.memcache.hitRatioOP = $<number>2;
+                        portset.parameters.memcache.hitRatio = $<real>3;
+                  }
+                | CONNECTIONS operator NUMBER {
+                        portset.parameters.memcache.connectionsOP = $<number>2;
+                        portset.parameters.memcache.connections = $3;
+                  }
+                ;
+
 mqttlist        : /* EMPTY */
                 | mqttlist mqtt
                 ;
@@ -1755,6 +2193,61 @@ mqtt            : username {
                   }
                 ;
 
+dnslist         : /* EMPTY */
+                | dnslist dns
+                ;
+
+dns             : QUERY STRING dnsrecord dnsanswer {
+                        adddnsquery(&portset, $2, $<string>3, $<string>4);
+                  }
+                ;
+
+dnsrecord       : /* EMPTY */ {
+                        $<string>$ = NULL;
+                  }
+                | RECORD STRING {
+                        $<string>$ = $2;
+                  }
+                ;
+
+dnsanswer       : /* EMPTY */ {
+                        $<string>$ = NULL;
+                  }
+                | ANSWER STRING {
+                        $<string>$ = $2;
+                  }
+                ;
+
+grpclist        : /* EMPTY */
+                | grpclist grpc
+                ;
+
+grpc            : SERVICE STRING {
+                        if (strlen($2) > 255)
+                                yyerror2("The grpc service name is too long, the maximum is 255 characters");
+                        portset.parameters.grpc.service = $2;
+                  }
+                ;
+
+pgsqllist       : /* EMPTY */
+                | pgsqllist pgsql
+                ;
+
+pgsql           : username {
+                        portset.parameters.pgsql.username = $<string>1;
+                  }
+                | password {
+                        portset.parameters.pgsql.password = $<string>1;
+                  }
+                | DATABASE STRING {
+                        portset.parameters.pgsql.database = $2;
+                  }
+                | REPLICATIONLAG operator NUMBER time {
+                        portset.parameters.pgsql.lagOP = $<number>2;
+                        portset.parameters.pgsql.lag = $3 * $<number>4;
+                  }
+                ;
+
 mysqllist       : /* EMPTY */
                 | mysqllist mysql
                 ;
@@ -1762,6 +2255,14 @@ mysqllist       : /* EMPTY */
 mysql           : username {
                         portset.parameters.mysql.username = $<string>1;
                   }
+                | THREADS operator NUMBER {
+                        portset.parameters.mysql.threadsOP = $<number>2;
+                        portset.parameters.mysql.threads = $3;
+                  }
+                | REPLICATIONLAG operator NUMBER time {
+                        portset.parameters.mysql.lagOP = $<number>2;
+                        portset.parameters.mysql.lag = $3 * $<number>4;
+                  }
                 | password {
                         portset.parameters.mysql.password = $<string>1;
                   }
@@ -1895,6 +2396,31 @@ radius          : secret {
                   }
                 ;
 
+redislist       : /* EMPTY */
+                | redislist redis
+                ;
+
+redis           : password {
+                        portset.parameters.redis.password = $<string>1;
+                  }
+                | MEMORY operator NUMBER unit {
+                        portset.parameters.redis.memoryOP = $<number>2;
+                        portset.parameters.redis.memory = (long long)$3 * $<number>4;
+                  }
+                | CLIENTS operator NUMBER {
+                        portset.parameters.redis.clientsOP = $<number>2;
+                        portset.parameters.redis.clients = $3;
+                  }
+                | OPERATION operator NUMBER {
+                        portset.parameters.redis.operationsOP = $<number>2;
+                        portset.parameters.redis.operations = $3;
+                  }
+                | REPLICATIONLAG operator NUMBER time {
+                        portset.parameters.redis.lagOP = $<number>2;
+                        portset.parameters.redis.lag = $3 * $<number>4;
+                  }
+                ;
+
 apache_stat_list: apache_stat
                 | apache_stat_list apache_stat
                 ;
@@ -1981,6 +2507,39 @@ uptime          : IF UPTIME operator NUMBER time rate1 THEN action1 recovery {
                   }
                 ;
 
+responsetime    : IF RESPONSETIME PERCENTILE operator NUMBER MILLISECOND rate1 THEN action1 recovery {
+                        latencyset.percentile = $3;
+                        latencyset.operator = $<number>4;
+                        latencyset.limit = $5;
+                        addeventaction(&(latencyset).action, $<number>8, $<number>9);
+                        addlatency(&latencyset);
+                  }
+                | IF RESPONSETIME PERCENTILE operator NUMBER SECOND rate1 THEN action1 recovery {
+                        latencyset.percentile = $3;
+                        latencyset.operator = $<number>4;
+                        latencyset.limit = $5 * 1000.;
+                        addeventaction(&(latencyset).action, $<number>8, $<number>9);
+                        addlatency(&latencyset);
+                  }
+                ;
+
+trend           : IF trendmetric GROWTH operator value PERCENT NUMBER intervaltime rate1 THEN action1 recovery {
+                        trendset.metric = $<number>2;
+                        trendset.operator = $<number>4;
+                        trendset.limit = $<real>5;
+                        trendset.period = $7 * $<number>8;
+                        addeventaction(&(trendset).action, $<number>11, $<number>12);
+                        addtrend(&trendset);
+                  }
+                ;
+
+trendmetric     : CPU          { $<number>$ = Series_Cpu; }
+                | MEMORY       { $<number>$ = Series_Memory; }
+                | RESPONSETIME { $<number>$ = Series_ResponseTime; }
+                | READ         { $<number>$ = Series_Read; }
+                | WRITE        { $<number>$ = Series_Write; }
+                ;
+
 icmpcount       : COUNT NUMBER {
                         icmpset.count = $<number>2;
                  }
@@ -2056,6 +2615,11 @@ retry           : RETRY NUMBER {
                   }
                 ;
 
+keepalive       : KEEPALIVE {
+                        portset.keepalive = true;
+                  }
+                ;
+
 actionrate      : IF NUMBER RESTART NUMBER CYCLE THEN action1 {
                         actionrateset.count = $2;
                         actionrateset.cycle = $4;
@@ -2156,13 +2720,23 @@ every           : EVERY NUMBER CYCLE {
                         current->every.type = Every_SkipCycles;
                         current->every.spec.cycle.counter = current->every.spec.cycle.number = $2;
                  }
+                | EVERY NUMBER intervaltime {
+                        if ($2 < 1)
+                                yyerror2("The check interval must be greater than 0");
+                        current->every.type = Every_Interval;
+                        current->every.spec.interval = $2 * $<number>3;
+                 }
                 | EVERY TIMESPEC {
                         current->every.type = Every_Cron;
-                        current->every.spec.cron = $2;
+                        current->every.spec.cron.string = $2;
+                        if (! Time_parseCron($2, &current->every.spec.cron.spec))
+                                yyerror2("Invalid cron specification \"%s\"", $2);
                  }
                 | NOTEVERY TIMESPEC {
                         current->every.type = Every_NotInCron;
-                        current->every.spec.cron = $2;
+                        current->every.spec.cron.string = $2;
+                        if (! Time_parseCron($2, &current->every.spec.cron.spec))
+                                yyerror2("Invalid cron specification \"%s\"", $2);
                  }
                 ;
 
@@ -2190,6 +2764,11 @@ onreboot        : ONREBOOT START {
                   }
                 ;
 
+priority        : PRIORITY {
+                        current->priority = $<number>1;
+                  }
+                ;
+
 group           : GROUP STRINGNAME {
                         addservicegroup($2);
                         FREE($2);
@@ -2240,6 +2819,12 @@ resourceprocessopt  : resourcecpuproc
                     | resourceload
                     | resourceread
                     | resourcewrite
+                    | resourcepressure
+                    | resourceconnections
+                    | resourcetcp
+                    | resourceiodelay
+                    | resourcememsetsize
+                    | resourcecgroupmem
                     ;
 
 resourcesystem  : IF resourcesystemlist rate1 THEN action1 recovery {
@@ -2256,6 +2841,9 @@ resourcesystemopt  : resourceload
                    | resourcemem
                    | resourceswap
                    | resourcecpu
+                   | resourcecpuspread
+                   | resourcepressure
+                   | resourcehugepages
                    ;
 
 resourcecpuproc : CPU operator value PERCENT {
@@ -2268,6 +2856,11 @@ resourcecpuproc : CPU operator value PERCENT {
                         resourceset.operator = $<number>2;
                         resourceset.limit = $<real>3;
                   }
+                | MAXTHREADCPU operator value PERCENT {
+                        resourceset.resource_id = Resource_CpuPercentThread;
+                        resourceset.operator = $<number>2;
+                        resourceset.limit = $<real>3;
+                  }
                 ;
 
 resourcecpu     : resourcecpuid operator value PERCENT {
@@ -2277,6 +2870,36 @@ resourcecpu     : resourcecpuid operator value PERCENT {
                   }
                 ;
 
+resourcecpuspread : CPU CORE operator value PERCENT {
+                        if (systeminfo.statisticsAvailable & Statistics_CpuPerCore)
+                                resourceset.resource_id = Resource_CpuPerCore;
+                        else
+                                yywarning2("The CPU usage per core statistics is not available on this system\n");
+                        resourceset.operator = $<number>3;
+                        resourceset.limit = $<real>4;
+                  }
+                | CPU NUMANODE operator value PERCENT {
+                        if (systeminfo.statisticsAvailable & Statistics_CpuPerNode)
+                                resourceset.resource_id = Resource_CpuPerNode;
+                        else
+                                yywarning2("The CPU usage per NUMA node statistics is not available on this system\n");
+                        resourceset.operator = $<number>3;
+                        resourceset.limit = $<real>4;
+                  }
+                ;
+
+resourcepressure : resourcepressureid operator value PERCENT {
+                        resourceset.resource_id = $<number>1;
+                        resourceset.operator = $<number>2;
+                        resourceset.limit = $<real>3;
+                  }
+                ;
+
+resourcepressureid : PRESSURECPU    { $<number>$ = Resource_PressureCpuSome + $<number>1; }
+                   | PRESSUREMEMORY { $<number>$ = Resource_PressureMemorySome + $<number>1; }
+                   | PRESSUREIO     { $<number>$ = Resource_PressureIoSome + $<number>1; }
+                   ;
+
 resourcecpuid   : CPUUSER {
                         if (systeminfo.statisticsAvailable & Statistics_CpuUser)
                                 $<number>$ = Resource_CpuUser;
@@ -2370,6 +2993,32 @@ resourcememproc : MEMORY operator value unit {
                   }
                 ;
 
+resourcememsetsize : PSS operator value unit {
+                        resourceset.resource_id = Resource_MemoryPss;
+                        resourceset.operator = $<number>2;
+                        resourceset.limit = $<real>3 * $<number>4;
+                  }
+                | USS operator value unit {
+                        resourceset.resource_id = Resource_MemoryUss;
+                        resourceset.operator = $<number>2;
+                        resourceset.limit = $<real>3 * $<number>4;
+                  }
+                ;
+
+resourcecgroupmem : CGROUPMEMORY operator value PERCENT {
+                        resourceset.resource_id = Resource_CgroupMemoryPercent;
+                        resourceset.operator = $<number>2;
+                        resourceset.limit = $<real>3;
+                  }
+                ;
+
+resourcehugepages : HUGEPAGES operator value PERCENT {
+                        resourceset.resource_id = Resource_HugepagesPercent;
+                        resourceset.operator = $<number>2;
+                        resourceset.limit = $<real>3;
+                  }
+                ;
+
 resourceswap    : SWAP operator value unit {
                         resourceset.resource_id = Resource_SwapKbyte;
                         resourceset.operator = $<number>2;
@@ -2389,6 +3038,38 @@ resourcethreads : THREADS operator NUMBER {
                   }
                 ;
 
+resourceconnections : CONNECTIONS connectionstate operator NUMBER {
+                        resourceset.resource_id = $<number>2;
+                        resourceset.operator = $<number>3;
+                        resourceset.limit = $<number>4;
+                  }
+                ;
+
+connectionstate : /* EMPTY */ { $<number>$ = Resource_Connections; }
+                | ESTABLISHED { $<number>$ = Resource_ConnectionsEstablished; }
+                | LISTEN      { $<number>$ = Resource_ConnectionsListen; }
+                | CLOSEWAIT   { $<number>$ = Resource_ConnectionsCloseWait; }
+                ;
+
+resourcetcp     : TCP SENT statistic operator value unit currenttime {
+                        resourceset.resource_id = Resource_TcpSent;
+                        resourceset.operator = $<number>4;
+                        resourceset.limit = $<real>5 * $<number>6;
+                  }
+                | TCP RECEIVED statistic operator value unit currenttime {
+                        resourceset.resource_id = Resource_TcpReceived;
+                        resourceset.operator = $<number>4;
+                        resourceset.limit = $<real>5 * $<number>6;
+                  }
+                ;
+
+resourceiodelay : IODELAY statistic operator value PERCENT {
+                        resourceset.resource_id = Resource_IoDelay;
+                        resourceset.operator = $<number>3;
+                        resourceset.limit = $<real>4;
+                  }
+                ;
+
 resourcechild   : CHILDREN operator NUMBER {
                         resourceset.resource_id = Resource_Children;
                         resourceset.operator = $<number>2;
@@ -2426,37 +3107,49 @@ coremultiplier  : /* EMPTY */ { $<number>$ = 1; }
                 ;
 
 
-resourceread    : READ operator value unit currenttime {
+resourceread    : READ statistic operator value unit currenttime {
                         resourceset.resource_id = Resource_ReadBytes;
-                        resourceset.operator = $<number>2;
-                        resourceset.limit = $<real>3 * $<number>4;
-                  }
-                | DISK READ operator value unit currenttime {
-                        resourceset.resource_id = Resource_ReadBytesPhysical;
                         resourceset.operator = $<number>3;
                         resourceset.limit = $<real>4 * $<number>5;
                   }
-                | DISK READ operator NUMBER OPERATION {
+                | DISK READ statistic operator value unit currenttime {
+                        resourceset.resource_id = Resource_ReadBytesPhysical;
+                        resourceset.operator = $<number>4;
+                        resourceset.limit = $<real>5 * $<number>6;
+                  }
+                | DISK READ statistic operator NUMBER OPERATION {
                         resourceset.resource_id = Resource_ReadOperations;
-                        resourceset.operator = $<number>3;
-                        resourceset.limit = $<number>4;
+                        resourceset.operator = $<number>4;
+                        resourceset.limit = $<number>5;
                   }
                 ;
 
-resourcewrite   : WRITE operator value unit currenttime {
+resourcewrite   : WRITE statistic operator value unit currenttime {
                         resourceset.resource_id = Resource_WriteBytes;
-                        resourceset.operator = $<number>2;
-                        resourceset.limit = $<real>3 * $<number>4;
-                  }
-                | DISK WRITE operator value unit currenttime {
-                        resourceset.resource_id = Resource_WriteBytesPhysical;
                         resourceset.operator = $<number>3;
                         resourceset.limit = $<real>4 * $<number>5;
                   }
-                | DISK WRITE operator NUMBER OPERATION {
+                | DISK WRITE statistic operator value unit currenttime {
+                        resourceset.resource_id = Resource_WriteBytesPhysical;
+                        resourceset.operator = $<number>4;
+                        resourceset.limit = $<real>5 * $<number>6;
+                  }
+                | DISK WRITE statistic operator NUMBER OPERATION {
                         resourceset.resource_id = Resource_WriteOperations;
-                        resourceset.operator = $<number>3;
-                        resourceset.limit = $<number>4;
+                        resourceset.operator = $<number>4;
+                        resourceset.limit = $<number>5;
+                  }
+                ;
+
+statistic       : /* EMPTY */ {
+                        statisticset.function = Statistics_Current;
+                  }
+                | RATEFUNCTION {
+                        statisticset.function = $<number>1;
+                  }
+                | PERCENTILE {
+                        statisticset.function = Statistics_Percentile;
+                        statisticset.percentile = $<real>1;
                   }
                 ;
 
@@ -2468,6 +3161,8 @@ timestamptype   : TIME  { $<number>$ = Timestamp_Default; }
                 | ATIME { $<number>$ = Timestamp_Access; }
                 | CTIME { $<number>$ = Timestamp_Change; }
                 | MTIME { $<number>$ = Timestamp_Modification; }
+                | OLDEST { $<number>$ = Timestamp_Oldest; }
+                | NEWEST { $<number>$ = Timestamp_Newest; }
                 ;
 
 timestamp       : IF timestamptype operator NUMBER time rate1 THEN action1 recovery {
@@ -2503,6 +3198,12 @@ time            : /* EMPTY */ { $<number>$ = Time_Second; }
                 | MONTH       { $<number>$ = Time_Month; }
                 ;
 
+intervaltime    : SECOND      { $<number>$ = Time_Second; }
+                | MINUTE      { $<number>$ = Time_Minute; }
+                | HOUR        { $<number>$ = Time_Hour; }
+                | DAY         { $<number>$ = Time_Day; }
+                ;
+
 totaltime       : MINUTE      { $<number>$ = Time_Minute; }
                 | HOUR        { $<number>$ = Time_Hour; }
                 | DAY         { $<number>$ = Time_Day; }
@@ -2632,26 +3333,34 @@ recovery        : /* EMPTY */ {
                   }
                 ;
 
-checksum        : IF FAILED hashtype CHECKSUM rate1 THEN action1 recovery {
-                        addeventaction(&(checksumset).action, $<number>7, $<number>8);
+checksum        : IF FAILED hashtype CHECKSUM checksumverify rate1 THEN action1 recovery {
+                        addeventaction(&(checksumset).action, $<number>8, $<number>9);
                         addchecksum(&checksumset);
                   }
-                | IF FAILED hashtype CHECKSUM EXPECT STRING rate1 THEN action1
+                | IF FAILED hashtype CHECKSUM EXPECT STRING checksumverify rate1 THEN action1
                   recovery {
                         snprintf(checksumset.hash, sizeof(checksumset.hash), "%s", $6);
                         FREE($6);
-                        addeventaction(&(checksumset).action, $<number>9, $<number>10);
+                        addeventaction(&(checksumset).action, $<number>10, $<number>11);
                         addchecksum(&checksumset);
                   }
-                | IF CHANGED hashtype CHECKSUM rate1 THEN action1 {
+                | IF CHANGED hashtype CHECKSUM checksumverify rate1 THEN action1 {
                         checksumset.test_changes = true;
-                        addeventaction(&(checksumset).action, $<number>7, Action_Ignored);
+                        addeventaction(&(checksumset).action, $<number>8, Action_Ignored);
                         addchecksum(&checksumset);
                   }
                 ;
+checksumverify  : /* EMPTY */
+                | VERIFY EVERY NUMBER CYCLE {
+                        if ($3 < 1)
+                                yyerror2("The checksum verification interval must be greater than zero");
+                        checksumset.verify = $3;
+                  }
+                ;
 hashtype        : /* EMPTY */ { checksumset.type = Hash_Unknown; }
                 | MD5HASH     { checksumset.type = Hash_Md5; }
                 | SHA1HASH    { checksumset.type = Hash_Sha1; }
+                | SHA256HASH  { checksumset.type = Hash_Sha256; }
                 ;
 
 inode           : IF INODE operator NUMBER rate1 THEN action1 recovery {
@@ -2714,34 +3423,34 @@ space           : IF SPACE operator value unit rate1 THEN action1 recovery {
                   }
                 ;
 
-read            : IF READ operator value unit currenttime rate1 THEN action1 recovery {
+read            : IF READ statistic operator value unit currenttime rate1 THEN action1 recovery {
                         filesystemset.resource = Resource_ReadBytes;
-                        filesystemset.operator = $<number>3;
-                        filesystemset.limit_absolute = $<real>4 * $<number>5;
-                        addeventaction(&(filesystemset).action, $<number>9, $<number>10);
+                        filesystemset.operator = $<number>4;
+                        filesystemset.limit_absolute = $<real>5 * $<number>6;
+                        addeventaction(&(filesystemset).action, $<number>10, $<number>11);
                         addfilesystem(&filesystemset);
                   }
-                | IF READ operator NUMBER OPERATION rate1 THEN action1 recovery {
+                | IF READ statistic operator NUMBER OPERATION rate1 THEN action1 recovery {
                         filesystemset.resource = Resource_ReadOperations;
-                        filesystemset.operator = $<number>3;
-                        filesystemset.limit_absolute = $<number>4;
-                        addeventaction(&(filesystemset).action, $<number>8, $<number>9);
+                        filesystemset.operator = $<number>4;
+                        filesystemset.limit_absolute = $<number>5;
+                        addeventaction(&(filesystemset).action, $<number>9, $<number>10);
                         addfilesystem(&filesystemset);
                   }
                 ;
 
-write           : IF WRITE operator value unit currenttime rate1 THEN action1 recovery {
+write           : IF WRITE statistic operator value unit currenttime rate1 THEN action1 recovery {
                         filesystemset.resource = Resource_WriteBytes;
-                        filesystemset.operator = $<number>3;
-                        filesystemset.limit_absolute = $<real>4 * $<number>5;
-                        addeventaction(&(filesystemset).action, $<number>9, $<number>10);
+                        filesystemset.operator = $<number>4;
+                        filesystemset.limit_absolute = $<real>5 * $<number>6;
+                        addeventaction(&(filesystemset).action, $<number>10, $<number>11);
                         addfilesystem(&filesystemset);
                   }
-                | IF WRITE operator NUMBER OPERATION rate1 THEN action1 recovery {
+                | IF WRITE statistic operator NUMBER OPERATION rate1 THEN action1 recovery {
                         filesystemset.resource = Resource_WriteOperations;
-                        filesystemset.operator = $<number>3;
-                        filesystemset.limit_absolute = $<number>4;
-                        addeventaction(&(filesystemset).action, $<number>8, $<number>9);
+                        filesystemset.operator = $<number>4;
+                        filesystemset.limit_absolute = $<number>5;
+                        addeventaction(&(filesystemset).action, $<number>9, $<number>10);
                         addfilesystem(&filesystemset);
                   }
                 ;
@@ -2762,6 +3471,15 @@ servicetime     : IF SERVICETIME operator NUMBER MILLISECOND rate1 THEN action1
                   }
                 ;
 
+utilization     : IF UTILIZATION operator value PERCENT rate1 THEN action1 recovery {
+                        filesystemset.resource = Resource_Utilization;
+                        filesystemset.operator = $<number>3;
+                        filesystemset.limit_percent = $<real>4;
+                        addeventaction(&(filesystemset).action, $<number>8, $<number>9);
+                        addfilesystem(&filesystemset);
+                  }
+                ;
+
 fsflag          : IF CHANGED FSFLAG rate1 THEN action1 {
                         addeventaction(&(fsflagset).action, $<number>6, Action_Ignored);
                         addfsflag(&fsflagset);
@@ -2801,6 +3519,7 @@ match           : IF CONTENT urloperator PATH rate1 THEN action1 {
                         matchset.match_path = NULL;
                         matchset.match_string = $4;
                         addmatch(&matchset, $<number>7, 0);
+                        FREE($4);
                   }
                 | IGNORE CONTENT urloperator PATH {
                         matchset.not = $<number>3 == Operator_Equal ? false : true;
@@ -2816,6 +3535,7 @@ match           : IF CONTENT urloperator PATH rate1 THEN action1 {
                         matchset.match_path = NULL;
                         matchset.match_string = $4;
                         addmatch(&matchset, Action_Ignored, 0);
+                        FREE($4);
                   }
                 /* The below MATCH statement is deprecated (replaced by CONTENT) */
                 | IF matchflagnot MATCH PATH rate1 THEN action1 {
@@ -2830,6 +3550,7 @@ match           : IF CONTENT urloperator PATH rate1 THEN action1 {
                         matchset.match_path = NULL;
                         matchset.match_string = $4;
                         addmatch(&matchset, $<number>7, 0);
+                        FREE($4);
                   }
                 | IGNORE matchflagnot MATCH PATH {
                         matchset.ignore = true;
@@ -2843,6 +3564,7 @@ match           : IF CONTENT urloperator PATH rate1 THEN action1 {
                         matchset.match_path = NULL;
                         matchset.match_string = $4;
                         addmatch(&matchset, Action_Ignored, 0);
+                        FREE($4);
                   }
                 ;
 
@@ -2866,6 +3588,32 @@ size            : IF SIZE operator NUMBER unit rate1 THEN action1 recovery {
                         addeventaction(&(sizeset).action, $<number>6, Action_Ignored);
                         addsize(&sizeset);
                   }
+                | IF SIZE GROWTH operator NUMBER unit intervaltime rate1 THEN action1 recovery {
+                        sizeset.operator = $<number>4;
+                        sizeset.size = ((unsigned long long)$5 * $<number>6);
+                        sizeset.growth = $<number>7;
+                        addeventaction(&(sizeset).action, $<number>10, $<number>11);
+                        addsize(&sizeset);
+                  }
+                ;
+
+certificate     : IF FAILED CERTIFICATE VALID expireoperator NUMBER DAY rate1 THEN action1 recovery {
+#ifdef HAVE_OPENSSL
+                        certificateset.minimumDays = $<number>6;
+                        addeventaction(&(certificateset).action, $<number>10, $<number>11);
+                        addcertificate(&certificateset);
+#else
+                        yyerror("Certificate check cannot be activated -- SSL disabled");
+#endif
+                  }
+                ;
+
+filecount       : IF FILES operator NUMBER rate1 THEN action1 recovery {
+                        filecountset.operator = $<number>3;
+                        filecountset.limit = $4;
+                        addeventaction(&(filecountset).action, $<number>7, $<number>8);
+                        addfilecount(&filecountset);
+                  }
                 ;
 
 uid             : IF FAILED UID STRING rate1 THEN action1 recovery {
@@ -2902,6 +3650,11 @@ secattr         : IF FAILED SECURITY ATTRIBUTE STRING rate1 THEN action1 recover
                   }
                 ;
 
+cgroupaccounting : CGROUPACCOUNTING {
+                        current->cgroupAccounting = true;
+                  }
+                ;
+
 filedescriptorssystem : IF FILEDESCRIPTORS operator NUMBER rate1 THEN action1 recovery {
                         if (systeminfo.statisticsAvailable & Statistics_FiledescriptorsPerSystem)
                                 addfiledescriptors($<number>3, false, (long long)$4, -1., $<number>7, $<number>8);
@@ -3173,6 +3926,7 @@ bool parse(char *controlfile) {
                 yyparse();
                 fclose(yyin);
                 postparse();
+                reset_idcache();
         }
         END_LOCK;
 
@@ -3212,6 +3966,7 @@ static void preparse() {
         /* Reset parser */
         Run.limits.sendExpectBuffer  = LIMIT_SENDEXPECTBUFFER;
         Run.limits.fileContentBuffer = LIMIT_FILECONTENTBUFFER;
+        Run.limits.fileContentBudget = LIMIT_FILECONTENTBUDGET;
         Run.limits.httpContentBuffer = LIMIT_HTTPCONTENTBUFFER;
         Run.limits.programOutput     = LIMIT_PROGRAMOUTPUT;
         Run.limits.networkTimeout    = LIMIT_NETWORKTIMEOUT;
@@ -3219,16 +3974,35 @@ static void preparse() {
         Run.limits.stopTimeout       = LIMIT_STOPTIMEOUT;
         Run.limits.startTimeout      = LIMIT_STARTTIMEOUT;
         Run.limits.restartTimeout    = LIMIT_RESTARTTIMEOUT;
+        Run.limits.filesystemTimeout = LIMIT_FILESYSTEMTIMEOUT;
+        Run.limits.checkTimeout      = LIMIT_CHECKTIMEOUT;
+        Run.limits.checkQuarantine   = LIMIT_CHECKQUARANTINE;
         Run.onreboot                 = Onreboot_Start;
+        Run.workers                  = 1;
+        Run.jitter                   = 0;
+        Run.ratelimit                = 0;
+        Run.recheck                  = 0;
+        Run.backoff                  = 0;
+        Run.processscanners          = 0;
+        Run.procfs                   = NULL;
         Run.mmonitcredentials        = NULL;
         Run.httpd.flags              = Httpd_Disabled | Httpd_Signature;
         Run.httpd.credentials        = NULL;
         memset(&(Run.httpd.socket), 0, sizeof(Run.httpd.socket));
+        Run.httpd.workers            = HTTPD_WORKERS;
+        Run.httpd.connections        = HTTPD_CONNECTIONS;
         Run.mailserver_timeout       = SMTP_TIMEOUT;
+        Run.mail_digest              = 0;
         Run.eventlist_dir            = NULL;
         Run.eventlist_slots          = -1;
+        Run.eventlist_used           = -1;
         Run.system                   = NULL;
         Run.mmonits                  = NULL;
+        Run.webhooks                 = NULL;
+        Run.mqtt                     = NULL;
+        Run.cluster.group            = NULL;
+        Run.cluster.timeout          = CLUSTER_TIMEOUT;
+        Run.cluster.peers            = NULL;
         Run.maillist                 = NULL;
         Run.mailservers              = NULL;
         Run.MailFormat.from          = NULL;
@@ -3237,6 +4011,8 @@ static void preparse() {
         Run.MailFormat.message       = NULL;
         depend_list                  = NULL;
         Run.flags |= Run_HandlerInit | Run_MmonitCredentials;
+        Run.flags &= ~(Run_ProcessEvents | Run_ProcessAccounting | Run_FileEvents | Run_LogJson);
+        Run.logrepeat                = 0;
         for (int i = 0; i <= Handler_Max; i++)
                 Run.handler_queue[i] = 0;
 
@@ -3247,10 +4023,14 @@ static void preparse() {
         reset_gidset();
         reset_statusset();
         reset_sizeset();
+        reset_certificateset();
+        reset_filecountset();
         reset_mailset();
         reset_sslset();
         reset_mailserverset();
         reset_mmonitset();
+        reset_webhookset();
+        reset_mqttset();
         reset_portset();
         reset_permset();
         reset_icmpset();
@@ -3278,6 +4058,7 @@ static void postparse() {
 
         /* If defined - add the last service to the service list */
         if (current) {
+                current->fingerprint = servicehash;
                 addservice(current);
                 current = NULL;
         }
@@ -3364,8 +4145,10 @@ static Service_T createservice(Service_Type type, char *name, char *value, State
 
         check_name(name);
 
-        if (current)
+        if (current) {
+                current->fingerprint = prevservicehash;
                 addservice(current);
+        }
 
         NEW(current);
         current->type = type;
@@ -3392,6 +4175,7 @@ static Service_T createservice(Service_Type type, char *name, char *value, State
                         break;
         }
         Util_resetInfo(current);
+        ServiceStatus_init(current);
 
         if (type == Service_Program) {
                 NEW(current->program);
@@ -3405,11 +4189,15 @@ static Service_T createservice(Service_Type type, char *name, char *value, State
         current->mode     = Monitor_Active;
         current->monitor  = Monitor_Init;
         current->onreboot = Run.onreboot;
-        current->name     = name;
+        current->name     = Atom_new(name);
         current->name_urlescaped = Util_urlEncode(name, false);
         current->name_htmlescaped = escapeHTML(StringBuffer_create(16), name);
+        FREE(name);
         current->check    = check;
-        current->path     = value;
+        if (value) {
+                current->path = Atom_new(value);
+                FREE(value);
+        }
 
         /* Initialize general event handlers */
         addeventaction(&(current)->action_DATA,     Action_Alert,     Action_Alert);
@@ -3455,7 +4243,7 @@ static void addservice(Service_T s) {
                                         Command_appendArgument(s->program->C, s->program->args->arg[i]);
                                         snprintf(program + strlen(program), sizeof(program) - strlen(program) - 1, " %s", s->program->args->arg[i]);
                                 }
-                                s->path = Str_dup(program);
+                                s->path = Atom_new(program);
                                 if (s->program->args->has_uid)
                                         Command_setUid(s->program->C, s->program->args->uid);
                                 if (s->program->args->has_gid)
@@ -3509,6 +4297,7 @@ static void addservice(Service_T s) {
                 servicelist_conf = s;
         }
         tail = s;
+        Util_indexService(s);
 }
 
 
@@ -3516,21 +4305,17 @@ static void addservice(Service_T s) {
  * Add entry to service group list
  */
 static void addservicegroup(char *name) {
-        ServiceGroup_T g;
-
         ASSERT(name);
 
         /* Check if service group with the same name is defined already */
-        for (g = servicegrouplist; g; g = g->next)
-                if (IS(g->name, name))
-                        break;
-
+        ServiceGroup_T g = Util_getServiceGroup(name);
         if (! g) {
                 NEW(g);
                 g->name = Str_dup(name);
                 g->members = List_new();
                 g->next = servicegrouplist;
                 servicegrouplist = g;
+                Util_indexServiceGroup(g);
         }
 
         List_append(g->members, current);
@@ -3550,10 +4335,11 @@ static void adddependant(char *dependant) {
         if (current->dependantlist)
                 d->next = current->dependantlist;
 
-        d->dependant = dependant;
+        d->dependant = Atom_new(dependant);
         d->dependant_urlescaped = Util_urlEncode(dependant, false);
         d->dependant_htmlescaped = escapeHTML(StringBuffer_create(16), dependant);
         current->dependantlist = d;
+        FREE(dependant);
 
 }
 
@@ -3592,6 +4378,17 @@ static void addport(Port_T *list, Port_T port) {
         if (port->protocol->check == check_radius && port->type != Socket_Udp)
                 yyerror("Radius protocol test supports UDP only");
 
+        if (port->keepalive) {
+                if (! port->protocol->ping)
+                        yyerror2("The %s protocol test doesn't support keepalive", port->protocol->name);
+                else if (port->type != Socket_Tcp)
+                        yyerror("The keepalive option requires a TCP connection");
+                else if (port->protocol->check == check_mysql && ! port->parameters.mysql.username)
+                        yyerror("The mysql keepalive option requires credentials to be defined");
+                else if (port->protocol->check == check_pgsql && ! port->parameters.pgsql.username)
+                        yyerror("The pgsql keepalive option requires credentials to be defined");
+        }
+
         Port_T p;
         NEW(p);
         p->is_available       = Connection_Init;
@@ -3601,6 +4398,8 @@ static void addport(Port_T *list, Port_T port) {
         p->action             = port->action;
         p->timeout            = port->timeout;
         p->retry              = port->retry;
+        p->keepalive          = port->keepalive;
+        p->latency            = Histogram_new();
         p->protocol           = port->protocol;
         p->hostname           = port->hostname;
         p->url_request        = port->url_request;
@@ -3629,6 +4428,8 @@ static void addport(Port_T *list, Port_T port) {
                                 p->parameters.http.hashtype = Hash_Md5;
                         else if (strlen(p->parameters.http.checksum) == 40)
                                 p->parameters.http.hashtype = Hash_Sha1;
+                        else if (strlen(p->parameters.http.checksum) == 64)
+                                p->parameters.http.hashtype = Hash_Sha256;
                         else
                                 yyerror2("invalid checksum [%s]", p->parameters.http.checksum);
                 } else {
@@ -3649,6 +4450,27 @@ static void addport(Port_T *list, Port_T port) {
                         if (p->target.net.ssl.options.flags != SSL_Disabled)
                                 yyerror2("the rsakey checksum test can be used just with unsecured mysql protocol");
                 }
+                if ((p->parameters.mysql.threads > 0 || p->parameters.mysql.lag > 0) && ! p->parameters.mysql.username)
+                        yyerror2("the mysql status limits require credentials to be defined");
+        } else if (p->protocol->check == check_pgsql) {
+                if ((p->parameters.pgsql.database || p->parameters.pgsql.lag > 0) && ! p->parameters.pgsql.username)
+                        yyerror2("the pgsql database and replication lag options require credentials to be defined");
+        } else if (p->protocol->check == check_grpc) {
+                // gRPC requires HTTP/2, negotiate it by ALPN if SSL is used
+                if (p->family != Socket_Unix && p->target.net.ssl.options.flags)
+                        p->target.net.ssl.options.alpn = "h2";
+        }
+
+        if (p->keepalive) {
+                // Share the keepalive connection with the ports of the service with the same target and protocol, e.g. several HTTP requests to the same virtual host
+                for (Port_T q = *list; q; q = q->next) {
+                        if (q->keepalive && ! q->shared && q->protocol == p->protocol && q->family == p->family) {
+                                if (p->family == Socket_Unix ? IS(q->target.unix.pathname, p->target.unix.pathname) : (IS(q->hostname, p->hostname) && q->target.net.port == p->target.net.port && _isSSLOptionsEqual(&(q->target.net.ssl.options), &(p->target.net.ssl.options)))) {
+                                        p->shared = q;
+                                        break;
+                                }
+                        }
+                }
         }
 
         p->next = *list;
@@ -3665,7 +4487,7 @@ static void addhttpheader(Port_T port, const char *header) {
                 port->parameters.http.headers = List_new();
         }
         if (Str_startsWith(header, "Connection:") && ! Str_sub(header, "close")) {
-                yywarning("We don't recommend setting the Connection header. Monit will always close the connection even if 'keep-alive' is set\n");
+                yywarning("We don't recommend setting the Connection header. Use the keepalive option to keep the connection open across the test cycles\n");
         }
         List_append(port->parameters.http.headers, (char *)header);
 }
@@ -3683,6 +4505,8 @@ static void addresource(Resource_T rr) {
                 r->limit       = rr->limit;
                 r->action      = rr->action;
                 r->operator    = rr->operator;
+                r->match       = Util_getDoubleQExpression(rr->operator);
+                r->statistic   = statisticset;
                 r->next        = current->resourcelist;
                 current->resourcelist = r;
         } else {
@@ -3698,6 +4522,9 @@ static void addresource(Resource_T rr) {
 static void addtimestamp(Timestamp_T ts) {
         ASSERT(ts);
 
+        if ((ts->type == Timestamp_Oldest || ts->type == Timestamp_Newest) && current->type != Service_Directory)
+                yyerror2("The %s file timestamp test is supported by the directory check only", ts->type == Timestamp_Oldest ? "oldest" : "newest");
+
         Timestamp_T t;
         NEW(t);
         t->type         = ts->type;
@@ -3753,8 +4580,9 @@ static void addsize(Size_T ss) {
         s->size         = ss->size;
         s->action       = ss->action;
         s->test_changes = ss->test_changes;
-        /* Get the initial size for future comparison, if the file exists */
-        if (s->test_changes) {
+        s->growth       = ss->growth;
+        /* Get the initial size for future comparison, if the file exists (the directory tree size is initialized by the first test) */
+        if (s->test_changes && current->type != Service_Directory) {
                 s->initialized = ! stat(current->path, &buf);
                 if (s->initialized)
                         s->size = (unsigned long long)buf.st_size;
@@ -3767,6 +4595,43 @@ static void addsize(Size_T ss) {
 }
 
 
+/*
+ * Add a new Certificate object to the current service certificate list
+ */
+static void addcertificate(Certificate_T cs) {
+        ASSERT(cs);
+
+        Certificate_T c;
+        NEW(c);
+        c->minimumDays = cs->minimumDays;
+        c->action      = cs->action;
+
+        c->next = current->certificatelist;
+        current->certificatelist = c;
+
+        reset_certificateset();
+}
+
+
+/*
+ * Add a new FileCount object to the current service file count list
+ */
+static void addfilecount(FileCount_T fs) {
+        ASSERT(fs);
+
+        FileCount_T f;
+        NEW(f);
+        f->operator = fs->operator;
+        f->limit    = fs->limit;
+        f->action   = fs->action;
+
+        f->next = current->filecountlist;
+        current->filecountlist = f;
+
+        reset_filecountset();
+}
+
+
 /*
  * Add a new Uptime object to the current service uptime list
  */
@@ -3787,6 +4652,72 @@ static void adduptime(Uptime_T uu) {
 }
 
 
+/*
+ * Add a new Latency object to the current service response time list
+ */
+static void addlatency(Latency_T ll) {
+        Latency_T l;
+
+        ASSERT(ll);
+
+        if (! current->portlist && ! current->socketlist)
+                yyerror("The response time test requires a port or unix socket test to be defined before");
+
+        NEW(l);
+        l->operator = ll->operator;
+        l->percentile = ll->percentile;
+        l->limit = ll->limit;
+        l->action = ll->action;
+
+        l->next = current->latencylist;
+        current->latencylist = l;
+
+        reset_latencyset();
+}
+
+
+/*
+ * Add a new Trend object to the current service trend list
+ */
+static void addtrend(Trend_T tt) {
+        Trend_T t;
+
+        ASSERT(tt);
+
+        bool supported;
+        switch (tt->metric) {
+                case Series_Cpu:
+                case Series_Memory:
+                        supported = current->type == Service_Process || current->type == Service_System;
+                        break;
+                case Series_ResponseTime:
+                        supported = current->type == Service_Process || current->type == Service_Host;
+                        if (supported && ! current->portlist && ! current->socketlist)
+                                yyerror("The response time trend test requires a port or unix socket test to be defined before");
+                        break;
+                default:
+                        supported = current->type == Service_Process || current->type == Service_Filesystem;
+                        break;
+        }
+        if (! supported)
+                yyerror2("The %s trend test is not supported by this service type", Series_getName(tt->metric));
+        if (tt->period <= 0)
+                yyerror("The trend period must be greater than zero");
+
+        NEW(t);
+        t->metric = tt->metric;
+        t->operator = tt->operator;
+        t->limit = tt->limit;
+        t->period = tt->period;
+        t->action = tt->action;
+
+        t->next = current->trendlist;
+        current->trendlist = t;
+
+        reset_trendset();
+}
+
+
 /*
  * Add a new Pid object to the current service pid list
  */
@@ -3879,7 +4810,7 @@ static void addchecksum(Checksum_T cs) {
                         cs->type = Hash_Default;
                 if (! (Checksum_getChecksum(current->path, cs->type, cs->hash, sizeof(cs->hash)))) {
                         /* If the file doesn't exist, set dummy value */
-                        snprintf(cs->hash, sizeof(cs->hash), cs->type == Hash_Md5 ? "00000000000000000000000000000000" : "0000000000000000000000000000000000000000");
+                        snprintf(cs->hash, sizeof(cs->hash), "%.*s", cs->type == Hash_Md5 ? 32 : cs->type == Hash_Sha1 ? 40 : 64, "0000000000000000000000000000000000000000000000000000000000000000");
                         cs->initialized = false;
                         yywarning2("Cannot compute a checksum for file %s", current->path);
                 }
@@ -3891,12 +4822,14 @@ static void addchecksum(Checksum_T cs) {
                         cs->type = Hash_Md5;
                 } else if (len == 40) {
                         cs->type = Hash_Sha1;
+                } else if (len == 64) {
+                        cs->type = Hash_Sha256;
                 } else {
                         yyerror2("Unknown checksum type [%s] for file %s", cs->hash, current->path);
                         reset_checksumset();
                         return;
                 }
-        } else if ((cs->type == Hash_Md5 && len != 32) || (cs->type == Hash_Sha1 && len != 40)) {
+        } else if ((cs->type == Hash_Md5 && len != 32) || (cs->type == Hash_Sha1 && len != 40) || (cs->type == Hash_Sha256 && len != 64)) {
                 yyerror2("Invalid checksum [%s] for file %s", cs->hash, current->path);
                 reset_checksumset();
                 return;
@@ -3907,6 +4840,7 @@ static void addchecksum(Checksum_T cs) {
         c->type         = cs->type;
         c->test_changes = cs->test_changes;
         c->initialized  = cs->initialized;
+        c->verify       = cs->verify;
         c->action       = cs->action;
         snprintf(c->hash, sizeof(c->hash), "%s", cs->hash);
 
@@ -4043,10 +4977,9 @@ static void addmatch(Match_T ms, int actionnumber, int linenumber) {
         ASSERT(ms);
 
         NEW(m);
-        NEW(m->regex_comp);
 
-        m->match_string = ms->match_string;
-        m->match_path   = ms->match_path ? Str_dup(ms->match_path) : NULL;
+        m->match_string = Atom_new(ms->match_string);
+        m->match_path   = ms->match_path ? Atom_new(ms->match_path) : NULL;
         m->action       = ms->action;
         m->not          = ms->not;
         m->ignore       = ms->ignore;
@@ -4054,15 +4987,14 @@ static void addmatch(Match_T ms, int actionnumber, int linenumber) {
 
         addeventaction(&(m->action), actionnumber, Action_Ignored);
 
-        int reg_return = regcomp(m->regex_comp, ms->match_string, REG_NOSUB|REG_EXTENDED);
-
-        if (reg_return != 0) {
-                char errbuf[STRLEN];
-                regerror(reg_return, ms->regex_comp, errbuf, STRLEN);
+        char errbuf[STRLEN];
+        if (! (m->regex_comp = RegexCache_get(ms->match_string, REG_NOSUB|REG_EXTENDED, errbuf, sizeof(errbuf)))) {
                 if (m->match_path != NULL)
                         yyerror2("Regex parsing error: %s on line %i of", errbuf, linenumber);
                 else
                         yyerror2("Regex parsing error: %s", errbuf);
+        } else {
+                m->literal = LiteralMatch_literal(m->match_string);
         }
         appendmatch(m->ignore ? &current->matchignorelist : &current->matchlist, m);
 }
@@ -4093,7 +5025,7 @@ static void addmatchpath(Match_T ms, Action_Type actionnumber) {
                 if (buf[len - 1] == '\n')
                         buf[len - 1] = 0;
 
-                ms->match_string = Str_dup(buf);
+                ms->match_string = buf;
 
                 if (actionnumber == Action_Exec) {
                         if (command1 == NULL) {
@@ -4172,6 +5104,7 @@ static void addfilesystem(FileSystem_T ds) {
         dev->operator           = ds->operator;
         dev->limit_absolute     = ds->limit_absolute;
         dev->limit_percent      = ds->limit_percent;
+        dev->statistic          = statisticset;
         dev->action             = ds->action;
 
         dev->next               = current->filesystemlist;
@@ -4208,6 +5141,15 @@ static void addicmp(Icmp_T is) {
 }
 
 
+/*
+ * Return the state map mask covering the given number of cycles
+ */
+static unsigned long long cyclesmask(int cycles) {
+        ASSERT(cycles > 0 && (unsigned long)cycles <= BITMAP_MAX);
+        return (unsigned long)cycles == BITMAP_MAX ? ~0ULL : (1ULL << cycles) - 1;
+}
+
+
 /*
  * Set EventAction object
  */
@@ -4224,6 +5166,7 @@ static void addeventaction(EventAction_T *_ea, Action_Type failed, Action_Type s
         ea->failed->repeat = repeat1;
         ea->failed->count = rate1.count;
         ea->failed->cycles = rate1.cycles;
+        ea->failed->mask = cyclesmask(rate1.cycles);
         if (failed == Action_Exec) {
                 ASSERT(command1);
                 ea->failed->exec = command1;
@@ -4234,6 +5177,7 @@ static void addeventaction(EventAction_T *_ea, Action_Type failed, Action_Type s
         ea->succeeded->repeat = repeat2;
         ea->succeeded->count = rate2.count;
         ea->succeeded->cycles = rate2.cycles;
+        ea->succeeded->mask = cyclesmask(rate2.cycles);
         if (succeeded == Action_Exec) {
                 ASSERT(command2);
                 ea->succeeded->exec = command2;
@@ -4262,23 +5206,64 @@ static void addgeneric(Port_T port, char *send, char *expect) {
                 g = g->next;
         }
         if (send) {
+                // Unescape any \0x00 escaped chars once here, the send string may contain \0 bytes
                 g->send = send;
+                g->length = Util_handle0Escapes(send);
                 g->expect = NULL;
         } else if (expect) {
-                int reg_return;
-                NEW(g->expect);
-                reg_return = regcomp(g->expect, expect, REG_NOSUB|REG_EXTENDED);
-                FREE(expect);
-                if (reg_return != 0) {
-                        char errbuf[STRLEN];
-                        regerror(reg_return, g->expect, errbuf, STRLEN);
+                char errbuf[STRLEN];
+                if (! (g->expect = RegexCache_get(expect, REG_NOSUB|REG_EXTENDED, errbuf, sizeof(errbuf))))
                         yyerror2("Regex parsing error: %s", errbuf);
-                }
+                // Unanchored expression without metacharacters matches as a substring, the test can skip the regex engine
+                if (! *(expect + strcspn(expect, "^$.[]|()*+?{}\\")))
+                        g->literal = expect;
+                else
+                        FREE(expect);
                 g->send = NULL;
         }
 }
 
 
+/*
+ * Add a query to the dns protocol test batch
+ */
+static void adddnsquery(Port_T port, char *name, char *type, char *answer) {
+        static struct {
+                const char *name;
+                unsigned short rrtype;
+        } types[] = {
+                {"A",     1},
+                {"NS",    2},
+                {"CNAME", 5},
+                {"SOA",   6},
+                {"PTR",   12},
+                {"MX",    15},
+                {"TXT",   16},
+                {"AAAA",  28},
+                {"SRV",   33}
+        };
+        DnsQuery_T q;
+        NEW(q);
+        q->name = name;
+        q->answer = answer;
+        q->type = type ? Str_toUpper(type) : Str_dup("A");
+        for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+                if (IS(q->type, types[i].name)) {
+                        q->rrtype = types[i].rrtype;
+                        break;
+                }
+        }
+        if (! q->rrtype)
+                yyerror2("unsupported DNS record type '%s'", q->type);
+        if (strlen(name) > 253)
+                yyerror2("DNS query name '%s' is too long", name);
+        DnsQuery_T *last = &port->parameters.dns.queries;
+        while (*last)
+                last = &(*last)->next;
+        *last = q;
+}
+
+
 /*
  * Add the current command object to the current service object's
  * start or stop program.
@@ -4312,6 +5297,7 @@ static void addargument(char *argument) {
 
         }
 
+        RESIZE(command->arg, (command->length + 2) * sizeof(char *));
         command->arg[command->length++] = argument;
         command->arg[command->length] = NULL;
 
@@ -4354,14 +5340,10 @@ static void  seturlrequest(int operator, char *regex) {
         if (! urlrequest)
                 NEW(urlrequest);
         urlrequest->operator = operator;
-        int reg_return;
-        NEW(urlrequest->regex);
-        reg_return = regcomp(urlrequest->regex, regex, REG_NOSUB|REG_EXTENDED);
-        if (reg_return != 0) {
-                char errbuf[STRLEN];
-                regerror(reg_return, urlrequest->regex, errbuf, STRLEN);
+        char errbuf[STRLEN];
+        RegexCache_release(&(urlrequest->regex));
+        if (! (urlrequest->regex = RegexCache_get(regex, REG_NOSUB|REG_EXTENDED, errbuf, sizeof(errbuf))))
                 yyerror2("Regex parsing error: %s", errbuf);
-        }
 }
 
 
@@ -4384,6 +5366,8 @@ static void addmmonit(Mmonit_T mmonit) {
 #endif
         }
         c->timeout = mmonit->timeout;
+        c->snapshot = mmonit->snapshot;
+        c->relay = mmonit->relay;
         c->next = NULL;
 
         if (Run.mmonits) {
@@ -4399,6 +5383,123 @@ static void addmmonit(Mmonit_T mmonit) {
 }
 
 
+/*
+ * Check that the URL protocol is the given protocol or its SSL variant
+ */
+static void check_urlprotocol(URL_T U, const char *protocol) {
+        ASSERT(U);
+        if (! Str_startsWith(U->protocol, protocol) || (U->protocol[strlen(protocol)] && ! IS(U->protocol + strlen(protocol), "s")))
+                yyerror2("URL protocol %s not supported here -- %s or %ss expected", U->protocol, protocol, protocol);
+}
+
+
+/*
+ * Set the MQTT broker for the status publisher
+ */
+static void addmqtt(Mqtt_T mqtt) {
+        ASSERT(mqtt->url);
+
+        check_urlprotocol(mqtt->url, "mqtt");
+        if (Run.mqtt) {
+                yyerror2("The MQTT broker was set already");
+                reset_sslset();
+                reset_mqttset();
+                return;
+        }
+        Mqtt_T m;
+        NEW(m);
+        m->url = mqtt->url;
+        _setSSLOptions(&(m->ssl));
+        if (IS(m->url->protocol, "mqtts")) {
+#ifdef HAVE_OPENSSL
+                m->ssl.flags = SSL_Enabled;
+#else
+                yyerror("SSL check cannot be activated -- SSL disabled");
+#endif
+        }
+        m->timeout = mqtt->timeout;
+        m->qos = mqtt->qos;
+        m->snapshot = mqtt->snapshot;
+        m->format = mqtt->format;
+        // The topic prefix is the URL path without the slashes, "monit" by default
+        char *topic = m->url->path;
+        while (*topic == '/')
+                topic++;
+        m->topic = *topic ? Str_dup(topic) : Str_dup("monit");
+        for (int i = (int)strlen(m->topic) - 1; i > 0 && m->topic[i] == '/'; i--)
+                m->topic[i] = 0;
+        Run.mqtt = m;
+        reset_sslset();
+        reset_mqttset();
+}
+
+
+/*
+ * Add a new webhook to the webhook list
+ */
+static void addwebhook(Webhook_T webhook) {
+        ASSERT(webhook->url);
+
+        Webhook_T w;
+        NEW(w);
+        w->url = webhook->url;
+        _setSSLOptions(&(w->ssl));
+        if (IS(w->url->protocol, "https")) {
+#ifdef HAVE_OPENSSL
+                w->ssl.flags = SSL_Enabled;
+#else
+                yyerror("SSL check cannot be activated -- SSL disabled");
+#endif
+        }
+        w->timeout = webhook->timeout;
+        w->interval = webhook->interval;
+        w->workers = webhook->workers;
+        w->next = NULL;
+
+        if (Run.webhooks) {
+                Webhook_T W;
+                for (W = Run.webhooks; W->next; W = W->next)
+                        /* Empty */ ;
+                W->next = w;
+        } else {
+                Run.webhooks = w;
+        }
+        reset_sslset();
+        reset_webhookset();
+}
+
+
+/*
+ * Add a new peer to the cluster peer list
+ */
+static void addclusterpeer(URL_T url) {
+        ASSERT(url);
+
+        ClusterPeer_T p;
+        NEW(p);
+        p->url = url;
+        _setSSLOptions(&(p->ssl));
+        if (IS(p->url->protocol, "https")) {
+#ifdef HAVE_OPENSSL
+                p->ssl.flags = SSL_Enabled;
+#else
+                yyerror("SSL check cannot be activated -- SSL disabled");
+#endif
+        }
+        p->next = NULL;
+
+        if (Run.cluster.peers) {
+                ClusterPeer_T P;
+                for (P = Run.cluster.peers; P->next; P = P->next)
+                        /* Empty */ ;
+                P->next = p;
+        } else {
+                Run.cluster.peers = p;
+        }
+        reset_sslset();
+}
+
+
 /*
  * Add a new smtp server to the mail server list
  */
@@ -4438,20 +5539,12 @@ static void addmailserver(MailServer_T mailserver) {
  * otherwise the user parameter is used.
  */
 static uid_t get_uid(char *user, uid_t uid) {
-        char buf[4096];
-        struct passwd pwd, *result = NULL;
-        if (user) {
-                if (getpwnam_r(user, &pwd, buf, sizeof(buf), &result) != 0 || ! result) {
-                        yyerror2("Requested user not found on the system");
-                        return(0);
-                }
-        } else {
-                if (getpwuid_r(uid, &pwd, buf, sizeof(buf), &result) != 0 || ! result) {
-                        yyerror2("Requested uid not found on the system");
-                        return(0);
-                }
+        long result = resolve_id(false, user, uid);
+        if (result < 0) {
+                yyerror2(user ? "Requested user not found on the system" : "Requested uid not found on the system");
+                return(0);
         }
-        return(pwd.pw_uid);
+        return((uid_t)result);
 }
 
 
@@ -4461,27 +5554,50 @@ static uid_t get_uid(char *user, uid_t uid) {
  * otherwise the group parameter is used.
  */
 static gid_t get_gid(char *group, gid_t gid) {
-        struct group *grd;
-
-        if (group) {
-                grd = getgrnam(group);
+        long result = resolve_id(true, group, gid);
+        if (result < 0) {
+                yyerror2(group ? "Requested group not found on the system" : "Requested gid not found on the system");
+                return(0);
+        }
+        return((gid_t)result);
+}
 
-                if (! grd) {
-                        yyerror2("Requested group not found on the system");
-                        return(0);
-                }
 
+/*
+ * Look up the user or group by name, or by id if the name is NULL. The
+ * results, including the failed lookups, are cached for the parse
+ */
+static long resolve_id(bool group, const char *name, long id) {
+        for (int i = 0; i < idcache.count; i++) {
+                struct idcache_t *e = &idcache.list[i];
+                if (e->group == group && (name ? IS(e->name, name) : (! e->name && e->id == id)))
+                        return e->result;
+        }
+        long result = -1;
+        if (group) {
+                struct group *grd = name ? getgrnam(name) : getgrgid((gid_t)id);
+                if (grd)
+                        result = grd->gr_gid;
         } else {
-
-                if (! (grd = getgrgid(gid))) {
-                        yyerror2("Requested gid not found on the system");
-                        return(0);
-                }
-
+                char buf[4096];
+                struct passwd pwd, *pw = NULL;
+                if ((name ? getpwnam_r(name, &pwd, buf, sizeof(buf), &pw) : getpwuid_r((uid_t)id, &pwd, buf, sizeof(buf), &pw)) == 0 && pw)
+                        result = pw->pw_uid;
         }
+        if (idcache.count == idcache.size) {
+                idcache.size = idcache.size ? idcache.size * 2 : 16;
+                RESIZE(idcache.list, idcache.size * sizeof(struct idcache_t));
+        }
+        idcache.list[idcache.count++] = (struct idcache_t){.group = group, .name = name ? Str_dup(name) : NULL, .id = id, .result = result};
+        return result;
+}
 
-        return(grd->gr_gid);
 
+static void reset_idcache() {
+        for (int i = 0; i < idcache.count; i++)
+                FREE(idcache.list[i].name);
+        FREE(idcache.list);
+        idcache.count = idcache.size = 0;
 }
 
 
@@ -4770,6 +5886,22 @@ static void reset_mmonitset() {
 }
 
 
+/*
+ * Reset the Webhook set to default values
+ */
+static void reset_mqttset() {
+        memset(&mqttset, 0, sizeof(struct Mqtt_T));
+        mqttset.timeout = Run.limits.networkTimeout;
+}
+
+
+static void reset_webhookset() {
+        memset(&webhookset, 0, sizeof(struct Webhook_T));
+        webhookset.timeout = Run.limits.networkTimeout;
+        webhookset.workers = 1;
+}
+
+
 /*
  * Reset the Port set to default values
  */
@@ -4793,6 +5925,7 @@ static void reset_resourceset() {
         resourceset.limit = 0;
         resourceset.action = NULL;
         resourceset.operator = Operator_Equal;
+        reset_statisticset();
 }
 
 
@@ -4826,10 +5959,50 @@ static void reset_sizeset() {
         sizeset.operator = Operator_Equal;
         sizeset.size = 0;
         sizeset.test_changes = false;
+        sizeset.growth = 0;
         sizeset.action = NULL;
 }
 
 
+static void reset_certificateset() {
+        certificateset.minimumDays = 0;
+        certificateset.action = NULL;
+}
+
+
+/*
+ * Reset the FileCount set to default values
+ */
+static void reset_filecountset() {
+        filecountset.operator = Operator_Equal;
+        filecountset.limit = 0;
+        filecountset.action = NULL;
+}
+
+
+/*
+ * Reset the Latency set to default values
+ */
+static void reset_latencyset() {
+        latencyset.operator = Operator_Greater;
+        latencyset.percentile = 0.;
+        latencyset.limit = 0.;
+        latencyset.action = NULL;
+}
+
+
+/*
+ * Reset the Trend set to default values
+ */
+static void reset_trendset() {
+        trendset.metric = Series_Cpu;
+        trendset.operator = Operator_Greater;
+        trendset.limit = 0.;
+        trendset.period = 0;
+        trendset.action = NULL;
+}
+
+
 /*
  * Reset the Uptime set to default values
  */
@@ -4910,6 +6083,7 @@ static void reset_existset() {
 static void reset_checksumset() {
         checksumset.type         = Hash_Unknown;
         checksumset.test_changes = false;
+        checksumset.verify       = 0;
         checksumset.action       = NULL;
         *checksumset.hash        = 0;
 }
@@ -4963,6 +6137,16 @@ static void reset_filesystemset() {
         filesystemset.limit_absolute = -1;
         filesystemset.limit_percent = -1.;
         filesystemset.action = NULL;
+        reset_statisticset();
+}
+
+
+/*
+ * Reset the rate function to the rate between the last two samples
+ */
+static void reset_statisticset() {
+        statisticset.function = Statistics_Current;
+        statisticset.percentile = 0.;
 }
 
 
@@ -5023,57 +6207,118 @@ static int check_perm(int perm) {
 
 
 /*
- * Check the dependency graph for errors
- * by doing a topological sort, thereby finding any cycles.
- * Assures that graph is a Directed Acyclic Graph (DAG).
+ * The service node of the dependency graph sort
  */
-static void check_depend() {
-        Service_T depends_on = NULL;
-        Service_T* dlt = &depend_list; /* the current tail of it                                 */
-        bool done;                /* no unvisited nodes left?                               */
-        bool found_some;          /* last iteration found anything new ?                    */
-        depend_list = NULL;            /* depend_list will be the topological sorted servicelist */
+typedef struct depend_t {
+        Service_T service;
+        int position;                         /* Position in the service list */
+        int round;                 /* The sort round, the service is visited in */
+        enum {
+                Depend_New = 0,
+                Depend_Active,
+                Depend_Done
+        } state;
+} depend_t;
+
+
+static int _compareDependService(const void *a, const void *b) {
+        Service_T x = ((const depend_t *)a)->service;
+        Service_T y = ((const depend_t *)b)->service;
+        return x < y ? -1 : x > y;
+}
 
-        do {
-                done = true;
-                found_some = false;
-                for (Service_T s = servicelist; s; s = s->next) {
-                        Dependant_T d;
-                        if (s->visited)
-                                continue;
-                        done = false; // still unvisited nodes
-                        depends_on = NULL;
-                        for (d = s->dependantlist; d; d = d->next) {
-                                Service_T dp = Util_getService(d->dependant);
-                                if (! dp) {
-                                        Log_error("Depending service '%s' is not defined in the control file\n", d->dependant);
-                                        exit(1);
-                                }
-                                if (! dp->visited) {
-                                        depends_on = dp;
-                                }
-                        }
 
-                        if (! depends_on) {
-                                s->visited = true;
-                                found_some = true;
-                                *dlt = s;
-                                dlt = &s->next_depend;
-                        }
-                }
-        } while (found_some && ! done);
+static int _compareDependOrder(const void *a, const void *b) {
+        const depend_t *x = a;
+        const depend_t *y = b;
+        return x->round != y->round ? x->round - y->round : x->position - y->position;
+}
 
-        if (! done) {
-                ASSERT(depends_on);
-                Log_error("Found a depend loop in the control file involving the service '%s'\n", depends_on->name);
+
+/*
+ * Compute the round of the service by depth-first search. The service is
+ * visited in the round of its latest dependency if the dependency precedes
+ * the service in the service list, otherwise in the next round
+ */
+static int _dependRound(depend_t *graph, int count, depend_t *node) {
+        if (node->state == Depend_Done)
+                return node->round;
+        if (node->state == Depend_Active) {
+                Log_error("Found a depend loop in the control file involving the service '%s'\n", node->service->name);
                 exit(1);
         }
+        node->state = Depend_Active;
+        for (Dependant_T d = node->service->dependantlist; d; d = d->next) {
+                if (! (d->service = Util_getService(d->dependant))) {
+                        Log_error("Depending service '%s' is not defined in the control file\n", d->dependant);
+                        exit(1);
+                }
+                depend_t *dependency = bsearch(&(depend_t){.service = d->service}, graph, count, sizeof(depend_t), _compareDependService);
+                int round = _dependRound(graph, count, dependency) + (dependency->position > node->position ? 1 : 0);
+                node->round = MAX(node->round, round);
+        }
+        node->state = Depend_Done;
+        return node->round;
+}
+
+
+/*
+ * Check the dependency graph for errors
+ * by doing a topological sort, thereby finding any cycles.
+ * Assures that graph is a Directed Acyclic Graph (DAG).
+ *
+ * The services are sorted in rounds: the service is visited in the first
+ * round in which its dependencies were visited already, the services of
+ * one round are in the control file order. The rounds are computed in one
+ * pass over the dependencies instead of scanning the service list in every
+ * round, which was quadratic with long dependency chains.
+ *
+ * The dependencies are resolved to the service pointers and the reverse
+ * dependency lists (children) are built here, so the validation and the
+ * actions don't look the services up by the name.
+ */
+static void check_depend() {
+        int count = 0;
+        for (Service_T s = servicelist; s; s = s->next)
+                count++;
+        depend_t *graph = CALLOC(count, sizeof(depend_t));
+        int position = 0;
+        for (Service_T s = servicelist; s; s = s->next, position++)
+                graph[position] = (depend_t){.service = s, .position = position};
+        qsort(graph, count, sizeof(depend_t), _compareDependService);
+        for (int i = 0; i < count; i++)
+                _dependRound(graph, count, &graph[i]);
+        qsort(graph, count, sizeof(depend_t), _compareDependOrder);
+
+        /* depend_list will be the topological sorted servicelist */
+        Service_T *dlt = &depend_list;
+        for (int i = 0; i < count; i++) {
+                graph[i].service->visited = true;
+                *dlt = graph[i].service;
+                dlt = &graph[i].service->next_depend;
+        }
+        *dlt = NULL;
+        FREE(graph);
 
         ASSERT(depend_list);
         servicelist = depend_list;
 
-        for (Service_T s = depend_list; s; s = s->next_depend)
+        position = 0;
+        for (Service_T s = depend_list; s; s = s->next_depend) {
                 s->next = s->next_depend;
+                s->position = position++;
+                for (Dependant_T d = s->dependantlist; d; d = d->next)
+                        d->service->children.count++;
+        }
+        for (Service_T s = depend_list; s; s = s->next_depend) {
+                if (s->children.count) {
+                        s->children.list = CALLOC(s->children.count, sizeof(Service_T));
+                        s->children.count = 0;
+                }
+        }
+        for (Service_T s = depend_list; s; s = s->next_depend)
+                for (Dependant_T d = s->dependantlist; d; d = d->next)
+                        d->service->children.list[d->service->children.count++] = s;
 }
 
 
@@ -5135,6 +6380,7 @@ static command_t copycommand(command_t source) {
         copy->has_gid = source->has_gid;
         copy->gid = source->gid;
         copy->timeout = source->timeout;
+        copy->arg = CALLOC(copy->length + 1, sizeof(char *));
         for (i = 0; i < copy->length; i++)
                 copy->arg[i] = Str_dup(source->arg[i]);
         copy->arg[copy->length] = NULL;
@@ -5181,6 +6427,32 @@ static void _setSSLOptions(SslOptions_T options) {
 }
 
 
+static bool _isStringEqual(const char *a, const char *b) {
+        return a == b || Str_isByteEqual(a, b);
+}
+
+
+/*
+ * Return true if the connections with the SSL options are interchangeable
+ */
+static bool _isSSLOptionsEqual(SslOptions_T a, SslOptions_T b) {
+        return a->flags == b->flags &&
+               a->version == b->version &&
+               a->verify == b->verify &&
+               a->allowSelfSigned == b->allowSelfSigned &&
+               a->checksumType == b->checksumType &&
+               _isStringEqual(a->checksum, b->checksum) &&
+               _isStringEqual(a->pemfile, b->pemfile) &&
+               _isStringEqual(a->pemchain, b->pemchain) &&
+               _isStringEqual(a->pemkey, b->pemkey) &&
+               _isStringEqual(a->clientpemfile, b->clientpemfile) &&
+               _isStringEqual(a->ciphers, b->ciphers) &&
+               _isStringEqual(a->CACertificateFile, b->CACertificateFile) &&
+               _isStringEqual(a->CACertificatePath, b->CACertificatePath) &&
+               _isStringEqual(a->alpn, b->alpn);
+}
+
+
 #ifdef HAVE_OPENSSL
 static void _setSSLVersion(short version) {
         sslset.flags = SSL_Enabled;
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_PROBE_H
+#define MONIT_PROBE_H
+
+#include "config.h"
+
+
+/**
+ * Static tracing probes on the hot paths of the daemon. If Monit was
+ * configured with --enable-probes, the probes are the USDT probes of the
+ * "monit" provider defined by <sys/sdt.h>, which can be traced with
+ * DTrace, SystemTap, bpftrace or perf. A probe which is not traced is a
+ * single nop instruction, so the arguments are only the values the code
+ * has at hand already and the durations are left to the tracer (the time
+ * between the start and done probes). Otherwise the probes are empty.
+ *
+ * The probes and their arguments:
+ *
+ *  check__start(name, type)                 The service check started
+ *  check__done(name, type, state)           The service check finished
+ *  event__post(name, id, state)             The event was posted
+ *  processtree__start()                     The process tree scan started
+ *  processtree__done(count)                 The process tree scan finished
+ *  connect__start(host, port)               The connection test started
+ *  connect__done(host, port, ok)            The connection attempt finished
+ *  protocol__start(host, port, protocol)    The protocol test started
+ *  protocol__done(host, port, ok)           The protocol test finished
+ *  http__request__start(method, url)        The HTTP request was parsed
+ *  http__request__done(method, url, status) The HTTP response was sent
+ *  state__save__start()                     The state file save started
+ *  state__save__done()                      The state file save finished
+ *
+ * @file
+ */
+
+
+#ifdef HAVE_PROBES
+#include <sys/sdt.h>
+#define PROBE0(name) DTRACE_PROBE(monit, name)
+#define PROBE1(name, a) DTRACE_PROBE1(monit, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(monit, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(monit, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(monit, name, a, b, c, d)
+#else
+// The arguments are referenced but never evaluated, so the variables kept for the probes only don't warn
+#define PROBE0(name) do {} while (0)
+#define PROBE1(name, a) do { if (0) { (void)(a); } } while (0)
+#define PROBE2(name, a, b) do { if (0) { (void)(a); (void)(b); } } while (0)
+#define PROBE3(name, a, b, c) do { if (0) { (void)(a); (void)(b); (void)(c); } } while (0)
+#define PROBE4(name, a, b, c, d) do { if (0) { (void)(a); (void)(b); (void)(c); (void)(d); } } while (0)
+#endif
+
+
+#endif
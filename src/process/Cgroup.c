@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+#include "config.h"
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#include "monit.h"
+#include "Cgroup.h"
+
+// libmonit
+#include "system/Time.h"
+#include "exceptions/AssertException.h"
+
+/**
+ *  Cgroup v2 resource accounting: the statistics are read from the cpu.stat,
+ *  memory.current and io.stat files of the process's cgroup, the pressure
+ *  stall information from the *.pressure files or /proc/pressure.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#ifdef LINUX
+
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+
+static const char *_pressureFiles[Pressure_Count] = {
+        [Pressure_Cpu]    = "cpu",
+        [Pressure_Memory] = "memory",
+        [Pressure_Io]     = "io"
+};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static bool _read(const char *path, char *buf, int size) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                DEBUG("Cannot open cgroup file '%s' -- %s\n", path, STRERROR);
+                return false;
+        }
+        int bytes = (int)read(fd, buf, size - 1);
+        close(fd);
+        if (bytes < 0) {
+                DEBUG("Cannot read cgroup file '%s' -- %s\n", path, STRERROR);
+                return false;
+        }
+        buf[bytes] = 0;
+        return true;
+}
+
+
+// Get the cgroup v2 directory of the process
+static bool _cgroupPath(pid_t pid, char *path, int size) {
+        char cgroup[PATH_MAX];
+        if (! Cgroup_path(pid, cgroup, sizeof(cgroup))) {
+                DEBUG("Process %d is not in the cgroup v2 hierarchy\n", pid);
+                return false;
+        }
+        return snprintf(path, size, "%s%s", CGROUP_ROOT, IS(cgroup, "/") ? "" : cgroup) < size;
+}
+
+
+static bool _readCpu(const char *cgroup, CgroupStatistics_T *statistics) {
+        char buf[1024];
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/cpu.stat", cgroup);
+        if (_read(path, buf, sizeof(buf))) {
+                char *usage = strstr(buf, "usage_usec ");
+                if (usage && sscanf(usage + 11, "%llu", &(statistics->cpu)) == 1)
+                        return true;
+                DEBUG("Cannot parse cgroup file '%s'\n", path);
+        }
+        return false;
+}
+
+
+static bool _readMemory(const char *cgroup, CgroupStatistics_T *statistics) {
+        char buf[64];
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/memory.current", cgroup);
+        if (_read(path, buf, sizeof(buf))) {
+                if (sscanf(buf, "%llu", &(statistics->memory)) == 1)
+                        return true;
+                DEBUG("Cannot parse cgroup file '%s'\n", path);
+        }
+        return false;
+}
+
+
+// The io.stat file has one line per block device: "<major>:<minor> rbytes=<n> wbytes=<n> rios=<n> wios=<n> ...", the values are summed
+static void _readIO(const char *cgroup, CgroupStatistics_T *statistics) {
+        char buf[8192];
+        char path[PATH_MAX];
+        statistics->read.bytes = statistics->read.operations = statistics->write.bytes = statistics->write.operations = -1LL;
+        snprintf(path, sizeof(path), "%s/io.stat", cgroup);
+        if (_read(path, buf, sizeof(buf))) {
+                statistics->read.bytes = statistics->read.operations = statistics->write.bytes = statistics->write.operations = 0LL;
+                for (char *line = buf; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+                        long long rbytes, wbytes, rios, wios;
+                        if (sscanf(line, "%*u:%*u rbytes=%lld wbytes=%lld rios=%lld wios=%lld", &rbytes, &wbytes, &rios, &wios) == 4) {
+                                statistics->read.bytes += rbytes;
+                                statistics->write.bytes += wbytes;
+                                statistics->read.operations += rios;
+                                statistics->write.operations += wios;
+                        }
+                }
+        }
+}
+
+
+// The pressure file has the "some" line and (except of the system-wide cpu pressure on Linux < 5.13) the "full" line: "some avg10=<n> avg60=<n> avg300=<n> total=<n>"
+static bool _readPressure(const char *path, Pressure_T *pressure) {
+        char buf[256];
+        pressure->some = pressure->full = -1.;
+        if (_read(path, buf, sizeof(buf))) {
+                for (char *line = buf; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+                        float value;
+                        if (sscanf(line, "some avg10=%f", &value) == 1)
+                                pressure->some = value;
+                        else if (sscanf(line, "full avg10=%f", &value) == 1)
+                                pressure->full = value;
+                }
+                if (pressure->some >= 0.)
+                        return true;
+                DEBUG("Cannot parse pressure file '%s'\n", path);
+        }
+        return false;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+char *Cgroup_parse(char *content) {
+        ASSERT(content);
+        // The unified hierarchy entry has the form "0::<path>"
+        for (char *line = content; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+                if (Str_startsWith(line, "0::")) {
+                        char *end = strchr(line, '\n');
+                        if (end)
+                                *end = 0;
+                        return line + 3;
+                }
+        }
+        return NULL;
+}
+
+
+bool Cgroup_path(pid_t pid, char *path, int size) {
+        ASSERT(path);
+        char buf[4096];
+        char file[PATH_MAX];
+        snprintf(file, sizeof(file), "%s/%d/cgroup", PROCFS_ROOT, pid);
+        if (! _read(file, buf, sizeof(buf)))
+                return false;
+        const char *cgroup = Cgroup_parse(buf);
+        if (! cgroup)
+                return false;
+        snprintf(path, size, "%s", cgroup);
+        return true;
+}
+
+
+bool Cgroup_statistics(pid_t pid, CgroupStatistics_T *statistics) {
+        ASSERT(statistics);
+        char cgroup[PATH_MAX - 32]; // Leave room for the statistics file name
+        if (! _cgroupPath(pid, cgroup, sizeof(cgroup)))
+                return false;
+        // The root cgroup has no cpu.stat and memory.current files
+        if (IS(cgroup, CGROUP_ROOT))
+                return false;
+        statistics->time = Time_milli();
+        if (! _readCpu(cgroup, statistics) || ! _readMemory(cgroup, statistics))
+                return false;
+        _readIO(cgroup, statistics);
+        return true;
+}
+
+
+bool Cgroup_memory(pid_t pid, unsigned long long *usage, unsigned long long *limit) {
+        ASSERT(usage);
+        ASSERT(limit);
+        char cgroup[PATH_MAX - 32]; // Leave room for the memory file name
+        if (! _cgroupPath(pid, cgroup, sizeof(cgroup)))
+                return false;
+        // The root cgroup has no memory.current and memory.max files
+        if (IS(cgroup, CGROUP_ROOT))
+                return false;
+        CgroupStatistics_T statistics;
+        if (! _readMemory(cgroup, &statistics))
+                return false;
+        *usage = statistics.memory;
+        // The memory.max file contains "max" if the cgroup has no limit
+        char buf[64];
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/memory.max", cgroup);
+        if (! _read(path, buf, sizeof(buf)))
+                return false;
+        if (Str_startsWith(buf, "max"))
+                *limit = 0ULL;
+        else if (sscanf(buf, "%llu", limit) != 1) {
+                DEBUG("Cannot parse cgroup file '%s'\n", path);
+                return false;
+        }
+        return true;
+}
+
+
+bool Cgroup_pressure(pid_t pid, Pressure_Type type, Pressure_T *pressure) {
+        ASSERT(pressure);
+        ASSERT(type < Pressure_Count);
+        char path[PATH_MAX];
+        if (pid > 0) {
+                char cgroup[PATH_MAX - 32]; // Leave room for the pressure file name
+                if (! _cgroupPath(pid, cgroup, sizeof(cgroup)))
+                        return false;
+                // The root cgroup pressure is the system-wide pressure
+                if (! IS(cgroup, CGROUP_ROOT)) {
+                        snprintf(path, sizeof(path), "%s/%s.pressure", cgroup, _pressureFiles[type]);
+                        return _readPressure(path, pressure);
+                }
+        }
+        snprintf(path, sizeof(path), "%s/pressure/%s", PROCFS_ROOT, _pressureFiles[type]);
+        return _readPressure(path, pressure);
+}
+
+
+#else
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+char *Cgroup_parse(__attribute__ ((unused)) char *content) {
+        return NULL;
+}
+
+
+bool Cgroup_path(__attribute__ ((unused)) pid_t pid, __attribute__ ((unused)) char *path, __attribute__ ((unused)) int size) {
+        return false;
+}
+
+
+bool Cgroup_statistics(__attribute__ ((unused)) pid_t pid, __attribute__ ((unused)) CgroupStatistics_T *statistics) {
+        return false;
+}
+
+
+bool Cgroup_memory(__attribute__ ((unused)) pid_t pid, __attribute__ ((unused)) unsigned long long *usage, __attribute__ ((unused)) unsigned long long *limit) {
+        return false;
+}
+
+
+bool Cgroup_pressure(__attribute__ ((unused)) pid_t pid, __attribute__ ((unused)) Pressure_Type type, Pressure_T *pressure) {
+        pressure->some = pressure->full = -1.;
+        return false;
+}
+
+
+#endif
+
+
+bool Cgroup_match(const char *cgroup, const char *scope) {
+        if (! cgroup || ! scope || ! *scope)
+                return false;
+        if (*scope == '/') {
+                // The path matches the cgroup itself and its subtree
+                size_t length = strlen(scope);
+                while (length > 1 && scope[length - 1] == '/')
+                        length--;
+                return strncmp(cgroup, scope, length) == 0 && (cgroup[length] == 0 || cgroup[length] == '/' || length == 1);
+        }
+        // The container ID matches the cgroup of the container (such as docker-<id>.scope or cri-containerd-<id>.scope) and its subtree
+        return strstr(cgroup, scope) != NULL;
+}
+
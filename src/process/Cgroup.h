@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_CGROUP_H
+#define MONIT_CGROUP_H
+
+#include "config.h"
+
+
+/**
+ * Resource accounting of the control group (cgroup v2) of the process.
+ * If enabled for the process service with "cgroup accounting", the total
+ * cpu, memory and physical I/O of the service are read from the cgroup
+ * statistics instead of summing the process subtree. This includes the
+ * children which exited between the cycles as well. Available on Linux
+ * with the unified cgroup hierarchy mounted at /sys/fs/cgroup. The
+ * pressure stall information (PSI) of the cgroup or the whole system
+ * is available as well.
+ *
+ * @file
+ */
+
+
+typedef struct CgroupStatistics_T {
+        unsigned long long time;        /**< Timestamp of the statistics [ms] */
+        unsigned long long cpu;          /**< Total CPU time of the cgroup [us] */
+        unsigned long long memory;      /**< Current memory usage of the cgroup */
+        struct {
+                long long bytes;        /**< Bytes read from block devices or -1 */
+                long long operations;     /**< Read operations count or -1 */
+        } read;
+        struct {
+                long long bytes;     /**< Bytes written to block devices or -1 */
+                long long operations;    /**< Write operations count or -1 */
+        } write;
+} CgroupStatistics_T;
+
+
+/**
+ * Get the cgroup v2 path of the process from the content of its
+ * /proc/PID/cgroup file
+ * @param content The file content, the path is terminated in place
+ * @return The path such as /system.slice/nginx.service or NULL if the
+ * process is not in the unified hierarchy
+ */
+char *Cgroup_parse(char *content);
+
+
+/**
+ * Get the cgroup v2 path of the process
+ * @param pid Process PID
+ * @param path The buffer for the path relative to the cgroup root
+ * @param size The buffer size
+ * @return true if succeeded otherwise false
+ */
+bool Cgroup_path(pid_t pid, char *path, int size);
+
+
+/**
+ * Test if the cgroup belongs to the scope of the service. The scope is
+ * either the cgroup path starting with '/', which matches the cgroup and
+ * its subtree, or the container ID, which matches the cgroups containing
+ * the ID, such as docker-<id>.scope or cri-containerd-<id>.scope, and
+ * their subtrees
+ * @param cgroup The cgroup path or NULL
+ * @param scope The cgroup path or container ID
+ * @return true if the cgroup belongs to the scope
+ */
+bool Cgroup_match(const char *cgroup, const char *scope);
+
+
+/**
+ * Get the statistics of the cgroup the process belongs to
+ * @param pid Process PID
+ * @param statistics The statistics
+ * @return true if succeeded otherwise false
+ */
+bool Cgroup_statistics(pid_t pid, CgroupStatistics_T *statistics);
+
+
+/**
+ * Get the memory usage and limit of the cgroup the process belongs to
+ * from its memory.current and memory.max files
+ * @param pid Process PID
+ * @param usage The current memory usage [B]
+ * @param limit The memory limit [B] or 0 if the cgroup has no limit
+ * @return true if succeeded otherwise false
+ */
+bool Cgroup_memory(pid_t pid, unsigned long long *usage, unsigned long long *limit);
+
+
+/**
+ * Get the pressure stall information of the resource. The system-wide
+ * pressure is read from /proc/pressure, the pressure of the process's
+ * cgroup from its cpu.pressure, memory.pressure or io.pressure file.
+ * Requires Linux 4.20 or later with PSI enabled.
+ * @param pid Process PID or 0 for the system-wide pressure
+ * @param type The resource
+ * @param pressure The pressure
+ * @return true if succeeded otherwise false
+ */
+bool Cgroup_pressure(pid_t pid, Pressure_Type type, Pressure_T *pressure);
+
+
+#endif
+
@@ -0,0 +1,647 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_STDDEF_H
+#include <stddef.h>
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
+
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
+#ifdef HAVE_LINUX_BPF_H
+#include <linux/bpf.h>
+#endif
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#include "monit.h"
+#include "ProcessBPF.h"
+
+// libmonit
+#include "io/File.h"
+#include "exceptions/AssertException.h"
+
+/**
+ *  eBPF process accounting. The BPF programs are assembled here, so no BPF
+ *  compiler or library is needed: each program computes the amount, gets
+ *  the thread group ID of the current task and adds the amount to its
+ *  counters in the hash map (the entry is created on the first event). The
+ *  CPU time is the time between the context switches on the CPU, which is
+ *  accounted to the task switched out. The entry is removed when the
+ *  thread group leader exits, so the map holds the running processes only.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#if defined(HAVE_LINUX_BPF_H) && defined(HAVE_LINUX_PERF_EVENT_H) && defined(SYS_bpf) && defined(SYS_perf_event_open)
+
+
+#define BPF_MAX_PROCESSES 65536
+
+
+#define BPF_MAX_INSNS 96
+
+
+// The sched_switch prev_state of the exiting task: EXIT_DEAD | EXIT_ZOMBIE
+#define TASK_EXITED 0x30
+
+
+#define BPF_MAX_LINKS 16
+
+
+// The stack slots of the programs: the map key and the initial counters
+#define STACK_KEY    -4
+#define STACK_VALUE  -64
+
+
+#define OFFSET(field) ((int)offsetof(ProcessCounters_T, field))
+
+
+#define _ALU64_IMM(OP, DST, IMM)       ((struct bpf_insn){.code = BPF_ALU64 | BPF_OP(OP) | BPF_K, .dst_reg = DST, .imm = IMM})
+#define _ALU64_REG(OP, DST, SRC)       ((struct bpf_insn){.code = BPF_ALU64 | BPF_OP(OP) | BPF_X, .dst_reg = DST, .src_reg = SRC})
+#define _MOV64_IMM(DST, IMM)           _ALU64_IMM(BPF_MOV, DST, IMM)
+#define _MOV64_REG(DST, SRC)           _ALU64_REG(BPF_MOV, DST, SRC)
+#define _LDX_MEM(SIZE, DST, SRC, OFF)  ((struct bpf_insn){.code = BPF_LDX | BPF_SIZE(SIZE) | BPF_MEM, .dst_reg = DST, .src_reg = SRC, .off = OFF})
+#define _STX_MEM(SIZE, DST, SRC, OFF)  ((struct bpf_insn){.code = BPF_STX | BPF_SIZE(SIZE) | BPF_MEM, .dst_reg = DST, .src_reg = SRC, .off = OFF})
+#define _ST_MEM(SIZE, DST, OFF, IMM)   ((struct bpf_insn){.code = BPF_ST | BPF_SIZE(SIZE) | BPF_MEM, .dst_reg = DST, .off = OFF, .imm = IMM})
+#define _ATOMIC_ADD(DST, SRC, OFF)     ((struct bpf_insn){.code = BPF_STX | BPF_DW | BPF_XADD, .dst_reg = DST, .src_reg = SRC, .off = OFF})
+#define _JMP_IMM(OP, DST, IMM)         ((struct bpf_insn){.code = BPF_JMP | BPF_OP(OP) | BPF_K, .dst_reg = DST, .imm = IMM})
+#define _JMP_REG(OP, DST, SRC)         ((struct bpf_insn){.code = BPF_JMP | BPF_OP(OP) | BPF_X, .dst_reg = DST, .src_reg = SRC})
+#define _CALL(FUNCTION)                ((struct bpf_insn){.code = BPF_JMP | BPF_CALL, .imm = FUNCTION})
+#define _EXIT()                        ((struct bpf_insn){.code = BPF_JMP | BPF_EXIT})
+
+
+typedef struct Bytecode_T {
+        int count;
+        struct bpf_insn insn[BPF_MAX_INSNS];
+        int exits;
+        int exit[8];               /**< Jumps to the program end to be patched */
+} *Bytecode_T;
+
+
+typedef struct Field_T {
+        int offset;
+        int size;
+} Field_T;
+
+
+typedef struct Entry_T {
+        pid_t pid;
+        ProcessCounters_T counters;
+} Entry_T;
+
+
+static struct {
+        bool running;
+        int map;                              /**< The counters of the processes */
+        int clock;         /**< The timestamp of the last context switch per CPU */
+        int links;
+        int link[BPF_MAX_LINKS];                     /**< The perf event fds */
+        int programs;
+        int program[BPF_MAX_LINKS];
+        const char *tracefs;
+        struct {
+                int size;
+                unsigned int *keys;
+                ProcessCounters_T *values;
+        } buffer;
+        struct {
+                int count;
+                Entry_T *list;                          /**< Sorted by the PID */
+        } snapshot;
+} _bpf = {.map = -1, .clock = -1};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static long _bpfCall(int command, union bpf_attr *attr) {
+        return syscall(SYS_bpf, command, attr, sizeof(*attr));
+}
+
+
+static int _mapCreate(int type, int keySize, int valueSize, int maxEntries, int flags) {
+        union bpf_attr attr = {.map_type = type, .key_size = keySize, .value_size = valueSize, .max_entries = maxEntries, .map_flags = flags};
+        return (int)_bpfCall(BPF_MAP_CREATE, &attr);
+}
+
+
+static void _emit(Bytecode_T P, struct bpf_insn insn) {
+        ASSERT(P->count < BPF_MAX_INSNS);
+        P->insn[P->count++] = insn;
+}
+
+
+static void _emitMap(Bytecode_T P, int reg, int map) {
+        _emit(P, (struct bpf_insn){.code = BPF_LD | BPF_DW | BPF_IMM, .dst_reg = reg, .src_reg = BPF_PSEUDO_MAP_FD, .imm = map});
+        _emit(P, (struct bpf_insn){});
+}
+
+
+// Emit the conditional jump to the program end
+static void _emitExitIf(Bytecode_T P, struct bpf_insn jump) {
+        ASSERT(P->exits < (int)(sizeof(P->exit) / sizeof(P->exit[0])));
+        P->exit[P->exits++] = P->count;
+        _emit(P, jump);
+}
+
+
+// Emit the program end and patch the jumps to it
+static void _emitEnd(Bytecode_T P) {
+        for (int i = 0; i < P->exits; i++)
+                P->insn[P->exit[i]].off = (short)(P->count - P->exit[i] - 1);
+        _emit(P, _MOV64_IMM(BPF_REG_0, 0));
+        _emit(P, _EXIT());
+}
+
+
+// Store the thread group ID of the current task to the key slot, the idle task (0) is skipped
+static void _emitTgid(Bytecode_T P) {
+        _emit(P, _CALL(BPF_FUNC_get_current_pid_tgid));
+        _emit(P, _ALU64_IMM(BPF_RSH, BPF_REG_0, 32));
+        _emitExitIf(P, _JMP_IMM(BPF_JEQ, BPF_REG_0, 0));
+        _emit(P, _STX_MEM(BPF_W, BPF_REG_10, BPF_REG_0, STACK_KEY));
+}
+
+
+/**
+ * Add R6 to the counter at the offset (and R7 to the second counter if the offset2 >= 0) of the process
+ * in the key slot. If the process has no entry yet, it is created with the initial counters
+ */
+static void _emitAccount(Bytecode_T P, int map, int offset, int offset2) {
+        _emitMap(P, BPF_REG_1, map);
+        _emit(P, _MOV64_REG(BPF_REG_2, BPF_REG_10));
+        _emit(P, _ALU64_IMM(BPF_ADD, BPF_REG_2, STACK_KEY));
+        _emit(P, _CALL(BPF_FUNC_map_lookup_elem));
+        _emit(P, _JMP_IMM(BPF_JEQ, BPF_REG_0, 0));
+        int create = P->count - 1;
+        _emit(P, _ATOMIC_ADD(BPF_REG_0, BPF_REG_6, offset));
+        if (offset2 >= 0)
+                _emit(P, _ATOMIC_ADD(BPF_REG_0, BPF_REG_7, offset2));
+        _emit(P, _MOV64_IMM(BPF_REG_0, 0));
+        _emit(P, _EXIT());
+        P->insn[create].off = (short)(P->count - create - 1);
+        for (int i = 0; i < (int)sizeof(ProcessCounters_T); i += 8)
+                _emit(P, _ST_MEM(BPF_DW, BPF_REG_10, STACK_VALUE + i, 0));
+        _emit(P, _STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_6, STACK_VALUE + offset));
+        if (offset2 >= 0)
+                _emit(P, _STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_7, STACK_VALUE + offset2));
+        _emitMap(P, BPF_REG_1, map);
+        _emit(P, _MOV64_REG(BPF_REG_2, BPF_REG_10));
+        _emit(P, _ALU64_IMM(BPF_ADD, BPF_REG_2, STACK_KEY));
+        _emit(P, _MOV64_REG(BPF_REG_3, BPF_REG_10));
+        _emit(P, _ALU64_IMM(BPF_ADD, BPF_REG_3, STACK_VALUE));
+        _emit(P, _MOV64_IMM(BPF_REG_4, BPF_NOEXIST));
+        _emit(P, _CALL(BPF_FUNC_map_update_elem));
+        _emitEnd(P);
+}
+
+
+// sched/sched_switch: account the time since the last context switch on this CPU to the task switched out. The last
+// switch of the exiting task is skipped, so the entry removed by the exit program is not created again
+static void _programCpu(Bytecode_T P, Field_T state) {
+        _emit(P, _MOV64_IMM(BPF_REG_8, 0));
+        if (state.size)
+                _emit(P, _LDX_MEM(state.size == 8 ? BPF_DW : BPF_W, BPF_REG_8, BPF_REG_1, state.offset));
+        _emit(P, _CALL(BPF_FUNC_ktime_get_ns));
+        _emit(P, _MOV64_REG(BPF_REG_6, BPF_REG_0));
+        _emit(P, _ST_MEM(BPF_W, BPF_REG_10, -8, 0));
+        _emitMap(P, BPF_REG_1, _bpf.clock);
+        _emit(P, _MOV64_REG(BPF_REG_2, BPF_REG_10));
+        _emit(P, _ALU64_IMM(BPF_ADD, BPF_REG_2, -8));
+        _emit(P, _CALL(BPF_FUNC_map_lookup_elem));
+        _emitExitIf(P, _JMP_IMM(BPF_JEQ, BPF_REG_0, 0));
+        _emit(P, _LDX_MEM(BPF_DW, BPF_REG_7, BPF_REG_0, 0));
+        _emit(P, _STX_MEM(BPF_DW, BPF_REG_0, BPF_REG_6, 0));
+        _emitExitIf(P, _JMP_IMM(BPF_JEQ, BPF_REG_7, 0));
+        _emit(P, _ALU64_IMM(BPF_AND, BPF_REG_8, TASK_EXITED));
+        _emitExitIf(P, _JMP_IMM(BPF_JNE, BPF_REG_8, 0));
+        _emit(P, _ALU64_REG(BPF_SUB, BPF_REG_6, BPF_REG_7));
+        _emitTgid(P);
+        _emitAccount(P, _bpf.map, OFFSET(cpu), -1);
+}
+
+
+// syscalls/sys_exit_*: account the bytes returned by the read or write system call and the operation
+static void _programSyscall(Bytecode_T P, Field_T ret, int bytes, int operations) {
+        _emit(P, _LDX_MEM(ret.size == 8 ? BPF_DW : BPF_W, BPF_REG_6, BPF_REG_1, ret.offset));
+        if (ret.size != 8) {
+                _emit(P, _ALU64_IMM(BPF_LSH, BPF_REG_6, 32));
+                _emit(P, _ALU64_IMM(BPF_ARSH, BPF_REG_6, 32));
+        }
+        _emitExitIf(P, _JMP_IMM(BPF_JSLT, BPF_REG_6, 0));
+        _emit(P, _MOV64_IMM(BPF_REG_7, 1));
+        _emitTgid(P);
+        _emitAccount(P, _bpf.map, bytes, operations);
+}
+
+
+// sock/sock_send_length and sock/sock_recv_length: account the TCP bytes, the peeked data is skipped
+static void _programSocket(Bytecode_T P, Field_T protocol, Field_T ret, Field_T flags, int bytes) {
+        _emit(P, _LDX_MEM(BPF_H, BPF_REG_2, BPF_REG_1, protocol.offset));
+        _emitExitIf(P, _JMP_IMM(BPF_JNE, BPF_REG_2, IPPROTO_TCP));
+        if (flags.size) {
+                _emit(P, _LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_1, flags.offset));
+                _emit(P, _ALU64_IMM(BPF_AND, BPF_REG_3, MSG_PEEK));
+                _emitExitIf(P, _JMP_IMM(BPF_JNE, BPF_REG_3, 0));
+        }
+        _emit(P, _LDX_MEM(BPF_W, BPF_REG_6, BPF_REG_1, ret.offset));
+        _emit(P, _ALU64_IMM(BPF_LSH, BPF_REG_6, 32));
+        _emit(P, _ALU64_IMM(BPF_ARSH, BPF_REG_6, 32));
+        _emitExitIf(P, _JMP_IMM(BPF_JSLE, BPF_REG_6, 0));
+        _emitTgid(P);
+        _emitAccount(P, _bpf.map, bytes, -1);
+}
+
+
+// sched/sched_process_exit: remove the entry when the thread group leader exits
+static void _programExit(Bytecode_T P) {
+        _emit(P, _CALL(BPF_FUNC_get_current_pid_tgid));
+        _emit(P, _MOV64_REG(BPF_REG_6, BPF_REG_0));
+        _emit(P, _ALU64_IMM(BPF_RSH, BPF_REG_6, 32));
+        _emit(P, _ALU64_IMM(BPF_LSH, BPF_REG_0, 32));
+        _emit(P, _ALU64_IMM(BPF_RSH, BPF_REG_0, 32));
+        _emitExitIf(P, _JMP_REG(BPF_JNE, BPF_REG_0, BPF_REG_6));
+        _emit(P, _STX_MEM(BPF_W, BPF_REG_10, BPF_REG_6, STACK_KEY));
+        _emitMap(P, BPF_REG_1, _bpf.map);
+        _emit(P, _MOV64_REG(BPF_REG_2, BPF_REG_10));
+        _emit(P, _ALU64_IMM(BPF_ADD, BPF_REG_2, STACK_KEY));
+        _emit(P, _CALL(BPF_FUNC_map_delete_elem));
+        _emitEnd(P);
+}
+
+
+static int _programLoad(Bytecode_T P, const char *name) {
+        union bpf_attr attr = {
+                .prog_type = BPF_PROG_TYPE_TRACEPOINT,
+                .insns = (unsigned long)P->insn,
+                .insn_cnt = P->count,
+                .license = (unsigned long)"GPL"
+        };
+        int fd = (int)_bpfCall(BPF_PROG_LOAD, &attr);
+        if (fd < 0 && Run.debug) {
+                // Load again with the verifier log
+                char log[8192] = {};
+                int error = errno;
+                attr.log_buf = (unsigned long)log;
+                attr.log_size = sizeof(log);
+                attr.log_level = 1;
+                if (_bpfCall(BPF_PROG_LOAD, &attr) < 0)
+                        DEBUG("eBPF accounting -- cannot load the %s program: %s\n%s\n", name, strerror(error), log);
+                errno = error;
+        }
+        if (fd >= 0)
+                _bpf.program[_bpf.programs++] = fd;
+        return fd;
+}
+
+
+static bool _readTracefs(const char *event, const char *file, char *buf, int size) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/events/%s/%s", _bpf.tracefs, event, file);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return false;
+        int n = (int)read(fd, buf, size - 1);
+        close(fd);
+        if (n <= 0)
+                return false;
+        buf[n] = 0;
+        return true;
+}
+
+
+/**
+ * Get the offset and size of the tracepoint field from its format file, such as "field:long ret;	offset:16;	size:8;"
+ * @return true if the field was found
+ */
+static bool _field(const char *event, const char *name, Field_T *field) {
+        char buf[4096];
+        if (_readTracefs(event, "format", buf, sizeof(buf))) {
+                size_t length = strlen(name);
+                for (char *line = strstr(buf, "field:"); line; line = strstr(line + 1, "field:")) {
+                        char *end = strchr(line, ';');
+                        if (end && (size_t)(end - line) > length && strncmp(end - length, name, length) == 0 && (end[-length - 1] == ' ' || end[-length - 1] == '*'))
+                                return sscanf(end + 1, " offset:%d; size:%d;", &field->offset, &field->size) == 2;
+                }
+        }
+        DEBUG("eBPF accounting -- cannot find the tracepoint %s field %s\n", event, name);
+        return false;
+}
+
+
+/**
+ * Attach the program to the tracepoint. The tracepoint program runs on all CPUs, so one perf event is enough
+ * @return true if succeeded
+ */
+static bool _attach(int program, const char *event) {
+        char buf[32];
+        if (! _readTracefs(event, "id", buf, sizeof(buf))) {
+                DEBUG("eBPF accounting -- tracepoint %s is not available\n", event);
+                return false;
+        }
+        ASSERT(_bpf.links < BPF_MAX_LINKS);
+        struct perf_event_attr attr = {.type = PERF_TYPE_TRACEPOINT, .size = sizeof(attr), .config = strtoull(buf, NULL, 10), .sample_period = 1, .wakeup_events = 1};
+        int fd = (int)syscall(SYS_perf_event_open, &attr, -1, 0, -1, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0) {
+                DEBUG("eBPF accounting -- cannot open the tracepoint %s: %s\n", event, STRERROR);
+                return false;
+        }
+        if (ioctl(fd, PERF_EVENT_IOC_SET_BPF, program) < 0 || ioctl(fd, PERF_EVENT_IOC_ENABLE, 0) < 0) {
+                DEBUG("eBPF accounting -- cannot attach to the tracepoint %s: %s\n", event, STRERROR);
+                close(fd);
+                return false;
+        }
+        _bpf.link[_bpf.links++] = fd;
+        return true;
+}
+
+
+static bool _attachSyscalls(const char *events[], int bytes, int operations) {
+        Field_T ret;
+        if (! _field(events[0], "ret", &ret))
+                return false;
+        struct Bytecode_T P = {};
+        _programSyscall(&P, ret, bytes, operations);
+        int program = _programLoad(&P, events[0]);
+        if (program < 0)
+                return false;
+        // The plain read or write system call is required, the vectored and positional variants are optional
+        if (! _attach(program, events[0]))
+                return false;
+        for (int i = 1; events[i]; i++)
+                _attach(program, events[i]);
+        return true;
+}
+
+
+static bool _attachSocket(const char *event, bool received) {
+        Field_T protocol, ret, flags = {};
+        if (! _field(event, "protocol", &protocol) || ! _field(event, "ret", &ret) || (received && ! _field(event, "flags", &flags)))
+                return false;
+        struct Bytecode_T P = {};
+        _programSocket(&P, protocol, ret, flags, received ? OFFSET(tcpReceived) : OFFSET(tcpSent));
+        int program = _programLoad(&P, event);
+        return program >= 0 && _attach(program, event);
+}
+
+
+static void _close() {
+        for (int i = 0; i < _bpf.links; i++)
+                close(_bpf.link[i]);
+        for (int i = 0; i < _bpf.programs; i++)
+                close(_bpf.program[i]);
+        _bpf.links = _bpf.programs = 0;
+        if (_bpf.map >= 0)
+                close(_bpf.map);
+        if (_bpf.clock >= 0)
+                close(_bpf.clock);
+        _bpf.map = _bpf.clock = -1;
+        FREE(_bpf.buffer.keys);
+        FREE(_bpf.buffer.values);
+        _bpf.buffer.size = 0;
+        FREE(_bpf.snapshot.list);
+        _bpf.snapshot.count = 0;
+}
+
+
+static void _bufferResize(int size) {
+        _bpf.buffer.size = size;
+        RESIZE(_bpf.buffer.keys, size * sizeof(unsigned int));
+        RESIZE(_bpf.buffer.values, size * sizeof(ProcessCounters_T));
+}
+
+
+/**
+ * Read the whole map with BPF_MAP_LOOKUP_BATCH (Linux 5.6 and later)
+ * @return The number of entries or -1 if the batch operation is not supported
+ */
+static int _lookupBatch() {
+        int count = 0;
+        bool first = true;
+        unsigned long long batch = 0;
+        while (true) {
+                union bpf_attr attr = {.batch = {
+                        .in_batch = first ? 0 : (unsigned long)&batch,
+                        .out_batch = (unsigned long)&batch,
+                        .keys = (unsigned long)(_bpf.buffer.keys + count),
+                        .values = (unsigned long)(_bpf.buffer.values + count),
+                        .count = _bpf.buffer.size - count,
+                        .map_fd = _bpf.map
+                }};
+                long rv = _bpfCall(BPF_MAP_LOOKUP_BATCH, &attr);
+                if (rv < 0 && errno == ENOSPC) {
+                        // The bucket doesn't fit into the rest of the buffer and nothing was read => retry with the same token
+                        _bufferResize(_bpf.buffer.size * 2);
+                        continue;
+                }
+                first = false;
+                count += attr.batch.count;
+                if (rv < 0)
+                        return errno == ENOENT ? count : -1;
+                if (count == _bpf.buffer.size)
+                        _bufferResize(_bpf.buffer.size * 2);
+        }
+}
+
+
+// Read the map entry by entry (Linux < 5.6)
+static int _lookupEach() {
+        int count = 0;
+        unsigned int key = 0;
+        for (unsigned int *previous = NULL; true; previous = &key) {
+                union bpf_attr attr = {.map_fd = _bpf.map, .key = (unsigned long)previous, .next_key = (unsigned long)&key};
+                if (_bpfCall(BPF_MAP_GET_NEXT_KEY, &attr) < 0)
+                        break;
+                if (count == _bpf.buffer.size)
+                        _bufferResize(_bpf.buffer.size * 2);
+                attr = (union bpf_attr){.map_fd = _bpf.map, .key = (unsigned long)&key, .value = (unsigned long)(_bpf.buffer.values + count)};
+                if (_bpfCall(BPF_MAP_LOOKUP_ELEM, &attr) == 0)
+                        _bpf.buffer.keys[count++] = key;
+        }
+        return count;
+}
+
+
+static int _compareEntry(const void *a, const void *b) {
+        pid_t x = ((const Entry_T *)a)->pid, y = ((const Entry_T *)b)->pid;
+        return x < y ? -1 : x > y;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool ProcessBPF_start() {
+        if (_bpf.running)
+                return true;
+        const char *tracefs[] = {"/sys/kernel/tracing", "/sys/kernel/debug/tracing", NULL};
+        _bpf.tracefs = NULL;
+        for (int i = 0; tracefs[i] && ! _bpf.tracefs; i++)
+                if (access(tracefs[i], R_OK) == 0 && File_isDirectory(tracefs[i]))
+                        _bpf.tracefs = tracefs[i];
+        if (! _bpf.tracefs) {
+                Log_warning("eBPF process accounting is not available -- tracefs is not mounted\n");
+                return false;
+        }
+        _bpf.map = _mapCreate(BPF_MAP_TYPE_HASH, sizeof(unsigned int), sizeof(ProcessCounters_T), BPF_MAX_PROCESSES, BPF_F_NO_PREALLOC);
+        _bpf.clock = _mapCreate(BPF_MAP_TYPE_PERCPU_ARRAY, sizeof(unsigned int), sizeof(unsigned long long), 1, 0);
+        if (_bpf.map < 0 || _bpf.clock < 0) {
+                Log_warning("eBPF process accounting is not available -- cannot create the BPF map: %s\n", STRERROR);
+                _close();
+                return false;
+        }
+        // The CPU, exit and I/O programs are required, the TCP programs are optional
+        struct Bytecode_T cpu = {}, exit = {};
+        Field_T state = {};
+        _field("sched/sched_switch", "prev_state", &state);
+        _programCpu(&cpu, state);
+        _programExit(&exit);
+        int cpuProgram = _programLoad(&cpu, "cpu");
+        int exitProgram = cpuProgram >= 0 ? _programLoad(&exit, "exit") : -1;
+        if (exitProgram < 0 || ! _attach(cpuProgram, "sched/sched_switch") || ! _attach(exitProgram, "sched/sched_process_exit") ||
+            ! _attachSyscalls((const char *[]){"syscalls/sys_exit_read", "syscalls/sys_exit_readv", "syscalls/sys_exit_pread64", "syscalls/sys_exit_preadv", NULL}, OFFSET(readBytes), OFFSET(readOperations)) ||
+            ! _attachSyscalls((const char *[]){"syscalls/sys_exit_write", "syscalls/sys_exit_writev", "syscalls/sys_exit_pwrite64", "syscalls/sys_exit_pwritev", NULL}, OFFSET(writeBytes), OFFSET(writeOperations))) {
+                Log_warning("eBPF process accounting is not available -- cannot load the BPF programs: %s\n", STRERROR);
+                _close();
+                return false;
+        }
+        if (! _attachSocket("sock/sock_send_length", false) || ! _attachSocket("sock/sock_recv_length", true))
+                DEBUG("eBPF accounting -- the socket tracepoints are not available (Linux < 6.3), the TCP traffic is not accounted\n");
+        _bufferResize(1024);
+        _bpf.running = true;
+        Log_info("eBPF process accounting started\n");
+        return true;
+}
+
+
+void ProcessBPF_stop() {
+        if (_bpf.running) {
+                _bpf.running = false;
+                _close();
+        }
+}
+
+
+bool ProcessBPF_collect() {
+        if (! _bpf.running)
+                return false;
+        int count = _lookupBatch();
+        if (count < 0)
+                count = _lookupEach();
+        RESIZE(_bpf.snapshot.list, (count > 0 ? count : 1) * sizeof(Entry_T));
+        for (int i = 0; i < count; i++)
+                _bpf.snapshot.list[i] = (Entry_T){.pid = (pid_t)_bpf.buffer.keys[i], .counters = _bpf.buffer.values[i]};
+        if (count > 1)
+                qsort(_bpf.snapshot.list, count, sizeof(Entry_T), _compareEntry);
+        _bpf.snapshot.count = count;
+        return true;
+}
+
+
+const ProcessCounters_T *ProcessBPF_get(pid_t pid) {
+        Entry_T key = {.pid = pid};
+        Entry_T *entry = _bpf.snapshot.count ? bsearch(&key, _bpf.snapshot.list, _bpf.snapshot.count, sizeof(Entry_T), _compareEntry) : NULL;
+        return entry ? &(entry->counters) : NULL;
+}
+
+
+#else
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool ProcessBPF_start() {
+        Log_warning("eBPF process accounting is not supported on this system\n");
+        return false;
+}
+
+
+void ProcessBPF_stop() {
+}
+
+
+bool ProcessBPF_collect() {
+        return false;
+}
+
+
+const ProcessCounters_T *ProcessBPF_get(__attribute__ ((unused)) pid_t pid) {
+        return NULL;
+}
+
+
+#endif
+
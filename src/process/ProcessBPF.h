@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_PROCESSBPF_H
+#define MONIT_PROCESSBPF_H
+
+#include "config.h"
+
+
+/**
+ * eBPF process accounting. If enabled with "set process accounting ebpf",
+ * small BPF programs attached to the scheduler, system call and socket
+ * tracepoints maintain the counters of each process (thread group) in a
+ * BPF hash map: the CPU time, the bytes and operations of the read and
+ * write system calls and the TCP bytes sent and received. The counters
+ * include the threads which exited between the cycles. The process engine
+ * reads the map in one batch per cycle, so /proc/PID/io is not read unless
+ * some service tests the physical I/O.
+ *
+ * Available on Linux with BPF support, the tracefs mounted and the root
+ * privileges (or CAP_BPF and CAP_PERFMON). The TCP counters require Linux
+ * 6.3 or later. If BPF is not available, the process statistics are read
+ * from procfs as usual.
+ *
+ * @file
+ */
+
+
+/**
+ * The counters of the process since the accounting started. The layout
+ * is shared with the BPF programs
+ */
+typedef struct ProcessCounters_T {
+        unsigned long long cpu;                               /**< CPU time [ns] */
+        unsigned long long readBytes;          /**< Bytes read by the system calls */
+        unsigned long long writeBytes;      /**< Bytes written by the system calls */
+        unsigned long long readOperations;              /**< Read system calls */
+        unsigned long long writeOperations;            /**< Write system calls */
+        unsigned long long tcpSent;                           /**< TCP bytes sent */
+        unsigned long long tcpReceived;                   /**< TCP bytes received */
+} ProcessCounters_T;
+
+
+/**
+ * Load the BPF programs and start the accounting
+ * @return true if the accounting was started otherwise false
+ */
+bool ProcessBPF_start(void);
+
+
+/**
+ * Stop the accounting and unload the BPF programs
+ */
+void ProcessBPF_stop(void);
+
+
+/**
+ * Read the counters of all processes from the BPF map. Should be called
+ * once per process tree scan, before the counters are looked up
+ * @return true if the counters were read, false if the accounting is not
+ * running
+ */
+bool ProcessBPF_collect(void);
+
+
+/**
+ * Get the counters of the process from the last collected snapshot
+ * @param pid The process PID (thread group ID)
+ * @return The counters or NULL if the process has no counters
+ */
+const ProcessCounters_T *ProcessBPF_get(pid_t pid);
+
+
+#endif
+
@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
+#include "monit.h"
+#include "ProcessEvent.h"
+#include "system/Time.h"
+
+// libmonit
+#include "exceptions/AssertException.h"
+
+/**
+ *  Process event engine based on the Linux pidfd: the watcher thread polls
+ *  the pidfd of each monitored process, which becomes readable when the
+ *  process exits.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#if defined(SYS_pidfd_open) && defined(HAVE_POLL_H)
+
+
+typedef struct PidList_T {
+        int count;
+        int size;
+        pid_t *list;
+} PidList_T;
+
+
+typedef struct Watch_T {
+        pid_t pid;
+        int fd;
+} Watch_T;
+
+
+static struct {
+        bool running;
+        int pipe[2];                            /**< Watcher thread wakeup pipe */
+        Thread_T thread;
+        Mutex_T mutex;
+        PidList_T wanted;                     /**< PIDs of monitored processes */
+        PidList_T exited;                /**< PIDs which exited, not collected */
+        struct {
+                int count;
+                int size;
+                Watch_T *list;
+        } watched;                       /**< Watcher thread private pidfd list */
+} _engine = {.pipe = {-1, -1}, .mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static int _pidfdOpen(pid_t pid) {
+        return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+
+static void _pidListAdd(PidList_T *L, pid_t pid) {
+        if (L->count == L->size) {
+                L->size = L->size ? L->size * 2 : 64;
+                RESIZE(L->list, L->size * sizeof(pid_t));
+        }
+        L->list[L->count++] = pid;
+}
+
+
+static bool _pidListContains(PidList_T *L, pid_t pid) {
+        for (int i = 0; i < L->count; i++)
+                if (L->list[i] == pid)
+                        return true;
+        return false;
+}
+
+
+static void _pidListFree(PidList_T *L) {
+        FREE(L->list);
+        L->count = L->size = 0;
+}
+
+
+static void _wakeup() {
+        ssize_t __attribute__ ((unused)) n = write(_engine.pipe[1], "", 1);
+}
+
+
+/**
+ * Synchronize the watched pidfds with the wanted PIDs. Must be called with the engine mutex locked
+ * @return true if some wanted process is already gone
+ */
+static bool _reconcile() {
+        bool exited = false;
+        // Close pidfds of processes which are not monitored anymore
+        for (int i = 0; i < _engine.watched.count; ) {
+                if (! _pidListContains(&_engine.wanted, _engine.watched.list[i].pid)) {
+                        close(_engine.watched.list[i].fd);
+                        _engine.watched.list[i] = _engine.watched.list[--_engine.watched.count];
+                } else {
+                        i++;
+                }
+        }
+        // Open pidfds for new processes
+        for (int i = 0; i < _engine.wanted.count; i++) {
+                pid_t pid = _engine.wanted.list[i];
+                bool watched = false;
+                for (int j = 0; j < _engine.watched.count && ! watched; j++)
+                        watched = _engine.watched.list[j].pid == pid;
+                if (! watched) {
+                        int fd = _pidfdOpen(pid);
+                        if (fd >= 0) {
+                                if (_engine.watched.count == _engine.watched.size) {
+                                        _engine.watched.size = _engine.watched.size ? _engine.watched.size * 2 : 64;
+                                        RESIZE(_engine.watched.list, _engine.watched.size * sizeof(Watch_T));
+                                }
+                                _engine.watched.list[_engine.watched.count++] = (Watch_T){.pid = pid, .fd = fd};
+                        } else if (errno == ESRCH) {
+                                _pidListAdd(&_engine.exited, pid);
+                                exited = true;
+                        } else {
+                                DEBUG("Process events -- cannot watch process %d: %s\n", pid, STRERROR);
+                        }
+                }
+        }
+        if (exited) {
+                // Don't retry until the next update
+                _engine.wanted.count = 0;
+                for (int i = 0; i < _engine.watched.count; i++)
+                        _pidListAdd(&_engine.wanted, _engine.watched.list[i].pid);
+        }
+        return exited;
+}
+
+
+static void *_watcher(__attribute__ ((unused)) void *args) {
+        set_signal_block();
+        struct pollfd *fds = NULL;
+        while (_engine.running) {
+                bool exited;
+                LOCK(_engine.mutex)
+                {
+                        exited = _reconcile();
+                        RESIZE(fds, (_engine.watched.count + 1) * sizeof(struct pollfd));
+                        fds[0] = (struct pollfd){.fd = _engine.pipe[0], .events = POLLIN};
+                        for (int i = 0; i < _engine.watched.count; i++)
+                                fds[i + 1] = (struct pollfd){.fd = _engine.watched.list[i].fd, .events = POLLIN};
+                }
+                END_LOCK;
+                if (exited)
+                        kill(getpid(), SIGUSR1);
+                int nfds = _engine.watched.count + 1;
+                if (poll(fds, nfds, -1) < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        Log_error("Process events -- poll failed: %s\n", STRERROR);
+                        break;
+                }
+                if (fds[0].revents & POLLIN) {
+                        char buf[64];
+                        while (read(_engine.pipe[0], buf, sizeof(buf)) > 0)
+                                ;
+                }
+                exited = false;
+                LOCK(_engine.mutex)
+                {
+                        for (int i = nfds - 1; i > 0; i--) {
+                                if (fds[i].revents) {
+                                        Watch_T *w = &_engine.watched.list[i - 1];
+                                        DEBUG("Process events -- process %d exited\n", w->pid);
+                                        _pidListAdd(&_engine.exited, w->pid);
+                                        for (int j = 0; j < _engine.wanted.count; j++) {
+                                                if (_engine.wanted.list[j] == w->pid) {
+                                                        _engine.wanted.list[j] = _engine.wanted.list[--_engine.wanted.count];
+                                                        break;
+                                                }
+                                        }
+                                        close(w->fd);
+                                        *w = _engine.watched.list[--_engine.watched.count];
+                                        exited = true;
+                                }
+                        }
+                }
+                END_LOCK;
+                if (exited)
+                        kill(getpid(), SIGUSR1); // Wake up the daemon
+        }
+        FREE(fds);
+        return NULL;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool ProcessEvent_start() {
+        if (_engine.running)
+                return true;
+        int fd = _pidfdOpen(getpid());
+        if (fd < 0) {
+                Log_warning("Process events are not available -- %s\n", STRERROR);
+                return false;
+        }
+        close(fd);
+        if (pipe(_engine.pipe) < 0) {
+                Log_error("Process events -- cannot create pipe: %s\n", STRERROR);
+                return false;
+        }
+        for (int i = 0; i < 2; i++) {
+                fcntl(_engine.pipe[i], F_SETFD, FD_CLOEXEC);
+                fcntl(_engine.pipe[i], F_SETFL, O_NONBLOCK);
+        }
+        _engine.running = true;
+        ProcessEvent_update();
+        Thread_create(_engine.thread, _watcher, NULL);
+        Log_info("Process event engine started\n");
+        return true;
+}
+
+
+void ProcessEvent_stop() {
+        if (_engine.running) {
+                _engine.running = false;
+                _wakeup();
+                Thread_join(_engine.thread);
+                for (int i = 0; i < _engine.watched.count; i++)
+                        close(_engine.watched.list[i].fd);
+                FREE(_engine.watched.list);
+                _engine.watched.count = _engine.watched.size = 0;
+                _pidListFree(&_engine.wanted);
+                _pidListFree(&_engine.exited);
+                close(_engine.pipe[0]);
+                close(_engine.pipe[1]);
+                _engine.pipe[0] = _engine.pipe[1] = -1;
+                Log_info("Process event engine stopped\n");
+        }
+}
+
+
+void ProcessEvent_update() {
+        if (_engine.running) {
+                LOCK(_engine.mutex)
+                {
+                        _engine.wanted.count = 0;
+                        for (Service_T s = servicelist; s; s = s->next)
+                                if (s->type == Service_Process && s->monitor != Monitor_Not && s->inf.process->pid > 0)
+                                        _pidListAdd(&_engine.wanted, s->inf.process->pid);
+                }
+                END_LOCK;
+                _wakeup();
+        }
+}
+
+
+bool ProcessEvent_collect() {
+        bool collected = false;
+        if (_engine.running) {
+                LOCK(_engine.mutex)
+                {
+                        for (int i = 0; i < _engine.exited.count; i++) {
+                                for (Service_T s = servicelist; s; s = s->next) {
+                                        if (s->type == Service_Process && s->inf.process->pid == _engine.exited.list[i]) {
+                                                DEBUG("'%s' process exited -- scheduling immediate check\n", s->name);
+                                                s->every.next = 0;
+                                                collected = true;
+                                        }
+                                }
+                        }
+                        _engine.exited.count = 0;
+                }
+                END_LOCK;
+        }
+        return collected;
+}
+
+
+bool ProcessEvent_pending() {
+        bool pending = false;
+        if (_engine.running) {
+                LOCK(_engine.mutex)
+                {
+                        pending = _engine.exited.count > 0;
+                }
+                END_LOCK;
+        }
+        return pending;
+}
+
+
+bool ProcessEvent_waitExit(pid_t pid, int timeout) {
+        int fd = _pidfdOpen(pid);
+        if (fd < 0) {
+                if (errno == ESRCH)
+                        return true;
+                // The kernel without pidfd support
+                Time_usleep(timeout * USEC_PER_MSEC);
+                return getpgid(pid) == -1 && errno != EPERM;
+        }
+        struct pollfd event = {.fd = fd, .events = POLLIN};
+        int rv = poll(&event, 1, timeout);
+        close(fd);
+        return rv > 0;
+}
+
+
+#else
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool ProcessEvent_start() {
+        Log_warning("Process events are not supported on this system\n");
+        return false;
+}
+
+
+void ProcessEvent_stop() {
+}
+
+
+void ProcessEvent_update() {
+}
+
+
+bool ProcessEvent_collect() {
+        return false;
+}
+
+
+bool ProcessEvent_pending() {
+        return false;
+}
+
+
+bool ProcessEvent_waitExit(pid_t pid, int timeout) {
+        Time_usleep(timeout * USEC_PER_MSEC);
+        return getpgid(pid) == -1 && errno != EPERM;
+}
+
+
+#endif
+
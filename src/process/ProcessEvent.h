@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_PROCESSEVENT_H
+#define MONIT_PROCESSEVENT_H
+
+#include "config.h"
+
+
+/**
+ * Process event engine. If enabled with "set process events", a thread
+ * watches the PIDs of the monitored processes and wakes up the daemon
+ * as soon as a process exits, so the service is checked immediately
+ * instead of in the next poll cycle. The engine is available on Linux
+ * with pidfd support (kernel 5.3 and later), otherwise the processes
+ * are polled as usual.
+ *
+ * @file
+ */
+
+
+/**
+ * Start the process event engine
+ * @return true if the engine was started otherwise false
+ */
+bool ProcessEvent_start(void);
+
+
+/**
+ * Stop the process event engine
+ */
+void ProcessEvent_stop(void);
+
+
+/**
+ * Update the set of watched processes from the servicelist. Should be
+ * called after each validation cycle as PIDs may change
+ */
+void ProcessEvent_update(void);
+
+
+/**
+ * Schedule the services whose process exited for an immediate check
+ * @return true if some process exited since the last call otherwise false
+ */
+bool ProcessEvent_collect(void);
+
+
+/**
+ * Test if a process exit event is pending
+ * @return true if some process exited and was not collected yet
+ */
+bool ProcessEvent_pending(void);
+
+
+/**
+ * Wait for the process exit. The pidfd of the process is polled if
+ * supported, so the exit is noticed immediately, otherwise the process
+ * is tested after the timeout. The engine doesn't need to run
+ * @param pid The process ID
+ * @param timeout The maximum wait in milliseconds
+ * @return true if the process exited otherwise false
+ */
+bool ProcessEvent_waitExit(pid_t pid, int timeout);
+
+
+#endif
+
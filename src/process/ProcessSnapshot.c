@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
+#include "monit.h"
+#include "ProcessSnapshot.h"
+
+// libmonit
+#include "exceptions/AssertException.h"
+
+/**
+ *  The snapshot archive starts with the SNAPSHOT_MAGIC line, followed by
+ *  the records:
+ *
+ *    F <path> <length>\n<length bytes of the file content>
+ *    N <path> <count>\n
+ *
+ *  The path is relative to the procfs root. The N record is a directory
+ *  with count entries, such as /proc/<pid>/fd, where only the number of
+ *  the entries is used. The parent directories are created on extraction.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define SNAPSHOT_MAGIC "MONIT-PROCFS 1\n"
+
+
+// The system statistics files, which are recorded if present
+static const char *_systemFiles[] = {"loadavg", "meminfo", "stat", "uptime", "sys/fs/file-nr", "pressure/cpu", "pressure/memory", "pressure/io", "spl/kstat/zfs/arcstats", NULL};
+
+
+// The files of each process, the stat file is required
+static const char *_processFiles[] = {"stat", "status", "io", "cmdline", "limits", "attr/current", "cgroup", NULL};
+
+
+#ifdef HAVE_LIBZ
+typedef gzFile Archive_T;
+#define _archiveOpen(path, mode)       gzopen((path), (mode))
+#define _archiveWrite(a, data, length) (gzwrite((a), (data), (unsigned)(length)) == (int)(length))
+#define _archiveRead(a, data, length)  (gzread((a), (data), (unsigned)(length)) == (int)(length))
+#define _archiveGets(a, buf, size)     gzgets((a), (buf), (size))
+#define _archiveClose(a)               (gzclose(a) == Z_OK)
+#else
+typedef FILE *Archive_T;
+#define _archiveOpen(path, mode)       fopen((path), (mode))
+#define _archiveWrite(a, data, length) (fwrite((data), 1, (length), (a)) == (size_t)(length))
+#define _archiveRead(a, data, length)  (fread((data), 1, (length), (a)) == (size_t)(length))
+#define _archiveGets(a, buf, size)     fgets((buf), (size), (a))
+#define _archiveClose(a)               (fclose(a) == 0)
+#endif
+
+
+typedef struct Buffer_T {
+        size_t size;
+        char *data;
+} Buffer_T;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Read the file relative to the root directory into the buffer
+ * @return The file length or -1 if the file cannot be read
+ */
+static long long _readFile(int root, const char *path, Buffer_T *buffer) {
+        int fd = openat(root, path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return -1;
+        size_t n = 0;
+        ssize_t bytes;
+        while ((bytes = read(fd, buffer->data + n, buffer->size - n)) > 0) {
+                n += bytes;
+                if (n == buffer->size) {
+                        buffer->size *= 2;
+                        RESIZE(buffer->data, buffer->size);
+                }
+        }
+        close(fd);
+        return bytes < 0 ? -1 : (long long)n;
+}
+
+
+/**
+ * Write the F record of the file, the missing or unreadable file is skipped
+ * @return false if the archive write failed
+ */
+static bool _recordFile(Archive_T a, int root, const char *path, Buffer_T *buffer, bool *found) {
+        char header[STRLEN];
+        long long length = _readFile(root, path, buffer);
+        if (found)
+                *found = length >= 0;
+        if (length < 0)
+                return true;
+        int n = snprintf(header, sizeof(header), "F %s %lld\n", path, length);
+        return _archiveWrite(a, header, n) && _archiveWrite(a, buffer->data, length);
+}
+
+
+/**
+ * Write the N record with the number of the entries in the directory
+ * @return false if the archive write failed
+ */
+static bool _recordCount(Archive_T a, int root, const char *path) {
+        int fd = openat(root, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+                return true;
+        DIR *d = fdopendir(fd);
+        if (! d) {
+                close(fd);
+                return true;
+        }
+        long long count = 0;
+        for (struct dirent *e = readdir(d); e; e = readdir(d))
+                if (! IS(e->d_name, ".") && ! IS(e->d_name, ".."))
+                        count++;
+        closedir(d);
+        char header[STRLEN];
+        int n = snprintf(header, sizeof(header), "N %s %lld\n", path, count);
+        return _archiveWrite(a, header, n);
+}
+
+
+/**
+ * Record the process files. The process which exited during the recording is skipped
+ * @return false if the archive write failed
+ */
+static bool _recordProcess(Archive_T a, int root, const char *pid, Buffer_T *buffer, int *count) {
+        char path[STRLEN];
+        bool found = false;
+        for (int i = 0; _processFiles[i]; i++) {
+                snprintf(path, sizeof(path), "%s/%s", pid, _processFiles[i]);
+                if (! _recordFile(a, root, path, buffer, i == 0 ? &found : NULL))
+                        return false;
+                if (! found)
+                        return true;
+        }
+        snprintf(path, sizeof(path), "%s/fd", pid);
+        if (! _recordCount(a, root, path))
+                return false;
+        (*count)++;
+        return true;
+}
+
+
+/**
+ * Check that the path from the archive is relative and stays inside the target directory
+ */
+static bool _isSafePath(const char *path) {
+        return *path && *path != '/' && ! Str_startsWith(path, "../") && ! strstr(path, "/../") && ! Str_endsWith(path, "/..") && ! IS(path, "..");
+}
+
+
+/**
+ * Create the parent directories of the path
+ */
+static bool _createParents(char *path) {
+        for (char *p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/')) {
+                *p = 0;
+                bool rv = mkdir(path, 0700) == 0 || errno == EEXIST;
+                *p = '/';
+                if (! rv)
+                        return false;
+        }
+        return true;
+}
+
+
+static bool _extractFile(const char *path, const char *data, long long length) {
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0)
+                return false;
+        bool rv = write(fd, data, length) == length;
+        return close(fd) == 0 && rv;
+}
+
+
+static bool _extractCount(char *path, long long count) {
+        if (mkdir(path, 0700) != 0 && errno != EEXIST)
+                return false;
+        size_t length = strlen(path);
+        for (long long i = 0; i < count; i++) {
+                snprintf(path + length, PATH_MAX - length, "/%lld", i);
+                if (! _extractFile(path, "", 0))
+                        return false;
+        }
+        path[length] = 0;
+        return true;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int ProcessSnapshot_record(const char *archive) {
+        ASSERT(archive);
+        const char *procfs = PROCFS_ROOT;
+        int root = open(procfs, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (root < 0) {
+                Log_error("Cannot open %s -- %s\n", procfs, STRERROR);
+                return -1;
+        }
+        DIR *d = fdopendir(dup(root));
+        Archive_T a = d ? _archiveOpen(archive, "wb") : NULL;
+        if (! a) {
+                Log_error("Cannot create the snapshot %s -- %s\n", archive, STRERROR);
+                if (d)
+                        closedir(d);
+                close(root);
+                return -1;
+        }
+        Buffer_T buffer = {.size = 65536};
+        buffer.data = ALLOC(buffer.size);
+        int count = 0;
+        bool rv = _archiveWrite(a, SNAPSHOT_MAGIC, strlen(SNAPSHOT_MAGIC));
+        for (int i = 0; rv && _systemFiles[i]; i++)
+                rv = _recordFile(a, root, _systemFiles[i], &buffer, NULL);
+        for (struct dirent *e = readdir(d); rv && e; e = readdir(d))
+                if (*e->d_name >= '1' && *e->d_name <= '9')
+                        rv = _recordProcess(a, root, e->d_name, &buffer, &count);
+        FREE(buffer.data);
+        closedir(d);
+        close(root);
+        if (! _archiveClose(a) || ! rv) {
+                Log_error("Cannot write the snapshot %s -- %s\n", archive, STRERROR);
+                unlink(archive);
+                return -1;
+        }
+        return count;
+}
+
+
+int ProcessSnapshot_extract(const char *archive, const char *directory) {
+        ASSERT(archive);
+        ASSERT(directory);
+        if (mkdir(directory, 0700) != 0 && errno != EEXIST) {
+                Log_error("Cannot create the directory %s -- %s\n", directory, STRERROR);
+                return -1;
+        }
+        Archive_T a = _archiveOpen(archive, "rb");
+        if (! a) {
+                Log_error("Cannot open the snapshot %s -- %s\n", archive, STRERROR);
+                return -1;
+        }
+        char line[PATH_MAX], name[PATH_MAX], path[PATH_MAX];
+        if (! _archiveGets(a, line, sizeof(line)) || ! IS(line, SNAPSHOT_MAGIC)) {
+                Log_error("The file %s is not a procfs snapshot\n", archive);
+                (void)_archiveClose(a);
+                return -1;
+        }
+        Buffer_T buffer = {.size = 65536};
+        buffer.data = ALLOC(buffer.size);
+        int count = 0;
+        bool rv = true;
+        while (rv && _archiveGets(a, line, sizeof(line))) {
+                char type;
+                long long length;
+                if (sscanf(line, "%c %4095s %lld", &type, name, &length) != 3 || length < 0 || ! _isSafePath(name) || (type != 'F' && type != 'N')) {
+                        Log_error("The snapshot %s is corrupted\n", archive);
+                        rv = false;
+                        break;
+                }
+                if (snprintf(path, sizeof(path), "%s/%s", directory, name) >= (int)sizeof(path)) {
+                        errno = ENAMETOOLONG;
+                        rv = false;
+                } else if (! _createParents(path)) {
+                        rv = false;
+                } else if (type == 'N') {
+                        rv = _extractCount(path, length);
+                } else {
+                        if ((size_t)length >= buffer.size) {
+                                buffer.size = length + 1;
+                                RESIZE(buffer.data, buffer.size);
+                        }
+                        if (! _archiveRead(a, buffer.data, length)) {
+                                Log_error("The snapshot %s is truncated\n", archive);
+                                rv = false;
+                                break;
+                        }
+                        rv = _extractFile(path, buffer.data, length);
+                        // Count the processes by their required stat file
+                        char *slash = strchr(name, '/');
+                        if (rv && slash && IS(slash, "/stat") && *name >= '1' && *name <= '9')
+                                count++;
+                }
+                if (! rv)
+                        Log_error("Cannot extract %s -- %s\n", path, STRERROR);
+        }
+        FREE(buffer.data);
+        (void)_archiveClose(a);
+        return rv ? count : -1;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_PROCESSSNAPSHOT_H
+#define MONIT_PROCESSSNAPSHOT_H
+
+#include "config.h"
+
+
+/**
+ * Snapshot of the Linux /proc filesystem. The snapshot archive keeps
+ * the files which are read by the process engine: the system statistics
+ * and for each process its stat, status, io, cmdline, limits, security
+ * attribute, cgroup and the number of open file descriptors. The archive
+ * is compressed with gzip if Monit was built with zlib.
+ *
+ * The extracted snapshot is a directory in the /proc layout, so it can
+ * be replayed through the process engine with "set procfs <directory>"
+ * or profiled with "monitbench replay <archive>". This allows the
+ * deterministic profiling of the process engine on production data.
+ *
+ * @file
+ */
+
+
+/**
+ * Record the procfs root (see "set procfs", default /proc) to the archive
+ * @param archive The archive path
+ * @return The number of the recorded processes or -1 on error
+ */
+int ProcessSnapshot_record(const char *archive);
+
+
+/**
+ * Extract the archive to the directory, which is created if it doesn't
+ * exist
+ * @param archive The archive path
+ * @param directory The target directory
+ * @return The number of the extracted processes or -1 on error
+ */
+int ProcessSnapshot_extract(const char *archive, const char *directory);
+
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#ifdef HAVE_LINUX_NETLINK_H
+#include <linux/netlink.h>
+#endif
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+#include <linux/rtnetlink.h>
+#endif
+
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+#include <linux/sock_diag.h>
+#endif
+
+#ifdef HAVE_LINUX_INET_DIAG_H
+#include <linux/inet_diag.h>
+#endif
+
+#ifdef HAVE_LINUX_TCP_H
+#include <linux/tcp.h>
+#endif
+
+#include "monit.h"
+#include "ProcessSocket.h"
+
+// libmonit
+#include "exceptions/AssertException.h"
+
+/**
+ *  The TCP sockets snapshot. The sockets of both address families are
+ *  dumped by the NETLINK_SOCK_DIAG socket and sorted by the inode. The
+ *  traffic counters of the socket (tcp_info) are cumulative, so the bytes
+ *  transferred since the previous dump are computed by merging with the
+ *  previous snapshot; the new socket counts all its bytes. The bytes
+ *  transferred by the socket closed between the dumps are not counted.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#if defined(HAVE_LINUX_NETLINK_H) && defined(HAVE_LINUX_RTNETLINK_H) && defined(HAVE_LINUX_SOCK_DIAG_H) && defined(HAVE_LINUX_INET_DIAG_H) && defined(HAVE_LINUX_TCP_H)
+
+
+// The TCP states (include/net/tcp_states.h), not exported by the kernel headers
+#define TCP_STATE_ESTABLISHED 1
+#define TCP_STATE_SYN_RECV    3
+#define TCP_STATE_TIME_WAIT   6
+#define TCP_STATE_CLOSE_WAIT  8
+#define TCP_STATE_LISTEN      10
+
+
+#define NETLINK_BUFFER_SIZE 65536
+
+
+typedef struct TcpSocket_T {
+        unsigned long long inode;
+        unsigned long long sent;
+        unsigned long long received;
+        unsigned long long sentDelta;
+        unsigned long long receivedDelta;
+        int state;
+} TcpSocket_T;
+
+
+typedef struct Snapshot_T {
+        int count;
+        int size;
+        TcpSocket_T *list;
+} Snapshot_T;
+
+
+static struct {
+        int fd;
+        unsigned int sequence;
+        char *buffer;
+        Snapshot_T current;
+        Snapshot_T previous;
+} _sockets = {.fd = -1};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _add(Snapshot_T *S, const struct inet_diag_msg *msg, int length) {
+        // The sockets without inode (TIME_WAIT, the orphaned sockets) don't belong to any process
+        if (! msg->idiag_inode)
+                return;
+        if (S->count == S->size) {
+                S->size = S->size ? S->size * 2 : 1024;
+                RESIZE(S->list, S->size * sizeof(TcpSocket_T));
+        }
+        TcpSocket_T *entry = &S->list[S->count++];
+        *entry = (TcpSocket_T){.inode = msg->idiag_inode, .state = msg->idiag_state};
+        length -= NLMSG_ALIGN(sizeof(struct inet_diag_msg));
+        for (struct rtattr *a = (struct rtattr *)((char *)msg + NLMSG_ALIGN(sizeof(struct inet_diag_msg))); RTA_OK(a, length); a = RTA_NEXT(a, length)) {
+                if (a->rta_type == INET_DIAG_INFO) {
+                        // The kernel before 4.1 sends shorter tcp_info without the bytes counters
+                        struct tcp_info info = {};
+                        memcpy(&info, RTA_DATA(a), MIN(RTA_PAYLOAD(a), sizeof(info)));
+                        entry->sent = info.tcpi_bytes_acked;
+                        entry->received = info.tcpi_bytes_received;
+                }
+        }
+}
+
+
+static bool _dump(Snapshot_T *S, int family, bool bytes) {
+        struct {
+                struct nlmsghdr header;
+                struct inet_diag_req_v2 request;
+        } message = {
+                .header = {
+                        .nlmsg_len = sizeof(message),
+                        .nlmsg_type = SOCK_DIAG_BY_FAMILY,
+                        .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+                        .nlmsg_seq = ++_sockets.sequence
+                },
+                .request = {
+                        .sdiag_family = family,
+                        .sdiag_protocol = IPPROTO_TCP,
+                        // Skip the states without the socket inode
+                        .idiag_states = ~((1U << TCP_STATE_TIME_WAIT) | (1U << TCP_STATE_SYN_RECV)),
+                        .idiag_ext = bytes ? 1 << (INET_DIAG_INFO - 1) : 0
+                }
+        };
+        struct sockaddr_nl kernel = {.nl_family = AF_NETLINK};
+        if (sendto(_sockets.fd, &message, sizeof(message), 0, (struct sockaddr *)&kernel, sizeof(kernel)) < 0)
+                return false;
+        while (true) {
+                ssize_t n = recv(_sockets.fd, _sockets.buffer, NETLINK_BUFFER_SIZE, 0);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return false;
+                }
+                int length = (int)n;
+                for (struct nlmsghdr *h = (struct nlmsghdr *)_sockets.buffer; NLMSG_OK(h, length); h = NLMSG_NEXT(h, length)) {
+                        if (h->nlmsg_seq != _sockets.sequence)
+                                continue;
+                        if (h->nlmsg_type == NLMSG_DONE)
+                                return true;
+                        if (h->nlmsg_type == NLMSG_ERROR) {
+                                const struct nlmsgerr *error = NLMSG_DATA(h);
+                                errno = -error->error;
+                                return false;
+                        }
+                        if (h->nlmsg_type == SOCK_DIAG_BY_FAMILY)
+                                _add(S, NLMSG_DATA(h), h->nlmsg_len - NLMSG_LENGTH(0));
+                }
+        }
+}
+
+
+static int _compareSocket(const void *a, const void *b) {
+        unsigned long long x = ((const TcpSocket_T *)a)->inode, y = ((const TcpSocket_T *)b)->inode;
+        return x < y ? -1 : x > y;
+}
+
+
+// Compute the bytes since the previous dump, both snapshots are sorted by the inode
+static void _delta(Snapshot_T *current, const Snapshot_T *previous) {
+        for (int i = 0, j = 0; i < current->count; i++) {
+                TcpSocket_T *s = &current->list[i];
+                while (j < previous->count && previous->list[j].inode < s->inode)
+                        j++;
+                const TcpSocket_T *p = j < previous->count && previous->list[j].inode == s->inode ? &previous->list[j] : NULL;
+                // The inode may be reused by a new socket, its counters start from zero
+                bool known = p && s->sent >= p->sent && s->received >= p->received;
+                s->sentDelta = known ? s->sent - p->sent : s->sent;
+                s->receivedDelta = known ? s->received - p->received : s->received;
+        }
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool ProcessSocket_collect(bool bytes) {
+        if (_sockets.fd < 0) {
+                if ((_sockets.fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG)) < 0) {
+                        DEBUG("system statistic error -- cannot open the sock_diag netlink socket: %s\n", STRERROR);
+                        return false;
+                }
+                _sockets.buffer = ALLOC(NETLINK_BUFFER_SIZE);
+        }
+        Snapshot_T swap = _sockets.previous;
+        _sockets.previous = _sockets.current;
+        _sockets.current = swap;
+        _sockets.current.count = 0;
+        if (! _dump(&_sockets.current, AF_INET, bytes) || ! _dump(&_sockets.current, AF_INET6, bytes)) {
+                DEBUG("system statistic error -- cannot dump the TCP sockets: %s\n", STRERROR);
+                // Drop the partial snapshot and the socket, which may contain the rest of the dump
+                _sockets.current.count = 0;
+                close(_sockets.fd);
+                _sockets.fd = -1;
+                FREE(_sockets.buffer);
+                return false;
+        }
+        qsort(_sockets.current.list, _sockets.current.count, sizeof(TcpSocket_T), _compareSocket);
+        if (bytes)
+                _delta(&_sockets.current, &_sockets.previous);
+        return true;
+}
+
+
+void ProcessSocket_add(unsigned long long inode, ProcessSockets_T *sockets) {
+        ASSERT(sockets);
+        TcpSocket_T key = {.inode = inode};
+        const TcpSocket_T *s = _sockets.current.count ? bsearch(&key, _sockets.current.list, _sockets.current.count, sizeof(TcpSocket_T), _compareSocket) : NULL;
+        if (s) {
+                if (s->state == TCP_STATE_LISTEN) {
+                        sockets->listen++;
+                } else {
+                        sockets->total++;
+                        if (s->state == TCP_STATE_ESTABLISHED)
+                                sockets->established++;
+                        else if (s->state == TCP_STATE_CLOSE_WAIT)
+                                sockets->closeWait++;
+                }
+                sockets->sent += s->sentDelta;
+                sockets->received += s->receivedDelta;
+        }
+}
+
+
+void ProcessSocket_free(void) {
+        if (_sockets.fd >= 0) {
+                close(_sockets.fd);
+                _sockets.fd = -1;
+        }
+        FREE(_sockets.buffer);
+        FREE(_sockets.current.list);
+        FREE(_sockets.previous.list);
+        _sockets.current.count = _sockets.current.size = _sockets.previous.count = _sockets.previous.size = 0;
+}
+
+
+#else
+
+
+bool ProcessSocket_collect(__attribute__ ((unused)) bool bytes) {
+        return false;
+}
+
+
+void ProcessSocket_add(__attribute__ ((unused)) unsigned long long inode, __attribute__ ((unused)) ProcessSockets_T *sockets) {
+}
+
+
+void ProcessSocket_free(void) {
+}
+
+
+#endif
+
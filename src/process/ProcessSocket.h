@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+
+#ifndef MONIT_PROCESSSOCKET_H
+#define MONIT_PROCESSSOCKET_H
+
+#include "config.h"
+
+
+/**
+ * The TCP connections of the processes. The TCP sockets of the host are
+ * read with one sock_diag netlink dump per cycle and indexed by the socket
+ * inode. The sockets of the process are found by the inodes of its file
+ * descriptors, so neither /proc/net/tcp nor the socket tables of the
+ * network namespaces are parsed for each service.
+ *
+ * Available on Linux only. The sockets in the TIME_WAIT state are not
+ * owned by any process and are not counted.
+ *
+ * @file
+ */
+
+
+/**
+ * The TCP connections of the process
+ */
+typedef struct ProcessSockets_T {
+        int total;                     /**< Connections (the listening sockets excluded) */
+        int established;                            /**< Established connections */
+        int listen;                                        /**< Listening sockets */
+        int closeWait;      /**< Connections closed by the peer, not by the process */
+        unsigned long long sent;  /**< Bytes sent (acknowledged) since the previous dump */
+        unsigned long long received;      /**< Bytes received since the previous dump */
+} ProcessSockets_T;
+
+
+/**
+ * Read the TCP sockets. Should be called once per process tree scan,
+ * before the sockets are looked up
+ * @param bytes true if the traffic counters should be read too
+ * @return true if succeeded, otherwise false
+ */
+bool ProcessSocket_collect(bool bytes);
+
+
+/**
+ * Add the socket to the process connections if it is a TCP socket
+ * @param inode The socket inode
+ * @param sockets The process connections
+ */
+void ProcessSocket_add(unsigned long long inode, ProcessSockets_T *sockets);
+
+
+/**
+ * Free the sockets snapshot
+ */
+void ProcessSocket_free(void);
+
+
+#endif
+
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_LINUX_NETLINK_H
+#include <linux/netlink.h>
+#endif
+
+#ifdef HAVE_LINUX_GENETLINK_H
+#include <linux/genetlink.h>
+#endif
+
+#ifdef HAVE_LINUX_TASKSTATS_H
+#include <linux/taskstats.h>
+#endif
+
+#include "monit.h"
+#include "ProcessTaskstats.h"
+
+// libmonit
+#include "exceptions/AssertException.h"
+
+/**
+ *  The TASKSTATS generic netlink client. The family ID is resolved by the
+ *  netlink controller when the socket is opened, then each process is
+ *  queried by its thread group ID: the kernel replies with the statistics
+ *  summed over the live and exited threads of the group. The scanner
+ *  threads share the socket, so the request and reply are serialized.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#if defined(HAVE_LINUX_NETLINK_H) && defined(HAVE_LINUX_GENETLINK_H) && defined(HAVE_LINUX_TASKSTATS_H)
+
+
+#define TASKSTATS_BUFFER_SIZE 4096
+
+
+#define NLATTR_DATA(a)          ((void *)((char *)(a) + NLA_HDRLEN))
+#define NLATTR_PAYLOAD(a)       ((int)(a)->nla_len - NLA_HDRLEN)
+#define NLATTR_OK(a, length)    ((length) >= (int)sizeof(struct nlattr) && (a)->nla_len >= sizeof(struct nlattr) && (a)->nla_len <= (length))
+#define NLATTR_NEXT(a, length)  ((length) -= NLA_ALIGN((a)->nla_len), (struct nlattr *)((char *)(a) + NLA_ALIGN((a)->nla_len)))
+
+
+static struct {
+        int fd;
+        bool disabled;          // The TASKSTATS family is not available or the query is not permitted
+        unsigned short family;
+        unsigned int sequence;
+        Mutex_T mutex;
+        char buffer[TASKSTATS_BUFFER_SIZE];
+} _taskstats = {.fd = -1, .mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Send the generic netlink request with one attribute and receive the reply
+ * @param type The netlink family ID
+ * @param command The generic netlink command
+ * @param attribute The attribute type
+ * @param data The attribute data (up to 16 bytes)
+ * @param length The attribute data length
+ * @param attributes Set to the attributes of the reply
+ * @return The length of the reply attributes or -1 if failed (errno is set)
+ */
+static int _request(unsigned short type, unsigned char command, unsigned short attribute, const void *data, int length, struct nlattr **attributes) {
+        struct {
+                struct nlmsghdr header;
+                struct genlmsghdr genl;
+                struct nlattr attribute;
+                char data[16];
+        } message = {
+                .header = {
+                        .nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN + NLA_HDRLEN + NLA_ALIGN(length)),
+                        .nlmsg_type = type,
+                        .nlmsg_flags = NLM_F_REQUEST,
+                        .nlmsg_seq = ++_taskstats.sequence
+                },
+                .genl = {.cmd = command, .version = 1},
+                .attribute = {.nla_len = NLA_HDRLEN + length, .nla_type = attribute}
+        };
+        ASSERT(length <= (int)sizeof(message.data));
+        memcpy(message.data, data, length);
+        struct sockaddr_nl kernel = {.nl_family = AF_NETLINK};
+        if (sendto(_taskstats.fd, &message, message.header.nlmsg_len, 0, (struct sockaddr *)&kernel, sizeof(kernel)) < 0)
+                return -1;
+        while (true) {
+                ssize_t n = recv(_taskstats.fd, _taskstats.buffer, TASKSTATS_BUFFER_SIZE, 0);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -1;
+                }
+                int remaining = (int)n;
+                for (struct nlmsghdr *h = (struct nlmsghdr *)_taskstats.buffer; NLMSG_OK(h, remaining); h = NLMSG_NEXT(h, remaining)) {
+                        // Skip the late reply to the previous request
+                        if (h->nlmsg_seq != _taskstats.sequence)
+                                continue;
+                        if (h->nlmsg_type == NLMSG_ERROR) {
+                                const struct nlmsgerr *error = NLMSG_DATA(h);
+                                errno = -error->error;
+                                return -1;
+                        }
+                        if (h->nlmsg_type == type && h->nlmsg_len >= NLMSG_LENGTH(GENL_HDRLEN)) {
+                                *attributes = (struct nlattr *)((char *)NLMSG_DATA(h) + GENL_HDRLEN);
+                                return h->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+                        }
+                }
+        }
+}
+
+
+static bool _open(void) {
+        if ((_taskstats.fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC)) < 0) {
+                Log_warning("Process delay accounting is not available -- cannot open the generic netlink socket: %s\n", STRERROR);
+                return false;
+        }
+        _taskstats.family = 0;
+        struct nlattr *a = NULL;
+        int length = _request(GENL_ID_CTRL, CTRL_CMD_GETFAMILY, CTRL_ATTR_FAMILY_NAME, TASKSTATS_GENL_NAME, sizeof(TASKSTATS_GENL_NAME), &a);
+        for (; length > 0 && NLATTR_OK(a, length); a = NLATTR_NEXT(a, length))
+                if (a->nla_type == CTRL_ATTR_FAMILY_ID && NLATTR_PAYLOAD(a) >= (int)sizeof(unsigned short))
+                        memcpy(&_taskstats.family, NLATTR_DATA(a), sizeof(unsigned short));
+        if (! _taskstats.family) {
+                Log_warning("Process delay accounting is not available -- the kernel doesn't support TASKSTATS\n");
+                close(_taskstats.fd);
+                _taskstats.fd = -1;
+                return false;
+        }
+        // Only the CPU delay is accounted if the delay accounting is disabled
+        char enabled = 0;
+        int fd = open("/proc/sys/kernel/task_delayacct", O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+                if (read(fd, &enabled, 1) != 1)
+                        enabled = 0;
+                close(fd);
+        }
+        if (enabled == '0')
+                Log_warning("Process I/O delay is not accounted -- enable it with 'sysctl kernel.task_delayacct=1'\n");
+        return true;
+}
+
+
+// Find the statistics in the nested TASKSTATS_TYPE_AGGR_TGID attribute
+static bool _parse(struct nlattr *a, int length, ProcessDelay_T *delay) {
+        for (; NLATTR_OK(a, length); a = NLATTR_NEXT(a, length)) {
+                if (a->nla_type == TASKSTATS_TYPE_AGGR_TGID) {
+                        int nestedLength = NLATTR_PAYLOAD(a);
+                        for (struct nlattr *n = NLATTR_DATA(a); NLATTR_OK(n, nestedLength); n = NLATTR_NEXT(n, nestedLength)) {
+                                if (n->nla_type == TASKSTATS_TYPE_STATS) {
+                                        // The older kernel sends the shorter structure, the newer one appends the fields
+                                        struct taskstats stats = {};
+                                        memcpy(&stats, NLATTR_DATA(n), MIN((size_t)NLATTR_PAYLOAD(n), sizeof(stats)));
+                                        delay->cpu = stats.cpu_delay_total;
+                                        delay->io = stats.blkio_delay_total + stats.swapin_delay_total;
+                                        return true;
+                                }
+                        }
+                }
+        }
+        return false;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+bool ProcessTaskstats_get(pid_t pid, ProcessDelay_T *delay) {
+        ASSERT(delay);
+        bool rv = false;
+        LOCK(_taskstats.mutex)
+        {
+                if (_taskstats.fd < 0 && ! _taskstats.disabled && ! _open())
+                        _taskstats.disabled = true;
+                if (_taskstats.fd >= 0) {
+                        unsigned int tgid = (unsigned int)pid;
+                        struct nlattr *a = NULL;
+                        int length = _request(_taskstats.family, TASKSTATS_CMD_GET, TASKSTATS_CMD_ATTR_TGID, &tgid, sizeof(tgid), &a);
+                        if (length >= 0) {
+                                rv = _parse(a, length, delay);
+                        } else if (errno == EPERM) {
+                                Log_warning("Process delay accounting is not available -- %s\n", STRERROR);
+                                close(_taskstats.fd);
+                                _taskstats.fd = -1;
+                                _taskstats.disabled = true;
+                        } else {
+                                // The process exited
+                                DEBUG("system statistic error -- cannot get the taskstats of the process %d: %s\n", pid, STRERROR);
+                        }
+                }
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+void ProcessTaskstats_free(void) {
+        LOCK(_taskstats.mutex)
+        {
+                if (_taskstats.fd >= 0) {
+                        close(_taskstats.fd);
+                        _taskstats.fd = -1;
+                }
+                _taskstats.disabled = false;
+        }
+        END_LOCK;
+}
+
+
+#else
+
+
+bool ProcessTaskstats_get(__attribute__ ((unused)) pid_t pid, __attribute__ ((unused)) ProcessDelay_T *delay) {
+        return false;
+}
+
+
+void ProcessTaskstats_free(void) {
+}
+
+
+#endif
+
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_PROCESSTASKSTATS_H
+#define MONIT_PROCESSTASKSTATS_H
+
+#include "config.h"
+
+
+/**
+ * The delay accounting of the processes. The time the threads of the
+ * process spent waiting is read with one netlink TASKSTATS query per
+ * process (thread group), for the monitored processes only. The query
+ * requires the root privileges (CAP_NET_ADMIN) and the I/O delay requires
+ * the delay accounting enabled in the kernel (the "delayacct" boot option
+ * or the kernel.task_delayacct sysctl on Linux 5.14 and later).
+ *
+ * Available on Linux only. The kernel doesn't sum the I/O counters of the
+ * threads in the thread group statistics, so the read and write counters
+ * are still read from /proc/PID/io or the eBPF accounting.
+ *
+ * @file
+ */
+
+
+/**
+ * The delays of the process since it started, including the exited threads
+ */
+typedef struct ProcessDelay_T {
+        unsigned long long cpu;           /**< Waiting for CPU while runnable [ns] */
+        unsigned long long io;  /**< Waiting for the block I/O and the swap in [ns] */
+} ProcessDelay_T;
+
+
+/**
+ * Get the delays of the process. The netlink socket is opened on the first
+ * call and shared by the scanner threads
+ * @param pid The process PID (thread group ID)
+ * @param delay The delays of the process
+ * @return true if succeeded, otherwise false
+ */
+bool ProcessTaskstats_get(pid_t pid, ProcessDelay_T *delay);
+
+
+/**
+ * Close the netlink socket
+ */
+void ProcessTaskstats_free(void);
+
+
+#endif
@@ -67,12 +67,18 @@
 #include "monit.h"
 #include "event.h"
 #include "ProcessTree.h"
+#include "LiteralMatch.h"
+#include "Cgroup.h"
+#include "ProcessSocket.h"
+#include "ProcessTaskstats.h"
 #include "process_sysdep.h"
 #include "Box.h"
 #include "Color.h"
+#include "probe.h"
 
 // libmonit
 #include "system/Time.h"
+#include "system/Arena.h"
 
 
 /**
@@ -85,25 +91,197 @@
 /* ------------------------------------------------------------- Definitions */
 
 
+/**
+ * Hash index of the process tree entries by pid (open addressing with linear probing)
+ */
+typedef struct ProcessIndex_T {
+        int bits;                                   /**< log2 of the slots count */
+        int *slot;       /**< Process tree entry index + 1 or 0 if the slot is free */
+} ProcessIndex_T;
+
+
 static int ptreesize = 0;
 static ProcessTree_T *ptree = NULL;
+static ProcessIndex_T ptreeindex = {};
+static Mutex_T _mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * The selection entry of the top processes
+ */
+typedef struct TopEntry_T {
+        double key;
+        int index;
+} TopEntry_T;
+
+
+/**
+ * Result of the process match for the service
+ */
+typedef struct ProcessMatch_T {
+        Service_T service;                       /**< The service or NULL (procmatch) */
+        const char *pattern;
+        regex_t *regex;
+        int id;                          /**< The pattern index in procmatch batch */
+        int found;                            /**< Matching process index or -1 */
+} ProcessMatch_T;
+
+
+/**
+ * Results of the process match for the services, which are shared by all services in the
+ * cycle. The command lines are collected once and all pending patterns are matched in one pass
+ */
+static struct {
+        bool collected;                /**< The process tree holds command lines */
+        long long time;           /**< Timestamp of the command lines collection */
+        int count;                                  /**< Number of match results */
+        int size;                                  /**< Allocated results count */
+        ProcessMatch_T *list;
+} _matches = {};
+
+
+#define MATCHER_LITERAL_MIN 3
+
+
+#define ARENA_BLOCK_SIZE 65536
+
+
+/**
+ * String arena of the snapshot: the command lines and security attributes are copied
+ * to the arena, whose blocks are kept across the process tree refreshes and reused
+ */
+static struct {
+        Arena_T arena;
+        Mutex_T mutex;                      /**< The scanner threads share the arena */
+} _strings = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/**
+ * Partitions of the process tree by cgroup: the processes of one cgroup form one partition. The
+ * cgroup scoped service tests its scope against the partitions and scans only the processes of
+ * the matching partitions
+ */
+typedef struct Partition_T {
+        const char *cgroup;
+        int first;                     /**< Index of the first process in the list */
+        int count;                                   /**< Number of processes */
+} Partition_T;
+
+
+static struct {
+        int count;
+        int size;
+        Partition_T *list;
+        int processSize;
+        int *process;                     /**< Process indices sorted by cgroup */
+} _partitions = {};
+
+
+/**
+ * Sorted PIDs of the monitored processes
+ */
+static struct {
+        int count;
+        int size;
+        pid_t *list;
+} _monitored = {};
 
 
 /* ----------------------------------------------------------------- Private */
 
 
+/**
+ * Release the strings of the snapshot. The arena blocks are kept for the next snapshot
+ */
+static void _stringsReset(void) {
+        if (_strings.arena)
+                Arena_reset(_strings.arena);
+}
+
+
+static void _stringsFree(void) {
+        if (_strings.arena)
+                Arena_free(&_strings.arena);
+}
+
+
+static char *_stringsCopy(const char *s, size_t length) {
+        if (! _strings.arena)
+                _strings.arena = Arena_new(ARENA_BLOCK_SIZE);
+        return Arena_strndup(_strings.arena, s, (long)length);
+}
+
+
+/**
+ * Move the process tree to one allocation, which holds the entries followed by the children
+ * lists of all processes in one contiguous array (each process has its own index range)
+ * @param pt The process tree with the parent and children count set, it is freed
+ * @param size Number of processes
+ * @return The compacted process tree, which is freed with one FREE()
+ */
+static ProcessTree_T *_compact(ProcessTree_T *pt, int size) {
+        size_t total = 0;
+        for (int i = 0; i < size; i++)
+                total += pt[i].children.count;
+        ProcessTree_T *snapshot = ALLOC(sizeof(ProcessTree_T) * size + sizeof(int) * total);
+        memcpy(snapshot, pt, sizeof(ProcessTree_T) * size);
+        FREE(pt);
+        int *list = (int *)(snapshot + size);
+        for (int i = 0; i < size; i++) {
+                snapshot[i].children.list = list;
+                list += snapshot[i].children.count;
+                snapshot[i].children.count = 0;
+        }
+        for (int i = 0; i < size; i++) {
+                int parent = snapshot[i].parent;
+                if (parent != i)
+                        snapshot[parent].children.list[snapshot[parent].children.count++] = i;
+        }
+        return snapshot;
+}
+
+
 static void _delete(ProcessTree_T **pt, int *size) {
         ASSERT(pt);
-        ProcessTree_T *_pt = *pt;
-        if (_pt) {
-                for (int i = 0; i < *size; i++) {
-                        FREE(_pt[i].cmdline);
-                        FREE(_pt[i].children.list);
-                        FREE(_pt[i].secattr);
+        FREE(*pt);
+        *size = 0;
+}
+
+
+static unsigned int _hash(pid_t pid, int bits) {
+        return ((unsigned int)pid * 2654435761u) >> (32 - bits);
+}
+
+
+/**
+ * Allocate the index for given number of processes. The table is kept at most
+ * quarter full, so the virtual parent entries fit in as well
+ * @param index The index to initialize
+ * @param size Number of processes
+ */
+static void _indexInit(ProcessIndex_T *index, int size) {
+        index->bits = 4;
+        while ((1 << index->bits) < 4 * size && index->bits < 30)
+                index->bits++;
+        index->slot = CALLOC(1 << index->bits, sizeof(int));
+}
+
+
+static void _indexFree(ProcessIndex_T *index) {
+        FREE(index->slot);
+        index->bits = 0;
+}
+
+
+static void _indexAdd(ProcessIndex_T *index, ProcessTree_T *pt, int i) {
+        unsigned int mask = (1u << index->bits) - 1;
+        for (unsigned int h = _hash(pt[i].pid, index->bits); ; h = (h + 1) & mask) {
+                if (! index->slot[h]) {
+                        index->slot[h] = i + 1;
+                        return;
+                } else if (pt[index->slot[h] - 1].pid == pt[i].pid) {
+                        return; // Keep the first entry
                 }
-                FREE(_pt);
-                *pt = NULL;
-                *size = 0;
         }
 }
 
@@ -111,50 +289,72 @@ static void _delete(ProcessTree_T **pt, int *size) {
 /**
  * Search a leaf in the processtree
  * @param pid  pid of the process
+ * @param index processtree index
  * @param pt  processtree
- * @param treesize  size of the processtree
  * @return process index if succeeded otherwise -1
  */
-static int _findProcess(int pid, ProcessTree_T *pt, int size) {
-        if (size > 0) {
-                for (int i = 0; i < size; i++)
-                        if (pid == pt[i].pid)
-                                return i;
+static int _findProcess(pid_t pid, ProcessIndex_T *index, ProcessTree_T *pt) {
+        if (index->slot) {
+                unsigned int mask = (1u << index->bits) - 1;
+                for (unsigned int h = _hash(pid, index->bits); index->slot[h]; h = (h + 1) & mask)
+                        if (pt[index->slot[h] - 1].pid == pid)
+                                return index->slot[h] - 1;
         }
         return -1;
 }
 
 
 /**
- * Fill data in the process tree by recursively walking through it
+ * Fill data in the process tree. The processes are ordered breadth-first from the roots, so each
+ * process follows its parent, and the totals are accumulated in one bottom-up pass over the reversed
+ * order. The counters are kept in separate arrays during the pass to keep the walk cache-friendly
  * @param pt process tree
- * @param i process index
- */
-static void _fillProcessTree(ProcessTree_T *pt, int index) {
-        if (! pt[index].visited) {
-                pt[index].visited = true;
-                pt[index].children.total = pt[index].children.count;
-                pt[index].threads.children = 0;
-                pt[index].cpu.usage.children = 0.;
-                pt[index].memory.usage_total = pt[index].memory.usage;
-                pt[index].filedescriptors.usage_total = pt[index].filedescriptors.usage;
-                for (int i = 0; i < pt[index].children.count; i++) {
-                        _fillProcessTree(pt, pt[index].children.list[i]);
-                }
-                if (pt[index].parent != -1 && pt[index].parent != index) {
-                        ProcessTree_T *parent_pt = &pt[pt[index].parent];
-                        parent_pt->children.total += pt[index].children.total;
-                        parent_pt->threads.children += (pt[index].threads.self > 1 ? pt[index].threads.self : 1) + (pt[index].threads.children > 0 ? pt[index].threads.children : 0);
-                        if (pt[index].cpu.usage.self >= 0) {
-                                parent_pt->cpu.usage.children += pt[index].cpu.usage.self;
-                        }
-                        if (pt[index].cpu.usage.children >= 0) {
-                                parent_pt->cpu.usage.children += pt[index].cpu.usage.children;
-                        }
-                        parent_pt->memory.usage_total     += pt[index].memory.usage_total;
-                        parent_pt->filedescriptors.usage_total += pt[index].filedescriptors.usage_total;
+ * @param size process tree size
+ */
+static void _fillProcessTree(ProcessTree_T *pt, int size) {
+        unsigned long long *memory = ALLOC(size * (2 * sizeof(long long) + 3 * sizeof(int) + sizeof(float)));
+        long long *filedescriptors = (long long *)(memory + size);
+        float *cpu = (float *)(filedescriptors + size);
+        int *children = (int *)(cpu + size);
+        int *threads = children + size;
+        int *order = threads + size;
+        int count = 0;
+        for (int i = 0; i < size; i++) {
+                memory[i] = pt[i].memory.usage;
+                filedescriptors[i] = pt[i].filedescriptors.usage;
+                cpu[i] = 0.;
+                children[i] = pt[i].children.count;
+                threads[i] = 0;
+                if (pt[i].parent == i)
+                        order[count++] = i;
+        }
+        // Each process is listed in the children list of its parent only, so the order has at most size entries (processes in a parent loop are not reachable from any root)
+        for (int head = 0; head < count; head++) {
+                ProcessTree_T *p = &pt[order[head]];
+                for (int i = 0; i < p->children.count; i++)
+                        order[count++] = p->children.list[i];
+        }
+        for (int k = count - 1; k >= 0; k--) {
+                int i = order[k];
+                int parent = pt[i].parent;
+                if (parent != i) {
+                        children[parent] += children[i];
+                        threads[parent] += (pt[i].threads.self > 1 ? pt[i].threads.self : 1) + threads[i];
+                        if (pt[i].cpu.usage.self >= 0)
+                                cpu[parent] += pt[i].cpu.usage.self;
+                        cpu[parent] += cpu[i];
+                        memory[parent] += memory[i];
+                        filedescriptors[parent] += filedescriptors[i];
                 }
         }
+        for (int i = 0; i < size; i++) {
+                pt[i].children.total = children[i];
+                pt[i].threads.children = threads[i];
+                pt[i].cpu.usage.children = cpu[i];
+                pt[i].memory.usage_total = memory[i];
+                pt[i].filedescriptors.usage_total = filedescriptors[i];
+        }
+        FREE(memory);
 }
 
 
@@ -188,36 +388,322 @@ static float _cpuUsage(float rawUsage, unsigned int threads) {
 }
 
 
+/**
+ * Test if the process matches the pattern and its parent doesn't match (the main process is selected, not its children)
+ */
+static bool _matchProcess(regex_t *regex, int i) {
+        return ptree[i].cmdline && regexec(regex, ptree[i].cmdline, 0, NULL, 0) == 0 && (i == ptree[i].parent || ! ptree[ptree[i].parent].cmdline || regexec(regex, ptree[ptree[i].parent].cmdline, 0, NULL, 0) != 0);
+}
+
+
+static int _compareCgroup(const void *a, const void *b) {
+        int x = *(const int *)a, y = *(const int *)b;
+        int rv = strcmp(ptree[x].cgroup, ptree[y].cgroup);
+        return rv ? rv : x - y;
+}
+
+
+/**
+ * Partition the process tree by cgroup. The cgroups are collected with the command lines if some service is cgroup scoped
+ */
+static void _partitionInit() {
+        _partitions.count = 0;
+        int count = 0;
+        if (_partitions.processSize < ptreesize) {
+                _partitions.processSize = ptreesize;
+                RESIZE(_partitions.process, _partitions.processSize * sizeof(int));
+        }
+        for (int i = 0; i < ptreesize; i++)
+                if (ptree[i].cgroup)
+                        _partitions.process[count++] = i;
+        if (count > 1)
+                qsort(_partitions.process, count, sizeof(int), _compareCgroup);
+        for (int k = 0; k < count; k++) {
+                const char *cgroup = ptree[_partitions.process[k]].cgroup;
+                if (_partitions.count && IS(_partitions.list[_partitions.count - 1].cgroup, cgroup)) {
+                        _partitions.list[_partitions.count - 1].count++;
+                } else {
+                        if (_partitions.count == _partitions.size) {
+                                _partitions.size = _partitions.size ? _partitions.size * 2 : 64;
+                                RESIZE(_partitions.list, _partitions.size * sizeof(Partition_T));
+                        }
+                        _partitions.list[_partitions.count++] = (Partition_T){.cgroup = cgroup, .first = k, .count = 1};
+                }
+        }
+}
+
+
+/**
+ * Find the process of the cgroup scoped service in the partitions matching the scope. If the service has the
+ * pattern, the oldest matching process is selected, otherwise the oldest process whose parent is out of the scope
+ * (such as the container's init process)
+ * @return The process index or -1 if not found
+ */
+static int _matchScope(Service_T s) {
+        int found = -1;
+        for (int k = 0; k < _partitions.count; k++) {
+                if (Cgroup_match(_partitions.list[k].cgroup, s->cgroup)) {
+                        for (int p = _partitions.list[k].first; p < _partitions.list[k].first + _partitions.list[k].count; p++) {
+                                int i = _partitions.process[p];
+                                if ((found == -1 || ptree[found].uptime < ptree[i].uptime) && (s->matchlist ? _matchProcess(s->matchlist->regex_comp, i) : (i == ptree[i].parent || ! Cgroup_match(ptree[ptree[i].parent].cgroup, s->cgroup))))
+                                        found = i;
+                        }
+                }
+        }
+        return found;
+}
+
+
 static int _match(regex_t *regex) {
         int found = -1;
         // Scan the whole process tree and find the oldest matching process whose parent doesn't match the pattern
         for (int i = 0; i < ptreesize; i++)
-                if (ptree[i].cmdline && regexec(regex, ptree[i].cmdline, 0, NULL, 0) == 0 && (i == ptree[i].parent || ! ptree[ptree[i].parent].cmdline || regexec(regex, ptree[ptree[i].parent].cmdline, 0, NULL, 0) != 0) && (found == -1 || ptree[found].uptime < ptree[i].uptime))
+                if (_matchProcess(regex, i) && (found == -1 || ptree[found].uptime < ptree[i].uptime))
                         found = i;
         return found >= 0 ? ptree[found].pid : -1;
 }
 
 
-/* ------------------------------------------------------------------ Public */
+static bool _isRunning(pid_t pid) {
+        if (Run.procfs) {
+                // The processes of the procfs root (such as the host's /proc mounted in a container or a snapshot) may not be visible to kill(2)
+                char path[PATH_MAX];
+                snprintf(path, sizeof(path), "%s/%d", Run.procfs, pid);
+                return pid > 0 && access(path, F_OK) == 0;
+        }
+        errno = 0;
+        return pid > 0 && (getpgid(pid) > -1 || errno == EPERM);
+}
 
 
 /**
- * Initialize the process tree
- * @return treesize >= 0 if succeeded otherwise < 0
+ * Test if the process of the service is running. The process of the cgroup scoped service must be in the scope,
+ * the PID may have been reused by another container's process
  */
-int ProcessTree_init(ProcessEngine_Flags pflags) {
+static bool _isServiceRunning(Service_T s, pid_t pid) {
+        if (! _isRunning(pid))
+                return false;
+        if (s->cgroup) {
+                char cgroup[PATH_MAX];
+                return Cgroup_path(pid, cgroup, sizeof(cgroup)) && Cgroup_match(cgroup, s->cgroup);
+        }
+        return true;
+}
+
+
+#ifdef LINUX
+/**
+ * Get the start time of the running process (the field 22 of /proc/<pid>/stat, clock ticks since boot)
+ * @return The start time or 0 if not available
+ */
+static unsigned long long _startTime(pid_t pid) {
+        char path[PATH_MAX], buf[STRLEN];
+        snprintf(path, sizeof(path), "%s/%d/stat", Run.procfs ? Run.procfs : "/proc", pid);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return 0;
+        ssize_t n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (n <= 0)
+                return 0;
+        buf[n] = 0;
+        // Skip the process name (can contain spaces and parentheses), the state is the field 3
+        unsigned long long starttime;
+        const char *fields = strrchr(buf, ')');
+        if (! fields || sscanf(fields + 1, " %*c" " %*s %*s %*s %*s %*s %*s %*s %*s %*s" " %*s %*s %*s %*s %*s %*s %*s %*s %*s" " %llu", &starttime) != 1)
+                return 0;
+        return starttime;
+}
+#endif
+
+
+/**
+ * Test if the process found in the process tree is still running: the process may have exited since the process tree was collected and its PID may have been
+ * reused by another process. The process is identified by the PID and the start time, if the system provides it
+ */
+static bool _isSameProcess(pid_t pid) {
+        if (! _isRunning(pid))
+                return false;
+#ifdef LINUX
+        int leaf = _findProcess(pid, &ptreeindex, ptree);
+        if (leaf >= 0 && ptree[leaf].starttime && _startTime(pid) != ptree[leaf].starttime)
+                return false;
+#endif
+        return true;
+}
+
+
+/**
+ * Get the literal of the match result pattern for the prefilter. The literals shorter than MATCHER_LITERAL_MIN
+ * are found in most command lines, such patterns are evaluated for each process without the prefilter
+ */
+static char *_matcherLiteral(int j) {
+        char *literal = LiteralMatch_literal(_matches.list[j].pattern);
+        if (literal && strlen(literal) < MATCHER_LITERAL_MIN)
+                FREE(literal);
+        return literal;
+}
+
+
+/**
+ * Add the literals of the match results to the prefilter. The results without literal are moved to the front,
+ * the literal k of the prefilter belongs to the result always + k
+ * @return The number of results without literal (always)
+ */
+static int _matcherBuild(LiteralMatch_T matcher) {
+        int always = 0;
+        for (int j = 0; j < _matches.count; j++) {
+                char *literal = _matcherLiteral(j);
+                if (literal) {
+                        FREE(literal);
+                } else {
+                        ProcessMatch_T result = _matches.list[always];
+                        _matches.list[always++] = _matches.list[j];
+                        _matches.list[j] = result;
+                }
+        }
+        for (int j = always; j < _matches.count; j++) {
+                char *literal = _matcherLiteral(j);
+                LiteralMatch_add(matcher, literal);
+                FREE(literal);
+        }
+        return always;
+}
+
+
+static void _matchCandidate(int j, int i) {
+        int found = _matches.list[j].found;
+        if ((found == -1 || ptree[found].uptime < ptree[i].uptime) && _matchProcess(_matches.list[j].regex, i))
+                _matches.list[j].found = i;
+}
+
+
+static void _matchAdd(Service_T s, int found) {
+        if (_matches.count == _matches.size) {
+                _matches.size = _matches.size ? _matches.size * 2 : 8;
+                RESIZE(_matches.list, _matches.size * sizeof(ProcessMatch_T));
+        }
+        _matches.list[_matches.count++] = (ProcessMatch_T){.service = s, .pattern = s->matchlist ? s->matchlist->match_string : NULL, .regex = s->matchlist ? s->matchlist->regex_comp : NULL, .found = found};
+}
+
+
+/**
+ * Match all process services, whose cached PID is not running, against the process tree in one pass. The
+ * regular expression is evaluated only if the command line contains the literal required by the pattern.
+ * The cgroup scoped services are matched against the processes of their partitions only
+ */
+static void _matchPending() {
+        _matches.count = 0;
+        for (Service_T s = servicelist; s; s = s->next)
+                if (s->type == Service_Process && s->matchlist && ! s->cgroup && ! _isRunning(s->inf.process->pid))
+                        _matchAdd(s, -1);
+        if (_matches.count) {
+                LiteralMatch_T matcher = LiteralMatch_new();
+                int always = _matcherBuild(matcher);
+                for (int i = 0; i < ptreesize; i++) {
+                        if (ptree[i].cmdline) {
+                                for (int j = 0; j < always; j++)
+                                        _matchCandidate(j, i);
+                                for (int k = 0, found = LiteralMatch_scan(matcher, ptree[i].cmdline); k < found; k++)
+                                        _matchCandidate(always + LiteralMatch_found(matcher, k), i);
+                        }
+                }
+                LiteralMatch_free(&matcher);
+        }
+        for (Service_T s = servicelist; s; s = s->next)
+                if (s->type == Service_Process && s->cgroup && ! _isServiceRunning(s, s->inf.process->pid))
+                        _matchAdd(s, _matchScope(s));
+}
+
+
+static int _comparePid(const void *a, const void *b) {
+        pid_t x = *(const pid_t *)a, y = *(const pid_t *)b;
+        return x < y ? -1 : x > y;
+}
+
+
+static void _monitoredAdd(pid_t pid) {
+        if (pid > 0) {
+                if (_monitored.count == _monitored.size) {
+                        _monitored.size = _monitored.size ? _monitored.size * 2 : 64;
+                        RESIZE(_monitored.list, _monitored.size * sizeof(pid_t));
+                }
+                _monitored.list[_monitored.count++] = pid;
+        }
+}
+
+
+/**
+ * Collect the PIDs of the monitored processes and the process engine flags required by the rules
+ * @return The process engine flags
+ */
+static ProcessEngine_Flags _monitoredInit() {
+        ProcessEngine_Flags pflags = ProcessEngine_None;
+        _monitored.count = 0;
+        for (Service_T s = servicelist; s; s = s->next) {
+                if (s->type == Service_Process) {
+                        _monitoredAdd(s->inf.process->pid);
+                        // The process may have been restarted => use the actual PID from the pidfile as well
+                        if (! s->matchlist && ! s->cgroup && s->path)
+                                _monitoredAdd(Util_getPid(s->path));
+                        if (s->filedescriptorslist)
+                                pflags |= ProcessEngine_CollectFiledescriptors;
+                        if (s->cgroup)
+                                pflags |= ProcessEngine_CollectCgroup;
+                        for (Resource_T r = s->resourcelist; r; r = r->next) {
+                                if (r->resource_id == Resource_ReadBytesPhysical || r->resource_id == Resource_WriteBytesPhysical)
+                                        pflags |= ProcessEngine_CollectPhysicalIO;
+                                else if (r->resource_id >= Resource_Connections && r->resource_id <= Resource_TcpReceived)
+                                        pflags |= ProcessEngine_CollectConnections;
+                                else if (r->resource_id == Resource_IoDelay)
+                                        pflags |= ProcessEngine_CollectDelay;
+                                else if (r->resource_id == Resource_CpuPercentThread)
+                                        pflags |= ProcessEngine_CollectThreads;
+                                else if (r->resource_id == Resource_MemoryPss || r->resource_id == Resource_MemoryUss)
+                                        pflags |= ProcessEngine_CollectSmaps;
+                        }
+                }
+        }
+        if (_monitored.count > 1)
+                qsort(_monitored.list, _monitored.count, sizeof(pid_t), _comparePid);
+        return pflags;
+}
+
+
+/**
+ * Get the PID of the process matching the service pattern. The result of the shared pass is used if available
+ */
+static int _matchService(Service_T s) {
+        for (int i = 0; i < _matches.count; i++)
+                if (_matches.list[i].service == s)
+                        return _matches.list[i].found >= 0 ? ptree[_matches.list[i].found].pid : -1;
+        if (s->cgroup) {
+                int found = _matchScope(s);
+                return found >= 0 ? ptree[found].pid : -1;
+        }
+        return _match(s->matchlist->regex_comp);
+}
+
+
+static int _init(ProcessEngine_Flags pflags) {
         ProcessTree_T *oldptree = ptree;
         int oldptreesize = ptreesize;
+        ProcessIndex_T oldindex = ptreeindex;
+        ptreeindex = (ProcessIndex_T){};
+        _matches.count = 0;
+        _partitions.count = 0;
+        _matches.collected = pflags & ProcessEngine_CollectCommandLine;
+        _matches.time = Time_milli();
+        pflags |= _monitoredInit();
+        // Collect the details of all processes only if the tree is scanned for any process (command line match), otherwise just the monitored subtrees
+        if (! (pflags & ProcessEngine_CollectCommandLine))
+                pflags |= ProcessEngine_CollectMonitoredOnly;
         if (oldptree) {
                 ptree = NULL;
                 ptreesize = 0;
-                // We need only process's cpu.time from the old ptree, so free dynamically allocated parts which we don't need before initializing new ptree (so the memory can be reused, otherwise the memory footprint will hold two ptrees)
-                for (int i = 0; i < oldptreesize; i++) {
-                        FREE(oldptree[i].cmdline);
-                        FREE(oldptree[i].children.list);
-                        FREE(oldptree[i].secattr);
-                }
         }
+        // We need only process's cpu.time from the old ptree, so the string arena is reused for the new ptree right away (the old cmdline and secattr pointers must not be used)
+        _stringsReset();
 
         systeminfo.time_prev = systeminfo.time;
         systeminfo.time = Time_milli() / 100.;
@@ -226,23 +712,32 @@ int ProcessTree_init(ProcessEngine_Flags pflags) {
                 Run.flags &= ~Run_ProcessEngineEnabled;
                 if (oldptree)
                         _delete(&oldptree, &oldptreesize);
+                _indexFree(&oldindex);
                 return -1;
         } else if (! (Run.flags & Run_ProcessEngineEnabled)) {
                 DEBUG("System statistic -- initialization of the process tree succeeded -- process resource monitoring enabled\n");
                 Run.flags |= Run_ProcessEngineEnabled;
         }
 
+        _indexInit(&ptreeindex, ptreesize);
+        for (int i = 0; i < ptreesize; i++)
+                _indexAdd(&ptreeindex, ptree, i);
+
         int root = -1; // Main process. Not all systems have main process with PID 1 (such as Solaris zones and FreeBSD jails), so we try to find process which is parent of itself
         ProcessTree_T *pt = ptree;
         double time_delta = systeminfo.time - systeminfo.time_prev;
         for (int i = 0; i < (volatile int)ptreesize; i ++) {
                 pt[i].cpu.usage.self = -1;
                 if (oldptree) {
-                        int oldentry = _findProcess(pt[i].pid, oldptree, oldptreesize);
+                        int oldentry = _findProcess(pt[i].pid, &oldindex, oldptree);
                         if (oldentry != -1) {
                                 if (systeminfo.cpu.count > 0 && time_delta > 0 && oldptree[oldentry].cpu.time >= 0 && pt[i].cpu.time >= oldptree[oldentry].cpu.time) {
                                         pt[i].cpu.usage.self = 100. * (pt[i].cpu.time - oldptree[oldentry].cpu.time) / time_delta;
                                 }
+                                if (pt[i].tcp.delta && oldptree[oldentry].tcp.delta) {
+                                        pt[i].tcp.sent += oldptree[oldentry].tcp.sent;
+                                        pt[i].tcp.received += oldptree[oldentry].tcp.received;
+                                }
                         }
                 }
                 // Note: on DragonFly, main process is swapper with pid 0 and ppid -1, so take also this case into consideration
@@ -250,7 +745,7 @@ int ProcessTree_init(ProcessEngine_Flags pflags) {
                         root = pt[i].parent = i;
                 } else {
                         // Find this process's parent
-                        int parent = _findProcess(pt[i].ppid, pt, ptreesize);
+                        int parent = _findProcess(pt[i].ppid, &ptreeindex, pt);
                         if (parent == -1) {
                                 /* Parent process wasn't found - on Linux this is normal: main process with PID 0 is not listed, similarly in FreeBSD jail.
                                  * We create virtual process entry for missing parent so we can have full tree-like structure with root. */
@@ -258,32 +753,151 @@ int ProcessTree_init(ProcessEngine_Flags pflags) {
                                 pt = RESIZE(ptree, ptreesize * sizeof(ProcessTree_T));
                                 memset(&pt[parent], 0, sizeof(ProcessTree_T));
                                 root = pt[parent].ppid = pt[parent].pid = pt[i].ppid;
+                                _indexAdd(&ptreeindex, pt, parent);
                         }
                         pt[i].parent = parent;
-                        // Connect the child (this process) to the parent
-                        RESIZE(pt[parent].children.list, sizeof(int) * (pt[parent].children.count + 1));
-                        pt[parent].children.list[pt[parent].children.count] = i;
+                        // Count the child (this process), the children lists are connected in _compact()
                         pt[parent].children.count++;
                 }
         }
-        FREE(oldptree); // Free the rest of old ptree
+        FREE(oldptree);
+        _indexFree(&oldindex);
         if (root == -1) {
                 DEBUG("System statistic error -- cannot find root process id\n");
                 _delete(&ptree, &ptreesize);
+                _indexFree(&ptreeindex);
                 return -1;
         }
+        ptree = pt = _compact(pt, ptreesize);
+
+        _fillProcessTree(pt, ptreesize);
 
-        _fillProcessTree(pt, root);
+        if ((pflags & ProcessEngine_CollectCommandLine) && (pflags & ProcessEngine_CollectCgroup))
+                _partitionInit();
 
         return ptreesize;
 }
 
 
+/**
+ * Replace the subtree totals and the physical I/O of the process by the statistics of its cgroup
+ */
+static void _updateCgroup(Service_T s, ProcessTree_T *pt, CgroupStatistics_T *cgroup) {
+        ProcessInfo_T info = s->inf.process;
+        if (info->cgroup.time > 0 && cgroup->time > info->cgroup.time && cgroup->cpu >= info->cgroup.cpu) {
+                // The cpu time is in microseconds and the timestamp in milliseconds => 100% = 1000us per 1ms
+                float usage = (float)(cgroup->cpu - info->cgroup.cpu) / (float)(cgroup->time - info->cgroup.time) / 10.;
+                info->total_cpu_percent = _cpuUsage(usage, pt->threads.self + pt->threads.children);
+                if (info->total_cpu_percent > 100.)
+                        info->total_cpu_percent = 100.;
+        } else {
+                info->total_cpu_percent = -1;
+        }
+        info->cgroup.time = cgroup->time;
+        info->cgroup.cpu = cgroup->cpu;
+        info->total_mem = cgroup->memory;
+        if (systeminfo.memory.size > 0)
+                info->total_mem_percent = cgroup->memory >= systeminfo.memory.size ? 100. : (100. * (double)cgroup->memory / (double)systeminfo.memory.size);
+        if (cgroup->read.bytes >= 0)
+                Statistics_update(&(info->read.bytesPhysical), cgroup->time, cgroup->read.bytes);
+        if (cgroup->write.bytes >= 0)
+                Statistics_update(&(info->write.bytesPhysical), cgroup->time, cgroup->write.bytes);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+/**
+ * Initialize the process tree. The tree is shared by the validation workers,
+ * so the rebuild is serialized
+ * @return treesize >= 0 if succeeded otherwise < 0
+ */
+int ProcessTree_init(ProcessEngine_Flags pflags) {
+        int rv;
+        LOCK(_mutex)
+        {
+                PROBE0(processtree__start);
+                rv = _init(pflags);
+                PROBE1(processtree__done, rv);
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+/**
+ * Rebuild the process tree with the command lines unless the tree holds
+ * the command lines collected within the given age. The concurrent waits
+ * for the process start share the scan
+ * @return treesize >= 0 if succeeded otherwise < 0
+ */
+int ProcessTree_refresh(int age) {
+        int rv;
+        LOCK(_mutex)
+        {
+                if (_matches.collected && Time_milli() - _matches.time < age)
+                        rv = ptreesize;
+                else
+                        rv = _init(ProcessEngine_CollectCommandLine);
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+char *ProcessTree_strdup(const char *s) {
+        return s ? ProcessTree_strndup(s, strlen(s)) : NULL;
+}
+
+
+char *ProcessTree_strndup(const char *s, size_t length) {
+        ASSERT(s);
+        char *copy;
+        length = strnlen(s, length);
+        LOCK(_strings.mutex)
+        {
+                copy = _stringsCopy(s, length);
+        }
+        END_LOCK;
+        return copy;
+}
+
+
+bool ProcessTree_isMonitored(pid_t pid) {
+        return bsearch(&pid, _monitored.list, _monitored.count, sizeof(pid_t), _comparePid) != NULL;
+}
+
+
 /**
  * Delete the process tree
  */
 void ProcessTree_delete() {
-        _delete(&ptree, &ptreesize);
+        LOCK(_mutex)
+        {
+                _delete(&ptree, &ptreesize);
+                _indexFree(&ptreeindex);
+                _stringsFree();
+                _matches.count = 0;
+                _matches.collected = false;
+                FREE(_matches.list);
+                _matches.size = 0;
+                FREE(_partitions.list);
+                FREE(_partitions.process);
+                ProcessSocket_free();
+                ProcessTaskstats_free();
+                _partitions.size = _partitions.processSize = _partitions.count = 0;
+        }
+        END_LOCK;
+}
+
+
+void ProcessTree_resetMatches() {
+        LOCK(_mutex)
+        {
+                _matches.count = 0;
+        }
+        END_LOCK;
 }
 
 
@@ -294,82 +908,142 @@ bool ProcessTree_updateProcess(Service_T s, pid_t pid) {
         s->inf.process->_pid = s->inf.process->pid;
         s->inf.process->pid  = pid;
 
-        int leaf = _findProcess(pid, ptree, ptreesize);
-        if (leaf != -1) {
-                /* save the previous ppid and set actual one */
-                s->inf.process->_ppid             = s->inf.process->ppid;
-                s->inf.process->ppid              = ptree[leaf].ppid;
-                s->inf.process->uid               = ptree[leaf].cred.uid;
-                s->inf.process->euid              = ptree[leaf].cred.euid;
-                s->inf.process->gid               = ptree[leaf].cred.gid;
-                s->inf.process->uptime            = ptree[leaf].uptime;
-                s->inf.process->threads           = ptree[leaf].threads.self;
-                s->inf.process->children          = ptree[leaf].children.total;
-                s->inf.process->zombie            = ptree[leaf].zombie;
-                snprintf(s->inf.process->secattr, STRLEN, "%s", NVLSTR(ptree[leaf].secattr));
-                if (ptree[leaf].cpu.usage.self >= 0) {
-                        // compute only if initialized (delta between current and previous snapshot is available)
-                        s->inf.process->cpu_percent = _cpuUsage(ptree[leaf].cpu.usage.self, ptree[leaf].threads.self);
-                        s->inf.process->total_cpu_percent = s->inf.process->cpu_percent + _cpuUsage(ptree[leaf].cpu.usage.children, ptree[leaf].threads.children);
-                        if (s->inf.process->total_cpu_percent > 100.) {
-                                s->inf.process->total_cpu_percent = 100.;
+        bool found = false;
+        CgroupStatistics_T cgroup;
+        // The totals of the cgroup scoped service are confined to its cgroup as well
+        bool cgroupAvailable = (s->cgroupAccounting || s->cgroup) && Cgroup_statistics(pid, &cgroup);
+        LOCK(_mutex)
+        {
+                int leaf = _findProcess(pid, &ptreeindex, ptree);
+                if (leaf != -1) {
+                        found = true;
+                        /* save the previous ppid and set actual one */
+                        s->inf.process->_ppid             = s->inf.process->ppid;
+                        s->inf.process->ppid              = ptree[leaf].ppid;
+                        s->inf.process->uid               = ptree[leaf].cred.uid;
+                        s->inf.process->euid              = ptree[leaf].cred.euid;
+                        s->inf.process->gid               = ptree[leaf].cred.gid;
+                        s->inf.process->uptime            = ptree[leaf].uptime;
+                        s->inf.process->threads           = ptree[leaf].threads.self;
+                        s->inf.process->children          = ptree[leaf].children.total;
+                        s->inf.process->zombie            = ptree[leaf].zombie;
+                        snprintf(s->inf.process->secattr, STRLEN, "%s", NVLSTR(ptree[leaf].secattr));
+                        if (ptree[leaf].cpu.usage.self >= 0) {
+                                // compute only if initialized (delta between current and previous snapshot is available)
+                                s->inf.process->cpu_percent = _cpuUsage(ptree[leaf].cpu.usage.self, ptree[leaf].threads.self);
+                                s->inf.process->total_cpu_percent = s->inf.process->cpu_percent + _cpuUsage(ptree[leaf].cpu.usage.children, ptree[leaf].threads.children);
+                                if (s->inf.process->total_cpu_percent > 100.) {
+                                        s->inf.process->total_cpu_percent = 100.;
+                                }
+                        } else {
+                                s->inf.process->cpu_percent = -1;
+                                s->inf.process->total_cpu_percent = -1;
                         }
-                } else {
-                        s->inf.process->cpu_percent = -1;
-                        s->inf.process->total_cpu_percent = -1;
-                }
-                s->inf.process->mem               = ptree[leaf].memory.usage;
-                s->inf.process->total_mem         = ptree[leaf].memory.usage_total;
-                s->inf.process->filedescriptors.open        = ptree[leaf].filedescriptors.usage;
-                s->inf.process->filedescriptors.openTotal   = ptree[leaf].filedescriptors.usage_total;
-                s->inf.process->filedescriptors.limit.soft  = ptree[leaf].filedescriptors.limit.soft;
-                s->inf.process->filedescriptors.limit.hard  = ptree[leaf].filedescriptors.limit.hard;
-                if (systeminfo.memory.size > 0) {
-                        s->inf.process->total_mem_percent = ptree[leaf].memory.usage_total >= systeminfo.memory.size ? 100. : (100. * (double)ptree[leaf].memory.usage_total / (double)systeminfo.memory.size);
-                        s->inf.process->mem_percent       = ptree[leaf].memory.usage >= systeminfo.memory.size ? 100. : (100. * (double)ptree[leaf].memory.usage / (double)systeminfo.memory.size);
+#ifdef LINUX
+                        s->inf.process->thread_cpu_percent = ptree[leaf].threads.cpu;
+                        s->inf.process->pss = ptree[leaf].memory.pss;
+                        s->inf.process->uss = ptree[leaf].memory.uss;
+#endif
+                        s->inf.process->mem               = ptree[leaf].memory.usage;
+                        s->inf.process->total_mem         = ptree[leaf].memory.usage_total;
+                        s->inf.process->filedescriptors.open        = ptree[leaf].filedescriptors.usage;
+                        s->inf.process->filedescriptors.openTotal   = ptree[leaf].filedescriptors.usage_total;
+                        s->inf.process->filedescriptors.limit.soft  = ptree[leaf].filedescriptors.limit.soft;
+                        s->inf.process->filedescriptors.limit.hard  = ptree[leaf].filedescriptors.limit.hard;
+                        if (systeminfo.memory.size > 0) {
+                                s->inf.process->total_mem_percent = ptree[leaf].memory.usage_total >= systeminfo.memory.size ? 100. : (100. * (double)ptree[leaf].memory.usage_total / (double)systeminfo.memory.size);
+                                s->inf.process->mem_percent       = ptree[leaf].memory.usage >= systeminfo.memory.size ? 100. : (100. * (double)ptree[leaf].memory.usage / (double)systeminfo.memory.size);
+                        }
+                        if (ptree[leaf].read.bytes >= 0)
+                                Statistics_update(&(s->inf.process->read.bytes), ptree[leaf].read.time, ptree[leaf].read.bytes);
+                        if (ptree[leaf].read.bytesPhysical >= 0 && ! cgroupAvailable)
+                                Statistics_update(&(s->inf.process->read.bytesPhysical), ptree[leaf].read.time, ptree[leaf].read.bytesPhysical);
+                        if (ptree[leaf].read.operations >= 0)
+                                Statistics_update(&(s->inf.process->read.operations), ptree[leaf].read.time, ptree[leaf].read.operations);
+                        if (ptree[leaf].write.bytes >= 0)
+                                Statistics_update(&(s->inf.process->write.bytes), ptree[leaf].write.time, ptree[leaf].write.bytes);
+                        if (ptree[leaf].write.bytesPhysical >= 0 && ! cgroupAvailable)
+                                Statistics_update(&(s->inf.process->write.bytesPhysical), ptree[leaf].write.time, ptree[leaf].write.bytesPhysical);
+                        if (ptree[leaf].write.operations >= 0)
+                                Statistics_update(&(s->inf.process->write.operations), ptree[leaf].write.time, ptree[leaf].write.operations);
+                        if (ptree[leaf].tcp.time) {
+                                // The total may restart from zero if the counters source changed or the previous scan skipped the process
+                                if (Statistics_initialized(&(s->inf.process->tcp.sent)) && (ptree[leaf].tcp.sent < (long long)Statistics_raw(&(s->inf.process->tcp.sent)) || ptree[leaf].tcp.received < (long long)Statistics_raw(&(s->inf.process->tcp.received)))) {
+                                        Statistics_reset(&(s->inf.process->tcp.sent));
+                                        Statistics_reset(&(s->inf.process->tcp.received));
+                                }
+                                Statistics_update(&(s->inf.process->tcp.sent), ptree[leaf].tcp.time, ptree[leaf].tcp.sent);
+                                Statistics_update(&(s->inf.process->tcp.received), ptree[leaf].tcp.time, ptree[leaf].tcp.received);
+                        }
+                        if (ptree[leaf].delay.time) {
+                                // The delay of the restarted process starts from zero
+                                if (Statistics_initialized(&(s->inf.process->ioDelay)) && ptree[leaf].delay.io < Statistics_raw(&(s->inf.process->ioDelay)))
+                                        Statistics_reset(&(s->inf.process->ioDelay));
+                                Statistics_update(&(s->inf.process->ioDelay), ptree[leaf].delay.time, ptree[leaf].delay.io);
+                        }
+                        if (ptree[leaf].connections.time) {
+                                s->inf.process->connections.total = ptree[leaf].connections.total;
+                                s->inf.process->connections.established = ptree[leaf].connections.established;
+                                s->inf.process->connections.listen = ptree[leaf].connections.listen;
+                                s->inf.process->connections.closeWait = ptree[leaf].connections.closeWait;
+                        } else {
+                                s->inf.process->connections.total = s->inf.process->connections.established = s->inf.process->connections.listen = s->inf.process->connections.closeWait = -1;
+                        }
+                        if (cgroupAvailable)
+                                _updateCgroup(s, &ptree[leaf], &cgroup);
                 }
-                if (ptree[leaf].read.bytes >= 0)
-                        Statistics_update(&(s->inf.process->read.bytes), ptree[leaf].read.time, ptree[leaf].read.bytes);
-                if (ptree[leaf].read.bytesPhysical >= 0)
-                        Statistics_update(&(s->inf.process->read.bytesPhysical), ptree[leaf].read.time, ptree[leaf].read.bytesPhysical);
-                if (ptree[leaf].read.operations >= 0)
-                        Statistics_update(&(s->inf.process->read.operations), ptree[leaf].read.time, ptree[leaf].read.operations);
-                if (ptree[leaf].write.bytes >= 0)
-                        Statistics_update(&(s->inf.process->write.bytes), ptree[leaf].write.time, ptree[leaf].write.bytes);
-                if (ptree[leaf].write.bytesPhysical >= 0)
-                        Statistics_update(&(s->inf.process->write.bytesPhysical), ptree[leaf].write.time, ptree[leaf].write.bytesPhysical);
-                if (ptree[leaf].write.operations >= 0)
-                        Statistics_update(&(s->inf.process->write.operations), ptree[leaf].write.time, ptree[leaf].write.operations);
-                return true;
         }
+        END_LOCK;
+        if (found)
+                return true;
         Util_resetInfo(s);
         return false;
 }
 
 
 time_t ProcessTree_getProcessUptime(pid_t pid) {
-        if (ptree) {
-                int leaf = _findProcess(pid, ptree, ptreesize);
-                return (time_t)((leaf >= 0 && leaf < ptreesize) ? ptree[leaf].uptime : -1);
+        time_t uptime = 0;
+        LOCK(_mutex)
+        {
+                if (ptree) {
+                        int leaf = _findProcess(pid, &ptreeindex, ptree);
+                        uptime = (time_t)((leaf >= 0 && leaf < ptreesize) ? ptree[leaf].uptime : -1);
+                }
         }
-        return 0;
+        END_LOCK;
+        return uptime;
 }
 
 
 pid_t ProcessTree_findProcess(Service_T s) {
         ASSERT(s);
         // Test the cached PID first
-        if (s->inf.process->pid > 0) {
-                errno = 0;
-                if (getpgid(s->inf.process->pid) > -1 || errno == EPERM)
-                        return s->inf.process->pid;
-        }
+        if (_isServiceRunning(s, s->inf.process->pid))
+                return s->inf.process->pid;
         // If the cached PID is not running, scan for the process again
-        if (s->matchlist) {
-                // Update the process tree including command line
-                ProcessTree_init(ProcessEngine_CollectCommandLine);
+        if (s->matchlist || s->cgroup) {
+                int pid = -1;
+                LOCK(_mutex)
+                {
+                        // Update the process tree including command line once and match all services which lost the process
+                        if (! _matches.collected) {
+                                _init(ProcessEngine_CollectCommandLine);
+                                if (Run.flags & Run_ProcessEngineEnabled)
+                                        _matchPending();
+                        }
+                        if (Run.flags & Run_ProcessEngineEnabled && (pid = _matchService(s)) > 0 && ! _isSameProcess(pid)) {
+                                // The shared match result is stale, the process exited since the process tree was collected
+                                DEBUG("'%s' the matching process %d exited, collecting the process tree again\n", s->name, pid);
+                                _init(ProcessEngine_CollectCommandLine);
+                                pid = -1;
+                                if (Run.flags & Run_ProcessEngineEnabled) {
+                                        _matchPending();
+                                        pid = _matchService(s);
+                                }
+                        }
+                }
+                END_LOCK;
                 if (Run.flags & Run_ProcessEngineEnabled) {
-                        int pid = _match(s->matchlist->regex_comp);
                         if (pid >= 0)
                                 return pid;
                 } else {
@@ -380,8 +1054,7 @@ pid_t ProcessTree_findProcess(Service_T s) {
         } else {
                 pid_t pid = Util_getPid(s->path);
                 if (pid > 0) {
-                        errno = 0;
-                        if (getpgid(pid) > -1 || errno == EPERM)
+                        if (_isRunning(pid))
                                 return pid;
                         DEBUG("'%s' process test failed [pid=%d] -- %s\n", s->name, pid, STRERROR);
                 }
@@ -416,7 +1089,9 @@ void ProcessTree_testMatch(char *pattern) {
                                 {.name = "Command", .width = 50, .wrap = true,  .align = BoxAlign_Left}
                           }, true);
                 // Select the process matching the pattern
+                long long start = Time_micro();
                 int pid = _match(regex_comp);
+                long long elapsed = Time_micro() - start;
                 // Print all matching processes and highlight the one which is selected
                 for (int i = 0; i < ptreesize; i++) {
                         if (ptree[i].cmdline && ! strstr(ptree[i].cmdline, "procmatch")) {
@@ -441,7 +1116,7 @@ void ProcessTree_testMatch(char *pattern) {
                         Color_strip(Box_strip((char *)StringBuffer_toString(output)));
                 printf("%s", StringBuffer_toString(output));
                 StringBuffer_free(&output);
-                printf("Total matches: %d\n", count);
+                printf("Total matches: %d (the process selection took %.3f ms)\n", count, elapsed / 1000.);
                 if (count > 1)
                         printf("\n"
                                "WARNING:\n"
@@ -453,6 +1128,224 @@ void ProcessTree_testMatch(char *pattern) {
 }
 
 
+/**
+ * The procmatch batch result of one pattern
+ */
+typedef struct MatchSet_T {
+        char *pattern;
+        regex_t regex;
+        bool valid;
+        int selected;            /**< The process which the service would select or -1 */
+        int evaluations;                     /**< Number of the regex evaluations */
+        long long time;                        /**< Time of the evaluations [us] */
+        int count;
+        int size;
+        int *process;                        /**< Indices of the matching processes */
+} MatchSet_T;
+
+
+/**
+ * Evaluate the pattern of the batch match result j for the process i and record the match. The process
+ * selection is the same as for the service: the matching process whose parent doesn't match and with the
+ * highest uptime
+ */
+static void _matchBatch(MatchSet_T *sets, int j, int i) {
+        MatchSet_T *set = &sets[_matches.list[j].id];
+        long long start = Time_micro();
+        bool matched = regexec(&set->regex, ptree[i].cmdline, 0, NULL, 0) == 0;
+        bool selectable = matched && (i == ptree[i].parent || ! ptree[ptree[i].parent].cmdline || regexec(&set->regex, ptree[ptree[i].parent].cmdline, 0, NULL, 0) != 0);
+        set->time += Time_micro() - start;
+        set->evaluations++;
+        if (matched) {
+                if (set->count == set->size) {
+                        set->size = set->size ? set->size * 2 : 8;
+                        RESIZE(set->process, set->size * sizeof(int));
+                }
+                set->process[set->count++] = i;
+                if (selectable && (set->selected == -1 || ptree[set->selected].uptime < ptree[i].uptime))
+                        set->selected = i;
+        }
+}
+
+
+static double _topKey(ProcessTree_T *pt, ProcessSort_Type sort) {
+        switch (sort) {
+                case ProcessSort_Memory:
+                        return pt->memory.usage;
+                case ProcessSort_Threads:
+                        return pt->threads.self;
+                case ProcessSort_Files:
+                        return pt->filedescriptors.usage;
+                default:
+                        return pt->cpu.usage.self;
+        }
+}
+
+
+static int _compareTop(const void *a, const void *b) {
+        const TopEntry_T *x = a, *y = b;
+        if (x->key != y->key)
+                return x->key < y->key ? 1 : -1;
+        return x->index - y->index;
+}
+
+
+/**
+ * Move the k entries with the highest key to the front of the array, unordered (quickselect)
+ */
+static void _topSelect(TopEntry_T *e, int n, int k) {
+        int left = 0, right = n - 1;
+        while (left < right) {
+                double pivot = e[left + (right - left) / 2].key;
+                int i = left, j = right;
+                while (i <= j) {
+                        while (e[i].key > pivot)
+                                i++;
+                        while (e[j].key < pivot)
+                                j--;
+                        if (i <= j) {
+                                TopEntry_T t = e[i];
+                                e[i++] = e[j];
+                                e[j--] = t;
+                        }
+                }
+                // The entries up to j are >= pivot, the entries from i are <= pivot, the entries between them equal the pivot
+                if (k - 1 <= j)
+                        right = j;
+                else if (k - 1 >= i)
+                        left = i;
+                else
+                        break;
+        }
+}
+
+
+int ProcessTree_top(ProcessSort_Type sort, int limit, ProcessTree_Visitor visitor, void *context) {
+        ASSERT(visitor);
+        int rv = -1;
+        LOCK(_mutex)
+        {
+                if (ptree && ptreesize > 0) {
+                        rv = ptreesize;
+                        TopEntry_T *e = CALLOC(ptreesize, sizeof(TopEntry_T));
+                        for (int i = 0; i < ptreesize; i++) {
+                                e[i].key = _topKey(&ptree[i], sort);
+                                e[i].index = i;
+                        }
+                        int count = MIN(MAX(limit, 0), ptreesize);
+                        if (count > 0) {
+                                _topSelect(e, ptreesize, count);
+                                qsort(e, count, sizeof(TopEntry_T), _compareTop);
+                        }
+                        for (int i = 0; i < count; i++)
+                                visitor(&ptree[e[i].index], context);
+                        FREE(e);
+                }
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+bool ProcessTree_testMatchFile(const char *file) {
+        ASSERT(file);
+        FILE *f = IS(file, "-") ? stdin : fopen(file, "r");
+        if (! f) {
+                printf("Cannot read the patterns from %s -- %s\n", file, STRERROR);
+                return false;
+        }
+        bool rv = true;
+        int count = 0, size = 0;
+        MatchSet_T *sets = NULL;
+        char line[4096];
+        while (fgets(line, sizeof(line), f)) {
+                Str_chomp(line);
+                if (! *line)
+                        continue;
+                if (count == size) {
+                        size = size ? size * 2 : 64;
+                        RESIZE(sets, size * sizeof(MatchSet_T));
+                }
+                MatchSet_T *set = &sets[count++];
+                *set = (MatchSet_T){.pattern = Str_dup(line), .selected = -1};
+                set->valid = regcomp(&set->regex, line, REG_NOSUB|REG_EXTENDED) == 0;
+                if (! set->valid)
+                        rv = false;
+        }
+        if (f != stdin)
+                fclose(f);
+        ProcessTree_init(ProcessEngine_CollectCommandLine);
+        if (! (Run.flags & Run_ProcessEngineEnabled)) {
+                printf("The process engine is not available\n");
+                rv = false;
+        } else {
+                long long elapsed = 0;
+                int processes = 0, evaluations = 0, valid = 0;
+                LOCK(_mutex)
+                {
+                        // Match all patterns in one pass over the process tree, the literal prefilter selects the patterns to evaluate for each command line
+                        long long start = Time_micro();
+                        _matches.count = 0;
+                        for (int k = 0; k < count; k++) {
+                                if (sets[k].valid) {
+                                        if (_matches.count == _matches.size) {
+                                                _matches.size = _matches.size ? _matches.size * 2 : 8;
+                                                RESIZE(_matches.list, _matches.size * sizeof(ProcessMatch_T));
+                                        }
+                                        _matches.list[_matches.count++] = (ProcessMatch_T){.pattern = sets[k].pattern, .regex = &sets[k].regex, .id = k, .found = -1};
+                                }
+                        }
+                        if ((valid = _matches.count)) {
+                                LiteralMatch_T matcher = LiteralMatch_new();
+                                int always = _matcherBuild(matcher);
+                                for (int i = 0; i < ptreesize; i++) {
+                                        if (ptree[i].cmdline && ! strstr(ptree[i].cmdline, "procmatch")) {
+                                                processes++;
+                                                for (int j = 0; j < always; j++)
+                                                        _matchBatch(sets, j, i);
+                                                for (int k = 0, found = LiteralMatch_scan(matcher, ptree[i].cmdline); k < found; k++)
+                                                        _matchBatch(sets, always + LiteralMatch_found(matcher, k), i);
+                                        }
+                                }
+                                LiteralMatch_free(&matcher);
+                        }
+                        _matches.count = 0;
+                        elapsed = Time_micro() - start;
+                        // One line per pattern: number of matches, selected PID, regex evaluations, evaluation time [us], the pattern and the matching PIDs
+                        printf("# matches\tselected\tevaluated\ttime[us]\tpattern\tpids\n");
+                        for (int k = 0; k < count; k++) {
+                                MatchSet_T *set = &sets[k];
+                                if (! set->valid) {
+                                        printf("-\t-\t-\t-\t%s\tinvalid pattern\n", set->pattern);
+                                        continue;
+                                }
+                                evaluations += set->evaluations;
+                                printf("%d\t", set->count);
+                                if (set->selected >= 0)
+                                        printf("%d\t", ptree[set->selected].pid);
+                                else
+                                        printf("-\t");
+                                printf("%d\t%lld\t%s\t", set->evaluations, set->time, set->pattern);
+                                for (int i = 0; i < set->count; i++)
+                                        printf("%s%d", i ? "," : "", ptree[set->process[i]].pid);
+                                printf("\n");
+                        }
+                }
+                END_LOCK;
+                printf("Tested %d patterns against %d processes in %.3f ms, %d regex evaluations (%lld skipped by the literal prefilter)\n",
+                       count, processes, elapsed / 1000., evaluations, (long long)processes * valid - evaluations);
+        }
+        for (int k = 0; k < count; k++) {
+                if (sets[k].valid)
+                        regfree(&sets[k].regex);
+                FREE(sets[k].pattern);
+                FREE(sets[k].process);
+        }
+        FREE(sets);
+        return rv;
+}
+
+
 //FIXME: move to standalone system class
 bool init_system_info(void) {
         memset(&systeminfo, 0, sizeof(SystemInfo_T));
@@ -489,6 +1382,8 @@ bool init_system_info(void) {
         systeminfo.cpu.usage.user = -1.;
         systeminfo.cpu.usage.system = -1.;
         systeminfo.cpu.usage.iowait = -1.;
+        for (int i = 0; i < Pressure_Count; i++)
+                systeminfo.pressure[i].some = systeminfo.pressure[i].full = -1.;
         return (init_process_info_sysdep());
 }
 
@@ -504,8 +1399,11 @@ bool update_system_info() {
                 Log_error("'%s' statistic error -- memory usage data collection failed\n", Run.system->name);
                 goto error2;
         }
-        systeminfo.memory.usage.percent  = systeminfo.memory.size > 0ULL ? (100. * (double)systeminfo.memory.usage.bytes / (double)systeminfo.memory.size) : 0.;
+        // The hugepages pool isn't available for other use, the memory usage is relative to the rest
+        unsigned long long memorySize = systeminfo.memory.size > systeminfo.memory.hugepages.size ? systeminfo.memory.size - systeminfo.memory.hugepages.size : 0ULL;
+        systeminfo.memory.usage.percent  = memorySize > 0ULL ? (100. * (double)systeminfo.memory.usage.bytes / (double)memorySize) : 0.;
         systeminfo.swap.usage.percent = systeminfo.swap.size > 0ULL ? (100. * (double)systeminfo.swap.usage.bytes / (double)systeminfo.swap.size) : 0.;
+        systeminfo.memory.hugepages.usage.percent = systeminfo.memory.hugepages.size > 0ULL ? (100. * (double)systeminfo.memory.hugepages.usage.bytes / (double)systeminfo.memory.hugepages.size) : 0.;
 
         if (! used_system_cpu_sysdep(&systeminfo)) {
                 Log_error("'%s' statistic error -- cpu usage data collection failed\n", Run.system->name);
@@ -517,6 +1415,10 @@ bool update_system_info() {
                 goto error4;
         }
 
+        // The pressure stall information is optional (Linux >= 4.20 with PSI enabled), the values are -1 if not available
+        for (int i = 0; i < Pressure_Count; i++)
+                Cgroup_pressure(0, i, &(systeminfo.pressure[i]));
+
         return true;
 
 error1:
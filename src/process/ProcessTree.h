@@ -28,8 +28,18 @@
 #include "config.h"
 
 
+/**
+ * The process resource by which the top processes are selected
+ */
+typedef enum {
+        ProcessSort_Cpu = 0,
+        ProcessSort_Memory,
+        ProcessSort_Threads,
+        ProcessSort_Files
+} ProcessSort_Type;
+
+
 typedef struct ProcessTree_T {
-        bool visited;
         bool zombie;
         pid_t pid;
         pid_t ppid;
@@ -49,6 +59,7 @@ typedef struct ProcessTree_T {
         struct {
                 int self;
                 int children;
+                float cpu; // The CPU usage of the busiest thread in percent of one CPU, -1 if not collected
         } threads;
         struct {
                 int count;
@@ -58,6 +69,8 @@ typedef struct ProcessTree_T {
         struct {
                 unsigned long long usage;
                 unsigned long long usage_total;
+                long long pss; // The proportional set size, -1 if not collected
+                long long uss; // The unique (private) set size, -1 if not collected
         } memory;
         struct {
                 unsigned long long time;
@@ -71,9 +84,28 @@ typedef struct ProcessTree_T {
                 long long bytesPhysical;
                 long long operations;
         } write;
+        struct {
+                unsigned long long time;
+                long long sent;
+                long long received;
+                bool delta; // The bytes since the previous scan
+        } tcp;
+        struct {
+                unsigned long long time; // 0 if not collected
+                unsigned long long io;   // The block I/O and swap in delay [ns]
+        } delay;
+        struct {
+                unsigned long long time;
+                int total;
+                int established;
+                int listen;
+                int closeWait;
+        } connections;
         time_t uptime;
+        unsigned long long starttime; // The start time in system specific units (0 if unknown), with the PID it identifies the process
         char *cmdline;
         char *secattr;
+        char *cgroup;
         struct {
                 long long usage;
                 long long usage_total;
@@ -93,12 +125,60 @@ typedef struct ProcessTree_T {
 int ProcessTree_init(ProcessEngine_Flags pflags);
 
 
+/**
+ * Rebuild the process tree including the command lines, unless it was
+ * done recently. Used by the wait for the process start, so the parallel
+ * starts don't rescan the process table each
+ * @param age The maximum age of the current tree in milliseconds
+ * @return The process tree size or -1 if failed
+ */
+int ProcessTree_refresh(int age);
+
+
+/**
+ * Copy the string to the string arena of the process tree snapshot. The system
+ * backend uses it for the command line and security attribute, the copy is
+ * valid until the next process tree refresh and must not be freed
+ * @param s The string to copy
+ * @return The copy or NULL if s is NULL
+ */
+char *ProcessTree_strdup(const char *s);
+
+
+/**
+ * Copy at most length bytes of the string to the string arena of the process
+ * tree snapshot. The copy is always NUL terminated
+ * @param s The string to copy
+ * @param length Maximum number of bytes to copy
+ * @return The copy
+ */
+char *ProcessTree_strndup(const char *s, size_t length);
+
+
+/**
+ * Test if the process is monitored by some service. The system backend may
+ * use it to collect the expensive details only for the monitored processes
+ * and their children (see ProcessEngine_CollectMonitoredOnly)
+ * @param pid Process PID
+ * @return true if the process is monitored otherwise false
+ */
+bool ProcessTree_isMonitored(pid_t pid);
+
+
 /**
  * Delete the process tree
  */
 void ProcessTree_delete(void);
 
 
+/**
+ * Drop the process match results, which refer to the services. The tree
+ * itself is kept, so the CPU usage can be computed in the next cycle after
+ * the services were replaced by reload
+ */
+void ProcessTree_resetMatches(void);
+
+
 /**
  * Update the process information.
  * @param s A Service object
@@ -131,6 +211,43 @@ pid_t ProcessTree_findProcess(Service_T s);
 void ProcessTree_testMatch(char *pattern);
 
 
+/**
+ * Test the patterns from the file, one per line, against the process tree
+ * in one pass with the literal prefilter of the process matching. For each
+ * pattern print the number of the matching processes, the PID which the
+ * process service would select, the number and the time of the regex
+ * evaluations and the PIDs of the matching processes, tab separated
+ * @param file The pattern file or "-" for the standard input
+ * @return true if succeeded, false if the file cannot be read, some
+ * pattern is invalid or the process engine is not available
+ */
+bool ProcessTree_testMatchFile(const char *file);
+
+
+/**
+ * The callback called for each of the top processes
+ * @param pt The process
+ * @param context The context given to ProcessTree_top()
+ */
+typedef void (*ProcessTree_Visitor)(const ProcessTree_T *pt, void *context);
+
+
+/**
+ * Visit the processes with the highest usage of the resource in the current
+ * process tree snapshot, the highest first. The top processes are picked by
+ * partial selection over the snapshot, the process table is not rescanned
+ * and the whole tree is not sorted. The visitor is called with the tree
+ * locked, it must not call other ProcessTree functions
+ * @param sort The resource
+ * @param limit The maximum number of the processes
+ * @param visitor The callback
+ * @param context The callback context
+ * @return The number of the processes in the snapshot or -1 if there is
+ * no snapshot
+ */
+int ProcessTree_top(ProcessSort_Type sort, int limit, ProcessTree_Visitor visitor, void *context);
+
+
 /**
  * Initialize the system information
  * @return true if succeeded otherwise false.
@@ -240,7 +240,7 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                 pt[i].cred.gid = ps.pr_gid;
                 if (pflags & ProcessEngine_CollectCommandLine) {
                         if (ps.pr_argc == 0) {
-                                pt[i].cmdline = Str_dup(procs[i].pi_comm); // Kernel thread
+                                pt[i].cmdline = ProcessTree_strdup(procs[i].pi_comm); // Kernel thread
                         } else {
                                 char command[8192];
                                 if (! getargs(&procs[i], sizeof(struct procentry64), command, sizeof(command))) {
@@ -252,9 +252,9 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                                                         command[i] = ' ';
                                                 }
                                         }
-                                        pt[i].cmdline = Str_dup(command);
+                                        pt[i].cmdline = ProcessTree_strdup(command);
                                 } else {
-                                        pt[i].cmdline = Str_dup(procs[i].pi_comm);
+                                        pt[i].cmdline = ProcessTree_strdup(procs[i].pi_comm);
                                 }
                         }
                 }
@@ -55,6 +55,7 @@
 
 // libmonit
 #include "system/Time.h"
+#include "system/Arena.h"
 
 
 /**
@@ -77,6 +78,223 @@ static long cpu_nice_old = 0;
 static long cpu_syst_old = 0;
 
 
+// The KERN_PROCARGS2 buffer sized to kern.argmax, allocated once
+static char *_args = NULL;
+
+
+/**
+ * The command line of the process from the previous scan. The process is identified by the PID, the start
+ * time and the name (exec changes the name), so the arguments are fetched only for the new processes
+ */
+typedef struct CmdlineEntry_T {
+        pid_t pid;
+        struct timeval starttime;
+        char comm[MAXCOMLEN + 1];
+        char *cmdline;
+} CmdlineEntry_T;
+
+
+static struct {
+        int count;
+        int size;
+        int current;
+        CmdlineEntry_T *list;        // The previous scan sorted by PID
+        CmdlineEntry_T *next;        // The current scan
+        Arena_T arena[2];
+} _cmdlines = {};
+
+
+typedef struct ProcIndex_T {
+        pid_t pid;
+        int index;
+} ProcIndex_T;
+
+
+typedef enum {
+        _Collect_Unknown = 0,
+        _Collect_Pending,
+        _Collect_Yes,
+        _Collect_No
+} __attribute__((__packed__)) _Collect_Type;
+
+
+static int _compareCmdlineEntry(const void *a, const void *b) {
+        pid_t x = ((const CmdlineEntry_T *)a)->pid, y = ((const CmdlineEntry_T *)b)->pid;
+        return x < y ? -1 : x > y;
+}
+
+
+static int _compareProcIndex(const void *a, const void *b) {
+        pid_t x = ((const ProcIndex_T *)a)->pid, y = ((const ProcIndex_T *)b)->pid;
+        return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Fetch the process arguments with the KERN_PROCARGS2 sysctl
+ * @return The command line or NULL if not available
+ */
+static const char *_fetchArguments(pid_t pid, StringBuffer_T cmdline) {
+        size_t size = systeminfo.argmax;
+        int mib[] = {CTL_KERN, KERN_PROCARGS2, pid};
+        if (! _args || sysctl(mib, 3, _args, &size, NULL, 0) == -1)
+                return NULL;
+        /* KERN_PROCARGS2 sysctl() returns following pseudo structure:
+         *        struct {
+         *                int argc
+         *                char execname[];
+         *                char argv[argc][];
+         *                char env[][];
+         *        }
+         * The strings are terminated with '\0' and may have variable '\0' padding
+         */
+        int argc = *_args;
+        char *p = _args + sizeof(int); // arguments beginning
+        char *end = _args + size;
+        StringBuffer_clear(cmdline);
+        p += strnlen(p, end - p); // skip exename
+        while (argc && p < end) {
+                if (*p == 0) { // skip terminating 0 and variable length 0 padding
+                        p++;
+                        continue;
+                }
+                StringBuffer_append(cmdline, argc-- ? "%s " : "%s", p);
+                p += strnlen(p, end - p);
+        }
+        return StringBuffer_length(cmdline) ? StringBuffer_toString(StringBuffer_trim(cmdline)) : NULL;
+}
+
+
+/**
+ * Get the process command line. The command line of the process known from the previous scan is reused,
+ * otherwise the arguments are fetched
+ */
+static char *_getCmdline(struct kinfo_proc *pinfo, CmdlineEntry_T *entry, StringBuffer_T cmdline) {
+        *entry = (CmdlineEntry_T){.pid = pinfo->kp_proc.p_pid, .starttime = pinfo->kp_proc.p_starttime};
+        snprintf(entry->comm, sizeof(entry->comm), "%s", pinfo->kp_proc.p_comm);
+        const CmdlineEntry_T *cached = _cmdlines.count ? bsearch(entry, _cmdlines.list, _cmdlines.count, sizeof(CmdlineEntry_T), _compareCmdlineEntry) : NULL;
+        if (cached && timercmp(&cached->starttime, &entry->starttime, ==) && IS(cached->comm, entry->comm)) {
+                entry->cmdline = Arena_strdup(_cmdlines.arena[_cmdlines.current], cached->cmdline);
+        } else {
+                const char *args = _fetchArguments(entry->pid, cmdline);
+                if (args) {
+                        entry->cmdline = Arena_strdup(_cmdlines.arena[_cmdlines.current], args);
+                } else {
+                        // No access to the arguments (or zombie), fallback to the executable path or the name. Not cached, the access can change
+                        char cmdpath[PROC_PIDPATHINFO_MAXSIZE] = {};
+                        entry->pid = -1;
+                        return proc_pidpath(pinfo->kp_proc.p_pid, cmdpath, sizeof(cmdpath)) > 0 ? ProcessTree_strdup(cmdpath) : ProcessTree_strdup(pinfo->kp_proc.p_comm);
+                }
+        }
+        return ProcessTree_strdup(entry->cmdline);
+}
+
+
+/**
+ * Collect the command lines of all processes and keep them for the next scan
+ */
+static void _collectCmdlines(ProcessTree_T *pt, struct kinfo_proc *pinfo, int count) {
+        // The strings of the previous scan are in the other arena, the arena of the scan before is reused
+        _cmdlines.current = ! _cmdlines.current;
+        if (_cmdlines.arena[_cmdlines.current])
+                Arena_reset(_cmdlines.arena[_cmdlines.current]);
+        else
+                _cmdlines.arena[_cmdlines.current] = Arena_new(65536);
+        if (count > _cmdlines.size) {
+                _cmdlines.size = count;
+                RESIZE(_cmdlines.list, _cmdlines.size * sizeof(CmdlineEntry_T));
+                RESIZE(_cmdlines.next, _cmdlines.size * sizeof(CmdlineEntry_T));
+        }
+        StringBuffer_T cmdline = StringBuffer_create(64);
+        int cached = 0;
+        for (int i = 0; i < count; i++) {
+                pt[i].cmdline = _getCmdline(&pinfo[i], &_cmdlines.next[cached], cmdline);
+                if (_cmdlines.next[cached].pid >= 0)
+                        cached++;
+        }
+        StringBuffer_free(&cmdline);
+        CmdlineEntry_T *list = _cmdlines.list;
+        _cmdlines.list = _cmdlines.next;
+        _cmdlines.next = list;
+        _cmdlines.count = cached;
+        qsort(_cmdlines.list, _cmdlines.count, sizeof(CmdlineEntry_T), _compareCmdlineEntry);
+}
+
+
+/**
+ * Test if the process or some of its ancestors is monitored. The result is cached in the collect array
+ */
+static _Collect_Type _collectProcess(ProcessTree_T *pt, ProcIndex_T *index, int count, int8_t *collect, int i) {
+        if (collect[i] == _Collect_Unknown) {
+                collect[i] = _Collect_Pending; // Guard against the cycle
+                if (ProcessTree_isMonitored(pt[i].pid)) {
+                        collect[i] = _Collect_Yes;
+                } else {
+                        ProcIndex_T key = {.pid = pt[i].ppid};
+                        ProcIndex_T *parent = pt[i].ppid != pt[i].pid ? bsearch(&key, index, count, sizeof(ProcIndex_T), _compareProcIndex) : NULL;
+                        collect[i] = parent ? _collectProcess(pt, index, count, collect, parent->index) : _Collect_No;
+                }
+        }
+        return collect[i] == _Collect_Yes ? _Collect_Yes : _Collect_No;
+}
+
+
+/**
+ * Select the processes whose task info and I/O should be collected
+ * @return The array with _Collect_Yes for each process whose details should be collected
+ */
+static int8_t *_collectDetails(ProcessTree_T *pt, int count, ProcessEngine_Flags pflags) {
+        int8_t *collect = CALLOC(count > 0 ? count : 1, sizeof(int8_t));
+        if (pflags & ProcessEngine_CollectMonitoredOnly) {
+                if (count > 0) {
+                        ProcIndex_T *index = CALLOC(count, sizeof(ProcIndex_T));
+                        for (int i = 0; i < count; i++)
+                                index[i] = (ProcIndex_T){.pid = pt[i].pid, .index = i};
+                        qsort(index, count, sizeof(ProcIndex_T), _compareProcIndex);
+                        for (int i = 0; i < count; i++)
+                                _collectProcess(pt, index, count, collect, i);
+                        FREE(index);
+                }
+        } else {
+                memset(collect, _Collect_Yes, count);
+        }
+        return collect;
+}
+
+
+static void _collectTaskInfo(ProcessTree_T *pt) {
+        // CPU, memory, threads
+        struct proc_taskinfo tinfo;
+        int rv = proc_pidinfo(pt->pid, PROC_PIDTASKINFO, 0, &tinfo, sizeof(tinfo));
+        if (rv <= 0) {
+                if (errno != EPERM)
+                        DEBUG("proc_pidinfo for pid %d failed -- %s\n", pt->pid, STRERROR);
+        } else if ((unsigned long)rv < sizeof(tinfo)) {
+                Log_error("proc_pidinfo for pid %d -- invalid result size\n", pt->pid);
+        } else {
+                pt->memory.usage = (unsigned long long)tinfo.pti_resident_size;
+                pt->cpu.time = (double)(tinfo.pti_total_user + tinfo.pti_total_system) / 100000000.; // The time is in nanoseconds, we store it as 1/10s
+                pt->threads.self = tinfo.pti_threadnum;
+        }
+#ifdef rusage_info_current
+        // Disk IO
+        rusage_info_current rusage;
+        if (proc_pid_rusage(pt->pid, RUSAGE_INFO_CURRENT, (rusage_info_t *)&rusage) < 0) {
+                if (errno != EPERM)
+                        DEBUG("proc_pid_rusage for pid %d failed -- %s\n", pt->pid, STRERROR);
+        } else {
+                pt->read.time = pt->write.time = Time_milli();
+                pt->read.bytes = -1;
+                pt->read.bytesPhysical = rusage.ri_diskio_bytesread;
+                pt->read.operations = -1;
+                pt->write.bytes = -1;
+                pt->write.bytesPhysical = rusage.ri_diskio_byteswritten;
+                pt->write.operations = -1;
+        }
+#endif
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -104,6 +322,7 @@ bool init_process_info_sysdep(void) {
                 DEBUG("system statistics error -- sysctl kern.argmax failed: %s\n", STRERROR);
                 return false;
         }
+        RESIZE(_args, systeminfo.argmax + 1);
 
         struct timeval booted;
         size = sizeof(booted);
@@ -119,7 +338,9 @@ bool init_process_info_sysdep(void) {
 
 
 /**
- * Read all processes to initialize the information tree.
+ * Read all processes to initialize the information tree. The command line is fetched only for the
+ * processes which were not seen in the previous scan. The task info and I/O are collected, if the
+ * ProcessEngine_CollectMonitoredOnly flag is set, only for monitored processes and their children
  * @param reference reference of ProcessTree
  * @param pflags Process engine flags
  * @return treesize > 0 if succeeded otherwise 0
@@ -137,16 +358,9 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                 Log_error("system statistic error -- sysctl failed: %s\n", STRERROR);
                 return 0;
         }
-        size_t treesize = pinfo_size / sizeof(struct kinfo_proc);
+        int treesize = (int)(pinfo_size / sizeof(struct kinfo_proc));
         ProcessTree_T *pt = CALLOC(sizeof(ProcessTree_T), treesize);
-
-        char *args = NULL;
-        StringBuffer_T cmdline = NULL;
-        if (pflags & ProcessEngine_CollectCommandLine) {
-                cmdline = StringBuffer_create(64);
-                args = CALLOC(1, systeminfo.argmax + 1);
-        }
-        for (size_t i = 0; i < treesize; i++) {
+        for (int i = 0; i < treesize; i++) {
                 pt[i].uptime    = systeminfo.time / 10. - pinfo[i].kp_proc.p_starttime.tv_sec;
                 pt[i].zombie    = pinfo[i].kp_proc.p_stat == SZOMB ? true : false;
                 pt[i].pid       = pinfo[i].kp_proc.p_pid;
@@ -154,87 +368,19 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                 pt[i].cred.uid  = pinfo[i].kp_eproc.e_pcred.p_ruid;
                 pt[i].cred.euid = pinfo[i].kp_eproc.e_ucred.cr_uid;
                 pt[i].cred.gid  = pinfo[i].kp_eproc.e_pcred.p_rgid;
-                if (pflags & ProcessEngine_CollectCommandLine) {
-                        size_t size = systeminfo.argmax;
-                        mib[0] = CTL_KERN;
-                        mib[1] = KERN_PROCARGS2;
-                        mib[2] = pt[i].pid;
-                        if (sysctl(mib, 3, args, &size, NULL, 0) != -1) {
-                                /* KERN_PROCARGS2 sysctl() returns following pseudo structure:
-                                 *        struct {
-                                 *                int argc
-                                 *                char execname[];
-                                 *                char argv[argc][];
-                                 *                char env[][];
-                                 *        }
-                                 * The strings are terminated with '\0' and may have variable '\0' padding
-                                 */
-                                int argc = *args;
-                                char *p = args + sizeof(int); // arguments beginning
-                                StringBuffer_clear(cmdline);
-                                p += strlen(p); // skip exename
-                                while (argc && p < args + systeminfo.argmax) {
-                                        if (*p == 0) { // skip terminating 0 and variable length 0 padding
-                                                p++;
-                                                continue;
-                                        }
-                                        StringBuffer_append(cmdline, argc-- ? "%s " : "%s", p);
-                                        p += strlen(p);
-                                }
-                                if (StringBuffer_length(cmdline))
-                                        pt[i].cmdline = Str_dup(StringBuffer_toString(StringBuffer_trim(cmdline)));
-                        }
-                        if (STR_UNDEF(pt[i].cmdline)) {
-                                char cmdpath[PROC_PIDPATHINFO_MAXSIZE] = {};
-                                FREE(pt[i].cmdline);
-                                if (proc_pidpath(pt[i].pid, cmdpath, sizeof(cmdpath)) > 0) {
-                                        pt[i].cmdline = Str_dup(cmdpath);
-                                } else {
-                                        pt[i].cmdline = Str_dup(pinfo[i].kp_proc.p_comm);
-                                }
-                        }
-                }
-                if (! pt[i].zombie) {
-                        // CPU, memory, threads
-                        struct proc_taskinfo tinfo;
-                        int rv = proc_pidinfo(pt[i].pid, PROC_PIDTASKINFO, 0, &tinfo, sizeof(tinfo)); // If the process is zombie, skip this
-                        if (rv <= 0) {
-                                if (errno != EPERM)
-                                        DEBUG("proc_pidinfo for pid %d failed -- %s\n", pt[i].pid, STRERROR);
-                        } else if ((unsigned long)rv < sizeof(tinfo)) {
-                                Log_error("proc_pidinfo for pid %d -- invalid result size\n", pt[i].pid);
-                        } else {
-                                pt[i].memory.usage = (unsigned long long)tinfo.pti_resident_size;
-                                pt[i].cpu.time = (double)(tinfo.pti_total_user + tinfo.pti_total_system) / 100000000.; // The time is in nanoseconds, we store it as 1/10s
-                                pt[i].threads.self = tinfo.pti_threadnum;
-                        }
-#ifdef rusage_info_current
-                        // Disk IO
-                        rusage_info_current rusage;
-                        if (proc_pid_rusage(pt[i].pid, RUSAGE_INFO_CURRENT, (rusage_info_t *)&rusage) < 0) {
-                                if (errno != EPERM)
-                                        DEBUG("proc_pid_rusage for pid %d failed -- %s\n", pt[i].pid, STRERROR);
-                        } else {
-                                pt[i].read.time = pt[i].write.time = Time_milli();
-                                pt[i].read.bytes = -1;
-                                pt[i].read.bytesPhysical = rusage.ri_diskio_bytesread;
-                                pt[i].read.operations = -1;
-                                pt[i].write.bytes = -1;
-                                pt[i].write.bytesPhysical = rusage.ri_diskio_byteswritten;
-                                pt[i].write.operations = -1;
-                        }
-#endif
-                }
-        }
-        if (pflags & ProcessEngine_CollectCommandLine) {
-                StringBuffer_free(&cmdline);
-                FREE(args);
         }
+        if (pflags & ProcessEngine_CollectCommandLine)
+                _collectCmdlines(pt, pinfo, treesize);
+        int8_t *collect = _collectDetails(pt, treesize, pflags);
+        for (int i = 0; i < treesize; i++)
+                if (collect[i] == _Collect_Yes && ! pt[i].zombie)
+                        _collectTaskInfo(&pt[i]);
+        FREE(collect);
         FREE(pinfo);
 
         *reference = pt;
-        
-        return (int)treesize;
+
+        return treesize;
 }
 
 
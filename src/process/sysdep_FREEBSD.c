@@ -75,6 +75,7 @@
 
 // libmonit
 #include "system/Time.h"
+#include "system/Arena.h"
 
 
 /**
@@ -95,6 +96,101 @@ static long cpu_syst_old = 0;
 static long cpu_intr_old = 0;
 
 
+// The kvm handle is kept open across the scans, so libkvm reuses its process and arguments buffers
+static kvm_t *_kvm = NULL;
+
+
+/**
+ * The command line of the process from the previous scan. The process is identified by the PID, the start
+ * time and the name (exec changes the name), so the arguments are fetched only for the new processes
+ */
+typedef struct CmdlineEntry_T {
+        pid_t pid;
+        struct timeval starttime;
+        char comm[MAXCOMLEN + 1];
+        char *cmdline;
+} CmdlineEntry_T;
+
+
+static struct {
+        int count;
+        int size;
+        int current;
+        CmdlineEntry_T *list;        // The previous scan sorted by PID
+        CmdlineEntry_T *next;        // The current scan
+        Arena_T arena[2];
+} _cmdlines = {};
+
+
+static int _compareCmdlineEntry(const void *a, const void *b) {
+        pid_t x = ((const CmdlineEntry_T *)a)->pid, y = ((const CmdlineEntry_T *)b)->pid;
+        return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Get the process command line. The command line of the process known from the previous scan is reused,
+ * otherwise the arguments are fetched
+ */
+static char *_getCmdline(struct kinfo_proc *pinfo, CmdlineEntry_T *entry, StringBuffer_T cmdline) {
+        *entry = (CmdlineEntry_T){.pid = pinfo->ki_pid, .starttime = pinfo->ki_start};
+        snprintf(entry->comm, sizeof(entry->comm), "%s", pinfo->ki_comm);
+        const CmdlineEntry_T *cached = _cmdlines.count ? bsearch(entry, _cmdlines.list, _cmdlines.count, sizeof(CmdlineEntry_T), _compareCmdlineEntry) : NULL;
+        if (cached && timercmp(&cached->starttime, &entry->starttime, ==) && IS(cached->comm, entry->comm)) {
+                entry->cmdline = Arena_strdup(_cmdlines.arena[_cmdlines.current], cached->cmdline);
+                return ProcessTree_strdup(entry->cmdline);
+        }
+        char **args = kvm_getargv(_kvm, pinfo, 0);
+        if (args) {
+                StringBuffer_clear(cmdline);
+                for (int j = 0; args[j]; j++)
+                        StringBuffer_append(cmdline, args[j + 1] ? "%s " : "%s", args[j]);
+        }
+        if (args && StringBuffer_length(cmdline)) {
+                entry->cmdline = Arena_strdup(_cmdlines.arena[_cmdlines.current], StringBuffer_toString(StringBuffer_trim(cmdline)));
+        } else if (pinfo->ki_flag & P_SYSTEM) {
+                // The kernel process has no arguments
+                entry->cmdline = Arena_strdup(_cmdlines.arena[_cmdlines.current], pinfo->ki_comm);
+        } else {
+                // No access to the arguments (or zombie), fallback to the name. Not cached, the access can change
+                entry->pid = -1;
+                return ProcessTree_strdup(pinfo->ki_comm);
+        }
+        return ProcessTree_strdup(entry->cmdline);
+}
+
+
+/**
+ * Collect the command lines of all processes and keep them for the next scan
+ */
+static void _collectCmdlines(ProcessTree_T *pt, struct kinfo_proc *pinfo, int count) {
+        // The strings of the previous scan are in the other arena, the arena of the scan before is reused
+        _cmdlines.current = ! _cmdlines.current;
+        if (_cmdlines.arena[_cmdlines.current])
+                Arena_reset(_cmdlines.arena[_cmdlines.current]);
+        else
+                _cmdlines.arena[_cmdlines.current] = Arena_new(65536);
+        if (count > _cmdlines.size) {
+                _cmdlines.size = count;
+                RESIZE(_cmdlines.list, _cmdlines.size * sizeof(CmdlineEntry_T));
+                RESIZE(_cmdlines.next, _cmdlines.size * sizeof(CmdlineEntry_T));
+        }
+        StringBuffer_T cmdline = StringBuffer_create(64);
+        int cached = 0;
+        for (int i = 0; i < count; i++) {
+                pt[i].cmdline = _getCmdline(&pinfo[i], &_cmdlines.next[cached], cmdline);
+                if (_cmdlines.next[cached].pid >= 0)
+                        cached++;
+        }
+        StringBuffer_free(&cmdline);
+        CmdlineEntry_T *list = _cmdlines.list;
+        _cmdlines.list = _cmdlines.next;
+        _cmdlines.next = list;
+        _cmdlines.count = cached;
+        qsort(_cmdlines.list, _cmdlines.count, sizeof(CmdlineEntry_T), _compareCmdlineEntry);
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -134,33 +230,33 @@ bool init_process_info_sysdep(void) {
 
 
 /**
- * Read all processes to initialize the information tree.
+ * Read all processes to initialize the information tree. The command line is fetched only for the
+ * processes which were not seen in the previous scan
  * @param reference  reference of ProcessTree
  * @param pflags Process engine flags
  * @return treesize > 0 if succeeded otherwise 0.
  */
 int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags) {
-        char errbuf[_POSIX2_LINE_MAX];
-        kvm_t *kvm_handle = kvm_openfiles(NULL, _PATH_DEVNULL, NULL, O_RDONLY, errbuf);
-        if (! kvm_handle) {
-                Log_error("system statistics error -- cannot initialize kvm interface\n");
-                return 0;
+        if (! _kvm) {
+                char errbuf[_POSIX2_LINE_MAX];
+                if (! (_kvm = kvm_openfiles(NULL, _PATH_DEVNULL, NULL, O_RDONLY, errbuf))) {
+                        Log_error("system statistics error -- cannot initialize kvm interface\n");
+                        return 0;
+                }
         }
 
         int treesize;
-        struct kinfo_proc *pinfo = kvm_getprocs(kvm_handle, KERN_PROC_PROC, 0, &treesize);
+        struct kinfo_proc *pinfo = kvm_getprocs(_kvm, KERN_PROC_PROC, 0, &treesize);
         if (! pinfo || (treesize < 1)) {
-                Log_error("system statistics error -- kvm_getprocs: %s\n", kvm_geterr(kvm_handle));
-                kvm_close(kvm_handle);
+                Log_error("system statistics error -- kvm_getprocs: %s\n", kvm_geterr(_kvm));
+                kvm_close(_kvm);
+                _kvm = NULL;
                 return 0;
         }
         unsigned long long now = Time_milli();
 
         ProcessTree_T *pt = CALLOC(sizeof(ProcessTree_T), treesize);
 
-        StringBuffer_T cmdline = NULL;
-        if (pflags & ProcessEngine_CollectCommandLine)
-                cmdline = StringBuffer_create(64);
         for (int i = 0; i < treesize; i++) {
                 pt[i].pid                   = pinfo[i].ki_pid;
                 pt[i].ppid                  = pinfo[i].ki_ppid;
@@ -179,26 +275,11 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                 pt[i].write.operations      = pinfo[i].ki_rusage.ru_oublock;
                 pt[i].read.time             = pt[i].write.time = now;
                 pt[i].zombie                = pinfo[i].ki_stat == SZOMB ? true : false;
-                if (pflags & ProcessEngine_CollectCommandLine) {
-                        char **args = kvm_getargv(kvm_handle, &pinfo[i], 0);
-                        if (args) {
-                                StringBuffer_clear(cmdline);
-                                for (int j = 0; args[j]; j++)
-                                        StringBuffer_append(cmdline, args[j + 1] ? "%s " : "%s", args[j]);
-                                if (StringBuffer_length(cmdline))
-                                        pt[i].cmdline = Str_dup(StringBuffer_toString(StringBuffer_trim(cmdline)));
-                        }
-                        if (STR_UNDEF(pt[i].cmdline)) {
-                                FREE(pt[i].cmdline);
-                                pt[i].cmdline = Str_dup(pinfo[i].ki_comm);
-                        }
-                }
         }
         if (pflags & ProcessEngine_CollectCommandLine)
-                StringBuffer_free(&cmdline);
+                _collectCmdlines(pt, pinfo, treesize);
 
         *reference = pt;
-        kvm_close(kvm_handle);
 
         return treesize;
 }
@@ -69,10 +69,6 @@
 #include <asm/param.h>
 #endif
 
-#ifdef HAVE_GLOB_H
-#include <glob.h>
-#endif
-
 #ifdef HAVE_SYS_SYSINFO_H
 #include <sys/sysinfo.h>
 #endif
@@ -85,12 +81,22 @@
 #include <sys/resource.h>
 #endif
 
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
 #include "monit.h"
 #include "ProcessTree.h"
 #include "process_sysdep.h"
+#include "Cgroup.h"
+#include "ProcessBPF.h"
+#include "ProcessTaskstats.h"
+#include "ProcessSocket.h"
 
 // libmonit
 #include "system/Time.h"
+#include "system/Arena.h"
+#include "exceptions/AssertException.h"
 
 /**
  *  System dependent resource data collection code for Linux.
@@ -107,8 +113,181 @@ static struct {
 } _statistics = {};
 
 
+/**
+ * Read buffer for the /proc files, which is reused for all processes and grown as needed
+ */
+typedef struct ProcBuffer_T {
+        size_t size;
+        char *data;
+} ProcBuffer_T;
+
+
+/**
+ * The /proc directory descriptor is kept open and the process and system files are opened relative
+ * to it. Each scanner thread has its own read buffer, the first buffer is used by the main thread
+ */
+static struct {
+        int fd;                // The /proc directory descriptor or -1 if not open
+        char *root;            // The path of the open /proc directory, see "set procfs"
+        bool native;           // The root is the /proc of this host, so the processes can be queried by the system calls
+        struct {
+                int count;
+                ProcBuffer_T *list;
+        } buffers;             // Read buffers of the scanner threads
+        struct {
+                int count;
+                int size;
+                pid_t *list;
+        } pids;                // PIDs found in the last /proc scan
+} _proc = {.fd = -1};
+
+
+#define PROC_SCAN_SLICE 256 // Minimum number of processes per scanner thread
+
+
+#define FD_BUFFER_SIZE 262144 // The getdents64 buffer for /proc/PID/fd
+
+
+#define CACHE_REFRESH 8     // The cached process attributes are read again after this number of scans
+#define CACHE_AGE     60    // The attributes of the process younger than this [s] are not cached (it may still drop privileges, set the title, etc.)
+
+
+typedef enum {
+        Cache_Cmdline     = 0x1,
+        Cache_Cgroup      = 0x2,
+        Cache_Credentials = 0x4,
+        Cache_Secattr     = 0x8,
+        Cache_Limits      = 0x10
+} __attribute__((__packed__)) Cache_Flags;
+
+
+/**
+ * The cached attributes of the process, which rarely change. The entry is identified by the PID, start time
+ * and name, so the reused PID or exec() invalidates it. The flags mark the attributes which are set (the
+ * string attribute may be NULL if the process has none)
+ */
+typedef struct CacheEntry_T {
+        pid_t pid;
+        unsigned long long starttime;
+        unsigned int expires;      // The scan number when the attributes are read again
+        Cache_Flags flags;
+        char comm[16];
+        char *cmdline;
+        char *cgroup;
+        char *secattr;
+        int uid;
+        int euid;
+        int gid;
+        long long soft;
+        long long hard;
+} CacheEntry_T;
+
+
+/**
+ * The process attributes cache. The entries of the scanned processes are collected in the array parallel
+ * to the process tree (the scanner threads write their slices) and the cache is rebuilt from them after
+ * the scan, so it is read-only while the scanner threads run. The strings are copied to one of the two
+ * arenas, the other holds the strings of the previous cache until the rebuild finished
+ */
+static struct {
+        unsigned int scan;         // The scan number
+        int count;
+        int size;
+        CacheEntry_T *list;        // The cache sorted by PID
+        CacheEntry_T *entries;     // The entries of the current scan, parallel to the process tree
+        int entriesSize;
+        Arena_T arena[2];
+        int current;               // The arena of the cache strings
+} _cache = {};
+
+
+/**
+ * The CPU time of the threads of the monitored processes, to find the busiest thread. The samples of the
+ * previous scan are sorted by the thread ID and read-only while the scanner threads append the samples
+ * of the current scan
+ */
+typedef struct ThreadSample_T {
+        pid_t tid;
+        unsigned long long ticks;
+} ThreadSample_T;
+
+
+typedef struct ThreadSamples_T {
+        int count;
+        int size;
+        ThreadSample_T *list;
+} ThreadSamples_T;
+
+
+static struct {
+        Mutex_T mutex;                  // Serializes the appends of the scanner threads
+        unsigned long long time;        // The time of the current scan [ms]
+        unsigned long long previousTime;
+        ThreadSamples_T current;
+        ThreadSamples_T previous;
+} _threads = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/**
+ * System statistics files, which are kept open and read with pread() into one buffer
+ */
+typedef enum {
+        _System_LoadAverage = 0,
+        _System_Memory,
+        _System_Cpu,
+        _System_Filedescriptors,
+        _System_Count
+} _System_Type;
+
+
+static struct {
+        int fd[_System_Count];
+        ProcBuffer_T buffer;
+} _system = {.fd = {-1, -1, -1, -1}};
+
+
+static const char *_systemFiles[_System_Count] = {
+        [_System_LoadAverage]     = "loadavg",
+        [_System_Memory]          = "meminfo",
+        [_System_Cpu]             = "stat",
+        [_System_Filedescriptors] = "sys/fs/file-nr"
+};
+
+
+/**
+ * Per-CPU counters from the /proc/stat "cpu<N>" lines. The counters are kept in flat arrays indexed
+ * by the CPU number, with the previous and current sample swapped after each cycle, so the deltas
+ * and percentages are computed in plain loops over contiguous memory which the compiler vectorizes
+ */
+static struct {
+        int count;                     // Number of slots (highest CPU number + 1)
+        int current;                   // Index of the current sample
+        bool initialized;              // True if the previous sample is available
+        int *node;                     // NUMA node of each CPU
+        unsigned long long *busy[2];   // Busy time of each CPU (previous and current sample)
+        unsigned long long *total[2];  // Total time of each CPU (previous and current sample)
+        float *usage;                  // Usage of each CPU [%]
+        struct {
+                int count;             // Number of NUMA nodes
+                double *busy;          // Busy time delta per node
+                double *total;         // Total time delta per node
+                float *usage;          // Usage of each node [%]
+        } nodes;
+} _cpus = {};
+
+
+// Directory entry returned by the getdents64 system call
+typedef struct Dirent64_T {
+        uint64_t       d_ino;
+        int64_t        d_off;
+        unsigned short d_reclen;
+        unsigned char  d_type;
+        char           d_name[];
+} Dirent64_T;
+
+
 typedef struct Proc_T {
-        StringBuffer_T name;
+        ProcBuffer_T *buffer;
         struct {
                 int                 pid;
                 int                 ppid;
@@ -140,7 +319,10 @@ typedef struct Proc_T {
                                 long long hard;
                         } limit;
                 } filedescriptors;
-                char                secattr[STRLEN];
+                char                comm[64];
+                char               *cmdline;
+                char               *secattr;
+                char               *cgroup;
         } data;
 } *Proc_T;
 
@@ -188,127 +370,604 @@ static time_t _getStartTime(void) {
 }
 
 
+static void _bufferInit(ProcBuffer_T *buffer) {
+        if (! buffer->data) {
+                buffer->size = 8192;
+                buffer->data = ALLOC(buffer->size);
+        }
+}
+
+
+/**
+ * Read the /proc file of the process into the process buffer. The buffer is NUL terminated
+ * @param proc The process
+ * @param name The file name relative to the process directory
+ * @param length Optional out parameter, set to the number of bytes read
+ * @return The buffer or NULL if the file cannot be read
+ */
+static char *_readProc(Proc_T proc, const char *name, size_t *length) {
+        char path[64];
+        snprintf(path, sizeof(path), "%d/%s", proc->data.pid, name);
+        int fd = openat(_proc.fd, path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                DEBUG("Cannot open proc file '/proc/%s' -- %s\n", path, STRERROR);
+                return NULL;
+        }
+        ProcBuffer_T *buffer = proc->buffer;
+        _bufferInit(buffer);
+        size_t n = 0;
+        ssize_t bytes;
+        // Files such as cmdline or fd limits are read until EOF, the buffer grows if needed
+        while ((bytes = pread(fd, buffer->data + n, buffer->size - n - 1, n)) > 0) {
+                n += bytes;
+                if (n == buffer->size - 1) {
+                        buffer->size *= 2;
+                        RESIZE(buffer->data, buffer->size);
+                }
+        }
+        if (bytes < 0) {
+                DEBUG("Cannot read proc file '/proc/%s' -- %s\n", path, STRERROR);
+                close(fd);
+                return NULL;
+        }
+        close(fd);
+        buffer->data[n] = 0;
+        if (length)
+                *length = n;
+        return buffer->data;
+}
+
+
+/**
+ * Iterate the directory entries
+ * @param buffer The read buffer
+ * @param fd The directory descriptor
+ * @param callback The function called for each entry
+ * @param ap Callback argument
+ * @return true if succeeded otherwise false
+ */
+static bool _readDirectory(ProcBuffer_T *buffer, int fd, void (*callback)(const char *name, void *ap), void *ap) {
+        _bufferInit(buffer);
+        long bytes;
+        while ((bytes = syscall(SYS_getdents64, fd, buffer->data, buffer->size)) > 0) {
+                for (long offset = 0; offset < bytes;) {
+                        Dirent64_T *entry = (Dirent64_T *)(buffer->data + offset);
+                        callback(entry->d_name, ap);
+                        offset += entry->d_reclen;
+                }
+        }
+        return bytes == 0;
+}
+
+
+static void _addPid(const char *name, __attribute__ ((unused)) void *ap) {
+        if (*name >= '1' && *name <= '9') {
+                if (_proc.pids.count == _proc.pids.size) {
+                        _proc.pids.size = _proc.pids.size ? _proc.pids.size * 2 : 1024;
+                        RESIZE(_proc.pids.list, _proc.pids.size * sizeof(pid_t));
+                }
+                _proc.pids.list[_proc.pids.count++] = atoi(name);
+        }
+}
+
+
+/**
+ * Open the /proc directory (PROCFS_ROOT). If the root was changed by reload, the descriptors of the
+ * previous root are closed
+ * @return true if succeeded otherwise false
+ */
+static bool _openProc(void) {
+        const char *root = PROCFS_ROOT;
+        if (_proc.fd >= 0) {
+                if (IS(_proc.root, root))
+                        return true;
+                close(_proc.fd);
+                _proc.fd = -1;
+                for (int i = 0; i < _System_Count; i++) {
+                        if (_system.fd[i] >= 0) {
+                                close(_system.fd[i]);
+                                _system.fd[i] = -1;
+                        }
+                }
+        }
+        FREE(_proc.root);
+        if ((_proc.fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+                Log_error("system statistic error -- cannot open %s -- %s\n", root, STRERROR);
+                return false;
+        }
+        _proc.root = Str_dup(root);
+        _proc.native = IS(root, "/proc");
+        _cache.count = 0;
+        return true;
+}
+
+
+/**
+ * Scan the /proc directory for the processes
+ * @return true if succeeded otherwise false
+ */
+static bool _scanProc(void) {
+        _proc.pids.count = 0;
+        if (! _openProc())
+                return false;
+        if (! _proc.buffers.count) {
+                _proc.buffers.count = 1;
+                _proc.buffers.list = CALLOC(1, sizeof(ProcBuffer_T));
+        }
+        if (lseek(_proc.fd, 0, SEEK_SET) < 0 || ! _readDirectory(&_proc.buffers.list[0], _proc.fd, _addPid, NULL)) {
+                Log_error("system statistic error -- cannot read %s -- %s\n", _proc.root, STRERROR);
+                return false;
+        }
+        return true;
+}
+
+
+/**
+ * Read the system statistics file into the system buffer. The file descriptor is kept open
+ * @param type The file
+ * @return The NUL terminated buffer or NULL if the file cannot be read
+ */
+static char *_readSystem(_System_Type type) {
+        if (! _openProc())
+                return NULL;
+        if (_system.fd[type] < 0 && (_system.fd[type] = openat(_proc.fd, _systemFiles[type], O_RDONLY | O_CLOEXEC)) < 0) {
+                DEBUG("system statistic error -- cannot open %s/%s -- %s\n", _proc.root, _systemFiles[type], STRERROR);
+                return NULL;
+        }
+        _bufferInit(&_system.buffer);
+        size_t n = 0;
+        ssize_t bytes;
+        while ((bytes = pread(_system.fd[type], _system.buffer.data + n, _system.buffer.size - n - 1, n)) > 0) {
+                n += bytes;
+                if (n == _system.buffer.size - 1) {
+                        _system.buffer.size *= 2;
+                        RESIZE(_system.buffer.data, _system.buffer.size);
+                }
+        }
+        if (bytes < 0) {
+                DEBUG("system statistic error -- cannot read %s/%s -- %s\n", _proc.root, _systemFiles[type], STRERROR);
+                close(_system.fd[type]);
+                _system.fd[type] = -1;
+                return NULL;
+        }
+        _system.buffer.data[n] = 0;
+        return _system.buffer.data;
+}
+
+
+/**
+ * Parse the unsigned decimal number and move the cursor behind it. The leading blanks are skipped
+ * @param cursor The parser position
+ * @param value The parsed value
+ * @return true if the number was found otherwise false
+ */
+static bool _parseUnsigned(const char **cursor, unsigned long long *value) {
+        const char *p = *cursor;
+        while (*p == ' ' || *p == '\t')
+                p++;
+        if (*p < '0' || *p > '9')
+                return false;
+        unsigned long long v = 0ULL;
+        while (*p >= '0' && *p <= '9')
+                v = v * 10 + (*p++ - '0');
+        *value = v;
+        *cursor = p;
+        return true;
+}
+
+
+// Parse the decimal number with optional fraction, such as the load average "0.42"
+static bool _parseDouble(const char **cursor, double *value) {
+        unsigned long long integer, fraction = 0ULL;
+        if (! _parseUnsigned(cursor, &integer))
+                return false;
+        double v = integer;
+        if (**cursor == '.') {
+                const char *p = ++(*cursor);
+                if (_parseUnsigned(cursor, &fraction)) {
+                        double divisor = 1.;
+                        for (; p < *cursor; p++)
+                                divisor *= 10.;
+                        v += fraction / divisor;
+                }
+        }
+        *value = v;
+        return true;
+}
+
+
+/**
+ * Parse the numbers which follow the key in the "<key> <number> <number> ..." line at the cursor
+ * @param line The line
+ * @param key The key expected at the line start
+ * @param values The parsed values
+ * @param count The maximum number of values
+ * @return The number of values parsed or -1 if the line doesn't start with the key
+ */
+static int _parseLine(const char *line, const char *key, unsigned long long *values, int count) {
+        size_t length = strlen(key);
+        if (strncmp(line, key, length))
+                return -1;
+        const char *cursor = line + length;
+        int parsed = 0;
+        while (parsed < count && _parseUnsigned(&cursor, &values[parsed]))
+                parsed++;
+        return parsed;
+}
+
+
+// Skip the count of blank separated fields at the cursor, return false if the line ended before
+static bool _skipFields(const char **cursor, int count) {
+        const char *p = *cursor;
+        while (count--) {
+                while (*p == ' ')
+                        p++;
+                if (! *p || *p == '\n')
+                        return false;
+                while (*p && *p != ' ' && *p != '\n')
+                        p++;
+        }
+        *cursor = p;
+        return true;
+}
+
+
+/**
+ * Find the line which starts with the key at or after the cursor. The fields of the /proc/PID/status
+ * and io files come in a fixed order, so the lines are searched in one pass if the cursor is passed on
+ * @param cursor The position of the line start to search from
+ * @param key The key expected at the line start
+ * @return The position behind the key or NULL if no line starts with the key
+ */
+static const char *_findLine(const char *cursor, const char *key) {
+        size_t length = strlen(key);
+        while (strncmp(cursor, key, length)) {
+                if (! (cursor = strchr(cursor, '\n')))
+                        return NULL;
+                cursor++;
+        }
+        return cursor + length;
+}
+
+
+
+// Parse the sysfs CPU list, such as "0-3,8-11", and assign the listed CPUs to the node
+static void _cpuNodeList(const char *list, int node) {
+        const char *p = list;
+        unsigned long long first, last;
+        while (_parseUnsigned(&p, &first)) {
+                last = first;
+                if (*p == '-') {
+                        p++;
+                        if (! _parseUnsigned(&p, &last))
+                                break;
+                }
+                for (unsigned long long cpu = first; cpu <= last && cpu < (unsigned long long)_cpus.count; cpu++)
+                        _cpus.node[cpu] = node;
+                if (*p != ',')
+                        break;
+                p++;
+        }
+}
+
+
+// Map the CPUs to NUMA nodes using /sys/devices/system/node/node<N>/cpulist. Without NUMA all CPUs are on node 0
+static void _cpuNodes(void) {
+        int nodes = 1;
+        memset(_cpus.node, 0, _cpus.count * sizeof(int));
+        DIR *dir = opendir("/sys/devices/system/node");
+        if (dir) {
+                struct dirent *de;
+                while ((de = readdir(dir))) {
+                        int node;
+                        char path[STRLEN], list[STRLEN];
+                        if (sscanf(de->d_name, "node%d", &node) != 1 || node < 0)
+                                continue;
+                        snprintf(path, sizeof(path), "/sys/devices/system/node/%.64s/cpulist", de->d_name);
+                        FILE *f = fopen(path, "r");
+                        if (f) {
+                                if (fgets(list, sizeof(list), f)) {
+                                        _cpuNodeList(list, node);
+                                        nodes = MAX(nodes, node + 1);
+                                }
+                                fclose(f);
+                        }
+                }
+                closedir(dir);
+        }
+        if (nodes != _cpus.nodes.count) {
+                _cpus.nodes.count = nodes;
+                RESIZE(_cpus.nodes.busy, nodes * sizeof(double));
+                RESIZE(_cpus.nodes.total, nodes * sizeof(double));
+                RESIZE(_cpus.nodes.usage, nodes * sizeof(float));
+        }
+}
+
+
+// Grow the per-CPU arrays, for example when a CPU was hotplugged. The samples restart as the new slots have no history
+static void _cpusResize(int count) {
+        RESIZE(_cpus.node, count * sizeof(int));
+        for (int i = 0; i < 2; i++) {
+                RESIZE(_cpus.busy[i], count * sizeof(unsigned long long));
+                RESIZE(_cpus.total[i], count * sizeof(unsigned long long));
+                memset(_cpus.busy[i] + _cpus.count, 0, (count - _cpus.count) * sizeof(unsigned long long));
+                memset(_cpus.total[i] + _cpus.count, 0, (count - _cpus.count) * sizeof(unsigned long long));
+        }
+        RESIZE(_cpus.usage, count * sizeof(float));
+        _cpus.count = count;
+        _cpus.initialized = false;
+        _cpuNodes();
+}
+
+
+/**
+ * Update the per-CPU and per-node usage from the /proc/stat content. The busy time is the time spent
+ * in user, nice, system, hardirq and softirq modes, the total time adds the idle, iowait and steal time
+ * @param buf The /proc/stat content
+ * @param si The system info to update
+ */
+static void _updateCpus(const char *buf, SystemInfo_T *si) {
+        int current = _cpus.current;
+        for (const char *line = buf; line; line = strchr(line, '\n')) {
+                if (*line == '\n')
+                        line++;
+                if (strncmp(line, "cpu", 3) || line[3] < '0' || line[3] > '9')
+                        continue;
+                const char *cursor = line + 3;
+                unsigned long long cpu, values[8] = {};
+                if (! _parseUnsigned(&cursor, &cpu) || cpu >= INT_MAX)
+                        continue;
+                if (cpu >= (unsigned long long)_cpus.count)
+                        _cpusResize(MAX((int)cpu + 1, systeminfo.cpu.count));
+                for (int i = 0; i < 8 && _parseUnsigned(&cursor, &values[i]); i++)
+                        ;
+                _cpus.busy[current][cpu] = values[0] + values[1] + values[2] + values[5] + values[6];
+                _cpus.total[current][cpu] = _cpus.busy[current][cpu] + values[3] + values[4] + values[7];
+        }
+        if (! _cpus.initialized) {
+                // The first sample has no history yet
+                for (int i = 0; i < _cpus.count; i++)
+                        _cpus.usage[i] = -1.;
+                for (int i = 0; i < _cpus.nodes.count; i++)
+                        _cpus.nodes.usage[i] = -1.;
+        } else {
+                const unsigned long long *restrict busy = _cpus.busy[current], *restrict busyPrevious = _cpus.busy[! current];
+                const unsigned long long *restrict total = _cpus.total[current], *restrict totalPrevious = _cpus.total[! current];
+                float *restrict usage = _cpus.usage;
+                // Counters which jumped back (CPU went offline and back) are handled as zero delta by the signed difference
+                for (int i = 0; i < _cpus.count; i++) {
+                        double deltaBusy = (double)(long long)(busy[i] - busyPrevious[i]);
+                        double deltaTotal = (double)(long long)(total[i] - totalPrevious[i]);
+                        usage[i] = deltaTotal > 0. && deltaBusy > 0. ? (float)(100. * deltaBusy / deltaTotal) : 0.f;
+                }
+                for (int i = 0; i < _cpus.nodes.count; i++)
+                        _cpus.nodes.busy[i] = _cpus.nodes.total[i] = 0.;
+                for (int i = 0; i < _cpus.count; i++) {
+                        double deltaTotal = (double)(long long)(total[i] - totalPrevious[i]);
+                        if (deltaTotal > 0.) {
+                                _cpus.nodes.busy[_cpus.node[i]] += (double)(long long)(busy[i] - busyPrevious[i]);
+                                _cpus.nodes.total[_cpus.node[i]] += deltaTotal;
+                        }
+                }
+                for (int i = 0; i < _cpus.nodes.count; i++)
+                        _cpus.nodes.usage[i] = _cpus.nodes.total[i] > 0. && _cpus.nodes.busy[i] > 0. ? (float)(100. * _cpus.nodes.busy[i] / _cpus.nodes.total[i]) : 0.f;
+        }
+        _cpus.initialized = true;
+        _cpus.current = ! current;
+        si->cpu.cores.count = _cpus.count;
+        si->cpu.cores.usage = _cpus.usage;
+        si->cpu.nodes.count = _cpus.nodes.count;
+        si->cpu.nodes.usage = _cpus.nodes.usage;
+}
+
+
+static int _compareCacheEntry(const void *a, const void *b) {
+        pid_t x = ((const CacheEntry_T *)a)->pid, y = ((const CacheEntry_T *)b)->pid;
+        return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Initialize the cache entry of the process parsed from /proc/PID/stat. The valid cached attributes are
+ * kept, otherwise the entry is empty and the attributes are read. The refresh is staggered by the PID, so
+ * each scan reads 1/CACHE_REFRESH of the long running processes
+ */
+static void _cacheInit(CacheEntry_T *entry, Proc_T proc, time_t uptime) {
+        CacheEntry_T key = {.pid = proc->data.pid};
+        const CacheEntry_T *cached = _cache.count ? bsearch(&key, _cache.list, _cache.count, sizeof(CacheEntry_T), _compareCacheEntry) : NULL;
+        if (cached && cached->starttime == proc->data.item_starttime && _cache.scan < cached->expires && strncmp(cached->comm, proc->data.comm, sizeof(cached->comm) - 1) == 0) {
+                *entry = *cached;
+        } else {
+                *entry = (CacheEntry_T){.pid = proc->data.pid, .starttime = proc->data.item_starttime};
+                snprintf(entry->comm, sizeof(entry->comm), "%.*s", (int)sizeof(entry->comm) - 1, proc->data.comm);
+                entry->expires = uptime < CACHE_AGE ? _cache.scan + 1 : _cache.scan + 1 + (unsigned int)(proc->data.pid + CACHE_REFRESH - (_cache.scan + 1) % CACHE_REFRESH) % CACHE_REFRESH;
+        }
+}
+
+
+static char *_cacheCopy(const char *s) {
+        return s ? Arena_strdup(_cache.arena[_cache.current], s) : NULL;
+}
+
+
+// Rebuild the cache from the entries of the scanned processes
+static void _cacheUpdate(int count) {
+        _cache.current ^= 1;
+        if (_cache.arena[_cache.current])
+                Arena_reset(_cache.arena[_cache.current]);
+        else
+                _cache.arena[_cache.current] = Arena_new(65536);
+        if (count > _cache.size) {
+                _cache.size = count;
+                RESIZE(_cache.list, _cache.size * sizeof(CacheEntry_T));
+        }
+        for (int i = 0; i < count; i++) {
+                _cache.list[i] = _cache.entries[i];
+                _cache.list[i].cmdline = _cacheCopy(_cache.entries[i].cmdline);
+                _cache.list[i].cgroup = _cacheCopy(_cache.entries[i].cgroup);
+                _cache.list[i].secattr = _cacheCopy(_cache.entries[i].secattr);
+        }
+        _cache.count = count;
+        qsort(_cache.list, _cache.count, sizeof(CacheEntry_T), _compareCacheEntry);
+        _cache.scan++;
+}
+
+
 // parse /proc/PID/stat
 static bool _parseProcPidStat(Proc_T proc) {
-        char buf[8192];
-        char *tmp = NULL;
-        if (! file_readProc(buf, sizeof(buf), "stat", proc->data.pid, NULL)) {
+        char *buf, *tmp = NULL, *name = NULL;
+        if (! (buf = _readProc(proc, "stat", NULL))) {
                 DEBUG("system statistic error -- cannot read /proc/%d/stat\n", proc->data.pid);
                 return false;
         }
         // Skip the process name (can have multiple words)
-        if (! (tmp = strrchr(buf, ')'))) {
+        if (! (tmp = strrchr(buf, ')')) || ! (name = strchr(buf, '(')) || name > tmp) {
+                DEBUG("system statistic error -- file /proc/%d/stat parse error\n", proc->data.pid);
+                return false;
+        }
+        snprintf(proc->data.comm, sizeof(proc->data.comm), "%.*s", (int)(tmp - name - 1), name + 1);
+        // Parse only the used fields behind the name in one pass: state (3), ppid (4), utime, stime, cutime, cstime (14-17),
+        // threads (20), starttime (22) and rss (24). The fields are never negative for a live process
+        const char *cursor = tmp + 1;
+        unsigned long long ppid, times[4], threads, starttime, rss;
+        if (*cursor++ != ' ' || ! *cursor || *cursor == ' ') {
                 DEBUG("system statistic error -- file /proc/%d/stat parse error\n", proc->data.pid);
                 return false;
         }
-        if (sscanf(tmp + 2,
-                   "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %ld %ld %*d %*d %d %*u %llu %*u %ld %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %*d\n",
-                   &(proc->data.item_state),
-                   &(proc->data.ppid),
-                   &(proc->data.item_utime),
-                   &(proc->data.item_stime),
-                   &(proc->data.item_cutime),
-                   &(proc->data.item_cstime),
-                   &(proc->data.item_threads),
-                   &(proc->data.item_starttime),
-                   &(proc->data.item_rss)) != 9) {
+        proc->data.item_state = *cursor++;
+        if (! _parseUnsigned(&cursor, &ppid) ||
+            ! _skipFields(&cursor, 9) ||
+            ! _parseUnsigned(&cursor, &times[0]) ||
+            ! _parseUnsigned(&cursor, &times[1]) ||
+            ! _parseUnsigned(&cursor, &times[2]) ||
+            ! _parseUnsigned(&cursor, &times[3]) ||
+            ! _skipFields(&cursor, 2) ||
+            ! _parseUnsigned(&cursor, &threads) ||
+            ! _skipFields(&cursor, 1) ||
+            ! _parseUnsigned(&cursor, &starttime) ||
+            ! _skipFields(&cursor, 1) ||
+            ! _parseUnsigned(&cursor, &rss)) {
                 DEBUG("system statistic error -- file /proc/%d/stat parse error\n", proc->data.pid);
                 return false;
         }
+        proc->data.ppid = (pid_t)ppid;
+        proc->data.item_utime = (unsigned long)times[0];
+        proc->data.item_stime = (unsigned long)times[1];
+        proc->data.item_cutime = (long)times[2];
+        proc->data.item_cstime = (long)times[3];
+        proc->data.item_threads = (int)threads;
+        proc->data.item_starttime = starttime;
+        proc->data.item_rss = (long)rss;
         return true;
 }
 
 
 // parse /proc/PID/status
-static bool _parseProcPidStatus(Proc_T proc) {
-        char buf[4096];
-        char *tmp = NULL;
-        if (! file_readProc(buf, sizeof(buf), "status", proc->data.pid, NULL)) {
+static bool _parseProcPidStatus(Proc_T proc, CacheEntry_T *entry) {
+        if (entry->flags & Cache_Credentials) {
+                proc->data.uid = entry->uid;
+                proc->data.euid = entry->euid;
+                proc->data.gid = entry->gid;
+                return true;
+        }
+        char *buf;
+        const char *cursor;
+        unsigned long long uid, euid, gid;
+        if (! (buf = _readProc(proc, "status", NULL))) {
                 DEBUG("system statistic error -- cannot read /proc/%d/status\n", proc->data.pid);
                 return false;
         }
-        if (! (tmp = strstr(buf, "Uid:"))) {
+        if (! (cursor = _findLine(buf, "Uid:"))) {
                 DEBUG("system statistic error -- cannot find process uid\n");
                 return false;
         }
-        if (sscanf(tmp + 4, "\t%d\t%d", &(proc->data.uid), &(proc->data.euid)) != 2) {
+        if (! _parseUnsigned(&cursor, &uid) || ! _parseUnsigned(&cursor, &euid)) {
                 DEBUG("system statistic error -- cannot read process uid\n");
                 return false;
         }
-        if (! (tmp = strstr(buf, "Gid:"))) {
+        // The Gid line follows the Uid line
+        if (! (cursor = _findLine(cursor, "Gid:"))) {
                 DEBUG("system statistic error -- cannot find process gid\n");
                 return false;
         }
-        if (sscanf(tmp + 4, "\t%d", &(proc->data.gid)) != 1) {
+        if (! _parseUnsigned(&cursor, &gid)) {
                 DEBUG("system statistic error -- cannot read process gid\n");
                 return false;
         }
+        proc->data.uid = (int)uid;
+        proc->data.euid = (int)euid;
+        proc->data.gid = (int)gid;
+        entry->uid = proc->data.uid;
+        entry->euid = proc->data.euid;
+        entry->gid = proc->data.gid;
+        entry->flags |= Cache_Credentials;
         return true;
 }
 
 
 // parse /proc/PID/io
 static bool _parseProcPidIO(Proc_T proc) {
-        char buf[4096];
-        char *tmp = NULL;
+        char *buf;
         if (_statistics.hasIOStatistics) {
-                if (file_readProc(buf, sizeof(buf), "io", proc->data.pid, NULL)) {
+                if ((buf = _readProc(proc, "io", NULL))) {
+                        // The lines come in a fixed order, so the search continues from the last parsed line
+                        const char *cursor = buf;
                         // read bytes (total)
-                        if (! (tmp = strstr(buf, "rchar:"))) {
+                        if (! (cursor = _findLine(cursor, "rchar:"))) {
                                 DEBUG("system statistic error -- cannot find process read bytes\n");
                                 return false;
                         }
-                        if (sscanf(tmp + 6, "\t%llu", &(proc->data.read.bytes)) != 1) {
+                        if (! _parseUnsigned(&cursor, &(proc->data.read.bytes))) {
                                 DEBUG("system statistic error -- cannot get process read bytes\n");
                                 return false;
                         }
                         // write bytes (total)
-                        if (! (tmp = strstr(tmp, "wchar:"))) {
+                        if (! (cursor = _findLine(cursor, "wchar:"))) {
                                 DEBUG("system statistic error -- cannot find process write bytes\n");
                                 return false;
                         }
-                        if (sscanf(tmp + 6, "\t%llu", &(proc->data.write.bytes)) != 1) {
+                        if (! _parseUnsigned(&cursor, &(proc->data.write.bytes))) {
                                 DEBUG("system statistic error -- cannot get process write bytes\n");
                                 return false;
                         }
                         // read operations
-                        if (! (tmp = strstr(tmp, "syscr:"))) {
+                        if (! (cursor = _findLine(cursor, "syscr:"))) {
                                 DEBUG("system statistic error -- cannot find process read system calls count\n");
                                 return false;
                         }
-                        if (sscanf(tmp + 6, "\t%llu", &(proc->data.read.operations)) != 1) {
+                        if (! _parseUnsigned(&cursor, &(proc->data.read.operations))) {
                                 DEBUG("system statistic error -- cannot get process read system calls count\n");
                                 return false;
                         }
                         // write operations
-                        if (! (tmp = strstr(tmp, "syscw:"))) {
+                        if (! (cursor = _findLine(cursor, "syscw:"))) {
                                 DEBUG("system statistic error -- cannot find process write system calls count\n");
                                 return false;
                         }
-                        if (sscanf(tmp + 6, "\t%llu", &(proc->data.write.operations)) != 1) {
+                        if (! _parseUnsigned(&cursor, &(proc->data.write.operations))) {
                                 DEBUG("system statistic error -- cannot get process write system calls count\n");
                                 return false;
                         }
                         // read bytes (physical I/O)
-                        if (! (tmp = strstr(tmp, "read_bytes:"))) {
+                        if (! (cursor = _findLine(cursor, "read_bytes:"))) {
                                 DEBUG("system statistic error -- cannot find process physical read bytes\n");
                                 return false;
                         }
-                        if (sscanf(tmp + 11, "\t%llu", &(proc->data.read.bytesPhysical)) != 1) {
+                        if (! _parseUnsigned(&cursor, &(proc->data.read.bytesPhysical))) {
                                 DEBUG("system statistic error -- cannot get process physical read bytes\n");
                                 return false;
                         }
                         // write bytes (physical I/O)
-                        if (! (tmp = strstr(tmp, "write_bytes:"))) {
+                        if (! (cursor = _findLine(cursor, "write_bytes:"))) {
                                 DEBUG("system statistic error -- cannot find process physical write bytes\n");
                                 return false;
                         }
-                        if (sscanf(tmp + 12, "\t%llu", &(proc->data.write.bytesPhysical)) != 1) {
+                        if (! _parseUnsigned(&cursor, &(proc->data.write.bytesPhysical))) {
                                 DEBUG("system statistic error -- cannot get process physical write bytes\n");
                                 return false;
                         }
                 } else {
-                        // file_readProc() already printed a DEBUG() message
+                        // _readProc() already printed a DEBUG() message
                         // return false;
                         // sometimes no io data is available, this is not a problem.
                         return true;
@@ -319,117 +978,348 @@ static bool _parseProcPidIO(Proc_T proc) {
 
 
 // parse /proc/PID/cmdline
-static bool _parseProcPidCmdline(Proc_T proc, ProcessEngine_Flags pflags) {
+static bool _parseProcPidCmdline(Proc_T proc, ProcessEngine_Flags pflags, CacheEntry_T *entry) {
         if (pflags & ProcessEngine_CollectCommandLine) {
-                char filename[STRLEN];
+                if (entry->flags & Cache_Cmdline) {
+                        proc->data.cmdline = ProcessTree_strdup(entry->cmdline);
+                        return true;
+                }
                 // Try to collect the command-line from the procfs cmdline (user-space processes)
-                snprintf(filename, sizeof(filename), "/proc/%d/cmdline", proc->data.pid);
-                FILE *f = fopen(filename, "r");
-                if (! f) {
-                        DEBUG("system statistic error -- cannot open /proc/%d/cmdline: %s\n", proc->data.pid, STRERROR);
+                size_t length;
+                char *buf = _readProc(proc, "cmdline", &length);
+                if (! buf) {
+                        DEBUG("system statistic error -- cannot read /proc/%d/cmdline\n", proc->data.pid);
                         return false;
                 }
-                size_t n;
-                char buf[STRLEN] = {};
-                while ((n = fread(buf, 1, sizeof(buf) - 1, f)) > 0) {
-                        // The cmdline file contains argv elements/strings separated by '\0' => join the string
-                        for (size_t i = 0; i < n; i++) {
-                                if (buf[i] == 0)
-                                        StringBuffer_append(proc->name, " ");
-                                else
-                                        StringBuffer_append(proc->name, "%c", buf[i]);
-                        }
+                // The cmdline file contains argv elements/strings separated by '\0' => join the string
+                for (size_t i = 0; i < length; i++) {
+                        if (buf[i] == 0)
+                                buf[i] = ' ';
                 }
-                fclose(f);
-                StringBuffer_trim(proc->name);
+                buf = Str_trim(buf);
                 // Fallback to procfs stat process name if cmdline was empty (even kernel-space processes have information here)
-                if (! StringBuffer_length(proc->name)) {
-                        char buffer[8192];
-                        char *tmp = NULL;
-                        char *procname = NULL;
-                        if (! file_readProc(buffer, sizeof(buffer), "stat", proc->data.pid, NULL)) {
-                                DEBUG("system statistic error -- cannot read /proc/%d/stat\n", proc->data.pid);
-                                return false;
-                        }
-                        if (! (tmp = strrchr(buffer, ')'))) {
-                                DEBUG("system statistic error -- file /proc/%d/stat parse error\n", proc->data.pid);
-                                return false;
-                        }
-                        *tmp = 0;
-                        if (! (procname = strchr(buffer, '('))) {
-                                DEBUG("system statistic error -- file /proc/%d/stat parse error\n", proc->data.pid);
-                                return false;
-                        }
-                        StringBuffer_append(proc->name, "%s", procname + 1);
-                }
+                proc->data.cmdline = ProcessTree_strdup(*buf ? buf : proc->data.comm);
+                entry->cmdline = proc->data.cmdline;
+                entry->flags |= Cache_Cmdline;
         }
         return true;
 }
 
 
+// parse /proc/PID/cgroup, the cgroup is collected with the command line for the cgroup scoped services
+static void _parseProcPidCgroup(Proc_T proc, ProcessEngine_Flags pflags, CacheEntry_T *entry) {
+        if ((pflags & ProcessEngine_CollectCommandLine) && (pflags & ProcessEngine_CollectCgroup)) {
+                if (entry->flags & Cache_Cgroup) {
+                        proc->data.cgroup = ProcessTree_strdup(entry->cgroup);
+                        return;
+                }
+                char *buf = _readProc(proc, "cgroup", NULL);
+                char *cgroup = buf ? Cgroup_parse(buf) : NULL;
+                if (cgroup)
+                        proc->data.cgroup = ProcessTree_strdup(cgroup);
+                // The process without the cgroup v2 entry is cached too
+                if (buf) {
+                        entry->cgroup = proc->data.cgroup;
+                        entry->flags |= Cache_Cgroup;
+                }
+        }
+}
+
+
 // parse /proc/PID/attr/current
-static bool _parseProcPidAttrCurrent(Proc_T proc) {
-        if (file_readProc(proc->data.secattr, sizeof(proc->data.secattr), "attr/current", proc->data.pid, NULL)) {
-                Str_trim(proc->data.secattr);
-                return true;
+static bool _parseProcPidAttrCurrent(Proc_T proc, CacheEntry_T *entry) {
+        if (entry->flags & Cache_Secattr) {
+                proc->data.secattr = ProcessTree_strdup(entry->secattr);
+                return proc->data.secattr != NULL;
         }
-        return false;
+        char *buf = _readProc(proc, "attr/current", NULL);
+        if (buf)
+                proc->data.secattr = ProcessTree_strdup(Str_trim(buf));
+        // The missing attribute (no security module) is cached too
+        entry->secattr = proc->data.secattr;
+        entry->flags |= Cache_Secattr;
+        return buf != NULL;
 }
 
-// count entries in /proc/PID/fd
-static bool _parseProcFdCount(Proc_T proc) {
-        char path[PATH_MAX] = {};
-        unsigned long long file_count = 0;
 
-        snprintf(path, sizeof(path), "/proc/%d/fd", proc->data.pid);
-        DIR *dirp = opendir(path);
-        if (! dirp) {
-                DEBUG("system statistic error -- opendir %s: %s\n", path, STRERROR);
-                return false;
+/**
+ * The state of the /proc/PID/fd walk: the descriptors are counted and if the sockets are requested,
+ * each descriptor is resolved to find the TCP sockets
+ */
+typedef struct FdScan_T {
+        int fd;
+        long long count;
+        ProcessSockets_T *sockets;
+} FdScan_T;
+
+
+static void _addDescriptor(const char *name, void *ap) {
+        FdScan_T *scan = ap;
+        if (*name >= '0' && *name <= '9') {
+                scan->count++;
+                struct stat st;
+                // The socket descriptor links to the socket inode, fstatat follows the link
+                if (scan->sockets && fstatat(scan->fd, name, &st, 0) == 0 && S_ISSOCK(st.st_mode))
+                        ProcessSocket_add(st.st_ino, scan->sockets);
+        }
+}
+
+
+// Count the getdents64 records of the directory, only the dot entries are skipped by the name
+static bool _countDirectory(ProcBuffer_T *buffer, int fd, long long *count) {
+        long bytes;
+        while ((bytes = syscall(SYS_getdents64, fd, buffer->data, buffer->size)) > 0) {
+                for (long offset = 0; offset < bytes;) {
+                        Dirent64_T *entry = (Dirent64_T *)(buffer->data + offset);
+                        if (*entry->d_name != '.')
+                                (*count)++;
+                        offset += entry->d_reclen;
+                }
         }
-        errno = 0;
-        while (readdir(dirp) != NULL) {
-                // count everything
-                file_count++;
+        return bytes == 0;
+}
+
+
+/**
+ * Walk /proc/PID/fd once for the descriptors count and the TCP sockets of the process. If only the count
+ * is needed, it is the directory size (Linux 6.2 and later), otherwise the getdents64 records are read in
+ * large batches
+ * @param proc The process
+ * @param sockets The TCP connections of the process or NULL if not requested
+ * @return true if succeeded
+ */
+static bool _parseProcPidFd(Proc_T proc, ProcessSockets_T *sockets) {
+        char path[64];
+        snprintf(path, sizeof(path), "%d/fd", proc->data.pid);
+        struct stat st;
+        if (! sockets && fstatat(_proc.fd, path, &st, 0) == 0 && st.st_size > 0) {
+                proc->data.filedescriptors.open = st.st_size;
+                return true;
         }
-        // do not closedir() until readdir errno has been evaluated
-        if (errno) {
-                DEBUG("system statistic error -- cannot iterate %s: %s\n", path, STRERROR);
-                closedir(dirp);
+        FdScan_T scan = {.fd = openat(_proc.fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC), .sockets = sockets};
+        if (scan.fd < 0) {
+                DEBUG("system statistic error -- cannot open /proc/%s: %s\n", path, STRERROR);
                 return false;
         }
-        closedir(dirp);
-        // assert at least '.' and '..' have been found
-        if (file_count < 2) {
-                DEBUG("system statistic error -- cannot find basic entries in %s\n", path);
-                return false;
+        // The process with many descriptors is read in batches of ~10000 entries
+        if (proc->buffer->size < FD_BUFFER_SIZE) {
+                proc->buffer->size = FD_BUFFER_SIZE;
+                RESIZE(proc->buffer->data, proc->buffer->size);
         }
-        // subtract entries '.' and '..'
-        proc->data.filedescriptors.open = file_count - 2;
+        bool rv = sockets ? _readDirectory(proc->buffer, scan.fd, _addDescriptor, &scan) : _countDirectory(proc->buffer, scan.fd, &scan.count);
+        if (! rv)
+                DEBUG("system statistic error -- cannot iterate /proc/%s: %s\n", path, STRERROR);
+        close(scan.fd);
+        if (rv)
+                proc->data.filedescriptors.open = scan.count;
+        return rv;
+}
 
-        // get process's limits
-        snprintf(path, sizeof(path), "/proc/%d/limits", proc->data.pid);
-        FILE *f = fopen(path, "r");
-        if (f) {
-                int softLimit;
-                int hardLimit;
-                char line[STRLEN];
-                while (fgets(line, sizeof(line), f)) {
-                        if (sscanf(line, "Max open files %d %d", &softLimit, &hardLimit) == 2) {
-                                proc->data.filedescriptors.limit.soft = softLimit;
-                                proc->data.filedescriptors.limit.hard = hardLimit;
-                                break;
-                        }
+
+static void _addSample(ThreadSamples_T *samples, pid_t tid, unsigned long long ticks) {
+        if (samples->count == samples->size) {
+                samples->size = samples->size ? samples->size * 2 : 64;
+                RESIZE(samples->list, samples->size * sizeof(ThreadSample_T));
+        }
+        samples->list[samples->count++] = (ThreadSample_T){.tid = tid, .ticks = ticks};
+}
+
+
+static void _addTid(const char *name, void *ap) {
+        if (*name >= '1' && *name <= '9')
+                _addSample(ap, atoi(name), 0ULL);
+}
+
+
+static int _compareSample(const void *a, const void *b) {
+        pid_t x = ((const ThreadSample_T *)a)->tid, y = ((const ThreadSample_T *)b)->tid;
+        return x < y ? -1 : x > y;
+}
+
+
+// Get the CPU usage of the busiest thread of the process in percent of one CPU since the previous scan, -1 if unknown
+static float _parseProcPidTask(Proc_T proc) {
+        char path[64];
+        snprintf(path, sizeof(path), "%d/task", proc->data.pid);
+        int fd = openat(_proc.fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+                DEBUG("system statistic error -- cannot open /proc/%s: %s\n", path, STRERROR);
+                return -1.;
+        }
+        // The thread IDs are collected first, the directory entries are in the buffer used by _readProc()
+        ThreadSamples_T samples = {};
+        bool rv = _readDirectory(proc->buffer, fd, _addTid, &samples);
+        close(fd);
+        float max = -1.;
+        double elapsed = (double)(_threads.time - _threads.previousTime) / 1000.;
+        for (int i = 0; rv && i < samples.count; i++) {
+                snprintf(path, sizeof(path), "task/%d/stat", samples.list[i].tid);
+                char *buf = _readProc(proc, path, NULL);
+                // The utime and stime are the fields 14 and 15 behind the name, which may contain blanks and parentheses
+                const char *cursor = buf ? strrchr(buf, ')') : NULL;
+                unsigned long long utime, stime;
+                if (! cursor || ! _skipFields(&cursor, 12) || ! _parseUnsigned(&cursor, &utime) || ! _parseUnsigned(&cursor, &stime)) {
+                        // The thread exited
+                        samples.list[i].tid = 0;
+                        continue;
                 }
-                fclose(f);
+                samples.list[i].ticks = utime + stime;
+                const ThreadSample_T *previous = _threads.previous.count && _threads.previousTime ? bsearch(&samples.list[i], _threads.previous.list, _threads.previous.count, sizeof(ThreadSample_T), _compareSample) : NULL;
+                // The thread started since the previous scan is measured since the next scan
+                if (previous && elapsed > 0. && samples.list[i].ticks >= previous->ticks) {
+                        float usage = 100. * (samples.list[i].ticks - previous->ticks) / hz / elapsed;
+                        if (usage > max)
+                                max = usage;
+                }
+        }
+        LOCK(_threads.mutex)
+        {
+                for (int i = 0; i < samples.count; i++)
+                        if (samples.list[i].tid)
+                                _addSample(&_threads.current, samples.list[i].tid, samples.list[i].ticks);
+        }
+        END_LOCK;
+        FREE(samples.list);
+        return max;
+}
+
+
+/**
+ * Read the proportional (PSS) and unique (USS) set size of the process from /proc/PID/smaps_rollup (Linux >= 4.14).
+ * The PSS splits the shared pages between the processes which map them, the USS counts the private pages only, so
+ * it is the memory which would be freed if the process exited. The kernel walks the page tables of the process to
+ * produce the file, it's thus read for the monitored processes only and only if some rule tests it
+ */
+static void _parseProcPidSmapsRollup(Proc_T proc, ProcessTree_T *pt) {
+        char *buf = _readProc(proc, "smaps_rollup", NULL);
+        if (! buf)
+                return;
+        // The lines come in a fixed order: Rss, Pss, ..., Private_Clean, Private_Dirty, the values are in kB
+        unsigned long long pss, privateClean, privateDirty;
+        const char *cursor = buf;
+        if (! (cursor = _findLine(cursor, "Pss:")) || ! _parseUnsigned(&cursor, &pss)) {
+                DEBUG("system statistic error -- cannot get process PSS\n");
+                return;
+        }
+        if (! (cursor = _findLine(cursor, "Private_Clean:")) || ! _parseUnsigned(&cursor, &privateClean) || ! (cursor = _findLine(cursor, "Private_Dirty:")) || ! _parseUnsigned(&cursor, &privateDirty)) {
+                DEBUG("system statistic error -- cannot get process USS\n");
+                return;
+        }
+        pt->memory.pss = pss * 1024;
+        pt->memory.uss = (privateClean + privateDirty) * 1024;
+}
+
+
+// Start the thread samples of the scan, the samples of the current scan become the previous ones
+static void _threadsInit(ProcessEngine_Flags pflags) {
+        ThreadSamples_T swap = _threads.previous;
+        _threads.previous = _threads.current;
+        _threads.current = swap;
+        _threads.current.count = 0;
+        _threads.previousTime = _threads.time;
+        // The samples are dropped if no rule tests the threads, so the stale samples are not used when it is added by reload
+        if (! (pflags & ProcessEngine_CollectThreads)) {
+                _threads.previous.count = 0;
+                _threads.time = _threads.previousTime = 0ULL;
         } else {
-                DEBUG("system statistic error -- cannot open %s\n", path);
-                return false;
+                _threads.time = Time_milli();
         }
+}
+
 
+// get the process's limit of the open files, from the system call if the process runs on this host
+static bool _parseProcPidLimits(Proc_T proc, CacheEntry_T *entry) {
+        if (entry->flags & Cache_Limits) {
+                proc->data.filedescriptors.limit.soft = entry->soft;
+                proc->data.filedescriptors.limit.hard = entry->hard;
+                return true;
+        }
+        struct rlimit limit;
+        if (_proc.native && prlimit(proc->data.pid, RLIMIT_NOFILE, NULL, &limit) == 0) {
+                proc->data.filedescriptors.limit.soft = limit.rlim_cur == RLIM_INFINITY ? 0 : (long long)limit.rlim_cur;
+                proc->data.filedescriptors.limit.hard = limit.rlim_max == RLIM_INFINITY ? 0 : (long long)limit.rlim_max;
+        } else {
+                char *buf = _readProc(proc, "limits", NULL);
+                if (! buf) {
+                        DEBUG("system statistic error -- cannot read /proc/%d/limits\n", proc->data.pid);
+                        return false;
+                }
+                char *line = strstr(buf, "Max open files");
+                int softLimit;
+                int hardLimit;
+                if (line && sscanf(line, "Max open files %d %d", &softLimit, &hardLimit) == 2) {
+                        proc->data.filedescriptors.limit.soft = softLimit;
+                        proc->data.filedescriptors.limit.hard = hardLimit;
+                }
+        }
+        entry->soft = proc->data.filedescriptors.limit.soft;
+        entry->hard = proc->data.filedescriptors.limit.hard;
+        entry->flags |= Cache_Limits;
         return true;
 }
 
+
+typedef enum {
+        _Collect_Unknown = 0,
+        _Collect_Pending,
+        _Collect_Yes,
+        _Collect_No
+} __attribute__((__packed__)) _Collect_Type;
+
+
+typedef struct ProcIndex_T {
+        pid_t pid;
+        int index;
+} ProcIndex_T;
+
+
+static int _compareProcIndex(const void *a, const void *b) {
+        pid_t x = ((const ProcIndex_T *)a)->pid, y = ((const ProcIndex_T *)b)->pid;
+        return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Test if the process or some of its ancestors is monitored. The result is cached in the collect array
+ */
+static _Collect_Type _collectProcess(ProcessTree_T *pt, ProcIndex_T *index, int count, int8_t *collect, int i) {
+        if (collect[i] == _Collect_Unknown) {
+                collect[i] = _Collect_Pending; // Guard against the cycle
+                if (ProcessTree_isMonitored(pt[i].pid)) {
+                        collect[i] = _Collect_Yes;
+                } else {
+                        ProcIndex_T key = {.pid = pt[i].ppid};
+                        ProcIndex_T *parent = pt[i].ppid != pt[i].pid ? bsearch(&key, index, count, sizeof(ProcIndex_T), _compareProcIndex) : NULL;
+                        collect[i] = parent ? _collectProcess(pt, index, count, collect, parent->index) : _Collect_No;
+                }
+        }
+        return collect[i] == _Collect_Yes ? _Collect_Yes : _Collect_No;
+}
+
+
+/**
+ * Select the processes whose details should be collected
+ * @return The array with _Collect_Yes for each process whose details should be collected
+ */
+static int8_t *_collectDetails(ProcessTree_T *pt, int count, ProcessEngine_Flags pflags) {
+        int8_t *collect = CALLOC(count > 0 ? count : 1, sizeof(int8_t));
+        if (pflags & ProcessEngine_CollectMonitoredOnly) {
+                if (count > 0) {
+                        ProcIndex_T *index = CALLOC(count, sizeof(ProcIndex_T));
+                        for (int i = 0; i < count; i++)
+                                index[i] = (ProcIndex_T){.pid = pt[i].pid, .index = i};
+                        qsort(index, count, sizeof(ProcIndex_T), _compareProcIndex);
+                        for (int i = 0; i < count; i++)
+                                _collectProcess(pt, index, count, collect, i);
+                        FREE(index);
+                }
+        } else {
+                memset(collect, _Collect_Yes, count);
+        }
+        return collect;
+}
+
+
 static double _usagePercent(unsigned long long previous, unsigned long long current, double total) {
         if (current < previous) {
                 // The counter jumped back (observed for cpu wait metric on Linux 4.15) or wrapped
@@ -461,6 +1351,8 @@ bool init_process_info_sysdep(void) {
                 systeminfo.cpu.count = 1;
         }
 
+        _cpusResize(systeminfo.cpu.count);
+
         FILE *f = fopen("/proc/meminfo", "r");
         if (f) {
                 char line[STRLEN];
@@ -499,7 +1391,202 @@ bool init_process_info_sysdep(void) {
 
 
 /**
- * Read all processes of the proc files system to initialize the process tree
+ * Slice of the processes scanned by one thread
+ */
+typedef struct ProcScan_T {
+        ProcessTree_T *pt;                   // Process tree
+        int8_t *collect;                     // Details selection (second pass)
+        int first;                           // First PID (first pass) or process tree entry (second pass) of the slice
+        int last;                            // Behind the last PID or entry of the slice
+        int count;                           // Number of processes found by the first pass
+        time_t starttime;
+        ProcessEngine_Flags pflags;
+        bool accounting;                     // The eBPF counters are available
+        bool sockets;                        // The TCP sockets snapshot is available
+        ProcBuffer_T *buffer;
+} ProcScan_T;
+
+
+// Collect the basic data for the PIDs of the slice. The processes are stored from the slice start
+static void *_scanProcesses(void *args) {
+        ProcScan_T *scan = args;
+        ProcessTree_T *pt = scan->pt + scan->first;
+        CacheEntry_T *entries = _cache.entries + scan->first;
+        struct Proc_T proc = {.buffer = scan->buffer};
+        for (int i = scan->first; i < scan->last; i++) {
+                proc.data.pid = _proc.pids.list[i];
+                if (! _parseProcPidStat(&proc)) {
+                        memset(&proc.data, 0, sizeof(proc.data));
+                        continue;
+                }
+                int count = scan->count;
+                time_t uptime = scan->starttime > 0 ? (systeminfo.time / 10. - (scan->starttime + (time_t)(proc.data.item_starttime / hz))) : 0;
+                _cacheInit(&entries[count], &proc, uptime);
+                if (_parseProcPidCmdline(&proc, scan->pflags, &entries[count])) {
+                        _parseProcPidCgroup(&proc, scan->pflags, &entries[count]);
+                        // Set the data in ptree only if all process related reads succeeded (prevent partial data in the case that continue was called during data collecting)
+                        pt[count].pid = proc.data.pid;
+                        pt[count].ppid = proc.data.ppid;
+                        pt[count].threads.self = proc.data.item_threads;
+                        pt[count].uptime = uptime;
+                        pt[count].starttime = proc.data.item_starttime;
+                        pt[count].cpu.time = (double)(proc.data.item_utime + proc.data.item_stime) / hz * 10.; // jiffies -> seconds = 1/hz
+                        if (scan->accounting) {
+                                // The eBPF cpu time since the accounting started (the process without counters didn't run since then) in nanoseconds
+                                const ProcessCounters_T *counters = ProcessBPF_get(proc.data.pid);
+                                pt[count].cpu.time = counters ? (double)counters->cpu / 1e8 : 0.;
+                        }
+                        pt[count].memory.usage = (unsigned long long)proc.data.item_rss * (unsigned long long)page_size;
+                        pt[count].read.bytes = pt[count].read.bytesPhysical = pt[count].read.operations = -1LL;
+                        pt[count].write.bytes = pt[count].write.bytesPhysical = pt[count].write.operations = -1LL;
+                        pt[count].threads.cpu = -1.;
+                        pt[count].memory.pss = pt[count].memory.uss = -1LL;
+                        pt[count].zombie = proc.data.item_state == 'Z' ? true : false;
+                        pt[count].cmdline = proc.data.cmdline;
+                        pt[count].cgroup = proc.data.cgroup;
+                        scan->count++;
+                }
+                // Clear
+                memset(&proc.data, 0, sizeof(proc.data));
+        }
+        return NULL;
+}
+
+
+// Collect the details of the selected processes of the slice
+static void *_scanDetails(void *args) {
+        ProcScan_T *scan = args;
+        ProcessTree_T *pt = scan->pt;
+        struct Proc_T proc = {.buffer = scan->buffer};
+        for (int i = scan->first; i < scan->last; i++) {
+                if (scan->collect[i] == _Collect_Yes) {
+                        proc.data.pid = pt[i].pid;
+                        CacheEntry_T *entry = &_cache.entries[i];
+                        if (_parseProcPidStatus(&proc, entry)) {
+                                pt[i].cred.uid = proc.data.uid;
+                                pt[i].cred.euid = proc.data.euid;
+                                pt[i].cred.gid = proc.data.gid;
+                        }
+                        const ProcessCounters_T *counters = scan->accounting ? ProcessBPF_get(pt[i].pid) : NULL;
+                        if (scan->accounting && ! (scan->pflags & ProcessEngine_CollectPhysicalIO)) {
+                                // The eBPF counters replace /proc/PID/io unless the physical I/O is tested
+                                pt[i].read.bytes = counters ? counters->readBytes : 0LL;
+                                pt[i].read.operations = counters ? counters->readOperations : 0LL;
+                                pt[i].write.bytes = counters ? counters->writeBytes : 0LL;
+                                pt[i].write.operations = counters ? counters->writeOperations : 0LL;
+                                pt[i].read.time = pt[i].write.time = Time_milli();
+                        } else if (_parseProcPidIO(&proc)) {
+                                pt[i].read.bytes = proc.data.read.bytes;
+                                pt[i].read.bytesPhysical = proc.data.read.bytesPhysical;
+                                pt[i].read.operations = proc.data.read.operations;
+                                pt[i].write.bytes = proc.data.write.bytes;
+                                pt[i].write.bytesPhysical = proc.data.write.bytesPhysical;
+                                pt[i].write.operations = proc.data.write.operations;
+                                pt[i].read.time = pt[i].write.time = Time_milli();
+                        }
+                        // Non-mandatory statistics (may not exist)
+                        bool filedescriptors = scan->pflags & ProcessEngine_CollectFiledescriptors;
+                        ProcessSockets_T sockets = {};
+                        bool fd = (filedescriptors || scan->sockets) && _parseProcPidFd(&proc, scan->sockets ? &sockets : NULL);
+                        if (fd && filedescriptors && _parseProcPidLimits(&proc, entry)) {
+                                pt[i].filedescriptors.usage = proc.data.filedescriptors.open;
+                                pt[i].filedescriptors.limit.soft = proc.data.filedescriptors.limit.soft;
+                                pt[i].filedescriptors.limit.hard = proc.data.filedescriptors.limit.hard;
+                        }
+                        if (_parseProcPidAttrCurrent(&proc, entry))
+                                pt[i].secattr = proc.data.secattr;
+                        if (scan->pflags & ProcessEngine_CollectThreads)
+                                pt[i].threads.cpu = _parseProcPidTask(&proc);
+                        if (scan->pflags & ProcessEngine_CollectSmaps)
+                                _parseProcPidSmapsRollup(&proc, &pt[i]);
+                        if (scan->pflags & ProcessEngine_CollectDelay) {
+                                ProcessDelay_T delay = {};
+                                if (ProcessTaskstats_get(pt[i].pid, &delay)) {
+                                        pt[i].delay.io = delay.io;
+                                        pt[i].delay.time = Time_milli();
+                                }
+                        }
+                        if (scan->accounting) {
+                                pt[i].tcp.sent = counters ? counters->tcpSent : 0LL;
+                                pt[i].tcp.received = counters ? counters->tcpReceived : 0LL;
+                                pt[i].tcp.time = Time_milli();
+                        }
+                        if (fd && scan->sockets) {
+                                pt[i].connections.total = sockets.total;
+                                pt[i].connections.established = sockets.established;
+                                pt[i].connections.listen = sockets.listen;
+                                pt[i].connections.closeWait = sockets.closeWait;
+                                pt[i].connections.time = Time_milli();
+                                if (! scan->accounting) {
+                                        // The bytes since the previous scan, summed with the previous total by the process tree
+                                        pt[i].tcp.sent = sockets.sent;
+                                        pt[i].tcp.received = sockets.received;
+                                        pt[i].tcp.delta = true;
+                                        pt[i].tcp.time = pt[i].connections.time;
+                                }
+                        }
+                        memset(&proc.data, 0, sizeof(proc.data));
+                }
+        }
+        return NULL;
+}
+
+
+static void *_scanThread(void *args) {
+        set_signal_block();
+        ProcScan_T *scan = args;
+        return scan->collect ? _scanDetails(scan) : _scanProcesses(scan);
+}
+
+
+/**
+ * Get the number of scanner threads for the given number of processes. If not set in the
+ * control file, the threads are used only on big hosts: one thread per 4 CPUs (at most 8)
+ * if there are at least 8192 processes
+ */
+static int _scanners(int count) {
+        int scanners = Run.processscanners;
+        if (scanners <= 0)
+                scanners = count >= 8192 ? MIN(systeminfo.cpu.count / 4, 8) : 1;
+        scanners = MIN(scanners, count / PROC_SCAN_SLICE);
+        return MAX(scanners, 1);
+}
+
+
+/**
+ * Split the range to the slices and scan them in parallel. The first slice is scanned by the calling thread
+ */
+static void _scan(ProcScan_T *scan, int scanners, int count) {
+        if (_proc.buffers.count < scanners) {
+                RESIZE(_proc.buffers.list, scanners * sizeof(ProcBuffer_T));
+                memset(_proc.buffers.list + _proc.buffers.count, 0, (scanners - _proc.buffers.count) * sizeof(ProcBuffer_T));
+                _proc.buffers.count = scanners;
+        }
+        for (int i = 0; i < scanners; i++) {
+                scan[i] = scan[0];
+                scan[i].first = (int)((long long)count * i / scanners);
+                scan[i].last = (int)((long long)count * (i + 1) / scanners);
+                scan[i].count = 0;
+                scan[i].buffer = &_proc.buffers.list[i];
+        }
+        Thread_T threads[scanners];
+        for (int i = 1; i < scanners; i++)
+                Thread_create(threads[i], _scanThread, &scan[i]);
+        if (scan[0].collect)
+                _scanDetails(&scan[0]);
+        else
+                _scanProcesses(&scan[0]);
+        for (int i = 1; i < scanners; i++)
+                Thread_join(threads[i]);
+}
+
+
+/**
+ * Read all processes of the proc files system to initialize the process tree. The basic
+ * data, required to build the tree, is collected for all processes. The details (credentials,
+ * I/O, filedescriptors and security attributes) are collected in second pass, if the
+ * ProcessEngine_CollectMonitoredOnly flag is set only for monitored processes and their children.
+ * On big hosts the processes are split to slices, which are scanned in parallel
  * @param reference reference of ProcessTree
  * @param pflags Process engine flags
  * @return treesize > 0 if succeeded otherwise 0
@@ -508,59 +1595,39 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
         ASSERT(reference);
 
         // Find all processes in the /proc directory
-        glob_t globbuf;
-        int rv = glob("/proc/[0-9]*", 0, NULL, &globbuf);
-        if (rv) {
-                Log_error("system statistic error -- glob failed: %d (%s)\n", rv, STRERROR);
+        if (! _scanProc() || _proc.pids.count == 0)
                 return 0;
+        ProcessTree_T *pt = CALLOC(sizeof(ProcessTree_T), _proc.pids.count);
+        if (_cache.entriesSize < _proc.pids.count) {
+                _cache.entriesSize = _proc.pids.count;
+                RESIZE(_cache.entries, _cache.entriesSize * sizeof(CacheEntry_T));
         }
-        ProcessTree_T *pt = CALLOC(sizeof(ProcessTree_T), globbuf.gl_pathc);
-
 
-        int count = 0;
-        struct Proc_T proc = {
-                .name = StringBuffer_create(64)
-        };
-        time_t starttime = _getStartTime();
-        for (size_t i = 0; i < globbuf.gl_pathc; i++) {
-                proc.data.pid = atoi(globbuf.gl_pathv[i] + 6); // skip "/proc/"
-                if (_parseProcPidStat(&proc) && _parseProcPidStatus(&proc) && _parseProcPidIO(&proc) && _parseProcPidCmdline(&proc, pflags)) {
-                        // Non-mandatory statistics (may not exist)
-                        _parseProcFdCount(&proc);
-                        _parseProcPidAttrCurrent(&proc);
-                        // Set the data in ptree only if all process related reads succeeded (prevent partial data in the case that continue was called during data collecting)
-                        pt[count].pid = proc.data.pid;
-                        pt[count].ppid = proc.data.ppid;
-                        pt[count].cred.uid = proc.data.uid;
-                        pt[count].cred.euid = proc.data.euid;
-                        pt[count].cred.gid = proc.data.gid;
-                        pt[count].threads.self = proc.data.item_threads;
-                        pt[count].uptime = starttime > 0 ? (systeminfo.time / 10. - (starttime + (time_t)(proc.data.item_starttime / hz))) : 0;
-                        pt[count].cpu.time = (double)(proc.data.item_utime + proc.data.item_stime) / hz * 10.; // jiffies -> seconds = 1/hz
-                        pt[count].memory.usage = (unsigned long long)proc.data.item_rss * (unsigned long long)page_size;
-                        pt[count].read.bytes = proc.data.read.bytes;
-                        pt[count].read.bytesPhysical = proc.data.read.bytesPhysical;
-                        pt[count].read.operations = proc.data.read.operations;
-                        pt[count].write.bytes = proc.data.write.bytes;
-                        pt[count].write.bytesPhysical = proc.data.write.bytesPhysical;
-                        pt[count].write.operations = proc.data.write.operations;
-                        pt[count].read.time = pt[count].write.time = Time_milli();
-                        pt[count].zombie = proc.data.item_state == 'Z' ? true : false;
-                        pt[count].cmdline = Str_dup(StringBuffer_toString(proc.name));
-                        pt[count].secattr = Str_dup(proc.data.secattr);
-                        pt[count].filedescriptors.usage = proc.data.filedescriptors.open;
-                        pt[count].filedescriptors.limit.soft = proc.data.filedescriptors.limit.soft;
-                        pt[count].filedescriptors.limit.hard = proc.data.filedescriptors.limit.hard;
-                        count++;
-                        // Clear
-                        memset(&proc.data, 0, sizeof(proc.data));
-                        StringBuffer_clear(proc.name);
-                }
+        int scanners = _scanners(_proc.pids.count);
+        ProcScan_T scan[scanners];
+        scan[0] = (ProcScan_T){.pt = pt, .starttime = _getStartTime(), .pflags = pflags, .accounting = ProcessBPF_collect()};
+        _scan(scan, scanners, _proc.pids.count);
+        // Merge the slices
+        int count = scan[0].count;
+        for (int i = 1; i < scanners; i++) {
+                memmove(pt + count, pt + scan[i].first, scan[i].count * sizeof(ProcessTree_T));
+                memmove(_cache.entries + count, _cache.entries + scan[i].first, scan[i].count * sizeof(CacheEntry_T));
+                count += scan[i].count;
         }
-        StringBuffer_free(&(proc.name));
+        memset(pt + count, 0, (_proc.pids.count - count) * sizeof(ProcessTree_T));
+
+        // Collect the details
+        scanners = _scanners(count);
+        scan[0].collect = _collectDetails(pt, count, pflags);
+        scan[0].sockets = (pflags & ProcessEngine_CollectConnections) && ProcessSocket_collect(! scan[0].accounting);
+        _threadsInit(pflags);
+        _scan(scan, scanners, count);
+        FREE(scan[0].collect);
+        if (_threads.current.count > 1)
+                qsort(_threads.current.list, _threads.current.count, sizeof(ThreadSample_T), _compareSample);
+        _cacheUpdate(count);
 
         *reference = pt;
-        globfree(&globbuf);
 
         return count;
 }
@@ -574,21 +1641,19 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
  * @return: 0 if successful, -1 if failed (and all load averages are 0).
  */
 int getloadavg_sysdep(double *loadv, int nelem) {
-#ifdef HAVE_GETLOADAVG
-        return getloadavg(loadv, nelem);
-#else
-        char buf[STRLEN];
         double load[3];
-        if (! file_readProc(buf, sizeof(buf), "loadavg", -1, NULL))
-                return -1;
-        if (sscanf(buf, "%lf %lf %lf", &load[0], &load[1], &load[2]) != 3) {
-                DEBUG("system statistic error -- cannot get load average\n");
+        const char *cursor = _readSystem(_System_LoadAverage);
+        if (! cursor)
                 return -1;
+        for (int i = 0; i < 3; i++) {
+                if (! _parseDouble(&cursor, &load[i])) {
+                        DEBUG("system statistic error -- cannot get load average\n");
+                        return -1;
+                }
         }
-        for (int i = 0; i < nelem; i++)
+        for (int i = 0; i < nelem && i < 3; i++)
                 loadv[i] = load[i];
         return 0;
-#endif
 }
 
 
@@ -597,21 +1662,53 @@ int getloadavg_sysdep(double *loadv, int nelem) {
  * @return: true if successful, false if failed
  */
 bool used_system_memory_sysdep(SystemInfo_T *si) {
-        char          *ptr;
-        char           buf[2048];
-        unsigned long  mem_available = 0UL;
-        unsigned long  mem_free = 0UL;
-        unsigned long  buffers = 0UL;
-        unsigned long  cached = 0UL;
-        unsigned long  slabreclaimable = 0UL;
-        unsigned long  swap_total = 0UL;
-        unsigned long  swap_free = 0UL;
-        unsigned long long       zfsarcsize = 0ULL;
-
-        if (! file_readProc(buf, sizeof(buf), "meminfo", -1, NULL)) {
+        unsigned long long mem_available = 0ULL;
+        unsigned long long mem_free = 0ULL;
+        unsigned long long buffers = 0ULL;
+        unsigned long long cached = 0ULL;
+        unsigned long long slabreclaimable = 0ULL;
+        unsigned long long swap_total = 0ULL;
+        unsigned long long swap_free = 0ULL;
+        unsigned long long zfsarcsize = 0ULL;
+        unsigned long long anonhugepages = 0ULL;
+        unsigned long long hugepages_total = 0ULL;
+        unsigned long long hugepages_free = 0ULL;
+        unsigned long long hugepagesize = 0ULL;
+        struct {
+                const char *key;
+                unsigned long long *value;
+                bool found;
+        } fields[] = {
+                {"MemAvailable:", &mem_available, false},
+                {"MemFree:", &mem_free, false},
+                {"Buffers:", &buffers, false},
+                {"Cached:", &cached, false},
+                {"SReclaimable:", &slabreclaimable, false},
+                {"SwapTotal:", &swap_total, false},
+                {"SwapFree:", &swap_free, false},
+                {"AnonHugePages:", &anonhugepages, false},
+                {"HugePages_Total:", &hugepages_total, false},
+                {"HugePages_Free:", &hugepages_free, false},
+                {"Hugepagesize:", &hugepagesize, false}
+        };
+        enum {_MemAvailable = 0, _MemFree, _Buffers, _Cached, _SReclaimable, _SwapTotal, _SwapFree, _AnonHugePages, _HugePagesTotal, _HugePagesFree, _Hugepagesize, _Fields};
+
+        const char *buf = _readSystem(_System_Memory);
+        if (! buf) {
                 Log_error("system statistic error -- cannot get system memory info\n");
                 goto error;
         }
+        // The meminfo file has one "<key>: <value> kB" line per value
+        for (const char *line = buf; *line; line++) {
+                for (int i = 0; i < _Fields; i++) {
+                        if (! fields[i].found && _parseLine(line, fields[i].key, fields[i].value, 1) == 1) {
+                                fields[i].found = true;
+                                break;
+                        }
+                }
+                if (! (line = strchr(line, '\n')))
+                        break;
+        }
 
         /*
          * Memory
@@ -619,21 +1716,23 @@ bool used_system_memory_sysdep(SystemInfo_T *si) {
          * First, check if the "MemAvailable" value is available on this system. If it is, we will
          * use it. Otherwise we will attempt to calculate the amount of available memory ourself.
          */
-        if ((ptr = strstr(buf, "MemAvailable:")) && sscanf(ptr + 13, "%lu", &mem_available) == 1) {
-                si->memory.usage.bytes = systeminfo.memory.size - (unsigned long long)mem_available * 1024;
+        if (fields[_MemAvailable].found) {
+                si->memory.usage.bytes = systeminfo.memory.size - mem_available * 1024;
         } else {
                 DEBUG("'MemAvailable' value not available on this system. Attempting to calculate available memory manually...\n");
-                if (! (ptr = strstr(buf, "MemFree:")) || sscanf(ptr + 8, "%lu", &mem_free) != 1) {
+                if (! fields[_MemFree].found) {
                         Log_error("system statistic error -- cannot get real memory free amount\n");
                         goto error;
                 }
-                if (! (ptr = strstr(buf, "Buffers:")) || sscanf(ptr + 8, "%lu", &buffers) != 1)
+                if (! fields[_Buffers].found)
                         DEBUG("system statistic error -- cannot get real memory buffers amount\n");
-                if (! (ptr = strstr(buf, "Cached:")) || sscanf(ptr + 7, "%lu", &cached) != 1)
+                if (! fields[_Cached].found)
                         DEBUG("system statistic error -- cannot get real memory cache amount\n");
-                if (! (ptr = strstr(buf, "SReclaimable:")) || sscanf(ptr + 13, "%lu", &slabreclaimable) != 1)
+                if (! fields[_SReclaimable].found)
                         DEBUG("system statistic error -- cannot get slab reclaimable memory amount\n");
-                FILE *f = fopen("/proc/spl/kstat/zfs/arcstats", "r");
+                char path[PATH_MAX];
+                snprintf(path, sizeof(path), "%s/spl/kstat/zfs/arcstats", PROCFS_ROOT);
+                FILE *f = fopen(path, "r");
                 if (f) {
                         char line[STRLEN];
                         while (fgets(line, sizeof(line), f)) {
@@ -643,25 +1742,38 @@ bool used_system_memory_sysdep(SystemInfo_T *si) {
                         }
                         fclose(f);
                 }
-                si->memory.usage.bytes = systeminfo.memory.size - zfsarcsize - (unsigned long long)(mem_free + buffers + cached + slabreclaimable) * 1024;
+                si->memory.usage.bytes = systeminfo.memory.size - zfsarcsize - (mem_free + buffers + cached + slabreclaimable) * 1024;
         }
 
         /* Swap */
-        if (! (ptr = strstr(buf, "SwapTotal:")) || sscanf(ptr + 10, "%lu", &swap_total) != 1) {
+        if (! fields[_SwapTotal].found) {
                 Log_error("system statistic error -- cannot get swap total amount\n");
                 goto error;
         }
-        if (! (ptr = strstr(buf, "SwapFree:")) || sscanf(ptr + 9, "%lu", &swap_free) != 1) {
+        if (! fields[_SwapFree].found) {
                 Log_error("system statistic error -- cannot get swap free amount\n");
                 goto error;
         }
-        si->swap.size = (unsigned long long)swap_total * 1024;
-        si->swap.usage.bytes = (unsigned long long)(swap_total - swap_free) * 1024;
+        si->swap.size = swap_total * 1024;
+        si->swap.usage.bytes = (swap_total - swap_free) * 1024;
+
+        /*
+         * Hugepages (optional)
+         *
+         * The pool of the default size hugepages is reserved up front and isn't available for other use, the pages
+         * are in use once some process faults them in. The transparent hugepages are a part of the anonymous memory.
+         */
+        si->memory.hugepages.size = hugepages_total * hugepagesize * 1024;
+        si->memory.hugepages.usage.bytes = hugepages_total > hugepages_free ? (hugepages_total - hugepages_free) * hugepagesize * 1024 : 0ULL;
+        si->memory.hugepages.anonymous = anonhugepages * 1024;
+        // The pool is tested separately, the memory usage is the rest
+        si->memory.usage.bytes = si->memory.usage.bytes > si->memory.hugepages.size ? si->memory.usage.bytes - si->memory.hugepages.size : 0ULL;
 
         return true;
 
 error:
         si->memory.usage.bytes = 0ULL;
+        si->memory.hugepages.size = si->memory.hugepages.usage.bytes = si->memory.hugepages.anonymous = 0ULL;
         si->swap.size = 0ULL;
         return false;
 }
@@ -684,24 +1796,25 @@ bool used_system_cpu_sysdep(SystemInfo_T *si) {
         unsigned long long cpu_steal;      // Stolen time, which is the time spent in other operating systems when running in a virtualized environment
         unsigned long long cpu_guest;      // Time spent running a virtual CPU for guest operating systems under the control of the Linux kernel
         unsigned long long cpu_guest_nice; // Time spent running a niced guest (virtual CPU for guest operating systems under the control of the Linux kernel)
-        char buf[8192];
+        unsigned long long values[10];
 
-        if (! file_readProc(buf, sizeof(buf), "stat", -1, NULL)) {
+        const char *buf = _readSystem(_System_Cpu);
+        if (! buf) {
                 Log_error("system statistic error -- cannot read /proc/stat\n");
                 goto error;
         }
 
-        rv = sscanf(buf, "cpu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
-                    &cpu_user,
-                    &cpu_nice,
-                    &cpu_syst,
-                    &cpu_idle,
-                    &cpu_iowait,
-                    &cpu_hardirq,
-                    &cpu_softirq,
-                    &cpu_steal,
-                    &cpu_guest,
-                    &cpu_guest_nice);
+        rv = _parseLine(buf, "cpu ", values, 10);
+        cpu_user       = values[0];
+        cpu_nice       = values[1];
+        cpu_syst       = values[2];
+        cpu_idle       = values[3];
+        cpu_iowait     = values[4];
+        cpu_hardirq    = values[5];
+        cpu_softirq    = values[6];
+        cpu_steal      = values[7];
+        cpu_guest      = values[8];
+        cpu_guest_nice = values[9];
         switch (rv) {
                 case 4:
                         // linux < 2.5.41
@@ -743,6 +1856,8 @@ bool used_system_cpu_sysdep(SystemInfo_T *si) {
                         goto error;
         }
 
+        _updateCpus(buf, si);
+
         cpu_total = cpu_user + cpu_nice + cpu_syst + cpu_idle + cpu_iowait + cpu_hardirq + cpu_softirq + cpu_steal; // Note: cpu_guest and cpu_guest_nice are included in user and nice already
 
         if (old_cpu_total == 0) {
@@ -799,53 +1914,30 @@ error:
  * @return: true if successful, false if failed (or not available)
  */
 bool used_system_filedescriptors_sysdep(SystemInfo_T *si) {
-        bool rv = false;
-        FILE *f = fopen("/proc/sys/fs/file-nr", "r");
-        if (f) {
-                char line[STRLEN];
-                if (fgets(line, sizeof(line), f)) {
-                        if (sscanf(line, "%lld %lld %lld\n", &(si->filedescriptors.allocated), &(si->filedescriptors.unused), &(si->filedescriptors.maximum)) == 3) {
-                                rv = true;
-                        }
-                }
-                fclose(f);
-        } else {
-                DEBUG("system statistic error -- cannot open /proc/sys/fs/file-nr\n");
+        unsigned long long values[3];
+        const char *buf = _readSystem(_System_Filedescriptors);
+        if (buf && _parseLine(buf, "", values, 3) == 3) {
+                si->filedescriptors.allocated = values[0];
+                si->filedescriptors.unused = values[1];
+                si->filedescriptors.maximum = values[2];
+                return true;
         }
-        return rv;
+        DEBUG("system statistic error -- cannot read /proc/sys/fs/file-nr\n");
+        return false;
 }
 
 
 bool available_statistics(SystemInfo_T *si) {
         int rv;
-        unsigned long long cpu_user;       // Time spent in user mode
-        unsigned long long cpu_nice;       // Time spent in user mode with low priority (nice)
-        unsigned long long cpu_syst;       // Time spent in system mode
-        unsigned long long cpu_idle;       // Time idle
-        unsigned long long cpu_iowait;     // Time waiting for I/O to complete. This value is not reliable
-        unsigned long long cpu_hardirq;    // Time servicing hardware interrupts
-        unsigned long long cpu_softirq;    // Time servicing software interrupts
-        unsigned long long cpu_steal;      // Stolen time, which is the time spent in other operating systems when running in a virtualized environment
-        unsigned long long cpu_guest;      // Time spent running a virtual CPU for guest operating systems under the control of the Linux kernel
-        unsigned long long cpu_guest_nice; // Time spent running a niced guest (virtual CPU for guest operating systems under the control of the Linux kernel)
-        char buf[8192];
+        unsigned long long values[10];
 
-        if (! file_readProc(buf, sizeof(buf), "stat", -1, NULL)) {
+        const char *buf = _readSystem(_System_Cpu);
+        if (! buf) {
                 Log_error("system statistic error -- cannot read /proc/stat\n");
                 return false;
         }
 
-        rv = sscanf(buf, "cpu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
-                    &cpu_user,
-                    &cpu_nice,
-                    &cpu_syst,
-                    &cpu_idle,
-                    &cpu_iowait,
-                    &cpu_hardirq,
-                    &cpu_softirq,
-                    &cpu_steal,
-                    &cpu_guest,
-                    &cpu_guest_nice);
+        rv = _parseLine(buf, "cpu ", values, 10);
         switch (rv) {
                 case 4:
                         // linux < 2.5.41
@@ -876,7 +1968,7 @@ bool available_statistics(SystemInfo_T *si) {
                         return false;
         }
 
-        si->statisticsAvailable |= Statistics_FiledescriptorsPerSystem | Statistics_FiledescriptorsPerProcess;
+        si->statisticsAvailable |= Statistics_CpuPerCore | Statistics_CpuPerNode | Statistics_FiledescriptorsPerSystem | Statistics_FiledescriptorsPerProcess;
 
 #ifdef HAVE_PRLIMIT
         si->statisticsAvailable |= Statistics_FiledescriptorsPerProcessMax;
@@ -203,11 +203,10 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                                 for (int j = 0; args[j]; j++)
                                         StringBuffer_append(cmdline, args[j + 1] ? "%s " : "%s", args[j]);
                                 if (StringBuffer_length(cmdline))
-                                        pt[i].cmdline = Str_dup(StringBuffer_toString(StringBuffer_trim(cmdline)));
+                                        pt[i].cmdline = ProcessTree_strdup(StringBuffer_toString(StringBuffer_trim(cmdline)));
                         }
                         if (STR_UNDEF(pt[i].cmdline)) {
-                                FREE(pt[i].cmdline);
-                                pt[i].cmdline = Str_dup(pinfo[i].p_comm);
+                                pt[i].cmdline = ProcessTree_strdup(pinfo[i].p_comm);
                         }
                 }
         }
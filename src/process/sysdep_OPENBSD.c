@@ -213,11 +213,10 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                                         for (int j = 0; args[j]; j++)
                                                 StringBuffer_append(cmdline, args[j + 1] ? "%s " : "%s", args[j]);
                                         if (StringBuffer_length(cmdline))
-                                                pt[index].cmdline = Str_dup(StringBuffer_toString(StringBuffer_trim(cmdline)));
+                                                pt[index].cmdline = ProcessTree_strdup(StringBuffer_toString(StringBuffer_trim(cmdline)));
                                 }
                                 if (STR_UNDEF(pt[index].cmdline)) {
-                                        FREE(pt[index].cmdline);
-                                        pt[index].cmdline = Str_dup(pinfo[i].p_comm);
+                                        pt[index].cmdline = ProcessTree_strdup(pinfo[i].p_comm);
                                 }
                         }
                 } else {
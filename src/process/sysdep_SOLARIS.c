@@ -65,8 +65,12 @@
 #include <procfs.h>
 #endif
 
-#ifdef HAVE_GLOB_H
-#include <glob.h>
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
 #endif
 
 #ifdef HAVE_KSTAT_H
@@ -100,6 +104,33 @@
  *  @file
  */
 
+/* ------------------------------------------------------------- Definitions */
+
+
+// The open psinfo and usage files of the process. The descriptor reads the current data of the same process until it exits, then the read fails with ENOENT, so a reused PID never gets the data of the previous process
+typedef struct ProcFiles_T {
+        pid_t pid;
+        int psinfo;
+        int usage;
+} ProcFiles_T;
+
+
+typedef struct ProcFilesList_T {
+        int count;
+        int size;
+        ProcFiles_T *list;
+} ProcFilesList_T;
+
+
+static struct {
+        int fd;                                       // The /proc directory descriptor
+        int open;                                     // Number of the cached process file descriptors
+        int limit;                                    // Maximum number of the cached process file descriptors
+        ProcFilesList_T current;                      // The files of the current scan sorted by the PID
+        ProcFilesList_T previous;                     // The files of the previous scan sorted by the PID
+} _proc = {.fd = -1};
+
+
 static int    page_size;
 static long   old_cpu_user = 0;
 static long   old_cpu_syst = 0;
@@ -111,6 +142,12 @@ static long   old_total = 0;
 bool init_process_info_sysdep(void) {
         systeminfo.cpu.count = sysconf( _SC_NPROCESSORS_ONLN);
         page_size = getpagesize();
+        // Keep the process files open across the cycles up to a half of the descriptors limit, the rest of the processes is read by open/pread/close as before
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+                _proc.limit = (int)(rl.rlim_cur / 2);
+        else
+                _proc.limit = 1024;
         systeminfo.memory.size = (unsigned long long)sysconf(_SC_PHYS_PAGES) * (unsigned long long)page_size;
         kstat_ctl_t *kctl = kstat_open();
         if (kctl) {
@@ -132,8 +169,83 @@ double timestruc_to_tseconds(timestruc_t t) {
 }
 
 
+static int _comparePid(const void *a, const void *b) {
+        pid_t x = *(const pid_t *)a, y = *(const pid_t *)b;
+        return x < y ? -1 : x > y;
+}
+
+
+static void _closeFile(int *fd) {
+        if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+                _proc.open--;
+        }
+}
+
+
 /**
- * Read all processes of the proc files system to initialize the process tree
+ * Read the process file by pread() from its open descriptor, the file is opened relative to the /proc directory
+ * descriptor if it's not open yet. The descriptor is kept open if the cache has room, otherwise closed after the read
+ * @param fd The descriptor reference or -1 if not open
+ * @param pid The process ID
+ * @param name The file name
+ * @param buf The buffer
+ * @param size The number of bytes to read (the structure size)
+ * @return true if the whole structure was read
+ */
+static bool _readFile(int *fd, pid_t pid, const char *name, void *buf, size_t size) {
+        if (*fd < 0) {
+                char path[64];
+                snprintf(path, sizeof(path), "%d/%s", (int)pid, name);
+                if ((*fd = openat(_proc.fd, path, O_RDONLY)) < 0) {
+                        DEBUG("Cannot open proc file '/proc/%s' -- %s\n", path, STRERROR);
+                        return false;
+                }
+                fcntl(*fd, F_SETFD, FD_CLOEXEC);
+                _proc.open++;
+        }
+        ssize_t bytes = pread(*fd, buf, size, 0);
+        if (bytes != (ssize_t)size) {
+                // The process exited
+                _closeFile(fd);
+                return false;
+        }
+        if (_proc.open > _proc.limit)
+                _closeFile(fd);
+        return true;
+}
+
+
+// Get the sorted list of the process IDs from the /proc directory
+static int _readPids(pid_t **pids) {
+        DIR *dir = opendir("/proc");
+        if (! dir) {
+                Log_error("system statistic error -- cannot read /proc directory: %s\n", STRERROR);
+                return 0;
+        }
+        int count = 0, size = 0;
+        struct dirent *de;
+        while ((de = readdir(dir))) {
+                if (*de->d_name >= '0' && *de->d_name <= '9') {
+                        if (count == size) {
+                                size = size ? size * 2 : 1024;
+                                RESIZE(*pids, size * sizeof(pid_t));
+                        }
+                        (*pids)[count++] = (pid_t)atoi(de->d_name);
+                }
+        }
+        closedir(dir);
+        qsort(*pids, count, sizeof(pid_t), _comparePid);
+        return count;
+}
+
+
+/**
+ * Read all processes of the proc files system to initialize the process tree. The /proc directory is kept open
+ * and the psinfo and usage files of each process are read by pread() from the descriptors kept open since the
+ * previous scan, so a scan of thousands of processes doesn't open and close two files per process. The previous
+ * list of the open files is merged with the current sorted process IDs, the files of the exited processes are closed
  * @param reference reference of ProcessTree
  * @param pflags Process engine flags
  * @return treesize > 0 if succeeded otherwise 0
@@ -141,60 +253,94 @@ double timestruc_to_tseconds(timestruc_t t) {
 int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags) {
         ASSERT(reference);
 
-        /* Find all processes in the /proc directory */
-        glob_t globbuf;
-        int rv = glob("/proc/[0-9]*", 0, NULL, &globbuf);
-        if (rv != 0) {
-                Log_error("system statistic error -- glob failed: %d (%s)\n", rv, STRERROR);
-                return 0;
+        if (_proc.fd < 0) {
+                if ((_proc.fd = open("/proc", O_RDONLY)) < 0) {
+                        Log_error("system statistic error -- cannot open /proc: %s\n", STRERROR);
+                        return 0;
+                }
+                fcntl(_proc.fd, F_SETFD, FD_CLOEXEC);
         }
 
-        int treesize = globbuf.gl_pathc;
+        pid_t *pids = NULL;
+        int count = _readPids(&pids);
+        if (count == 0) {
+                FREE(pids);
+                return 0;
+        }
 
         /* Allocate the tree */
-        ProcessTree_T *pt = CALLOC(sizeof(ProcessTree_T), treesize);
-
-        char buf[4096];
-        for (int i = 0; i < treesize; i++) {
-                pt[i].pid = atoi(globbuf.gl_pathv[i] + strlen("/proc/"));
-                if (file_readProc(buf, sizeof(buf), "psinfo", pt[i].pid, NULL)) {
-                        psinfo_t *psinfo = (psinfo_t *)&buf;
-                        pt[i].ppid         = psinfo->pr_ppid;
-                        pt[i].cred.uid     = psinfo->pr_uid;
-                        pt[i].cred.euid    = psinfo->pr_euid;
-                        pt[i].cred.gid     = psinfo->pr_gid;
-                        pt[i].uptime       = systeminfo.time / 10. - psinfo->pr_start.tv_sec;
-                        pt[i].zombie       = psinfo->pr_nlwp == 0 ? true : false; // If we don't have any light-weight processes (LWP) then we are definitely a zombie
-                        pt[i].memory.usage = (unsigned long long)psinfo->pr_rssize * 1024;
+        ProcessTree_T *pt = CALLOC(sizeof(ProcessTree_T), count);
+
+        if (_proc.current.size < count) {
+                _proc.current.size = count;
+                RESIZE(_proc.current.list, count * sizeof(ProcFiles_T));
+        }
+        _proc.current.count = 0;
+
+        int treesize = 0, previous = 0;
+        for (int i = 0; i < count; i++) {
+                // Close the files of the processes which exited since the previous scan
+                for (; previous < _proc.previous.count && _proc.previous.list[previous].pid < pids[i]; previous++) {
+                        _closeFile(&(_proc.previous.list[previous].psinfo));
+                        _closeFile(&(_proc.previous.list[previous].usage));
+                }
+                ProcFiles_T files = {.pid = pids[i], .psinfo = -1, .usage = -1};
+                if (previous < _proc.previous.count && _proc.previous.list[previous].pid == pids[i])
+                        files = _proc.previous.list[previous++];
+                psinfo_t psinfo;
+                if (_readFile(&files.psinfo, files.pid, "psinfo", &psinfo, sizeof(psinfo))) {
+                        pt[treesize].pid          = files.pid;
+                        pt[treesize].ppid         = psinfo.pr_ppid;
+                        pt[treesize].cred.uid     = psinfo.pr_uid;
+                        pt[treesize].cred.euid    = psinfo.pr_euid;
+                        pt[treesize].cred.gid     = psinfo.pr_gid;
+                        pt[treesize].uptime       = systeminfo.time / 10. - psinfo.pr_start.tv_sec;
+                        pt[treesize].zombie       = psinfo.pr_nlwp == 0 ? true : false; // If we don't have any light-weight processes (LWP) then we are definitely a zombie
+                        pt[treesize].memory.usage = (unsigned long long)psinfo.pr_rssize * 1024;
+                        pt[treesize].cpu.time     = timestruc_to_tseconds(psinfo.pr_time); // The user + system time of the process, same as in the status file
+                        pt[treesize].threads.self = psinfo.pr_nlwp;
                         if (pflags & ProcessEngine_CollectCommandLine) {
-                                pt[i].cmdline = Str_dup(psinfo->pr_psargs);
-                                if (STR_UNDEF(pt[i].cmdline)) {
-                                        FREE(pt[i].cmdline);
-                                        pt[i].cmdline = Str_dup(psinfo->pr_fname);
+                                pt[treesize].cmdline = ProcessTree_strdup(psinfo.pr_psargs);
+                                if (STR_UNDEF(pt[treesize].cmdline)) {
+                                        pt[treesize].cmdline = ProcessTree_strdup(psinfo.pr_fname);
                                 }
                         }
-                        if (file_readProc(buf, sizeof(buf), "status", pt[i].pid, NULL)) {
-                                pstatus_t *pstatus = (pstatus_t *)&buf;
-                                pt[i].cpu.time = timestruc_to_tseconds(pstatus->pr_utime) + timestruc_to_tseconds(pstatus->pr_stime);
-                                pt[i].threads.self = pstatus->pr_nlwp;
-                        }
-                        if (file_readProc(buf, sizeof(buf), "usage", pt[i].pid, NULL)) {
-                                struct prusage *usage = (struct prusage *)&buf;
-                                pt[i].read.bytes          = -1;
-                                pt[i].read.bytesPhysical  = -1;
-                                pt[i].read.operations     = usage->pr_inblk;
-                                pt[i].write.bytes         = -1;
-                                pt[i].write.bytesPhysical = -1;
-                                pt[i].write.operations    = usage->pr_oublk;
-                                pt[i].read.time = pt[i].write.time = Time_milli();
+                        pt[treesize].read.bytes          = -1;
+                        pt[treesize].read.bytesPhysical  = -1;
+                        pt[treesize].read.operations     = -1;
+                        pt[treesize].write.bytes         = -1;
+                        pt[treesize].write.bytesPhysical = -1;
+                        pt[treesize].write.operations    = -1;
+                        struct prusage usage;
+                        if (_readFile(&files.usage, files.pid, "usage", &usage, sizeof(usage))) {
+                                pt[treesize].read.operations     = usage.pr_inblk;
+                                pt[treesize].write.operations    = usage.pr_oublk;
+                                pt[treesize].read.time = pt[treesize].write.time = Time_milli();
                         }
+                        treesize++;
+                } else {
+                        _closeFile(&files.usage);
                 }
+                if (files.psinfo >= 0 || files.usage >= 0)
+                        _proc.current.list[_proc.current.count++] = files;
         }
+        // Close the files of the exited processes with the highest PIDs
+        for (; previous < _proc.previous.count; previous++) {
+                _closeFile(&(_proc.previous.list[previous].psinfo));
+                _closeFile(&(_proc.previous.list[previous].usage));
+        }
+        ProcFilesList_T swap = _proc.previous;
+        _proc.previous = _proc.current;
+        _proc.current = swap;
 
-        *reference = pt;
+        FREE(pids);
+
+        if (treesize == 0) {
+                FREE(pt);
+                return 0;
+        }
 
-        /* Free globbing buffer */
-        globfree(&globbuf);
+        *reference = pt;
 
         return treesize;
 }
@@ -24,6 +24,10 @@
 
 #include "config.h"
 
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
 #include "protocol.h"
 
 // libmonit
@@ -54,3 +58,22 @@ void check_default(Socket_T socket) {
         }
 }
 
+
+/**
+ * Keepalive test of the default protocol: the connection is alive unless the peer closed it or the socket is in error state
+ */
+void ping_default(Socket_T socket) {
+        ASSERT(socket);
+        int s = Socket_getSocket(socket);
+        if (Net_canRead(s, 0)) {
+                char token[1];
+                ssize_t n;
+                do {
+                        n = recv(s, token, 1, MSG_PEEK);
+                } while (n == -1 && errno == EINTR);
+                if (n == 0)
+                        THROW(IOException, "Connection closed by peer");
+                else if (n < 0)
+                        THROW(IOException, "%s", STRERROR);
+        }
+}
@@ -36,20 +36,155 @@
 #include <sys/socket.h>
 #endif
 
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
 #include "protocol.h"
+#include "Histogram.h"
 
 // libmonit
+#include "system/Net.h"
+#include "system/Time.h"
 #include "exceptions/IOException.h"
 #include "exceptions/ProtocolException.h"
 
 /**
- *  Simple DNS test.
+ *  DNS test.
  *
- *  The nameserver is queried for NS record of DNS root.
+ *  Without configured queries the nameserver is queried for NS record of DNS
+ *  root. Otherwise all configured queries are sent at once over the socket
+ *  and the responses are matched to the queries by the transaction ID as
+ *  they arrive, so the batch takes one round trip instead of one per query.
  *
  *  @file
  */
-void check_dns(Socket_T socket) {
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+#define DNS_PACKET 4096
+
+
+typedef struct {
+        DnsQuery_T query;
+        uint16_t id;
+        long long sent;                                 // Time the query was sent [us]
+        long long latency;                          // Response latency [us], -1 if pending
+        char error[STRLEN];                                  // Error description if failed
+} dns_query_t;
+
+
+static const char *rcodes[] = {"NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED"};
+
+
+/* ------------------------------------------------------- Private methods */
+
+
+static uint16_t _getUInt16(const unsigned char *data) {
+        return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+
+// Encode the query name to DNS labels, return the encoded length
+static int _encodeName(const char *name, unsigned char *buf, int size) {
+        int n = 0;
+        for (const char *label = name; *label;) {
+                const char *dot = strchr(label, '.');
+                int length = dot ? (int)(dot - label) : (int)strlen(label);
+                if (length == 0 || length > 63 || n + length + 2 > size)
+                        THROW(ProtocolException, "DNS: invalid query name '%s'", name);
+                buf[n++] = (unsigned char)length;
+                memcpy(buf + n, label, length);
+                n += length;
+                label += length;
+                if (*label)
+                        label++;
+        }
+        buf[n++] = 0;
+        return n;
+}
+
+
+// Decode the (possibly compressed) name at the offset, return the offset after the name or -1 if the name is invalid
+static int _decodeName(const unsigned char *packet, int length, int offset, char *name, int size) {
+        int next = -1, n = 0;
+        *name = 0;
+        for (int jumps = 0; offset < length && jumps < 64;) {
+                int label = packet[offset];
+                if (label == 0) {
+                        if (n)
+                                name[n - 1] = 0; // Remove the trailing dot
+                        return next < 0 ? offset + 1 : next;
+                } else if ((label & 0xc0) == 0xc0) {
+                        if (offset + 1 >= length)
+                                break;
+                        if (next < 0)
+                                next = offset + 2;
+                        offset = ((label & 0x3f) << 8) | packet[offset + 1];
+                        jumps++;
+                } else {
+                        if (offset + 1 + label > length || n + label + 2 > size)
+                                break;
+                        memcpy(name + n, packet + offset + 1, label);
+                        n += label;
+                        name[n++] = '.';
+                        name[n] = 0;
+                        offset += label + 1;
+                }
+        }
+        return -1;
+}
+
+
+// Format the record data as text for the answer test, return false if the data are invalid
+static bool _formatRecord(const unsigned char *packet, int length, int offset, int rrtype, int rdlength, char *value, int size) {
+        switch (rrtype) {
+                case 1:  // A
+                        return rdlength == 4 && inet_ntop(AF_INET, packet + offset, value, size);
+                case 28: // AAAA
+                        return rdlength == 16 && inet_ntop(AF_INET6, packet + offset, value, size);
+                case 2:  // NS
+                case 5:  // CNAME
+                case 6:  // SOA (primary nameserver)
+                case 12: // PTR
+                        return _decodeName(packet, length, offset, value, size) > 0;
+                case 15: // MX (skip the preference)
+                        return rdlength > 2 && _decodeName(packet, length, offset + 2, value, size) > 0;
+                case 33: // SRV (skip the priority, weight and port)
+                        return rdlength > 6 && _decodeName(packet, length, offset + 6, value, size) > 0;
+                case 16: // TXT (concatenated character strings)
+                        {
+                                int n = 0;
+                                for (int i = 0; i < rdlength;) {
+                                        int l = packet[offset + i];
+                                        if (i + 1 + l > rdlength)
+                                                return false;
+                                        n += snprintf(value + n, size - n, "%.*s", l, packet + offset + i + 1);
+                                        if (n >= size)
+                                                return false;
+                                        i += l + 1;
+                                }
+                                return true;
+                        }
+                default:
+                        return false;
+        }
+}
+
+
+// Compare the expected answer with the record value, the trailing dot of an absolute name is ignored
+static bool _isAnswer(const char *expected, const char *value) {
+        size_t length = strlen(expected);
+        if (length > 1 && expected[length - 1] == '.')
+                length--;
+        return strlen(value) == length && strncasecmp(expected, value, length) == 0;
+}
+
+
+// Legacy test: query the NS record of DNS root
+static void _checkRoot(Socket_T socket) {
         int            offset_request  = 0;
         int            offset_response = 0;
         int            rc;
@@ -137,3 +272,202 @@ void check_dns(Socket_T socket) {
                 THROW(ProtocolException, "DNS: no answer or authority records returned");
 }
 
+
+
+// Validate the response to the query, set the query error if it failed
+static void _verify(dns_query_t *q, const unsigned char *response, int length) {
+        char name[STRLEN];
+        uint16_t flags = _getUInt16(response + 2);
+        int rcode = flags & 0x0f;
+        if (! (flags & 0x8000)) {
+                snprintf(q->error, sizeof(q->error), "invalid response type");
+                return;
+        }
+        if (rcode != 0) {
+                snprintf(q->error, sizeof(q->error), "response code %s", rcode < (int)(sizeof(rcodes) / sizeof(rcodes[0])) ? rcodes[rcode] : "unknown");
+                return;
+        }
+        int answers = _getUInt16(response + 6);
+        if (answers == 0) {
+                snprintf(q->error, sizeof(q->error), "no answer records");
+                return;
+        }
+        if (! q->query->answer)
+                return;
+        if (flags & 0x0200) {
+                snprintf(q->error, sizeof(q->error), "truncated response");
+                return;
+        }
+        // Skip the question and look for the expected value in the answer records of the query type
+        int offset = _decodeName(response, length, 12, name, sizeof(name));
+        if (offset < 0 || offset + 4 > length) {
+                snprintf(q->error, sizeof(q->error), "invalid response");
+                return;
+        }
+        offset += 4;
+        char value[STRLEN] = {}, first[STRLEN] = {};
+        for (int i = 0; i < answers; i++) {
+                if ((offset = _decodeName(response, length, offset, name, sizeof(name))) < 0 || offset + 10 > length)
+                        break;
+                int rrtype = _getUInt16(response + offset);
+                int rdlength = _getUInt16(response + offset + 8);
+                offset += 10;
+                if (offset + rdlength > length)
+                        break;
+                if (rrtype == q->query->rrtype && _formatRecord(response, length, offset, rrtype, rdlength, value, sizeof(value))) {
+                        if (_isAnswer(q->query->answer, value))
+                                return;
+                        if (! *first)
+                                snprintf(first, sizeof(first), "%s", value);
+                }
+                offset += rdlength;
+        }
+        snprintf(q->error, sizeof(q->error), "answer '%s' not found%s%.64s", q->query->answer, *first ? ", received " : "", first);
+}
+
+
+// Match the response to the pending query by the transaction ID and the question, return true if matched
+static bool _process(dns_query_t *queries, int count, const unsigned char *response, int length) {
+        if (length < 12)
+                return false;
+        uint16_t id = _getUInt16(response);
+        for (int i = 0; i < count; i++) {
+                dns_query_t *q = &queries[i];
+                if (q->id == id && q->latency < 0) {
+                        char name[STRLEN];
+                        int offset = _decodeName(response, length, 12, name, sizeof(name));
+                        // The response must repeat the question, otherwise it is stale or spoofed
+                        if (_getUInt16(response + 4) != 1 || offset < 0 || offset + 4 > length || ! _isAnswer(q->query->name, name) || _getUInt16(response + offset) != q->query->rrtype) {
+                                DEBUG("DNS: ignoring response with ID %d -- question mismatch\n", id);
+                                return false;
+                        }
+                        q->latency = Time_micro() - q->sent;
+                        _verify(q, response, length);
+                        return true;
+                }
+        }
+        DEBUG("DNS: ignoring response with unknown ID %d\n", id);
+        return false;
+}
+
+
+// Read the next response, return its length or 0 on timeout
+static int _readResponse(Socket_T socket, unsigned char *response, int size, long long deadline) {
+        int timeout = (int)(deadline - Time_milli());
+        if (timeout <= 0)
+                return 0;
+        if (Socket_getType(socket) == Socket_Udp) {
+                int n = (int)Net_read(Socket_getSocket(socket), response, size, timeout);
+                if (n < 0)
+                        THROW(IOException, "DNS: error receiving response -- %s", STRERROR);
+                return n;
+        }
+        // TCP: the response is prefixed by the 2-byte length
+        unsigned char header[2];
+        if (Socket_read(socket, header, 2) != 2)
+                return 0;
+        int length = _getUInt16(header);
+        if (length > size)
+                THROW(ProtocolException, "DNS: response too large -- %d bytes", length);
+        if (Socket_read(socket, response, length) != length)
+                THROW(IOException, "DNS: error receiving response -- %s", STRERROR);
+        return length;
+}
+
+
+// Send the query to the socket
+static void _sendQuery(Socket_T socket, dns_query_t *q) {
+        unsigned char request[2 + 12 + 256 + 4] = {};
+        unsigned char *message = request + 2;
+        message[0] = q->id >> 8;
+        message[1] = q->id & 0xff;
+        message[2] = 0x01;                                 // Flags: recursion desired
+        message[5] = 0x01;                                 // One question
+        int length = 12 + _encodeName(q->query->name, message + 12, 256);
+        message[length++] = q->query->rrtype >> 8;
+        message[length++] = q->query->rrtype & 0xff;
+        message[length++] = 0x00;
+        message[length++] = 0x01;                          // Class IN
+        // The TCP message is prefixed by the length, UDP sends the message in one datagram
+        request[0] = length >> 8;
+        request[1] = length & 0xff;
+        bool tcp = Socket_getType(socket) == Socket_Tcp;
+        q->sent = Time_micro();
+        if (Socket_write(socket, tcp ? request : message, tcp ? length + 2 : length) < 0)
+                THROW(IOException, "DNS: error sending query -- %s", STRERROR);
+}
+
+
+// Batch test: send all queries at once and collect the responses in the order they arrive
+static void _runQueries(Socket_T socket, Port_T port, dns_query_t *queries, int count, Histogram_T latency) {
+        uint16_t id;
+        System_random(&id, sizeof(id));
+        DnsQuery_T query = port->parameters.dns.queries;
+        for (int i = 0; i < count; i++, query = query->next) {
+                queries[i].query = query;
+                queries[i].id = id++;
+                queries[i].latency = -1;
+                _sendQuery(socket, &queries[i]);
+        }
+        unsigned char response[DNS_PACKET];
+        long long deadline = Time_milli() + port->timeout;
+        for (int pending = count, n; pending > 0 && (n = _readResponse(socket, response, sizeof(response), deadline)) > 0;)
+                if (_process(queries, count, response, n))
+                        pending--;
+        int failed = 0;
+        long long maximum = 0;
+        char error[STRLEN] = {};
+        for (int i = 0; i < count; i++) {
+                if (queries[i].latency < 0)
+                        snprintf(queries[i].error, sizeof(queries[i].error), "no response");
+                else
+                        Histogram_add(latency, queries[i].latency);
+                maximum = MAX(maximum, queries[i].latency);
+                if (*queries[i].error) {
+                        DEBUG("DNS: query %s %s failed -- %s\n", queries[i].query->type, queries[i].query->name, queries[i].error);
+                        if (! failed++)
+                                snprintf(error, sizeof(error), "%s %.100s: %.100s", queries[i].query->type, queries[i].query->name, queries[i].error);
+                }
+        }
+        port->statistics.dns.queries = count;
+        port->statistics.dns.failed = failed;
+        // The histogram percentile is the bucket bound, keep it within the exact maximum
+        port->statistics.dns.median = MIN(Histogram_getPercentile(latency, 50), maximum);
+        port->statistics.dns.p95 = MIN(Histogram_getPercentile(latency, 95), maximum);
+        port->statistics.dns.maximum = maximum;
+        if (failed)
+                THROW(ProtocolException, "DNS: %d of %d queries failed -- %s", failed, count, error);
+}
+
+
+static void _checkQueries(Socket_T socket, Port_T port) {
+        int volatile count = 0;
+        for (DnsQuery_T q = port->parameters.dns.queries; q; q = q->next)
+                count++;
+        dns_query_t *queries = CALLOC(count, sizeof(dns_query_t));
+        Histogram_T latency = Histogram_new();
+        TRY
+        {
+                _runQueries(socket, port, queries, count, latency);
+        }
+        FINALLY
+        {
+                Histogram_free(&latency);
+                FREE(queries);
+        }
+        END_TRY;
+}
+
+
+/* -------------------------------------------------------- Public methods */
+
+
+void check_dns(Socket_T socket) {
+        ASSERT(socket);
+        Port_T port = Socket_getPort(socket);
+        if (port->parameters.dns.queries)
+                _checkQueries(socket, port);
+        else
+                _checkRoot(socket);
+}
+
@@ -57,6 +57,10 @@ static char *_escapeZeroInExpectBuffer(char *buf, int buflen, int n) {
 /**
  *  Generic service test.
  *
+ *  The send data is unescaped and the expect expressions are compiled when
+ *  the configuration is parsed. The expect string without regex metacharacters
+ *  is matched as a plain substring.
+ *
  *  @file
  */
 void check_generic(Socket_T socket) {
@@ -71,18 +75,12 @@ void check_generic(Socket_T socket) {
         while (g != NULL) {
 
                 if (g->send != NULL) {
-                        /* Unescape any \0x00 escaped chars in g's send string to allow sending a string containing \0 bytes also */
-                        char *X = Str_dup(g->send);
-                        int l = Util_handle0Escapes(X);
-
-                        if (Socket_write(socket, X, l) < 0) {
-                                FREE(X);
+                        if (Socket_write(socket, g->send, g->length) < 0) {
                                 FREE(buf);
                                 THROW(IOException, "GENERIC: error sending data -- %s", STRERROR);
                         } else {
                                 DEBUG("GENERIC: successfully sent: '%s'\n", g->send);
                         }
-                        FREE(X);
                 } else if (g->expect != NULL) {
                         /* Since the protocol is unknown we need to wait on EOF. To avoid waiting
                          timeout seconds on EOF we first read one byte to fill the socket's read
@@ -102,16 +100,27 @@ void check_generic(Socket_T socket) {
                         if (n > 0)
                                 _escapeZeroInExpectBuffer(buf, Run.limits.sendExpectBuffer, n);
                         Socket_setTimeout(socket, timeout); // Reset back original timeout for next send/expect
-                        int regex_return = regexec(g->expect, buf, 0, NULL, 0);
-                        if (regex_return != 0) {
-                                char e[STRLEN];
-                                regerror(regex_return, g->expect, e, STRLEN);
-                                char error[512];
-                                snprintf(error, sizeof(error), "GENERIC: received unexpected data [%s] -- %s", Str_trunc(Str_trim(buf), sizeof(error) - 128), e);
-                                FREE(buf);
-                                THROW(ProtocolException, "%s", error);
+                        if (g->literal) {
+                                if (! strstr(buf, g->literal)) {
+                                        char error[512];
+                                        snprintf(error, sizeof(error), "GENERIC: received unexpected data [%s] -- expected '%.64s'", Str_trunc(Str_trim(buf), sizeof(error) - 256), g->literal);
+                                        FREE(buf);
+                                        THROW(ProtocolException, "%s", error);
+                                } else {
+                                        DEBUG("GENERIC: successfully received: '%s'\n", Str_trunc(buf, STRLEN));
+                                }
                         } else {
-                                DEBUG("GENERIC: successfully received: '%s'\n", Str_trunc(buf, STRLEN));
+                                int regex_return = regexec(g->expect, buf, 0, NULL, 0);
+                                if (regex_return != 0) {
+                                        char e[STRLEN];
+                                        regerror(regex_return, g->expect, e, STRLEN);
+                                        char error[512];
+                                        snprintf(error, sizeof(error), "GENERIC: received unexpected data [%s] -- %s", Str_trunc(Str_trim(buf), sizeof(error) - 128), e);
+                                        FREE(buf);
+                                        THROW(ProtocolException, "%s", error);
+                                } else {
+                                        DEBUG("GENERIC: successfully received: '%s'\n", Str_trunc(buf, STRLEN));
+                                }
                         }
                 } else {
                         /* This should not happen */
@@ -0,0 +1,789 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include "protocol.h"
+
+// libmonit
+#include "exceptions/IOException.h"
+#include "exceptions/ProtocolException.h"
+
+
+/**
+ *  gRPC health checking protocol test.
+ *
+ *  The test calls the grpc.health.v1.Health/Check method over HTTP/2 (h2c, or
+ *  h2 negotiated by ALPN if SSL is enabled) and expects the SERVING status.
+ *  The HTTP/2 client is minimal: it sends one request per stream, sets the
+ *  HPACK dynamic table size to zero, so the response headers are decoded
+ *  using the static table only, and doesn't use the flow control except
+ *  returning the received connection window. The keepalive test sends the
+ *  next request on a new stream of the open connection.
+ *
+ *  @see https://github.com/grpc/grpc/blob/master/doc/health-checking.md
+ *  @see https://github.com/grpc/grpc/blob/master/doc/PROTOCOL-HTTP2.md
+ *  @see https://tools.ietf.org/html/rfc7540
+ *  @see https://tools.ietf.org/html/rfc7541
+ *
+ *  @file
+ */
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+#define GRPC_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define GRPC_PATH    "/grpc.health.v1.Health/Check"
+
+#define GRPC_FRAME_HEADER 9
+#define GRPC_FRAME_SIZE   16384                       // SETTINGS_MAX_FRAME_SIZE default
+#define GRPC_HEADERS_SIZE 16384                  // Maximum header block size we accept
+#define GRPC_MESSAGE_SIZE 256                  // Maximum health response size we accept
+#define GRPC_STREAM_MAX   0x7fffff00       // Reconnect before the stream ids are exhausted
+
+// Frame types
+#define GRPC_DATA          0x0
+#define GRPC_HEADERS       0x1
+#define GRPC_RST_STREAM    0x3
+#define GRPC_SETTINGS      0x4
+#define GRPC_PING          0x6
+#define GRPC_GOAWAY        0x7
+#define GRPC_WINDOW_UPDATE 0x8
+#define GRPC_CONTINUATION  0x9
+
+// Frame flags
+#define GRPC_END_STREAM  0x1
+#define GRPC_ACK         0x1
+#define GRPC_END_HEADERS 0x4
+#define GRPC_PADDED      0x8
+#define GRPC_PRIORITY    0x20
+
+// Settings
+#define GRPC_SETTINGS_HEADER_TABLE_SIZE 0x1
+#define GRPC_SETTINGS_ENABLE_PUSH       0x2
+
+// Health check response serving status
+typedef enum {
+        Grpc_Unknown = 0,
+        Grpc_Serving,
+        Grpc_NotServing,
+        Grpc_ServiceUnknown
+} Grpc_ServingStatus;
+
+typedef struct {
+        Socket_T socket;
+        Port_T port;
+        Port_T owner;                    /**< The port owning the keepalive connection */
+        int stream;                                        /**< Request stream id */
+        struct {
+                int type;
+                int flags;
+                int stream;
+                int length;
+                unsigned char payload[GRPC_FRAME_SIZE];
+        } frame;
+        struct {
+                int length;
+                unsigned char block[GRPC_HEADERS_SIZE];
+        } headers;
+        struct {
+                int length;
+                unsigned char data[GRPC_MESSAGE_SIZE];
+        } message;
+        int status;                                          /**< HTTP status */
+        int grpcStatus;                               /**< grpc-status or -1 if not set */
+        char grpcMessage[STRLEN];                                     /**< grpc-message */
+} grpc_t;
+
+
+// HPACK static table (RFC 7541 Appendix A)
+static const struct {
+        const char *name;
+        const char *value;
+} _staticTable[] = {
+        {NULL, NULL},
+        {":authority", ""},
+        {":method", "GET"},
+        {":method", "POST"},
+        {":path", "/"},
+        {":path", "/index.html"},
+        {":scheme", "http"},
+        {":scheme", "https"},
+        {":status", "200"},
+        {":status", "204"},
+        {":status", "206"},
+        {":status", "304"},
+        {":status", "400"},
+        {":status", "404"},
+        {":status", "500"},
+        {"accept-charset", ""},
+        {"accept-encoding", "gzip, deflate"},
+        {"accept-language", ""},
+        {"accept-ranges", ""},
+        {"accept", ""},
+        {"access-control-allow-origin", ""},
+        {"age", ""},
+        {"allow", ""},
+        {"authorization", ""},
+        {"cache-control", ""},
+        {"content-disposition", ""},
+        {"content-encoding", ""},
+        {"content-language", ""},
+        {"content-length", ""},
+        {"content-location", ""},
+        {"content-range", ""},
+        {"content-type", ""},
+        {"cookie", ""},
+        {"date", ""},
+        {"etag", ""},
+        {"expect", ""},
+        {"expires", ""},
+        {"from", ""},
+        {"host", ""},
+        {"if-match", ""},
+        {"if-modified-since", ""},
+        {"if-none-match", ""},
+        {"if-range", ""},
+        {"if-unmodified-since", ""},
+        {"last-modified", ""},
+        {"link", ""},
+        {"location", ""},
+        {"max-forwards", ""},
+        {"proxy-authenticate", ""},
+        {"proxy-authorization", ""},
+        {"range", ""},
+        {"referer", ""},
+        {"refresh", ""},
+        {"retry-after", ""},
+        {"server", ""},
+        {"set-cookie", ""},
+        {"strict-transport-security", ""},
+        {"transfer-encoding", ""},
+        {"user-agent", ""},
+        {"vary", ""},
+        {"via", ""},
+        {"www-authenticate", ""}
+};
+#define GRPC_STATIC_TABLE_SIZE ((int)(sizeof(_staticTable) / sizeof(_staticTable[0])) - 1)
+
+
+// HPACK Huffman code (RFC 7541 Appendix B), indexed by symbol, the last entry is EOS
+static const struct {
+        unsigned int code;
+        int bits;
+} _huffman[257] = {
+        {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+        {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+        {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+        {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+        {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+        {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+        {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+        {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+        {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+        {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+        {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+        {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+        {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+        {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+        {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+        {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+        {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+        {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+        {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+        {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+        {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+        {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+        {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+        {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+        {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+        {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+        {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+        {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+        {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+        {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+        {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+        {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+        {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+        {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+        {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+        {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+        {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+        {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+        {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+        {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+        {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+        {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+        {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30}
+};
+
+
+// gRPC status codes
+static const char *_grpcStatus[] = {
+        "OK",
+        "CANCELLED",
+        "UNKNOWN",
+        "INVALID_ARGUMENT",
+        "DEADLINE_EXCEEDED",
+        "NOT_FOUND",
+        "ALREADY_EXISTS",
+        "PERMISSION_DENIED",
+        "RESOURCE_EXHAUSTED",
+        "FAILED_PRECONDITION",
+        "ABORTED",
+        "OUT_OF_RANGE",
+        "UNIMPLEMENTED",
+        "INTERNAL",
+        "UNAVAILABLE",
+        "DATA_LOSS",
+        "UNAUTHENTICATED"
+};
+
+
+static const char *_servingStatus[] = {
+        "UNKNOWN",
+        "SERVING",
+        "NOT_SERVING",
+        "SERVICE_UNKNOWN"
+};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static unsigned char *_putFrameHeader(unsigned char *b, int length, int type, int flags, int stream) {
+        *b++ = (length >> 16) & 0xff;
+        *b++ = (length >> 8) & 0xff;
+        *b++ = length & 0xff;
+        *b++ = type;
+        *b++ = flags;
+        *b++ = (stream >> 24) & 0x7f;
+        *b++ = (stream >> 16) & 0xff;
+        *b++ = (stream >> 8) & 0xff;
+        *b++ = stream & 0xff;
+        return b;
+}
+
+
+static unsigned char *_putInt32(unsigned char *b, unsigned int value) {
+        *b++ = (value >> 24) & 0xff;
+        *b++ = (value >> 16) & 0xff;
+        *b++ = (value >> 8) & 0xff;
+        *b++ = value & 0xff;
+        return b;
+}
+
+
+static unsigned char *_putSetting(unsigned char *b, int identifier, unsigned int value) {
+        *b++ = (identifier >> 8) & 0xff;
+        *b++ = identifier & 0xff;
+        return _putInt32(b, value);
+}
+
+
+// HPACK integer with the given prefix size, the flags are set in the first byte
+static unsigned char *_putInteger(unsigned char *b, int prefix, unsigned char flags, size_t value) {
+        size_t max = (1 << prefix) - 1;
+        if (value < max) {
+                *b++ = flags | value;
+        } else {
+                *b++ = flags | max;
+                for (value -= max; value >= 128; value >>= 7)
+                        *b++ = (value & 0x7f) | 0x80;
+                *b++ = value;
+        }
+        return b;
+}
+
+
+static unsigned char *_putString(unsigned char *b, const char *s) {
+        size_t length = strlen(s);
+        b = _putInteger(b, 7, 0x00, length);
+        memcpy(b, s, length);
+        return b + length;
+}
+
+
+// HPACK literal header field without indexing, the name is referenced by the static table index or sent as literal if the index is 0
+static unsigned char *_putHeader(unsigned char *b, int index, const char *name, const char *value) {
+        b = _putInteger(b, 4, 0x00, index);
+        if (! index)
+                b = _putString(b, name);
+        return _putString(b, value);
+}
+
+
+static unsigned char *_putVarint(unsigned char *b, size_t value) {
+        for (; value >= 128; value >>= 7)
+                *b++ = (value & 0x7f) | 0x80;
+        *b++ = value;
+        return b;
+}
+
+
+/**
+ * Send the HealthCheckRequest on a new stream: the HEADERS frame followed by
+ * the DATA frame with the gRPC length-prefixed message. The message is the
+ * protobuf encoded HealthCheckRequest with the service name (field 1), the
+ * empty message asks for the server's overall health. The flow-control window
+ * consumed by the previous response is returned in the same write
+ */
+static void _sendRequest(grpc_t *G, bool preface) {
+        unsigned char request[1024 + GRPC_FRAME_HEADER];
+        unsigned char *b = request;
+        if (preface) {
+                memcpy(b, GRPC_PREFACE, sizeof(GRPC_PREFACE) - 1);
+                b += sizeof(GRPC_PREFACE) - 1;
+                b = _putFrameHeader(b, 12, GRPC_SETTINGS, 0, 0);
+                b = _putSetting(b, GRPC_SETTINGS_HEADER_TABLE_SIZE, 0);
+                b = _putSetting(b, GRPC_SETTINGS_ENABLE_PUSH, 0);
+        } else if (G->owner->statistics.grpc.window > 0) {
+                b = _putFrameHeader(b, 4, GRPC_WINDOW_UPDATE, 0, 0);
+                b = _putInt32(b, G->owner->statistics.grpc.window);
+        }
+        G->owner->statistics.grpc.window = 0;
+        // HEADERS
+        char authority[STRLEN];
+        if (G->port->family == Socket_Unix)
+                snprintf(authority, sizeof(authority), "localhost");
+        else
+                snprintf(authority, sizeof(authority), "%s:%d", G->port->hostname, G->port->target.net.port);
+        unsigned char *header = b;
+        b += GRPC_FRAME_HEADER;
+        *b++ = 0x83;                                                                      // :method: POST
+        *b++ = G->port->target.net.ssl.options.flags == SSL_Enabled ? 0x87 : 0x86;        // :scheme: https or http
+        b = _putHeader(b, 4, NULL, GRPC_PATH);                                            // :path
+        b = _putHeader(b, 1, NULL, authority);                                            // :authority
+        b = _putHeader(b, 31, NULL, "application/grpc");                                  // content-type
+        b = _putHeader(b, 0, "te", "trailers");
+        b = _putHeader(b, 58, NULL, "Monit/" VERSION);                                    // user-agent
+        _putFrameHeader(header, (int)(b - header - GRPC_FRAME_HEADER), GRPC_HEADERS, GRPC_END_HEADERS, G->stream);
+        // DATA
+        const char *service = G->port->parameters.grpc.service;
+        size_t length = service ? 1 + (strlen(service) < 128 ? 1 : 2) + strlen(service) : 0;
+        b = _putFrameHeader(b, (int)(5 + length), GRPC_DATA, GRPC_END_STREAM, G->stream);
+        *b++ = 0;                                                                         // Not compressed
+        b = _putInt32(b, (unsigned int)length);
+        if (service) {
+                *b++ = 0x0a;                                                              // Field 1, length-delimited
+                b = _putVarint(b, strlen(service));
+                memcpy(b, service, strlen(service));
+                b += strlen(service);
+        }
+        if (Socket_write(G->socket, request, b - request) < 0)
+                THROW(IOException, "GRPC: error sending request -- %s", STRERROR);
+}
+
+
+static void _sendFrame(grpc_t *G, int type, int flags, int stream, const unsigned char *payload, int length) {
+        unsigned char frame[GRPC_FRAME_HEADER + 8];
+        ASSERT(length <= 8);
+        _putFrameHeader(frame, length, type, flags, stream);
+        if (length)
+                memcpy(frame + GRPC_FRAME_HEADER, payload, length);
+        if (Socket_write(G->socket, frame, GRPC_FRAME_HEADER + length) < 0)
+                THROW(IOException, "GRPC: error sending frame -- %s", STRERROR);
+}
+
+
+static void _readFrame(grpc_t *G) {
+        unsigned char header[GRPC_FRAME_HEADER];
+        if (Socket_read(G->socket, header, GRPC_FRAME_HEADER) != GRPC_FRAME_HEADER)
+                THROW(IOException, "GRPC: error receiving response -- %s", STRERROR);
+        G->frame.length = (header[0] << 16) | (header[1] << 8) | header[2];
+        G->frame.type = header[3];
+        G->frame.flags = header[4];
+        G->frame.stream = ((header[5] & 0x7f) << 24) | (header[6] << 16) | (header[7] << 8) | header[8];
+        if (G->frame.length > GRPC_FRAME_SIZE)
+                THROW(ProtocolException, "GRPC: invalid frame size %d -- not HTTP/2 protocol", G->frame.length);
+        if (G->frame.length && Socket_read(G->socket, G->frame.payload, G->frame.length) != G->frame.length)
+                THROW(IOException, "GRPC: error receiving response -- %s", STRERROR);
+}
+
+
+static unsigned int _getInt32(const unsigned char *b) {
+        return ((unsigned int)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+
+// Remove the padding and priority fields from the HEADERS or DATA frame payload
+static unsigned char *_getPayload(grpc_t *G, int *length) {
+        unsigned char *payload = G->frame.payload;
+        *length = G->frame.length;
+        if (G->frame.type != GRPC_CONTINUATION && (G->frame.flags & GRPC_PADDED)) {
+                if (*length < 1 || payload[0] >= *length)
+                        THROW(ProtocolException, "GRPC: invalid frame padding");
+                *length -= payload[0] + 1;
+                payload++;
+        }
+        if (G->frame.type == GRPC_HEADERS && (G->frame.flags & GRPC_PRIORITY)) {
+                if (*length < 5)
+                        THROW(ProtocolException, "GRPC: invalid HEADERS frame");
+                *length -= 5;
+                payload += 5;
+        }
+        return payload;
+}
+
+
+static size_t _getInteger(const unsigned char **b, const unsigned char *limit, int prefix) {
+        if (*b >= limit)
+                THROW(ProtocolException, "GRPC: invalid header block");
+        size_t max = (1 << prefix) - 1;
+        size_t value = *(*b)++ & max;
+        if (value == max) {
+                for (int shift = 0; ; shift += 7) {
+                        if (*b >= limit || shift > 28)
+                                THROW(ProtocolException, "GRPC: invalid header block");
+                        unsigned char byte = *(*b)++;
+                        value += (size_t)(byte & 0x7f) << shift;
+                        if (! (byte & 0x80))
+                                break;
+                }
+        }
+        return value;
+}
+
+
+static void _huffmanDecode(const unsigned char *data, size_t length, char *s, int size) {
+        unsigned long long code = 0;
+        int bits = 0, n = 0;
+        for (size_t i = 0; i < length; i++) {
+                for (int bit = 7; bit >= 0; bit--) {
+                        code = (code << 1) | ((data[i] >> bit) & 1);
+                        if (++bits >= 5) {
+                                for (int symbol = 0; symbol < 257; symbol++) {
+                                        if (_huffman[symbol].bits == bits && _huffman[symbol].code == code) {
+                                                if (symbol == 256)
+                                                        THROW(ProtocolException, "GRPC: invalid huffman code in the header block");
+                                                if (n < size - 1)
+                                                        s[n++] = symbol;
+                                                code = bits = 0;
+                                                break;
+                                        }
+                                }
+                                if (bits > 30)
+                                        THROW(ProtocolException, "GRPC: invalid huffman code in the header block");
+                        }
+                }
+        }
+        // The padding is the most significant bits of EOS, i.e. up to 7 ones
+        if (bits > 7 || code != (1ULL << bits) - 1)
+                THROW(ProtocolException, "GRPC: invalid huffman padding in the header block");
+        s[n] = 0;
+}
+
+
+// Decode the HPACK string, the value which doesn't fit into the buffer is truncated
+static void _getString(const unsigned char **b, const unsigned char *limit, char *s, int size) {
+        bool huffman = **b & 0x80;
+        size_t length = _getInteger(b, limit, 7);
+        if (length > (size_t)(limit - *b))
+                THROW(ProtocolException, "GRPC: invalid header block");
+        if (huffman) {
+                _huffmanDecode(*b, length, s, size);
+        } else {
+                size_t n = MIN(length, (size_t)size - 1);
+                memcpy(s, *b, n);
+                s[n] = 0;
+        }
+        *b += length;
+}
+
+
+static void _getIndexed(int index, char *name, char *value) {
+        if (index < 1 || index > GRPC_STATIC_TABLE_SIZE)
+                THROW(ProtocolException, "GRPC: header table index %d is not supported", index);
+        snprintf(name, STRLEN, "%s", _staticTable[index].name);
+        snprintf(value, STRLEN, "%s", _staticTable[index].value);
+}
+
+
+// Decode the percent-encoded grpc-message
+static void _unescape(char *s) {
+        char *d = s;
+        for (; *s; s++) {
+                unsigned int c;
+                if (*s == '%' && sscanf(s + 1, "%2x", &c) == 1) {
+                        *d++ = c;
+                        s += 2;
+                } else {
+                        *d++ = *s;
+                }
+        }
+        *d = 0;
+}
+
+
+static void _processHeader(grpc_t *G, const char *name, const char *value) {
+        DEBUG("GRPC: header %s: %s\n", name, value);
+        if (Str_isEqual(name, ":status")) {
+                G->status = (int)strtol(value, NULL, 10);
+        } else if (Str_isEqual(name, "grpc-status")) {
+                G->grpcStatus = (int)strtol(value, NULL, 10);
+        } else if (Str_isEqual(name, "grpc-message")) {
+                snprintf(G->grpcMessage, sizeof(G->grpcMessage), "%s", value);
+                _unescape(G->grpcMessage);
+        }
+}
+
+
+/**
+ * Decode the header block. We have set the header table size to 0, so the
+ * server cannot reference the dynamic table, just the static table
+ */
+static void _processHeaders(grpc_t *G) {
+        char name[STRLEN], value[STRLEN];
+        const unsigned char *b = G->headers.block;
+        const unsigned char *limit = G->headers.block + G->headers.length;
+        while (b < limit) {
+                if (*b & 0x80) {
+                        // Indexed header field
+                        _getIndexed((int)_getInteger(&b, limit, 7), name, value);
+                } else if ((*b & 0xe0) == 0x20) {
+                        // Dynamic table size update
+                        if (_getInteger(&b, limit, 5) > 0)
+                                THROW(ProtocolException, "GRPC: header table size update exceeds the limit");
+                        continue;
+                } else {
+                        // Literal header field: with incremental indexing (the entry is evicted immediately as the table size is 0), without indexing or never indexed
+                        int index = (int)_getInteger(&b, limit, (*b & 0xc0) == 0x40 ? 6 : 4);
+                        if (index)
+                                _getIndexed(index, name, value);
+                        else
+                                _getString(&b, limit, name, sizeof(name));
+                        _getString(&b, limit, value, sizeof(value));
+                }
+                _processHeader(G, name, value);
+        }
+        G->headers.length = 0;
+}
+
+
+static void _appendHeaders(grpc_t *G, const unsigned char *data, int length) {
+        if (G->headers.length + length > GRPC_HEADERS_SIZE)
+                THROW(ProtocolException, "GRPC: header block is too large");
+        memcpy(G->headers.block + G->headers.length, data, length);
+        G->headers.length += length;
+}
+
+
+static void _appendMessage(grpc_t *G, const unsigned char *data, int length) {
+        if (G->message.length + length > GRPC_MESSAGE_SIZE)
+                THROW(ProtocolException, "GRPC: health check response is too large");
+        memcpy(G->message.data + G->message.length, data, length);
+        G->message.length += length;
+}
+
+
+// Parse the health check response message, returns the serving status
+static int _getServingStatus(grpc_t *G) {
+        if (G->message.length < 5)
+                THROW(ProtocolException, "GRPC: health check response is missing");
+        if (G->message.data[0])
+                THROW(ProtocolException, "GRPC: compressed health check response is not supported");
+        unsigned int length = _getInt32(G->message.data + 1);
+        if (length != (unsigned int)G->message.length - 5)
+                THROW(ProtocolException, "GRPC: invalid health check response length");
+        // HealthCheckResponse: field 1 (varint) is the status, the unknown fields are skipped
+        int status = Grpc_Unknown;
+        const unsigned char *b = G->message.data + 5, *limit = G->message.data + G->message.length;
+        while (b < limit) {
+                int tag = *b++;
+                unsigned long long value = 0;
+                switch (tag & 0x7) {
+                        case 0:
+                                for (int shift = 0; ; shift += 7) {
+                                        if (b >= limit || shift > 63)
+                                                THROW(ProtocolException, "GRPC: invalid health check response");
+                                        value |= (unsigned long long)(*b & 0x7f) << shift;
+                                        if (! (*b++ & 0x80))
+                                                break;
+                                }
+                                if (tag == 0x08)
+                                        status = (int)value;
+                                break;
+                        case 2:
+                                for (int shift = 0; ; shift += 7) {
+                                        if (b >= limit || shift > 63)
+                                                THROW(ProtocolException, "GRPC: invalid health check response");
+                                        value |= (unsigned long long)(*b & 0x7f) << shift;
+                                        if (! (*b++ & 0x80))
+                                                break;
+                                }
+                                if (value > (unsigned long long)(limit - b))
+                                        THROW(ProtocolException, "GRPC: invalid health check response");
+                                b += value;
+                                break;
+                        default:
+                                THROW(ProtocolException, "GRPC: invalid health check response");
+                                break;
+                }
+        }
+        return status;
+}
+
+
+/**
+ * Read the frames until our stream ends. The connection level frames are
+ * handled on the fly, the frames of other streams are ignored
+ */
+static void _readResponse(grpc_t *G) {
+        bool end = false, continuation = false;
+        do {
+                _readFrame(G);
+                int length;
+                unsigned char *payload;
+                if (continuation && (G->frame.type != GRPC_CONTINUATION || G->frame.stream != G->stream))
+                        THROW(ProtocolException, "GRPC: CONTINUATION frame expected");
+                switch (G->frame.type) {
+                        case GRPC_SETTINGS:
+                                if (! (G->frame.flags & GRPC_ACK))
+                                        _sendFrame(G, GRPC_SETTINGS, GRPC_ACK, 0, NULL, 0);
+                                break;
+                        case GRPC_PING:
+                                if (! (G->frame.flags & GRPC_ACK) && G->frame.length == 8)
+                                        _sendFrame(G, GRPC_PING, GRPC_ACK, 0, G->frame.payload, 8);
+                                break;
+                        case GRPC_GOAWAY:
+                                if (G->frame.length < 8)
+                                        THROW(ProtocolException, "GRPC: invalid GOAWAY frame");
+                                // If our stream was accepted, the server finishes it before closing the connection
+                                if ((int)(_getInt32(G->frame.payload) & 0x7fffffff) < G->stream)
+                                        THROW(IOException, "GRPC: connection closed by the server -- error code %u", _getInt32(G->frame.payload + 4));
+                                break;
+                        case GRPC_RST_STREAM:
+                                if (G->frame.stream == G->stream)
+                                        THROW(ProtocolException, "GRPC: stream reset by the server -- error code %u", G->frame.length >= 4 ? _getInt32(G->frame.payload) : 0);
+                                break;
+                        case GRPC_HEADERS:
+                        case GRPC_CONTINUATION:
+                                if (G->frame.stream == G->stream) {
+                                        payload = _getPayload(G, &length);
+                                        _appendHeaders(G, payload, length);
+                                        continuation = ! (G->frame.flags & GRPC_END_HEADERS);
+                                        if (! continuation)
+                                                _processHeaders(G);
+                                }
+                                break;
+                        case GRPC_DATA:
+                                // The received data are returned to the connection flow-control window with the next request, so the reused connection doesn't run out of the window
+                                G->owner->statistics.grpc.window += G->frame.length;
+                                payload = _getPayload(G, &length);
+                                if (G->frame.stream == G->stream)
+                                        _appendMessage(G, payload, length);
+                                break;
+                        default:
+                                break;
+                }
+                // The stream ends by the HEADERS (trailers) or DATA frame with the END_STREAM flag, the trailers may continue in CONTINUATION frames
+                if (G->frame.stream == G->stream && (G->frame.type == GRPC_HEADERS || G->frame.type == GRPC_DATA) && (G->frame.flags & GRPC_END_STREAM))
+                        end = true;
+        } while (! end || continuation);
+}
+
+
+static void _check(grpc_t *G) {
+        if (G->status != 200)
+                THROW(ProtocolException, "GRPC: HTTP error -- status %d", G->status);
+        if (G->grpcStatus < 0)
+                THROW(ProtocolException, "GRPC: error -- grpc-status is missing in the response");
+        if (G->grpcStatus > 0)
+                THROW(ProtocolException, "GRPC: error -- %s%s%s",
+                      G->grpcStatus < (int)(sizeof(_grpcStatus) / sizeof(_grpcStatus[0])) ? _grpcStatus[G->grpcStatus] : "status code",
+                      *G->grpcMessage ? ": " : "",
+                      G->grpcMessage);
+        int status = _getServingStatus(G);
+        G->port->statistics.grpc.status = status;
+        if (status != Grpc_Serving) {
+                const char *name = status < (int)(sizeof(_servingStatus) / sizeof(_servingStatus[0])) ? _servingStatus[status] : "invalid";
+                if (G->port->parameters.grpc.service)
+                        THROW(ProtocolException, "GRPC: service %s status is %s", G->port->parameters.grpc.service, name);
+                THROW(ProtocolException, "GRPC: server status is %s", name);
+        }
+}
+
+
+static void _healthCheck(Socket_T socket, bool connect) {
+        grpc_t *G;
+        NEW(G);
+        TRY
+        {
+                G->socket = socket;
+                G->port = Socket_getPort(socket);
+                ASSERT(G->port);
+                G->status = -1;
+                G->grpcStatus = -1;
+                // The connection state (the last stream id and the window to return) is kept in the port owning the keepalive connection
+                G->owner = G->port->shared ? G->port->shared : G->port;
+                if (connect)
+                        G->owner->statistics.grpc.stream = 1;
+                else if (G->owner->statistics.grpc.stream >= GRPC_STREAM_MAX)
+                        THROW(IOException, "GRPC: stream identifiers exhausted, reconnecting");
+                else
+                        G->owner->statistics.grpc.stream += 2;
+                G->stream = G->owner->statistics.grpc.stream;
+                _sendRequest(G, connect);
+                _readResponse(G);
+                _check(G);
+        }
+        FINALLY
+        {
+                FREE(G);
+        }
+        END_TRY;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void check_grpc(Socket_T socket) {
+        ASSERT(socket);
+        _healthCheck(socket, true);
+}
+
+
+/**
+ * Keepalive test: send the health check request on the next stream of the
+ * open connection
+ */
+void ping_grpc(Socket_T socket) {
+        ASSERT(socket);
+        _healthCheck(socket, false);
+}
+
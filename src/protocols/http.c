@@ -30,6 +30,7 @@
 
 #include "md5.h"
 #include "sha1.h"
+#include "sha256.h"
 #include "base64.h"
 #include "checksum.h"
 #include "protocol.h"
@@ -52,6 +53,14 @@
  *
  *  If the status code is >= 400, an error has occurred.
  *
+ *  If the content is tested (checksum or content match), the ETag and
+ *  Last-Modified headers of the last response which passed the tests are
+ *  kept in the port and the next request is conditional (If-None-Match,
+ *  If-Modified-Since). The 304 response means the content didn't change,
+ *  so the last verified result is valid and the body is not downloaded.
+ *  The conditional request is not used if the test expects an explicit
+ *  status or if the request headers set the conditions already.
+ *
  *  @file
  */
 
@@ -59,30 +68,89 @@
 /* ------------------------------------------------------------- Definitions */
 
 
-#define BUFSIZE 4096
+// The content is matched in a window of constant size
+#define MATCH_WINDOW 65536
+
+// The tail of the window which is kept for the matches spanning the window boundary
+#define MATCH_OVERLAP 4096
+
+
+/*
+ * Streaming content matcher. The body is scanned window by window as it is
+ * read, so the memory used doesn't depend on the content size. A match of at
+ * most MATCH_OVERLAP bytes is found even if it spans the window boundary.
+ */
+typedef struct Matcher_T {
+        regex_t *regex;
+        bool matched;
+        bool shifted;         /**< The window doesn't start at the body start */
+        int length;                                /**< The window data length */
+        char window[MATCH_WINDOW + 1];
+} *Matcher_T;
+
+
+/*
+ * The cache validators of the response
+ */
+typedef struct Validators_T {
+        char etag[256];
+        char lastModified[64];
+} Validators_T;
 
 
 /* ----------------------------------------------------------------- Private */
 
 
-static void _contentVerify(Port_T P, const char *data) {
-        if (P->url_request && P->url_request->regex) {
+static void _match(Matcher_T m, int eflags) {
+        m->window[m->length] = 0;
+        if (regexec(m->regex, m->window, 0, NULL, eflags | (m->shifted ? REG_NOTBOL : 0)) == 0)
+                m->matched = true;
+}
+
+
+static void _matchAppend(Matcher_T m, const char *data, int length) {
+        while (length > 0 && ! m->matched) {
+                int n = MIN(length, MATCH_WINDOW - m->length);
+                memcpy(m->window + m->length, data, n);
+                m->length += n;
+                data += n;
+                length -= n;
+                if (m->length == MATCH_WINDOW) {
+                        // More data follows, so '$' cannot match at the window end yet
+                        _match(m, REG_NOTEOL);
+                        memmove(m->window, m->window + MATCH_WINDOW - MATCH_OVERLAP, MATCH_OVERLAP);
+                        m->length = MATCH_OVERLAP;
+                        m->shifted = true;
+                }
+        }
+}
+
+
+static void _appendData(Port_T P, Matcher_T matcher, ChecksumContext_T context, const char *data, int length) {
+        if (P->parameters.http.checksum)
+                Checksum_append(context, data, length);
+        if (matcher)
+                _matchAppend(matcher, data, length);
+}
+
+
+static void _contentVerify(Port_T P, Matcher_T matcher) {
+        if (matcher) {
                 bool rv = false;
                 char error[512];
-                int regex_return = regexec(P->url_request->regex, data, 0, NULL, 0);
+                if (! matcher->matched)
+                        _match(matcher, 0);
                 switch (P->url_request->operator) {
                         case Operator_Equal:
-                                if (regex_return == 0) {
+                                if (matcher->matched) {
                                         rv = true;
                                         DEBUG("HTTP: Regular expression matches\n");
                                 } else {
-                                        char errbuf[STRLEN];
-                                        regerror(regex_return, NULL, errbuf, sizeof(errbuf));
-                                        snprintf(error, sizeof(error), "Regular expression doesn't match: %s", errbuf);
+                                        snprintf(error, sizeof(error), "Regular expression doesn't match");
                                 }
                                 break;
                         case Operator_NotEqual:
-                                if (regex_return == 0) {
+                                if (matcher->matched) {
                                         snprintf(error, sizeof(error), "Regular expression matches");
                                 } else {
                                         rv = true;
@@ -112,6 +180,46 @@ static bool _hasHeader(List_T list, const char *name) {
 }
 
 
+static bool _hasContentTest(Port_T P) {
+        return (P->url_request && P->url_request->regex) || P->parameters.http.checksum;
+}
+
+
+/**
+ * Check if the request is conditional: the content of the last response which passed the tests has a validator
+ */
+static bool _isConditional(Port_T P) {
+        return _hasContentTest(P)
+                && P->parameters.http.method == Http_Get
+                && ! P->parameters.http.hasStatus
+                && (P->parameters.http.etag || P->parameters.http.lastModified)
+                && ! _hasHeader(P->parameters.http.headers, "If-None-Match")
+                && ! _hasHeader(P->parameters.http.headers, "If-Modified-Since");
+}
+
+
+/**
+ * Keep the validators of the verified content for the next conditional request
+ */
+static void _setValidators(Port_T P, Validators_T *validators) {
+        FREE(P->parameters.http.etag);
+        FREE(P->parameters.http.lastModified);
+        if (*validators->etag)
+                P->parameters.http.etag = Str_dup(validators->etag);
+        if (*validators->lastModified)
+                P->parameters.http.lastModified = Str_dup(validators->lastModified);
+}
+
+
+/**
+ * Check if the response has a body which must be read before the keepalive
+ * connection can be reused for the next request (RFC 9112 section 6.3)
+ */
+static bool _hasBody(Port_T P, int status) {
+        return P->parameters.http.method != Http_Head && status >= 200 && status != 204 && status != 304;
+}
+
+
 static unsigned int _getChunkSize(Socket_T socket) {
         char buf[9];
         unsigned int wantBytes = 0;
@@ -141,86 +249,108 @@ static int _readDataFromSocket(Socket_T socket, char *data, int wantBytes) {
 }
 
 
-static void _readData(Socket_T socket, Port_T P, char **data, unsigned int wantBytes, unsigned int *haveBytes, ChecksumContext_T context) {
-        if (P->url_request && P->url_request->regex) {
-                // The content test is required => cache the whole body
-                *data = realloc(*data, *haveBytes + wantBytes + 1);
-                *haveBytes += _readDataFromSocket(socket, *data + *haveBytes, wantBytes);
-                if (P->parameters.http.checksum)
-                        Checksum_append(context, *data, wantBytes);
-                *(*data + *haveBytes) = 0;
-        } else {
-                // No content check is required => use small buffer and compute the checksum on the fly
-                *haveBytes = 0;
-                for (int readBytes = (wantBytes < BUFSIZE) ? wantBytes : BUFSIZE; *haveBytes < wantBytes; readBytes = (wantBytes - *haveBytes) < BUFSIZE ? (wantBytes - *haveBytes) : BUFSIZE) {
-                        _readDataFromSocket(socket, *data, readBytes);
-                        if (P->parameters.http.checksum)
-                                Checksum_append(context, *data, readBytes);
-                        *haveBytes += readBytes;
-                }
+static void _skipData(Socket_T socket, unsigned int wantBytes) {
+        while (wantBytes > 0) {
+                int length;
+                if (! Socket_peek(socket, &length))
+                        THROW(ProtocolException, "HTTP error: Receiving data -- %s", STRERROR);
+                length = MIN((unsigned int)length, wantBytes);
+                Socket_consume(socket, length);
+                wantBytes -= length;
+        }
+}
+
+
+static void _skipTrailer(Socket_T socket) {
+        char buf[512];
+        while (Socket_readLine(socket, buf, sizeof(buf))) {
+                if ((buf[0] == '\r' && buf[1] == '\n') || (buf[0] == '\n'))
+                        break;
         }
 }
 
 
-static void _processBodyChunked(Socket_T socket, Port_T P, char **data, __attribute__ ((unused)) int *contentLength, ChecksumContext_T context) {
+/*
+ * Read wantBytes of the body and compute the checksum and content match on
+ * the fly in the socket buffer
+ */
+static void _readData(Socket_T socket, Port_T P, Matcher_T matcher, unsigned int wantBytes, unsigned int *haveBytes, ChecksumContext_T context) {
+        while (wantBytes > 0) {
+                int readBytes;
+                const char *buffer = Socket_peek(socket, &readBytes);
+                if (! buffer)
+                        THROW(ProtocolException, "HTTP error: Receiving data -- %s", STRERROR);
+                readBytes = MIN((unsigned int)readBytes, wantBytes);
+                _appendData(P, matcher, context, buffer, readBytes);
+                Socket_consume(socket, readBytes);
+                *haveBytes += readBytes;
+                wantBytes -= readBytes;
+        }
+}
+
+
+static void _processBodyChunked(Socket_T socket, Port_T P, Matcher_T matcher, __attribute__ ((unused)) int *contentLength, ChecksumContext_T context) {
         char crlf[2] = {};
         unsigned int wantBytes = 0;
         unsigned int haveBytes = 0;
-        while ((wantBytes = _getChunkSize(socket)) && haveBytes < Run.limits.httpContentBuffer) {
+        while ((wantBytes = _getChunkSize(socket))) {
+                unsigned int skipBytes = 0;
                 if (haveBytes + wantBytes > Run.limits.httpContentBuffer) {
+                        skipBytes = haveBytes + wantBytes - Run.limits.httpContentBuffer;
+                        wantBytes -= skipBytes;
+                }
+                if (wantBytes)
+                        _readData(socket, P, matcher, wantBytes, &haveBytes, context);
+                if (skipBytes) {
                         DEBUG("HTTP: content buffer limit exceeded -- limiting the data to %d\n", Run.limits.httpContentBuffer);
-                        wantBytes = Run.limits.httpContentBuffer - haveBytes;
+                        if (! P->keepalive)
+                                return;
+                        // Discard the rest of the body, so the keepalive connection can be reused
+                        _skipData(socket, skipBytes);
                 }
-                _readData(socket, P, data, wantBytes, &haveBytes, context);
                 // Read the CRLF terminator
                 _readDataFromSocket(socket, crlf, 2);
         }
+        if (P->keepalive)
+                _skipTrailer(socket);
 }
 
 
-static void _processBodyContentLength(Socket_T socket, Port_T P, char **data, int *contentLength, ChecksumContext_T context) {
+static void _processBodyContentLength(Socket_T socket, Port_T P, Matcher_T matcher, int *contentLength, ChecksumContext_T context) {
         unsigned int haveBytes = 0;
+        unsigned int skipBytes = 0;
         if (*contentLength < 0) {
                 THROW(ProtocolException, "HTTP error: Missing Content-Length header");
         } else if (*contentLength == 0) {
-                THROW(ProtocolException, "HTTP error: No content returned from server");
+                if (_hasContentTest(P))
+                        THROW(ProtocolException, "HTTP error: No content returned from server");
+                return;
         } else if (*contentLength > (int)Run.limits.httpContentBuffer) {
                 DEBUG("HTTP: content buffer limit exceeded -- limiting the data to %d\n", Run.limits.httpContentBuffer);
+                skipBytes = *contentLength - Run.limits.httpContentBuffer;
                 *contentLength = Run.limits.httpContentBuffer;
         }
-        _readData(socket, P, data, *contentLength, &haveBytes, context);
+        _readData(socket, P, matcher, *contentLength, &haveBytes, context);
+        if (P->keepalive)
+                _skipData(socket, skipBytes);
 }
 
 
-static void _processBodyUntilEOF(Socket_T socket, Port_T P, char **data, __attribute__ ((unused)) int *contentLength, ChecksumContext_T context) {
-        int readBytes = 0;
-        if (P->url_request && P->url_request->regex) {
-                // The content test is required => cache the whole body
-                unsigned int haveBytes = 0;
-                unsigned int wantBytes = STRLEN;
-                while (haveBytes < Run.limits.httpContentBuffer && (readBytes = Socket_read(socket, *data + haveBytes, wantBytes)) > 0)  {
-                        if (P->parameters.http.checksum)
-                                Checksum_append(context, *data + haveBytes, readBytes);
-                        haveBytes += readBytes;
-                        if (haveBytes + wantBytes > Run.limits.httpContentBuffer)
-                                wantBytes = Run.limits.httpContentBuffer - haveBytes;
-                        *data = realloc(*data, haveBytes + wantBytes + 1);
-                }
-                *(*data + haveBytes) = 0;
-        } else {
-                // No content check is required => use small buffer and compute the checksum on the fly
-                while ((readBytes = Socket_read(socket, *data, BUFSIZE)) > 0) {
-                        if (P->parameters.http.checksum)
-                                Checksum_append(context, *data, readBytes);
-                }
-        }
-        if (readBytes < 0) {
-                THROW(ProtocolException, "HTTP error: Receiving data -- %s", STRERROR);
+static void _processBodyUntilEOF(Socket_T socket, Port_T P, Matcher_T matcher, __attribute__ ((unused)) int *contentLength, ChecksumContext_T context) {
+        int readBytes;
+        const char *buffer;
+        // The content test is limited to the content buffer size, the checksum is computed from the whole body
+        unsigned long long wantBytes = matcher ? Run.limits.httpContentBuffer : ULLONG_MAX;
+        while (wantBytes > 0 && (buffer = Socket_peek(socket, &readBytes))) {
+                readBytes = MIN((unsigned long long)readBytes, wantBytes);
+                _appendData(P, matcher, context, buffer, readBytes);
+                Socket_consume(socket, readBytes);
+                wantBytes -= readBytes;
         }
 }
 
 
-static void _processStatus(Socket_T socket, Port_T P) {
+static int _processStatus(Socket_T socket, Port_T P) {
         int status;
         char buf[512] = {};
 
@@ -231,10 +361,11 @@ static void _processStatus(Socket_T socket, Port_T P) {
                 THROW(ProtocolException, "HTTP error: Cannot parse HTTP status in response: %s", buf);
         if (! Util_evalQExpression(P->parameters.http.operator, status, P->parameters.http.hasStatus ? P->parameters.http.status : 400))
                 THROW(ProtocolException, "HTTP error: Server returned status %d", status);
+        return status;
 }
 
 
-static void _processHeaders(Socket_T socket, void (**processBody)(Socket_T socket, Port_T P, char **data, int *contentLength, ChecksumContext_T context), int *contentLength) {
+static void _processHeaders(Socket_T socket, void (**processBody)(Socket_T socket, Port_T P, Matcher_T matcher, int *contentLength, ChecksumContext_T context), int *contentLength, Validators_T *validators) {
         char buf[512] = {};
         *processBody = _processBodyUntilEOF;
 
@@ -252,6 +383,10 @@ static void _processHeaders(Socket_T socket, void (**processBody)(Socket_T socke
                         if (Str_sub(buf, "chunked")) {
                                 *processBody = _processBodyChunked;
                         }
+                } else if (Str_startsWith(buf, "ETag:")) {
+                        snprintf(validators->etag, sizeof(validators->etag), "%s", Str_trim(buf + 5));
+                } else if (Str_startsWith(buf, "Last-Modified:")) {
+                        snprintf(validators->lastModified, sizeof(validators->lastModified), "%s", Str_trim(buf + 14));
                 }
         }
 }
@@ -264,27 +399,41 @@ static void _processHeaders(Socket_T socket, void (**processBody)(Socket_T socke
  */
 static void _checkResponse(Socket_T socket, Port_T P) {
         int contentLength = -1;
-        void (*processBody)(Socket_T socket, Port_T P, char **data, int *contentLength, ChecksumContext_T context);
-        _processStatus(socket, P);
-        _processHeaders(socket, &processBody, &contentLength);
-        if ((P->url_request && P->url_request->regex) || P->parameters.http.checksum) {
+        Validators_T validators = {};
+        void (*processBody)(Socket_T socket, Port_T P, Matcher_T matcher, int *contentLength, ChecksumContext_T context);
+        int status = _processStatus(socket, P);
+        _processHeaders(socket, &processBody, &contentLength, &validators);
+        if (status == 304 && _isConditional(P)) {
+                DEBUG("HTTP: Content not modified -- the last verified content is valid\n");
+                return;
+        }
+        // The keepalive connection requires the whole response to be read, even if there is no content test
+        if (_hasContentTest(P) || (P->keepalive && _hasBody(P, status))) {
                 if (processBody) {
-                        char *data = CALLOC(1, BUFSIZE);
+                        Matcher_T matcher = NULL;
                         struct ChecksumContext_T context;
+                        if (P->url_request && P->url_request->regex) {
+                                matcher = ALLOC(sizeof(struct Matcher_T));
+                                matcher->regex = P->url_request->regex;
+                                matcher->matched = matcher->shifted = false;
+                                matcher->length = 0;
+                        }
                         TRY
                         {
                                 // Read data
                                 if (P->parameters.http.checksum)
                                         Checksum_init(&context, P->parameters.http.hashtype);
-                                processBody(socket, P, &data, &contentLength, &context);
+                                processBody(socket, P, matcher, &contentLength, &context);
                                 // Perform tests
                                 if (P->parameters.http.checksum)
                                         Checksum_verify(&context, P->parameters.http.checksum);
-                                _contentVerify(P, data);
+                                _contentVerify(P, matcher);
+                                if (_hasContentTest(P))
+                                        _setValidators(P, &validators);
                         }
                         FINALLY
                         {
-                                FREE(data);
+                                FREE(matcher);
                         }
                         END_TRY;
                 } else {
@@ -325,7 +474,13 @@ static void _sendRequest(Socket_T socket, Port_T P) {
         if (! _hasHeader(P->parameters.http.headers, "Accept-Encoding"))
                 StringBuffer_append(sb, "Accept-Encoding: identity\r\n"); // We want no compression
         if (! _hasHeader(P->parameters.http.headers, "Connection"))
-                StringBuffer_append(sb, "Connection: close\r\n");
+                StringBuffer_append(sb, "Connection: %s\r\n", P->keepalive ? "keep-alive" : "close");
+        if (_isConditional(P)) {
+                if (P->parameters.http.etag)
+                        StringBuffer_append(sb, "If-None-Match: %s\r\n", P->parameters.http.etag);
+                if (P->parameters.http.lastModified)
+                        StringBuffer_append(sb, "If-Modified-Since: %s\r\n", P->parameters.http.lastModified);
+        }
         // Add headers if we have them
         if (P->parameters.http.headers) {
                 for (list_t p = P->parameters.http.headers->head; p; p = p->next) {
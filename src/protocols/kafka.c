@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "protocol.h"
+
+// libmonit
+#include "exceptions/IOException.h"
+#include "exceptions/ProtocolException.h"
+
+
+/**
+ *  Kafka broker test.
+ *
+ *  The test sends the ApiVersions request to find the supported Metadata
+ *  request versions and then the Metadata request for the configured topics
+ *  (or no topics, if just the brokers are checked). The test fails if the
+ *  cluster has no active controller, a topic has an error or a partition
+ *  of the topic has no leader. The number of brokers, the partitions and
+ *  the under-replicated partitions (the in-sync replica set is smaller than
+ *  the replica set) are collected. The keepalive test sends the same
+ *  requests on the open connection.
+ *
+ *  The client uses the non-flexible Metadata versions 1 to 8.
+ *
+ *  @see https://kafka.apache.org/protocol.html
+ *
+ *  @file
+ */
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+#define KAFKA_REQUEST_MAX  8192
+#define KAFKA_RESPONSE_MAX (16 * 1024 * 1024)
+
+#define KAFKA_CLIENT_ID "monit"
+
+// API keys
+#define KAFKA_METADATA     3
+#define KAFKA_API_VERSIONS 18
+
+// The Metadata versions we can encode and decode
+#define KAFKA_METADATA_MIN 1
+#define KAFKA_METADATA_MAX 8
+
+// Error codes
+#define KAFKA_UNSUPPORTED_VERSION 35
+
+typedef struct {
+        Socket_T socket;
+        Port_T port;
+        int correlation;
+        int version;                                           /**< Metadata version */
+        struct {
+                unsigned char buf[KAFKA_REQUEST_MAX];
+                unsigned char *cursor;
+        } request;
+        struct {
+                unsigned char *buf;
+                unsigned char *cursor;
+                unsigned char *limit;
+        } response;
+} kafka_t;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _putInt8(kafka_t *K, int value) {
+        if (K->request.cursor + 1 > K->request.buf + sizeof(K->request.buf))
+                THROW(ProtocolException, "KAFKA: request is too large");
+        *K->request.cursor++ = value;
+}
+
+
+static void _putInt16(kafka_t *K, int value) {
+        _putInt8(K, (value >> 8) & 0xff);
+        _putInt8(K, value & 0xff);
+}
+
+
+static void _putInt32(kafka_t *K, int value) {
+        _putInt16(K, (value >> 16) & 0xffff);
+        _putInt16(K, value & 0xffff);
+}
+
+
+static void _putString(kafka_t *K, const char *s) {
+        size_t length = strlen(s);
+        if (K->request.cursor + 2 + length > K->request.buf + sizeof(K->request.buf))
+                THROW(ProtocolException, "KAFKA: request is too large");
+        _putInt16(K, (int)length);
+        memcpy(K->request.cursor, s, length);
+        K->request.cursor += length;
+}
+
+
+// Request header v1: size (set by _send), api key, api version, correlation id and client id
+static void _begin(kafka_t *K, int key, int version) {
+        K->request.cursor = K->request.buf + 4;
+        _putInt16(K, key);
+        _putInt16(K, version);
+        _putInt32(K, ++K->correlation);
+        _putString(K, KAFKA_CLIENT_ID);
+}
+
+
+static void _send(kafka_t *K) {
+        int size = (int)(K->request.cursor - K->request.buf);
+        unsigned char *cursor = K->request.cursor;
+        K->request.cursor = K->request.buf;
+        _putInt32(K, size - 4);
+        if (Socket_write(K->socket, K->request.buf, size) != size)
+                THROW(IOException, "KAFKA: error sending request -- %s", STRERROR);
+        K->request.cursor = cursor;
+}
+
+
+static void _need(kafka_t *K, long long size) {
+        if (size < 0 || size > K->response.limit - K->response.cursor)
+                THROW(ProtocolException, "KAFKA: response is truncated");
+}
+
+
+static int _getInt8(kafka_t *K) {
+        _need(K, 1);
+        return (signed char)*K->response.cursor++;
+}
+
+
+static int _getInt16(kafka_t *K) {
+        _need(K, 2);
+        short value = (K->response.cursor[0] << 8) | K->response.cursor[1];
+        K->response.cursor += 2;
+        return value;
+}
+
+
+static int _getInt32(kafka_t *K) {
+        _need(K, 4);
+        int value = (int)(((unsigned int)K->response.cursor[0] << 24) | (K->response.cursor[1] << 16) | (K->response.cursor[2] << 8) | K->response.cursor[3]);
+        K->response.cursor += 4;
+        return value;
+}
+
+
+// Skip the string or nullable string (length -1)
+static void _skipString(kafka_t *K) {
+        int length = _getInt16(K);
+        if (length > 0) {
+                _need(K, length);
+                K->response.cursor += length;
+        }
+}
+
+
+static void _skipArray(kafka_t *K, int itemSize) {
+        int count = _getInt32(K);
+        if (count > 0) {
+                _need(K, (long long)count * itemSize);
+                K->response.cursor += count * itemSize;
+        }
+}
+
+
+// Read the response and check the correlation id
+static void _receive(kafka_t *K) {
+        unsigned char header[4];
+        if (Socket_read(K->socket, header, 4) != 4)
+                THROW(IOException, "KAFKA: error receiving response -- %s", STRERROR);
+        int size = (int)(((unsigned int)header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3]);
+        if (size < 4 || size > KAFKA_RESPONSE_MAX)
+                THROW(ProtocolException, "KAFKA: invalid response size %d -- not Kafka protocol", size);
+        FREE(K->response.buf);
+        K->response.buf = ALLOC(size);
+        if (Socket_read(K->socket, K->response.buf, size) != size)
+                THROW(IOException, "KAFKA: error receiving response -- %s", STRERROR);
+        K->response.cursor = K->response.buf;
+        K->response.limit = K->response.buf + size;
+        int correlation = _getInt32(K);
+        if (correlation != K->correlation)
+                THROW(ProtocolException, "KAFKA: invalid response correlation id %d, expected %d -- not Kafka protocol", correlation, K->correlation);
+}
+
+
+/**
+ * ApiVersions v0: find the highest Metadata version supported by both sides.
+ * The broker responds to an unsupported request version with the error and
+ * its supported versions, so the v0 request works with any broker
+ */
+static void _apiVersions(kafka_t *K) {
+        _begin(K, KAFKA_API_VERSIONS, 0);
+        _send(K);
+        _receive(K);
+        int error = _getInt16(K);
+        if (error && error != KAFKA_UNSUPPORTED_VERSION)
+                THROW(ProtocolException, "KAFKA: ApiVersions error %d", error);
+        K->version = -1;
+        for (int count = _getInt32(K); count > 0; count--) {
+                int key = _getInt16(K);
+                int min = _getInt16(K);
+                int max = _getInt16(K);
+                if (key == KAFKA_METADATA && min <= KAFKA_METADATA_MAX && max >= KAFKA_METADATA_MIN)
+                        K->version = MIN(max, KAFKA_METADATA_MAX);
+        }
+        if (K->version < 0)
+                THROW(ProtocolException, "KAFKA: the broker doesn't support Metadata request versions %d-%d", KAFKA_METADATA_MIN, KAFKA_METADATA_MAX);
+}
+
+
+static void _sendMetadata(kafka_t *K) {
+        _begin(K, KAFKA_METADATA, K->version);
+        List_T topics = K->port->parameters.kafka.topics;
+        // Empty array: no topics, just the brokers and the controller
+        _putInt32(K, topics ? List_length(topics) : 0);
+        if (topics)
+                for (list_t t = topics->head; t; t = t->next)
+                        _putString(K, t->e);
+        if (K->version >= 4)
+                _putInt8(K, 0);                                         // allow_auto_topic_creation
+        if (K->version >= 8) {
+                _putInt8(K, 0);                             // include_cluster_authorized_operations
+                _putInt8(K, 0);                               // include_topic_authorized_operations
+        }
+        _send(K);
+}
+
+
+static void _readPartitions(kafka_t *K, const char *topic) {
+        int leaderless = 0;
+        for (int count = _getInt32(K); count > 0; count--) {
+                int error = _getInt16(K);
+                int partition = _getInt32(K);
+                int leader = _getInt32(K);
+                if (K->version >= 7)
+                        _getInt32(K);                                               // leader_epoch
+                int replicas = _getInt32(K);
+                _need(K, (long long)MAX(replicas, 0) * 4);
+                K->response.cursor += MAX(replicas, 0) * 4;
+                int isr = _getInt32(K);
+                _need(K, (long long)MAX(isr, 0) * 4);
+                K->response.cursor += MAX(isr, 0) * 4;
+                if (K->version >= 5)
+                        _skipArray(K, 4);                                       // offline_replicas
+                K->port->statistics.kafka.partitions++;
+                if (leader < 0) {
+                        DEBUG("KAFKA: topic %s partition %d has no leader (error %d)\n", topic, partition, error);
+                        leaderless++;
+                } else if (isr < replicas) {
+                        DEBUG("KAFKA: topic %s partition %d is under-replicated, %d of %d replicas in sync\n", topic, partition, isr, replicas);
+                        K->port->statistics.kafka.underReplicated++;
+                }
+        }
+        K->port->statistics.kafka.leaderless += leaderless;
+}
+
+
+static void _readMetadata(kafka_t *K) {
+        char topic[STRLEN];
+        _receive(K);
+        if (K->version >= 3)
+                _getInt32(K);                                                      // throttle_time_ms
+        int brokers = _getInt32(K);
+        for (int i = 0; i < brokers; i++) {
+                _getInt32(K);                                                       // node_id
+                _skipString(K);                                                        // host
+                _getInt32(K);                                                          // port
+                _skipString(K);                                                        // rack
+        }
+        if (K->version >= 2)
+                _skipString(K);                                                  // cluster_id
+        int controller = _getInt32(K);
+        K->port->statistics.kafka.brokers = brokers;
+        K->port->statistics.kafka.controller = controller;
+        K->port->statistics.kafka.partitions = K->port->statistics.kafka.leaderless = K->port->statistics.kafka.underReplicated = 0;
+        for (int count = _getInt32(K); count > 0; count--) {
+                int error = _getInt16(K);
+                int length = _getInt16(K);
+                _need(K, length);
+                snprintf(topic, sizeof(topic), "%.*s", MAX(length, 0), K->response.cursor);
+                K->response.cursor += MAX(length, 0);
+                _getInt8(K);                                                     // is_internal
+                if (error)
+                        THROW(ProtocolException, "KAFKA: topic %s error %d", topic, error);
+                _readPartitions(K, topic);
+                if (K->version >= 8)
+                        _getInt32(K);                                 // topic_authorized_operations
+        }
+        K->port->statistics.kafka.available = true;
+}
+
+
+static void _checkLimits(kafka_t *K) {
+        Port_T p = K->port;
+        if (p->statistics.kafka.controller < 0)
+                THROW(ProtocolException, "KAFKA: error -- the cluster has no active controller");
+        if (p->statistics.kafka.leaderless > 0)
+                THROW(ProtocolException, "KAFKA: error -- %d partitions have no leader", p->statistics.kafka.leaderless);
+        if (p->parameters.kafka.brokers > 0 && Util_evalQExpression(p->parameters.kafka.brokersOP, p->statistics.kafka.brokers, p->parameters.kafka.brokers))
+                THROW(ProtocolException, "KAFKA: error -- the cluster has %d brokers", p->statistics.kafka.brokers);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void check_kafka(Socket_T socket) {
+        ASSERT(socket);
+        kafka_t K = {.socket = socket, .port = Socket_getPort(socket)};
+        ASSERT(K.port);
+        K.port->statistics.kafka.available = false;
+        TRY
+        {
+                _apiVersions(&K);
+                _sendMetadata(&K);
+                _readMetadata(&K);
+                _checkLimits(&K);
+        }
+        FINALLY
+        {
+                FREE(K.response.buf);
+        }
+        END_TRY;
+}
+
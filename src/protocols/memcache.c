@@ -36,6 +36,10 @@
 
 #define MEMCACHELEN 24
 
+/* Opcodes */
+#define OPCODE_NOOP        0x0a
+#define OPCODE_STAT        0x10
+
 /* Magic Byte */
 #define MAGIC_REQUEST      0x80
 #define MAGIC_RESPONSE     0x81
@@ -50,44 +54,14 @@
 #define UNKNOWN_COMMAND    0x0081
 #define OUT_OF_MEMORY      0x0082
 
-/**
- *  Memcache binary protocol
- *
- *  Send No-op request
- *
- *  @file
- */
-void check_memcache(Socket_T socket) {
-        unsigned int length;
-        unsigned char response[MEMCACHELEN];
-        unsigned int status;
-
-        unsigned char request[MEMCACHELEN] = {
-                MAGIC_REQUEST,                    /** Magic */
-                0x0a,                             /** Opcode */
-                0x00, 0x00,                       /** Key length */
-                0x00,                             /** Extra length */
-                0x00,                             /** Data type */
-                0x00, 0x00,                       /** request Reserved / response Status */
-                0x00, 0x00, 0x00, 0x00,           /** Total body */
-                0x00, 0x00, 0x00, 0x00,           /** Opaque */
-                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00    /** CAS */
-        };
-
-        ASSERT(socket);
+/* Size of the stat packet body we parse, longer stat values are skipped */
+#define STATLEN            256
 
-        if (Socket_write(socket, (unsigned char *)request, sizeof(request)) <= 0)
-                THROW(IOException, "MEMCACHE: error sending data -- %s", STRERROR);
 
-        /* Response should have at least MEMCACHELEN bytes */
-        length = Socket_read(socket, (unsigned char *)response, sizeof(response));
-        if (length != MEMCACHELEN)
-                THROW(IOException, "MEMCACHE: Received %d bytes from server, expected %d bytes", length, MEMCACHELEN);
+/* ----------------------------------------------------------------- Private */
 
-        if (response[0] != MAGIC_RESPONSE)
-                THROW(ProtocolException, "MEMCACHELEN: Invalid response code -- error occurred");
 
-        status = (response[6] << 8) | response[7];
+static void _checkStatus(unsigned int status) {
         switch (status) {
                 case NO_ERROR:
                         break;
@@ -119,3 +93,159 @@ void check_memcache(Socket_T socket) {
 }
 
 
+/**
+ * Read the response packet header and up to size bytes of the body to the
+ * buffer, the rest of the body is skipped. Returns the body length
+ */
+static unsigned int _readPacket(Socket_T socket, unsigned char *header, unsigned char *body, unsigned int size) {
+        int length = Socket_read(socket, header, MEMCACHELEN);
+        if (length != MEMCACHELEN)
+                THROW(IOException, "MEMCACHE: Received %d bytes from server, expected %d bytes", length, MEMCACHELEN);
+        if (header[0] != MAGIC_RESPONSE)
+                THROW(ProtocolException, "MEMCACHELEN: Invalid response code -- error occurred");
+        unsigned int total = ((unsigned int)header[8] << 24) | (header[9] << 16) | (header[10] << 8) | header[11];
+        unsigned int n = MIN(total, size);
+        if (n && Socket_read(socket, body, n) != (int)n)
+                THROW(IOException, "MEMCACHE: error receiving data -- %s", STRERROR);
+        for (unsigned int skip = total - n; skip > 0;) {
+                unsigned char buf[256];
+                length = Socket_read(socket, buf, MIN(skip, sizeof(buf)));
+                if (length <= 0)
+                        THROW(IOException, "MEMCACHE: error receiving data -- %s", STRERROR);
+                skip -= length;
+        }
+        return n;
+}
+
+
+static long long _parseNumber(const unsigned char *value, int length) {
+        long long n = 0;
+        for (int i = 0; i < length && value[i] >= '0' && value[i] <= '9'; i++)
+                n = n * 10 + (value[i] - '0');
+        return n;
+}
+
+
+// Counters since the last test, the whole value if the server was restarted meanwhile
+static long long _delta(long long current, long long last) {
+        return current >= last ? current - last : current;
+}
+
+
+/**
+ * Read the stat packets up to the terminating packet with empty key. The
+ * stat name and value are compared and parsed in the packet buffer
+ */
+static void _readStats(Socket_T socket, Port_T p) {
+        unsigned char header[MEMCACHELEN], body[STATLEN];
+        long long hits = -1, misses = -1, evictions = -1, connections = -1;
+        for (;;) {
+                unsigned int length = _readPacket(socket, header, body, sizeof(body));
+                unsigned int status = (header[6] << 8) | header[7];
+                if (status != NO_ERROR) {
+                        DEBUG("MEMCACHE: statistics not available -- response code %u\n", status);
+                        p->statistics.memcache.available = false;
+                        return;
+                }
+                unsigned int keyLength = (header[2] << 8) | header[3];
+                if (! keyLength)
+                        break;
+                unsigned int extras = header[4];
+                if (extras + keyLength > length)
+                        continue;
+                const unsigned char *key = body + extras, *value = key + keyLength;
+                int valueLength = (int)(length - extras - keyLength);
+#define IS_STAT(name) (keyLength == sizeof(name) - 1 && ! memcmp(key, name, keyLength))
+                if (IS_STAT("get_hits"))
+                        hits = _parseNumber(value, valueLength);
+                else if (IS_STAT("get_misses"))
+                        misses = _parseNumber(value, valueLength);
+                else if (IS_STAT("evictions"))
+                        evictions = _parseNumber(value, valueLength);
+                else if (IS_STAT("curr_connections"))
+                        connections = _parseNumber(value, valueLength);
+#undef IS_STAT
+        }
+        if (hits < 0 || misses < 0 || evictions < 0 || connections < 0) {
+                DEBUG("MEMCACHE: statistics not available -- the stats are incomplete\n");
+                p->statistics.memcache.available = false;
+                return;
+        }
+        // The evictions and hit ratio are computed for the interval since the last test, the first test uses the values since the server start
+        bool first = ! p->statistics.memcache.available;
+        long long h = first ? hits : _delta(hits, p->statistics.memcache.hits);
+        long long m = first ? misses : _delta(misses, p->statistics.memcache.misses);
+        p->statistics.memcache.evictions = first ? evictions : _delta(evictions, p->statistics.memcache.evictionsTotal);
+        p->statistics.memcache.hitRatio = h + m > 0 ? 100. * h / (h + m) : -1.;
+        p->statistics.memcache.connections = (int)connections;
+        p->statistics.memcache.hits = hits;
+        p->statistics.memcache.misses = misses;
+        p->statistics.memcache.evictionsTotal = evictions;
+        p->statistics.memcache.available = true;
+}
+
+
+static void _checkLimits(Port_T p) {
+        if (p->parameters.memcache.evictions > 0 || p->parameters.memcache.hitRatio > 0 || p->parameters.memcache.connections > 0) {
+                if (! p->statistics.memcache.available)
+                        THROW(ProtocolException, "MEMCACHE: statistics not available");
+                if (p->parameters.memcache.evictions > 0 && Util_evalQExpression(p->parameters.memcache.evictionsOP, p->statistics.memcache.evictions, p->parameters.memcache.evictions))
+                        THROW(ProtocolException, "MEMCACHE: error -- %lld evictions since the last test", p->statistics.memcache.evictions);
+                if (p->parameters.memcache.hitRatio > 0 && p->statistics.memcache.hitRatio >= 0 && Util_evalDoubleQExpression(p->parameters.memcache.hitRatioOP, p->statistics.memcache.hitRatio, p->parameters.memcache.hitRatio))
+                        THROW(ProtocolException, "MEMCACHE: error -- hit ratio is %.1f percent", p->statistics.memcache.hitRatio);
+                if (p->parameters.memcache.connections > 0 && Util_evalQExpression(p->parameters.memcache.connectionsOP, p->statistics.memcache.connections, p->parameters.memcache.connections))
+                        THROW(ProtocolException, "MEMCACHE: error -- %d connections", p->statistics.memcache.connections);
+        }
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+/**
+ *  Memcache binary protocol
+ *
+ *  Send the No-op and Stat requests at once, so the statistics are collected
+ *  in one round trip. The Stat response is a sequence of packets with the
+ *  stat name as the key, terminated by a packet with empty key
+ *
+ *  @file
+ */
+void check_memcache(Socket_T socket) {
+        unsigned char response[MEMCACHELEN];
+
+        unsigned char request[2 * MEMCACHELEN] = {
+                MAGIC_REQUEST,                    /** Magic */
+                OPCODE_NOOP,                      /** Opcode */
+                0x00, 0x00,                       /** Key length */
+                0x00,                             /** Extra length */
+                0x00,                             /** Data type */
+                0x00, 0x00,                       /** request Reserved / response Status */
+                0x00, 0x00, 0x00, 0x00,           /** Total body */
+                0x00, 0x00, 0x00, 0x00,           /** Opaque */
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   /** CAS */
+
+                MAGIC_REQUEST,                    /** Magic */
+                OPCODE_STAT,                      /** Opcode */
+                0x00, 0x00,                       /** Key length (no key: general statistics) */
+                0x00,                             /** Extra length */
+                0x00,                             /** Data type */
+                0x00, 0x00,                       /** request Reserved / response Status */
+                0x00, 0x00, 0x00, 0x00,           /** Total body */
+                0x00, 0x00, 0x00, 0x01,           /** Opaque */
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00    /** CAS */
+        };
+
+        ASSERT(socket);
+        Port_T p = Socket_getPort(socket);
+        ASSERT(p);
+
+        if (Socket_write(socket, (unsigned char *)request, sizeof(request)) <= 0)
+                THROW(IOException, "MEMCACHE: error sending data -- %s", STRERROR);
+
+        _readPacket(socket, response, NULL, 0);
+        _checkStatus((response[6] << 8) | response[7]);
+        _readStats(socket, p);
+        _checkLimits(p);
+}
+
@@ -48,6 +48,7 @@
 #include "protocol.h"
 #include "md5.h"
 #include "sha1.h"
+#include "sha256.h"
 #include "checksum.h"
 
 // libmonit
@@ -137,6 +138,7 @@ typedef struct {
 typedef struct {
         // Data buffer
         char buf[MYSQL_RESPONSE_BUFFER + 4 + 1]; // reserve 4 bytes for header
+        char *payload; // The resultset packet payload which doesn't fit into the buffer or NULL
         // Parser state
         char *cursor;
         char *limit;
@@ -483,8 +485,10 @@ static void _greeting(mysql_t *mysql) {
 }
 
 
-// Response handler
-static void _readResponse(mysql_t *mysql) {
+// Read one packet to the response buffer. If whole is true, the payload which doesn't fit into the buffer is read to the allocated
+// response data (a resultset row such as SHOW REPLICA STATUS with a long GTID set), otherwise the data which don't fit are skipped
+static void _readPacket(mysql_t *mysql, bool whole) {
+        FREE(mysql->response.payload);
         memset(&mysql->response, 0, sizeof(mysql_response_t));
         mysql->response.cursor = mysql->response.buf;
         mysql->response.limit = mysql->response.buf + sizeof(mysql->response.buf);
@@ -499,14 +503,32 @@ static void _readResponse(mysql_t *mysql) {
                 if (mysql->response.seq != 0)
                         THROW(ProtocolException, "Invalid handshake packet sequence id -- not MySQL protocol");
         }
-        if (mysql->response.len > MYSQL_RESPONSE_BUFFER) {
+        int skip = 0;
+        if (mysql->response.len > MYSQL_RESPONSE_BUFFER && whole) {
+                mysql->response.payload = CALLOC(1, mysql->response.len + 1);
+                mysql->response.cursor = mysql->response.payload;
+                mysql->response.limit = mysql->response.payload + mysql->response.len + 1;
+        } else if (mysql->response.len > MYSQL_RESPONSE_BUFFER) {
                 DEBUG("MySQL response: The response length %d is too large for our buffer, will read just %d\n", mysql->response.len, MYSQL_RESPONSE_BUFFER);
+                skip = mysql->response.len - MYSQL_RESPONSE_BUFFER;
                 mysql->response.len = MYSQL_RESPONSE_BUFFER;
         }
-        mysql->response.len = mysql->response.len > MYSQL_RESPONSE_BUFFER ? MYSQL_RESPONSE_BUFFER : mysql->response.len; // Adjust packet length for this buffer
         // Read payload
         if (Socket_read(mysql->socket, mysql->response.cursor, mysql->response.len) != mysql->response.len)
                 THROW(IOException, "Error receiving server response -- %s", STRERROR);
+        // Skip the rest of the packet, so the next packet can be read
+        for (char buf[256]; skip > 0;) {
+                int n = Socket_read(mysql->socket, buf, MIN(skip, (int)sizeof(buf)));
+                if (n <= 0)
+                        THROW(IOException, "Error receiving server response -- %s", STRERROR);
+                skip -= n;
+        }
+}
+
+
+// Response handler
+static void _readResponse(mysql_t *mysql) {
+        _readPacket(mysql, false);
         // Packet type router
         mysql->response.header = _getUInt1(&mysql->response);
         switch (mysql->response.header) {
@@ -621,6 +643,18 @@ static void _sendQuit(mysql_t *mysql) {
 }
 
 
+// COM_PING packet (see https://dev.mysql.com/doc/dev/mysql-server/8.0.11/page_protocol_com_ping.html)
+static void _sendPing(mysql_t *mysql) {
+        if (mysql->state != MySQL_Ok)
+                THROW(ProtocolException, "Unexpected communication state %d before Ping", mysql->state);
+        mysql->sequence = 0;
+        _initRequest(mysql);
+        _setUInt1(&mysql->request, COM_PING);
+        _sendRequest(mysql, MySQL_Ok);
+        DEBUG("MySQL PING sent\n");
+}
+
+
 static void _sendPassword(mysql_t *mysql, const unsigned char *password, int passwordLength) {
         if (mysql->state != MySQL_FullAuthenticationNeeded && mysql->state != MySQL_FetchRSAKey && mysql->state != MySQL_AuthSwitch)
                 THROW(ProtocolException, "Unexpected communication state %d before password exchange", mysql->state);
@@ -679,22 +713,164 @@ static void _checkRSAKey(mysql_t *mysql) {
 }
 
 
-/*
-// Note: we currently don't implement COM_QUERY *response* handler (OK/EOF packet with payload), if it'll be added and COM_QUERY used, uncomment the following COM_QUERY request implementation.
-//
-//   Usage (for example):
-//      _requestQuery(&mysql, "show global status");
-//
-
 // COM_QUERY packet (see http://dev.mysql.com/doc/internals/en/com-query.html)
-static void _requestQuery(mysql_t *mysql, const unsigned char *query) {
-        ASSERT(mysql->state == MySQL_Ok);
+static void _sendQuery(mysql_t *mysql, const char *query) {
+        if (mysql->state != MySQL_Ok)
+                THROW(ProtocolException, "Unexpected communication state %d before Query", mysql->state);
+        mysql->sequence = 0;
         _initRequest(mysql);
         _setUInt1(&mysql->request, COM_QUERY);
         _setData(&mysql->request, query, strlen(query));
         _sendRequest(mysql, MySQL_Ok);
+        DEBUG("MySQL QUERY sent: %s\n", query);
+}
+
+
+// Read the next packet of the text resultset, the parser is limited to the packet payload
+static uint8_t _readResultPacket(mysql_t *mysql) {
+        _readPacket(mysql, true);
+        mysql->response.limit = mysql->response.cursor + mysql->response.len;
+        if (mysql->response.cursor >= mysql->response.limit)
+                THROW(ProtocolException, "Empty packet in the query response");
+        return (uint8_t)*mysql->response.cursor;
+}
+
+
+// Length encoded integer (see https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_dt_integers.html)
+static uint64_t _getLengthEncodedInteger(mysql_response_t *response) {
+        uint8_t value = _getUInt1(response);
+        switch (value) {
+                case 0xfc:
+                        return _getUInt2(response);
+                case 0xfd:
+                        return _getUInt3(response);
+                case 0xfe:
+                        {
+                                uint64_t low = _getUInt4(response);
+                                return low | ((uint64_t)_getUInt4(response) << 32);
+                        }
+                default:
+                        return value;
+        }
+}
+
+
+// Length encoded string copied to value (truncated to its size), false is returned for the NULL value
+static bool _getLengthEncodedString(mysql_response_t *response, char *value, int size) {
+        if (response->cursor < response->limit && (uint8_t)*response->cursor == 0xfb) {
+                response->cursor++;
+                return false;
+        }
+        uint64_t length = _getLengthEncodedInteger(response);
+        if (length > (uint64_t)(response->limit - response->cursor))
+                THROW(ProtocolException, "Data not available -- EOF");
+        snprintf(value, size, "%.*s", (int)length, response->cursor);
+        response->cursor += length;
+        return true;
+}
+
+
+/*
+ * Run the query and get the value of the first column found from the names
+ * list in the first row of the text resultset (see https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_query_response_text_resultset.html)
+ * @return 1 if the value was found (*null is set for the NULL value), 0 if the
+ * resultset has no row or no such column, -1 if the query failed
+ */
+static int _query(mysql_t *mysql, const char *query, const char *names[], char *value, int size, bool *null) {
+        _sendQuery(mysql, query);
+        uint8_t header = _readResultPacket(mysql);
+        if (header == MYSQL_ERROR) {
+                _getUInt1(&mysql->response);
+                uint16_t code = _getUInt2(&mysql->response);
+                DEBUG("MySQL query '%s' failed with error code %d\n", query, code);
+                return -1;
+        } else if (header == MYSQL_OK) {
+                return 0;
+        }
+        int rv = 0;
+        int index = -1;
+        uint64_t columns = _getLengthEncodedInteger(&mysql->response);
+        for (uint64_t i = 0; i < columns; i++) {
+                char name[64];
+                _readResultPacket(mysql);
+                // Skip the catalog, schema, table and original table name
+                for (int j = 0; j < 4; j++)
+                        _getLengthEncodedString(&mysql->response, name, sizeof(name));
+                _getLengthEncodedString(&mysql->response, name, sizeof(name));
+                for (int j = 0; names[j] && index < 0; j++)
+                        if (Str_isEqual(name, names[j]))
+                                index = (int)i;
+        }
+        if (_readResultPacket(mysql) != MYSQL_AUTHSWITCH) // EOF packet after the column definitions
+                THROW(ProtocolException, "Unexpected packet after the column definitions");
+        // Read the rows until the EOF packet, the value is taken from the first row
+        for (bool first = true; (header = _readResultPacket(mysql)) != MYSQL_AUTHSWITCH || mysql->response.len >= 9; first = false) {
+                if (header == MYSQL_ERROR)
+                        return -1;
+                if (first && index >= 0) {
+                        for (int i = 0; i < index; i++)
+                                _getLengthEncodedString(&mysql->response, value, size);
+                        *null = ! _getLengthEncodedString(&mysql->response, value, size);
+                        rv = 1;
+                }
+        }
+        return rv;
+}
+
+
+// Collect the server status for the limits (Threads_running and replication lag)
+static void _getStatus(mysql_t *mysql) {
+        char value[64];
+        bool null = false;
+        Port_T p = mysql->port;
+        p->statistics.mysql.available = false;
+        if (_query(mysql, "SHOW GLOBAL STATUS LIKE 'Threads_running'", (const char *[]){"Value", NULL}, value, sizeof(value), &null) != 1 || null)
+                THROW(ProtocolException, "Cannot read the Threads_running status");
+        p->statistics.mysql.threads = (int)strtol(value, NULL, 10);
+        p->statistics.mysql.replica = false;
+        p->statistics.mysql.lag = 0;
+        if (p->parameters.mysql.lag > 0) {
+                const char *columns[] = {"Seconds_Behind_Source", "Seconds_Behind_Master", NULL};
+                // SHOW REPLICA STATUS is supported since MySQL 8.0.22 and MariaDB 10.5.1, fall back to SHOW SLAVE STATUS
+                int rv = _query(mysql, "SHOW REPLICA STATUS", columns, value, sizeof(value), &null);
+                if (rv < 0)
+                        rv = _query(mysql, "SHOW SLAVE STATUS", columns, value, sizeof(value), &null);
+                if (rv < 0)
+                        THROW(ProtocolException, "Cannot read the replica status");
+                if (rv == 1) {
+                        p->statistics.mysql.replica = true;
+                        p->statistics.mysql.lag = null ? -1 : (int)strtol(value, NULL, 10);
+                }
+        }
+        p->statistics.mysql.available = true;
+}
+
+
+static void _checkLimits(mysql_t *mysql) {
+        Port_T p = mysql->port;
+        TRY
+        {
+                _getStatus(mysql);
+        }
+        FINALLY
+        {
+                FREE(mysql->response.payload);
+        }
+        END_TRY;
+        if (p->parameters.mysql.threads > 0 && Util_evalQExpression(p->parameters.mysql.threadsOP, p->statistics.mysql.threads, p->parameters.mysql.threads))
+                THROW(ProtocolException, "MYSQL: error -- %d threads are running", p->statistics.mysql.threads);
+        if (p->parameters.mysql.lag > 0 && p->statistics.mysql.replica) {
+                if (p->statistics.mysql.lag < 0)
+                        THROW(ProtocolException, "MYSQL: error -- the replication is not running");
+                if (Util_evalQExpression(p->parameters.mysql.lagOP, p->statistics.mysql.lag, p->parameters.mysql.lag))
+                        THROW(ProtocolException, "MYSQL: error -- the replication lag is %d seconds", p->statistics.mysql.lag);
+        }
+}
+
+
+static bool _hasLimits(Port_T p) {
+        return p->parameters.mysql.threads > 0 || p->parameters.mysql.lag > 0;
 }
-*/
 
 
 /* ---------------------------------------------------------------- Public */
@@ -770,7 +946,33 @@ void check_mysql(Socket_T S) {
                                 _readResponse(&mysql);
                         }
                 }
-                _sendQuit(&mysql);
+                if (mysql.state != MySQL_Ok)
+                        THROW(ProtocolException, "Unexpected communication state %d after login", mysql.state);
+                if (_hasLimits(mysql.port))
+                        _checkLimits(&mysql);
+                if (! mysql.port->keepalive)
+                        _sendQuit(&mysql);
         }
 }
 
+
+/**
+ * Keepalive test of the connection logged in by check_mysql(): query the server status if limits are set, otherwise send COM_PING and expect the OK packet
+ */
+void ping_mysql(Socket_T S) {
+        ASSERT(S);
+        mysql_t mysql = {
+                .state = MySQL_Ok,
+                .socket = S,
+                .port = Socket_getPort(S)
+        };
+        if (_hasLimits(mysql.port)) {
+                _checkLimits(&mysql);
+                return;
+        }
+        _sendPing(&mysql);
+        _readResponse(&mysql);
+        if (mysql.state != MySQL_Ok)
+                THROW(ProtocolException, "Invalid response to the ping");
+}
+
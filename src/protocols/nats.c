@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include "protocol.h"
+
+// libmonit
+#include "util/Str.h"
+#include "exceptions/IOException.h"
+#include "exceptions/ProtocolException.h"
+
+
+/**
+ *  NATS test.
+ *
+ *  The server sends the INFO message with the server description in JSON
+ *  when the client connects. The test parses the server version, cluster
+ *  name and the list of the cluster servers' URLs, sends CONNECT (with the
+ *  optional credentials) and PING and expects PONG. The keepalive test sends
+ *  just PING on the open connection, the server's PINGs received meanwhile
+ *  are answered and asynchronous INFO updates are parsed.
+ *
+ *  @see https://docs.nats.io/reference/reference-protocols/nats-protocol
+ *
+ *  @file
+ */
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+#define NATS_LINE 8192
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+// Read the line and remove CRLF, the rest of the line which doesn't fit into the buffer is skipped
+static void _readLine(Socket_T socket, char *buf, int size) {
+        if (! Socket_readLine(socket, buf, size))
+                THROW(IOException, "NATS: error receiving data -- %s", STRERROR);
+        size_t length = strlen(buf);
+        if (length && buf[length - 1] != '\n') {
+                for (char skip[256]; Socket_readLine(socket, skip, sizeof(skip)) && skip[strlen(skip) - 1] != '\n';)
+                        ;
+        }
+        Str_chomp(buf);
+}
+
+
+// Return the value of the JSON object member or NULL if not found
+static const char *_getValue(const char *json, const char *key) {
+        char name[64];
+        snprintf(name, sizeof(name), "\"%s\"", key);
+        for (const char *s = json; (s = strstr(s, name)); s++) {
+                const char *v = s + strlen(name);
+                while (*v == ' ' || *v == '\t')
+                        v++;
+                if (*v == ':') {
+                        for (v++; *v == ' ' || *v == '\t'; v++)
+                                ;
+                        return v;
+                }
+        }
+        return NULL;
+}
+
+
+static bool _getString(const char *json, const char *key, char *value, int size) {
+        const char *v = _getValue(json, key);
+        if (v && *v == '"') {
+                int n = 0;
+                for (v++; *v && *v != '"'; v++) {
+                        if (*v == '\\' && *(v + 1))
+                                v++;
+                        if (n < size - 1)
+                                value[n++] = *v;
+                }
+                value[n] = 0;
+                return true;
+        }
+        *value = 0;
+        return false;
+}
+
+
+static bool _getBool(const char *json, const char *key) {
+        const char *v = _getValue(json, key);
+        return v && Str_startsWith(v, "true");
+}
+
+
+// Return the number of elements of the JSON array of strings or -1 if not found
+static int _getArrayLength(const char *json, const char *key) {
+        const char *v = _getValue(json, key);
+        if (! v || *v != '[')
+                return -1;
+        int count = 0;
+        bool string = false;
+        for (v++; *v && (string || *v != ']'); v++) {
+                if (string) {
+                        if (*v == '\\' && *(v + 1))
+                                v++;
+                        else if (*v == '"')
+                                string = false;
+                } else if (*v == '"') {
+                        string = true;
+                        count++;
+                }
+        }
+        return count;
+}
+
+
+// The server description is kept in the port owning the keepalive connection, the INFO message comes just after connect
+static Port_T _owner(Port_T p) {
+        return p->shared ? p->shared : p;
+}
+
+
+static void _parseInfo(Port_T p, const char *info) {
+        char id[64];
+        _getString(info, "server_id", id, sizeof(id));
+        _getString(info, "version", p->statistics.nats.version, sizeof(p->statistics.nats.version));
+        _getString(info, "cluster", p->statistics.nats.cluster, sizeof(p->statistics.nats.cluster));
+        // The connect_urls list is advertised by the clustered server and includes the server itself
+        p->statistics.nats.servers = MAX(1, _getArrayLength(info, "connect_urls"));
+        DEBUG("NATS: server %s, version %s, cluster %s, %d servers\n", id, p->statistics.nats.version, *p->statistics.nats.cluster ? p->statistics.nats.cluster : "none", p->statistics.nats.servers);
+}
+
+
+// Append the JSON string member to the buffer
+static void _putString(char *buf, int size, const char *key, const char *value) {
+        int n = (int)strlen(buf);
+        n += snprintf(buf + n, size - n, ",\"%s\":\"", key);
+        for (; *value && n < size - 3; value++) {
+                if (*value == '"' || *value == '\\')
+                        buf[n++] = '\\';
+                buf[n++] = *value;
+        }
+        if (n < size - 1)
+                buf[n++] = '"';
+        buf[MIN(n, size - 1)] = 0;
+}
+
+
+static void _sendConnect(Socket_T socket, Port_T p, bool tls) {
+        char connect[STRLEN * 2];
+        snprintf(connect, sizeof(connect), "{\"verbose\":false,\"pedantic\":false,\"tls_required\":%s,\"name\":\"monit\",\"lang\":\"c\",\"version\":\"%s\",\"protocol\":1,\"echo\":false", tls ? "true" : "false", VERSION);
+        if (p->parameters.nats.username) {
+                _putString(connect, sizeof(connect), "user", p->parameters.nats.username);
+                if (p->parameters.nats.password)
+                        _putString(connect, sizeof(connect), "pass", p->parameters.nats.password);
+        } else if (p->parameters.nats.password) {
+                // The password without username is the authentication token
+                _putString(connect, sizeof(connect), "auth_token", p->parameters.nats.password);
+        }
+        if (Socket_print(socket, "CONNECT %s}\r\n", connect) < 0)
+                THROW(IOException, "NATS: error sending CONNECT -- %s", STRERROR);
+}
+
+
+/**
+ * Send PING and read the messages up to PONG. An error or the PING from the
+ * server may come first
+ */
+static void _ping(Socket_T socket, Port_T p, char *buf, int size) {
+        if (Socket_print(socket, "PING\r\n") < 0)
+                THROW(IOException, "NATS: error sending PING -- %s", STRERROR);
+        for (;;) {
+                _readLine(socket, buf, size);
+                if (Str_isEqual(buf, "PONG")) {
+                        return;
+                } else if (Str_isEqual(buf, "PING")) {
+                        if (Socket_print(socket, "PONG\r\n") < 0)
+                                THROW(IOException, "NATS: error sending PONG -- %s", STRERROR);
+                } else if (Str_startsWith(buf, "INFO ")) {
+                        _parseInfo(_owner(p), buf + 5);
+                } else if (Str_startsWith(buf, "-ERR")) {
+                        THROW(ProtocolException, "NATS: error -- %s", Str_trim(buf + 4));
+                } else if (! Str_isEqual(buf, "+OK")) {
+                        DEBUG("NATS: unexpected message -- %s\n", buf);
+                }
+        }
+}
+
+
+static void _checkLimits(Port_T p) {
+        if (p != _owner(p))
+                memcpy(&p->statistics.nats, &_owner(p)->statistics.nats, sizeof(p->statistics.nats));
+        if (p->parameters.nats.cluster && ! IS(p->parameters.nats.cluster, p->statistics.nats.cluster))
+                THROW(ProtocolException, "NATS: error -- the server is in the cluster '%s', expected '%s'", p->statistics.nats.cluster, p->parameters.nats.cluster);
+        if (p->parameters.nats.servers > 0 && Util_evalQExpression(p->parameters.nats.serversOP, p->statistics.nats.servers, p->parameters.nats.servers))
+                THROW(ProtocolException, "NATS: error -- the cluster has %d servers", p->statistics.nats.servers);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void check_nats(Socket_T socket) {
+        ASSERT(socket);
+        char buf[NATS_LINE];
+        Port_T p = Socket_getPort(socket);
+        ASSERT(p);
+        _readLine(socket, buf, sizeof(buf));
+        if (! Str_startsWith(buf, "INFO "))
+                THROW(ProtocolException, "NATS: invalid server greeting -- %s", buf);
+        _parseInfo(_owner(p), buf + 5);
+        // The server may require TLS, the connection is upgraded after INFO
+        bool tls = Socket_isSecure(socket);
+        if (_getBool(buf + 5, "tls_required") && ! tls) {
+                Socket_enableSsl(socket, &(Run.ssl), NULL);
+                tls = true;
+        }
+        _sendConnect(socket, p, tls);
+        _ping(socket, p, buf, sizeof(buf));
+        _checkLimits(p);
+}
+
+
+/**
+ * Keepalive test: PING on the connected session
+ */
+void ping_nats(Socket_T socket) {
+        ASSERT(socket);
+        char buf[NATS_LINE];
+        Port_T p = Socket_getPort(socket);
+        ASSERT(p);
+        _ping(socket, p, buf, sizeof(buf));
+        _checkLimits(p);
+}
+
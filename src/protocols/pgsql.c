@@ -24,11 +24,28 @@
 
 #include "config.h"
 
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
 #include "protocol.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "checksum.h"
+#include "base64.h"
 
 // libmonit
 #include "exceptions/IOException.h"
@@ -38,99 +55,543 @@
 /**
  *  PostgreSQL test.
  *
+ *  Without credentials the test sends the startup message and expects the
+ *  authentication request or an error from the server. With credentials the
+ *  test logs in (trust, cleartext, MD5 or SCRAM-SHA-256 authentication) and
+ *  runs the health probe query using the extended query protocol. The probe
+ *  statement is prepared once per session, the keepalive test just executes
+ *  it on the logged-in connection.
+ *
+ *  @see https://www.postgresql.org/docs/current/protocol.html
+ *
  *  @file
  */
-void check_pgsql(Socket_T socket) {
-        Port_T port = Socket_getPort(socket);
 
-        unsigned char buf[STRLEN] = {};
 
-        unsigned char requestLogin[33] = {
-                0x00,                              /** Length */
-                0x00,
-                0x00,
-                0x21,
+/* ----------------------------------------------------------- Definitions */
 
-                0x00,                              /** ProtoVer 3.0 */
-                0x03,
-                0x00,
-                0x00,
 
-                0x75, 0x73, 0x65, 0x72, 0x00,      /** user */
-                0x72, 0x6f, 0x6f, 0x74, 0x00,      /** root */
+#define PGSQL_BUFFER 4096
 
-                0x64, 0x61, 0x74, 0x61, 0x62, 0x61, 0x73, 0x65, 0x00,  /** database */
-                0x72, 0x6f, 0x6f, 0x74, 0x00,                          /** root */
+#define PGSQL_STATEMENT "monit_probe"
+#define PGSQL_QUERY     "SELECT pg_is_in_recovery(), EXTRACT(EPOCH FROM now() - pg_last_xact_replay_timestamp())::integer"
 
-                0x00
-        };
+// Authentication request codes
+#define PGSQL_AUTH_OK           0
+#define PGSQL_AUTH_CLEARTEXT    3
+#define PGSQL_AUTH_MD5          5
+#define PGSQL_AUTH_SASL         10
+#define PGSQL_AUTH_SASLCONTINUE 11
+#define PGSQL_AUTH_SASLFINAL    12
 
-        /** Doing this is too suspicious maybe.
-         * Type Q, Length 19 and QUERY select 1 as a; */
-        /**
-         unsigned char requestQuery[20] = {
-         0x51,
 
-         0x00,
-         0x00,
-         0x00,
-         0x13,
+typedef struct {
+        Socket_T socket;
+        Port_T port;
+        struct {
+                unsigned char buf[PGSQL_BUFFER];
+                int length;
+                int start;                          // Start of the current message
+        } request;
+        struct {
+                char type;
+                unsigned char buf[PGSQL_BUFFER + 1];  // Reserve 1 byte for the terminating NUL
+                unsigned char *cursor;
+                unsigned char *limit;
+        } response;
+        struct {
+                char nonce[MD_SIZE];
+                char clientFirst[STRLEN];
+                unsigned char serverSignature[SHA256_DIGEST_SIZE];
+        } scram;
+} pgsql_t;
 
-         0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x20,
-         0x31, 0x20, 0x61, 0x73, 0x20, 0x61, 0x3b,
 
-         0x00
-         };
-         */
+/* ----------------------------------------------------------- Request */
 
-        unsigned char requestTerm[5] = {
-                0x58,                              /** Type X */
 
-                0x00,                              /** Length */
-                0x00,
-                0x00,
-                0x04
-        };
+static void _putData(pgsql_t *pg, const void *data, int length) {
+        if (pg->request.length + length > PGSQL_BUFFER)
+                THROW(ProtocolException, "PGSQL: request is too large");
+        memcpy(pg->request.buf + pg->request.length, data, length);
+        pg->request.length += length;
+}
 
-        unsigned char responseAuthOk[9] = {
-                0x52,                              /** Type R */
 
-                0x00,                              /** Length */
-                0x00,
-                0x00,
-                0x08,
+static void _putByte(pgsql_t *pg, uint8_t value) {
+        _putData(pg, &value, 1);
+}
 
-                0x00,                              /** OK code 0 */
-                0x00,
-                0x00,
-                0x00
-        };
 
-        ASSERT(socket);
+static void _putInt16(pgsql_t *pg, uint16_t value) {
+        value = htons(value);
+        _putData(pg, &value, 2);
+}
+
+
+static void _putInt32(pgsql_t *pg, uint32_t value) {
+        value = htonl(value);
+        _putData(pg, &value, 4);
+}
+
+
+static void _putString(pgsql_t *pg, const char *value) {
+        _putData(pg, value, (int)strlen(value) + 1);
+}
+
 
-        if (Socket_write(socket, (unsigned char *)requestLogin, sizeof(requestLogin)) <= 0)
+// Start the new message, the startup message has no type
+static void _begin(pgsql_t *pg, char type) {
+        if (type)
+                _putByte(pg, type);
+        pg->request.start = pg->request.length;
+        _putInt32(pg, 0); // Length placeholder, set by _end()
+}
+
+
+static void _end(pgsql_t *pg) {
+        uint32_t length = htonl(pg->request.length - pg->request.start);
+        memcpy(pg->request.buf + pg->request.start, &length, 4);
+}
+
+
+// Send all messages in the request buffer at once
+static void _send(pgsql_t *pg) {
+        if (Socket_write(pg->socket, pg->request.buf, pg->request.length) < 0)
                 THROW(IOException, "PGSQL: error sending data -- %s", STRERROR);
+        pg->request.length = 0;
+}
 
-        /** Nine-byte is enough to hold Auth-Ok */
-        if (Socket_read(socket, buf, 9) <= 0)
+
+/* ---------------------------------------------------------- Response */
+
+
+// Read the next message, the data which don't fit into the buffer are skipped
+static char _readMessage(pgsql_t *pg) {
+        unsigned char header[5];
+        if (Socket_read(pg->socket, header, sizeof(header)) != sizeof(header))
+                THROW(IOException, "PGSQL: error receiving data -- %s", STRERROR);
+        uint32_t length;
+        memcpy(&length, header + 1, 4);
+        length = ntohl(length);
+        if (length < 4)
+                THROW(ProtocolException, "PGSQL: invalid message length %u", length);
+        length -= 4;
+        int skip = 0;
+        if (length > PGSQL_BUFFER) {
+                skip = length - PGSQL_BUFFER;
+                length = PGSQL_BUFFER;
+        }
+        if (length > 0 && Socket_read(pg->socket, pg->response.buf, length) != (int)length)
                 THROW(IOException, "PGSQL: error receiving data -- %s", STRERROR);
+        for (unsigned char buf[256]; skip > 0;) {
+                int n = Socket_read(pg->socket, buf, MIN(skip, (int)sizeof(buf)));
+                if (n <= 0)
+                        THROW(IOException, "PGSQL: error receiving data -- %s", STRERROR);
+                skip -= n;
+        }
+        pg->response.buf[length] = 0;
+        pg->response.type = header[0];
+        pg->response.cursor = pg->response.buf;
+        pg->response.limit = pg->response.buf + length;
+        return pg->response.type;
+}
+
+
+static void _getData(pgsql_t *pg, void *data, int length) {
+        if (length < 0 || pg->response.cursor + length > pg->response.limit)
+                THROW(ProtocolException, "PGSQL: data not available -- EOF");
+        memcpy(data, pg->response.cursor, length);
+        pg->response.cursor += length;
+}
+
+
+static uint8_t _getByte(pgsql_t *pg) {
+        uint8_t value;
+        _getData(pg, &value, 1);
+        return value;
+}
+
+
+static int16_t _getInt16(pgsql_t *pg) {
+        uint16_t value;
+        _getData(pg, &value, 2);
+        return (int16_t)ntohs(value);
+}
+
+
+static int32_t _getInt32(pgsql_t *pg) {
+        uint32_t value;
+        _getData(pg, &value, 4);
+        return (int32_t)ntohl(value);
+}
+
+
+static const char *_getString(pgsql_t *pg) {
+        const char *value = (const char *)pg->response.cursor;
+        unsigned char *end = memchr(pg->response.cursor, 0, pg->response.limit - pg->response.cursor);
+        if (! end)
+                THROW(ProtocolException, "PGSQL: unterminated string in the response");
+        pg->response.cursor = end + 1;
+        return value;
+}
+
+
+// DataRow column value copied to value (truncated to its size), false is returned for the NULL value
+static bool _getValue(pgsql_t *pg, char *value, int size) {
+        int32_t length = _getInt32(pg);
+        if (length < 0)
+                return false;
+        if (length > pg->response.limit - pg->response.cursor)
+                THROW(ProtocolException, "PGSQL: data not available -- EOF");
+        snprintf(value, size, "%.*s", (int)length, pg->response.cursor);
+        pg->response.cursor += length;
+        return true;
+}
+
+
+// ErrorResponse: copy the message field to the buffer
+static char *_getError(pgsql_t *pg, char *message, int size) {
+        snprintf(message, size, "unknown error");
+        for (char field; pg->response.cursor < pg->response.limit && (field = _getByte(pg));) {
+                const char *value = _getString(pg);
+                if (field == 'M')
+                        snprintf(message, size, "%s", value);
+        }
+        return message;
+}
 
-        /** If server insists on auth error it is working anyway */
-        if (*buf == 'E')
-                return;
 
-        /** Successful connection */
-        if (! memcmp((unsigned char *)buf, (unsigned char *)responseAuthOk, 9)) {
-                /** Terminate the connection if connected via TCP socket */
-                if (port->family != Socket_Unix && Socket_write(socket, (unsigned char *)requestTerm, sizeof(requestTerm)) < 0)
-                        THROW(IOException, "PGSQL: connection terminator write error -- %s", STRERROR);
-                return;
+/* ---------------------------------------------------- Authentication */
+
+
+static void _sendPassword(pgsql_t *pg, const char *password) {
+        _begin(pg, 'p');
+        _putString(pg, password);
+        _end(pg);
+        _send(pg);
+}
+
+
+// MD5 password: "md5" + md5(md5(password + username) + salt)
+static void _authMd5(pgsql_t *pg, const char *username, const char *password) {
+        unsigned char salt[4];
+        _getData(pg, salt, sizeof(salt));
+        md5_context_t ctx;
+        unsigned char digest[16];
+        MD_T hex;
+        md5_init(&ctx);
+        md5_append(&ctx, (const md5_byte_t *)password, (int)strlen(password));
+        md5_append(&ctx, (const md5_byte_t *)username, (int)strlen(username));
+        md5_finish(&ctx, digest);
+        Checksum_digest2Bytes(digest, 16, hex);
+        md5_init(&ctx);
+        md5_append(&ctx, (const md5_byte_t *)hex, 32);
+        md5_append(&ctx, salt, sizeof(salt));
+        md5_finish(&ctx, digest);
+        char response[36];
+        snprintf(response, sizeof(response), "md5%.32s", Checksum_digest2Bytes(digest, 16, hex));
+        _sendPassword(pg, response);
+}
+
+
+// SCRAM Hi() function: PBKDF2 with HMAC-SHA256 (see RFC 5802)
+static void _scramHi(const char *password, const unsigned char *salt, int saltLength, int iterations, unsigned char result[SHA256_DIGEST_SIZE]) {
+        unsigned char block[STRLEN + 4];
+        unsigned char u[SHA256_DIGEST_SIZE];
+        int passwordLength = (int)strlen(password);
+        memcpy(block, salt, saltLength);
+        memcpy(block + saltLength, "\0\0\0\1", 4);
+        Checksum_hmacSHA256(block, saltLength + 4, (const unsigned char *)password, passwordLength, u);
+        memcpy(result, u, SHA256_DIGEST_SIZE);
+        for (int i = 1; i < iterations; i++) {
+                unsigned char previous[SHA256_DIGEST_SIZE];
+                memcpy(previous, u, SHA256_DIGEST_SIZE);
+                Checksum_hmacSHA256(previous, SHA256_DIGEST_SIZE, (const unsigned char *)password, passwordLength, u);
+                for (int j = 0; j < SHA256_DIGEST_SIZE; j++)
+                        result[j] ^= u[j];
+        }
+}
+
+
+// SASL: pick SCRAM-SHA-256 and send the client-first-message
+static void _scramFirst(pgsql_t *pg) {
+        bool supported = false;
+        for (const char *mechanism; *(mechanism = _getString(pg));)
+                if (IS(mechanism, "SCRAM-SHA-256"))
+                        supported = true;
+        if (! supported)
+                THROW(ProtocolException, "PGSQL: the server doesn't support the SCRAM-SHA-256 authentication");
+        MD_T token;
+        snprintf(pg->scram.nonce, sizeof(pg->scram.nonce), "%s", Util_getToken(token));
+        // The username is taken from the startup message, the SCRAM username attribute is left empty
+        snprintf(pg->scram.clientFirst, sizeof(pg->scram.clientFirst), "n=,r=%s", pg->scram.nonce);
+        char message[STRLEN];
+        int length = snprintf(message, sizeof(message), "n,,%s", pg->scram.clientFirst);
+        _begin(pg, 'p');
+        _putString(pg, "SCRAM-SHA-256");
+        _putInt32(pg, length);
+        _putData(pg, message, length);
+        _end(pg);
+        _send(pg);
+}
+
+
+// SASLContinue: process the server-first-message and send the client-final-message with the proof
+static void _scramContinue(pgsql_t *pg, const char *password) {
+        const char *serverFirst = (const char *)pg->response.cursor;
+        const char *nonce = NULL, *salt64 = NULL;
+        int iterations = 0;
+        char attributes[PGSQL_BUFFER];
+        snprintf(attributes, sizeof(attributes), "%s", serverFirst);
+        for (char *save = NULL, *a = strtok_r(attributes, ",", &save); a; a = strtok_r(NULL, ",", &save)) {
+                if (Str_startsWith(a, "r="))
+                        nonce = a + 2;
+                else if (Str_startsWith(a, "s="))
+                        salt64 = a + 2;
+                else if (Str_startsWith(a, "i="))
+                        iterations = (int)strtol(a + 2, NULL, 10);
         }
+        if (! nonce || ! Str_startsWith(nonce, pg->scram.nonce) || strlen(nonce) == strlen(pg->scram.nonce))
+                THROW(ProtocolException, "PGSQL: invalid SCRAM server nonce");
+        if (! salt64 || strlen(salt64) * 3 / 4 + 3 > STRLEN || iterations <= 0)
+                THROW(ProtocolException, "PGSQL: invalid SCRAM server parameters");
+        unsigned char salt[STRLEN];
+        int saltLength = (int)decode_base64(salt, salt64);
+        unsigned char saltedPassword[SHA256_DIGEST_SIZE], clientKey[SHA256_DIGEST_SIZE], storedKey[SHA256_DIGEST_SIZE], serverKey[SHA256_DIGEST_SIZE], signature[SHA256_DIGEST_SIZE];
+        _scramHi(password, salt, saltLength, iterations, saltedPassword);
+        Checksum_hmacSHA256((const unsigned char *)"Client Key", 10, saltedPassword, SHA256_DIGEST_SIZE, clientKey);
+        sha256_context_t ctx;
+        sha256_init(&ctx);
+        sha256_append(&ctx, clientKey, SHA256_DIGEST_SIZE);
+        sha256_finish(&ctx, storedKey);
+        // AuthMessage = client-first-message-bare + "," + server-first-message + "," + client-final-message-without-proof ("biws" is base64 of the "n,," GS2 header)
+        char clientFinal[PGSQL_BUFFER];
+        snprintf(clientFinal, sizeof(clientFinal), "c=biws,r=%s", nonce);
+        char *authMessage = Str_cat("%s,%s,%s", pg->scram.clientFirst, serverFirst, clientFinal);
+        Checksum_hmacSHA256((const unsigned char *)authMessage, (int)strlen(authMessage), storedKey, SHA256_DIGEST_SIZE, signature);
+        for (int i = 0; i < SHA256_DIGEST_SIZE; i++)
+                clientKey[i] ^= signature[i];
+        Checksum_hmacSHA256((const unsigned char *)"Server Key", 10, saltedPassword, SHA256_DIGEST_SIZE, serverKey);
+        Checksum_hmacSHA256((const unsigned char *)authMessage, (int)strlen(authMessage), serverKey, SHA256_DIGEST_SIZE, pg->scram.serverSignature);
+        FREE(authMessage);
+        char *proof = encode_base64(SHA256_DIGEST_SIZE, clientKey);
+        _begin(pg, 'p');
+        _putData(pg, clientFinal, (int)strlen(clientFinal));
+        _putData(pg, ",p=", 3);
+        _putData(pg, proof, (int)strlen(proof));
+        _end(pg);
+        FREE(proof);
+        _send(pg);
+}
+
+
+// SASLFinal: verify the server signature
+static void _scramFinal(pgsql_t *pg) {
+        const char *serverFinal = (const char *)pg->response.cursor;
+        if (! Str_startsWith(serverFinal, "v=") || strlen(serverFinal + 2) * 3 / 4 + 3 > STRLEN)
+                THROW(ProtocolException, "PGSQL: invalid SCRAM server final message");
+        unsigned char signature[STRLEN];
+        if (decode_base64(signature, serverFinal + 2) != SHA256_DIGEST_SIZE || memcmp(signature, pg->scram.serverSignature, SHA256_DIGEST_SIZE))
+                THROW(ProtocolException, "PGSQL: SCRAM server signature mismatch");
+}
+
+
+static void _authenticate(pgsql_t *pg) {
+        const char *username = pg->port->parameters.pgsql.username;
+        const char *password = pg->port->parameters.pgsql.password;
+        int32_t code = _getInt32(pg);
+        if (code != PGSQL_AUTH_OK && ! password)
+                THROW(ProtocolException, "PGSQL: the server requires a password");
+        switch (code) {
+                case PGSQL_AUTH_OK:
+                        DEBUG("PGSQL: authenticated\n");
+                        break;
+                case PGSQL_AUTH_CLEARTEXT:
+                        _sendPassword(pg, password);
+                        break;
+                case PGSQL_AUTH_MD5:
+                        _authMd5(pg, username, password);
+                        break;
+                case PGSQL_AUTH_SASL:
+                        _scramFirst(pg);
+                        break;
+                case PGSQL_AUTH_SASLCONTINUE:
+                        _scramContinue(pg, password);
+                        break;
+                case PGSQL_AUTH_SASLFINAL:
+                        _scramFinal(pg);
+                        break;
+                default:
+                        THROW(ProtocolException, "PGSQL: unsupported authentication method %d", code);
+        }
+}
 
-        /** The last possibility must be that server is demanding password */
-        if (*buf == 'R')
-                return;
 
-        THROW(ProtocolException, "PGSQL: unknown error");
+/* ------------------------------------------------------------- Session */
+
+
+static void _startup(pgsql_t *pg, const char *username, const char *database) {
+        _begin(pg, 0);
+        _putInt32(pg, 0x00030000); // Protocol version 3.0
+        _putString(pg, "user");
+        _putString(pg, username);
+        if (database) {
+                _putString(pg, "database");
+                _putString(pg, database);
+        }
+        _putByte(pg, 0);
+        _end(pg);
+        _send(pg);
+}
+
+
+static void _terminate(pgsql_t *pg) {
+        _begin(pg, 'X');
+        _end(pg);
+        _send(pg);
+}
+
+
+// Log in and wait for the ReadyForQuery message
+static void _login(pgsql_t *pg) {
+        char error[STRLEN];
+        _startup(pg, pg->port->parameters.pgsql.username, pg->port->parameters.pgsql.database);
+        for (char type; (type = _readMessage(pg)) != 'Z';) {
+                switch (type) {
+                        case 'R':
+                                _authenticate(pg);
+                                break;
+                        case 'E':
+                                THROW(ProtocolException, "PGSQL: server returned error -- %s", _getError(pg, error, sizeof(error)));
+                                break;
+                        case 'S': // ParameterStatus
+                        case 'K': // BackendKeyData
+                        case 'N': // NoticeResponse
+                                break;
+                        default:
+                                THROW(ProtocolException, "PGSQL: unexpected message '%c' during the startup", type);
+                }
+        }
+}
+
+
+/*
+ * Run the health probe: Bind, Execute and Sync of the probe statement are sent
+ * in one request, on a new session the statement is prepared by the Parse
+ * message in the same request
+ */
+static void _probe(pgsql_t *pg, bool prepare) {
+        Port_T p = pg->port;
+        p->statistics.pgsql.available = false;
+        if (prepare) {
+                _begin(pg, 'P');
+                _putString(pg, PGSQL_STATEMENT);
+                _putString(pg, PGSQL_QUERY);
+                _putInt16(pg, 0); // No parameter types
+                _end(pg);
+        }
+        _begin(pg, 'B');
+        _putString(pg, "");              // Unnamed portal
+        _putString(pg, PGSQL_STATEMENT);
+        _putInt16(pg, 0);                // No parameter formats
+        _putInt16(pg, 0);                // No parameters
+        _putInt16(pg, 0);                // Text results
+        _end(pg);
+        _begin(pg, 'E');
+        _putString(pg, "");
+        _putInt32(pg, 0);                // No row limit
+        _end(pg);
+        _begin(pg, 'S');
+        _end(pg);
+        _send(pg);
+        char error[STRLEN] = {};
+        bool row = false;
+        for (char type; (type = _readMessage(pg)) != 'Z';) {
+                switch (type) {
+                        case 'D':
+                                {
+                                        char value[32];
+                                        if (_getInt16(pg) != 2)
+                                                THROW(ProtocolException, "PGSQL: unexpected probe query result");
+                                        p->statistics.pgsql.recovery = _getValue(pg, value, sizeof(value)) && *value == 't';
+                                        p->statistics.pgsql.lag = _getValue(pg, value, sizeof(value)) ? (int)strtol(value, NULL, 10) : -1;
+                                        row = true;
+                                }
+                                break;
+                        case 'E':
+                                // The server skips the messages up to Sync and sends ReadyForQuery, keep reading to stay in sync
+                                _getError(pg, error, sizeof(error));
+                                break;
+                        case '1': // ParseComplete
+                        case '2': // BindComplete
+                        case 'C': // CommandComplete
+                        case 'S': // ParameterStatus
+                        case 'N': // NoticeResponse
+                        case 'A': // NotificationResponse
+                                break;
+                        default:
+                                THROW(ProtocolException, "PGSQL: unexpected message '%c' in the probe query response", type);
+                }
+        }
+        if (*error)
+                THROW(ProtocolException, "PGSQL: probe query failed -- %s", error);
+        if (! row)
+                THROW(ProtocolException, "PGSQL: probe query returned no data");
+        p->statistics.pgsql.available = true;
+        DEBUG("PGSQL: recovery: %s, replication lag: %d\n", p->statistics.pgsql.recovery ? "yes" : "no", p->statistics.pgsql.lag);
+}
+
+
+static void _checkLimits(pgsql_t *pg) {
+        Port_T p = pg->port;
+        if (p->parameters.pgsql.lag > 0 && p->statistics.pgsql.recovery && p->statistics.pgsql.lag >= 0 && Util_evalQExpression(p->parameters.pgsql.lagOP, p->statistics.pgsql.lag, p->parameters.pgsql.lag))
+                THROW(ProtocolException, "PGSQL: error -- the replication lag is %d seconds", p->statistics.pgsql.lag);
+}
+
+
+/* ---------------------------------------------------------------- Public */
+
+
+void check_pgsql(Socket_T socket) {
+        ASSERT(socket);
+        pgsql_t pg = {
+                .socket = socket,
+                .port = Socket_getPort(socket)
+        };
+        if (! pg.port->parameters.pgsql.username) {
+                // Anonymous test: the server is working if it answers with the authentication request or an error
+                _startup(&pg, "root", "root");
+                switch (_readMessage(&pg)) {
+                        case 'E':
+                                return;
+                        case 'R':
+                                // Terminate the connection if the login was successful and connected via TCP socket
+                                if (_getInt32(&pg) == PGSQL_AUTH_OK && pg.port->family != Socket_Unix)
+                                        _terminate(&pg);
+                                return;
+                        default:
+                                THROW(ProtocolException, "PGSQL: unknown error");
+                }
+        }
+        _login(&pg);
+        _probe(&pg, true);
+        if (! pg.port->keepalive)
+                _terminate(&pg);
+        _checkLimits(&pg);
+}
+
+
+/**
+ * Keepalive test of the session logged in by check_pgsql(): execute the prepared probe statement
+ */
+void ping_pgsql(Socket_T socket) {
+        ASSERT(socket);
+        pgsql_t pg = {
+                .socket = socket,
+                .port = Socket_getPort(socket)
+        };
+        _probe(&pg, false);
+        _checkLimits(&pg);
 }
 
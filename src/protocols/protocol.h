@@ -65,7 +65,10 @@ typedef enum {
         Protocol_SIEVE,
         Protocol_SPAMASSASSIN,
         Protocol_FAIL2BAN,
-        Protocol_MQTT
+        Protocol_MQTT,
+        Protocol_GRPC,
+        Protocol_KAFKA,
+        Protocol_NATS
 } Protocol_Type;
 
 
@@ -76,8 +79,11 @@ void check_dwp(Socket_T);
 void check_fail2ban(Socket_T);
 void check_ftp(Socket_T);
 void check_generic(Socket_T);
+void check_grpc(Socket_T);
 void check_http(Socket_T);
 void check_imap(Socket_T);
+void check_kafka(Socket_T);
+void check_nats(Socket_T);
 void check_clamav(Socket_T);
 void check_ldap2(Socket_T);
 void check_ldap3(Socket_T);
@@ -103,6 +109,38 @@ void check_radius(Socket_T);
 void check_memcache(Socket_T);
 void check_mqtt(Socket_T);
 void check_websocket(Socket_T);
+void ping_default(Socket_T);
+void ping_mysql(Socket_T);
+void ping_redis(Socket_T);
+void ping_pgsql(Socket_T);
+void ping_grpc(Socket_T);
+void ping_nats(Socket_T);
+
+
+/*
+ * Protocol plugin ABI. A plugin is a shared object which exports the
+ * PROTOCOL_PLUGIN_SYMBOL variable describing the protocol test. The check
+ * function gets the connected socket, uses the Socket_* API and reports
+ * a failure by throwing IOException or ProtocolException, like the built-in
+ * tests. The optional ping function tests the connection kept open by the
+ * keepalive option. The version must be set to PROTOCOL_PLUGIN_VERSION the
+ * plugin was compiled with, plugins of another version are rejected.
+ *
+ *   const struct ProtocolPlugin_T monit_protocol_plugin = {
+ *           .version = PROTOCOL_PLUGIN_VERSION,
+ *           .name = "MYRPC",
+ *           .check = check_myrpc
+ *   };
+ */
+#define PROTOCOL_PLUGIN_VERSION 1
+#define PROTOCOL_PLUGIN_SYMBOL  "monit_protocol_plugin"
+
+struct ProtocolPlugin_T {
+        int version;                                    /**< PROTOCOL_PLUGIN_VERSION */
+        const char *name;                                         /**< Protocol name */
+        void (*check)(Socket_T);            /**< Protocol verification function */
+        void (*ping)(Socket_T);     /**< Keepalive connection test (NULL if not supported) */
+};
 
 
 /*
@@ -111,4 +149,13 @@ void check_websocket(Socket_T);
 Protocol_T Protocol_get(Protocol_Type type);
 
 
+/*
+ * Load the protocol plugin from the shared object. The plugin is loaded
+ * on the first use and stays loaded, next calls with the same path return
+ * the same protocol object. Returns NULL and logs the error if the plugin
+ * cannot be loaded
+ */
+Protocol_T Protocol_load(const char *path);
+
+
 #endif
@@ -39,6 +39,7 @@
 
 #include "md5.h"
 #include "sha1.h"
+#include "sha256.h"
 #include "checksum.h"
 #include "protocol.h"
 
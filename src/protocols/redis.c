@@ -22,41 +22,149 @@
  * for all of the code used other than OpenSSL.
  */
 
+
 #include "config.h"
 
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
 #include "protocol.h"
 
 // libmonit
+#include "util/Convert.h"
 #include "exceptions/IOException.h"
 #include "exceptions/ProtocolException.h"
 
 
-/* --------------------------------------------------------------- Public */
+/* ----------------------------------------------------------------- Private */
+
+
+static void _readReply(Socket_T socket, const char *command, char *buf, int size) {
+        if (! Socket_readLine(socket, buf, size))
+                THROW(IOException, "REDIS: %s response error -- %s", command, STRERROR);
+        Str_chomp(buf);
+}
+
+
+static void _parseInfo(Port_T p, const char *line) {
+        const char *value = strchr(line, ':');
+        if (value) {
+                value++;
+                if (Str_startsWith(line, "used_memory:")) {
+                        p->statistics.redis.memory = strtoll(value, NULL, 10);
+                } else if (Str_startsWith(line, "connected_clients:")) {
+                        p->statistics.redis.clients = (int)strtol(value, NULL, 10);
+                } else if (Str_startsWith(line, "instantaneous_ops_per_sec:")) {
+                        p->statistics.redis.operations = (int)strtol(value, NULL, 10);
+                } else if (Str_startsWith(line, "master_last_io_seconds_ago:")) {
+                        // Replica: the time since the last interaction with the master, -1 if the link is down
+                        p->statistics.redis.lag = (int)strtol(value, NULL, 10);
+                } else if (Str_startsWith(line, "slave") && (value = strstr(value, ",lag="))) {
+                        // Master: the replica with the highest lag
+                        p->statistics.redis.lag = MAX(p->statistics.redis.lag, (int)strtol(value + 5, NULL, 10));
+                }
+        }
+}
+
+
+/**
+ * Read the INFO bulk string reply line by line as it arrives, so the
+ * whole reply doesn't need to be buffered
+ */
+static void _readInfo(Socket_T socket, Port_T p) {
+        char buf[1024];
+        p->statistics.redis.available = false;
+        _readReply(socket, "INFO", buf, sizeof(buf));
+        if (*buf != '$') {
+                DEBUG("REDIS: INFO statistics not available -- %s\n", buf);
+                return;
+        }
+        long long length = strtoll(buf + 1, NULL, 10);
+        p->statistics.redis.lag = 0;
+        // The bulk string is followed by CRLF
+        for (length += 2; length > 0; length -= strlen(buf)) {
+                if (! Socket_readLine(socket, buf, sizeof(buf)))
+                        THROW(IOException, "REDIS: INFO response error -- %s", STRERROR);
+                _parseInfo(p, buf);
+        }
+        p->statistics.redis.available = true;
+}
+
+
+static void _checkLimits(Port_T p) {
+        if (p->parameters.redis.memory > 0 || p->parameters.redis.clients > 0 || p->parameters.redis.operations > 0 || p->parameters.redis.lag > 0) {
+                if (! p->statistics.redis.available)
+                        THROW(ProtocolException, "REDIS: INFO statistics not available");
+                if (p->parameters.redis.memory > 0 && Util_evalQExpression(p->parameters.redis.memoryOP, p->statistics.redis.memory, p->parameters.redis.memory))
+                        THROW(ProtocolException, "REDIS: error -- used memory is %s", Convert_bytes2str(p->statistics.redis.memory, (char[10]){}));
+                if (p->parameters.redis.clients > 0 && Util_evalQExpression(p->parameters.redis.clientsOP, p->statistics.redis.clients, p->parameters.redis.clients))
+                        THROW(ProtocolException, "REDIS: error -- %d clients are connected", p->statistics.redis.clients);
+                if (p->parameters.redis.operations > 0 && Util_evalQExpression(p->parameters.redis.operationsOP, p->statistics.redis.operations, p->parameters.redis.operations))
+                        THROW(ProtocolException, "REDIS: error -- %d operations per second", p->statistics.redis.operations);
+                if (p->parameters.redis.lag > 0) {
+                        if (p->statistics.redis.lag < 0)
+                                THROW(ProtocolException, "REDIS: error -- the replication link is down");
+                        if (Util_evalQExpression(p->parameters.redis.lagOP, p->statistics.redis.lag, p->parameters.redis.lag))
+                                THROW(ProtocolException, "REDIS: error -- the replication lag is %d seconds", p->statistics.redis.lag);
+                }
+        }
+}
+
+
+/* ------------------------------------------------------------------ Public */
 
 
 /**
- * Simple redis RESP protocol ping test:
+ * Redis RESP protocol test:
  *
- *     1. send a PING command
- *     2. expect a PONG response
- *     3. send a QUIT command
+ *     1. send the AUTH (if a password is set), PING and INFO commands in one
+ *        pipelined request
+ *     2. expect a PONG response, collect the INFO statistics and test the
+ *        limits
+ *     3. send a QUIT command (unless the connection is kept alive)
  *
  * @see http://redis.io/topics/protocol
  *
  * @file
  */
 void check_redis(Socket_T socket) {
+        ASSERT(socket);
+        ping_redis(socket);
+        Port_T p = Socket_getPort(socket);
+        if (! p->keepalive) {
+                if (Socket_print(socket, "*1\r\n$4\r\nQUIT\r\n") < 0)
+                        THROW(IOException, "REDIS: QUIT command error -- %s", STRERROR);
+        }
+}
+
+
+/**
+ * Keepalive test: the same pipelined request as check_redis() without QUIT
+ */
+void ping_redis(Socket_T socket) {
         ASSERT(socket);
         char buf[STRLEN];
+        Port_T p = Socket_getPort(socket);
+        ASSERT(p);
 
-        if (Socket_print(socket, "*1\r\n$4\r\nPING\r\n") < 0)
+        // Send all commands at once, the replies are read in order
+        const char *password = p->parameters.redis.password;
+        int rv = password ? Socket_print(socket, "*2\r\n$4\r\nAUTH\r\n$%zu\r\n%s\r\n*1\r\n$4\r\nPING\r\n*1\r\n$4\r\nINFO\r\n", strlen(password), password) : Socket_print(socket, "*1\r\n$4\r\nPING\r\n*1\r\n$4\r\nINFO\r\n");
+        if (rv < 0)
                 THROW(IOException, "REDIS: PING command error -- %s", STRERROR);
-        if (! Socket_readLine(socket, buf, sizeof(buf)))
-                THROW(IOException, "REDIS: PING response error -- %s", STRERROR);
-        Str_chomp(buf);
+        if (password) {
+                _readReply(socket, "AUTH", buf, sizeof(buf));
+                if (! Str_isEqual(buf, "+OK"))
+                        THROW(ProtocolException, "REDIS: AUTH error -- %s", buf);
+        }
+        _readReply(socket, "PING", buf, sizeof(buf));
         if (! Str_isEqual(buf, "+PONG") && ! Str_startsWith(buf, "-NOAUTH")) // We accept authentication error (-NOAUTH Authentication required): redis responded to request, but requires authentication => we assume it works
                 THROW(ProtocolException, "REDIS: PING error -- %s", buf);
-        if (Socket_print(socket, "*1\r\n$4\r\nQUIT\r\n") < 0)
-                THROW(IOException, "REDIS: QUIT command error -- %s", STRERROR);
+        _readInfo(socket, p);
+        _checkLimits(p);
 }
-
@@ -31,6 +31,7 @@
 #include "protocol.h"
 
 // libmonit
+#include "system/Time.h"
 #include "exceptions/IOException.h"
 #include "exceptions/ProtocolException.h"
 
@@ -40,7 +41,9 @@
  *
  *  http://tools.ietf.org/html/rfc6455
  *
- *  Establish websocket connection, send ping and close.
+ *  Establish websocket connection, send ping and close. If the ping count is
+ *  set, the pings are sent one by one over the upgraded connection and the
+ *  round trip time statistics (min/avg/max and jitter) are collected.
  *
  *  @file
  */
@@ -49,7 +52,11 @@
 /* ----------------------------------------------------------------- Private */
 
 
-static void read_response(Socket_T socket, int opcode) {
+/*
+ * Read frames up to the frame with the given opcode, return its payload size.
+ * The payload of the frame is left in the socket for the caller
+ */
+static int read_response(Socket_T socket, int opcode) {
         int n;
         do {
                 char buf[STRLEN];
@@ -75,9 +82,42 @@ static void read_response(Socket_T socket, int opcode) {
                                 THROW(ProtocolException, "WEBSOCKET: response 0x%x: unexpected payload size: %d", opcode, payload_size);
                         }
                 } else {
-                        break; // Found frame with matching opcode
+                        return *(buf + 1) & 0x7F; // Found frame with matching opcode
                 }
         } while (n > 0);
+        return 0;
+}
+
+
+/*
+ * Send the masked ping with the sequence number payload and wait for the pong
+ * with the same payload, unsolicited pongs (heartbeat) are skipped. Returns
+ * the round trip time in milliseconds
+ */
+static double ping(Socket_T socket, int sequence) {
+        unsigned char key[4] = {0x5b, 0x63, 0x68, 0x84};
+        unsigned char payload[4] = {(sequence >> 24) & 0xff, (sequence >> 16) & 0xff, (sequence >> 8) & 0xff, sequence & 0xff};
+        unsigned char request[10] = {
+                0x89,                  // Fin:True, Opcode:Ping
+                0x84,                  // Mask:True, Payload:4
+                key[0], key[1], key[2], key[3]
+        };
+        for (int i = 0; i < 4; i++)
+                request[6 + i] = payload[i] ^ key[i];
+        long long start = Time_micro();
+        if (Socket_write(socket, request, sizeof(request)) < 0)
+                THROW(IOException, "WEBSOCKET: error sending ping -- %s", STRERROR);
+        // Pong: verify response opcode is Pong (0xA) and the payload echoes the ping
+        for (;;) {
+                unsigned char buf[STRLEN];
+                int size = read_response(socket, 0xA);
+                if (size > (int)sizeof(buf))
+                        THROW(ProtocolException, "WEBSOCKET: response 0xa: unexpected payload size: %d", size);
+                if (size && Socket_read(socket, buf, size) != size)
+                        THROW(IOException, "WEBSOCKET: response 0xa: data read error");
+                if (size == sizeof(payload) && ! memcmp(buf, payload, sizeof(payload)))
+                        return (double)(Time_micro() - start) / 1000.;
+        }
 }
 
 
@@ -118,17 +158,27 @@ void check_websocket(Socket_T socket) {
         while (Socket_readLine(socket, buf, sizeof(buf)) && ! Str_isEqual(buf, "\r\n"))
                 ; // drop remaining HTTP response headers from the pipeline
 
-        // Ping
-        unsigned char ping[6] = {
-                0x89,                  // Fin:True, Opcode:Ping
-                0x80,                  // Mask:True, Payload:0
-                0x5b, 0x63, 0x68, 0x84 // Key
-        };
-        if (Socket_write(socket, ping, sizeof(ping)) < 0)
-                THROW(IOException, "WEBSOCKET: error sending ping -- %s", STRERROR);
-
-        // Pong: verify response opcode is Pong (0xA)
-        read_response(socket, 0xA);
+        // Ping: the round trip statistics are computed from the pings sent over the upgraded connection, the handshake is not included
+        int count = MAX(1, P->parameters.websocket.pings);
+        double sum = 0., variation = 0., last = 0.;
+        P->statistics.websocket.pings = 0;
+        for (int i = 0; i < count; i++) {
+                double rtt = ping(socket, i + 1);
+                if (i == 0) {
+                        P->statistics.websocket.minimum = P->statistics.websocket.maximum = rtt;
+                } else {
+                        P->statistics.websocket.minimum = MIN(P->statistics.websocket.minimum, rtt);
+                        P->statistics.websocket.maximum = MAX(P->statistics.websocket.maximum, rtt);
+                        variation += rtt > last ? rtt - last : last - rtt;
+                }
+                sum += rtt;
+                last = rtt;
+                P->statistics.websocket.pings = i + 1;
+        }
+        P->statistics.websocket.average = sum / count;
+        // Jitter: the mean difference of the consecutive round trip times
+        P->statistics.websocket.jitter = count > 1 ? variation / (count - 1) : 0.;
+        DEBUG("WEBSOCKET: %d pings, round trip min %.3f ms, avg %.3f ms, max %.3f ms, jitter %.3f ms\n", count, P->statistics.websocket.minimum, P->statistics.websocket.average, P->statistics.websocket.maximum, P->statistics.websocket.jitter);
 
         // Close request
         unsigned char close_request[6] = {
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+/**
+ * SHA-256 (FIPS 180-4). The block compression uses the Intel SHA
+ * extensions if the CPU supports them, otherwise the portable code.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#include "sha256.h"
+
+#if defined(__x86_64__) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define SHA256_SHANI 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+
+static const uint32_t _k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+
+static void _compress(uint32_t state[8], const unsigned char *data, size_t blocks) {
+        for (; blocks; blocks--, data += 64) {
+                uint32_t w[64];
+                for (int i = 0; i < 16; i++)
+                        w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16 | (uint32_t)data[4 * i + 2] << 8 | (uint32_t)data[4 * i + 3];
+                for (int i = 16; i < 64; i++) {
+                        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+                }
+                uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+                for (int i = 0; i < 64; i++) {
+                        uint32_t t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + _k[i] + w[i];
+                        uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                        h = g;
+                        g = f;
+                        f = e;
+                        e = d + t1;
+                        d = c;
+                        c = b;
+                        b = a;
+                        a = t1 + t2;
+                }
+                state[0] += a;
+                state[1] += b;
+                state[2] += c;
+                state[3] += d;
+                state[4] += e;
+                state[5] += f;
+                state[6] += g;
+                state[7] += h;
+        }
+}
+
+
+#ifdef SHA256_SHANI
+
+
+static __attribute__ ((target("sha,sse4.1"))) void _compressShaNi(uint32_t state[8], const unsigned char *data, size_t blocks) {
+        const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+        // Reorder the state words to the ABEF/CDGH layout used by the sha256rnds2 instruction
+        __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);
+        __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);
+        __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+        state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+        for (; blocks; blocks--, data += 64) {
+                __m128i abef = state0, cdgh = state1, w[4];
+                for (int i = 0; i < 16; i++) {
+                        if (i < 4)
+                                w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * i)), mask);
+                        else // W[i] = msg2(msg1(W[i - 4], W[i - 3]) + (W[i - 2]:W[i - 1] >> 32), W[i - 1])
+                                w[i & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]), _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4)), w[(i + 3) & 3]);
+                        __m128i m = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i *)&_k[4 * i]));
+                        state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+                        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+                }
+                state0 = _mm_add_epi32(state0, abef);
+                state1 = _mm_add_epi32(state1, cdgh);
+        }
+        tmp = _mm_shuffle_epi32(state0, 0x1B);
+        state1 = _mm_shuffle_epi32(state1, 0xB1);
+        _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xF0));
+        _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+
+#endif
+
+
+static void (*_compressBlocks)(uint32_t state[8], const unsigned char *data, size_t blocks) = _compress;
+
+
+/* --------------------------------------- Static constructor */
+
+
+static void __attribute__ ((constructor)) _constructor(void) {
+#ifdef SHA256_SHANI
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3) && (ecx & bit_SSE4_1) && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1U << 29)))
+                _compressBlocks = _compressShaNi;
+#endif
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void sha256_init(sha256_context_t *context) {
+        static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        memcpy(context->state, initial, sizeof(initial));
+        context->count = 0;
+}
+
+
+void sha256_append(sha256_context_t *context, const unsigned char *data, size_t len) {
+        size_t used = (size_t)(context->count & 63);
+        context->count += len;
+        if (used) {
+                size_t fill = 64 - used;
+                if (len < fill) {
+                        memcpy(context->buffer + used, data, len);
+                        return;
+                }
+                memcpy(context->buffer + used, data, fill);
+                _compressBlocks(context->state, context->buffer, 1);
+                data += fill;
+                len -= fill;
+        }
+        if (len >= 64) {
+                _compressBlocks(context->state, data, len / 64);
+                data += len & ~(size_t)63;
+                len &= 63;
+        }
+        if (len)
+                memcpy(context->buffer, data, len);
+}
+
+
+void sha256_finish(sha256_context_t *context, unsigned char digest[SHA256_DIGEST_SIZE]) {
+        uint64_t bits = context->count * 8;
+        size_t used = (size_t)(context->count & 63);
+        context->buffer[used++] = 0x80;
+        if (used > 56) {
+                memset(context->buffer + used, 0, 64 - used);
+                _compressBlocks(context->state, context->buffer, 1);
+                used = 0;
+        }
+        memset(context->buffer + used, 0, 56 - used);
+        for (int i = 0; i < 8; i++)
+                context->buffer[56 + i] = (unsigned char)(bits >> (56 - 8 * i));
+        _compressBlocks(context->state, context->buffer, 1);
+        for (int i = 0; i < 8; i++) {
+                digest[4 * i] = (unsigned char)(context->state[i] >> 24);
+                digest[4 * i + 1] = (unsigned char)(context->state[i] >> 16);
+                digest[4 * i + 2] = (unsigned char)(context->state[i] >> 8);
+                digest[4 * i + 3] = (unsigned char)context->state[i];
+        }
+}
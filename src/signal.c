@@ -32,15 +32,46 @@
 #include <signal.h>
 #endif
 
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
 #include "monit.h"
 
 /**
  *  Signal handling routines.
  *
+ *  The signal handlers only set the Run flags and write a byte to the
+ *  self-pipe. The daemon sleeps in poll on the pipe, so the signal which
+ *  arrived while the daemon was busy wakes up the next sleep at once
+ *  instead of being noticed after the poll cycle.
+ *
  *  @file
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+static int _wakeup[2] = {-1, -1};
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -82,7 +113,50 @@ void set_signal_block() {
         sigaddset(&mask, SIGHUP);
         sigaddset(&mask, SIGINT);
         sigaddset(&mask, SIGUSR1);
+        sigaddset(&mask, SIGUSR2);
         sigaddset(&mask, SIGTERM);
         pthread_sigmask(SIG_BLOCK, &mask, NULL);
 }
 
+
+bool set_signal_wakeup() {
+        if (_wakeup[0] >= 0)
+                return true;
+        int fd[2];
+        if (pipe(fd) != 0) {
+                Log_error("Cannot create the signal wakeup pipe -- %s\n", STRERROR);
+                return false;
+        }
+        for (int i = 0; i < 2; i++) {
+                fcntl(fd[i], F_SETFD, FD_CLOEXEC);
+                fcntl(fd[i], F_SETFL, O_NONBLOCK);
+        }
+        _wakeup[0] = fd[0];
+        _wakeup[1] = fd[1];
+        return true;
+}
+
+
+void signal_wakeup() {
+        // Called from the signal handler, write() is async-signal-safe
+        if (_wakeup[1] >= 0) {
+                int saved = errno;
+                ssize_t __attribute__ ((unused)) n = write(_wakeup[1], "", 1);
+                errno = saved;
+        }
+}
+
+
+bool signal_sleep(long long milli) {
+        if (_wakeup[0] < 0) {
+                nanosleep(&(struct timespec){.tv_sec = milli / 1000, .tv_nsec = (milli % 1000) * 1000000}, NULL);
+                return false;
+        }
+        struct pollfd fds = {.fd = _wakeup[0], .events = POLLIN};
+        // The poll is interrupted by the signal handler (EINTR) or returns with the byte it wrote, drain the pipe in both cases
+        bool woken = poll(&fds, 1, (int)MIN(milli, INT_MAX)) != 0;
+        char buffer[64];
+        while (read(_wakeup[0], buffer, sizeof(buffer)) > 0)
+                ;
+        return woken;
+}
@@ -84,12 +84,16 @@
 // libmonit
 #include "util/Str.h"
 #include "system/Time.h"
+#include "system/System.h"
 
 
 /**
- *  Function for spawning of a process. This function fork's twice to
- *  avoid creating any zombie processes. Inspired by code from
- *  W. Richard Stevens book, APUE.
+ *  Function for spawning of a process. The daemon executes the program
+ *  directly using vfork() and reaps it later in spawn_reap(). If the
+ *  program has to switch the user or to be detached from the monit
+ *  command line process, the function fork's twice to avoid creating
+ *  any zombie processes. Inspired by code from W. Richard Stevens book,
+ *  APUE.
  *
  *  @file
  */
@@ -109,35 +113,127 @@ enum ExitStatus_E {
 } __attribute__((__packed__));
 
 
+#define MONIT_ENVIRONMENT 10
+
+
+static struct {
+        Mutex_T mutex;
+        int count;
+        int size;
+        pid_t *list;                       /**< The direct children to reap */
+} _children = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+extern char **environ;
+
+
 /* ----------------------------------------------------------------- Private */
 
 
 /*
- * Setup the environment with special MONIT_xxx variables. The program
- * executed may use such variable for various purposes.
+ * Collect the special MONIT_xxx variables as "NAME=value" strings. The
+ * program executed may use such variable for various purposes.
+ * @return The number of variables
  */
-static void _setMonitEnvironment(Service_T S, command_t C, Event_T E, const char *date) {
-        setenv("MONIT_DATE", date, 1);
-        setenv("MONIT_SERVICE", S->name, 1);
-        setenv("MONIT_HOST", Run.system->name, 1);
-        setenv("MONIT_EVENT", E ? Event_get_description(E) : C == S->start ? "Started" : C == S->stop ? "Stopped" : "No Event", 1);
-        setenv("MONIT_DESCRIPTION", E ? E->message : C == S->start ? "Started" : C == S->stop ? "Stopped" : "No Event", 1);
+static int _getMonitEnvironment(Service_T S, command_t C, Event_T E, const char *date, char *env[static MONIT_ENVIRONMENT]) {
+        int n = 0;
+        env[n++] = Str_cat("MONIT_DATE=%s", date);
+        env[n++] = Str_cat("MONIT_SERVICE=%s", S->name);
+        env[n++] = Str_cat("MONIT_HOST=%s", Run.system->name);
+        env[n++] = Str_cat("MONIT_EVENT=%s", E ? Event_get_description(E) : C == S->start ? "Started" : C == S->stop ? "Stopped" : "No Event");
+        env[n++] = Str_cat("MONIT_DESCRIPTION=%s", E ? E->message : C == S->start ? "Started" : C == S->stop ? "Stopped" : "No Event");
         switch (S->type) {
                 case Service_Process:
                         if (S->inf.process->pid > -1)
-                                putenv(Str_cat("MONIT_PROCESS_PID=%d", S->inf.process->pid));
+                                env[n++] = Str_cat("MONIT_PROCESS_PID=%d", S->inf.process->pid);
                         if (S->inf.process->children > -1)
-                                putenv(Str_cat("MONIT_PROCESS_CHILDREN=%d", S->inf.process->children));
+                                env[n++] = Str_cat("MONIT_PROCESS_CHILDREN=%d", S->inf.process->children);
                         if (S->inf.process->cpu_percent > -1)
-                                putenv(Str_cat("MONIT_PROCESS_CPU_PERCENT=%.1f", S->inf.process->cpu_percent));
-                        putenv(Str_cat("MONIT_PROCESS_MEMORY=%llu", (unsigned long long)((double)S->inf.process->mem / 1024.)));
+                                env[n++] = Str_cat("MONIT_PROCESS_CPU_PERCENT=%.1f", S->inf.process->cpu_percent);
+                        env[n++] = Str_cat("MONIT_PROCESS_MEMORY=%llu", (unsigned long long)((double)S->inf.process->mem / 1024.));
                         break;
                 case Service_Program:
-                        putenv(Str_cat("MONIT_PROGRAM_STATUS=%d", S->program->exitStatus));
+                        env[n++] = Str_cat("MONIT_PROGRAM_STATUS=%d", S->program->exitStatus);
                         break;
                 default:
                         break;
         }
+        return n;
+}
+
+
+// Return true if the "NAME=value" variable is redefined by one of the MONIT_xxx variables
+static bool _isOverridden(const char *variable, char **env, int count) {
+        for (int i = 0; i < count; i++) {
+                size_t length = strchr(env[i], '=') - env[i] + 1;
+                if (strncmp(variable, env[i], length) == 0)
+                        return true;
+        }
+        return false;
+}
+
+
+static void _addChild(pid_t pid) {
+        LOCK(_children.mutex)
+        {
+                if (_children.count == _children.size) {
+                        _children.size = _children.size ? _children.size * 2 : 16;
+                        RESIZE(_children.list, _children.size * sizeof(pid_t));
+                }
+                _children.list[_children.count++] = pid;
+        }
+        END_LOCK;
+}
+
+
+/*
+ * Execute the program directly as our child using vfork(), which doesn't copy the
+ * monit address space. The environment is prepared in the parent, the child just
+ * detaches from the session, closes the descriptors and executes the program. The
+ * child is reaped by spawn_reap()
+ */
+static void _spawnDirect(Service_T S, command_t C, Event_T E, const char *date) {
+        char *monitenv[MONIT_ENVIRONMENT];
+        int count = _getMonitEnvironment(S, C, E, date, monitenv);
+        int size = 0;
+        while (environ[size])
+                size++;
+        char **env = CALLOC(size + count + 1, sizeof(char *));
+        int n = 0;
+        for (int i = 0; i < size; i++)
+                if (! _isOverridden(environ[i], monitenv, count))
+                        env[n++] = environ[i];
+        for (int i = 0; i < count; i++)
+                env[n++] = monitenv[i];
+        volatile int exec_error = 0;
+        int descriptors = System_getDescriptorsGuarded();
+        pid_t pid = vfork();
+        if (pid == 0) {
+                setsid();
+                for (int i = 3; i < descriptors; i++)
+                        close(i);
+                // Reset all signals, so the spawned process is *not* created with any inherited SIG_BLOCKs
+                sigset_t mask;
+                sigemptyset(&mask);
+                pthread_sigmask(SIG_SETMASK, &mask, NULL);
+                signal(SIGINT, SIG_DFL);
+                signal(SIGHUP, SIG_DFL);
+                signal(SIGTERM, SIG_DFL);
+                signal(SIGUSR1, SIG_DFL);
+                signal(SIGPIPE, SIG_DFL);
+                execve(C->arg[0], C->arg, env);
+                exec_error = errno;
+                _exit(errno);
+        }
+        if (pid < 0)
+                Log_error("Cannot fork a new process -- %s\n", STRERROR);
+        else if (exec_error)
+                Log_error("Error: Could not execute %s -- %s\n", C->arg[0], strerror(exec_error));
+        if (pid > 0)
+                _addChild(pid);
+        for (int i = 0; i < count; i++)
+                FREE(monitenv[i]);
+        FREE(env);
 }
 
 
@@ -167,6 +263,12 @@ void spawn(Service_T S, command_t C, Event_T E) {
                 return;
         }
 
+        // The daemon executes the program without the uid/gid switch directly, the double fork is used to detach the program from the monit command line process or to switch the user
+        if ((Run.flags & Run_Daemon) && ! C->has_uid && ! C->has_gid) {
+                _spawnDirect(S, C, E, Time_string(Time_now(), date));
+                return;
+        }
+
         /*
          * Block SIGCHLD
          */
@@ -204,7 +306,9 @@ void spawn(Service_T S, command_t C, Event_T E) {
                         }
                 }
 
-                _setMonitEnvironment(S, C, E, date);
+                char *monitenv[MONIT_ENVIRONMENT];
+                for (int i = 0, count = _getMonitEnvironment(S, C, E, date, monitenv); i < count; i++)
+                        putenv(monitenv[i]);
 
                 if (! (Run.flags & Run_Daemon)) {
                         for (int i = 0; i < 3; i++)
@@ -274,3 +378,23 @@ void spawn(Service_T S, command_t C, Event_T E) {
 
 }
 
+
+/**
+ * Reap the programs executed directly by spawn() which exited. Should be
+ * called periodically by the daemon, so the exited programs don't remain
+ * as zombies
+ */
+void spawn_reap() {
+        LOCK(_children.mutex)
+        {
+                for (int i = 0; i < _children.count;) {
+                        pid_t rv = waitpid(_children.list[i], NULL, WNOHANG);
+                        if (rv == _children.list[i] || (rv < 0 && errno == ECHILD))
+                                _children.list[i] = _children.list[--_children.count];
+                        else
+                                i++;
+                }
+        }
+        END_LOCK;
+}
+
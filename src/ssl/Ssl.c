@@ -76,6 +76,10 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
+#include <openssl/hmac.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
 
 #include "monit.h"
 #include "Ssl.h"
@@ -121,6 +125,44 @@
 #define SSLERROR ERR_error_string(ERR_get_error(),NULL)
 
 
+/**
+ * Server session cache size and session lifetime [s]
+ */
+#define SESSION_CACHE_SIZE 1024
+#define SESSION_TIMEOUT 300
+
+
+/**
+ * The session ticket key is replaced after this time [s]. The tickets encrypted by the previous key are still accepted and renewed
+ */
+#define TICKET_KEY_LIFETIME 3600
+
+
+/**
+ * Maximum number of the client sessions cached for resumption. The least recently used session is replaced if the cache is full
+ */
+#define CLIENT_SESSION_CACHE_SIZE 64
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && ! defined(LIBRESSL_VERSION_NUMBER)
+#define CLIENT_SESSION_CACHE 1
+#endif
+
+
+/**
+ * Maximum number of the client contexts cached for the distinct SSL options. The least recently used context is replaced if the cache is full
+ */
+#define CLIENT_CONTEXT_CACHE_SIZE 32
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && ! defined(LIBRESSL_VERSION_NUMBER)
+#define CLIENT_CONTEXT_CACHE 1
+#endif
+
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#define TICKET_MAC_CTX EVP_MAC_CTX
+#else
+#define TICKET_MAC_CTX HMAC_CTX
+#endif
+
+
 #define T Ssl_T
 struct T {
         bool accepted;
@@ -129,14 +171,27 @@ struct T {
         SSL *handler;
         SSL_CTX *ctx;
         X509 *certificate;
+        char *session;                       /**< Client session cache key */
         char error[128];
 };
 
 
+typedef struct TicketKey_T {
+        unsigned char name[16];
+        unsigned char aes[32];
+        unsigned char hmac[32];
+} TicketKey_T;
+
+
 struct SslServer_T {
         int socket;
         SSL_CTX *ctx;
         SslOptions_T options;
+        struct {
+                time_t created;                 /**< Creation time of the current key */
+                TicketKey_T key[2];            /**< The current and the previous key */
+                Mutex_T mutex;
+        } ticket;
 };
 
 
@@ -148,6 +203,30 @@ static Mutex_T *instanceMutexTable;
 static int session_id_context = 1;
 
 
+#ifdef CLIENT_SESSION_CACHE
+static struct {
+        Mutex_T mutex;
+        struct {
+                char *key;
+                SSL_SESSION *session;
+                long long used;
+        } entry[CLIENT_SESSION_CACHE_SIZE];
+} _clientSessions = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+#endif
+
+
+#ifdef CLIENT_CONTEXT_CACHE
+static struct {
+        Mutex_T mutex;
+        struct {
+                char *key;
+                SSL_CTX *ctx;
+                long long used;
+        } entry[CLIENT_CONTEXT_CACHE_SIZE];
+} _clientContexts = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+#endif
+
+
 /* ----------------------------------------------------------------- Private */
 
 
@@ -329,17 +408,16 @@ static void _mutexLock(int mode, int n, __attribute__ ((unused)) const char *fil
 #endif
 
 
-static int _checkChecksum(T C, X509_STORE_CTX *ctx, X509 *certificate) {
+static bool _matchChecksum(T C, X509 *certificate) {
         Hash_Type checksumType = _optionsChecksumType(C->options->checksumType);
         const char *checksum = _optionsChecksum(C->options->checksum);
-        if (checksumType != Hash_Unknown && STR_DEF(checksum) && X509_STORE_CTX_get_error_depth(ctx) == 0) {
+        if (checksumType != Hash_Unknown && STR_DEF(checksum)) {
                 const EVP_MD *hash = NULL;
                 switch (checksumType) {
                         case Hash_Md5:
                                 if (Run.flags & Run_FipsEnabled) {
-                                        X509_STORE_CTX_set_error(ctx, X509_V_ERR_APPLICATION_VERIFICATION);
                                         snprintf(C->error, sizeof(C->error), "SSL certificate MD5 checksum is not supported in FIPS mode, please use SHA1");
-                                        return 0;
+                                        return false;
                                 } else {
                                         hash = EVP_md5();
                                 }
@@ -347,10 +425,12 @@ static int _checkChecksum(T C, X509_STORE_CTX *ctx, X509 *certificate) {
                         case Hash_Sha1:
                                 hash = EVP_sha1();
                                 break;
+                        case Hash_Sha256:
+                                hash = EVP_sha256();
+                                break;
                         default:
-                                X509_STORE_CTX_set_error(ctx, X509_V_ERR_APPLICATION_VERIFICATION);
                                 snprintf(C->error, sizeof(C->error), "Invalid SSL certificate checksum type (0x%x)", checksumType);
-                                return 0;
+                                return false;
                 }
                 unsigned int len, i = 0;
                 unsigned char realChecksum[EVP_MAX_MD_SIZE];
@@ -358,13 +438,21 @@ static int _checkChecksum(T C, X509_STORE_CTX *ctx, X509 *certificate) {
                 while ((i < len) && (checksum[2 * i] != '\0') && (checksum[2 * i + 1] != '\0')) {
                         unsigned char c = (checksum[2 * i] > 57 ? checksum[2 * i] - 87 : checksum[2 * i] - 48) * 0x10 + (checksum[2 * i + 1] > 57 ? checksum[2 * i + 1] - 87 : checksum[2 * i + 1] - 48);
                         if (c != realChecksum[i]) {
-                                X509_STORE_CTX_set_error(ctx, X509_V_ERR_APPLICATION_VERIFICATION);
                                 snprintf(C->error, sizeof(C->error), "SSL server certificate checksum failed");
-                                return 0;
+                                return false;
                         }
                         i++;
                 }
         }
+        return true;
+}
+
+
+static int _checkChecksum(T C, X509_STORE_CTX *ctx, X509 *certificate) {
+        if (X509_STORE_CTX_get_error_depth(ctx) == 0 && ! _matchChecksum(C, certificate)) {
+                X509_STORE_CTX_set_error(ctx, X509_V_ERR_APPLICATION_VERIFICATION);
+                return 0;
+        }
         return 1;
 }
 
@@ -467,16 +555,143 @@ static bool _setServerNameIdentification(T C, const char *hostname) {
 }
 
 
-static bool _setClientCertificate(T C, const char *file) {
-        if (SSL_CTX_use_certificate_chain_file(C->ctx, file) != 1) {
+static void _setApplicationProtocol(T C) {
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+        // Offer the application protocol by ALPN, the protocol list is in the wire format: the length prefixed names
+        if (C->options->alpn) {
+                unsigned char protocols[256];
+                size_t length = strlen(C->options->alpn);
+                ASSERT(length < sizeof(protocols));
+                protocols[0] = (unsigned char)length;
+                memcpy(protocols + 1, C->options->alpn, length);
+                if (SSL_set_alpn_protos(C->handler, protocols, (unsigned int)length + 1) != 0)
+                        DEBUG("SSL: unable to set the ALPN protocol to %s\n", C->options->alpn);
+        }
+#endif
+}
+
+
+#ifdef CLIENT_SESSION_CACHE
+/**
+ * The client session cache key: the server address and name and the options which affect the session verification
+ */
+static char *_clientSessionKey(T C, int socket, const char *name) {
+        struct sockaddr_storage addr;
+        socklen_t addrlen = sizeof(addr);
+        if (getpeername(socket, (struct sockaddr *)&addr, &addrlen) != 0)
+                return NULL;
+        char host[NI_MAXHOST], port[NI_MAXSERV];
+        if (getnameinfo((struct sockaddr *)&addr, addrlen, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+                return NULL;
+        return Str_cat("[%s]:%s %s %d %d %d %s %s %s %s %s",
+                host,
+                port,
+                STR_DEF(name) ? name : "-",
+                _optionsVersion(C->options->version),
+                _optionsVerify(C->options->verify),
+                _optionsAllowSelfSigned(C->options->allowSelfSigned),
+                _optionsCiphers(C->options->ciphers),
+                NVLSTR(_optionsClientPEMFile(C->options->clientpemfile)),
+                NVLSTR(_optionsCACertificateFile(C->options->CACertificateFile)),
+                NVLSTR(_optionsCACertificatePath(C->options->CACertificatePath)),
+                NVLSTR(_optionsChecksum(C->options->checksum)));
+}
+
+
+/**
+ * Get the cached client session for the given key or NULL. The caller must free the session
+ */
+static SSL_SESSION *_getClientSession(const char *key) {
+        SSL_SESSION *session = NULL;
+        LOCK(_clientSessions.mutex)
+        {
+                for (int i = 0; i < CLIENT_SESSION_CACHE_SIZE; i++) {
+                        if (_clientSessions.entry[i].key && IS(_clientSessions.entry[i].key, key)) {
+                                session = _clientSessions.entry[i].session;
+                                SSL_SESSION_up_ref(session);
+                                _clientSessions.entry[i].used = Time_milli();
+                                break;
+                        }
+                }
+        }
+        END_LOCK;
+        return session;
+}
+
+
+/**
+ * Store the client session in the cache. The cache takes the session ownership. If the session is NULL, the cached session is removed
+ */
+static void _setClientSession(const char *key, SSL_SESSION *session) {
+        LOCK(_clientSessions.mutex)
+        {
+                int slot = -1;
+                for (int i = 0; i < CLIENT_SESSION_CACHE_SIZE; i++) {
+                        if (_clientSessions.entry[i].key && IS(_clientSessions.entry[i].key, key)) {
+                                slot = i;
+                                break;
+                        } else if (session && (slot == -1 || _clientSessions.entry[i].used < _clientSessions.entry[slot].used)) {
+                                slot = i; // Free or least recently used slot
+                        }
+                }
+                if (slot != -1) {
+                        if (_clientSessions.entry[slot].session)
+                                SSL_SESSION_free(_clientSessions.entry[slot].session);
+                        FREE(_clientSessions.entry[slot].key);
+                        _clientSessions.entry[slot].session = session;
+                        _clientSessions.entry[slot].used = 0LL;
+                        if (session) {
+                                _clientSessions.entry[slot].key = Str_dup(key);
+                                _clientSessions.entry[slot].used = Time_milli();
+                        }
+                }
+        }
+        END_LOCK;
+}
+
+
+/**
+ * New session callback: the session is ready for resumption (in TLS 1.3 the session ticket is received after the handshake)
+ */
+static int _newClientSession(SSL *ssl, SSL_SESSION *session) {
+        T C = SSL_get_app_data(ssl);
+        if (C && C->session && SSL_SESSION_is_resumable(session)) {
+                _setClientSession(C->session, session);
+                return 1;
+        }
+        return 0;
+}
+
+
+/**
+ * The certificate verification callback is not called for the resumed session => get the server certificate from the session
+ */
+static bool _checkResumedSession(T C) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        C->certificate = SSL_get0_peer_certificate(C->handler);
+#else
+        if ((C->certificate = SSL_get_peer_certificate(C->handler)))
+                X509_free(C->certificate); // The session keeps the reference
+#endif
+        if (! C->certificate) {
+                snprintf(C->error, sizeof(C->error), "cannot get SSL server certificate");
+                return false;
+        }
+        return _matchChecksum(C, C->certificate);
+}
+#endif
+
+
+static bool _setClientCertificate(SSL_CTX *ctx, const char *file) {
+        if (SSL_CTX_use_certificate_chain_file(ctx, file) != 1) {
                 Log_error("SSL client certificate chain loading failed: %s\n", SSLERROR);
                 return false;
         }
-        if (SSL_CTX_use_PrivateKey_file(C->ctx, file, SSL_FILETYPE_PEM) != 1) {
+        if (SSL_CTX_use_PrivateKey_file(ctx, file, SSL_FILETYPE_PEM) != 1) {
                 Log_error("SSL client private key loading failed: %s\n", SSLERROR);
                 return false;
         }
-        if (SSL_CTX_check_private_key(C->ctx) != 1) {
+        if (SSL_CTX_check_private_key(ctx) != 1) {
                 Log_error("SSL client private key doesn't match the certificate: %s\n", SSLERROR);
                 return false;
         }
@@ -484,6 +699,216 @@ static bool _setClientCertificate(T C, const char *file) {
 }
 
 
+/**
+ * Create the client context. The context holds the settings which depend on the SSL options only, so it can be shared by the connections with the same options
+ */
+static SSL_CTX *_newClientContext(SslOptions_T options) {
+#if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
+        const SSL_METHOD *method = SSLv23_client_method();
+#else
+        const SSL_METHOD *method = TLS_client_method();
+#endif
+        if (! method) {
+                Log_error("SSL: client method initialization failed -- %s\n", SSLERROR);
+                return NULL;
+        }
+        SSL_CTX *ctx = SSL_CTX_new(method);
+        if (! ctx) {
+                Log_error("SSL: client context initialization failed -- %s\n", SSLERROR);
+                return NULL;
+        }
+        if (! _setVersion(ctx, options))
+                goto sslerror;
+        SSL_CTX_set_default_verify_paths(ctx);
+        const char *CACertificateFile = _optionsCACertificateFile(options->CACertificateFile);
+        const char *CACertificatePath = _optionsCACertificatePath(options->CACertificatePath);
+        if (CACertificateFile || CACertificatePath) {
+                if (! SSL_CTX_load_verify_locations(ctx, CACertificateFile, CACertificatePath)) {
+                        Log_error("SSL: CA certificates loading failed -- %s\n", SSLERROR);
+                        goto sslerror;
+                }
+        }
+        const char *ClientPEMFile = _optionsClientPEMFile(options->clientpemfile);
+        if (ClientPEMFile && ! _setClientCertificate(ctx, ClientPEMFile))
+                goto sslerror;
+#ifdef SSL_OP_NO_COMPRESSION
+        SSL_CTX_set_options(ctx, SSL_OP_NO_COMPRESSION);
+#endif
+#ifdef CLIENT_SESSION_CACHE
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, _newClientSession);
+#endif
+        const char *ciphers = _optionsCiphers(options->ciphers);
+        if (SSL_CTX_set_cipher_list(ctx, ciphers) != 1) {
+                Log_error("SSL: client cipher list [%s] error -- no valid ciphers\n", ciphers);
+                goto sslerror;
+        }
+        return ctx;
+sslerror:
+        SSL_CTX_free(ctx);
+        return NULL;
+}
+
+
+#ifdef CLIENT_CONTEXT_CACHE
+/**
+ * The client context cache key: the options which are applied to the context
+ */
+static char *_clientContextKey(SslOptions_T options) {
+        return Str_cat("%d %s %s %s %s",
+                _optionsVersion(options->version),
+                _optionsCiphers(options->ciphers),
+                NVLSTR(_optionsClientPEMFile(options->clientpemfile)),
+                NVLSTR(_optionsCACertificateFile(options->CACertificateFile)),
+                NVLSTR(_optionsCACertificatePath(options->CACertificatePath)));
+}
+
+
+static void _clearClientContexts(void) {
+        LOCK(_clientContexts.mutex)
+        {
+                for (int i = 0; i < CLIENT_CONTEXT_CACHE_SIZE; i++) {
+                        if (_clientContexts.entry[i].ctx)
+                                SSL_CTX_free(_clientContexts.entry[i].ctx);
+                        _clientContexts.entry[i].ctx = NULL;
+                        _clientContexts.entry[i].used = 0LL;
+                        FREE(_clientContexts.entry[i].key);
+                }
+        }
+        END_LOCK;
+}
+#endif
+
+
+/**
+ * Get the client context for the options. The context is created once for the distinct options, so the CA certificates
+ * and the client certificate are loaded and the cipher list is parsed once, and then shared by all connections. The
+ * caller owns a reference to the context and must free it
+ */
+static SSL_CTX *_getClientContext(SslOptions_T options) {
+#ifdef CLIENT_CONTEXT_CACHE
+        SSL_CTX *ctx = NULL;
+        char *key = _clientContextKey(options);
+        LOCK(_clientContexts.mutex)
+        {
+                int slot = -1;
+                for (int i = 0; i < CLIENT_CONTEXT_CACHE_SIZE; i++) {
+                        if (_clientContexts.entry[i].key && IS(_clientContexts.entry[i].key, key)) {
+                                ctx = _clientContexts.entry[i].ctx;
+                                slot = i;
+                                break;
+                        } else if (slot == -1 || _clientContexts.entry[i].used < _clientContexts.entry[slot].used) {
+                                slot = i; // Free or least recently used slot
+                        }
+                }
+                // The context is created under the lock, so concurrent connections with the same options load the certificates once
+                if (! ctx && (ctx = _newClientContext(options))) {
+                        if (_clientContexts.entry[slot].ctx)
+                                SSL_CTX_free(_clientContexts.entry[slot].ctx);
+                        FREE(_clientContexts.entry[slot].key);
+                        _clientContexts.entry[slot].key = key;
+                        _clientContexts.entry[slot].ctx = ctx;
+                        key = NULL;
+                }
+                if (ctx) {
+                        SSL_CTX_up_ref(ctx);
+                        _clientContexts.entry[slot].used = Time_milli();
+                }
+        }
+        END_LOCK;
+        FREE(key);
+        return ctx;
+#else
+        return _newClientContext(options);
+#endif
+}
+
+
+/**
+ * Replace the ticket key if it expired. The caller must hold the ticket mutex
+ */
+static bool _rotateTicketKey(SslServer_T S) {
+        time_t now = Time_now();
+        if (S->ticket.created && now - S->ticket.created < TICKET_KEY_LIFETIME && now >= S->ticket.created)
+                return true;
+        TicketKey_T key;
+        if (RAND_bytes((unsigned char *)&key, sizeof(key)) != 1)
+                return false;
+        S->ticket.key[1] = S->ticket.created ? S->ticket.key[0] : key;
+        S->ticket.key[0] = key;
+        S->ticket.created = now;
+        return true;
+}
+
+
+/**
+ * Session ticket key callback: encrypt the new tickets with the current key and decrypt the tickets encrypted by the
+ * current or the previous key. Returns 2 if the ticket was encrypted by the previous key, so OpenSSL issues a new one
+ */
+static int _ticketKey(SSL *ssl, unsigned char name[16], unsigned char *iv, EVP_CIPHER_CTX *cipher, TICKET_MAC_CTX *mac, int encrypt) {
+        SslServer_T S = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+        TicketKey_T key;
+        int rv = 0;
+        LOCK(S->ticket.mutex)
+        {
+                if (_rotateTicketKey(S)) {
+                        if (encrypt) {
+                                key = S->ticket.key[0];
+                                rv = 1;
+                        } else {
+                                for (int i = 0; i < 2; i++) {
+                                        if (memcmp(name, S->ticket.key[i].name, sizeof(key.name)) == 0) {
+                                                key = S->ticket.key[i];
+                                                rv = i + 1;
+                                                break;
+                                        }
+                                }
+                        }
+                } else {
+                        rv = -1;
+                }
+        }
+        END_LOCK;
+        if (rv <= 0)
+                return rv; // Unknown key => full handshake
+        if (encrypt) {
+                memcpy(name, key.name, sizeof(key.name));
+                if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+                        return -1;
+        }
+        if (EVP_CipherInit_ex(cipher, EVP_aes_256_cbc(), NULL, key.aes, iv, encrypt) != 1)
+                return -1;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        OSSL_PARAM params[] = {
+                OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac, sizeof(key.hmac)),
+                OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)"SHA256", 0),
+                OSSL_PARAM_construct_end()
+        };
+        if (EVP_MAC_CTX_set_params(mac, params) != 1)
+                return -1;
+#else
+        if (HMAC_Init_ex(mac, key.hmac, sizeof(key.hmac), EVP_sha256(), NULL) != 1)
+                return -1;
+#endif
+        return rv;
+}
+
+
+static void _setSessionResumption(SslServer_T S) {
+        // Stateful resumption: the sessions are cached in the server context shared by all connections
+        SSL_CTX_set_session_cache_mode(S->ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(S->ctx, SESSION_CACHE_SIZE);
+        SSL_CTX_set_timeout(S->ctx, SESSION_TIMEOUT);
+        // Stateless resumption: session tickets encrypted by our rotated key
+        SSL_CTX_set_app_data(S->ctx, S);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(S->ctx, _ticketKey);
+#else
+        SSL_CTX_set_tlsext_ticket_key_cb(S->ctx, _ticketKey);
+#endif
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -516,11 +941,33 @@ void Ssl_stop() {
         FREE(instanceMutexTable);
         RAND_cleanup();
         ERR_free_strings();
+#endif
+#ifdef CLIENT_SESSION_CACHE
+        LOCK(_clientSessions.mutex)
+        {
+                for (int i = 0; i < CLIENT_SESSION_CACHE_SIZE; i++) {
+                        if (_clientSessions.entry[i].session)
+                                SSL_SESSION_free(_clientSessions.entry[i].session);
+                        _clientSessions.entry[i].session = NULL;
+                        FREE(_clientSessions.entry[i].key);
+                }
+        }
+        END_LOCK;
+#endif
+#ifdef CLIENT_CONTEXT_CACHE
+        _clearClientContexts();
 #endif
         Ssl_threadCleanup();
 }
 
 
+void Ssl_reload() {
+#ifdef CLIENT_CONTEXT_CACHE
+        _clearClientContexts();
+#endif
+}
+
+
 void Ssl_threadCleanup() {
 #if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
         ERR_remove_thread_state(NULL);
@@ -543,42 +990,8 @@ T Ssl_new(SslOptions_T options) {
         T C;
         NEW(C);
         C->options = options;
-#if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
-        const SSL_METHOD *method = SSLv23_client_method();
-#else
-        const SSL_METHOD *method = TLS_client_method();
-#endif
-        if (! method) {
-                Log_error("SSL: client method initialization failed -- %s\n", SSLERROR);
-                goto sslerror;
-        }
-        if (! (C->ctx = SSL_CTX_new(method))) {
-                Log_error("SSL: client context initialization failed -- %s\n", SSLERROR);
-                goto sslerror;
-        }
-        if (! _setVersion(C->ctx, options)) {
+        if (! (C->ctx = _getClientContext(options)))
                 goto sslerror;
-        }
-        SSL_CTX_set_default_verify_paths(C->ctx);
-        const char *CACertificateFile = _optionsCACertificateFile(options->CACertificateFile);
-        const char *CACertificatePath = _optionsCACertificatePath(options->CACertificatePath);
-        if (CACertificateFile || CACertificatePath) {
-                if (! SSL_CTX_load_verify_locations(C->ctx, CACertificateFile, CACertificatePath)) {
-                        Log_error("SSL: CA certificates loading failed -- %s\n", SSLERROR);
-                        goto sslerror;
-                }
-        }
-        const char *ClientPEMFile = _optionsClientPEMFile(options->clientpemfile);
-        if (ClientPEMFile && ! _setClientCertificate(C, ClientPEMFile))
-                goto sslerror;
-#ifdef SSL_OP_NO_COMPRESSION
-        SSL_CTX_set_options(C->ctx, SSL_OP_NO_COMPRESSION);
-#endif
-        const char *ciphers = _optionsCiphers(options->ciphers);
-        if (SSL_CTX_set_cipher_list(C->ctx, ciphers) != 1) {
-                Log_error("SSL: client cipher list [%s] error -- no valid ciphers\n", ciphers);
-                goto sslerror;
-        }
         if (! (C->handler = SSL_new(C->ctx))) {
                 Log_error("SSL: cannot create client handler -- %s\n", SSLERROR);
                 goto sslerror;
@@ -599,6 +1012,7 @@ void Ssl_free(T *C) {
                 SSL_free((*C)->handler);
         if ((*C)->ctx && ! (*C)->accepted)
                 SSL_CTX_free((*C)->ctx);
+        FREE((*C)->session);
         FREE(*C);
 }
 
@@ -642,6 +1056,16 @@ void Ssl_connect(T C, int socket, int timeout, const char *name) {
         SSL_set_connect_state(C->handler);
         SSL_set_fd(C->handler, C->socket);
         _setServerNameIdentification(C, name);
+        _setApplicationProtocol(C);
+#ifdef CLIENT_SESSION_CACHE
+        if ((C->session = _clientSessionKey(C, socket, name))) {
+                SSL_SESSION *session = _getClientSession(C->session);
+                if (session) {
+                        SSL_set_session(C->handler, session);
+                        SSL_SESSION_free(session);
+                }
+        }
+#endif
         bool retry = false;
         do {
                 int rv = SSL_connect(C->handler);
@@ -657,16 +1081,27 @@ void Ssl_connect(T C, int socket, int timeout, const char *name) {
                                         break;
                                 default:
 					rv = (int)SSL_get_verify_result(C->handler);
-					if (rv != X509_V_OK)
+					if (rv != X509_V_OK) {
+#ifdef CLIENT_SESSION_CACHE
+                                                if (C->session)
+                                                        _setClientSession(C->session, NULL);
+#endif
                                                 THROW(IOException, "SSL server certificate verification error: %s", *C->error ? C->error : X509_verify_cert_error_string(rv));
-					else
+					} else {
                                                 THROW(IOException, "SSL connection error: %s", SSLERROR);
+                                        }
                                         break;
                         }
                 } else {
                         break;
                 }
         } while (retry);
+#ifdef CLIENT_SESSION_CACHE
+        if (SSL_session_reused(C->handler) && ! _checkResumedSession(C)) {
+                _setClientSession(C->session, NULL);
+                THROW(IOException, "SSL server certificate verification error: %s", C->error);
+        }
+#endif
 }
 
 
@@ -752,6 +1187,12 @@ int Ssl_read(T C, void *b, int size, int timeout) {
 }
 
 
+int Ssl_pending(T C) {
+        ASSERT(C);
+        return SSL_pending(C->handler);
+}
+
+
 int Ssl_getCertificateValidDays(T C) {
         if (C && C->certificate) {
                 // Certificates which expired already are caught in preverify => we don't need to handle them here
@@ -790,6 +1231,54 @@ int Ssl_getCertificateValidDays(T C) {
 }
 
 
+time_t Ssl_getCertificateFileExpiry(const char *file) {
+        ASSERT(file);
+        BIO *bio = BIO_new_file(file, "r");
+        if (! bio)
+                THROW(IOException, "cannot open the certificate %s -- %s", file, STRERROR);
+        X509 *certificate = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+        if (! certificate && BIO_reset(bio) == 0)
+                certificate = d2i_X509_bio(bio, NULL);
+        BIO_free(bio);
+        ERR_clear_error();
+        if (! certificate)
+                THROW(IOException, "%s is not a PEM or DER certificate", file);
+        volatile time_t expiry = 0;
+        TRY
+        {
+#ifdef HAVE_ASN1_TIME_DIFF
+                int days, seconds;
+#if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
+                if (! ASN1_TIME_diff(&days, &seconds, NULL, X509_get_notAfter(certificate)))
+#else
+                if (! ASN1_TIME_diff(&days, &seconds, NULL, X509_get0_notAfter(certificate)))
+#endif
+                        THROW(IOException, "invalid time format in the notAfter field of %s", file);
+                expiry = Time_now() + days * 86400LL + seconds;
+#else
+                ASN1_GENERALIZEDTIME *t = ASN1_TIME_to_generalizedtime(X509_get_notAfter(certificate), NULL);
+                if (! t)
+                        THROW(IOException, "invalid time format in the notAfter field of %s", file);
+                TRY
+                {
+                        expiry = Time_toTimestamp((const char *)t->data);
+                }
+                FINALLY
+                {
+                        ASN1_STRING_free(t);
+                }
+                END_TRY;
+#endif
+        }
+        FINALLY
+        {
+                X509_free(certificate);
+        }
+        END_TRY;
+        return expiry;
+}
+
+
 char *Ssl_printOptions(SslOptions_T options, char *b, int size) {
         ASSERT(b);
         ASSERT(size > 0);
@@ -846,6 +1335,7 @@ SslServer_T SslServer_new(int socket, SslOptions_T options) {
         NEW(S);
         S->socket = socket;
         S->options = options;
+        Mutex_init(S->ticket.mutex);
 #if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
         const SSL_METHOD *method = SSLv23_server_method();
 #else
@@ -893,7 +1383,7 @@ SslServer_T SslServer_new(int socket, SslOptions_T options) {
 #ifdef SSL_OP_NO_COMPRESSION
         SSL_CTX_set_options(S->ctx, SSL_OP_NO_COMPRESSION);
 #endif
-        SSL_CTX_set_session_cache_mode(S->ctx, SSL_SESS_CACHE_OFF);
+        _setSessionResumption(S);
         const char *pemchain = _optionsServerPEMChain(options->pemchain);
         const char *pemkey = _optionsServerPEMKey(options->pemkey);
         const char *pemfile = _optionsServerPEMFile(options->pemfile);
@@ -944,6 +1434,7 @@ void SslServer_free(SslServer_T *S) {
         ASSERT(S && *S);
         if ((*S)->ctx)
                 SSL_CTX_free((*S)->ctx);
+        Mutex_destroy((*S)->ticket.mutex);
         FREE(*S);
 }
 
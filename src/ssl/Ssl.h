@@ -61,6 +61,7 @@ typedef struct SslOptions_T {
         char *ciphers;                               /**< Allowed SSL ciphers list */
         char *CACertificateFile;             /**< Path to CA certificates PEM file */
         char *CACertificatePath;            /**< Path to CA certificates directory */
+        const char *alpn;       /**< Optional ALPN protocol name (not freed, static) */
 } *SslOptions_T;
 
 
@@ -86,6 +87,14 @@ void Ssl_start(void);
 void Ssl_stop(void);
 
 
+/**
+ * Release the cached client contexts, so the next connections load the
+ * CA certificates and the client certificate again. Should be called when
+ * the configuration is reloaded
+ */
+void Ssl_reload(void);
+
+
 /**
  * Cleanup thread's error queue.
  */
@@ -157,6 +166,15 @@ int Ssl_write(T C, const void *b, int size, int timeout);
 int Ssl_read(T C, void *b, int size, int timeout);
 
 
+/**
+ * Get the number of decrypted bytes which can be read without reading
+ * the socket
+ * @param C An SSL connection object
+ * @return Number of pending bytes
+ */
+int Ssl_pending(T C);
+
+
 /**
  * Get days the certificate remains valid.
  * @param C An SSL connection object
@@ -166,6 +184,16 @@ int Ssl_read(T C, void *b, int size, int timeout);
 int Ssl_getCertificateValidDays(T C);
 
 
+/**
+ * Get the expiry time of the certificate in the file. The file can be in
+ * the PEM format, where the first certificate is used, or in the DER format
+ * @param file The certificate file path
+ * @return The notAfter time of the certificate
+ * @exception IOException if the file cannot be read or is not a certificate
+ */
+time_t Ssl_getCertificateFileExpiry(const char *file);
+
+
 /**
  * Print SSL options string representation to the given buffer.
  * @param options SSL options object
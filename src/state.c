@@ -52,6 +52,7 @@
 
 #include "monit.h"
 #include "state.h"
+#include "probe.h"
 
 // libmonit
 #include "exceptions/IOException.h"
@@ -83,9 +84,30 @@
  *
  *    5.) size, checksum, timestamp, permissions, link speed for the change observation test
  *
+ *    6.) file fingerprint (inode, size, modification and change time) of the last checksum computation
+ *        Allows to skip the checksum computation on Monit restart, if the file didn't change.
+ *
  * Data is stored in binary form in the statefile using the following format:
  *    <MAGIC><VERSION>{<SERVICE_STATE>}+
  *
+ * The state of all services is written to the temporary file, synced and
+ * renamed to the statefile (checkpoint), so the crash during the save cannot
+ * destroy the previous state. The state of the services which changed since
+ * the last save is appended to the statefile without sync (journal), the
+ * service record read later supersedes the previous one on restore. The
+ * journal is compacted by the checkpoint when the statefile grows to twice the
+ * size of the service list and on Monit stop and reload.
+ *
+ * The recent metrics of the services (the I/O counters with their rate
+ * history and the time series) are saved with the checkpoint to the metrics
+ * file next to the statefile (<statefile>.metrics) and restored on Monit
+ * reload or restart within the same boot session, so the rates are available
+ * in the first cycle. The metrics file has a header followed by fixed-size
+ * service records:
+ *    <MAGIC><VERSION><RECORD SIZE><BOOT TIME>{<SERVICE_METRICS>}*
+ * The record size changes with the structure layout, the file is ignored if
+ * it doesn't match.
+ *
  * When the persistent field needs to be added, update the State_Version along
  * with State_restore() and State_save(). The version allows to recognize the
  * service state structure and file format.
@@ -107,10 +129,62 @@ typedef enum {
         StateVersion2,
         StateVersion3,
         StateVersion4,
-        StateVersionLatest = StateVersion4
+        StateVersion5,
+        StateVersionLatest = StateVersion5
 } State_Version;
 
 
+/* Extended format version 5 */
+typedef struct mystate5 {
+        char               name[STRLEN];
+        int32_t            type;
+        int32_t            monitor;
+        int32_t            nstart;
+        int32_t            ncycle;
+        union {
+                struct {
+                        unsigned long long atime;
+                        unsigned long long ctime;
+                        unsigned long long mtime;
+                        int32_t mode;
+                } directory;
+
+                struct {
+                        unsigned long long inode;
+                        unsigned long long readpos;
+                        unsigned long long size;
+                        unsigned long long atime;
+                        unsigned long long ctime;
+                        unsigned long long mtime;
+                        int32_t mode;
+                        MD_T hash;
+                        struct {
+                                unsigned long long inode;
+                                unsigned long long size;
+                                unsigned long long mtime;
+                                unsigned long long ctime;
+                        } fingerprint;
+                } file;
+
+                struct {
+                        unsigned long long atime;
+                        unsigned long long ctime;
+                        unsigned long long mtime;
+                        int32_t mode;
+                } fifo;
+
+                struct {
+                        int32_t mode;
+                } filesystem;
+
+                struct {
+                        int32_t duplex;
+                        long long speed;
+                } net;
+        } priv;
+} State5_T;
+
+
 /* Extended format version 4 */
 typedef struct mystate4 {
         char               name[STRLEN];
@@ -217,6 +291,25 @@ typedef struct mystate1 {
 } State1_T;
 
 
+/* Metrics file format */
+#define METRICS_MAGIC      0x4d4d4554 // "MMET"
+#define METRICS_VERSION    1
+#define METRICS_STATISTICS 11 // Maximum number of statistics per service
+
+
+typedef struct mymetrics {
+        char               name[STRLEN];
+        int32_t            type;
+        int32_t            statistics;                  /**< Number of statistics */
+        struct Statistics_T statistic[METRICS_STATISTICS];
+        struct {
+                int32_t    count;
+                int64_t    time[SERIES_CAPACITY];
+                float      value[Series_Last][SERIES_CAPACITY];
+        } series;
+} Metrics_T;
+
+
 /* Format version 0 (Monit <= 5.3) */
 typedef struct mystate0 {
         char     name[STRLEN];
@@ -231,6 +324,7 @@ typedef struct mystate0 {
 static int file = -1;
 static unsigned long long booted = 0ULL;
 static bool _stateDirty = false;
+static int _records = 0; // Number of the service records in the state file (checkpoint and journal)
 
 
 /* ----------------------------------------------------------------- Private */
@@ -308,7 +402,16 @@ static void _updateSize(Service_T S, long long size) {
 static void _updateChecksum(Service_T S, char *hash) {
         if (S->checksum && S->checksum->test_changes) {
                 S->checksum->initialized = false;
-                strncpy(S->checksum->hash, hash, sizeof(S->checksum->hash) - 1);
+                snprintf(S->checksum->hash, sizeof(S->checksum->hash), "%s", hash);
+        }
+}
+
+
+static void _updateChecksumFingerprint(Service_T S, char *hash, unsigned long long inode, unsigned long long size, unsigned long long mtime, unsigned long long ctime) {
+        // The hash length differs if the checksum type was changed in the configuration
+        if (S->checksum && *hash && inode && strlen(hash) == strlen(S->checksum->hash)) {
+                snprintf(S->inf.file->cs_sum, sizeof(S->inf.file->cs_sum), "%s", hash);
+                S->inf.file->cs_fingerprint = (Fingerprint_T){.inode = inode, .size = size, .mtime = mtime, .ctime = ctime};
         }
 }
 
@@ -321,6 +424,61 @@ static void _updateLinkSpeed(Service_T S, int32_t duplex, long long speed) {
 }
 
 
+static void _restoreV5(void) {
+        // System header
+        if (read(file, &booted, sizeof(booted)) != sizeof(booted)) {
+                THROW(IOException, "Unable to read system boot time");
+        }
+        // Services state
+        State5_T state;
+        ssize_t n;
+        while ((n = read(file, &state, sizeof(state))) == sizeof(state)) {
+                _records++;
+                Service_T service = Util_getService(state.name);
+                if (service && service->type == state.type) {
+                        _updateStart(service, state.nstart, state.ncycle);
+                        _updateMonitor(service, state.monitor);
+                        switch (service->type) {
+                                case Service_Directory:
+                                        _updatePermission(service, state.priv.directory.mode);
+                                        _updateTimestamp(service, state.priv.directory.atime, state.priv.directory.ctime, state.priv.directory.mtime);
+                                        break;
+
+                                case Service_Fifo:
+                                        _updatePermission(service, state.priv.fifo.mode);
+                                        _updateTimestamp(service, state.priv.fifo.atime, state.priv.fifo.ctime, state.priv.fifo.mtime);
+                                        break;
+
+                                case Service_File:
+                                        _updatePermission(service, state.priv.file.mode);
+                                        _updateTimestamp(service, state.priv.file.atime, state.priv.file.ctime, state.priv.file.mtime);
+                                        _updateFilePosition(service, state.priv.file.inode, state.priv.file.readpos);
+                                        _updateSize(service, state.priv.file.size);
+                                        _updateChecksum(service, state.priv.file.hash);
+                                        _updateChecksumFingerprint(service, state.priv.file.hash, state.priv.file.fingerprint.inode, state.priv.file.fingerprint.size, state.priv.file.fingerprint.mtime, state.priv.file.fingerprint.ctime);
+                                        break;
+
+                                case Service_Filesystem:
+                                        _updatePermission(service, state.priv.filesystem.mode);
+                                        break;
+
+                                case Service_Net:
+                                        _updateLinkSpeed(service, state.priv.net.duplex, state.priv.net.speed);
+                                        break;
+
+                                default:
+                                        break;
+                        }
+                }
+        }
+        if (n > 0) {
+                // The journal append was interrupted, the next journal record would follow the torn record and be misaligned => write the checkpoint on the next save
+                DEBUG("State file '%s': ignoring the incomplete record at the end of the file\n", Run.files.state);
+                _stateDirty = true;
+        }
+}
+
+
 static void _restoreV4(void) {
         // System header
         if (read(file, &booted, sizeof(booted)) != sizeof(booted)) {
@@ -488,6 +646,324 @@ static void _restoreV0(int services) {
 }
 
 
+static void _fillState(Service_T service, State5_T *state) {
+        memset(state, 0, sizeof(*state));
+        snprintf(state->name, sizeof(state->name), "%s", service->name);
+        state->type = service->type;
+        state->monitor = service->monitor & ~Monitor_Waiting;
+        state->nstart = service->nstart;
+        state->ncycle = service->ncycle;
+        switch (service->type) {
+                case Service_Directory:
+                        state->priv.directory.atime = (unsigned long long)service->inf.directory->timestamp.access;
+                        state->priv.directory.ctime = (unsigned long long)service->inf.directory->timestamp.change;
+                        state->priv.directory.mtime = (unsigned long long)service->inf.directory->timestamp.modify;
+                        state->priv.directory.mode = service->inf.directory->mode;
+                        break;
+
+                case Service_Fifo:
+                        state->priv.fifo.atime = (unsigned long long)service->inf.fifo->timestamp.access;
+                        state->priv.fifo.ctime = (unsigned long long)service->inf.fifo->timestamp.change;
+                        state->priv.fifo.mtime = (unsigned long long)service->inf.fifo->timestamp.modify;
+                        state->priv.fifo.mode = service->inf.fifo->mode;
+                        break;
+
+                case Service_File:
+                        state->priv.file.inode = service->inf.file->inode;
+                        state->priv.file.readpos = service->inf.file->readpos;
+                        state->priv.file.size = (long long)service->inf.file->size;
+                        state->priv.file.atime = (unsigned long long)service->inf.file->timestamp.access;
+                        state->priv.file.ctime = (unsigned long long)service->inf.file->timestamp.change;
+                        state->priv.file.mtime = (unsigned long long)service->inf.file->timestamp.modify;
+                        state->priv.file.mode = service->inf.file->mode;
+                        snprintf(state->priv.file.hash, sizeof(state->priv.file.hash), "%s", service->inf.file->cs_sum);
+                        state->priv.file.fingerprint.inode = service->inf.file->cs_fingerprint.inode;
+                        state->priv.file.fingerprint.size = service->inf.file->cs_fingerprint.size;
+                        state->priv.file.fingerprint.mtime = service->inf.file->cs_fingerprint.mtime;
+                        state->priv.file.fingerprint.ctime = service->inf.file->cs_fingerprint.ctime;
+                        break;
+
+                case Service_Filesystem:
+                        state->priv.filesystem.mode = service->inf.filesystem->mode;
+                        break;
+
+                case Service_Net:
+                        if (service->linkspeedlist) {
+                                state->priv.net.duplex = service->linkspeedlist->duplex;
+                                state->priv.net.speed = service->linkspeedlist->speed;
+                        }
+                        break;
+
+                default:
+                        break;
+        }
+}
+
+
+static void _writeState(int fd, Service_T service) {
+        State5_T state;
+        _fillState(service, &state);
+        if (write(fd, &state, sizeof(state)) != sizeof(state))
+                THROW(IOException, "Unable to write service state");
+}
+
+
+static void _writeHeader(int fd) {
+        int32_t magic = 0;
+        if (write(fd, &magic, sizeof(magic)) != sizeof(magic))
+                THROW(IOException, "Unable to write magic");
+        // Save always using the latest format version
+        int32_t version = StateVersion5;
+        if (write(fd, &version, sizeof(version)) != sizeof(version))
+                THROW(IOException, "Unable to write format version");
+        if (write(fd, &systeminfo.booted, sizeof(systeminfo.booted)) != sizeof(systeminfo.booted))
+                THROW(IOException, "Unable to write system boot time");
+}
+
+
+/**
+ * Get the persistent statistics of the service
+ * @return The number of statistics
+ */
+static int _getStatistics(Service_T service, Statistics_T statistic[METRICS_STATISTICS]) {
+        int count = 0;
+        switch (service->type) {
+                case Service_Process:
+                        statistic[count++] = &(service->inf.process->read.operations);
+                        statistic[count++] = &(service->inf.process->read.bytes);
+                        statistic[count++] = &(service->inf.process->read.bytesPhysical);
+                        statistic[count++] = &(service->inf.process->write.operations);
+                        statistic[count++] = &(service->inf.process->write.bytes);
+                        statistic[count++] = &(service->inf.process->write.bytesPhysical);
+                        break;
+
+                case Service_Filesystem:
+                        statistic[count++] = &(service->inf.filesystem->read.operations);
+                        statistic[count++] = &(service->inf.filesystem->read.bytes);
+                        statistic[count++] = &(service->inf.filesystem->read.bytesPhysical);
+                        statistic[count++] = &(service->inf.filesystem->write.operations);
+                        statistic[count++] = &(service->inf.filesystem->write.bytes);
+                        statistic[count++] = &(service->inf.filesystem->write.bytesPhysical);
+                        statistic[count++] = &(service->inf.filesystem->time.read);
+                        statistic[count++] = &(service->inf.filesystem->time.write);
+                        statistic[count++] = &(service->inf.filesystem->time.wait);
+                        statistic[count++] = &(service->inf.filesystem->time.run);
+                        statistic[count++] = &(service->inf.filesystem->time.io);
+                        break;
+
+                default:
+                        break;
+        }
+        return count;
+}
+
+
+static void _writeMetrics(int fd) {
+        int32_t header[3] = {METRICS_MAGIC, METRICS_VERSION, sizeof(Metrics_T)};
+        if (write(fd, header, sizeof(header)) != sizeof(header) || write(fd, &systeminfo.booted, sizeof(systeminfo.booted)) != sizeof(systeminfo.booted))
+                THROW(IOException, "Unable to write metrics header");
+        Metrics_T *metrics = CALLOC(1, sizeof(Metrics_T));
+        TRY
+        {
+                for (Service_T service = servicelist; service; service = service->next) {
+                        Statistics_T statistic[METRICS_STATISTICS];
+                        int count = _getStatistics(service, statistic);
+                        if (! count && ! service->series)
+                                continue;
+                        memset(metrics, 0, sizeof(Metrics_T));
+                        snprintf(metrics->name, sizeof(metrics->name), "%s", service->name);
+                        metrics->type = service->type;
+                        metrics->statistics = count;
+                        for (int i = 0; i < count; i++)
+                                metrics->statistic[i] = *statistic[i];
+                        if (service->series) {
+                                metrics->series.count = Series_getCount(service->series);
+                                for (int i = 0; i < metrics->series.count; i++) {
+                                        metrics->series.time[i] = Series_getTime(service->series, i);
+                                        for (Series_Metric m = 0; m < Series_Last; m++)
+                                                metrics->series.value[m][i] = Series_getValue(service->series, m, i);
+                                }
+                        }
+                        if (write(fd, metrics, sizeof(Metrics_T)) != sizeof(Metrics_T))
+                                THROW(IOException, "Unable to write service metrics");
+                }
+        }
+        FINALLY
+        {
+                FREE(metrics);
+        }
+        END_TRY;
+}
+
+
+/**
+ * Save the metrics of all services to the temporary file and replace the
+ * metrics file with it
+ */
+static void _saveMetrics(void) {
+        char path[PATH_MAX], tmp[PATH_MAX];
+        snprintf(path, sizeof(path), "%s.metrics", Run.files.state);
+        snprintf(tmp, sizeof(tmp), "%s.metrics.tmp", Run.files.state);
+        volatile int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd == -1) {
+                // The metrics are optional, the state is saved in place if the directory is not writable
+                DEBUG("State file '%s': cannot create metrics file -- %s\n", Run.files.state, STRERROR);
+                return;
+        }
+        TRY
+        {
+                _writeMetrics(fd);
+                if (close(fd) == -1)
+                        THROW(IOException, "Unable to close metrics file -- %s", STRERROR);
+                fd = -1;
+                if (rename(tmp, path) == -1)
+                        THROW(IOException, "Unable to rename '%s' -- %s", tmp, STRERROR);
+        }
+        ELSE
+        {
+                if (fd != -1)
+                        close(fd);
+                unlink(tmp);
+                RETHROW;
+        }
+        END_TRY;
+}
+
+
+static void _restoreMetricsRecord(Metrics_T *metrics) {
+        Service_T service = Util_getService(metrics->name);
+        if (! service || service->type != metrics->type)
+                return;
+        Statistics_T statistic[METRICS_STATISTICS];
+        if (_getStatistics(service, statistic) == metrics->statistics)
+                for (int i = 0; i < metrics->statistics; i++)
+                        *statistic[i] = metrics->statistic[i];
+        // The series of the service, which was not changed by reload, was carried over already
+        int count = MIN(MAX(metrics->series.count, 0), SERIES_CAPACITY);
+        if (count > 0 && ! service->series) {
+                service->series = Series_new();
+                for (int i = 0; i < count; i++) {
+                        double values[Series_Last];
+                        for (Series_Metric m = 0; m < Series_Last; m++)
+                                values[m] = metrics->series.value[m][i];
+                        Series_add(service->series, (time_t)metrics->series.time[i], values);
+                }
+        }
+}
+
+
+/**
+ * Restore the metrics saved in the same boot session, the counters are not
+ * comparable after reboot
+ */
+static void _restoreMetrics(void) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s.metrics", Run.files.state);
+        int fd = open(path, O_RDONLY);
+        if (fd == -1)
+                return;
+        Metrics_T *metrics = CALLOC(1, sizeof(Metrics_T));
+        TRY
+        {
+                int32_t header[3];
+                unsigned long long metricsBooted;
+                if (read(fd, header, sizeof(header)) != sizeof(header) || read(fd, &metricsBooted, sizeof(metricsBooted)) != sizeof(metricsBooted))
+                        THROW(IOException, "Unable to read metrics header");
+                if (header[0] != METRICS_MAGIC || header[1] != METRICS_VERSION || header[2] != sizeof(Metrics_T)) {
+                        DEBUG("State file '%s': incompatible metrics file, ignored\n", Run.files.state);
+                } else if (metricsBooted == systeminfo.booted) {
+                        while (read(fd, metrics, sizeof(Metrics_T)) == sizeof(Metrics_T)) {
+                                metrics->name[sizeof(metrics->name) - 1] = 0;
+                                metrics->statistics = MIN(MAX(metrics->statistics, 0), METRICS_STATISTICS);
+                                _restoreMetricsRecord(metrics);
+                        }
+                }
+        }
+        ELSE
+        {
+                Log_error("State file '%s': %s\n", Run.files.state, Exception_frame.message);
+        }
+        FINALLY
+        {
+                FREE(metrics);
+                close(fd);
+        }
+        END_TRY;
+}
+
+
+/**
+ * Write the state of all services to the temporary file and replace the state
+ * file with it, the previous state file is kept intact if the write fails. If
+ * the temporary file cannot be created (the directory is not writable), the
+ * state file is rewritten in place
+ */
+static void _checkpoint(void) {
+        volatile int records = 0;
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s.tmp", Run.files.state);
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd == -1) {
+                DEBUG("State file '%s': cannot create temporary file -- %s, rewriting in place\n", Run.files.state, STRERROR);
+                if (ftruncate(file, 0L) == -1)
+                        THROW(IOException, "Unable to truncate");
+                if (lseek(file, 0L, SEEK_SET) == -1)
+                        THROW(IOException, "Unable to seek");
+                _writeHeader(file);
+                for (Service_T service = servicelist; service; service = service->next, records++) {
+                        service->stateDirty = false;
+                        _writeState(file, service);
+                }
+                if (fsync(file))
+                        THROW(IOException, "Unable to sync -- %s", STRERROR);
+        } else {
+                TRY
+                {
+                        _writeHeader(fd);
+                        for (Service_T service = servicelist; service; service = service->next, records++) {
+                                service->stateDirty = false;
+                                _writeState(fd, service);
+                        }
+                        if (fsync(fd))
+                                THROW(IOException, "Unable to sync -- %s", STRERROR);
+                        if (rename(path, Run.files.state) == -1)
+                                THROW(IOException, "Unable to rename '%s' -- %s", path, STRERROR);
+                }
+                ELSE
+                {
+                        close(fd);
+                        unlink(path);
+                        RETHROW;
+                }
+                END_TRY;
+                close(file);
+                file = fd;
+        }
+        _records = records;
+        _stateDirty = false;
+}
+
+
+/**
+ * Append the state of the changed services. The restore applies the records in
+ * order, so the appended record supersedes the service record of the last
+ * checkpoint. The journal is not synced, a torn record at the end of the file
+ * is ignored by the restore, which then requests the checkpoint, so no record
+ * is appended after the torn one
+ */
+static void _journal(void) {
+        if (lseek(file, 0L, SEEK_END) == -1)
+                THROW(IOException, "Unable to seek");
+        for (Service_T service = servicelist; service; service = service->next) {
+                if (service->stateDirty) {
+                        service->stateDirty = false;
+                        _writeState(file, service);
+                        _records++;
+                }
+        }
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -513,104 +989,53 @@ void State_close() {
 
 
 void State_save() {
+        PROBE0(state__save__start);
         TRY
         {
-                if (ftruncate(file, 0L) == -1) {
-                        THROW(IOException, "Unable to truncate");
-                }
-                if (lseek(file, 0L, SEEK_SET) == -1) {
-                        THROW(IOException, "Unable to seek");
-                }
-                int32_t magic = 0;
-                if (write(file, &magic, sizeof(magic)) != sizeof(magic)) {
-                        THROW(IOException, "Unable to write magic");
-                }
-                // Save always using the latest format version
-                int32_t version = StateVersion4;
-                if (write(file, &version, sizeof(version)) != sizeof(version)) {
-                        THROW(IOException, "Unable to write format version");
-                }
-                if (write(file, &systeminfo.booted, sizeof(systeminfo.booted)) != sizeof(systeminfo.booted)) {
-                        THROW(IOException, "Unable to write system boot time");
-                }
-                for (Service_T service = servicelist; service; service = service->next) {
-                        State4_T state;
-                        memset(&state, 0, sizeof(state));
-                        snprintf(state.name, sizeof(state.name), "%s", service->name);
-                        state.type = service->type;
-                        state.monitor = service->monitor & ~Monitor_Waiting;
-                        state.nstart = service->nstart;
-                        state.ncycle = service->ncycle;
-                        switch (service->type) {
-                                case Service_Directory:
-                                        state.priv.directory.atime = (unsigned long long)service->inf.directory->timestamp.access;
-                                        state.priv.directory.ctime = (unsigned long long)service->inf.directory->timestamp.change;
-                                        state.priv.directory.mtime = (unsigned long long)service->inf.directory->timestamp.modify;
-                                        state.priv.directory.mode = service->inf.directory->mode;
-                                        break;
-
-                                case Service_Fifo:
-                                        state.priv.fifo.atime = (unsigned long long)service->inf.fifo->timestamp.access;
-                                        state.priv.fifo.ctime = (unsigned long long)service->inf.fifo->timestamp.change;
-                                        state.priv.fifo.mtime = (unsigned long long)service->inf.fifo->timestamp.modify;
-                                        state.priv.fifo.mode = service->inf.fifo->mode;
-                                        break;
-
-                                case Service_File:
-                                        state.priv.file.inode = service->inf.file->inode;
-                                        state.priv.file.readpos = service->inf.file->readpos;
-                                        state.priv.file.size = (long long)service->inf.file->size;
-                                        state.priv.file.atime = (unsigned long long)service->inf.file->timestamp.access;
-                                        state.priv.file.ctime = (unsigned long long)service->inf.file->timestamp.change;
-                                        state.priv.file.mtime = (unsigned long long)service->inf.file->timestamp.modify;
-                                        state.priv.file.mode = service->inf.file->mode;
-                                        snprintf(state.priv.file.hash, sizeof(state.priv.file.hash), "%s", service->inf.file->cs_sum);
-                                        break;
-
-                                case Service_Filesystem:
-                                        state.priv.filesystem.mode = service->inf.filesystem->mode;
-                                        break;
-
-                                case Service_Net:
-                                        if (service->linkspeedlist) {
-                                                state.priv.net.duplex = service->linkspeedlist->duplex;
-                                                state.priv.net.speed = service->linkspeedlist->speed;
-                                        }
-                                        break;
-
-                                default:
-                                        break;
-                        }
-                        if (write(file, &state, sizeof(state)) != sizeof(state)) {
-                                THROW(IOException, "Unable to write service state");
-                        }
-                }
-                if (fsync(file)) {
-                        THROW(IOException, "Unable to sync -- %s", STRERROR);
-                }
-                _stateDirty = false;
+                _checkpoint();
+                _saveMetrics();
         }
         ELSE
         {
                 Log_error("State file '%s': %s\n", Run.files.state, Exception_frame.message);
         }
         END_TRY;
+        PROBE0(state__save__done);
 }
 
 
-void State_dirty() {
-        _stateDirty = true;
+void State_dirty(Service_T S) {
+        if (S)
+                S->stateDirty = true;
+        else
+                _stateDirty = true;
 }
 
 
 void State_saveIfDirty() {
-        if (_stateDirty) {
+        int services = 0, dirty = 0;
+        for (Service_T service = servicelist; service; service = service->next, services++)
+                if (service->stateDirty)
+                        dirty++;
+        if (_stateDirty || _records + dirty > 2 * services) {
+                // Compact the journal when the state file grows to twice the size of the service list
                 State_save();
+        } else if (dirty) {
+                TRY
+                {
+                        _journal();
+                }
+                ELSE
+                {
+                        Log_error("State file '%s': %s\n", Run.files.state, Exception_frame.message);
+                }
+                END_TRY;
         }
 }
 
 
 void State_restore() {
+        _records = 0;
         /* Ignore empty state file */
         if ((lseek(file, 0L, SEEK_END) == 0)) {
                 return;
@@ -646,6 +1071,9 @@ void State_restore() {
                                 case StateVersion4:
                                         _restoreV4();
                                         break;
+                                case StateVersion5:
+                                        _restoreV5();
+                                        break;
                                 default:
                                         Log_warning("State file '%s': incompatible version %d\n", Run.files.state, version);
                                         break;
@@ -660,6 +1088,7 @@ void State_restore() {
                 Log_error("State file '%s': %s\n", Run.files.state, Exception_frame.message);
         }
         END_TRY;
+        _restoreMetrics();
 }
 
 
@@ -56,19 +56,22 @@ void State_close(void);
 
 
 /**
- * Mark the state file as dirty
+ * Mark the service state as dirty, the state is appended to the state file
+ * journal by the next State_saveIfDirty() call
+ * @param S The service which persistent state changed or NULL to write
+ * the state of all services
  */
-void State_dirty(void);
+void State_dirty(Service_T S);
 
 
 /**
- * Save the state if dirty
+ * Save the state of the dirty services
  */
 void State_saveIfDirty(void);
 
 
 /**
- * Save the state file
+ * Save the state of all services to the state file
  */
 void State_save(void);
 
@@ -25,6 +25,14 @@
 
 #include "config.h"
 
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_MATH_H
+#include <math.h>
+#endif
+
 #include "monit.h"
 
 
@@ -43,6 +51,32 @@
 #define T Statistics_T
 
 
+// The time constants of the moving averages [s]
+static const double _periods[] = {60., 300., 900.};
+
+
+/* --------------------------------------------------------------- Private */
+
+
+// Add the normalized delta of the last update to the averages and to the window
+static void _updateRate(T S) {
+        if (S->last.time > 0 && S->current.time > S->last.time) {
+                double rate = Statistics_deltaNormalize(S);
+                double elapsed = (double)(S->current.time - S->last.time) / 1000.;
+                for (int i = 0; i < 3; i++) {
+                        if (S->window.count == 0)
+                                S->average[i] = rate;
+                        else
+                                S->average[i] += (1. - exp(-elapsed / _periods[i])) * (rate - S->average[i]);
+                }
+                S->window.rate[S->window.cursor] = (float)rate;
+                S->window.cursor = (S->window.cursor + 1) % STATISTICS_WINDOW;
+                if (S->window.count < STATISTICS_WINDOW)
+                        S->window.count++;
+        }
+}
+
+
 /* ---------------------------------------------------------------- Public */
 
 
@@ -60,6 +94,7 @@ void Statistics_update(T S, unsigned long long time, unsigned long long value) {
         S->current.time = time;
         S->current.value = _value;
         S->initialized = true;
+        _updateRate(S);
 }
 
 
@@ -68,6 +103,8 @@ void Statistics_reset(T S) {
         S->raw = 0ULL;
 #endif
         S->last.time = S->current.time = S->last.value = S->current.value = 0ULL;
+        memset(S->average, 0, sizeof(S->average));
+        memset(&S->window, 0, sizeof(S->window));
         S->initialized = false;
 }
 
@@ -96,3 +133,62 @@ double Statistics_deltaNormalize(T S) {
         return 0.;
 }
 
+
+double Statistics_average(T S, Statistics_Function function) {
+        ASSERT(function >= Statistics_Average1 && function <= Statistics_Average15);
+        return S->average[function - Statistics_Average1];
+}
+
+
+double Statistics_minimum(T S) {
+        double minimum = 0.;
+        for (int i = 0; i < S->window.count; i++)
+                if (i == 0 || S->window.rate[i] < minimum)
+                        minimum = S->window.rate[i];
+        return minimum;
+}
+
+
+double Statistics_maximum(T S) {
+        double maximum = 0.;
+        for (int i = 0; i < S->window.count; i++)
+                if (S->window.rate[i] > maximum)
+                        maximum = S->window.rate[i];
+        return maximum;
+}
+
+
+double Statistics_percentile(T S, double percentile) {
+        if (S->window.count == 0)
+                return 0.;
+        // Insertion sort of the copy, the window is small
+        float sorted[STATISTICS_WINDOW];
+        for (int i = 0; i < S->window.count; i++) {
+                int j = i;
+                for (; j > 0 && sorted[j - 1] > S->window.rate[i]; j--)
+                        sorted[j] = sorted[j - 1];
+                sorted[j] = S->window.rate[i];
+        }
+        // Nearest rank: the value of the sample at the percentile position
+        int rank = (int)ceil(percentile * S->window.count / 100.);
+        return sorted[MIN(MAX(rank, 1), S->window.count) - 1];
+}
+
+
+double Statistics_rate(T S, Statistics_Function function, double percentile) {
+        switch (function) {
+                case Statistics_Average1:
+                case Statistics_Average5:
+                case Statistics_Average15:
+                        return Statistics_average(S, function);
+                case Statistics_Minimum:
+                        return Statistics_minimum(S);
+                case Statistics_Maximum:
+                        return Statistics_maximum(S);
+                case Statistics_Percentile:
+                        return Statistics_percentile(S, percentile);
+                default:
+                        return Statistics_deltaNormalize(S);
+        }
+}
+
@@ -39,6 +39,34 @@
 #define T Statistics_T
 
 
+#define STATISTICS_WINDOW 32
+
+
+/**
+ * The rate functions. The averages are exponentially weighted moving
+ * averages of the rate, the minimum, maximum and percentile are taken
+ * from the rates of the last STATISTICS_WINDOW updates
+ */
+typedef enum {
+        Statistics_Current = 0,       /**< The rate between the last two updates */
+        Statistics_Average1,                         /**< 1 minute moving average */
+        Statistics_Average5,                         /**< 5 minute moving average */
+        Statistics_Average15,                       /**< 15 minute moving average */
+        Statistics_Minimum,                             /**< Minimum in the window */
+        Statistics_Maximum,                             /**< Maximum in the window */
+        Statistics_Percentile                        /**< Percentile of the window */
+} __attribute__((__packed__)) Statistics_Function;
+
+
+/**
+ * The rate function of a test with its parameter
+ */
+typedef struct Statistics_Rate_T {
+        Statistics_Function function;
+        double percentile;           /**< The percentile for Statistics_Percentile */
+} Statistics_Rate_T;
+
+
 typedef struct T {
         bool initialized;
 #ifndef __LP64__
@@ -52,6 +80,12 @@ typedef struct T {
                 unsigned long long time;
                 unsigned long long value;
         } current;
+        double average[3];                    /**< 1, 5 and 15 minute rate averages */
+        struct {
+                int count;                                    /**< Number of rates */
+                int cursor;                       /**< Position of the next rate */
+                float rate[STATISTICS_WINDOW];               /**< The recent rates */
+        } window;
 } *T;
 
 
@@ -104,5 +138,51 @@ unsigned long long Statistics_delta(T S);
 double Statistics_deltaNormalize(T S);
 
 
+/**
+ * Return the exponentially weighted moving average of the normalized delta
+ * @param S A Statistics object
+ * @param function Statistics_Average1, Statistics_Average5 or
+ * Statistics_Average15
+ * @return average [value per second]
+ */
+double Statistics_average(T S, Statistics_Function function);
+
+
+/**
+ * Return the minimum normalized delta of the last STATISTICS_WINDOW updates
+ * @param S A Statistics object
+ * @return minimum [value per second]
+ */
+double Statistics_minimum(T S);
+
+
+/**
+ * Return the maximum normalized delta of the last STATISTICS_WINDOW updates
+ * @param S A Statistics object
+ * @return maximum [value per second]
+ */
+double Statistics_maximum(T S);
+
+
+/**
+ * Return the percentile of the normalized deltas of the last
+ * STATISTICS_WINDOW updates
+ * @param S A Statistics object
+ * @param percentile The percentile, e.g. 95 for p95
+ * @return percentile [value per second]
+ */
+double Statistics_percentile(T S, double percentile);
+
+
+/**
+ * Return the normalized delta computed by the given function
+ * @param S A Statistics object
+ * @param function The rate function
+ * @param percentile The percentile for Statistics_Percentile
+ * @return rate [value per second]
+ */
+double Statistics_rate(T S, Statistics_Function function, double percentile);
+
+
 #undef T
 #endif
@@ -29,6 +29,10 @@
 #include <stdlib.h>
 #endif
 
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
 #include "monit.h"
 #include "Color.h"
 #include "Box.h"
@@ -41,6 +45,12 @@
  * Implementation of the Terminal table interface using UTF-8 box:
  * http://www.unicode.org/charts/PDF/U2500.pdf
  *
+ * The row is rendered in one pass: the borders and the padding are
+ * appended as byte runs prepared when the table is created, only the
+ * column values are copied. In the plain mode the table is rendered
+ * without the colors and the box drawing characters, the same as the
+ * Box_strip() and Color_strip() of the full table output.
+ *
  * @author http://www.tildeslash.com/
  * @see http://www.mmonit.com/
  * @file
@@ -74,59 +84,93 @@ struct T {
                         bool enabled;
                         const char *color;
                 } header;
+                bool plain;
         } options;
         unsigned int columnsCount;
         BoxColumn_T *columns;
         StringBuffer_T b;
+        char *horizontal;                      // BOX_HORIZONTAL run of the widest column
+        char *spaces;                                 // Padding of the widest column
 };
 
 
+#define BOX_HORIZONTAL_LENGTH (sizeof(BOX_HORIZONTAL) - 1)
+#define _appendString(t, s) StringBuffer_appendBytes((t)->b, (s), sizeof(s) - 1)
+
+
 /* ------------------------------------------------------- Private Methods */
 
 
-static void _printBorderTop(T t) {
-        StringBuffer_append(t->b, COLOR_DARKGRAY BOX_DOWN_RIGHT BOX_HORIZONTAL);
+static void _printBorder(T t, const char *left, const char *middle, const char *right) {
+        StringBuffer_append(t->b, "%s%s", COLOR_DARKGRAY, left);
         for (unsigned int i = 0; i < t->columnsCount; i++) {
-                for (int j = 0; j < t->columns[i].width; j++)
-                        StringBuffer_append(t->b, BOX_HORIZONTAL);
+                StringBuffer_appendBytes(t->b, t->horizontal, (int)((t->columns[i].width + 2) * BOX_HORIZONTAL_LENGTH));
                 if (i < t->columnsCount - 1)
-                        StringBuffer_append(t->b, BOX_HORIZONTAL BOX_HORIZONTAL_DOWN BOX_HORIZONTAL);
+                        StringBuffer_appendBytes(t->b, middle, (int)strlen(middle));
         }
-        StringBuffer_append(t->b, BOX_HORIZONTAL BOX_DOWN_LEFT COLOR_RESET "\n");
+        StringBuffer_append(t->b, "%s" COLOR_RESET "\n", right);
+}
+
+
+static void _printBorderTop(T t) {
+        if (! t->options.plain)
+                _printBorder(t, BOX_DOWN_RIGHT, BOX_HORIZONTAL_DOWN, BOX_DOWN_LEFT);
 }
 
 
 static void _printBorderMiddle(T t) {
-        StringBuffer_append(t->b, COLOR_DARKGRAY BOX_VERTICAL_RIGHT BOX_HORIZONTAL);
-        for (unsigned int i = 0; i < t->columnsCount; i++) {
-                for (int j = 0; j < t->columns[i].width; j++)
-                        StringBuffer_append(t->b, BOX_HORIZONTAL);
-                if (i < t->columnsCount - 1)
-                        StringBuffer_append(t->b, BOX_HORIZONTAL BOX_VERTICAL_HORIZONTAL BOX_HORIZONTAL);
-        }
-        StringBuffer_append(t->b, BOX_HORIZONTAL BOX_VERTICAL_LEFT COLOR_RESET "\n");
+        if (! t->options.plain)
+                _printBorder(t, BOX_VERTICAL_RIGHT, BOX_VERTICAL_HORIZONTAL, BOX_VERTICAL_LEFT);
 }
 
 
 static void _printBorderBottom(T t) {
-        StringBuffer_append(t->b, COLOR_DARKGRAY BOX_UP_RIGHT BOX_HORIZONTAL);
-        for (unsigned int i = 0; i < t->columnsCount; i++) {
-                for (int j = 0; j < t->columns[i].width; j++)
-                        StringBuffer_append(t->b, BOX_HORIZONTAL);
-                if (i < t->columnsCount - 1)
-                        StringBuffer_append(t->b, BOX_HORIZONTAL BOX_UP_HORIZONTAL BOX_HORIZONTAL);
-        }
-        StringBuffer_append(t->b, BOX_HORIZONTAL BOX_UP_LEFT COLOR_RESET "\n");
+        if (! t->options.plain)
+                _printBorder(t, BOX_UP_RIGHT, BOX_UP_HORIZONTAL, BOX_UP_LEFT);
+}
+
+
+static void _printSeparator(T t) {
+        if (t->options.plain)
+                _appendString(t, " ");
+        else
+                _appendString(t, COLOR_DARKGRAY BOX_VERTICAL COLOR_RESET " ");
+}
+
+
+static void _printEnd(T t) {
+        if (t->options.plain)
+                _appendString(t, "\n");
+        else
+                _appendString(t, COLOR_DARKGRAY BOX_VERTICAL COLOR_RESET "\n");
+}
+
+
+/**
+ * Append the value aligned and padded to the column width
+ */
+static void _printValue(T t, int width, BoxAlign_T align, const char *value, int length) {
+        int padding = width > length ? width - length : 0;
+        if (align == BoxAlign_Right)
+                StringBuffer_appendBytes(t->b, t->spaces, padding);
+        StringBuffer_appendBytes(t->b, value, length);
+        if (align != BoxAlign_Right)
+                StringBuffer_appendBytes(t->b, t->spaces, padding);
 }
 
 
 static void _printHeader(T t) {
         for (unsigned int i = 0; i < t->columnsCount; i++) {
-                StringBuffer_append(t->b, COLOR_DARKGRAY BOX_VERTICAL COLOR_RESET " ");
-                StringBuffer_append(t->b, "%s%-*s%s", t->options.header.color, t->columns[i].width, t->columns[i].name, COLOR_RESET);
-                StringBuffer_append(t->b, " ");
+                _printSeparator(t);
+                if (! t->options.plain)
+                        StringBuffer_appendBytes(t->b, t->options.header.color, (int)strlen(t->options.header.color));
+                _printValue(t, t->columns[i].width, BoxAlign_Left, t->columns[i].name, (int)strlen(t->columns[i].name));
+                if (t->options.plain)
+                        _appendString(t, " ");
+                else
+                        _appendString(t, COLOR_RESET " ");
         }
-        StringBuffer_append(t->b, COLOR_DARKGRAY BOX_VERTICAL COLOR_RESET "\n");
+        _printEnd(t);
         t->index.row++;
 }
 
@@ -156,36 +200,38 @@ static void _cacheColor(BoxColumn_T *column) {
 static bool _printRow(T t) {
         bool repeat = false;
         for (unsigned int i = 0; i < t->columnsCount; i++) {
-                StringBuffer_append(t->b, COLOR_DARKGRAY BOX_VERTICAL COLOR_RESET " ");
-                if (*(t->columns[i]._color))
-                        StringBuffer_append(t->b, "%s", t->columns[i]._color);
-                if (! t->columns[i].value || t->columns[i]._cursor > strlen(t->columns[i].value) - 1) {
+                BoxColumn_T *column = &(t->columns[i]);
+                bool color = *(column->_color) && ! t->options.plain;
+                _printSeparator(t);
+                if (color)
+                        StringBuffer_appendBytes(t->b, column->_color, (int)strlen(column->_color));
+                if (! column->value || column->_cursor >= column->_valueLength) {
                         // Empty column padding
-                        StringBuffer_append(t->b, "%*s", t->columns[i].width, " ");
-                } else if (strlen(t->columns[i].value + t->columns[i]._cursor) > (unsigned long)t->columns[i].width) {
-                        if (t->columns[i].wrap) {
-                                // The value exceeds the column width and should be wrapped
-                                int column = 0;
-                                for (; t->columns[i].value[t->columns[i]._cursor] && (column == 0 || t->columns[i]._cursor % t->columns[i].width > 0); t->columns[i]._cursor++, column++)
-                                        StringBuffer_append(t->b, "%c", t->columns[i].value[t->columns[i]._cursor]);
-                                if (t->columns[i]._cursor < t->columns[i]._valueLength)
+                        _printValue(t, column->width, column->align, "", 0);
+                } else if (column->_valueLength - column->_cursor > (unsigned long)column->width) {
+                        if (column->wrap) {
+                                // The value exceeds the column width and should be wrapped, print the text up to the column boundary
+                                unsigned long length = column->width - column->_cursor % column->width;
+                                StringBuffer_appendBytes(t->b, column->value + column->_cursor, (int)length);
+                                column->_cursor += length;
+                                if (column->_cursor < column->_valueLength)
                                         repeat = true;
                         } else {
                                 // The value exceeds the column width and should be truncated
-                                Str_trunc(t->columns[i].value, t->columns[i].width);
-                                StringBuffer_append(t->b, t->columns[i].align == BoxAlign_Right ? "%*s" : "%-*s", t->columns[i].width, t->columns[i].value);
-                                t->columns[i]._cursor = t->columns[i]._valueLength;
+                                Str_trunc(column->value, column->width);
+                                _printValue(t, column->width, column->align, column->value, (int)strlen(column->value));
+                                column->_cursor = column->_valueLength;
                         }
                 } else {
                         // The whole value fits in the column width
-                        StringBuffer_append(t->b, t->columns[i].align == BoxAlign_Right ? "%*s" : "%-*s", t->columns[i].width, t->columns[i].value + t->columns[i]._cursor);
-                        t->columns[i]._cursor = t->columns[i]._valueLength;
+                        _printValue(t, column->width, column->align, column->value + column->_cursor, (int)(column->_valueLength - column->_cursor));
+                        column->_cursor = column->_valueLength;
                 }
-                StringBuffer_append(t->b, " ");
-                if (*(t->columns[i]._color))
-                        StringBuffer_append(t->b, COLOR_RESET);
+                _appendString(t, " ");
+                if (color)
+                        _appendString(t, COLOR_RESET);
         }
-        StringBuffer_append(t->b, COLOR_DARKGRAY BOX_VERTICAL COLOR_RESET "\n");
+        _printEnd(t);
         t->index.row++;
         return repeat;
 }
@@ -220,16 +266,34 @@ T Box_new(StringBuffer_T b, int columnsCount, BoxColumn_T *columns, bool printHe
         t->options.header.color = COLOR_BOLDCYAN; // Note: hardcoded, option setting can be implemented if needed
         // Options
         t->options.header.enabled = printHeader;
+        // The border and padding runs for the widest column
+        int width = 0;
+        for (int i = 0; i < columnsCount; i++)
+                width = MAX(width, MAX(columns[i].width, (int)strlen(columns[i].name)));
+        t->horizontal = ALLOC((width + 2) * BOX_HORIZONTAL_LENGTH);
+        for (int i = 0; i < width + 2; i++)
+                memcpy(t->horizontal + i * BOX_HORIZONTAL_LENGTH, BOX_HORIZONTAL, BOX_HORIZONTAL_LENGTH);
+        t->spaces = ALLOC(width + 1);
+        memset(t->spaces, ' ', width + 1);
         return t;
 }
 
 
+void Box_setPlain(T t, bool plain) {
+        ASSERT(t);
+        ASSERT(t->index.row == 0);
+        t->options.plain = plain;
+}
+
+
 void Box_free(T *t) {
         ASSERT(t && *t);
         if ((*t)->index.row > 0)
                 _printBorderBottom(*t);
         for (unsigned int i = 0; i < (*t)->columnsCount; i++)
                 FREE((*t)->columns[i].value);
+        FREE((*t)->horizontal);
+        FREE((*t)->spaces);
         FREE(*t);
 }
 
@@ -72,6 +72,16 @@ typedef struct T *T;
 T Box_new(StringBuffer_T b, int columnsCount, BoxColumn_T *columns, bool printHeader); //FIXME: when OutputStream is added, use it instead of StringBuffer
 
 
+/**
+ * Render the table without the colors and the box drawing characters. The
+ * output is the same as the Color_strip() and Box_strip() of the table,
+ * without the extra pass. Must be set before the first row is printed
+ * @param t The terminal table object
+ * @param plain true for the plain output
+ */
+void Box_setPlain(T t, bool plain);
+
+
 /**
  * Close and destroy a Box object and free allocated resources
  * @param t a Box object reference
@@ -56,6 +56,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_FNMATCH_H
+#include <fnmatch.h>
+#endif
+
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -113,6 +117,7 @@
 #include "md5.h"
 #include "md5_crypt.h"
 #include "sha1.h"
+#include "sha256.h"
 #include "base64.h"
 #include "alert.h"
 #include "ProcessTree.h"
@@ -120,6 +125,7 @@
 #include "state.h"
 #include "protocol.h"
 #include "checksum.h"
+#include "ServiceStatus.h"
 
 // libmonit
 #include "io/File.h"
@@ -213,6 +219,11 @@ static const unsigned char b2x[][256] = {
 };
 
 
+/* The name indexes of the services and service groups created by the parser, the services are indexed by the name atom */
+static HashMap_T _serviceIndex = NULL;
+static HashMap_T _serviceGroupIndex = NULL;
+
+
 /**
  *  General purpose utility methods.
  *
@@ -439,6 +450,16 @@ static Auth_T PAMcheckUserGroup(const char *uname) {
 #endif
 
 
+/* The qualification expressions returned by Util_getDoubleQExpression() */
+static bool _greater(double left, double right) { return left > right; }
+static bool _greaterOrEqual(double left, double right) { return left >= right; }
+static bool _less(double left, double right) { return left < right; }
+static bool _lessOrEqual(double left, double right) { return left <= right; }
+static bool _equal(double left, double right) { return left == right; }
+static bool _notEqual(double left, double right) { return left != right; }
+static bool _never(__attribute__ ((unused)) double left, __attribute__ ((unused)) double right) { return false; }
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -583,13 +604,118 @@ int Util_handle0Escapes(char *buf) {
 
 Service_T Util_getService(const char *name) {
         ASSERT(name);
+        // The service names are atoms, a string which is not an atom is no service name
+        const char *atom = Atom_find(name);
+        if (! atom)
+                return NULL;
+        if (_serviceIndex)
+                return HashMap_getInt(_serviceIndex, (intptr_t)atom);
+        // The services which weren't added by the parser are not indexed
         for (Service_T s = servicelist; s; s = s->next)
-                if (IS(s->name, name))
+                if (s->name == atom)
                         return s;
         return NULL;
 }
 
 
+ServiceGroup_T Util_getServiceGroup(const char *name) {
+        ASSERT(name);
+        if (_serviceGroupIndex)
+                return HashMap_get(_serviceGroupIndex, name);
+        for (ServiceGroup_T g = servicegrouplist; g; g = g->next)
+                if (IS(g->name, name))
+                        return g;
+        return NULL;
+}
+
+
+Select_Type Util_getSelectType(const char *selector) {
+        ASSERT(selector);
+        return strpbrk(selector, "*?[") ? Select_Pattern : Select_Service;
+}
+
+
+int Util_selectServices(List_T services, Select_Type type, const char *selector) {
+        ASSERT(services);
+        ASSERT(selector);
+        int count = 0;
+        if (type == Select_Group) {
+                ServiceGroup_T g = Util_getServiceGroup(selector);
+                if (g) {
+                        for (list_t m = g->members->head; m; m = m->next, count++)
+                                List_append(services, m->e);
+                }
+        } else if (type == Select_Pattern) {
+                for (Service_T s = servicelist; s; s = s->next) {
+                        if (fnmatch(selector, s->name, 0) == 0) {
+                                List_append(services, s);
+                                count++;
+                        }
+                }
+        } else {
+                Service_T s = Util_getService(selector);
+                if (s) {
+                        List_append(services, s);
+                        count++;
+                }
+        }
+        return count;
+}
+
+
+void Util_indexService(Service_T s) {
+        ASSERT(s);
+        ASSERT(s->name);
+        if (! _serviceIndex)
+                _serviceIndex = HashMap_new(HashMap_Integer, 0);
+        HashMap_putInt(_serviceIndex, (intptr_t)s->name, s);
+}
+
+
+void Util_indexServiceGroup(ServiceGroup_T g) {
+        ASSERT(g);
+        ASSERT(g->name);
+        if (! _serviceGroupIndex)
+                _serviceGroupIndex = HashMap_new(HashMap_String, 0);
+        HashMap_put(_serviceGroupIndex, g->name, g);
+}
+
+
+void Util_resetServiceIndex(void) {
+        if (_serviceIndex)
+                HashMap_free(&_serviceIndex);
+        if (_serviceGroupIndex)
+                HashMap_free(&_serviceGroupIndex);
+}
+
+
+char *Util_getUptime(time_t delta, char s[256]) {
+        static int min = 60;
+        static int hour = 3600;
+        static int day = 86400;
+        long rest_d;
+        long rest_h;
+        long rest_m;
+        char *p = s;
+
+        if (delta < 0) {
+                *s = 0;
+        } else {
+                if ((rest_d = delta / day) > 0) {
+                        p += snprintf(p, 256 - (p - s), "%ldd ", rest_d);
+                        delta -= rest_d * day;
+                }
+                if ((rest_h = delta / hour) > 0 || (rest_d > 0)) {
+                        p += snprintf(p, 256 - (p - s), "%ldh ", rest_h);
+                        delta -= rest_h * hour;
+                }
+                rest_m = delta / min;
+                snprintf(p, 256 - (p - s), "%ldm", rest_m);
+        }
+        return s;
+}
+
+
 int Util_getNumberOfServices() {
         int i = 0;
         Service_T s;
@@ -618,19 +744,35 @@ void Util_printRunList() {
         printf(" %-18s = %s\n", "Use syslog", (Run.flags & Run_UseSyslog) ? "True" : "False");
         printf(" %-18s = %s\n", "Is Daemon", (Run.flags & Run_Daemon) ? "True" : "False");
         printf(" %-18s = %s\n", "Use process engine", (Run.flags & Run_ProcessEngineEnabled) ? "True" : "False");
+        printf(" %-18s = %s\n", "Process events", (Run.flags & Run_ProcessEvents) ? "True" : "False");
+        printf(" %-18s = %s\n", "File events", (Run.flags & Run_FileEvents) ? "True" : "False");
+        printf(" %-18s = %s\n", "Process accounting", (Run.flags & Run_ProcessAccounting) ? "eBPF" : "procfs");
         printf(" %-18s = {\n", "Limits");
         printf(" %-18s =   programOutput:     %s\n", " ", Convert_bytes2str(Run.limits.programOutput, buf));
         printf(" %-18s =   sendExpectBuffer:  %s\n", " ", Convert_bytes2str(Run.limits.sendExpectBuffer, buf));
         printf(" %-18s =   fileContentBuffer: %s\n", " ", Convert_bytes2str(Run.limits.fileContentBuffer, buf));
+        printf(" %-18s =   fileContentBudget: %s\n", " ", Convert_bytes2str(Run.limits.fileContentBudget, buf));
         printf(" %-18s =   httpContentBuffer: %s\n", " ", Convert_bytes2str(Run.limits.httpContentBuffer, buf));
         printf(" %-18s =   networkTimeout:    %s\n", " ", Convert_time2str(Run.limits.networkTimeout, (char[11]){}));
         printf(" %-18s =   programTimeout:    %s\n", " ", Convert_time2str(Run.limits.programTimeout, (char[11]){}));
         printf(" %-18s =   stopTimeout:       %s\n", " ", Convert_time2str(Run.limits.stopTimeout, (char[11]){}));
         printf(" %-18s =   startTimeout:      %s\n", " ", Convert_time2str(Run.limits.startTimeout, (char[11]){}));
         printf(" %-18s =   restartTimeout:    %s\n", " ", Convert_time2str(Run.limits.restartTimeout, (char[11]){}));
+        printf(" %-18s =   filesystemTimeout: %s\n", " ", Convert_time2str(Run.limits.filesystemTimeout, (char[11]){}));
+        if (Run.limits.checkTimeout) {
+                printf(" %-18s =   checkTimeout:      %s\n", " ", Convert_time2str(Run.limits.checkTimeout, (char[11]){}));
+                printf(" %-18s =   checkQuarantine:   %u\n", " ", Run.limits.checkQuarantine);
+        }
         printf(" %-18s = }\n", " ");
         printf(" %-18s = %s\n", "On reboot", onrebootnames[Run.onreboot]);
         printf(" %-18s = %d seconds with start delay %d seconds\n", "Poll time", Run.polltime, Run.startdelay);
+        printf(" %-18s = %d\n", "Workers", Run.workers);
+        if (Run.processscanners > 0)
+                printf(" %-18s = %d\n", "Process scanners", Run.processscanners);
+        else
+                printf(" %-18s = automatic\n", "Process scanners");
+        if (Run.procfs)
+                printf(" %-18s = %s\n", "Procfs", Run.procfs);
 
         if (Run.eventlist_dir) {
                 char slots[STRLEN];
@@ -673,6 +815,34 @@ void Util_printRunList() {
                 printf("\n");
         }
 
+        if (Run.webhooks) {
+                printf(" %-18s = ", "Webhook(s)");
+                for (Webhook_T w = Run.webhooks; w; w = w->next) {
+                        printf("%s with timeout %s", w->url->url, Convert_time2str(w->timeout, (char[11]){}));
+                        if (w->interval)
+                                printf(" every %d seconds", w->interval);
+                        printf(" and %d worker%s", w->workers, w->workers > 1 ? "s" : "");
+#ifdef HAVE_OPENSSL
+                        if (w->ssl.flags)
+                                printf(" using TLS");
+#endif
+                        if (w->next)
+                               printf(",\n                    = ");
+                }
+                printf("\n");
+        }
+
+        if (Run.mqtt) {
+                printf(" %-18s = %s with timeout %s, QoS %d and %s format", "MQTT broker", Run.mqtt->url->url, Convert_time2str(Run.mqtt->timeout, (char[11]){}), Run.mqtt->qos, Run.mqtt->format == MqttFormat_Cbor ? "CBOR" : "JSON");
+                if (Run.mqtt->snapshot)
+                        printf(", full status every %d cycles", Run.mqtt->snapshot);
+#ifdef HAVE_OPENSSL
+                if (Run.mqtt->ssl.flags)
+                        printf(" using TLS");
+#endif
+                printf("\n");
+        }
+
         if (Run.mailservers) {
                 MailServer_T mta;
                 printf(" %-18s = ", "Mail server(s)");
@@ -694,6 +864,8 @@ void Util_printRunList() {
                 printf(" with timeout %s", Convert_time2str(Run.mailserver_timeout, (char[11]){}));
                 if (Run.mail_hostname)
                         printf(" using '%s' as my hostname", Run.mail_hostname);
+                if (Run.mail_digest)
+                        printf(" with digest %d seconds", Run.mail_digest);
                 printf("\n");
         }
 
@@ -775,8 +947,12 @@ void Util_printService(Service_T s) {
         if (s->type == Service_Process) {
                 if (s->matchlist)
                         printf(" %-20s = %s\n", "Match", s->path);
-                else
+                else if (! s->cgroup)
                         printf(" %-20s = %s\n", "Pid file", s->path);
+                if (s->cgroup)
+                        printf(" %-20s = %s\n", "Cgroup", s->cgroup);
+                if (s->cgroupAccounting)
+                        printf(" %-20s = %s\n", "Cgroup accounting", "Enabled");
         } else if (s->type == Service_Host) {
                 printf(" %-20s = %s\n", "Address", s->path);
         } else if (s->type == Service_Net) {
@@ -786,6 +962,7 @@ void Util_printService(Service_T s) {
         }
         printf(" %-20s = %s\n", "Monitoring mode", modenames[s->mode]);
         printf(" %-20s = %s\n", "On reboot", onrebootnames[s->onreboot]);
+        printf(" %-20s = %s\n", "Priority", prioritynames[s->priority]);
         if (s->start) {
                 printf(" %-20s = '%s'", "Start program", Util_commandDescription(s->start, (char[STRLEN]){}));
                 if (s->start->has_uid)
@@ -864,6 +1041,8 @@ void Util_printService(Service_T s) {
                        :
                        StringBuffer_toString(Util_printRule(buf, s->checksum->action, "if failed %s(%s)", s->checksum->hash, checksumnames[s->checksum->type]))
                        );
+                if (s->checksum->verify)
+                        printf(" %-20s = every %d cycle(s)\n", "Checksum verify", s->checksum->verify);
         }
 
         if (s->perm && s->perm->action) {
@@ -979,10 +1158,19 @@ void Util_printService(Service_T s) {
                        ?
                        StringBuffer_toString(Util_printRule(buf, o->action, "if changed"))
                        :
+                       o->growth
+                       ?
+                       StringBuffer_toString(Util_printRule(buf, o->action, "if growth %s %llu byte(s) per %s", operatornames[o->operator], o->size, Convert_time2str(o->growth * 1000., (char[11]){})))
+                       :
                        StringBuffer_toString(Util_printRule(buf, o->action, "if %s %llu byte(s)", operatornames[o->operator], o->size))
                        );
         }
 
+        for (FileCount_T o = s->filecountlist; o; o = o->next) {
+                StringBuffer_clear(buf);
+                printf(" %-20s = %s\n", "File count", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %llu", operatornames[o->operator], o->limit)));
+        }
+
         for (LinkStatus_T o = s->linkstatuslist; o; o = o->next) {
                 StringBuffer_clear(buf);
                 printf(" %-20s = %s\n", "Link status", StringBuffer_toString(Util_printRule(buf, o->action, "if failed")));
@@ -1039,6 +1227,11 @@ void Util_printService(Service_T s) {
                 printf(" %-20s = %s\n", "Uptime", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %llu second(s)", operatornames[o->operator], o->uptime)));
         }
 
+        for (Latency_T o = s->latencylist; o; o = o->next) {
+                StringBuffer_clear(buf);
+                printf(" %-20s = %s\n", "Response time", StringBuffer_toString(Util_printRule(buf, o->action, "if p%g %s %s", o->percentile, operatornames[o->operator], Convert_time2str(o->limit, (char[11]){}))));
+        }
+
         if (s->type != Service_Process) {
                 for (Match_T o = s->matchignorelist; o; o = o->next) {
                         StringBuffer_clear(buf);
@@ -1090,6 +1283,8 @@ void Util_printService(Service_T s) {
                         printf(" %-20s = %s\n", "Write limit", StringBuffer_toString(Util_printRule(buf, o->action, "if write %s %llu operations/s", operatornames[o->operator], o->limit_absolute)));
                 } else if (o->resource == Resource_ServiceTime) {
                         printf(" %-20s = %s\n", "Service time limit", StringBuffer_toString(Util_printRule(buf, o->action, "if service time %s %s/operation", operatornames[o->operator], Convert_time2str(o->limit_absolute, (char[11]){}))));
+                } else if (o->resource == Resource_Utilization) {
+                        printf(" %-20s = %s\n", "Utilization limit", StringBuffer_toString(Util_printRule(buf, o->action, "if utilization %s %.1f%%", operatornames[o->operator], o->limit_percent)));
                 }
         }
 
@@ -1104,6 +1299,10 @@ void Util_printService(Service_T s) {
                                 printf(" %-20s = ", "CPU usage limit (incl. children)");
                                 break;
 
+                        case Resource_CpuPercentThread:
+                                printf(" %-20s = ", "Thread CPU usage limit");
+                                break;
+
                         case Resource_CpuUser:
                                 printf(" %-20s = ", "CPU user limit");
                                 break;
@@ -1140,6 +1339,38 @@ void Util_printService(Service_T s) {
                                 printf(" %-20s = ", "CPU guest nice limit");
                                 break;
 
+                        case Resource_CpuPerCore:
+                                printf(" %-20s = ", "CPU usage limit per core");
+                                break;
+
+                        case Resource_CpuPerNode:
+                                printf(" %-20s = ", "CPU usage limit per NUMA node");
+                                break;
+
+                        case Resource_PressureCpuSome:
+                                printf(" %-20s = ", "CPU pressure (some) limit");
+                                break;
+
+                        case Resource_PressureCpuFull:
+                                printf(" %-20s = ", "CPU pressure (full) limit");
+                                break;
+
+                        case Resource_PressureMemorySome:
+                                printf(" %-20s = ", "Memory pressure (some) limit");
+                                break;
+
+                        case Resource_PressureMemoryFull:
+                                printf(" %-20s = ", "Memory pressure (full) limit");
+                                break;
+
+                        case Resource_PressureIoSome:
+                                printf(" %-20s = ", "I/O pressure (some) limit");
+                                break;
+
+                        case Resource_PressureIoFull:
+                                printf(" %-20s = ", "I/O pressure (full) limit");
+                                break;
+
                         case Resource_MemoryPercent:
                                 printf(" %-20s = ", "Memory usage limit");
                                 break;
@@ -1152,6 +1383,22 @@ void Util_printService(Service_T s) {
                                 printf(" %-20s = ", "Swap usage limit");
                                 break;
 
+                        case Resource_HugepagesPercent:
+                                printf(" %-20s = ", "Hugepages usage limit");
+                                break;
+
+                        case Resource_MemoryPss:
+                                printf(" %-20s = ", "PSS amount limit");
+                                break;
+
+                        case Resource_MemoryUss:
+                                printf(" %-20s = ", "USS amount limit");
+                                break;
+
+                        case Resource_CgroupMemoryPercent:
+                                printf(" %-20s = ", "Cgroup memory limit");
+                                break;
+
                         case Resource_SwapKbyte:
                                 printf(" %-20s = ", "Swap amount limit");
                                 break;
@@ -1220,6 +1467,34 @@ void Util_printService(Service_T s) {
                                 printf(" %-20s = ", "Disk write limit");
                                 break;
 
+                        case Resource_Connections:
+                                printf(" %-20s = ", "Connections");
+                                break;
+
+                        case Resource_ConnectionsEstablished:
+                                printf(" %-20s = ", "Established connections");
+                                break;
+
+                        case Resource_ConnectionsListen:
+                                printf(" %-20s = ", "Listening sockets");
+                                break;
+
+                        case Resource_ConnectionsCloseWait:
+                                printf(" %-20s = ", "Close wait connections");
+                                break;
+
+                        case Resource_TcpSent:
+                                printf(" %-20s = ", "TCP sent limit");
+                                break;
+
+                        case Resource_TcpReceived:
+                                printf(" %-20s = ", "TCP received limit");
+                                break;
+
+                        case Resource_IoDelay:
+                                printf(" %-20s = ", "I/O delay limit");
+                                break;
+
                         default:
                                 break;
                 }
@@ -1236,14 +1511,28 @@ void Util_printService(Service_T s) {
                         case Resource_CpuSteal:
                         case Resource_CpuGuest:
                         case Resource_CpuGuestNice:
+                        case Resource_CpuPerCore:
+                        case Resource_CpuPerNode:
+                        case Resource_PressureCpuSome:
+                        case Resource_PressureCpuFull:
+                        case Resource_PressureMemorySome:
+                        case Resource_PressureMemoryFull:
+                        case Resource_PressureIoSome:
+                        case Resource_PressureIoFull:
                         case Resource_MemoryPercent:
                         case Resource_SwapPercent:
+                        case Resource_IoDelay:
+                        case Resource_CpuPercentThread:
+                        case Resource_HugepagesPercent:
+                        case Resource_CgroupMemoryPercent:
                                 printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %.1f%%", operatornames[o->operator], o->limit)));
                                 break;
 
                         case Resource_MemoryKbyte:
                         case Resource_SwapKbyte:
                         case Resource_MemoryKbyteTotal:
+                        case Resource_MemoryPss:
+                        case Resource_MemoryUss:
                                 printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s", operatornames[o->operator], Convert_bytes2str(o->limit, buffer))));
                                 break;
 
@@ -1258,11 +1547,17 @@ void Util_printService(Service_T s) {
 
                         case Resource_Threads:
                         case Resource_Children:
+                        case Resource_Connections:
+                        case Resource_ConnectionsEstablished:
+                        case Resource_ConnectionsListen:
+                        case Resource_ConnectionsCloseWait:
                                 printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %.0f", operatornames[o->operator], o->limit)));
                                 break;
 
                         case Resource_ReadBytes:
                         case Resource_WriteBytes:
+                        case Resource_TcpSent:
+                        case Resource_TcpReceived:
                                 printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s/s", operatornames[o->operator], Convert_bytes2str(o->limit, (char[10]){}))));
                                 break;
 
@@ -1285,9 +1580,11 @@ void Util_printService(Service_T s) {
         if (s->every.type == Every_SkipCycles)
                 printf(" %-20s = Check service every %d cycles\n", "Every", s->every.spec.cycle.number);
         else if (s->every.type == Every_Cron)
-                printf(" %-20s = Check service every %s\n", "Every", s->every.spec.cron);
+                printf(" %-20s = Check service every %s\n", "Every", s->every.spec.cron.string);
         else if (s->every.type == Every_NotInCron)
-                printf(" %-20s = Don't check service every %s\n", "Every", s->every.spec.cron);
+                printf(" %-20s = Don't check service every %s\n", "Every", s->every.spec.cron.string);
+        else if (s->every.type == Every_Interval)
+                printf(" %-20s = Check service every %s\n", "Every", Convert_time2str(s->every.spec.interval * 1000., (char[11]){}));
 
         for (ActionRate_T o = s->actionratelist; o; o = o->next) {
                 StringBuffer_clear(buf);
@@ -1322,6 +1619,254 @@ void Util_printServiceList() {
 }
 
 
+static void _memorySite(const MemSite_T *site, void *ap) {
+        Vector_append(ap, site);
+}
+
+
+static int _compareLiveBytes(const void *a, const void *b) {
+        long long x = ((const MemSite_T *)a)->liveBytes;
+        long long y = ((const MemSite_T *)b)->liveBytes;
+        return (x < y) - (x > y);
+}
+
+
+bool Util_printMemoryStatistics(StringBuffer_T B, int limit) {
+        ASSERT(B);
+        Vector_T sites = Vector_new(sizeof(MemSite_T), 256);
+        if (! Mem_statistics(_memorySite, sites)) {
+                Vector_free(&sites);
+                return false;
+        }
+        Vector_sort(sites, _compareLiveBytes);
+        int count = Vector_length(sites);
+        MemSite_T *list = Vector_data(sites);
+        long long live = 0, liveBytes = 0;
+        for (int i = 0; i < count; i++) {
+                live += list[i].live;
+                liveBytes += list[i].liveBytes;
+        }
+        StringBuffer_append(B, "Allocation sites: %d, live objects: %lld, live bytes: %lld\n\n", count, live, liveBytes);
+        StringBuffer_append(B, "%12s %14s %14s %16s  %s\n", "live", "live bytes", "allocations", "allocated bytes", "site");
+        for (int i = 0; i < count && (limit <= 0 || i < limit); i++) {
+                MemSite_T *s = &list[i];
+                StringBuffer_append(B, "%12lld %14lld %14llu %16llu  %s:%d %s()\n", s->live, s->liveBytes, s->allocations, s->bytes, s->file, s->line, s->func);
+        }
+        Vector_free(&sites);
+        return true;
+}
+
+
+typedef enum {
+        Footprint_Service = 0,
+        Footprint_Info,
+        Footprint_Rules,
+        Footprint_Actions,
+        Footprint_Commands,
+        Footprint_Ports,
+        Footprint_Other,
+        Footprint_Last
+} Footprint_Type;
+
+
+static const char *_footprintNames[] = {"service", "info", "rules", "actions", "commands", "ports", "other"};
+
+
+typedef struct Footprint_T {
+        unsigned long long count[Footprint_Last];             /**< Objects */
+        unsigned long long bytes[Footprint_Last];               /**< Bytes */
+} Footprint_T;
+
+
+static inline void _footprintAdd(Footprint_T *F, Footprint_Type type, size_t bytes) {
+        F->count[type]++;
+        F->bytes[type] += bytes;
+}
+
+
+static inline size_t _footprintString(const char *s) {
+        return s ? strlen(s) + 1 : 0;
+}
+
+
+static void _footprintCommand(Footprint_T *F, command_t c) {
+        if (c) {
+                size_t bytes = sizeof(*c) + (c->arg ? (c->length + 1) * sizeof(char *) : 0);
+                for (int i = 0; i < c->length; i++)
+                        bytes += _footprintString(c->arg[i]);
+                _footprintAdd(F, Footprint_Commands, bytes);
+        }
+}
+
+
+static void _footprintAction(Footprint_T *F, EventAction_T a) {
+        if (a) {
+                _footprintAdd(F, Footprint_Actions, sizeof(*a) + sizeof(*a->failed) + sizeof(*a->succeeded));
+                _footprintCommand(F, a->failed->exec);
+                _footprintCommand(F, a->succeeded->exec);
+        }
+}
+
+
+// The rule list node and its action, the strings of the rule are added by the caller
+#define _footprintRules(F, T, list) \
+        for (T r = (list); r; r = r->next) { \
+                _footprintAdd((F), Footprint_Rules, sizeof(*r)); \
+                _footprintAction((F), r->action); \
+        }
+
+
+#define _footprintRule(F, rule) \
+        if (rule) { \
+                _footprintAdd((F), Footprint_Rules, sizeof(*(rule))); \
+                _footprintAction((F), (rule)->action); \
+        }
+
+
+/**
+ * Count the bytes of the service structures. The sizes are the requested
+ * sizes, without the allocator overhead. The runtime objects which are
+ * created after the start (the events, the metrics series) are included
+ * only if they exist
+ */
+static void _footprintService(Service_T s, Footprint_T *F) {
+        memset(F, 0, sizeof(*F));
+        size_t bytes = sizeof(*s) + _footprintString(s->name) + _footprintString(s->name_urlescaped) + _footprintString(s->path) + _footprintString(s->cgroup) + _footprintString(s->token);
+        if (s->name_htmlescaped)
+                bytes += StringBuffer_length(s->name_htmlescaped) + 1;
+        bytes += s->eventindex.size * sizeof(*s->eventindex.table) + s->children.count * sizeof(*s->children.list);
+        for (struct myevent *e = s->eventlist; e; e = e->next)
+                bytes += sizeof(*e) + _footprintString(e->message);
+        _footprintAdd(F, Footprint_Service, bytes);
+        switch (s->type) {
+                case Service_Directory:
+                        _footprintAdd(F, Footprint_Info, sizeof(*s->inf.directory));
+                        break;
+                case Service_Fifo:
+                        _footprintAdd(F, Footprint_Info, sizeof(*s->inf.fifo));
+                        break;
+                case Service_File:
+                        _footprintAdd(F, Footprint_Info, sizeof(*s->inf.file));
+                        break;
+                case Service_Filesystem:
+                        _footprintAdd(F, Footprint_Info, sizeof(*s->inf.filesystem));
+                        break;
+                case Service_Net:
+                        _footprintAdd(F, Footprint_Info, sizeof(*s->inf.net));
+                        break;
+                case Service_Process:
+                        _footprintAdd(F, Footprint_Info, sizeof(*s->inf.process));
+                        break;
+                default:
+                        break;
+        }
+        _footprintCommand(F, s->start);
+        _footprintCommand(F, s->stop);
+        _footprintCommand(F, s->restart);
+        if (s->program) {
+                _footprintAdd(F, Footprint_Other, sizeof(*s->program));
+                _footprintCommand(F, s->program->args);
+        }
+        for (Dependant_T d = s->dependantlist; d; d = d->next)
+                _footprintAdd(F, Footprint_Other, sizeof(*d) + _footprintString(d->dependant) + _footprintString(d->dependant_urlescaped));
+        for (Mail_T m = s->maillist; m; m = m->next)
+                _footprintAdd(F, Footprint_Other, sizeof(*m) + _footprintString(m->to) + _footprintString(m->subject) + _footprintString(m->message) + _footprintString(m->host));
+        for (Port_T p = s->portlist; p; p = p->next) {
+                _footprintAdd(F, Footprint_Ports, sizeof(*p) + _footprintString(p->hostname));
+                _footprintAction(F, p->action);
+        }
+        for (Port_T p = s->socketlist; p; p = p->next) {
+                _footprintAdd(F, Footprint_Ports, sizeof(*p) + _footprintString(p->target.unix.pathname));
+                _footprintAction(F, p->action);
+        }
+        for (Icmp_T i = s->icmplist; i; i = i->next) {
+                _footprintAdd(F, Footprint_Ports, sizeof(*i));
+                _footprintAction(F, i->action);
+        }
+        for (Match_T m = s->matchlist; m; m = m->next)
+                F->bytes[Footprint_Rules] += _footprintString(m->match_string) + _footprintString(m->match_path) + _footprintString(m->literal) + (m->regex_comp ? sizeof(*m->regex_comp) : 0);
+        for (SecurityAttribute_T a = s->secattrlist; a; a = a->next)
+                F->bytes[Footprint_Rules] += _footprintString(a->attribute);
+        _footprintRules(F, ActionRate_T, s->actionratelist);
+        _footprintRule(F, s->checksum);
+        _footprintRules(F, FileSystem_T, s->filesystemlist);
+        _footprintRule(F, s->perm);
+        _footprintRules(F, Resource_T, s->resourcelist);
+        _footprintRules(F, Size_T, s->sizelist);
+        _footprintRules(F, Certificate_T, s->certificatelist);
+        _footprintRules(F, FileCount_T, s->filecountlist);
+        _footprintRules(F, Uptime_T, s->uptimelist);
+        _footprintRules(F, Latency_T, s->latencylist);
+        _footprintRules(F, Trend_T, s->trendlist);
+        _footprintRules(F, Match_T, s->matchlist);
+        _footprintRules(F, Match_T, s->matchignorelist);
+        _footprintRules(F, Timestamp_T, s->timestamplist);
+        _footprintRules(F, Pid_T, s->pidlist);
+        _footprintRules(F, Pid_T, s->ppidlist);
+        _footprintRules(F, Status_T, s->statuslist);
+        _footprintRules(F, FsFlag_T, s->fsflaglist);
+        _footprintRules(F, NonExist_T, s->nonexistlist);
+        _footprintRules(F, Exist_T, s->existlist);
+        _footprintRule(F, s->uid);
+        _footprintRule(F, s->euid);
+        _footprintRule(F, s->gid);
+        _footprintRules(F, SecurityAttribute_T, s->secattrlist);
+        _footprintRules(F, Filedescriptors_T, s->filedescriptorslist);
+        _footprintRules(F, LinkStatus_T, s->linkstatuslist);
+        _footprintRules(F, LinkSpeed_T, s->linkspeedlist);
+        _footprintRules(F, LinkSaturation_T, s->linksaturationlist);
+        _footprintRules(F, Bandwidth_T, s->uploadbyteslist);
+        _footprintRules(F, Bandwidth_T, s->uploadpacketslist);
+        _footprintRules(F, Bandwidth_T, s->downloadbyteslist);
+        _footprintRules(F, Bandwidth_T, s->downloadpacketslist);
+        _footprintAction(F, s->action_DATA);
+        _footprintAction(F, s->action_EXEC);
+        _footprintAction(F, s->action_INVALID);
+        _footprintAction(F, s->action_MONIT_START);
+        _footprintAction(F, s->action_MONIT_STOP);
+        _footprintAction(F, s->action_ACTION);
+}
+
+
+static unsigned long long _footprintTotal(Footprint_T *F) {
+        unsigned long long total = 0;
+        for (int i = 0; i < Footprint_Last; i++)
+                total += F->bytes[i];
+        return total;
+}
+
+
+bool Util_printMemoryFootprint(StringBuffer_T B, const char *name) {
+        ASSERT(B);
+        Footprint_T total = {}, F;
+        int services = 0;
+        StringBuffer_append(B, "%-40s %-12s %12s", "Service", "Type", "Total");
+        for (int i = 0; i < Footprint_Last; i++)
+                StringBuffer_append(B, " %10s", _footprintNames[i]);
+        StringBuffer_append(B, "\n");
+        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
+                if (name && ! IS(name, s->name))
+                        continue;
+                _footprintService(s, &F);
+                StringBuffer_append(B, "%-40s %-12s %12llu", s->name, servicetypes[s->type], _footprintTotal(&F));
+                for (int i = 0; i < Footprint_Last; i++) {
+                        StringBuffer_append(B, " %10llu", F.bytes[i]);
+                        total.count[i] += F.count[i];
+                        total.bytes[i] += F.bytes[i];
+                }
+                StringBuffer_append(B, "\n");
+                services++;
+        }
+        if (! services)
+                return false;
+        StringBuffer_append(B, "\n%-12s %12s %14s %12s\n", "Structure", "Objects", "Bytes", "Per service");
+        for (int i = 0; i < Footprint_Last; i++)
+                StringBuffer_append(B, "%-12s %12llu %14llu %12llu\n", _footprintNames[i], total.count[i], total.bytes[i], total.bytes[i] / services);
+        StringBuffer_append(B, "%-12s %12s %14llu %12llu\n", "total", "", _footprintTotal(&total), _footprintTotal(&total) / services);
+        return true;
+}
+
+
 char *Util_getToken(MD_T token) {
         md5_context_t ctx;
         char buf[STRLEN] = {};
@@ -1370,7 +1915,7 @@ char *Util_monitId(char *idfile) {
 }
 
 
-pid_t Util_getPid(char *pidfile) {
+pid_t Util_getPid(const char *pidfile) {
         FILE *file = NULL;
         int pid = -1;
 
@@ -1564,6 +2109,9 @@ bool Util_checkCredentials(char *uname, char *outside) {
                         return PAMcheckPasswd(uname, outside);
                         break;
 #endif
+                case Digest_Token:
+                        // The bearer token is accepted in the Authorization: Bearer header only
+                        return false;
                 default:
                         Log_error("Unknown password digestion method.\n");
                         return false;
@@ -1604,12 +2152,17 @@ void Util_resetInfo(Service_T s) {
                         Statistics_reset(&(s->inf.filesystem->time.write));
                         Statistics_reset(&(s->inf.filesystem->time.wait));
                         Statistics_reset(&(s->inf.filesystem->time.run));
+                        Statistics_reset(&(s->inf.filesystem->time.io));
                         break;
                 case Service_File:
                         s->inf.file->size  = -1;
                         s->inf.file->readpos = 0;
                         s->inf.file->inode = 0;
                         s->inf.file->inode_prev = 0;
+                        if (s->inf.file->tail.open) {
+                                close(s->inf.file->tail.fd);
+                                s->inf.file->tail.open = false;
+                        }
                         s->inf.file->mode = -1;
                         s->inf.file->uid = -1;
                         s->inf.file->gid = -1;
@@ -1617,6 +2170,7 @@ void Util_resetInfo(Service_T s) {
                         s->inf.file->timestamp.change = 0;
                         s->inf.file->timestamp.modify = 0;
                         *s->inf.file->cs_sum = 0;
+                        s->inf.file->fingerprint = s->inf.file->cs_fingerprint = (Fingerprint_T){};
                         break;
                 case Service_Directory:
                         s->inf.directory->mode = -1;
@@ -1625,6 +2179,7 @@ void Util_resetInfo(Service_T s) {
                         s->inf.directory->timestamp.access = 0;
                         s->inf.directory->timestamp.change = 0;
                         s->inf.directory->timestamp.modify = 0;
+                        s->inf.directory->tree.collected = false;
                         break;
                 case Service_Fifo:
                         s->inf.fifo->mode = -1;
@@ -1651,12 +2206,20 @@ void Util_resetInfo(Service_T s) {
                         s->inf.process->total_mem_percent = -1.;
                         s->inf.process->cpu_percent = -1.;
                         s->inf.process->total_cpu_percent = -1.;
+                        s->inf.process->thread_cpu_percent = -1.;
+                        s->inf.process->pss = -1LL;
+                        s->inf.process->uss = -1LL;
                         s->inf.process->uptime = -1;
                         s->inf.process->filedescriptors.open = -1LL;
                         s->inf.process->filedescriptors.openTotal = -1LL;
+                        s->inf.process->cgroup.time = s->inf.process->cgroup.cpu = 0ULL;
                         *(s->inf.process->secattr) = 0;
                         _resetIOStatistics(&(s->inf.process->read));
                         _resetIOStatistics(&(s->inf.process->write));
+                        Statistics_reset(&(s->inf.process->tcp.sent));
+                        Statistics_reset(&(s->inf.process->tcp.received));
+                        Statistics_reset(&(s->inf.process->ioDelay));
+                        s->inf.process->connections.total = s->inf.process->connections.established = s->inf.process->connections.listen = s->inf.process->connections.closeWait = -1;
                         break;
                 case Service_Net:
                         if (s->inf.net->stats)
@@ -1755,12 +2318,35 @@ bool Util_evalDoubleQExpression(Operator_Type operator, double left, double righ
 }
 
 
+DoubleQExpression_T Util_getDoubleQExpression(Operator_Type operator) {
+        switch (operator) {
+                case Operator_Greater:
+                        return _greater;
+                case Operator_GreaterOrEqual:
+                        return _greaterOrEqual;
+                case Operator_Less:
+                        return _less;
+                case Operator_LessOrEqual:
+                        return _lessOrEqual;
+                case Operator_Equal:
+                        return _equal;
+                case Operator_NotEqual:
+                case Operator_Changed:
+                        return _notEqual;
+                default:
+                        Log_error("Unknown comparison operator\n");
+                        return _never;
+        }
+}
+
+
 void Util_monitorSet(Service_T s) {
         ASSERT(s);
         if (s->monitor == Monitor_Not) {
                 s->monitor = Monitor_Init;
                 DEBUG("'%s' monitoring enabled\n", s->name);
-                State_dirty();
+                State_dirty(s);
+                ServiceStatus_publish(s);
         }
 }
 
@@ -1776,10 +2362,10 @@ void Util_monitorUnset(Service_T s) {
         if (s->every.type == Every_SkipCycles)
                 s->every.spec.cycle.counter = 0;
         s->error = Event_Null;
-        if (s->eventlist)
-                gc_event(&s->eventlist);
+        Event_free(s);
         Util_resetInfo(s);
-        State_dirty();
+        State_dirty(s);
+        ServiceStatus_publish(s);
 }
 
 
@@ -1935,3 +2521,23 @@ const char *Util_timestr(int time) {
         return NULL;
 }
 
+
+uint64_t Util_hash(const char *key, const char *name) {
+        uint64_t hash = 14695981039346656037ULL; // FNV-1a
+        for (const char *p = key; *p; p++) {
+                hash ^= (unsigned char)*p;
+                hash *= 1099511628211ULL;
+        }
+        hash ^= '/';
+        hash *= 1099511628211ULL;
+        for (const char *p = name; *p; p++) {
+                hash ^= (unsigned char)*p;
+                hash *= 1099511628211ULL;
+        }
+        // Final mix, the hashes of the similar keys are not correlated then
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return hash;
+}
+
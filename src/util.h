@@ -79,6 +79,65 @@ int Util_handle0Escapes(char *buf);
 Service_T Util_getService(const char *name);
 
 
+/**
+ * Format the uptime
+ * @param delta The uptime in seconds
+ * @param s The output buffer
+ * @return The uptime string ("2d 3h 15m")
+ */
+char *Util_getUptime(time_t delta, char s[256]);
+
+
+/**
+ * @param name A service group name as stated in the config file
+ * @return the named service group or NULL if not found
+ */
+ServiceGroup_T Util_getServiceGroup(const char *name);
+
+
+/**
+ * Get the type of the service selector given on the command line: the
+ * selector with the glob characters (*, ? or [) is a pattern, otherwise
+ * it is a service name
+ * @param selector The service name or pattern
+ * @return Select_Pattern or Select_Service
+ */
+Select_Type Util_getSelectType(const char *selector);
+
+
+/**
+ * Append the services selected by the name, the glob pattern (see
+ * fnmatch(3)) or the group to the list
+ * @param services The list of Service_T to append to
+ * @param type The selector type
+ * @param selector The service name, pattern or group name
+ * @return The number of the selected services, 0 if none matched
+ */
+int Util_selectServices(List_T services, Select_Type type, const char *selector);
+
+
+/**
+ * Add the service to the name index used by Util_getService(). The parser
+ * indexes every service it adds to the service list
+ * @param s The service to index
+ */
+void Util_indexService(Service_T s);
+
+
+/**
+ * Add the service group to the name index used by Util_getServiceGroup()
+ * @param g The service group to index
+ */
+void Util_indexServiceGroup(ServiceGroup_T g);
+
+
+/**
+ * Free the service and service group name index. Called when the service
+ * list is destroyed
+ */
+void Util_resetServiceIndex(void);
+
+
 /**
  * @param name A service name as stated in the config file
  * @return true if the service name exist in the
@@ -114,6 +173,29 @@ void Util_printService(Service_T s);
 void Util_printServiceList(void);
 
 
+/**
+ * Print the allocation statistics of the call sites, sorted by the live
+ * bytes. Available if monit was configured with --enable-memstat
+ * @param B The buffer to print the statistics to
+ * @param limit The maximum number of call sites to print, 0 for all
+ * @return true if the statistics are available, otherwise false
+ */
+bool Util_printMemoryStatistics(StringBuffer_T B, int limit);
+
+
+/**
+ * Print the memory footprint of the services: the bytes of each service
+ * split by the structure (the service itself, the type specific check
+ * state, the rules, the event actions, the commands, the ports and the
+ * other configuration) and the totals of each structure. The sizes are
+ * the requested sizes without the allocator overhead
+ * @param B The buffer to print the report to
+ * @param name The service name or NULL for all services
+ * @return true if some service was printed, otherwise false
+ */
+bool Util_printMemoryFootprint(StringBuffer_T B, const char *name);
+
+
 /**
  * Get a random token
  * @param token buffer to store the MD digest
@@ -137,7 +219,7 @@ char *Util_monitId(char *idfile);
  * @return the pid or 0 if the pid could
  * not be read from the file
  */
-pid_t Util_getPid(char *pidfile);
+pid_t Util_getPid(const char *pidfile);
 
 
 /**
@@ -251,6 +333,16 @@ bool Util_evalQExpression(Operator_Type operator, long long left, long long righ
 bool Util_evalDoubleQExpression(Operator_Type operator, double left, double right);
 
 
+/**
+ * Get the function evaluating the qualification expression with the
+ * operator. The rules which are tested every cycle resolve the operator
+ * once at parse time and don't dispatch on it for each evaluation.
+ * @param operator The qualification operator
+ * @return the function evaluating the expression
+ */
+DoubleQExpression_T Util_getDoubleQExpression(Operator_Type operator);
+
+
 /*
  * This will enable service monitoring in the case that it was disabled.
  * @param s A Service_T object
@@ -354,5 +446,17 @@ char *Util_commandDescription(command_t command, char s[STRLEN]);
 const char *Util_timestr(int time);
 
 
+/**
+ * Compute a well mixed 64 bit hash of the key and the name. The result is
+ * stable across the hosts and restarts, so it can be used to derive a
+ * deterministic per host value for the object (e.g. the cluster owner score
+ * or the schedule phase when the key is the Monit ID)
+ * @param key The key, for example the Monit ID
+ * @param name The name, for example the service name
+ * @return The hash
+ */
+uint64_t Util_hash(const char *key, const char *name);
+
+
 #endif
 
@@ -69,6 +69,10 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
 #endif
@@ -93,23 +97,42 @@
 #include <netinet/ip_icmp.h>
 #endif
 
+#ifdef HAVE_MATH_H
+#include <math.h>
+#endif
+
 #include "monit.h"
 #include "alert.h"
 #include "event.h"
 #include "device.h"
 #include "net/net.h"
 #include "ProcessTree.h"
+#include "ProcessEvent.h"
+#include "FileEvent.h"
+#include "Cluster.h"
+#include "ContentMatch.h"
+#include "DirectoryTree.h"
+#include "ServiceStatus.h"
+#include "ProgramOutput.h"
+#include "Cgroup.h"
+#include "Watchdog.h"
+#include "state.h"
 #include "protocol.h"
 #include "md5.h"
 #include "sha1.h"
+#include "sha256.h"
 #include "checksum.h"
+#include "probe.h"
 
 // libmonit
 #include "system/Time.h"
 #include "util/Convert.h"
 #include "io/File.h"
+#include "io/StatBatch.h"
 #include "io/InputStream.h"
+#include "io/OutputStream.h"
 #include "exceptions/AssertException.h"
+#include "exceptions/IOException.h"
 
 /**
  *  Implementation of validation engine
@@ -118,6 +141,100 @@
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+// Read size of the content match
+#define CONTENTBLOCKSIZE 262144
+
+
+/**
+ * Services queue shared by the validation workers. Services which are connected
+ * by a dependency are chained in one group, which is validated by one worker in
+ * the servicelist (dependency) order, independent groups are validated in parallel
+ */
+static struct {
+        int count;                                  /**< Number of services */
+        int groups;                           /**< Number of service groups */
+        int cursor;                 /**< Index of the next group to validate */
+        int errors;                                   /**< Failed services */
+        Service_T *services;              /**< Services in servicelist order */
+        int *head;                       /**< First service index of a group */
+        int *next;                 /**< Next service index in the same group */
+        Mutex_T mutex;
+} _queue = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/**
+ * Services schedule: a min-heap of services ordered by the check deadline. Each
+ * service is checked in its own interval (the poll cycle by default, or the
+ * interval set by the every statement), only the services which are due are
+ * checked in the given cycle.
+ *
+ * The scheduling state is kept in arrays indexed by the service position (the
+ * servicelist order), the heap and the cycle scans read these arrays only and
+ * the service object is touched when the service is checked. Service_T.every.next
+ * mirrors the deadline: the event engines set it to 0 to request an immediate
+ * check and _scheduleRebuild() picks it up
+ */
+static struct {
+        int count;                             /**< Number of scheduled services */
+        int size;                                    /**< Allocated heap size */
+        int due;                         /**< Number of services due in the cycle */
+        int services;                       /**< Number of services in the arrays */
+        time_t now;                                   /**< The cycle timestamp */
+        long long clock;          /**< The cycle time of the monotonic clock [ms] */
+        int *heap;                    /**< Service positions ordered by deadline */
+        int *duelist;                   /**< Service positions due in the cycle */
+        long long *next;             /**< Check deadline of each service [ms] */
+        bool *isDue;                    /**< The service is due in this cycle */
+        Service_T *service;                     /**< The service at the position */
+} _schedule;
+
+
+/**
+ * The check rate limit of one remote host (set rate limit), a generic cell rate
+ * algorithm: the host may get a burst of up to one second worth of checks, the
+ * further checks are deferred until the checks of the host are below the rate
+ */
+typedef struct RateLimit_T {
+        long long tat;  /**< Theoretical arrival time of the next check [ms] */
+        char host[];                          /**< The host name, the map key */
+} *RateLimit_T;
+
+
+static HashMap_T _ratelimit = NULL;
+
+
+/**
+ * Cycle overrun tracking: after OVERRUN_CYCLES consecutive cycles longer than
+ * the poll time the deferral level is raised (the low priority services first,
+ * then the normal priority services are checked OVERRUN_DEFER times less often),
+ * after OVERRUN_CYCLES consecutive cycles in time the level is lowered again.
+ * The high priority services are never deferred
+ */
+#define OVERRUN_CYCLES 3
+#define OVERRUN_DEFER  4
+
+/**
+ * Adaptive interval: the service with some rule within its X of Y cycles window
+ * is checked in the recheck interval (set recheck), so the window resolves fast.
+ * The interval of the service without failures is doubled after each backoff
+ * checks in a row (set backoff), up to BACKOFF_LIMIT times the interval
+ */
+#define BACKOFF_LIMIT  4
+static struct {
+        int overruns;                     /**< Consecutive overrun cycles */
+        int intime;                       /**< Consecutive cycles in time */
+} _overrun;
+
+
+/**
+ * The stat requests of the file, directory and fifo services due in the cycle
+ */
+static StatBatch_T _statBatch = NULL;
+
+
 /* ----------------------------------------------------------------- Private */
 
 
@@ -156,6 +273,8 @@ retry:
                 Socket_test(p);
                 rv = State_Succeeded;
                 DEBUG("'%s' succeeded testing protocol [%s] at %s [response time %s]\n", s->name, p->protocol->name, Util_portDescription(p, buf, sizeof(buf)), Convert_time2str(p->response, (char[11]){}));
+                if (p->latency)
+                        Histogram_add(p->latency, (long long)(p->response * 1000.)); // Milliseconds -> microseconds
         }
         ELSE
         {
@@ -184,6 +303,42 @@ retry:
 }
 
 
+/**
+ * Test the response time percentiles of the port and unix socket tests
+ */
+static State_Type _checkLatency(Service_T s) {
+        ASSERT(s);
+        State_Type rv = State_Succeeded;
+        for (Latency_T l = s->latencylist; l; l = l->next) {
+                char buf[STRLEN];
+                Port_T failed = NULL;
+                double value = 0., worst = -1.;
+                Port_T lists[] = {s->portlist, s->socketlist};
+                for (int i = 0; i < 2 && ! failed; i++) {
+                        for (Port_T p = lists[i]; p && ! failed; p = p->next) {
+                                if (p->is_available != Connection_Ok || ! p->latency)
+                                        continue;
+                                long long percentile = Histogram_getPercentile(p->latency, l->percentile);
+                                if (percentile < 0)
+                                        continue;
+                                value = percentile / 1000.; // Microseconds -> milliseconds
+                                if (Util_evalDoubleQExpression(l->operator, value, l->limit))
+                                        failed = p;
+                                else
+                                        worst = MAX(worst, value);
+                        }
+                }
+                if (failed) {
+                        rv = State_Failed;
+                        Event_post(s, Event_Resource, State_Failed, l->action, "response time p%g of %s matches limit [p%g %s %s] at %s", l->percentile, Convert_time2str(value, (char[11]){}), l->percentile, operatorshortnames[l->operator], Convert_time2str(l->limit, (char[11]){}), Util_portDescription(failed, buf, sizeof(buf)));
+                } else if (worst >= 0.) {
+                        Event_post(s, Event_Resource, State_Succeeded, l->action, "response time p%g test succeeded [current p%g = %s]", l->percentile, l->percentile, Convert_time2str(worst, (char[11]){}));
+                }
+        }
+        return rv;
+}
+
+
 /**
  * Test process state (e.g. Zombie)
  */
@@ -234,6 +389,50 @@ static State_Type _checkProcessPpid(Service_T s) {
 }
 
 
+/**
+ * Test the pressure stall information of the resource selected by the Resource_Pressure* test
+ */
+static State_Type _checkPressure(Service_T s, Resource_T r, Pressure_T pressure[Pressure_Count], char report[STRLEN]) {
+        static const char *resources[Pressure_Count] = {"cpu", "memory", "io"};
+        int type = (r->resource_id - Resource_PressureCpuSome) / 2;
+        bool full = (r->resource_id - Resource_PressureCpuSome) % 2;
+        double value = full ? pressure[type].full : pressure[type].some;
+        if (value < 0.) {
+                DEBUG("'%s' %s pressure check skipped (not available)\n", s->name, resources[type]);
+                return State_Init;
+        } else if (r->match(value, r->limit)) {
+                snprintf(report, STRLEN, "%s pressure (%s) of %.1f%% matches resource limit [%s pressure %s %.1f%%]", resources[type], full ? "full" : "some", value, resources[type], operatorshortnames[r->operator], r->limit);
+                return State_Failed;
+        }
+        snprintf(report, STRLEN, "%s pressure (%s) check succeeded [current %s pressure = %.1f%%]", resources[type], full ? "full" : "some", resources[type], value);
+        return State_Succeeded;
+}
+
+
+/**
+ * Describe the rate function of the I/O rate test for the event message, e.g. " p95"
+ */
+static const char *_rateFunction(Statistics_Rate_T *rate, char s[static 16]) {
+        switch (rate->function) {
+                case Statistics_Average1:
+                        return " avg(1m)";
+                case Statistics_Average5:
+                        return " avg(5m)";
+                case Statistics_Average15:
+                        return " avg(15m)";
+                case Statistics_Minimum:
+                        return " min";
+                case Statistics_Maximum:
+                        return " max";
+                case Statistics_Percentile:
+                        snprintf(s, 16, " p%g", rate->percentile);
+                        return s;
+                default:
+                        return "";
+        }
+}
+
+
 /**
  * Check process resources
  */
@@ -247,7 +446,7 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
                         if (s->inf.process->cpu_percent < 0.) {
                                 DEBUG("'%s' cpu usage check skipped (initializing)\n", s->name);
                                 return State_Init;
-                        } else if (Util_evalDoubleQExpression(r->operator, s->inf.process->cpu_percent, r->limit)) {
+                        } else if (r->match(s->inf.process->cpu_percent, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "cpu usage of %.1f%% matches resource limit [cpu usage %s %.1f%%]", s->inf.process->cpu_percent, operatorshortnames[r->operator], r->limit);
                         } else {
@@ -259,7 +458,7 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
                         if (s->inf.process->total_cpu_percent < 0.) {
                                 DEBUG("'%s' total cpu usage check skipped (initializing)\n", s->name);
                                 return State_Init;
-                        } else if (Util_evalDoubleQExpression(r->operator, s->inf.process->total_cpu_percent, r->limit)) {
+                        } else if (r->match(s->inf.process->total_cpu_percent, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "total cpu usage of %.1f%% matches resource limit [cpu usage %s %.1f%%]", s->inf.process->total_cpu_percent, operatorshortnames[r->operator], r->limit);
                         } else {
@@ -267,11 +466,23 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
                         }
                         break;
 
+                case Resource_CpuPercentThread:
+                        if (s->inf.process->thread_cpu_percent < 0.) {
+                                DEBUG("'%s' thread cpu usage check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        } else if (r->match(s->inf.process->thread_cpu_percent, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "max thread cpu usage of %.1f%% matches resource limit [max thread cpu usage %s %.1f%%]", s->inf.process->thread_cpu_percent, operatorshortnames[r->operator], r->limit);
+                        } else {
+                                snprintf(report, STRLEN, "max thread cpu usage check succeeded [current max thread cpu usage = %.1f%%]", s->inf.process->thread_cpu_percent);
+                        }
+                        break;
+
                 case Resource_MemoryPercent:
                         if (s->inf.process->mem_percent < 0.) {
                                 DEBUG("'%s' memory usage check skipped (initializing)\n", s->name);
                                 return State_Init;
-                        } else if (Util_evalDoubleQExpression(r->operator, s->inf.process->mem_percent, r->limit)) {
+                        } else if (r->match(s->inf.process->mem_percent, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "mem usage of %.1f%% matches resource limit [mem usage %s %.1f%%]", s->inf.process->mem_percent, operatorshortnames[r->operator], r->limit);
                         } else {
@@ -283,7 +494,7 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
                         if (s->inf.process->mem == 0) {
                                 DEBUG("'%s' process memory usage check skipped (initializing)\n", s->name);
                                 return State_Init;
-                        } else if (Util_evalDoubleQExpression(r->operator, s->inf.process->mem, r->limit)) {
+                        } else if (r->match(s->inf.process->mem, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "mem amount of %s matches resource limit [mem amount %s %s]", Convert_bytes2str(s->inf.process->mem, buf1), operatorshortnames[r->operator], Convert_bytes2str(r->limit, buf2));
                         } else {
@@ -291,11 +502,55 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
                         }
                         break;
 
+                case Resource_MemoryPss:
+                        if (s->inf.process->pss < 0) {
+                                DEBUG("'%s' process pss check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        } else if (r->match(s->inf.process->pss, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "pss amount of %s matches resource limit [pss amount %s %s]", Convert_bytes2str(s->inf.process->pss, buf1), operatorshortnames[r->operator], Convert_bytes2str(r->limit, buf2));
+                        } else {
+                                snprintf(report, STRLEN, "pss amount check succeeded [current pss amount = %s]", Convert_bytes2str(s->inf.process->pss, buf1));
+                        }
+                        break;
+
+                case Resource_MemoryUss:
+                        if (s->inf.process->uss < 0) {
+                                DEBUG("'%s' process uss check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        } else if (r->match(s->inf.process->uss, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "uss amount of %s matches resource limit [uss amount %s %s]", Convert_bytes2str(s->inf.process->uss, buf1), operatorshortnames[r->operator], Convert_bytes2str(r->limit, buf2));
+                        } else {
+                                snprintf(report, STRLEN, "uss amount check succeeded [current uss amount = %s]", Convert_bytes2str(s->inf.process->uss, buf1));
+                        }
+                        break;
+
+                case Resource_CgroupMemoryPercent:
+                        {
+                                unsigned long long usage, limit;
+                                if (! Cgroup_memory(s->inf.process->pid, &usage, &limit)) {
+                                        DEBUG("'%s' cgroup memory usage check skipped (cannot read the cgroup memory of the process %d)\n", s->name, s->inf.process->pid);
+                                        return State_Init;
+                                } else if (limit == 0ULL) {
+                                        DEBUG("'%s' cgroup memory usage check skipped (the cgroup has no memory limit)\n", s->name);
+                                        return State_Init;
+                                }
+                                float percent = usage >= limit ? 100. : 100. * (double)usage / (double)limit;
+                                if (r->match(percent, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "cgroup memory usage of %.1f%% [%s of %s limit] matches resource limit [cgroup memory usage %s %.1f%%]", percent, Convert_bytes2str(usage, buf1), Convert_bytes2str(limit, buf2), operatorshortnames[r->operator], r->limit);
+                                } else {
+                                        snprintf(report, STRLEN, "cgroup memory usage check succeeded [current cgroup memory usage = %.1f%% of %s limit]", percent, Convert_bytes2str(limit, buf2));
+                                }
+                        }
+                        break;
+
                 case Resource_Threads:
                         if (s->inf.process->threads < 0) {
                                 DEBUG("'%s' process threads count check skipped (initializing)\n", s->name);
                                 return State_Init;
-                        } else if (Util_evalDoubleQExpression(r->operator, s->inf.process->threads, r->limit)) {
+                        } else if (r->match(s->inf.process->threads, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "threads count %i matches resource limit [threads %s %.0f]", s->inf.process->threads, operatorshortnames[r->operator], r->limit);
                         } else {
@@ -307,7 +562,7 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
                         if (s->inf.process->children < 0) {
                                 DEBUG("'%s' process children count check skipped (initializing)\n", s->name);
                                 return State_Init;
-                        } else if (Util_evalDoubleQExpression(r->operator, s->inf.process->children, r->limit)) {
+                        } else if (r->match(s->inf.process->children, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "children count %i matches resource limit [children %s %.0f]", s->inf.process->children, operatorshortnames[r->operator], r->limit);
                         } else {
@@ -315,11 +570,30 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
                         }
                         break;
 
+                case Resource_Connections:
+                case Resource_ConnectionsEstablished:
+                case Resource_ConnectionsListen:
+                case Resource_ConnectionsCloseWait:
+                        {
+                                const char *name = r->resource_id == Resource_ConnectionsEstablished ? "established connections" : r->resource_id == Resource_ConnectionsListen ? "listening sockets" : r->resource_id == Resource_ConnectionsCloseWait ? "close wait connections" : "connections";
+                                int value = r->resource_id == Resource_ConnectionsEstablished ? s->inf.process->connections.established : r->resource_id == Resource_ConnectionsListen ? s->inf.process->connections.listen : r->resource_id == Resource_ConnectionsCloseWait ? s->inf.process->connections.closeWait : s->inf.process->connections.total;
+                                if (value < 0) {
+                                        DEBUG("'%s' process %s count check skipped (initializing)\n", s->name, name);
+                                        return State_Init;
+                                } else if (r->match(value, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "%s count %i matches resource limit [%s %s %.0f]", name, value, name, operatorshortnames[r->operator], r->limit);
+                                } else {
+                                        snprintf(report, STRLEN, "%s check succeeded [current %s = %i]", name, name, value);
+                                }
+                        }
+                        break;
+
                 case Resource_MemoryKbyteTotal:
                         if (s->inf.process->total_mem == 0) {
                                 DEBUG("'%s' process total memory usage check skipped (initializing)\n", s->name);
                                 return State_Init;
-                        } else if (Util_evalDoubleQExpression(r->operator, s->inf.process->total_mem, r->limit)) {
+                        } else if (r->match(s->inf.process->total_mem, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "total mem amount of %s matches resource limit [total mem amount %s %s]", Convert_bytes2str(s->inf.process->total_mem, buf1), operatorshortnames[r->operator], Convert_bytes2str(r->limit, buf2));
                         } else {
@@ -331,7 +605,7 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
                         if (s->inf.process->total_mem_percent < 0.) {
                                 DEBUG("'%s' total memory usage check skipped (initializing)\n", s->name);
                                 return State_Init;
-                        } else if (Util_evalDoubleQExpression(r->operator, s->inf.process->total_mem_percent, r->limit)) {
+                        } else if (r->match(s->inf.process->total_mem_percent, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "total mem amount of %.1f%% matches resource limit [total mem amount %s %.1f%%]", (float)s->inf.process->total_mem_percent, operatorshortnames[r->operator], (float)r->limit);
                         } else {
@@ -341,12 +615,13 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
 
                 case Resource_ReadBytes:
                         if (Statistics_initialized(&(s->inf.process->read.bytes))) {
-                                double value = Statistics_deltaNormalize(&(s->inf.process->read.bytes));
-                                if (Util_evalDoubleQExpression(r->operator, value, r->limit)) {
+                                double value = Statistics_rate(&(s->inf.process->read.bytes), r->statistic.function, r->statistic.percentile);
+                                const char *function = _rateFunction(&(r->statistic), (char[16]){});
+                                if (r->match(value, r->limit)) {
                                         rv = State_Failed;
-                                        snprintf(report, STRLEN, "read rate %s/s matches resource limit [read %s %s/s]", Convert_bytes2str(value, (char[10]){}), operatorshortnames[r->operator], Convert_bytes2str(r->limit, (char[10]){}));
+                                        snprintf(report, STRLEN, "read rate %s/s matches resource limit [read%s %s %s/s]", Convert_bytes2str(value, (char[10]){}), function, operatorshortnames[r->operator], Convert_bytes2str(r->limit, (char[10]){}));
                                 } else {
-                                        snprintf(report, STRLEN, "read rate test succeeded [current read = %s/s]", Convert_bytes2str(value, (char[10]){}));
+                                        snprintf(report, STRLEN, "read rate test succeeded [current read%s = %s/s]", function, Convert_bytes2str(value, (char[10]){}));
                                 }
                         } else {
                                 DEBUG("'%s' warning -- no data are available for bytes read rate test\n", s->name);
@@ -356,12 +631,13 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
 
                 case Resource_ReadBytesPhysical:
                         if (Statistics_initialized(&(s->inf.process->read.bytesPhysical))) {
-                                double value = Statistics_deltaNormalize(&(s->inf.process->read.bytesPhysical));
-                                if (Util_evalDoubleQExpression(r->operator, value, r->limit)) {
+                                double value = Statistics_rate(&(s->inf.process->read.bytesPhysical), r->statistic.function, r->statistic.percentile);
+                                const char *function = _rateFunction(&(r->statistic), (char[16]){});
+                                if (r->match(value, r->limit)) {
                                         rv = State_Failed;
-                                        snprintf(report, STRLEN, "physical read activity %s/s matches resource limit [read %s %s/s]", Convert_bytes2str(value, (char[10]){}), operatorshortnames[r->operator], Convert_bytes2str(r->limit, (char[10]){}));
+                                        snprintf(report, STRLEN, "physical read activity %s/s matches resource limit [read%s %s %s/s]", Convert_bytes2str(value, (char[10]){}), function, operatorshortnames[r->operator], Convert_bytes2str(r->limit, (char[10]){}));
                                 } else {
-                                        snprintf(report, STRLEN, "physical read activity test succeeded [current read = %s/s]", Convert_bytes2str(value, (char[10]){}));
+                                        snprintf(report, STRLEN, "physical read activity test succeeded [current read%s = %s/s]", function, Convert_bytes2str(value, (char[10]){}));
                                 }
                         } else {
                                 DEBUG("'%s' warning -- no data are available for physical read activity test\n", s->name);
@@ -371,12 +647,13 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
 
                 case Resource_ReadOperations:
                         if (Statistics_initialized(&(s->inf.process->read.operations))) {
-                                double value = Statistics_deltaNormalize(&(s->inf.process->read.operations));
-                                if (Util_evalDoubleQExpression(r->operator, value, r->limit)) {
+                                double value = Statistics_rate(&(s->inf.process->read.operations), r->statistic.function, r->statistic.percentile);
+                                const char *function = _rateFunction(&(r->statistic), (char[16]){});
+                                if (r->match(value, r->limit)) {
                                         rv = State_Failed;
-                                        snprintf(report, STRLEN, "read rate %.1f operations/s matches resource limit [read %s %.0f operations/s]", value, operatorshortnames[r->operator], r->limit);
+                                        snprintf(report, STRLEN, "read rate %.1f operations/s matches resource limit [read%s %s %.0f operations/s]", value, function, operatorshortnames[r->operator], r->limit);
                                 } else {
-                                        snprintf(report, STRLEN, "read rate test succeeded [current read = %.1f operations/s]", value);
+                                        snprintf(report, STRLEN, "read rate test succeeded [current read%s = %.1f operations/s]", function, value);
                                 }
                         } else {
                                 DEBUG("'%s' warning -- no data are available for read rate test\n", s->name);
@@ -386,12 +663,13 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
 
                 case Resource_WriteBytes:
                         if (Statistics_initialized(&(s->inf.process->write.bytes))) {
-                                double value = Statistics_deltaNormalize(&(s->inf.process->write.bytes));
-                                if (Util_evalDoubleQExpression(r->operator, value, r->limit)) {
+                                double value = Statistics_rate(&(s->inf.process->write.bytes), r->statistic.function, r->statistic.percentile);
+                                const char *function = _rateFunction(&(r->statistic), (char[16]){});
+                                if (r->match(value, r->limit)) {
                                         rv = State_Failed;
-                                        snprintf(report, STRLEN, "write rate %s/s matches resource limit [write %s %s/s]", Convert_bytes2str(value, (char[10]){}), operatorshortnames[r->operator], Convert_bytes2str(r->limit, (char[10]){}));
+                                        snprintf(report, STRLEN, "write rate %s/s matches resource limit [write%s %s %s/s]", Convert_bytes2str(value, (char[10]){}), function, operatorshortnames[r->operator], Convert_bytes2str(r->limit, (char[10]){}));
                                 } else {
-                                        snprintf(report, STRLEN, "write rate test succeeded [current write = %s/s]", Convert_bytes2str(value, (char[10]){}));
+                                        snprintf(report, STRLEN, "write rate test succeeded [current write%s = %s/s]", function, Convert_bytes2str(value, (char[10]){}));
                                 }
                         } else {
                                 DEBUG("'%s' warning -- no data are available for bytes write rate test\n", s->name);
@@ -401,12 +679,13 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
 
                 case Resource_WriteBytesPhysical:
                         if (Statistics_initialized(&(s->inf.process->write.bytesPhysical))) {
-                                double value = Statistics_deltaNormalize(&(s->inf.process->write.bytesPhysical));
-                                if (Util_evalDoubleQExpression(r->operator, value, r->limit)) {
+                                double value = Statistics_rate(&(s->inf.process->write.bytesPhysical), r->statistic.function, r->statistic.percentile);
+                                const char *function = _rateFunction(&(r->statistic), (char[16]){});
+                                if (r->match(value, r->limit)) {
                                         rv = State_Failed;
-                                        snprintf(report, STRLEN, "physical write activity %s/s matches resource limit [write %s %s/s]", Convert_bytes2str(value, (char[10]){}), operatorshortnames[r->operator], Convert_bytes2str(r->limit, (char[10]){}));
+                                        snprintf(report, STRLEN, "physical write activity %s/s matches resource limit [write%s %s %s/s]", Convert_bytes2str(value, (char[10]){}), function, operatorshortnames[r->operator], Convert_bytes2str(r->limit, (char[10]){}));
                                 } else {
-                                        snprintf(report, STRLEN, "physical write activity test succeeded [current write = %s/s]", Convert_bytes2str(value, (char[10]){}));
+                                        snprintf(report, STRLEN, "physical write activity test succeeded [current write%s = %s/s]", function, Convert_bytes2str(value, (char[10]){}));
                                 }
                         } else {
                                 DEBUG("'%s' warning -- no data are available for physical write activity test\n", s->name);
@@ -416,12 +695,13 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
 
                 case Resource_WriteOperations:
                         if (Statistics_initialized(&(s->inf.process->write.operations))) {
-                                double value = Statistics_deltaNormalize(&(s->inf.process->write.operations));
-                                if (Util_evalDoubleQExpression(r->operator, value, r->limit)) {
+                                double value = Statistics_rate(&(s->inf.process->write.operations), r->statistic.function, r->statistic.percentile);
+                                const char *function = _rateFunction(&(r->statistic), (char[16]){});
+                                if (r->match(value, r->limit)) {
                                         rv = State_Failed;
-                                        snprintf(report, STRLEN, "write rate %.1f operations/s matches resource limit [write %s %.0f operations/s]", value, operatorshortnames[r->operator], r->limit);
+                                        snprintf(report, STRLEN, "write rate %.1f operations/s matches resource limit [write%s %s %.0f operations/s]", value, function, operatorshortnames[r->operator], r->limit);
                                 } else {
-                                        snprintf(report, STRLEN, "write rate test succeeded [current write = %.1f operations/s]", value);
+                                        snprintf(report, STRLEN, "write rate test succeeded [current write%s = %.1f operations/s]", function, value);
                                 }
                         } else {
                                 DEBUG("'%s' warning -- no data are available for write rate test\n", s->name);
@@ -429,6 +709,60 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
                         }
                         break;
 
+                case Resource_TcpSent:
+                case Resource_TcpReceived:
+                        {
+                                Statistics_T statistics = r->resource_id == Resource_TcpSent ? &(s->inf.process->tcp.sent) : &(s->inf.process->tcp.received);
+                                const char *name = r->resource_id == Resource_TcpSent ? "sent" : "received";
+                                if (Statistics_initialized(statistics)) {
+                                        double value = Statistics_rate(statistics, r->statistic.function, r->statistic.percentile);
+                                        const char *function = _rateFunction(&(r->statistic), (char[16]){});
+                                        if (r->match(value, r->limit)) {
+                                                rv = State_Failed;
+                                                snprintf(report, STRLEN, "tcp %s activity %s/s matches resource limit [tcp %s%s %s %s/s]", name, Convert_bytes2str(value, (char[10]){}), name, function, operatorshortnames[r->operator], Convert_bytes2str(r->limit, (char[10]){}));
+                                        } else {
+                                                snprintf(report, STRLEN, "tcp %s activity test succeeded [current tcp %s%s = %s/s]", name, name, function, Convert_bytes2str(value, (char[10]){}));
+                                        }
+                                } else {
+                                        DEBUG("'%s' warning -- no data are available for tcp %s activity test\n", s->name, name);
+                                        return State_Init;
+                                }
+                        }
+                        break;
+
+                case Resource_IoDelay:
+                        if (Statistics_initialized(&(s->inf.process->ioDelay))) {
+                                // The delay [ns] per second of the wall time in percent
+                                double value = Statistics_rate(&(s->inf.process->ioDelay), r->statistic.function, r->statistic.percentile) / 1e7;
+                                const char *function = _rateFunction(&(r->statistic), (char[16]){});
+                                if (r->match(value, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "io delay of %.1f%% matches resource limit [io delay%s %s %.1f%%]", value, function, operatorshortnames[r->operator], r->limit);
+                                } else {
+                                        snprintf(report, STRLEN, "io delay check succeeded [current io delay%s = %.1f%%]", function, value);
+                                }
+                        } else {
+                                DEBUG("'%s' warning -- no data are available for io delay test\n", s->name);
+                                return State_Init;
+                        }
+                        break;
+
+                case Resource_PressureCpuSome:
+                case Resource_PressureCpuFull:
+                case Resource_PressureMemorySome:
+                case Resource_PressureMemoryFull:
+                case Resource_PressureIoSome:
+                case Resource_PressureIoFull:
+                        {
+                                Pressure_T pressure[Pressure_Count];
+                                int type = (r->resource_id - Resource_PressureCpuSome) / 2;
+                                if (! Cgroup_pressure(s->inf.process->pid, type, &pressure[type]))
+                                        DEBUG("'%s' cannot read the cgroup pressure of the process %d\n", s->name, s->inf.process->pid);
+                                if ((rv = _checkPressure(s, r, pressure, report)) == State_Init)
+                                        return State_Init;
+                        }
+                        break;
+
                 default:
                         Log_error("'%s' error -- unknown resource ID: [%d]\n", s->name, r->resource_id);
                         return State_Failed;
@@ -439,7 +773,7 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
 
 
 static State_Type _checkLoadAverage(Resource_T r, double loadavg, const char *name, char report[STRLEN]) {
-        if (Util_evalDoubleQExpression(r->operator, loadavg, r->limit)) {
+        if (r->match(loadavg, r->limit)) {
                 snprintf(report, STRLEN, "%s of %.1f matches resource limit [%s %s %.1f]", name, loadavg, name, operatorshortnames[r->operator], r->limit);
                 return State_Failed;
         }
@@ -448,6 +782,39 @@ static State_Type _checkLoadAverage(Resource_T r, double loadavg, const char *na
 }
 
 
+/**
+ * Test the usage of each CPU or NUMA node. The test fails if any of them matches the limit, the report
+ * names the one with the highest usage among the matching ones (or among all if none matched)
+ */
+static State_Type _checkCpuSpread(Service_T s, Resource_T r, const float *usage, int count, const char *name, char report[STRLEN]) {
+        int worst = -1;
+        bool failed = false;
+        for (int i = 0; i < count; i++) {
+                if (usage[i] < 0.) {
+                        DEBUG("'%s' cpu usage per %s check skipped (initializing)\n", s->name, name);
+                        return State_Init;
+                }
+                if (r->match(usage[i], r->limit)) {
+                        if (! failed || usage[i] > usage[worst])
+                                worst = i;
+                        failed = true;
+                } else if (! failed && (worst < 0 || usage[i] > usage[worst])) {
+                        worst = i;
+                }
+        }
+        if (worst < 0) {
+                DEBUG("'%s' cpu usage per %s check skipped (no data)\n", s->name, name);
+                return State_Init;
+        }
+        if (failed) {
+                snprintf(report, STRLEN, "cpu usage of %.1f%% on %s %d matches resource limit [cpu usage per %s %s %.1f%%]", usage[worst], name, worst, name, operatorshortnames[r->operator], r->limit);
+                return State_Failed;
+        }
+        snprintf(report, STRLEN, "cpu usage per %s check succeeded [highest usage = %.1f%% on %s %d]", name, usage[worst], name, worst);
+        return State_Succeeded;
+}
+
+
 static State_Type _checkSystemResources(Service_T s, Resource_T r) {
         ASSERT(s);
         ASSERT(r);
@@ -462,7 +829,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                                 if (cpu < 0.) {
                                         DEBUG("'%s' cpu usage check skipped (initializing)\n", s->name);
                                         return State_Init;
-                                } else if (Util_evalDoubleQExpression(r->operator, cpu, r->limit)) {
+                                } else if (r->match(cpu, r->limit)) {
                                         rv = State_Failed;
                                         snprintf(report, STRLEN, "cpu usage of %.1f%% matches resource limit [cpu usage %s %.1f%%]", cpu, operatorshortnames[r->operator], r->limit);
                                 } else {
@@ -475,7 +842,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                         if (systeminfo.cpu.usage.user < 0.) {
                                 DEBUG("'%s' cpu user usage check skipped (initializing)\n", s->name);
                                 return State_Init;
-                        } else if (Util_evalDoubleQExpression(r->operator, systeminfo.cpu.usage.user, r->limit)) {
+                        } else if (r->match(systeminfo.cpu.usage.user, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "cpu user usage of %.1f%% matches resource limit [cpu user usage %s %.1f%%]", systeminfo.cpu.usage.user, operatorshortnames[r->operator], r->limit);
                         } else {
@@ -487,7 +854,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                         if (systeminfo.cpu.usage.system < 0.) {
                                 DEBUG("'%s' cpu system usage check skipped (initializing)\n", s->name);
                                 return State_Init;
-                        } else if (Util_evalDoubleQExpression(r->operator, systeminfo.cpu.usage.system, r->limit)) {
+                        } else if (r->match(systeminfo.cpu.usage.system, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "cpu system usage of %.1f%% matches resource limit [cpu system usage %s %.1f%%]", systeminfo.cpu.usage.system, operatorshortnames[r->operator], r->limit);
                         } else {
@@ -500,7 +867,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                                 if (systeminfo.cpu.usage.iowait < 0.) {
                                         DEBUG("'%s' cpu I/O wait check skipped (initializing)\n", s->name);
                                         return State_Init;
-                                } else if (Util_evalDoubleQExpression(r->operator, systeminfo.cpu.usage.iowait, r->limit)) {
+                                } else if (r->match(systeminfo.cpu.usage.iowait, r->limit)) {
                                         rv = State_Failed;
                                         snprintf(report, STRLEN, "cpu I/O wait of %.1f%% matches resource limit [cpu I/O wait %s %.1f%%]", systeminfo.cpu.usage.iowait, operatorshortnames[r->operator], r->limit);
                                 } else {
@@ -516,7 +883,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                                 if (systeminfo.cpu.usage.nice < 0.) {
                                         DEBUG("'%s' cpu nice usage check skipped (initializing)\n", s->name);
                                         return State_Init;
-                                } else if (Util_evalDoubleQExpression(r->operator, systeminfo.cpu.usage.nice, r->limit)) {
+                                } else if (r->match(systeminfo.cpu.usage.nice, r->limit)) {
                                         rv = State_Failed;
                                         snprintf(report, STRLEN, "cpu nice usage of %.1f%% matches resource limit [cpu nice usage %s %.1f%%]", systeminfo.cpu.usage.nice, operatorshortnames[r->operator], r->limit);
                                 } else {
@@ -532,7 +899,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                                 if (systeminfo.cpu.usage.hardirq < 0.) {
                                         DEBUG("'%s' cpu hardware IRQ usage check skipped (initializing)\n", s->name);
                                         return State_Init;
-                                } else if (Util_evalDoubleQExpression(r->operator, systeminfo.cpu.usage.hardirq, r->limit)) {
+                                } else if (r->match(systeminfo.cpu.usage.hardirq, r->limit)) {
                                         rv = State_Failed;
                                         snprintf(report, STRLEN, "cpu hardware IRQ usage of %.1f%% matches resource limit [cpu hardware IRQ usage %s %.1f%%]", systeminfo.cpu.usage.hardirq, operatorshortnames[r->operator], r->limit);
                                 } else {
@@ -548,7 +915,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                                 if (systeminfo.cpu.usage.softirq < 0.) {
                                         DEBUG("'%s' cpu software IRQ usage check skipped (initializing)\n", s->name);
                                         return State_Init;
-                                } else if (Util_evalDoubleQExpression(r->operator, systeminfo.cpu.usage.softirq, r->limit)) {
+                                } else if (r->match(systeminfo.cpu.usage.softirq, r->limit)) {
                                         rv = State_Failed;
                                         snprintf(report, STRLEN, "cpu software IRQ usage of %.1f%% matches resource limit [cpu software IRQ usage %s %.1f%%]", systeminfo.cpu.usage.softirq, operatorshortnames[r->operator], r->limit);
                                 } else {
@@ -564,7 +931,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                                 if (systeminfo.cpu.usage.steal < 0.) {
                                         DEBUG("'%s' cpu steal usage check skipped (initializing)\n", s->name);
                                         return State_Init;
-                                } else if (Util_evalDoubleQExpression(r->operator, systeminfo.cpu.usage.steal, r->limit)) {
+                                } else if (r->match(systeminfo.cpu.usage.steal, r->limit)) {
                                         rv = State_Failed;
                                         snprintf(report, STRLEN, "cpu steal usage of %.1f%% matches resource limit [cpu steal usage %s %.1f%%]", systeminfo.cpu.usage.steal, operatorshortnames[r->operator], r->limit);
                                 } else {
@@ -580,7 +947,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                                 if (systeminfo.cpu.usage.guest < 0.) {
                                         DEBUG("'%s' cpu guest usage check skipped (initializing)\n", s->name);
                                         return State_Init;
-                                } else if (Util_evalDoubleQExpression(r->operator, systeminfo.cpu.usage.guest, r->limit)) {
+                                } else if (r->match(systeminfo.cpu.usage.guest, r->limit)) {
                                         rv = State_Failed;
                                         snprintf(report, STRLEN, "cpu guest usage of %.1f%% matches resource limit [cpu guest usage %s %.1f%%]", systeminfo.cpu.usage.guest, operatorshortnames[r->operator], r->limit);
                                 } else {
@@ -596,7 +963,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                                 if (systeminfo.cpu.usage.guest_nice < 0.) {
                                         DEBUG("'%s' cpu guest nice usage check skipped (initializing)\n", s->name);
                                         return State_Init;
-                                } else if (Util_evalDoubleQExpression(r->operator, systeminfo.cpu.usage.guest_nice, r->limit)) {
+                                } else if (r->match(systeminfo.cpu.usage.guest_nice, r->limit)) {
                                         rv = State_Failed;
                                         snprintf(report, STRLEN, "cpu guest nice usage of %.1f%% matches resource limit [cpu guest nice usage %s %.1f%%]", systeminfo.cpu.usage.guest_nice, operatorshortnames[r->operator], r->limit);
                                 } else {
@@ -608,7 +975,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                         break;
 
                 case Resource_MemoryPercent:
-                        if (Util_evalDoubleQExpression(r->operator, systeminfo.memory.usage.percent, r->limit)) {
+                        if (r->match(systeminfo.memory.usage.percent, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "mem usage of %.1f%% matches resource limit [mem usage %s %.1f%%]", systeminfo.memory.usage.percent, operatorshortnames[r->operator], r->limit);
                         } else {
@@ -617,7 +984,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                         break;
 
                 case Resource_MemoryKbyte:
-                        if (Util_evalDoubleQExpression(r->operator, systeminfo.memory.usage.bytes, r->limit)) {
+                        if (r->match(systeminfo.memory.usage.bytes, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "mem amount of %s matches resource limit [mem amount %s %s]", Convert_bytes2str(systeminfo.memory.usage.bytes, buf1), operatorshortnames[r->operator], Convert_bytes2str(r->limit, buf2));
                         } else {
@@ -625,8 +992,21 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                         }
                         break;
 
+                case Resource_HugepagesPercent:
+                        if (systeminfo.memory.hugepages.size > 0ULL) {
+                                if (r->match(systeminfo.memory.hugepages.usage.percent, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "hugepages usage of %.1f%% matches resource limit [hugepages usage %s %.1f%%]", systeminfo.memory.hugepages.usage.percent, operatorshortnames[r->operator], r->limit);
+                                } else {
+                                        snprintf(report, STRLEN, "hugepages usage check succeeded [current hugepages usage = %.1f%%]", systeminfo.memory.hugepages.usage.percent);
+                                }
+                        } else {
+                                Log_warning("Cannot test hugepages usage as no hugepages pool is configured on this system\n");
+                        }
+                        break;
+
                 case Resource_SwapPercent:
-                        if (Util_evalDoubleQExpression(r->operator, systeminfo.swap.usage.percent, r->limit)) {
+                        if (r->match(systeminfo.swap.usage.percent, r->limit)) {
                                 rv = State_Failed;
                                 snprintf(report, STRLEN, "swap usage of %.1f%% matches resource limit [swap usage %s %.1f%%]", systeminfo.swap.usage.percent, operatorshortnames[r->operator], r->limit);
                         } else {
@@ -636,7 +1016,7 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
 
                 case Resource_SwapKbyte:
                         if (s->type == Service_System) {
-                                if (Util_evalDoubleQExpression(r->operator, systeminfo.swap.usage.bytes, r->limit)) {
+                                if (r->match(systeminfo.swap.usage.bytes, r->limit)) {
                                         rv = State_Failed;
                                         snprintf(report, STRLEN, "swap amount of %s matches resource limit [swap amount %s %s]", Convert_bytes2str(systeminfo.swap.usage.bytes, buf1), operatorshortnames[r->operator], Convert_bytes2str(r->limit, buf2));
                                 } else {
@@ -669,6 +1049,34 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
                         rv = _checkLoadAverage(r, systeminfo.loadavg[2] / (double)systeminfo.cpu.count, "loadavg per core (15min)", report);
                         break;
 
+                case Resource_CpuPerCore:
+                        if (systeminfo.statisticsAvailable & Statistics_CpuPerCore) {
+                                if ((rv = _checkCpuSpread(s, r, systeminfo.cpu.cores.usage, systeminfo.cpu.cores.count, "core", report)) == State_Init)
+                                        return State_Init;
+                        } else {
+                                Log_warning("Cannot test cpu usage per core as the statistics is not available on this system\n");
+                        }
+                        break;
+
+                case Resource_CpuPerNode:
+                        if (systeminfo.statisticsAvailable & Statistics_CpuPerNode) {
+                                if ((rv = _checkCpuSpread(s, r, systeminfo.cpu.nodes.usage, systeminfo.cpu.nodes.count, "numa node", report)) == State_Init)
+                                        return State_Init;
+                        } else {
+                                Log_warning("Cannot test cpu usage per numa node as the statistics is not available on this system\n");
+                        }
+                        break;
+
+                case Resource_PressureCpuSome:
+                case Resource_PressureCpuFull:
+                case Resource_PressureMemorySome:
+                case Resource_PressureMemoryFull:
+                case Resource_PressureIoSome:
+                case Resource_PressureIoFull:
+                        if ((rv = _checkPressure(s, r, systeminfo.pressure, report)) == State_Init)
+                                return State_Init;
+                        break;
+
                 default:
                         Log_error("'%s' error -- unknown resource ID: [%d]\n", s->name, r->resource_id);
                         return State_Failed;
@@ -678,6 +1086,48 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
 }
 
 
+static void _fingerprint(struct stat *stat_buf, Fingerprint_T *fingerprint) {
+        fingerprint->inode = (unsigned long long)stat_buf->st_ino;
+        fingerprint->size = (unsigned long long)stat_buf->st_size;
+#if defined HAVE_STRUCT_STAT_ST_MTIM
+        fingerprint->mtime = (unsigned long long)stat_buf->st_mtim.tv_sec * 1000000000ULL + (unsigned long long)stat_buf->st_mtim.tv_nsec;
+        fingerprint->ctime = (unsigned long long)stat_buf->st_ctim.tv_sec * 1000000000ULL + (unsigned long long)stat_buf->st_ctim.tv_nsec;
+#elif defined HAVE_STRUCT_STAT_ST_MTIMESPEC
+        fingerprint->mtime = (unsigned long long)stat_buf->st_mtimespec.tv_sec * 1000000000ULL + (unsigned long long)stat_buf->st_mtimespec.tv_nsec;
+        fingerprint->ctime = (unsigned long long)stat_buf->st_ctimespec.tv_sec * 1000000000ULL + (unsigned long long)stat_buf->st_ctimespec.tv_nsec;
+#else
+        fingerprint->mtime = (unsigned long long)stat_buf->st_mtime * 1000000000ULL;
+        fingerprint->ctime = (unsigned long long)stat_buf->st_ctime * 1000000000ULL;
+#endif
+}
+
+
+/**
+ * Compute the checksum if the file fingerprint changed since the last computation or the verification interval elapsed
+ * @return true if the checksum in the file info is current
+ */
+static bool _computeChecksum(Service_T s) {
+        Checksum_T cs = s->checksum;
+        FileInfo_T inf = s->inf.file;
+        cs->cycles++;
+        if (*inf->cs_sum && inf->cs_fingerprint.inode && ! memcmp(&inf->fingerprint, &inf->cs_fingerprint, sizeof(Fingerprint_T)) && (! cs->verify || cs->cycles < cs->verify)) {
+                DEBUG("'%s' checksum computation skipped -- the file didn't change\n", s->name);
+                return true;
+        }
+        cs->cycles = 0;
+        if (Checksum_getChecksum(s->path, cs->type, inf->cs_sum, sizeof(inf->cs_sum))) {
+                // If the file was modified in the current second, it may change again without timestamp change (coarse filesystem timestamp granularity) => don't trust the fingerprint
+                if (inf->fingerprint.mtime / 1000000000ULL < (unsigned long long)Time_now())
+                        inf->cs_fingerprint = inf->fingerprint;
+                else
+                        inf->cs_fingerprint = (Fingerprint_T){};
+                return true;
+        }
+        inf->cs_fingerprint = (Fingerprint_T){};
+        return false;
+}
+
+
 /**
  * Test for associated path checksum change
  */
@@ -687,7 +1137,7 @@ static State_Type _checkChecksum(Service_T s) {
         State_Type rv = State_Succeeded;
         if (s->checksum) {
                 Checksum_T cs = s->checksum;
-                if (Checksum_getChecksum(s->path, cs->type, s->inf.file->cs_sum, sizeof(s->inf.file->cs_sum))) {
+                if (_computeChecksum(s)) {
                         Event_post(s, Event_Data, State_Succeeded, s->action_DATA, "checksum %s", s->inf.file->cs_sum);
                         if (! cs->initialized) {
                                 cs->initialized = true;
@@ -701,6 +1151,9 @@ static State_Type _checkChecksum(Service_T s) {
                                 case Hash_Sha1:
                                         changed = strncmp(cs->hash, s->inf.file->cs_sum, 40);
                                         break;
+                                case Hash_Sha256:
+                                        changed = strncmp(cs->hash, s->inf.file->cs_sum, 64);
+                                        break;
                                 default:
                                         Log_error("'%s' unknown hash type (%d)\n", s->name, cs->type);
                                         *s->inf.file->cs_sum = 0;
@@ -727,6 +1180,7 @@ static State_Type _checkChecksum(Service_T s) {
                         return rv;
                 }
                 Event_post(s, Event_Data, State_Failed, s->action_DATA, "cannot compute checksum for %s", s->path);
+                FileEvent_invalidate(s);
                 return State_Failed;
         }
         return rv;
@@ -944,7 +1398,7 @@ static State_Type _checkTimestamp(Service_T s, Timestamp_T t, time_t timestamp)
 /**
  * Validate timestamps of a service s
  */
-static State_Type _checkTimestamps(Service_T s, time_t atime, time_t ctime, time_t mtime) {
+static State_Type _checkTimestamps(Service_T s, time_t atime, time_t ctime, time_t mtime, time_t oldest, time_t newest) {
         ASSERT(s);
         if (atime > 0 && ctime > 0 && mtime > 0) {
                 State_Type rv;
@@ -960,6 +1414,17 @@ static State_Type _checkTimestamps(Service_T s, time_t atime, time_t ctime, time
                                 case Timestamp_Modification:
                                         rv = _checkTimestamp(s, t, mtime);
                                         break;
+                                case Timestamp_Oldest:
+                                        // No files in the tree or the tree statistics are not available
+                                        if (oldest <= 0)
+                                                continue;
+                                        rv = _checkTimestamp(s, t, oldest);
+                                        break;
+                                case Timestamp_Newest:
+                                        if (newest <= 0)
+                                                continue;
+                                        rv = _checkTimestamp(s, t, newest);
+                                        break;
                                 default:
                                         rv = _checkTimestamp(s, t, MAX(mtime, ctime));
                                         break;
@@ -976,6 +1441,24 @@ static State_Type _checkTimestamps(Service_T s, time_t atime, time_t ctime, time
 }
 
 
+/**
+ * Test the number of files in the directory tree
+ */
+static State_Type _checkFileCount(Service_T s, unsigned long long files) {
+        ASSERT(s);
+        State_Type rv = State_Succeeded;
+        for (FileCount_T fc = s->filecountlist; fc; fc = fc->next) {
+                if (Util_evalQExpression(fc->operator, files, fc->limit)) {
+                        rv = State_Failed;
+                        Event_post(s, Event_Resource, State_Failed, fc->action, "file count of %llu matches resource limit [file count %s %llu]", files, operatorshortnames[fc->operator], fc->limit);
+                } else {
+                        Event_post(s, Event_Resource, State_Succeeded, fc->action, "file count test succeeded [current file count = %llu]", files);
+                }
+        }
+        return rv;
+}
+
+
 /**
  * Test size
  */
@@ -986,8 +1469,23 @@ static State_Type _checkSize(Service_T s, off_t size) {
                 if (s->sizelist) {
                         char buf[10];
                         for (Size_T sl = s->sizelist; sl; sl = sl->next) {
-                                /* if we are testing for changes only, the value is variable */
-                                if (sl->test_changes) {
+                                if (sl->growth) {
+                                        /* the growth rate is computed from the size in the last cycle */
+                                        long long now = Time_monotonicMilli();
+                                        if (sl->initialized && now > sl->lastTime) {
+                                                unsigned long long growth = (unsigned long long)size > sl->lastSize ? (unsigned long long)(((unsigned long long)size - sl->lastSize) * (sl->growth * 1000.) / (now - sl->lastTime)) : 0ULL;
+                                                if (Util_evalQExpression(sl->operator, growth, sl->size)) {
+                                                        rv = State_Failed;
+                                                        Event_post(s, Event_Size, State_Failed, sl->action, "size growth test failed for %s -- current growth is %s per %s", s->path, Convert_bytes2str(growth, buf), Convert_time2str(sl->growth * 1000., (char[11]){}));
+                                                } else {
+                                                        Event_post(s, Event_Size, State_Succeeded, sl->action, "size growth check succeeded [current growth = %s per %s]", Convert_bytes2str(growth, buf), Convert_time2str(sl->growth * 1000., (char[11]){}));
+                                                }
+                                        }
+                                        sl->initialized = true;
+                                        sl->lastSize = size;
+                                        sl->lastTime = now;
+                                } else if (sl->test_changes) {
+                                        /* if we are testing for changes only, the value is variable */
                                         if (! sl->initialized) {
                                                 /* the size was not initialized during monit start, so set the size now
                                                  * and allow further size change testing */
@@ -1021,6 +1519,53 @@ static State_Type _checkSize(Service_T s, off_t size) {
 }
 
 
+/**
+ * Test the certificate expiry. The certificate is parsed again only if the file fingerprint changed
+ */
+static State_Type _checkCertificate(Service_T s) {
+        ASSERT(s);
+        State_Type rv = State_Succeeded;
+#ifdef HAVE_OPENSSL
+        FileInfo_T inf = s->inf.file;
+        for (Certificate_T c = s->certificatelist; c; c = c->next) {
+                char error[EXCEPTION_MESSAGE_LENGTH + 1] = {};
+                if (! c->fingerprint.inode || memcmp(&inf->fingerprint, &c->fingerprint, sizeof(Fingerprint_T))) {
+                        TRY
+                        {
+                                c->expiry = Ssl_getCertificateFileExpiry(s->path);
+                                // If the file was modified in the current second, it may change again without timestamp change (coarse filesystem timestamp granularity) => don't trust the fingerprint
+                                c->fingerprint = inf->fingerprint.mtime / 1000000000ULL < (unsigned long long)Time_now() ? inf->fingerprint : (Fingerprint_T){};
+                        }
+                        ELSE
+                        {
+                                c->expiry = 0;
+                                c->fingerprint = (Fingerprint_T){};
+                                snprintf(error, sizeof(error), "%s", Exception_frame.message);
+                        }
+                        END_TRY;
+                }
+                if (*error) {
+                        rv = State_Failed;
+                        Event_post(s, Event_Timestamp, State_Failed, c->action, "certificate test failed -- %s", error);
+                } else {
+                        long long seconds = (long long)c->expiry - (long long)Time_now();
+                        int days = (int)(seconds / 86400);
+                        if (seconds < 0) {
+                                rv = State_Failed;
+                                Event_post(s, Event_Timestamp, State_Failed, c->action, "certificate expired %d days ago", -days);
+                        } else if (days < c->minimumDays) {
+                                rv = State_Failed;
+                                Event_post(s, Event_Timestamp, State_Failed, c->action, "certificate expiry in %d days matches check limit [valid > %d days]", days, c->minimumDays);
+                        } else {
+                                Event_post(s, Event_Timestamp, State_Succeeded, c->action, "certificate valid days test succeeded [valid for %d days]", days);
+                        }
+                }
+        }
+#endif
+        return rv;
+}
+
+
 /**
  * Test uptime
  */
@@ -1041,136 +1586,271 @@ static State_Type _checkUptime(Service_T s, long long uptime) {
 }
 
 
-static int _checkPattern(Match_T pattern, const char *line) {
-        return regexec(pattern->regex_comp, line, 0, NULL, 0);
+/**
+ * Test one content line against the ignore and match patterns
+ */
+static void _checkMatchLine(Service_T s, const char *line) {
+        // Find the literals of all patterns in one pass, the regex runs only if the line contains the pattern's literal
+        ContentMatch_scan(s->contentMatch, line);
+        /* Check ignores */
+        for (Match_T ml = s->matchignorelist; ml; ml = ml->next) {
+                if ((ContentMatch_test(s->contentMatch, ml, line) == 0) ^ (ml->not)) {
+                        /* We match! -> line is ignored! */
+                        DEBUG("'%s' Ignore pattern %s'%s' match on content line\n", s->name, ml->not ? "not " : "", ml->match_string);
+                        return;
+                }
+        }
+        /* Check non ignores */
+        for (Match_T ml = s->matchlist; ml; ml = ml->next) {
+                if ((ContentMatch_test(s->contentMatch, ml, line) == 0) ^ (ml->not)) {
+                        DEBUG("'%s' Pattern %s'%s' match on content line [%s]\n", s->name, ml->not ? "not " : "", ml->match_string, line);
+                        /* Save the line for Event_post */
+                        if (! ml->log)
+                                ml->log = StringBuffer_create((int)Run.limits.fileContentBuffer);
+                        if ((size_t)StringBuffer_length(ml->log) < Run.limits.fileContentBuffer) {
+                                StringBuffer_append(ml->log, "%s\n", line);
+                                if ((size_t)StringBuffer_length(ml->log) >= Run.limits.fileContentBuffer)
+                                        StringBuffer_append(ml->log, "...\n");
+                        }
+                } else {
+                        DEBUG("'%s' Pattern %s'%s' doesn't match on content line [%s]\n", s->name, ml->not ? "not " : "", ml->match_string, line);
+                }
+        }
 }
 
 
 /**
- * Match content.
- *
- * The test compares only the lines terminated with \n.
- *
- * In the case that line with missing \n is read, the test stops, as we suppose that the file contains only partial line and the rest of it is yet stored in the buffer of the application which writes to the file.
- * The test will resume at the beginning of the incomplete line during the next cycle, allowing the writer to finish the write.
- *
- * We test only Run.limits.fileContentBuffer at maximum - in the case that the line is bigger, we read the rest of the line (till '\n') but ignore the characters past the maximum
+ * Post process the matches: generate events for particular patterns
  */
-static State_Type _checkMatch(Service_T s) {
-        ASSERT(s);
-        /* TODO: https://bitbucket.org/tildeslash/monit/issues/401 Refactor and use mmap instead of naive std file io.
-         mmap can make code simpler, more efficient and support multi-line matching as there is no line-buffer, but the
-         whole file is in the buffer.
-         */
-        State_Type rv = State_Succeeded;
-        if (s->matchlist) {
-                FILE *file = fopen(s->path, "r");
-                if (! file) {
-                        Log_error("'%s' cannot open file %s: %s\n", s->name, s->path, STRERROR);
-                        return State_Failed;
-                }
-                /* FIXME: Refactor: Initialize the filesystems table ahead of file and filesystems test and index it by device id + replace the Str_startsWith() with lookup to the table by device id (obtained via file's stat()).
-                 The central filesystems initialization will allow to reduce the statfs() calls in the case that there will be multiple file and/or filesystems tests for the same fs. Temporarily we go with
-                 dummy Str_startsWith() as quick fix which will cover 99.9% of use cases without rising the statfs overhead if statfs call would be inlined here.
-                 */
-                if (Str_startsWith(s->path, "/proc")) {
-                        s->inf.file->readpos = 0;
-                } else {
-                        /* If inode changed or size shrunk -> set read position = 0 */
-                        if (s->inf.file->inode != s->inf.file->inode_prev || s->inf.file->readpos > s->inf.file->size)
-                                s->inf.file->readpos = 0;
-                        /* Do we need to match? Even if not, go to final, so we can reset the content match error flags in this cycle */
-                        if (s->inf.file->readpos == s->inf.file->size) {
-                                DEBUG("'%s' content match skipped - file size nor inode has not changed since last test\n", s->name);
-                                goto final1;
+static State_Type _postMatches(Service_T s, State_Type rv) {
+        for (Match_T ml = s->matchlist; ml; ml = ml->next) {
+                if (ml->log) {
+                        rv = State_Changed;
+                        Event_post(s, Event_Content, State_Changed, ml->action, "content match:\n%s", StringBuffer_toString(ml->log));
+                        if (ml->log) {
+                                // If the service has dependants, the dependant tests if the parent service (file) is running with no errors before it'll be allowed to start. That recursive check_file() call will
+                                // enter the _checkMatch() too and will free the SringBuffer as part of Event_post => must check ml->log here again before free
+                                StringBuffer_free(&ml->log);
                         }
+                } else {
+                        Event_post(s, Event_Content, State_ChangedNot, ml->action, "content doesn't match");
                 }
-                char *line = CALLOC(sizeof(unsigned char), Run.limits.fileContentBuffer);
-                while (true) {
-next:
-                        /* Seek to the read position */
-                        if (fseek(file, (long)s->inf.file->readpos, SEEK_SET)) {
-                                rv = State_Failed;
-                                Log_error("'%s' cannot seek file %s: %s\n", s->name, s->path, STRERROR);
-                                goto final2;
+        }
+        return rv;
+}
+
+
+/**
+ * Read the file content from the read position and test the lines. If drain is true, the file is a rotated log which won't be written to anymore: the read limit
+ * doesn't apply and the incomplete line at the end of the file is tested too.
+ */
+static bool _readContent(Service_T s, int fd, off_t *readpos, bool drain) {
+        bool rv = true;
+        size_t limit = Run.limits.fileContentBuffer, capacity = limit + CONTENTBLOCKSIZE, length = 0, budget = 0;
+        char *buffer = ALLOC(capacity);
+        off_t position = *readpos;             // File offset of buffer[0]
+        off_t dropped = 0;                     // Bytes of the (too long) line at buffer[0] which didn't fit in the buffer
+        bool progress = false;                 // A line was tested, the read limit may stop the test (a line longer than the limit must not stall it)
+        while (true) {
+                size_t size = capacity - length;
+                if (Run.limits.fileContentBudget && ! drain) {
+                        if (budget < Run.limits.fileContentBudget) {
+                                if (size > Run.limits.fileContentBudget - budget)
+                                        size = Run.limits.fileContentBudget - budget;
+                        } else if (progress) {
+                                DEBUG("'%s' content match: read limit of %s per cycle reached, the rest of the file will be tested in the next cycle\n", s->name, Convert_bytes2str(Run.limits.fileContentBudget, (char[10]){}));
+                                break;
                         }
-                        if (! fgets(line, (int)Run.limits.fileContentBuffer, file)) {
-                                if (! feof(file)) {
-                                        rv = State_Failed;
-                                        Log_error("'%s' cannot read file %s: %s\n", s->name, s->path, STRERROR);
-                                }
-                                goto final2;
-                        }
-                        size_t length = strlen(line);
-                        if (length == 0) {
-                                /* No content: shouldn't happen - empty line will contain at least '\n' */
-                                goto final2;
-                        } else if (line[length - 1] != '\n') {
-                                if (length < (size_t)(Run.limits.fileContentBuffer - 1)) {
-                                        /* Incomplete line: we gonna read it next time again, allowing the writer to complete the write */
-                                        DEBUG("'%s' content match: incomplete line read - no new line at end. (retrying next cycle)\n", s->name);
-                                        goto final2;
-                                } else if (length >= Run.limits.fileContentBuffer - 1) {
-                                        /* Our read buffer is full: ignore the content past the Run.limits.fileContentBuffer */
-                                        int _rv;
-                                        do {
-                                                if ((_rv = fgetc(file)) == EOF)
-                                                        goto final2;
-                                                length++;
-                                        } while (_rv != '\n');
-                                }
-                        } else {
-                                /* Remove trailing newline */
-                                line[length - 1] = 0;
-                        }
-                        /* Set read position to the end of last read */
-                        s->inf.file->readpos += length;
-                        /* Check ignores */
-                        for (Match_T ml = s->matchignorelist; ml; ml = ml->next) {
-                                if ((_checkPattern(ml, line) == 0) ^ (ml->not)) {
-                                        /* We match! -> line is ignored! */
-                                        DEBUG("'%s' Ignore pattern %s'%s' match on content line\n", s->name, ml->not ? "not " : "", ml->match_string);
-                                        goto next;
-                                }
-                        }
-                        /* Check non ignores */
-                        for (Match_T ml = s->matchlist; ml; ml = ml->next) {
-                                if ((_checkPattern(ml, line) == 0) ^ (ml->not)) {
-                                        DEBUG("'%s' Pattern %s'%s' match on content line [%s]\n", s->name, ml->not ? "not " : "", ml->match_string, line);
-                                        /* Save the line for Event_post */
-                                        if (! ml->log)
-                                                ml->log = StringBuffer_create((int)Run.limits.fileContentBuffer);
-                                        if ((size_t)StringBuffer_length(ml->log) < Run.limits.fileContentBuffer) {
-                                                StringBuffer_append(ml->log, "%s\n", line);
-                                                if ((size_t)StringBuffer_length(ml->log) >= Run.limits.fileContentBuffer)
-                                                        StringBuffer_append(ml->log, "...\n");
-                                        }
+                }
+                ssize_t n = pread(fd, buffer + length, size, position + dropped + length);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        rv = false;
+                        Log_error("'%s' cannot read file %s: %s\n", s->name, s->path, STRERROR);
+                        break;
+                } else if (n == 0) {
+                        if (length) {
+                                if (drain) {
+                                        buffer[length] = 0;
+                                        _checkMatchLine(s, buffer);
+                                        position += length + dropped;
                                 } else {
-                                        DEBUG("'%s' Pattern %s'%s' doesn't match on content line [%s]\n", s->name, ml->not ? "not " : "", ml->match_string, line);
+                                        /* End of file: if there is an incomplete line (no new line at end), we gonna read it next time again, allowing the writer to complete the write */
+                                        DEBUG("'%s' content match: incomplete line read - no new line at end. (retrying next cycle)\n", s->name);
                                 }
                         }
+                        break;
                 }
-final2:
-                FREE(line);
-final1:
-                if (fclose(file)) {
-                        rv = State_Failed;
+                budget += n;
+                // The carried over data has no new line, search only the new data
+                char *line = buffer, *cursor = buffer + length, *end = buffer + length + n;
+                for (char *newline; (newline = memchr(cursor, '\n', end - cursor)); line = cursor = newline + 1) {
+                        *newline = 0;
+                        /* Ignore the content past the Run.limits.fileContentBuffer */
+                        if ((size_t)(newline - line) >= limit)
+                                line[limit - 1] = 0;
+                        _checkMatchLine(s, line);
+                        position += newline + 1 - line + dropped;
+                        dropped = 0;
+                        progress = true;
+                }
+                /* Carry the incomplete line over to the next read, keep only the part which will be tested */
+                length = end - line;
+                if (length >= limit) {
+                        dropped += length - (limit - 1);
+                        length = limit - 1;
+                }
+                memmove(buffer, line, length);
+        }
+        /* Set read position to the end of last complete line */
+        *readpos = position;
+        FREE(buffer);
+        return rv;
+}
+
+
+/**
+ * Close the descriptor of the tailed file
+ */
+static void _tailClose(Service_T s) {
+        if (s->inf.file->tail.open) {
+                if (close(s->inf.file->tail.fd))
                         Log_error("'%s' cannot close file %s: %s\n", s->name, s->path, STRERROR);
+                s->inf.file->tail.open = false;
+        }
+}
+
+
+/**
+ * Test if the content preceding the read position is the same as when the file was read last time. If not, the file was truncated (for example by logrotate
+ * copytruncate) and written again past the old read position.
+ */
+static bool _tailContinues(Service_T s) {
+        int length = s->inf.file->tail.length;
+        if (length) {
+                char signature[sizeof(s->inf.file->tail.signature)];
+                if (pread(s->inf.file->tail.fd, signature, length, s->inf.file->readpos - length) != length || memcmp(signature, s->inf.file->tail.signature, length))
+                        return false;
+        }
+        return true;
+}
+
+
+/**
+ * Save the content preceding the read position for _tailContinues()
+ */
+static void _tailSign(Service_T s) {
+        int length = (int)MIN(s->inf.file->readpos, (off_t)sizeof(s->inf.file->tail.signature));
+        if (length > 0 && pread(s->inf.file->tail.fd, s->inf.file->tail.signature, length, s->inf.file->readpos - length) != length)
+                length = 0;
+        s->inf.file->tail.length = length;
+}
+
+
+/**
+ * Test the rest of the previous file, which was replaced or removed, and close it. The previous file won't be written to anymore, so its last incomplete line is
+ * tested too
+ */
+static bool _tailDrain(Service_T s) {
+        bool rv = _readContent(s, s->inf.file->tail.fd, &(s->inf.file->readpos), true);
+        _tailClose(s);
+        s->inf.file->readpos = 0;
+        return rv;
+}
+
+
+/**
+ * Match content.
+ *
+ * The test compares only the lines terminated with \n.
+ *
+ * In the case that line with missing \n is read, the test stops, as we suppose that the file contains only partial line and the rest of it is yet stored in the buffer of the application which writes to the file.
+ * The test will resume at the beginning of the incomplete line during the next cycle, allowing the writer to finish the write.
+ *
+ * We test only Run.limits.fileContentBuffer at maximum - in the case that the line is bigger, we read the rest of the line (till '\n') but ignore the characters past the maximum
+ *
+ * The file is read in large blocks which are split to lines in the buffer, the incomplete line at the end of the block is carried over to the next read. At most
+ * Run.limits.fileContentBudget bytes are read per cycle, the rest of the file is tested in the next cycle.
+ *
+ * The file is kept open between cycles. If the path refers to a new file (the log was rotated by rename), the rest of the old file is read via the open descriptor
+ * before the test switches to the new file, so the lines written between the last test and the rotation are not lost. If the file was truncated in place (logrotate
+ * copytruncate), the test starts from the beginning of the file, even if the file grew past the old read position meanwhile.
+ */
+static State_Type _checkMatch(Service_T s) {
+        ASSERT(s);
+        State_Type rv = State_Succeeded;
+        if (s->matchlist) {
+                if (! s->contentMatch)
+                        s->contentMatch = ContentMatch_new(s->matchignorelist, s->matchlist);
+                /* FIXME: Refactor: Initialize the filesystems table ahead of file and filesystems test and index it by device id + replace the Str_startsWith() with lookup to the table by device id (obtained via file's stat()).
+                 The central filesystems initialization will allow to reduce the statfs() calls in the case that there will be multiple file and/or filesystems tests for the same fs. Temporarily we go with
+                 dummy Str_startsWith() as quick fix which will cover 99.9% of use cases without rising the statfs overhead if statfs call would be inlined here.
+                 */
+                if (Str_startsWith(s->path, "/proc")) {
+                        int fd = open(s->path, O_RDONLY | O_NOCTTY);
+                        if (fd < 0) {
+                                Log_error("'%s' cannot open file %s: %s\n", s->name, s->path, STRERROR);
+                                return State_Failed;
+                        }
+                        s->inf.file->readpos = 0;
+                        if (! _readContent(s, fd, &(s->inf.file->readpos), false))
+                                rv = State_Failed;
+                        if (close(fd)) {
+                                rv = State_Failed;
+                                Log_error("'%s' cannot close file %s: %s\n", s->name, s->path, STRERROR);
+                        }
+                        goto final1;
                 }
-                /* Post process the matches: generate events for particular patterns */
-                for (Match_T ml = s->matchlist; ml; ml = ml->next) {
-                        if (ml->log) {
-                                rv = State_Changed;
-                                Event_post(s, Event_Content, State_Changed, ml->action, "content match:\n%s", StringBuffer_toString(ml->log));
-                                if (ml->log) {
-                                        // If the service has dependants, the dependant tests if the parent service (file) is running with no errors before it'll be allowed to start. That recursive check_file() call will
-                                        // enter the _checkMatch() too and will free the SringBuffer as part of Event_post => must check ml->log here again before free
-                                        StringBuffer_free(&ml->log);
-                                }
-                        } else {
-                                Event_post(s, Event_Content, State_ChangedNot, ml->action, "content doesn't match");
+                if (s->inf.file->tail.open && s->inf.file->tail.inode != s->inf.file->inode) {
+                        /* The file was rotated: test the rest of the old file and continue with the new one */
+                        DEBUG("'%s' content match: file was replaced, reading the rest of the previous file\n", s->name);
+                        if (! _tailDrain(s))
+                                rv = State_Failed;
+                        s->inf.file->inode_prev = s->inf.file->inode;
+                }
+                if (! s->inf.file->tail.open) {
+                        struct stat buf;
+                        if ((s->inf.file->tail.fd = open(s->path, O_RDONLY | O_NOCTTY | O_CLOEXEC)) < 0) {
+                                Log_error("'%s' cannot open file %s: %s\n", s->name, s->path, STRERROR);
+                                FileEvent_invalidate(s);
+                                return State_Failed;
                         }
+                        s->inf.file->tail.open = true;
+                        s->inf.file->tail.length = 0;
+                        if (fstat(s->inf.file->tail.fd, &buf)) {
+                                Log_error("'%s' cannot stat file %s: %s\n", s->name, s->path, STRERROR);
+                                _tailClose(s);
+                                return State_Failed;
+                        }
+                        s->inf.file->tail.inode = buf.st_ino;
+                        /* If inode changed since the read position was saved -> set read position = 0 */
+                        if (buf.st_ino != s->inf.file->inode_prev)
+                                s->inf.file->readpos = 0;
+                }
+                off_t size = s->inf.file->size;
+                if (s->inf.file->tail.inode != s->inf.file->inode) {
+                        // The file was replaced after the last stat
+                        struct stat buf;
+                        if (fstat(s->inf.file->tail.fd, &buf) == 0)
+                                size = buf.st_size;
+                }
+                /* If size shrunk or the content before the read position changed -> the file was truncated, set read position = 0. The content is checked at the end of
+                   the file too, the file could be truncated and written again up to the same size */
+                if (s->inf.file->readpos > size || ! _tailContinues(s)) {
+                        DEBUG("'%s' content match: file was truncated, reading from the beginning\n", s->name);
+                        s->inf.file->readpos = 0;
+                }
+                /* Do we need to match? Even if not, go to final, so we can reset the content match error flags in this cycle */
+                if (s->inf.file->readpos == size) {
+                        DEBUG("'%s' content match skipped - file size nor inode has not changed since last test\n", s->name);
+                        goto final1;
                 }
+                if (! _readContent(s, s->inf.file->tail.fd, &(s->inf.file->readpos), false))
+                        rv = State_Failed;
+                _tailSign(s);
+final1:
+                rv = _postMatches(s, rv);
         }
         return rv;
 }
@@ -1288,12 +1968,13 @@ static State_Type _checkFilesystemResources(Service_T s, FileSystem_T td) {
 
                 case Resource_ReadBytes:
                         if (Statistics_initialized(&(s->inf.filesystem->read.bytes))) {
-                                double value = Statistics_deltaNormalize(&(s->inf.filesystem->read.bytes));
+                                double value = Statistics_rate(&(s->inf.filesystem->read.bytes), td->statistic.function, td->statistic.percentile);
+                                const char *function = _rateFunction(&(td->statistic), (char[16]){});
                                 if (Util_evalDoubleQExpression(td->operator, value, td->limit_absolute)) {
-                                        Event_post(s, Event_Resource, State_Failed, td->action, "read rate %s/s matches resource limit [read %s %s/s]", Convert_bytes2str(value, (char[10]){}), operatorshortnames[td->operator], Convert_bytes2str(td->limit_absolute, (char[10]){}));
+                                        Event_post(s, Event_Resource, State_Failed, td->action, "read rate %s/s matches resource limit [read%s %s %s/s]", Convert_bytes2str(value, (char[10]){}), function, operatorshortnames[td->operator], Convert_bytes2str(td->limit_absolute, (char[10]){}));
                                         return State_Failed;
                                 }
-                                Event_post(s, Event_Resource, State_Succeeded, td->action, "read rate test succeeded [current read = %s/s]", Convert_bytes2str(value, (char[10]){}));
+                                Event_post(s, Event_Resource, State_Succeeded, td->action, "read rate test succeeded [current read%s = %s/s]", function, Convert_bytes2str(value, (char[10]){}));
                         } else {
                                 DEBUG("'%s' warning -- no data are available for bytes read rate test\n", s->name);
                         }
@@ -1301,12 +1982,13 @@ static State_Type _checkFilesystemResources(Service_T s, FileSystem_T td) {
 
                 case Resource_ReadOperations:
                         if (Statistics_initialized(&(s->inf.filesystem->read.operations))) {
-                                double value = Statistics_deltaNormalize(&(s->inf.filesystem->read.operations));
+                                double value = Statistics_rate(&(s->inf.filesystem->read.operations), td->statistic.function, td->statistic.percentile);
+                                const char *function = _rateFunction(&(td->statistic), (char[16]){});
                                 if (Util_evalDoubleQExpression(td->operator, value, td->limit_absolute)) {
-                                        Event_post(s, Event_Resource, State_Failed, td->action, "read rate %.1f operations/s matches resource limit [read %s %llu operations/s]", value, operatorshortnames[td->operator], td->limit_absolute);
+                                        Event_post(s, Event_Resource, State_Failed, td->action, "read rate %.1f operations/s matches resource limit [read%s %s %llu operations/s]", value, function, operatorshortnames[td->operator], td->limit_absolute);
                                         return State_Failed;
                                 }
-                                Event_post(s, Event_Resource, State_Succeeded, td->action, "read rate test succeeded [current read = %.1f operations/s]", value);
+                                Event_post(s, Event_Resource, State_Succeeded, td->action, "read rate test succeeded [current read%s = %.1f operations/s]", function, value);
                         } else {
                                 DEBUG("'%s' warning -- no data are available for read rate test\n", s->name);
                         }
@@ -1314,12 +1996,13 @@ static State_Type _checkFilesystemResources(Service_T s, FileSystem_T td) {
 
                 case Resource_WriteBytes:
                         if (Statistics_initialized(&(s->inf.filesystem->write.bytes))) {
-                                double value = Statistics_deltaNormalize(&(s->inf.filesystem->write.bytes));
+                                double value = Statistics_rate(&(s->inf.filesystem->write.bytes), td->statistic.function, td->statistic.percentile);
+                                const char *function = _rateFunction(&(td->statistic), (char[16]){});
                                 if (Util_evalDoubleQExpression(td->operator, value, td->limit_absolute)) {
-                                        Event_post(s, Event_Resource, State_Failed, td->action, "write rate %s/s matches resource limit [write %s %s/s]", Convert_bytes2str(value, (char[10]){}), operatorshortnames[td->operator], Convert_bytes2str(td->limit_absolute, (char[10]){}));
+                                        Event_post(s, Event_Resource, State_Failed, td->action, "write rate %s/s matches resource limit [write%s %s %s/s]", Convert_bytes2str(value, (char[10]){}), function, operatorshortnames[td->operator], Convert_bytes2str(td->limit_absolute, (char[10]){}));
                                         return State_Failed;
                                 }
-                                Event_post(s, Event_Resource, State_Succeeded, td->action, "write rate test succeeded [current write = %s/s]", Convert_bytes2str(value, (char[10]){}));
+                                Event_post(s, Event_Resource, State_Succeeded, td->action, "write rate test succeeded [current write%s = %s/s]", function, Convert_bytes2str(value, (char[10]){}));
                         } else {
                                 DEBUG("'%s' warning -- no data are available for bytes write rate test\n", s->name);
                         }
@@ -1327,12 +2010,13 @@ static State_Type _checkFilesystemResources(Service_T s, FileSystem_T td) {
 
                 case Resource_WriteOperations:
                         if (Statistics_initialized(&(s->inf.filesystem->write.operations))) {
-                                double value = Statistics_deltaNormalize(&(s->inf.filesystem->write.operations));
+                                double value = Statistics_rate(&(s->inf.filesystem->write.operations), td->statistic.function, td->statistic.percentile);
+                                const char *function = _rateFunction(&(td->statistic), (char[16]){});
                                 if (Util_evalDoubleQExpression(td->operator, value, td->limit_absolute)) {
-                                        Event_post(s, Event_Resource, State_Failed, td->action, "write rate %.1f operations/s matches resource limit [write %s %llu operations/s]", value, operatorshortnames[td->operator], td->limit_absolute);
+                                        Event_post(s, Event_Resource, State_Failed, td->action, "write rate %.1f operations/s matches resource limit [write%s %s %llu operations/s]", value, function, operatorshortnames[td->operator], td->limit_absolute);
                                         return State_Failed;
                                 }
-                                Event_post(s, Event_Resource, State_Succeeded, td->action, "write rate test succeeded [current write = %.1f operations/s]", value);
+                                Event_post(s, Event_Resource, State_Succeeded, td->action, "write rate test succeeded [current write%s = %.1f operations/s]", function, value);
                         } else {
                                 DEBUG("'%s' warning -- no data are available for write rate test\n", s->name);
                         }
@@ -1372,6 +2056,19 @@ static State_Type _checkFilesystemResources(Service_T s, FileSystem_T td) {
                         }
                         return State_Succeeded;
 
+                case Resource_Utilization:
+                        if (Statistics_initialized(&(s->inf.filesystem->time.io))) {
+                                double value = Statistics_deltaNormalize(&(s->inf.filesystem->time.io)) / 10.; // I/O ms per second -> %
+                                if (Util_evalDoubleQExpression(td->operator, value, td->limit_percent)) {
+                                        Event_post(s, Event_Resource, State_Failed, td->action, "device utilization of %.1f%% matches resource limit [utilization %s %.1f%%]", value, operatorshortnames[td->operator], td->limit_percent);
+                                        return State_Failed;
+                                }
+                                Event_post(s, Event_Resource, State_Succeeded, td->action, "device utilization test succeeded [current utilization = %.1f%%]", value);
+                        } else {
+                                DEBUG("'%s' warning -- no data are available for utilization test\n", s->name);
+                        }
+                        return State_Succeeded;
+
                 default:
                         Log_error("'%s' error -- unknown resource type: [%d]\n", s->name, td->resource);
                         return State_Failed;
@@ -1402,7 +2099,7 @@ static void _checkTimeout(Service_T s) {
 
 static bool _incron(Service_T s, time_t now) {
         if ((now - s->every.last_run) > 59) { // Minute is the lowest resolution, so only run once per minute
-                if (Time_incron(s->every.spec.cron, now)) {
+                if (Time_matchCron(&s->every.spec.cron.spec, now)) {
                         s->every.last_run = now;
                         return true;
                 }
@@ -1433,17 +2130,17 @@ static bool _checkSkip(Service_T s) {
                 s->every.spec.cycle.counter = 0;
         } else if (s->every.type == Every_Cron && ! _incron(s, now)) {
                 s->monitor |= Monitor_Waiting;
-                DEBUG("'%s' test skipped as current time (%lld) does not match every's cron spec \"%s\"\n", s->name, (long long)now, s->every.spec.cron);
+                DEBUG("'%s' test skipped as current time (%lld) does not match every's cron spec \"%s\"\n", s->name, (long long)now, s->every.spec.cron.string);
                 return true;
-        } else if (s->every.type == Every_NotInCron && Time_incron(s->every.spec.cron, now)) {
+        } else if (s->every.type == Every_NotInCron && Time_matchCron(&s->every.spec.cron.spec, now)) {
                 s->monitor |= Monitor_Waiting;
-                DEBUG("'%s' test skipped as current time (%lld) matches every's cron spec \"not %s\"\n", s->name, (long long)now, s->every.spec.cron);
+                DEBUG("'%s' test skipped as current time (%lld) matches every's cron spec \"not %s\"\n", s->name, (long long)now, s->every.spec.cron.string);
                 return true;
         }
         s->monitor &= ~Monitor_Waiting;
         // Skip if parent is not initialized
         for (Dependant_T d = s->dependantlist; d; d = d->next ) {
-                Service_T parent = Util_getService(d->dependant);
+                Service_T parent = d->service;
                 if (parent) {
                         if (parent->monitor != Monitor_Yes) {
                                 DEBUG("'%s' test skipped as required service '%s' is %s\n", s->name, parent->name, parent->monitor == Monitor_Init ? "initializing" : "not monitored");
@@ -1459,34 +2156,649 @@ static bool _checkSkip(Service_T s) {
 
 
 /**
- * Returns true if scheduled action was performed
+ * Returns true if scheduled action was queued, the service is checked when the action finished
  */
 static bool _doScheduledAction(Service_T s) {
-        int rv = false;
         Action_Type action = s->doaction;
-        if (action != Action_Ignored) {
-                rv = control_service(s->name, action);
-                Event_post(s, Event_Action, State_Changed, s->action_ACTION, "%s action %s", actionnames[action], rv ? "done" : "failed");
-                FREE(s->token);
+        if (action != Action_Ignored && ! s->busy) {
+                control_queue(s, action, true);
+                return true;
+        }
+        return false;
+}
+
+
+static inline long long _deadline(int i) {
+        return _schedule.next[_schedule.heap[i]];
+}
+
+
+static void _scheduleSwap(int a, int b) {
+        int p = _schedule.heap[a];
+        _schedule.heap[a] = _schedule.heap[b];
+        _schedule.heap[b] = p;
+}
+
+
+static void _schedulePush(int position) {
+        int i = _schedule.count++;
+        _schedule.heap[i] = position;
+        while (i > 0 && _deadline((i - 1) / 2) > _deadline(i)) {
+                _scheduleSwap(i, (i - 1) / 2);
+                i = (i - 1) / 2;
+        }
+}
+
+
+static int _schedulePop() {
+        int position = _schedule.heap[0];
+        _schedule.heap[0] = _schedule.heap[--_schedule.count];
+        for (int i = 0, child; (child = 2 * i + 1) < _schedule.count; i = child) {
+                if (child + 1 < _schedule.count && _deadline(child + 1) < _deadline(child))
+                        child++;
+                if (_deadline(i) <= _deadline(child))
+                        break;
+                _scheduleSwap(i, child);
+        }
+        return position;
+}
+
+
+static void _freeRateLimit(__attribute__ ((unused)) const void *key, void *value, __attribute__ ((unused)) void *ap) {
+        RateLimit_T r = value;
+        FREE(r);
+}
+
+
+/**
+ * Returns the phase of the service schedule: a deterministic offset within the
+ * jitter window derived from the Monit ID and the service name, so the hosts
+ * which monitor the same target don't check it in lockstep
+ * @param s The service
+ * @param interval The check interval [ms]
+ * @return The phase [ms]
+ */
+static long long _schedulePhase(Service_T s, long long interval) {
+        long long window = interval * Run.jitter / 100;
+        return window > 0 ? (long long)(Util_hash(Run.id, s->name) % (uint64_t)window) : 0;
+}
+
+
+/**
+ * Test the rate limit of the remote host service. If the host was checked at the
+ * rate limit already, the service deadline is moved to the time when the check
+ * fits in the rate
+ * @param position The service position
+ * @return true if the check is deferred, otherwise false
+ */
+static bool _scheduleLimited(int position) {
+        Service_T s = _schedule.service[position];
+        if (! Run.ratelimit || s->type != Service_Host)
+                return false;
+        if (! _ratelimit)
+                _ratelimit = HashMap_new(HashMap_String, 0);
+        RateLimit_T r = HashMap_get(_ratelimit, s->path);
+        if (! r) {
+                size_t length = strlen(s->path) + 1;
+                r = CALLOC(1, sizeof(*r) + length);
+                memcpy(r->host, s->path, length);
+                HashMap_put(_ratelimit, r->host, r);
+        }
+        long long period = MAX(1000 / Run.ratelimit, 1);
+        long long burst = period * (Run.ratelimit - 1);
+        // The checks due within TIMER_SLACK fit in this cycle, as in _scheduleDue()
+        if (r->tat - burst > _schedule.clock + TIMER_SLACK) {
+                s->every.next = _schedule.next[position] = r->tat - burst;
+                DEBUG("'%s' check deferred by %lldms as host %s is at the rate limit\n", s->name, _schedule.next[position] - _schedule.clock, s->path);
+                return true;
+        }
+        r->tat = MAX(r->tat, _schedule.clock) + period;
+        return false;
+}
+
+
+/**
+ * Schedule all services for immediate check. In the daemon mode the remote host
+ * services start at their phase within the jitter window (set jitter), the phase
+ * is kept afterwards as the interval is counted from the check
+ */
+static void _scheduleInit() {
+        int count = 0;
+        for (Service_T s = servicelist; s; s = s->next)
+                count++;
+        if (count > _schedule.size) {
+                _schedule.size = count;
+                RESIZE(_schedule.heap, count * sizeof(int));
+                RESIZE(_schedule.duelist, count * sizeof(int));
+                RESIZE(_schedule.next, count * sizeof(long long));
+                RESIZE(_schedule.isDue, count * sizeof(bool));
+                RESIZE(_schedule.service, count * sizeof(Service_T));
+        }
+        _schedule.services = count;
+        if (_ratelimit) {
+                HashMap_map(_ratelimit, _freeRateLimit, NULL);
+                HashMap_clear(_ratelimit);
+        }
+        long long now = Time_monotonicMilli();
+        int i = 0;
+        for (Service_T s = servicelist; s; s = s->next, i++) {
+                ASSERT(s->position == i);
+                s->every.next = 0;
+                if (Run.jitter && (Run.flags & Run_Daemon) && s->type == Service_Host && s->every.type != Every_Cron)
+                        s->every.next = now + _schedulePhase(s, (s->every.type == Every_Interval ? s->every.spec.interval : Run.polltime) * 1000LL);
+                _schedule.next[i] = s->every.next;
+                _schedule.isDue[i] = false;
+                _schedule.service[i] = s;
+                _schedulePush(i);
+        }
+}
+
+
+/**
+ * Restore the heap order after the deadline of some services was changed, the
+ * changed deadlines are read from the services
+ */
+static void _scheduleRebuild() {
+        int count = _schedule.count;
+        _schedule.count = 0;
+        for (int i = 0; i < count; i++) {
+                int position = _schedule.heap[i];
+                _schedule.next[position] = _schedule.service[position]->every.next;
+                _schedulePush(position);
+        }
+}
+
+
+/**
+ * Move the services which are due to the duelist. The interval services which
+ * become due within TIMER_SLACK are checked in this cycle too, so the services
+ * with close deadlines share one daemon wakeup and stay aligned afterwards. The
+ * cron services are never checked early, as the minute might not match yet. The
+ * remote host services over the rate limit are deferred
+ */
+static void _scheduleDue() {
+        _schedule.due = 0;
+        int early = _schedule.services; // The early cron and the deferred services are set aside at the end of the duelist
+        while (_schedule.count && _deadline(0) <= _schedule.clock + TIMER_SLACK) {
+                int position = _schedulePop();
+                if ((_schedule.next[position] > _schedule.clock && _schedule.service[position]->every.type == Every_Cron) || _scheduleLimited(position)) {
+                        _schedule.duelist[--early] = position;
+                } else {
+                        _schedule.isDue[position] = true;
+                        _schedule.duelist[_schedule.due++] = position;
+                }
+        }
+        while (early < _schedule.services)
+                _schedulePush(_schedule.duelist[early++]);
+}
+
+
+/**
+ * Returns true if the service at the position is visited in this cycle: the services
+ * which are due and, in a cluster, all services as the status of the services owned by
+ * other nodes is refreshed in each cycle
+ */
+static inline bool _scheduleVisit(int position) {
+        return _schedule.isDue[position] || Run.cluster.group;
+}
+
+
+/**
+ * Return true if the service check is deferred due to the cycle overruns
+ */
+static bool _deferred(Service_T s) {
+        if (s->every.type == Every_Cron || s->every.type == Every_NotInCron)
+                return false;
+        return (Run.overrun.level >= 1 && s->priority == Priority_Low) || (Run.overrun.level >= 2 && s->priority == Priority_Normal);
+}
+
+
+/**
+ * Detect the cycle which took longer than the poll time and adapt the deferral level
+ * @param duration The duration of the cycle [ms]
+ */
+static void _checkOverrun(long long duration) {
+        if (duration > Run.polltime * 1000LL) {
+                Run.overrun.count++;
+                Run.overrun.duration = duration;
+                _overrun.intime = 0;
+                if (_overrun.overruns++ == 0)
+                        Log_warning("Monit cycle took %s which is longer than the poll time %ds\n", Convert_time2str(duration, (char[11]){}), Run.polltime);
+                if (_overrun.overruns >= OVERRUN_CYCLES && Run.overrun.level < 2) {
+                        _overrun.overruns = 0;
+                        Run.overrun.level++;
+                        Log_warning("Monit cycles overrun the poll time -- the %s priority services are checked less often\n", Run.overrun.level > 1 ? "low and normal" : "low");
+                }
+        } else {
+                _overrun.overruns = 0;
+                if (Run.overrun.level && ++_overrun.intime >= OVERRUN_CYCLES) {
+                        _overrun.intime = 0;
+                        Run.overrun.level--;
+                        Log_info("Monit cycles are in time again -- %s\n", Run.overrun.level ? "only the low priority services are checked less often" : "all services are checked in their interval");
+                }
+        }
+}
+
+
+/**
+ * Returns the check interval of the service adapted to its state
+ * @param s The service
+ * @return The interval [ms]
+ */
+static long long _scheduleInterval(Service_T s) {
+        long long interval = (s->every.type == Every_Interval ? s->every.spec.interval : Run.polltime) * 1000LL;
+        if (s->every.type != Every_Interval && s->every.type != Every_Cycle)
+                return interval;
+        if (s->every.recheck) {
+                if (Run.recheck)
+                        interval = MIN(interval, Run.recheck * 1000LL);
+        } else if (Run.backoff && s->priority != Priority_High && s->type != Service_Program) {
+                interval *= MIN(1 << MIN(s->every.stable / Run.backoff, 16), BACKOFF_LIMIT);
+        }
+        return interval;
+}
+
+
+/**
+ * Set the next deadline of the services checked in this cycle. The interval is counted from the
+ * end of the check, so the poll cycle keeps the "sleep between checks" semantics
+ */
+static void _scheduleNext() {
+        long long now = Time_monotonicMilli();
+        time_t wall = Time_now();
+        for (int i = 0; i < _schedule.due; i++) {
+                int position = _schedule.duelist[i];
+                Service_T s = _schedule.service[position];
+                s->every.next = now + _scheduleInterval(s);
+                if (_deferred(s))
+                        s->every.next += (s->every.next - now) * (OVERRUN_DEFER - 1);
+                // The cron service sleeps until the next matching minute unless the next cycle matches already. The program check collects the exit status in each cycle
+                if (s->every.type == Every_Cron && s->type != Service_Program && ! Time_matchCron(&s->every.spec.cron.spec, wall + Run.polltime)) {
+                        time_t next = Time_nextCron(&s->every.spec.cron.spec, wall);
+                        if (next > wall)
+                                s->every.next = now + (next - wall) * 1000LL;
+                }
+                _schedule.next[position] = s->every.next;
+                _schedule.isDue[position] = false;
+                _schedulePush(position);
+        }
+        _schedule.due = 0;
+}
+
+
+/**
+ * Ping the remote hosts which are due in this cycle at once, check_remote_host() uses the prepared result
+ */
+static void _pingDue() {
+        int count = 0;
+        Service_T *hosts = CALLOC(_schedule.due ? _schedule.due : 1, sizeof(Service_T));
+        for (int i = 0; i < _schedule.due; i++) {
+                Service_T s = _schedule.service[_schedule.duelist[i]];
+                for (Icmp_T icmp = s->icmplist; icmp; icmp = icmp->next)
+                        icmp->is_prepared = false;
+                if (s->type == Service_Host && s->icmplist && s->monitor != Monitor_Not)
+                        hosts[count++] = s;
+        }
+        if (count > 1)
+                icmp_echo_batch(hosts, count);
+        FREE(hosts);
+}
+
+
+/**
+ * Stat the files, directories and fifos which are due in this cycle at once, the checks use the prepared result.
+ * The batch keeps the parent directories open, so only the file name is resolved for each service
+ */
+static void _statDue() {
+        if (! _statBatch)
+                _statBatch = StatBatch_new(_schedule.due);
+        StatBatch_clear(_statBatch);
+        Service_T *files = CALLOC(_schedule.due ? _schedule.due : 1, sizeof(Service_T));
+        int count = 0;
+        for (int i = 0; i < _schedule.due; i++) {
+                // Only the due services are checked and use the prefetched status
+                Service_T s = _schedule.service[_schedule.duelist[i]];
+                s->prefetch = 0;
+                if ((s->type == Service_File || s->type == Service_Directory || s->type == Service_Fifo) && s->monitor != Monitor_Not && ! FileEvent_current(s))
+                        files[count++] = s;
+        }
+        if (count > 1) {
+                for (int i = 0; i < count; i++)
+                        files[i]->prefetch = StatBatch_add(_statBatch, files[i]->path) + 1;
+                StatBatch_run(_statBatch);
+        }
+        FREE(files);
+}
+
+
+/**
+ * Get the file status from the batch prepared by _statDue() or stat the file
+ * @return 0 on success, otherwise -1 and errno is set
+ */
+static int _stat(Service_T s, struct stat *buf) {
+        if (s->prefetch) {
+                int error = StatBatch_get(_statBatch, s->prefetch - 1, buf);
+                s->prefetch = 0;
+                if (error) {
+                        errno = error;
+                        return -1;
+                }
+                return 0;
+        }
+        return stat(s->path, buf);
+}
+
+
+/**
+ * Response time of the first available port or unix socket [ms]
+ */
+static double _seriesResponseTime(Service_T s) {
+        Port_T lists[] = {s->portlist, s->socketlist};
+        for (int i = 0; i < 2; i++)
+                for (Port_T p = lists[i]; p; p = p->next)
+                        if (p->is_available == Connection_Ok && p->response >= 0.)
+                                return p->response;
+        return NAN;
+}
+
+
+static double _seriesRate(Statistics_T S) {
+        return Statistics_initialized(S) ? Statistics_deltaNormalize(S) : NAN;
+}
+
+
+/**
+ * Add the current metrics of the service to its time series. The series
+ * is allocated when the first sample is available, services without the
+ * supported metrics don't have it
+ */
+static void _updateSeries(Service_T s) {
+        double values[Series_Last] = {NAN, NAN, NAN, NAN, NAN};
+        switch (s->type) {
+                case Service_Process:
+                        if ((Run.flags & Run_ProcessEngineEnabled) && s->inf.process->pid > 0) {
+                                if (s->inf.process->cpu_percent >= 0.)
+                                        values[Series_Cpu] = s->inf.process->cpu_percent;
+                                values[Series_Memory] = s->inf.process->mem;
+                                values[Series_Read] = _seriesRate(&(s->inf.process->read.bytes));
+                                values[Series_Write] = _seriesRate(&(s->inf.process->write.bytes));
+                        }
+                        values[Series_ResponseTime] = _seriesResponseTime(s);
+                        break;
+                case Service_System:
+                        if (systeminfo.cpu.usage.user >= 0.)
+                                values[Series_Cpu] = (systeminfo.cpu.usage.system > 0. ? systeminfo.cpu.usage.system : 0.) + systeminfo.cpu.usage.user;
+                        values[Series_Memory] = systeminfo.memory.usage.bytes;
+                        break;
+                case Service_Filesystem:
+                        values[Series_Read] = _seriesRate(&(s->inf.filesystem->read.bytes));
+                        values[Series_Write] = _seriesRate(&(s->inf.filesystem->write.bytes));
+                        break;
+                case Service_Host:
+                        values[Series_ResponseTime] = _seriesResponseTime(s);
+                        break;
+                default:
+                        return;
+        }
+        if (! s->series)
+                s->series = Series_new();
+        Series_add(s->series, _schedule.now, values);
+}
+
+
+/**
+ * Test the relative change of the metrics over the trend period
+ */
+static State_Type _checkTrend(Service_T s) {
+        State_Type rv = State_Succeeded;
+        for (Trend_T t = s->trendlist; t; t = t->next) {
+                double change;
+                if (! s->series || ! Series_getChange(s->series, t->metric, t->period, &change)) {
+                        DEBUG("'%s' %s trend test skipped -- the history doesn't cover the trend period yet\n", s->name, Series_getName(t->metric));
+                        continue;
+                }
+                char period[11];
+                Convert_time2str(t->period * 1000., period);
+                if (Util_evalDoubleQExpression(t->operator, change, t->limit)) {
+                        rv = State_Failed;
+                        Event_post(s, Event_Resource, State_Failed, t->action, "%s changed by %+.1f%% within %s, matches trend limit [%s growth %s %.1f%%]", Series_getName(t->metric), change, period, Series_getName(t->metric), operatorshortnames[t->operator], t->limit);
+                } else {
+                        Event_post(s, Event_Resource, State_Succeeded, t->action, "%s trend test succeeded [current change within %s = %+.1f%%]", Series_getName(t->metric), period, change);
+                }
         }
         return rv;
 }
 
 
+/**
+ * Run the service check. If the check timeout is set, the check runs with
+ * the time limit and the service is unmonitored after too many consecutive
+ * hung checks
+ * @return false if the check is hung, otherwise true
+ */
+static bool _check(Service_T s, State_Type *state) {
+        if (! Run.limits.checkTimeout) {
+                *state = s->check(s);
+                return true;
+        }
+        if (Watchdog_check(s, state)) {
+                if (s->watchdog.hangs) {
+                        s->watchdog.hangs = 0;
+                        Event_post(s, Event_Timeout, State_Succeeded, s->action_DATA, "check finished in time");
+                }
+                return true;
+        }
+        s->watchdog.hangs++;
+        if (Run.limits.checkQuarantine && s->watchdog.hangs >= (int)Run.limits.checkQuarantine) {
+                Event_post(s, Event_Timeout, State_Failed, s->action_DATA, "check hung %d times in a row -- monitoring disabled", s->watchdog.hangs);
+                // The check may still be running, so only the monitoring flag is cleared, Util_monitorUnset() would reset the service data which the check uses
+                s->monitor = Monitor_Not;
+                State_dirty(s);
+        } else {
+                Event_post(s, Event_Timeout, State_Failed, s->action_DATA, "check didn't finish within %s", Convert_time2str(Run.limits.checkTimeout, (char[11]){}));
+        }
+        return false;
+}
+
+
+/**
+ * Validate the service
+ * @return true if the service check failed, otherwise false
+ */
+static bool _validateService(Service_T s) {
+        bool failed = false;
+        if (s->busy) {
+                DEBUG("'%s' test skipped as the service action is in progress\n", s->name);
+                return false;
+        }
+        long long hung;
+        if (s->watchdog.hangs && Watchdog_isHung(s, &hung)) {
+                // The hung check still owns the service data, so neither the check nor the actions run and the published status is kept until it returns
+                if (_schedule.isDue[s->position] && s->monitor) {
+                        Event_post(s, Event_Timeout, State_Failed, s->action_DATA, "check is hung for %s", Convert_time2str(hung, (char[11]){}));
+                        return true;
+                }
+                return false;
+        }
+        if (! Cluster_isOwner(s)) {
+                // The service is checked by the cluster node which owns it, show the status reported by the owner
+                int error = 0, errorHint = 0;
+                if (s->monitor) {
+                        if (Cluster_getStatus(s, &error, &errorHint))
+                                s->monitor &= ~Monitor_Waiting;
+                        else
+                                s->monitor |= Monitor_Waiting;
+                }
+                s->remote = true;
+                s->error = error;
+                s->error_hint = errorHint;
+                DEBUG("'%s' test skipped as the service is owned by another cluster node\n", s->name);
+                ServiceStatus_publish(s);
+                return false;
+        }
+        if (s->remote) {
+                // The service moved to this node, the local tests set the status again
+                s->remote = false;
+                s->error = s->error_hint = 0;
+        }
+        // FIXME: The Service_Program must collect the exit value from last run, even if the program start should be skipped in this cycle by the cycle or cron based every statement => let check program always run the test and test the skip itself. The interval based schedule is handled by the scheduler
+        if (! _doScheduledAction(s) && _schedule.isDue[s->position] && s->monitor && (s->type == Service_Program || ! _checkSkip(s))) {
+                _checkTimeout(s); // Can disable monitoring => need to check s->monitor again
+                if (s->monitor) {
+                        long long start = Profile_start();
+                        s->every.recheck = false;
+                        PROBE2(check__start, s->name, s->type);
+                        State_Type state;
+                        if (! _check(s, &state))
+                                return true;
+                        PROBE3(check__done, s->name, s->type, state);
+                        Profile_add(&s->profile, start);
+                        s->every.stable = state == State_Failed || s->every.recheck || s->error ? 0 : s->every.stable + 1;
+                        if (state != State_Init && s->monitor != Monitor_Not) // The monitoring can be disabled by some matching rule in s->check so we have to check again before setting to Monitor_Yes
+                                s->monitor = Monitor_Yes;
+                        if (state == State_Failed)
+                                failed = true;
+                        if (state != State_Init) {
+                                _updateSeries(s);
+                                if (_checkTrend(s) == State_Failed)
+                                        failed = true;
+                        }
+                }
+                gettimeofday(&s->collected, NULL);
+        }
+        ServiceStatus_publish(s);
+        return failed;
+}
+
+
+static int _groupOf(int *group, int i) {
+        while (group[i] != i)
+                i = group[i] = group[group[i]];
+        return i;
+}
+
+
+/**
+ * Split the servicelist to groups of services connected by a dependency
+ */
+static void _queueInit() {
+        _queue.count = _queue.groups = _queue.cursor = _queue.errors = 0;
+        for (Service_T s = servicelist; s; s = s->next)
+                _queue.count++;
+        RESIZE(_queue.services, _queue.count * sizeof(Service_T));
+        RESIZE(_queue.head, _queue.count * sizeof(int));
+        RESIZE(_queue.next, _queue.count * sizeof(int));
+        int *group = CALLOC(_queue.count, sizeof(int));
+        int *tail = CALLOC(_queue.count, sizeof(int));
+        int i = 0;
+        for (Service_T s = servicelist; s; s = s->next, i++) {
+                _queue.services[i] = s;
+                group[i] = i;
+                tail[i] = _queue.next[i] = -1;
+        }
+        for (i = 0; i < _queue.count; i++) {
+                for (Dependant_T d = _queue.services[i]->dependantlist; d; d = d->next)
+                        group[_groupOf(group, i)] = _groupOf(group, d->service->position);
+        }
+        for (i = 0; i < _queue.count; i++) {
+                int g = _groupOf(group, i);
+                if (tail[g] == -1)
+                        _queue.head[_queue.groups++] = i;
+                else
+                        _queue.next[tail[g]] = i;
+                tail[g] = i;
+        }
+        FREE(tail);
+        FREE(group);
+}
+
+
+/**
+ * Validation worker thread: validate the service groups from the shared queue until all groups are done
+ */
+static void *_worker(__attribute__ ((unused)) void *args) {
+        set_signal_block();
+        while (! interrupt()) {
+                int g;
+                LOCK(_queue.mutex)
+                {
+                        g = _queue.cursor < _queue.groups ? _queue.head[_queue.cursor++] : -1;
+                }
+                END_LOCK;
+                if (g < 0)
+                        break;
+                int errors = 0;
+                for (int i = g; i >= 0 && ! interrupt(); i = _queue.next[i])
+                        if (_scheduleVisit(i) && _validateService(_queue.services[i]))
+                                errors++;
+                LOCK(_queue.mutex)
+                {
+                        _queue.errors += errors;
+                }
+                END_LOCK;
+        }
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        return NULL;
+}
+
+
+/**
+ * Validate the services in parallel using Run.workers threads
+ */
+static int _validateParallel() {
+        _queueInit();
+        int workers = MIN(Run.workers, _queue.groups);
+        Thread_T *threads = CALLOC(workers, sizeof(Thread_T));
+        for (int i = 0; i < workers; i++)
+                Thread_create(threads[i], _worker, NULL);
+        for (int i = 0; i < workers; i++)
+                Thread_join(threads[i]);
+        FREE(threads);
+        return _queue.errors;
+}
+
+
 /* ---------------------------------------------------------------- Public */
 
 
 /**
  *  This function contains the main check machinery for  monit. The
  *  validate function check services in the service list to see if
- *  they will pass all defined tests.
+ *  they will pass all defined tests. If more workers are configured,
+ *  the independent services are checked in parallel.
  */
 int validate() {
+        long long cycle = Profile_start();
         Run.handler_flag = Handler_Succeeded;
+        // The services of the finished background actions are due now
+        bool finished = control_collect();
+        long long start = Profile_start();
         Event_queue_process();
+        Profile_phase(Profile_EventQueue, start);
 
+        if (! _schedule.count) {
+                _scheduleInit();
+        } else {
+                // The services whose process exited or whose object changed are due now
+                bool exited = ProcessEvent_collect();
+                bool changed = FileEvent_collect();
+                if (exited || changed || finished)
+                        _scheduleRebuild();
+        }
+        _schedule.now = Time_now();
+        _schedule.clock = Time_monotonicMilli();
+        _scheduleDue();
+        if (! _schedule.due && ! (Run.flags & Run_ActionPending))
+                return 0;
+
+        start = Profile_start();
         update_system_info();
+        Profile_phase(Profile_SystemInfo, start);
+        start = Profile_start();
         ProcessTree_init(ProcessEngine_None);
+        Profile_phase(Profile_ProcessTree, start);
         gettimeofday(&systeminfo.collected, NULL);
 
         /* In the case that at least one action is pending, perform quick loop to handle the actions ASAP */
@@ -1496,26 +2808,46 @@ int validate() {
                         _doScheduledAction(s);
         }
 
+        _pingDue();
+        _statDue();
+
         int errors = 0;
-        /* Check the services */
-        for (Service_T s = servicelist; s && ! interrupt(); s = s->next) {
-                // FIXME: The Service_Program must collect the exit value from last run, even if the program start should be skipped in this cycle => let check program always run the test (to be refactored with new scheduler)
-                if (! _doScheduledAction(s) && s->monitor && (s->type == Service_Program || ! _checkSkip(s))) {
-                        _checkTimeout(s); // Can disable monitoring => need to check s->monitor again
-                        if (s->monitor) {
-                                State_Type state = s->check(s);
-                                if (state != State_Init && s->monitor != Monitor_Not) // The monitoring can be disabled by some matching rule in s->check so we have to check again before setting to Monitor_Yes
-                                        s->monitor = Monitor_Yes;
-                                if (state == State_Failed)
-                                        errors++;
-                        }
-                        gettimeofday(&s->collected, NULL);
-                }
-        }
+        start = Profile_start();
+        if (Run.workers > 1 && servicelist) {
+                errors = _validateParallel();
+        } else {
+                /* Check the services, the services which aren't due keep their published status */
+                for (int i = 0; i < _schedule.services && ! interrupt(); i++)
+                        if (_scheduleVisit(i) && _validateService(_schedule.service[i]))
+                                errors++;
+        }
+        Profile_phase(Profile_Checks, start);
+        if (Run.flags & Run_Daemon)
+                _checkOverrun((Profile_start() - cycle) / 1000);
+        _scheduleNext();
+        Profile_phase(Profile_Cycle, cycle);
         return errors;
 }
 
 
+/**
+ * Get the deadline of the next scheduled service check
+ * @return The deadline of the first service in the schedule, in milliseconds of the monotonic clock
+ */
+long long validate_next() {
+        return _schedule.count ? _deadline(0) : Time_monotonicMilli() + Run.polltime * 1000LL;
+}
+
+
+/**
+ * Reset the schedule, all services will be checked in the next cycle.
+ * Must be called if the servicelist is changed
+ */
+void validate_reset() {
+        _schedule.count = _schedule.due = 0;
+}
+
+
 /**
  * Validate a given process service s. Events are posted according to
  * its configuration. In case of a fatal event false is returned.
@@ -1579,6 +2911,8 @@ State_Type check_process(Service_T s) {
                                 rv = State_Failed;
         }
         long long uptimeMilli = (long long)(s->inf.process->uptime) * 1000LL;
+        if (! s->start || uptimeMilli > s->start->timeout)
+                Socket_connectPorts(s->portlist);
         for (Port_T pp = s->portlist; pp; pp = pp->next) {
                 //FIXME: instead of pause, try to test, but ignore any errors in the start timeout timeframe ... will allow to display the port response time as soon as available, instead of waiting for 30+ seconds
                 /* pause port tests in the start timeout timeframe while the process is starting (it may take some time to the process before it starts accepting connections) */
@@ -1601,6 +2935,8 @@ State_Type check_process(Service_T s) {
                         DEBUG("'%s' connection test paused for %s while the process is starting\n", s->name, Convert_time2str(s->start->timeout - (uptimeMilli < 0 ? 0 : uptimeMilli), (char[11]){}));
                 }
         }
+        if (_checkLatency(s) == State_Failed)
+                rv = State_Failed;
         return rv;
 }
 
@@ -1613,6 +2949,16 @@ State_Type check_filesystem(Service_T s) {
         ASSERT(s);
         State_Type rv = State_Succeeded;
         if (! filesystem_usage(s)) {
+                unsigned long long hung, age;
+                if (filesystem_hung(s, &hung, &age)) {
+                        // The statistics collection is hanging (e.g. unresponsive NFS server), we don't know whether the filesystem exists => report the data failure only
+                        if (age)
+                                Event_post(s, Event_Data, State_Failed, s->action_DATA, "filesystem statistics collection timed out -- hanging for %s, last statistics are %s old", Convert_time2str(hung, (char[11]){}), Convert_time2str(age, (char[11]){}));
+                        else
+                                Event_post(s, Event_Data, State_Failed, s->action_DATA, "filesystem statistics collection timed out -- hanging for %s", Convert_time2str(hung, (char[11]){}));
+                        return State_Failed;
+                }
+                Event_post(s, Event_Data, State_Succeeded, s->action_DATA, "filesystem statistics collection succeeded");
                 for (NonExist_T l = s->nonexistlist; l; l = l->next) {
                         rv = State_Failed;
                         Event_post(s, Event_NonExist, State_Failed, l->action, "unable to read filesystem '%s' state", s->path);
@@ -1622,6 +2968,7 @@ State_Type check_filesystem(Service_T s) {
                 }
                 return rv;
         }
+        Event_post(s, Event_Data, State_Succeeded, s->action_DATA, "filesystem statistics collection succeeded");
         for (NonExist_T l = s->nonexistlist; l; l = l->next) {
                 Event_post(s, Event_NonExist, State_Succeeded, l->action, "succeeded getting filesystem statistics for '%s'", s->path);
         }
@@ -1652,7 +2999,16 @@ State_Type check_file(Service_T s) {
         ASSERT(s);
         struct stat stat_buf;
         State_Type rv = State_Succeeded;
-        if (stat(s->path, &stat_buf) != 0) {
+        if (FileEvent_unchanged(s)) {
+                DEBUG("'%s' file didn't change since the last cycle -- using the last stat data\n", s->name);
+                s->inf.file->inode_prev = s->inf.file->inode;
+        } else if (_stat(s, &stat_buf) != 0) {
+                FileEvent_invalidate(s);
+                if (s->inf.file->tail.open) {
+                        // The file was removed or renamed, test the rest of it and close it, so the descriptor doesn't keep the removed file allocated
+                        DEBUG("'%s' content match: file was removed, reading the rest of the previous file\n", s->name);
+                        _postMatches(s, _tailDrain(s) ? State_Succeeded : State_Failed);
+                }
                 for (NonExist_T l = s->nonexistlist; l; l = l->next) {
                         rv = State_Failed;
                         Event_post(s, Event_NonExist, State_Failed, l->action, "file doesn't exist");
@@ -1678,13 +3034,14 @@ State_Type check_file(Service_T s) {
                 s->inf.file->timestamp.access = stat_buf.st_atime;
                 s->inf.file->timestamp.change = stat_buf.st_ctime;
                 s->inf.file->timestamp.modify = stat_buf.st_mtime;
-                for (NonExist_T l = s->nonexistlist; l; l = l->next) {
-                        Event_post(s, Event_NonExist, State_Succeeded, l->action, "file exists");
-                }
-                for (Exist_T l = s->existlist; l; l = l->next) {
-                        rv = State_Failed;
-                        Event_post(s, Event_Exist, State_Failed, l->action, "file exists");
-                }
+                _fingerprint(&stat_buf, &(s->inf.file->fingerprint));
+        }
+        for (NonExist_T l = s->nonexistlist; l; l = l->next) {
+                Event_post(s, Event_NonExist, State_Succeeded, l->action, "file exists");
+        }
+        for (Exist_T l = s->existlist; l; l = l->next) {
+                rv = State_Failed;
+                Event_post(s, Event_Exist, State_Failed, l->action, "file exists");
         }
         if (! S_ISREG(s->inf.file->mode) && ! S_ISSOCK(s->inf.file->mode)) {
                 Event_post(s, Event_Invalid, State_Failed, s->action_INVALID, "is neither a regular file nor a socket");
@@ -1703,7 +3060,9 @@ State_Type check_file(Service_T s) {
                 rv = State_Failed;
         if (_checkSize(s, s->inf.file->size) == State_Failed)
                 rv = State_Failed;
-        if (_checkTimestamps(s, s->inf.file->timestamp.access, s->inf.file->timestamp.change, s->inf.file->timestamp.modify) == State_Failed)
+        if (_checkCertificate(s) == State_Failed)
+                rv = State_Failed;
+        if (_checkTimestamps(s, s->inf.file->timestamp.access, s->inf.file->timestamp.change, s->inf.file->timestamp.modify, 0, 0) == State_Failed)
                 rv = State_Failed;
         if (_checkMatch(s) == State_Failed)
                 rv = State_Failed;
@@ -1719,7 +3078,10 @@ State_Type check_directory(Service_T s) {
         ASSERT(s);
         struct stat stat_buf;
         State_Type rv = State_Succeeded;
-        if (stat(s->path, &stat_buf) != 0) {
+        if (FileEvent_unchanged(s)) {
+                DEBUG("'%s' directory didn't change since the last cycle -- using the last stat data\n", s->name);
+        } else if (_stat(s, &stat_buf) != 0) {
+                FileEvent_invalidate(s);
                 for (NonExist_T l = s->nonexistlist; l; l = l->next) {
                         rv = State_Failed;
                         Event_post(s, Event_NonExist, State_Failed, l->action, "directory doesn't exist");
@@ -1735,13 +3097,13 @@ State_Type check_directory(Service_T s) {
                 s->inf.directory->timestamp.access = stat_buf.st_atime;
                 s->inf.directory->timestamp.change = stat_buf.st_ctime;
                 s->inf.directory->timestamp.modify = stat_buf.st_mtime;
-                for (NonExist_T l = s->nonexistlist; l; l = l->next) {
-                        Event_post(s, Event_NonExist, State_Succeeded, l->action, "directory exists");
-                }
-                for (Exist_T l = s->existlist; l; l = l->next) {
-                        rv = State_Failed;
-                        Event_post(s, Event_Exist, State_Failed, l->action, "directory exists");
-                }
+        }
+        for (NonExist_T l = s->nonexistlist; l; l = l->next) {
+                Event_post(s, Event_NonExist, State_Succeeded, l->action, "directory exists");
+        }
+        for (Exist_T l = s->existlist; l; l = l->next) {
+                rv = State_Failed;
+                Event_post(s, Event_Exist, State_Failed, l->action, "directory exists");
         }
         if (! S_ISDIR(s->inf.directory->mode)) {
                 Event_post(s, Event_Invalid, State_Failed, s->action_INVALID, "is not directory");
@@ -1755,7 +3117,20 @@ State_Type check_directory(Service_T s) {
                 rv = State_Failed;
         if (_checkGid(s, s->inf.directory->gid) == State_Failed)
                 rv = State_Failed;
-        if (_checkTimestamps(s, s->inf.directory->timestamp.access, s->inf.directory->timestamp.change, s->inf.directory->timestamp.modify) == State_Failed)
+        time_t oldest = 0, newest = 0;
+        if (DirectoryTree_isNeeded(s)) {
+                if (DirectoryTree_update(s)) {
+                        oldest = s->inf.directory->tree.oldest;
+                        newest = s->inf.directory->tree.newest;
+                        if (_checkSize(s, (off_t)s->inf.directory->tree.size) == State_Failed)
+                                rv = State_Failed;
+                        if (_checkFileCount(s, s->inf.directory->tree.files) == State_Failed)
+                                rv = State_Failed;
+                } else {
+                        rv = State_Failed;
+                }
+        }
+        if (_checkTimestamps(s, s->inf.directory->timestamp.access, s->inf.directory->timestamp.change, s->inf.directory->timestamp.modify, oldest, newest) == State_Failed)
                 rv = State_Failed;
         return rv;
 }
@@ -1769,7 +3144,10 @@ State_Type check_fifo(Service_T s) {
         ASSERT(s);
         struct stat stat_buf;
         State_Type rv = State_Succeeded;
-        if (stat(s->path, &stat_buf) != 0) {
+        if (FileEvent_unchanged(s)) {
+                DEBUG("'%s' fifo didn't change since the last cycle -- using the last stat data\n", s->name);
+        } else if (_stat(s, &stat_buf) != 0) {
+                FileEvent_invalidate(s);
                 for (NonExist_T l = s->nonexistlist; l; l = l->next) {
                         rv = State_Failed;
                         Event_post(s, Event_NonExist, State_Failed, l->action, "fifo doesn't exist");
@@ -1785,13 +3163,13 @@ State_Type check_fifo(Service_T s) {
                 s->inf.fifo->timestamp.access = stat_buf.st_atime;
                 s->inf.fifo->timestamp.change = stat_buf.st_ctime;
                 s->inf.fifo->timestamp.modify = stat_buf.st_mtime;
-                for (NonExist_T l = s->nonexistlist; l; l = l->next) {
-                        Event_post(s, Event_NonExist, State_Succeeded, l->action, "fifo exists");
-                }
-                for (Exist_T l = s->existlist; l; l = l->next) {
-                        rv = State_Failed;
-                        Event_post(s, Event_Exist, State_Failed, l->action, "fifo exists");
-                }
+        }
+        for (NonExist_T l = s->nonexistlist; l; l = l->next) {
+                Event_post(s, Event_NonExist, State_Succeeded, l->action, "fifo exists");
+        }
+        for (Exist_T l = s->existlist; l; l = l->next) {
+                rv = State_Failed;
+                Event_post(s, Event_Exist, State_Failed, l->action, "fifo exists");
         }
         if (! S_ISFIFO(s->inf.fifo->mode)) {
                 Event_post(s, Event_Invalid, State_Failed, s->action_INVALID, "is not fifo");
@@ -1805,12 +3183,162 @@ State_Type check_fifo(Service_T s) {
                 rv = State_Failed;
         if (_checkGid(s, s->inf.fifo->gid) == State_Failed)
                 rv = State_Failed;
-        if (_checkTimestamps(s, s->inf.fifo->timestamp.access, s->inf.fifo->timestamp.change, s->inf.fifo->timestamp.modify) == State_Failed)
+        if (_checkTimestamps(s, s->inf.fifo->timestamp.access, s->inf.fifo->timestamp.change, s->inf.fifo->timestamp.modify, 0, 0) == State_Failed)
                 rv = State_Failed;
         return rv;
 }
 
 
+/**
+ * Evaluate the program exit status and the output of the finished program instance against the status tests
+ */
+static State_Type _programStatus(Service_T s, State_Type rv) {
+        StringBuffer_trim(s->program->inprogressOutput);
+        // Swap program output (instance finished)
+        StringBuffer_clear(s->program->lastOutput);
+        StringBuffer_append(s->program->lastOutput, "%s", StringBuffer_toString(s->program->inprogressOutput));
+        // Evaluate program's exit status against our status checks.
+        const char *output = StringBuffer_length(s->program->inprogressOutput) ? StringBuffer_toString(s->program->inprogressOutput) : "no output";
+        for (Status_T status = s->statuslist; status; status = status->next) {
+                if (status->operator == Operator_Changed) {
+                        if (status->initialized) {
+                                if (Util_evalQExpression(status->operator, s->program->exitStatus, status->return_value)) {
+                                        Event_post(s, Event_Status, State_Changed, status->action, "status changed (%d -> %d) -- %s", status->return_value, s->program->exitStatus, output);
+                                        status->return_value = s->program->exitStatus;
+                                } else {
+                                        Event_post(s, Event_Status, State_ChangedNot, status->action, "status didn't change (%d) -- %s", s->program->exitStatus, output);
+                                }
+                        } else {
+                                status->initialized = true;
+                                status->return_value = s->program->exitStatus;
+                        }
+                } else {
+                        if (Util_evalQExpression(status->operator, s->program->exitStatus, status->return_value)) {
+                                rv = State_Failed;
+                                Event_post(s, Event_Status, State_Failed, status->action, "status failed (%d) -- %s", s->program->exitStatus, output);
+                        } else {
+                                Event_post(s, Event_Status, State_Succeeded, status->action, "status succeeded (%d) -- %s", s->program->exitStatus, output);
+                        }
+                }
+        }
+        return rv;
+}
+
+
+/**
+ * Read the worker response "<exit status> <output length>\n<output>" into the program output
+ * @return 1 if the response is complete, 0 if more data is expected, -1 if the response is invalid
+ */
+static int _programWorkerResponse(Program_T p) {
+        int n;
+        char buf[STRLEN];
+        InputStream_T I = Process_getInputStream(p->P);
+        InputStream_setTimeout(I, 0);
+        while ((n = InputStream_readBytes(I, buf, sizeof(buf) - 1)) > 0) {
+                buf[n] = 0;
+                StringBuffer_append(p->inprogressOutput, "%s", buf);
+                if (StringBuffer_length(p->inprogressOutput) > Run.limits.programOutput + 32)
+                        return -1;
+        }
+        const char *response = StringBuffer_toString(p->inprogressOutput);
+        const char *eol = strchr(response, '\n');
+        if (! eol)
+                return StringBuffer_length(p->inprogressOutput) > 32 ? -1 : 0;
+        int status, length;
+        if (sscanf(response, "%d %d", &status, &length) != 2 || length < 0 || length > Run.limits.programOutput)
+                return -1;
+        if (StringBuffer_length(p->inprogressOutput) < (eol - response) + 1 + length)
+                return 0;
+        char *output = Str_ndup(eol + 1, length);
+        StringBuffer_clear(p->inprogressOutput);
+        StringBuffer_append(p->inprogressOutput, "%s", output);
+        FREE(output);
+        p->exitStatus = status;
+        return 1;
+}
+
+
+/**
+ * Validate a program status using the persistent worker. The request is sent to the worker's stdin
+ * and the response is collected in the next cycle, the same way as the exit status of the program.
+ * The worker is restarted if it exits, times out or breaks the protocol
+ */
+static State_Type _checkProgramWorker(Service_T s) {
+        Program_T p = s->program;
+        State_Type rv = State_Succeeded;
+        time_t now = Time_now();
+        if (p->P) {
+                // The worker's stderr is not part of the response, drain it so the worker doesn't block
+                StringBuffer_T err = StringBuffer_create(64);
+                _programOutput(Process_getErrorStream(p->P), err);
+                if (StringBuffer_length(err))
+                        DEBUG("'%s' program worker: %s\n", s->name, StringBuffer_toString(StringBuffer_trim(err)));
+                StringBuffer_free(&err);
+        }
+        if (p->pending) {
+                const char *error = NULL;
+                int response = p->P ? _programWorkerResponse(p) : -1;
+                if (response < 0) {
+                        error = "invalid response";
+                } else if (response == 0) {
+                        long long execution_time = (now - p->started) * 1000;
+                        if (Process_exitStatus(p->P) >= 0) {
+                                error = "worker exited";
+                        } else if (execution_time > p->timeout) {
+                                Log_error("'%s' program timed out after %s. Killing program worker with pid %ld\n", s->name, Convert_time2str(execution_time, (char[11]){}), (long)Process_getPid(p->P));
+                                error = "worker timed out";
+                        } else {
+                                DEBUG("'%s' status check deferred - waiting on program worker response\n", s->name);
+                                return State_Init;
+                        }
+                }
+                p->pending = false;
+                if (error) {
+                        rv = State_Failed;
+                        p->exitStatus = -1;
+                        StringBuffer_clear(p->inprogressOutput);
+                        StringBuffer_append(p->inprogressOutput, "program %s", error);
+                        Process_free(&p->P);
+                }
+                rv = _programStatus(s, rv);
+        } else {
+                rv = State_Init;
+        }
+        if (s->monitor != Monitor_Not && ! _checkSkip(s)) {
+                if (p->P && Process_exitStatus(p->P) >= 0) {
+                        DEBUG("'%s' program worker exited with status %d\n", s->name, Process_exitStatus(p->P));
+                        Process_free(&p->P);
+                }
+                if (! p->P) {
+                        if (! (p->P = Command_execute(p->C))) {
+                                Event_post(s, Event_Status, State_Failed, s->action_EXEC, "failed to execute '%s' -- %s", s->path, STRERROR);
+                                return State_Failed;
+                        }
+                        DEBUG("'%s' program worker started with pid %ld\n", s->name, (long)Process_getPid(p->P));
+                }
+                StringBuffer_clear(p->inprogressOutput);
+                OutputStream_T O = Process_getOutputStream(p->P);
+                if (OutputStream_print(O, "CHECK %s\n", s->name) < 0 || OutputStream_flush(O) < 0) {
+                        Event_post(s, Event_Status, State_Failed, s->action_EXEC, "failed to send the request to the program worker '%s' -- %s", s->path, STRERROR);
+                        Process_free(&p->P);
+                        return State_Failed;
+                }
+                Event_post(s, Event_Status, State_Succeeded, s->action_EXEC, "program started");
+                p->pending = true;
+                p->started = now;
+        }
+        return rv;
+}
+
+
+/**
+ * Test the program output line against the content match patterns. Called by the program output capture thread
+ */
+static void _programLine(void *context, const char *line) {
+        _checkMatchLine((Service_T)context, line);
+}
+
+
 /**
  * Validate a program status. Events are posted according to
  * its configuration. In case of a fatal event false is returned.
@@ -1818,13 +3346,13 @@ State_Type check_fifo(Service_T s) {
 State_Type check_program(Service_T s) {
         ASSERT(s);
         ASSERT(s->program);
+        if (s->program->worker)
+                return _checkProgramWorker(s);
         State_Type rv = State_Succeeded;
         time_t now = Time_now();
         Process_T P = s->program->P;
         if (P) {
-                // Process program output
-                _programOutput(Process_getErrorStream(P), s->program->inprogressOutput);
-                _programOutput(Process_getInputStream(P), s->program->inprogressOutput);
+                // The program output is drained by the capture thread while the program runs
                 // Is the program still running?
                 if (Process_exitStatus(P) < 0) {
                         long long execution_time = (now - s->program->started) * 1000;
@@ -1841,34 +3369,12 @@ State_Type check_program(Service_T s) {
                         }
                 }
                 s->program->exitStatus = Process_exitStatus(P); // Save exit status for web-view display
-                StringBuffer_trim(s->program->inprogressOutput);
-                // Swap program output (instance finished)
-                StringBuffer_clear(s->program->lastOutput);
-                StringBuffer_append(s->program->lastOutput, "%s", StringBuffer_toString(s->program->inprogressOutput));
-                // Evaluate program's exit status against our status checks.
-                const char *output = StringBuffer_length(s->program->inprogressOutput) ? StringBuffer_toString(s->program->inprogressOutput) : "no output";
-                for (Status_T status = s->statuslist; status; status = status->next) {
-                        if (status->operator == Operator_Changed) {
-                                if (status->initialized) {
-                                        if (Util_evalQExpression(status->operator, s->program->exitStatus, status->return_value)) {
-                                                Event_post(s, Event_Status, State_Changed, status->action, "status changed (%d -> %d) -- %s", status->return_value, s->program->exitStatus, output);
-                                                status->return_value = s->program->exitStatus;
-                                        } else {
-                                                Event_post(s, Event_Status, State_ChangedNot, status->action, "status didn't change (%d) -- %s", s->program->exitStatus, output);
-                                        }
-                                } else {
-                                        status->initialized = true;
-                                        status->return_value = s->program->exitStatus;
-                                }
-                        } else {
-                                if (Util_evalQExpression(status->operator, s->program->exitStatus, status->return_value)) {
-                                        rv = State_Failed;
-                                        Event_post(s, Event_Status, State_Failed, status->action, "status failed (%d) -- %s", s->program->exitStatus, output);
-                                } else {
-                                        Event_post(s, Event_Status, State_Succeeded, status->action, "status succeeded (%d) -- %s", s->program->exitStatus, output);
-                                }
-                        }
-                }
+                ProgramOutput_unwatch(s->program->output);
+                StringBuffer_clear(s->program->inprogressOutput);
+                ProgramOutput_get(s->program->output, s->program->inprogressOutput);
+                rv = _programStatus(s, rv);
+                if (s->matchlist && _postMatches(s, State_Succeeded) == State_Changed && rv != State_Failed)
+                        rv = State_Changed;
                 Process_free(&s->program->P);
         } else {
                 rv = State_Init;
@@ -1884,6 +3390,15 @@ State_Type check_program(Service_T s) {
                 } else {
                         Event_post(s, Event_Status, State_Succeeded, s->action_EXEC, "program started");
                         s->program->started = now;
+                        if (! s->program->output)
+                                s->program->output = ProgramOutput_new(Run.limits.programOutput, Run.limits.fileContentBuffer);
+                        if (s->matchlist) {
+                                if (! s->contentMatch)
+                                        s->contentMatch = ContentMatch_new(s->matchignorelist, s->matchlist);
+                                ProgramOutput_watch(s->program->output, s->program->P, _programLine, s);
+                        } else {
+                                ProgramOutput_watch(s->program->output, s->program->P, NULL, NULL);
+                        }
                 }
         }
         return rv;
@@ -1903,7 +3418,14 @@ State_Type check_remote_host(Service_T s) {
         for (Icmp_T icmp = s->icmplist; icmp; icmp = icmp->next) {
                 switch (icmp->type) {
                         case ICMP_ECHO:
-                                icmp->response = icmp_echo(s->path, icmp->family, &(icmp->outgoing), icmp->size, icmp->timeout, icmp->count);
+                                if (icmp->is_prepared) {
+                                        // The host was pinged by the batch pinger at the start of the cycle
+                                        icmp->is_prepared = false;
+                                } else {
+                                        icmp->response = icmp_echo(s->path, icmp->family, &(icmp->outgoing), icmp->size, icmp->timeout, icmp->count);
+                                        icmp->statistics.min = icmp->statistics.max = icmp->response;
+                                        icmp->statistics.loss = icmp->response >= 0. ? 0. : 100.;
+                                }
                                 if (icmp->response == -2) {
                                         icmp->is_available = Connection_Init;
 #ifdef SOLARIS
@@ -1917,7 +3439,7 @@ State_Type check_remote_host(Service_T s) {
                                         Event_post(s, Event_Icmp, State_Failed, icmp->action, "ping test failed");
                                 } else {
                                         icmp->is_available = Connection_Ok;
-                                        Event_post(s, Event_Icmp, State_Succeeded, icmp->action, "ping test succeeded [response time %s]", Convert_time2str(icmp->response, (char[11]){}));
+                                        Event_post(s, Event_Icmp, State_Succeeded, icmp->action, "ping test succeeded [response time %s, packet loss %.0f%%]", Convert_time2str(icmp->response, (char[11]){}), icmp->statistics.loss);
                                 }
                                 last_ping = icmp;
                                 break;
@@ -1931,10 +3453,13 @@ State_Type check_remote_host(Service_T s) {
                 DEBUG("'%s' icmp ping failed, skipping any port connection tests\n", s->name);
                 return State_Failed;
         }
-        /* Test each host:port and protocol in the service's portlist */
+        /* Test each host:port and protocol in the service's portlist, the connections are made in parallel */
+        Socket_connectPorts(s->portlist);
         for (Port_T p = s->portlist; p; p = p->next)
                 if (_checkConnection(s, p) == State_Failed)
                         rv = State_Failed;
+        if (_checkLatency(s) == State_Failed)
+                rv = State_Failed;
         return rv;
 }
 